@@ -36,6 +36,7 @@
 #include <iomanip>
 #include <fstream>
 #include <algorithm>
+#include <deque>
 #include <list>
 #include <map>
 #include <time.h>
@@ -74,6 +75,8 @@
 #define   LOGGER_CONSOLE    3
 #define   LOGGER_DUMP       4
 
+#define LOG_ASYNC_MAX_QUEUED_SIZE (64 * 1024 * 1024) // text waiting for the writer thread above which messages past level 0 are dropped
+
 
 #ifndef LOCAL_ASSERT
 #include <assert.h>
@@ -751,6 +754,28 @@ namespace log_space
     }
     ~logger()
     {
+      set_async(false);
+    }
+
+    //with async set, messages are queued for a writer thread instead of being written by the
+    //threads logging them; unsetting it writes what is left and stops the thread
+    bool set_async(bool async)
+    {
+      boost::unique_lock<boost::mutex> lock(m_queue_lock);
+      if(async == m_async)
+        return true;
+      if(async)
+      {
+        m_async = true;
+        m_stop_writer = false;
+        m_writer = boost::thread(&logger::write_queued, this);
+        return true;
+      }
+      m_stop_writer = true;
+      m_queue_cond.notify_one();
+      lock.unlock();
+      m_writer.join();
+      return true;
     }
 
     bool set_max_logfile_size(uint64_t max_size)
@@ -771,7 +796,7 @@ namespace log_space
 
     bool take_away_journal(std::list<std::string>& journal)
     {
-      CRITICAL_REGION_BEGIN(m_critical_sec);
+      CRITICAL_REGION_BEGIN(m_journal_lock);
       m_journal.swap(journal);
       CRITICAL_REGION_END();
       return true;
@@ -779,13 +804,33 @@ namespace log_space
 
     bool do_log_message(const std::string& rlog_mes, int log_level, int color, bool add_to_journal = false, const char* plog_name = NULL)
     {
-      CRITICAL_REGION_BEGIN(m_critical_sec);
-      m_log_target.do_log_message(rlog_mes, log_level, color, plog_name);
       if(add_to_journal)
+      {
+        CRITICAL_REGION_LOCAL(m_journal_lock);
         m_journal.push_back(rlog_mes);
+      }
+
+      {
+        boost::unique_lock<boost::mutex> lock(m_queue_lock);
+        if(m_async)
+        {
+          if(m_queued_size > LOG_ASYNC_MAX_QUEUED_SIZE && log_level > LOG_LEVEL_0)
+          {
+            ++m_dropped;
+            return false;
+          }
+          m_queue.push_back(queued_message{rlog_mes, plog_name ? plog_name : "", log_level, color, plog_name != NULL});
+          m_queued_size += rlog_mes.size();
+          //the writer only waits on an empty queue
+          if(m_queue.size() == 1)
+            m_queue_cond.notify_one();
+          return true;
+        }
+      }
 
+      CRITICAL_REGION_LOCAL(m_critical_sec);
+      m_log_target.do_log_message(rlog_mes, log_level, color, plog_name);
       return true;
-      CRITICAL_REGION_END();
     }
 
     bool add_logger( int type, const char* pdefault_file_name, const char* pdefault_log_folder , int log_level_limit = LOG_LEVEL_4)
@@ -811,7 +856,7 @@ namespace log_space
 
     bool set_thread_prefix(const std::string& prefix)
     {
-      CRITICAL_REGION_BEGIN(m_critical_sec);
+      CRITICAL_REGION_BEGIN(m_thr_prefix_lock);
       m_thr_prefix_strings[misc_utils::get_thread_string_id()] = prefix;
       CRITICAL_REGION_END();
       return true;
@@ -853,6 +898,43 @@ namespace log_space
       return true;
     }
 
+    void write_queued()
+    {
+      std::deque<queued_message> batch;
+      boost::unique_lock<boost::mutex> lock(m_queue_lock);
+      while(true)
+      {
+        while(m_queue.empty() && !m_stop_writer)
+          m_queue_cond.wait(lock);
+        if(m_queue.empty())
+        {
+          //from now on the logging threads write themselves
+          m_async = false;
+          return;
+        }
+        batch.swap(m_queue);
+        const size_t dropped = m_dropped;
+        m_queued_size = 0;
+        m_dropped = 0;
+        lock.unlock();
+
+        {
+          CRITICAL_REGION_LOCAL(m_critical_sec);
+          if(dropped)
+          {
+            std::stringstream ss;
+            ss << get_time_string() << " Logging fell behind, " << dropped << " messages dropped" << std::endl;
+            m_log_target.do_log_message(ss.str(), LOG_LEVEL_0, console_color_yellow);
+          }
+          for(const queued_message& m: batch)
+            m_log_target.do_log_message(m.text, m.log_level, m.color, m.has_log_name ? m.log_name.c_str() : NULL);
+        }
+        batch.clear();
+
+        lock.lock();
+      }
+    }
+
     bool init_log_path_by_default()
     {
       //load process name
@@ -874,8 +956,27 @@ namespace log_space
     std::string m_default_log_file;
     std::string m_process_name;
     std::map<std::string, std::string> m_thr_prefix_strings;
+    critical_section m_thr_prefix_lock;
     std::list<std::string> m_journal;
-    critical_section m_critical_sec;
+    critical_section m_journal_lock;
+    critical_section m_critical_sec; //streams, held by whoever writes to them
+
+    struct queued_message
+    {
+      std::string text;
+      std::string log_name;
+      int log_level;
+      int color;
+      bool has_log_name;
+    };
+    boost::mutex m_queue_lock;
+    boost::condition_variable m_queue_cond;
+    std::deque<queued_message> m_queue;
+    size_t m_queued_size = 0;
+    size_t m_dropped = 0;
+    bool m_async = false;
+    bool m_stop_writer = false;
+    boost::thread m_writer;
   };
   /************************************************************************/
   /*                                                                      */
@@ -914,6 +1015,13 @@ namespace log_space
       return res;
     }
 
+    static bool set_async(bool async)
+    {
+      logger* plogger = get_or_create_instance();
+      if(!plogger) return false;
+      return plogger->set_async(async);
+    }
+
     static bool take_away_journal(std::list<std::string>& journal)
     {
       logger* plogger = get_or_create_instance();
@@ -1116,7 +1224,7 @@ POP_WARNINGS
 
       if(plogger->m_thr_prefix_strings.size())
       {
-        CRITICAL_REGION_LOCAL(plogger->m_critical_sec);
+        CRITICAL_REGION_LOCAL(plogger->m_thr_prefix_lock);
         std::string thr_str = misc_utils::get_thread_string_id();
         std::map<std::string, std::string>::iterator it = plogger->m_thr_prefix_strings.find(thr_str);
         if(it!=plogger->m_thr_prefix_strings.end())
@@ -1214,7 +1322,7 @@ POP_WARNINGS
     const char*           m_plog_name;
   public:
 
-    log_frame(const std::string& name,  int dlevel = LOG_LEVEL_2 , const char* plog_name = NULL)
+    log_frame(const char* name,  int dlevel = LOG_LEVEL_2 , const char* plog_name = NULL)
     {
 #ifdef _MSC_VER
       int lasterr=::GetLastError();
@@ -78,6 +78,34 @@ namespace misc_utils
 #endif
         }
 
+        inline uint64_t get_ns_count()
+        {
+#if defined(WIN32)
+                static LARGE_INTEGER pcfreq = {0};
+                LARGE_INTEGER ticks;
+                if (!pcfreq.QuadPart)
+                    QueryPerformanceFrequency(&pcfreq);
+                QueryPerformanceCounter(&ticks);
+                /* split to keep the scaling from overflowing */
+                return (ticks.QuadPart / pcfreq.QuadPart) * 1000000000 + (ticks.QuadPart % pcfreq.QuadPart) * 1000000000 / pcfreq.QuadPart;
+#elif defined(__MACH__)
+                clock_serv_t cclock;
+                mach_timespec_t mts;
+
+                host_get_clock_service(mach_host_self(), SYSTEM_CLOCK, &cclock);
+                clock_get_time(cclock, &mts);
+                mach_port_deallocate(mach_task_self(), cclock);
+
+                return ((uint64_t)mts.tv_sec * 1000000000) + mts.tv_nsec;
+#else
+                struct timespec ts;
+                if(clock_gettime(CLOCK_MONOTONIC, &ts) != 0) {
+                        return 0;
+                }
+                return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+#endif
+        }
+
 
         inline int call_sys_cmd(const std::string& cmd)
 	{      
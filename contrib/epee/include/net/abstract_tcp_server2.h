@@ -59,6 +59,10 @@
 #include "../../../../src/p2p/network_throttle-detail.hpp"
 
 #define ABSTRACT_SERVER_SEND_QUE_MAX_COUNT 1000
+#define ABSTRACT_SERVER_SEND_QUE_WAIT_MS 5000 // how long a sender waits for a full queue to drain
+#define ABSTRACT_SERVER_SEND_GATHER_MAX_COUNT 64 // queue entries written by one async_write
+#define ABSTRACT_SERVER_SEND_GATHER_MAX_BYTES (256 * 1024)
+#define ABSTRACT_SERVER_READ_PAUSE_MS 100 // recheck interval for reads paused over the memory budget
 
 namespace epee
 {
@@ -112,11 +116,17 @@ namespace net_utils
 		bool speed_limit_is_enabled() const; ///< tells us should we be sleeping here (e.g. do not sleep on RPC connections)
 
     bool cancel();
+
+    /// Close the connection once it has waited this long for the next request
+    /// with nothing left to send; 0 (the default) keeps idle connections open.
+    void set_idle_timeout(uint64_t timeout_ms){m_idle_timeout_ms = timeout_ms;}
     
   private:
     //----------------- i_service_endpoint ---------------------
     virtual bool do_send(const void* ptr, size_t cb); ///< (see do_send from i_service_endpoint)
+    virtual bool do_send(const void* head, size_t head_cb, const shared_buffer& body, traffic_class cls); ///< queues body by reference, split into chunks like do_send
     virtual bool do_send_chunk(const void* ptr, size_t cb); ///< will send (or queue) a part of data
+    virtual bool wait_send_que(size_t max_bytes, uint64_t timeout_ms); ///< (see wait_send_que from i_service_endpoint)
     virtual bool close();
     virtual bool call_run_once_service_io();
     virtual bool request_callback();
@@ -125,7 +135,12 @@ namespace net_utils
     virtual bool release();
     //------------------------------------------------------
     boost::shared_ptr<connection<t_protocol_handler> > safe_shared_from_this();
+    bool queue_send(send_que_entry&& entry); ///< throttles, then queues (or starts writing) one chunk
+    void start_write(const boost::shared_ptr<connection<t_protocol_handler> >& self); ///< gathers queued entries into one write
     bool shutdown();
+    /// Start the next read, or postpone it while over the memory budget.
+    void start_read();
+
     /// Handle completion of a read operation.
     void handle_read(const boost::system::error_code& e,
       std::size_t bytes_transferred);
@@ -133,6 +148,9 @@ namespace net_utils
     /// Handle completion of a write operation.
     void handle_write(const boost::system::error_code& e, size_t cb);
 
+    /// Close the connection if it is still idle when the idle timer fires.
+    void handle_idle_timeout(const boost::system::error_code& e);
+
     /// Buffer for incoming data.
     boost::array<char, 8192> buffer_;
     //boost::array<char, 1024> buffer_;
@@ -149,6 +167,9 @@ namespace net_utils
     critical_section m_chunking_lock; // held while we add small chunks of the big do_send() to small do_send_chunk()
     
     t_connection_type m_connection_type;
+
+    uint64_t m_idle_timeout_ms;
+    boost::asio::deadline_timer m_idle_timer; // armed while a read waits for the peer
     
     // for calculate speed (last 60 sec)
     network_throttle m_throttle_speed_in;
@@ -203,6 +224,16 @@ namespace net_utils
 
     void set_connection_filter(i_connection_filter* pfilter);
 
+    /// Give every connection its own io_service shard, each run by one thread,
+    /// instead of sharing io_service_. The acceptor, idle handlers and async
+    /// calls stay on io_service_. Must be called before init_server; 0 disables.
+    void set_io_service_shards(size_t shards_count);
+
+    size_t get_io_service_shards_count(){return m_shards.size();}
+
+    /// Close accepted connections idle for longer than this (see connection::set_idle_timeout).
+    void set_connection_idle_timeout(uint64_t timeout_ms){m_connection_idle_timeout_ms = timeout_ms;}
+
     bool connect(const std::string& adr, const std::string& port, uint32_t conn_timeot, t_connection_context& cn, const std::string& bind_ip = "0.0.0.0");
     template<class t_callback>
     bool connect_async(const std::string& adr, const std::string& port, uint32_t conn_timeot, t_callback cb, const std::string& bind_ip = "0.0.0.0");
@@ -274,6 +305,12 @@ namespace net_utils
   private:
     /// Run the server's io_service loop.
     bool worker_thread();
+    /// Run one io_service shard's loop.
+    bool shard_worker_thread(size_t index);
+    /// Pick the io_service for a new connection, round-robin over the shards.
+    boost::asio::io_service& get_shard_io_service(bool exclude_current_thread = false);
+    bool is_shard_thread(size_t index);
+    bool is_multithreaded_connection(){return 1 < m_threads_count || !m_shards.empty();}
     /// Handle completion of an asynchronous accept operation.
     void handle_accept(const boost::system::error_code& e);
 
@@ -285,6 +322,12 @@ namespace net_utils
     std::unique_ptr<boost::asio::io_service> m_io_service_local_instance;
     boost::asio::io_service& io_service_;    
 
+    /// Per-thread io_services, declared before anything holding sockets on them.
+    std::vector<std::unique_ptr<boost::asio::io_service> > m_shards;
+    std::vector<std::unique_ptr<boost::asio::io_service::work> > m_shards_work;
+    std::vector<boost::shared_ptr<boost::thread> > m_shard_threads;
+    std::atomic<size_t> m_next_shard;
+
     /// Acceptor used to listen for incoming connections.
     boost::asio::ip::tcp::acceptor acceptor_;
 
@@ -302,6 +345,7 @@ namespace net_utils
     volatile uint32_t m_thread_index; // TODO change to std::atomic
 
     t_connection_type m_connection_type;
+    std::atomic<uint64_t> m_connection_idle_timeout_ms;
 
     /// The next connection to be accepted
     connection_ptr new_connection_;
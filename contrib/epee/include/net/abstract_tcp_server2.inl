@@ -80,6 +80,8 @@ PRAGMA_WARNING_DISABLE_VS(4355)
 		m_protocol_handler(this, config, context),
 		m_pfilter( pfilter ),
 		m_connection_type( connection_type ),
+		m_idle_timeout_ms(0),
+		m_idle_timer(io_service),
 		m_throttle_speed_in("speed_in", "throttle_speed_in"),
 		m_throttle_speed_out("speed_out", "throttle_speed_out")
   {
@@ -95,6 +97,7 @@ PRAGMA_WARNING_DISABLE_VS(4355)
       _dbg3("[sock " << socket_.native_handle() << "] Socket destroyed without shutdown.");
       shutdown();
     }
+    connections_memory::usage() -= context.m_send_que_bytes;
 
     _dbg3("[sock " << socket_.native_handle() << "] Socket destroyed");
   }
@@ -160,11 +163,7 @@ PRAGMA_WARNING_DISABLE_VS(4355)
 
     m_protocol_handler.after_init_connection();
 
-    socket_.async_read_some(boost::asio::buffer(buffer_),
-      strand_.wrap(
-        boost::bind(&connection<t_protocol_handler>::handle_read, self,
-          boost::asio::placeholders::error,
-          boost::asio::placeholders::bytes_transferred)));
+    start_read();
 #if !defined(_WIN32) || !defined(__i686)
 	// not supported before Windows7, too lazy for runtime check
 	// Just exclude for 32bit windows builds
@@ -273,11 +272,64 @@ PRAGMA_WARNING_DISABLE_VS(4355)
   }
   //---------------------------------------------------------------------------------
   template<class t_protocol_handler>
+  void connection<t_protocol_handler>::start_read()
+  {
+    if (m_was_shutdown)
+      return;
+    auto self = connection<t_protocol_handler>::shared_from_this();
+    if (speed_limit_is_enabled())
+    {
+      // over the download limit: delay the next read instead of sleeping on the network thread
+      const double wait = traffic_shaper::get_global_in().get_delay(traffic_class_peerlist);
+      if (wait > 0)
+      {
+        boost::shared_ptr<boost::asio::deadline_timer> timer(new boost::asio::deadline_timer(socket_.get_io_service()));
+        timer->expires_from_now(boost::posix_time::microseconds((int64_t)(wait * 1000000)));
+        timer->async_wait(strand_.wrap([self, timer](const boost::system::error_code& ec)
+        {
+          if (!ec)
+            self->start_read();
+        }));
+        return;
+      }
+    }
+    if (connections_memory::over_total_limit() || connections_memory::over_connection_limit(context))
+    {
+      // over memory budget: stop reading this peer (so it can't make us buffer more) and look again later
+      _dbg2("[sock " << socket_.native_handle() << "] reads paused, connection memory " << context.m_send_que_bytes + context.m_recv_buffer_bytes
+        << " B, all connections " << connections_memory::usage() << " B");
+      boost::shared_ptr<boost::asio::deadline_timer> timer(new boost::asio::deadline_timer(socket_.get_io_service()));
+      timer->expires_from_now(boost::posix_time::milliseconds(ABSTRACT_SERVER_READ_PAUSE_MS));
+      timer->async_wait(strand_.wrap([self, timer](const boost::system::error_code& ec)
+      {
+        if (!ec)
+          self->start_read();
+      }));
+      return;
+    }
+    if (m_idle_timeout_ms)
+    {
+      m_idle_timer.expires_from_now(boost::posix_time::milliseconds(m_idle_timeout_ms));
+      m_idle_timer.async_wait(strand_.wrap(
+        boost::bind(&connection<t_protocol_handler>::handle_idle_timeout, self,
+          boost::asio::placeholders::error)));
+    }
+    socket_.async_read_some(boost::asio::buffer(buffer_),
+      strand_.wrap(
+        boost::bind(&connection<t_protocol_handler>::handle_read, self,
+          boost::asio::placeholders::error,
+          boost::asio::placeholders::bytes_transferred)));
+  }
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
   void connection<t_protocol_handler>::handle_read(const boost::system::error_code& e,
     std::size_t bytes_transferred)
   {
     TRY_ENTRY();
     //_info("[sock " << socket_.native_handle() << "] Async read calledback.");
+
+    if (m_idle_timeout_ms)
+      m_idle_timer.expires_at(boost::posix_time::pos_infin); // disarm until the next read
     
     if (!e)
     {
@@ -292,25 +344,8 @@ PRAGMA_WARNING_DISABLE_VS(4355)
 			epee::net_utils::network_throttle_manager::network_throttle_manager::get_global_throttle_in().handle_trafic_exact(bytes_transferred * 1024);
 		}
 
-		double delay=0; // will be calculated - how much we should sleep to obey speed limit etc
-
-
-		if (speed_limit_is_enabled()) {
-			do // keep sleeping if we should sleep
-			{
-				{ //_scope_dbg1("CRITICAL_REGION_LOCAL");
-					CRITICAL_REGION_LOCAL(	epee::net_utils::network_throttle_manager::m_lock_get_global_throttle_in );
-					delay = epee::net_utils::network_throttle_manager::get_global_throttle_in().get_sleep_time_after_tick( bytes_transferred ); // decission from global throttle
-				}
-				
-				delay *= 0.5;
-				if (delay > 0) {
-					long int ms = (long int)(delay * 100);
-					epee::net_utils::data_logger::get_instance().add_data("sleep_down", ms);
-					boost::this_thread::sleep_for(boost::chrono::milliseconds(ms));
-				}
-			} while(delay > 0);
-		} // any form of sleeping
+		if (speed_limit_is_enabled())
+			traffic_shaper::get_global_in().consume(bytes_transferred); // start_read() holds the next read back while over the limit
 		
       //_info("[sock " << socket_.native_handle() << "] RECV " << bytes_transferred);
       logger_handle_net_read(bytes_transferred);
@@ -332,11 +367,7 @@ PRAGMA_WARNING_DISABLE_VS(4355)
           shutdown();
       }else
       {
-        socket_.async_read_some(boost::asio::buffer(buffer_),
-          strand_.wrap(
-            boost::bind(&connection<t_protocol_handler>::handle_read, connection<t_protocol_handler>::shared_from_this(),
-              boost::asio::placeholders::error,
-              boost::asio::placeholders::bytes_transferred)));
+        start_read();
         //_info("[sock " << socket_.native_handle() << "]Async read requested.");
       }
     }else
@@ -356,6 +387,36 @@ PRAGMA_WARNING_DISABLE_VS(4355)
   }
   //---------------------------------------------------------------------------------
   template<class t_protocol_handler>
+  void connection<t_protocol_handler>::handle_idle_timeout(const boost::system::error_code& e)
+  {
+    TRY_ENTRY();
+    if (e == boost::asio::error::operation_aborted || m_was_shutdown)
+      return;
+    // handle_read may have disarmed the timer after this wait already completed
+    if (m_idle_timer.expires_at() > boost::asio::deadline_timer::traits_type::now())
+      return;
+    bool sending = false;
+    CRITICAL_REGION_BEGIN(m_send_que_lock);
+    sending = !m_send_que.empty();
+    CRITICAL_REGION_END();
+    if (sending)
+    {
+      // the peer is still taking our last response, give it another period
+      auto self = safe_shared_from_this();
+      if (!self)
+        return;
+      m_idle_timer.expires_from_now(boost::posix_time::milliseconds(m_idle_timeout_ms));
+      m_idle_timer.async_wait(strand_.wrap(
+        boost::bind(&connection<t_protocol_handler>::handle_idle_timeout, self,
+          boost::asio::placeholders::error)));
+      return;
+    }
+    _dbg2("[sock " << socket_.native_handle() << "] idle for " << m_idle_timeout_ms << " ms, closing");
+    shutdown();
+    CATCH_ENTRY_L0("connection<t_protocol_handler>::handle_idle_timeout", void());
+  }
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
   bool connection<t_protocol_handler>::call_run_once_service_io()
   {
     TRY_ENTRY();
@@ -463,9 +524,65 @@ PRAGMA_WARNING_DISABLE_VS(4355)
     CATCH_ENTRY_L0("connection<t_protocol_handler>::do_send", false);
 	} // do_send()
 
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
+  bool connection<t_protocol_handler>::do_send(const void* head, size_t head_cb, const shared_buffer& body, traffic_class cls) {
+    TRY_ENTRY();
+    auto self = safe_shared_from_this();
+    if (!self) return false;
+    if (m_was_shutdown) return false;
+    CHECK_AND_ASSERT_MES(body, false, "do_send() called with empty shared buffer");
+
+    // same chunking as do_send(ptr, cb), but chunks reference the shared body instead of copying it
+    const size_t chunksize_good = 1024 * 32;
+    const size_t chunksize_max = chunksize_good * 2;
+    const bool allow_split = (m_connection_type == e_connection_type_RPC) ? false : true;
+
+    send_que_entry first;
+    first.m_data.assign((const char*)head, head_cb);
+    first.m_shared = body;
+    first.m_class = cls;
+    if (!allow_split || head_cb + body->size() <= chunksize_max)
+    {
+      first.m_shared_size = body->size();
+      return queue_send(std::move(first));
+    }
+
+    epee::critical_region_t<decltype(m_chunking_lock)> send_guard(m_chunking_lock);
+    _dbg3_c("net/out/size", "do_send() will SPLIT shared buffer into small chunks, from packet=" << head_cb + body->size() << " B");
+    first.m_shared_size = chunksize_good > head_cb ? std::min(chunksize_good - head_cb, body->size()) : 0;
+    size_t pos = first.m_shared_size;
+    if (!queue_send(std::move(first)))
+      return false;
+    while (pos < body->size())
+    {
+      send_que_entry chunk;
+      chunk.m_shared = body;
+      chunk.m_class = cls;
+      chunk.m_shared_offset = pos;
+      chunk.m_shared_size = std::min(chunksize_good, body->size() - pos);
+      pos += chunk.m_shared_size;
+      if (!queue_send(std::move(chunk)))
+      {
+        _dbg1("do_send() SEND was aborted in middle of big shared package - this is mostly harmless (e.g. peer closed connection)");
+        return false;
+      }
+    }
+    return true;
+
+    CATCH_ENTRY_L0("connection<t_protocol_handler>::do_send", false);
+  }
   //---------------------------------------------------------------------------------
   template<class t_protocol_handler>
   bool connection<t_protocol_handler>::do_send_chunk(const void* ptr, size_t cb)
+  {
+    send_que_entry entry;
+    entry.m_data.assign((const char*)ptr, cb);
+    return queue_send(std::move(entry));
+  }
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
+  bool connection<t_protocol_handler>::queue_send(send_que_entry&& entry)
   {
     TRY_ENTRY();
     // Use safe_shared_from_this, because of this is public method and it can be called on the object being deleted
@@ -474,6 +591,12 @@ PRAGMA_WARNING_DISABLE_VS(4355)
       return false;
     if(m_was_shutdown)
       return false;
+    const size_t cb = entry.size();
+    if (connections_memory::over_total_limit(cb))
+    {
+      _dbg1("[sock " << socket_.native_handle() << "] refusing to queue " << cb << " B, all connections already hold " << connections_memory::usage() << " B");
+      return false;
+    }
     {
 		CRITICAL_REGION_LOCAL(m_throttle_speed_out_mutex);
 		m_throttle_speed_out.handle_trafic_exact(cb);
@@ -485,82 +608,125 @@ PRAGMA_WARNING_DISABLE_VS(4355)
     context.m_send_cnt += cb;
     //some data should be wrote to stream
     //request complete
-    
-		if (speed_limit_is_enabled()) {
-			sleep_before_packet(cb, 1, 1);
-		}
 
     m_send_que_lock.lock(); // *** critical ***
     epee::misc_utils::auto_scope_leave_caller scope_exit_handler = epee::misc_utils::create_scope_leave_handler([&](){m_send_que_lock.unlock();});
 
-    long int retry=0;
-    const long int retry_limit = 5*4;
-    while (m_send_que.size() > ABSTRACT_SERVER_SEND_QUE_MAX_COUNT)
+    // backpressure: wait for handle_write to drain the queue instead of polling it
+    // (a single entry may exceed the byte budget, otherwise nothing could be sent when it's set low)
+    auto que_full = [&]() { return m_send_que.size() > ABSTRACT_SERVER_SEND_QUE_MAX_COUNT
+      || (!m_send_que.empty() && connections_memory::over_connection_limit(context, cb)); };
+    if (que_full())
     {
-        retry++;
-
-        /* if ( ::cryptonote::core::get_is_stopping() ) { // TODO re-add fast stop
-            _fact("ABORT queue wait due to stopping");
-            return false; // aborted
-        }*/
-
-        long int ms = 250 + (rand()%50);
-        _info_c("net/sleep", "Sleeping because QUEUE is FULL, in " << __FUNCTION__ << " for " << ms << " ms before packet_size="<<cb); // XXX debug sleep
-        m_send_que_lock.unlock();
-        boost::this_thread::sleep(boost::posix_time::milliseconds( ms ) );
-        m_send_que_lock.lock();
-        _dbg1("sleep for queue: " << ms);
-
-        if (retry > retry_limit) {
-            _erro("send que size is more than ABSTRACT_SERVER_SEND_QUE_MAX_COUNT(" << ABSTRACT_SERVER_SEND_QUE_MAX_COUNT << "), shutting down connection");
-            //	_dbg1_c("net/sleep", "send que size is more than ABSTRACT_SERVER_SEND_QUE_MAX_COUNT(" << ABSTRACT_SERVER_SEND_QUE_MAX_COUNT << "), shutting down connection");
-            shutdown();
-            return false;
-        }
+      _info_c("net/sleep", "Waiting because QUEUE is FULL, in " << __FUNCTION__ << " before packet_size="<<cb);
+      const boost::system_time deadline = boost::get_system_time() + boost::posix_time::milliseconds(ABSTRACT_SERVER_SEND_QUE_WAIT_MS);
+      while (que_full() && !m_was_shutdown)
+      {
+        if (!m_send_que_cond.timed_wait(m_send_que_lock, deadline))
+          break;
+      }
+      if (m_was_shutdown)
+        return false;
+      if (que_full())
+      {
+        _erro("send que holds " << m_send_que.size() << " entries, " << context.m_send_que_bytes << " B, over ABSTRACT_SERVER_SEND_QUE_MAX_COUNT(" << ABSTRACT_SERVER_SEND_QUE_MAX_COUNT << ") or the connection memory limit, shutting down connection");
+        shutdown();
+        return false;
+      }
     }
 
-    m_send_que.resize(m_send_que.size()+1);
-    m_send_que.back().assign((const char*)ptr, cb);
+    m_send_que.push_back(std::move(entry));
+    context.m_send_que_bytes += cb;
+    connections_memory::usage() += cb;
     
-    if(m_send_que.size() > 1)
-    { // active operation should be in progress, nothing to do, just wait last operation callback
-        auto size_now = cb;
-        _info_c("net/out/size", "do_send() NOW just queues: packet="<<size_now<<" B, is added to queue-size="<<m_send_que.size());
-        //do_send_handler_delayed( ptr , size_now ); // (((H))) // empty function
-      
-      LOG_PRINT_L4("[sock " << socket_.native_handle() << "] Async send requested " << m_send_que.front().size());
+    if(m_send_que_in_flight || m_write_scheduled)
+    { // active (or shaped, scheduled) operation should be in progress, nothing to do, just wait last operation callback
+        _info_c("net/out/size", "do_send() NOW just queues: packet="<<cb<<" B, is added to queue-size="<<m_send_que.size());
     }
     else
     { // no active operation
-
         if(m_send_que.size()!=1)
         {
             _erro("Looks like no active operations, but send que size != 1!!");
             return false;
         }
 
-        auto size_now = m_send_que.front().size();
-        _dbg1_c("net/out/size", "do_send() NOW SENSD: packet="<<size_now<<" B");
-        if (speed_limit_is_enabled())
-			do_send_handler_write( ptr , size_now ); // (((H)))
-
-        ASRT( size_now == m_send_que.front().size() );
-        boost::asio::async_write(socket_, boost::asio::buffer(m_send_que.front().data(), size_now ) ,
-                                 //strand_.wrap(
-                                 boost::bind(&connection<t_protocol_handler>::handle_write, self, _1, _2)
-                                 //)
-                                 );
-        //_dbg3("(chunk): " << size_now);
-        //logger_handle_net_write(size_now);
-        //_info("[sock " << socket_.native_handle() << "] Async send requested " << m_send_que.front().size());
+        _dbg1_c("net/out/size", "do_send() NOW SENSD: packet="<<cb<<" B");
+        start_write(self);
     }
     
     //do_send_handler_stop( ptr , cb ); // empty function
 
     return true;
 
-    CATCH_ENTRY_L0("connection<t_protocol_handler>::do_send", false);
-  } // do_send_chunk
+    CATCH_ENTRY_L0("connection<t_protocol_handler>::queue_send", false);
+  } // queue_send
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
+  bool connection<t_protocol_handler>::wait_send_que(size_t max_bytes, uint64_t timeout_ms)
+  {
+    TRY_ENTRY();
+    auto self = safe_shared_from_this();
+    if(!self)
+      return false;
+    m_send_que_lock.lock();
+    epee::misc_utils::auto_scope_leave_caller scope_exit_handler = epee::misc_utils::create_scope_leave_handler([&](){m_send_que_lock.unlock();});
+    const boost::system_time deadline = boost::get_system_time() + boost::posix_time::milliseconds(timeout_ms);
+    while (context.m_send_que_bytes > max_bytes && !m_was_shutdown)
+    {
+      if (!m_send_que_cond.timed_wait(m_send_que_lock, deadline))
+        break;
+    }
+    return !m_was_shutdown && context.m_send_que_bytes <= max_bytes;
+    CATCH_ENTRY_L0("connection<t_protocol_handler>::wait_send_que", false);
+  }
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
+  void connection<t_protocol_handler>::start_write(const boost::shared_ptr<connection<t_protocol_handler> >& self)
+  {
+    // m_send_que_lock is held: gather queued entries of one traffic class into one async_write, up to the count/byte caps
+    std::vector<boost::asio::const_buffer> buffers;
+    size_t bytes = 0;
+    size_t count = 0;
+    const traffic_class cls = m_send_que.front().m_class;
+    for (const send_que_entry& entry: m_send_que)
+    {
+      if (count && (count >= ABSTRACT_SERVER_SEND_GATHER_MAX_COUNT || bytes + entry.size() > ABSTRACT_SERVER_SEND_GATHER_MAX_BYTES || entry.m_class != cls))
+        break;
+      const boost::array<boost::asio::const_buffer, 2> b = entry.buffers();
+      buffers.insert(buffers.end(), b.begin(), b.end());
+      bytes += entry.size();
+      ++count;
+    }
+
+    if (speed_limit_is_enabled())
+    {
+      // over the upload limit for this class: come back when the shaper has room, without blocking this thread
+      const double wait = traffic_shaper::get_global_out().reserve(cls, bytes);
+      if (wait > 0)
+      {
+        _info_c("net/sleep", "[sock " << socket_.native_handle() << "] upload shaped, " << bytes << " B of class " << cls << " wait " << wait << " s");
+        m_write_scheduled = true;
+        boost::shared_ptr<boost::asio::deadline_timer> timer(new boost::asio::deadline_timer(socket_.get_io_service()));
+        timer->expires_from_now(boost::posix_time::microseconds((int64_t)(wait * 1000000)));
+        timer->async_wait([self, timer](const boost::system::error_code& ec)
+        {
+          CRITICAL_REGION_LOCAL(self->m_send_que_lock);
+          self->m_write_scheduled = false;
+          if (self->m_was_shutdown || self->m_send_que.empty() || self->m_send_que_in_flight)
+            return;
+          self->start_write(self);
+        });
+        return;
+      }
+      do_send_handler_write(NULL, bytes); // (((H)))
+    }
+
+    m_send_que_in_flight = count;
+    LOG_PRINT_L4("[sock " << socket_.native_handle() << "] Async send requested " << bytes << " B in " << count << " buffers");
+    boost::asio::async_write(socket_, buffers,
+      boost::bind(&connection<t_protocol_handler>::handle_write, self, _1, _2));
+  }
   //---------------------------------------------------------------------------------
   template<class t_protocol_handler>
   bool connection<t_protocol_handler>::shutdown()
@@ -569,6 +735,8 @@ PRAGMA_WARNING_DISABLE_VS(4355)
     boost::system::error_code ignored_ec;
     socket_.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignored_ec);
     m_was_shutdown = true;
+    m_idle_timer.cancel(ignored_ec);
+    m_send_que_cond.notify_all();
     m_protocol_handler.release_protocol();
     return true;
   }
@@ -612,19 +780,22 @@ PRAGMA_WARNING_DISABLE_VS(4355)
     }
     logger_handle_net_write(cb);
 
-		if (speed_limit_is_enabled()) {
-			sleep_before_packet(cb, 1, 1);
-		}
-
     bool do_shutdown = false;
     CRITICAL_REGION_BEGIN(m_send_que_lock);
-    if(m_send_que.empty())
+    if(m_send_que.size() < m_send_que_in_flight || !m_send_que_in_flight)
     {
-      _erro("[sock " << socket_.native_handle() << "] m_send_que.size() == 0 at handle_write!");
+      _erro("[sock " << socket_.native_handle() << "] m_send_que.size() == " << m_send_que.size() << " with " << m_send_que_in_flight << " in flight at handle_write!");
       return;
     }
 
-    m_send_que.pop_front();
+    for (size_t n = 0; n < m_send_que_in_flight; ++n)
+    {
+      context.m_send_que_bytes -= m_send_que.front().size();
+      connections_memory::usage() -= m_send_que.front().size();
+      m_send_que.pop_front();
+    }
+    m_send_que_in_flight = 0;
+    m_send_que_cond.notify_all();
     if(m_send_que.empty())
     {
       if(boost::interprocess::ipcdetail::atomic_read32(&m_want_close_connection))
@@ -634,17 +805,8 @@ PRAGMA_WARNING_DISABLE_VS(4355)
     }else
     {
       //have more data to send
-		auto size_now = m_send_que.front().size();
-		_dbg1_c("net/out/size", "handle_write() NOW SENDS: packet="<<size_now<<" B" <<", from  queue size="<<m_send_que.size());
-		if (speed_limit_is_enabled())
-			do_send_handler_write_from_queue(e, m_send_que.front().size() , m_send_que.size()); // (((H)))
-		ASRT( size_now == m_send_que.front().size() );
-		boost::asio::async_write(socket_, boost::asio::buffer(m_send_que.front().data(), size_now) , 
-        // strand_.wrap(
-          boost::bind(&connection<t_protocol_handler>::handle_write, connection<t_protocol_handler>::shared_from_this(), _1, _2)
-				// )
-        );
-      //_dbg3("(normal)" << size_now);
+		_dbg1_c("net/out/size", "handle_write() NOW SENDS from queue size="<<m_send_que.size());
+		start_write(connection<t_protocol_handler>::shared_from_this());
     }
     CRITICAL_REGION_END();
 
@@ -678,11 +840,13 @@ PRAGMA_WARNING_DISABLE_VS(4355)
   boosted_tcp_server<t_protocol_handler>::boosted_tcp_server( t_connection_type connection_type ) :
     m_io_service_local_instance(new boost::asio::io_service()),
     io_service_(*m_io_service_local_instance.get()),
+    m_next_shard(0),
     acceptor_(io_service_),
     m_stop_signal_sent(false), m_port(0), 
 	m_sock_count(0), m_sock_number(0), m_threads_count(0), 
 	m_pfilter(NULL), m_thread_index(0),
 		m_connection_type( connection_type ),
+    m_connection_idle_timeout_ms(0),
     new_connection_()
   {
     create_server_type_map();
@@ -692,11 +856,13 @@ PRAGMA_WARNING_DISABLE_VS(4355)
   template<class t_protocol_handler>
   boosted_tcp_server<t_protocol_handler>::boosted_tcp_server(boost::asio::io_service& extarnal_io_service, t_connection_type connection_type) :
     io_service_(extarnal_io_service),
+    m_next_shard(0),
     acceptor_(io_service_),
     m_stop_signal_sent(false), m_port(0), 
 		m_sock_count(0), m_sock_number(0), m_threads_count(0), 
 		m_pfilter(NULL), m_thread_index(0),
 		m_connection_type(connection_type),
+    m_connection_idle_timeout_ms(0),
     new_connection_()
   {
     create_server_type_map();
@@ -736,7 +902,7 @@ PRAGMA_WARNING_DISABLE_VS(4355)
     boost::asio::ip::tcp::endpoint binded_endpoint = acceptor_.local_endpoint();
     m_port = binded_endpoint.port();
     _fact_c("net/RPClog", "start accept");
-    new_connection_.reset(new connection<t_protocol_handler>(io_service_, m_config, m_sock_count, m_sock_number, m_pfilter, m_connection_type));
+    new_connection_.reset(new connection<t_protocol_handler>(get_shard_io_service(), m_config, m_sock_count, m_sock_number, m_pfilter, m_connection_type));
     acceptor_.async_accept(new_connection_->socket(),
       boost::bind(&boosted_tcp_server<t_protocol_handler>::handle_accept, this,
       boost::asio::placeholders::error));
@@ -790,6 +956,70 @@ POP_WARNINGS
   }
   //---------------------------------------------------------------------------------
   template<class t_protocol_handler>
+  bool boosted_tcp_server<t_protocol_handler>::shard_worker_thread(size_t index)
+  {
+    TRY_ENTRY();
+    std::string thread_name = std::string("[") + m_thread_name_prefix;
+    thread_name += "S" + boost::to_string(index) + "]";
+    log_space::log_singletone::set_thread_log_prefix(thread_name);
+    boost::asio::io_service& shard = *m_shards[index];
+    while(!m_stop_signal_sent)
+    {
+      try
+      {
+        shard.run();
+      }
+      catch(const std::exception& ex)
+      {
+        _erro("Exception at server shard thread, what=" << ex.what());
+      }
+      catch(...)
+      {
+        _erro("Exception at server shard thread, unknown execption");
+      }
+    }
+    return true;
+    CATCH_ENTRY_L0("boosted_tcp_server<t_protocol_handler>::shard_worker_thread", false);
+  }
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
+  void boosted_tcp_server<t_protocol_handler>::set_io_service_shards(size_t shards_count)
+  {
+    CHECK_AND_ASSERT_MES(!acceptor_.is_open() && m_shard_threads.empty(), void(), "io_service shards must be set before init_server");
+    m_shards_work.clear();
+    m_shards.clear();
+    for (size_t i = 0; i < shards_count; ++i)
+    {
+      m_shards.emplace_back(new boost::asio::io_service());
+      m_shards_work.emplace_back(new boost::asio::io_service::work(*m_shards.back()));
+    }
+    _info_c("net/RPClog", "Using " << shards_count << " io_service shards for " << m_thread_name_prefix);
+  }
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
+  bool boosted_tcp_server<t_protocol_handler>::is_shard_thread(size_t index)
+  {
+    CRITICAL_REGION_LOCAL(m_threads_lock);
+    return index < m_shard_threads.size() && m_shard_threads[index]->get_id() == boost::this_thread::get_id();
+  }
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
+  boost::asio::io_service& boosted_tcp_server<t_protocol_handler>::get_shard_io_service(bool exclude_current_thread)
+  {
+    if (m_shards.empty())
+      return io_service_;
+    const size_t start = m_next_shard++;
+    for (size_t i = 0; i < m_shards.size(); ++i)
+    {
+      const size_t index = (start + i) % m_shards.size();
+      // a blocking connect must not wait on the very shard it is running on
+      if (!exclude_current_thread || !is_shard_thread(index))
+        return *m_shards[index];
+    }
+    return io_service_;
+  }
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
   void boosted_tcp_server<t_protocol_handler>::set_threads_prefix(const std::string& prefix_name)
   {
     m_thread_name_prefix = prefix_name;
@@ -814,6 +1044,15 @@ POP_WARNINGS
     m_main_thread_id = boost::this_thread::get_id();
     log_space::log_singletone::set_thread_log_prefix("[SRV_MAIN]");
     add_idle_handler(boost::bind(&boosted_tcp_server::cleanup_connections, this), 5000);
+    CRITICAL_REGION_BEGIN(m_threads_lock);
+    for (std::size_t i = m_shard_threads.size(); i < m_shards.size(); ++i)
+    {
+      boost::shared_ptr<boost::thread> thread(new boost::thread(
+        attrs, boost::bind(&boosted_tcp_server<t_protocol_handler>::shard_worker_thread, this, i)));
+      _note("Run server shard thread name: " << m_thread_name_prefix << " shard " << i);
+      m_shard_threads.push_back(thread);
+    }
+    CRITICAL_REGION_END();
     while(!m_stop_signal_sent)
     {
 
@@ -858,6 +1097,13 @@ POP_WARNINGS
         }
       }
     }
+    if (wait)
+    {
+      for (std::size_t i = 0; i < m_shard_threads.size(); ++i)
+        m_shard_threads[i]->join();
+      CRITICAL_REGION_LOCAL(m_threads_lock);
+      m_shard_threads.clear();
+    }
     return true;
     CATCH_ENTRY_L0("boosted_tcp_server<t_protocol_handler>::run_server", false);
   }
@@ -872,6 +1118,11 @@ POP_WARNINGS
       if(thp->get_id() == boost::this_thread::get_id())
         return true;
     }
+    BOOST_FOREACH(boost::shared_ptr<boost::thread>& thp,  m_shard_threads)
+    {
+      if(thp->get_id() == boost::this_thread::get_id())
+        return true;
+    }
     if(m_threads_count == 1 && boost::this_thread::get_id() == m_main_thread_id)
       return true;
     return false;
@@ -891,6 +1142,14 @@ POP_WARNINGS
         m_threads[i]->interrupt();
       }
     }
+    for (std::size_t i = 0; i < m_shard_threads.size(); ++i)
+    {
+      if(m_shard_threads[i]->joinable() && !m_shard_threads[i]->try_join_for(ms))
+      {
+        _dbg1("Interrupting shard thread " << m_shard_threads[i]->native_handle());
+        m_shard_threads[i]->interrupt();
+      }
+    }
     return true;
     CATCH_ENTRY_L0("boosted_tcp_server<t_protocol_handler>::timed_wait_server_stop", false);
   }
@@ -908,6 +1167,8 @@ POP_WARNINGS
     connections_.clear();
     connections_mutex.unlock();
     io_service_.stop();
+    for (auto &shard: m_shards)
+      shard->stop();
     CATCH_ENTRY_L0("boosted_tcp_server<t_protocol_handler>::send_stop_signal()", void());
   }
   //---------------------------------------------------------------------------------
@@ -943,12 +1204,13 @@ POP_WARNINGS
 			new_connection_->setRpcStation(); // hopefully this is not needed actually
 		}
 		connection_ptr conn(std::move(new_connection_));
-      new_connection_.reset(new connection<t_protocol_handler>(io_service_, m_config, m_sock_count, m_sock_number, m_pfilter, m_connection_type));
+      new_connection_.reset(new connection<t_protocol_handler>(get_shard_io_service(), m_config, m_sock_count, m_sock_number, m_pfilter, m_connection_type));
       acceptor_.async_accept(new_connection_->socket(),
         boost::bind(&boosted_tcp_server<t_protocol_handler>::handle_accept, this,
         boost::asio::placeholders::error));
 
-      conn->start(true, 1 < m_threads_count);
+      conn->set_idle_timeout(m_connection_idle_timeout_ms);
+      conn->start(true, is_multithreaded_connection());
       conn->save_dbg_log();
     }else
     {
@@ -962,7 +1224,7 @@ POP_WARNINGS
   {
     TRY_ENTRY();
 
-    connection_ptr new_connection_l(new connection<t_protocol_handler>(io_service_, m_config, m_sock_count, m_sock_number, m_pfilter, m_connection_type) );
+    connection_ptr new_connection_l(new connection<t_protocol_handler>(get_shard_io_service(true), m_config, m_sock_count, m_sock_number, m_pfilter, m_connection_type) );
     connections_mutex.lock();
     connections_.push_back(std::make_pair(boost::get_system_time(), new_connection_l));
     LOG_PRINT_L2("connections_ size now " << connections_.size());
@@ -1044,7 +1306,7 @@ POP_WARNINGS
 
     _dbg3("Connected success to " << adr << ':' << port);
 
-    bool r = new_connection_l->start(false, 1 < m_threads_count);
+    bool r = new_connection_l->start(false, is_multithreaded_connection());
     if (r)
     {
       new_connection_l->get_context(conn_context);
@@ -1066,7 +1328,8 @@ POP_WARNINGS
   bool boosted_tcp_server<t_protocol_handler>::connect_async(const std::string& adr, const std::string& port, uint32_t conn_timeout, t_callback cb, const std::string& bind_ip)
   {
     TRY_ENTRY();    
-    connection_ptr new_connection_l(new connection<t_protocol_handler>(io_service_, m_config, m_sock_count, m_sock_number, m_pfilter, m_connection_type) );
+    boost::asio::io_service& connection_io_service = get_shard_io_service();
+    connection_ptr new_connection_l(new connection<t_protocol_handler>(connection_io_service, m_config, m_sock_count, m_sock_number, m_pfilter, m_connection_type) );
     connections_mutex.lock();
     connections_.push_back(std::make_pair(boost::get_system_time(), new_connection_l));
     LOG_PRINT_L2("connections_ size now " << connections_.size());
@@ -1093,7 +1356,7 @@ POP_WARNINGS
       sock_.bind(local_endpoint);
     }
     
-    boost::shared_ptr<boost::asio::deadline_timer> sh_deadline(new boost::asio::deadline_timer(io_service_));
+    boost::shared_ptr<boost::asio::deadline_timer> sh_deadline(new boost::asio::deadline_timer(connection_io_service));
     //start deadline
     sh_deadline->expires_from_now(boost::posix_time::milliseconds(conn_timeout));
     sh_deadline->async_wait([=](const boost::system::error_code& error)
@@ -1119,7 +1382,7 @@ POP_WARNINGS
           {
             _dbg3("[sock " << new_connection_l->socket().native_handle() << "] Connected success to " << adr << ':' << port <<
               " from " << lep.address().to_string() << ':' << lep.port());
-            bool r = new_connection_l->start(false, 1 < m_threads_count);
+            bool r = new_connection_l->start(false, is_multithreaded_connection());
             if (r)
             {
               new_connection_l->get_context(conn_context);
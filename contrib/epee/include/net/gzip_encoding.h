@@ -0,0 +1,175 @@
+// Copyright (c) 2006-2013, Andrey N. Sabelnikov, www.sabelnikov.net
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+// * Neither the name of the Andrey N. Sabelnikov nor the
+// names of its contributors may be used to endorse or promote products
+// derived from this software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER  BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 
+
+#pragma once 
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <boost/regex.hpp>
+#include <zlib.h>
+#include "http_client_base.h"
+#include "misc_log_ex.h"
+
+#define HTTP_GZIP_BUFFER_SIZE (16 * 1024)
+
+namespace epee
+{
+namespace net_utils
+{
+  //whether an "Accept-Encoding:" value lets gzip through, "gzip;q=0" being a refusal
+  inline bool is_gzip_accepted(const std::string& accept_encoding)
+  {
+    static const boost::regex rexp_match_gzip("(^|,)\\s*(x-)?gzip\\s*(;\\s*q\\s*=\\s*([0-9.]+))?\\s*(,|$)", boost::regex::icase | boost::regex::normal);
+    boost::smatch result;
+    if(!boost::regex_search(accept_encoding, result, rexp_match_gzip, boost::match_default) || !result[0].matched)
+      return false;
+    return !result[4].matched || strtod(result[4].str().c_str(), NULL) > 0;
+  }
+
+  /************************************************************************/
+  /* decodes a gzip (or zlib, for "deflate") body piece by piece as it    */
+  /* arrives, handing what it gets to the owner                           */
+  /************************************************************************/
+  class content_encoding_gzip: public i_sub_handler
+  {
+  public:
+    content_encoding_gzip(i_target_handler* powner_filter, bool is_deflate_mode = false):m_powner_filter(powner_filter), m_is_stream_ended(false)
+    {
+      memset(&m_zstream_in, 0, sizeof(m_zstream_in));
+      int ret = inflateInit2(&m_zstream_in, is_deflate_mode ? MAX_WBITS : MAX_WBITS + 16);
+      m_is_initialized = (ret == Z_OK);
+      if(!m_is_initialized)
+        LOG_ERROR("Failed to init inflate, ret = " << ret);
+    }
+    ~content_encoding_gzip()
+    {
+      if(m_is_initialized)
+        inflateEnd(&m_zstream_in);
+    }
+
+    virtual bool update_in(std::string& piece_of_transfer)
+    {
+      CHECK_AND_ASSERT_MES(m_is_initialized, false, "content_encoding_gzip used without inflate initialized");
+      if(m_is_stream_ended || piece_of_transfer.empty())
+      {
+        //whatever follows the end of the stream is not part of the body
+        piece_of_transfer.clear();
+        return true;
+      }
+
+      std::string decoded;
+      char buff[HTTP_GZIP_BUFFER_SIZE];
+      m_zstream_in.next_in = (Bytef*)piece_of_transfer.data();
+      m_zstream_in.avail_in = piece_of_transfer.size();
+      do
+      {
+        m_zstream_in.next_out = (Bytef*)buff;
+        m_zstream_in.avail_out = sizeof(buff);
+        int ret = inflate(&m_zstream_in, Z_NO_FLUSH);
+        if(ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR)
+        {
+          LOG_ERROR("Failed to inflate content, ret = " << ret);
+          return false;
+        }
+        decoded.append(buff, sizeof(buff) - m_zstream_in.avail_out);
+        if(ret == Z_STREAM_END)
+        {
+          m_is_stream_ended = true;
+          break;
+        }
+        if(ret == Z_BUF_ERROR)
+          break;
+      }while(m_zstream_in.avail_in || !m_zstream_in.avail_out);
+      piece_of_transfer.clear();
+
+      if(decoded.empty())
+        return true;
+      return m_powner_filter->handle_target_data(decoded);
+    }
+
+    virtual void stop(std::string& OUT collect_remains)
+    {
+      //inflate gives out all it has on every update
+    }
+
+  private:
+    i_target_handler* m_powner_filter;
+    z_stream m_zstream_in;
+    bool m_is_initialized;
+    bool m_is_stream_ended;
+  };
+
+  /************************************************************************/
+  /* gzip encoder for bodies sent in one or several pieces                */
+  /************************************************************************/
+  class gzip_encoder
+  {
+  public:
+    gzip_encoder(int level = Z_DEFAULT_COMPRESSION)
+    {
+      memset(&m_zstream_out, 0, sizeof(m_zstream_out));
+      int ret = deflateInit2(&m_zstream_out, level, Z_DEFLATED, MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY);
+      m_is_initialized = (ret == Z_OK);
+      if(!m_is_initialized)
+        LOG_ERROR("Failed to init deflate, ret = " << ret);
+    }
+    ~gzip_encoder()
+    {
+      if(m_is_initialized)
+        deflateEnd(&m_zstream_out);
+    }
+
+    //appends to out what the encoder has ready after taking in, which may be nothing
+    //until the last piece, given with finish set
+    bool update(const std::string& in, std::string& out, bool finish)
+    {
+      CHECK_AND_ASSERT_MES(m_is_initialized, false, "gzip_encoder used without deflate initialized");
+      char buff[HTTP_GZIP_BUFFER_SIZE];
+      m_zstream_out.next_in = (Bytef*)in.data();
+      m_zstream_out.avail_in = in.size();
+      int ret;
+      do
+      {
+        m_zstream_out.next_out = (Bytef*)buff;
+        m_zstream_out.avail_out = sizeof(buff);
+        ret = deflate(&m_zstream_out, finish ? Z_FINISH : Z_NO_FLUSH);
+        if(ret == Z_STREAM_ERROR)
+        {
+          LOG_ERROR("Failed to deflate content");
+          return false;
+        }
+        out.append(buff, sizeof(buff) - m_zstream_out.avail_out);
+      }while(finish ? ret != Z_STREAM_END : !m_zstream_out.avail_out);
+      return true;
+    }
+
+  private:
+    z_stream m_zstream_out;
+    bool m_is_initialized;
+  };
+}
+}
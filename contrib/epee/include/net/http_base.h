@@ -27,10 +27,14 @@
 
 
 #pragma once
+#include <functional>
 #include <boost/lexical_cast.hpp>
 #include <boost/regex.hpp>
 
 #include "string_tools.h"
+
+#define HTTP_RESPONSE_CHUNK_SIZE (64 * 1024) // body sent per chunk by handlers streaming their response
+
 namespace epee
 {
 namespace net_utils
@@ -99,6 +103,7 @@ namespace net_utils
 			std::string m_host;             //"Host:"
 			std::string m_cookie;			//"Cookie:"
 			std::string m_user_agent;	//"User-Agent:"
+			std::string m_accept_encoding;	//"Accept-Encoding:"
 			fields_list m_etc_fields;
 
 			void clear()
@@ -112,6 +117,7 @@ namespace net_utils
 				m_host.clear();
 				m_cookie.clear();
 				m_user_agent.clear();
+				m_accept_encoding.clear();
 				m_etc_fields.clear();
 			}
 		};
@@ -174,6 +180,10 @@ namespace net_utils
 			http_header_info    m_header_info;
 			int                 m_http_ver_hi;// OUT paramter only
 			int                 m_http_ver_lo;// OUT paramter only
+			//set by servers taking chunked bodies: the first call sends the head, so code and mime type
+			//must be final by then, and each call sends its data as one chunk and empties it
+			std::function<bool(std::string&)> m_send_chunk;
+			size_t              m_sent_body_bytes = 0;// body already gone out in chunks
 
 			void clear()
 			{
@@ -270,6 +270,7 @@ using namespace std;
 			reciev_machine_state m_state;
 			chunked_state m_chunked_state;
 			std::string m_chunked_cache;
+			bool m_closed_before_response;
 			critical_section m_lock;
 
 		public:
@@ -323,7 +324,8 @@ using namespace std;
 			inline bool invoke(const std::string& uri, const std::string& method, const std::string& body, const http_response_info** ppresponse_info = NULL, const fields_list& additional_params = fields_list())
 			{
 				CRITICAL_REGION_LOCAL(m_lock);
-				if(!is_connected())
+				const bool reused = is_connected();
+				if(!reused)
 				{
 					LOG_PRINT("Reconnecting...", LOG_LEVEL_3);
 					if(!connect(m_host_buff, m_port, m_timeout))
@@ -332,10 +334,12 @@ using namespace std;
 						return false;
 					}
 				}
-				m_response_info.clear();
 				std::string req_buff = 	method + " ";
 				req_buff += uri + " HTTP/1.1\r\n" + 
 					"Host: "+ m_host_buff +"\r\n" +	"Content-Length: " + boost::lexical_cast<std::string>(body.size()) + "\r\n";
+#ifdef HTTP_ENABLE_GZIP
+				req_buff += "Accept-Encoding: gzip\r\n";
+#endif
 
 
 				//handle "additional_params"
@@ -343,18 +347,28 @@ using namespace std;
 					req_buff += it->first + ": " + it->second + "\r\n";
 				req_buff += "\r\n";
 				//--
-
-				bool res = m_net_client.send(req_buff);
-				CHECK_AND_ASSERT_MES(res, false, "HTTP_CLIENT: Failed to SEND");
-				if(body.size())
-					res = m_net_client.send(body);
-				CHECK_AND_ASSERT_MES(res, false, "HTTP_CLIENT: Failed to SEND");
+				//one send for head and body, so the request leaves in as few segments as possible
+				req_buff += body;
 
 				if(ppresponse_info)
 					*ppresponse_info = &m_response_info;
 
-				m_state = reciev_machine_state_header;
-				return handle_reciev();
+				bool res = send_request_and_handle_reciev(req_buff);
+				if(!res && reused && m_closed_before_response)
+				{
+					//the server dropped the kept-alive connection while it was idle, the request never got handled
+					LOG_PRINT("Kept-alive connection to " << m_host_buff << ":" << m_port << " was closed, reconnecting...", LOG_LEVEL_3);
+					disconnect();
+					if(!connect(m_host_buff, m_port, m_timeout))
+					{
+						LOG_PRINT("Failed to connect to " << m_host_buff << ":" << m_port, LOG_LEVEL_3);
+						return false;
+					}
+					res = send_request_and_handle_reciev(req_buff);
+				}
+				if(!res)
+					disconnect(); //don't reuse a connection left in an unknown state
+				return res;
 			}
 			//---------------------------------------------------------------------------
 			inline bool invoke_post(const std::string& uri, const std::string& body,  const http_response_info** ppresponse_info = NULL, const fields_list& additional_params = fields_list())
@@ -363,6 +377,21 @@ using namespace std;
 				return invoke(uri, "POST", body, ppresponse_info, additional_params);
 			}
 		private: 
+			//---------------------------------------------------------------------------
+			inline bool send_request_and_handle_reciev(const std::string& req_buff)
+			{
+				CRITICAL_REGION_LOCAL(m_lock);
+				m_response_info.clear();
+				m_closed_before_response = false;
+				if(!m_net_client.send(req_buff))
+				{
+					LOG_PRINT("HTTP_CLIENT: Failed to SEND", LOG_LEVEL_3);
+					m_closed_before_response = true;
+					return false;
+				}
+				m_state = reciev_machine_state_header;
+				return handle_reciev();
+			}
 			//---------------------------------------------------------------------------
 			inline bool handle_reciev()
 			{
@@ -379,6 +408,11 @@ using namespace std;
 							LOG_PRINT("Unexpected reciec fail", LOG_LEVEL_3);
 							m_state = reciev_machine_state_error;
             }
+            else if(!recv_buffer.size() && reciev_machine_state_header == m_state && m_header_cache.empty())
+            {
+              //closed before a single byte of the response arrived
+              m_closed_before_response = true;
+            }
             if(!recv_buffer.size())
             {
               //connection is going to be closed
@@ -470,7 +504,8 @@ using namespace std;
 				}
 				CHECK_AND_ASSERT_MES(m_len_in_remain >= recv_buff.size(), false, "m_len_in_remain >= recv_buff.size()");
 				m_len_in_remain -= recv_buff.size();
-				m_pcontent_encoding_handler->update_in(recv_buff);
+				if(!m_pcontent_encoding_handler->update_in(recv_buff))
+					return false;
 
 				if(m_len_in_remain == 0)
 					m_state = reciev_machine_state_done;
@@ -490,7 +525,8 @@ using namespace std;
 					return true;
 				}
         need_more_data = true;
-				m_pcontent_encoding_handler->update_in(recv_buff);
+				if(!m_pcontent_encoding_handler->update_in(recv_buff))
+					return false;
 
 
 				return true;
@@ -643,7 +679,8 @@ using namespace std;
 								m_len_in_remain = 0;
 							}
 
-							m_pcontent_encoding_handler->update_in(chunk_body);
+							if(!m_pcontent_encoding_handler->update_in(chunk_body))
+								return false;
 
 							if(!m_len_in_remain)
 								m_chunked_state = http_chunked_state_chunk_head;
@@ -36,6 +36,14 @@
 #include "to_nonconst_iterator.h"
 #include "http_auth.h"
 #include "http_base.h"
+#ifdef HTTP_ENABLE_GZIP
+#include <memory>
+#include "gzip_encoding.h"
+#endif
+
+#define HTTP_CHUNKED_MAX_QUEUED_CHUNKS 4
+#define HTTP_CHUNKED_SEND_TIMEOUT_MS (30 * 1000) // longest a chunked response waits for the client to read
+#define HTTP_COMPRESSION_THRESHOLD 1024 // smallest whole body gzipped for clients accepting it
 
 namespace epee
 {
@@ -54,6 +62,7 @@ namespace net_utils
 			std::string m_required_user_agent;
 			boost::optional<http_auth::login> m_user;
 			critical_section m_lock;
+			bool m_chunked_responses = false; //handlers may send long bodies chunked to HTTP/1.1 clients
 		};
 
 		/************************************************************************/
@@ -121,7 +130,9 @@ namespace net_utils
 			bool set_ready_state();
 			bool slash_to_back_slash(std::string& str);
 			std::string get_file_mime_tipe(const std::string& path);
-			std::string get_response_header(const http_response_info& response);
+			std::string get_response_header(const http_response_info& response, bool chunked = false);
+			bool send_chunk(http_response_info& response, std::string& data, bool& started, bool last = false);
+			bool encode_response_body(http_response_info& response);
 
 			//major function 
 			inline bool handle_request_and_send_response(const http::http_request_info& query_info);
@@ -138,6 +149,9 @@ namespace net_utils
 			size_t m_len_summary, m_len_remain;
 			config_type& m_config;
 			bool m_want_close;
+#ifdef HTTP_ENABLE_GZIP
+			std::unique_ptr<gzip_encoder> m_chunk_encoder; //set while a chunked response is sent gzipped
+#endif
 		protected:
 			i_service_endpoint* m_psnd_hndlr; 
 		};
@@ -25,6 +25,8 @@
 // 
 
 
+#include <cctype>
+#include <cstring>
 #include <boost/regex.hpp>
 #include <boost/lexical_cast.hpp>
 #include "http_protocol_handler.h"
@@ -290,7 +292,10 @@ namespace net_utils
 					break;
 				}
 			case http_state_retriving_body:
-				return handle_retriving_query_body();
+				//the rest of the cache may already hold the next pipelined request
+				if(!handle_retriving_query_body())
+					return false;
+				break;
 			case http_state_connection_close:
 				return false;
 			default:
@@ -308,22 +313,77 @@ namespace net_utils
 		return true;
 	}
 	//--------------------------------------------------------------------------------------------
-	inline bool analize_http_method(const boost::smatch& result, http::http_method& method, int& http_ver_major, int& http_ver_minor)
+	inline bool is_equal_no_case(const char* s, size_t len, const char* lowercase)
+	{
+		for(size_t i = 0; i != len; ++i)
+			if(!lowercase[i] || std::tolower((unsigned char)s[i]) != lowercase[i])
+				return false;
+		return !lowercase[len];
+	}
+	//--------------------------------------------------------------------------------------------
+	inline bool parse_http_version_number(const char*& p, const char* end, int& number)
 	{
-		CHECK_AND_ASSERT_MES(result[0].matched, false, "simple_http_connection_handler::analize_http_method() assert failed...");
-		http_ver_major = boost::lexical_cast<int>(result[11]);
-		http_ver_minor = boost::lexical_cast<int>(result[12]);
-		if(result[4].matched)
-			method = http::http_method_get;
-		else if(result[5].matched)
-			method = http::http_method_head;
-		else if(result[6].matched)
-			method = http::http_method_post;
-		else if(result[7].matched)
-			method = http::http_method_put;
-		else 
-			method = http::http_method_etc;
+		const char* begin = p;
+		number = 0;
+		for(; p != end && *p >= '0' && *p <= '9'; ++p)
+		{
+			if(p - begin >= 4)
+				return false;
+			number = number * 10 + (*p - '0');
+		}
+		return p != begin;
+	}
+	//--------------------------------------------------------------------------------------------
+	//"METHOD URI HTTP/x.y" ended by the first line break of buf, which the caller made sure is there
+	inline bool parse_request_line(const std::string& buf, http::http_request_info& info, size_t& line_len)
+	{
+		static const struct { const char* name; http::http_method method; } methods[] = {
+			{"get", http::http_method_get}, {"post", http::http_method_post}, {"head", http::http_method_head}, {"put", http::http_method_put},
+			{"options", http::http_method_etc}, {"delete", http::http_method_etc}, {"trace", http::http_method_etc}};
+
+		const char* const begin = buf.data();
+		const char* const line_break = (const char*)memchr(begin, '\n', buf.size());
+		if(!line_break)
+			return false;
+		const char* end = line_break;
+		if(end != begin && end[-1] == '\r')
+			--end;
+
+		const char* const method_end = (const char*)memchr(begin, ' ', end - begin);
+		if(!method_end)
+			return false;
+		size_t m = 0;
+		for(; m != sizeof(methods) / sizeof(methods[0]); ++m)
+			if(is_equal_no_case(begin, method_end - begin, methods[m].name))
+				break;
+		if(m == sizeof(methods) / sizeof(methods[0]))
+			return false;
+
+		const char* const uri = method_end + 1;
+		const char* p = uri;
+		while(p != end && !std::isspace((unsigned char)*p))
+			++p;
+		if(p == uri || p == end || *p != ' ')
+			return false;
+		const char* const uri_end = p++;
+
+		if(end - p < 5 || !is_equal_no_case(p, 5, "http/"))
+			return false;
+		p += 5;
+		int hi = 0, lo = 0;
+		if(!parse_http_version_number(p, end, hi) || p == end)
+			return false;
+		++p; //any separator, "." really
+		if(!parse_http_version_number(p, end, lo) || p != end)
+			return false;
 
+		info.m_http_method = methods[m].method;
+		info.m_http_method_str.assign(begin, method_end);
+		info.m_URI.assign(uri, uri_end);
+		info.m_http_ver_hi = hi;
+		info.m_http_ver_lo = lo;
+		line_len = line_break + 1 - begin;
+		info.m_full_request_str.assign(begin, line_len);
 		return true;
 	}
 
@@ -333,19 +393,11 @@ namespace net_utils
 	{ 
 		LOG_FRAME("simple_http_connection_handler<t_connection_context>::handle_recognize_protocol_out(*)", LOG_LEVEL_3);
 
-		STATIC_REGEXP_EXPR_1(rexp_match_command_line, "^(((OPTIONS)|(GET)|(HEAD)|(POST)|(PUT)|(DELETE)|(TRACE)) (\\S+) HTTP/(\\d+).(\\d+))\r?\n", boost::regex::icase | boost::regex::normal);
-		//											    123         4     5      6      7     8        9        10          11     12    
-		//size_t match_len = 0;
-		boost::smatch result;	
-		if(boost::regex_search(m_cache, result, rexp_match_command_line, boost::match_default) && result[0].matched)
+		size_t line_len = 0;
+		if(parse_request_line(m_cache, m_query_info, line_len))
 		{
-			analize_http_method(result, m_query_info.m_http_method, m_query_info.m_http_ver_hi, m_query_info.m_http_ver_hi);
-			m_query_info.m_URI = result[10];
       parse_uri(m_query_info.m_URI, m_query_info.m_uri_content);
-			m_query_info.m_http_method_str = result[2];
-			m_query_info.m_full_request_str = result[0];
-
-			m_cache.erase(m_cache.begin(),  to_nonsonst_iterator(m_cache, result[0].second));
+			m_cache.erase(0, line_len);
 
 			m_state = http_state_retriving_header;
 
@@ -481,52 +533,63 @@ namespace net_utils
 	{ 
 		LOG_FRAME("http_stream_filter::parse_cached_header(*)", LOG_LEVEL_3);
 
-		STATIC_REGEXP_EXPR_1(rexp_mach_field, 
-			"\n?((Connection)|(Referer)|(Content-Length)|(Content-Type)|(Transfer-Encoding)|(Content-Encoding)|(Host)|(Cookie)|(User-Agent)"
-			//  12            3         4                5              6                   7                  8      9        10
-			"|([\\w-]+?)) ?: ?((.*?)(\r?\n))[^\t ]",	
-			//11             1213   14 
-			boost::regex::icase | boost::regex::normal);
-
-		boost::smatch		result;
-		std::string::const_iterator it_current_bound = m_cache_to_process.begin();
-		std::string::const_iterator it_end_bound = m_cache_to_process.begin()+pos;
+		static const struct { const char* name; std::string http_header_info::*field; } known_fields[] = {
+			{"connection", &http_header_info::m_connection},
+			{"referer", &http_header_info::m_referer},
+			{"content-length", &http_header_info::m_content_length},
+			{"content-type", &http_header_info::m_content_type},
+			{"transfer-encoding", &http_header_info::m_transfer_encoding},
+			{"content-encoding", &http_header_info::m_content_encoding},
+			{"host", &http_header_info::m_host},
+			{"cookie", &http_header_info::m_cookie},
+			{"user-agent", &http_header_info::m_user_agent},
+			{"accept-encoding", &http_header_info::m_accept_encoding}};
 
 		body_info.clear();
 
-		//lookup all fields and fill well-known fields
-		while( boost::regex_search( it_current_bound, it_end_bound, result, rexp_mach_field, boost::match_default) && result[0].matched) 
+		//one "Name: value" field per line, a line starting with a space or tab carrying
+		//on the one before; lines not making a field are passed over
+		const char* p = m_cache_to_process.data();
+		const char* const end = p + pos;
+		while(p != end)
 		{
-			const size_t field_val = 13;
-			const size_t field_etc_name = 11;
-
-			int i = 2; //start position = 2
-			if(result[i++].matched)//"Connection"
-				body_info.m_connection = result[field_val];
-			else if(result[i++].matched)//"Referer"
-				body_info.m_referer = result[field_val];
-			else if(result[i++].matched)//"Content-Length"
-				body_info.m_content_length = result[field_val];
-			else if(result[i++].matched)//"Content-Type"
-				body_info.m_content_type = result[field_val];
-			else if(result[i++].matched)//"Transfer-Encoding"
-				body_info.m_transfer_encoding = result[field_val];
-			else if(result[i++].matched)//"Content-Encoding"
-				body_info.m_content_encoding = result[field_val];
-			else if(result[i++].matched)//"Host"
-				body_info.m_host = result[field_val];
-			else if(result[i++].matched)//"Cookie"
-				body_info.m_cookie = result[field_val];
-			else if(result[i++].matched)//"User-Agent"
-				body_info.m_user_agent = result[field_val];
-			else if(result[i++].matched)//e.t.c (HAVE TO BE MATCHED!)
-				body_info.m_etc_fields.push_back(std::pair<std::string, std::string>(result[field_etc_name], result[field_val]));
-			else
+			const char* field_end = (const char*)memchr(p, '\n', end - p);
+			while(field_end && field_end + 1 != end && (field_end[1] == ' ' || field_end[1] == '\t'))
+				field_end = (const char*)memchr(field_end + 1, '\n', end - field_end - 1);
+			if(!field_end)
+				break;
+			const char* const next = field_end + 1;
+			const char* value_end = field_end;
+			if(value_end != p && value_end[-1] == '\r')
+				--value_end;
+
+			const char* name_end = p;
+			while(name_end != value_end && (std::isalnum((unsigned char)*name_end) || *name_end == '-' || *name_end == '_'))
+				++name_end;
+			const char* value = name_end;
+			if(value != value_end && *value == ' ')
+				++value;
+			if(name_end == p || value == value_end || *value != ':')
 			{
-				LOG_ERROR("simple_http_connection_handler<t_connection_context>::parse_cached_header() not matched last entry in:"<<m_cache_to_process);
+				p = next;
+				continue;
 			}
+			++value;
+			if(value != value_end && *value == ' ')
+				++value;
 
-			it_current_bound = result[(int)result.size()-1]. first;
+			size_t k = 0;
+			for(; k != sizeof(known_fields) / sizeof(known_fields[0]); ++k)
+			{
+				if(is_equal_no_case(p, name_end - p, known_fields[k].name))
+				{
+					(body_info.*known_fields[k].field).assign(value, value_end);
+					break;
+				}
+			}
+			if(k == sizeof(known_fields) / sizeof(known_fields[0]))
+				body_info.m_etc_fields.push_back(std::pair<std::string, std::string>(std::string(p, name_end), std::string(value, value_end)));
+			p = next;
 		}
 		return  true;
 	}
@@ -548,17 +611,47 @@ namespace net_utils
 	bool simple_http_connection_handler<t_connection_context>::handle_request_and_send_response(const http::http_request_info& query_info)
 	{
 		http_response_info response;
+		bool chunked = false;
+		bool chunks_sent = true;
+		const bool http_1_1 = query_info.m_http_ver_hi > 1 || (query_info.m_http_ver_hi == 1 && query_info.m_http_ver_lo >= 1);
+		if(m_config.m_chunked_responses && http_1_1)
+		{
+			response.m_send_chunk = [this, &response, &chunked, &chunks_sent](std::string& data)
+			{
+				chunks_sent = chunks_sent && send_chunk(response, data, chunked);
+				data.clear();
+				return chunks_sent;
+			};
+		}
 		bool res = handle_request(query_info, response);
 		//CHECK_AND_ASSERT_MES(res, res, "handle_request(query_info, response) returned false" );
+		response.m_send_chunk = nullptr;
 
+		if(chunked)
+		{
+			//what is left of the body, then the empty chunk ending it; a body cut short
+			//has no end, and the connection is closed so the client can tell
+			if(!chunks_sent || !send_chunk(response, response.m_body, chunked, true) || !m_psnd_hndlr->do_send("0\r\n\r\n", 5))
+			{
+				LOG_PRINT_L1("Chunked response to " << query_info.m_URI << " cut short after " << response.m_sent_body_bytes << " bytes");
+				m_want_close = true;
+				m_state = http_state_connection_close;
+				m_psnd_hndlr->close();
+			}
+			return res;
+		}
+
+		encode_response_body(response);
 		std::string response_data = get_response_header(response);
 		
 		//LOG_PRINT_L0("HTTP_SEND: << \r\n" << response_data + response.m_body);
     LOG_PRINT_L3("HTTP_RESPONSE_HEAD: << \r\n" << response_data);
 		
-		m_psnd_hndlr->do_send((void*)response_data.data(), response_data.size());
+		//the body is queued as it is rather than copied
 		if(response.m_body.size())
-			m_psnd_hndlr->do_send((void*)response.m_body.data(), response.m_body.size());
+			m_psnd_hndlr->do_send(response_data.data(), response_data.size(), boost::make_shared<const std::string>(std::move(response.m_body)), traffic_class_relay);
+		else
+			m_psnd_hndlr->do_send((void*)response_data.data(), response_data.size());
 		return res;
 	}
 	//-----------------------------------------------------------------------------------
@@ -594,13 +687,15 @@ namespace net_utils
 	}
 	//-----------------------------------------------------------------------------------
   template<class t_connection_context>
-	std::string simple_http_connection_handler<t_connection_context>::get_response_header(const http_response_info& response)
+	std::string simple_http_connection_handler<t_connection_context>::get_response_header(const http_response_info& response, bool chunked)
 	{
 		std::string buf = "HTTP/1.1 ";
 		buf += boost::lexical_cast<std::string>(response.m_response_code) + " " + response.m_response_comment + "\r\n" +
-			"Server: Epee-based\r\n"
-			"Content-Length: ";
-		buf += boost::lexical_cast<std::string>(response.m_body.size()) + "\r\n";
+			"Server: Epee-based\r\n";
+		if(chunked)
+			buf += "Transfer-Encoding: chunked\r\n";
+		else
+			buf += "Content-Length: " + boost::lexical_cast<std::string>(response.m_body.size()) + "\r\n";
 		buf += "Content-Type: ";
 		buf += response.m_mime_tipe + "\r\n";
 
@@ -611,16 +706,20 @@ namespace net_utils
 		buf += "Accept-Ranges: bytes\r\n";
 		//Wed, 01 Dec 2010 03:27:41 GMT"
 
+		//HTTP/1.1 connections persist unless the client asks to close them,
+		//HTTP/1.0 ones only when the client asks to keep them alive
 		string_tools::trim(m_query_info.m_header_info.m_connection);
-		if(m_query_info.m_header_info.m_connection.size())
+		const bool http_1_0 = m_query_info.m_http_ver_hi < 1 || (m_query_info.m_http_ver_hi == 1 && m_query_info.m_http_ver_lo == 0);
+		if(!string_tools::compare_no_case("close", m_query_info.m_header_info.m_connection) ||
+			(http_1_0 && string_tools::compare_no_case("keep-alive", m_query_info.m_header_info.m_connection)))
 		{
-			if(!string_tools::compare_no_case("close", m_query_info.m_header_info.m_connection))
-			{
-        //closing connection after sending
-				buf += "Connection: close\r\n";
-				m_state = http_state_connection_close;
-				m_want_close = true;
-			}
+			//closing connection after sending
+			buf += "Connection: close\r\n";
+			m_state = http_state_connection_close;
+			m_want_close = true;
+		}else if(http_1_0)
+		{
+			buf += "Connection: keep-alive\r\n";
 		}
 		//add additional fields, if it is
 		for(fields_list::const_iterator it = response.m_additional_fields.begin(); it!=response.m_additional_fields.end(); it++)
@@ -632,6 +731,77 @@ namespace net_utils
 	}
 	//-----------------------------------------------------------------------------------
 	template<class t_connection_context>
+	bool simple_http_connection_handler<t_connection_context>::encode_response_body(http_response_info& response)
+	{
+#ifdef HTTP_ENABLE_GZIP
+		if(response.m_body.size() < HTTP_COMPRESSION_THRESHOLD || !is_gzip_accepted(m_query_info.m_header_info.m_accept_encoding))
+			return false;
+		for(const auto& field: response.m_additional_fields)
+			if(string_tools::compare_no_case(field.first, "Content-Encoding"))
+				return false;
+
+		gzip_encoder encoder;
+		std::string encoded;
+		encoded.reserve(response.m_body.size() / 2);
+		//already compressed content gains nothing, and goes out as it is
+		if(!encoder.update(response.m_body, encoded, true) || encoded.size() >= response.m_body.size())
+			return false;
+		response.m_body.swap(encoded);
+		response.m_additional_fields.push_back(std::make_pair("Content-Encoding", "gzip"));
+		return true;
+#else
+		return false;
+#endif
+	}
+	//-----------------------------------------------------------------------------------
+	template<class t_connection_context>
+	bool simple_http_connection_handler<t_connection_context>::send_chunk(http_response_info& response, std::string& data, bool& started, bool last)
+	{
+		if(!started)
+		{
+#ifdef HTTP_ENABLE_GZIP
+			//a chunked body is a long one, so it is gzipped whenever the client takes it
+			m_chunk_encoder.reset();
+			if(is_gzip_accepted(m_query_info.m_header_info.m_accept_encoding))
+			{
+				m_chunk_encoder.reset(new gzip_encoder());
+				response.m_additional_fields.push_back(std::make_pair("Content-Encoding", "gzip"));
+			}
+#endif
+			const std::string head = get_response_header(response, true);
+			LOG_PRINT_L3("HTTP_RESPONSE_HEAD: << \r\n" << head);
+			if(!m_psnd_hndlr->do_send(head.data(), head.size()))
+				return false;
+			started = true;
+		}
+#ifdef HTTP_ENABLE_GZIP
+		if(m_chunk_encoder)
+		{
+			std::string encoded;
+			const bool r = m_chunk_encoder->update(data, encoded, last);
+			if(last)
+				m_chunk_encoder.reset();
+			if(!r)
+				return false;
+			data.swap(encoded);
+		}
+#endif
+		if(data.empty())
+			return true;
+
+		//a couple of chunks in flight at most: the handler waits for the client instead of buffering the rest
+		if(!m_psnd_hndlr->wait_send_que(HTTP_CHUNKED_MAX_QUEUED_CHUNKS * HTTP_RESPONSE_CHUNK_SIZE, HTTP_CHUNKED_SEND_TIMEOUT_MS))
+			return false;
+		char size_line[24];
+		const int size_line_len = snprintf(size_line, sizeof(size_line), "%zx\r\n", data.size());
+		response.m_sent_body_bytes += data.size();
+		data += "\r\n";
+		const bool r = m_psnd_hndlr->do_send(size_line, size_line_len, boost::make_shared<const std::string>(std::move(data)), traffic_class_relay);
+		data.clear();
+		return r;
+	}
+	//-----------------------------------------------------------------------------------
+	template<class t_connection_context>
   std::string simple_http_connection_handler<t_connection_context>::get_file_mime_tipe(const std::string& path)
 	{
 		std::string result;
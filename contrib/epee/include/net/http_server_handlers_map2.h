@@ -27,11 +27,36 @@
 
 #pragma once 
 #include "http_base.h"
+#include "http_server_jsonrpc_batch.h"
+#include "http_server_method_stats.h"
 #include "jsonrpc_structs.h"
 #include "storages/portable_storage.h"
 #include "storages/portable_storage_template_helper.h"
 
 
+namespace epee
+{
+namespace net_utils
+{
+namespace http
+{
+  //the JSON of resp as the body, sent chunk by chunk while it is written if the server lets it
+  template<class t_struct>
+  bool store_response_to_json(t_struct& resp, http_response_info& response_info)
+  {
+    if(!response_info.m_send_chunk)
+      return epee::serialization::store_t_to_json(resp, response_info.m_body);
+    return epee::serialization::store_t_to_json_spilled(resp, response_info.m_body, HTTP_RESPONSE_CHUNK_SIZE, response_info.m_send_chunk);
+  }
+}
+}
+}
+
+// counts and times the call handled in the enclosing block (see method_stats)
+#define METHOD_STATS_SCOPE(method_name) \
+  static epee::net_utils::http::method_stats method_stats_(method_name); \
+  epee::net_utils::http::method_stats_scope method_stats_scope_(method_stats_, response_info);
+
 #define CHAIN_HTTP_TO_MAP2(context_type) bool handle_http_request(const epee::net_utils::http::http_request_info& query_info, \
               epee::net_utils::http::http_response_info& response, \
               context_type& m_conn_context) \
@@ -59,6 +84,7 @@
     else if((query_info.m_URI == s_pattern) && (cond)) \
     { \
       handled = true; \
+      METHOD_STATS_SCOPE(s_pattern) \
       uint64_t ticks = misc_utils::get_tick_count(); \
       boost::value_initialized<command_type::request> req; \
       bool parse_res = epee::serialization::load_t_from_json(static_cast<command_type::request&>(req), query_info.m_body); \
@@ -73,11 +99,12 @@
         return true; \
       } \
       uint64_t ticks2 = epee::misc_utils::get_tick_count(); \
-      epee::serialization::store_t_to_json(static_cast<command_type::response&>(resp), response_info.m_body); \
-      uint64_t ticks3 = epee::misc_utils::get_tick_count(); \
       response_info.m_mime_tipe = "application/json"; \
       response_info.m_header_info.m_content_type = " application/json"; \
+      epee::net_utils::http::store_response_to_json(static_cast<command_type::response&>(resp), response_info); \
+      uint64_t ticks3 = epee::misc_utils::get_tick_count(); \
       LOG_PRINT( s_pattern << " processed with " << ticks1-ticks << "/"<< ticks2-ticks1 << "/" << ticks3-ticks2 << "ms", LOG_LEVEL_2); \
+      method_stats_scope_.succeeded(); \
     }
 
 #define MAP_URI_AUTO_JON2(s_pattern, callback_f, command_type) MAP_URI_AUTO_JON2_IF(s_pattern, callback_f, command_type, true)
@@ -86,6 +113,7 @@
     else if(query_info.m_URI == s_pattern) \
     { \
       handled = true; \
+      METHOD_STATS_SCOPE(s_pattern) \
       uint64_t ticks = misc_utils::get_tick_count(); \
       boost::value_initialized<command_type::request> req; \
       bool parse_res = epee::serialization::load_t_from_binary(static_cast<command_type::request&>(req), query_info.m_body); \
@@ -105,6 +133,7 @@
       response_info.m_mime_tipe = " application/octet-stream"; \
       response_info.m_header_info.m_content_type = " application/octet-stream"; \
       LOG_PRINT( s_pattern << "() processed with " << ticks1-ticks << "/"<< ticks2-ticks1 << "/" << ticks3-ticks2 << "ms", LOG_LEVEL_2); \
+      method_stats_scope_.succeeded(); \
     }
 
 #define CHAIN_URI_MAP2(callback) else {callback(query_info, response_info, m_conn_context);handled = true;}
@@ -112,10 +141,20 @@
 #define END_URI_MAP2() return handled;}
 
 
-#define BEGIN_JSON_RPC_MAP(uri)    else if(query_info.m_URI == uri) \
+#define BEGIN_JSON_RPC_MAP(uri) BEGIN_JSON_RPC_MAP_CONCURRENT(uri, 1)
+
+// calls of a batch run on up to max_threads threads at once (see json_rpc::handle_batch)
+#define BEGIN_JSON_RPC_MAP_CONCURRENT(uri, max_threads)    else if(query_info.m_URI == uri) \
+    { \
+    if(epee::json_rpc::is_batch(query_info.m_body)) \
     { \
+      epee::json_rpc::handle_batch(query_info, response_info, m_conn_context, max_threads, \
+        [this](const epee::net_utils::http::http_request_info& call_info, epee::net_utils::http::http_response_info& call_response, t_context& call_context) \
+        { return this->handle_http_request_map(call_info, call_response, call_context); }); \
+      return true; \
+    } \
     uint64_t ticks = epee::misc_utils::get_tick_count(); \
-    epee::serialization::portable_storage ps; \
+    epee::serialization::portable_json_reader ps; \
     if(!ps.load_from_json(query_info.m_body)) \
     { \
        boost::value_initialized<epee::json_rpc::error_response> rsp; \
@@ -162,15 +201,17 @@
 
 #define FINALIZE_OBJECTS_TO_JSON(method_name) \
   uint64_t ticks2 = epee::misc_utils::get_tick_count(); \
-  epee::serialization::store_t_to_json(resp, response_info.m_body); \
-  uint64_t ticks3 = epee::misc_utils::get_tick_count(); \
   response_info.m_mime_tipe = "application/json"; \
   response_info.m_header_info.m_content_type = " application/json"; \
-  LOG_PRINT( query_info.m_URI << "[" << method_name << "] processed with " << ticks1-ticks << "/"<< ticks2-ticks1 << "/" << ticks3-ticks2 << "ms", LOG_LEVEL_2);
+  epee::net_utils::http::store_response_to_json(resp, response_info); \
+  uint64_t ticks3 = epee::misc_utils::get_tick_count(); \
+  LOG_PRINT( query_info.m_URI << "[" << method_name << "] processed with " << ticks1-ticks << "/"<< ticks2-ticks1 << "/" << ticks3-ticks2 << "ms", LOG_LEVEL_2); \
+  method_stats_scope_.succeeded();
 
 #define MAP_JON_RPC_WE_IF(method_name, callback_f, command_type, cond) \
     else if((callback_name == method_name) && (cond)) \
 { \
+  METHOD_STATS_SCOPE(method_name) \
   PREPARE_OBJECTS_FROM_JSON(command_type) \
   epee::json_rpc::error_response fail_resp = AUTO_VAL_INIT(fail_resp); \
   fail_resp.jsonrpc = "2.0"; \
@@ -189,6 +230,7 @@
 #define MAP_JON_RPC_WERI(method_name, callback_f, command_type) \
     else if(callback_name == method_name) \
 { \
+  METHOD_STATS_SCOPE(method_name) \
   PREPARE_OBJECTS_FROM_JSON(command_type) \
   epee::json_rpc::error_response fail_resp = AUTO_VAL_INIT(fail_resp); \
   fail_resp.jsonrpc = "2.0"; \
@@ -205,6 +247,7 @@
 #define MAP_JON_RPC(method_name, callback_f, command_type) \
     else if(callback_name == method_name) \
 { \
+  METHOD_STATS_SCOPE(method_name) \
   PREPARE_OBJECTS_FROM_JSON(command_type) \
   if(!callback_f(req.params, resp.result)) \
   { \
@@ -36,6 +36,8 @@
 #include "net/http_server_cp2.h"
 #include "net/http_server_handlers_map2.h"
 
+#define HTTP_SERVER_IDLE_TIMEOUT_MS (60 * 1000) // keep-alive connections waiting longer for a request are closed
+
 namespace epee
 {
 
@@ -66,6 +68,9 @@ namespace epee
       m_net_server.get_config_object().m_required_user_agent = std::move(user_agent);
       m_net_server.get_config_object().m_user = std::move(user);
 
+      // keep-alive connections are reused by clients, but not held forever
+      m_net_server.set_connection_idle_timeout(HTTP_SERVER_IDLE_TIMEOUT_MS);
+
       LOG_PRINT_L0("Binding on " << bind_ip << ":" << bind_port);
       bool res = m_net_server.init_server(bind_port, bind_ip);
       if(!res)
@@ -107,6 +112,13 @@ namespace epee
       return true;
     }
 
+    /// Let JSON responses longer than HTTP_RESPONSE_CHUNK_SIZE go out chunked as they are
+    /// serialized. Handlers then wait for slow clients, so the server needs spare threads.
+    void set_chunked_responses(bool chunked)
+    {
+      m_net_server.get_config_object().m_chunked_responses = chunked;
+    }
+
     int get_binded_port()
     {
       return m_net_server.get_binded_port();
@@ -0,0 +1,199 @@
+// Copyright (c) 2014-2016, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <boost/thread/thread.hpp>
+
+#include "http_base.h"
+#include "jsonrpc_structs.h"
+#include "misc_language.h"
+#include "misc_log_ex.h"
+#include "storages/portable_storage_template_helper.h"
+
+// most calls taken in one JSON-RPC batch
+#define JSON_RPC_MAX_BATCH_SIZE 256
+
+namespace epee
+{
+namespace json_rpc
+{
+  /// A JSON-RPC 2.0 batch is an array of calls.
+  inline bool is_batch(const std::string& body)
+  {
+    const std::string::size_type start = body.find_first_not_of(" \t\r\n");
+    return start != std::string::npos && body[start] == '[';
+  }
+
+  /// Splits a batch into the text of each of its calls, without parsing them.
+  inline bool split_batch(const std::string& body, std::vector<std::string>& calls)
+  {
+    static const char* const space = " \t\r\n";
+    calls.clear();
+    std::string::size_type pos = body.find_first_not_of(space);
+    if (pos == std::string::npos || body[pos] != '[')
+      return false;
+    pos = body.find_first_not_of(space, pos + 1);
+    if (pos != std::string::npos && body[pos] == ']')
+      return body.find_first_not_of(space, pos + 1) == std::string::npos;
+
+    size_t depth = 0;
+    bool in_string = false;
+    std::string::size_type start = pos;
+    for (; pos < body.size(); ++pos)
+    {
+      const char c = body[pos];
+      if (in_string)
+      {
+        if (c == '\\')
+          ++pos;
+        else if (c == '"')
+          in_string = false;
+        continue;
+      }
+      if (c == '"')
+        in_string = true;
+      else if (c == '{' || c == '[')
+        ++depth;
+      else if ((c == '}' || c == ']') && depth > 0)
+        --depth;
+      else if (depth == 0 && (c == ',' || c == ']'))
+      {
+        const std::string::size_type end = body.find_last_not_of(space, pos - 1);
+        if (end == std::string::npos || end < start)
+          return false;
+        calls.push_back(body.substr(start, end - start + 1));
+        if (c == ']')
+          return body.find_first_not_of(space, pos + 1) == std::string::npos;
+        start = body.find_first_not_of(space, pos + 1);
+        if (start == std::string::npos)
+          return false;
+        pos = start - 1;
+      }
+    }
+    return false;
+  }
+
+  inline std::string make_error_json(int64_t code, const std::string& message)
+  {
+    error_response rsp = AUTO_VAL_INIT(rsp);
+    rsp.jsonrpc = "2.0";
+    rsp.id = epee::serialization::storage_entry(std::string());
+    rsp.error.code = code;
+    rsp.error.message = message;
+    std::string json;
+    epee::serialization::store_t_to_json(rsp, json);
+    return json;
+  }
+
+  /// Answers a batch with the array of the answers to its calls, in order.
+  /// Each call goes through handler as a request of its own; up to
+  /// max_threads of them run at once, each thread with a copy of the
+  /// connection context, so only pass more than 1 for handlers which the
+  /// server already runs concurrently.
+  template<class t_context, class t_handler>
+  void handle_batch(const net_utils::http::http_request_info& query_info, net_utils::http::http_response_info& response_info,
+    t_context& context, size_t max_threads, t_handler handler)
+  {
+    response_info.m_mime_tipe = "application/json";
+    response_info.m_header_info.m_content_type = " application/json";
+
+    std::vector<std::string> calls;
+    if (!split_batch(query_info.m_body, calls))
+    {
+      response_info.m_body = make_error_json(-32700, "Parse error");
+      return;
+    }
+    if (calls.empty() || calls.size() > JSON_RPC_MAX_BATCH_SIZE)
+    {
+      response_info.m_body = make_error_json(-32600, "Invalid Request");
+      return;
+    }
+
+    net_utils::http::http_request_info call_template = query_info;
+    call_template.m_body.clear();
+    std::vector<std::string> results(calls.size());
+    std::atomic<size_t> next(0);
+    auto run_calls = [&](t_context& call_context)
+    {
+      net_utils::http::http_request_info call_info = call_template;
+      for (size_t i = next++; i < calls.size(); i = next++)
+      {
+        // a batch can't nest, and each of its calls is an object
+        if (calls[i][0] != '{')
+        {
+          results[i] = make_error_json(-32600, "Invalid Request");
+          continue;
+        }
+        call_info.m_body.swap(calls[i]);
+        net_utils::http::http_response_info call_response = AUTO_VAL_INIT(call_response);
+        call_response.m_response_code = 200;
+        try
+        {
+          handler(call_info, call_response, call_context);
+        }
+        catch (const std::exception &e)
+        {
+          LOG_ERROR("JSON-RPC batch call failed: " << e.what());
+          call_response.m_body.clear();
+        }
+        results[i] = call_response.m_body.empty() ? make_error_json(-32603, "Internal error") : std::move(call_response.m_body);
+      }
+    };
+
+    const size_t threads = std::max<size_t>(1, std::min(max_threads, calls.size()));
+    boost::thread_group helpers;
+    for (size_t n = 1; n < threads; ++n)
+    {
+      // copied before any call runs on the original
+      t_context call_context = context;
+      helpers.create_thread([&run_calls, call_context]() mutable { run_calls(call_context); });
+    }
+    run_calls(context);
+    helpers.join_all();
+
+    size_t bytes = 2 + results.size();
+    for (const std::string &r: results)
+      bytes += r.size();
+    response_info.m_body.clear();
+    response_info.m_body.reserve(bytes);
+    response_info.m_body += '[';
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+      if (i)
+        response_info.m_body += ',';
+      response_info.m_body += results[i];
+    }
+    response_info.m_body += ']';
+  }
+}
+}
@@ -0,0 +1,195 @@
+// Copyright (c) 2014-2016, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "http_base.h"
+#include "syncobj.h"
+
+#define HTTP_METHOD_STATS_BUCKETS 32
+
+namespace epee
+{
+namespace net_utils
+{
+namespace http
+{
+  /*! Counters for one URI or JSON RPC method of an HTTP server, process wide.
+
+    Latencies go in log2 buckets of microseconds: bucket i counts calls that
+    took at most 2^(i+1) us. Each dispatch site of the handlers map keeps one
+    static instance, registered on first use.
+  */
+  class method_stats
+  {
+  public:
+    explicit method_stats(const char* method):
+      m_method(method), m_calls(0), m_errors(0), m_bytes_out(0), m_total_us(0)
+    {
+      for (auto &b: m_latency)
+        b = 0;
+      CRITICAL_REGION_LOCAL(registry_lock());
+      registry().push_back(this);
+    }
+    ~method_stats()
+    {
+      CRITICAL_REGION_LOCAL(registry_lock());
+      std::vector<method_stats*>& all = registry();
+      all.erase(std::remove(all.begin(), all.end(), this), all.end());
+    }
+
+    void add(uint64_t usec, uint64_t bytes_out, bool error)
+    {
+      m_total_us += usec;
+      unsigned bucket = 0;
+      while (usec > 1 && bucket < HTTP_METHOD_STATS_BUCKETS - 1)
+      {
+        usec >>= 1;
+        ++bucket;
+      }
+      ++m_latency[bucket];
+      m_bytes_out += bytes_out;
+      if (error)
+        ++m_errors;
+      ++m_calls;
+    }
+
+    const char* get_method() const { return m_method; }
+    uint64_t get_calls() const { return m_calls; }
+    uint64_t get_errors() const { return m_errors; }
+    uint64_t get_bytes_out() const { return m_bytes_out; }
+    uint64_t get_total_us() const { return m_total_us; }
+    uint64_t get_bucket(unsigned i) const { return m_latency[i]; }
+    static uint64_t get_bucket_bound_us(unsigned i) { return (uint64_t)2 << i; }
+
+    //! upper bound of the bucket holding the pct-th percentile of calls
+    uint64_t percentile(uint64_t calls, unsigned pct) const
+    {
+      if (calls == 0)
+        return 0;
+      const uint64_t target = (calls * pct + 99) / 100;
+      uint64_t seen = 0;
+      for (unsigned i = 0; i < HTTP_METHOD_STATS_BUCKETS; ++i)
+      {
+        seen += m_latency[i];
+        if (seen >= target)
+          return get_bucket_bound_us(i);
+      }
+      return get_bucket_bound_us(HTTP_METHOD_STATS_BUCKETS - 1);
+    }
+
+    //! every method called so far
+    static std::vector<const method_stats*> get_all()
+    {
+      CRITICAL_REGION_LOCAL(registry_lock());
+      return std::vector<const method_stats*>(registry().begin(), registry().end());
+    }
+
+  private:
+    static std::vector<method_stats*>& registry()
+    {
+      static std::vector<method_stats*> all;
+      return all;
+    }
+    static critical_section& registry_lock()
+    {
+      static critical_section lock;
+      return lock;
+    }
+
+    const char* m_method;
+    std::atomic<uint64_t> m_calls;
+    std::atomic<uint64_t> m_errors;
+    std::atomic<uint64_t> m_bytes_out;
+    std::atomic<uint64_t> m_total_us;
+    std::atomic<uint64_t> m_latency[HTTP_METHOD_STATS_BUCKETS];
+  };
+
+  /*! Times one dispatched call and adds it to its method_stats when it goes out
+    of scope, with the size of the response body. Calls count as errors unless
+    succeeded() was called.
+  */
+  class method_stats_scope
+  {
+  public:
+    method_stats_scope(method_stats& stats, const http_response_info& response):
+      m_stats(stats), m_response(response), m_start(std::chrono::steady_clock::now()), m_succeeded(false)
+    {}
+    ~method_stats_scope()
+    {
+      const uint64_t usec = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_start).count();
+      m_stats.add(usec, m_response.m_sent_body_bytes + m_response.m_body.size(), !m_succeeded);
+    }
+    void succeeded() { m_succeeded = true; }
+
+  private:
+    method_stats& m_stats;
+    const http_response_info& m_response;
+    const std::chrono::steady_clock::time_point m_start;
+    bool m_succeeded;
+  };
+
+  /*! All method_stats in the Prometheus text exposition format, as histograms
+    in seconds plus counters for errors and response bytes.
+  */
+  inline std::string get_method_stats_text(const std::string& prefix)
+  {
+    std::ostringstream ss;
+    const std::vector<const method_stats*> all = method_stats::get_all();
+    ss << "# TYPE " << prefix << "_request_duration_seconds histogram\n";
+    for (const method_stats* s: all)
+    {
+      // counted from the buckets, so count and +Inf agree even while calls come in
+      uint64_t cumulative = 0;
+      for (unsigned i = 0; i < HTTP_METHOD_STATS_BUCKETS; ++i)
+      {
+        cumulative += s->get_bucket(i);
+        ss << prefix << "_request_duration_seconds_bucket{method=\"" << s->get_method() << "\",le=\"" << method_stats::get_bucket_bound_us(i) / 1e6 << "\"} " << cumulative << "\n";
+      }
+      ss << prefix << "_request_duration_seconds_bucket{method=\"" << s->get_method() << "\",le=\"+Inf\"} " << cumulative << "\n";
+      ss << prefix << "_request_duration_seconds_sum{method=\"" << s->get_method() << "\"} " << s->get_total_us() / 1e6 << "\n";
+      ss << prefix << "_request_duration_seconds_count{method=\"" << s->get_method() << "\"} " << cumulative << "\n";
+    }
+    ss << "# TYPE " << prefix << "_request_errors_total counter\n";
+    for (const method_stats* s: all)
+      ss << prefix << "_request_errors_total{method=\"" << s->get_method() << "\"} " << s->get_errors() << "\n";
+    ss << "# TYPE " << prefix << "_response_bytes_total counter\n";
+    for (const method_stats* s: all)
+      ss << prefix << "_response_bytes_total{method=\"" << s->get_method() << "\"} " << s->get_bytes_out() << "\n";
+    return ss.str();
+  }
+}
+}
+}
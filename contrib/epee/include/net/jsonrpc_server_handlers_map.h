@@ -15,7 +15,7 @@ bool handle_rpc_request(const std::string& req_data, \
 { \
   bool handled = false; \
   uint64_t ticks = epee::misc_utils::get_tick_count(); \
-  epee::serialization::portable_storage ps; \
+  epee::serialization::portable_json_reader ps; \
   if (!ps.load_from_json(req_data)) \
   { \
     epee::net_utils::jsonrpc2::make_error_resp_json(-32700, "Parse error", resp_data); \
@@ -86,6 +86,7 @@ namespace levin
 
     virtual void on_connection_new(t_connection_context& context){};
     virtual void on_connection_close(t_connection_context& context){};
+    virtual net_utils::traffic_class get_traffic_class(int command){ return net_utils::traffic_class_peerlist; }
 
   };
 
@@ -97,6 +98,7 @@ namespace levin
 #define LEVIN_ERROR_CONNECTION_NO_DUPLEX_PROTOCOL      -5
 #define LEVIN_ERROR_CONNECTION_HANDLER_NOT_DEFINED     -6
 #define LEVIN_ERROR_FORMAT                             -7
+#define LEVIN_ERROR_CONNECTION_OVERLOADED              -8
 
 #define DESCRIBE_RET_CODE(code) case code: return #code;
   inline
@@ -112,6 +114,7 @@ namespace levin
       DESCRIBE_RET_CODE(LEVIN_ERROR_CONNECTION_NO_DUPLEX_PROTOCOL);
       DESCRIBE_RET_CODE(LEVIN_ERROR_CONNECTION_HANDLER_NOT_DEFINED);
       DESCRIBE_RET_CODE(LEVIN_ERROR_FORMAT);
+      DESCRIBE_RET_CODE(LEVIN_ERROR_CONNECTION_OVERLOADED);
     default:
       return "unknown code";
     }
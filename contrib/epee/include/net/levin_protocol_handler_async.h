@@ -31,9 +31,12 @@
 #include <boost/smart_ptr/make_shared.hpp>
 
 #include <atomic>
+#include <algorithm>
+#include <cstring>
 
 #include "levin_base.h"
 #include "misc_language.h"
+#include "../../../../src/p2p/data_logger.hpp"
 
 #include <random>
 #include <chrono>
@@ -76,6 +79,7 @@ public:
   int invoke_async(int command, const std::string& in_buff, boost::uuids::uuid connection_id, callback_t cb, size_t timeout = LEVIN_DEFAULT_TIMEOUT_PRECONFIGURED);
 
   int notify(int command, const std::string& in_buff, boost::uuids::uuid connection_id);
+  int notify(int command, const net_utils::shared_buffer& in_buff, boost::uuids::uuid connection_id);
   bool close(boost::uuids::uuid connection_id);
   bool update_connection_context(const t_connection_context& contxt);
   bool request_callback(boost::uuids::uuid connection_id);
@@ -244,9 +248,31 @@ public:
     }
     CHECK_AND_ASSERT_MES_NO_RET(0 == boost::interprocess::ipcdetail::atomic_read32(&m_wait_count), "Failed to wait for operation completion. m_wait_count = " << m_wait_count);
 
+    set_recv_buffer_bytes(0);
+
     LOG_PRINT_CC(m_connection_context, "~async_protocol_handler()", LOG_LEVEL_4);
   }
 
+  //header and body go out in one write, the body is queued by reference and shaped by the command's traffic class
+  bool send_packet(const bucket_head2& head, const net_utils::shared_buffer& body)
+  {
+    const net_utils::traffic_class cls = m_config.m_pcommands_handler ? m_config.m_pcommands_handler->get_traffic_class(head.m_command) : net_utils::traffic_class_peerlist;
+    net_utils::data_logger::account_out(head.m_command, m_connection_context.m_remote_ip, sizeof(head) + body->size());
+    return m_pservice_endpoint->do_send(&head, sizeof(head), body, cls);
+  }
+  bool send_packet(const bucket_head2& head, const std::string& body)
+  {
+    return send_packet(head, net_utils::make_shared_buffer(body));
+  }
+
+  //keeps the connection's and the global memory accounting in step with the staged body
+  void set_recv_buffer_bytes(uint64_t bytes)
+  {
+    net_utils::connections_memory::usage() += bytes;
+    net_utils::connections_memory::usage() -= m_connection_context.m_recv_buffer_bytes;
+    m_connection_context.m_recv_buffer_bytes = bytes;
+  }
+
   bool start_outer_call()
   {
     LOG_PRINT_CC_L4(m_connection_context, "[levin_protocol] -->> start_outer_call");
@@ -328,7 +354,10 @@ public:
       return false;
     }
 
-    m_cache_in_buffer.append((const char*)ptr, cb);
+    //frames are parsed straight out of the received chunk, only a frame split across reads is staged
+    //in m_cache_in_buffer (sized once from the header), so nothing is ever erased from its front
+    const char* in_ptr = (const char*)ptr;
+    size_t in_left = cb;
 
     bool is_continue = true;
     while(is_continue)
@@ -336,22 +365,39 @@ public:
       switch(m_state)
       {
       case stream_state_body:
-        if(m_cache_in_buffer.size() < m_current_head.m_cb)
-        {
-          is_continue = false;
-          break;
-        }
         {
+          const size_t body_size = (size_t)m_current_head.m_cb;
           std::string buff_to_invoke;
-          if(m_cache_in_buffer.size()  == m_current_head.m_cb)
-            buff_to_invoke.swap(m_cache_in_buffer);
+          if(m_cache_in_buffer.empty() && in_left >= body_size)
+          {
+            buff_to_invoke.assign(in_ptr, body_size);
+            in_ptr += body_size;
+            in_left -= body_size;
+          }
           else
           {
-            buff_to_invoke.assign(m_cache_in_buffer, 0, (std::string::size_type)m_current_head.m_cb);
-            m_cache_in_buffer.erase(0, (std::string::size_type)m_current_head.m_cb);
+            if(m_cache_in_buffer.empty())
+            {
+              m_cache_in_buffer.reserve(body_size);
+              set_recv_buffer_bytes(body_size);
+            }
+            const size_t to_copy = std::min(body_size - m_cache_in_buffer.size(), in_left);
+            m_cache_in_buffer.append(in_ptr, to_copy);
+            in_ptr += to_copy;
+            in_left -= to_copy;
+            if(m_cache_in_buffer.size() < body_size)
+            {
+              is_continue = false;
+              break;
+            }
+            buff_to_invoke.swap(m_cache_in_buffer);
+            set_recv_buffer_bytes(0);
           }
 
           bool is_response = (m_oponent_protocol_ver == LEVIN_PROTOCOL_VER_1 && m_current_head.m_flags&LEVIN_PACKET_RESPONSE);
+          const int command = m_current_head.m_command;
+          net_utils::data_logger::account_in(command, m_connection_context.m_remote_ip, sizeof(bucket_head2) + body_size);
+          const std::chrono::steady_clock::time_point handler_start = std::chrono::steady_clock::now();
 
           LOG_PRINT_CC_L4(m_connection_context, "LEVIN_PACKET_RECIEVED. [len=" << m_current_head.m_cb 
             << ", flags" << m_current_head.m_flags 
@@ -407,10 +453,8 @@ public:
               m_current_head.m_have_to_return_data = false;
               m_current_head.m_protocol_version = LEVIN_PROTOCOL_VER_1;
               m_current_head.m_flags = LEVIN_PACKET_RESPONSE;
-              std::string send_buff((const char*)&m_current_head, sizeof(m_current_head));
-              send_buff += return_buff;
               CRITICAL_REGION_BEGIN(m_send_lock);
-              if(!m_pservice_endpoint->do_send(send_buff.data(), send_buff.size()))
+              if(!send_packet(m_current_head, return_buff))
                 return false;
               CRITICAL_REGION_END();
               LOG_PRINT_CC_L4(m_connection_context, "LEVIN_PACKET_SENT. [len=" << m_current_head.m_cb 
@@ -422,31 +466,54 @@ public:
             else
               m_config.m_pcommands_handler->notify(m_current_head.m_command, buff_to_invoke, m_connection_context);
           }
+          net_utils::data_logger::account_handler_time(command, std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - handler_start).count());
         }
         m_state = stream_state_head;
         break;
       case stream_state_head:
         {
-          if(m_cache_in_buffer.size() < sizeof(bucket_head2))
+          if(m_cache_in_buffer.empty() && in_left >= sizeof(bucket_head2))
           {
-            if(m_cache_in_buffer.size() >= sizeof(uint64_t) && *((uint64_t*)m_cache_in_buffer.data()) != LEVIN_SIGNATURE)
+            memcpy(&m_current_head, in_ptr, sizeof(bucket_head2));
+            in_ptr += sizeof(bucket_head2);
+            in_left -= sizeof(bucket_head2);
+          }
+          else
+          {
+            if(!in_left)
+            {
+              is_continue = false;
+              break;
+            }
+            const size_t to_copy = std::min(sizeof(bucket_head2) - m_cache_in_buffer.size(), in_left);
+            m_cache_in_buffer.append(in_ptr, to_copy);
+            in_ptr += to_copy;
+            in_left -= to_copy;
+            if(m_cache_in_buffer.size() < sizeof(bucket_head2))
             {
-              LOG_ERROR_CC(m_connection_context, "Signature mismatch, connection will be closed");
-              return false;
+              uint64_t signature;
+              if(m_cache_in_buffer.size() >= sizeof(signature))
+              {
+                memcpy(&signature, m_cache_in_buffer.data(), sizeof(signature));
+                if(signature != LEVIN_SIGNATURE)
+                {
+                  LOG_ERROR_CC(m_connection_context, "Signature mismatch, connection will be closed");
+                  return false;
+                }
+              }
+              is_continue = false;
+              break;
             }
-            is_continue = false;
-            break;
+            memcpy(&m_current_head, m_cache_in_buffer.data(), sizeof(bucket_head2));
+            m_cache_in_buffer.clear();
           }
 
-          bucket_head2* phead = (bucket_head2*)m_cache_in_buffer.data();
-          if(LEVIN_SIGNATURE != phead->m_signature)
+          if(LEVIN_SIGNATURE != m_current_head.m_signature)
           {
             LOG_ERROR_CC(m_connection_context, "Signature mismatch, connection will be closed");
             return false;
           }
-          m_current_head = *phead;
 
-          m_cache_in_buffer.erase(0, sizeof(bucket_head2));
           m_state = stream_state_body;
           m_oponent_protocol_ver = m_current_head.m_protocol_version;
           if(m_current_head.m_cb > m_config.m_max_packet_size)
@@ -515,14 +582,7 @@ public:
       boost::interprocess::ipcdetail::atomic_write32(&m_invoke_buf_ready, 0);
       CRITICAL_REGION_BEGIN(m_send_lock);
       CRITICAL_REGION_LOCAL1(m_invoke_response_handlers_lock);
-      if(!m_pservice_endpoint->do_send(&head, sizeof(head)))
-      {
-        LOG_ERROR_CC(m_connection_context, "Failed to do_send");
-        err_code = LEVIN_ERROR_CONNECTION;
-        break;
-      }
-
-      if(!m_pservice_endpoint->do_send(in_buff.data(), (int)in_buff.size()))
+      if(!send_packet(head, in_buff))
       {
         LOG_ERROR_CC(m_connection_context, "Failed to do_send");
         err_code = LEVIN_ERROR_CONNECTION;
@@ -572,13 +632,7 @@ public:
 
     boost::interprocess::ipcdetail::atomic_write32(&m_invoke_buf_ready, 0);
     CRITICAL_REGION_BEGIN(m_send_lock);
-    if(!m_pservice_endpoint->do_send(&head, sizeof(head)))
-    {
-      LOG_ERROR_CC(m_connection_context, "Failed to do_send");
-      return LEVIN_ERROR_CONNECTION;
-    }
-
-    if(!m_pservice_endpoint->do_send(in_buff.data(), (int)in_buff.size()))
+    if(!send_packet(head, in_buff))
     {
       LOG_ERROR_CC(m_connection_context, "Failed to do_send");
       return LEVIN_ERROR_CONNECTION;
@@ -638,22 +692,53 @@ public:
     head.m_protocol_version = LEVIN_PROTOCOL_VER_1;
     head.m_flags = LEVIN_PACKET_REQUEST;
     CRITICAL_REGION_BEGIN(m_send_lock);
-    if(!m_pservice_endpoint->do_send(&head, sizeof(head)))
+    if(!send_packet(head, in_buff))
     {
       LOG_ERROR_CC(m_connection_context, "Failed to do_send()");
       return -1;
     }
+    CRITICAL_REGION_END();
+    LOG_PRINT_CC_L4(m_connection_context, "LEVIN_PACKET_SENT. [len=" << head.m_cb << 
+      ", f=" << head.m_flags << 
+      ", r?=" << head.m_have_to_return_data <<
+      ", cmd = " << head.m_command << 
+      ", ver=" << head.m_protocol_version);
+
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------
+  int notify(int command, const net_utils::shared_buffer& in_buff)
+  {
+    misc_utils::auto_scope_leave_caller scope_exit_handler = misc_utils::create_scope_leave_handler(
+                          boost::bind(&async_protocol_handler::finish_outer_call, this));
+
+    if(m_deletion_initiated)
+      return LEVIN_ERROR_CONNECTION_DESTROYED;
+
+    CRITICAL_REGION_LOCAL(m_call_lock);
+
+    if(m_deletion_initiated)
+      return LEVIN_ERROR_CONNECTION_DESTROYED;
+
+    bucket_head2 head = {0};
+    head.m_signature = LEVIN_SIGNATURE;
+    head.m_have_to_return_data = false;
+    head.m_cb = in_buff->size();
 
-    if(!m_pservice_endpoint->do_send(in_buff.data(), (int)in_buff.size()))
+    head.m_command = command;
+    head.m_protocol_version = LEVIN_PROTOCOL_VER_1;
+    head.m_flags = LEVIN_PACKET_REQUEST;
+    CRITICAL_REGION_BEGIN(m_send_lock);
+    if(!send_packet(head, in_buff))
     {
       LOG_ERROR_CC(m_connection_context, "Failed to do_send()");
       return -1;
     }
     CRITICAL_REGION_END();
-    LOG_PRINT_CC_L4(m_connection_context, "LEVIN_PACKET_SENT. [len=" << head.m_cb << 
-      ", f=" << head.m_flags << 
+    LOG_PRINT_CC_L4(m_connection_context, "LEVIN_PACKET_SENT. [len=" << head.m_cb <<
+      ", f=" << head.m_flags <<
       ", r?=" << head.m_have_to_return_data <<
-      ", cmd = " << head.m_command << 
+      ", cmd = " << head.m_command <<
       ", ver=" << head.m_protocol_version);
 
     return 1;
@@ -733,6 +818,8 @@ int async_protocol_handler_config<t_connection_context>::find_and_lock_connectio
 template<class t_connection_context>
 int async_protocol_handler_config<t_connection_context>::invoke(int command, const std::string& in_buff, std::string& buff_out, boost::uuids::uuid connection_id)
 {
+  if(net_utils::connections_memory::over_total_limit())
+    return LEVIN_ERROR_CONNECTION_OVERLOADED;
   async_protocol_handler<t_connection_context>* aph;
   int r = find_and_lock_connection(connection_id, aph);
   return LEVIN_OK == r ? aph->invoke(command, in_buff, buff_out) : r;
@@ -741,6 +828,8 @@ int async_protocol_handler_config<t_connection_context>::invoke(int command, con
 template<class t_connection_context> template<class callback_t>
 int async_protocol_handler_config<t_connection_context>::invoke_async(int command, const std::string& in_buff, boost::uuids::uuid connection_id, callback_t cb, size_t timeout)
 {
+  if(net_utils::connections_memory::over_total_limit())
+    return LEVIN_ERROR_CONNECTION_OVERLOADED;
   async_protocol_handler<t_connection_context>* aph;
   int r = find_and_lock_connection(connection_id, aph);
   return LEVIN_OK == r ? aph->async_invoke(command, in_buff, cb, timeout) : r;
@@ -775,6 +864,14 @@ int async_protocol_handler_config<t_connection_context>::notify(int command, con
 }
 //------------------------------------------------------------------------------------------
 template<class t_connection_context>
+int async_protocol_handler_config<t_connection_context>::notify(int command, const net_utils::shared_buffer& in_buff, boost::uuids::uuid connection_id)
+{
+  async_protocol_handler<t_connection_context>* aph;
+  int r = find_and_lock_connection(connection_id, aph);
+  return LEVIN_OK == r ? aph->notify(command, in_buff) : r;
+}
+//------------------------------------------------------------------------------------------
+template<class t_connection_context>
 bool async_protocol_handler_config<t_connection_context>::close(boost::uuids::uuid connection_id)
 {
   CRITICAL_REGION_LOCAL(m_connects_lock);
@@ -93,31 +93,21 @@ namespace net_utils
   }
   
   inline 
-    bool parse_uri(const std::string uri, http::uri_content& content)
+    bool parse_uri(const std::string& uri, http::uri_content& content)
   {
 
     ///iframe_test.html?api_url=http://api.vk.com/api.php&api_id=3289090&api_settings=1&viewer_id=562964060&viewer_type=0&sid=0aad8d1c5713130f9ca0076f2b7b47e532877424961367d81e7fa92455f069be7e21bc3193cbd0be11895&secret=368ebbc0ef&access_token=668bc03f43981d883f73876ffff4aa8564254b359cc745dfa1b3cde7bdab2e94105d8f6d8250717569c0a7&user_id=0&group_id=0&is_app_user=1&auth_key=d2f7a895ca5ff3fdb2a2a8ae23fe679a&language=0&parent_language=0&ad_info=ElsdCQBaQlxiAQRdFUVUXiN2AVBzBx5pU1BXIgZUJlIEAWcgAUoLQg==&referrer=unknown&lc_name=9834b6a3&hash=
     content.m_query_params.clear();
-    STATIC_REGEXP_EXPR_1(rexp_match_uri, "^([^?#]*)(\\?([^#]*))?(#(.*))?", boost::regex::icase | boost::regex::normal);
-
-    boost::smatch result;	
-    if(!boost::regex_search(uri, result, rexp_match_uri, boost::match_default) && result[0].matched)
-    {
-      LOG_PRINT_L1("[PARSE URI] regex not matched for uri: " << uri);
-      content.m_path = uri;
-      return true;
-    }
-    if(result[1].matched)
-    {
-      content.m_path = result[1];
-    }
-    if(result[3].matched)
-    {
-      content.m_query = result[3];
-    }
-    if(result[5].matched)
+    //path, then "?query" and "#fragment" when there are
+    const std::string::size_type path_end = uri.find_first_of("?#");
+    content.m_path.assign(uri, 0, path_end);
+    if(path_end != std::string::npos)
     {
-      content.m_fragment = result[5];
+      const std::string::size_type fragment_begin = uri.find('#', path_end);
+      if(uri[path_end] == '?')
+        content.m_query.assign(uri, path_end + 1, fragment_begin == std::string::npos ? std::string::npos : fragment_begin - path_end - 1);
+      if(fragment_begin != std::string::npos)
+        content.m_fragment.assign(uri, fragment_begin + 1, std::string::npos);
     }
     if(content.m_query.size())
     {
@@ -29,7 +29,10 @@
 #ifndef _NET_UTILS_BASE_H_
 #define _NET_UTILS_BASE_H_
 
+#include <atomic>
 #include <boost/uuid/uuid.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/make_shared.hpp>
 #include "string_tools.h"
 
 #ifndef MAKE_IP
@@ -57,6 +60,8 @@ namespace net_utils
     uint64_t m_send_cnt;
     double m_current_speed_down;
     double m_current_speed_up;
+    uint64_t m_send_que_bytes;    //written by the connection, under its send queue lock
+    uint64_t m_recv_buffer_bytes; //staged by the protocol handler for a partially received packet
 
     connection_context_base(boost::uuids::uuid connection_id,
                             long remote_ip, int remote_port, bool is_income,
@@ -72,7 +77,9 @@ namespace net_utils
                                             m_recv_cnt(recv_cnt),
                                             m_send_cnt(send_cnt),
                                             m_current_speed_down(0),
-                                            m_current_speed_up(0)
+                                            m_current_speed_up(0),
+                                            m_send_que_bytes(0),
+                                            m_recv_buffer_bytes(0)
     {}
 
     connection_context_base(): m_connection_id(),
@@ -85,7 +92,9 @@ namespace net_utils
                                m_recv_cnt(0),
                                m_send_cnt(0),
                                m_current_speed_down(0),
-                               m_current_speed_up(0)
+                               m_current_speed_up(0),
+                               m_send_que_bytes(0),
+                               m_recv_buffer_bytes(0)
     {}
 
     connection_context_base& operator=(const connection_context_base& a)
@@ -108,9 +117,59 @@ namespace net_utils
 	/************************************************************************/
 	/*                                                                      */
 	/************************************************************************/
+  //bytes held in send queues and partially received packets, summed over all connections,
+  //with the budgets enforced against it (0 means unlimited)
+  struct connections_memory
+  {
+    static std::atomic<uint64_t>& usage() { static std::atomic<uint64_t> v(0); return v; }
+    static std::atomic<uint64_t>& total_limit() { static std::atomic<uint64_t> v(0); return v; }
+    static std::atomic<uint64_t>& connection_limit() { static std::atomic<uint64_t> v(0); return v; }
+
+    static bool over_total_limit(uint64_t extra = 0)
+    {
+      const uint64_t limit = total_limit();
+      return limit && usage() + extra > limit;
+    }
+    static bool over_connection_limit(const connection_context_base& context, uint64_t extra = 0)
+    {
+      const uint64_t limit = connection_limit();
+      return limit && context.m_send_que_bytes + context.m_recv_buffer_bytes + extra > limit;
+    }
+  };
+
+  //what a packet is for, so the upload shaper can favour relays over bulk transfers when saturated
+  enum traffic_class
+  {
+    traffic_class_relay = 0,  //new blocks and transactions
+    traffic_class_peerlist,   //handshakes, peer lists, requests and other small control traffic
+    traffic_class_sync,       //bulk block sync responses
+    traffic_class_count
+  };
+
+  //immutable payload, shared by every connection it is queued on (relays are built once)
+  typedef boost::shared_ptr<const std::string> shared_buffer;
+
+  inline
+    shared_buffer make_shared_buffer(const std::string& data)
+  {
+    return boost::make_shared<const std::string>(data);
+  }
+
 	struct i_service_endpoint
 	{
 		virtual bool do_send(const void* ptr, size_t cb)=0;
+    //sends a private header followed by a shared body, endpoints that can queue the body by reference
+    //(and shape it by traffic class) override this
+    virtual bool do_send(const void* head, size_t head_cb, const shared_buffer& body, traffic_class cls)
+    {
+      return do_send(head, head_cb) && do_send(body->data(), body->size());
+    }
+    //waits until at most max_bytes are left to send, false if that takes over timeout_ms or the
+    //connection goes away; endpoints which don't queue have nothing to wait for
+    virtual bool wait_send_que(size_t max_bytes, uint64_t timeout_ms)
+    {
+      return true;
+    }
     virtual bool close()=0;
     virtual bool call_run_once_service_io()=0;
     virtual bool request_callback()=0;
@@ -31,7 +31,8 @@
 #include <boost/variant.hpp>
 #include <boost/any.hpp>
 #include <string>
-#include <list>
+#include <vector>
+#include <deque>
 
 #define PORTABLE_STORAGE_SIGNATUREA 0x01011101
 #define PORTABLE_STORAGE_SIGNATUREB 0x01020101 // bender's nightmare 
@@ -71,45 +72,65 @@ namespace epee
   {
     struct section;
 
+    //contiguous storage, one allocation per array instead of one per element
+    template<class t_entry_type>
+    struct array_entry_container
+    {
+      typedef std::vector<t_entry_type> type;
+    };
+
+    //std::vector<bool> can't hand out pointers to its elements
+    template<>
+    struct array_entry_container<bool>
+    {
+      typedef std::deque<bool> type;
+    };
+
+    template<class t_entry_type>
+    inline void reserve_array_entries(std::vector<t_entry_type>& a, size_t count) { a.reserve(count); }
+    template<class t_entry_type>
+    inline void reserve_array_entries(std::deque<t_entry_type>& a, size_t count) {}
+
     /************************************************************************/
     /*                                                                      */
     /************************************************************************/
     template<class t_entry_type>
     struct array_entry_t
     {
-      array_entry_t():m_it(m_array.end()){}        
+      array_entry_t():m_index(0){}        
 
       const t_entry_type* get_first_val() const 
       {
-        m_it = m_array.begin();
+        m_index = 0;
         return get_next_val();
       }
 
       t_entry_type* get_first_val() 
       {
-        m_it = m_array.begin();
+        m_index = 0;
         return get_next_val();
       }
 
 
       const t_entry_type* get_next_val() const 
       {
-        if(m_it == m_array.end())
+        if(m_index >= m_array.size())
           return nullptr;
-        return &(*(m_it++));
+        return &m_array[m_index++];
       }
 
       t_entry_type* get_next_val() 
       {
-        if(m_it == m_array.end())
+        if(m_index >= m_array.size())
           return nullptr;
-        return (t_entry_type*)&(*(m_it++));//fuckoff
+        return &m_array[m_index++];
       }
 
+      //the returned reference is only good until the next insert
       t_entry_type& insert_first_val(const t_entry_type& v)
       {
         m_array.clear();
-        m_it = m_array.end();
+        m_index = 0;
         return insert_next_value(v);
       }
 
@@ -119,8 +140,13 @@ namespace epee
         return m_array.back();
       }
 
-      std::list<t_entry_type> m_array;
-      mutable typename std::list<t_entry_type>::const_iterator m_it;
+      void reserve(size_t count)
+      {
+        reserve_array_entries(m_array, count);
+      }
+
+      typename array_entry_container<t_entry_type>::type m_array;
+      mutable size_t m_index;
     };
 
 
@@ -0,0 +1,699 @@
+// Copyright (c) 2006-2013, Andrey N. Sabelnikov, www.sabelnikov.net
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+// * Neither the name of the Andrey N. Sabelnikov nor the
+// names of its contributors may be used to endorse or promote products
+// derived from this software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER  BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 
+
+
+#pragma once 
+
+#include <cstring>
+#include <deque>
+#include <vector>
+#include "misc_language.h"
+#include "portable_storage_base.h"
+#include "portable_storage_to_bin.h"
+#include "portable_storage_from_bin.h"
+#include "portable_storage_val_converters.h"
+
+namespace epee
+{
+  namespace serialization
+  {
+    template<class t_type> struct portable_type_code;
+    template<> struct portable_type_code<int64_t>     { static const uint8_t value = SERIALIZE_TYPE_INT64; };
+    template<> struct portable_type_code<int32_t>     { static const uint8_t value = SERIALIZE_TYPE_INT32; };
+    template<> struct portable_type_code<int16_t>     { static const uint8_t value = SERIALIZE_TYPE_INT16; };
+    template<> struct portable_type_code<int8_t>      { static const uint8_t value = SERIALIZE_TYPE_INT8; };
+    template<> struct portable_type_code<uint64_t>    { static const uint8_t value = SERIALIZE_TYPE_UINT64; };
+    template<> struct portable_type_code<uint32_t>    { static const uint8_t value = SERIALIZE_TYPE_UINT32; };
+    template<> struct portable_type_code<uint16_t>    { static const uint8_t value = SERIALIZE_TYPE_UINT16; };
+    template<> struct portable_type_code<uint8_t>     { static const uint8_t value = SERIALIZE_TYPE_UINT8; };
+    template<> struct portable_type_code<double>      { static const uint8_t value = SERIALIZE_TYPE_DUOBLE; };
+    template<> struct portable_type_code<bool>        { static const uint8_t value = SERIALIZE_TYPE_BOOL; };
+    template<> struct portable_type_code<std::string> { static const uint8_t value = SERIALIZE_TYPE_STRING; };
+
+    struct string_append_stream
+    {
+      std::string& m_buff;
+      string_append_stream(std::string& buff):m_buff(buff){}
+      void write(const char* p, size_t count){ m_buff.append(p, count); }
+    };
+
+    struct varint_stream
+    {
+      char m_data[sizeof(uint64_t)];
+      size_t m_size;
+      varint_stream():m_size(0){}
+      void write(const char* p, size_t count){ memcpy(m_data + m_size, p, count); m_size += count; }
+    };
+
+#define PORTABLE_BIN_WRITER_CATCH(location, return_val) } \
+  catch(const std::exception& ex) \
+  { \
+    LOG_ERROR("Exception at [" << location << "], what=" << ex.what()); \
+    m_failed = true; \
+    return return_val; \
+  }
+
+    /************************************************************************/
+    /* Same binary format as portable_storage::store_to_binary, but written  */
+    /* in one pass straight from the KV_SERIALIZE map, without a tree.       */
+    /* Entries come out in declaration order rather than sorted by name.     */
+    /************************************************************************/
+    class portable_bin_writer
+    {
+    public:
+      struct frame
+      {
+        size_t depth;
+        size_t count_pos;
+        size_t count;
+        uint8_t type; //element type for arrays, SERIALIZE_TYPE_OBJECT for sections
+        bool is_array;
+      };
+      typedef frame* hsection;
+      typedef frame* harray;
+      typedef storage_entry meta_entry;
+
+      portable_bin_writer();
+
+      hsection   open_section(const std::string& section_name,  hsection hparent_section, bool create_if_notexist = false);
+      template<class t_value>
+      bool       set_value(const std::string& value_name, const t_value& target, hsection hparent_section);
+      template<class t_value>
+      harray     insert_first_value(const std::string& value_name, const t_value& target, hsection hparent_section);
+      template<class t_value>
+      bool       insert_next_value(harray hval_array, const t_value& target);
+      harray     insert_first_section(const std::string& pSectionName, hsection& hinserted_childsection, hsection hparent_section);
+      bool       insert_next_section(harray hSecArray, hsection& hinserted_childsection);
+
+      //closes everything still open and hands the buffer over, so it can only be called once
+      bool       store_to_binary(binarybuffer& target);
+
+    private:
+      bool       close_to(frame* f);
+      void       close_top();
+      frame*     push_frame(bool is_array, uint8_t type);
+      bool       begin_entry(hsection hparent_section, const std::string& name, uint8_t type);
+      template<class t_value>
+      void       put_value(const t_value& v) { m_buff.append((const char*)&v, sizeof(v)); }
+      void       put_value(const std::string& v) { string_append_stream ss(m_buff); put_string(ss, v); }
+
+      std::string m_buff;
+      std::deque<frame> m_frames; //open sections and arrays, one per nesting level
+      size_t m_depth;
+      bool m_failed;
+      bool m_stored;
+    };
+
+    inline
+    portable_bin_writer::portable_bin_writer():m_depth(0), m_failed(false), m_stored(false)
+    {
+      uint32_t signature_a = PORTABLE_STORAGE_SIGNATUREA;
+      uint32_t signature_b = PORTABLE_STORAGE_SIGNATUREB;
+      uint8_t ver = PORTABLE_STORAGE_FORMAT_VER;
+      put_value(signature_a);
+      put_value(signature_b);
+      put_value(ver);
+      push_frame(false, SERIALIZE_TYPE_OBJECT);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    bool portable_bin_writer::close_to(frame* f)
+    {
+      CHECK_AND_ASSERT_MES(!m_stored, false, "portable_bin_writer: already stored");
+      CHECK_AND_ASSERT_MES(f && f->depth < m_depth && &m_frames[f->depth] == f, false, "portable_bin_writer: stale section handle");
+      //the traversal is depth first, so writing to f means everything opened deeper is done
+      while(m_depth > f->depth + 1)
+        close_top();
+      return true;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    void portable_bin_writer::close_top()
+    {
+      frame& f = m_frames[--m_depth];
+      //a byte was kept for the count, which fits unless there are more than 63 entries
+      varint_stream vs;
+      pack_varint(vs, f.count);
+      if(vs.m_size > 1)
+        m_buff.insert(f.count_pos + 1, vs.m_size - 1, '\0');
+      memcpy(&m_buff[f.count_pos], vs.m_data, vs.m_size);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    portable_bin_writer::frame* portable_bin_writer::push_frame(bool is_array, uint8_t type)
+    {
+      if(m_frames.size() == m_depth)
+        m_frames.emplace_back();
+      frame& f = m_frames[m_depth];
+      f.depth = m_depth;
+      f.count_pos = m_buff.size();
+      f.count = 0;
+      f.type = type;
+      f.is_array = is_array;
+      m_buff.push_back('\0');
+      ++m_depth;
+      return &f;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    bool portable_bin_writer::begin_entry(hsection hparent_section, const std::string& name, uint8_t type)
+    {
+      hparent_section = hparent_section ? hparent_section : &m_frames[0];
+      CHECK_AND_ASSERT_MES(name.size() < std::numeric_limits<uint8_t>::max(), false, "storage_entry_name is too long: " << name.size() << ", val: " << name);
+      if(!close_to(hparent_section))
+        return false;
+      CHECK_AND_ASSERT_MES(!hparent_section->is_array, false, "portable_bin_writer: named entry inside an array");
+      uint8_t len = static_cast<uint8_t>(name.size());
+      put_value(len);
+      m_buff.append(name);
+      put_value(type);
+      ++hparent_section->count;
+      return true;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    portable_bin_writer::hsection portable_bin_writer::open_section(const std::string& section_name, hsection hparent_section, bool create_if_notexist)
+    {
+      try {
+      if(!begin_entry(hparent_section, section_name, SERIALIZE_TYPE_OBJECT))
+      {
+        m_failed = true;
+        return nullptr;
+      }
+      return push_frame(false, SERIALIZE_TYPE_OBJECT);
+      PORTABLE_BIN_WRITER_CATCH("portable_bin_writer::open_section", nullptr);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_value>
+    bool portable_bin_writer::set_value(const std::string& value_name, const t_value& v, hsection hparent_section)
+    {
+      try {
+      if(!begin_entry(hparent_section, value_name, portable_type_code<t_value>::value))
+      {
+        m_failed = true;
+        return false;
+      }
+      put_value(v);
+      return true;
+      PORTABLE_BIN_WRITER_CATCH("portable_bin_writer::set_value", false);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_value>
+    portable_bin_writer::harray portable_bin_writer::insert_first_value(const std::string& value_name, const t_value& target, hsection hparent_section)
+    {
+      try {
+      if(!begin_entry(hparent_section, value_name, portable_type_code<t_value>::value | SERIALIZE_FLAG_ARRAY))
+      {
+        m_failed = true;
+        return nullptr;
+      }
+      frame* arr = push_frame(true, portable_type_code<t_value>::value);
+      put_value(target);
+      ++arr->count;
+      return arr;
+      PORTABLE_BIN_WRITER_CATCH("portable_bin_writer::insert_first_value", nullptr);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_value>
+    bool portable_bin_writer::insert_next_value(harray hval_array, const t_value& target)
+    {
+      try {
+      if(!close_to(hval_array))
+      {
+        m_failed = true;
+        return false;
+      }
+      if(!hval_array->is_array || hval_array->type != portable_type_code<t_value>::value)
+      {
+        LOG_ERROR("unexpected type in insert_next_value: " << typeid(t_value).name());
+        m_failed = true;
+        return false;
+      }
+      put_value(target);
+      ++hval_array->count;
+      return true;
+      PORTABLE_BIN_WRITER_CATCH("portable_bin_writer::insert_next_value", false);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    portable_bin_writer::harray portable_bin_writer::insert_first_section(const std::string& sec_name, hsection& hinserted_childsection, hsection hparent_section)
+    {
+      try {
+      if(!begin_entry(hparent_section, sec_name, SERIALIZE_TYPE_OBJECT | SERIALIZE_FLAG_ARRAY))
+      {
+        m_failed = true;
+        return nullptr;
+      }
+      frame* arr = push_frame(true, SERIALIZE_TYPE_OBJECT);
+      hinserted_childsection = push_frame(false, SERIALIZE_TYPE_OBJECT);
+      ++arr->count;
+      return arr;
+      PORTABLE_BIN_WRITER_CATCH("portable_bin_writer::insert_first_section", nullptr);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    bool portable_bin_writer::insert_next_section(harray hsec_array, hsection& hinserted_childsection)
+    {
+      try {
+      if(!close_to(hsec_array))
+      {
+        m_failed = true;
+        return false;
+      }
+      if(!hsec_array->is_array || hsec_array->type != SERIALIZE_TYPE_OBJECT)
+      {
+        LOG_ERROR("unexpected type(not 'section') in insert_next_section");
+        m_failed = true;
+        return false;
+      }
+      hinserted_childsection = push_frame(false, SERIALIZE_TYPE_OBJECT);
+      ++hsec_array->count;
+      return true;
+      PORTABLE_BIN_WRITER_CATCH("portable_bin_writer::insert_next_section", false);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    bool portable_bin_writer::store_to_binary(binarybuffer& target)
+    {
+      TRY_ENTRY();
+      CHECK_AND_ASSERT_MES(!m_stored, false, "portable_bin_writer: already stored");
+      CHECK_AND_ASSERT_MES(!m_failed, false, "portable_bin_writer: failed to serialize some of the entries");
+      while(m_depth)
+        close_top();
+      m_stored = true;
+      target.swap(m_buff);
+      m_buff.clear();
+      return true;
+      CATCH_ENTRY("portable_bin_writer::store_to_binary", false);
+    }
+
+    /************************************************************************/
+    /* Loads KV_SERIALIZE maps straight out of a portable binary buffer.    */
+    /* Sections are indexed in place, values are decoded only when asked   */
+    /* for. The buffer passed to load_from_binary must outlive the reader.  */
+    /************************************************************************/
+    class portable_bin_reader
+    {
+    public:
+      struct section_index
+      {
+        struct entry
+        {
+          const char* name;
+          size_t name_len;
+          uint8_t type;
+          size_t pos;
+        };
+        std::vector<entry> m_entries;
+      };
+      struct array_cursor
+      {
+        uint8_t type; //element type, without SERIALIZE_FLAG_ARRAY
+        size_t remaining;
+        size_t pos;
+        section_index current; //the element being loaded, for arrays of sections
+      };
+      typedef section_index* hsection;
+      typedef array_cursor* harray;
+      typedef storage_entry meta_entry;
+
+      portable_bin_reader():m_ptr(nullptr), m_size(0){}
+
+      bool       load_from_binary(const binarybuffer& source);
+      bool       load_from_binary(binarybuffer&& source) = delete;
+
+      hsection   open_section(const std::string& section_name,  hsection hparent_section, bool create_if_notexist = false);
+      template<class t_value>
+      bool       get_value(const std::string& value_name, t_value& val, hsection hparent_section);
+      template<class t_value>
+      harray     get_first_value(const std::string& value_name, t_value& target, hsection hparent_section);
+      template<class t_value>
+      bool       get_next_value(harray hval_array, t_value& target);
+      harray     get_first_section(const std::string& pSectionName, hsection& h_child_section, hsection hparent_section);
+      bool       get_next_section(harray hSecArray, hsection& h_child_section);
+
+    private:
+      void       need(size_t pos, size_t count) const;
+      size_t     read_varint(size_t& pos) const;
+      void       index_section(section_index& sec, size_t& pos, size_t depth) const;
+      void       skip_section(size_t& pos, size_t depth) const;
+      void       skip_value(uint8_t type, size_t& pos, size_t depth) const;
+      void       skip_array(uint8_t type, size_t& pos, size_t depth) const;
+      const section_index::entry* find_entry(const std::string& name, hsection hparent_section);
+      template<class t_value>
+      void       read_value(uint8_t type, size_t pos, t_value& target) const;
+      template<class t_pod, class t_value>
+      void       read_pod(size_t pos, t_value& target) const;
+      template<class t_value>
+      void       assign_string(const char* p, size_t len, t_value& target) const { convert_t(std::string(p, len), target); }
+      void       assign_string(const char* p, size_t len, std::string& target) const { target.assign(p, len); }
+
+      const uint8_t* m_ptr;
+      size_t m_size;
+      section_index m_root;
+      section_index m_empty;
+      std::deque<section_index> m_sections;
+      std::deque<array_cursor> m_arrays;
+    };
+
+    inline
+    size_t portable_type_pod_size(uint8_t type)
+    {
+      switch(type)
+      {
+      case SERIALIZE_TYPE_INT64:  return sizeof(int64_t);
+      case SERIALIZE_TYPE_INT32:  return sizeof(int32_t);
+      case SERIALIZE_TYPE_INT16:  return sizeof(int16_t);
+      case SERIALIZE_TYPE_INT8:   return sizeof(int8_t);
+      case SERIALIZE_TYPE_UINT64: return sizeof(uint64_t);
+      case SERIALIZE_TYPE_UINT32: return sizeof(uint32_t);
+      case SERIALIZE_TYPE_UINT16: return sizeof(uint16_t);
+      case SERIALIZE_TYPE_UINT8:  return sizeof(uint8_t);
+      case SERIALIZE_TYPE_DUOBLE: return sizeof(double);
+      case SERIALIZE_TYPE_BOOL:   return sizeof(bool);
+      default: return 0;
+      }
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    bool portable_bin_reader::load_from_binary(const binarybuffer& source)
+    {
+      m_root.m_entries.clear();
+      m_sections.clear();
+      m_arrays.clear();
+      const size_t header_size = 2 * sizeof(uint32_t) + sizeof(uint8_t);
+      if(source.size() < header_size)
+      {
+        LOG_ERROR("portable_storage: wrong binary format, packet size = " << source.size() << " less than expected sizeof(storage_block_header)=" << header_size);
+        return false;
+      }
+      uint32_t signature_a = 0, signature_b = 0;
+      memcpy(&signature_a, source.data(), sizeof(signature_a));
+      memcpy(&signature_b, source.data() + sizeof(signature_a), sizeof(signature_b));
+      uint8_t ver = source[2 * sizeof(uint32_t)];
+      if(signature_a != PORTABLE_STORAGE_SIGNATUREA || signature_b != PORTABLE_STORAGE_SIGNATUREB)
+      {
+        LOG_ERROR("portable_storage: wrong binary format - signature missmatch");
+        return false;
+      }
+      if(ver != PORTABLE_STORAGE_FORMAT_VER)
+      {
+        LOG_ERROR("portable_storage: wrong binary format - unknown format ver = " << ver);
+        return false;
+      }
+      TRY_ENTRY();
+      m_ptr = (const uint8_t*)source.data() + header_size;
+      m_size = source.size() - header_size;
+      //indexing the root walks the whole buffer, so a malformed one is rejected here like the tree loader does
+      size_t pos = 0;
+      index_section(m_root, pos, 0);
+      return true;
+      CATCH_ENTRY("portable_bin_reader::load_from_binary", false);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    void portable_bin_reader::need(size_t pos, size_t count) const
+    {
+      CHECK_AND_ASSERT_THROW_MES(pos <= m_size && count <= m_size - pos, " attempt to read " << count << " bytes from buffer with " << (pos <= m_size ? m_size - pos : 0) << " bytes remained");
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    size_t portable_bin_reader::read_varint(size_t& pos) const
+    {
+      need(pos, 1);
+      size_t size = 0;
+      switch(m_ptr[pos] & PORTABLE_RAW_SIZE_MARK_MASK)
+      {
+      case PORTABLE_RAW_SIZE_MARK_BYTE:  size = sizeof(uint8_t); break;
+      case PORTABLE_RAW_SIZE_MARK_WORD:  size = sizeof(uint16_t); break;
+      case PORTABLE_RAW_SIZE_MARK_DWORD: size = sizeof(uint32_t); break;
+      case PORTABLE_RAW_SIZE_MARK_INT64: size = sizeof(uint64_t); break;
+      }
+      need(pos, size);
+      uint64_t v = 0;
+      memcpy(&v, m_ptr + pos, size);
+      pos += size;
+      return static_cast<size_t>(v >> 2);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    void portable_bin_reader::index_section(section_index& sec, size_t& pos, size_t depth) const
+    {
+      CHECK_AND_ASSERT_THROW_MES(depth < EPEE_PORTABLE_STORAGE_RECURSION_LIMIT_INTERNAL, "Wrong blob data in portable storage: recursion limitation (" << EPEE_PORTABLE_STORAGE_RECURSION_LIMIT_INTERNAL << ") exceeded");
+      sec.m_entries.clear();
+      size_t count = read_varint(pos);
+      //every entry takes at least two bytes, so a bogus count can't make us reserve more than the input
+      sec.m_entries.reserve(std::min(count, (m_size - pos) / 2));
+      while(count--)
+      {
+        need(pos, 1);
+        section_index::entry e;
+        e.name_len = m_ptr[pos++];
+        need(pos, e.name_len + 1);
+        e.name = (const char*)m_ptr + pos;
+        pos += e.name_len;
+        e.type = m_ptr[pos++];
+        e.pos = pos;
+        skip_value(e.type, pos, depth);
+        sec.m_entries.push_back(e);
+      }
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    void portable_bin_reader::skip_section(size_t& pos, size_t depth) const
+    {
+      CHECK_AND_ASSERT_THROW_MES(depth < EPEE_PORTABLE_STORAGE_RECURSION_LIMIT_INTERNAL, "Wrong blob data in portable storage: recursion limitation (" << EPEE_PORTABLE_STORAGE_RECURSION_LIMIT_INTERNAL << ") exceeded");
+      size_t count = read_varint(pos);
+      while(count--)
+      {
+        need(pos, 1);
+        size_t name_len = m_ptr[pos++];
+        need(pos, name_len + 1);
+        pos += name_len;
+        uint8_t type = m_ptr[pos++];
+        skip_value(type, pos, depth);
+      }
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    void portable_bin_reader::skip_value(uint8_t type, size_t& pos, size_t depth) const
+    {
+      if(type & SERIALIZE_FLAG_ARRAY)
+        return skip_array(type & ~SERIALIZE_FLAG_ARRAY, pos, depth + 1);
+
+      size_t pod_size = portable_type_pod_size(type);
+      if(pod_size)
+      {
+        need(pos, pod_size);
+        pos += pod_size;
+        return;
+      }
+      switch(type)
+      {
+      case SERIALIZE_TYPE_STRING:
+        {
+          size_t len = read_varint(pos);
+          CHECK_AND_ASSERT_THROW_MES(len < MAX_STRING_LEN_POSSIBLE, "to big string len value in storage: " << len);
+          need(pos, len);
+          pos += len;
+          return;
+        }
+      case SERIALIZE_TYPE_OBJECT:
+        return skip_section(pos, depth + 1);
+      case SERIALIZE_TYPE_ARRAY:
+        {
+          need(pos, 1);
+          uint8_t ent_type = m_ptr[pos++];
+          CHECK_AND_ASSERT_THROW_MES(ent_type&SERIALIZE_FLAG_ARRAY, "wrong type sequenses");
+          return skip_array(ent_type & ~SERIALIZE_FLAG_ARRAY, pos, depth + 1);
+        }
+      default:
+        ASSERT_MES_AND_THROW("unknown entry_type code = " << (unsigned)type);
+      }
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    void portable_bin_reader::skip_array(uint8_t type, size_t& pos, size_t depth) const
+    {
+      CHECK_AND_ASSERT_THROW_MES(depth < EPEE_PORTABLE_STORAGE_RECURSION_LIMIT_INTERNAL, "Wrong blob data in portable storage: recursion limitation (" << EPEE_PORTABLE_STORAGE_RECURSION_LIMIT_INTERNAL << ") exceeded");
+      size_t count = read_varint(pos);
+      size_t pod_size = portable_type_pod_size(type);
+      if(pod_size)
+      {
+        CHECK_AND_ASSERT_THROW_MES(count <= (m_size - pos) / pod_size, "array of " << count << " elements goes out of remain storage len " << m_size - pos);
+        pos += count * pod_size;
+        return;
+      }
+      //nested arrays aren't produced by KV_SERIALIZE and the tree loader can't read them either
+      CHECK_AND_ASSERT_THROW_MES(type == SERIALIZE_TYPE_STRING || type == SERIALIZE_TYPE_OBJECT, "unsupported array entry_type code = " << (unsigned)type);
+      while(count--)
+        skip_value(type, pos, depth);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    const portable_bin_reader::section_index::entry* portable_bin_reader::find_entry(const std::string& name, hsection hparent_section)
+    {
+      const section_index& sec = hparent_section ? *hparent_section : m_root;
+      for(const section_index::entry& e: sec.m_entries)
+      {
+        if(e.name_len == name.size() && !memcmp(e.name, name.data(), e.name_len))
+          return &e;
+      }
+      return nullptr;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_pod, class t_value>
+    void portable_bin_reader::read_pod(size_t pos, t_value& target) const
+    {
+      need(pos, sizeof(t_pod));
+      t_pod v;
+      memcpy(&v, m_ptr + pos, sizeof(t_pod));
+      convert_t(v, target);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_value>
+    void portable_bin_reader::read_value(uint8_t type, size_t pos, t_value& target) const
+    {
+      switch(type)
+      {
+      case SERIALIZE_TYPE_INT64:  return read_pod<int64_t>(pos, target);
+      case SERIALIZE_TYPE_INT32:  return read_pod<int32_t>(pos, target);
+      case SERIALIZE_TYPE_INT16:  return read_pod<int16_t>(pos, target);
+      case SERIALIZE_TYPE_INT8:   return read_pod<int8_t>(pos, target);
+      case SERIALIZE_TYPE_UINT64: return read_pod<uint64_t>(pos, target);
+      case SERIALIZE_TYPE_UINT32: return read_pod<uint32_t>(pos, target);
+      case SERIALIZE_TYPE_UINT16: return read_pod<uint16_t>(pos, target);
+      case SERIALIZE_TYPE_UINT8:  return read_pod<uint8_t>(pos, target);
+      case SERIALIZE_TYPE_DUOBLE: return read_pod<double>(pos, target);
+      case SERIALIZE_TYPE_BOOL:   return read_pod<bool>(pos, target);
+      case SERIALIZE_TYPE_STRING:
+        {
+          size_t len = read_varint(pos);
+          need(pos, len);
+          return assign_string((const char*)m_ptr + pos, len, target);
+        }
+      default:
+        ASSERT_MES_AND_THROW("WRONG DATA CONVERSION: from entry_type code=" << (unsigned)type << " to type " << typeid(t_value).name());
+      }
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    portable_bin_reader::hsection portable_bin_reader::open_section(const std::string& section_name, hsection hparent_section, bool create_if_notexist)
+    {
+      TRY_ENTRY();
+      const section_index::entry* e = find_entry(section_name, hparent_section);
+      if(!e || e->type != SERIALIZE_TYPE_OBJECT)
+      {
+        //the tree storage hands out a fresh empty section in this case
+        return create_if_notexist ? &m_empty : nullptr;
+      }
+      m_sections.emplace_back();
+      size_t pos = e->pos;
+      index_section(m_sections.back(), pos, 0);
+      return &m_sections.back();
+      CATCH_ENTRY("portable_bin_reader::open_section", nullptr);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_value>
+    bool portable_bin_reader::get_value(const std::string& value_name, t_value& val, hsection hparent_section)
+    {
+      const section_index::entry* e = find_entry(value_name, hparent_section);
+      if(!e)
+        return false;
+      read_value(e->type, e->pos, val);
+      return true;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_value>
+    portable_bin_reader::harray portable_bin_reader::get_first_value(const std::string& value_name, t_value& target, hsection hparent_section)
+    {
+      const section_index::entry* e = find_entry(value_name, hparent_section);
+      if(!e || !(e->type & SERIALIZE_FLAG_ARRAY))
+        return nullptr;
+      size_t pos = e->pos;
+      size_t count = read_varint(pos);
+      if(!count)
+        return nullptr;
+      m_arrays.emplace_back();
+      array_cursor& a = m_arrays.back();
+      a.type = e->type & ~SERIALIZE_FLAG_ARRAY;
+      a.remaining = count;
+      a.pos = pos;
+      if(!get_next_value(&a, target))
+        return nullptr;
+      return &a;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_value>
+    bool portable_bin_reader::get_next_value(harray hval_array, t_value& target)
+    {
+      CHECK_AND_ASSERT(hval_array, false);
+      if(!hval_array->remaining)
+        return false;
+      read_value(hval_array->type, hval_array->pos, target);
+      skip_value(hval_array->type, hval_array->pos, 0);
+      --hval_array->remaining;
+      return true;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    portable_bin_reader::harray portable_bin_reader::get_first_section(const std::string& sec_name, hsection& h_child_section, hsection hparent_section)
+    {
+      TRY_ENTRY();
+      const section_index::entry* e = find_entry(sec_name, hparent_section);
+      if(!e || e->type != (SERIALIZE_TYPE_OBJECT | SERIALIZE_FLAG_ARRAY))
+        return nullptr;
+      size_t pos = e->pos;
+      size_t count = read_varint(pos);
+      if(!count)
+        return nullptr;
+      m_arrays.emplace_back();
+      array_cursor& a = m_arrays.back();
+      a.type = SERIALIZE_TYPE_OBJECT;
+      a.remaining = count;
+      a.pos = pos;
+      if(!get_next_section(&a, h_child_section))
+        return nullptr;
+      return &a;
+      CATCH_ENTRY("portable_bin_reader::get_first_section", nullptr);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    bool portable_bin_reader::get_next_section(harray hsec_array, hsection& h_child_section)
+    {
+      TRY_ENTRY();
+      CHECK_AND_ASSERT(hsec_array, false);
+      if(hsec_array->type != SERIALIZE_TYPE_OBJECT || !hsec_array->remaining)
+        return false;
+      //the previous element has been fully loaded by now, so its index can be reused
+      index_section(hsec_array->current, hsec_array->pos, 0);
+      --hsec_array->remaining;
+      h_child_section = &hsec_array->current;
+      return true;
+      CATCH_ENTRY("portable_bin_reader::get_next_section", false);
+    }
+  }
+}
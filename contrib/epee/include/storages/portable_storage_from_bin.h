@@ -134,10 +134,11 @@ namespace epee
       //for pod types
       array_entry_t<type_name> sa;
       size_t size = read_varint();
-      //TODO: add some optimization here later
+      //every element takes at least a byte, so a bogus size can't make us reserve more than the input
+      sa.reserve(std::min(size, m_count));
       while(size--)
         sa.m_array.push_back(read<type_name>());        
-      return storage_entry(array_entry(sa));
+      return storage_entry(array_entry(std::move(sa)));
     }
 
     inline 
@@ -262,7 +263,7 @@ namespace epee
         //read section name string
         std::string sec_name;
         read_sec_name(sec_name);
-        sec.m_entries.insert(std::make_pair(sec_name, load_storage_entry()));
+        sec.m_entries.emplace(std::move(sec_name), load_storage_entry());
       }
     }
     inline 
@@ -0,0 +1,588 @@
+// Copyright (c) 2006-2013, Andrey N. Sabelnikov, www.sabelnikov.net
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+// * Neither the name of the Andrey N. Sabelnikov nor the
+// names of its contributors may be used to endorse or promote products
+// derived from this software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER  BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 
+
+
+#pragma once
+
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include "misc_language.h"
+#include "portable_storage_base.h"
+#include "portable_storage_val_converters.h"
+#include "rapidjson/document.h"
+#include "rapidjson/writer.h"
+#include "rapidjson/prettywriter.h"
+
+namespace epee
+{
+  namespace serialization
+  {
+    //rapidjson output stream appending straight to a std::string
+    struct json_string_sink
+    {
+      typedef char Ch;
+      std::string m_buff;
+      //when set, takes the text each time it reaches m_spill_size and empties m_buff
+      std::function<void(std::string&)> m_spill;
+      size_t m_spill_size = 0;
+      void Put(char c) { m_buff.push_back(c); if(m_spill_size && m_buff.size() >= m_spill_size) m_spill(m_buff); }
+      void Flush() {}
+    };
+
+    /************************************************************************/
+    /* Writes KV_SERIALIZE maps as JSON through a rapidjson SAX writer,     */
+    /* without building a portable_storage tree first. Entries come out in  */
+    /* declaration order rather than sorted by name.                        */
+    /************************************************************************/
+    template<class t_json_writer>
+    class portable_json_writer_t
+    {
+    public:
+      struct frame
+      {
+        size_t depth;
+        bool is_array;
+      };
+      typedef frame* hsection;
+      typedef frame* harray;
+      typedef storage_entry meta_entry;
+
+      portable_json_writer_t();
+
+      hsection   open_section(const std::string& section_name,  hsection hparent_section, bool create_if_notexist = false);
+      template<class t_value>
+      bool       set_value(const std::string& value_name, const t_value& target, hsection hparent_section);
+      template<class t_value>
+      harray     insert_first_value(const std::string& value_name, const t_value& target, hsection hparent_section);
+      template<class t_value>
+      bool       insert_next_value(harray hval_array, const t_value& target);
+      harray     insert_first_section(const std::string& pSectionName, hsection& hinserted_childsection, hsection hparent_section);
+      bool       insert_next_section(harray hSecArray, hsection& hinserted_childsection);
+
+      //closes everything still open and hands the buffer over, so it can only be called once
+      bool       store_to_json(std::string& target);
+      //hands the text written so far over to spill every spill_size bytes, store_to_json only gets the rest
+      void       set_spill(size_t spill_size, const std::function<void(std::string&)>& spill) { m_sink.m_spill_size = spill_size; m_sink.m_spill = spill; }
+
+    private:
+      bool       close_to(frame* f);
+      void       close_top();
+      frame*     push_frame(bool is_array);
+      bool       begin_entry(hsection hparent_section, const std::string& name);
+
+      void       put_value(uint64_t v) { m_writer.Uint64(v); }
+      void       put_value(uint32_t v) { m_writer.Uint(v); }
+      void       put_value(uint16_t v) { m_writer.Uint(v); }
+      void       put_value(uint8_t v)  { m_writer.Uint(v); }
+      void       put_value(int64_t v)  { m_writer.Int64(v); }
+      void       put_value(int32_t v)  { m_writer.Int(v); }
+      void       put_value(int16_t v)  { m_writer.Int(v); }
+      void       put_value(int8_t v)   { m_writer.Int(v); }
+      void       put_value(bool v)     { m_writer.Bool(v); }
+      //the tree printed these as nan/inf, which no JSON parser accepts
+      void       put_value(double v)   { if(std::isfinite(v)) m_writer.Double(v); else m_writer.Null(); }
+      void       put_value(const std::string& v) { m_writer.String(v.data(), static_cast<rapidjson::SizeType>(v.size())); }
+      void       put_value(const section& v);
+      void       put_value(const array_entry& v);
+      void       put_value(const storage_entry& v);
+
+      struct entry_visitor: public boost::static_visitor<void>
+      {
+        portable_json_writer_t& m_self;
+        entry_visitor(portable_json_writer_t& self):m_self(self){}
+        template<class t_type>
+        void operator()(const t_type& v) { m_self.put_value(v); }
+        template<class t_type>
+        void operator()(const array_entry_t<t_type>& a)
+        {
+          m_self.m_writer.StartArray();
+          for(const t_type& v: a.m_array)
+            m_self.put_value(v);
+          m_self.m_writer.EndArray();
+        }
+      };
+
+      json_string_sink m_sink;
+      t_json_writer m_writer;
+      std::deque<frame> m_frames; //open objects and arrays, one per nesting level
+      size_t m_depth;
+      bool m_failed;
+      bool m_stored;
+    };
+
+    typedef portable_json_writer_t<rapidjson::Writer<json_string_sink> > portable_json_writer;
+    typedef portable_json_writer_t<rapidjson::PrettyWriter<json_string_sink> > portable_json_pretty_writer;
+
+    template<class t_json_writer>
+    portable_json_writer_t<t_json_writer>::portable_json_writer_t():m_writer(m_sink), m_depth(0), m_failed(false), m_stored(false)
+    {
+      m_writer.StartObject();
+      push_frame(false);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_json_writer>
+    bool portable_json_writer_t<t_json_writer>::close_to(frame* f)
+    {
+      CHECK_AND_ASSERT_MES(!m_stored, false, "portable_json_writer: already stored");
+      CHECK_AND_ASSERT_MES(f && f->depth < m_depth && &m_frames[f->depth] == f, false, "portable_json_writer: stale section handle");
+      //the traversal is depth first, so writing to f means everything opened deeper is done
+      while(m_depth > f->depth + 1)
+        close_top();
+      return true;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_json_writer>
+    void portable_json_writer_t<t_json_writer>::close_top()
+    {
+      frame& f = m_frames[--m_depth];
+      if(f.is_array)
+        m_writer.EndArray();
+      else
+        m_writer.EndObject();
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_json_writer>
+    typename portable_json_writer_t<t_json_writer>::frame* portable_json_writer_t<t_json_writer>::push_frame(bool is_array)
+    {
+      if(m_frames.size() == m_depth)
+        m_frames.emplace_back();
+      frame& f = m_frames[m_depth];
+      f.depth = m_depth;
+      f.is_array = is_array;
+      ++m_depth;
+      return &f;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_json_writer>
+    bool portable_json_writer_t<t_json_writer>::begin_entry(hsection hparent_section, const std::string& name)
+    {
+      hparent_section = hparent_section ? hparent_section : &m_frames[0];
+      if(!close_to(hparent_section))
+      {
+        m_failed = true;
+        return false;
+      }
+      if(hparent_section->is_array)
+      {
+        LOG_ERROR("portable_json_writer: named entry inside an array");
+        m_failed = true;
+        return false;
+      }
+      m_writer.Key(name.data(), static_cast<rapidjson::SizeType>(name.size()));
+      return true;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_json_writer>
+    void portable_json_writer_t<t_json_writer>::put_value(const section& v)
+    {
+      m_writer.StartObject();
+      for(const auto& se: v.m_entries)
+      {
+        m_writer.Key(se.first.data(), static_cast<rapidjson::SizeType>(se.first.size()));
+        put_value(se.second);
+      }
+      m_writer.EndObject();
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_json_writer>
+    void portable_json_writer_t<t_json_writer>::put_value(const array_entry& v)
+    {
+      entry_visitor ev(*this);
+      boost::apply_visitor(ev, v);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_json_writer>
+    void portable_json_writer_t<t_json_writer>::put_value(const storage_entry& v)
+    {
+      entry_visitor ev(*this);
+      boost::apply_visitor(ev, v);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_json_writer>
+    typename portable_json_writer_t<t_json_writer>::hsection portable_json_writer_t<t_json_writer>::open_section(const std::string& section_name, hsection hparent_section, bool create_if_notexist)
+    {
+      TRY_ENTRY();
+      if(!begin_entry(hparent_section, section_name))
+        return nullptr;
+      m_writer.StartObject();
+      return push_frame(false);
+      CATCH_ENTRY("portable_json_writer::open_section", nullptr);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_json_writer>
+    template<class t_value>
+    bool portable_json_writer_t<t_json_writer>::set_value(const std::string& value_name, const t_value& v, hsection hparent_section)
+    {
+      TRY_ENTRY();
+      if(!begin_entry(hparent_section, value_name))
+        return false;
+      put_value(v);
+      return true;
+      CATCH_ENTRY("portable_json_writer::set_value", false);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_json_writer>
+    template<class t_value>
+    typename portable_json_writer_t<t_json_writer>::harray portable_json_writer_t<t_json_writer>::insert_first_value(const std::string& value_name, const t_value& target, hsection hparent_section)
+    {
+      TRY_ENTRY();
+      if(!begin_entry(hparent_section, value_name))
+        return nullptr;
+      m_writer.StartArray();
+      frame* arr = push_frame(true);
+      put_value(target);
+      return arr;
+      CATCH_ENTRY("portable_json_writer::insert_first_value", nullptr);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_json_writer>
+    template<class t_value>
+    bool portable_json_writer_t<t_json_writer>::insert_next_value(harray hval_array, const t_value& target)
+    {
+      TRY_ENTRY();
+      if(!close_to(hval_array) || !hval_array->is_array)
+      {
+        m_failed = true;
+        return false;
+      }
+      put_value(target);
+      return true;
+      CATCH_ENTRY("portable_json_writer::insert_next_value", false);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_json_writer>
+    typename portable_json_writer_t<t_json_writer>::harray portable_json_writer_t<t_json_writer>::insert_first_section(const std::string& sec_name, hsection& hinserted_childsection, hsection hparent_section)
+    {
+      TRY_ENTRY();
+      if(!begin_entry(hparent_section, sec_name))
+        return nullptr;
+      m_writer.StartArray();
+      frame* arr = push_frame(true);
+      m_writer.StartObject();
+      hinserted_childsection = push_frame(false);
+      return arr;
+      CATCH_ENTRY("portable_json_writer::insert_first_section", nullptr);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_json_writer>
+    bool portable_json_writer_t<t_json_writer>::insert_next_section(harray hsec_array, hsection& hinserted_childsection)
+    {
+      TRY_ENTRY();
+      if(!close_to(hsec_array) || !hsec_array->is_array)
+      {
+        m_failed = true;
+        return false;
+      }
+      m_writer.StartObject();
+      hinserted_childsection = push_frame(false);
+      return true;
+      CATCH_ENTRY("portable_json_writer::insert_next_section", false);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_json_writer>
+    bool portable_json_writer_t<t_json_writer>::store_to_json(std::string& target)
+    {
+      TRY_ENTRY();
+      CHECK_AND_ASSERT_MES(!m_stored, false, "portable_json_writer: already stored");
+      while(m_depth)
+        close_top();
+      m_stored = true;
+      target.swap(m_sink.m_buff);
+      m_sink.m_buff.clear();
+      CHECK_AND_ASSERT_MES(!m_failed, false, "portable_json_writer: failed to serialize some of the entries");
+      return true;
+      CATCH_ENTRY("portable_json_writer::store_to_json", false);
+    }
+
+    /************************************************************************/
+    /* Loads KV_SERIALIZE maps out of a rapidjson document, with the same   */
+    /* number conversions as the tree. Nulls count as missing entries.      */
+    /************************************************************************/
+    class portable_json_reader
+    {
+    public:
+      struct array_cursor
+      {
+        const rapidjson::Value* m_array;
+        rapidjson::SizeType m_index;
+      };
+      typedef const rapidjson::Value* hsection;
+      typedef array_cursor* harray;
+      typedef storage_entry meta_entry;
+
+      portable_json_reader():m_empty(rapidjson::kObjectType){}
+
+      bool       load_from_json(const std::string& source);
+
+      hsection   open_section(const std::string& section_name,  hsection hparent_section, bool create_if_notexist = false);
+      template<class t_value>
+      bool       get_value(const std::string& value_name, t_value& val, hsection hparent_section);
+      bool       get_value(const std::string& value_name, storage_entry& val, hsection hparent_section);
+      template<class t_value>
+      harray     get_first_value(const std::string& value_name, t_value& target, hsection hparent_section);
+      template<class t_value>
+      bool       get_next_value(harray hval_array, t_value& target);
+      harray     get_first_section(const std::string& pSectionName, hsection& h_child_section, hsection hparent_section);
+      bool       get_next_section(harray hSecArray, hsection& h_child_section);
+
+    private:
+      const rapidjson::Value* find_entry(const std::string& name, hsection hparent_section) const;
+      template<class t_value>
+      void       read_value(const rapidjson::Value& v, t_value& target) const;
+      template<class t_value>
+      void       assign_string(const rapidjson::Value& v, t_value& target) const { convert_t(std::string(v.GetString(), v.GetStringLength()), target); }
+      void       assign_string(const rapidjson::Value& v, std::string& target) const { target.assign(v.GetString(), v.GetStringLength()); }
+      static bool to_storage_entry(const rapidjson::Value& v, storage_entry& se);
+
+      rapidjson::Document m_doc;
+      rapidjson::Value m_empty;
+      std::deque<array_cursor> m_arrays;
+    };
+
+    inline
+    bool portable_json_reader::load_from_json(const std::string& source)
+    {
+      m_arrays.clear();
+      //like the old parser, anything after the closing brace of the root object is ignored
+      m_doc.Parse<rapidjson::kParseStopWhenDoneFlag | rapidjson::kParseFullPrecisionFlag>(source.c_str(), source.size());
+      if(m_doc.HasParseError())
+      {
+        LOG_PRINT_RED_L0("Failed to parse json, error " << m_doc.GetParseError() << " at offset " << m_doc.GetErrorOffset());
+        return false;
+      }
+      if(!m_doc.IsObject())
+      {
+        LOG_PRINT_RED_L0("Failed to parse json, root is not an object");
+        return false;
+      }
+      return true;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    const rapidjson::Value* portable_json_reader::find_entry(const std::string& name, hsection hparent_section) const
+    {
+      const rapidjson::Value& sec = hparent_section ? *hparent_section : m_doc;
+      for(rapidjson::Value::ConstMemberIterator it = sec.MemberBegin(); it != sec.MemberEnd(); ++it)
+      {
+        if(it->name.GetStringLength() == name.size() && !memcmp(it->name.GetString(), name.data(), name.size()))
+          return it->value.IsNull() ? nullptr : &it->value;
+      }
+      return nullptr;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_value>
+    void portable_json_reader::read_value(const rapidjson::Value& v, t_value& target) const
+    {
+      if(v.IsString())
+        assign_string(v, target);
+      else if(v.IsBool())
+        convert_t(v.GetBool(), target);
+      else if(v.IsUint64())
+        convert_t(v.GetUint64(), target);
+      else if(v.IsInt64())
+        convert_t(v.GetInt64(), target);
+      else if(v.IsDouble())
+        convert_t(v.GetDouble(), target);
+      else
+        ASSERT_MES_AND_THROW("WRONG DATA CONVERSION: from json type=" << v.GetType() << " to type " << typeid(t_value).name());
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    portable_json_reader::hsection portable_json_reader::open_section(const std::string& section_name, hsection hparent_section, bool create_if_notexist)
+    {
+      const rapidjson::Value* v = find_entry(section_name, hparent_section);
+      if(!v || !v->IsObject())
+      {
+        //the tree storage hands out a fresh empty section in this case
+        return create_if_notexist ? &m_empty : nullptr;
+      }
+      return v;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_value>
+    bool portable_json_reader::get_value(const std::string& value_name, t_value& val, hsection hparent_section)
+    {
+      const rapidjson::Value* v = find_entry(value_name, hparent_section);
+      if(!v)
+        return false;
+      read_value(*v, val);
+      return true;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    bool portable_json_reader::get_value(const std::string& value_name, storage_entry& val, hsection hparent_section)
+    {
+      const rapidjson::Value* v = find_entry(value_name, hparent_section);
+      if(!v)
+        return false;
+      return to_storage_entry(*v, val);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    bool portable_json_reader::to_storage_entry(const rapidjson::Value& v, storage_entry& se)
+    {
+      if(v.IsString())
+        se = std::string(v.GetString(), v.GetStringLength());
+      else if(v.IsBool())
+        se = v.GetBool();
+      else if(v.IsUint64())
+        se = v.GetUint64();
+      else if(v.IsInt64())
+        se = v.GetInt64();
+      else if(v.IsDouble())
+        se = v.GetDouble();
+      else if(v.IsObject())
+      {
+        section s;
+        for(rapidjson::Value::ConstMemberIterator it = v.MemberBegin(); it != v.MemberEnd(); ++it)
+        {
+          storage_entry child;
+          if(to_storage_entry(it->value, child))
+            s.m_entries.emplace(std::string(it->name.GetString(), it->name.GetStringLength()), std::move(child));
+        }
+        se = std::move(s);
+      }
+      else if(v.IsArray())
+      {
+        //arrays are typed by their first element, as in the old parser
+        if(v.Empty())
+          return false;
+        const rapidjson::Value& first = v[0];
+        if(first.IsString())
+        {
+          array_entry_t<std::string> a;
+          for(rapidjson::SizeType i = 0; i < v.Size(); ++i)
+          {
+            CHECK_AND_ASSERT_THROW_MES(v[i].IsString(), "mixed types in json array");
+            a.insert_next_value(std::string(v[i].GetString(), v[i].GetStringLength()));
+          }
+          se = array_entry(std::move(a));
+        }
+        else if(first.IsBool())
+        {
+          array_entry_t<bool> a;
+          for(rapidjson::SizeType i = 0; i < v.Size(); ++i)
+          {
+            CHECK_AND_ASSERT_THROW_MES(v[i].IsBool(), "mixed types in json array");
+            a.insert_next_value(v[i].GetBool());
+          }
+          se = array_entry(std::move(a));
+        }
+        else if(first.IsObject())
+        {
+          array_entry_t<section> a;
+          for(rapidjson::SizeType i = 0; i < v.Size(); ++i)
+          {
+            CHECK_AND_ASSERT_THROW_MES(v[i].IsObject(), "mixed types in json array");
+            storage_entry child;
+            to_storage_entry(v[i], child);
+            a.insert_next_value(boost::get<section>(child));
+          }
+          se = array_entry(std::move(a));
+        }
+        else if(first.IsInt64())
+        {
+          array_entry_t<int64_t> a;
+          for(rapidjson::SizeType i = 0; i < v.Size(); ++i)
+          {
+            CHECK_AND_ASSERT_THROW_MES(v[i].IsInt64(), "mixed types in json array");
+            a.insert_next_value(v[i].GetInt64());
+          }
+          se = array_entry(std::move(a));
+        }
+        else if(first.IsNumber())
+        {
+          array_entry_t<double> a;
+          for(rapidjson::SizeType i = 0; i < v.Size(); ++i)
+          {
+            CHECK_AND_ASSERT_THROW_MES(v[i].IsNumber(), "mixed types in json array");
+            a.insert_next_value(v[i].GetDouble());
+          }
+          se = array_entry(std::move(a));
+        }
+        else
+          ASSERT_MES_AND_THROW("array of array not suppoerted yet :( sorry");
+      }
+      else
+        return false;
+      return true;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_value>
+    portable_json_reader::harray portable_json_reader::get_first_value(const std::string& value_name, t_value& target, hsection hparent_section)
+    {
+      const rapidjson::Value* v = find_entry(value_name, hparent_section);
+      if(!v || !v->IsArray() || v->Empty())
+        return nullptr;
+      m_arrays.emplace_back();
+      array_cursor& a = m_arrays.back();
+      a.m_array = v;
+      a.m_index = 0;
+      if(!get_next_value(&a, target))
+        return nullptr;
+      return &a;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_value>
+    bool portable_json_reader::get_next_value(harray hval_array, t_value& target)
+    {
+      CHECK_AND_ASSERT(hval_array, false);
+      if(hval_array->m_index >= hval_array->m_array->Size())
+        return false;
+      read_value((*hval_array->m_array)[hval_array->m_index++], target);
+      return true;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    portable_json_reader::harray portable_json_reader::get_first_section(const std::string& sec_name, hsection& h_child_section, hsection hparent_section)
+    {
+      const rapidjson::Value* v = find_entry(sec_name, hparent_section);
+      if(!v || !v->IsArray() || v->Empty() || !(*v)[0].IsObject())
+        return nullptr;
+      m_arrays.emplace_back();
+      array_cursor& a = m_arrays.back();
+      a.m_array = v;
+      a.m_index = 0;
+      if(!get_next_section(&a, h_child_section))
+        return nullptr;
+      return &a;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    bool portable_json_reader::get_next_section(harray hsec_array, hsection& h_child_section)
+    {
+      CHECK_AND_ASSERT(hsec_array, false);
+      if(hsec_array->m_index >= hsec_array->m_array->Size())
+        return false;
+      const rapidjson::Value& v = (*hsec_array->m_array)[hsec_array->m_index++];
+      CHECK_AND_ASSERT_THROW_MES(v.IsObject(), "mixed types in json array");
+      h_child_section = &v;
+      return true;
+    }
+  }
+}
@@ -30,6 +30,8 @@
 
 #include "parserse_base_utils.h"
 #include "portable_storage.h"
+#include "portable_storage_bin_stream.h"
+#include "portable_storage_json_stream.h"
 #include "file_io_utils.h"
 
 namespace epee
@@ -40,12 +42,12 @@ namespace epee
     template<class t_struct>
     bool load_t_from_json(t_struct& out, const std::string& json_buff)
     {
-      portable_storage ps;
-      bool rs = ps.load_from_json(json_buff);
+      portable_json_reader reader;
+      bool rs = reader.load_from_json(json_buff);
       if(!rs)
         return false;
 
-      return out.load(ps);
+      return out.load(reader);
     }
     //-----------------------------------------------------------------------------------------------------------
     template<class t_struct>
@@ -61,10 +63,25 @@ namespace epee
     template<class t_struct>
     bool store_t_to_json(t_struct& str_in, std::string& json_buff, size_t indent = 0, bool insert_newlines = true)
     {
-      portable_storage ps;
-      str_in.store(ps);
-      ps.dump_as_json(json_buff, indent, insert_newlines);
-      return true;
+      if(insert_newlines)
+      {
+        portable_json_pretty_writer writer;
+        str_in.store(writer);
+        return writer.store_to_json(json_buff);
+      }
+      portable_json_writer writer;
+      str_in.store(writer);
+      return writer.store_to_json(json_buff);
+    }
+    //-----------------------------------------------------------------------------------------------------------
+    //as store_t_to_json, but the text goes to spill in pieces of spill_size as it is written, only the rest to json_buff
+    template<class t_struct>
+    bool store_t_to_json_spilled(t_struct& str_in, std::string& json_buff, size_t spill_size, const std::function<void(std::string&)>& spill)
+    {
+      portable_json_pretty_writer writer;
+      writer.set_spill(spill_size, spill);
+      str_in.store(writer);
+      return writer.store_to_json(json_buff);
     }
     //-----------------------------------------------------------------------------------------------------------
     template<class t_struct>
@@ -86,12 +103,12 @@ namespace epee
     template<class t_struct>
     bool load_t_from_binary(t_struct& out, const std::string& binary_buff)
     {
-      portable_storage ps;
-      bool rs = ps.load_from_binary(binary_buff);
+      portable_bin_reader reader;
+      bool rs = reader.load_from_binary(binary_buff);
       if(!rs)
         return false;
 
-      return out.load(ps);
+      return out.load(reader);
     }
     //-----------------------------------------------------------------------------------------------------------
     template<class t_struct>
@@ -107,9 +124,9 @@ namespace epee
     template<class t_struct>
     bool store_t_to_binary(t_struct& str_in, std::string& binary_buff, size_t indent = 0)
     {
-      portable_storage ps;
-      str_in.store(ps);
-      return ps.store_to_binary(binary_buff);
+      portable_bin_writer writer;
+      str_in.store(writer);
+      return writer.store_to_binary(binary_buff);
     }
     //-----------------------------------------------------------------------------------------------------------
     template<class t_struct>
@@ -42,6 +42,11 @@
 #include <boost/algorithm/string/compare.hpp>
 #include <boost/algorithm/string.hpp>
 #include "warnings.h"
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
 
 
 #ifndef OUT
@@ -125,6 +130,105 @@ namespace string_tools
     return hexStream.str();
   }
   //----------------------------------------------------------------------------
+  //lowercase hex of size bytes into dst, which takes 2 * size chars
+  inline void encode_hex(const void* src, size_t size, char* dst)
+  {
+    static const char digits[] = "0123456789abcdef";
+    const unsigned char* in = static_cast<const unsigned char*>(src);
+    const unsigned char* const end = in + size;
+#if defined(__AVX2__)
+    const __m256i digits_avx = _mm256_setr_epi8('0','1','2','3','4','5','6','7','8','9','a','b','c','d','e','f',
+                                                '0','1','2','3','4','5','6','7','8','9','a','b','c','d','e','f');
+    for(; end - in >= 32; in += 32, dst += 64)
+    {
+      const __m256i v = _mm256_loadu_si256((const __m256i*)in);
+      const __m256i hi = _mm256_shuffle_epi8(digits_avx, _mm256_and_si256(_mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x0f)));
+      const __m256i lo = _mm256_shuffle_epi8(digits_avx, _mm256_and_si256(v, _mm256_set1_epi8(0x0f)));
+      //unpacking works within 128 bit lanes, the halves are put back in order after
+      const __m256i a = _mm256_unpacklo_epi8(hi, lo), b = _mm256_unpackhi_epi8(hi, lo);
+      _mm256_storeu_si256((__m256i*)dst, _mm256_permute2x128_si256(a, b, 0x20));
+      _mm256_storeu_si256((__m256i*)(dst + 32), _mm256_permute2x128_si256(a, b, 0x31));
+    }
+#endif
+#if defined(__SSSE3__)
+    const __m128i digits_sse = _mm_setr_epi8('0','1','2','3','4','5','6','7','8','9','a','b','c','d','e','f');
+    for(; end - in >= 16; in += 16, dst += 32)
+    {
+      const __m128i v = _mm_loadu_si128((const __m128i*)in);
+      const __m128i hi = _mm_shuffle_epi8(digits_sse, _mm_and_si128(_mm_srli_epi16(v, 4), _mm_set1_epi8(0x0f)));
+      const __m128i lo = _mm_shuffle_epi8(digits_sse, _mm_and_si128(v, _mm_set1_epi8(0x0f)));
+      _mm_storeu_si128((__m128i*)dst, _mm_unpacklo_epi8(hi, lo));
+      _mm_storeu_si128((__m128i*)(dst + 16), _mm_unpackhi_epi8(hi, lo));
+    }
+#endif
+    for(; in != end; ++in)
+    {
+      *dst++ = digits[*in >> 4];
+      *dst++ = digits[*in & 0x0f];
+    }
+  }
+  //----------------------------------------------------------------------------
+  //value of a hex digit, either case, or -1
+  inline int hex_digit_value(char c)
+  {
+    if(c >= '0' && c <= '9')
+      return c - '0';
+    c |= 0x20;
+    if(c >= 'a' && c <= 'f')
+      return c - 'a' + 10;
+    return -1;
+  }
+  //----------------------------------------------------------------------------
+#if defined(__SSSE3__)
+  //values of 16 hex digits, false if any is not one
+  inline bool hex_digit_values(__m128i c, __m128i& values)
+  {
+    const __m128i lower = _mm_or_si128(c, _mm_set1_epi8(0x20));
+    const __m128i is_digit = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(c, _mm_set1_epi8('9' + 1)));
+    const __m128i is_letter = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+    if(_mm_movemask_epi8(_mm_or_si128(is_digit, is_letter)) != 0xffff)
+      return false;
+    values = _mm_or_si128(_mm_and_si128(is_digit, _mm_sub_epi8(c, _mm_set1_epi8('0'))),
+                          _mm_and_si128(is_letter, _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10))));
+    return true;
+  }
+#endif
+  //----------------------------------------------------------------------------
+  //bytes of 2 * size hex digits into dst, which takes size bytes; false on anything not
+  //a hex digit, with dst then partly written
+  inline bool decode_hex(const char* src, size_t size, void* dst)
+  {
+    unsigned char* out = static_cast<unsigned char*>(dst);
+    unsigned char* const end = out + size;
+#if defined(__SSSE3__)
+    //pairs of digit values to bytes: high * 16 + low
+    const __m128i weights = _mm_set1_epi16(0x0110);
+    for(; end - out >= 16; out += 16, src += 32)
+    {
+      __m128i a, b;
+      if(!hex_digit_values(_mm_loadu_si128((const __m128i*)src), a) || !hex_digit_values(_mm_loadu_si128((const __m128i*)(src + 16)), b))
+        return false;
+      _mm_storeu_si128((__m128i*)out, _mm_packus_epi16(_mm_maddubs_epi16(a, weights), _mm_maddubs_epi16(b, weights)));
+    }
+#endif
+    for(; out != end; ++out, src += 2)
+    {
+      const int hi = hex_digit_value(src[0]), lo = hex_digit_value(src[1]);
+      if(hi < 0 || lo < 0)
+        return false;
+      *out = static_cast<unsigned char>(hi << 4 | lo);
+    }
+    return true;
+  }
+  //----------------------------------------------------------------------------
+  inline std::string buff_to_hex_nodelimer(const std::string& s)
+  {
+    std::string res(s.size() * 2, '\0');
+    if(!s.empty())
+      encode_hex(s.data(), s.size(), &res[0]);
+    return res;
+  }
+  //----------------------------------------------------------------------------
   template<class CharT>
   std::basic_string<CharT> buff_to_hex_nodelimer(const std::basic_string<CharT>& s)
   {
@@ -169,21 +273,42 @@ namespace string_tools
     }
   }
   //----------------------------------------------------------------------------
-  template<class t_pod_type>
-  bool parse_tpod_from_hex_string(const std::string& str_hash, t_pod_type& t_pod)
+  inline bool parse_hexstr_to_binbuff(const std::string& s, std::string& res, bool allow_partial_byte = false)
   {
-    static_assert(std::is_pod<t_pod_type>::value, "expected pod type");
-    std::string buf;
-    bool res = epee::string_tools::parse_hexstr_to_binbuff(str_hash, buf);
-    if (!res || buf.size() != sizeof(t_pod_type))
+    res.clear();
+    if (!allow_partial_byte && (s.size() & 1))
+      return false;
+    res.resize((s.size() + 1) / 2);
+    if (!decode_hex(s.data(), s.size() / 2, &res[0]))
     {
+      res.clear();
       return false;
     }
-    else
+    if (s.size() & 1)
     {
-      buf.copy(reinterpret_cast<char *>(&t_pod), sizeof(t_pod_type));
-      return true;
+      //the last digit alone makes the last byte
+      const int v = hex_digit_value(s.back());
+      if (v < 0)
+      {
+        res.clear();
+        return false;
+      }
+      res.back() = static_cast<char>(v);
     }
+    return true;
+  }
+  //----------------------------------------------------------------------------
+  template<class t_pod_type>
+  bool parse_tpod_from_hex_string(const std::string& str_hash, t_pod_type& t_pod)
+  {
+    static_assert(std::is_pod<t_pod_type>::value, "expected pod type");
+    if (str_hash.size() != sizeof(t_pod_type) * 2)
+      return false;
+    t_pod_type pod;
+    if (!decode_hex(str_hash.data(), sizeof(t_pod_type), &pod))
+      return false;
+    t_pod = pod;
+    return true;
   }
   //----------------------------------------------------------------------------
 PUSH_WARNINGS
@@ -573,25 +698,21 @@ POP_WARNINGS
   std::string pod_to_hex(const t_pod_type& s)
   {
     static_assert(std::is_pod<t_pod_type>::value, "expected pod type");
-    std::string buff;
-    buff.assign(reinterpret_cast<const char*>(&s), sizeof(s));
-    return buff_to_hex_nodelimer(buff);
+    std::string res(sizeof(s) * 2, '\0');
+    encode_hex(&s, sizeof(s), &res[0]);
+    return res;
   }
   //----------------------------------------------------------------------------
   template<class t_pod_type>
   bool hex_to_pod(const std::string& hex_str, t_pod_type& s)
   {
     static_assert(std::is_pod<t_pod_type>::value, "expected pod type");
-    std::string hex_str_tr = trim(hex_str);
     if(sizeof(s)*2 != hex_str.size())
       return false;
-    std::string bin_buff;
-    if(!parse_hexstr_to_binbuff(hex_str_tr, bin_buff))
-      return false;
-    if(bin_buff.size()!=sizeof(s))
+    t_pod_type pod;
+    if(!decode_hex(hex_str.data(), sizeof(s), &pod))
       return false;
-
-    s = *(t_pod_type*)bin_buff.data();
+    s = pod;
     return true;
   }
   //----------------------------------------------------------------------------
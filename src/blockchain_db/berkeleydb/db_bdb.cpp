@@ -33,6 +33,7 @@
 
 #include "cryptonote_core/cryptonote_format_utils.h"
 #include "crypto/crypto.h"
+#include "common/util.h"
 #include "profile_tools.h"
 
 using epee::string_tools::pod_to_hex;
@@ -134,11 +135,9 @@ const unsigned int DB_BUFFER_LENGTH = 32 * MB;
 // 256MB cache adjust as necessary using DB_CONFIG
 const unsigned int DB_DEF_CACHESIZE = 256 * MB;
 
-#if defined(BDB_BULK_CAN_THREAD)
+// one bulk read buffer per thread prepare_handle_incoming_blocks may use
+// (bdb_safe_buffer caps this); buffers are allocated on first use
 const unsigned int DB_BUFFER_COUNT = tools::get_max_concurrency();
-#else
-const unsigned int DB_BUFFER_COUNT = 1;
-#endif
 
 template<typename T>
 struct Dbt_copy: public Dbt
@@ -224,7 +223,7 @@ struct Dbt_safe : public Dbt
 namespace cryptonote
 {
 
-void BlockchainBDB::add_block(const block& blk, const size_t& block_size, const difficulty_type& cumulative_difficulty, const uint64_t& coins_generated, const crypto::hash& blk_hash)
+void BlockchainBDB::add_block(const block& blk, const size_t& block_size, const difficulty_type& cumulative_difficulty, const uint64_t& coins_generated, uint64_t num_rct_outs, const crypto::hash& blk_hash, const blobdata& blk_blob)
 {
     LOG_PRINT_L3("BlockchainBDB::" << __func__);
     check_open();
@@ -250,7 +249,7 @@ void BlockchainBDB::add_block(const block& blk, const size_t& block_size, const
 
     Dbt_copy<uint32_t> key(m_height + 1);
 
-    Dbt_copy<blobdata> blob(block_to_blob(blk));
+    Dbt_copy<blobdata> blob(blk_blob);
     auto res = m_blocks->put(DB_DEFAULT_TX, &key, &blob, 0);
     if (res)
         throw0(DB_ERROR("Failed to add block blob to db transaction."));
@@ -313,7 +312,7 @@ void BlockchainBDB::remove_block()
         throw1(DB_ERROR("Failed to add removal of block hash to db transaction"));
 }
 
-void BlockchainBDB::add_transaction_data(const crypto::hash& blk_hash, const transaction& tx, const crypto::hash& tx_hash)
+void BlockchainBDB::add_transaction_data(const crypto::hash& blk_hash, const transaction& tx, const crypto::hash& tx_hash, const blobdata& tx_blob)
 {
     LOG_PRINT_L3("BlockchainBDB::" << __func__);
     check_open();
@@ -323,7 +322,7 @@ void BlockchainBDB::add_transaction_data(const crypto::hash& blk_hash, const tra
     if (m_txs->exists(DB_DEFAULT_TX, &val_h, 0) == 0)
         throw1(TX_EXISTS("Attempting to add transaction that's already in the db"));
 
-    Dbt_copy<blobdata> blob(tx_to_blob(tx));
+    Dbt_copy<blobdata> blob(tx_blob);
     if (m_txs->put(DB_DEFAULT_TX, &val_h, &blob, 0))
         throw0(DB_ERROR("Failed to add tx blob to db transaction"));
 
@@ -726,8 +725,7 @@ blobdata BlockchainBDB::output_to_blob(const tx_out& output) const
 tx_out BlockchainBDB::output_from_blob(const blobdata& blob) const
 {
     LOG_PRINT_L3("BlockchainBDB::" << __func__);
-    std::stringstream ss;
-    ss << blob;
+    binary_input_stream ss(blob);
     binary_archive<false> ba(ss);
     tx_out o;
 
@@ -779,6 +777,8 @@ BlockchainBDB::BlockchainBDB(bool batch_transactions) :
     m_open = false;
     m_run_checkpoint = 0;
     m_batch_transactions = batch_transactions;
+    m_batch_active = false;
+    m_batch_nosync_was_set = false;
     m_write_txn = nullptr;
     m_height = 0;
 
@@ -888,31 +888,34 @@ void BlockchainBDB::open(const std::string& filename, const int db_flags)
         // m_tx_outputs and m_output_amounts must be DB_HASH or DB_BTREE
         //   because they need duplicate entry support.  The rest are DB_RECNO,
         //   as it seems that will be the most performant choice.
-        m_blocks->open(txn, BDB_BLOCKS, NULL, DB_RECNO, DB_CREATE, 0);
+        // DB_THREAD makes the handles usable from the threads
+        //   prepare_handle_incoming_blocks reads with.
+        const uint32_t db_open_flags = DB_CREATE | DB_THREAD;
+        m_blocks->open(txn, BDB_BLOCKS, NULL, DB_RECNO, db_open_flags, 0);
 
-        m_block_timestamps->open(txn, BDB_BLOCK_TIMESTAMPS, NULL, DB_RECNO, DB_CREATE, 0);
-        m_block_heights->open(txn, BDB_BLOCK_HEIGHTS, NULL, DB_HASH, DB_CREATE, 0);
-        m_block_hashes->open(txn, BDB_BLOCK_HASHES, NULL, DB_RECNO, DB_CREATE, 0);
-        m_block_sizes->open(txn, BDB_BLOCK_SIZES, NULL, DB_RECNO, DB_CREATE, 0);
-        m_block_diffs->open(txn, BDB_BLOCK_DIFFS, NULL, DB_RECNO, DB_CREATE, 0);
-        m_block_coins->open(txn, BDB_BLOCK_COINS, NULL, DB_RECNO, DB_CREATE, 0);
+        m_block_timestamps->open(txn, BDB_BLOCK_TIMESTAMPS, NULL, DB_RECNO, db_open_flags, 0);
+        m_block_heights->open(txn, BDB_BLOCK_HEIGHTS, NULL, DB_HASH, db_open_flags, 0);
+        m_block_hashes->open(txn, BDB_BLOCK_HASHES, NULL, DB_RECNO, db_open_flags, 0);
+        m_block_sizes->open(txn, BDB_BLOCK_SIZES, NULL, DB_RECNO, db_open_flags, 0);
+        m_block_diffs->open(txn, BDB_BLOCK_DIFFS, NULL, DB_RECNO, db_open_flags, 0);
+        m_block_coins->open(txn, BDB_BLOCK_COINS, NULL, DB_RECNO, db_open_flags, 0);
 
-        m_txs->open(txn, BDB_TXS, NULL, DB_HASH, DB_CREATE, 0);
-        m_tx_unlocks->open(txn, BDB_TX_UNLOCKS, NULL, DB_HASH, DB_CREATE, 0);
-        m_tx_heights->open(txn, BDB_TX_HEIGHTS, NULL, DB_HASH, DB_CREATE, 0);
-        m_tx_outputs->open(txn, BDB_TX_OUTPUTS, NULL, DB_HASH, DB_CREATE, 0);
+        m_txs->open(txn, BDB_TXS, NULL, DB_HASH, db_open_flags, 0);
+        m_tx_unlocks->open(txn, BDB_TX_UNLOCKS, NULL, DB_HASH, db_open_flags, 0);
+        m_tx_heights->open(txn, BDB_TX_HEIGHTS, NULL, DB_HASH, db_open_flags, 0);
+        m_tx_outputs->open(txn, BDB_TX_OUTPUTS, NULL, DB_HASH, db_open_flags, 0);
 
-        m_output_txs->open(txn, BDB_OUTPUT_TXS, NULL, DB_RECNO, DB_CREATE, 0);
-        m_output_indices->open(txn, BDB_OUTPUT_INDICES, NULL, DB_RECNO, DB_CREATE, 0);
-        m_output_amounts->open(txn, BDB_OUTPUT_AMOUNTS, NULL, DB_HASH, DB_CREATE, 0);
-        m_output_keys->open(txn, BDB_OUTPUT_KEYS, NULL, DB_RECNO, DB_CREATE, 0);
+        m_output_txs->open(txn, BDB_OUTPUT_TXS, NULL, DB_RECNO, db_open_flags, 0);
+        m_output_indices->open(txn, BDB_OUTPUT_INDICES, NULL, DB_RECNO, db_open_flags, 0);
+        m_output_amounts->open(txn, BDB_OUTPUT_AMOUNTS, NULL, DB_HASH, db_open_flags, 0);
+        m_output_keys->open(txn, BDB_OUTPUT_KEYS, NULL, DB_RECNO, db_open_flags, 0);
 
-        m_spent_keys->open(txn, BDB_SPENT_KEYS, NULL, DB_HASH, DB_CREATE, 0);
+        m_spent_keys->open(txn, BDB_SPENT_KEYS, NULL, DB_HASH, db_open_flags, 0);
 
-        m_hf_starting_heights->open(txn, BDB_HF_STARTING_HEIGHTS, NULL, DB_RECNO, DB_CREATE, 0);
-        m_hf_versions->open(txn, BDB_HF_VERSIONS, NULL, DB_RECNO, DB_CREATE, 0);
+        m_hf_starting_heights->open(txn, BDB_HF_STARTING_HEIGHTS, NULL, DB_RECNO, db_open_flags, 0);
+        m_hf_versions->open(txn, BDB_HF_VERSIONS, NULL, DB_RECNO, db_open_flags, 0);
 
-        m_properties->open(txn, BDB_PROPERTIES, NULL, DB_HASH, DB_CREATE, 0);
+        m_properties->open(txn, BDB_PROPERTIES, NULL, DB_HASH, db_open_flags, 0);
 
         txn.commit();
 
@@ -1265,6 +1268,14 @@ block BlockchainBDB::get_block(const crypto::hash& h) const
     return get_block_from_height(get_block_height(h));
 }
 
+blobdata BlockchainBDB::get_block_blob(const crypto::hash& h) const
+{
+    LOG_PRINT_L3("BlockchainBDB::" << __func__);
+    check_open();
+
+    return get_block_blob_from_height(get_block_height(h));
+}
+
 uint64_t BlockchainBDB::get_block_height(const crypto::hash& h) const
 {
     LOG_PRINT_L3("BlockchainBDB::" << __func__);
@@ -1296,6 +1307,20 @@ block BlockchainBDB::get_block_from_height(const uint64_t& height) const
     LOG_PRINT_L3("BlockchainBDB::" << __func__);
     check_open();
 
+    blobdata bd = get_block_blob_from_height(height);
+
+    block b;
+    if (!parse_and_validate_block_from_blob(bd, b))
+        throw0(DB_ERROR("Failed to parse block from blob retrieved from the db"));
+
+    return b;
+}
+
+blobdata BlockchainBDB::get_block_blob_from_height(const uint64_t& height) const
+{
+    LOG_PRINT_L3("BlockchainBDB::" << __func__);
+    check_open();
+
     Dbt_copy<uint32_t> key(height + 1);
     Dbt_safe result;
     auto get_result = m_blocks->get(DB_DEFAULT_TX, &key, &result, 0);
@@ -1309,11 +1334,7 @@ block BlockchainBDB::get_block_from_height(const uint64_t& height) const
     blobdata bd;
     bd.assign(reinterpret_cast<char*>(result.get_data()), result.get_size());
 
-    block b;
-    if (!parse_and_validate_block_from_blob(bd, b))
-        throw0(DB_ERROR("Failed to parse block from blob retrieved from the db"));
-
-    return b;
+    return bd;
 }
 
 uint64_t BlockchainBDB::get_block_timestamp(const uint64_t& height) const
@@ -1542,22 +1563,33 @@ transaction BlockchainBDB::get_tx(const crypto::hash& h) const
     LOG_PRINT_L3("BlockchainBDB::" << __func__);
     check_open();
 
+    blobdata bd;
+    if (!get_tx_blob(h, bd))
+        throw1(TX_DNE(std::string("tx with hash ").append(epee::string_tools::pod_to_hex(h)).append(" not found in db").c_str()));
+
+    transaction tx;
+    if (!parse_and_validate_tx_from_blob(bd, tx))
+        throw0(DB_ERROR("Failed to parse tx from blob retrieved from the db"));
+
+    return tx;
+}
+
+bool BlockchainBDB::get_tx_blob(const crypto::hash& h, blobdata &bd) const
+{
+    LOG_PRINT_L3("BlockchainBDB::" << __func__);
+    check_open();
+
     Dbt_copy<crypto::hash> key(h);
     Dbt_safe result;
     auto get_result = m_txs->get(DB_DEFAULT_TX, &key, &result, 0);
     if (get_result == DB_NOTFOUND)
-        throw1(TX_DNE(std::string("tx with hash ").append(epee::string_tools::pod_to_hex(h)).append(" not found in db").c_str()));
+        return false;
     else if (get_result)
         throw0(DB_ERROR("DB error attempting to fetch tx from hash"));
 
-    blobdata bd;
     bd.assign(reinterpret_cast<char*>(result.get_data()), result.get_size());
 
-    transaction tx;
-    if (!parse_and_validate_tx_from_blob(bd, tx))
-        throw0(DB_ERROR("Failed to parse tx from blob retrieved from the db"));
-
-    return tx;
+    return true;
 }
 
 uint64_t BlockchainBDB::get_tx_count() const
@@ -1810,27 +1842,71 @@ bool BlockchainBDB::has_key_image(const crypto::key_image& img) const
     return false;
 }
 
-// Ostensibly BerkeleyDB has batch transaction support built-in,
-// so the following few functions will be NOP.
+// Every block is still committed in its own BerkeleyDB transaction, so a
+// batch only switches the environment to DB_TXN_NOSYNC for its duration:
+// commits stay atomic but are not forced to the log on disk one by one,
+// which is what makes bulk loads slow. The log is flushed when the batch
+// is committed or stopped. Without batch transactions enabled these are
+// NOP, as before.
 
 void BlockchainBDB::batch_start(uint64_t batch_num_blocks)
 {
     LOG_PRINT_L3("BlockchainBDB::" << __func__);
+    if (!m_batch_transactions)
+        return;
+    if (m_batch_active)
+        throw0(DB_ERROR("batch transaction already in progress"));
+    check_open();
+
+    uint32_t env_flags = 0;
+    if (m_env->get_flags(&env_flags))
+        throw0(DB_ERROR("Failed to get environment flags"));
+    m_batch_nosync_was_set = env_flags & DB_TXN_NOSYNC;
+    if (!m_batch_nosync_was_set)
+        m_env->set_flags(DB_TXN_NOSYNC, 1);
+    m_batch_active = true;
+    LOG_PRINT_L3("batch transaction: begin");
 }
 
 void BlockchainBDB::batch_commit()
 {
     LOG_PRINT_L3("BlockchainBDB::" << __func__);
+    if (!m_batch_transactions || !m_batch_active)
+        return;
+    check_open();
+
+    if (m_env->log_flush(NULL))
+        throw0(DB_ERROR("Failed to flush the log for the batch transaction"));
+    LOG_PRINT_L3("batch transaction: committed");
 }
 
 void BlockchainBDB::batch_stop()
 {
     LOG_PRINT_L3("BlockchainBDB::" << __func__);
+    if (!m_batch_transactions || !m_batch_active)
+        return;
+    check_open();
+
+    m_batch_active = false;
+    if (!m_batch_nosync_was_set)
+        m_env->set_flags(DB_TXN_NOSYNC, 0);
+    if (m_env->log_flush(NULL))
+        throw0(DB_ERROR("Failed to flush the log for the batch transaction"));
+    LOG_PRINT_L3("batch transaction: end");
 }
 
 void BlockchainBDB::batch_abort()
 {
     LOG_PRINT_L3("BlockchainBDB::" << __func__);
+    if (!m_batch_transactions || !m_batch_active)
+        return;
+    check_open();
+
+    // blocks already added were committed individually and stay
+    m_batch_active = false;
+    if (!m_batch_nosync_was_set)
+        m_env->set_flags(DB_TXN_NOSYNC, 0);
+    LOG_PRINT_L3("batch transaction: aborted");
 }
 
 void BlockchainBDB::set_batch_transactions(bool batch_transactions)
@@ -1855,7 +1931,7 @@ void BlockchainBDB::block_txn_abort()
   // TODO
 }
 
-uint64_t BlockchainBDB::add_block(const block& blk, const size_t& block_size, const difficulty_type& cumulative_difficulty, const uint64_t& coins_generated, const std::vector<transaction>& txs)
+uint64_t BlockchainBDB::add_block(const block& blk, const size_t& block_size, const difficulty_type& cumulative_difficulty, const uint64_t& coins_generated, const std::vector<transaction>& txs, const prepared_block_t* prepared)
 {
     LOG_PRINT_L3("BlockchainBDB::" << __func__);
     check_open();
@@ -1868,7 +1944,7 @@ uint64_t BlockchainBDB::add_block(const block& blk, const size_t& block_size, co
     uint64_t num_outputs = m_num_outputs;
     try
     {
-        BlockchainDB::add_block(blk, block_size, cumulative_difficulty, coins_generated, txs);
+        BlockchainDB::add_block(blk, block_size, cumulative_difficulty, coins_generated, txs, prepared);
         m_write_txn = NULL;
 
         TIME_MEASURE_START(time1);
@@ -2146,25 +2222,73 @@ void BlockchainBDB::get_output_key(const uint64_t &amount, const std::vector<uin
 
     TIME_MEASURE_START(db3);
     if (global_indices.size() > 0)
+        get_output_keys_from_global(global_indices, outputs);
+    TIME_MEASURE_FINISH(db3);
+
+    TIME_MEASURE_FINISH(txx);
+    LOG_PRINT_L3("db3: " << db3);
+}
+
+void BlockchainBDB::get_output_keys_bulk(const std::vector<std::pair<uint64_t, uint64_t>> &offsets, std::vector<output_data_t> &outputs)
+{
+    LOG_PRINT_L3("BlockchainBDB::" << __func__);
+    check_open();
+    outputs.clear();
+    outputs.reserve(offsets.size());
+
+    // resolve the global indices run by run of a same amount, then read
+    // all the keys in one cursor pass
+    std::vector<uint64_t> global_indices;
+    global_indices.reserve(offsets.size());
+    std::vector<uint64_t> amount_offsets;
+    std::vector<uint64_t> amount_indices;
+    for (size_t i = 0; i < offsets.size(); )
+    {
+        const uint64_t amount = offsets[i].first;
+        amount_offsets.clear();
+        for (; i < offsets.size() && offsets[i].first == amount; ++i)
+            amount_offsets.push_back(offsets[i].second);
+        amount_indices.clear();
+        get_output_global_indices(amount, amount_offsets, amount_indices);
+        global_indices.insert(global_indices.end(), amount_indices.begin(), amount_indices.end());
+    }
+
+    if (global_indices.size() > 0)
+        get_output_keys_from_global(global_indices, outputs);
+}
+
+void BlockchainBDB::get_output_keys_from_global(const std::vector<uint64_t> &global_indices, std::vector<output_data_t> &outputs)
+{
+    LOG_PRINT_L3("BlockchainBDB::" << __func__);
+    check_open();
+
+    bdb_cur cur(DB_DEFAULT_TX, m_output_keys);
+
+    bool positioned = false;
+    uint64_t current = 0;
+    for (const uint64_t &index : global_indices)
     {
-        for (const uint64_t &index : global_indices)
-        {
-            Dbt_copy<uint32_t> k(index);
-            Dbt_copy<output_data_t> v;
+        Dbt_copy<uint32_t> k(index);
+        Dbt_copy<output_data_t> v;
 
-            auto get_result = m_output_keys->get(DB_DEFAULT_TX, &k, &v, 0);
-            if (get_result == DB_NOTFOUND)
-                throw1(OUTPUT_DNE("output with given index not in db"));
-            else if (get_result)
-                throw0(DB_ERROR("DB error attempting to fetch output tx hash"));
+        // output keys is a RECNO db with contiguous record numbers, so the
+        // next record is the next global index
+        int get_result;
+        if (positioned && index == current + 1)
+            get_result = cur->get(&k, &v, DB_NEXT);
+        else
+            get_result = cur->get(&k, &v, DB_SET);
+        if (get_result == DB_NOTFOUND)
+            throw1(OUTPUT_DNE("output with given index not in db"));
+        else if (get_result)
+            throw0(DB_ERROR("DB error attempting to fetch output key"));
 
-            output_data_t data = *(output_data_t *) v.get_data();
-            outputs.push_back(data);
-        }
+        outputs.push_back(*(const output_data_t *) v.get_data());
+        positioned = true;
+        current = index;
     }
 
-    TIME_MEASURE_FINISH(txx);
-    LOG_PRINT_L3("db3: " << db3);
+    cur.close();
 }
 
 void BlockchainBDB::get_output_tx_and_index(const uint64_t& amount, const std::vector<uint64_t> &offsets, std::vector<tx_out_index> &indices)
@@ -32,10 +32,8 @@
 
 #include <unordered_map>
 #include <condition_variable>
+#include <new>  // std::bad_alloc
 
-// ND: Enables multi-threaded bulk reads for when getting indices.
-//     TODO: Disabled for now, as it doesn't seem to provide noticeable improvements (??. Reason: TBD.
-// #define BDB_BULK_CAN_THREAD
 namespace cryptonote
 {
 
@@ -96,7 +94,8 @@ private:
 // ND: Class to handle buffer management when doing bulk queries
 // (DB_MULTIPLE). Allocates buffers then handles thread queuing
 // so a fixed set of buffers can be used (instead of allocating
-// every time a bulk query is needed).
+// every time a bulk query is needed). A buffer is only allocated
+// the first time its slot is handed out, so idle slots cost nothing.
 template <typename T>
 class bdb_safe_buffer
 {
@@ -109,8 +108,7 @@ public:
         num_buffers = MaxAllowedBuffers;
 
       set_count(num_buffers);
-      for (size_t i = 0; i < num_buffers; i++)
-        m_buffers.push_back((T) malloc(sizeof(T) * count));
+      m_buffers.resize(num_buffers, nullptr);
       m_buffer_count = count;
     }
 
@@ -147,6 +145,18 @@ public:
 
         assert(index >= 0);
 
+        if (m_buffers[index] == nullptr)
+        {
+            m_buffers[index] = (T) malloc(sizeof(T) * m_buffer_count);
+            if (m_buffers[index] == nullptr)
+            {
+                m_open_slot[index] = true;
+                ++m_count;
+                m_cv.notify_one();
+                throw std::bad_alloc();
+            }
+        }
+
         T buffer = m_buffers[index];
         m_buffer_map.emplace(buffer, index);
         return buffer;
@@ -254,12 +264,16 @@ public:
 
   virtual block get_block(const crypto::hash& h) const;
 
+  virtual blobdata get_block_blob(const crypto::hash& h) const;
+
   virtual uint64_t get_block_height(const crypto::hash& h) const;
 
   virtual block_header get_block_header(const crypto::hash& h) const;
 
   virtual block get_block_from_height(const uint64_t& height) const;
 
+  virtual blobdata get_block_blob_from_height(const uint64_t& height) const;
+
   virtual uint64_t get_block_timestamp(const uint64_t& height) const;
 
   virtual uint64_t get_top_block_timestamp() const;
@@ -290,6 +304,8 @@ public:
 
   virtual transaction get_tx(const crypto::hash& h) const;
 
+  virtual bool get_tx_blob(const crypto::hash& h, blobdata &tx) const;
+
   virtual uint64_t get_tx_count() const;
 
   virtual std::vector<transaction> get_tx_list(const std::vector<crypto::hash>& hlist) const;
@@ -303,6 +319,7 @@ public:
   virtual output_data_t get_output_key(const uint64_t& amount, const uint64_t& index);
   virtual output_data_t get_output_key(const uint64_t& global_index) const;
   virtual void get_output_key(const uint64_t &amount, const std::vector<uint64_t> &offsets, std::vector<output_data_t> &outputs);
+  virtual void get_output_keys_bulk(const std::vector<std::pair<uint64_t, uint64_t>> &offsets, std::vector<output_data_t> &outputs);
 
   virtual tx_out_index get_output_tx_and_index_from_global(const uint64_t& index) const;
   virtual void get_output_tx_and_index_from_global(const std::vector<uint64_t> &global_indices,
@@ -321,6 +338,7 @@ public:
                             , const difficulty_type& cumulative_difficulty
                             , const uint64_t& coins_generated
                             , const std::vector<transaction>& txs
+                            , const prepared_block_t* prepared = NULL
                             );
 
   virtual void set_batch_transactions(bool batch_transactions);
@@ -335,11 +353,7 @@ public:
 
   virtual void pop_block(block& blk, std::vector<transaction>& txs);
 
-#if defined(BDB_BULK_CAN_THREAD)
   virtual bool can_thread_bulk_indices() const { return true; }
-#else
-  virtual bool can_thread_bulk_indices() const { return false; }
-#endif
 
   /**
    * @brief return a histogram of outputs on the blockchain
@@ -355,12 +369,14 @@ private:
                 , const size_t& block_size
                 , const difficulty_type& cumulative_difficulty
                 , const uint64_t& coins_generated
+                , uint64_t num_rct_outs
                 , const crypto::hash& block_hash
+                , const blobdata& block_blob
                 );
 
   virtual void remove_block();
 
-  virtual void add_transaction_data(const crypto::hash& blk_hash, const transaction& tx, const crypto::hash& tx_hash);
+  virtual void add_transaction_data(const crypto::hash& blk_hash, const transaction& tx, const crypto::hash& tx_hash, const blobdata& tx_blob);
 
   virtual void remove_transaction_data(const crypto::hash& tx_hash, const transaction& tx);
 
@@ -379,6 +395,10 @@ private:
 
   void get_output_global_indices(const uint64_t& amount, const std::vector<uint64_t> &offsets, std::vector<uint64_t> &global_indices);
 
+  // reads the output keys for the given global indices with a single
+  // cursor, stepping forward instead of seeking for consecutive indices
+  void get_output_keys_from_global(const std::vector<uint64_t> &global_indices, std::vector<output_data_t> &outputs);
+
   virtual bool for_all_key_images(std::function<bool(const crypto::key_image&)>) const;
   virtual bool for_all_blocks(std::function<bool(uint64_t, const crypto::hash&, const cryptonote::block&)>) const;
   virtual bool for_all_transactions(std::function<bool(const crypto::hash&, const cryptonote::transaction&)>) const;
@@ -464,6 +484,8 @@ private:
   bdb_txn_safe *m_write_txn;
 
   bool m_batch_transactions; // support for batch transactions
+  bool m_batch_active; // whether commits are currently not flushed to the log
+  bool m_batch_nosync_was_set; // DB_TXN_NOSYNC state to restore when the batch ends
 };
 
 }  // namespace cryptonote
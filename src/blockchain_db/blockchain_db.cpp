@@ -31,6 +31,8 @@
 #include "blockchain_db.h"
 #include "cryptonote_core/cryptonote_format_utils.h"
 #include "profile_tools.h"
+#include "common/util.h"
+#include "common/parallel_for.h"
 
 using epee::string_tools::pod_to_hex;
 
@@ -44,20 +46,75 @@ void BlockchainDB::pop_block()
   pop_block(blk, txs);
 }
 
+void BlockchainDB::prepare_transaction(const transaction& tx, const crypto::hash& tx_hash, prepared_tx_t& prepared)
+{
+  prepared.hash = tx_hash;
+  prepared.blob = tx_to_blob(tx);
+  prepared.commitments.clear();
+
+  // miner v2 txes have their coinbase output in one single out to save space,
+  // and we store them as rct outputs with an identity mask
+  if (tx.version == 2 && !tx.vin.empty() && tx.vin[0].type() == typeid(txin_gen))
+  {
+    prepared.commitments.reserve(tx.vout.size());
+    for (const tx_out& vout : tx.vout)
+      prepared.commitments.push_back(rct::zeroCommit(vout.amount));
+  }
+}
+
+void BlockchainDB::prepare_block(const block& blk, const std::vector<transaction>& txs, prepared_block_t& prepared, tools::thread_group* threads)
+{
+  if (blk.tx_hashes.size() != txs.size())
+    throw DB_ERROR("Block's transaction hashes don't match its transactions");
+
+  prepared.hash = get_block_hash(blk);
+  prepared.blob = block_to_blob(blk);
+
+  // RingCT outputs all go under amount 0, whatever their miner tx amount
+  prepared.num_rct_outs = 0;
+  if (blk.miner_tx.version >= 2)
+    prepared.num_rct_outs += blk.miner_tx.vout.size();
+  for (const transaction& tx : txs)
+    if (tx.version >= 2)
+      prepared.num_rct_outs += tx.vout.size();
+
+  prepared.txs.resize(txs.size() + 1);
+  auto prepare = [&] (size_t first, size_t last) {
+    for (size_t i = first; i < last; ++i)
+    {
+      if (i == 0)
+        prepare_transaction(blk.miner_tx, get_transaction_hash(blk.miner_tx), prepared.txs[0]);
+      else
+        prepare_transaction(txs[i - 1], blk.tx_hashes[i - 1], prepared.txs[i]);
+    }
+    return true;
+  };
+  if (threads)
+    tools::parallel_for(*threads, 0, prepared.txs.size(), 8, prepare);
+  else
+    prepare(0, prepared.txs.size());
+}
+
 void BlockchainDB::add_transaction(const crypto::hash& blk_hash, const transaction& tx, const crypto::hash* tx_hash_ptr)
 {
-  bool miner_tx = false;
-  crypto::hash tx_hash;
+  prepared_tx_t prepared;
   if (!tx_hash_ptr)
   {
     // should only need to compute hash for miner transactions
-    tx_hash = get_transaction_hash(tx);
-    LOG_PRINT_L3("null tx_hash_ptr - needed to compute: " << tx_hash);
+    prepare_transaction(tx, get_transaction_hash(tx), prepared);
+    LOG_PRINT_L3("null tx_hash_ptr - needed to compute: " << prepared.hash);
   }
   else
   {
-    tx_hash = *tx_hash_ptr;
+    prepare_transaction(tx, *tx_hash_ptr, prepared);
   }
+  add_transaction(blk_hash, tx, prepared);
+}
+
+void BlockchainDB::add_transaction(const crypto::hash& blk_hash, const transaction& tx, const prepared_tx_t& prepared)
+{
+  bool miner_tx = false;
+  const crypto::hash& tx_hash = prepared.hash;
 
   for (const txin_v& tx_input : tx.vin)
   {
@@ -84,23 +141,23 @@ void BlockchainDB::add_transaction(const crypto::hash& blk_hash, const transacti
     }
   }
 
-  uint64_t tx_id = add_transaction_data(blk_hash, tx, tx_hash);
+  uint64_t tx_id = add_transaction_data(blk_hash, tx, tx_hash, prepared.blob);
 
   std::vector<uint64_t> amount_output_indices;
+  amount_output_indices.reserve(tx.vout.size());
 
   // iterate tx.vout using indices instead of C++11 foreach syntax because
   // we need the index
   for (uint64_t i = 0; i < tx.vout.size(); ++i)
   {
-    // miner v2 txes have their coinbase output in one single out to save space,
-    // and we store them as rct outputs with an identity mask
+    // miner v2 txes are stored as rct outputs, with the commitments prepared
+    // before the write transaction
     if (miner_tx && tx.version == 2)
     {
       cryptonote::tx_out vout = tx.vout[i];
-      rct::key commitment = rct::zeroCommit(vout.amount);
       vout.amount = 0;
       amount_output_indices.push_back(add_output(tx_hash, vout, i, tx.unlock_time,
-        &commitment));
+        &prepared.commitments[i]));
     }
     else
     {
@@ -116,33 +173,39 @@ uint64_t BlockchainDB::add_block( const block& blk
                                 , const difficulty_type& cumulative_difficulty
                                 , const uint64_t& coins_generated
                                 , const std::vector<transaction>& txs
+                                , const prepared_block_t* prepared
                                 )
 {
   block_txn_start(false);
 
-  TIME_MEASURE_START(time1);
-  crypto::hash blk_hash = get_block_hash(blk);
-  TIME_MEASURE_FINISH(time1);
-  time_blk_hash += time1;
+  // serialization and hashing are best done by the caller, before the write
+  // transaction, which is exclusive; do them here if it did not
+  prepared_block_t local;
+  if (!prepared)
+  {
+    TIME_MEASURE_START(time1);
+    prepare_block(blk, txs, local);
+    TIME_MEASURE_FINISH(time1);
+    time_blk_hash += time1;
+    prepared = &local;
+  }
+  if (prepared->txs.size() != txs.size() + 1)
+    throw DB_ERROR("Prepared records don't match the block's transactions");
+
+  const crypto::hash& blk_hash = prepared->hash;
 
   // call out to subclass implementation to add the block & metadata
-  time1 = epee::misc_utils::get_tick_count();
-  add_block(blk, block_size, cumulative_difficulty, coins_generated, blk_hash);
+  TIME_MEASURE_START(time1);
+  add_block(blk, block_size, cumulative_difficulty, coins_generated, prepared->num_rct_outs, blk_hash, prepared->blob);
   TIME_MEASURE_FINISH(time1);
   time_add_block1 += time1;
 
   // call out to add the transactions
 
   time1 = epee::misc_utils::get_tick_count();
-  add_transaction(blk_hash, blk.miner_tx);
-  int tx_i = 0;
-  crypto::hash tx_hash = null_hash;
-  for (const transaction& tx : txs)
-  {
-    tx_hash = blk.tx_hashes[tx_i];
-    add_transaction(blk_hash, tx, &tx_hash);
-    ++tx_i;
-  }
+  add_transaction(blk_hash, blk.miner_tx, prepared->txs[0]);
+  for (size_t i = 0; i < txs.size(); ++i)
+    add_transaction(blk_hash, txs[i], prepared->txs[i + 1]);
   TIME_MEASURE_FINISH(time1);
   time_add_transaction += time1;
 
@@ -154,6 +217,7 @@ uint64_t BlockchainDB::add_block( const block& blk
   block_txn_stop();
 
   ++num_calls;
+  add_unsynced(block_size);
 
   return prev_height;
 }
@@ -177,11 +241,295 @@ void BlockchainDB::pop_block(block& blk, std::vector<transaction>& txs)
   remove_transaction(get_transaction_hash(blk.miner_tx));
 }
 
+void BlockchainDB::flush()
+{
+  uint64_t blocks, since_ms;
+  {
+    boost::lock_guard<boost::mutex> lock(m_flush_mutex);
+    blocks = m_sync_stats.unsynced_blocks;
+    since_ms = m_unsynced_since_ms;
+    // what is added from here on may not make it in this sync
+    m_sync_stats.unsynced_blocks = 0;
+    m_sync_stats.unsynced_bytes = 0;
+    m_flush_requested = false;
+  }
+
+  const uint64_t start_ns = epee::misc_utils::get_ns_count();
+  {
+    CRITICAL_REGION_LOCAL(m_synchronization_lock);
+    sync();
+  }
+  const uint64_t sync_us = (epee::misc_utils::get_ns_count() - start_ns) / 1000;
+
+  boost::lock_guard<boost::mutex> lock(m_flush_mutex);
+  if (blocks)
+  {
+    const uint64_t lag_ms = epee::misc_utils::get_tick_count() - since_ms;
+    m_sync_stats.max_lag_ms = std::max(m_sync_stats.max_lag_ms, lag_ms);
+  }
+  ++m_sync_stats.syncs;
+  m_sync_stats.last_sync_us = sync_us;
+  m_sync_stats.max_sync_us = std::max(m_sync_stats.max_sync_us, sync_us);
+  m_sync_stats.total_sync_us += sync_us;
+}
+
+void BlockchainDB::start_flusher(uint64_t blocks_per_sync, uint64_t bytes_per_sync, uint64_t interval_ms)
+{
+  stop_flusher();
+  {
+    boost::lock_guard<boost::mutex> lock(m_flush_mutex);
+    m_blocks_per_flush = blocks_per_sync;
+    m_bytes_per_flush = bytes_per_sync;
+    m_flush_interval_ms = interval_ms;
+    m_flusher_stop = false;
+    m_flusher_running = true;
+  }
+  m_flusher = boost::thread(&BlockchainDB::flusher_main, this);
+}
+
+void BlockchainDB::stop_flusher()
+{
+  {
+    boost::lock_guard<boost::mutex> lock(m_flush_mutex);
+    if (!m_flusher_running)
+      return;
+    m_flusher_stop = true;
+  }
+  m_flush_cond.notify_all();
+  m_flusher.join();
+  boost::lock_guard<boost::mutex> lock(m_flush_mutex);
+  m_flusher_running = false;
+}
+
+void BlockchainDB::request_flush()
+{
+  boost::lock_guard<boost::mutex> lock(m_flush_mutex);
+  if (!m_flusher_running || !m_sync_stats.unsynced_blocks)
+    return;
+  m_flush_requested = true;
+  m_flush_cond.notify_all();
+}
+
+void BlockchainDB::get_sync_stats(db_sync_stats_t &stats) const
+{
+  boost::lock_guard<boost::mutex> lock(m_flush_mutex);
+  stats = m_sync_stats;
+  stats.lag_ms = stats.unsynced_blocks ? epee::misc_utils::get_tick_count() - m_unsynced_since_ms : 0;
+}
+
+void BlockchainDB::add_unsynced(uint64_t bytes)
+{
+  boost::lock_guard<boost::mutex> lock(m_flush_mutex);
+  const uint64_t now_ms = epee::misc_utils::get_tick_count();
+  if (!m_sync_stats.unsynced_blocks++)
+    m_unsynced_since_ms = now_ms;
+  m_sync_stats.unsynced_bytes += bytes;
+  // the first block starts the interval, so wake the flusher for that too
+  if (m_flusher_running && (m_sync_stats.unsynced_blocks == 1 || flush_due(now_ms)))
+    m_flush_cond.notify_all();
+}
+
+bool BlockchainDB::flush_due(uint64_t now_ms) const
+{
+  if (!m_sync_stats.unsynced_blocks)
+    return false;
+  return m_flush_requested
+    || (m_blocks_per_flush && m_sync_stats.unsynced_blocks >= m_blocks_per_flush)
+    || (m_bytes_per_flush && m_sync_stats.unsynced_bytes >= m_bytes_per_flush)
+    || (m_flush_interval_ms && now_ms - m_unsynced_since_ms >= m_flush_interval_ms);
+}
+
+void BlockchainDB::flusher_main()
+{
+  boost::unique_lock<boost::mutex> lock(m_flush_mutex);
+  while (!m_flusher_stop)
+  {
+    const uint64_t now_ms = epee::misc_utils::get_tick_count();
+    if (!flush_due(now_ms))
+    {
+      if (m_flush_interval_ms && m_sync_stats.unsynced_blocks)
+        m_flush_cond.timed_wait(lock, boost::posix_time::milliseconds(m_unsynced_since_ms + m_flush_interval_ms - now_ms));
+      else
+        m_flush_cond.wait(lock);
+      continue;
+    }
+
+    lock.unlock();
+    try
+    {
+      flush();
+    }
+    catch (const std::exception &e)
+    {
+      // the blocks it was for stay counted as synced, so this does not spin
+      LOG_ERROR("Error syncing blockchain db: " << e.what());
+    }
+    lock.lock();
+  }
+}
+
 bool BlockchainDB::is_open() const
 {
   return m_open;
 }
 
+void BlockchainDB::get_txs_amount_output_indices(const std::vector<crypto::hash>& tx_hashes, std::vector<std::vector<uint64_t> >& output_indices, std::vector<bool>& found) const
+{
+  output_indices.clear();
+  output_indices.resize(tx_hashes.size());
+  found.clear();
+  found.resize(tx_hashes.size(), false);
+  for (size_t n = 0; n < tx_hashes.size(); ++n)
+  {
+    uint64_t tx_id;
+    if (!tx_exists(tx_hashes[n], tx_id))
+      continue;
+    output_indices[n] = get_tx_amount_output_indices(tx_id);
+    found[n] = true;
+  }
+}
+
+void BlockchainDB::has_key_images(const std::vector<crypto::key_image>& imgs, std::vector<bool>& spent) const
+{
+  spent.clear();
+  spent.reserve(imgs.size());
+  for (const auto& img : imgs)
+    spent.push_back(has_key_image(img));
+}
+
+bool BlockchainDB::copy_snapshot(const std::string &path, uint64_t max_bytes_per_sec, const std::function<bool(uint64_t, uint64_t)> &progress) const
+{
+  throw DB_ERROR((get_db_name() + " databases can't be copied while in use").c_str());
+}
+
+bool BlockchainDB::for_all_key_images_parallel(unsigned shards, std::function<bool(unsigned, const crypto::key_image&)> f) const
+{
+  return for_all_key_images([&f](const crypto::key_image &k_image) { return f(0, k_image); });
+}
+
+bool BlockchainDB::for_all_blocks_parallel(unsigned shards, std::function<bool(unsigned, uint64_t, const crypto::hash&, const cryptonote::block&)> f) const
+{
+  return for_all_blocks([&f](uint64_t height, const crypto::hash &hash, const cryptonote::block &b) { return f(0, height, hash, b); });
+}
+
+bool BlockchainDB::for_all_transactions_parallel(unsigned shards, std::function<bool(unsigned, const crypto::hash&, const cryptonote::transaction&)> f) const
+{
+  return for_all_transactions([&f](const crypto::hash &hash, const cryptonote::transaction &tx) { return f(0, hash, tx); });
+}
+
+bool BlockchainDB::for_all_outputs_parallel(unsigned shards, std::function<bool(unsigned, uint64_t amount, const crypto::hash &tx_hash, size_t tx_idx)> f) const
+{
+  return for_all_outputs([&f](uint64_t amount, const crypto::hash &tx_hash, size_t tx_idx) { return f(0, amount, tx_hash, tx_idx); });
+}
+
+bool BlockchainDB::run_shards(unsigned shards, const std::function<bool(unsigned, const std::atomic<bool>&)> &f)
+{
+  std::atomic<bool> stop(false);
+  std::vector<char> results(shards, true);
+  std::vector<std::exception_ptr> errors(shards);
+
+  auto run = [&](unsigned shard) {
+    try
+    {
+      results[shard] = f(shard, stop);
+    }
+    catch (...)
+    {
+      errors[shard] = std::current_exception();
+      results[shard] = false;
+    }
+    if (!results[shard])
+      stop = true;
+  };
+
+  // the calling thread runs the last shard
+  std::vector<boost::thread> threads;
+  threads.reserve(shards - 1);
+  for (unsigned shard = 0; shard + 1 < shards; ++shard)
+    threads.emplace_back([&run, shard]() { run(shard); });
+  run(shards - 1);
+  for (auto &t: threads)
+    t.join();
+
+  for (const auto &e: errors)
+    if (e)
+      std::rethrow_exception(e);
+  for (char r: results)
+    if (!r)
+      return false;
+  return true;
+}
+
+unsigned BlockchainDB::get_default_shards()
+{
+  return std::max(1u, tools::get_max_concurrency());
+}
+
+void BlockchainDB::get_blocks_with_output_indices(uint64_t start_height, size_t count, std::vector<std::pair<blobdata, std::vector<blobdata> > >& blocks, std::vector<std::vector<std::vector<uint64_t> > >& output_indices) const
+{
+  const uint64_t end_height = std::min<uint64_t>(height(), start_height + count);
+  for (uint64_t h = start_height; h < end_height; ++h)
+  {
+    blocks.push_back(std::make_pair(get_block_blob_from_height(h), std::vector<blobdata>()));
+    block b;
+    if (!parse_and_validate_block_from_blob(blocks.back().first, b))
+      throw DB_ERROR("Failed to parse block from blob retrieved from the db");
+
+    output_indices.push_back(std::vector<std::vector<uint64_t> >());
+    output_indices.back().reserve(1 + b.tx_hashes.size());
+    uint64_t tx_id;
+    if (!tx_exists(get_transaction_hash(b.miner_tx), tx_id))
+      throw TX_DNE("Miner tx of a block not found in db");
+    output_indices.back().push_back(get_tx_amount_output_indices(tx_id));
+
+    blocks.back().second.resize(b.tx_hashes.size());
+    for (size_t n = 0; n < b.tx_hashes.size(); ++n)
+    {
+      if (!tx_exists(b.tx_hashes[n], tx_id) || !get_tx_blob(b.tx_hashes[n], blocks.back().second[n]))
+        throw TX_DNE("Tx of a block not found in db");
+      output_indices.back().push_back(get_tx_amount_output_indices(tx_id));
+    }
+  }
+}
+
+static uint64_t count_outputs_of_amount(const transaction &tx, uint64_t amount)
+{
+  if (tx.version >= 2)
+    return amount == 0 ? tx.vout.size() : 0;
+  uint64_t count = 0;
+  for (const auto &out : tx.vout)
+    if (out.amount == amount)
+      ++count;
+  return count;
+}
+
+bool BlockchainDB::get_output_distribution(uint64_t amount, uint64_t from_height, uint64_t to_height, std::vector<uint64_t> &distribution, uint64_t &base) const
+{
+  distribution.clear();
+  base = 0;
+  const uint64_t db_height = height();
+  if (from_height >= db_height)
+    return false;
+  to_height = std::min(to_height, db_height - 1);
+  if (to_height < from_height)
+    return true;
+
+  distribution.reserve(to_height - from_height + 1);
+  uint64_t count = 0;
+  for (uint64_t h = 0; h <= to_height; ++h)
+  {
+    if (h == from_height)
+      base = count;
+    const block b = get_block_from_height(h);
+    count += count_outputs_of_amount(b.miner_tx, amount);
+    for (const auto &tx_hash : b.tx_hashes)
+      count += count_outputs_of_amount(get_tx(tx_hash), amount);
+    if (h >= from_height)
+      distribution.push_back(count);
+  }
+  return true;
+}
+
 void BlockchainDB::remove_transaction(const crypto::hash& tx_hash)
 {
   transaction tx = get_tx(tx_hash);
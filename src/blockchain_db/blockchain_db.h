@@ -33,10 +33,16 @@
 #include <list>
 #include <string>
 #include <exception>
+#include <atomic>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
 #include "crypto/hash.h"
 #include "cryptonote_core/cryptonote_basic.h"
 #include "cryptonote_core/difficulty.h"
 #include "cryptonote_core/hardfork.h"
+#include "cryptonote_protocol/blobdatatype.h"
+#include "common/thread_group.h"
 
 /** \file
  * Cryptonote Blockchain Database Interface
@@ -123,6 +129,76 @@ struct tx_data_t
 };
 #pragma pack(pop)
 
+/**
+ * @brief usage statistics for one of a BlockchainDB's methods
+ *
+ * Latencies are rounded up to the next power of two microseconds.
+ */
+struct db_op_stats_t
+{
+  std::string method;       //!< the BlockchainDB method
+  std::string table;        //!< the table the method mostly reads from
+  uint64_t    calls;        //!< how many times the method was called
+  uint64_t    bytes_read;   //!< total size of the values read
+  uint64_t    cursor_ops;   //!< number of lookups done through a cursor
+  uint64_t    gets;         //!< number of lookups done through a plain get
+  uint64_t    p50_us;       //!< median latency, in microseconds
+  uint64_t    p99_us;       //!< 99th percentile latency, in microseconds
+};
+
+/**
+ * @brief how far a BlockchainDB's writes are ahead of what is on disk
+ *
+ * The lag of a write is the time from when add_block returned it until a
+ * sync started after that completes.
+ */
+struct db_sync_stats_t
+{
+  uint64_t    syncs;            //!< number of syncs so far
+  uint64_t    unsynced_blocks;  //!< blocks added since the last sync started
+  uint64_t    unsynced_bytes;   //!< size of those blocks
+  uint64_t    lag_ms;           //!< age of the oldest of those blocks, 0 if none
+  uint64_t    max_lag_ms;       //!< largest lag a sync has cleared
+  uint64_t    last_sync_us;     //!< how long the last sync took
+  uint64_t    max_sync_us;      //!< longest sync so far
+  uint64_t    total_sync_us;    //!< time spent syncing so far
+};
+
+/**
+ * @brief memory a BlockchainDB has mapped, and how much of it is resident
+ */
+struct db_memory_stats_t
+{
+  uint64_t    map_size;         //!< address space reserved for the database
+  uint64_t    used_bytes;       //!< the part of it the database's pages take up
+  uint64_t    resident_bytes;   //!< the part of those in memory, 0 if not known
+};
+
+/**
+ * @brief a transaction's records, serialized ahead of its write transaction
+ */
+struct prepared_tx_t
+{
+  crypto::hash           hash;          //!< the transaction's hash
+  blobdata               blob;          //!< the transaction as it is stored
+  std::vector<rct::key>  commitments;   //!< a v2 miner tx's output commitments, empty otherwise
+};
+
+/**
+ * @brief a block's records, serialized ahead of its write transaction
+ *
+ * These depend on the block and its transactions only, so they can be built
+ * on any number of threads before the block's write transaction starts,
+ * which then only has to store them.
+ */
+struct prepared_block_t
+{
+  crypto::hash                hash;           //!< the block's hash
+  blobdata                    blob;           //!< the block as it is stored
+  uint64_t                    num_rct_outs;   //!< the RingCT outputs the block creates
+  std::vector<prepared_tx_t>  txs;            //!< the miner tx, then the block's transactions
+};
+
 /***********************************
  * Exception Definitions
  ***********************************/
@@ -325,13 +401,17 @@ private:
    * @param block_size the size of the block (transactions and all)
    * @param cumulative_difficulty the accumulated difficulty after this block
    * @param coins_generated the number of coins generated total after this block
+   * @param num_rct_outs the number of RingCT outputs created by this block's transactions
    * @param blk_hash the hash of the block
+   * @param blk_blob the block, serialized
    */
   virtual void add_block( const block& blk
                 , const size_t& block_size
                 , const difficulty_type& cumulative_difficulty
                 , const uint64_t& coins_generated
+                , uint64_t num_rct_outs
                 , const crypto::hash& blk_hash
+                , const blobdata& blk_blob
                 ) = 0;
 
   /**
@@ -339,7 +419,7 @@ private:
    *
    * The subclass implementing this will remove the block data from the top
    * block in the chain.  The data to be removed is that which was added in
-   * BlockchainDB::add_block(const block& blk, const size_t& block_size, const difficulty_type& cumulative_difficulty, const uint64_t& coins_generated, const crypto::hash& blk_hash)
+   * BlockchainDB::add_block(const block& blk, const size_t& block_size, const difficulty_type& cumulative_difficulty, const uint64_t& coins_generated, uint64_t num_rct_outs, const crypto::hash& blk_hash, const blobdata& blk_blob)
    *
    * If any of this cannot be done, the subclass should throw the corresponding
    * subclass of DB_EXCEPTION
@@ -363,9 +443,10 @@ private:
    * @param blk_hash the hash of the block containing the transaction
    * @param tx the transaction to be added
    * @param tx_hash the hash of the transaction
+   * @param tx_blob the transaction, serialized
    * @return the transaction ID
    */
-  virtual uint64_t add_transaction_data(const crypto::hash& blk_hash, const transaction& tx, const crypto::hash& tx_hash) = 0;
+  virtual uint64_t add_transaction_data(const crypto::hash& blk_hash, const transaction& tx, const crypto::hash& tx_hash, const blobdata& tx_blob) = 0;
 
   /**
    * @brief remove data about a transaction
@@ -494,9 +575,46 @@ protected:
    */
   void add_transaction(const crypto::hash& blk_hash, const transaction& tx, const crypto::hash* tx_hash_ptr = NULL);
 
+  /**
+   * @brief adds a transaction from its prepared records
+   *
+   * @param blk_hash hash of the block which has the transaction
+   * @param tx the transaction to add
+   * @param prepared the transaction's hash, blob and commitments
+   */
+  void add_transaction(const crypto::hash& blk_hash, const transaction& tx, const prepared_tx_t& prepared);
+
+  /**
+   * @brief serializes a transaction and computes its miner commitments
+   *
+   * @param tx the transaction
+   * @param tx_hash the hash of the transaction
+   * @param prepared return-by-reference the transaction's records
+   */
+  static void prepare_transaction(const transaction& tx, const crypto::hash& tx_hash, prepared_tx_t& prepared);
+
+  /**
+   * @brief runs a function once per shard, each on its own thread
+   *
+   * Helper for the for_all_*_parallel implementations. Each shard should
+   * check stop before each item, and stop early once it is set; it is set
+   * as soon as a shard returns false or throws.
+   *
+   * @param shards the number of shards, at least 1
+   * @param f the function to run, passed (shard, stop)
+   *
+   * @return false if any call returned false, otherwise true; rethrows the
+   * first exception a call threw
+   */
+  static bool run_shards(unsigned shards, const std::function<bool(unsigned, const std::atomic<bool>&)> &f);
+
+  //! the number of shards for_all_*_parallel use when asked for 0
+  static unsigned get_default_shards();
+
   mutable uint64_t time_tx_exists = 0;  //!< a performance metric
   uint64_t time_commit1 = 0;  //!< a performance metric
   bool m_auto_remove_logs = true;  //!< whether or not to automatically remove old logs
+  uint64_t m_pruning_depth = 0;  //!< how deep txs get before being pruned, 0 to disable
 
   HardFork* m_hardfork;
 
@@ -577,6 +695,53 @@ public:
    */
   virtual void sync() = 0;
 
+  /**
+   * @brief sync the BlockchainDB with disk, keeping track of the lag
+   *
+   * Calls sync() under m_synchronization_lock, and records how long it
+   * took and the writes it made durable, see get_sync_stats().
+   *
+   * If any of this cannot be done, throws whatever sync() throws
+   */
+  void flush();
+
+  /**
+   * @brief start a thread which syncs the BlockchainDB in groups of blocks
+   *
+   * The thread syncs once the blocks added since the last sync reach any
+   * of the limits given, or when asked to through request_flush().  A
+   * limit of 0 is not used.  Whoever adds blocks then never waits on a
+   * sync, unless a subclass needs m_synchronization_lock while one runs.
+   *
+   * The thread must be stopped, by stop_flusher(), before close().
+   *
+   * @param blocks_per_sync sync once this many blocks are unsynced
+   * @param bytes_per_sync sync once the unsynced blocks are this big
+   * @param interval_ms sync once the oldest unsynced block is this old
+   */
+  void start_flusher(uint64_t blocks_per_sync, uint64_t bytes_per_sync, uint64_t interval_ms);
+
+  /**
+   * @brief stop the thread started by start_flusher(), if any
+   *
+   * A sync in progress is completed, the writes since are left to close().
+   */
+  void stop_flusher();
+
+  /**
+   * @brief ask the flusher thread to sync now, without waiting for it
+   *
+   * Does nothing when there is nothing to sync or no flusher thread.
+   */
+  void request_flush();
+
+  /**
+   * @brief get how far the BlockchainDB's writes are ahead of the disk
+   *
+   * @param stats return-by-reference the sync statistics so far
+   */
+  void get_sync_stats(db_sync_stats_t &stats) const;
+
   /**
    * @brief Remove everything from the BlockchainDB
    *
@@ -611,6 +776,25 @@ public:
    */
   virtual std::string get_db_name() const = 0;
 
+  /**
+   * @brief writes a compacted copy of the database while it stays in use
+   *
+   * The copy is of a single consistent state of the database, and leaves
+   * out its free pages, so it is ready to be opened by a new node. Blocks
+   * may keep being added meanwhile.
+   *
+   * The default implementation throws DB_ERROR, as not all backends can.
+   *
+   * @param path the directory to write the copy in, created if needed;
+   * it must not already hold a database
+   * @param max_bytes_per_sec the most bytes written per second, 0 for no limit
+   * @param progress if not empty, called as the copy goes with (bytes
+   * written, expected total); returning false abandons the copy
+   *
+   * @return true if the copy was written, false if it was abandoned
+   */
+  virtual bool copy_snapshot(const std::string &path, uint64_t max_bytes_per_sec, const std::function<bool(uint64_t, uint64_t)> &progress) const;
+
 
   // FIXME: these are just for functionality mocking, need to implement
   // RAII-friendly and multi-read one-write friendly locking mechanism
@@ -702,6 +886,75 @@ public:
   virtual void block_txn_stop() = 0;
   virtual void block_txn_abort() = 0;
 
+  /**
+   * @brief whether reads can run from a snapshot while blocks are written
+   *
+   * When true, read_snapshot_start lets a thread read a consistent view of
+   * the db without holding out a writer on another thread, so callers may
+   * query without the blockchain lock.
+   *
+   * @return true if read_snapshot_start/stop are supported
+   */
+  virtual bool can_snapshot_reads() const { return false; }
+
+  /**
+   * @brief pins a read snapshot of the db for the calling thread
+   *
+   * Until the matching read_snapshot_stop, every read on this thread sees
+   * the db as it was at this call. Calls nest, and block_txn_start(true)
+   * and block_txn_stop() within one leave it in place. On a thread which
+   * holds the write transaction, reads already see its own writes, and
+   * this does nothing.
+   *
+   * The default implementation does nothing, see can_snapshot_reads.
+   */
+  virtual void read_snapshot_start() const { }
+
+  /**
+   * @brief releases a snapshot taken with read_snapshot_start
+   */
+  virtual void read_snapshot_stop() const { }
+
+  /**
+   * @brief lets the subclass do housekeeping while the daemon is idle
+   *
+   * A subclass may use this to do work which would otherwise stall readers
+   * and writers at a worse time, such as growing its storage ahead of need.
+   *
+   * The caller must ensure no write transaction is in progress.
+   */
+  virtual void on_idle() { }
+
+  /**
+   * @brief catches up with what another process wrote to the db
+   *
+   * A db opened read only while another process writes it must not trust
+   * what it cached about the chain, such as its height and counts, nor
+   * filters of what it holds. This reloads them, and adopts a larger map if
+   * the writer grew the db.
+   *
+   * The default implementation does nothing.
+   */
+  virtual void refresh() { }
+
+  /**
+   * @brief get per-method usage statistics
+   *
+   * A subclass which does not keep such statistics returns nothing.
+   *
+   * @param stats return-by-reference one entry per method called so far
+   */
+  virtual void get_op_stats(std::vector<db_op_stats_t> &stats) const { stats.clear(); }
+
+  /**
+   * @brief get the memory the database has mapped
+   *
+   * A subclass which does not map its storage returns zeros.
+   *
+   * @param stats return-by-reference the mapped, used and resident bytes
+   */
+  virtual void get_memory_stats(db_memory_stats_t &stats) const { stats = db_memory_stats_t(); }
+
   virtual void set_hard_fork(HardFork* hf);
 
   // adds a block with the given metadata to the top of the blockchain, returns the new height
@@ -722,6 +975,8 @@ public:
    * @param cumulative_difficulty the accumulated difficulty after this block
    * @param coins_generated the number of coins generated total after this block
    * @param txs the transactions in the block
+   * @param prepared the block's records from prepare_block(), NULL to
+   *        prepare them here, inside the write transaction
    *
    * @return the height of the chain post-addition
    */
@@ -730,8 +985,22 @@ public:
                             , const difficulty_type& cumulative_difficulty
                             , const uint64_t& coins_generated
                             , const std::vector<transaction>& txs
+                            , const prepared_block_t* prepared = NULL
                             );
 
+  /**
+   * @brief serializes a block and its transactions for add_block()
+   *
+   * This does not touch the db, so it may run on any thread and while
+   * another block is being written.
+   *
+   * @param blk the block to be added
+   * @param txs the transactions in the block
+   * @param prepared return-by-reference the block's records
+   * @param threads if not NULL, transactions are serialized on these too
+   */
+  static void prepare_block(const block& blk, const std::vector<transaction>& txs, prepared_block_t& prepared, tools::thread_group* threads = NULL);
+
   /**
    * @brief checks if a block exists
    *
@@ -755,6 +1024,20 @@ public:
    */
   virtual block get_block(const crypto::hash& h) const = 0;
 
+  /**
+   * @brief fetches the block with the given hash, as stored
+   *
+   * The subclass should return the requested block's blob as it is stored,
+   * without parsing it, so it can be sent on as is.
+   *
+   * If the block does not exist, the subclass should throw BLOCK_DNE
+   *
+   * @param h the hash to look for
+   *
+   * @return the block blob requested
+   */
+  virtual blobdata get_block_blob(const crypto::hash& h) const = 0;
+
   /**
    * @brief gets the height of the block with a given hash
    *
@@ -796,6 +1079,21 @@ public:
    */
   virtual block get_block_from_height(const uint64_t& height) const = 0;
 
+  /**
+   * @brief fetch a block blob by height
+   *
+   * The subclass should return the blob of the block at the given height,
+   * as it is stored.
+   *
+   * If the block does not exist, that is to say if the blockchain is not
+   * that high, then the subclass should throw BLOCK_DNE
+   *
+   * @param height the height to look for
+   *
+   * @return the block blob
+   */
+  virtual blobdata get_block_blob_from_height(const uint64_t& height) const = 0;
+
   /**
    * @brief fetch a block's timestamp
    *
@@ -1019,6 +1317,19 @@ public:
    */
   virtual transaction get_tx(const crypto::hash& h) const = 0;
 
+  /**
+   * @brief fetches the transaction blob with the given hash
+   *
+   * The subclass should return the blob of the transaction stored which has
+   * the given hash, without parsing it.
+   *
+   * @param h the hash to look for
+   * @param tx return-by-reference the transaction blob
+   *
+   * @return false if the transaction does not exist, true otherwise
+   */
+  virtual bool get_tx_blob(const crypto::hash& h, blobdata &tx) const = 0;
+
   /**
    * @brief fetches the total number of transactions ever
    *
@@ -1170,6 +1481,23 @@ public:
    * @param outputs return-by-reference a list of outputs' metadata
    */
   virtual void get_output_key(const uint64_t &amount, const std::vector<uint64_t> &offsets, std::vector<output_data_t> &outputs) = 0;
+
+  /**
+   * @brief gets outputs' data for several amounts at once
+   *
+   * This function is a mirror of
+   * get_output_key(const uint64_t &amount, const std::vector<uint64_t> &offsets, std::vector<output_data_t> &outputs)
+   * but for outputs of any number of amounts, looked up in a single pass.
+   *
+   * The list should be sorted by amount, then by index, so the lookups walk
+   * the output table in order.
+   *
+   * If any of the outputs cannot be found, the subclass should throw OUTPUT_DNE.
+   *
+   * @param offsets a list of (amount, amount-specific output index) pairs
+   * @param outputs return-by-reference a list of outputs' metadata, in the same order
+   */
+  virtual void get_output_keys_bulk(const std::vector<std::pair<uint64_t, uint64_t>> &offsets, std::vector<output_data_t> &outputs) = 0;
   
   /*
    * FIXME: Need to check with git blame and ask what this does to
@@ -1193,6 +1521,41 @@ public:
    */
   virtual std::vector<uint64_t> get_tx_amount_output_indices(const uint64_t tx_id) const = 0;
 
+  /**
+   * @brief gets the amount-specific output indices of a list of transactions
+   *
+   * The default implementation calls tx_exists and
+   * get_tx_amount_output_indices for each transaction; a subclass may do
+   * all the lookups in a single read transaction.
+   *
+   * @param tx_hashes the hashes of the transactions
+   * @param output_indices return-by-reference the output indices of each transaction, in input order, empty if not found
+   * @param found return-by-reference whether each transaction is present, in input order
+   */
+  virtual void get_txs_amount_output_indices(const std::vector<crypto::hash>& tx_hashes, std::vector<std::vector<uint64_t> >& output_indices, std::vector<bool>& found) const;
+
+  /**
+   * @brief gets a range of blocks with their transactions and output indices
+   *
+   * For each block from start_height up, until count blocks or the top of
+   * the chain, this appends the block blob and its non-miner transaction
+   * blobs to blocks.  It also appends the amount-specific output indices of
+   * each of the block's transactions, miner tx first, to output_indices.
+   *
+   * The default implementation looks each transaction up by hash; a
+   * subclass which stores transactions in block order may read them all in
+   * a single pass.
+   *
+   * If a block or transaction is missing, the subclass should throw
+   * BLOCK_DNE or TX_DNE.
+   *
+   * @param start_height the height of the first block
+   * @param count the max number of blocks to get
+   * @param blocks return-by-reference the block and transaction blobs, as stored
+   * @param output_indices return-by-reference the output indices, per block and per tx
+   */
+  virtual void get_blocks_with_output_indices(uint64_t start_height, size_t count, std::vector<std::pair<blobdata, std::vector<blobdata> > >& blocks, std::vector<std::vector<std::vector<uint64_t> > >& output_indices) const;
+
   /**
    * @brief check if a key image is stored as spent
    *
@@ -1202,6 +1565,17 @@ public:
    */
   virtual bool has_key_image(const crypto::key_image& img) const = 0;
 
+  /**
+   * @brief check if each of a list of key images is stored as spent
+   *
+   * The default implementation calls has_key_image for each image; a
+   * subclass may do it in a single pass.
+   *
+   * @param imgs the key images to check for
+   * @param spent return-by-reference whether each image is present, in input order
+   */
+  virtual void has_key_images(const std::vector<crypto::key_image>& imgs, std::vector<bool>& spent) const;
+
   /**
    * @brief runs a function over all key images stored
    *
@@ -1272,6 +1646,66 @@ public:
    */
   virtual bool for_all_outputs(std::function<bool(uint64_t amount, const crypto::hash &tx_hash, size_t tx_idx)> f) const = 0;
 
+  /**
+   * @brief runs a function over all key images stored, in parallel
+   *
+   * As for_all_key_images, but the key images are split into shards by
+   * key range, and the shards are walked concurrently, each on its own
+   * thread. Calls for one shard are made in order from a single thread,
+   * calls for different shards are not, so the function must be thread
+   * safe; keeping its state per shard, indexed by the shard parameter,
+   * avoids any locking. If the db is written to meanwhile, the shards may
+   * see different states of it.
+   *
+   * Once a call returns false, the other shards stop at their next item.
+   * Exceptions thrown in a shard are rethrown to the caller.
+   *
+   * The default implementation runs for_all_key_images as shard 0.
+   *
+   * @param shards the number of shards, 0 for one per hardware thread
+   * @param f the function to run, passed (shard, key_image)
+   *
+   * @return false if the function returns false for any key image, otherwise true
+   */
+  virtual bool for_all_key_images_parallel(unsigned shards, std::function<bool(unsigned, const crypto::key_image&)> f) const;
+
+  /**
+   * @brief runs a function over all blocks stored, in parallel
+   *
+   * See for_all_key_images_parallel; blocks are sharded by height.
+   *
+   * @param shards the number of shards, 0 for one per hardware thread
+   * @param f the function to run, passed (shard, block_height, block_hash, block)
+   *
+   * @return false if the function returns false for any block, otherwise true
+   */
+  virtual bool for_all_blocks_parallel(unsigned shards, std::function<bool(unsigned, uint64_t, const crypto::hash&, const cryptonote::block&)> f) const;
+
+  /**
+   * @brief runs a function over all transactions stored, in parallel
+   *
+   * See for_all_key_images_parallel; transactions are sharded by hash.
+   *
+   * @param shards the number of shards, 0 for one per hardware thread
+   * @param f the function to run, passed (shard, transaction_hash, transaction)
+   *
+   * @return false if the function returns false for any transaction, otherwise true
+   */
+  virtual bool for_all_transactions_parallel(unsigned shards, std::function<bool(unsigned, const crypto::hash&, const cryptonote::transaction&)> f) const;
+
+  /**
+   * @brief runs a function over all outputs stored, in parallel
+   *
+   * See for_all_key_images_parallel; outputs are sharded by (amount,
+   * amount index), in shards of about the same size.
+   *
+   * @param shards the number of shards, 0 for one per hardware thread
+   * @param f the function to run, passed (shard, amount, transaction_hash, tx_local_output_index)
+   *
+   * @return false if the function returns false for any output, otherwise true
+   */
+  virtual bool for_all_outputs_parallel(unsigned shards, std::function<bool(unsigned, uint64_t amount, const crypto::hash &tx_hash, size_t tx_idx)> f) const;
+
 
   //
   // Hard fork related storage
@@ -1294,6 +1728,31 @@ public:
    */
   virtual uint8_t get_hard_fork_version(uint64_t height) const = 0;
 
+  /**
+   * @brief sets which hardfork version a height is on, along with the
+   * version and vote of the block there
+   *
+   * Keeping the block's version and vote lets the voting window be rebuilt
+   * without reading whole blocks. By default only the hardfork version is kept.
+   *
+   * @param height the height
+   * @param version the hardfork version
+   * @param block_version the block's major version
+   * @param vote the block's vote
+   */
+  virtual void set_hard_fork_info(uint64_t height, uint8_t version, uint8_t block_version, uint8_t vote) { set_hard_fork_version(height, version); }
+
+  /**
+   * @brief gets the version and vote of the block at a height, as kept by set_hard_fork_info
+   *
+   * @param height the height
+   * @param block_version return-by-reference the block's major version
+   * @param vote return-by-reference the block's vote
+   *
+   * @return false if they were not kept, e.g. for blocks added by older versions
+   */
+  virtual bool get_hard_fork_info(uint64_t height, uint8_t &block_version, uint8_t &vote) const { return false; }
+
   /**
    * @brief verify hard fork info in database
    */
@@ -1315,6 +1774,27 @@ public:
    */
   virtual std::map<uint64_t, std::tuple<uint64_t, uint64_t, uint64_t>> get_output_histogram(const std::vector<uint64_t> &amounts, bool unlocked, uint64_t recent_cutoff) const = 0;
 
+  /**
+   * @brief get the cumulative number of outputs of an amount per block
+   *
+   * distribution[n] is the number of outputs with the given amount created
+   * by the blocks up to and including from_height + n, so the outputs of
+   * block from_height + n have the amount indices from distribution[n - 1]
+   * (or base, for n == 0) up to distribution[n].  RingCT outputs are amount 0.
+   *
+   * The default implementation parses every block up to to_height; a
+   * subclass may keep running counts instead.
+   *
+   * @param amount the amount to count outputs of
+   * @param from_height the first height to report
+   * @param to_height the last height to report, clamped to the top block
+   * @param distribution return-by-reference the cumulative counts
+   * @param base return-by-reference the number of outputs before from_height
+   *
+   * @return false if from_height is past the top block, otherwise true
+   */
+  virtual bool get_output_distribution(uint64_t amount, uint64_t from_height, uint64_t to_height, std::vector<uint64_t> &distribution, uint64_t &base) const;
+
   /**
    * @brief is BlockchainDB in read-only mode?
    *
@@ -1339,9 +1819,57 @@ public:
    */
   void set_auto_remove_logs(bool auto_remove) { m_auto_remove_logs = auto_remove; }
 
+  /**
+   * @brief set how deep transactions must be before being pruned
+   *
+   * Pruning drops a transaction's signatures, or the prunable part of its
+   * ringct signatures, and keeps its prefix and ringct base.  This is only
+   * supported by one implementation (BlockchainLMDB).
+   *
+   * @param depth number of blocks below the top to keep unpruned, 0 to disable
+   */
+  void set_pruning_depth(uint64_t depth) { m_pruning_depth = depth; }
+
+  /**
+   * @brief get the height below which transactions are pruned
+   *
+   * Transactions read from blocks below this height come back with their
+   * pruned flag set, and such blocks can't be served to peers in full.
+   *
+   * @return the pruned height, 0 if nothing is pruned
+   */
+  virtual uint64_t get_pruned_height() const { return 0; }
+
   bool m_open;  //!< Whether or not the BlockchainDB is open/ready for use
   mutable epee::critical_section m_synchronization_lock;  //!< A lock, currently for when BlockchainLMDB needs to resize the backing db file
 
+private:
+
+  /**
+   * @brief records a block added, waking the flusher thread if it is due
+   *
+   * @param bytes the size of the block
+   */
+  void add_unsynced(uint64_t bytes);
+
+  //! whether the flusher thread should sync now, m_flush_mutex held
+  bool flush_due(uint64_t now_ms) const;
+
+  //! the flusher thread
+  void flusher_main();
+
+  boost::thread m_flusher;
+  mutable boost::mutex m_flush_mutex;  //!< for all the members below
+  boost::condition_variable m_flush_cond;
+  bool m_flusher_running = false;
+  bool m_flusher_stop = false;
+  bool m_flush_requested = false;
+  uint64_t m_blocks_per_flush = 0;
+  uint64_t m_bytes_per_flush = 0;
+  uint64_t m_flush_interval_ms = 0;
+  uint64_t m_unsynced_since_ms = 0;  //!< when the oldest unsynced block was added
+  db_sync_stats_t m_sync_stats = {};
+
 };  // class BlockchainDB
 
 
@@ -0,0 +1,105 @@
+// Copyright (c) 2014-2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <cstring>
+
+#include "crypto/crypto.h"
+#include "hash_filter.h"
+
+namespace cryptonote
+{
+
+hash_filter::hash_filter(uint64_t capacity)
+  : m_capacity(capacity)
+  , m_salt(crypto::rand<uint64_t>())
+  , m_count(0)
+{
+  m_blocks = (capacity + HASHES_PER_BLOCK - 1) / HASHES_PER_BLOCK;
+  if (m_blocks == 0)
+    m_blocks = 1;
+  // the block index is picked from 32 bits of the hash
+  if (m_blocks > 0xffffffff)
+    m_blocks = 0xffffffff;
+  m_words.reset(new std::atomic<uint64_t>[m_blocks * WORDS_PER_BLOCK]);
+  for (uint64_t n = 0; n < m_blocks * WORDS_PER_BLOCK; ++n)
+    m_words[n].store(0, std::memory_order_relaxed);
+}
+
+uint64_t hash_filter::hash(const void *data) const
+{
+  // the salt is secret and per filter, so nobody can pick hashes which all
+  // land in the same few blocks
+  uint64_t w[4];
+  memcpy(w, data, sizeof(w));
+  uint64_t h = m_salt;
+  for (size_t n = 0; n < 4; ++n)
+  {
+    h ^= w[n];
+    h *= 0x9e3779b97f4a7c15ull;
+    h ^= h >> 29;
+  }
+  h *= 0xbf58476d1ce4e5b9ull;
+  h ^= h >> 32;
+  return h;
+}
+
+uint64_t hash_filter::block_index(uint64_t h) const
+{
+  // maps the top 32 bits onto [0, m_blocks) without a division
+  return (h >> 32) * m_blocks >> 32;
+}
+
+uint64_t hash_filter::bit_hash(uint64_t h)
+{
+  // the bits within the block must not depend on the bits that picked it
+  h *= 0x94d049bb133111ebull;
+  return h >> 16;
+}
+
+void hash_filter::insert(const void *data)
+{
+  const uint64_t h = hash(data);
+  const uint64_t bits = bit_hash(h);
+  std::atomic<uint64_t> *block = &m_words[block_index(h) * WORDS_PER_BLOCK];
+  for (size_t n = 0; n < WORDS_PER_BLOCK; ++n)
+    block[n].fetch_or(1ull << ((bits >> (6 * n)) & 63), std::memory_order_relaxed);
+  m_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool hash_filter::may_contain(const void *data) const
+{
+  const uint64_t h = hash(data);
+  const uint64_t bits = bit_hash(h);
+  const std::atomic<uint64_t> *block = &m_words[block_index(h) * WORDS_PER_BLOCK];
+  for (size_t n = 0; n < WORDS_PER_BLOCK; ++n)
+    if (!(block[n].load(std::memory_order_relaxed) & (1ull << ((bits >> (6 * n)) & 63))))
+      return false;
+  return true;
+}
+
+}  // namespace cryptonote
@@ -0,0 +1,101 @@
+// Copyright (c) 2014-2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace cryptonote
+{
+
+/**
+ * @brief an in-memory Bloom filter over 32 byte hashes
+ *
+ * Answers whether a hash (a tx hash, a key image, ...) is definitely not in
+ * a set, so lookups for things a database doesn't have can skip it. It is
+ * a split block filter: each hash sets one bit in each of the eight words
+ * of a single 64 byte block, so a lookup touches one cache line. At the
+ * requested capacity about one lookup in 1500 is a false positive.
+ *
+ * Hashes can't be removed. insert() and may_contain() may be called from
+ * any number of threads at once.
+ */
+class hash_filter
+{
+public:
+  /**
+   * @brief create an empty filter sized for the given number of hashes
+   *
+   * @param capacity the number of hashes the filter is sized for
+   */
+  explicit hash_filter(uint64_t capacity);
+
+  /**
+   * @brief add a hash to the filter
+   *
+   * @param data the 32 byte hash
+   */
+  void insert(const void *data);
+
+  /**
+   * @brief check whether a hash may have been added
+   *
+   * @param data the 32 byte hash
+   *
+   * @return false if the hash was never added, true if it may have been
+   */
+  bool may_contain(const void *data) const;
+
+  //! the number of insertions so far
+  uint64_t size() const { return m_count.load(std::memory_order_relaxed); }
+
+  //! the number of hashes the filter was sized for
+  uint64_t capacity() const { return m_capacity; }
+
+  //! the memory used by the filter's bits, in bytes
+  size_t memory() const { return m_blocks * sizeof(uint64_t) * WORDS_PER_BLOCK; }
+
+private:
+  static constexpr size_t WORDS_PER_BLOCK = 8;
+  static constexpr uint64_t HASHES_PER_BLOCK = 32;
+
+  uint64_t hash(const void *data) const;
+  uint64_t block_index(uint64_t h) const;
+  static uint64_t bit_hash(uint64_t h);
+
+  std::unique_ptr<std::atomic<uint64_t>[]> m_words;
+  uint64_t m_blocks;
+  uint64_t m_capacity;
+  uint64_t m_salt;
+  std::atomic<uint64_t> m_count;
+};
+
+}  // namespace cryptonote
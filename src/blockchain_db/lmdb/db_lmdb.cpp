@@ -33,6 +33,15 @@
 #include <memory>  // std::unique_ptr
 #include <cstring>  // memcpy
 #include <random>
+#include <chrono>
+#include <algorithm>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+#endif
 
 #include "cryptonote_core/cryptonote_format_utils.h"
 #include "crypto/crypto.h"
@@ -76,6 +85,8 @@ inline void throw1(const T &e)
 }
 
 #define MDB_val_set(var, val)   MDB_val var = {sizeof(val), (void *)&val}
+// points at a blob's bytes, which must outlive the put, instead of copying them
+#define MDB_val_str(var, str)   MDB_val var = {(str).size(), (void *)(str).data()}
 
 template<typename T>
 struct MDB_val_copy: public MDB_val
@@ -155,6 +166,7 @@ int compare_string(const MDB_val *a, const MDB_val *b)
  * blocks           block ID     block blob
  * block_heights    block hash   block height
  * block_info       block ID     {block metadata}
+ * block_rct_outputs block ID    {RingCT outputs created up to and including the block}
  *
  * txs              txn ID       txn blob
  * tx_indices       txn hash     {txn ID, metadata}
@@ -165,6 +177,9 @@ int compare_string(const MDB_val *a, const MDB_val *b)
  *
  * spent_keys       input hash   -
  *
+ * When pruning, the txn blobs of blocks below the "pruned_height" property
+ * are rewritten without their signatures / prunable ringct data.
+ *
  * Note: where the data items are of uniform size, DUPFIXED tables have
  * been used to save space. In most of these cases, a dummy "zerokval"
  * key is used when accessing the table; the Key listed above will be
@@ -176,6 +191,7 @@ int compare_string(const MDB_val *a, const MDB_val *b)
 const char* const LMDB_BLOCKS = "blocks";
 const char* const LMDB_BLOCK_HEIGHTS = "block_heights";
 const char* const LMDB_BLOCK_INFO = "block_info";
+const char* const LMDB_BLOCK_RCT_OUTPUTS = "block_rct_outputs";
 
 const char* const LMDB_TXS = "txs";
 const char* const LMDB_TX_INDICES = "tx_indices";
@@ -199,6 +215,18 @@ const std::string lmdb_error(const std::string& error_string, int mdb_res)
   return full_string;
 }
 
+// Puts a record whose key (or with dup, whose duplicate) sorts after all the
+// stored ones, as block, tx and output IDs do. LMDB then skips the search and
+// fills pages up instead of splitting them in half. Should the order not hold,
+// the record is inserted normally, still refusing to overwrite one.
+int cursor_append(MDB_cursor *cur, MDB_val *key, MDB_val *data, bool dup)
+{
+  int result = mdb_cursor_put(cur, key, data, dup ? MDB_APPENDDUP : MDB_APPEND);
+  if (result == MDB_KEYEXIST)
+    result = mdb_cursor_put(cur, key, data, dup ? MDB_NODUPDATA : MDB_NOOVERWRITE);
+  return result;
+}
+
 inline void lmdb_db_open(MDB_txn* txn, const char* name, int flags, MDB_dbi& dbi, const std::string& error_string)
 {
   if (auto res = mdb_dbi_open(txn, name, flags, &dbi))
@@ -247,6 +275,11 @@ typedef struct blk_height {
     uint64_t bh_height;
 } blk_height;
 
+typedef struct blk_rct_outputs {
+    uint64_t bro_height;
+    uint64_t bro_cum_rct;
+} blk_rct_outputs;
+
 typedef struct txindex {
     crypto::hash key;
     tx_data_t data;
@@ -272,6 +305,71 @@ typedef struct outtx {
 
 std::atomic<uint64_t> mdb_txn_safe::num_active_txns{0};
 std::atomic_flag mdb_txn_safe::creation_gate = ATOMIC_FLAG_INIT;
+std::atomic<uint64_t> mdb_txn_safe::num_rtxn_begins{0};
+std::atomic<uint64_t> mdb_txn_safe::num_rtxn_renews{0};
+
+std::vector<mdb_op_stats*> mdb_op_stats::all;
+std::atomic_flag mdb_op_stats::all_gate = ATOMIC_FLAG_INIT;
+
+mdb_op_stats::mdb_op_stats(const char *method, const char *table) :
+  m_method(method), m_table(table), m_calls{0}, m_bytes{0}, m_cursor_ops{0}, m_gets{0}
+{
+  for (auto &l: m_latency)
+    l = 0;
+  while (all_gate.test_and_set());
+  all.push_back(this);
+  all_gate.clear();
+}
+
+void mdb_op_stats::add(uint64_t usec, uint64_t bytes, uint64_t cursor_ops, uint64_t gets)
+{
+  unsigned bucket = 0;
+  while (usec > 1 && bucket < MDB_OP_STATS_BUCKETS - 1)
+  {
+    usec >>= 1;
+    ++bucket;
+  }
+  ++m_latency[bucket];
+  m_bytes += bytes;
+  m_cursor_ops += cursor_ops;
+  m_gets += gets;
+  ++m_calls;
+}
+
+uint64_t mdb_op_stats::percentile(uint64_t calls, unsigned pct) const
+{
+  if (calls == 0)
+    return 0;
+  const uint64_t target = (calls * pct + 99) / 100;
+  uint64_t seen = 0;
+  for (unsigned i = 0; i < MDB_OP_STATS_BUCKETS; ++i)
+  {
+    seen += m_latency[i];
+    if (seen >= target)
+      return (uint64_t)2 << i;
+  }
+  return (uint64_t)2 << (MDB_OP_STATS_BUCKETS - 1);
+}
+
+static uint64_t mdb_op_now_usec()
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+mdb_op_timer::mdb_op_timer(mdb_op_stats &stats) :
+  m_stats(stats), m_start(mdb_op_now_usec()), m_bytes(0), m_cursor_ops(0), m_gets(0)
+{
+}
+
+mdb_op_timer::~mdb_op_timer()
+{
+  m_stats.add(mdb_op_now_usec() - m_start, m_bytes, m_cursor_ops, m_gets);
+}
+
+// one set of counters per calling method, registered on first use
+#define DB_OP_STATS(table) \
+  static mdb_op_stats op_stats(__func__, table); \
+  mdb_op_timer op_timer(op_stats)
 
 mdb_threadinfo::~mdb_threadinfo()
 {
@@ -373,6 +471,18 @@ void mdb_txn_safe::allow_new_txns()
   creation_gate.clear();
 }
 
+void mdb_txn_safe::add_active_txn()
+{
+  while (creation_gate.test_and_set());
+  num_active_txns++;
+  creation_gate.clear();
+}
+
+void mdb_txn_safe::remove_active_txn()
+{
+  num_active_txns--;
+}
+
 
 
 void BlockchainLMDB::do_resize(uint64_t increase_size)
@@ -386,7 +496,7 @@ void BlockchainLMDB::do_resize(uint64_t increase_size)
   {
     boost::filesystem::path path(m_folder);
     boost::filesystem::space_info si = boost::filesystem::space(path);
-    if(si.available < add_size)
+    if(si.available < std::max(add_size, increase_size))
     {
       LOG_PRINT_RED_L0("!! WARNING: Insufficient free space to extend database !!: " << si.available / 1LL << 20L);
       return;
@@ -417,6 +527,7 @@ void BlockchainLMDB::do_resize(uint64_t increase_size)
 
   new_mapsize += (new_mapsize % mst.ms_psize);
 
+  TIME_MEASURE_START(pause);
   mdb_txn_safe::prevent_new_txns();
 
   if (m_write_txn != nullptr)
@@ -437,9 +548,193 @@ void BlockchainLMDB::do_resize(uint64_t increase_size)
   if (result)
     throw0(DB_ERROR(lmdb_error("Failed to set new mapsize: ", result).c_str()));
 
-  LOG_PRINT_GREEN("LMDB Mapsize increased." << "  Old: " << mei.me_mapsize / (1024 * 1024) << "MiB" << ", New: " << new_mapsize / (1024 * 1024) << "MiB", LOG_LEVEL_0);
-
   mdb_txn_safe::allow_new_txns();
+  TIME_MEASURE_FINISH(pause);
+
+  ++m_resize_count;
+  m_resize_pause_total += pause;
+  m_resize_pause_max = std::max(m_resize_pause_max, (uint64_t)pause);
+
+  LOG_PRINT_GREEN("LMDB Mapsize increased." << "  Old: " << mei.me_mapsize / (1024 * 1024) << "MiB" << ", New: " << new_mapsize / (1024 * 1024) << "MiB"
+      << ", txns paused for " << pause << " ms", LOG_LEVEL_0);
+}
+
+void BlockchainLMDB::refresh()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  // a writer's counts follow its own writes
+  if (!is_read_only())
+    return;
+
+  // once the writer grows the map past ours, read txns fail until we adopt
+  // its size, which needs them all ended, as for a resize
+  MDB_txn *probe;
+  int result = mdb_txn_begin(m_env, NULL, MDB_RDONLY, &probe);
+  if (result == MDB_MAP_RESIZED)
+  {
+    mdb_txn_safe::prevent_new_txns();
+    mdb_txn_safe::wait_no_active_txns();
+    result = mdb_env_set_mapsize(m_env, 0);
+    mdb_txn_safe::allow_new_txns();
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to adopt the writer's map size: ", result).c_str()));
+    LOG_PRINT_L1("LMDB map size followed the writer's");
+  }
+  else if (result)
+  {
+    throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+  }
+  else
+  {
+    mdb_txn_abort(probe);
+  }
+
+  mdb_txn_safe txn;
+  if ((result = mdb_txn_begin(m_env, NULL, MDB_RDONLY, txn)))
+    throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+
+  MDB_stat db_stats;
+  if ((result = mdb_stat(txn, m_blocks, &db_stats)))
+    throw0(DB_ERROR(lmdb_error("Failed to query m_blocks: ", result).c_str()));
+  m_height = db_stats.ms_entries;
+  if ((result = mdb_stat(txn, m_txs, &db_stats)))
+    throw0(DB_ERROR(lmdb_error("Failed to query m_txs: ", result).c_str()));
+  m_num_txs = db_stats.ms_entries;
+  if ((result = mdb_stat(txn, m_output_txs, &db_stats)))
+    throw0(DB_ERROR(lmdb_error("Failed to query m_output_txs: ", result).c_str()));
+  m_num_outputs = db_stats.ms_entries;
+
+  MDB_val_copy<const char*> pk("pruned_height");
+  MDB_val pv;
+  if (mdb_get(txn, m_properties, &pk, &pv) == MDB_SUCCESS)
+    m_pruned_height = *(const uint64_t*)pv.mv_data;
+
+  CRITICAL_REGION_LOCAL(m_recent_outputs_lock);
+  m_recent_outputs_valid = false;
+}
+
+uint64_t BlockchainLMDB::get_pruned_height() const
+{
+  return m_pruned_height;
+}
+
+void BlockchainLMDB::get_op_stats(std::vector<db_op_stats_t> &stats) const
+{
+  stats.clear();
+  while (mdb_op_stats::all_gate.test_and_set());
+  const std::vector<mdb_op_stats*> all = mdb_op_stats::all;
+  mdb_op_stats::all_gate.clear();
+
+  for (const mdb_op_stats *op: all)
+  {
+    db_op_stats_t entry;
+    entry.method = op->m_method;
+    entry.table = op->m_table;
+    entry.calls = op->m_calls;
+    entry.bytes_read = op->m_bytes;
+    entry.cursor_ops = op->m_cursor_ops;
+    entry.gets = op->m_gets;
+    entry.p50_us = op->percentile(entry.calls, 50);
+    entry.p99_us = op->percentile(entry.calls, 99);
+    stats.push_back(entry);
+  }
+}
+
+void BlockchainLMDB::get_memory_stats(db_memory_stats_t &stats) const
+{
+  stats = db_memory_stats_t();
+  MDB_envinfo mei;
+  MDB_stat mst;
+  if (mdb_env_info(m_env, &mei) || mdb_env_stat(m_env, &mst))
+    return;
+  stats.map_size = mei.me_mapsize;
+  stats.used_bytes = (mei.me_last_pgno + 1) * (uint64_t)mst.ms_psize;
+
+#ifdef __linux__
+  // the pages of the map in the page cache count in our resident set; a
+  // resize racing with this remaps, and mincore then fails harmlessly
+  const uint64_t page_size = sysconf(_SC_PAGESIZE);
+  const uint64_t length = std::min(stats.used_bytes, stats.map_size);
+  std::vector<unsigned char> resident((length + page_size - 1) / page_size);
+  if (mei.me_mapaddr && mincore(mei.me_mapaddr, length, resident.data()) == 0)
+  {
+    uint64_t pages = 0;
+    for (unsigned char r: resident)
+      pages += r & 1;
+    stats.resident_bytes = pages * page_size;
+  }
+#endif
+}
+
+void BlockchainLMDB::get_resize_stats(uint64_t &count, uint64_t &total_ms, uint64_t &max_ms) const
+{
+  count = m_resize_count;
+  total_ms = m_resize_pause_total;
+  max_ms = m_resize_pause_max;
+}
+
+void BlockchainLMDB::on_idle()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  if (!m_open || m_batch_active || m_write_txn)
+    return;
+
+  unsigned int env_flags;
+  if (mdb_env_get_flags(m_env, &env_flags) || (env_flags & MDB_RDONLY))
+    return;
+
+  prune(PRUNE_BLOCKS_PER_IDLE);
+
+  // we're called with the blockchain locked, so nothing is being written
+  // while the filters are rebuilt
+  const std::shared_ptr<hash_filter> spent_keys_filter = std::atomic_load(&m_spent_keys_filter);
+  const std::shared_ptr<hash_filter> tx_filter = std::atomic_load(&m_tx_filter);
+  if (spent_keys_filter && tx_filter)
+  {
+    if (spent_keys_filter->size() > spent_keys_filter->capacity() || m_spent_keys_removed > spent_keys_filter->size() / 8
+        || tx_filter->size() > tx_filter->capacity() || m_txs_removed > tx_filter->size() / 8)
+      build_filters();
+  }
+
+#if defined(ENABLE_AUTO_RESIZE)
+  MDB_envinfo mei;
+  mdb_env_info(m_env, &mei);
+  MDB_stat mst;
+  mdb_env_stat(m_env, &mst);
+  const uint64_t size_used = mst.ms_psize * mei.me_last_pgno;
+
+  // smooth the write rate over idle checks, so a single burst doesn't
+  // trigger a large resize
+  const time_t now = time(NULL);
+  if (m_idle_check_time > 0 && now > m_idle_check_time && size_used >= m_idle_check_size_used)
+  {
+    const double rate = (size_used - m_idle_check_size_used) / (double)(now - m_idle_check_time);
+    m_write_rate = m_write_rate > 0 ? (m_write_rate + rate) / 2 : rate;
+  }
+  m_idle_check_time = now;
+  m_idle_check_size_used = size_used;
+
+  // grow before the map fills up, or reaches the point where add_block
+  // would resize it while we're busy syncing
+  const uint64_t needed = m_write_rate * RESIZE_AHEAD_SECONDS;
+  if (mei.me_mapsize - size_used > needed && (double)size_used / mei.me_mapsize < RESIZE_PERCENT * 0.75)
+    return;
+
+  // geometric growth, so the number of resizes stays logarithmic in db size
+  uint64_t increase_size = std::max((uint64_t)(mei.me_mapsize * RESIZE_AHEAD_FACTOR), 2 * needed);
+  try
+  {
+    // fall back to the default increase if there's not enough room for that
+    boost::filesystem::space_info si = boost::filesystem::space(boost::filesystem::path(m_folder));
+    if (si.available < increase_size)
+      increase_size = 0;
+  }
+  catch (...) { }
+  LOG_PRINT_L1("Growing LMDB map ahead of need, write rate " << (uint64_t)m_write_rate << " B/s");
+  do_resize(increase_size);
+#endif
 }
 
 // threshold_size is used for batch transactions
@@ -587,8 +882,8 @@ uint64_t BlockchainLMDB::get_estimated_batch_size(uint64_t batch_num_blocks) con
   return threshold_size;
 }
 
-void BlockchainLMDB::add_block(const block& blk, const size_t& block_size, const difficulty_type& cumulative_difficulty, const uint64_t& coins_generated,
-    const crypto::hash& blk_hash)
+void BlockchainLMDB::add_block(const block& blk, const size_t& block_size, const difficulty_type& cumulative_difficulty, const uint64_t& coins_generated, uint64_t num_rct_outs,
+    const crypto::hash& blk_hash, const blobdata& blk_blob)
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
@@ -622,8 +917,8 @@ void BlockchainLMDB::add_block(const block& blk, const size_t& block_size, const
   CURSOR(blocks)
   CURSOR(block_info)
 
-  MDB_val_copy<blobdata> blob(block_to_blob(blk));
-  result = mdb_cursor_put(m_cur_blocks, &key, &blob, MDB_APPEND);
+  MDB_val_str(blob, blk_blob);
+  result = cursor_append(m_cur_blocks, &key, &blob, false);
   if (result)
     throw0(DB_ERROR(lmdb_error("Failed to add block blob to db transaction: ", result).c_str()));
 
@@ -636,7 +931,7 @@ void BlockchainLMDB::add_block(const block& blk, const size_t& block_size, const
   bi.bi_hash = blk_hash;
 
   MDB_val_set(val, bi);
-  result = mdb_cursor_put(m_cur_block_info, (MDB_val *)&zerokval, &val, MDB_APPENDDUP);
+  result = cursor_append(m_cur_block_info, (MDB_val *)&zerokval, &val, true);
   if (result)
     throw0(DB_ERROR(lmdb_error("Failed to add block info to db transaction: ", result).c_str()));
 
@@ -644,6 +939,22 @@ void BlockchainLMDB::add_block(const block& blk, const size_t& block_size, const
   if (result)
     throw0(DB_ERROR(lmdb_error("Failed to add block height by hash to db transaction: ", result).c_str()));
 
+  CURSOR(block_rct_outputs)
+  blk_rct_outputs bro = {m_height, num_rct_outs};
+  if (m_height > 0)
+  {
+    blk_rct_outputs prev = {m_height - 1, 0};
+    MDB_val_set(val_prev, prev);
+    result = mdb_cursor_get(m_cur_block_rct_outputs, (MDB_val *)&zerokval, &val_prev, MDB_GET_BOTH);
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to get the RingCT output count of the previous block: ", result).c_str()));
+    bro.bro_cum_rct += ((const blk_rct_outputs *)val_prev.mv_data)->bro_cum_rct;
+  }
+  MDB_val_set(val_bro, bro);
+  result = cursor_append(m_cur_block_rct_outputs, (MDB_val *)&zerokval, &val_bro, true);
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Failed to add block RingCT output count to db transaction: ", result).c_str()));
+
   m_cum_size += block_size;
   m_cum_count++;
 }
@@ -684,9 +995,17 @@ void BlockchainLMDB::remove_block()
 
   if ((result = mdb_cursor_del(m_cur_block_info, 0)))
       throw1(DB_ERROR(lmdb_error("Failed to add removal of block info to db transaction: ", result).c_str()));
+
+  CURSOR(block_rct_outputs)
+  blk_rct_outputs bro = {m_height - 1, 0};
+  MDB_val_set(val_bro, bro);
+  if ((result = mdb_cursor_get(m_cur_block_rct_outputs, (MDB_val *)&zerokval, &val_bro, MDB_GET_BOTH)))
+      throw1(DB_ERROR(lmdb_error("Failed to locate block RingCT output count for removal: ", result).c_str()));
+  if ((result = mdb_cursor_del(m_cur_block_rct_outputs, 0)))
+      throw1(DB_ERROR(lmdb_error("Failed to add removal of block RingCT output count to db transaction: ", result).c_str()));
 }
 
-uint64_t BlockchainLMDB::add_transaction_data(const crypto::hash& blk_hash, const transaction& tx, const crypto::hash& tx_hash)
+uint64_t BlockchainLMDB::add_transaction_data(const crypto::hash& blk_hash, const transaction& tx, const crypto::hash& tx_hash, const blobdata& tx_blob)
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
@@ -720,9 +1039,11 @@ uint64_t BlockchainLMDB::add_transaction_data(const crypto::hash& blk_hash, cons
   result = mdb_cursor_put(m_cur_tx_indices, (MDB_val *)&zerokval, &val_h, 0);
   if (result)
     throw0(DB_ERROR(lmdb_error("Failed to add tx data to db transaction: ", result).c_str()));
+  if (m_tx_filter)
+    m_tx_filter->insert(&tx_hash);
 
-  MDB_val_copy<blobdata> blob(tx_to_blob(tx));
-  result = mdb_cursor_put(m_cur_txs, &val_tx_id, &blob, MDB_APPEND);
+  MDB_val_str(blob, tx_blob);
+  result = cursor_append(m_cur_txs, &val_tx_id, &blob, false);
   if (result)
     throw0(DB_ERROR(lmdb_error("Failed to add tx blob to db transaction: ", result).c_str()));
 
@@ -776,6 +1097,7 @@ void BlockchainLMDB::remove_transaction_data(const crypto::hash& tx_hash, const
       throw1(DB_ERROR("Failed to add removal of tx index to db transaction"));
 
   m_num_txs--;
+  ++m_txs_removed;
 }
 
 uint64_t BlockchainLMDB::add_output(const crypto::hash& tx_hash,
@@ -801,7 +1123,7 @@ uint64_t BlockchainLMDB::add_output(const crypto::hash& tx_hash,
   outtx ot = {m_num_outputs, tx_hash, local_index};
   MDB_val_set(vot, ot);
 
-  result = mdb_cursor_put(m_cur_output_txs, (MDB_val *)&zerokval, &vot, MDB_APPENDDUP);
+  result = cursor_append(m_cur_output_txs, (MDB_val *)&zerokval, &vot, true);
   if (result)
     throw0(DB_ERROR(lmdb_error("Failed to add output tx hash to db transaction: ", result).c_str()));
 
@@ -836,9 +1158,10 @@ uint64_t BlockchainLMDB::add_output(const crypto::hash& tx_hash,
   }
   data.mv_data = &ok;
 
-  if ((result = mdb_cursor_put(m_cur_output_amounts, &val_amount, &data, MDB_APPENDDUP)))
+  if ((result = cursor_append(m_cur_output_amounts, &val_amount, &data, true)))
       throw0(DB_ERROR(lmdb_error("Failed to add output pubkey to db transaction: ", result).c_str()));
 
+  ++m_pending_output_counts[tx_output.amount];
   m_num_outputs++;
   return ok.amount_index;
 }
@@ -861,7 +1184,7 @@ void BlockchainLMDB::add_tx_amount_output_indices(const uint64_t tx_id,
   v.mv_size = sizeof(uint64_t) * num_outputs;
   // LOG_PRINT_L1("tx_outputs[tx_hash] size: " << v.mv_size);
 
-  result = mdb_cursor_put(m_cur_tx_outputs, &k_tx_id, &v, MDB_APPEND);
+  result = cursor_append(m_cur_tx_outputs, &k_tx_id, &v, false);
   if (result)
     throw0(DB_ERROR(std::string("Failed to add <tx hash, amount output index array> to db transaction: ").append(mdb_strerror(result)).c_str()));
 }
@@ -943,6 +1266,8 @@ void BlockchainLMDB::add_spent_key(const crypto::key_image& k_image)
     else
       throw1(DB_ERROR(lmdb_error("Error adding spent key image to db transaction: ", result).c_str()));
   }
+  if (m_spent_keys_filter)
+    m_spent_keys_filter->insert(&k_image);
 }
 
 void BlockchainLMDB::remove_spent_key(const crypto::key_image& k_image)
@@ -962,6 +1287,7 @@ void BlockchainLMDB::remove_spent_key(const crypto::key_image& k_image)
     result = mdb_cursor_del(m_cur_spent_keys, 0);
     if (result)
         throw1(DB_ERROR(lmdb_error("Error adding removal of key image to db transaction", result).c_str()));
+    ++m_spent_keys_removed;
   }
 }
 
@@ -977,8 +1303,7 @@ blobdata BlockchainLMDB::output_to_blob(const tx_out& output) const
 tx_out BlockchainLMDB::output_from_blob(const blobdata& blob) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
-  std::stringstream ss;
-  ss << blob;
+  binary_input_stream ss(blob);
   binary_archive<false> ba(ss);
   tx_out o;
 
@@ -1021,6 +1346,19 @@ BlockchainLMDB::BlockchainLMDB(bool batch_transactions)
   m_height = 0;
   m_cum_size = 0;
   m_cum_count = 0;
+  m_has_block_rct_outputs = false;
+
+  m_idle_check_time = 0;
+  m_idle_check_size_used = 0;
+  m_write_rate = 0;
+  m_resize_count = 0;
+  m_resize_pause_total = 0;
+  m_resize_pause_max = 0;
+  m_pruned_height = 0;
+  m_recent_outputs_end = 0;
+  m_recent_outputs_valid = false;
+  m_spent_keys_removed = 0;
+  m_txs_removed = 0;
 
   m_hardfork = nullptr;
 }
@@ -1030,6 +1368,7 @@ void BlockchainLMDB::open(const std::string& filename, const int mdb_flags)
   int result;
 
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  DB_OP_STATS(LMDB_PROPERTIES);
 
   if (m_open)
     throw0(DB_OPEN_FAILURE("Attempted to open db, but it's already open"));
@@ -1102,6 +1441,19 @@ void BlockchainLMDB::open(const std::string& filename, const int mdb_flags)
 
   lmdb_db_open(txn, LMDB_BLOCK_INFO, MDB_INTEGERKEY | MDB_CREATE | MDB_DUPSORT | MDB_DUPFIXED, m_block_info, "Failed to open db handle for m_block_info");
   lmdb_db_open(txn, LMDB_BLOCK_HEIGHTS, MDB_INTEGERKEY | MDB_CREATE | MDB_DUPSORT | MDB_DUPFIXED, m_block_heights, "Failed to open db handle for m_block_heights");
+  // added after version 1, and filled in on the first read-write open
+  if (mdb_flags & MDB_RDONLY)
+  {
+    result = mdb_dbi_open(txn, LMDB_BLOCK_RCT_OUTPUTS, MDB_INTEGERKEY | MDB_DUPSORT | MDB_DUPFIXED, &m_block_rct_outputs);
+    if (result && result != MDB_NOTFOUND)
+      throw0(DB_OPEN_FAILURE(lmdb_error("Failed to open db handle for m_block_rct_outputs: ", result).c_str()));
+    m_has_block_rct_outputs = result == 0;
+  }
+  else
+  {
+    lmdb_db_open(txn, LMDB_BLOCK_RCT_OUTPUTS, MDB_INTEGERKEY | MDB_CREATE | MDB_DUPSORT | MDB_DUPFIXED, m_block_rct_outputs, "Failed to open db handle for m_block_rct_outputs");
+    m_has_block_rct_outputs = true;
+  }
 
   lmdb_db_open(txn, LMDB_TXS, MDB_INTEGERKEY | MDB_CREATE, m_txs, "Failed to open db handle for m_txs");
   lmdb_db_open(txn, LMDB_TX_INDICES, MDB_INTEGERKEY | MDB_CREATE | MDB_DUPSORT | MDB_DUPFIXED, m_tx_indices, "Failed to open db handle for m_tx_indices");
@@ -1128,6 +1480,8 @@ void BlockchainLMDB::open(const std::string& filename, const int mdb_flags)
   mdb_set_dupsort(txn, m_output_amounts, compare_uint64);
   mdb_set_dupsort(txn, m_output_txs, compare_uint64);
   mdb_set_dupsort(txn, m_block_info, compare_uint64);
+  if (m_has_block_rct_outputs)
+    mdb_set_dupsort(txn, m_block_rct_outputs, compare_uint64);
 
   mdb_set_compare(txn, m_properties, compare_string);
 
@@ -1155,6 +1509,21 @@ void BlockchainLMDB::open(const std::string& filename, const int mdb_flags)
     throw0(DB_ERROR(lmdb_error("Failed to query m_output_txs: ", result).c_str()));
   m_num_outputs = db_stats.ms_entries;
 
+  m_pruned_height = 0;
+  MDB_val_copy<const char*> pk("pruned_height");
+  MDB_val pv;
+  if (mdb_get(txn, m_properties, &pk, &pv) == MDB_SUCCESS)
+  {
+    op_timer.get(pv);
+    m_pruned_height = *(const uint64_t*)pv.mv_data;
+  }
+
+  {
+    CRITICAL_REGION_LOCAL(m_recent_outputs_lock);
+    m_recent_outputs.clear();
+    m_recent_outputs_valid = false;
+  }
+
   bool compatible = true;
 
   MDB_val_copy<const char*> k("version");
@@ -1162,6 +1531,7 @@ void BlockchainLMDB::open(const std::string& filename, const int mdb_flags)
   auto get_result = mdb_get(txn, m_properties, &k, &v);
   if(get_result == MDB_SUCCESS)
   {
+    op_timer.get(v);
     if (*(const uint32_t*)v.mv_data > VERSION)
     {
       LOG_PRINT_RED_L0("Existing lmdb database was made by a later version. We don't know how it will change yet.");
@@ -1176,6 +1546,7 @@ void BlockchainLMDB::open(const std::string& filename, const int mdb_flags)
       txn.commit();
       m_open = true;
       migrate(*(const uint32_t *)v.mv_data);
+      build_block_rct_outputs();
       return;
     }
 #endif
@@ -1222,6 +1593,13 @@ void BlockchainLMDB::open(const std::string& filename, const int mdb_flags)
   txn.commit();
 
   m_open = true;
+  // another process may be writing a db we only read, which the filters
+  // would not follow
+  if (!(mdb_flags & MDB_RDONLY))
+  {
+    build_block_rct_outputs();
+    build_filters();
+  }
   // from here, init should be finished
 }
 
@@ -1236,9 +1614,16 @@ void BlockchainLMDB::close()
   this->sync();
   m_tinfo.reset();
 
+  uint64_t begins, renews;
+  get_rtxn_stats(begins, renews);
+  LOG_PRINT_L1("BlockchainLMDB read txns: " << begins << " begun, " << renews << " renewed");
+  LOG_PRINT_L1("BlockchainLMDB resizes: " << m_resize_count << ", txns paused for " << m_resize_pause_total << " ms total, " << m_resize_pause_max << " ms max");
+
   // FIXME: not yet thread safe!!!  Use with care.
   mdb_env_close(m_env);
   m_open = false;
+  std::atomic_store(&m_spent_keys_filter, std::shared_ptr<hash_filter>());
+  std::atomic_store(&m_tx_filter, std::shared_ptr<hash_filter>());
 }
 
 void BlockchainLMDB::sync()
@@ -1246,6 +1631,10 @@ void BlockchainLMDB::sync()
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
 
+  // nothing to sync in a read only environment, LMDB refuses to
+  if (is_read_only())
+    return;
+
   // Does nothing unless LMDB environment was opened with MDB_NOSYNC or in part
   // MDB_NOMETASYNC. Force flush to be synchronous.
   if (auto result = mdb_env_sync(m_env, true))
@@ -1269,6 +1658,9 @@ void BlockchainLMDB::reset()
     throw0(DB_ERROR(lmdb_error("Failed to drop m_block_info: ", result).c_str()));
   if (auto result = mdb_drop(txn, m_block_heights, 0))
     throw0(DB_ERROR(lmdb_error("Failed to drop m_block_heights: ", result).c_str()));
+  if (m_has_block_rct_outputs)
+    if (auto result = mdb_drop(txn, m_block_rct_outputs, 0))
+      throw0(DB_ERROR(lmdb_error("Failed to drop m_block_rct_outputs: ", result).c_str()));
   if (auto result = mdb_drop(txn, m_txs, 0))
     throw0(DB_ERROR(lmdb_error("Failed to drop m_txs: ", result).c_str()));
   if (auto result = mdb_drop(txn, m_tx_indices, 0))
@@ -1296,8 +1688,15 @@ void BlockchainLMDB::reset()
   txn.commit();
   m_height = 0;
   m_num_outputs = 0;
+  m_pruned_height = 0;
+  {
+    CRITICAL_REGION_LOCAL(m_recent_outputs_lock);
+    m_recent_outputs.clear();
+    m_recent_outputs_valid = false;
+  }
   m_cum_size = 0;
   m_cum_count = 0;
+  build_filters();
 }
 
 std::vector<std::string> BlockchainLMDB::get_filenames() const
@@ -1428,10 +1827,19 @@ block BlockchainLMDB::get_block(const crypto::hash& h) const
   return get_block_from_height(get_block_height(h));
 }
 
+blobdata BlockchainLMDB::get_block_blob(const crypto::hash& h) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  return get_block_blob_from_height(get_block_height(h));
+}
+
 uint64_t BlockchainLMDB::get_block_height(const crypto::hash& h) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
+  DB_OP_STATS(LMDB_BLOCK_HEIGHTS);
 
   TXN_PREFIX_RDONLY();
   RCURSOR(block_heights);
@@ -1443,6 +1851,7 @@ uint64_t BlockchainLMDB::get_block_height(const crypto::hash& h) const
   else if (get_result)
     throw0(DB_ERROR("Error attempting to retrieve a block height from the db"));
 
+  op_timer.cursor(key);
   blk_height *bhp = (blk_height *)key.mv_data;
   uint64_t ret = bhp->bh_height;
   TXN_POSTFIX_RDONLY();
@@ -1463,6 +1872,21 @@ block BlockchainLMDB::get_block_from_height(const uint64_t& height) const
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
 
+  blobdata bd = get_block_blob_from_height(height);
+
+  block b;
+  if (!parse_and_validate_block_from_blob(bd, b))
+    throw0(DB_ERROR("Failed to parse block from blob retrieved from the db"));
+
+  return b;
+}
+
+blobdata BlockchainLMDB::get_block_blob_from_height(const uint64_t& height) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+  DB_OP_STATS(LMDB_BLOCKS);
+
   TXN_PREFIX_RDONLY();
   RCURSOR(blocks);
 
@@ -1476,16 +1900,13 @@ block BlockchainLMDB::get_block_from_height(const uint64_t& height) const
   else if (get_result)
     throw0(DB_ERROR("Error attempting to retrieve a block from the db"));
 
+  op_timer.cursor(result);
   blobdata bd;
   bd.assign(reinterpret_cast<char*>(result.mv_data), result.mv_size);
 
-  block b;
-  if (!parse_and_validate_block_from_blob(bd, b))
-    throw0(DB_ERROR("Failed to parse block from blob retrieved from the db"));
-
   TXN_POSTFIX_RDONLY();
 
-  return b;
+  return bd;
 }
 
 uint64_t BlockchainLMDB::get_block_timestamp(const uint64_t& height) const
@@ -1517,12 +1938,13 @@ uint64_t BlockchainLMDB::get_top_block_timestamp() const
   check_open();
 
   // if no blocks, return 0
-  if (m_height == 0)
+  const uint64_t h = height();
+  if (h == 0)
   {
     return 0;
   }
 
-  return get_block_timestamp(m_height - 1);
+  return get_block_timestamp(h - 1);
 }
 
 size_t BlockchainLMDB::get_block_size(const uint64_t& height) const
@@ -1615,6 +2037,7 @@ crypto::hash BlockchainLMDB::get_block_hash_from_height(const uint64_t& height)
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
+  DB_OP_STATS(LMDB_BLOCK_INFO);
 
   TXN_PREFIX_RDONLY();
   RCURSOR(block_info);
@@ -1628,6 +2051,7 @@ crypto::hash BlockchainLMDB::get_block_hash_from_height(const uint64_t& height)
   else if (get_result)
     throw0(DB_ERROR(lmdb_error("Error attempting to retrieve a block hash from the db: ", get_result).c_str()));
 
+  op_timer.cursor(result);
   mdb_block_info *bi = (mdb_block_info *)result.mv_data;
   crypto::hash ret = bi->bi_hash;
   TXN_POSTFIX_RDONLY();
@@ -1666,9 +2090,10 @@ crypto::hash BlockchainLMDB::top_block_hash() const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
-  if (m_height != 0)
+  const uint64_t h = height();
+  if (h != 0)
   {
-    return get_block_hash_from_height(m_height - 1);
+    return get_block_hash_from_height(h - 1);
   }
 
   return null_hash;
@@ -1679,9 +2104,10 @@ block BlockchainLMDB::get_top_block() const
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
 
-  if (m_height != 0)
+  const uint64_t h = height();
+  if (h != 0)
   {
-    return get_block_from_height(m_height - 1);
+    return get_block_from_height(h - 1);
   }
 
   block b;
@@ -1693,6 +2119,17 @@ uint64_t BlockchainLMDB::height() const
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
 
+  // m_height follows the writer, a read snapshot must see its own height
+  if (m_tinfo.get() && m_tinfo->m_ti_rsnapshots)
+  {
+    TXN_PREFIX_RDONLY();
+    MDB_stat db_stats;
+    if (auto result = mdb_stat(m_txn, m_blocks, &db_stats))
+      throw0(DB_ERROR(lmdb_error("Failed to query m_blocks: ", result).c_str()));
+    TXN_POSTFIX_RDONLY();
+    return db_stats.ms_entries;
+  }
+
   return m_height;
 }
 
@@ -1701,6 +2138,13 @@ bool BlockchainLMDB::tx_exists(const crypto::hash& h) const
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
 
+  if (filtered_out(m_tx_filter, &h))
+  {
+    LOG_PRINT_L1("transaction with hash " << epee::string_tools::pod_to_hex(h) << " not found in db");
+    return false;
+  }
+  DB_OP_STATS(LMDB_TX_INDICES);
+
   TXN_PREFIX_RDONLY();
   RCURSOR(tx_indices);
   RCURSOR(txs);
@@ -1711,7 +2155,10 @@ bool BlockchainLMDB::tx_exists(const crypto::hash& h) const
   TIME_MEASURE_START(time1);
   auto get_result = mdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &key, MDB_GET_BOTH);
   if (get_result == 0)
+  {
+    op_timer.cursor(key);
     tx_found = true;
+  }
   else if (get_result != MDB_NOTFOUND)
     throw0(DB_ERROR(lmdb_error(std::string("DB error attempting to fetch transaction index from hash ") + epee::string_tools::pod_to_hex(h) + ": ", get_result).c_str()));
 
@@ -1741,6 +2188,13 @@ bool BlockchainLMDB::tx_exists(const crypto::hash& h, uint64_t& tx_id) const
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
 
+  if (filtered_out(m_tx_filter, &h))
+  {
+    LOG_PRINT_L1("transaction with hash " << epee::string_tools::pod_to_hex(h) << " not found in db");
+    return false;
+  }
+  DB_OP_STATS(LMDB_TX_INDICES);
+
   TXN_PREFIX_RDONLY();
   RCURSOR(tx_indices);
 
@@ -1751,6 +2205,7 @@ bool BlockchainLMDB::tx_exists(const crypto::hash& h, uint64_t& tx_id) const
   TIME_MEASURE_FINISH(time1);
   time_tx_exists += time1;
   if (!get_result) {
+    op_timer.cursor(v);
     txindex *tip = (txindex *)v.mv_data;
     tx_id = tip->data.tx_id;
   }
@@ -1796,6 +2251,28 @@ transaction BlockchainLMDB::get_tx(const crypto::hash& h) const
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
 
+  blobdata bd;
+  if (!get_tx_blob(h, bd))
+    throw1(TX_DNE(std::string("tx with hash ").append(epee::string_tools::pod_to_hex(h)).append(" not found in db").c_str()));
+
+  transaction tx;
+  if (m_pruned_height > 0 && get_tx_block_height(h) < m_pruned_height)
+  {
+    if (!parse_and_validate_tx_base_from_blob(bd, tx))
+      throw0(DB_ERROR("Failed to parse pruned tx from blob retrieved from the db"));
+  }
+  else if (!parse_and_validate_tx_from_blob(bd, tx))
+    throw0(DB_ERROR("Failed to parse tx from blob retrieved from the db"));
+
+  return tx;
+}
+
+bool BlockchainLMDB::get_tx_blob(const crypto::hash& h, blobdata &bd) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+  DB_OP_STATS(LMDB_TXS);
+
   TXN_PREFIX_RDONLY();
   RCURSOR(tx_indices);
   RCURSOR(txs);
@@ -1805,25 +2282,22 @@ transaction BlockchainLMDB::get_tx(const crypto::hash& h) const
   auto get_result = mdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
   if (get_result == 0)
   {
+    op_timer.cursor(v);
     txindex *tip = (txindex *)v.mv_data;
     MDB_val_set(val_tx_id, tip->data.tx_id);
     get_result = mdb_cursor_get(m_cur_txs, &val_tx_id, &result, MDB_SET);
   }
   if (get_result == MDB_NOTFOUND)
-    throw1(TX_DNE(std::string("tx with hash ").append(epee::string_tools::pod_to_hex(h)).append(" not found in db").c_str()));
+    return false;
   else if (get_result)
     throw0(DB_ERROR(lmdb_error("DB error attempting to fetch tx from hash", get_result).c_str()));
 
-  blobdata bd;
+  op_timer.cursor(result);
   bd.assign(reinterpret_cast<char*>(result.mv_data), result.mv_size);
 
-  transaction tx;
-  if (!parse_and_validate_tx_from_blob(bd, tx))
-    throw0(DB_ERROR("Failed to parse tx from blob retrieved from the db"));
-
   TXN_POSTFIX_RDONLY();
 
-  return tx;
+  return true;
 }
 
 uint64_t BlockchainLMDB::get_tx_count() const
@@ -1879,46 +2353,121 @@ uint64_t BlockchainLMDB::get_tx_block_height(const crypto::hash& h) const
   return ret;
 }
 
-uint64_t BlockchainLMDB::get_num_outputs(const uint64_t& amount) const
+uint64_t BlockchainLMDB::get_first_tx_id(uint64_t height) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
-  check_open();
-
   TXN_PREFIX_RDONLY();
-  RCURSOR(output_amounts);
-
-  MDB_val_copy<uint64_t> k(amount);
-  MDB_val v;
-  mdb_size_t num_elems = 0;
-  auto result = mdb_cursor_get(m_cur_output_amounts, &k, &v, MDB_SET);
-  if (result == MDB_SUCCESS)
-  {
-    mdb_cursor_count(m_cur_output_amounts, &num_elems);
-  }
-  else if (result != MDB_NOTFOUND)
-    throw0(DB_ERROR("DB error attempting to get number of outputs of an amount"));
+  RCURSOR(tx_indices);
 
+  // txs are stored in block order, starting with each block's miner tx
+  const block b = get_block_from_height(height);
+  MDB_val_copy<crypto::hash> v(get_transaction_hash(b.miner_tx));
+  auto get_result = mdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
+  if (get_result)
+    throw0(DB_ERROR(lmdb_error("DB error attempting to fetch miner tx id: ", get_result).c_str()));
+  const uint64_t tx_id = ((const txindex *)v.mv_data)->data.tx_id;
   TXN_POSTFIX_RDONLY();
-
-  return num_elems;
+  return tx_id;
 }
 
-// This is a lot harder now that we've removed the output_keys index
-output_data_t BlockchainLMDB::get_output_key(const uint64_t &global_index) const
+void BlockchainLMDB::prune(uint64_t max_blocks)
 {
-  LOG_PRINT_L3("BlockchainLMDB::" << __func__ << " (unused version - does nothing)");
-  check_open();
-  TXN_PREFIX_RDONLY();
-  RCURSOR(output_txs);
-  RCURSOR(tx_indices);
-  RCURSOR(txs);
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  if (m_pruning_depth == 0 || m_height <= m_pruning_depth)
+    return;
+  const uint64_t target = std::min(m_height - m_pruning_depth, m_pruned_height + max_blocks);
+  if (target <= m_pruned_height)
+    return;
 
-  output_data_t od;
-  MDB_val_set(v, global_index);
-  auto get_result = mdb_cursor_get(m_cur_output_txs, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
-  if (get_result == MDB_NOTFOUND)
-    throw1(OUTPUT_DNE("output with given index not in db"));
-  else if (get_result)
+  TIME_MEASURE_START(time1);
+  block_txn_start(false);
+  uint64_t tx_id, end_id;
+  try
+  {
+    mdb_txn_cursors *m_cursors = &m_wcursors;
+    CURSOR(txs)
+
+    tx_id = get_first_tx_id(m_pruned_height);
+    end_id = get_first_tx_id(target);
+
+    MDB_val_set(k, tx_id);
+    MDB_val v;
+    int result = mdb_cursor_get(m_cur_txs, &k, &v, MDB_SET);
+    for (; tx_id < end_id; ++tx_id)
+    {
+      if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to get tx to prune: ", result).c_str()));
+
+      transaction tx;
+      if (!parse_and_validate_tx_from_blob(blobdata((const char*)v.mv_data, v.mv_size), tx))
+        throw0(DB_ERROR("Failed to parse tx from blob retrieved from the db"));
+      tx.pruned = true;
+
+      MDB_val_set(key, tx_id);
+      MDB_val_copy<blobdata> blob(tx_to_blob(tx));
+      if ((result = mdb_cursor_put(m_cur_txs, &key, &blob, MDB_CURRENT)))
+        throw0(DB_ERROR(lmdb_error("Failed to write pruned tx: ", result).c_str()));
+
+      result = mdb_cursor_get(m_cur_txs, &k, &v, MDB_NEXT);
+    }
+
+    MDB_val_copy<const char*> pk("pruned_height");
+    MDB_val_copy<uint64_t> pv(target);
+    if ((result = mdb_put(*m_write_txn, m_properties, &pk, &pv, 0)))
+      throw0(DB_ERROR(lmdb_error("Failed to write pruned height: ", result).c_str()));
+  }
+  catch (...)
+  {
+    block_txn_abort();
+    throw;
+  }
+  block_txn_stop();
+  TIME_MEASURE_FINISH(time1);
+
+  LOG_PRINT_L1("Pruned blocks " << m_pruned_height << " to " << target - 1 << " in " << time1 << " ms");
+  m_pruned_height = target;
+}
+
+uint64_t BlockchainLMDB::get_num_outputs(const uint64_t& amount) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  TXN_PREFIX_RDONLY();
+  RCURSOR(output_amounts);
+
+  MDB_val_copy<uint64_t> k(amount);
+  MDB_val v;
+  mdb_size_t num_elems = 0;
+  auto result = mdb_cursor_get(m_cur_output_amounts, &k, &v, MDB_SET);
+  if (result == MDB_SUCCESS)
+  {
+    mdb_cursor_count(m_cur_output_amounts, &num_elems);
+  }
+  else if (result != MDB_NOTFOUND)
+    throw0(DB_ERROR("DB error attempting to get number of outputs of an amount"));
+
+  TXN_POSTFIX_RDONLY();
+
+  return num_elems;
+}
+
+// This is a lot harder now that we've removed the output_keys index
+output_data_t BlockchainLMDB::get_output_key(const uint64_t &global_index) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__ << " (unused version - does nothing)");
+  check_open();
+  TXN_PREFIX_RDONLY();
+  RCURSOR(output_txs);
+  RCURSOR(tx_indices);
+  RCURSOR(txs);
+
+  output_data_t od;
+  MDB_val_set(v, global_index);
+  auto get_result = mdb_cursor_get(m_cur_output_txs, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
+  if (get_result == MDB_NOTFOUND)
+    throw1(OUTPUT_DNE("output with given index not in db"));
+  else if (get_result)
     throw0(DB_ERROR("DB error attempting to fetch output tx hash"));
 
   outtx *ot = (outtx *)v.mv_data;
@@ -1957,6 +2506,7 @@ output_data_t BlockchainLMDB::get_output_key(const uint64_t& amount, const uint6
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
+  DB_OP_STATS(LMDB_OUTPUT_AMOUNTS);
 
   TXN_PREFIX_RDONLY();
   RCURSOR(output_amounts);
@@ -1969,6 +2519,7 @@ output_data_t BlockchainLMDB::get_output_key(const uint64_t& amount, const uint6
   else if (get_result)
     throw0(DB_ERROR("Error attempting to retrieve an output pubkey from the db"));
 
+  op_timer.cursor(v);
   output_data_t ret;
   if (amount == 0)
   {
@@ -1989,6 +2540,7 @@ tx_out_index BlockchainLMDB::get_output_tx_and_index_from_global(const uint64_t&
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
+  DB_OP_STATS(LMDB_OUTPUT_TXS);
 
   TXN_PREFIX_RDONLY();
   RCURSOR(output_txs);
@@ -2001,6 +2553,7 @@ tx_out_index BlockchainLMDB::get_output_tx_and_index_from_global(const uint64_t&
   else if (get_result)
     throw0(DB_ERROR("DB error attempting to fetch output tx hash"));
 
+  op_timer.cursor(v);
   outtx *ot = (outtx *)v.mv_data;
   tx_out_index ret = tx_out_index(ot->tx_hash, ot->local_index);
 
@@ -2058,12 +2611,148 @@ std::vector<uint64_t> BlockchainLMDB::get_tx_amount_output_indices(const uint64_
   return amount_output_indices;
 }
 
+void BlockchainLMDB::get_txs_amount_output_indices(const std::vector<crypto::hash>& tx_hashes, std::vector<std::vector<uint64_t> >& output_indices, std::vector<bool>& found) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+  DB_OP_STATS(LMDB_TX_OUTPUTS);
+
+  output_indices.clear();
+  output_indices.resize(tx_hashes.size());
+  found.clear();
+  found.resize(tx_hashes.size(), false);
+
+  // hashes are looked up in the index's own order, then the outputs in tx
+  // id order, so both walks move forward through neighbouring pages
+  const std::shared_ptr<hash_filter> filter = std::atomic_load(&m_tx_filter);
+  std::vector<size_t> order;
+  order.reserve(tx_hashes.size());
+  for (size_t n = 0; n < tx_hashes.size(); ++n)
+    if (!filter || filter->may_contain(&tx_hashes[n]))
+      order.push_back(n);
+  if (order.empty())
+    return;
+  std::sort(order.begin(), order.end(), [&tx_hashes](size_t a, size_t b) {
+    MDB_val va = {sizeof(crypto::hash), (void *)&tx_hashes[a]};
+    MDB_val vb = {sizeof(crypto::hash), (void *)&tx_hashes[b]};
+    return compare_hash32(&va, &vb) < 0;
+  });
+
+  TXN_PREFIX_RDONLY();
+  RCURSOR(tx_indices);
+  RCURSOR(tx_outputs);
+
+  std::vector<std::pair<uint64_t, size_t> > tx_ids;
+  tx_ids.reserve(order.size());
+  for (const size_t n : order)
+  {
+    MDB_val_set(v, tx_hashes[n]);
+    auto get_result = mdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
+    if (get_result == MDB_NOTFOUND)
+      continue;
+    else if (get_result)
+      throw0(DB_ERROR(lmdb_error("DB error attempting to fetch transaction from hash: ", get_result).c_str()));
+    op_timer.cursor(v);
+    tx_ids.push_back(std::make_pair(((const txindex *)v.mv_data)->data.tx_id, n));
+  }
+  std::sort(tx_ids.begin(), tx_ids.end());
+
+  for (const auto &i : tx_ids)
+  {
+    MDB_val_set(k_tx_id, i.first);
+    MDB_val v;
+    auto get_result = mdb_cursor_get(m_cur_tx_outputs, &k_tx_id, &v, MDB_SET);
+    if (get_result)
+      throw0(DB_ERROR(lmdb_error("DB error attempting to get data for tx_outputs[tx_index]: ", get_result).c_str()));
+    op_timer.cursor(v);
+    const uint64_t* indices = (const uint64_t*)v.mv_data;
+    output_indices[i.second].assign(indices, indices + v.mv_size / sizeof(uint64_t));
+    found[i.second] = true;
+  }
+
+  TXN_POSTFIX_RDONLY();
+}
+
+void BlockchainLMDB::get_blocks_with_output_indices(uint64_t start_height, size_t count, std::vector<std::pair<blobdata, std::vector<blobdata> > >& blocks, std::vector<std::vector<std::vector<uint64_t> > >& output_indices) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+  DB_OP_STATS(LMDB_TX_OUTPUTS);
+
+  const uint64_t end_height = std::min<uint64_t>(height(), start_height + count);
+  if (start_height >= end_height)
+    return;
+
+  TXN_PREFIX_RDONLY();
+  RCURSOR(blocks);
+  RCURSOR(txs);
+  RCURSOR(tx_outputs);
+
+  // txs are stored in block order, starting with each block's miner tx, so
+  // the whole range is a single walk along blocks, txs and tx_outputs
+  uint64_t tx_id = get_first_tx_id(start_height);
+  MDB_val_copy<uint64_t> k_height(start_height);
+  MDB_val_copy<uint64_t> k_tx(tx_id);
+  MDB_val_copy<uint64_t> k_outputs(tx_id);
+  MDB_val v;
+  MDB_cursor_op block_op = MDB_SET, tx_op = MDB_SET;
+  for (uint64_t height = start_height; height < end_height; ++height)
+  {
+    int result = mdb_cursor_get(m_cur_blocks, &k_height, &v, block_op);
+    block_op = MDB_NEXT;
+    if (result == MDB_NOTFOUND)
+      throw0(BLOCK_DNE(std::string("Attempt to get block from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- block not in db").c_str()));
+    else if (result)
+      throw0(DB_ERROR(lmdb_error("Error attempting to retrieve a block from the db: ", result).c_str()));
+    op_timer.cursor(v);
+
+    blocks.push_back(std::make_pair(blobdata((const char*)v.mv_data, v.mv_size), std::vector<blobdata>()));
+    block b;
+    if (!parse_and_validate_block_from_blob(blocks.back().first, b))
+      throw0(DB_ERROR("Failed to parse block from blob retrieved from the db"));
+
+    blocks.back().second.reserve(b.tx_hashes.size());
+    output_indices.push_back(std::vector<std::vector<uint64_t> >());
+    output_indices.back().reserve(1 + b.tx_hashes.size());
+    for (size_t n = 0; n <= b.tx_hashes.size(); ++n, ++tx_id)
+    {
+      result = mdb_cursor_get(m_cur_txs, &k_tx, &v, tx_op);
+      if (result == 0 && *(const uint64_t*)k_tx.mv_data != tx_id)
+        result = MDB_NOTFOUND;
+      if (result == MDB_NOTFOUND)
+        throw1(TX_DNE(std::string("tx id ").append(boost::lexical_cast<std::string>(tx_id)).append(" not found in db").c_str()));
+      else if (result)
+        throw0(DB_ERROR(lmdb_error("DB error attempting to fetch tx by id: ", result).c_str()));
+      op_timer.cursor(v);
+      // the miner tx is already in the block blob
+      if (n > 0)
+        blocks.back().second.push_back(blobdata((const char*)v.mv_data, v.mv_size));
+
+      result = mdb_cursor_get(m_cur_tx_outputs, &k_outputs, &v, tx_op);
+      if (result == 0 && *(const uint64_t*)k_outputs.mv_data != tx_id)
+        result = MDB_NOTFOUND;
+      if (result)
+        throw0(DB_ERROR(lmdb_error("DB error attempting to get data for tx_outputs[tx_index]: ", result).c_str()));
+      op_timer.cursor(v);
+      const uint64_t* indices = (const uint64_t*)v.mv_data;
+      output_indices.back().push_back(std::vector<uint64_t>(indices, indices + v.mv_size / sizeof(uint64_t)));
+      tx_op = MDB_NEXT;
+    }
+  }
+
+  TXN_POSTFIX_RDONLY();
+}
+
 
 bool BlockchainLMDB::has_key_image(const crypto::key_image& img) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
 
+  if (filtered_out(m_spent_keys_filter, &img))
+    return false;
+  DB_OP_STATS(LMDB_SPENT_KEYS);
+
   bool ret;
 
   TXN_PREFIX_RDONLY();
@@ -2071,11 +2760,262 @@ bool BlockchainLMDB::has_key_image(const crypto::key_image& img) const
 
   MDB_val k = {sizeof(img), (void *)&img};
   ret = (mdb_cursor_get(m_cur_spent_keys, (MDB_val *)&zerokval, &k, MDB_GET_BOTH) == 0);
+  if (ret)
+    op_timer.cursor(k);
 
   TXN_POSTFIX_RDONLY();
   return ret;
 }
 
+void BlockchainLMDB::has_key_images(const std::vector<crypto::key_image>& imgs, std::vector<bool>& spent) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+  DB_OP_STATS(LMDB_SPENT_KEYS);
+
+  spent.clear();
+  spent.resize(imgs.size(), false);
+
+  // look the images up in the table's own order, so consecutive lookups
+  // touch neighbouring pages instead of seeking all over the tree
+  const std::shared_ptr<hash_filter> filter = std::atomic_load(&m_spent_keys_filter);
+  std::vector<size_t> order;
+  order.reserve(imgs.size());
+  for (size_t n = 0; n < imgs.size(); ++n)
+    if (!filter || filter->may_contain(&imgs[n]))
+      order.push_back(n);
+  if (order.empty())
+    return;
+  std::sort(order.begin(), order.end(), [&imgs](size_t a, size_t b) {
+    MDB_val va = {sizeof(crypto::key_image), (void *)&imgs[a]};
+    MDB_val vb = {sizeof(crypto::key_image), (void *)&imgs[b]};
+    return compare_hash32(&va, &vb) < 0;
+  });
+
+  TXN_PREFIX_RDONLY();
+  RCURSOR(spent_keys);
+
+  for (const size_t n : order)
+  {
+    MDB_val k = {sizeof(crypto::key_image), (void *)&imgs[n]};
+    auto get_result = mdb_cursor_get(m_cur_spent_keys, (MDB_val *)&zerokval, &k, MDB_GET_BOTH);
+    if (get_result == 0)
+    {
+      op_timer.cursor(k);
+      spent[n] = true;
+    }
+    else if (get_result != MDB_NOTFOUND)
+      throw0(DB_ERROR(lmdb_error("Error attempting to look up a key image: ", get_result).c_str()));
+  }
+
+  TXN_POSTFIX_RDONLY();
+}
+
+bool BlockchainLMDB::get_output_distribution(uint64_t amount, uint64_t from_height, uint64_t to_height, std::vector<uint64_t> &distribution, uint64_t &base) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+  DB_OP_STATS(LMDB_OUTPUT_AMOUNTS);
+
+  distribution.clear();
+  base = 0;
+  const uint64_t db_height = height();
+  if (from_height >= db_height)
+    return false;
+  to_height = std::min(to_height, db_height - 1);
+  if (to_height < from_height)
+    return true;
+  const uint64_t count = to_height - from_height + 1;
+  distribution.reserve(count);
+
+  TXN_PREFIX_RDONLY();
+
+  if (amount == 0 && m_has_block_rct_outputs)
+  {
+    RCURSOR(block_rct_outputs);
+    blk_rct_outputs first = {from_height > 0 ? from_height - 1 : 0, 0};
+    MDB_val k = zerokval;
+    MDB_val_set(v, first);
+    MDB_cursor_op op = MDB_GET_BOTH;
+    for (uint64_t h = first.bro_height; h <= to_height; ++h)
+    {
+      int result = mdb_cursor_get(m_cur_block_rct_outputs, &k, &v, op);
+      op = MDB_NEXT_DUP;
+      if (result == MDB_NOTFOUND)
+        break;
+      if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to get block RingCT output count: ", result).c_str()));
+      op_timer.cursor(v);
+      const blk_rct_outputs *bro = (const blk_rct_outputs *)v.mv_data;
+      if (h < from_height)
+        base = bro->bro_cum_rct;
+      else
+        distribution.push_back(bro->bro_cum_rct);
+    }
+    if (distribution.size() == count)
+    {
+      TXN_POSTFIX_RDONLY();
+      return true;
+    }
+    // an older db opened read only, the counts aren't filled in yet
+    distribution.clear();
+    base = 0;
+  }
+
+  // outputs are stored in chain order, so this stops at the first one past to_height
+  RCURSOR(output_amounts);
+  distribution.resize(count, 0);
+  MDB_val_set(k, amount);
+  MDB_val v;
+  MDB_cursor_op op = MDB_SET;
+  while (1)
+  {
+    int result = mdb_cursor_get(m_cur_output_amounts, &k, &v, op);
+    op = MDB_NEXT_DUP;
+    if (result == MDB_NOTFOUND)
+      break;
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to enumerate outputs: ", result).c_str()));
+    op_timer.cursor(v);
+    const uint64_t h = ((const pre_rct_outkey *)v.mv_data)->data.height;
+    if (h > to_height)
+      break;
+    if (h < from_height)
+      ++base;
+    else
+      ++distribution[h - from_height];
+  }
+
+  TXN_POSTFIX_RDONLY();
+
+  distribution[0] += base;
+  for (size_t n = 1; n < distribution.size(); ++n)
+    distribution[n] += distribution[n - 1];
+  return true;
+}
+
+bool BlockchainLMDB::filtered_out(const std::shared_ptr<hash_filter> &filter, const void *data)
+{
+  const std::shared_ptr<hash_filter> f = std::atomic_load(&filter);
+  return f && !f->may_contain(data);
+}
+
+static std::shared_ptr<hash_filter> build_filter(MDB_txn *txn, MDB_dbi dbi, MDB_cursor *cur, size_t element_size, uint64_t min_capacity, const char *name)
+{
+  MDB_stat db_stats;
+  if (auto result = mdb_stat(txn, dbi, &db_stats))
+    throw0(DB_ERROR(lmdb_error(std::string("Failed to query ") + name + ": ", result).c_str()));
+
+  // leave room to grow before the next rebuild
+  const uint64_t capacity = std::max<uint64_t>(db_stats.ms_entries + db_stats.ms_entries / 2, min_capacity);
+  std::shared_ptr<hash_filter> filter = std::make_shared<hash_filter>(capacity);
+
+  // the tables are DUPFIXED, so read them a page at a time
+  MDB_val k, v;
+  int result = mdb_cursor_get(cur, &k, &v, MDB_FIRST);
+  MDB_cursor_op op = MDB_GET_MULTIPLE;
+  while (result == 0)
+  {
+    result = mdb_cursor_get(cur, &k, &v, op);
+    op = MDB_NEXT_MULTIPLE;
+    if (result)
+      break;
+    // the hash is at the start of each element
+    for (size_t offset = 0; offset + element_size <= v.mv_size; offset += element_size)
+      filter->insert((const char*)v.mv_data + offset);
+  }
+  if (result != MDB_NOTFOUND)
+    throw0(DB_ERROR(lmdb_error(std::string("Failed to enumerate ") + name + ": ", result).c_str()));
+
+  LOG_PRINT_L1("Built " << name << " filter for " << db_stats.ms_entries << " entries, " << filter->memory() / 1024 << " kB");
+  return filter;
+}
+
+void BlockchainLMDB::build_filters()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  TXN_PREFIX_RDONLY();
+  RCURSOR(spent_keys);
+  RCURSOR(tx_indices);
+
+  std::shared_ptr<hash_filter> spent_keys_filter = build_filter(m_txn, m_spent_keys, m_cur_spent_keys, sizeof(crypto::key_image), FILTER_MIN_CAPACITY, "spent_keys");
+  std::shared_ptr<hash_filter> tx_filter = build_filter(m_txn, m_tx_indices, m_cur_tx_indices, sizeof(txindex), FILTER_MIN_CAPACITY, "tx_indices");
+
+  TXN_POSTFIX_RDONLY();
+
+  std::atomic_store(&m_spent_keys_filter, spent_keys_filter);
+  std::atomic_store(&m_tx_filter, tx_filter);
+  m_spent_keys_removed = 0;
+  m_txs_removed = 0;
+}
+
+void BlockchainLMDB::build_block_rct_outputs()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  int result;
+  mdb_txn_safe txn;
+  if ((result = mdb_txn_begin(m_env, NULL, 0, txn)))
+    throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+
+  MDB_stat db_stats;
+  if ((result = mdb_stat(txn, m_block_rct_outputs, &db_stats)))
+    throw0(DB_ERROR(lmdb_error("Failed to query m_block_rct_outputs: ", result).c_str()));
+  uint64_t height = db_stats.ms_entries;
+  if (height >= m_height)
+    return;
+  LOG_PRINT_L0("Counting RingCT outputs of blocks " << height << " to " << m_height - 1 << ", this may take a while");
+
+  MDB_cursor *c_bro, *c_amounts;
+  if ((result = mdb_cursor_open(txn, m_block_rct_outputs, &c_bro)))
+    throw0(DB_ERROR(lmdb_error("Failed to open a cursor for block_rct_outputs: ", result).c_str()));
+  if ((result = mdb_cursor_open(txn, m_output_amounts, &c_amounts)))
+    throw0(DB_ERROR(lmdb_error("Failed to open a cursor for output_amounts: ", result).c_str()));
+
+  uint64_t cum_rct = 0;
+  if (height > 0)
+  {
+    blk_rct_outputs prev = {height - 1, 0};
+    MDB_val k = zerokval;
+    MDB_val_set(v, prev);
+    if ((result = mdb_cursor_get(c_bro, &k, &v, MDB_GET_BOTH)))
+      throw0(DB_ERROR(lmdb_error("Failed to get block RingCT output count: ", result).c_str()));
+    cum_rct = ((const blk_rct_outputs *)v.mv_data)->bro_cum_rct;
+  }
+
+  // RingCT outputs are all under amount 0 in chain order, so each block's
+  // count is the run of them carrying its height
+  uint64_t rct_amount = 0;
+  MDB_val_set(k_amount, rct_amount);
+  uint64_t amount_index = cum_rct;
+  MDB_val v_out = {sizeof(amount_index), (void *)&amount_index};
+  result = mdb_cursor_get(c_amounts, &k_amount, &v_out, MDB_GET_BOTH);
+  if (result && result != MDB_NOTFOUND)
+    throw0(DB_ERROR(lmdb_error("Failed to get RingCT output: ", result).c_str()));
+  bool have_output = result == 0;
+  for (; height < m_height; ++height)
+  {
+    while (have_output && ((const pre_rct_outkey *)v_out.mv_data)->data.height <= height)
+    {
+      ++cum_rct;
+      result = mdb_cursor_get(c_amounts, &k_amount, &v_out, MDB_NEXT_DUP);
+      if (result && result != MDB_NOTFOUND)
+        throw0(DB_ERROR(lmdb_error("Failed to enumerate RingCT outputs: ", result).c_str()));
+      have_output = result == 0;
+    }
+    blk_rct_outputs bro = {height, cum_rct};
+    MDB_val_set(v, bro);
+    if ((result = mdb_cursor_put(c_bro, (MDB_val *)&zerokval, &v, MDB_APPENDDUP)))
+      throw0(DB_ERROR(lmdb_error("Failed to add block RingCT output count to db transaction: ", result).c_str()));
+  }
+
+  txn.commit();
+  LOG_PRINT_L0("Counted " << cum_rct << " RingCT outputs");
+}
+
 bool BlockchainLMDB::for_all_key_images(std::function<bool(const crypto::key_image&)> f) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
@@ -2173,64 +3113,431 @@ bool BlockchainLMDB::for_all_transactions(std::function<bool(const crypto::hash&
     if (ret)
       throw0(DB_ERROR(lmdb_error("Failed to enumerate transactions: ", ret).c_str()));
 
-    txindex *ti = (txindex *)v.mv_data;
-    const crypto::hash hash = ti->key;
-    k.mv_data = (void *)&ti->data.tx_id;
-    k.mv_size = sizeof(ti->data.tx_id);
-    ret = mdb_cursor_get(m_cur_txs, &k, &v, MDB_SET);
-    if (ret == MDB_NOTFOUND)
-      break;
-    if (ret)
-      throw0(DB_ERROR(lmdb_error("Failed to enumerate transactions: ", ret).c_str()));
-    blobdata bd;
-    bd.assign(reinterpret_cast<char*>(v.mv_data), v.mv_size);
-    transaction tx;
-    if (!parse_and_validate_tx_from_blob(bd, tx))
-      throw0(DB_ERROR("Failed to parse tx from blob retrieved from the db"));
-    if (!f(hash, tx)) {
-      ret = false;
-      break;
+    txindex *ti = (txindex *)v.mv_data;
+    const crypto::hash hash = ti->key;
+    k.mv_data = (void *)&ti->data.tx_id;
+    k.mv_size = sizeof(ti->data.tx_id);
+    ret = mdb_cursor_get(m_cur_txs, &k, &v, MDB_SET);
+    if (ret == MDB_NOTFOUND)
+      break;
+    if (ret)
+      throw0(DB_ERROR(lmdb_error("Failed to enumerate transactions: ", ret).c_str()));
+    blobdata bd;
+    bd.assign(reinterpret_cast<char*>(v.mv_data), v.mv_size);
+    transaction tx;
+    if (!parse_and_validate_tx_from_blob(bd, tx))
+      throw0(DB_ERROR("Failed to parse tx from blob retrieved from the db"));
+    if (!f(hash, tx)) {
+      ret = false;
+      break;
+    }
+  }
+
+  TXN_POSTFIX_RDONLY();
+
+  return ret;
+}
+
+bool BlockchainLMDB::for_all_outputs(std::function<bool(uint64_t amount, const crypto::hash &tx_hash, size_t tx_idx)> f) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  TXN_PREFIX_RDONLY();
+  RCURSOR(output_amounts);
+
+  MDB_val k;
+  MDB_val v;
+  bool ret = true;
+
+  MDB_cursor_op op = MDB_FIRST;
+  while (1)
+  {
+    int ret = mdb_cursor_get(m_cur_output_amounts, &k, &v, op);
+    op = MDB_NEXT;
+    if (ret == MDB_NOTFOUND)
+      break;
+    if (ret)
+      throw0(DB_ERROR("Failed to enumerate outputs"));
+    uint64_t amount = *(const uint64_t*)k.mv_data;
+    outkey *ok = (outkey *)v.mv_data;
+    tx_out_index toi = get_output_tx_and_index_from_global(ok->output_id);
+    if (!f(amount, toi.first, toi.second)) {
+      ret = false;
+      break;
+    }
+  }
+
+  TXN_POSTFIX_RDONLY();
+
+  return ret;
+}
+
+// The hash keyed tables sort by the last 32 bit word first (see
+// compare_hash32), so they are sharded by ranges of that word, which split
+// them evenly. A shard covers [bound(shard), bound(shard + 1)).
+static uint64_t hash_shard_bound(unsigned shard, unsigned shards)
+{
+  return ((uint64_t)1 << 32) * shard / shards;
+}
+
+static uint32_t hash_shard_word(const void *hash)
+{
+  uint32_t w;
+  memcpy(&w, (const char*)hash + 28, sizeof(w));
+  return w;
+}
+
+static crypto::hash hash_shard_start(unsigned shard, unsigned shards)
+{
+  crypto::hash h = null_hash;
+  const uint32_t w = hash_shard_bound(shard, shards);
+  memcpy((char*)&h + 28, &w, sizeof(w));
+  return h;
+}
+
+bool BlockchainLMDB::for_all_key_images_parallel(unsigned shards, std::function<bool(unsigned, const crypto::key_image&)> f) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  if (shards == 0)
+    shards = get_default_shards();
+
+  return run_shards(shards, [this, shards, &f](unsigned shard, const std::atomic<bool> &stop) {
+    TXN_PREFIX_RDONLY();
+    RCURSOR(spent_keys);
+
+    const uint64_t end = hash_shard_bound(shard + 1, shards);
+    crypto::hash start = hash_shard_start(shard, shards);
+    MDB_val k = zerokval;
+    MDB_val v = {sizeof(start), (void *)&start};
+    MDB_cursor_op op = MDB_GET_BOTH_RANGE;
+    while (!stop)
+    {
+      int result = mdb_cursor_get(m_cur_spent_keys, &k, &v, op);
+      op = MDB_NEXT_DUP;
+      if (result == MDB_NOTFOUND)
+        break;
+      if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to enumerate key images: ", result).c_str()));
+      if (hash_shard_word(v.mv_data) >= end)
+        break;
+      const crypto::key_image k_image = *(const crypto::key_image*)v.mv_data;
+      if (!f(shard, k_image))
+        return false;
+    }
+
+    TXN_POSTFIX_RDONLY();
+    return true;
+  });
+}
+
+bool BlockchainLMDB::for_all_blocks_parallel(unsigned shards, std::function<bool(unsigned, uint64_t, const crypto::hash&, const cryptonote::block&)> f) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  if (shards == 0)
+    shards = get_default_shards();
+  const uint64_t blockchain_height = height();
+
+  return run_shards(shards, [this, shards, blockchain_height, &f](unsigned shard, const std::atomic<bool> &stop) {
+    TXN_PREFIX_RDONLY();
+    RCURSOR(blocks);
+
+    uint64_t start = blockchain_height * shard / shards;
+    const uint64_t end = blockchain_height * (shard + 1) / shards;
+    MDB_val k = {sizeof(start), (void *)&start};
+    MDB_val v;
+    MDB_cursor_op op = MDB_SET;
+    for (uint64_t n = start; n < end && !stop; ++n)
+    {
+      int result = mdb_cursor_get(m_cur_blocks, &k, &v, op);
+      op = MDB_NEXT;
+      if (result == MDB_NOTFOUND)
+        break;
+      if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to enumerate blocks: ", result).c_str()));
+      const uint64_t height = *(const uint64_t*)k.mv_data;
+      blobdata bd;
+      bd.assign(reinterpret_cast<char*>(v.mv_data), v.mv_size);
+      block b;
+      if (!parse_and_validate_block_from_blob(bd, b))
+        throw0(DB_ERROR("Failed to parse block from blob retrieved from the db"));
+      crypto::hash hash;
+      if (!get_block_hash(b, hash))
+        throw0(DB_ERROR("Failed to get block hash from blob retrieved from the db"));
+      if (!f(shard, height, hash, b))
+        return false;
+    }
+
+    TXN_POSTFIX_RDONLY();
+    return true;
+  });
+}
+
+bool BlockchainLMDB::for_all_transactions_parallel(unsigned shards, std::function<bool(unsigned, const crypto::hash&, const cryptonote::transaction&)> f) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  if (shards == 0)
+    shards = get_default_shards();
+
+  return run_shards(shards, [this, shards, &f](unsigned shard, const std::atomic<bool> &stop) {
+    TXN_PREFIX_RDONLY();
+    RCURSOR(txs);
+    RCURSOR(tx_indices);
+
+    const uint64_t end = hash_shard_bound(shard + 1, shards);
+    crypto::hash start = hash_shard_start(shard, shards);
+    MDB_val k = zerokval;
+    MDB_val v = {sizeof(start), (void *)&start};
+    MDB_cursor_op op = MDB_GET_BOTH_RANGE;
+    while (!stop)
+    {
+      int result = mdb_cursor_get(m_cur_tx_indices, &k, &v, op);
+      op = MDB_NEXT_DUP;
+      if (result == MDB_NOTFOUND)
+        break;
+      if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to enumerate transactions: ", result).c_str()));
+      if (hash_shard_word(v.mv_data) >= end)
+        break;
+
+      const txindex *ti = (const txindex *)v.mv_data;
+      const crypto::hash hash = ti->key;
+      MDB_val_copy<uint64_t> tx_id(ti->data.tx_id);
+      MDB_val blob;
+      result = mdb_cursor_get(m_cur_txs, &tx_id, &blob, MDB_SET);
+      if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to enumerate transactions: ", result).c_str()));
+      blobdata bd;
+      bd.assign(reinterpret_cast<char*>(blob.mv_data), blob.mv_size);
+      transaction tx;
+      if (!parse_and_validate_tx_from_blob(bd, tx))
+        throw0(DB_ERROR("Failed to parse tx from blob retrieved from the db"));
+      if (!f(shard, hash, tx))
+        return false;
+    }
+
+    TXN_POSTFIX_RDONLY();
+    return true;
+  });
+}
+
+bool BlockchainLMDB::for_all_outputs_parallel(unsigned shards, std::function<bool(unsigned, uint64_t amount, const crypto::hash &tx_hash, size_t tx_idx)> f) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  if (shards == 0)
+    shards = get_default_shards();
+
+  // most outputs are in a few amounts, so split the whole (amount, amount
+  // index) sequence evenly rather than the amounts
+  std::vector<std::pair<uint64_t, uint64_t>> amount_counts;
+  uint64_t total = 0;
+  {
+    TXN_PREFIX_RDONLY();
+    RCURSOR(output_amounts);
+
+    MDB_val k, v;
+    MDB_cursor_op op = MDB_FIRST;
+    while (1)
+    {
+      int result = mdb_cursor_get(m_cur_output_amounts, &k, &v, op);
+      op = MDB_NEXT_NODUP;
+      if (result == MDB_NOTFOUND)
+        break;
+      if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to enumerate outputs: ", result).c_str()));
+      mdb_size_t count;
+      if ((result = mdb_cursor_count(m_cur_output_amounts, &count)))
+        throw0(DB_ERROR(lmdb_error("Failed to count outputs: ", result).c_str()));
+      amount_counts.push_back(std::make_pair(*(const uint64_t*)k.mv_data, count));
+      total += count;
     }
+
+    TXN_POSTFIX_RDONLY();
   }
 
-  TXN_POSTFIX_RDONLY();
+  return run_shards(shards, [this, shards, total, &amount_counts, &f](unsigned shard, const std::atomic<bool> &stop) {
+    const uint64_t start = total * shard / shards;
+    const uint64_t end = total * (shard + 1) / shards;
+    if (start == end)
+      return true;
 
-  return ret;
+    // find the amount and amount index of the shard's first output
+    uint64_t amount = 0, amount_index = start;
+    for (const auto &ac: amount_counts)
+    {
+      amount = ac.first;
+      if (amount_index < ac.second)
+        break;
+      amount_index -= ac.second;
+    }
+
+    TXN_PREFIX_RDONLY();
+    RCURSOR(output_amounts);
+
+    MDB_val k = {sizeof(amount), (void *)&amount};
+    MDB_val v = {sizeof(amount_index), (void *)&amount_index};
+    MDB_cursor_op op = MDB_GET_BOTH_RANGE;
+    for (uint64_t n = start; n < end && !stop; ++n)
+    {
+      int result = mdb_cursor_get(m_cur_output_amounts, &k, &v, op);
+      op = MDB_NEXT;
+      if (result == MDB_NOTFOUND)
+        break;
+      if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to enumerate outputs: ", result).c_str()));
+      const uint64_t output_amount = *(const uint64_t*)k.mv_data;
+      const outkey *ok = (const outkey *)v.mv_data;
+      tx_out_index toi = get_output_tx_and_index_from_global(ok->output_id);
+      if (!f(shard, output_amount, toi.first, toi.second))
+        return false;
+    }
+
+    TXN_POSTFIX_RDONLY();
+    return true;
+  });
 }
 
-bool BlockchainLMDB::for_all_outputs(std::function<bool(uint64_t amount, const crypto::hash &tx_hash, size_t tx_idx)> f) const
+bool BlockchainLMDB::copy_snapshot(const std::string &path, uint64_t max_bytes_per_sec, const std::function<bool(uint64_t, uint64_t)> &progress) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
 
-  TXN_PREFIX_RDONLY();
-  RCURSOR(output_amounts);
+  const boost::filesystem::path datafile = boost::filesystem::path(path) / "data.mdb";
+  try
+  {
+    boost::filesystem::create_directories(path);
+  }
+  catch (const std::exception &e)
+  {
+    throw0(DB_ERROR((std::string("Failed to create snapshot directory: ") + e.what()).c_str()));
+  }
+  if (boost::filesystem::exists(datafile))
+    throw0(DB_ERROR((datafile.string() + " already exists").c_str()));
 
-  MDB_val k;
-  MDB_val v;
-  bool ret = true;
+  // the compacted size: all pages but the free ones, as mdb_env_copyfd2 counts them
+  uint64_t total = 0;
+  {
+    TXN_PREFIX_RDONLY();
+    MDB_envinfo mei;
+    mdb_env_info(m_env, &mei);
+    MDB_stat free_stats;
+    if (auto result = mdb_stat(m_txn, 0, &free_stats))
+      throw0(DB_ERROR(lmdb_error("Failed to query the free list: ", result).c_str()));
+    uint64_t free_pages = free_stats.ms_branch_pages + free_stats.ms_leaf_pages + free_stats.ms_overflow_pages;
+    MDB_cursor *cur;
+    if (auto result = mdb_cursor_open(m_txn, 0, &cur))
+      throw0(DB_ERROR(lmdb_error("Failed to open a cursor on the free list: ", result).c_str()));
+    MDB_val k, v;
+    while (mdb_cursor_get(cur, &k, &v, MDB_NEXT) == 0)
+      free_pages += *(const mdb_size_t*)v.mv_data; // each entry is a list of page numbers, led by its length
+    mdb_cursor_close(cur);
+    total = (mei.me_last_pgno + 1 - free_pages) * free_stats.ms_psize;
+    TXN_POSTFIX_RDONLY();
+  }
 
-  MDB_cursor_op op = MDB_FIRST;
+#ifdef _WIN32
+  // no pipes to stream through: a plain copy, without a rate limit
+  if (progress && !progress(0, total))
+    return false;
+  mdb_txn_safe::add_active_txn();
+  int result = mdb_env_copy2(m_env, path.c_str(), MDB_CP_COMPACT);
+  mdb_txn_safe::remove_active_txn();
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Failed to copy the database: ", result).c_str()));
+  if (progress)
+    progress(total, total);
+  return true;
+#else
+  // LMDB writes the copy into a pipe, and we write what comes out of it,
+  // which is where the rate gets limited and the progress counted
+  int fds[2];
+  if (pipe(fds))
+    throw0(DB_ERROR((std::string("Failed to create a pipe: ") + strerror(errno)).c_str()));
+  const int out = ::open(datafile.string().c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+  if (out < 0)
+  {
+    const int err = errno;
+    ::close(fds[0]);
+    ::close(fds[1]);
+    throw0(DB_ERROR((std::string("Failed to create ") + datafile.string() + ": " + strerror(err)).c_str()));
+  }
+
+  // the copy holds a read txn for as long as it runs, so a resize has to
+  // wait for it. It runs on its own thread, as its txn must not take the
+  // reader slot this thread's read txns use.
+  mdb_txn_safe::add_active_txn();
+  int copy_result = 0;
+  boost::thread copier([this, &fds, &copy_result]() {
+    copy_result = mdb_env_copyfd2(m_env, fds[1], MDB_CP_COMPACT);
+    ::close(fds[1]);
+  });
+
+  std::vector<char> buffer(1 << 20);
+  uint64_t written = 0;
+  bool abandoned = false;
+  std::string write_error;
+  const uint64_t start = epee::misc_utils::get_tick_count();
   while (1)
   {
-    int ret = mdb_cursor_get(m_cur_output_amounts, &k, &v, op);
-    op = MDB_NEXT;
-    if (ret == MDB_NOTFOUND)
-      break;
-    if (ret)
-      throw0(DB_ERROR("Failed to enumerate outputs"));
-    uint64_t amount = *(const uint64_t*)k.mv_data;
-    outkey *ok = (outkey *)v.mv_data;
-    tx_out_index toi = get_output_tx_and_index_from_global(ok->output_id);
-    if (!f(amount, toi.first, toi.second)) {
-      ret = false;
+    const ssize_t n = read(fds[0], buffer.data(), buffer.size());
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
       break;
+    // once abandoned or failed, keep draining so the copy can finish
+    if (abandoned || !write_error.empty())
+      continue;
+    for (ssize_t done = 0; done < n; )
+    {
+      const ssize_t w = write(out, buffer.data() + done, n - done);
+      if (w < 0 && errno == EINTR)
+        continue;
+      if (w <= 0)
+      {
+        write_error = strerror(errno);
+        break;
+      }
+      done += w;
+    }
+    written += n;
+    if (max_bytes_per_sec)
+    {
+      const uint64_t due_ms = written * 1000 / max_bytes_per_sec;
+      const uint64_t elapsed_ms = epee::misc_utils::get_tick_count() - start;
+      if (due_ms > elapsed_ms)
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(due_ms - elapsed_ms));
     }
+    if (progress && !progress(written, total))
+      abandoned = true;
   }
+  copier.join();
+  mdb_txn_safe::remove_active_txn();
+  ::close(fds[0]);
 
-  TXN_POSTFIX_RDONLY();
+  if (!abandoned && write_error.empty() && !copy_result && fsync(out))
+    write_error = strerror(errno);
+  ::close(out);
 
-  return ret;
+  if (abandoned || !write_error.empty() || copy_result)
+  {
+    boost::system::error_code ec;
+    boost::filesystem::remove(datafile, ec);
+    if (!write_error.empty())
+      throw0(DB_ERROR((std::string("Failed to write ") + datafile.string() + ": " + write_error).c_str()));
+    if (copy_result)
+      throw0(DB_ERROR(lmdb_error("Failed to copy the database: ", copy_result).c_str()));
+    return false;
+  }
+  return true;
+#endif
 }
 
 // batch_num_blocks: (optional) Used to check if resize needed before batch transaction starts.
@@ -2334,6 +3641,12 @@ void BlockchainLMDB::batch_abort()
   m_write_batch_txn = nullptr;
   m_batch_active = false;
   memset(&m_wcursors, 0, sizeof(m_wcursors));
+  {
+    // the batch's blocks are gone, and their outputs with them
+    CRITICAL_REGION_LOCAL(m_recent_outputs_lock);
+    m_recent_outputs.clear();
+    m_recent_outputs_valid = false;
+  }
   LOG_PRINT_L3("batch transaction: aborted");
 }
 
@@ -2362,13 +3675,17 @@ bool BlockchainLMDB::block_rtxn_start(MDB_txn **mtxn, mdb_txn_cursors **mcur) co
     m_tinfo.reset(new mdb_threadinfo);
     memset(&m_tinfo->m_ti_rcursors, 0, sizeof(m_tinfo->m_ti_rcursors));
     memset(&m_tinfo->m_ti_rflags, 0, sizeof(m_tinfo->m_ti_rflags));
+    m_tinfo->m_ti_rsnapshots = 0;
+    m_tinfo->m_ti_rsnapshot_owned = false;
     if (auto mdb_res = mdb_txn_begin(m_env, NULL, MDB_RDONLY, &m_tinfo->m_ti_rtxn))
       throw0(DB_ERROR_TXN_START(lmdb_error("Failed to create a read transaction for the db: ", mdb_res).c_str()));
+    mdb_txn_safe::num_rtxn_begins++;
     ret = true;
   } else if (!m_tinfo->m_ti_rflags.m_rf_txn)
   {
     if (auto mdb_res = mdb_txn_renew(m_tinfo->m_ti_rtxn))
       throw0(DB_ERROR_TXN_START(lmdb_error("Failed to renew a read transaction for the db: ", mdb_res).c_str()));
+    mdb_txn_safe::num_rtxn_renews++;
     ret = true;
   }
   if (ret)
@@ -2388,32 +3705,65 @@ void BlockchainLMDB::block_rtxn_stop() const
   memset(&m_tinfo->m_ti_rflags, 0, sizeof(m_tinfo->m_ti_rflags));
 }
 
+void BlockchainLMDB::read_snapshot_start() const
+{
+  // the writer reads through the write txn, which already sees its writes
+  if (m_write_txn && m_writer == boost::this_thread::get_id())
+    return;
+  if (m_tinfo.get() && m_tinfo->m_ti_rsnapshots)
+  {
+    ++m_tinfo->m_ti_rsnapshots;
+    return;
+  }
+
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  // counted like any other txn, so a resize waits for the snapshot to end
+  // rather than pulling the map from under it
+  mdb_txn_safe::add_active_txn();
+  MDB_txn *mtxn;
+  mdb_txn_cursors *mcur;
+  bool owned;
+  try
+  {
+    owned = block_rtxn_start(&mtxn, &mcur);
+  }
+  catch (...)
+  {
+    mdb_txn_safe::remove_active_txn();
+    throw;
+  }
+  m_tinfo->m_ti_rsnapshots = 1;
+  m_tinfo->m_ti_rsnapshot_owned = owned;
+}
+
+void BlockchainLMDB::read_snapshot_stop() const
+{
+  if (!m_tinfo.get() || !m_tinfo->m_ti_rsnapshots)
+    return;
+  if (--m_tinfo->m_ti_rsnapshots)
+    return;
+
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  if (m_tinfo->m_ti_rsnapshot_owned)
+    block_rtxn_stop();
+  m_tinfo->m_ti_rsnapshot_owned = false;
+  mdb_txn_safe::remove_active_txn();
+}
+
+void BlockchainLMDB::get_rtxn_stats(uint64_t &begins, uint64_t &renews)
+{
+  begins = mdb_txn_safe::num_rtxn_begins;
+  renews = mdb_txn_safe::num_rtxn_renews;
+}
+
 void BlockchainLMDB::block_txn_start(bool readonly)
 {
   if (readonly)
   {
-    bool didit = false;
-    if (m_write_txn && m_writer == boost::this_thread::get_id())
-      return;
-    if (!m_tinfo.get())
-    {
-      m_tinfo.reset(new mdb_threadinfo);
-      memset(&m_tinfo->m_ti_rcursors, 0, sizeof(m_tinfo->m_ti_rcursors));
-      memset(&m_tinfo->m_ti_rflags, 0, sizeof(m_tinfo->m_ti_rflags));
-      if (auto mdb_res = mdb_txn_begin(m_env, NULL, MDB_RDONLY, &m_tinfo->m_ti_rtxn))
-        throw0(DB_ERROR_TXN_START(lmdb_error("Failed to create a read transaction for the db: ", mdb_res).c_str()));
-      didit = true;
-    } else if (!m_tinfo->m_ti_rflags.m_rf_txn)
-    {
-      if (auto mdb_res = mdb_txn_renew(m_tinfo->m_ti_rtxn))
-        throw0(DB_ERROR_TXN_START(lmdb_error("Failed to renew a read transaction for the db: ", mdb_res).c_str()));
-      didit = true;
-    }
-    if (didit)
-    {
-      m_tinfo->m_ti_rflags.m_rf_txn = true;
+    MDB_txn *mtxn;
+    mdb_txn_cursors *mcur;
+    if (block_rtxn_start(&mtxn, &mcur))
       LOG_PRINT_L3("BlockchainLMDB::" << __func__ << " RO");
-    }
     return;
   }
 
@@ -2458,6 +3808,10 @@ void BlockchainLMDB::block_txn_stop()
       memset(&m_wcursors, 0, sizeof(m_wcursors));
 	}
   }
+  else if (m_tinfo.get() && m_tinfo->m_ti_rsnapshots)
+  {
+    // the enclosing read snapshot keeps the read txn
+  }
   else if (m_tinfo->m_ti_rtxn)
   {
     mdb_txn_reset(m_tinfo->m_ti_rtxn);
@@ -2477,6 +3831,10 @@ void BlockchainLMDB::block_txn_abort()
       memset(&m_wcursors, 0, sizeof(m_wcursors));
     }
   }
+  else if (m_tinfo.get() && m_tinfo->m_ti_rsnapshots)
+  {
+    // the enclosing read snapshot keeps the read txn
+  }
   else if (m_tinfo->m_ti_rtxn)
   {
     mdb_txn_reset(m_tinfo->m_ti_rtxn);
@@ -2493,10 +3851,11 @@ void BlockchainLMDB::block_txn_abort()
 }
 
 uint64_t BlockchainLMDB::add_block(const block& blk, const size_t& block_size, const difficulty_type& cumulative_difficulty, const uint64_t& coins_generated,
-    const std::vector<transaction>& txs)
+    const std::vector<transaction>& txs, const prepared_block_t* prepared)
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
+  DB_OP_STATS(LMDB_BLOCKS);
 
   if (m_height % 1000 == 0)
   {
@@ -2510,9 +3869,10 @@ uint64_t BlockchainLMDB::add_block(const block& blk, const size_t& block_size, c
 
   uint64_t num_txs = m_num_txs;
   uint64_t num_outputs = m_num_outputs;
+  m_pending_output_counts.clear();
   try
   {
-    BlockchainDB::add_block(blk, block_size, cumulative_difficulty, coins_generated, txs);
+    BlockchainDB::add_block(blk, block_size, cumulative_difficulty, coins_generated, txs, prepared);
   }
   catch (DB_ERROR_TXN_START& e)
   {
@@ -2523,10 +3883,46 @@ uint64_t BlockchainLMDB::add_block(const block& blk, const size_t& block_size, c
     m_num_txs = num_txs;
     m_num_outputs = num_outputs;
     block_txn_abort();
+    CRITICAL_REGION_LOCAL(m_recent_outputs_lock);
+    m_recent_outputs_valid = false;
     throw;
   }
 
-  return ++m_height;
+  ++m_height;
+
+  {
+    CRITICAL_REGION_LOCAL(m_recent_outputs_lock);
+    // a concurrent load may already have read this block's outputs
+    if (m_recent_outputs_valid && m_recent_outputs_end + 1 == m_height)
+    {
+      m_recent_outputs.push_back(recent_outputs_block());
+      m_recent_outputs.back().timestamp = blk.timestamp;
+      m_recent_outputs.back().counts.swap(m_pending_output_counts);
+      if (m_recent_outputs.size() > OUTPUT_HISTOGRAM_RECENT_BLOCKS)
+        m_recent_outputs.pop_front();
+      m_recent_outputs_end = m_height;
+    }
+    else if (m_recent_outputs_end != m_height)
+    {
+      m_recent_outputs_valid = false;
+    }
+  }
+
+  // the block is in, so a failure to prune is only worth a log; batches
+  // are left alone, as aborting them would not undo m_pruned_height
+  if (m_pruning_depth && !m_batch_active)
+  {
+    try
+    {
+      prune(PRUNE_BLOCKS_PER_ADD);
+    }
+    catch (const std::exception& e)
+    {
+      LOG_PRINT_L0("Failed to prune blockchain: " << e.what());
+    }
+  }
+
+  return m_height;
 }
 
 void BlockchainLMDB::pop_block(block& blk, std::vector<transaction>& txs)
@@ -2534,6 +3930,10 @@ void BlockchainLMDB::pop_block(block& blk, std::vector<transaction>& txs)
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
 
+  // the txs would come back without their signatures
+  if (m_height <= m_pruned_height)
+    throw0(DB_ERROR("Attempting to pop a pruned block"));
+
   block_txn_start(false);
 
   uint64_t num_txs = m_num_txs;
@@ -2548,10 +3948,26 @@ void BlockchainLMDB::pop_block(block& blk, std::vector<transaction>& txs)
     m_num_txs = num_txs;
     m_num_outputs = num_outputs;
 	block_txn_abort();
+    CRITICAL_REGION_LOCAL(m_recent_outputs_lock);
+    m_recent_outputs_valid = false;
     throw;
   }
 
   --m_height;
+
+  {
+    // the popped block's outputs go with its counts
+    CRITICAL_REGION_LOCAL(m_recent_outputs_lock);
+    if (m_recent_outputs_valid && m_recent_outputs_end == m_height + 1 && !m_recent_outputs.empty())
+    {
+      m_recent_outputs.pop_back();
+      m_recent_outputs_end = m_height;
+    }
+    else if (m_recent_outputs_end != m_height)
+    {
+      m_recent_outputs_valid = false;
+    }
+  }
 }
 
 void BlockchainLMDB::get_output_tx_and_index_from_global(const std::vector<uint64_t> &global_indices,
@@ -2625,6 +4041,53 @@ void BlockchainLMDB::get_output_key(const uint64_t &amount, const std::vector<ui
   LOG_PRINT_L3("db3: " << db3);
 }
 
+void BlockchainLMDB::get_output_keys_bulk(const std::vector<std::pair<uint64_t, uint64_t>> &offsets, std::vector<output_data_t> &outputs)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  TIME_MEASURE_START(db3);
+  check_open();
+  DB_OP_STATS(LMDB_OUTPUT_AMOUNTS);
+  outputs.clear();
+  outputs.reserve(offsets.size());
+
+  TXN_PREFIX_RDONLY();
+
+  RCURSOR(output_amounts);
+
+  for (const auto &o : offsets)
+  {
+    const uint64_t amount = o.first;
+    MDB_val_set(k, amount);
+    MDB_val_set(v, o.second);
+
+    auto get_result = mdb_cursor_get(m_cur_output_amounts, &k, &v, MDB_GET_BOTH);
+    if (get_result == MDB_NOTFOUND)
+      throw1(OUTPUT_DNE((std::string("Attempting to get output pubkey by global index (amount ") + boost::lexical_cast<std::string>(amount) + ", index " + boost::lexical_cast<std::string>(o.second) + ", count " + boost::lexical_cast<std::string>(get_num_outputs(amount)) + "), but key does not exist").c_str()));
+    else if (get_result)
+      throw0(DB_ERROR(lmdb_error("Error attempting to retrieve an output pubkey from the db", get_result).c_str()));
+
+    op_timer.cursor(v);
+    output_data_t data;
+    if (amount == 0)
+    {
+      const outkey *okp = (const outkey *)v.mv_data;
+      data = okp->data;
+    }
+    else
+    {
+      const pre_rct_outkey *okp = (const pre_rct_outkey *)v.mv_data;
+      memcpy(&data, &okp->data, sizeof(pre_rct_output_data_t));
+      data.commitment = rct::zeroCommit(amount);
+    }
+    outputs.push_back(data);
+  }
+
+  TXN_POSTFIX_RDONLY();
+
+  TIME_MEASURE_FINISH(db3);
+  LOG_PRINT_L3("db3: " << db3);
+}
+
 void BlockchainLMDB::get_output_tx_and_index(const uint64_t& amount, const std::vector<uint64_t> &offsets, std::vector<tx_out_index> &indices) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
@@ -2714,13 +4177,38 @@ std::map<uint64_t, std::tuple<uint64_t, uint64_t, uint64_t>> BlockchainLMDB::get
 
   if (unlocked || recent_cutoff > 0) {
     const uint64_t blockchain_height = height();
+    CRITICAL_REGION_LOCAL(m_recent_outputs_lock);
+    if (!m_recent_outputs_valid || m_recent_outputs_end != blockchain_height)
+      load_recent_outputs();
+    const uint64_t window_start = m_recent_outputs_end - m_recent_outputs.size();
+
+    // for outputs older than the counts go back, if ever needed
+    auto output_height = [&](uint64_t amount, uint64_t index) {
+      MDB_val_set(k, amount);
+      MDB_val_set(v, index);
+      int ret = mdb_cursor_get(m_cur_output_amounts, &k, &v, MDB_GET_BOTH);
+      if (ret)
+        throw0(DB_ERROR(lmdb_error("Failed to get output: ", ret).c_str()));
+      return ((const pre_rct_outkey *)v.mv_data)->data.height;
+    };
+    auto block_count = [this, window_start](uint64_t height, uint64_t amount) -> uint64_t {
+      const std::map<uint64_t, uint64_t> &counts = m_recent_outputs[height - window_start].counts;
+      const auto it = counts.find(amount);
+      return it == counts.end() ? 0 : it->second;
+    };
+
+    // outputs of an amount are in height order, so the locked ones are the
+    // newest, and the recent ones come just before them
     for (std::map<uint64_t, std::tuple<uint64_t, uint64_t, uint64_t>>::iterator i = histogram.begin(); i != histogram.end(); ++i) {
       uint64_t amount = i->first;
       uint64_t num_elems = std::get<0>(i->second);
-      while (num_elems > 0) {
-        const tx_out_index toi = get_output_tx_and_index(amount, num_elems - 1);
-        const uint64_t height = get_tx_block_height(toi.first);
-        if (height + CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE <= blockchain_height)
+      uint64_t h = blockchain_height;
+      while (h > window_start && h - 1 + CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE > blockchain_height) {
+        --h;
+        num_elems -= std::min(num_elems, block_count(h, amount));
+      }
+      while (h == window_start && num_elems > 0) {
+        if (output_height(amount, num_elems - 1) + CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE <= blockchain_height)
           break;
         --num_elems;
       }
@@ -2730,10 +4218,22 @@ std::map<uint64_t, std::tuple<uint64_t, uint64_t, uint64_t>> BlockchainLMDB::get
       if (recent_cutoff > 0)
       {
         uint64_t recent = 0;
-        while (num_elems > 0) {
-          const tx_out_index toi = get_output_tx_and_index(amount, num_elems - 1);
-          const uint64_t height = get_tx_block_height(toi.first);
-          const uint64_t ts = get_block_timestamp(height);
+        bool done = false;
+        while (!done && h > window_start) {
+          --h;
+          const uint64_t count = std::min(num_elems, block_count(h, amount));
+          if (count == 0)
+            continue;
+          if (m_recent_outputs[h - window_start].timestamp < recent_cutoff)
+            done = true;
+          else
+          {
+            num_elems -= count;
+            recent += count;
+          }
+        }
+        while (!done && num_elems > 0) {
+          const uint64_t ts = get_block_timestamp(output_height(amount, num_elems - 1));
           if (ts < recent_cutoff)
             break;
           --num_elems;
@@ -2750,6 +4250,52 @@ std::map<uint64_t, std::tuple<uint64_t, uint64_t, uint64_t>> BlockchainLMDB::get
   return histogram;
 }
 
+void BlockchainLMDB::load_recent_outputs() const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  const uint64_t end_height = m_height;
+  const uint64_t start_height = end_height > OUTPUT_HISTOGRAM_RECENT_BLOCKS ? end_height - OUTPUT_HISTOGRAM_RECENT_BLOCKS : 0;
+  std::deque<recent_outputs_block> blocks(end_height - start_height);
+  for (uint64_t h = start_height; h < end_height; ++h)
+    blocks[h - start_height].timestamp = get_block_timestamp(h);
+
+  TXN_PREFIX_RDONLY();
+  RCURSOR(output_amounts);
+
+  // only the tail of each amount's outputs is in range
+  MDB_val k;
+  MDB_val v;
+  MDB_cursor_op op = MDB_FIRST;
+  while (1)
+  {
+    int ret = mdb_cursor_get(m_cur_output_amounts, &k, &v, op);
+    op = MDB_NEXT_NODUP;
+    if (ret == MDB_NOTFOUND)
+      break;
+    if (ret)
+      throw0(DB_ERROR(lmdb_error("Failed to enumerate outputs: ", ret).c_str()));
+    const uint64_t amount = *(const uint64_t*)k.mv_data;
+    for (ret = mdb_cursor_get(m_cur_output_amounts, &k, &v, MDB_LAST_DUP); ret == 0; ret = mdb_cursor_get(m_cur_output_amounts, &k, &v, MDB_PREV_DUP))
+    {
+      const uint64_t height = ((const pre_rct_outkey *)v.mv_data)->data.height;
+      if (height < start_height)
+        break;
+      if (height < end_height)
+        ++blocks[height - start_height].counts[amount];
+    }
+    if (ret && ret != MDB_NOTFOUND)
+      throw0(DB_ERROR(lmdb_error("Failed to enumerate outputs: ", ret).c_str()));
+  }
+
+  TXN_POSTFIX_RDONLY();
+
+  m_recent_outputs.swap(blocks);
+  m_recent_outputs_end = end_height;
+  m_recent_outputs_valid = true;
+}
+
 void BlockchainLMDB::check_hard_fork_info()
 {
 }
@@ -2805,6 +4351,57 @@ uint8_t BlockchainLMDB::get_hard_fork_version(uint64_t height) const
   return ret;
 }
 
+// hf_versions values are the hard fork version, followed by the block's
+// version and vote when they were kept
+void BlockchainLMDB::set_hard_fork_info(uint64_t height, uint8_t version, uint8_t block_version, uint8_t vote)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  TXN_BLOCK_PREFIX(0);
+
+  MDB_val_copy<uint64_t> val_key(height);
+  uint8_t info[3] = { version, block_version, vote };
+  MDB_val val_value = { sizeof(info), info };
+  int result;
+  result = mdb_put(*txn_ptr, m_hf_versions, &val_key, &val_value, MDB_APPEND);
+  if (result == MDB_KEYEXIST)
+    result = mdb_put(*txn_ptr, m_hf_versions, &val_key, &val_value, 0);
+  if (result)
+    throw1(DB_ERROR(lmdb_error("Error adding hard fork info to db transaction: ", result).c_str()));
+
+  TXN_BLOCK_POSTFIX_SUCCESS();
+}
+
+bool BlockchainLMDB::get_hard_fork_info(uint64_t height, uint8_t &block_version, uint8_t &vote) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  TXN_PREFIX_RDONLY();
+  RCURSOR(hf_versions);
+
+  MDB_val_copy<uint64_t> val_key(height);
+  MDB_val val_ret;
+  auto result = mdb_cursor_get(m_cur_hf_versions, &val_key, &val_ret, MDB_SET);
+  if (result == MDB_NOTFOUND)
+  {
+    TXN_POSTFIX_RDONLY();
+    return false;
+  }
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Error attempting to retrieve hard fork info at height " + boost::lexical_cast<std::string>(height) + " from the db: ", result).c_str()));
+
+  const bool found = val_ret.mv_size >= 3;
+  if (found)
+  {
+    block_version = ((const uint8_t*)val_ret.mv_data)[1];
+    vote = ((const uint8_t*)val_ret.mv_data)[2];
+  }
+  TXN_POSTFIX_RDONLY();
+  return found;
+}
+
 bool BlockchainLMDB::is_read_only() const
 {
   unsigned int flags;
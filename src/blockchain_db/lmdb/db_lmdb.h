@@ -27,8 +27,10 @@
 #pragma once
 
 #include <atomic>
+#include <deque>
 
 #include "blockchain_db/blockchain_db.h"
+#include "blockchain_db/hash_filter.h"
 #include "cryptonote_protocol/blobdatatype.h" // for type blobdata
 #include "ringct/rctTypes.h"
 #include <boost/thread/tss.hpp>
@@ -45,6 +47,7 @@ typedef struct mdb_txn_cursors
   MDB_cursor *m_txc_blocks;
   MDB_cursor *m_txc_block_heights;
   MDB_cursor *m_txc_block_info;
+  MDB_cursor *m_txc_block_rct_outputs;
 
   MDB_cursor *m_txc_output_txs;
   MDB_cursor *m_txc_output_amounts;
@@ -61,6 +64,7 @@ typedef struct mdb_txn_cursors
 #define m_cur_blocks	m_cursors->m_txc_blocks
 #define m_cur_block_heights	m_cursors->m_txc_block_heights
 #define m_cur_block_info	m_cursors->m_txc_block_info
+#define m_cur_block_rct_outputs	m_cursors->m_txc_block_rct_outputs
 #define m_cur_output_txs	m_cursors->m_txc_output_txs
 #define m_cur_output_amounts	m_cursors->m_txc_output_amounts
 #define m_cur_txs	m_cursors->m_txc_txs
@@ -75,6 +79,7 @@ typedef struct mdb_rflags
   bool m_rf_blocks;
   bool m_rf_block_heights;
   bool m_rf_block_info;
+  bool m_rf_block_rct_outputs;
   bool m_rf_output_txs;
   bool m_rf_output_amounts;
   bool m_rf_txs;
@@ -89,6 +94,8 @@ typedef struct mdb_threadinfo
   MDB_txn *m_ti_rtxn;	// per-thread read txn
   mdb_txn_cursors m_ti_rcursors;	// per-thread read cursors
   mdb_rflags m_ti_rflags;	// per-thread read state
+  unsigned m_ti_rsnapshots;	// nesting depth of read_snapshot_start
+  bool m_ti_rsnapshot_owned;	// whether the outermost snapshot started the read txn
 
   ~mdb_threadinfo();
 } mdb_threadinfo;
@@ -122,16 +129,63 @@ struct mdb_txn_safe
   static void wait_no_active_txns();
   static void allow_new_txns();
 
+  // counts a txn not held by an mdb_txn_safe, so that a resize waits for it
+  static void add_active_txn();
+  static void remove_active_txn();
+
   mdb_threadinfo* m_tinfo;
   MDB_txn* m_txn;
   bool m_batch_txn = false;
   bool m_check;
   static std::atomic<uint64_t> num_active_txns;
 
+  // per-thread read txns: how many were created vs reused through mdb_txn_renew
+  static std::atomic<uint64_t> num_rtxn_begins;
+  static std::atomic<uint64_t> num_rtxn_renews;
+
   // could use a mutex here, but this should be sufficient.
   static std::atomic_flag creation_gate;
 };
 
+#define MDB_OP_STATS_BUCKETS 32
+
+// usage counters for one method, shared by all BlockchainLMDB instances.
+// latency bucket i counts calls which took less than 2^(i+1) usec.
+struct mdb_op_stats
+{
+  mdb_op_stats(const char *method, const char *table);
+
+  void add(uint64_t usec, uint64_t bytes, uint64_t cursor_ops, uint64_t gets);
+  uint64_t percentile(uint64_t calls, unsigned pct) const;
+
+  const char *m_method;
+  const char *m_table;
+  std::atomic<uint64_t> m_calls;
+  std::atomic<uint64_t> m_bytes;
+  std::atomic<uint64_t> m_cursor_ops;
+  std::atomic<uint64_t> m_gets;
+  std::atomic<uint64_t> m_latency[MDB_OP_STATS_BUCKETS];
+
+  static std::vector<mdb_op_stats*> all;
+  static std::atomic_flag all_gate;
+};
+
+// times one call of a method and adds it to its mdb_op_stats when it returns
+struct mdb_op_timer
+{
+  mdb_op_timer(mdb_op_stats &stats);
+  ~mdb_op_timer();
+
+  void cursor(const MDB_val &v) { ++m_cursor_ops; m_bytes += v.mv_size; }
+  void get(const MDB_val &v) { ++m_gets; m_bytes += v.mv_size; }
+
+  mdb_op_stats &m_stats;
+  uint64_t m_start;
+  uint64_t m_bytes;
+  uint64_t m_cursor_ops;
+  uint64_t m_gets;
+};
+
 
 // If m_batch_active is set, a batch transaction exists beyond this class, such
 // as a batch import with verification enabled, or possibly (later) a batch
@@ -164,6 +218,8 @@ public:
 
   virtual std::string get_db_name() const;
 
+  virtual bool copy_snapshot(const std::string &path, uint64_t max_bytes_per_sec, const std::function<bool(uint64_t, uint64_t)> &progress) const;
+
   virtual bool lock();
 
   virtual void unlock();
@@ -172,12 +228,16 @@ public:
 
   virtual block get_block(const crypto::hash& h) const;
 
+  virtual blobdata get_block_blob(const crypto::hash& h) const;
+
   virtual uint64_t get_block_height(const crypto::hash& h) const;
 
   virtual block_header get_block_header(const crypto::hash& h) const;
 
   virtual block get_block_from_height(const uint64_t& height) const;
 
+  virtual blobdata get_block_blob_from_height(const uint64_t& height) const;
+
   virtual uint64_t get_block_timestamp(const uint64_t& height) const;
 
   virtual uint64_t get_top_block_timestamp() const;
@@ -209,6 +269,8 @@ public:
 
   virtual transaction get_tx(const crypto::hash& h) const;
 
+  virtual bool get_tx_blob(const crypto::hash& h, blobdata &tx) const;
+
   virtual uint64_t get_tx_count() const;
 
   virtual std::vector<transaction> get_tx_list(const std::vector<crypto::hash>& hlist) const;
@@ -220,6 +282,7 @@ public:
   virtual output_data_t get_output_key(const uint64_t& amount, const uint64_t& index);
   virtual output_data_t get_output_key(const uint64_t& global_index) const;
   virtual void get_output_key(const uint64_t &amount, const std::vector<uint64_t> &offsets, std::vector<output_data_t> &outputs);
+  virtual void get_output_keys_bulk(const std::vector<std::pair<uint64_t, uint64_t>> &offsets, std::vector<output_data_t> &outputs);
 
   virtual tx_out_index get_output_tx_and_index_from_global(const uint64_t& index) const;
   virtual void get_output_tx_and_index_from_global(const std::vector<uint64_t> &global_indices,
@@ -229,19 +292,31 @@ public:
   virtual void get_output_tx_and_index(const uint64_t& amount, const std::vector<uint64_t> &offsets, std::vector<tx_out_index> &indices) const;
 
   virtual std::vector<uint64_t> get_tx_amount_output_indices(const uint64_t tx_id) const;
+  virtual void get_txs_amount_output_indices(const std::vector<crypto::hash>& tx_hashes, std::vector<std::vector<uint64_t> >& output_indices, std::vector<bool>& found) const;
+
+  virtual void get_blocks_with_output_indices(uint64_t start_height, size_t count, std::vector<std::pair<blobdata, std::vector<blobdata> > >& blocks, std::vector<std::vector<std::vector<uint64_t> > >& output_indices) const;
 
   virtual bool has_key_image(const crypto::key_image& img) const;
+  virtual void has_key_images(const std::vector<crypto::key_image>& imgs, std::vector<bool>& spent) const;
+
+  virtual bool get_output_distribution(uint64_t amount, uint64_t from_height, uint64_t to_height, std::vector<uint64_t> &distribution, uint64_t &base) const;
 
   virtual bool for_all_key_images(std::function<bool(const crypto::key_image&)>) const;
   virtual bool for_all_blocks(std::function<bool(uint64_t, const crypto::hash&, const cryptonote::block&)>) const;
   virtual bool for_all_transactions(std::function<bool(const crypto::hash&, const cryptonote::transaction&)>) const;
   virtual bool for_all_outputs(std::function<bool(uint64_t amount, const crypto::hash &tx_hash, size_t tx_idx)> f) const;
 
+  virtual bool for_all_key_images_parallel(unsigned shards, std::function<bool(unsigned, const crypto::key_image&)> f) const;
+  virtual bool for_all_blocks_parallel(unsigned shards, std::function<bool(unsigned, uint64_t, const crypto::hash&, const cryptonote::block&)> f) const;
+  virtual bool for_all_transactions_parallel(unsigned shards, std::function<bool(unsigned, const crypto::hash&, const cryptonote::transaction&)> f) const;
+  virtual bool for_all_outputs_parallel(unsigned shards, std::function<bool(unsigned, uint64_t amount, const crypto::hash &tx_hash, size_t tx_idx)> f) const;
+
   virtual uint64_t add_block( const block& blk
                             , const size_t& block_size
                             , const difficulty_type& cumulative_difficulty
                             , const uint64_t& coins_generated
                             , const std::vector<transaction>& txs
+                            , const prepared_block_t* prepared = NULL
                             );
 
   virtual void set_batch_transactions(bool batch_transactions);
@@ -256,6 +331,37 @@ public:
   virtual bool block_rtxn_start(MDB_txn **mtxn, mdb_txn_cursors **mcur) const;
   virtual void block_rtxn_stop() const;
 
+  virtual bool can_snapshot_reads() const { return true; }
+  virtual void read_snapshot_start() const;
+  virtual void read_snapshot_stop() const;
+
+  /**
+   * @brief get how many per-thread read txns were freshly begun vs renewed
+   *
+   * @param begins return-by-reference number of mdb_txn_begin calls
+   * @param renews return-by-reference number of mdb_txn_renew calls
+   */
+  static void get_rtxn_stats(uint64_t &begins, uint64_t &renews);
+
+  virtual void on_idle();
+
+  virtual void refresh();
+
+  virtual uint64_t get_pruned_height() const;
+
+  virtual void get_op_stats(std::vector<db_op_stats_t> &stats) const;
+
+  virtual void get_memory_stats(db_memory_stats_t &stats) const;
+
+  /**
+   * @brief get how often, and how long, the db was paused for resizing
+   *
+   * @param count return-by-reference number of resizes
+   * @param total_ms return-by-reference total time all txns were held off, in ms
+   * @param max_ms return-by-reference longest such pause, in ms
+   */
+  void get_resize_stats(uint64_t &count, uint64_t &total_ms, uint64_t &max_ms) const;
+
   virtual void pop_block(block& blk, std::vector<transaction>& txs);
 
   virtual bool can_thread_bulk_indices() const { return true; }
@@ -274,6 +380,37 @@ public:
 private:
   void do_resize(uint64_t size_increase=0);
 
+  /**
+   * @brief prune the txs of blocks which got deep enough since last time
+   *
+   * @param max_blocks the most blocks to prune in one go
+   */
+  void prune(uint64_t max_blocks);
+  uint64_t get_first_tx_id(uint64_t height) const;
+
+  /**
+   * @brief rebuild the per block output counts from the db
+   */
+  void load_recent_outputs() const;
+
+  /**
+   * @brief (re)build the key image and tx hash filters from the db
+   *
+   * Must not run concurrently with a write, or hashes added meanwhile
+   * could be missing from the new filters.
+   */
+  void build_filters();
+
+  /**
+   * @brief check whether a filter says a hash is not in the db
+   *
+   * @param filter the filter to check, may be empty
+   * @param data the 32 byte hash
+   *
+   * @return true if the hash is definitely not in the db
+   */
+  static bool filtered_out(const std::shared_ptr<hash_filter> &filter, const void *data);
+
   bool need_resize(uint64_t threshold_size=0) const;
   void check_and_resize_for_batch(uint64_t batch_num_blocks);
   uint64_t get_estimated_batch_size(uint64_t batch_num_blocks) const;
@@ -282,12 +419,14 @@ private:
                 , const size_t& block_size
                 , const difficulty_type& cumulative_difficulty
                 , const uint64_t& coins_generated
+                , uint64_t num_rct_outs
                 , const crypto::hash& block_hash
+                , const blobdata& block_blob
                 );
 
   virtual void remove_block();
 
-  virtual uint64_t add_transaction_data(const crypto::hash& blk_hash, const transaction& tx, const crypto::hash& tx_hash);
+  virtual uint64_t add_transaction_data(const crypto::hash& blk_hash, const transaction& tx, const crypto::hash& tx_hash, const blobdata& tx_blob);
 
   virtual void remove_transaction_data(const crypto::hash& tx_hash, const transaction& tx);
 
@@ -313,6 +452,8 @@ private:
   // Hard fork
   virtual void set_hard_fork_version(uint64_t height, uint8_t version);
   virtual uint8_t get_hard_fork_version(uint64_t height) const;
+  virtual void set_hard_fork_info(uint64_t height, uint8_t version, uint8_t block_version, uint8_t vote);
+  virtual bool get_hard_fork_info(uint64_t height, uint8_t &block_version, uint8_t &vote) const;
   virtual void check_hard_fork_info();
   virtual void drop_hard_fork_info();
 
@@ -347,11 +488,16 @@ private:
   // migrate from DB version 0 to 1
   void migrate_0_1();
 
+  // fill in block_rct_outputs for blocks added before it existed
+  void build_block_rct_outputs();
+
   MDB_env* m_env;
 
   MDB_dbi m_blocks;
   MDB_dbi m_block_heights;
   MDB_dbi m_block_info;
+  MDB_dbi m_block_rct_outputs;
+  bool m_has_block_rct_outputs; // may be missing from an older db opened read only
 
   MDB_dbi m_txs;
   MDB_dbi m_tx_indices;
@@ -383,6 +529,41 @@ private:
   mdb_txn_cursors m_wcursors;
   mutable boost::thread_specific_ptr<mdb_threadinfo> m_tinfo;
 
+  // map usage at the last idle check, to estimate how fast the db grows
+  time_t m_idle_check_time;
+  uint64_t m_idle_check_size_used;
+  double m_write_rate; // bytes per second
+
+  uint64_t m_resize_count;
+  uint64_t m_resize_pause_total; // ms
+  uint64_t m_resize_pause_max; // ms
+
+  uint64_t m_pruned_height; // txs of blocks below this are pruned
+
+  // key images and tx hashes in the db, so lookups for ones that aren't
+  // there skip it. Hashes are added along with the rows, but never removed,
+  // so a filter only gets stale; it is rebuilt when idle once the stale or
+  // extra hashes pile up. Swapped with std::atomic_load/store.
+  std::shared_ptr<hash_filter> m_spent_keys_filter;
+  std::shared_ptr<hash_filter> m_tx_filter;
+  uint64_t m_spent_keys_removed; // since the filter was built
+  uint64_t m_txs_removed; // since the filter was built
+
+  // outputs by amount added by each of the blocks before
+  // m_recent_outputs_end, oldest first, so get_output_histogram can count
+  // the locked and recent outputs without walking them. Built on first use,
+  // then kept up to date as blocks are added and popped.
+  struct recent_outputs_block
+  {
+    uint64_t timestamp;
+    std::map<uint64_t, uint64_t> counts;
+  };
+  mutable std::deque<recent_outputs_block> m_recent_outputs;
+  mutable uint64_t m_recent_outputs_end;
+  mutable bool m_recent_outputs_valid;
+  mutable epee::critical_section m_recent_outputs_lock;
+  std::map<uint64_t, uint64_t> m_pending_output_counts; // for the block being added
+
 #if defined(__arm__)
   // force a value so it can compile with 32-bit ARM
   constexpr static uint64_t DEFAULT_MAPSIZE = 1LL << 31;
@@ -395,6 +576,24 @@ private:
 #endif
 
   constexpr static float RESIZE_PERCENT = 0.8f;
+
+  // when idle, grow the map if it would fill up within this many seconds at
+  // the current write rate
+  constexpr static uint64_t RESIZE_AHEAD_SECONDS = 60 * 60;
+  // grow ahead by at least this fraction of the current map size
+  constexpr static float RESIZE_AHEAD_FACTOR = 0.5f;
+
+  // most blocks pruned when adding a block, and when idle (to catch up)
+  constexpr static uint64_t PRUNE_BLOCKS_PER_ADD = 16;
+  constexpr static uint64_t PRUNE_BLOCKS_PER_IDLE = 10000;
+
+  // how many of the latest blocks get_output_histogram has counts for, a
+  // week of two minute blocks
+  constexpr static uint64_t OUTPUT_HISTOGRAM_RECENT_BLOCKS = 7 * 720;
+
+  // smallest number of hashes the key image and tx hash filters are sized
+  // for, 2 MB each
+  constexpr static uint64_t FILTER_MIN_CAPACITY = 1 << 20;
 };
 
 }  // namespace cryptonote
@@ -0,0 +1,524 @@
+// Copyright (c) 2014-2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include <fstream>
+#include <random>
+#include <set>
+#include <boost/filesystem.hpp>
+
+#include "bootstrap_file.h"
+#include "fake_core.h"
+#include "common/command_line.h"
+#include "common/parallel_for.h"
+#include "common/thread_group.h"
+#include "common/util.h"
+#include "cryptonote_core/cryptonote_basic_impl.h"
+#include "cryptonote_core/cryptonote_format_utils.h"
+#include "ringct/rctSigs.h"
+#include "string_tools.h"
+#include "version.h"
+
+namespace po = boost::program_options;
+using namespace epee; // log_space
+
+namespace
+{
+// every block but the genesis block has this version, so there are RingCT
+// transactions from the start. No network's fork schedule allows that, so
+// the chain is for loading without verification (monero-blockchain-import
+// --verify off, or the database written here) rather than for syncing.
+const uint8_t generated_block_version = 5;
+
+// blocks are exactly one target apart, which keeps the difficulty at 1 so
+// nonce 0 meets the proof of work of each of them
+const uint64_t first_timestamp = 1483574400;
+
+// blocks are kept under the full reward zone, as they are on mainnet
+const size_t block_size_budget = CRYPTONOTE_BLOCK_GRANTED_FULL_REWARD_ZONE_V2 - CRYPTONOTE_COINBASE_BLOB_RESERVED_SIZE;
+
+const uint64_t progress_interval = 1000;
+
+struct owned_output
+{
+  uint64_t global_index;  // among rct (amount 0) outputs
+  uint64_t height;
+  crypto::public_key tx_pub_key;
+  size_t index_in_tx;
+  uint64_t amount;
+  rct::key mask;
+  bool rct;
+};
+
+struct generated_wallet
+{
+  cryptonote::account_base account;
+  std::vector<owned_output> outputs;  // by height, so the unlocked ones come first
+};
+
+// a transaction as drawn from the random stream, before it is signed
+struct tx_plan
+{
+  size_t sender;
+  std::vector<cryptonote::tx_source_entry> sources;
+  std::vector<cryptonote::tx_destination_entry> destinations;
+  std::vector<size_t> recipients;  // the wallet of each destination
+  uint64_t fee;
+};
+
+// as wallet2 estimates it to pick a fee
+size_t estimate_rct_tx_size(size_t n_inputs, size_t mixin, size_t n_outputs)
+{
+  // prefix: version and unlock time, inputs, outputs, extra
+  size_t size = 1 + 6 + n_inputs * (1 + 6 + (mixin + 1) * 2 + 32) + n_outputs * (6 + 32) + 40;
+  // rct: type, range proofs, MGs, pseudo outs, ecdh info, commitments, fee
+  size += 1 + (2 * 64 * 32 + 32 + 64 * 32) * n_outputs + n_inputs * (32 * (mixin + 1) + 32) + 32 * n_inputs + 2 * 32 * n_outputs + 32 * n_outputs + 4;
+  return size;
+}
+
+/*
+ * Generates blocks on top of the database of core, with wallets mining
+ * them in turn and sending each other RingCT transactions.
+ *
+ * All choices (transaction count, senders, inputs, ring members, amounts,
+ * fees) come from one seeded stream, so a seed gives the same shape of
+ * chain for a given build. Keys, masks and signatures come from the
+ * system's random generator as they do everywhere else, so the hashes
+ * differ between runs.
+ */
+class chain_generator
+{
+public:
+  chain_generator(fake_core_db& core, uint64_t seed, size_t wallets, double txs_per_block, size_t mixin, size_t threads)
+    : m_core(core)
+    , m_db(core.m_storage.get_db())
+    , m_rng(seed)
+    , m_wallets(wallets)
+    , m_txs_per_block(txs_per_block)
+    , m_mixin(mixin)
+    , m_threads(threads)
+    , m_txs(0)
+  {
+    for (size_t n = 0; n < wallets; ++n)
+    {
+      const std::string key_seed = "generated wallet " + std::to_string(seed) + " " + std::to_string(n);
+      crypto::secret_key recovery_key;
+      crypto::hash h = crypto::cn_fast_hash(key_seed.data(), key_seed.size());
+      memcpy(&recovery_key, &h, sizeof(recovery_key));
+      m_wallets[n].account.generate(recovery_key, true);
+    }
+
+    const uint64_t top = m_db.height() - 1;
+    for (uint64_t h = 0; h <= top; ++h)
+      m_outputs_at_height.push_back(0);
+    m_outputs_at_height.back() = m_db.get_num_outputs(0);
+    m_generated_coins = m_db.get_block_already_generated_coins(top);
+    m_cumulative_difficulty = m_db.get_block_cumulative_difficulty(top);
+    m_top_hash = m_db.top_block_hash();
+  }
+
+  uint64_t txs() const { return m_txs; }
+
+  bool generate_block()
+  {
+    const uint64_t height = m_db.height();
+
+    std::vector<tx_plan> plans;
+    size_t budget = block_size_budget;
+    const size_t wanted = std::poisson_distribution<size_t>(m_txs_per_block)(m_rng);
+    for (size_t n = 0; n < wanted; ++n)
+    {
+      tx_plan plan;
+      if (plan_tx(height, budget, plan))
+        plans.push_back(std::move(plan));
+    }
+
+    // signing is nearly all the time a block takes
+    std::vector<cryptonote::transaction> txs(plans.size());
+    const bool signed_all = tools::parallel_for(m_threads, 0, plans.size(), 1, [&](size_t first, size_t last) {
+      for (size_t n = first; n < last; ++n)
+      {
+        crypto::secret_key tx_key;
+        if (!cryptonote::construct_tx_and_get_tx_key(m_wallets[plans[n].sender].account.get_keys(), plans[n].sources, plans[n].destinations,
+            std::vector<uint8_t>(), txs[n], 0, tx_key, true))
+          return false;
+      }
+      return true;
+    });
+    if (!signed_all)
+    {
+      LOG_ERROR("Failed to construct a transaction at height " << height);
+      return false;
+    }
+
+    cryptonote::block b = AUTO_VAL_INIT(b);
+    b.major_version = generated_block_version;
+    b.minor_version = generated_block_version;
+    b.timestamp = first_timestamp + height * DIFFICULTY_TARGET_V2;
+    b.prev_id = m_top_hash;
+    b.nonce = 0;
+    size_t txs_size = 0;
+    uint64_t fees = 0;
+    for (size_t n = 0; n < txs.size(); ++n)
+    {
+      b.tx_hashes.push_back(cryptonote::get_transaction_hash(txs[n]));
+      txs_size += cryptonote::get_object_blobsize(txs[n]);
+      fees += plans[n].fee;
+    }
+
+    const size_t miner = std::uniform_int_distribution<size_t>(0, m_wallets.size() - 1)(m_rng);
+    if (!cryptonote::construct_miner_tx(height, 0, m_generated_coins, txs_size, fees, m_wallets[miner].account.get_keys().m_account_address,
+        b.miner_tx, cryptonote::blobdata(), 1, generated_block_version))
+    {
+      LOG_ERROR("Failed to construct the miner transaction at height " << height);
+      return false;
+    }
+    uint64_t reward = 0;
+    for (const cryptonote::tx_out& out: b.miner_tx.vout)
+      reward += out.amount;
+    m_generated_coins += reward - fees;
+    m_cumulative_difficulty += 1;
+
+    uint64_t next_index = m_db.get_num_outputs(0);
+    m_core.add_block(b, txs_size + cryptonote::get_object_blobsize(b.miner_tx), m_cumulative_difficulty, m_generated_coins, txs);
+    m_top_hash = cryptonote::get_block_hash(b);
+    m_txs += txs.size();
+
+    // outputs are numbered in the order add_block adds them
+    owned_output coinbase = {next_index, height, cryptonote::get_tx_pub_key_from_extra(b.miner_tx), 0, reward, rct::identity(), false};
+    m_wallets[miner].outputs.push_back(coinbase);
+    next_index += b.miner_tx.vout.size();
+    for (size_t n = 0; n < txs.size(); ++n)
+    {
+      std::vector<size_t> candidates = plans[n].recipients;
+      candidates.push_back(plans[n].sender);
+      add_outputs(txs[n], height, next_index, candidates);
+      next_index += txs[n].vout.size();
+    }
+    m_outputs_at_height.push_back(next_index);
+    return true;
+  }
+
+  bool write_wallets(const std::string& path, bool testnet) const
+  {
+    std::ofstream file(path);
+    for (const generated_wallet& w: m_wallets)
+    {
+      const cryptonote::account_keys& keys = w.account.get_keys();
+      file << cryptonote::get_account_address_as_str(testnet, keys.m_account_address) << " "
+        << string_tools::pod_to_hex(keys.m_spend_secret_key) << " "
+        << string_tools::pod_to_hex(keys.m_view_secret_key) << "\n";
+    }
+    return file.good();
+  }
+
+private:
+  // draws a transaction from a wallet with unlocked outputs. Returns false,
+  // leaving the wallets alone, when none was found, the funds are too
+  // small, or the transaction would not fit in budget
+  bool plan_tx(uint64_t height, size_t& budget, tx_plan& plan)
+  {
+    if (height <= CRYPTONOTE_MINED_MONEY_UNLOCK_WINDOW)
+      return false;
+    const uint64_t unlocked_height = height - CRYPTONOTE_MINED_MONEY_UNLOCK_WINDOW;
+    const uint64_t decoys = m_outputs_at_height[unlocked_height];
+
+    // mostly the default ring size, now and then a bigger one
+    const unsigned ring_draw = std::uniform_int_distribution<unsigned>(0, 99)(m_rng);
+    const size_t mixin = ring_draw < 90 ? m_mixin : ring_draw < 98 ? m_mixin * 2 : m_mixin * 4;
+    if (decoys <= mixin)
+      return false;
+
+    plan.sender = std::uniform_int_distribution<size_t>(0, m_wallets.size() - 1)(m_rng);
+    std::vector<owned_output>& outputs = m_wallets[plan.sender].outputs;
+    const size_t unlocked = std::upper_bound(outputs.begin(), outputs.end(), unlocked_height,
+      [](uint64_t h, const owned_output& o) { return h < o.height; }) - outputs.begin();
+    if (!unlocked)
+      return false;
+
+    const unsigned input_draw = std::uniform_int_distribution<unsigned>(0, 99)(m_rng);
+    const size_t n_inputs = std::min<size_t>(unlocked, input_draw < 55 ? 1 : input_draw < 90 ? 2 : input_draw < 97 ? 3 : 4);
+    const unsigned output_draw = std::uniform_int_distribution<unsigned>(0, 99)(m_rng);
+    const size_t n_outputs = output_draw < 85 ? 2 : output_draw < 95 ? 3 : 5;
+    const size_t size = estimate_rct_tx_size(n_inputs, mixin, n_outputs);
+    if (size > budget)
+      return false;
+
+    // the default priority mostly, some pay more to get in faster
+    const unsigned fee_draw = std::uniform_int_distribution<unsigned>(0, 99)(m_rng);
+    const uint64_t fee_multiplier = fee_draw < 80 ? 1 : fee_draw < 95 ? 4 : 20;
+    plan.fee = FEE_PER_KB * ((size + 1023) / 1024) * fee_multiplier;
+
+    std::set<size_t> picked;
+    while (picked.size() < n_inputs)
+      picked.insert(std::uniform_int_distribution<size_t>(0, unlocked - 1)(m_rng));
+    uint64_t amount_in = 0;
+    for (size_t i: picked)
+      amount_in += outputs[i].amount;
+    if (amount_in <= plan.fee + n_outputs)
+      return false;
+
+    for (size_t i: picked)
+    {
+      cryptonote::tx_source_entry source;
+      pick_ring(decoys, mixin, outputs[i], source);
+      plan.sources.push_back(source);
+    }
+    for (auto i = picked.rbegin(); i != picked.rend(); ++i)
+      outputs.erase(outputs.begin() + *i);
+
+    // a part goes to other wallets, the rest comes back as change
+    const uint64_t available = amount_in - plan.fee;
+    const uint64_t sent = std::max<uint64_t>(n_outputs - 1, available * std::uniform_real_distribution<double>(0.05, 0.95)(m_rng));
+    uint64_t left = sent;
+    for (size_t n = 0; n < n_outputs - 1; ++n)
+    {
+      size_t recipient = std::uniform_int_distribution<size_t>(0, m_wallets.size() - 1)(m_rng);
+      if (recipient == plan.sender && m_wallets.size() > 1)
+        recipient = (recipient + 1) % m_wallets.size();
+      const uint64_t amount = left / (n_outputs - 1 - n);
+      left -= amount;
+      plan.destinations.push_back(cryptonote::tx_destination_entry(amount, m_wallets[recipient].account.get_keys().m_account_address));
+      plan.recipients.push_back(recipient);
+    }
+    if (available > sent)
+    {
+      plan.destinations.push_back(cryptonote::tx_destination_entry(available - sent, m_wallets[plan.sender].account.get_keys().m_account_address));
+      plan.recipients.push_back(plan.sender);
+    }
+
+    budget -= size;
+    return true;
+  }
+
+  // recent outputs are picked more often, as wallets do
+  void pick_ring(uint64_t decoys, size_t mixin, const owned_output& real, cryptonote::tx_source_entry& source)
+  {
+    std::set<uint64_t> ring;
+    ring.insert(real.global_index);
+    while (ring.size() < mixin + 1)
+    {
+      const double frac = std::sqrt(std::uniform_real_distribution<double>(0, 1)(m_rng));
+      ring.insert(std::min<uint64_t>(decoys - 1, frac * decoys));
+    }
+
+    const std::vector<uint64_t> offsets(ring.begin(), ring.end());
+    std::vector<cryptonote::output_data_t> keys;
+    m_db.get_output_key(0, offsets, keys);
+    for (size_t n = 0; n < offsets.size(); ++n)
+    {
+      source.outputs.push_back(std::make_pair(offsets[n], rct::ctkey({rct::pk2rct(keys[n].pubkey), keys[n].commitment})));
+      if (offsets[n] == real.global_index)
+        source.real_output = n;
+    }
+    source.real_out_tx_key = real.tx_pub_key;
+    source.real_output_in_tx_index = real.index_in_tx;
+    source.amount = real.amount;
+    source.rct = real.rct;
+    source.mask = real.mask;
+  }
+
+  // gives the outputs of tx to whichever of the candidate wallets they pay
+  void add_outputs(const cryptonote::transaction& tx, uint64_t height, uint64_t first_index, std::vector<size_t> candidates)
+  {
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+    const crypto::public_key tx_pub_key = cryptonote::get_tx_pub_key_from_extra(tx);
+    for (size_t w: candidates)
+    {
+      const cryptonote::account_keys& keys = m_wallets[w].account.get_keys();
+      crypto::key_derivation derivation;
+      if (!crypto::generate_key_derivation(tx_pub_key, keys.m_view_secret_key, derivation))
+        continue;
+      for (size_t i = 0; i < tx.vout.size(); ++i)
+      {
+        crypto::public_key key;
+        if (!crypto::derive_public_key(derivation, i, keys.m_account_address.m_spend_public_key, key)
+            || key != boost::get<cryptonote::txout_to_key>(tx.vout[i].target).key)
+          continue;
+
+        owned_output o = {first_index + i, height, tx_pub_key, i, 0, rct::identity(), true};
+        crypto::secret_key scalar;
+        crypto::derivation_to_scalar(derivation, i, scalar);
+        o.amount = tx.rct_signatures.type == rct::RCTTypeSimple
+          ? rct::decodeRctSimple(tx.rct_signatures, rct::sk2rct(scalar), i, o.mask)
+          : rct::decodeRct(tx.rct_signatures, rct::sk2rct(scalar), i, o.mask);
+        m_wallets[w].outputs.push_back(o);
+      }
+    }
+  }
+
+  fake_core_db& m_core;
+  cryptonote::BlockchainDB& m_db;
+  std::mt19937_64 m_rng;
+  std::vector<generated_wallet> m_wallets;
+  double m_txs_per_block;
+  size_t m_mixin;
+  tools::thread_group m_threads;
+  std::vector<uint64_t> m_outputs_at_height;  // rct outputs in the chain up to and including each block
+  uint64_t m_generated_coins;
+  cryptonote::difficulty_type m_cumulative_difficulty;
+  crypto::hash m_top_hash;
+  uint64_t m_txs;
+};
+}
+
+int main(int argc, char* argv[])
+{
+  uint32_t log_level = 0;
+
+  tools::sanitize_locale();
+
+  po::options_description desc_cmd_only("Command line options");
+  po::options_description desc_cmd_sett("Command line options and settings options");
+  const command_line::arg_descriptor<std::string> arg_data_dir     = {"data-dir", "Directory to write the database to, which must not hold one yet", "generated-chain"};
+  const command_line::arg_descriptor<std::string> arg_output_file  = {"output-file", "Also export the chain to this bootstrap file", ""};
+  const command_line::arg_descriptor<uint64_t> arg_block_count     = {"block-count", "Height of the generated chain", 100000};
+  const command_line::arg_descriptor<uint64_t> arg_seed            = {"seed", "Seed of the choices made while generating", 1};
+  const command_line::arg_descriptor<size_t> arg_wallets           = {"wallets", "Number of wallets mining blocks and paying each other", 100};
+  const command_line::arg_descriptor<double> arg_txs_per_block     = {"txs-per-block", "Average number of transactions in a block", 4};
+  const command_line::arg_descriptor<size_t> arg_mixin             = {"mixin", "Mixin of most transactions, some use two or four times as much", 4};
+  const command_line::arg_descriptor<size_t> arg_threads           = {"threads", "Threads signing transactions, 0 for one per core", 0};
+  const command_line::arg_descriptor<uint32_t> arg_log_level       = {"log-level",  "", log_level};
+  const command_line::arg_descriptor<bool>     arg_testnet_on = {
+    "testnet"
+      , "Generate on top of the testnet genesis block, with testnet addresses."
+      , false
+  };
+
+  command_line::add_arg(desc_cmd_sett, arg_data_dir);
+  command_line::add_arg(desc_cmd_sett, arg_output_file);
+  command_line::add_arg(desc_cmd_sett, arg_block_count);
+  command_line::add_arg(desc_cmd_sett, arg_seed);
+  command_line::add_arg(desc_cmd_sett, arg_wallets);
+  command_line::add_arg(desc_cmd_sett, arg_txs_per_block);
+  command_line::add_arg(desc_cmd_sett, arg_mixin);
+  command_line::add_arg(desc_cmd_sett, arg_threads);
+  command_line::add_arg(desc_cmd_sett, arg_testnet_on);
+  command_line::add_arg(desc_cmd_sett, arg_log_level);
+
+  command_line::add_arg(desc_cmd_only, command_line::arg_help);
+
+  po::options_description desc_options("Allowed options");
+  desc_options.add(desc_cmd_only).add(desc_cmd_sett);
+
+  po::variables_map vm;
+  bool r = command_line::handle_error_helper(desc_options, [&]()
+  {
+    po::store(po::parse_command_line(argc, argv, desc_options), vm);
+    po::notify(vm);
+    return true;
+  });
+  if (! r)
+    return 1;
+
+  if (command_line::get_arg(vm, command_line::arg_help))
+  {
+    std::cout << "Monero '" << MONERO_RELEASE_NAME << "' (v" << MONERO_VERSION_FULL << ")" << ENDL << ENDL;
+    std::cout << desc_options << std::endl;
+    return 1;
+  }
+
+  log_level = command_line::get_arg(vm, arg_log_level);
+  log_space::get_set_log_detalisation_level(true, log_level);
+  log_space::log_singletone::add_logger(LOGGER_CONSOLE, NULL, NULL);
+
+  const bool opt_testnet = command_line::get_arg(vm, arg_testnet_on);
+  const boost::filesystem::path data_dir = command_line::get_arg(vm, arg_data_dir);
+  const uint64_t block_count = command_line::get_arg(vm, arg_block_count);
+  const size_t wallets = command_line::get_arg(vm, arg_wallets);
+  const size_t threads = command_line::get_arg(vm, arg_threads);
+  if (!wallets)
+  {
+    std::cerr << "--" << arg_wallets.name << " must not be 0" << std::endl;
+    return 1;
+  }
+
+  boost::system::error_code ec;
+  boost::filesystem::create_directories(data_dir, ec);
+
+  try
+  {
+    // the database is throwaway until it is complete
+    fake_core_db core(data_dir, opt_testnet, true, "lmdb", MDB_NOSYNC | MDB_WRITEMAP | MDB_MAPASYNC);
+    if (core.m_storage.get_current_blockchain_height() != 1)
+    {
+      std::cerr << "The database in " << data_dir.string() << " already has blocks" << std::endl;
+      return 1;
+    }
+
+    chain_generator generator(core, command_line::get_arg(vm, arg_seed), wallets, command_line::get_arg(vm, arg_txs_per_block),
+      command_line::get_arg(vm, arg_mixin), threads ? threads - 1 : tools::thread_group::optimal());
+
+    LOG_PRINT_L0("Generating " << block_count << " blocks in " << data_dir.string());
+    core.batch_start(progress_interval);
+    for (uint64_t height = 1; height < block_count; ++height)
+    {
+      if (!generator.generate_block())
+      {
+        core.batch_stop();
+        return 1;
+      }
+      if (height % progress_interval == 0)
+      {
+        core.batch_stop();
+        std::cout << "\rblock " << height << "/" << block_count - 1 << ", " << generator.txs() << " transactions" << std::flush;
+        core.batch_start(progress_interval);
+      }
+    }
+    core.batch_stop();
+    std::cout << std::endl;
+
+    const std::string wallets_file = (data_dir / "wallets.txt").string();
+    if (!generator.write_wallets(wallets_file, opt_testnet))
+    {
+      LOG_ERROR("Failed to write " << wallets_file);
+      return 1;
+    }
+    LOG_PRINT_L0("Generated " << block_count - 1 << " blocks with " << generator.txs() << " transactions, wallet keys in " << wallets_file);
+
+    if (command_line::has_arg(vm, arg_output_file))
+    {
+      boost::filesystem::path output_file = command_line::get_arg(vm, arg_output_file);
+      BootstrapFile bootstrap;
+      if (!bootstrap.store_blockchain_raw(&core.m_storage, &core.m_pool, output_file))
+      {
+        LOG_ERROR("Failed to export to " << output_file.string());
+        return 1;
+      }
+    }
+  }
+  catch (const std::exception& e)
+  {
+    LOG_ERROR("Error generating the chain: " << e.what());
+    return 1;
+  }
+
+  return 0;
+}
@@ -30,8 +30,12 @@
 #include <cstdio>
 #include <algorithm>
 #include <fstream>
+#include <deque>
 
 #include <boost/filesystem.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
 #include "bootstrap_file.h"
 #include "bootstrap_serialization.h"
 #include "cryptonote_core/cryptonote_format_utils.h"
@@ -65,6 +69,10 @@ uint64_t db_batch_size = 100;
 // frequently saved
 uint64_t db_batch_size_verify = 5000;
 
+// number of blocks prepared (hashed and input-scanned) together when
+// verifying; the file reader stays up to this many blocks further ahead
+uint64_t import_prep_blocks = 100;
+
 std::string refresh_string = "\r                                    \r";
 }
 
@@ -246,6 +254,182 @@ int pop_blocks(FakeCore& simple_core, int num_blocks)
   return num_blocks;
 }
 
+// a chunk read from the bootstrap file, with the height of its first block
+struct import_chunk
+{
+  uint64_t height;
+  bootstrap::block_package bp;
+};
+
+// fixed capacity queue between the bootstrap file reader and the importer
+template <typename T>
+class bounded_queue
+{
+public:
+  bounded_queue(size_t capacity) : m_capacity(capacity), m_closed(false) {}
+
+  // waits while the queue is full, returns false if it was closed
+  bool push(T&& item)
+  {
+    boost::unique_lock<boost::mutex> lock(m_lock);
+    while (!m_closed && m_items.size() >= m_capacity)
+      m_cv.wait(lock);
+    if (m_closed)
+      return false;
+    m_items.push_back(std::move(item));
+    m_cv.notify_all();
+    return true;
+  }
+
+  // waits for count items, or fewer once the queue is closed, and returns
+  // false when it is closed and drained
+  bool pop(std::vector<T>& items, size_t count)
+  {
+    boost::unique_lock<boost::mutex> lock(m_lock);
+    while (!m_closed && m_items.size() < count)
+      m_cv.wait(lock);
+    if (m_items.empty())
+      return false;
+    while (!m_items.empty() && items.size() < count)
+    {
+      items.push_back(std::move(m_items.front()));
+      m_items.pop_front();
+    }
+    m_cv.notify_all();
+    return true;
+  }
+
+  void close()
+  {
+    boost::unique_lock<boost::mutex> lock(m_lock);
+    m_closed = true;
+    m_cv.notify_all();
+  }
+
+private:
+  size_t m_capacity;
+  bool m_closed;
+  std::deque<T> m_items;
+  boost::mutex m_lock;
+  boost::condition_variable m_cv;
+};
+
+// reads and parses chunks from start_height to block_stop, checking their
+// checksums if the file has them, and queues them for import. import_file
+// must be positioned at the chunk for first_height. Closes the queue when
+// done. Returns 0 on success, or at the end of the file, and 2 on error.
+int read_chunks(std::ifstream& import_file, bool chunk_checksums, uint64_t first_height, uint64_t start_height, uint64_t block_stop, bounded_queue<import_chunk>& chunk_queue)
+{
+  std::string str1;
+  char buffer1[1024];
+  std::vector<char> buffer_block(BUFFER_SIZE);
+  uint64_t h = first_height;
+  uint64_t bytes_read = 0;
+  int ret = 0;
+
+  // Within the loop, we skip to start_height before we start adding. With a
+  // bootstrap index, first_height is already close to it.
+  while (true)
+  {
+    uint32_t chunk_size;
+    import_file.read(buffer1, sizeof(chunk_size));
+    // TODO: bootstrap.read_chunk();
+    if (! import_file) {
+      std::cout << refresh_string;
+      LOG_PRINT_L0("End of file reached");
+      break;
+    }
+    bytes_read += sizeof(chunk_size);
+
+    str1.assign(buffer1, sizeof(chunk_size));
+    if (! ::serialization::parse_binary(str1, chunk_size))
+    {
+      LOG_PRINT_RED_L0("Error in deserialization of chunk size");
+      ret = 2;
+      break;
+    }
+    LOG_PRINT_L3("chunk_size: " << chunk_size);
+
+    if (chunk_size > BUFFER_SIZE)
+    {
+      LOG_PRINT_L0("WARNING: chunk_size " << chunk_size << " > BUFFER_SIZE " << BUFFER_SIZE);
+      LOG_PRINT_RED_L0("Aborting: chunk size exceeds buffer size");
+      ret = 2;
+      break;
+    }
+    if (chunk_size > 100000)
+    {
+      LOG_PRINT_L0("NOTE: chunk_size " << chunk_size << " > 100000");
+    }
+    else if (chunk_size == 0) {
+      LOG_PRINT_L0("ERROR: chunk_size == 0");
+      ret = 2;
+      break;
+    }
+    import_file.read(buffer_block.data(), chunk_size);
+    if (! import_file) {
+      LOG_PRINT_L0("ERROR: unexpected end of file: bytes read before error: "
+          << import_file.gcount() << " of chunk_size " << chunk_size);
+      ret = 2;
+      break;
+    }
+    bytes_read += chunk_size;
+    if (chunk_checksums)
+    {
+      crypto::hash checksum;
+      import_file.read(checksum.data, sizeof(checksum.data));
+      if (! import_file) {
+        LOG_PRINT_L0("ERROR: unexpected end of file while reading chunk checksum");
+        ret = 2;
+        break;
+      }
+      bytes_read += sizeof(checksum.data);
+      if (checksum != crypto::cn_fast_hash(buffer_block.data(), chunk_size))
+      {
+        std::cout << refresh_string;
+        LOG_PRINT_RED_L0("Chunk checksum mismatch, height=" << h << ": bootstrap file is corrupt");
+        ret = 2;
+        break;
+      }
+    }
+    LOG_PRINT_L3("Total bytes read: " << bytes_read);
+
+    if (h + NUM_BLOCKS_PER_CHUNK < start_height + 1)
+    {
+      h += NUM_BLOCKS_PER_CHUNK;
+      continue;
+    }
+    if (h > block_stop)
+    {
+      std::cout << refresh_string << "block " << h-1
+        << " / " << block_stop
+        << std::flush;
+      std::cout << ENDL << ENDL;
+      LOG_PRINT_L0("Specified block number reached - stopping.  block: " << h-1 << "  total blocks: " << h);
+      break;
+    }
+
+    import_chunk chunk;
+    chunk.height = h;
+    str1.assign(buffer_block.data(), chunk_size);
+    if (! ::serialization::parse_binary(str1, chunk.bp))
+    {
+      std::cout << refresh_string;
+      LOG_PRINT_RED_L0("exception while reading from file, height=" << h << ": Error in deserialization of chunk");
+      ret = 2;
+      break;
+    }
+    h += NUM_BLOCKS_PER_CHUNK;
+
+    // the importer stopped early
+    if (! chunk_queue.push(std::move(chunk)))
+      break;
+  }
+
+  chunk_queue.close();
+  return ret;
+}
+
 template <typename FakeCore>
 int import_from_file(FakeCore& simple_core, const std::string& import_file_path, uint64_t block_stop=0)
 {
@@ -287,13 +471,8 @@ int import_from_file(FakeCore& simple_core, const std::string& import_file_path,
   // 4 byte magic + (currently) 1024 byte header structures
   bootstrap.seek_to_first_chunk(import_file);
 
-  std::string str1;
-  char buffer1[1024];
-  char buffer_block[BUFFER_SIZE];
   block b;
-  transaction tx;
   int quit = 0;
-  uint64_t bytes_read = 0;
 
   uint64_t start_height = 1;
   if (opt_resume)
@@ -327,249 +506,235 @@ int import_from_file(FakeCore& simple_core, const std::string& import_file_path,
   LOG_PRINT_L0("Reading blockchain from bootstrap file...");
   std::cout << ENDL;
 
-  // Within the loop, we skip to start_height before we start adding.
-  // TODO: Not a bottleneck, but we can use what's done in count_blocks() and
-  // only do the chunk size reads, skipping the chunk content reads until we're
-  // at start_height.
+  const uint64_t first_height = bootstrap.seek_to_height(import_file, import_file_path, start_height);
+
+  // Reading and parsing the file runs on its own thread, ahead of the
+  // blocks being verified and written, so the disk is kept busy while
+  // the CPU works on earlier blocks.
+  bounded_queue<import_chunk> chunk_queue(import_prep_blocks * 2);
+  std::atomic<int> read_status(0);
+  boost::thread reader([&]() {
+    read_status = read_chunks(import_file, bootstrap.has_chunk_checksums(), first_height, start_height, block_stop, chunk_queue);
+  });
+
+  std::vector<import_chunk> chunks;
+  bool failed = false;
   while (! quit)
   {
-    uint32_t chunk_size;
-    import_file.read(buffer1, sizeof(chunk_size));
-    // TODO: bootstrap.read_chunk();
-    if (! import_file) {
-      std::cout << refresh_string;
-      LOG_PRINT_L0("End of file reached");
-      quit = 1;
+    chunks.clear();
+    if (! chunk_queue.pop(chunks, import_prep_blocks))
       break;
-    }
-    bytes_read += sizeof(chunk_size);
-
-    str1.assign(buffer1, sizeof(chunk_size));
-    if (! ::serialization::parse_binary(str1, chunk_size))
-    {
-      throw std::runtime_error("Error in deserialization of chunk size");
-    }
-    LOG_PRINT_L3("chunk_size: " << chunk_size);
-
-    if (chunk_size > BUFFER_SIZE)
-    {
-      LOG_PRINT_L0("WARNING: chunk_size " << chunk_size << " > BUFFER_SIZE " << BUFFER_SIZE);
-      throw std::runtime_error("Aborting: chunk size exceeds buffer size");
-    }
-    if (chunk_size > 100000)
-    {
-      LOG_PRINT_L0("NOTE: chunk_size " << chunk_size << " > 100000");
-    }
-    else if (chunk_size == 0) {
-      LOG_PRINT_L0("ERROR: chunk_size == 0");
-      return 2;
-    }
-    import_file.read(buffer_block, chunk_size);
-    if (! import_file) {
-      LOG_PRINT_L0("ERROR: unexpected end of file: bytes read before error: "
-          << import_file.gcount() << " of chunk_size " << chunk_size);
-      return 2;
-    }
-    bytes_read += chunk_size;
-    LOG_PRINT_L3("Total bytes read: " << bytes_read);
 
-    if (h + NUM_BLOCKS_PER_CHUNK < start_height + 1)
+    // hash and look up the inputs of the whole group at once, using the
+    // verification threads, before the blocks are added one by one
+    if (opt_verify)
     {
-      h += NUM_BLOCKS_PER_CHUNK;
-      continue;
-    }
-    if (h > block_stop)
-    {
-      std::cout << refresh_string << "block " << h-1
-        << " / " << block_stop
-        << std::flush;
-      std::cout << ENDL << ENDL;
-      LOG_PRINT_L0("Specified block number reached - stopping.  block: " << h-1 << "  total blocks: " << h);
-      quit = 1;
-      break;
+      std::vector<block_complete_entry> entries(chunks.size());
+      for (size_t n = 0; n < chunks.size(); ++n)
+      {
+        entries[n].block = block_to_blob(chunks[n].bp.block);
+        for (const transaction& tx : chunks[n].bp.txs)
+          entries[n].txs.push_back(tx_to_blob(tx));
+      }
+      if (! simple_core.m_storage.prepare_handle_incoming_blocks(entries))
+        LOG_PRINT_L1("Failed to prepare blocks, verifying them one by one");
     }
 
     try
     {
-      str1.assign(buffer_block, chunk_size);
-      bootstrap::block_package bp;
-      if (! ::serialization::parse_binary(str1, bp))
-        throw std::runtime_error("Error in deserialization of chunk");
-
-      int display_interval = 1000;
-      int progress_interval = 10;
-      // NOTE: use of NUM_BLOCKS_PER_CHUNK is a placeholder in case multi-block chunks are later supported.
-      for (int chunk_ind = 0; chunk_ind < NUM_BLOCKS_PER_CHUNK; ++chunk_ind)
+      for (import_chunk& chunk : chunks)
       {
-        ++h;
-        if ((h-1) % display_interval == 0)
-        {
-          std::cout << refresh_string;
-          LOG_PRINT_L0("loading block number " << h-1);
-        }
-        else
-        {
-          LOG_PRINT_L3("loading block number " << h-1);
-        }
-        b = bp.block;
-        LOG_PRINT_L2("block prev_id: " << b.prev_id << ENDL);
+        h = chunk.height;
+        const bootstrap::block_package& bp = chunk.bp;
 
-        if ((h-1) % progress_interval == 0)
+        int display_interval = 1000;
+        int progress_interval = 10;
+        // NOTE: use of NUM_BLOCKS_PER_CHUNK is a placeholder in case multi-block chunks are later supported.
+        for (int chunk_ind = 0; chunk_ind < NUM_BLOCKS_PER_CHUNK; ++chunk_ind)
         {
-          std::cout << refresh_string << "block " << h-1
-            << " / " << block_stop
-            << std::flush;
-        }
+          ++h;
+          if ((h-1) % display_interval == 0)
+          {
+            std::cout << refresh_string;
+            LOG_PRINT_L0("loading block number " << h-1);
+          }
+          else
+          {
+            LOG_PRINT_L3("loading block number " << h-1);
+          }
+          b = bp.block;
+          LOG_PRINT_L2("block prev_id: " << b.prev_id << ENDL);
 
-        std::vector<transaction> txs;
-        std::vector<transaction> archived_txs;
+          if ((h-1) % progress_interval == 0)
+          {
+            std::cout << refresh_string << "block " << h-1
+              << " / " << block_stop
+              << std::flush;
+          }
 
-        archived_txs = bp.txs;
+          std::vector<transaction> txs;
+          std::vector<transaction> archived_txs;
 
-        // std::cout << refresh_string;
-        // LOG_PRINT_L1("txs: " << archived_txs.size());
+          archived_txs = bp.txs;
 
-        // if archived_txs is invalid
-        // {
-        //   std::cout << refresh_string;
-        //   LOG_PRINT_RED_L0("exception while de-archiving txs, height=" << h);
-        //   quit = 1;
-        //   break;
-        // }
+          // std::cout << refresh_string;
+          // LOG_PRINT_L1("txs: " << archived_txs.size());
 
-        // tx number 1: coinbase tx
-        // tx number 2 onwards: archived_txs
-        unsigned int tx_num = 1;
-        for (const transaction& tx : archived_txs)
-        {
-          ++tx_num;
-          // if tx is invalid
+          // if archived_txs is invalid
           // {
-          //   LOG_PRINT_RED_L0("exception while indexing tx from txs, height=" << h <<", tx_num=" << tx_num);
+          //   std::cout << refresh_string;
+          //   LOG_PRINT_RED_L0("exception while de-archiving txs, height=" << h);
           //   quit = 1;
           //   break;
           // }
 
-          // std::cout << refresh_string;
-          // LOG_PRINT_L1("tx hash: " << get_transaction_hash(tx));
+          // tx number 1: coinbase tx
+          // tx number 2 onwards: archived_txs
+          unsigned int tx_num = 1;
+          for (const transaction& tx : archived_txs)
+          {
+            ++tx_num;
+            // if tx is invalid
+            // {
+            //   LOG_PRINT_RED_L0("exception while indexing tx from txs, height=" << h <<", tx_num=" << tx_num);
+            //   quit = 1;
+            //   break;
+            // }
 
-          // crypto::hash hsh = null_hash;
-          // size_t blob_size = 0;
-          // NOTE: all tx hashes except for coinbase tx are available in the block data
-          // get_transaction_hash(tx, hsh, blob_size);
-          // LOG_PRINT_L0("tx " << tx_num << "  " << hsh << " : " << ENDL);
-          // LOG_PRINT_L0(obj_to_json_str(tx) << ENDL);
+            // std::cout << refresh_string;
+            // LOG_PRINT_L1("tx hash: " << get_transaction_hash(tx));
 
-          // add blocks with verification.
-          // for Blockchain and blockchain_storage add_new_block().
-          if (opt_verify)
-          {
             // crypto::hash hsh = null_hash;
             // size_t blob_size = 0;
+            // NOTE: all tx hashes except for coinbase tx are available in the block data
             // get_transaction_hash(tx, hsh, blob_size);
+            // LOG_PRINT_L0("tx " << tx_num << "  " << hsh << " : " << ENDL);
+            // LOG_PRINT_L0(obj_to_json_str(tx) << ENDL);
 
+            // add blocks with verification.
+            // for Blockchain and blockchain_storage add_new_block().
+            if (opt_verify)
+            {
+              // crypto::hash hsh = null_hash;
+              // size_t blob_size = 0;
+              // get_transaction_hash(tx, hsh, blob_size);
+
+
+              uint8_t version = simple_core.m_storage.get_current_hard_fork_version();
+              tx_verification_context tvc = AUTO_VAL_INIT(tvc);
+              bool r = true;
+              r = simple_core.m_pool.add_tx(tx, tvc, true, true, version);
+              if (!r)
+              {
+                LOG_PRINT_RED_L0("failed to add transaction to transaction pool, height=" << h <<", tx_num=" << tx_num);
+                quit = 1;
+                break;
+              }
+            }
+            else
+            {
+              // for add_block() method, without (much) processing.
+              // don't add coinbase transaction to txs.
+              //
+              // because add_block() calls
+              // add_transaction(blk_hash, blk.miner_tx) first, and
+              // then a for loop for the transactions in txs.
+              txs.push_back(tx);
+            }
+          }
+
+          if (opt_verify)
+          {
+            block_verification_context bvc = boost::value_initialized<block_verification_context>();
+            simple_core.m_storage.add_new_block(b, bvc);
 
-            uint8_t version = simple_core.m_storage.get_current_hard_fork_version();
-            tx_verification_context tvc = AUTO_VAL_INIT(tvc);
-            bool r = true;
-            r = simple_core.m_pool.add_tx(tx, tvc, true, true, version);
-            if (!r)
+            if (bvc.m_verifivation_failed)
             {
-              LOG_PRINT_RED_L0("failed to add transaction to transaction pool, height=" << h <<", tx_num=" << tx_num);
+              LOG_PRINT_L0("Failed to add block to blockchain, verification failed, height = " << h);
+              LOG_PRINT_L0("skipping rest of file");
+              // ok to commit previously batched data because it failed only in
+              // verification of potential new block with nothing added to batch
+              // yet
               quit = 1;
               break;
             }
+            if (! bvc.m_added_to_main_chain)
+            {
+              LOG_PRINT_L0("Failed to add block to blockchain, height = " << h);
+              LOG_PRINT_L0("skipping rest of file");
+              // make sure we don't commit partial block data
+              quit = 2;
+              break;
+            }
           }
           else
           {
-            // for add_block() method, without (much) processing.
-            // don't add coinbase transaction to txs.
-            //
-            // because add_block() calls
-            // add_transaction(blk_hash, blk.miner_tx) first, and
-            // then a for loop for the transactions in txs.
-            txs.push_back(tx);
-          }
-        }
-
-        if (opt_verify)
-        {
-          block_verification_context bvc = boost::value_initialized<block_verification_context>();
-          simple_core.m_storage.add_new_block(b, bvc);
-
-          if (bvc.m_verifivation_failed)
-          {
-            LOG_PRINT_L0("Failed to add block to blockchain, verification failed, height = " << h);
-            LOG_PRINT_L0("skipping rest of file");
-            // ok to commit previously batched data because it failed only in
-            // verification of potential new block with nothing added to batch
-            // yet
-            quit = 1;
-            break;
-          }
-          if (! bvc.m_added_to_main_chain)
-          {
-            LOG_PRINT_L0("Failed to add block to blockchain, height = " << h);
-            LOG_PRINT_L0("skipping rest of file");
-            // make sure we don't commit partial block data
-            quit = 2;
-            break;
-          }
-        }
-        else
-        {
-          size_t block_size;
-          difficulty_type cumulative_difficulty;
-          uint64_t coins_generated;
+            size_t block_size;
+            difficulty_type cumulative_difficulty;
+            uint64_t coins_generated;
 
-          block_size = bp.block_size;
-          cumulative_difficulty = bp.cumulative_difficulty;
-          coins_generated = bp.coins_generated;
+            block_size = bp.block_size;
+            cumulative_difficulty = bp.cumulative_difficulty;
+            coins_generated = bp.coins_generated;
 
-          // std::cout << refresh_string;
-          // LOG_PRINT_L2("block_size: " << block_size);
-          // LOG_PRINT_L2("cumulative_difficulty: " << cumulative_difficulty);
-          // LOG_PRINT_L2("coins_generated: " << coins_generated);
+            // std::cout << refresh_string;
+            // LOG_PRINT_L2("block_size: " << block_size);
+            // LOG_PRINT_L2("cumulative_difficulty: " << cumulative_difficulty);
+            // LOG_PRINT_L2("coins_generated: " << coins_generated);
 
-          try
-          {
-            simple_core.add_block(b, block_size, cumulative_difficulty, coins_generated, txs);
-          }
-          catch (const std::exception& e)
-          {
-            std::cout << refresh_string;
-            LOG_PRINT_RED_L0("Error adding block to blockchain: " << e.what());
-            quit = 2; // make sure we don't commit partial block data
-            break;
+            try
+            {
+              simple_core.add_block(b, block_size, cumulative_difficulty, coins_generated, txs);
+            }
+            catch (const std::exception& e)
+            {
+              std::cout << refresh_string;
+              LOG_PRINT_RED_L0("Error adding block to blockchain: " << e.what());
+              quit = 2; // make sure we don't commit partial block data
+              break;
+            }
           }
-        }
-        ++num_imported;
+          ++num_imported;
 
-        if (use_batch)
-        {
-          if ((h-1) % db_batch_size == 0)
+          if (use_batch)
           {
-            std::cout << refresh_string;
-            // zero-based height
-            std::cout << ENDL << "[- batch commit at height " << h-1 << " -]" << ENDL;
-            simple_core.batch_stop();
-            simple_core.batch_start(db_batch_size);
-            std::cout << ENDL;
-            simple_core.m_storage.get_db().show_stats();
+            if ((h-1) % db_batch_size == 0)
+            {
+              std::cout << refresh_string;
+              // zero-based height
+              std::cout << ENDL << "[- batch commit at height " << h-1 << " -]" << ENDL;
+              simple_core.batch_stop();
+              simple_core.batch_start(db_batch_size);
+              std::cout << ENDL;
+              simple_core.m_storage.get_db().show_stats();
+            }
           }
         }
+        if (quit)
+          break;
       }
     }
     catch (const std::exception& e)
     {
       std::cout << refresh_string;
-      LOG_PRINT_RED_L0("exception while reading from file, height=" << h << ": " << e.what());
-      return 2;
+      LOG_PRINT_RED_L0("exception while importing block, height=" << h << ": " << e.what());
+      quit = 2;
+      failed = true;
     }
+
+    if (opt_verify)
+      simple_core.m_storage.cleanup_handle_incoming_blocks();
   } // while
 
+  // stops the reader if we quit early
+  chunk_queue.close();
+  reader.join();
   import_file.close();
 
+  // on error, return without committing; the destructor aborts the write txn
+  if (failed || read_status)
+    return 2;
+
   if (use_batch)
   {
     if (quit > 1)
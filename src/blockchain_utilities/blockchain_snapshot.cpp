@@ -0,0 +1,135 @@
+// Copyright (c) 2014-2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <boost/filesystem.hpp>
+#include "common/command_line.h"
+#include "common/util.h"
+#include "include_base_utils.h"
+#include "misc_os_dependent.h"
+#include "blockchain_db/lmdb/db_lmdb.h"
+#include "version.h"
+
+#include <lmdb.h> // for db flag arguments
+
+namespace po = boost::program_options;
+using namespace epee; // log_space
+using namespace cryptonote;
+
+int main(int argc, char* argv[])
+{
+  tools::sanitize_locale();
+
+  boost::filesystem::path default_data_path {tools::get_default_data_dir()};
+  boost::filesystem::path default_testnet_data_path {default_data_path / "testnet"};
+
+  po::options_description desc_options("Allowed options");
+  const command_line::arg_descriptor<std::string> arg_output_dir = {"output-dir", "Directory to write the compacted copy of the database into"};
+  const command_line::arg_descriptor<uint64_t> arg_max_rate = {"max-rate", "Maximum write rate in kB/s, 0 for no limit", 0};
+  const command_line::arg_descriptor<bool> arg_testnet_on = {"testnet", "Run on testnet.", false};
+  const command_line::arg_descriptor<uint32_t> arg_log_level = {"log-level", "", LOG_LEVEL_0};
+
+  command_line::add_arg(desc_options, command_line::arg_data_dir, default_data_path.string());
+  command_line::add_arg(desc_options, command_line::arg_testnet_data_dir, default_testnet_data_path.string());
+  command_line::add_arg(desc_options, arg_output_dir);
+  command_line::add_arg(desc_options, arg_max_rate);
+  command_line::add_arg(desc_options, arg_testnet_on);
+  command_line::add_arg(desc_options, arg_log_level);
+  command_line::add_arg(desc_options, command_line::arg_help);
+
+  po::variables_map vm;
+  bool r = command_line::handle_error_helper(desc_options, [&]()
+  {
+    po::store(po::parse_command_line(argc, argv, desc_options), vm);
+    po::notify(vm);
+    return true;
+  });
+  if (!r)
+    return 1;
+
+  if (command_line::get_arg(vm, command_line::arg_help))
+  {
+    std::cout << "Monero '" << MONERO_RELEASE_NAME << "' (v" << MONERO_VERSION_FULL << ")" << ENDL << ENDL;
+    std::cout << desc_options << std::endl;
+    return 1;
+  }
+
+  log_space::get_set_log_detalisation_level(true, command_line::get_arg(vm, arg_log_level));
+  log_space::log_singletone::add_logger(LOGGER_CONSOLE, NULL, NULL);
+
+  const std::string output_dir = command_line::get_arg(vm, arg_output_dir);
+  if (output_dir.empty())
+  {
+    std::cerr << "--output-dir is required" << std::endl;
+    return 1;
+  }
+  const bool opt_testnet = command_line::get_arg(vm, arg_testnet_on);
+  const std::string data_dir = command_line::get_arg(vm, opt_testnet ? command_line::arg_testnet_data_dir : command_line::arg_data_dir);
+  const uint64_t max_rate = command_line::get_arg(vm, arg_max_rate) * 1000;
+
+  // the daemon may keep running and syncing while we copy
+  std::unique_ptr<BlockchainDB> db(new BlockchainLMDB());
+  const std::string filename = (boost::filesystem::path(data_dir) / db->get_db_name()).string();
+  LOG_PRINT_L0("Loading blockchain from folder " << filename << " ...");
+  try
+  {
+    db->open(filename, MDB_RDONLY);
+  }
+  catch (const std::exception& e)
+  {
+    LOG_ERROR("Error opening database: " << e.what());
+    return 1;
+  }
+
+  LOG_PRINT_L0("Copying compacted database to " << output_dir);
+  const uint64_t start = epee::misc_utils::get_tick_count();
+  unsigned last_percent = 101;
+  try
+  {
+    db->copy_snapshot(output_dir, max_rate, [&last_percent](uint64_t written, uint64_t total) {
+      const unsigned percent = total ? std::min<uint64_t>(100, written * 100 / total) : 0;
+      if (percent != last_percent)
+      {
+        std::cout << "\r" << written << "/" << total << " bytes (" << percent << "%)" << std::flush;
+        last_percent = percent;
+      }
+      return true;
+    });
+    std::cout << std::endl;
+  }
+  catch (const std::exception &e)
+  {
+    std::cout << std::endl;
+    LOG_ERROR("Error copying the db: " << e.what());
+    db->close();
+    return 1;
+  }
+
+  LOG_PRINT_L0("Done in " << (epee::misc_utils::get_tick_count() - start) / 1000.0 << " s");
+  db->close();
+  return 0;
+}
@@ -0,0 +1,280 @@
+// Copyright (c) 2014-2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <map>
+#include <boost/filesystem.hpp>
+#include "common/command_line.h"
+#include "common/util.h"
+#include "cryptonote_core/cryptonote_format_utils.h"
+#include "include_base_utils.h"
+#include "misc_os_dependent.h"
+#include "blockchain_db/lmdb/db_lmdb.h"
+#if defined(BERKELEY_DB)
+#include "blockchain_db/berkeleydb/db_bdb.h"
+#endif
+#include "version.h"
+
+#include <lmdb.h> // for db flag arguments
+
+namespace po = boost::program_options;
+using namespace epee; // log_space
+using namespace cryptonote;
+
+namespace
+{
+
+// what each shard counts, added up once all shards are done
+struct tx_stats
+{
+  uint64_t txs = 0;
+  uint64_t rct_txs = 0;
+  uint64_t inputs = 0;
+  uint64_t outputs = 0;
+  std::map<size_t, uint64_t> ring_sizes;
+
+  void add(const tx_stats &other)
+  {
+    txs += other.txs;
+    rct_txs += other.rct_txs;
+    inputs += other.inputs;
+    outputs += other.outputs;
+    for (const auto &rs: other.ring_sizes)
+      ring_sizes[rs.first] += rs.second;
+  }
+};
+
+struct block_stats
+{
+  uint64_t blocks = 0;
+  uint64_t txs = 0;
+  uint64_t coinbase = 0;
+  uint64_t max_timestamp = 0;
+
+  void add(const block_stats &other)
+  {
+    blocks += other.blocks;
+    txs += other.txs;
+    coinbase += other.coinbase;
+    max_timestamp = std::max(max_timestamp, other.max_timestamp);
+  }
+};
+
+struct output_stats
+{
+  uint64_t rct_outputs = 0;
+  uint64_t pre_rct_outputs = 0;
+  std::map<uint64_t, uint64_t> per_amount;
+
+  void add(const output_stats &other)
+  {
+    rct_outputs += other.rct_outputs;
+    pre_rct_outputs += other.pre_rct_outputs;
+    for (const auto &pa: other.per_amount)
+      per_amount[pa.first] += pa.second;
+  }
+};
+
+template<typename T>
+T merge(const std::vector<T> &shards)
+{
+  T total;
+  for (const auto &s: shards)
+    total.add(s);
+  return total;
+}
+
+void print_pass(const char *name, uint64_t items, uint64_t ms)
+{
+  std::cout << name << ": " << items << " in " << ms / 1000.0 << " s";
+  if (ms)
+    std::cout << " (" << items * 1000 / ms << "/s)";
+  std::cout << std::endl;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+  tools::sanitize_locale();
+
+  boost::filesystem::path default_data_path {tools::get_default_data_dir()};
+  boost::filesystem::path default_testnet_data_path {default_data_path / "testnet"};
+
+  po::options_description desc_options("Allowed options");
+  const command_line::arg_descriptor<std::string> arg_database = {"database", "Database type", "lmdb"};
+  const command_line::arg_descriptor<unsigned> arg_threads = {"threads", "Number of shards walked in parallel, 0 for one per CPU", 0};
+  const command_line::arg_descriptor<bool> arg_testnet_on = {"testnet", "Run on testnet.", false};
+  const command_line::arg_descriptor<uint32_t> arg_log_level = {"log-level", "", LOG_LEVEL_0};
+
+  command_line::add_arg(desc_options, command_line::arg_data_dir, default_data_path.string());
+  command_line::add_arg(desc_options, command_line::arg_testnet_data_dir, default_testnet_data_path.string());
+  command_line::add_arg(desc_options, arg_database);
+  command_line::add_arg(desc_options, arg_threads);
+  command_line::add_arg(desc_options, arg_testnet_on);
+  command_line::add_arg(desc_options, arg_log_level);
+  command_line::add_arg(desc_options, command_line::arg_help);
+
+  po::variables_map vm;
+  bool r = command_line::handle_error_helper(desc_options, [&]()
+  {
+    po::store(po::parse_command_line(argc, argv, desc_options), vm);
+    po::notify(vm);
+    return true;
+  });
+  if (!r)
+    return 1;
+
+  if (command_line::get_arg(vm, command_line::arg_help))
+  {
+    std::cout << "Monero '" << MONERO_RELEASE_NAME << "' (v" << MONERO_VERSION_FULL << ")" << ENDL << ENDL;
+    std::cout << desc_options << std::endl;
+    return 1;
+  }
+
+  log_space::get_set_log_detalisation_level(true, command_line::get_arg(vm, arg_log_level));
+  log_space::log_singletone::add_logger(LOGGER_CONSOLE, NULL, NULL);
+
+  const bool opt_testnet = command_line::get_arg(vm, arg_testnet_on);
+  const std::string data_dir = command_line::get_arg(vm, opt_testnet ? command_line::arg_testnet_data_dir : command_line::arg_data_dir);
+  const std::string db_type = command_line::get_arg(vm, arg_database);
+  unsigned shards = command_line::get_arg(vm, arg_threads);
+  if (shards == 0)
+    shards = std::max(1u, tools::get_max_concurrency());
+
+  std::unique_ptr<BlockchainDB> db;
+  int db_flags = 0;
+  if (db_type == "lmdb")
+  {
+    db.reset(new BlockchainLMDB());
+    db_flags = MDB_RDONLY;
+  }
+#if defined(BERKELEY_DB)
+  else if (db_type == "berkeley")
+    db.reset(new BlockchainBDB());
+#endif
+  else
+  {
+    std::cerr << "Invalid database type: " << db_type << std::endl;
+    return 1;
+  }
+
+  const std::string filename = (boost::filesystem::path(data_dir) / db->get_db_name()).string();
+  LOG_PRINT_L0("Loading blockchain from folder " << filename << " ...");
+  try
+  {
+    db->open(filename, db_flags);
+  }
+  catch (const std::exception& e)
+  {
+    LOG_ERROR("Error opening database: " << e.what());
+    return 1;
+  }
+  LOG_PRINT_L0("Walking the db in " << shards << " shards");
+
+  try
+  {
+    uint64_t start = epee::misc_utils::get_tick_count();
+    std::vector<block_stats> bs(shards);
+    db->for_all_blocks_parallel(shards, [&bs](unsigned shard, uint64_t height, const crypto::hash&, const block &b) {
+      block_stats &s = bs[shard];
+      ++s.blocks;
+      s.txs += b.tx_hashes.size();
+      for (const auto &o: b.miner_tx.vout)
+        s.coinbase += o.amount;
+      s.max_timestamp = std::max(s.max_timestamp, b.timestamp);
+      return true;
+    });
+    const block_stats blocks = merge(bs);
+    print_pass("Blocks", blocks.blocks, epee::misc_utils::get_tick_count() - start);
+
+    start = epee::misc_utils::get_tick_count();
+    std::vector<tx_stats> ts(shards);
+    db->for_all_transactions_parallel(shards, [&ts](unsigned shard, const crypto::hash&, const transaction &tx) {
+      tx_stats &s = ts[shard];
+      ++s.txs;
+      if (tx.version >= 2)
+        ++s.rct_txs;
+      s.outputs += tx.vout.size();
+      for (const auto &in: tx.vin)
+      {
+        if (in.type() != typeid(txin_to_key))
+          continue;
+        ++s.inputs;
+        ++s.ring_sizes[boost::get<txin_to_key>(in).key_offsets.size()];
+      }
+      return true;
+    });
+    const tx_stats txs = merge(ts);
+    print_pass("Transactions", txs.txs, epee::misc_utils::get_tick_count() - start);
+
+    start = epee::misc_utils::get_tick_count();
+    std::vector<uint64_t> ks(shards, 0);
+    db->for_all_key_images_parallel(shards, [&ks](unsigned shard, const crypto::key_image&) {
+      ++ks[shard];
+      return true;
+    });
+    uint64_t key_images = 0;
+    for (uint64_t k: ks)
+      key_images += k;
+    print_pass("Key images", key_images, epee::misc_utils::get_tick_count() - start);
+
+    start = epee::misc_utils::get_tick_count();
+    std::vector<output_stats> os(shards);
+    db->for_all_outputs_parallel(shards, [&os](unsigned shard, uint64_t amount, const crypto::hash&, size_t) {
+      output_stats &s = os[shard];
+      if (amount == 0)
+        ++s.rct_outputs;
+      else
+        ++s.pre_rct_outputs;
+      ++s.per_amount[amount];
+      return true;
+    });
+    const output_stats outputs = merge(os);
+    print_pass("Outputs", outputs.rct_outputs + outputs.pre_rct_outputs, epee::misc_utils::get_tick_count() - start);
+
+    std::cout << std::endl;
+    std::cout << "Height: " << blocks.blocks << ", last block at " << blocks.max_timestamp << std::endl;
+    std::cout << "Coinbase emission: " << print_money(blocks.coinbase) << std::endl;
+    std::cout << "Transactions: " << txs.txs << " (" << txs.rct_txs << " RingCT), " << blocks.txs << " excluding coinbase" << std::endl;
+    std::cout << "Inputs: " << txs.inputs << ", outputs: " << txs.outputs << std::endl;
+    std::cout << "Key images: " << key_images << std::endl;
+    std::cout << "Outputs: " << outputs.rct_outputs << " RingCT, " << outputs.pre_rct_outputs << " in " << outputs.per_amount.size() - (outputs.rct_outputs ? 1 : 0) << " pre-RingCT amounts" << std::endl;
+    std::cout << "Ring sizes:" << std::endl;
+    for (const auto &rs: txs.ring_sizes)
+      std::cout << "  " << rs.first << ": " << rs.second << std::endl;
+  }
+  catch (const std::exception &e)
+  {
+    LOG_ERROR("Error walking the db: " << e.what());
+    db->close();
+    return 1;
+  }
+
+  db->close();
+  return 0;
+}
@@ -0,0 +1,440 @@
+// Copyright (c) 2014-2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Initial sync benchmark: a node serving a chain from a local database, or
+// from a bootstrap file loaded into a temporary one, and a fresh node syncing
+// from it over the loopback, both in this process and both running the real
+// core, protocol and p2p code. The fresh node is only connected to the
+// serving one, so the numbers depend on the build and the hardware, not on
+// live peers.
+
+#include <iomanip>
+#include <fstream>
+#include <boost/filesystem.hpp>
+#include <boost/thread/thread.hpp>
+#include "rapidjson/writer.h"
+#include "rapidjson/stringbuffer.h"
+
+#include "bootstrap_file.h"
+#include "fake_core.h"
+#include "common/command_line.h"
+#include "common/util.h"
+#include "cryptonote_core/cryptonote_core.h"
+#include "cryptonote_protocol/cryptonote_protocol_handler.h"
+#include "p2p/net_node.h"
+#include "misc_language.h"
+#include "version.h"
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+namespace po = boost::program_options;
+using namespace epee; // log_space
+
+namespace
+{
+
+typedef cryptonote::t_cryptonote_protocol_handler<cryptonote::core> protocol_type;
+typedef nodetool::node_server<protocol_type> server_type;
+
+struct node
+{
+  node(): core(nullptr), protocol(core, nullptr), server(protocol)
+  {
+    protocol.set_p2p_endpoint(&server);
+    core.set_cryptonote_protocol(&protocol);
+  }
+
+  cryptonote::core core;
+  protocol_type protocol;
+  server_type server;
+  boost::thread thread;
+};
+
+// the p2p side of a node, listening on the loopback and only connecting to
+// the given peer
+po::variables_map p2p_options(bool testnet, const std::string &config_dir, uint32_t port, const std::string &peer)
+{
+  std::vector<std::string> args = {
+    "--p2p-bind-ip", "127.0.0.1",
+    testnet ? "--testnet-p2p-bind-port" : "--p2p-bind-port", std::to_string(port),
+    testnet ? "--testnet-data-dir" : "--data-dir", config_dir,
+    "--add-exclusive-node", peer,
+    "--no-igd",
+    "--hide-my-port"
+  };
+  if (testnet)
+    args.push_back("--testnet");
+
+  po::options_description desc;
+  command_line::add_arg(desc, command_line::arg_testnet_on);
+  command_line::add_arg(desc, command_line::arg_data_dir, config_dir);
+  command_line::add_arg(desc, command_line::arg_testnet_data_dir, config_dir);
+  server_type::init_options(desc);
+  po::variables_map vm;
+  po::store(po::command_line_parser(args).options(desc).run(), vm);
+  po::notify(vm);
+  return vm;
+}
+
+// loads a bootstrap file into a new database without verifying it, as
+// blockchain_import --verify 0 does
+bool load_bootstrap(const std::string &input_file, const boost::filesystem::path &data_dir, bool testnet)
+{
+  BootstrapFile bootstrap;
+  std::ifstream import_file(input_file, std::ios_base::binary | std::ifstream::in);
+  if (import_file.fail())
+  {
+    LOG_ERROR("Failed to open " << input_file);
+    return false;
+  }
+  bootstrap.seek_to_first_chunk(import_file);
+
+  fake_core_db core(data_dir, testnet, true, "lmdb", MDB_NOSYNC | MDB_WRITEMAP | MDB_MAPASYNC);
+  const uint64_t batch_size = 1000;
+  core.batch_start(batch_size);
+  for (uint64_t height = 0; ; ++height)
+  {
+    bootstrap::block_package bp;
+    const int r = bootstrap.read_chunk(import_file, bp);
+    if (r == 1)
+      break;
+    if (r)
+    {
+      core.batch_stop();
+      return false;
+    }
+    // the genesis block is already in
+    if (height < core.m_storage.get_current_blockchain_height())
+      continue;
+    core.add_block(bp.block, bp.block_size, bp.cumulative_difficulty, bp.coins_generated, bp.txs);
+    if (height % batch_size == 0)
+    {
+      core.batch_stop();
+      std::cout << "\rloaded block " << height << std::flush;
+      core.batch_start(batch_size);
+    }
+  }
+  core.batch_stop();
+  std::cout << std::endl;
+  return true;
+}
+
+uint64_t peak_rss_bytes()
+{
+#ifndef _WIN32
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0)
+  {
+#ifdef __APPLE__
+    return usage.ru_maxrss;
+#else
+    return usage.ru_maxrss * 1024;
+#endif
+  }
+#endif
+  return 0;
+}
+
+// what the syncing node has done so far
+struct sync_point
+{
+  uint64_t height;
+  uint64_t elapsed_ms;
+  uint64_t bytes;
+  uint64_t peak_rss;
+  uint64_t phase_us[cryptonote::block_processing_phases];
+};
+
+sync_point sample(node &n, uint64_t start_ms, uint64_t bytes_of_closed)
+{
+  sync_point p;
+  p.height = n.core.get_current_blockchain_height();
+  p.elapsed_ms = misc_utils::get_tick_count() - start_ms;
+  // the connection to the serving node may be dropped and made again, its
+  // byte count goes with it
+  p.bytes = 0;
+  for (const auto &c: n.protocol.get_connections())
+    p.bytes += c.recv_count;
+  p.bytes += bytes_of_closed;
+  p.peak_rss = peak_rss_bytes();
+  const cryptonote::block_processing_stats stats = n.core.get_blockchain_storage().get_block_processing_stats();
+  for (unsigned phase = 0; phase < cryptonote::block_processing_phases; ++phase)
+    p.phase_us[phase] = stats.get_cumulative_us((cryptonote::block_processing_phase)phase);
+  return p;
+}
+
+void print_header()
+{
+  std::cout << std::setw(10) << "height" << std::setw(10) << "seconds" << std::setw(10) << "blocks/s" << std::setw(10) << "MB/s"
+            << std::setw(8) << "pow%" << std::setw(8) << "sigs%" << std::setw(8) << "db%" << std::setw(9) << "other%" << std::setw(8) << "wait%"
+            << std::setw(10) << "peak MB" << std::endl;
+}
+
+// the rates and the share of the wall time in each phase between two points;
+// wait is the time no block was being added: downloading, preparing the
+// next blocks, or idle
+void print_interval(const sync_point &from, const sync_point &to)
+{
+  using namespace cryptonote;
+  const double seconds = std::max<uint64_t>(to.elapsed_ms - from.elapsed_ms, 1) / 1000.0;
+  auto share = [&](uint64_t us) { return 100.0 * us / 1e6 / seconds; };
+  auto phase = [&](block_processing_phase p) { return to.phase_us[p] - from.phase_us[p]; };
+  const uint64_t total = phase(bpp_total), pow = phase(bpp_pow), sigs = phase(bpp_tx_check), db = phase(bpp_db_add);
+  const uint64_t known = pow + sigs + db;
+  std::cout << std::fixed << std::setprecision(1)
+            << std::setw(10) << to.height << std::setw(10) << to.elapsed_ms / 1000.0
+            << std::setw(10) << (to.height - from.height) / seconds
+            << std::setw(10) << (to.bytes - from.bytes) / seconds / 1e6
+            << std::setw(8) << share(pow) << std::setw(8) << share(sigs) << std::setw(8) << share(db)
+            << std::setw(9) << share(total > known ? total - known : 0)
+            << std::setw(8) << std::max(0.0, 100.0 - share(total))
+            << std::setw(10) << to.peak_rss / 1048576 << std::endl;
+}
+
+void write_point(rapidjson::Writer<rapidjson::StringBuffer> &w, const sync_point &p)
+{
+  w.StartObject();
+  w.Key("height"); w.Uint64(p.height);
+  w.Key("elapsed_ms"); w.Uint64(p.elapsed_ms);
+  w.Key("bytes"); w.Uint64(p.bytes);
+  w.Key("peak_rss"); w.Uint64(p.peak_rss);
+  w.Key("phases_us");
+  w.StartObject();
+  for (unsigned phase = 0; phase < cryptonote::block_processing_phases; ++phase)
+  {
+    w.Key(cryptonote::block_processing_stats::get_phase_name((cryptonote::block_processing_phase)phase));
+    w.Uint64(p.phase_us[phase]);
+  }
+  w.EndObject();
+  w.EndObject();
+}
+
+} // anonymous namespace
+
+BOOST_CLASS_VERSION(server_type, 1);
+
+int main(int argc, char* argv[])
+{
+  tools::sanitize_locale();
+
+  po::options_description desc_cmd_only("Command line options");
+  po::options_description desc_cmd_sett("Command line options and settings options");
+  const command_line::arg_descriptor<std::string> arg_source_dir = {"source-dir", "Data directory of the chain to serve", ""};
+  const command_line::arg_descriptor<std::string> arg_input_file = {"input-file", "Bootstrap file to serve instead, loaded into a temporary database first", ""};
+  const command_line::arg_descriptor<uint64_t> arg_stop_height = {"stop-height", "Stop once the syncing node reaches this height, 0 for the whole chain", 0};
+  const command_line::arg_descriptor<uint64_t> arg_milestone = {"milestone", "Report every this many blocks", 10000};
+  const command_line::arg_descriptor<unsigned> arg_stall_timeout = {"stall-timeout", "Give up after this many seconds without a new block", 300};
+  const command_line::arg_descriptor<uint32_t> arg_port = {"port", "Loopback port of the serving node, the syncing one takes the next", 48180};
+  const command_line::arg_descriptor<std::string> arg_output_file = {"output-file", "Also write the milestones as JSON here", ""};
+  const command_line::arg_descriptor<uint32_t> arg_log_level = {"log-level", "", LOG_LEVEL_0};
+
+  command_line::add_arg(desc_cmd_sett, arg_source_dir);
+  command_line::add_arg(desc_cmd_sett, arg_input_file);
+  command_line::add_arg(desc_cmd_sett, arg_stop_height);
+  command_line::add_arg(desc_cmd_sett, arg_milestone);
+  command_line::add_arg(desc_cmd_sett, arg_stall_timeout);
+  command_line::add_arg(desc_cmd_sett, arg_port);
+  command_line::add_arg(desc_cmd_sett, arg_output_file);
+  command_line::add_arg(desc_cmd_sett, arg_log_level);
+  // the syncing node's options; it syncs into a temporary directory unless
+  // --data-dir is given
+  cryptonote::core::init_options(desc_cmd_sett);
+  command_line::add_arg(desc_cmd_only, command_line::arg_help);
+
+  po::options_description desc_options("Allowed options");
+  desc_options.add(desc_cmd_only).add(desc_cmd_sett);
+
+  po::variables_map vm;
+  bool r = command_line::handle_error_helper(desc_options, [&]()
+  {
+    po::store(po::parse_command_line(argc, argv, desc_options), vm);
+    po::notify(vm);
+    return true;
+  });
+  if (!r)
+    return 1;
+
+  const std::string source_dir = command_line::get_arg(vm, arg_source_dir);
+  const std::string input_file = command_line::get_arg(vm, arg_input_file);
+  if (command_line::get_arg(vm, command_line::arg_help) || source_dir.empty() == input_file.empty())
+  {
+    std::cout << "Monero '" << MONERO_RELEASE_NAME << "' (v" << MONERO_VERSION_FULL << ")" << ENDL << ENDL;
+    std::cout << "Give one of --" << arg_source_dir.name << " and --" << arg_input_file.name << ENDL << ENDL;
+    std::cout << desc_options << std::endl;
+    return 1;
+  }
+
+  log_space::get_set_log_detalisation_level(true, command_line::get_arg(vm, arg_log_level));
+  log_space::log_singletone::add_logger(LOGGER_CONSOLE, NULL, NULL);
+
+  const bool testnet = command_line::get_arg(vm, command_line::arg_testnet_on);
+  const uint32_t port = command_line::get_arg(vm, arg_port);
+  const uint64_t milestone = std::max<uint64_t>(command_line::get_arg(vm, arg_milestone), 1);
+  const unsigned stall_timeout = command_line::get_arg(vm, arg_stall_timeout);
+  const auto &data_dir_arg = testnet ? command_line::arg_testnet_data_dir : command_line::arg_data_dir;
+
+  // everything temporary goes here, and is removed at the end
+  const boost::filesystem::path work_dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("monero-sync-benchmark-%%%%-%%%%");
+  boost::system::error_code ec;
+  boost::filesystem::create_directories(work_dir, ec);
+  epee::misc_utils::auto_scope_leave_caller cleanup = epee::misc_utils::create_scope_leave_handler([&work_dir]() {
+    boost::system::error_code ec;
+    boost::filesystem::remove_all(work_dir, ec);
+  });
+
+  std::string serve_dir = source_dir;
+  if (!input_file.empty())
+  {
+    serve_dir = (work_dir / "source").string();
+    LOG_PRINT_L0("Loading " << input_file << " into " << serve_dir);
+    try
+    {
+      if (!load_bootstrap(input_file, serve_dir, testnet))
+        return 1;
+    }
+    catch (const std::exception &e)
+    {
+      LOG_ERROR("Failed to load " << input_file << ": " << e.what());
+      return 1;
+    }
+  }
+
+  // the serving node takes the syncing node's options but its own directory,
+  // and connects to itself only, which it drops, so it never dials out
+  po::variables_map source_vm = vm;
+  source_vm.at(data_dir_arg.name).value() = serve_dir;
+  po::variables_map target_vm = vm;
+  if (vm[data_dir_arg.name].defaulted())
+    target_vm.at(data_dir_arg.name).value() = (work_dir / "target").string();
+  const std::string source_address = "127.0.0.1:" + std::to_string(port);
+
+  node source, target;
+  if (!source.server.init(p2p_options(testnet, (work_dir / "source-p2p").string(), port, source_address)) ||
+      !source.protocol.init(source_vm) || !source.core.init(source_vm))
+  {
+    LOG_ERROR("Failed to start the serving node");
+    return 1;
+  }
+  const uint64_t source_height = source.core.get_current_blockchain_height();
+  uint64_t stop_height = command_line::get_arg(vm, arg_stop_height);
+  if (!stop_height || stop_height > source_height)
+    stop_height = source_height;
+
+  if (!target.server.init(p2p_options(testnet, (work_dir / "target-p2p").string(), port + 1, source_address)) ||
+      !target.protocol.init(target_vm) || !target.core.init(target_vm))
+  {
+    LOG_ERROR("Failed to start the syncing node");
+    return 1;
+  }
+  LOG_PRINT_L0("Syncing from height " << target.core.get_current_blockchain_height() << " to " << stop_height);
+
+  const uint64_t start_ms = misc_utils::get_tick_count();
+  source.thread = boost::thread([&source]() { source.server.run(); });
+  target.thread = boost::thread([&target]() { target.server.run(); });
+
+  uint64_t bytes_of_closed = 0, last_bytes = 0;
+  std::vector<sync_point> points;
+  sync_point last = sample(target, start_ms, bytes_of_closed);
+  points.push_back(last);
+  sync_point previous_milestone = last;
+  uint64_t last_progress_ms = last.elapsed_ms;
+  bool stalled = false;
+  print_header();
+  while (last.height < stop_height)
+  {
+    boost::this_thread::sleep_for(boost::chrono::seconds(1));
+    sync_point p = sample(target, start_ms, bytes_of_closed);
+    if (p.bytes < last_bytes)
+    {
+      p.bytes += last_bytes - bytes_of_closed;
+      bytes_of_closed = last_bytes;
+    }
+    last_bytes = p.bytes;
+    if (p.height > last.height)
+      last_progress_ms = p.elapsed_ms;
+    else if (p.elapsed_ms - last_progress_ms > stall_timeout * 1000ull)
+    {
+      LOG_ERROR("No new block for " << stall_timeout << " seconds, giving up");
+      stalled = true;
+      break;
+    }
+    if (p.height / milestone > previous_milestone.height / milestone || p.height >= stop_height)
+    {
+      print_interval(previous_milestone, p);
+      points.push_back(p);
+      previous_milestone = p;
+    }
+    last = p;
+  }
+
+  std::cout << "total:" << std::endl;
+  print_interval(points.front(), last);
+  if (last.height > points.back().height)
+    points.push_back(last);
+
+  source.server.send_stop_signal();
+  target.server.send_stop_signal();
+  source.thread.join();
+  target.thread.join();
+  for (node *n: {&target, &source})
+  {
+    n->server.deinit();
+    n->protocol.deinit();
+    n->core.deinit();
+    n->core.set_cryptonote_protocol(nullptr);
+  }
+
+  const std::string output_file = command_line::get_arg(vm, arg_output_file);
+  if (!output_file.empty())
+  {
+    rapidjson::StringBuffer sb;
+    rapidjson::Writer<rapidjson::StringBuffer> w(sb);
+    w.StartObject();
+    w.Key("version"); w.String(MONERO_VERSION_FULL);
+    w.Key("source_height"); w.Uint64(source_height);
+    w.Key("stalled"); w.Bool(stalled);
+    w.Key("milestones");
+    w.StartArray();
+    for (const auto &p: points)
+      write_point(w, p);
+    w.EndArray();
+    w.EndObject();
+    std::ofstream out(output_file);
+    out << sb.GetString() << std::endl;
+    if (!out)
+    {
+      LOG_ERROR("Failed to write " << output_file);
+      return 1;
+    }
+  }
+
+  epee::net_utils::data_logger::get_instance().kill_instance();
+  return stalled ? 1 : 0;
+}
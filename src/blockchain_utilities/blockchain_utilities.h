@@ -35,5 +35,12 @@
 // should be a sensible maximum
 #define BUFFER_SIZE 1000000
 #define NUM_BLOCKS_PER_CHUNK 1
+// blocks between entries of a bootstrap file's chunk index
+#define BOOTSTRAP_INDEX_INTERVAL 1000
+#define BOOTSTRAP_INDEX_SUFFIX ".index"
+// from this file_info minor version on, each chunk is followed by its hash
+#define BOOTSTRAP_CHECKSUM_MINOR_VERSION 2
+// blocks serialized in parallel before being written out in order
+#define BOOTSTRAP_EXPORT_BATCH 256
 #define BLOCKCHAIN_RAW "blockchain.raw"
 
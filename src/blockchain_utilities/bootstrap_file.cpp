@@ -29,6 +29,8 @@
 #include "bootstrap_serialization.h"
 #include "serialization/binary_utils.h" // dump_binary(), parse_binary()
 #include "serialization/json_utils.h" // dump_json()
+#include "file_io_utils.h"
+#include "common/task_region.h"
 
 #include "bootstrap_file.h"
 
@@ -88,6 +90,9 @@ bool BootstrapFile::open_writer(const boost::filesystem::path& file_path)
   {
     num_blocks = count_blocks(file_path.string());
     LOG_PRINT_L0("appending to existing file with height: " << num_blocks-1 << "  total blocks: " << num_blocks);
+    // new chunks must match the format the file was started with
+    std::ifstream existing_file(file_path.string(), std::ios_base::binary | std::ifstream::in);
+    seek_to_first_chunk(existing_file);
   }
   m_height = num_blocks;
 
@@ -123,8 +128,9 @@ bool BootstrapFile::initialize_file()
 
   bootstrap::file_info bfi;
   bfi.major_version = 0;
-  bfi.minor_version = 1;
+  bfi.minor_version = BOOTSTRAP_CHECKSUM_MINOR_VERSION;
   bfi.header_size = header_size;
+  m_chunk_checksums = true;
 
   bootstrap::blocks_info bbi;
   bbi.block_first = 0;
@@ -199,6 +205,14 @@ void BootstrapFile::flush_chunk()
     LOG_PRINT_RED_L0("Error writing chunk:  height: " << m_cur_height << "  chunk_size: " << chunk_size << "  num chars written: " << num_chars_written);
     throw std::runtime_error("Error writing chunk");
   }
+  if (m_chunk_checksums)
+  {
+    const crypto::hash checksum = crypto::cn_fast_hash(m_buffer.data(), m_buffer.size());
+    m_raw_data_file->write(checksum.data, sizeof(checksum.data));
+    m_raw_data_file->flush();
+    if (m_raw_data_file->fail())
+      throw std::runtime_error("Error writing chunk checksum");
+  }
 
   m_buffer.clear();
   delete m_output_stream;
@@ -207,6 +221,13 @@ void BootstrapFile::flush_chunk()
 }
 
 void BootstrapFile::write_block(block& block)
+{
+  blobdata bd = serialize_block(block);
+  m_output_stream->write((const char*)bd.data(), bd.size());
+}
+
+// only reads from the db, so several blocks can be serialized at once
+blobdata BootstrapFile::serialize_block(const block& block) const
 {
   bootstrap::block_package bp;
   bp.block = block;
@@ -244,8 +265,7 @@ void BootstrapFile::write_block(block& block)
     bp.coins_generated = coins_generated;
   }
 
-  blobdata bd = t_serializable_object_to_blob(bp);
-  m_output_stream->write((const char*)bd.data(), bd.size());
+  return t_serializable_object_to_blob(bp);
 }
 
 bool BootstrapFile::close()
@@ -273,8 +293,6 @@ bool BootstrapFile::store_blockchain_raw(Blockchain* _blockchain_storage, tx_mem
     LOG_PRINT_RED_L0("failed to open raw file for write");
     return false;
   }
-  block b;
-
   // block_start, block_stop use 0-based height. m_height uses 1-based height. So to resume export
   // from last exported block, block_start doesn't need to add 1 here, as it's already at the next
   // height.
@@ -291,19 +309,55 @@ bool BootstrapFile::store_blockchain_raw(Blockchain* _blockchain_storage, tx_mem
     block_stop = m_blockchain_storage->get_current_blockchain_height() - 1;
     LOG_PRINT_L0("Using block height of source blockchain: " << block_stop);
   }
-  for (m_cur_height = block_start; m_cur_height <= block_stop; ++m_cur_height)
+  // Fetching a block's transactions and serializing the package is most of
+  // the work, so a batch of blocks is prepared on all cores, then written
+  // out in height order.
+  tools::thread_group threads;
+  std::vector<blobdata> batch;
+  std::atomic<bool> failed(false);
+  m_cur_height = block_start;
+  while (m_cur_height <= block_stop)
   {
-    // this method's height refers to 0-based height (genesis block = height 0)
-    crypto::hash hash = m_blockchain_storage->get_block_id_by_height(m_cur_height);
-    m_blockchain_storage->get_block_by_hash(hash, b);
-    write_block(b);
-    if (m_cur_height % NUM_BLOCKS_PER_CHUNK == 0) {
-      flush_chunk();
-      num_blocks_written += NUM_BLOCKS_PER_CHUNK;
+    const uint64_t batch_start = m_cur_height;
+    const uint64_t batch_size = std::min<uint64_t>(BOOTSTRAP_EXPORT_BATCH, block_stop - batch_start + 1);
+    batch.clear();
+    batch.resize(batch_size);
+    tools::task_region(threads, [&] (tools::task_region_handle& region) {
+      for (uint64_t i = 0; i < batch_size; ++i)
+      {
+        region.run([&, i] {
+          try
+          {
+            // this method's height refers to 0-based height (genesis block = height 0)
+            const block b = m_blockchain_storage->get_db().get_block_from_height(batch_start + i);
+            batch[i] = serialize_block(b);
+          }
+          catch (const std::exception& e)
+          {
+            LOG_PRINT_RED_L0("Error preparing block " << batch_start + i << ": " << e.what());
+            failed = true;
+          }
+        });
+      }
+    });
+    if (failed)
+    {
+      BootstrapFile::close();
+      return false;
     }
-    if (m_cur_height % progress_interval == 0) {
-      std::cout << refresh_string;
-      std::cout << "block " << m_cur_height << "/" << block_stop << std::flush;
+
+    for (const blobdata& bd : batch)
+    {
+      m_output_stream->write(bd.data(), bd.size());
+      if (m_cur_height % NUM_BLOCKS_PER_CHUNK == 0) {
+        flush_chunk();
+        num_blocks_written += NUM_BLOCKS_PER_CHUNK;
+      }
+      if (m_cur_height % progress_interval == 0) {
+        std::cout << refresh_string;
+        std::cout << "block " << m_cur_height << "/" << block_stop << std::flush;
+      }
+      ++m_cur_height;
     }
   }
   // NOTE: use of NUM_BLOCKS_PER_CHUNK is a placeholder in case multi-block chunks are later supported.
@@ -366,6 +420,9 @@ uint64_t BootstrapFile::seek_to_first_chunk(std::ifstream& import_file)
   LOG_PRINT_L0("bootstrap file v" << unsigned(bfi.major_version) << "." << unsigned(bfi.minor_version));
   LOG_PRINT_L0("bootstrap magic size: " << sizeof(file_magic));
   LOG_PRINT_L0("bootstrap header size: " << bfi.header_size);
+  m_chunk_checksums = bfi.minor_version >= BOOTSTRAP_CHECKSUM_MINOR_VERSION;
+  if (m_chunk_checksums)
+    LOG_PRINT_L0("bootstrap chunks have checksums");
 
   uint64_t full_header_size = sizeof(file_magic) + bfi.header_size;
   import_file.seekg(full_header_size);
@@ -373,6 +430,106 @@ uint64_t BootstrapFile::seek_to_first_chunk(std::ifstream& import_file)
   return full_header_size;
 }
 
+int BootstrapFile::read_chunk(std::ifstream& import_file, bootstrap::block_package& bp)
+{
+  std::string str1;
+  char buf1[sizeof(uint32_t)];
+  uint32_t chunk_size;
+  import_file.read(buf1, sizeof(chunk_size));
+  if (! import_file)
+    return 1;
+  str1.assign(buf1, sizeof(chunk_size));
+  if (! ::serialization::parse_binary(str1, chunk_size))
+  {
+    LOG_PRINT_RED_L0("Error in deserialization of chunk size");
+    return 2;
+  }
+  if (chunk_size == 0 || chunk_size > BUFFER_SIZE)
+  {
+    LOG_PRINT_RED_L0("Invalid chunk size " << chunk_size);
+    return 2;
+  }
+
+  std::vector<char> buffer_block(chunk_size);
+  import_file.read(buffer_block.data(), chunk_size);
+  if (! import_file)
+  {
+    LOG_PRINT_RED_L0("Unexpected end of file: read " << import_file.gcount() << " of chunk_size " << chunk_size);
+    return 2;
+  }
+  if (m_chunk_checksums)
+  {
+    crypto::hash checksum;
+    import_file.read(checksum.data, sizeof(checksum.data));
+    if (! import_file)
+    {
+      LOG_PRINT_RED_L0("Unexpected end of file while reading chunk checksum");
+      return 2;
+    }
+    if (checksum != crypto::cn_fast_hash(buffer_block.data(), chunk_size))
+    {
+      LOG_PRINT_RED_L0("Chunk checksum mismatch: bootstrap file is corrupt");
+      return 2;
+    }
+  }
+
+  str1.assign(buffer_block.data(), chunk_size);
+  if (! ::serialization::parse_binary(str1, bp))
+  {
+    LOG_PRINT_RED_L0("Error in deserialization of chunk");
+    return 2;
+  }
+  return 0;
+}
+
+bool BootstrapFile::load_index(const std::string& import_file_path, bootstrap::chunk_index& index)
+{
+  boost::system::error_code ec;
+  const uint64_t file_size = boost::filesystem::file_size(import_file_path, ec);
+  if (ec)
+    return false;
+
+  std::string blob;
+  if (!epee::file_io_utils::load_file_to_string(import_file_path + BOOTSTRAP_INDEX_SUFFIX, blob))
+    return false;
+  if (!::serialization::parse_binary(blob, index))
+  {
+    LOG_PRINT_L0("bootstrap index unreadable, ignoring it");
+    return false;
+  }
+  if (index.file_size != file_size || index.interval == 0 || index.offsets.empty())
+  {
+    LOG_PRINT_L1("bootstrap index is stale, ignoring it");
+    return false;
+  }
+  return true;
+}
+
+bool BootstrapFile::store_index(const std::string& import_file_path, const bootstrap::chunk_index& index)
+{
+  const blobdata blob = t_serializable_object_to_blob(index);
+  if (!epee::file_io_utils::save_string_to_file(import_file_path + BOOTSTRAP_INDEX_SUFFIX, blob))
+  {
+    LOG_PRINT_L0("Failed to save bootstrap index to " << import_file_path + BOOTSTRAP_INDEX_SUFFIX);
+    return false;
+  }
+  return true;
+}
+
+uint64_t BootstrapFile::seek_to_height(std::ifstream& import_file, const std::string& import_file_path, uint64_t height)
+{
+  bootstrap::chunk_index index;
+  if (!load_index(import_file_path, index))
+    return 0;
+
+  const uint64_t entry = std::min<uint64_t>(height / index.interval, index.offsets.size() - 1);
+  import_file.seekg(index.offsets[entry]);
+  if (!import_file)
+    throw std::runtime_error("Error seeking to indexed chunk");
+  LOG_PRINT_L0("bootstrap index: skipped to block " << entry * index.interval);
+  return entry * index.interval;
+}
+
 uint64_t BootstrapFile::count_blocks(const std::string& import_file_path)
 {
   boost::filesystem::path raw_file_path(import_file_path);
@@ -382,6 +539,14 @@ uint64_t BootstrapFile::count_blocks(const std::string& import_file_path)
     LOG_PRINT_L0("bootstrap file not found: " << raw_file_path);
     throw std::runtime_error("Aborting");
   }
+
+  bootstrap::chunk_index index;
+  if (load_index(import_file_path, index))
+  {
+    std::cout << "Number of blocks (from bootstrap index): " << index.num_blocks << ENDL;
+    return index.num_blocks;
+  }
+  index.interval = BOOTSTRAP_INDEX_INTERVAL;
   std::ifstream import_file;
   import_file.open(import_file_path, std::ios_base::binary | std::ifstream::in);
 
@@ -405,6 +570,9 @@ uint64_t BootstrapFile::count_blocks(const std::string& import_file_path)
   char buf1[2048];
   while (! quit)
   {
+    if (h % index.interval == 0)
+      index.offsets.push_back((uint64_t)import_file.tellg());
+
     uint32_t chunk_size;
     import_file.read(buf1, sizeof(chunk_size));
     if (!import_file) {
@@ -446,14 +614,15 @@ uint64_t BootstrapFile::count_blocks(const std::string& import_file_path)
       throw std::runtime_error("Aborting");
     }
     // skip to next expected block size value
-    import_file.seekg(chunk_size, std::ios_base::cur);
+    const uint32_t checksum_size = m_chunk_checksums ? sizeof(crypto::hash) : 0;
+    import_file.seekg(chunk_size + checksum_size, std::ios_base::cur);
     if (! import_file) {
       std::cout << refresh_string;
       LOG_PRINT_L0("ERROR: unexpected end of file: bytes read before error: "
           << import_file.gcount() << " of chunk_size " << chunk_size);
       throw std::runtime_error("Aborting");
     }
-    bytes_read += chunk_size;
+    bytes_read += chunk_size + checksum_size;
 
     // std::cout << refresh_string;
     LOG_PRINT_L3("Number bytes scanned: " << bytes_read);
@@ -469,6 +638,14 @@ uint64_t BootstrapFile::count_blocks(const std::string& import_file_path)
   std::cout << "Number of blocks: " << h << ENDL;
   std::cout << ENDL;
 
+  // the last offset recorded may be the end of the file rather than a chunk
+  if (!index.offsets.empty() && index.offsets.back() == full_header_size + bytes_read)
+    index.offsets.pop_back();
+  index.file_size = boost::filesystem::file_size(raw_file_path, ec);
+  index.num_blocks = h;
+  if (!ec && !index.offsets.empty())
+    store_index(import_file_path, index);
+
   // NOTE: h is the number of blocks.
   // Note that a block's stored height is zero-based, but parts of the code use
   // one-based height.
@@ -47,6 +47,7 @@
 #include "version.h"
 
 #include "blockchain_utilities.h"
+#include "bootstrap_serialization.h"
 
 
 using namespace cryptonote;
@@ -59,6 +60,20 @@ public:
   uint64_t count_blocks(const std::string& dir_path);
   uint64_t seek_to_first_chunk(std::ifstream& import_file);
 
+  // positions import_file at the indexed chunk closest to, but not after,
+  // the given height, and returns that chunk's height. Without a usable
+  // index, stays at the first chunk and returns 0.
+  uint64_t seek_to_height(std::ifstream& import_file, const std::string& import_file_path, uint64_t height);
+
+  // whether the chunks of the file last opened carry a checksum; known
+  // once seek_to_first_chunk has read the file's header
+  bool has_chunk_checksums() const { return m_chunk_checksums; }
+
+  // reads and parses the chunk import_file is positioned at, checking its
+  // checksum if the file has them. Returns 0 on success, 1 at the end of
+  // the file, and 2 on error.
+  int read_chunk(std::ifstream& import_file, bootstrap::block_package& bp);
+
   bool store_blockchain_raw(cryptonote::Blockchain* cs, cryptonote::tx_memory_pool* txp,
       boost::filesystem::path& output_file, uint64_t use_block_height=0);
 
@@ -77,11 +92,18 @@ protected:
   bool initialize_file();
   bool close();
   void write_block(block& block);
+  blobdata serialize_block(const block& block) const;
   void flush_chunk();
 
 private:
 
+  // the index sits next to the bootstrap file, and is rebuilt by count_blocks
+  // whenever the file's size no longer matches
+  bool load_index(const std::string& import_file_path, bootstrap::chunk_index& index);
+  bool store_index(const std::string& import_file_path, const bootstrap::chunk_index& index);
+
   uint64_t m_height;
   uint64_t m_cur_height; // tracks current height during export
   uint32_t m_max_chunk;
+  bool m_chunk_checksums = false;
 };
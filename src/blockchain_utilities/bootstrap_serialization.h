@@ -66,6 +66,26 @@ namespace cryptonote
       END_SERIALIZE()
     };
 
+    // sidecar index of a bootstrap file, so it can be counted and seeked in
+    // without scanning every chunk
+    struct chunk_index
+    {
+      // size of the bootstrap file when indexed, the index is stale otherwise
+      uint64_t file_size;
+      uint64_t num_blocks;
+
+      // offsets[n] is the file position of the chunk holding block n * interval
+      uint64_t interval;
+      std::vector<uint64_t> offsets;
+
+      BEGIN_SERIALIZE_OBJECT()
+        VARINT_FIELD(file_size);
+        VARINT_FIELD(num_blocks);
+        VARINT_FIELD(interval);
+        FIELD(offsets);
+      END_SERIALIZE()
+    };
+
     struct block_package
     {
       cryptonote::block block;
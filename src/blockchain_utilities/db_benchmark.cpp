@@ -0,0 +1,480 @@
+// Copyright (c) 2014-2016, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include <fstream>
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include "rapidjson/writer.h"
+#include "rapidjson/stringbuffer.h"
+#include "bootstrap_file.h"
+#include "crypto/crypto.h"
+#include "cryptonote_core/cryptonote_format_utils.h"
+#include "include_base_utils.h"
+#include "blockchain_db/db_types.h"
+#include "blockchain_db/lmdb/db_lmdb.h"
+#if defined(BERKELEY_DB)
+#include "blockchain_db/berkeleydb/db_bdb.h"
+#endif
+
+#include <lmdb.h> // for db flag arguments
+
+namespace po = boost::program_options;
+using namespace epee; // log_space
+
+namespace
+{
+
+// a [safe|fast|fastest]:[sync|async|nosync]:[nblocks_per_sync] mode, as
+// --db-sync-mode takes, except that nosync can be asked for explicitly
+struct sync_mode
+{
+  std::string name;
+  std::string db_mode;
+  std::string sync;
+  uint64_t blocks_per_sync;
+};
+
+// latencies of one operation, in nanoseconds
+class latencies
+{
+public:
+  void add(uint64_t ns) { m_ns.push_back(ns); }
+
+  void write(rapidjson::Writer<rapidjson::StringBuffer> &w, const char *name)
+  {
+    std::sort(m_ns.begin(), m_ns.end());
+    uint64_t total = 0;
+    for (uint64_t ns: m_ns)
+      total += ns;
+    w.Key(name);
+    w.StartObject();
+    w.Key("count"); w.Uint64(m_ns.size());
+    w.Key("total_ns"); w.Uint64(total);
+    w.Key("mean_ns"); w.Uint64(m_ns.empty() ? 0 : total / m_ns.size());
+    w.Key("p50_ns"); w.Uint64(percentile(50));
+    w.Key("p99_ns"); w.Uint64(percentile(99));
+    w.Key("max_ns"); w.Uint64(m_ns.empty() ? 0 : m_ns.back());
+    w.EndObject();
+  }
+
+private:
+  uint64_t percentile(unsigned p) const
+  {
+    if (m_ns.empty())
+      return 0;
+    return m_ns[std::min<size_t>(m_ns.size() - 1, m_ns.size() * p / 100)];
+  }
+
+  std::vector<uint64_t> m_ns;
+};
+
+// the replayed chain segment, with what the lookups pick from
+struct chain_segment
+{
+  std::vector<bootstrap::block_package> blocks;
+  std::vector<crypto::hash> tx_hashes;
+  std::vector<crypto::key_image> key_images;
+  std::vector<uint64_t> output_amounts; // one per output
+  uint64_t bytes = 0;
+};
+
+bool load_segment(const std::string &path, uint64_t num_blocks, chain_segment &segment)
+{
+  BootstrapFile bootstrap;
+  std::ifstream import_file(path, std::ios_base::binary | std::ifstream::in);
+  if (import_file.fail())
+  {
+    LOG_ERROR("Failed to open " << path);
+    return false;
+  }
+  bootstrap.seek_to_first_chunk(import_file);
+
+  while (segment.blocks.size() < num_blocks)
+  {
+    bootstrap::block_package bp;
+    const int r = bootstrap.read_chunk(import_file, bp);
+    if (r == 1)
+      break;
+    if (r)
+      return false;
+
+    segment.tx_hashes.push_back(get_transaction_hash(bp.block.miner_tx));
+    for (const auto &h: bp.block.tx_hashes)
+      segment.tx_hashes.push_back(h);
+    for (const auto &o: bp.block.miner_tx.vout)
+      segment.output_amounts.push_back(bp.block.miner_tx.version >= 2 ? 0 : o.amount);
+    for (const auto &tx: bp.txs)
+    {
+      for (const auto &in: tx.vin)
+        if (in.type() == typeid(txin_to_key))
+          segment.key_images.push_back(boost::get<txin_to_key>(in).k_image);
+      for (const auto &o: tx.vout)
+        segment.output_amounts.push_back(o.amount);
+    }
+    segment.bytes += bp.block_size;
+    segment.blocks.push_back(std::move(bp));
+  }
+  return true;
+}
+
+int get_db_flags(const std::string &db_type, const std::string &db_mode)
+{
+  if (db_type == "lmdb")
+  {
+    if (db_mode == "safe")
+      return MDB_NORDAHEAD;
+    if (db_mode == "fastest")
+      return MDB_NORDAHEAD | MDB_NOSYNC | MDB_WRITEMAP | MDB_MAPASYNC;
+    return MDB_NORDAHEAD | MDB_NOSYNC;
+  }
+#if defined(BERKELEY_DB)
+  if (db_mode == "safe")
+    return DB_TXN_SYNC;
+  if (db_mode == "fastest")
+    return DB_TXN_NOSYNC;
+  return DB_TXN_WRITE_NOSYNC;
+#else
+  return 0;
+#endif
+}
+
+BlockchainDB *new_db(const std::string &db_type)
+{
+  if (db_type == "lmdb")
+    return new BlockchainLMDB();
+#if defined(BERKELEY_DB)
+  if (db_type == "berkeley")
+    return new BlockchainBDB();
+#endif
+  return NULL;
+}
+
+template<typename T>
+const T &pick(const std::vector<T> &v)
+{
+  return v[crypto::rand<uint64_t>() % v.size()];
+}
+
+// replays the segment into a new db of the given type, then times lookups,
+// pops and re-adds on it, and writes the results as a JSON object
+bool run(const std::string &db_type, const sync_mode &mode, const chain_segment &segment,
+    const boost::filesystem::path &dir, uint64_t samples, uint64_t pop_blocks,
+    rapidjson::Writer<rapidjson::StringBuffer> &w)
+{
+  LOG_PRINT_L0("Running " << db_type << " with " << mode.name);
+  std::unique_ptr<BlockchainDB> db(new_db(db_type));
+  if (!db)
+  {
+    LOG_ERROR("Database type not available: " << db_type);
+    return false;
+  }
+  boost::filesystem::remove_all(dir);
+  boost::filesystem::create_directories(dir);
+  db->open((dir / db->get_db_name()).string(), get_db_flags(db_type, mode.db_mode));
+  HardFork hardfork(*db, 1, 0);
+  hardfork.init();
+  db->set_hard_fork(&hardfork);
+
+  latencies add_block, sync, get_output_key, tx_exists_hit, tx_exists_miss, has_key_image_hit, has_key_image_miss, pop_block, readd_block;
+
+  const bool sync_here = mode.sync == "sync" && mode.blocks_per_sync;
+  if (mode.sync == "async")
+    db->start_flusher(mode.blocks_per_sync, 0, 0);
+  const uint64_t add_start = epee::misc_utils::get_ns_count();
+  uint64_t txs = 0;
+  for (size_t n = 0; n < segment.blocks.size(); ++n)
+  {
+    const bootstrap::block_package &bp = segment.blocks[n];
+    uint64_t t = epee::misc_utils::get_ns_count();
+    db->add_block(bp.block, bp.block_size, bp.cumulative_difficulty, bp.coins_generated, bp.txs);
+    add_block.add(epee::misc_utils::get_ns_count() - t);
+    txs += bp.txs.size() + 1;
+    if (sync_here && (n + 1) % mode.blocks_per_sync == 0)
+    {
+      t = epee::misc_utils::get_ns_count();
+      db->flush();
+      sync.add(epee::misc_utils::get_ns_count() - t);
+    }
+  }
+  const uint64_t add_ns = epee::misc_utils::get_ns_count() - add_start;
+  db->stop_flusher();
+  uint64_t t = epee::misc_utils::get_ns_count();
+  db->flush();
+  const uint64_t final_sync_ns = epee::misc_utils::get_ns_count() - t;
+  db_sync_stats_t sync_stats;
+  db->get_sync_stats(sync_stats);
+  // the pages the replayed segment takes up, which page splits inflate
+  db_memory_stats_t memory_stats;
+  db->get_memory_stats(memory_stats);
+
+  for (uint64_t n = 0; n < samples && !segment.output_amounts.empty(); ++n)
+  {
+    const uint64_t amount = pick(segment.output_amounts);
+    const uint64_t num_outputs = db->get_num_outputs(amount);
+    if (!num_outputs)
+      continue;
+    const uint64_t index = crypto::rand<uint64_t>() % num_outputs;
+    t = epee::misc_utils::get_ns_count();
+    db->get_output_key(amount, index);
+    get_output_key.add(epee::misc_utils::get_ns_count() - t);
+  }
+  for (uint64_t n = 0; n < samples && !segment.tx_hashes.empty(); ++n)
+  {
+    const crypto::hash h = pick(segment.tx_hashes);
+    t = epee::misc_utils::get_ns_count();
+    db->tx_exists(h);
+    tx_exists_hit.add(epee::misc_utils::get_ns_count() - t);
+    const crypto::hash r = crypto::rand<crypto::hash>();
+    t = epee::misc_utils::get_ns_count();
+    db->tx_exists(r);
+    tx_exists_miss.add(epee::misc_utils::get_ns_count() - t);
+  }
+  for (uint64_t n = 0; n < samples; ++n)
+  {
+    if (!segment.key_images.empty())
+    {
+      const crypto::key_image ki = pick(segment.key_images);
+      t = epee::misc_utils::get_ns_count();
+      db->has_key_image(ki);
+      has_key_image_hit.add(epee::misc_utils::get_ns_count() - t);
+    }
+    const crypto::key_image r = crypto::rand<crypto::key_image>();
+    t = epee::misc_utils::get_ns_count();
+    db->has_key_image(r);
+    has_key_image_miss.add(epee::misc_utils::get_ns_count() - t);
+  }
+
+  // a reorg of pop_blocks: pop them, then add them back
+  pop_blocks = std::min<uint64_t>(pop_blocks, segment.blocks.size() - 1);
+  for (uint64_t n = 0; n < pop_blocks; ++n)
+  {
+    block b;
+    std::vector<transaction> popped_txs;
+    t = epee::misc_utils::get_ns_count();
+    db->pop_block(b, popped_txs);
+    pop_block.add(epee::misc_utils::get_ns_count() - t);
+  }
+  for (size_t n = segment.blocks.size() - pop_blocks; n < segment.blocks.size(); ++n)
+  {
+    const bootstrap::block_package &bp = segment.blocks[n];
+    t = epee::misc_utils::get_ns_count();
+    db->add_block(bp.block, bp.block_size, bp.cumulative_difficulty, bp.coins_generated, bp.txs);
+    readd_block.add(epee::misc_utils::get_ns_count() - t);
+  }
+
+  db->close();
+  db.reset();
+  boost::filesystem::remove_all(dir);
+
+  const double add_s = add_ns / 1e9;
+  w.StartObject();
+  w.Key("database"); w.String(db_type.c_str());
+  w.Key("sync_mode"); w.String(mode.name.c_str());
+  w.Key("blocks"); w.Uint64(segment.blocks.size());
+  w.Key("add_total_ns"); w.Uint64(add_ns);
+  w.Key("blocks_per_s"); w.Double(add_s > 0 ? segment.blocks.size() / add_s : 0);
+  w.Key("txs_per_s"); w.Double(add_s > 0 ? txs / add_s : 0);
+  w.Key("bytes_per_s"); w.Double(add_s > 0 ? segment.bytes / add_s : 0);
+  add_block.write(w, "add_block");
+  sync.write(w, "sync");
+  w.Key("final_sync_ns"); w.Uint64(final_sync_ns);
+  w.Key("syncs"); w.Uint64(sync_stats.syncs);
+  w.Key("max_sync_us"); w.Uint64(sync_stats.max_sync_us);
+  w.Key("max_sync_lag_ms"); w.Uint64(sync_stats.max_lag_ms);
+  w.Key("db_used_bytes"); w.Uint64(memory_stats.used_bytes);
+  get_output_key.write(w, "get_output_key");
+  tx_exists_hit.write(w, "tx_exists_hit");
+  tx_exists_miss.write(w, "tx_exists_miss");
+  has_key_image_hit.write(w, "has_key_image_hit");
+  has_key_image_miss.write(w, "has_key_image_miss");
+  pop_block.write(w, "pop_block");
+  readd_block.write(w, "reorg_add_block");
+  w.EndObject();
+  return true;
+}
+
+bool parse_sync_mode(const std::string &s, sync_mode &mode)
+{
+  std::vector<std::string> options;
+  boost::split(options, s, boost::is_any_of(":"));
+  mode.name = s;
+  mode.db_mode = options[0];
+  mode.sync = options.size() >= 2 ? options[1] : "async";
+  mode.blocks_per_sync = 1000;
+  if (mode.db_mode != "safe" && mode.db_mode != "fast" && mode.db_mode != "fastest")
+    return false;
+  if (mode.sync != "sync" && mode.sync != "async" && mode.sync != "nosync")
+    return false;
+  // safe mode leaves syncing to the db, as the daemon does
+  if (mode.db_mode == "safe")
+    mode.sync = "nosync";
+  if (options.size() >= 3)
+  {
+    char *endptr;
+    mode.blocks_per_sync = strtoull(options[2].c_str(), &endptr, 0);
+    if (*endptr != '\0')
+      return false;
+  }
+  return true;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+  tools::sanitize_locale();
+
+#if defined(BERKELEY_DB)
+  const std::string default_db_types = "lmdb,berkeley";
+#else
+  const std::string default_db_types = "lmdb";
+#endif
+
+  po::options_description desc_options("Allowed options");
+  const command_line::arg_descriptor<std::string> arg_input_file = {"input-file", "Bootstrap file to replay, as blockchain_export writes", "", true};
+  const command_line::arg_descriptor<std::string> arg_output_file = {"output-file", "Write the JSON results here instead of to stdout", ""};
+  const command_line::arg_descriptor<std::string> arg_data_dir = {"data-dir", "Directory for the benchmark databases, removed after each run", (boost::filesystem::temp_directory_path() / "monero-db-benchmark").string()};
+  const command_line::arg_descriptor<std::string> arg_database = {"database", "Comma separated database types to run", default_db_types};
+  const command_line::arg_descriptor<std::string> arg_sync_modes = {"db-sync-mode", "Comma separated [safe|fast|fastest]:[sync|async|nosync]:[nblocks_per_sync] modes to run", "safe,fast:sync:1000,fast:async:1000,fastest:nosync"};
+  const command_line::arg_descriptor<uint64_t> arg_blocks = {"blocks", "Number of blocks to replay from the start of the file", 10000};
+  const command_line::arg_descriptor<uint64_t> arg_samples = {"samples", "Number of random lookups of each kind", 10000};
+  const command_line::arg_descriptor<uint64_t> arg_pop_blocks = {"pop-blocks", "Number of blocks popped and added back", 100};
+  const command_line::arg_descriptor<uint32_t> arg_log_level = {"log-level", "", LOG_LEVEL_0};
+
+  command_line::add_arg(desc_options, arg_input_file);
+  command_line::add_arg(desc_options, arg_output_file);
+  command_line::add_arg(desc_options, arg_data_dir);
+  command_line::add_arg(desc_options, arg_database);
+  command_line::add_arg(desc_options, arg_sync_modes);
+  command_line::add_arg(desc_options, arg_blocks);
+  command_line::add_arg(desc_options, arg_samples);
+  command_line::add_arg(desc_options, arg_pop_blocks);
+  command_line::add_arg(desc_options, arg_log_level);
+  command_line::add_arg(desc_options, command_line::arg_help);
+
+  po::variables_map vm;
+  bool r = command_line::handle_error_helper(desc_options, [&]()
+  {
+    po::store(po::parse_command_line(argc, argv, desc_options), vm);
+    po::notify(vm);
+    return true;
+  });
+  if (!r)
+    return 1;
+
+  if (command_line::get_arg(vm, command_line::arg_help) || !command_line::has_arg(vm, arg_input_file))
+  {
+    std::cout << desc_options << std::endl;
+    return 1;
+  }
+
+  log_space::get_set_log_detalisation_level(true, command_line::get_arg(vm, arg_log_level));
+  log_space::log_singletone::add_logger(LOGGER_CONSOLE, NULL, NULL);
+
+  std::vector<std::string> db_types, mode_strings;
+  boost::split(db_types, command_line::get_arg(vm, arg_database), boost::is_any_of(","));
+  boost::split(mode_strings, command_line::get_arg(vm, arg_sync_modes), boost::is_any_of(","));
+  for (const auto &db_type: db_types)
+  {
+    if (cryptonote::blockchain_db_types.count(db_type) == 0)
+    {
+      std::cerr << "Invalid database type: " << db_type << std::endl;
+      return 1;
+    }
+  }
+  std::vector<sync_mode> modes;
+  for (const auto &s: mode_strings)
+  {
+    sync_mode mode;
+    if (!parse_sync_mode(s, mode))
+    {
+      std::cerr << "Invalid sync mode: " << s << std::endl;
+      return 1;
+    }
+    modes.push_back(mode);
+  }
+
+  const std::string input_file = command_line::get_arg(vm, arg_input_file);
+  chain_segment segment;
+  try
+  {
+    if (!load_segment(input_file, command_line::get_arg(vm, arg_blocks), segment) || segment.blocks.empty())
+    {
+      std::cerr << "Failed to read blocks from " << input_file << std::endl;
+      return 1;
+    }
+  }
+  catch (const std::exception &e)
+  {
+    std::cerr << "Failed to read blocks from " << input_file << ": " << e.what() << std::endl;
+    return 1;
+  }
+  LOG_PRINT_L0("Loaded " << segment.blocks.size() << " blocks, " << segment.tx_hashes.size() << " txes, " << segment.bytes << " bytes");
+
+  rapidjson::StringBuffer sb;
+  rapidjson::Writer<rapidjson::StringBuffer> w(sb);
+  w.StartObject();
+  w.Key("input_file"); w.String(input_file.c_str());
+  w.Key("blocks"); w.Uint64(segment.blocks.size());
+  w.Key("txs"); w.Uint64(segment.tx_hashes.size());
+  w.Key("bytes"); w.Uint64(segment.bytes);
+  w.Key("runs");
+  w.StartArray();
+  const boost::filesystem::path dir = command_line::get_arg(vm, arg_data_dir);
+  for (const auto &db_type: db_types)
+  {
+    for (const auto &mode: modes)
+    {
+      try
+      {
+        if (!run(db_type, mode, segment, dir, command_line::get_arg(vm, arg_samples), command_line::get_arg(vm, arg_pop_blocks), w))
+          return 1;
+      }
+      catch (const std::exception &e)
+      {
+        std::cerr << "Error running " << db_type << " with " << mode.name << ": " << e.what() << std::endl;
+        return 1;
+      }
+    }
+  }
+  w.EndArray();
+  w.EndObject();
+
+  const std::string output_file = command_line::get_arg(vm, arg_output_file);
+  if (output_file.empty())
+  {
+    std::cout << sb.GetString() << std::endl;
+  }
+  else if (!epee::file_io_utils::save_string_to_file(output_file, std::string(sb.GetString()) + "\n"))
+  {
+    std::cerr << "Failed to write " << output_file << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -98,6 +98,10 @@ struct fake_core_db
 
     m_storage.init(db, m_hardfork, use_testnet);
 
+    // the importer commits through its own batches, so syncing after each
+    // group of incoming blocks is left off
+    m_storage.set_user_options(tools::get_max_concurrency(), 0, db_nosync, true);
+
     if (do_batch)
       m_storage.get_db().set_batch_transactions(do_batch);
     support_batch = true;
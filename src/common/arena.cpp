@@ -0,0 +1,133 @@
+// Copyright (c) 2014-2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include "common/arena.h"
+
+#include <algorithm>
+#include <boost/thread/tss.hpp>
+#include <cstdint>
+
+namespace tools
+{
+namespace
+{
+  boost::thread_specific_ptr<arena> thread_arena;
+  __thread arena* current_arena = NULL;
+}
+
+constexpr std::size_t arena::DEFAULT_CHUNK_SIZE;
+constexpr std::size_t arena::MAX_RETAINED_SIZE;
+
+arena::arena(std::size_t chunk_size)
+  : m_chunks(), m_chunk_size(chunk_size), m_chunk(0), m_offset(0)
+{
+}
+
+arena::~arena()
+{
+  for (const chunk& c : m_chunks)
+    ::operator delete(c.data);
+}
+
+void* arena::allocate(std::size_t size, std::size_t alignment)
+{
+  for (; m_chunk < m_chunks.size(); ++m_chunk, m_offset = 0)
+  {
+    const chunk& c = m_chunks[m_chunk];
+    const std::uintptr_t base = reinterpret_cast<std::uintptr_t>(c.data);
+    const std::size_t start = ((base + m_offset + alignment - 1) & ~std::uintptr_t(alignment - 1)) - base;
+    if (start <= c.size && size <= c.size - start)
+    {
+      m_offset = start + size;
+      return c.data + start;
+    }
+  }
+
+  // none of the chunks left has room, oversized allocations get their own
+  const std::size_t chunk_size = std::max(m_chunk_size, size + alignment);
+  m_chunks.push_back({static_cast<char*>(::operator new(chunk_size)), chunk_size});
+  m_chunk = m_chunks.size() - 1;
+  m_offset = 0;
+  return allocate(size, alignment);
+}
+
+void arena::rewind(const mark& m) noexcept
+{
+  m_chunk = m.chunk;
+  m_offset = m.offset;
+}
+
+void arena::reset() noexcept
+{
+  if (capacity() > MAX_RETAINED_SIZE)
+  {
+    for (std::size_t i = 1; i < m_chunks.size(); ++i)
+      ::operator delete(m_chunks[i].data);
+    m_chunks.resize(std::min<std::size_t>(m_chunks.size(), 1));
+  }
+  m_chunk = 0;
+  m_offset = 0;
+}
+
+std::size_t arena::capacity() const noexcept
+{
+  std::size_t size = 0;
+  for (const chunk& c : m_chunks)
+    size += c.size;
+  return size;
+}
+
+arena* arena::current() noexcept
+{
+  return current_arena;
+}
+
+namespace
+{
+  arena* get_thread_arena()
+  {
+    if (!thread_arena.get())
+      thread_arena.reset(new arena());
+    return thread_arena.get();
+  }
+}
+
+arena_scope::arena_scope()
+  : m_arena(get_thread_arena()), m_previous(current_arena), m_mark(m_arena->get_mark())
+{
+  current_arena = m_arena;
+}
+
+arena_scope::~arena_scope()
+{
+  if (m_previous)
+    m_arena->rewind(m_mark);
+  else
+    m_arena->reset();
+  current_arena = m_previous;
+}
+}
@@ -0,0 +1,159 @@
+// Copyright (c) 2014-2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+namespace tools
+{
+
+/*! A monotonic allocator. Memory is carved sequentially out of large chunks
+and only given back all at once, by `reset()` or `rewind(...)`; releasing a
+single allocation does nothing. Chunks are kept across resets, so an arena
+that has warmed up serves allocations without calling the system allocator.
+
+An arena is not thread safe, use `arena_scope` to get the calling thread's. */
+class arena
+{
+public:
+  //! A position to `rewind(...)` to, see `get_mark()`
+  struct mark
+  {
+    std::size_t chunk;
+    std::size_t offset;
+  };
+
+  static constexpr std::size_t DEFAULT_CHUNK_SIZE = 256 * 1024;
+
+  //! More than this is given back to the system on `reset()`
+  static constexpr std::size_t MAX_RETAINED_SIZE = 16 * 1024 * 1024;
+
+  explicit arena(std::size_t chunk_size = DEFAULT_CHUNK_SIZE);
+  ~arena();
+
+  arena(const arena&) = delete;
+  arena& operator=(const arena&) = delete;
+
+  //! \throw std::bad_alloc
+  void* allocate(std::size_t size, std::size_t alignment);
+
+  mark get_mark() const noexcept { return {m_chunk, m_offset}; }
+
+  //! Frees everything allocated since `m` was taken.
+  void rewind(const mark& m) noexcept;
+
+  //! Frees everything.
+  void reset() noexcept;
+
+  //! \return Bytes held by the arena, used or not.
+  std::size_t capacity() const noexcept;
+
+  //! \return The arena of the innermost `arena_scope` of this thread, or NULL.
+  static arena* current() noexcept;
+
+private:
+  struct chunk
+  {
+    char* data;
+    std::size_t size;
+  };
+
+  std::vector<chunk> m_chunks;
+  const std::size_t m_chunk_size;
+  std::size_t m_chunk;
+  std::size_t m_offset;
+};
+
+/*! Makes the calling thread's arena current until destruction, at which
+point everything allocated from it meanwhile is freed. Scopes nest: an inner
+scope only frees what was allocated since it was entered, so a task run
+inline by a thread already in a scope does not free the outer scope's
+objects.
+
+Containers using an `arena_allocator` must not outlive the scope that was
+current when they were constructed. */
+class arena_scope
+{
+public:
+  arena_scope();
+  ~arena_scope();
+
+  arena_scope(const arena_scope&) = delete;
+  arena_scope& operator=(const arena_scope&) = delete;
+
+private:
+  arena* const m_arena;
+  arena* const m_previous;
+  const arena::mark m_mark;
+};
+
+/*! A standard allocator drawing from the arena current at construction, or
+from the heap if there is none, so the same container types can be used in
+and out of an `arena_scope`. */
+template<typename T>
+class arena_allocator
+{
+  template<typename U> friend class arena_allocator;
+
+public:
+  typedef T value_type;
+
+  arena_allocator() noexcept : m_arena(arena::current()) {}
+  explicit arena_allocator(arena* a) noexcept : m_arena(a) {}
+
+  template<typename U>
+  arena_allocator(const arena_allocator<U>& other) noexcept : m_arena(other.m_arena) {}
+
+  T* allocate(std::size_t n)
+  {
+    if (m_arena)
+      return static_cast<T*>(m_arena->allocate(n * sizeof(T), alignof(T)));
+    return static_cast<T*>(::operator new(n * sizeof(T)));
+  }
+
+  void deallocate(T* p, std::size_t) noexcept
+  {
+    if (!m_arena)
+      ::operator delete(p);
+  }
+
+  template<typename U>
+  bool operator==(const arena_allocator<U>& other) const noexcept { return m_arena == other.m_arena; }
+
+  template<typename U>
+  bool operator!=(const arena_allocator<U>& other) const noexcept { return m_arena != other.m_arena; }
+
+private:
+  arena* m_arena;
+};
+
+template<typename T>
+using arena_vector = std::vector<T, arena_allocator<T>>;
+}
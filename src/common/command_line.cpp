@@ -98,29 +98,93 @@ namespace command_line
   , "Specify sync option, using format [safe|fast|fastest]:[sync|async]:[nblocks_per_sync]." 
   , "fast:async:1000"
   };
+  const command_line::arg_descriptor<std::string> arg_db_follow = {
+    "db-follow"
+  , "Open the lmdb database in this directory read only and follow the daemon writing it, without syncing from the network."
+  , ""
+  };
+  const command_line::arg_descriptor<uint64_t> arg_db_sync_bytes = {
+    "db-sync-bytes"
+  , "In async sync mode, also sync once this many bytes of blocks are not synced yet, 0 for no limit."
+  , 0
+  };
+  const command_line::arg_descriptor<uint64_t> arg_db_sync_interval = {
+    "db-sync-interval"
+  , "In async sync mode, also sync once a block has not been synced for this many seconds, 0 for no limit."
+  , 60
+  };
   const command_line::arg_descriptor<uint64_t> arg_fast_block_sync = {
     "fast-block-sync"
   , "Sync up most of the way by using embedded, known block hashes."
   , 1
   };
+  const command_line::arg_descriptor<std::string> arg_fast_block_sync_file = {
+    "fast-block-sync-file"
+  , "File of known block hashes, as blockchain_export --blocksdat writes, used instead of the embedded ones if it covers more blocks."
+  , ""
+  };
+  const command_line::arg_descriptor<std::string> arg_fast_block_sync_file_root = {
+    "fast-block-sync-file-root"
+  , "Expected root hash of --fast-block-sync-file, which is not used if it does not match."
+  , ""
+  };
   const command_line::arg_descriptor<uint64_t> arg_prep_blocks_threads = {
     "prep-blocks-threads"
-  , "Max number of threads to use when preparing block hashes in groups."
-  , 4
+  , "Max number of threads to use when preparing block hashes in groups, 0 for one per core."
+  , 0
+  };
+  const command_line::arg_descriptor<uint64_t> arg_prep_blocks_max_mb = {
+    "prep-blocks-max-mb"
+  , "Max MB of incoming block data to prepare at once, larger groups being prepared and added in windows, 0 for no limit."
+  , 0
+  };
+  const command_line::arg_descriptor<int32_t> arg_verification_cpu_affinity = {
+    "verification-cpu-affinity"
+  , "Pin block verification threads to consecutive CPUs starting with this one, -1 to leave them unpinned."
+  , -1
+  };
+  const command_line::arg_descriptor<uint64_t> arg_rct_verification_threads = {
+    "rct-verification-threads"
+  , "Max number of threads to use when verifying RingCT signatures, 0 for one per core."
+  , 0
+  };
+  const command_line::arg_descriptor<uint64_t> arg_ring_member_cache_size = {
+    "ring-member-cache-size"
+  , "Number of ring members whose precomputed points are cached for signature verification, 0 to disable."
+  , 8192
   };
   const command_line::arg_descriptor<uint64_t> arg_db_auto_remove_logs  = {
     "db-auto-remove-logs"
   , "For BerkeleyDB only. Remove transactions logs automatically."
   , 1
   };
+  const command_line::arg_descriptor<uint64_t> arg_db_prune_depth  = {
+    "db-prune-depth"
+  , "For LMDB only. Drop the signatures of transactions this many blocks deep, 0 to keep them. Pruned blocks are not served to peers."
+  , 0
+  };
   const command_line::arg_descriptor<uint64_t> arg_show_time_stats  = {
     "show-time-stats"
   , "Show time-stats when processing blocks/txs and disk synchronization."
   , 0
   };
+  const command_line::arg_descriptor<std::string> arg_block_notify  = {
+    "block-notify"
+  , "Run a command whenever the chain gets a new top block outside of syncing, %s in it is replaced by the block hash."
+  , ""
+  };
+  const command_line::arg_descriptor<uint64_t> arg_max_txpool_size  = {
+    "max-txpool-size"
+  , "Set the maximum size of the transaction pool in bytes, the transactions paying the least per byte are evicted beyond it."
+  , DEFAULT_TXPOOL_MAX_SIZE
+  };
   const command_line::arg_descriptor<size_t> arg_block_sync_size  = {
     "block-sync-size"
-  , "How many blocks to sync at once during chain synchronization."
-  , BLOCKS_SYNCHRONIZING_DEFAULT_COUNT
+  , "How many blocks to sync at once during chain synchronization (0 = size requests by bytes, adapting to block size and peer speed)."
+  , 0
+  };
+  const command_line::arg_descriptor<bool> arg_early_block_relay  = {
+    "early-block-relay"
+  , "Relay new blocks to the peers supporting it as soon as their header and proof of work check out, while they are being verified."
   };
 }
@@ -215,9 +215,22 @@ namespace command_line
   extern const arg_descriptor<bool> arg_dns_checkpoints;
   extern const arg_descriptor<std::string> arg_db_type;
   extern const arg_descriptor<std::string> arg_db_sync_mode;
+  extern const arg_descriptor<std::string> arg_db_follow;
+  extern const arg_descriptor<uint64_t> arg_db_sync_bytes;
+  extern const arg_descriptor<uint64_t> arg_db_sync_interval;
   extern const arg_descriptor<uint64_t> arg_fast_block_sync;
+  extern const arg_descriptor<std::string> arg_fast_block_sync_file;
+  extern const arg_descriptor<std::string> arg_fast_block_sync_file_root;
   extern const arg_descriptor<uint64_t> arg_prep_blocks_threads;
+  extern const arg_descriptor<uint64_t> arg_prep_blocks_max_mb;
+  extern const arg_descriptor<uint64_t> arg_rct_verification_threads;
+  extern const arg_descriptor<int32_t> arg_verification_cpu_affinity;
+  extern const arg_descriptor<uint64_t> arg_ring_member_cache_size;
   extern const arg_descriptor<uint64_t> arg_db_auto_remove_logs;
+  extern const arg_descriptor<uint64_t> arg_db_prune_depth;
   extern const arg_descriptor<uint64_t> arg_show_time_stats;
+  extern const arg_descriptor<std::string> arg_block_notify;
+  extern const arg_descriptor<uint64_t> arg_max_txpool_size;
   extern const arg_descriptor<size_t> arg_block_sync_size;
+  extern const arg_descriptor<bool> arg_early_block_relay;
 }
@@ -0,0 +1,82 @@
+// Copyright (c) 2014-2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include "common/compression.h"
+
+#ifdef HAVE_P2P_COMPRESSION
+#include <zlib.h>
+#endif
+
+namespace tools
+{
+#ifdef HAVE_P2P_COMPRESSION
+  namespace
+  {
+    // much faster than the default level, for most of its ratio on blocks
+    const int COMPRESSION_LEVEL = 3;
+  }
+
+  bool compression_available()
+  {
+    return true;
+  }
+
+  bool compress(const std::string& data, std::string& compressed)
+  {
+    uLongf size = compressBound(data.size());
+    compressed.resize(size);
+    if (compress2((Bytef*)&compressed[0], &size, (const Bytef*)data.data(), data.size(), COMPRESSION_LEVEL) != Z_OK)
+      return false;
+    compressed.resize(size);
+    return true;
+  }
+
+  bool decompress(const std::string& compressed, std::size_t size, std::string& data)
+  {
+    data.resize(size);
+    uLongf inflated = size;
+    if (uncompress((Bytef*)&data[0], &inflated, (const Bytef*)compressed.data(), compressed.size()) != Z_OK)
+      return false;
+    return inflated == size;
+  }
+#else
+  bool compression_available()
+  {
+    return false;
+  }
+
+  bool compress(const std::string& data, std::string& compressed)
+  {
+    return false;
+  }
+
+  bool decompress(const std::string& compressed, std::size_t size, std::string& data)
+  {
+    return false;
+  }
+#endif
+}
@@ -35,6 +35,8 @@
 #include <stdlib.h>
 #include "include_base_utils.h"
 #include <boost/filesystem/fstream.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/thread.hpp>
 using namespace epee;
 namespace bf = boost::filesystem;
 
@@ -323,4 +325,76 @@ bool DNSResolver::check_address_syntax(const char *addr) const
   return true;
 }
 
+namespace dns_utils
+{
+
+namespace
+{
+  // outlives the call when some lookups time out
+  struct parallel_lookups
+  {
+    boost::mutex lock;
+    boost::condition_variable done;
+    std::vector<std::vector<std::string>> records;
+    size_t pending;
+  };
+}
+
+std::vector<std::vector<std::string>> resolve_parallel(const std::vector<std::string>& urls, int record_type, bool require_dnssec, uint64_t timeout_ms)
+{
+  auto lookups = std::make_shared<parallel_lookups>();
+  lookups->records.resize(urls.size());
+  lookups->pending = urls.size();
+
+  for (size_t i = 0; i < urls.size(); ++i)
+  {
+    const std::string url = urls[i];
+    boost::thread([lookups, i, url, record_type, require_dnssec]()
+    {
+      bool avail = false, valid = false;
+      std::vector<std::string> records;
+      try
+      {
+        DNSResolver &resolver = DNSResolver::instance();
+        if (record_type == DNS_TYPE_TXT)
+          records = resolver.get_txt_record(url, avail, valid);
+        else if (record_type == DNS_TYPE_AAAA)
+          records = resolver.get_ipv6(url, avail, valid);
+        else
+          records = resolver.get_ipv4(url, avail, valid);
+      }
+      catch (const std::exception &e)
+      {
+        LOG_PRINT_L1("DNS lookup for " << url << " failed: " << e.what());
+        records.clear();
+      }
+      if (require_dnssec && !(avail && valid))
+      {
+        LOG_PRINT_L2("DNSSEC " << (avail ? "validation failed" : "not available") << " for " << url << ", skipping.");
+        records.clear();
+      }
+      LOG_PRINT_L4("DNS lookup for " << url << ": " << records.size() << " results");
+
+      boost::lock_guard<boost::mutex> lock(lookups->lock);
+      lookups->records[i] = std::move(records);
+      if (--lookups->pending == 0)
+        lookups->done.notify_all();
+    }).detach();
+  }
+
+  const boost::chrono::steady_clock::time_point deadline = boost::chrono::steady_clock::now() + boost::chrono::milliseconds(timeout_ms);
+  boost::unique_lock<boost::mutex> lock(lookups->lock);
+  while (lookups->pending > 0)
+  {
+    if (lookups->done.wait_until(lock, deadline) == boost::cv_status::timeout)
+    {
+      LOG_PRINT_L1(lookups->pending << " of " << urls.size() << " DNS lookups timed out after " << timeout_ms << " ms");
+      break;
+    }
+  }
+  return lookups->records;
+}
+
+}  // namespace dns_utils
+
 }  // namespace tools
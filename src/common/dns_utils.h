@@ -155,4 +155,29 @@ private:
   DNSResolverData *m_data;
 }; // class DNSResolver
 
+namespace dns_utils
+{
+
+/**
+ * @brief looks up records for several URLs at once, one thread per URL
+ *
+ * Waits until all lookups are done or the timeout expires, whichever comes
+ * first. Lookups still running then are left to finish on their own, and
+ * their results are dropped.
+ *
+ * This is an interruption point: if the calling thread is interrupted,
+ * boost::thread_interrupted is thrown.
+ *
+ * @param urls the URLs to query
+ * @param record_type DNS_TYPE_A, DNS_TYPE_AAAA or DNS_TYPE_TXT
+ * @param require_dnssec drop results which were not validated by DNSSEC
+ * @param timeout_ms how long to wait for the lookups, in milliseconds
+ *
+ * @return the records for each URL, in the same order; empty for lookups
+ *         which failed or timed out
+ */
+std::vector<std::vector<std::string>> resolve_parallel(const std::vector<std::string>& urls, int record_type, bool require_dnssec, uint64_t timeout_ms);
+
+}  // namespace dns_utils
+
 }  // namespace tools
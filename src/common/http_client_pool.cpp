@@ -0,0 +1,111 @@
+// Copyright (c) 2014-2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "common/http_client_pool.h"
+
+namespace tools
+{
+http_client_pool::lease::lease(http_client_pool& pool)
+  : m_pool(pool), m_client(pool.take(m_generation))
+{
+}
+
+void http_client_pool::lease::release() noexcept
+{
+  if (m_client)
+    m_pool.give_back(std::move(m_client), m_generation);
+}
+
+http_client_pool::http_client_pool(const std::size_t max_clients)
+  : m_clients(0), m_max_clients(max_clients ? max_clients : 1), m_generation(0)
+{
+  // so give_back never allocates
+  m_idle.reserve(m_max_clients);
+}
+
+http_client_pool::~http_client_pool()
+{
+}
+
+void http_client_pool::clear()
+{
+  std::vector<std::unique_ptr<client>> dropped;
+  {
+    const boost::lock_guard<boost::mutex> lock(m_lock);
+    ++m_generation;
+    m_clients -= m_idle.size();
+    dropped.swap(m_idle);
+    m_idle.reserve(m_max_clients);
+  }
+  // a new client may be made in place of the dropped ones
+  m_returned.notify_all();
+  // disconnecting happens here, out of the lock
+}
+
+std::unique_ptr<http_client_pool::client> http_client_pool::take(std::uint64_t& generation)
+{
+  boost::unique_lock<boost::mutex> lock(m_lock);
+  while (m_idle.empty() && m_clients >= m_max_clients)
+    m_returned.wait(lock);
+  generation = m_generation;
+  if (!m_idle.empty())
+  {
+    std::unique_ptr<client> c = std::move(m_idle.back());
+    m_idle.pop_back();
+    return c;
+  }
+  ++m_clients;
+  lock.unlock();
+  // connects on its first call, to the host in the call's url
+  try { return std::unique_ptr<client>(new client()); }
+  catch (...)
+  {
+    lock.lock();
+    --m_clients;
+    m_returned.notify_one();
+    throw;
+  }
+}
+
+void http_client_pool::give_back(std::unique_ptr<client> c, const std::uint64_t generation) noexcept
+{
+  {
+    const boost::lock_guard<boost::mutex> lock(m_lock);
+    if (generation == m_generation)
+    {
+      m_idle.push_back(std::move(c));
+    }
+    else
+    {
+      // from before clear(), destroyed below once unlocked
+      --m_clients;
+    }
+  }
+  m_returned.notify_one();
+}
+}
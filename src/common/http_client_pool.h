@@ -0,0 +1,94 @@
+// Copyright (c) 2014-2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "include_base_utils.h"
+#include "net/http_client.h"
+
+namespace tools
+{
+//! Connections to one HTTP server, which threads take one at a time so calls overlap.
+class http_client_pool
+{
+public:
+  typedef epee::net_utils::http::http_simple_client client;
+
+  //! A client taken from the pool until `release()` or destruction.
+  class lease
+  {
+  public:
+    //! Waits for a client if the pool has `max_clients` of them out already.
+    explicit lease(http_client_pool& pool);
+    ~lease() { release(); }
+
+    client& get() noexcept { return *m_client; }
+
+    //! Gives the client back early, as `boost::unique_lock::unlock()` does.
+    void release() noexcept;
+
+  private:
+    lease(const lease&) = delete;
+    lease& operator=(const lease&) = delete;
+
+    http_client_pool& m_pool;
+    std::unique_ptr<client> m_client;
+    std::uint64_t m_generation;
+  };
+
+  //! Creates clients as they are needed, at most `max_clients` (at least 1).
+  explicit http_client_pool(std::size_t max_clients);
+  ~http_client_pool();
+
+  //! Drops all connections, the leased ones when they come back, e.g. when the server changes.
+  void clear();
+
+  std::size_t get_max_clients() const noexcept { return m_max_clients; }
+
+private:
+  http_client_pool(const http_client_pool&) = delete;
+  http_client_pool& operator=(const http_client_pool&) = delete;
+
+  std::unique_ptr<client> take(std::uint64_t& generation);
+  void give_back(std::unique_ptr<client> c, std::uint64_t generation) noexcept;
+
+  boost::mutex m_lock;
+  boost::condition_variable m_returned;
+  std::vector<std::unique_ptr<client>> m_idle;
+  std::size_t m_clients; //!< idle and leased
+  const std::size_t m_max_clients;
+  std::uint64_t m_generation; //!< bumped by clear(), clients from before are not reused
+};
+}
@@ -0,0 +1,77 @@
+// Copyright (c) 2014-2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#ifdef __linux__
+#include <fstream>
+#include <unistd.h>
+#endif
+
+namespace tools
+{
+
+/*! Estimated heap bytes of a hash container (std::unordered_map, std::unordered_set):
+each element has a node of its own, with a link and the cached hash, and the bucket
+array holds a pointer per bucket. What the elements own is not counted, nor is the
+allocator's overhead. */
+template<typename T>
+uint64_t unordered_container_bytes(const T &c)
+{
+  return c.size() * (sizeof(typename T::value_type) + 2 * sizeof(void*)) + c.bucket_count() * sizeof(void*);
+}
+
+/*! Estimated heap bytes of a tree container (std::map, std::set), whose nodes hold
+three links and a colour besides the element. */
+template<typename T>
+uint64_t tree_container_bytes(const T &c)
+{
+  return c.size() * (sizeof(typename T::value_type) + 4 * sizeof(void*));
+}
+
+template<typename T>
+uint64_t vector_bytes(const std::vector<T> &v)
+{
+  return v.capacity() * sizeof(T);
+}
+
+/*! Resident set size of this process in bytes, 0 where it is not known. */
+inline uint64_t resident_memory()
+{
+#ifdef __linux__
+  std::ifstream statm("/proc/self/statm");
+  uint64_t size = 0, resident = 0;
+  if (statm >> size >> resident)
+    return resident * sysconf(_SC_PAGESIZE);
+#endif
+  return 0;
+}
+
+}
@@ -0,0 +1,147 @@
+// Copyright (c) 2014-2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+#include <cstddef>
+#include <exception>
+#include <utility>
+#include <vector>
+
+#include "common/task_region.h"
+#include "common/thread_group.h"
+
+namespace tools
+{
+
+/*! Calls `f(first, last)` on consecutive ranges of at most `grain` indices
+covering `[begin, end)`, using the threads of `threads` and `this_thread`.
+Ranges are handed out one at a time as threads become free, so uneven ranges
+balance out; pick `grain` large enough for the call overhead not to matter.
+
+Once a call to `f` returns false or throws, ranges not yet started are
+skipped. The first exception thrown by `f`, on any thread, is rethrown here
+once the ranges already started are done.
+
+\return False iff a call to `f` returned false. */
+template<typename F>
+bool parallel_for(thread_group& threads, std::size_t begin, std::size_t end, std::size_t grain, F f)
+{
+  if (begin >= end) {
+    return true;
+  }
+  grain = std::max<std::size_t>(grain, 1);
+  const std::size_t ranges = (end - begin - 1) / grain + 1;
+  const std::size_t workers = std::min<std::size_t>(threads.count() + 1, ranges);
+
+  std::atomic<std::size_t> next(0);
+  std::atomic<bool> failed(false);
+  std::exception_ptr error;
+  boost::mutex error_lock;
+  auto work = [&] {
+    for (std::size_t r = next++; r < ranges && !failed; r = next++) {
+      const std::size_t first = begin + r * grain;
+      const std::size_t last = first + std::min(grain, end - first);
+      try {
+        if (!f(first, last)) {
+          failed = true;
+        }
+      }
+      catch (...) {
+        const boost::unique_lock<boost::mutex> lock(error_lock);
+        if (!error) {
+          error = std::current_exception();
+        }
+        failed = true;
+      }
+    }
+  };
+
+  if (workers == 1) {
+    work();
+  }
+  else {
+    task_region(threads, [&] (task_region_handle& region) {
+      for (std::size_t n = 1; n < workers; ++n) {
+        region.run([&work] { work(); });
+      }
+      work();
+    });
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+  return !failed;
+}
+
+/*! Sets `out[i] = f(first[i])` for every `i` in `[0, last - first)`, split
+in ranges of `grain` elements as `parallel_for` does. `first` and `out` must
+be random access iterators. The first exception thrown by `f` is rethrown
+here, after which some of `out` may not have been set. */
+template<typename InputIt, typename OutputIt, typename F>
+void parallel_transform(thread_group& threads, InputIt first, InputIt last, OutputIt out, std::size_t grain, F f)
+{
+  parallel_for(threads, 0, last - first, grain, [&] (std::size_t b, std::size_t e) {
+    for (std::size_t i = b; i < e; ++i) {
+      out[i] = f(first[i]);
+    }
+    return true;
+  });
+}
+
+/*! Splits `[begin, end)` in ranges of `grain` indices as `parallel_for` does,
+computes `map(first, last)` for each range in parallel, then folds the
+results into `init` with `init = reduce(init, result)`, on `this_thread` and
+in range order, so the result does not depend on the scheduling.
+\return The folded result. */
+template<typename T, typename Map, typename Reduce>
+T parallel_reduce(thread_group& threads, std::size_t begin, std::size_t end, std::size_t grain, T init, Map map, Reduce reduce)
+{
+  if (begin >= end) {
+    return init;
+  }
+  grain = std::max<std::size_t>(grain, 1);
+  const std::size_t ranges = (end - begin - 1) / grain + 1;
+  std::vector<T> results(ranges, init);
+  parallel_for(threads, 0, ranges, 1, [&] (std::size_t b, std::size_t e) {
+    for (std::size_t r = b; r < e; ++r) {
+      const std::size_t first = begin + r * grain;
+      results[r] = map(first, first + std::min(grain, end - first));
+    }
+    return true;
+  });
+  for (T& result : results) {
+    init = reduce(std::move(init), std::move(result));
+  }
+  return init;
+}
+
+}
@@ -26,22 +26,188 @@
 // STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
 // THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+#include <map>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
 #include "perf_timer.h"
 
+#define PERF_PROFILE_MAX_PROBES 32
+
+namespace
+{
+  boost::mutex profiles_lock;
+  std::vector<tools::perf_thread_profile*> profiles;      // every profile ever made, under profiles_lock
+  std::vector<tools::perf_thread_profile*> free_profiles; // left by exited threads, under profiles_lock
+  std::map<std::string, std::pair<uint64_t, uint64_t>> baseline; // calls and ticks at the last reset, under profiles_lock
+
+  // to convert ticks to nanoseconds, against the clock at start-up
+  const uint64_t start_ticks = tools::get_perf_ticks();
+  const uint64_t start_ns = epee::misc_utils::get_ns_count();
+
+  void release_profile(tools::perf_thread_profile *p)
+  {
+    boost::lock_guard<boost::mutex> lock(profiles_lock);
+    free_profiles.push_back(p);
+  }
+
+  // hands the thread's profile back for reuse when it exits
+  boost::thread_specific_ptr<tools::perf_thread_profile> profile_owner(release_profile);
+
+  std::string get_path(const tools::perf_thread_profile &p, uint32_t idx)
+  {
+    std::string path;
+    for (size_t depth = 0; idx != tools::perf_thread_profile::root && depth < PERF_PROFILE_DEPTH; ++depth)
+    {
+      const tools::perf_thread_profile::node &n = p.nodes[idx];
+      const char *name = n.name.load(std::memory_order_acquire);
+      path = path.empty() ? std::string(name) : std::string(name) + ";" + path;
+      idx = n.parent;
+    }
+    return path;
+  }
+}
+
 namespace tools
 {
 
-int performance_timer_log_level = 2;
-__thread std::vector<PerformanceTimer*> *performance_timers = NULL;
+std::atomic<bool> performance_timers_enabled(true);
+__thread perf_thread_profile *performance_timers = NULL;
+
+perf_thread_profile::perf_thread_profile(): depth(0), dropped(0)
+{
+  for (node &n: nodes)
+  {
+    n.name = NULL;
+    n.parent = root;
+    n.calls = 0;
+    n.ticks = 0;
+  }
+}
+
+uint32_t perf_thread_profile::get_node(uint32_t parent, const char *name)
+{
+  uint64_t h = (uint64_t)(uintptr_t)name ^ ((uint64_t)parent << 32);
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdull;
+  h ^= h >> 33;
+  uint32_t idx = h % PERF_PROFILE_NODES;
+  for (size_t probe = 0; probe < PERF_PROFILE_MAX_PROBES; ++probe, idx = (idx + 1) % PERF_PROFILE_NODES)
+  {
+    node &n = nodes[idx];
+    // only this thread writes, so relaxed is enough here
+    const char *node_name = n.name.load(std::memory_order_relaxed);
+    if (!node_name)
+    {
+      n.parent = parent;
+      n.name.store(name, std::memory_order_release);
+      return idx;
+    }
+    if (node_name == name && n.parent == parent)
+      return idx;
+  }
+  return root;
+}
+
+perf_thread_profile *get_perf_thread_profile()
+{
+  perf_thread_profile *p = NULL;
+  {
+    boost::lock_guard<boost::mutex> lock(profiles_lock);
+    if (!free_profiles.empty())
+    {
+      p = free_profiles.back();
+      free_profiles.pop_back();
+    }
+    else
+    {
+      p = new perf_thread_profile();
+      profiles.push_back(p);
+    }
+  }
+  profile_owner.reset(p);
+  performance_timers = p;
+  return p;
+}
+
+void set_performance_timers_enabled(bool enabled)
+{
+  performance_timers_enabled = enabled;
+}
+
+bool get_performance_timers_enabled()
+{
+  return performance_timers_enabled;
+}
+
+std::vector<perf_profile_entry> get_performance_profile(bool reset, uint64_t &dropped)
+{
+  std::map<std::string, std::pair<uint64_t, uint64_t>> merged;
+  dropped = 0;
+
+  boost::lock_guard<boost::mutex> lock(profiles_lock);
+  for (const perf_thread_profile *p: profiles)
+  {
+    for (uint32_t idx = 0; idx < PERF_PROFILE_NODES; ++idx)
+    {
+      const perf_thread_profile::node &n = p->nodes[idx];
+      if (!n.name.load(std::memory_order_acquire))
+        continue;
+      std::pair<uint64_t, uint64_t> &m = merged[get_path(*p, idx)];
+      m.first += n.calls.load(std::memory_order_relaxed);
+      m.second += n.ticks.load(std::memory_order_relaxed);
+    }
+    dropped += p->dropped.load(std::memory_order_relaxed);
+  }
+
+  const uint64_t elapsed_ticks = get_perf_ticks() - start_ticks;
+  const uint64_t elapsed_ns = epee::misc_utils::get_ns_count() - start_ns;
+  const double ns_per_tick = elapsed_ticks ? (double)elapsed_ns / elapsed_ticks : 1.0;
+
+  std::vector<perf_profile_entry> entries;
+  std::map<std::string, size_t> indices;
+  for (const auto &m: merged)
+  {
+    uint64_t calls = m.second.first, ticks = m.second.second;
+    const auto b = baseline.find(m.first);
+    if (b != baseline.end())
+    {
+      calls -= std::min(calls, b->second.first);
+      ticks -= std::min(ticks, b->second.second);
+    }
+    if (!calls)
+      continue;
+    const uint64_t ns = ticks * ns_per_tick;
+    indices[m.first] = entries.size();
+    entries.push_back({m.first, calls, ns, ns});
+  }
+  for (const perf_profile_entry &e: entries)
+  {
+    const size_t sep = e.path.rfind(';');
+    if (sep == std::string::npos)
+      continue;
+    const auto parent = indices.find(e.path.substr(0, sep));
+    if (parent != indices.end())
+    {
+      perf_profile_entry &pe = entries[parent->second];
+      pe.self_ns -= std::min(pe.self_ns, e.total_ns);
+    }
+  }
+
+  if (reset)
+    baseline = std::move(merged);
+  return entries;
+}
 
-void set_performance_timer_log_level(int level)
+std::string get_performance_profile_folded(const std::vector<perf_profile_entry> &entries)
 {
-  if (level < LOG_LEVEL_MIN || level > LOG_LEVEL_MAX)
+  std::string folded;
+  for (const perf_profile_entry &e: entries)
   {
-    LOG_PRINT_L0("Wrong log level: " << level << ", using 2");
-    level = 2;
+    const uint64_t self_us = e.self_ns / 1000;
+    if (self_us)
+      folded += e.path + " " + std::to_string(self_us) + "\n";
   }
-  performance_timer_log_level = level;
+  return folded;
 }
 
 }
@@ -28,65 +28,137 @@
 
 #pragma once
 
+#include <atomic>
 #include <string>
-#include <stdio.h>
+#include <vector>
+#include <stdint.h>
 #include "misc_log_ex.h"
 
+#define PERF_PROFILE_NODES 512
+#define PERF_PROFILE_DEPTH 32
+
 namespace tools
 {
 
-class PerformanceTimer;
+/*! Call tree of the PERF_TIMER scopes run by one thread.
+
+  Nodes are a fixed open addressed table keyed by (parent node, name), the
+  name being the string literal given to PERF_TIMER, so names are compared by
+  address. Only the owning thread writes to it, and it publishes a node's key
+  by storing its name last, so dumps can read it from any thread without
+  locks. Scopes that do not fit, too deep or past a full table, only count as
+  dropped.
+*/
+struct perf_thread_profile
+{
+  static const uint32_t root = (uint32_t)-1;
 
-extern int performance_timer_log_level;
-extern __thread std::vector<PerformanceTimer*> *performance_timers;
+  struct node
+  {
+    std::atomic<const char*> name; //!< null while the node is unused
+    uint32_t parent;
+    std::atomic<uint64_t> calls;
+    std::atomic<uint64_t> ticks;
+  };
+
+  perf_thread_profile();
+
+  //! index of the child node of parent for name, or root if the table is full
+  uint32_t get_node(uint32_t parent, const char *name);
+
+  node nodes[PERF_PROFILE_NODES];
+  uint32_t stack[PERF_PROFILE_DEPTH]; //!< owner only, the nodes of the open scopes
+  uint32_t depth;                     //!< owner only
+  std::atomic<uint64_t> dropped;
+};
+
+extern std::atomic<bool> performance_timers_enabled;
+extern __thread perf_thread_profile *performance_timers;
+
+//! the profile of the calling thread, registered on first use
+perf_thread_profile *get_perf_thread_profile();
+
+//! ticks of the time stamp counter where there is one, nanoseconds otherwise
+inline uint64_t get_perf_ticks();
 
 class PerformanceTimer
 {
 public:
-  PerformanceTimer(const std::string &s, int l = LOG_LEVEL_2): name(s), level(l), started(false)
+  PerformanceTimer(const char *name): profile(NULL)
   {
-    ticks = epee::misc_utils::get_tick_count();
-    if (!performance_timers)
-    {
-      LOG_PRINT("PERF             ----------", level);
-      performance_timers = new std::vector<PerformanceTimer*>();
-    }
-    else
+    if (!performance_timers_enabled.load(std::memory_order_relaxed))
+      return;
+    perf_thread_profile *p = performance_timers ? performance_timers : get_perf_thread_profile();
+    const uint32_t parent = p->depth ? p->stack[p->depth - 1] : perf_thread_profile::root;
+    uint32_t n;
+    if (p->depth == PERF_PROFILE_DEPTH || (n = p->get_node(parent, name)) == perf_thread_profile::root)
     {
-      PerformanceTimer *pt = performance_timers->back();
-      if (!pt->started)
-      {
-        LOG_PRINT("PERF           " << std::string((performance_timers->size()-1) * 2, ' ') << "  " << pt->name, pt->level);
-        pt->started = true;
-      }
+      p->dropped.store(p->dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      return;
     }
-    performance_timers->push_back(this);
+    p->stack[p->depth++] = n;
+    profile = p;
+    ticks = get_perf_ticks();
   }
 
   ~PerformanceTimer()
   {
-    performance_timers->pop_back();
-    ticks = epee::misc_utils::get_tick_count() - ticks;
-    char s[12];
-    snprintf(s, sizeof(s), "%8llu  ", (unsigned long long)ticks);
-    LOG_PRINT("PERF " << s << std::string(performance_timers->size() * 2, ' ') << "  " << name, level);
-    if (performance_timers->empty())
-    {
-      delete performance_timers;
-      performance_timers = NULL;
-    }
+    if (!profile)
+      return;
+    const uint64_t elapsed = get_perf_ticks() - ticks;
+    perf_thread_profile::node &n = profile->nodes[profile->stack[--profile->depth]];
+    // single writer, no need for locked adds
+    n.calls.store(n.calls.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    n.ticks.store(n.ticks.load(std::memory_order_relaxed) + elapsed, std::memory_order_relaxed);
   }
 
 private:
-  std::string name;
-  int level;
+  perf_thread_profile *profile;
   uint64_t ticks;
-  bool started;
 };
 
-void set_performance_timer_log_level(int level);
+/*! One call path of the merged profile of all threads, names joined by ';'
+*/
+struct perf_profile_entry
+{
+  std::string path;
+  uint64_t calls;
+  uint64_t total_ns;
+  uint64_t self_ns; //!< total_ns less the children's
+};
+
+void set_performance_timers_enabled(bool enabled);
+bool get_performance_timers_enabled();
+
+/*! Merges all threads' profiles by call path, less what they held at the
+  last reset, if reset is set starting again from there.
 
-#define PERF_TIMER(name) tools::PerformanceTimer pt_##name(#name, tools::performance_timer_log_level)
-#define PERF_TIMER_L(name, l) tools::PerformanceTimer pt_##name(#name, l)
+  \param dropped return-by-reference scopes not recorded
+*/
+std::vector<perf_profile_entry> get_performance_profile(bool reset, uint64_t &dropped);
 
+//! entries as folded stacks of self microseconds, as read by flame graph tools
+std::string get_performance_profile_folded(const std::vector<perf_profile_entry> &entries);
+
+#define PERF_TIMER(name) tools::PerformanceTimer pt_##name(#name)
+#define PERF_TIMER_L(name, l) tools::PerformanceTimer pt_##name(#name)
+
+}
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define PERF_TICKS_ARE_TSC 1
+#endif
+
+inline uint64_t tools::get_perf_ticks()
+{
+#ifdef PERF_TICKS_ARE_TSC
+  return __rdtsc();
+#else
+  return epee::misc_utils::get_ns_count();
+#endif
 }
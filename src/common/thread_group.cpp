@@ -29,11 +29,19 @@
 
 #include <boost/thread/locks.hpp>
 #include <cassert>
+#include <chrono>
 #include <limits>
 #include <stdexcept>
 
 #include "common/util.h"
 
+namespace
+{
+  // the group, and the queue in it, of the thread_group thread running here
+  __thread const void* current_group = nullptr;
+  __thread std::size_t current_queue = 0;
+}
+
 namespace tools
 {
 std::size_t thread_group::optimal() {
@@ -57,14 +65,21 @@ thread_group::thread_group(std::size_t count) : internal() {
 
 thread_group::data::data(std::size_t count)
   : threads()
-  , head{nullptr}
-  , last(std::addressof(head))
-  , mutex()
+  , queues()
   , has_work()
+  , mutex()
+  , queued(0)
+  , sleeping(0)
+  , next_queue(0)
+  , busy(0)
   , stop(false) {
+  queues.reserve(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    queues.emplace_back(new worker_queue());
+  }
   threads.reserve(count);
-  while (count--) {
-    threads.push_back(boost::thread(&thread_group::data::run, this));
+  for (std::size_t i = 0; i < count; ++i) {
+    threads.push_back(boost::thread(&thread_group::data::run, this, i));
   }
 }
 
@@ -82,15 +97,41 @@ thread_group::data::~data() noexcept {
   }
 }
 
-std::unique_ptr<thread_group::data::work> thread_group::data::get_next() noexcept {
-  std::unique_ptr<work> rc = std::move(head.ptr);
-  if (rc != nullptr) {
-    head.ptr = std::move(rc->next.ptr);
-    if (head.ptr == nullptr) {
-      last = std::addressof(head);
+std::size_t thread_group::data::own_queue() const noexcept {
+  return current_group == this ? current_queue : queues.size();
+}
+
+bool thread_group::data::get_next(std::size_t first, std::function<void()>& next) noexcept {
+  for (std::size_t i = 0; i < queues.size() && queued != 0; ++i) {
+    worker_queue& queue = *queues[(first + i) % queues.size()];
+    const boost::unique_lock<boost::mutex> lock(queue.mutex);
+    if (!queue.work.empty()) {
+      next = std::move(queue.work.front());
+      queue.work.pop_front();
+      --queued;
+      return true;
     }
   }
-  return rc;
+  return false;
+}
+
+void thread_group::data::execute(std::function<void()>& next) noexcept {
+  assert(next);
+  const auto start = std::chrono::steady_clock::now();
+  next();
+  busy += std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now() - start
+  ).count();
+  // release what `next` captured before waiting for more work
+  next = nullptr;
+}
+
+bool thread_group::data::set_affinity(unsigned first_cpu) {
+  bool pinned = true;
+  for (std::size_t i = 0; i < threads.size(); ++i) {
+    pinned &= set_thread_affinity(threads[i].native_handle(), first_cpu + i);
+  }
+  return pinned;
 }
 
 bool thread_group::data::try_run_one() noexcept {
@@ -103,48 +144,54 @@ bool thread_group::data::try_run_one() noexcept {
   cases (std::bad_alloc). This was the existing behavior;
   `asio::io_service::run` propogates errors from dispatched calls, and uncaught
   exceptions on threads result in process termination. */
-  std::unique_ptr<work> next = nullptr;
-  {
-    const boost::unique_lock<boost::mutex> lock(mutex);
-    next = get_next();
+  std::size_t first = own_queue();
+  if (first == queues.size()) {
+    first = 0;
   }
-  if (next) {
-    assert(next->f);
-    next->f();
+  std::function<void()> next = nullptr;
+  if (get_next(first, next)) {
+    execute(next);
     return true;
   }
   return false;
 }
 
-void thread_group::data::run() noexcept {
+void thread_group::data::run(std::size_t index) noexcept {
   // see `try_run_one()` source for additional information
-  while (true) {
-    std::unique_ptr<work> next = nullptr;
-    {
-      boost::unique_lock<boost::mutex> lock(mutex);
-      has_work.wait(lock, [this] { return head.ptr != nullptr || stop; });
-      if (stop) {
-        return;
-      }
-      next = get_next();
+  current_group = this;
+  current_queue = index;
+  std::function<void()> next = nullptr;
+  while (!stop) {
+    if (get_next(index, next)) {
+      execute(next);
+      continue;
     }
-    assert(next != nullptr);
-    assert(next->f);
-    next->f();
+    /* `dispatch` increments `queued` before reading `sleeping`, and this
+    increments `sleeping` before reading `queued`, so either this thread sees
+    the new function or `dispatch` sees this thread and wakes it. */
+    boost::unique_lock<boost::mutex> lock(mutex);
+    ++sleeping;
+    has_work.wait(lock, [this] { return queued != 0 || stop; });
+    --sleeping;
   }
 }
 
 void thread_group::data::dispatch(std::function<void()> f) {
-  std::unique_ptr<work> latest(new work{std::move(f), node{nullptr}});
-  node* const latest_node = std::addressof(latest->next);
+  // functions dispatched from a thread of this group go on its own queue
+  std::size_t index = own_queue();
+  if (index == queues.size()) {
+    index = next_queue++ % queues.size();
+  }
   {
-    const boost::unique_lock<boost::mutex> lock(mutex);
-    assert(last != nullptr);
-    assert(last->ptr == nullptr);
-
-    last->ptr = std::move(latest);
-    last = latest_node;
+    worker_queue& queue = *queues[index];
+    const boost::unique_lock<boost::mutex> lock(queue.mutex);
+    queue.work.push_back(std::move(f));
+    ++queued;
+  }
+  if (sleeping != 0) {
+    // the sleeper holds `mutex` until it waits, so the notify is not lost
+    { const boost::unique_lock<boost::mutex> lock(mutex); }
+    has_work.notify_one();
   }
-  has_work.notify_one(); 
 }
 }
@@ -31,8 +31,12 @@
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/thread.hpp>
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
+#include <deque>
 #include <functional>
+#include <memory>
 #include <thread>
 #include <utility>
 #include <vector>
@@ -73,6 +77,31 @@ public:
     return 0;
   }
 
+  //! \return Number of dispatched functions that have not started yet.
+  std::size_t queue_depth() const noexcept {
+    if (internal) {
+      return internal->queue_depth();
+    }
+    return 0;
+  }
+
+  //! \return Total time spent running dispatched functions, in microseconds.
+  std::uint64_t busy_time() const noexcept {
+    if (internal) {
+      return internal->busy_time();
+    }
+    return 0;
+  }
+
+  /*! Pins the i'th thread of `this` group to CPU `first_cpu + i`, modulo the
+  number of CPUs. \return False if any thread could not be pinned. */
+  bool set_affinity(unsigned first_cpu) {
+    if (internal) {
+      return internal->set_affinity(first_cpu);
+    }
+    return true;
+  }
+
   //! \return True iff a function was available and executed (on `this_thread`).
   bool try_run_one() noexcept {
     if (internal) {
@@ -105,34 +134,50 @@ private:
       return threads.size();
     }
 
+    std::size_t queue_depth() const noexcept {
+      return queued;
+    }
+
+    std::uint64_t busy_time() const noexcept {
+      return busy;
+    }
+
     bool try_run_one() noexcept;
     void dispatch(std::function<void()> f);
+    bool set_affinity(unsigned first_cpu);
 
   private:
-    struct work;
-
-    struct node {
-      std::unique_ptr<work> ptr;
+    /*! Each thread has its own queue, so dispatching and running short
+    functions does not serialize every thread on one lock. Threads that run
+    out of work take from the front of the other queues. */
+    struct worker_queue {
+      boost::mutex mutex;
+      std::deque<std::function<void()>> work;
     };
 
-    struct work {
-      std::function<void()> f;
-      node next;
-    };
+    /*! Takes the oldest function from queue `first`, or failing that from
+    the other queues in turn. */
+    bool get_next(std::size_t first, std::function<void()>& next) noexcept;
 
-    //! Requires lock on `mutex`.
-    std::unique_ptr<work> get_next() noexcept;
+    //! \return Index of the queue `this_thread` uses, or `queues.size()`.
+    std::size_t own_queue() const noexcept;
 
     //! Blocks until destructor is invoked, only call from thread.
-    void run() noexcept;
+    void run(std::size_t index) noexcept;
+
+    //! Runs `next` and accounts for the time spent in `busy`.
+    void execute(std::function<void()>& next) noexcept;
 
   private:
     std::vector<boost::thread> threads;
-    node head;
-    node* last;
+    std::vector<std::unique_ptr<worker_queue>> queues;
     boost::condition_variable has_work;
-    boost::mutex mutex;
-    bool stop;
+    boost::mutex mutex; //!< taken to sleep on `has_work`, and to wake sleepers
+    std::atomic<std::size_t> queued;
+    std::atomic<std::size_t> sleeping;
+    std::atomic<std::size_t> next_queue;
+    std::atomic<std::uint64_t> busy;
+    std::atomic<bool> stop;
   };
 
 private:
@@ -29,6 +29,7 @@
 // Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
 
 #include <cstdio>
+#include <cstdlib>
 
 #include "include_base_utils.h"
 using namespace epee;
@@ -43,6 +44,10 @@ using namespace epee;
 #else 
 #include <sys/utsname.h>
 #endif
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
 #include <boost/filesystem.hpp>
 
 
@@ -531,4 +536,47 @@ std::string get_nix_version_display_string()
     boost::lock_guard<boost::mutex> lock(max_concurrency_lock);
     return max_concurrency;
   }
+
+  bool set_thread_affinity(boost::thread::native_handle_type thread, unsigned cpu)
+  {
+    const unsigned cpus = boost::thread::hardware_concurrency();
+    if (cpus == 0)
+      return false;
+    cpu %= cpus;
+#if defined(WIN32)
+    if (cpu >= sizeof(DWORD_PTR) * 8)
+      return false;
+    return SetThreadAffinityMask(thread, DWORD_PTR(1) << cpu) != 0;
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(thread, sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+  }
+
+  void run_notify_command(const std::string& command, const std::string& arg)
+  {
+    std::string cmd = command;
+    for (size_t pos = cmd.find("%s"); pos != std::string::npos; pos = cmd.find("%s", pos + arg.size()))
+      cmd.replace(pos, 2, arg);
+    boost::thread([cmd]() {
+      const int status = std::system(cmd.c_str());
+      if (status != 0)
+        LOG_PRINT_L1("Notify command \"" << cmd << "\" returned " << status);
+    }).detach();
+  }
+
+  bool set_thread_affinity(unsigned cpu)
+  {
+#if defined(WIN32)
+    return set_thread_affinity(GetCurrentThread(), cpu);
+#elif defined(__linux__)
+    return set_thread_affinity(pthread_self(), cpu);
+#else
+    return false;
+#endif
+  }
 }
@@ -32,6 +32,7 @@
 
 #include <boost/thread/locks.hpp>
 #include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
 #include <csignal>
 #include <cstdio>
 #include <functional>
@@ -180,4 +181,22 @@ namespace tools
 
   void set_max_concurrency(unsigned n);
   unsigned get_max_concurrency();
+
+  /*! \brief pins a thread to a single CPU, counted modulo the number of CPUs
+   *
+   * With the OS's usual first-touch policy, memory the thread allocates
+   * afterwards is then local to that CPU's NUMA node.
+   *
+   * \return false if not supported on this platform, or the OS refused
+   */
+  bool set_thread_affinity(boost::thread::native_handle_type thread, unsigned cpu);
+
+  //! \brief pins the calling thread to a single CPU, see above
+  bool set_thread_affinity(unsigned cpu);
+
+  /*! \brief runs a shell command in the background, without waiting for it
+   *
+   * Each "%s" in command is replaced by arg first.
+   */
+  void run_notify_command(const std::string& command, const std::string& arg);
 }
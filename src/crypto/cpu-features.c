@@ -0,0 +1,223 @@
+// Copyright (c) 2014-2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 
+#include <stdlib.h>
+#include <string.h>
+
+#include "cpu-features.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define CPU_FEATURES_X86
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#elif defined(__aarch64__) && defined(__linux__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+static const char *const feature_names[CPU_FEATURE_COUNT] = {
+  "aes", "sse2", "avx2", "avx512f", "bmi2", "adx", "neon"
+};
+
+// -1 until detected; detection gives the same answer on every thread, so
+// racing threads at most do it twice
+static volatile int64_t detected_features = -1;
+static volatile int64_t env_features = -1;
+static volatile uint32_t features_mask = ~(uint32_t)0;
+
+#if defined(CPU_FEATURES_X86)
+
+static void cpuid_count(uint32_t leaf, uint32_t subleaf, uint32_t regs[4])
+{
+#if defined(_MSC_VER)
+  __cpuidex((int *)regs, leaf, subleaf);
+#else
+  __asm__ __volatile__ ("cpuid" : "=a" (regs[0]), "=b" (regs[1]), "=c" (regs[2]), "=d" (regs[3]) : "a" (leaf), "c" (subleaf));
+#endif
+}
+
+// which register sets the OS saves on context switches
+static uint64_t xgetbv0(void)
+{
+#if defined(_MSC_VER)
+  return _xgetbv(0);
+#else
+  uint32_t lo, hi;
+  __asm__ __volatile__ (".byte 0x0f, 0x01, 0xd0" : "=a" (lo), "=d" (hi) : "c" (0));
+  return ((uint64_t)hi << 32) | lo;
+#endif
+}
+
+static uint32_t detect(void)
+{
+  uint32_t regs[4], max_leaf, features = 0;
+  uint64_t xcr0 = 0;
+
+  cpuid_count(0, 0, regs);
+  max_leaf = regs[0];
+  if (max_leaf < 1)
+    return 0;
+
+  cpuid_count(1, 0, regs);
+  if (regs[3] & (1 << 26))
+    features |= CPU_FEATURE_SSE2;
+  if (regs[2] & (1 << 25))
+    features |= CPU_FEATURE_AES;
+  if (regs[2] & (1 << 27))  // OSXSAVE
+    xcr0 = xgetbv0();
+
+  if (max_leaf < 7)
+    return features;
+  cpuid_count(7, 0, regs);
+  if ((regs[1] & (1 << 5)) && (xcr0 & 0x06) == 0x06)
+    features |= CPU_FEATURE_AVX2;
+  if ((regs[1] & (1 << 16)) && (xcr0 & 0xe6) == 0xe6)
+    features |= CPU_FEATURE_AVX512F;
+  if (regs[1] & (1 << 8))
+    features |= CPU_FEATURE_BMI2;
+  if (regs[1] & (1 << 19))
+    features |= CPU_FEATURE_ADX;
+  return features;
+}
+
+#elif defined(__aarch64__)
+
+static uint32_t detect(void)
+{
+  uint32_t features = CPU_FEATURE_NEON;
+#if defined(__ARM_FEATURE_CRYPTO)
+  features |= CPU_FEATURE_AES;
+#elif defined(__linux__) && defined(HWCAP_AES)
+  if (getauxval(AT_HWCAP) & HWCAP_AES)
+    features |= CPU_FEATURE_AES;
+#endif
+  return features;
+}
+
+#else
+
+static uint32_t detect(void)
+{
+  return 0;
+}
+
+#endif
+
+static int env_says_yes(const char *name)
+{
+  const char *env = getenv(name);
+  return env && strcmp(env, "0") && strcmp(env, "no");
+}
+
+// the features MONERO_DISABLE_CPU_FEATURES names
+static uint32_t env_disabled(void)
+{
+  const char *env = getenv("MONERO_DISABLE_CPU_FEATURES");
+  uint32_t disabled = 0;
+  size_t len, i;
+
+  if (!env)
+    return 0;
+  if (!strcmp(env, "all"))
+    return ~(uint32_t)0;
+  while (*env)
+  {
+    len = strcspn(env, ",");
+    for (i = 0; i < CPU_FEATURE_COUNT; i++)
+      if (strlen(feature_names[i]) == len && !strncmp(env, feature_names[i], len))
+        disabled |= 1u << i;
+    env += len;
+    if (*env == ',')
+      ++env;
+  }
+  return disabled;
+}
+
+uint32_t cpu_features_detected(void)
+{
+  uint32_t features;
+
+  if (detected_features >= 0)
+    return (uint32_t)detected_features;
+  features = detect();
+  detected_features = features;
+  return features;
+}
+
+uint32_t cpu_features(void)
+{
+  uint32_t allowed;
+
+  if (env_features >= 0)
+    return (uint32_t)env_features & features_mask;
+  allowed = cpu_features_detected() & ~env_disabled();
+  if (env_says_yes("MONERO_USE_SOFTWARE_AES"))
+    allowed &= ~(uint32_t)CPU_FEATURE_AES;
+  env_features = allowed;
+  return allowed & features_mask;
+}
+
+void cpu_features_set_mask(uint32_t mask)
+{
+  features_mask = mask;
+}
+
+const char *cpu_feature_name(uint32_t feature)
+{
+  uint32_t i;
+
+  for (i = 0; i < CPU_FEATURE_COUNT; i++)
+    if (feature == 1u << i)
+      return feature_names[i];
+  return NULL;
+}
+
+void cpu_features_describe(uint32_t features, char *buf, size_t size)
+{
+  size_t used = 0, len;
+  uint32_t i;
+
+  if (size == 0)
+    return;
+  buf[0] = 0;
+  for (i = 0; i < CPU_FEATURE_COUNT; i++)
+  {
+    if (!(features & (1u << i)))
+      continue;
+    len = strlen(feature_names[i]);
+    if (used + (used ? 1 : 0) + len + 1 > size)
+      break;
+    if (used)
+      buf[used++] = ' ';
+    memcpy(buf + used, feature_names[i], len + 1);
+    used += len;
+  }
+  if (!used && size > 4)
+    memcpy(buf, "none", 5);
+}
@@ -0,0 +1,81 @@
+// Copyright (c) 2014-2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/* What the crypto kernels may use. The CPU is asked once, the first time
+ * any of this is called, and code picking between kernels at run time
+ * checks cpu_features() rather than asking the CPU itself, so that all of
+ * it can be turned down together:
+ *
+ * - MONERO_DISABLE_CPU_FEATURES, a comma separated list of feature names
+ *   (see cpu_feature_name), or "all", hides those features
+ * - MONERO_USE_SOFTWARE_AES, as before, hides "aes"
+ * - cpu_features_set_mask does the same from code, for tests
+ */
+enum {
+  CPU_FEATURE_AES     = 1 << 0,  // AES-NI, or the ARMv8 AES instructions
+  CPU_FEATURE_SSE2    = 1 << 1,
+  CPU_FEATURE_AVX2    = 1 << 2,  // only if the OS saves the ymm registers
+  CPU_FEATURE_AVX512F = 1 << 3,  // only if the OS saves the zmm registers
+  CPU_FEATURE_BMI2    = 1 << 4,
+  CPU_FEATURE_ADX     = 1 << 5,
+  CPU_FEATURE_NEON    = 1 << 6,
+  CPU_FEATURE_COUNT   = 7
+};
+
+// the features the CPU has and the overrides leave in
+uint32_t cpu_features(void);
+
+// the features the CPU has, whatever the overrides say
+uint32_t cpu_features_detected(void);
+
+// hides the detected features not in mask, ~0 shows them all again
+void cpu_features_set_mask(uint32_t mask);
+
+// "aes", "sse2", ... for a single CPU_FEATURE_* bit, NULL otherwise
+const char *cpu_feature_name(uint32_t feature);
+
+// space separated names of the features in features, "none" if empty
+void cpu_features_describe(uint32_t features, char *buf, size_t size);
+
+// the kernel each dispatched operation currently goes to
+const char *cn_slow_hash_kernel(void);
+const char *keccak_batch_kernel(void);
+const char *fe_mul_kernel(void);
+
+#if defined(__cplusplus)
+}
+#endif
@@ -33,6 +33,7 @@
 
 #include "warnings.h"
 #include "crypto-ops.h"
+#include "cpu-features.h"
 
 DISABLE_VS_WARNINGS(4146 4244)
 
@@ -341,6 +342,126 @@ static int fe_isnonzero(const fe f) {
     s[27] | s[28] | s[29] | s[30] | s[31]) - 1) >> 8) + 1;
 }
 
+/* New code */
+
+/*
+Where the compiler has 128-bit integers, fe_mul, fe_sq and fe_sq2 pack their
+operands into five 51-bit limbs, multiply those with 64x64->128 bit products
+and split the result back into ten limbs. This takes 25 multiplications
+rather than 100 and keeps the pre and postconditions of the ref10 versions.
+*/
+
+#if defined(__SIZEOF_INT128__)
+#define FE_MUL_INT128
+
+typedef __int128 fe_int128;
+
+#define FE_PACK51(F, f) \
+  int64_t F##0 = (int64_t) f[0] + (int64_t) f[1] * (1 << 26); \
+  int64_t F##1 = (int64_t) f[2] + (int64_t) f[3] * (1 << 26); \
+  int64_t F##2 = (int64_t) f[4] + (int64_t) f[5] * (1 << 26); \
+  int64_t F##3 = (int64_t) f[6] + (int64_t) f[7] * (1 << 26); \
+  int64_t F##4 = (int64_t) f[8] + (int64_t) f[9] * (1 << 26)
+
+/*
+h = r0 + 2^51 r1 + 2^102 r2 + 2^153 r3 + 2^204 r4
+
+Preconditions:
+   |r| bounded by 2^125.
+
+Postconditions:
+   |h| bounded by 2^25,1.01*2^24,2^25,2^24,etc.
+*/
+
+static void fe_reduce51(fe h, fe_int128 r0, fe_int128 r1, fe_int128 r2, fe_int128 r3, fe_int128 r4) {
+  const fe_int128 round51 = (fe_int128) 1 << 50;
+  fe_int128 carry;
+  int64_t h0, h1, h2, h3, h4;
+  int64_t c0, c1, c2, c3, c4;
+
+  carry = (r0 + round51) >> 51; r1 += carry; r0 -= carry << 51;
+  carry = (r1 + round51) >> 51; r2 += carry; r1 -= carry << 51;
+  carry = (r2 + round51) >> 51; r3 += carry; r2 -= carry << 51;
+  carry = (r3 + round51) >> 51; r4 += carry; r3 -= carry << 51;
+  carry = (r4 + round51) >> 51; r0 += carry * 19; r4 -= carry << 51;
+  carry = (r0 + round51) >> 51; r1 += carry; r0 -= carry << 51;
+  /* |r| bounded by 2^50, 2^50 + 2^13, 2^50, 2^50, 2^50 */
+
+  h0 = (int64_t) r0;
+  h1 = (int64_t) r1;
+  h2 = (int64_t) r2;
+  h3 = (int64_t) r3;
+  h4 = (int64_t) r4;
+  c0 = (h0 + (int64_t) (1<<25)) >> 26;
+  c1 = (h1 + (int64_t) (1<<25)) >> 26;
+  c2 = (h2 + (int64_t) (1<<25)) >> 26;
+  c3 = (h3 + (int64_t) (1<<25)) >> 26;
+  c4 = (h4 + (int64_t) (1<<25)) >> 26;
+
+  h[0] = (int32_t) (h0 - c0 * (1 << 26));
+  h[1] = (int32_t) c0;
+  h[2] = (int32_t) (h1 - c1 * (1 << 26));
+  h[3] = (int32_t) c1;
+  h[4] = (int32_t) (h2 - c2 * (1 << 26));
+  h[5] = (int32_t) c2;
+  h[6] = (int32_t) (h3 - c3 * (1 << 26));
+  h[7] = (int32_t) c3;
+  h[8] = (int32_t) (h4 - c4 * (1 << 26));
+  h[9] = (int32_t) c4;
+}
+
+static void fe_mul(fe h, const fe f, const fe g) {
+  FE_PACK51(F, f);
+  FE_PACK51(G, g);
+  /* |F|, |G| bounded by 1.66*2^51 */
+  int64_t G1_19 = 19 * G1;
+  int64_t G2_19 = 19 * G2;
+  int64_t G3_19 = 19 * G3;
+  int64_t G4_19 = 19 * G4;
+  fe_int128 r0 = (fe_int128) F0 * G0 + (fe_int128) F1 * G4_19 + (fe_int128) F2 * G3_19 + (fe_int128) F3 * G2_19 + (fe_int128) F4 * G1_19;
+  fe_int128 r1 = (fe_int128) F0 * G1 + (fe_int128) F1 * G0 + (fe_int128) F2 * G4_19 + (fe_int128) F3 * G3_19 + (fe_int128) F4 * G2_19;
+  fe_int128 r2 = (fe_int128) F0 * G2 + (fe_int128) F1 * G1 + (fe_int128) F2 * G0 + (fe_int128) F3 * G4_19 + (fe_int128) F4 * G3_19;
+  fe_int128 r3 = (fe_int128) F0 * G3 + (fe_int128) F1 * G2 + (fe_int128) F2 * G1 + (fe_int128) F3 * G0 + (fe_int128) F4 * G4_19;
+  fe_int128 r4 = (fe_int128) F0 * G4 + (fe_int128) F1 * G3 + (fe_int128) F2 * G2 + (fe_int128) F3 * G1 + (fe_int128) F4 * G0;
+  fe_reduce51(h, r0, r1, r2, r3, r4);
+}
+
+static void fe_sq51(fe h, const fe f, int times) {
+  FE_PACK51(F, f);
+  int64_t F0_2 = 2 * F0;
+  int64_t F1_2 = 2 * F1;
+  int64_t F2_2 = 2 * F2;
+  int64_t F3_2 = 2 * F3;
+  int64_t F3_19 = 19 * F3;
+  int64_t F4_19 = 19 * F4;
+  fe_int128 r0 = (fe_int128) F0 * F0 + (fe_int128) F1_2 * F4_19 + (fe_int128) F2_2 * F3_19;
+  fe_int128 r1 = (fe_int128) F0_2 * F1 + (fe_int128) F2_2 * F4_19 + (fe_int128) F3 * F3_19;
+  fe_int128 r2 = (fe_int128) F0_2 * F2 + (fe_int128) F1 * F1 + (fe_int128) F3_2 * F4_19;
+  fe_int128 r3 = (fe_int128) F0_2 * F3 + (fe_int128) F1_2 * F2 + (fe_int128) F4 * F4_19;
+  fe_int128 r4 = (fe_int128) F0_2 * F4 + (fe_int128) F1_2 * F3 + (fe_int128) F2 * F2;
+  fe_reduce51(h, times * r0, times * r1, times * r2, times * r3, times * r4);
+}
+
+static void fe_sq(fe h, const fe f) {
+  fe_sq51(h, f, 1);
+}
+
+static void fe_sq2(fe h, const fe f) {
+  fe_sq51(h, f, 2);
+}
+#endif
+
+/* Both versions only need the baseline instruction set, so the choice is
+   made when building, a call through a pointer for each multiplication
+   would cost more than the wider limbs save. */
+const char *fe_mul_kernel(void) {
+#if defined(FE_MUL_INT128)
+  return "64-bit limbs";
+#else
+  return "32-bit limbs";
+#endif
+}
+
 /* From fe_mul.c */
 
 /*
@@ -375,6 +496,7 @@ Can get away with 11 carries, but then data flow is much deeper.
 With tighter constraints on inputs can squeeze carries into int32.
 */
 
+#if !defined(FE_MUL_INT128)
 static void fe_mul(fe h, const fe f, const fe g) {
   int32_t f0 = f[0];
   int32_t f1 = f[1];
@@ -592,6 +714,7 @@ static void fe_mul(fe h, const fe f, const fe g) {
   h[8] = h8;
   h[9] = h9;
 }
+#endif
 
 /* From fe_neg.c */
 
@@ -655,6 +778,7 @@ Postconditions:
 See fe_mul.c for discussion of implementation strategy.
 */
 
+#if !defined(FE_MUL_INT128)
 static void fe_sq(fe h, const fe f) {
   int32_t f0 = f[0];
   int32_t f1 = f[1];
@@ -785,6 +909,7 @@ static void fe_sq(fe h, const fe f) {
   h[8] = h8;
   h[9] = h9;
 }
+#endif
 
 /* From fe_sq2.c */
 
@@ -803,6 +928,7 @@ Postconditions:
 See fe_mul.c for discussion of implementation strategy.
 */
 
+#if !defined(FE_MUL_INT128)
 static void fe_sq2(fe h, const fe f) {
   int32_t f0 = f[0];
   int32_t f1 = f[1];
@@ -944,6 +1070,7 @@ static void fe_sq2(fe h, const fe f) {
   h[8] = h8;
   h[9] = h9;
 }
+#endif
 
 /* From fe_sub.c */
 
@@ -1194,16 +1321,21 @@ B is the Ed25519 base point (x,4/5) with x positive.
 */
 
 void ge_double_scalarmult_base_vartime(ge_p2 *r, const unsigned char *a, const ge_p3 *A, const unsigned char *b) {
+  ge_dsmp Ai; /* A, 3A, 5A, 7A, 9A, 11A, 13A, 15A */
+
+  ge_dsm_precomp(Ai, A);
+  ge_double_scalarmult_base_precomp_vartime(r, a, Ai, b);
+}
+
+void ge_double_scalarmult_base_precomp_vartime(ge_p2 *r, const unsigned char *a, const ge_dsmp Ai, const unsigned char *b) {
   signed char aslide[256];
   signed char bslide[256];
-  ge_dsmp Ai; /* A, 3A, 5A, 7A, 9A, 11A, 13A, 15A */
   ge_p1p1 t;
   ge_p3 u;
   int i;
 
   slide(aslide, a);
   slide(bslide, b);
-  ge_dsm_precomp(Ai, A);
 
   ge_p2_0(r);
 
@@ -1512,20 +1644,20 @@ static void ge_precomp_cmov(ge_precomp *t, const ge_precomp *u, unsigned char b)
   fe_cmov(t->xy2d, u->xy2d, b);
 }
 
-static void select(ge_precomp *t, int pos, signed char b) {
+static void select(ge_precomp *t, const ge_precomp *row, signed char b) {
   ge_precomp minust;
   unsigned char bnegative = negative(b);
   unsigned char babs = b - (((-bnegative) & b) << 1);
 
   ge_precomp_0(t);
-  ge_precomp_cmov(t, &ge_base[pos][0], equal(babs, 1));
-  ge_precomp_cmov(t, &ge_base[pos][1], equal(babs, 2));
-  ge_precomp_cmov(t, &ge_base[pos][2], equal(babs, 3));
-  ge_precomp_cmov(t, &ge_base[pos][3], equal(babs, 4));
-  ge_precomp_cmov(t, &ge_base[pos][4], equal(babs, 5));
-  ge_precomp_cmov(t, &ge_base[pos][5], equal(babs, 6));
-  ge_precomp_cmov(t, &ge_base[pos][6], equal(babs, 7));
-  ge_precomp_cmov(t, &ge_base[pos][7], equal(babs, 8));
+  ge_precomp_cmov(t, &row[0], equal(babs, 1));
+  ge_precomp_cmov(t, &row[1], equal(babs, 2));
+  ge_precomp_cmov(t, &row[2], equal(babs, 3));
+  ge_precomp_cmov(t, &row[3], equal(babs, 4));
+  ge_precomp_cmov(t, &row[4], equal(babs, 5));
+  ge_precomp_cmov(t, &row[5], equal(babs, 6));
+  ge_precomp_cmov(t, &row[6], equal(babs, 7));
+  ge_precomp_cmov(t, &row[7], equal(babs, 8));
   fe_copy(minust.yplusx, t->yminusx);
   fe_copy(minust.yminusx, t->yplusx);
   fe_neg(minust.xy2d, t->xy2d);
@@ -1568,7 +1700,95 @@ void ge_scalarmult_base(ge_p3 *h, const unsigned char *a) {
 
   ge_p3_0(h);
   for (i = 1; i < 64; i += 2) {
-    select(&t, i / 2, e[i]);
+    select(&t, ge_base[i / 2], e[i]);
+    ge_madd(&r, h, &t); ge_p1p1_to_p3(h, &r);
+  }
+
+  ge_p3_dbl(&r, h);  ge_p1p1_to_p2(&s, &r);
+  ge_p2_dbl(&r, &s); ge_p1p1_to_p2(&s, &r);
+  ge_p2_dbl(&r, &s); ge_p1p1_to_p2(&s, &r);
+  ge_p2_dbl(&r, &s); ge_p1p1_to_p3(h, &r);
+
+  for (i = 0; i < 64; i += 2) {
+    select(&t, ge_base[i / 2], e[i]);
+    ge_madd(&r, h, &t); ge_p1p1_to_p3(h, &r);
+  }
+}
+
+/* New code */
+
+static void ge_p3_to_precomp(ge_precomp *r, const ge_p3 *p) {
+  fe recip, x, y;
+  fe_invert(recip, p->Z);
+  fe_mul(x, p->X, recip);
+  fe_mul(y, p->Y, recip);
+  fe_add(r->yplusx, y, x);
+  fe_sub(r->yminusx, y, x);
+  fe_mul(r->xy2d, x, y);
+  fe_mul(r->xy2d, r->xy2d, fe_d2);
+}
+
+/*
+r[i][j] = (j+1) * 256^i * A, the same layout as ge_base, so that
+ge_scalarmult_precomp can use it for any fixed point.
+*/
+
+void ge_precomp_table(ge_precomp r[32][8], const ge_p3 *A) {
+  ge_p3 row, cur;
+  ge_cached rowc;
+  ge_p1p1 t;
+  ge_p2 s;
+  int i, j;
+
+  row = *A;
+  for (i = 0; i < 32; ++i) {
+    ge_p3_to_cached(&rowc, &row);
+    cur = row;
+    for (j = 0; j < 8; ++j) {
+      ge_p3_to_precomp(&r[i][j], &cur);
+      ge_add(&t, &cur, &rowc);
+      ge_p1p1_to_p3(&cur, &t);
+    }
+    ge_p3_to_p2(&s, &row);
+    for (j = 0; j < 7; ++j) {
+      ge_p2_dbl(&t, &s); ge_p1p1_to_p2(&s, &t);
+    }
+    ge_p2_dbl(&t, &s); ge_p1p1_to_p3(&row, &t);
+  }
+}
+
+/*
+h = a * A, where table was filled by ge_precomp_table from A.
+
+Preconditions:
+  a[31] <= 127
+*/
+
+void ge_scalarmult_precomp(ge_p3 *h, const unsigned char *a, const ge_precomp table[32][8]) {
+  signed char e[64];
+  signed char carry;
+  ge_p1p1 r;
+  ge_p2 s;
+  ge_precomp t;
+  int i;
+
+  for (i = 0; i < 32; ++i) {
+    e[2 * i + 0] = (a[i] >> 0) & 15;
+    e[2 * i + 1] = (a[i] >> 4) & 15;
+  }
+
+  carry = 0;
+  for (i = 0; i < 63; ++i) {
+    e[i] += carry;
+    carry = e[i] + 8;
+    carry >>= 4;
+    e[i] -= carry << 4;
+  }
+  e[63] += carry;
+
+  ge_p3_0(h);
+  for (i = 1; i < 64; i += 2) {
+    select(&t, table[i / 2], e[i]);
     ge_madd(&r, h, &t); ge_p1p1_to_p3(h, &r);
   }
 
@@ -1578,7 +1798,7 @@ void ge_scalarmult_base(ge_p3 *h, const unsigned char *a) {
   ge_p2_dbl(&r, &s); ge_p1p1_to_p3(h, &r);
 
   for (i = 0; i < 64; i += 2) {
-    select(&t, i / 2, e[i]);
+    select(&t, table[i / 2], e[i]);
     ge_madd(&r, h, &t); ge_p1p1_to_p3(h, &r);
   }
 }
@@ -1618,6 +1838,116 @@ void ge_tobytes(unsigned char *s, const ge_p2 *h) {
   s[31] ^= fe_isnegative(x) << 7;
 }
 
+/* New code */
+
+/* Same as ge_tobytes, for n points at once. The Z coordinates are inverted
+   together (Montgomery's trick), so a block of 64 points costs one field
+   inversion and three multiplications per point instead of 64 inversions. */
+
+void ge_tobytes_batch(unsigned char *s, const ge_p2 *h, size_t n) {
+  fe acc[64];
+  fe inv;
+  fe recip;
+  fe x;
+  fe y;
+  size_t i, count;
+
+  while (n > 0) {
+    count = n < 64 ? n : 64;
+    fe_copy(acc[0], h[0].Z);
+    for (i = 1; i < count; ++i) {
+      fe_mul(acc[i], acc[i - 1], h[i].Z);
+    }
+    fe_invert(inv, acc[count - 1]);
+    for (i = count - 1; i > 0; --i) {
+      fe_mul(recip, inv, acc[i - 1]);
+      fe_mul(inv, inv, h[i].Z);
+      fe_mul(x, h[i].X, recip);
+      fe_mul(y, h[i].Y, recip);
+      fe_tobytes(s + 32 * i, y);
+      s[32 * i + 31] ^= fe_isnegative(x) << 7;
+    }
+    fe_mul(x, h[0].X, inv);
+    fe_mul(y, h[0].Y, inv);
+    fe_tobytes(s, y);
+    s[31] ^= fe_isnegative(x) << 7;
+    s += 32 * count;
+    h += count;
+    n -= count;
+  }
+}
+
+static void fe_frombytes(fe h, const unsigned char *s) {
+  int64_t h0 = load_4(s);
+  int64_t h1 = load_3(s + 4) << 6;
+  int64_t h2 = load_3(s + 7) << 5;
+  int64_t h3 = load_3(s + 10) << 3;
+  int64_t h4 = load_3(s + 13) << 2;
+  int64_t h5 = load_4(s + 16);
+  int64_t h6 = load_3(s + 20) << 7;
+  int64_t h7 = load_3(s + 23) << 5;
+  int64_t h8 = load_3(s + 26) << 4;
+  int64_t h9 = (load_3(s + 29) & 8388607) << 2;
+  int64_t carry0;
+  int64_t carry1;
+  int64_t carry2;
+  int64_t carry3;
+  int64_t carry4;
+  int64_t carry5;
+  int64_t carry6;
+  int64_t carry7;
+  int64_t carry8;
+  int64_t carry9;
+
+  carry9 = (h9 + (int64_t) (1<<24)) >> 25; h0 += carry9 * 19; h9 -= carry9 << 25;
+  carry1 = (h1 + (int64_t) (1<<24)) >> 25; h2 += carry1; h1 -= carry1 << 25;
+  carry3 = (h3 + (int64_t) (1<<24)) >> 25; h4 += carry3; h3 -= carry3 << 25;
+  carry5 = (h5 + (int64_t) (1<<24)) >> 25; h6 += carry5; h5 -= carry5 << 25;
+  carry7 = (h7 + (int64_t) (1<<24)) >> 25; h8 += carry7; h7 -= carry7 << 25;
+
+  carry0 = (h0 + (int64_t) (1<<25)) >> 26; h1 += carry0; h0 -= carry0 << 26;
+  carry2 = (h2 + (int64_t) (1<<25)) >> 26; h3 += carry2; h2 -= carry2 << 26;
+  carry4 = (h4 + (int64_t) (1<<25)) >> 26; h5 += carry4; h4 -= carry4 << 26;
+  carry6 = (h6 + (int64_t) (1<<25)) >> 26; h7 += carry6; h6 -= carry6 << 26;
+  carry8 = (h8 + (int64_t) (1<<25)) >> 26; h9 += carry8; h8 -= carry8 << 26;
+
+  h[0] = h0;
+  h[1] = h1;
+  h[2] = h2;
+  h[3] = h3;
+  h[4] = h4;
+  h[5] = h5;
+  h[6] = h6;
+  h[7] = h7;
+  h[8] = h8;
+  h[9] = h9;
+}
+
+/* Whether ge_tobytes(h) would give s. A point with another y coordinate,
+   which is almost any point when looking for one, is told apart with two
+   field multiplications rather than the inversion ge_tobytes needs. */
+
+int ge_p2_eq_bytes_vartime(const ge_p2 *h, const unsigned char *s) {
+  fe y;
+  fe check;
+  unsigned char b[32];
+  int i;
+
+  fe_frombytes(y, s);
+  fe_mul(check, y, h->Z);
+  fe_sub(check, check, h->Y);   /* yZ - Y */
+  if (fe_isnonzero(check)) {
+    return 0;
+  }
+  ge_tobytes(b, h);
+  for (i = 0; i < 32; ++i) {
+    if (b[i] != s[i]) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
 /* From sc_reduce.c */
 
 /*
@@ -1941,9 +2271,37 @@ static void ge_cached_cmov(ge_cached *t, const ge_cached *u, unsigned char b) {
 
 /* Assumes that a[31] <= 127 */
 void ge_scalarmult(ge_p2 *r, const unsigned char *a, const ge_p3 *A) {
+  ge_smp Ai; /* 1 * A, 2 * A, ..., 8 * A */
+
+  ge_sm_precomp(Ai, A);
+  ge_scalarmult_cached(r, a, Ai);
+}
+
+/*
+r[i] = (i+1) * A, for ge_scalarmult_cached to multiply A by any number of
+scalars without rebuilding the table each time.
+*/
+
+void ge_sm_precomp(ge_smp r, const ge_p3 *A) {
+  ge_p1p1 t;
+  ge_p3 u;
+  int i;
+
+  ge_p3_to_cached(&r[0], A);
+  for (i = 0; i < 7; i++) {
+    ge_add(&t, A, &r[i]);
+    ge_p1p1_to_p3(&u, &t);
+    ge_p3_to_cached(&r[i + 1], &u);
+  }
+}
+
+/*
+r = a * A, where Ai was filled by ge_sm_precomp from A.
+*/
+
+void ge_scalarmult_cached(ge_p2 *r, const unsigned char *a, const ge_smp Ai) {
   signed char e[64];
   int carry, carry2, i;
-  ge_cached Ai[8]; /* 1 * A, 2 * A, ..., 8 * A */
   ge_p1p1 t;
   ge_p3 u;
 
@@ -1960,13 +2318,6 @@ void ge_scalarmult(ge_p2 *r, const unsigned char *a, const ge_p3 *A) {
   e[62] = carry - (carry2 << 4); /* -8..7 */
   e[63] = carry2; /* 0..8 */
 
-  ge_p3_to_cached(&Ai[0], A);
-  for (i = 0; i < 7; i++) {
-    ge_add(&t, A, &Ai[i]);
-    ge_p1p1_to_p3(&u, &t);
-    ge_p3_to_cached(&Ai[i + 1], &u);
-  }
-
   ge_p2_0(r);
   for (i = 63; i >= 0; i--) {
     signed char b = e[i];
@@ -2001,16 +2352,21 @@ void ge_scalarmult(ge_p2 *r, const unsigned char *a, const ge_p3 *A) {
 }
 
 void ge_double_scalarmult_precomp_vartime(ge_p2 *r, const unsigned char *a, const ge_p3 *A, const unsigned char *b, const ge_dsmp Bi) {
+  ge_dsmp Ai; /* A, 3A, 5A, 7A, 9A, 11A, 13A, 15A */
+
+  ge_dsm_precomp(Ai, A);
+  ge_double_scalarmult_precomp2_vartime(r, a, Ai, b, Bi);
+}
+
+void ge_double_scalarmult_precomp2_vartime(ge_p2 *r, const unsigned char *a, const ge_dsmp Ai, const unsigned char *b, const ge_dsmp Bi) {
   signed char aslide[256];
   signed char bslide[256];
-  ge_dsmp Ai; /* A, 3A, 5A, 7A, 9A, 11A, 13A, 15A */
   ge_p1p1 t;
   ge_p3 u;
   int i;
 
   slide(aslide, a);
   slide(bslide, b);
-  ge_dsm_precomp(Ai, A);
 
   ge_p2_0(r);
 
@@ -30,6 +30,8 @@
 
 #pragma once
 
+#include <stddef.h>
+
 /* From fe.h */
 
 typedef int32_t fe[10];
@@ -79,6 +81,7 @@ typedef ge_cached ge_dsmp[8];
 extern const ge_precomp ge_Bi[8];
 void ge_dsm_precomp(ge_dsmp r, const ge_p3 *s);
 void ge_double_scalarmult_base_vartime(ge_p2 *, const unsigned char *, const ge_p3 *, const unsigned char *);
+void ge_double_scalarmult_base_precomp_vartime(ge_p2 *, const unsigned char *, const ge_dsmp, const unsigned char *);
 
 /* From ge_frombytes.c, modified */
 
@@ -126,9 +129,18 @@ void sc_reduce(unsigned char *);
 
 /* New code */
 
+typedef ge_cached ge_smp[8];
+
 void ge_scalarmult(ge_p2 *, const unsigned char *, const ge_p3 *);
+void ge_sm_precomp(ge_smp, const ge_p3 *);
+void ge_scalarmult_cached(ge_p2 *, const unsigned char *, const ge_smp);
 void ge_double_scalarmult_precomp_vartime(ge_p2 *, const unsigned char *, const ge_p3 *, const unsigned char *, const ge_dsmp);
+void ge_double_scalarmult_precomp2_vartime(ge_p2 *, const unsigned char *, const ge_dsmp, const unsigned char *, const ge_dsmp);
 void ge_mul8(ge_p1p1 *, const ge_p2 *);
+void ge_tobytes_batch(unsigned char *, const ge_p2 *, size_t);
+int ge_p2_eq_bytes_vartime(const ge_p2 *, const unsigned char *);
+void ge_precomp_table(ge_precomp [32][8], const ge_p3 *);
+void ge_scalarmult_precomp(ge_p3 *, const unsigned char *, const ge_precomp [32][8]);
 extern const fe fe_ma2;
 extern const fe fe_ma;
 extern const fe fe_fffb1;
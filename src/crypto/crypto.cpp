@@ -33,7 +33,11 @@
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <iterator>
+#include <list>
 #include <memory>
+#include <unordered_map>
+#include <vector>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/lock_guard.hpp>
 
@@ -42,6 +46,9 @@
 #include "crypto.h"
 #include "hash.h"
 
+// batch size from which a full table of the public key pays for itself
+#define KEY_DERIVATION_TABLE_MIN_BATCH 32
+
 #if !defined(__FreeBSD__) && !defined(__OpenBSD__) && !defined(__DragonFly__)
  #include <alloca.h>
 #else
@@ -62,8 +69,6 @@ namespace crypto {
 #include "random.h"
   }
 
-  boost::mutex random_lock;
-
   static inline unsigned char *operator &(ec_point &point) {
     return &reinterpret_cast<unsigned char &>(point);
   }
@@ -83,7 +88,7 @@ namespace crypto {
   /* generate a random 32-byte (256-bit) integer and copy it to res */
   static inline void random_scalar(ec_scalar &res) {
     unsigned char tmp[64];
-    generate_random_bytes_not_thread_safe(64, tmp);
+    generate_random_bytes_thread_safe(64, tmp);
     sc_reduce(tmp);
     memcpy(&res, tmp, 32);
   }
@@ -99,7 +104,6 @@ namespace crypto {
    * 
    */
   secret_key crypto_ops::generate_keys(public_key &pub, secret_key &sec, const secret_key& recovery_key, bool recover) {
-    boost::lock_guard<boost::mutex> lock(random_lock);
     ge_p3 point;
 
     secret_key rng;
@@ -151,6 +155,69 @@ namespace crypto {
     return true;
   }
 
+  bool crypto_ops::generate_key_derivations(const public_key &key1, const secret_key *keys2, size_t n, key_derivation *derivations) {
+    ge_p3 point;
+    ge_p1p1 point3;
+    if (ge_frombytes_vartime(&point, &key1) != 0) {
+      return false;
+    }
+    std::vector<ge_p2> points(n);
+    if (n >= KEY_DERIVATION_TABLE_MIN_BATCH) {
+      // a full table of the point is worth it for enough scalars
+      std::unique_ptr<ge_precomp[][8]> table(new ge_precomp[32][8]);
+      ge_precomp_table(table.get(), &point);
+      for (size_t i = 0; i < n; ++i) {
+        ge_p3 point4;
+        assert(sc_check(&keys2[i]) == 0);
+        ge_scalarmult_precomp(&point4, &keys2[i], table.get());
+        ge_p3_to_p2(&points[i], &point4);
+        ge_mul8(&point3, &points[i]);
+        ge_p1p1_to_p2(&points[i], &point3);
+      }
+    } else {
+      ge_smp table;
+      ge_sm_precomp(table, &point);
+      for (size_t i = 0; i < n; ++i) {
+        assert(sc_check(&keys2[i]) == 0);
+        ge_scalarmult_cached(&points[i], &keys2[i], table);
+        ge_mul8(&point3, &points[i]);
+        ge_p1p1_to_p2(&points[i], &point3);
+      }
+    }
+    ge_tobytes_batch(reinterpret_cast<unsigned char *>(derivations), points.data(), n);
+    return true;
+  }
+
+  bool crypto_ops::generate_key_derivations(const public_key *keys1, size_t n, const secret_key &key2, key_derivation *derivations) {
+    std::vector<ge_p2> points;
+    std::vector<size_t> indices;
+    points.reserve(n);
+    indices.reserve(n);
+    assert(sc_check(&key2) == 0);
+    for (size_t i = 0; i < n; ++i) {
+      ge_p3 point;
+      ge_p1p1 point3;
+      if (ge_frombytes_vartime(&point, &keys1[i]) != 0) {
+        continue;
+      }
+      points.push_back(ge_p2());
+      ge_scalarmult(&points.back(), &key2, &point);
+      ge_mul8(&point3, &points.back());
+      ge_p1p1_to_p2(&points.back(), &point3);
+      indices.push_back(i);
+    }
+    if (indices.size() == n) {
+      ge_tobytes_batch(reinterpret_cast<unsigned char *>(derivations), points.data(), n);
+      return true;
+    }
+    std::vector<key_derivation> valid(indices.size());
+    ge_tobytes_batch(reinterpret_cast<unsigned char *>(valid.data()), points.data(), points.size());
+    for (size_t i = 0; i < indices.size(); ++i) {
+      derivations[indices[i]] = valid[i];
+    }
+    return false;
+  }
+
   void crypto_ops::derivation_to_scalar(const key_derivation &derivation, size_t output_index, ec_scalar &res) {
     struct {
       key_derivation derivation;
@@ -183,6 +250,30 @@ namespace crypto {
     return true;
   }
 
+  static_assert(sizeof(public_key_precomp) == sizeof(ge_cached), "Invalid structure size");
+
+  bool crypto_ops::precompute_public_key(const public_key &key, public_key_precomp &precomp) {
+    ge_p3 point;
+    if (ge_frombytes_vartime(&point, &key) != 0) {
+      return false;
+    }
+    ge_p3_to_cached(reinterpret_cast<ge_cached *>(&precomp), &point);
+    return true;
+  }
+
+  bool crypto_ops::check_derived_public_key(const key_derivation &derivation, size_t output_index,
+    const public_key_precomp &base, const public_key &derived_key) {
+    ec_scalar scalar;
+    ge_p3 point1;
+    ge_p1p1 point2;
+    ge_p2 point3;
+    derivation_to_scalar(derivation, output_index, scalar);
+    ge_scalarmult_base(&point1, &scalar);
+    ge_add(&point2, &point1, reinterpret_cast<const ge_cached *>(&base));
+    ge_p1p1_to_p2(&point3, &point2);
+    return ge_p2_eq_bytes_vartime(&point3, &derived_key) != 0;
+  }
+
   void crypto_ops::derive_secret_key(const key_derivation &derivation, size_t output_index,
     const secret_key &base, secret_key &derived_key) {
     ec_scalar scalar;
@@ -198,7 +289,6 @@ namespace crypto {
   };
 
   void crypto_ops::generate_signature(const hash &prefix_hash, const public_key &pub, const secret_key &sec, signature &sig) {
-    boost::lock_guard<boost::mutex> lock(random_lock);
     ge_p3 tmp3;
     ec_scalar k;
     s_comm buf;
@@ -252,6 +342,82 @@ namespace crypto {
     ge_p1p1_to_p3(&res, &point2);
   }
 
+  struct ring_member_entry {
+    public_key key;
+    ge_dsmp key_dsmp;
+    ge_dsmp hash_dsmp;
+  };
+
+  static boost::mutex ring_member_cache_lock;
+  static std::list<ring_member_entry> ring_member_cache_lru; /* most recently used first */
+  static std::unordered_map<public_key, std::list<ring_member_entry>::iterator> ring_member_cache_index;
+  static std::size_t ring_member_cache_max_size = 8192;
+  static std::uint64_t ring_member_cache_hits = 0;
+  static std::uint64_t ring_member_cache_misses = 0;
+
+  bool ring_member_precomp(const public_key &key, void *key_dsmp, void *hash_dsmp) {
+    ge_cached *const key_res = static_cast<ge_cached *>(key_dsmp);
+    ge_cached *const hash_res = static_cast<ge_cached *>(hash_dsmp);
+    {
+      boost::lock_guard<boost::mutex> lock(ring_member_cache_lock);
+      auto it = ring_member_cache_index.find(key);
+      if (it != ring_member_cache_index.end()) {
+        ring_member_cache_lru.splice(ring_member_cache_lru.begin(), ring_member_cache_lru, it->second);
+        memcpy(key_res, it->second->key_dsmp, sizeof(ge_dsmp));
+        memcpy(hash_res, it->second->hash_dsmp, sizeof(ge_dsmp));
+        ++ring_member_cache_hits;
+        return true;
+      }
+      ++ring_member_cache_misses;
+    }
+
+    /* computed without the lock, another thread may have added it meanwhile */
+    ge_p3 point;
+    if (ge_frombytes_vartime(&point, &key) != 0) {
+      return false;
+    }
+    ge_dsm_precomp(key_res, &point);
+    hash_to_ec(key, point);
+    ge_dsm_precomp(hash_res, &point);
+
+    boost::lock_guard<boost::mutex> lock(ring_member_cache_lock);
+    if (ring_member_cache_max_size == 0 || ring_member_cache_index.find(key) != ring_member_cache_index.end()) {
+      return true;
+    }
+    if (ring_member_cache_lru.size() >= ring_member_cache_max_size) {
+      /* recycle the least recently used entry */
+      ring_member_cache_index.erase(ring_member_cache_lru.back().key);
+      ring_member_cache_lru.splice(ring_member_cache_lru.begin(), ring_member_cache_lru, std::prev(ring_member_cache_lru.end()));
+    } else {
+      ring_member_cache_lru.emplace_front();
+    }
+    ring_member_entry &entry = ring_member_cache_lru.front();
+    entry.key = key;
+    memcpy(entry.key_dsmp, key_res, sizeof(ge_dsmp));
+    memcpy(entry.hash_dsmp, hash_res, sizeof(ge_dsmp));
+    ring_member_cache_index.emplace(key, ring_member_cache_lru.begin());
+    return true;
+  }
+
+  void set_ring_member_cache_size(std::size_t max_size) {
+    boost::lock_guard<boost::mutex> lock(ring_member_cache_lock);
+    ring_member_cache_max_size = max_size;
+    while (ring_member_cache_lru.size() > max_size) {
+      ring_member_cache_index.erase(ring_member_cache_lru.back().key);
+      ring_member_cache_lru.pop_back();
+    }
+  }
+
+  ring_member_cache_stats get_ring_member_cache_stats() {
+    boost::lock_guard<boost::mutex> lock(ring_member_cache_lock);
+    ring_member_cache_stats stats;
+    stats.hits = ring_member_cache_hits;
+    stats.misses = ring_member_cache_misses;
+    stats.size = ring_member_cache_lru.size();
+    stats.max_size = ring_member_cache_max_size;
+    return stats;
+  }
+
   void crypto_ops::generate_key_image(const public_key &pub, const secret_key &sec, key_image &image) {
     ge_p3 point;
     ge_p2 point2;
@@ -280,7 +446,6 @@ POP_WARNINGS
     const public_key *const *pubs, size_t pubs_count,
     const secret_key &sec, size_t sec_index,
     signature *sig) {
-    boost::lock_guard<boost::mutex> lock(random_lock);
     size_t i;
     ge_p3 image_unp;
     ge_dsmp image_pre;
@@ -359,17 +524,16 @@ POP_WARNINGS
     buf->h = prefix_hash;
     for (i = 0; i < pubs_count; i++) {
       ge_p2 tmp2;
-      ge_p3 tmp3;
+      ge_dsmp key_pre, hash_pre;
       if (sc_check(&sig[i].c) != 0 || sc_check(&sig[i].r) != 0) {
         return false;
       }
-      if (ge_frombytes_vartime(&tmp3, &*pubs[i]) != 0) {
+      if (!ring_member_precomp(*pubs[i], key_pre, hash_pre)) {
         return false;
       }
-      ge_double_scalarmult_base_vartime(&tmp2, &sig[i].c, &tmp3, &sig[i].r);
+      ge_double_scalarmult_base_precomp_vartime(&tmp2, &sig[i].c, key_pre, &sig[i].r);
       ge_tobytes(&buf->ab[i].a, &tmp2);
-      hash_to_ec(*pubs[i], tmp3);
-      ge_double_scalarmult_precomp_vartime(&tmp2, &sig[i].r, &tmp3, &sig[i].c, image_pre);
+      ge_double_scalarmult_precomp2_vartime(&tmp2, &sig[i].r, hash_pre, &sig[i].c, image_pre);
       ge_tobytes(&buf->ab[i].b, &tmp2);
       sc_add(&sum, &sum, &sig[i].c);
     }
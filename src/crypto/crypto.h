@@ -31,6 +31,7 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/lock_guard.hpp>
 #include <vector>
@@ -45,8 +46,6 @@ namespace crypto {
 #include "random.h"
   }
 
-  extern boost::mutex random_lock;
-
 #pragma pack(push, 1)
   POD_CLASS ec_point {
     char data[32];
@@ -99,6 +98,14 @@ namespace crypto {
     sizeof(key_derivation) == 32 && sizeof(key_image) == 32 &&
     sizeof(signature) == 64, "Invalid structure size");
 
+  /* A public key in the form derive_public_key adds to it, to check many
+   * outputs against the same key without decompressing it each time.
+   */
+  POD_CLASS public_key_precomp {
+    std::int32_t data[40];
+    friend class crypto_ops;
+  };
+
   class crypto_ops {
     crypto_ops();
     crypto_ops(const crypto_ops &);
@@ -113,10 +120,18 @@ namespace crypto {
     friend bool secret_key_to_public_key(const secret_key &, public_key &);
     static bool generate_key_derivation(const public_key &, const secret_key &, key_derivation &);
     friend bool generate_key_derivation(const public_key &, const secret_key &, key_derivation &);
+    static bool generate_key_derivations(const public_key &, const secret_key *, std::size_t, key_derivation *);
+    friend bool generate_key_derivations(const public_key &, const secret_key *, std::size_t, key_derivation *);
+    static bool generate_key_derivations(const public_key *, std::size_t, const secret_key &, key_derivation *);
+    friend bool generate_key_derivations(const public_key *, std::size_t, const secret_key &, key_derivation *);
     static void derivation_to_scalar(const key_derivation &derivation, size_t output_index, ec_scalar &res);
     friend void derivation_to_scalar(const key_derivation &derivation, size_t output_index, ec_scalar &res);
     static bool derive_public_key(const key_derivation &, std::size_t, const public_key &, public_key &);
     friend bool derive_public_key(const key_derivation &, std::size_t, const public_key &, public_key &);
+    static bool precompute_public_key(const public_key &, public_key_precomp &);
+    friend bool precompute_public_key(const public_key &, public_key_precomp &);
+    static bool check_derived_public_key(const key_derivation &, std::size_t, const public_key_precomp &, const public_key &);
+    friend bool check_derived_public_key(const key_derivation &, std::size_t, const public_key_precomp &, const public_key &);
     static void derive_secret_key(const key_derivation &, std::size_t, const secret_key &, secret_key &);
     friend void derive_secret_key(const key_derivation &, std::size_t, const secret_key &, secret_key &);
     static void generate_signature(const hash &, const public_key &, const secret_key &, signature &);
@@ -138,8 +153,7 @@ namespace crypto {
   /* Generate N random bytes
    */
   inline void rand(size_t N, uint8_t *bytes) {
-    boost::lock_guard<boost::mutex> lock(random_lock);
-    generate_random_bytes_not_thread_safe(N, bytes);
+    generate_random_bytes_thread_safe(N, bytes);
   }
 
   /* Generate a value filled with random bytes.
@@ -147,8 +161,7 @@ namespace crypto {
   template<typename T>
   typename std::enable_if<std::is_pod<T>::value, T>::type rand() {
     typename std::remove_cv<T>::type res;
-    boost::lock_guard<boost::mutex> lock(random_lock);
-    generate_random_bytes_not_thread_safe(sizeof(T), &res);
+    generate_random_bytes_thread_safe(sizeof(T), &res);
     return res;
   }
 
@@ -179,10 +192,35 @@ namespace crypto {
   inline bool generate_key_derivation(const public_key &key1, const secret_key &key2, key_derivation &derivation) {
     return crypto_ops::generate_key_derivation(key1, key2, derivation);
   }
+  /* Same as generate_key_derivation, for one public key and n secret keys,
+   * as when checking a transaction for several wallets.
+   */
+  inline bool generate_key_derivations(const public_key &key1, const secret_key *keys2, std::size_t n, key_derivation *derivations) {
+    return crypto_ops::generate_key_derivations(key1, keys2, n, derivations);
+  }
+  /* Same as generate_key_derivation, for n public keys and one secret key,
+   * as when checking many transactions for one wallet. The derivations of
+   * invalid public keys are left untouched, and false is returned.
+   */
+  inline bool generate_key_derivations(const public_key *keys1, std::size_t n, const secret_key &key2, key_derivation *derivations) {
+    return crypto_ops::generate_key_derivations(keys1, n, key2, derivations);
+  }
   inline bool derive_public_key(const key_derivation &derivation, std::size_t output_index,
     const public_key &base, public_key &derived_key) {
     return crypto_ops::derive_public_key(derivation, output_index, base, derived_key);
   }
+  /* check_derived_public_key tells whether derive_public_key(derivation,
+   * output_index, base) gives derived_key, with base prepared once by
+   * precompute_public_key. Keys which differ are mostly rejected without
+   * computing the derived key in full.
+   */
+  inline bool precompute_public_key(const public_key &key, public_key_precomp &precomp) {
+    return crypto_ops::precompute_public_key(key, precomp);
+  }
+  inline bool check_derived_public_key(const key_derivation &derivation, std::size_t output_index,
+    const public_key_precomp &base, const public_key &derived_key) {
+    return crypto_ops::check_derived_public_key(derivation, output_index, base, derived_key);
+  }
   inline void derivation_to_scalar(const key_derivation &derivation, size_t output_index, ec_scalar &res) {
     return crypto_ops::derivation_to_scalar(derivation, output_index, res);
   }
@@ -221,6 +259,23 @@ namespace crypto {
     return crypto_ops::check_ring_signature(prefix_hash, image, pubs, pubs_count, sig);
   }
 
+  /* Bounded LRU cache of ring member precomputations, shared by
+   * check_ring_signature and the RingCT MLSAG verifier, since popular outputs
+   * show up in many rings. ring_member_precomp fills key_dsmp and hash_dsmp,
+   * which must each point to a ge_dsmp (see crypto-ops.h), from the key and
+   * from hash_to_ec(key), and returns false if the key is not a valid point.
+   * A max size of 0 disables the cache.
+   */
+  struct ring_member_cache_stats {
+    std::uint64_t hits;
+    std::uint64_t misses;
+    std::size_t size;
+    std::size_t max_size;
+  };
+  bool ring_member_precomp(const public_key &key, void *key_dsmp, void *hash_dsmp);
+  void set_ring_member_cache_size(std::size_t max_size);
+  ring_member_cache_stats get_ring_member_cache_stats();
+
   /* Variants with vector<const public_key *> parameters.
    */
   inline void generate_ring_signature(const hash &prefix_hash, const key_image &image,
@@ -48,3 +48,7 @@ void cn_fast_hash(const void *data, size_t length, char *hash) {
   hash_process(&state, data, length);
   memcpy(hash, &state, HASH_SIZE);
 }
+
+void cn_fast_hash_batch(const void *data, size_t length, size_t count, char *hash) {
+  keccak_batch(data, length, count, (uint8_t*)hash, HASH_SIZE);
+}
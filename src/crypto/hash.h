@@ -67,10 +67,18 @@ namespace crypto {
     return h;
   }
 
+  inline void cn_fast_hash_batch(const void *data, std::size_t length, std::size_t count, hash *hashes) {
+    cn_fast_hash_batch(data, length, count, reinterpret_cast<char *>(hashes));
+  }
+
   inline void cn_slow_hash(const void *data, std::size_t length, hash &hash) {
     cn_slow_hash(data, length, reinterpret_cast<char *>(&hash));
   }
 
+  inline void cn_slow_hash_multi(const void *const *data, const std::size_t *length, std::size_t count, hash *hashes) {
+    cn_slow_hash_multi(data, length, count, reinterpret_cast<char *>(hashes));
+  }
+
   inline void tree_hash(const hash *hashes, std::size_t count, hash &root_hash) {
     tree_hash(reinterpret_cast<const char (*)[HASH_SIZE]>(hashes), count, reinterpret_cast<char *>(&root_hash));
   }
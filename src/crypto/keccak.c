@@ -2,6 +2,7 @@
 // 19-Nov-11  Markku-Juhani O. Saarinen <mjos@iki.fi>
 // A baseline Keccak (3rd round) implementation.
 
+#include "cpu-features.h"
 #include "hash-ops.h"
 #include "keccak.h"
 
@@ -110,3 +111,183 @@ void keccak1600(const uint8_t *in, size_t inlen, uint8_t *md)
 {
     keccak(in, inlen, md, sizeof(state_t));
 }
+
+#if defined(__GNUC__)
+
+// lane n of every state word belongs to the n-th hash of a group; with
+// -march=native this maps to AVX2 (or AVX-512 for 8 lanes) registers
+#if defined(__AVX512F__)
+#define KECCAK_LANES 8
+#else
+#define KECCAK_LANES 4
+#endif
+
+// what the code built for the target needs from the CPU
+#if defined(__AVX512F__)
+#define KECCAK_LANES_NEEDS CPU_FEATURE_AVX512F
+#define KECCAK_LANES_NAME "avx512f, 8 lanes"
+#elif defined(__AVX2__)
+#define KECCAK_LANES_NEEDS CPU_FEATURE_AVX2
+#define KECCAK_LANES_NAME "avx2, 4 lanes"
+#elif defined(__SSE2__)
+#define KECCAK_LANES_NEEDS CPU_FEATURE_SSE2
+#define KECCAK_LANES_NAME "sse2, 4 lanes"
+#elif defined(__aarch64__)
+#define KECCAK_LANES_NEEDS CPU_FEATURE_NEON
+#define KECCAK_LANES_NAME "neon, 4 lanes"
+#else
+#define KECCAK_LANES_NEEDS 0
+#define KECCAK_LANES_NAME "vector, 4 lanes"
+#endif
+
+// builds for x86 CPUs without AVX2 (ARCH=default) also get a copy for those
+// with it, picked at run time
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(__AVX2__) && !defined(__AVX512F__)
+#define KECCAK_LANES_AVX2
+#endif
+
+typedef uint64_t keccak_lanes_t __attribute__ ((vector_size (8 * KECCAK_LANES)));
+
+// inlined into each kernel below, so that each is compiled for its target
+static inline __attribute__ ((always_inline)) void keccakf_lanes(keccak_lanes_t st[25], int rounds)
+{
+    int i, j, round;
+    keccak_lanes_t t, bc[5];
+
+    for (round = 0; round < rounds; round++) {
+
+        // Theta
+        for (i = 0; i < 5; i++)
+            bc[i] = st[i] ^ st[i + 5] ^ st[i + 10] ^ st[i + 15] ^ st[i + 20];
+
+        for (i = 0; i < 5; i++) {
+            t = bc[(i + 4) % 5] ^ ROTL64(bc[(i + 1) % 5], 1);
+            for (j = 0; j < 25; j += 5)
+                st[j + i] ^= t;
+        }
+
+        // Rho Pi
+        t = st[1];
+        for (i = 0; i < 24; i++) {
+            j = keccakf_piln[i];
+            bc[0] = st[j];
+            st[j] = ROTL64(t, keccakf_rotc[i]);
+            t = bc[0];
+        }
+
+        //  Chi
+        for (j = 0; j < 25; j += 5) {
+            for (i = 0; i < 5; i++)
+                bc[i] = st[j + i];
+            for (i = 0; i < 5; i++)
+                st[j + i] ^= (~bc[(i + 1) % 5]) & bc[(i + 2) % 5];
+        }
+
+        //  Iota
+        st[0] ^= keccakf_rndc[round];
+    }
+}
+
+static inline __attribute__ ((always_inline)) void keccak_lanes(const uint8_t *in, size_t inlen, uint8_t *md, int mdlen)
+{
+    keccak_lanes_t st[25];
+    uint8_t temp[KECCAK_LANES][144];
+    uint64_t w, out[25];
+    size_t i, l, left, rsiz, rsizw;
+    const uint8_t *p;
+
+    rsiz = sizeof(state_t) == mdlen ? HASH_DATA_AREA : 200 - 2 * mdlen;
+    rsizw = rsiz / 8;
+
+    memset(st, 0, sizeof(st));
+
+    for (p = in, left = inlen; left >= rsiz; left -= rsiz, p += rsiz) {
+        for (i = 0; i < rsizw; i++)
+            for (l = 0; l < KECCAK_LANES; l++) {
+                memcpy(&w, p + l * inlen + i * 8, 8);
+                st[i][l] ^= w;
+            }
+        keccakf_lanes(st, KECCAK_ROUNDS);
+    }
+
+    // last blocks and padding
+    for (l = 0; l < KECCAK_LANES; l++) {
+        memcpy(temp[l], p + l * inlen, left);
+        temp[l][left] = 1;
+        memset(temp[l] + left + 1, 0, rsiz - left - 1);
+        temp[l][rsiz - 1] |= 0x80;
+    }
+
+    for (i = 0; i < rsizw; i++)
+        for (l = 0; l < KECCAK_LANES; l++) {
+            memcpy(&w, temp[l] + i * 8, 8);
+            st[i][l] ^= w;
+        }
+
+    keccakf_lanes(st, KECCAK_ROUNDS);
+
+    for (l = 0; l < KECCAK_LANES; l++) {
+        for (i = 0; i < (size_t)(mdlen + 7) / 8; i++)
+            out[i] = st[i][l];
+        memcpy(md + l * mdlen, out, mdlen);
+    }
+}
+
+static void keccak_lanes_target(const uint8_t *in, size_t inlen, uint8_t *md, int mdlen)
+{
+    keccak_lanes(in, inlen, md, mdlen);
+}
+
+#if defined(KECCAK_LANES_AVX2)
+__attribute__ ((target ("avx2"))) static void keccak_lanes_avx2(const uint8_t *in, size_t inlen, uint8_t *md, int mdlen)
+{
+    keccak_lanes(in, inlen, md, mdlen);
+}
+#endif
+
+typedef void (*keccak_lanes_f)(const uint8_t *, size_t, uint8_t *, int);
+
+// the best lanes kernel cpu_features() allows, NULL if none
+static keccak_lanes_f pick_lanes(const char **name)
+{
+    const uint32_t features = cpu_features();
+
+#if defined(KECCAK_LANES_AVX2)
+    if (features & CPU_FEATURE_AVX2) {
+        *name = "avx2, 4 lanes";
+        return keccak_lanes_avx2;
+    }
+#endif
+    if ((features & KECCAK_LANES_NEEDS) == KECCAK_LANES_NEEDS) {
+        *name = KECCAK_LANES_NAME;
+        return keccak_lanes_target;
+    }
+    return NULL;
+}
+
+#endif
+
+const char *keccak_batch_kernel(void)
+{
+    const char *name = "scalar";
+#if defined(KECCAK_LANES)
+    pick_lanes(&name);
+#endif
+    return name;
+}
+
+void keccak_batch(const uint8_t *in, size_t inlen, size_t count, uint8_t *md, int mdlen)
+{
+    size_t n = 0;
+
+#if defined(KECCAK_LANES)
+    const char *name;
+    const keccak_lanes_f lanes = count >= KECCAK_LANES ? pick_lanes(&name) : NULL;
+    if (lanes)
+        for ( ; n + KECCAK_LANES <= count; n += KECCAK_LANES)
+            lanes(in + n * inlen, inlen, md + n * mdlen, mdlen);
+#endif
+
+    for ( ; n < count; n++)
+        keccak(in + n * inlen, inlen, md + n * mdlen, mdlen);
+}
@@ -23,4 +23,11 @@ void keccakf(uint64_t st[25], int norounds);
 
 void keccak1600(const uint8_t *in, size_t inlen, uint8_t *md);
 
+// compute count keccak hashes of inlen byte inputs stored back to back in
+// "in", into md at mdlen byte strides. Several inputs go through the
+// permutation at once in SIMD lanes where the compiler supports vector types,
+// with the widest kernel cpu_features() allows (see keccak_batch_kernel).
+// md may overlap in, as long as hash n does not overwrite input n + 1 onward.
+void keccak_batch(const uint8_t *in, size_t inlen, size_t count, uint8_t *md, int mdlen);
+
 #endif
@@ -113,31 +113,77 @@ INITIALIZER(init_random) {
 #endif
 }
 
-void generate_random_bytes_not_thread_safe(size_t n, void *result) {
-#if !defined(NDEBUG)
-  assert(curstate == 1);
-  curstate = 2;
-#endif
+static void generate_random_bytes_from(union hash_state *s, size_t n, void *result) {
   if (n == 0) {
-#if !defined(NDEBUG)
-    assert(curstate == 2);
-    curstate = 1;
-#endif
     return;
   }
   for (;;) {
-    hash_permutation(&state);
+    hash_permutation(s);
     if (n <= HASH_DATA_AREA) {
-      memcpy(result, &state, n);
-#if !defined(NDEBUG)
-      assert(curstate == 2);
-      curstate = 1;
-#endif
+      memcpy(result, s, n);
       return;
     } else {
-      memcpy(result, &state, HASH_DATA_AREA);
+      memcpy(result, s, HASH_DATA_AREA);
       result = padd(result, HASH_DATA_AREA);
       n -= HASH_DATA_AREA;
     }
   }
 }
+
+void generate_random_bytes_not_thread_safe(size_t n, void *result) {
+#if !defined(NDEBUG)
+  assert(curstate == 1);
+  curstate = 2;
+#endif
+  generate_random_bytes_from(&state, n, result);
+#if !defined(NDEBUG)
+  assert(curstate == 2);
+  curstate = 1;
+#endif
+}
+
+#if defined(_MSC_VER)
+#define THREADV __declspec(thread)
+#else
+#define THREADV __thread
+#endif
+
+/* Each thread gets its own state, built the same way as the global one,
+ * so callers on different threads never contend for a lock. It is seeded
+ * from the OS on first use and gets fresh OS entropy mixed in every
+ * RANDOM_RESEED_BYTES of output, and after a fork so a child does not
+ * replay its parent's stream. */
+#define RANDOM_RESEED_BYTES (1024 * 1024)
+
+static THREADV union hash_state thread_state;
+static THREADV size_t thread_state_left; /* output left before a reseed, 0 if unseeded */
+#if !defined(_WIN32)
+static THREADV pid_t thread_state_pid;
+#endif
+
+static void reseed_thread_state(void) {
+  uint8_t seed[32];
+  size_t i;
+  generate_system_random_bytes(sizeof(seed), seed);
+  for (i = 0; i < sizeof(seed); ++i) {
+    thread_state.b[i] ^= seed[i];
+  }
+  memset(seed, 0, sizeof(seed));
+  hash_permutation(&thread_state);
+  thread_state_left = RANDOM_RESEED_BYTES;
+#if !defined(_WIN32)
+  thread_state_pid = getpid();
+#endif
+}
+
+void generate_random_bytes_thread_safe(size_t n, void *result) {
+#if !defined(_WIN32)
+  if (thread_state_left == 0 || thread_state_pid != getpid()) {
+#else
+  if (thread_state_left == 0) {
+#endif
+    reseed_thread_state();
+  }
+  generate_random_bytes_from(&thread_state, n, result);
+  thread_state_left = n < thread_state_left ? thread_state_left - n : 0;
+}
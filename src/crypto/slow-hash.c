@@ -34,6 +34,7 @@
 #include <string.h>
 
 #include "common/int-util.h"
+#include "cpu-features.h"
 #include "hash-ops.h"
 #include "oaes_lib.h"
 
@@ -156,22 +157,9 @@ union cn_slow_hash_state
 THREADV uint8_t *hp_state = NULL;
 THREADV int hp_allocated = 0;
 
-#if defined(_MSC_VER)
-#define cpuid(info,x)    __cpuidex(info,x,0)
-#else
-void cpuid(int CPUInfo[4], int InfoType)
-{
-    ASM __volatile__
-    (
-    "cpuid":
-        "=a" (CPUInfo[0]),
-        "=b" (CPUInfo[1]),
-        "=c" (CPUInfo[2]),
-        "=d" (CPUInfo[3]) :
-            "a" (InfoType), "c" (0)
-        );
-}
-#endif
+// scratchpads for the second and further hashes of cn_slow_hash_multi
+THREADV uint8_t *hp_multi_state[CN_SLOW_HASH_MAX_WAYS - 1] = { NULL };
+THREADV int hp_multi_allocated[CN_SLOW_HASH_MAX_WAYS - 1] = { 0 };
 
 /**
  * @brief a = (a xor b), where a and b point to 128 bit values
@@ -184,40 +172,13 @@ STATIC INLINE void xor_blocks(uint8_t *a, const uint8_t *b)
 }
 
 /**
- * @brief uses cpuid to determine if the CPU supports the AES instructions
- * @return true if the CPU supports AES, false otherwise
+ * @brief whether the AES-NI code may be used
+ * @return true if the CPU supports AES and it was not turned off, see cpu-features.h
  */
 
-STATIC INLINE int force_software_aes(void)
-{
-  static int use = -1;
-
-  if (use != -1)
-    return use;
-
-  const char *env = getenv("MONERO_USE_SOFTWARE_AES");
-  if (!env) {
-    use = 0;
-  }
-  else if (!strcmp(env, "0") || !strcmp(env, "no")) {
-    use = 0;
-  }
-  else {
-    use = 1;
-  }
-  return use;
-}
-
 STATIC INLINE int check_aes_hw(void)
 {
-    int cpuid_results[4];
-    static int supported = -1;
-
-    if(supported >= 0)
-        return supported;
-
-    cpuid(cpuid_results,1);
-    return supported = cpuid_results[2] & (1 << 25);
+    return (cpu_features() & CPU_FEATURE_AES) != 0;
 }
 
 STATIC INLINE void aes_256_assist1(__m128i* t1, __m128i * t2)
@@ -420,71 +381,161 @@ BOOL SetLockPagesPrivilege(HANDLE hProcess, BOOL bEnable)
 }
 #endif
 
+// how a scratch buffer was allocated, see allocate_pad
+#define PAD_MALLOC      0
+#define PAD_HUGE        1
+#define PAD_TRANSPARENT 2
+#define PAD_MMAP        3
+
 /**
- * @brief allocate the 2MB scratch buffer using OS support for huge pages, if available
+ * @brief allocate a 2MB scratch buffer using OS support for huge pages, if available
  *
  * This function tries to allocate the 2MB scratch buffer using a single
  * 2MB "huge page" (instead of the usual 4KB page sizes) to reduce TLB misses
  * during the random accesses to the scratch buffer.  This is one of the
  * important speed optimizations needed to make CryptoNight faster.
  *
- * No parameters.  Updates a thread-local pointer, hp_state, to point to
- * the allocated buffer.
+ * Explicit huge pages (MAP_HUGETLB, or large pages on Windows) have to be
+ * reserved by the administrator.  Without them, on Linux, a 2MB aligned
+ * mapping is asked to be backed by a transparent huge page instead, and
+ * failing that the buffer comes from malloc.
+ *
+ * @param allocated set to the PAD_* kind of allocation that succeeded
+ * @return the allocated buffer
  */
 
-void slow_hash_allocate_state(void)
+STATIC uint8_t *allocate_pad(int *allocated)
 {
-    if(hp_state != NULL)
-        return;
+    uint8_t *pad;
 
 #if defined(_MSC_VER) || defined(__MINGW32__)
     SetLockPagesPrivilege(GetCurrentProcess(), TRUE);
-    hp_state = (uint8_t *) VirtualAlloc(hp_state, MEMORY, MEM_LARGE_PAGES |
-                                        MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    pad = (uint8_t *) VirtualAlloc(NULL, MEMORY, MEM_LARGE_PAGES |
+                                   MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    *allocated = PAD_HUGE;
 #else
 #if defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || \
   defined(__DragonFly__)
-    hp_state = mmap(0, MEMORY, PROT_READ | PROT_WRITE,
-                    MAP_PRIVATE | MAP_ANON, 0, 0);
+    pad = mmap(0, MEMORY, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANON, 0, 0);
+    *allocated = PAD_MMAP;
 #else
-    hp_state = mmap(0, MEMORY, PROT_READ | PROT_WRITE,
-                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, 0, 0);
+    pad = mmap(0, MEMORY, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, 0, 0);
+    *allocated = PAD_HUGE;
+#if defined(MADV_HUGEPAGE)
+    if(pad == MAP_FAILED)
+    {
+        // over-allocate so that an aligned 2MB range can be kept, as only
+        // those can be backed by a transparent huge page
+        uint8_t *area = mmap(0, 2 * MEMORY, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, 0, 0);
+        pad = MAP_FAILED;
+        if(area != MAP_FAILED)
+        {
+            size_t head = (MEMORY - ((uintptr_t) area & (MEMORY - 1))) & (MEMORY - 1);
+            if(head)
+                munmap(area, head);
+            munmap(area + head + MEMORY, MEMORY - head);
+            pad = area + head;
+            if(madvise(pad, MEMORY, MADV_HUGEPAGE) == 0)
+                *allocated = PAD_TRANSPARENT;
+            else
+                *allocated = PAD_MMAP;
+        }
+    }
 #endif
-    if(hp_state == MAP_FAILED)
-        hp_state = NULL;
 #endif
-    hp_allocated = 1;
-    if(hp_state == NULL)
+    if(pad == MAP_FAILED)
+        pad = NULL;
+#endif
+    if(pad == NULL)
     {
-        hp_allocated = 0;
-        hp_state = (uint8_t *) malloc(MEMORY);
+        *allocated = PAD_MALLOC;
+        pad = (uint8_t *) malloc(MEMORY);
     }
+    return pad;
 }
 
 /**
- *@brief frees the state allocated by slow_hash_allocate_state
+ * @brief frees a scratch buffer allocated by allocate_pad
  */
 
-void slow_hash_free_state(void)
+STATIC void free_pad(uint8_t *pad, int allocated)
 {
-    if(hp_state == NULL)
-        return;
-
-    if(!hp_allocated)
-        free(hp_state);
+    if(allocated == PAD_MALLOC)
+        free(pad);
     else
     {
 #if defined(_MSC_VER) || defined(__MINGW32__)
-        VirtualFree(hp_state, MEMORY, MEM_RELEASE);
+        VirtualFree(pad, MEMORY, MEM_RELEASE);
 #else
-        munmap(hp_state, MEMORY);
+        munmap(pad, MEMORY);
 #endif
     }
+}
+
+/**
+ * @brief allocate the 2MB scratch buffer for this thread
+ *
+ * No parameters.  Updates a thread-local pointer, hp_state, to point to
+ * the allocated buffer.
+ */
 
+void slow_hash_allocate_state(void)
+{
+    if(hp_state != NULL)
+        return;
+
+    hp_state = allocate_pad(&hp_allocated);
+}
+
+/**
+ *@brief frees the state allocated by slow_hash_allocate_state, and any
+ *       extra scratch buffers used by cn_slow_hash_multi
+ */
+
+void slow_hash_free_state(void)
+{
+    size_t i;
+
+    for(i = 0; i < CN_SLOW_HASH_MAX_WAYS - 1; i++)
+    {
+        if(hp_multi_state[i] == NULL)
+            continue;
+        free_pad(hp_multi_state[i], hp_multi_allocated[i]);
+        hp_multi_state[i] = NULL;
+        hp_multi_allocated[i] = 0;
+    }
+
+    if(hp_state == NULL)
+        return;
+
+    free_pad(hp_state, hp_allocated);
     hp_state = NULL;
     hp_allocated = 0;
 }
 
+/**
+ * @brief describes the pages backing this thread's scratch buffer
+ *
+ * @return "huge pages", "transparent huge pages", "regular pages", or
+ *         "not allocated" if slow_hash_allocate_state has not been called
+ */
+
+const char *slow_hash_state_pages(void)
+{
+    if(hp_state == NULL)
+        return "not allocated";
+
+    switch(hp_allocated)
+    {
+        case PAD_HUGE: return "huge pages";
+        case PAD_TRANSPARENT: return "transparent huge pages";
+        default: return "regular pages";
+    }
+}
+
 /**
  * @brief the hash function implementing CryptoNight, used for the Monero proof-of-work
  *
@@ -531,7 +582,7 @@ void cn_slow_hash(const void *data, size_t length, char *hash)
     size_t i, j;
     uint64_t *p = NULL;
     oaes_ctx *aes_ctx;
-    int useAes = !force_software_aes() && check_aes_hw();
+    int useAes = check_aes_hw();
 
     static void (*const extra_hashes[4])(const void *, size_t, char *) =
     {
@@ -645,6 +696,117 @@ void cn_slow_hash(const void *data, size_t length, char *hash)
     extra_hashes[state.hs.b[0] & 3](&state, 200, hash);
 }
 
+/**
+ * @brief computes several CryptoNight hashes at once, interleaving their main loops
+ *
+ * Most of cn_slow_hash's time goes to waiting on the random reads and writes
+ * of step 3, each of which depends on the one before it.  Hashes of
+ * different data do not depend on each other, so stepping up to
+ * CN_SLOW_HASH_MAX_WAYS of them in lockstep, each in its own scratchpad,
+ * lets the CPU overlap one hash's memory accesses with another's.  The
+ * results are the same as calling cn_slow_hash on each input in turn, which
+ * is what happens when hardware AES is not available.
+ *
+ * @param data the data to hash, one pointer per hash
+ * @param length the length in bytes of each data
+ * @param count the number of hashes to compute
+ * @param hash a buffer of count * 32 bytes, in which the hashes are stored in order
+ */
+
+void cn_slow_hash_multi(const void *const *data, const size_t *length, size_t count, char *hash)
+{
+    RDATA_ALIGN16 uint8_t expandedKey[240];
+
+    uint8_t text[INIT_SIZE_BYTE];
+    RDATA_ALIGN16 uint64_t lane_a[CN_SLOW_HASH_MAX_WAYS][2];
+    RDATA_ALIGN16 uint64_t lane_b[CN_SLOW_HASH_MAX_WAYS][2];
+    RDATA_ALIGN16 uint64_t lane_c[CN_SLOW_HASH_MAX_WAYS][2];
+    __m128i lane_xb[CN_SLOW_HASH_MAX_WAYS];
+    uint8_t *pads[CN_SLOW_HASH_MAX_WAYS];
+    union cn_slow_hash_state state[CN_SLOW_HASH_MAX_WAYS];
+    size_t ways, i, l;
+
+    static void (*const extra_hashes[4])(const void *, size_t, char *) =
+    {
+        hash_extra_blake, hash_extra_groestl, hash_extra_jh, hash_extra_skein
+    };
+
+    if(!check_aes_hw())
+    {
+        for(i = 0; i < count; i++)
+            cn_slow_hash(data[i], length[i], hash + i * HASH_SIZE);
+        return;
+    }
+
+    if(hp_state == NULL)
+        slow_hash_allocate_state();
+    pads[0] = hp_state;
+
+    for(; count > 0; count -= ways, data += ways, length += ways, hash += ways * HASH_SIZE)
+    {
+        ways = count < CN_SLOW_HASH_MAX_WAYS ? count : CN_SLOW_HASH_MAX_WAYS;
+
+        /* Steps 1 and 2 stream through memory, so run them one hash at a time */
+        for(l = 0; l < ways; l++)
+        {
+            if(l > 0 && hp_multi_state[l - 1] == NULL)
+                hp_multi_state[l - 1] = allocate_pad(&hp_multi_allocated[l - 1]);
+            if(l > 0)
+                pads[l] = hp_multi_state[l - 1];
+
+            hash_process(&state[l].hs, data[l], length[l]);
+            memcpy(text, state[l].init, INIT_SIZE_BYTE);
+            aes_expand_key(state[l].hs.b, expandedKey);
+            for(i = 0; i < MEMORY / INIT_SIZE_BYTE; i++)
+            {
+                aes_pseudo_round(text, text, expandedKey, INIT_SIZE_BLK);
+                memcpy(&pads[l][i * INIT_SIZE_BYTE], text, INIT_SIZE_BYTE);
+            }
+
+            lane_a[l][0] = U64(&state[l].k[0])[0] ^ U64(&state[l].k[32])[0];
+            lane_a[l][1] = U64(&state[l].k[0])[1] ^ U64(&state[l].k[32])[1];
+            lane_b[l][0] = U64(&state[l].k[16])[0] ^ U64(&state[l].k[48])[0];
+            lane_b[l][1] = U64(&state[l].k[16])[1] ^ U64(&state[l].k[48])[1];
+            lane_xb[l] = _mm_load_si128(R128(lane_b[l]));
+        }
+
+        /* Step 3, one iteration of every hash at a time.  The locals shadow
+         * the names pre_aes() and post_aes() work on. */
+        for(i = 0; i < ITER / 2; i++)
+        {
+            for(l = 0; l < ways; l++)
+            {
+                uint8_t *hp_state = pads[l];
+                uint64_t *a = lane_a[l];
+                uint64_t *b = lane_b[l];
+                uint64_t *c = lane_c[l];
+                __m128i _a, _c, _b = lane_xb[l];
+                uint64_t hi, lo;
+                uint64_t *p;
+                size_t j;
+
+                pre_aes();
+                _c = _mm_aesenc_si128(_c, _a);
+                post_aes();
+                lane_xb[l] = _b;
+            }
+        }
+
+        /* Steps 4 and 5 */
+        for(l = 0; l < ways; l++)
+        {
+            memcpy(text, state[l].init, INIT_SIZE_BYTE);
+            aes_expand_key(&state[l].hs.b[32], expandedKey);
+            for(i = 0; i < MEMORY / INIT_SIZE_BYTE; i++)
+                aes_pseudo_round_xor(text, text, expandedKey, &pads[l][i * INIT_SIZE_BYTE], INIT_SIZE_BLK);
+
+            memcpy(state[l].init, text, INIT_SIZE_BYTE);
+            hash_permutation(&state[l].hs);
+            extra_hashes[state[l].hs.b[0] & 3](&state[l], 200, hash + l * HASH_SIZE);
+        }
+    }
+}
+
 #elif defined(__arm__) || defined(__aarch64__)
 void slow_hash_allocate_state(void)
 {
@@ -682,7 +844,30 @@ union cn_slow_hash_state
 };
 #pragma pack(pop)
 
+/* The ARMv8 crypto extension code below is built whenever the compiler can
+ * target it: always when the build enables it (-march=...+crypto), and with
+ * GCC >= 6 also in generic aarch64 builds, through a per function target
+ * attribute. In the latter case it is only used if the CPU reports AES
+ * support (HWCAP_AES), so one binary runs on cores with and without it
+ * (the Raspberry Pi 3's Cortex-A53 has none).
+ */
 #if defined(__aarch64__) && defined(__ARM_FEATURE_CRYPTO)
+#define CN_ARM_AES
+#define ARM_AES_TARGET
+#elif defined(__aarch64__) && defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 6
+#define CN_ARM_AES
+#define ARM_AES_TARGET __attribute__((target("+crypto")))
+#endif
+
+#if defined(CN_ARM_AES)
+
+/**
+ * @brief whether the ARMv8 AES code may be used, see cpu-features.h
+ */
+STATIC INLINE int check_aes_hw(void)
+{
+    return (cpu_features() & CPU_FEATURE_AES) != 0;
+}
 
 /* ARMv8-A optimized with NEON and AES instructions.
  * Copied from the x86-64 AES-NI implementation. It has much the same
@@ -717,63 +902,38 @@ union cn_slow_hash_state
   _b = _c; \
 
 
-/* Note: this was based on a standard 256bit key schedule but
- * it's been shortened since Cryptonight doesn't use the full
- * key schedule. Don't try to use this for vanilla AES.
-*/
-static void aes_expand_key(const uint8_t *key, uint8_t *expandedKey) {
-__asm__("mov x2, %1\n\t" : : "r"(key), "r"(expandedKey));
-__asm__(
-"	adr	x3,Lrcon\n"
-"\n"
-"	eor	v0.16b,v0.16b,v0.16b\n"
-"	ld1	{v3.16b},[x0],#16\n"
-"	ld1	{v1.4s,v2.4s},[x3],#32\n"
-"	b	L256\n"
-".align 5\n"
-"Lrcon:\n"
-".long	0x01,0x01,0x01,0x01\n"
-".long	0x0c0f0e0d,0x0c0f0e0d,0x0c0f0e0d,0x0c0f0e0d	// rotate-n-splat\n"
-".long	0x1b,0x1b,0x1b,0x1b\n"
-"\n"
-".align 4\n"
-"L256:\n"
-"	ld1	{v4.16b},[x0]\n"
-"	mov	w1,#5\n"
-"	st1	{v3.4s},[x2],#16\n"
-"\n"
-"Loop256:\n"
-"	tbl	v6.16b,{v4.16b},v2.16b\n"
-"	ext	v5.16b,v0.16b,v3.16b,#12\n"
-"	st1	{v4.4s},[x2],#16\n"
-"	aese	v6.16b,v0.16b\n"
-"	subs	w1,w1,#1\n"
-"\n"
-"	eor	v3.16b,v3.16b,v5.16b\n"
-"	ext	v5.16b,v0.16b,v5.16b,#12\n"
-"	eor	v3.16b,v3.16b,v5.16b\n"
-"	ext	v5.16b,v0.16b,v5.16b,#12\n"
-"	eor	v6.16b,v6.16b,v1.16b\n"
-"	eor	v3.16b,v3.16b,v5.16b\n"
-"	shl	v1.16b,v1.16b,#1\n"
-"	eor	v3.16b,v3.16b,v6.16b\n"
-"	st1	{v3.4s},[x2],#16\n"
-"	b.eq	Ldone\n"
-"\n"
-"	dup	v6.4s,v3.s[3]		// just splat\n"
-"	ext	v5.16b,v0.16b,v4.16b,#12\n"
-"	aese	v6.16b,v0.16b\n"
-"\n"
-"	eor	v4.16b,v4.16b,v5.16b\n"
-"	ext	v5.16b,v0.16b,v5.16b,#12\n"
-"	eor	v4.16b,v4.16b,v5.16b\n"
-"	ext	v5.16b,v0.16b,v5.16b,#12\n"
-"	eor	v4.16b,v4.16b,v5.16b\n"
-"\n"
-"	eor	v4.16b,v4.16b,v6.16b\n"
-"	b	Loop256\n"
-"\n"
-"Ldone:\n");
+/* SubWord of the AES key schedule: aese with a zero key is SubBytes then
+ * ShiftRows, and ShiftRows does nothing to a vector made of four copies
+ * of the same word.
+ */
+ARM_AES_TARGET STATIC INLINE uint32_t aes_sub_word(uint32_t w)
+{
+	uint8x16_t x = vreinterpretq_u8_u32(vdupq_n_u32(w));
+	x = vaeseq_u8(x, vdupq_n_u8(0));
+	return vgetq_lane_u32(vreinterpretq_u32_u8(x), 0);
+}
+
+/* Note: this is a standard 256bit key schedule (on little endian words)
+ * cut short, since Cryptonight only uses the first 10 round keys.
+ * Don't try to use this for vanilla AES.
+ */
+ARM_AES_TARGET STATIC void aes_expand_key(const uint8_t *key, uint8_t *expandedKey)
+{
+	static const uint32_t rcon[4] = { 0x01, 0x02, 0x04, 0x08 };
+	uint32_t w[40];
+	size_t i;
+
+	memcpy(w, key, AES_KEY_SIZE);
+	for (i = 8; i < 40; i++)
+	{
+		uint32_t t = w[i - 1];
+		if (i % 8 == 0)
+			t = aes_sub_word((t >> 8) | (t << 24)) ^ rcon[i / 8 - 1];
+		else if (i % 8 == 4)
+			t = aes_sub_word(t);
+		w[i] = w[i - 8] ^ t;
+	}
+	memcpy(expandedKey, w, sizeof(w));
 }
 
 /* An ordinary AES round is a sequence of SubBytes, ShiftRows, MixColumns, AddRoundKey. There
@@ -784,10 +944,9 @@ __asm__(
  * feeding in a vector of zeros for our first step. Also we have to do our own Xor explicitly
  * at the last step, to provide the AddRoundKey that the ARM instructions omit.
  */
-STATIC INLINE void aes_pseudo_round(const uint8_t *in, uint8_t *out, const uint8_t *expandedKey, int nblocks)
+ARM_AES_TARGET STATIC INLINE void aes_pseudo_round(const uint8_t *in, uint8_t *out, const uint8_t *expandedKey, int nblocks)
 {
 	const uint8x16_t *k = (const uint8x16_t *)expandedKey, zero = {0};
-	uint8x16_t tmp;
 	int i;
 
 	for (i=0; i<nblocks; i++)
@@ -818,11 +977,10 @@ STATIC INLINE void aes_pseudo_round(const uint8_t *in, uint8_t *out, const uint8
 	}
 }
 
-STATIC INLINE void aes_pseudo_round_xor(const uint8_t *in, uint8_t *out, const uint8_t *expandedKey, const uint8_t *xor, int nblocks)
+ARM_AES_TARGET STATIC INLINE void aes_pseudo_round_xor(const uint8_t *in, uint8_t *out, const uint8_t *expandedKey, const uint8_t *xor, int nblocks)
 {
 	const uint8x16_t *k = (const uint8x16_t *)expandedKey;
 	const uint8x16_t *x = (const uint8x16_t *)xor;
-	uint8x16_t tmp;
 	int i;
 
 	for (i=0; i<nblocks; i++)
@@ -853,7 +1011,7 @@ STATIC INLINE void aes_pseudo_round_xor(const uint8_t *in, uint8_t *out, const u
 	}
 }
 
-void cn_slow_hash(const void *data, size_t length, char *hash)
+ARM_AES_TARGET STATIC void cn_slow_hash_aes(const void *data, size_t length, char *hash)
 {
     RDATA_ALIGN16 uint8_t expandedKey[240];
     RDATA_ALIGN16 uint8_t hp_state[MEMORY];
@@ -936,7 +1094,9 @@ void cn_slow_hash(const void *data, size_t length, char *hash)
     hash_permutation(&state.hs);
     extra_hashes[state.hs.b[0] & 3](&state, 200, hash);
 }
-#else /* aarch64 && crypto */
+
+#undef state_index
+#endif /* CN_ARM_AES */
 
 // ND: Some minor optimizations for ARMv7 (raspberrry pi 2), effect seems to be ~40-50% faster.
 //     Needs more work.
@@ -1050,7 +1210,7 @@ STATIC INLINE void xor_blocks(uint8_t* a, const uint8_t* b)
   U64(a)[1] ^= U64(b)[1];
 }
 
-void cn_slow_hash(const void *data, size_t length, char *hash)
+STATIC void cn_slow_hash_soft(const void *data, size_t length, char *hash)
 {
     uint8_t long_state[MEMORY];
     uint8_t text[INIT_SIZE_BYTE];
@@ -1130,7 +1290,18 @@ void cn_slow_hash(const void *data, size_t length, char *hash)
     hash_permutation(&state.hs);
     extra_hashes[state.hs.b[0] & 3](&state, 200, hash);
 }
-#endif /* !aarch64 || !crypto */
+
+void cn_slow_hash(const void *data, size_t length, char *hash)
+{
+#if defined(CN_ARM_AES)
+    if(check_aes_hw())
+    {
+        cn_slow_hash_aes(data, length, hash);
+        return;
+    }
+#endif
+    cn_slow_hash_soft(data, length, hash);
+}
 
 #else
 // Portable implementation as a fallback
@@ -1284,3 +1455,30 @@ void cn_slow_hash(const void *data, size_t length, char *hash) {
 }
 
 #endif
+
+#if !(defined(__x86_64__) || (defined(_MSC_VER) && defined(_WIN64)))
+const char *slow_hash_state_pages(void)
+{
+  // the scratch buffer is not kept between hashes here
+  return "not allocated";
+}
+
+// Without the SSE code above, there is nothing to interleave
+void cn_slow_hash_multi(const void *const *data, const size_t *length, size_t count, char *hash)
+{
+  size_t i;
+  for (i = 0; i < count; i++)
+    cn_slow_hash(data[i], length[i], hash + i * HASH_SIZE);
+}
+#endif
+
+const char *cn_slow_hash_kernel(void)
+{
+#if defined(__x86_64__) || (defined(_MSC_VER) && defined(_WIN64))
+    return check_aes_hw() ? "aes-ni" : "sse2, software aes";
+#elif defined(CN_ARM_AES)
+    return check_aes_hw() ? "armv8 aes" : "portable";
+#else
+    return "portable";
+#endif
+}
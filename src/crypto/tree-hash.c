@@ -83,8 +83,6 @@ void tree_hash(const char (*hashes)[HASH_SIZE], size_t count, char *root_hash) {
   } else if (count == 2) {
     cn_fast_hash(hashes, 2 * HASH_SIZE, root_hash);
   } else {
-    size_t i, j;
-
     size_t cnt = tree_hash_cnt( count );
     size_t max_size_t = (size_t) -1; // max allowed value of size_t 
     assert( cnt < max_size_t/2 ); // reasonable size to avoid any overflows. /2 is extra; Anyway should be limited much stronger by logical code 
@@ -96,16 +94,13 @@ void tree_hash(const char (*hashes)[HASH_SIZE], size_t count, char *root_hash) {
 
     memcpy(ints, hashes, (2 * cnt - count) * HASH_SIZE);
 
-    for (i = 2 * cnt - count, j = 2 * cnt - count; j < cnt; i += 2, ++j) {
-      cn_fast_hash(hashes[i], 64, ints[j]);
-    }
-    assert(i == count);
+    // each level hashes independent pairs, which go through the batch
+    // hash together; hashing in place is fine as pair i lands on i / 2
+    cn_fast_hash_batch(hashes[2 * cnt - count], 64, count - cnt, ints[2 * cnt - count]);
 
     while (cnt > 2) {
       cnt >>= 1;
-      for (i = 0, j = 0; j < cnt; i += 2, ++j) {
-        cn_fast_hash(ints[i], 64, ints[j]);
-      }
+      cn_fast_hash_batch(ints[0], 64, cnt, ints[0]);
     }
 
     cn_fast_hash(ints[0], 64, root_hash);
@@ -46,6 +46,7 @@
 #define CURRENT_BLOCK_MINOR_VERSION                     0
 #define CRYPTONOTE_BLOCK_FUTURE_TIME_LIMIT              60*60*2
 #define CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE             10
+#define CRYPTONOTE_PRUNING_MIN_DEPTH                    5000 // blocks, so reorgs never reach pruned txs
 
 #define BLOCKCHAIN_TIMESTAMP_CHECK_WINDOW               60
 
@@ -88,12 +89,29 @@
 
 #define BLOCKS_IDS_SYNCHRONIZING_DEFAULT_COUNT          10000  //by default, blocks ids count in synchronizing
 #define BLOCKS_SYNCHRONIZING_DEFAULT_COUNT              200    //by default, blocks count in blocks downloading
+#define BLOCKS_SYNCHRONIZING_MAX_COUNT                  2048   //max blocks count in one download request sized by bytes
+#define BLOCKS_SYNCHRONIZING_DEFAULT_SIZE               (1024*1024)  //bytes to request from a peer we have no download rate for yet
+#define BLOCKS_SYNCHRONIZING_MIN_SIZE                   (256*1024)
+#define BLOCKS_SYNCHRONIZING_MAX_SIZE                   (P2P_DEFAULT_PACKET_MAX_SIZE / 5) //stay well clear of the packet limit
+#define BLOCKS_SYNCHRONIZING_TARGET_SECONDS             10     //size requests to take about this long at the peer's download rate
 #define CRYPTONOTE_PROTOCOL_HOP_RELAX_COUNT             3      //value of hop, after which we use only announce of new block
+#define BLOCK_QUEUE_SIZE_THRESHOLD                      (100*1024*1024) //downloaded blocks buffered ahead of the chain before we stop reserving new spans
+#define BLOCK_QUEUE_SPAN_RETRY_SECONDS                  30     //a span still not downloaded after this long may be requested from another peer
+#define ORPHAN_BLOCKS_MAX_SIZE                          (16*1024*1024) //blocks whose parent we miss, kept to add once it arrives
+#define ORPHAN_BLOCKS_MAX_COUNT                         64
+#define BLOCK_SYNC_SLOW_PEER_RATIO                      4      //peers this many times slower than the median sync peer lose their span to others
+#define BLOCK_SYNC_SLOW_PEER_STRIKES                    3      //sync peers found slow this many checks in a row are dropped
 
 #define CRYPTONOTE_MEMPOOL_TX_LIVETIME                    86400 //seconds, one day
 #define CRYPTONOTE_MEMPOOL_TX_FROM_ALT_BLOCK_LIVETIME     604800 //seconds, one week
+#define DEFAULT_TXPOOL_MAX_SIZE                           648000000ull // 3 days at 300000, in bytes
 
 #define COMMAND_RPC_GET_BLOCKS_FAST_MAX_COUNT           1000
+#define COMMAND_RPC_SEND_RAW_TXS_MAX_COUNT              1000
+#define COMMAND_RPC_GET_HASHES_BY_HEIGHT_MAX_COUNT      1000
+#define COMMAND_RPC_IS_KEY_IMAGE_SPENT_MAX_COUNT        1000
+#define COMMAND_RPC_GET_TXS_GLOBAL_OUTPUTS_INDEXES_MAX_COUNT 1000
+#define COMMAND_RPC_GET_EVENTS_MAX_COUNT                1000
 
 #define P2P_LOCAL_WHITE_PEERLIST_LIMIT                  1000
 #define P2P_LOCAL_GRAY_PEERLIST_LIMIT                   5000
@@ -101,20 +119,45 @@
 #define P2P_DEFAULT_CONNECTIONS_COUNT                   8
 #define P2P_DEFAULT_HANDSHAKE_INTERVAL                  60           //secondes
 #define P2P_DEFAULT_PACKET_MAX_SIZE                     50000000     //50000000 bytes maximum packet size
+#define P2P_DEFAULT_CONNECTION_MEMORY_LIMIT             (2 * P2P_DEFAULT_PACKET_MAX_SIZE) //bytes queued or partially received per peer
+#define P2P_DEFAULT_TOTAL_CONNECTION_MEMORY_LIMIT       (512 * 1024 * 1024) //same, over all peers
 #define P2P_DEFAULT_PEERS_IN_HANDSHAKE                  250
+#define P2P_DEFAULT_PEERS_IN_TIMED_SYNC                 64         //at most this many new entries per timed sync
 #define P2P_DEFAULT_CONNECTION_TIMEOUT                  5000       //5 seconds
 #define P2P_DEFAULT_PING_CONNECTION_TIMEOUT             2000       //2 seconds
 #define P2P_DEFAULT_INVOKE_TIMEOUT                      60*2*1000  //2 minutes
 #define P2P_DEFAULT_HANDSHAKE_INVOKE_TIMEOUT            5000       //5 seconds
 #define P2P_DEFAULT_WHITELIST_CONNECTIONS_PERCENT       70
+#define P2P_DEFAULT_MAX_PENDING_CONNECTIONS             8          //outgoing connects in flight at once
+#define P2P_DEFAULT_CONNECTION_ATTEMPTS_PER_SECOND      4
+#define P2P_DEFAULT_FAST_PEERS_PERCENT                  50         //share of white picks made among the lowest latency peers
+#define P2P_PEER_LATENCY_SMOOTHING                      4          //new latency samples weigh 1/4
+#define P2P_PEER_UNKNOWN_BLOCK_DELAY_MS                 2000
+#define P2P_TRACKED_BLOCK_ANNOUNCES                     16         //recent blocks whose announce delays are measured
+#define P2P_KNOWN_TXS_PER_PEER                          5000       //tx hashes remembered as sent to or received from each peer
 
 #define P2P_FAILED_ADDR_FORGET_SECONDS                  (60*60)     //1 hour
 #define P2P_IP_BLOCKTIME                                (60*60*24)  //24 hour
 #define P2P_IP_FAILS_BEFORE_BLOCK                       10
 #define P2P_IDLE_CONNECTION_KILL_INTERVAL               (5*60) //5 minutes
+#define P2P_UPNP_RETRY_INTERVAL                         (5*60) //5 minutes, after a failed port mapping
+#define P2P_UPNP_REFRESH_INTERVAL                       (30*60) //30 minutes, the router may have dropped it
 
 #define P2P_SUPPORT_FLAG_FLUFFY_BLOCKS                  0x01
-#define P2P_SUPPORT_FLAGS                               P2P_SUPPORT_FLAG_FLUFFY_BLOCKS
+#define P2P_SUPPORT_FLAG_COMPACT_BLOCKS                 0x02
+#define P2P_SUPPORT_FLAG_COMPRESSION                    0x04
+#define P2P_SUPPORT_FLAG_EARLY_RELAY                    0x08   //takes blocks relayed before they are fully verified
+#ifdef HAVE_P2P_COMPRESSION
+#define P2P_SUPPORT_FLAGS                               (P2P_SUPPORT_FLAG_FLUFFY_BLOCKS | P2P_SUPPORT_FLAG_COMPACT_BLOCKS | P2P_SUPPORT_FLAG_COMPRESSION | P2P_SUPPORT_FLAG_EARLY_RELAY)
+#else
+#define P2P_SUPPORT_FLAGS                               (P2P_SUPPORT_FLAG_FLUFFY_BLOCKS | P2P_SUPPORT_FLAG_COMPACT_BLOCKS | P2P_SUPPORT_FLAG_EARLY_RELAY)
+#endif
+#define P2P_EARLY_RELAY_MAX_STRIKES                     3          //early relayed blocks failing verification before the peer is dropped
+#define P2P_PEER_COST_WINDOW                            60         //seconds over which a peer's verification time is weighed against what it brought
+#define P2P_PEER_COST_FREE_US                           (5*1000000) //verification time any peer gets per window
+#define P2P_PEER_COST_PER_OBJECT_US                     (100*1000) //and per new valid tx or block it sent
+#define P2P_PEER_COST_DROP_FACTOR                       4          //peers over their budget have their txs ignored, this many times over are dropped
+#define P2P_COMPRESSION_THRESHOLD                       (16*1024)  //sync messages smaller than this are sent as they are
 
 #define ALLOW_DEBUG_COMMANDS
 
@@ -0,0 +1,120 @@
+// Copyright (c) 2014-2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+
+#include "block_processing_stats.h"
+
+namespace cryptonote
+{
+  block_processing_stats::block_processing_stats(size_t window):
+    m_window(window ? window : 1),
+    m_cumulative_blocks(0)
+  {
+    for (size_t p = 0; p < block_processing_phases; ++p)
+    {
+      m_total_us[p] = 0;
+      m_cumulative_us[p] = 0;
+      for (auto &b: m_buckets[p])
+        b = 0;
+    }
+  }
+  //---------------------------------------------------------------
+  unsigned block_processing_stats::get_bucket_index(uint64_t usec)
+  {
+    unsigned bucket = 0;
+    while (usec > 1 && bucket < BLOCK_PROCESSING_STATS_BUCKETS - 1)
+    {
+      usec >>= 1;
+      ++bucket;
+    }
+    return bucket;
+  }
+  //---------------------------------------------------------------
+  void block_processing_stats::add(const sample &s)
+  {
+    if (m_samples.size() == m_window)
+    {
+      const sample &oldest = m_samples.front();
+      for (size_t p = 0; p < block_processing_phases; ++p)
+      {
+        m_total_us[p] -= oldest[p];
+        --m_buckets[p][get_bucket_index(oldest[p])];
+      }
+      m_samples.pop_front();
+    }
+    for (size_t p = 0; p < block_processing_phases; ++p)
+    {
+      m_total_us[p] += s[p];
+      m_cumulative_us[p] += s[p];
+      ++m_buckets[p][get_bucket_index(s[p])];
+    }
+    ++m_cumulative_blocks;
+    m_samples.push_back(s);
+  }
+  //---------------------------------------------------------------
+  uint64_t block_processing_stats::get_max_us(block_processing_phase phase) const
+  {
+    uint64_t max_us = 0;
+    for (const sample &s: m_samples)
+      max_us = std::max(max_us, s[phase]);
+    return max_us;
+  }
+  //---------------------------------------------------------------
+  uint64_t block_processing_stats::percentile(block_processing_phase phase, unsigned pct) const
+  {
+    const uint64_t blocks = m_samples.size();
+    if (blocks == 0)
+      return 0;
+    const uint64_t target = (blocks * pct + 99) / 100;
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < BLOCK_PROCESSING_STATS_BUCKETS; ++i)
+    {
+      seen += m_buckets[phase][i];
+      if (seen >= target)
+        return get_bucket_bound_us(i);
+    }
+    return get_bucket_bound_us(BLOCK_PROCESSING_STATS_BUCKETS - 1);
+  }
+  //---------------------------------------------------------------
+  const char *block_processing_stats::get_phase_name(block_processing_phase phase)
+  {
+    switch (phase)
+    {
+      case bpp_difficulty: return "difficulty";
+      case bpp_pow: return "pow";
+      case bpp_tx_lookup: return "tx_lookup";
+      case bpp_pool: return "pool";
+      case bpp_tx_check: return "tx_check";
+      case bpp_miner_tx: return "miner_tx";
+      case bpp_db_add: return "db_add";
+      case bpp_total: return "total";
+      default: return "unknown";
+    }
+  }
+}
@@ -0,0 +1,106 @@
+// Copyright (c) 2014-2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <deque>
+
+#define BLOCK_PROCESSING_STATS_WINDOW 1000
+#define BLOCK_PROCESSING_STATS_BUCKETS 32
+
+namespace cryptonote
+{
+  /**
+   * @brief the phases of adding a block to the main chain
+   */
+  enum block_processing_phase
+  {
+    bpp_difficulty,  //!< next difficulty target
+    bpp_pow,         //!< proof of work, or the trusted hashes check
+    bpp_tx_lookup,   //!< checking the block's txes are not already in the chain
+    bpp_pool,        //!< taking the block's txes from the pool
+    bpp_tx_check,    //!< checking the txes' inputs and signatures
+    bpp_miner_tx,    //!< checking the miner tx
+    bpp_db_add,      //!< adding the block to the database
+    bpp_total,       //!< all of the above and the rest of the checks
+
+    block_processing_phases
+  };
+
+  /**
+   * @brief per phase timings of the last blocks added to the main chain
+   *
+   * Keeps the last BLOCK_PROCESSING_STATS_WINDOW blocks' timings and, for
+   * each phase, a log2 histogram of them in microseconds: bucket i counts
+   * blocks for which the phase took at most 2^(i+1) us. As for the RPC
+   * method stats, percentiles are given as the bound of their bucket.
+   * Totals since start up are kept too, for the difference between two
+   * copies to cover more than a window.
+   *
+   * Not thread safe, Blockchain uses it under its lock.
+   */
+  class block_processing_stats
+  {
+  public:
+    typedef std::array<uint64_t, block_processing_phases> sample; //!< microseconds per phase
+
+    explicit block_processing_stats(size_t window = BLOCK_PROCESSING_STATS_WINDOW);
+
+    /**
+     * @brief adds a block's timings, dropping the oldest block's if the window is full
+     */
+    void add(const sample &s);
+
+    //! number of blocks in the window
+    size_t size() const { return m_samples.size(); }
+    uint64_t get_total_us(block_processing_phase phase) const { return m_total_us[phase]; }
+    //! number of blocks and time per phase since start up, not only in the window
+    uint64_t get_cumulative_blocks() const { return m_cumulative_blocks; }
+    uint64_t get_cumulative_us(block_processing_phase phase) const { return m_cumulative_us[phase]; }
+    uint64_t get_max_us(block_processing_phase phase) const;
+    uint64_t get_bucket(block_processing_phase phase, unsigned i) const { return m_buckets[phase][i]; }
+    static uint64_t get_bucket_bound_us(unsigned i) { return (uint64_t)2 << i; }
+
+    //! upper bound of the bucket holding the pct-th percentile of blocks
+    uint64_t percentile(block_processing_phase phase, unsigned pct) const;
+
+    static const char *get_phase_name(block_processing_phase phase);
+
+  private:
+    static unsigned get_bucket_index(uint64_t usec);
+
+    size_t m_window;
+    std::deque<sample> m_samples;
+    uint64_t m_total_us[block_processing_phases];
+    uint64_t m_cumulative_blocks;
+    uint64_t m_cumulative_us[block_processing_phases];
+    uint64_t m_buckets[block_processing_phases][BLOCK_PROCESSING_STATS_BUCKETS];
+  };
+}
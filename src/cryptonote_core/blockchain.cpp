@@ -30,9 +30,11 @@
 
 #include <algorithm>
 #include <cstdio>
+#include <deque>
 #include <boost/archive/binary_oarchive.hpp>
 #include <boost/archive/binary_iarchive.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/range/iterator_range.hpp>
 
 #include "include_base_utils.h"
 #include "cryptonote_basic_impl.h"
@@ -54,6 +56,9 @@
 #include "cryptonote_core/cryptonote_core.h"
 #include "ringct/rctSigs.h"
 #include "common/perf_timer.h"
+#include "common/memory_usage.h"
+#include "common/parallel_for.h"
+#include "common/task_region.h"
 #if defined(PER_BLOCK_CHECKPOINT)
 #include "blocks/blocks.h"
 #endif
@@ -70,12 +75,37 @@ using namespace cryptonote;
 using epee::string_tools::pod_to_hex;
 extern "C" void slow_hash_allocate_state();
 extern "C" void slow_hash_free_state();
+extern "C" const char *slow_hash_state_pages();
 
 DISABLE_VS_WARNINGS(4267)
 
 // used to overestimate the block reward when estimating a per kB to use
 #define BLOCK_REWARD_OVERESTIMATE (10 * 1000000000000)
 
+// max number of transactions whose signatures are remembered as verified
+#define VERIFIED_TXS_CACHE_SIZE 16384
+
+// amounts with fewer offsets than this are looked up together in one DB pass
+// when scanning the outputs of incoming blocks, rather than one task each
+#define BULK_OUTPUT_SCAN_MAX_OFFSETS 64
+
+// recent blocks whose metadata is kept in memory: enough for the difficulty
+// window, the block size median and the timestamp check
+#define TOP_BLOCKS_CACHE_SIZE (DIFFICULTY_BLOCKS_COUNT)
+
+// main chain hashes remembered when following a read only database; a
+// deeper reorg by the writer is reported from the genesis block
+#define FOLLOWED_HASHES_COUNT (DIFFICULTY_BLOCKS_COUNT)
+
+// block hashes tree hashed together when checking a block hashes file
+#define BLOCK_HASHES_FILE_CHUNK_SIZE 4096
+
+// longest a cached block template is handed out again, so that
+// transactions whose unlock time has passed are eventually picked up
+#define BLOCK_TEMPLATE_CACHE_SECONDS 10
+static_assert(TOP_BLOCKS_CACHE_SIZE >= CRYPTONOTE_REWARD_BLOCKS_WINDOW, "TOP_BLOCKS_CACHE_SIZE too small for the block size median");
+static_assert(TOP_BLOCKS_CACHE_SIZE >= BLOCKCHAIN_TIMESTAMP_CHECK_WINDOW, "TOP_BLOCKS_CACHE_SIZE too small for the timestamp check");
+
 static const struct {
   uint8_t version;
   uint64_t height;
@@ -120,10 +150,15 @@ static const uint64_t testnet_hard_fork_version_1_till = 624633;
 
 //------------------------------------------------------------------
 Blockchain::Blockchain(tx_memory_pool& tx_pool) :
-  m_db(), m_tx_pool(tx_pool), m_hardfork(NULL), m_timestamps_and_difficulties_height(0), m_current_block_cumul_sz_limit(0), m_is_in_checkpoint_zone(false),
-  m_is_blockchain_storing(false), m_enforce_dns_checkpoints(false), m_max_prepare_blocks_threads(4), m_db_blocks_per_sync(1), m_db_sync_mode(db_async), m_fast_sync(true), m_show_time_stats(false), m_sync_counter(0), m_cancel(false)
+  m_db(), m_tx_pool(tx_pool), m_hardfork(NULL), m_top_blocks_height(0), m_difficulty_window_height(0), m_current_block_cumul_sz_limit(0), m_blocks_hash_check(NULL), m_blocks_hash_check_count(0), m_is_in_checkpoint_zone(false),
+  m_is_blockchain_storing(false), m_enforce_dns_checkpoints(false), m_max_prepare_blocks_threads(0), m_max_prepare_blocks_bytes(0), m_db_blocks_per_sync(1), m_db_bytes_per_sync(0), m_db_sync_interval(0), m_db_sync_mode(db_async), m_fast_sync(true), m_show_time_stats(false), m_sync_counter(0), m_cancel(false), m_popped_blocks(0),
+  m_db_snapshot_stop(false)
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
+  m_block_template.version = 0;
+  m_db_snapshot.running = false;
+  m_db_snapshot.written = 0;
+  m_db_snapshot.total = 0;
 }
 //------------------------------------------------------------------
 bool Blockchain::have_tx(const crypto::hash &id) const
@@ -140,11 +175,18 @@ bool Blockchain::have_tx_keyimg_as_spent(const crypto::key_image &key_im) const
   return  m_db->has_key_image(key_im);
 }
 //------------------------------------------------------------------
+void Blockchain::have_tx_keyimgs_as_spent(const std::vector<crypto::key_image> &key_im, std::vector<bool> &spent) const
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  m_db->has_key_images(key_im, spent);
+}
+//------------------------------------------------------------------
 // This function makes sure that each "input" in an input (mixins) exists
 // and collects the public key for each from the transaction it was included in
 // via the visitor passed to it.
 template <class visitor_t>
-bool Blockchain::scan_outputkeys_for_indexes(size_t tx_version, const txin_to_key& tx_in_to_key, visitor_t &vis, const crypto::hash &tx_prefix_hash, uint64_t* pmax_related_block_height) const
+bool Blockchain::scan_outputkeys_for_indexes(size_t tx_version, const tx_view& view, const tx_view::input& tx_in_to_key, visitor_t &vis, const crypto::hash &tx_prefix_hash, uint64_t* pmax_related_block_height) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
 
@@ -152,14 +194,12 @@ bool Blockchain::scan_outputkeys_for_indexes(size_t tx_version, const txin_to_ke
   //CRITICAL_REGION_LOCAL(m_blockchain_lock);
 
   // verify that the input has key offsets (that it exists properly, really)
-  if(!tx_in_to_key.key_offsets.size())
+  if(!tx_in_to_key.key_offsets_count)
     return false;
 
-  // cryptonote_format_utils uses relative offsets for indexing to the global
-  // outputs list.  that is to say that absolute offset #2 is absolute offset
-  // #1 plus relative offset #2.
-  // TODO: Investigate if this is necessary / why this is done.
-  std::vector<uint64_t> absolute_offsets = relative_output_offsets_to_absolute(tx_in_to_key.key_offsets);
+  // the view has made the tx's relative offsets absolute already
+  const uint64_t *absolute_offsets = view.key_offsets(tx_in_to_key);
+  const size_t n_offsets = tx_in_to_key.key_offsets_count;
   std::vector<output_data_t> outputs;
 
   bool found = false;
@@ -176,25 +216,49 @@ bool Blockchain::scan_outputkeys_for_indexes(size_t tx_version, const txin_to_ke
 
   if (!found)
   {
-    try
+    // popular decoys show up in many rings, so only read the ones we don't
+    // have cached
+    const uint64_t generation = m_output_key_cache.generation();
+    outputs.resize(n_offsets);
+    std::vector<size_t> missed;
+    std::vector<uint64_t> missed_offsets;
+    for (size_t i = 0; i < n_offsets; ++i)
     {
-      m_db->get_output_key(tx_in_to_key.amount, absolute_offsets, outputs);
+      if (!m_output_key_cache.get(tx_in_to_key.amount, absolute_offsets[i], outputs[i]))
+      {
+        missed.push_back(i);
+        missed_offsets.push_back(absolute_offsets[i]);
+      }
     }
-    catch (...)
+    if (!missed.empty())
     {
-      LOG_PRINT_L0("Output does not exist! amount = " << tx_in_to_key.amount);
-      return false;
+      try
+      {
+        std::vector<output_data_t> missed_outputs;
+        m_db->get_output_key(tx_in_to_key.amount, missed_offsets, missed_outputs);
+        for (size_t j = 0; j < missed.size(); ++j)
+        {
+          output_data_t &data = outputs[missed[j]];
+          data = j < missed_outputs.size() ? missed_outputs[j] : m_db->get_output_key(tx_in_to_key.amount, missed_offsets[j]);
+          m_output_key_cache.put(tx_in_to_key.amount, missed_offsets[j], data, generation);
+        }
+      }
+      catch (...)
+      {
+        LOG_PRINT_L0("Output does not exist! amount = " << tx_in_to_key.amount);
+        return false;
+      }
     }
   }
   else
   {
     // check for partial results and add the rest if needed;
-    if (outputs.size() < absolute_offsets.size() && outputs.size() > 0)
+    if (outputs.size() < n_offsets && outputs.size() > 0)
     {
-      LOG_PRINT_L1("Additional outputs needed: " << absolute_offsets.size() - outputs.size());
+      LOG_PRINT_L1("Additional outputs needed: " << n_offsets - outputs.size());
       std::vector < uint64_t > add_offsets;
       std::vector<output_data_t> add_outputs;
-      for (size_t i = outputs.size(); i < absolute_offsets.size(); i++)
+      for (size_t i = outputs.size(); i < n_offsets; i++)
         add_offsets.push_back(absolute_offsets[i]);
       try
       {
@@ -210,8 +274,9 @@ bool Blockchain::scan_outputkeys_for_indexes(size_t tx_version, const txin_to_ke
   }
 
   size_t count = 0;
-  for (const uint64_t& i : absolute_offsets)
+  for (const uint64_t *it = absolute_offsets; it != absolute_offsets + n_offsets; ++it)
   {
+    const uint64_t i = *it;
     try
     {
       output_data_t output_index;
@@ -237,7 +302,7 @@ bool Blockchain::scan_outputkeys_for_indexes(size_t tx_version, const txin_to_ke
       }
 
       // if on last output and pmax_related_block_height not null pointer
-      if(++count == absolute_offsets.size() && pmax_related_block_height)
+      if(++count == n_offsets && pmax_related_block_height)
       {
         // set *pmax_related_block_height to tx block height for this output
         auto h = output_index.height;
@@ -318,7 +383,10 @@ bool Blockchain::init(BlockchainDB* db, const bool testnet, const cryptonote::te
     for (size_t n = 0; n < sizeof(mainnet_hard_forks) / sizeof(mainnet_hard_forks[0]); ++n)
       m_hardfork->add_fork(mainnet_hard_forks[n].version, mainnet_hard_forks[n].height, mainnet_hard_forks[n].threshold, mainnet_hard_forks[n].time);
   }
+  TIME_MEASURE_START(hardfork_time);
   m_hardfork->init();
+  TIME_MEASURE_FINISH(hardfork_time);
+  LOG_PRINT_L0("Start-up: hard fork state loaded in " << hardfork_time << " ms");
 
   m_db->set_hard_fork(m_hardfork);
 
@@ -363,17 +431,30 @@ bool Blockchain::init(BlockchainDB* db, const bool testnet, const cryptonote::te
   if(!top_block_timestamp)
     timestamp_diff = time(NULL) - 1341378000;
 
-  // create general purpose async service queue
-
-  m_async_work_idle = std::unique_ptr < boost::asio::io_service::work > (new boost::asio::io_service::work(m_async_service));
-  // we only need 1
-  m_async_pool.create_thread(boost::bind(&boost::asio::io_service::run, &m_async_service));
+  // in async mode, syncs happen on the db's own thread, in groups
+  if (m_db_sync_mode == db_async)
+    m_db->start_flusher(m_db_blocks_per_sync, m_db_bytes_per_sync, m_db_sync_interval * 1000);
 
 #if defined(PER_BLOCK_CHECKPOINT)
   if (!fakechain)
+  {
+    TIME_MEASURE_START(hashes_time);
     load_compiled_in_block_hashes();
+    TIME_MEASURE_FINISH(hashes_time);
+    LOG_PRINT_L0("Start-up: block hashes loaded in " << hashes_time << " ms");
+  }
 #endif
 
+  if (m_db->is_read_only())
+  {
+    const uint64_t height = m_db->height();
+    m_followed_hashes.clear();
+    for (uint64_t h = height > FOLLOWED_HASHES_COUNT ? height - FOLLOWED_HASHES_COUNT : 0; h < height; ++h)
+      m_followed_hashes.push_back(m_db->get_block_hash_from_height(h));
+  }
+
+  publish_chain_state();
+
   LOG_PRINT_GREEN("Blockchain initialized. last block: " << m_db->height() - 1 << ", " << epee::misc_utils::get_time_interval_string(timestamp_diff) << " time ago, current difficulty: " << get_difficulty_for_next_block(), LOG_LEVEL_0);
   m_db->block_txn_stop();
 
@@ -393,15 +474,15 @@ bool Blockchain::init(BlockchainDB* db, HardFork*& hf, const bool testnet)
 bool Blockchain::store_blockchain()
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
-  // lock because the rpc_thread command handler also calls this
-  CRITICAL_REGION_LOCAL(m_db->m_synchronization_lock);
 
   TIME_MEASURE_START(save);
   // TODO: make sure sync(if this throws that it is not simply ignored higher
   // up the call stack
   try
   {
-    m_db->sync();
+    // takes the db's lock, as the flusher and the rpc_thread command handler
+    // may sync too
+    m_db->flush();
   }
   catch (const std::exception& e)
   {
@@ -420,17 +501,104 @@ bool Blockchain::store_blockchain()
   return true;
 }
 //------------------------------------------------------------------
+bool Blockchain::on_idle()
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  // block additions and their batches happen under this lock, so no write
+  // txn can be in progress
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  try
+  {
+    m_db->on_idle();
+  }
+  catch (const std::exception& e)
+  {
+    LOG_PRINT_L0("Error during blockchain db housekeeping: " << e.what());
+  }
+  return true;
+}
+//------------------------------------------------------------------
+bool Blockchain::refresh_from_db()
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  if (!m_db->is_read_only())
+    return false;
+
+  const uint64_t old_height = m_db->height();
+  const uint64_t first_followed = old_height - m_followed_hashes.size();
+  std::vector<crypto::hash> added;
+  uint64_t height, split_height;
+  try
+  {
+    m_db->refresh();
+    height = m_db->height();
+
+    // walk back over the hashes we saw until one is still in the chain
+    split_height = std::min(old_height, height);
+    while (split_height > first_followed &&
+        m_db->get_block_hash_from_height(split_height - 1) != m_followed_hashes[split_height - 1 - first_followed])
+      --split_height;
+    if (split_height == old_height && height == old_height)
+      return false;
+    if (split_height == first_followed && first_followed > 0)
+    {
+      LOG_PRINT_L0("Followed database reorganized deeper than " << m_followed_hashes.size() << " blocks, resetting from genesis");
+      split_height = 0;
+    }
+
+    for (uint64_t h = std::max(split_height, height > FOLLOWED_HASHES_COUNT ? height - FOLLOWED_HASHES_COUNT : 0); h < height; ++h)
+      added.push_back(m_db->get_block_hash_from_height(h));
+  }
+  catch (const std::exception& e)
+  {
+    LOG_PRINT_L0("Error refreshing from the blockchain db: " << e.what());
+    return false;
+  }
+
+  m_top_blocks.clear();
+  m_top_blocks_height = 0;
+  m_difficulty_window.clear();
+  m_difficulty_window_height = 0;
+  m_hardfork->init();
+
+  // report the same events a local reorg would: pops, then additions
+  if (split_height < old_height)
+  {
+    m_output_key_cache.remove_from_height(split_height);
+    ++m_popped_blocks;
+    for (uint64_t h = old_height; h > std::max(split_height, first_followed); --h)
+      m_events.publish(chain_events::block_removed, m_followed_hashes[h - 1 - first_followed], h - 1);
+  }
+  const uint64_t first_added = height - added.size();
+  if (split_height >= first_followed && first_added == split_height)
+    m_followed_hashes.resize(split_height - first_followed);
+  else
+    m_followed_hashes.clear();
+  for (size_t n = 0; n < added.size(); ++n)
+  {
+    m_events.publish(chain_events::block_added, added[n], first_added + n);
+    m_followed_hashes.push_back(added[n]);
+  }
+  while (m_followed_hashes.size() > FOLLOWED_HASHES_COUNT)
+    m_followed_hashes.pop_front();
+  if (split_height < old_height)
+  {
+    m_events.publish(chain_events::reorg, added.empty() ? null_hash : added.back(), split_height);
+    LOG_PRINT_L1("Followed database reorganized from height " << split_height);
+  }
+
+  publish_chain_state();
+  LOG_PRINT_L2("Followed database now at height " << height);
+  return true;
+}
+//------------------------------------------------------------------
 bool Blockchain::deinit()
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
 
   LOG_PRINT_L1("Stopping blockchain read/write activity");
 
- // stop async service
-  m_async_work_idle.reset();
-  m_async_pool.join_all();
-  m_async_service.stop();
-
   // as this should be called if handling a SIGSEGV, need to check
   // if m_db is a NULL pointer (and thus may have caused the illegal
   // memory operation), otherwise we may cause a loop.
@@ -439,8 +607,14 @@ bool Blockchain::deinit()
     throw new DB_ERROR("The db pointer is null in Blockchain, the blockchain may be corrupt!");
   }
 
+  // a snapshot in progress reads the db until it's abandoned
+  m_db_snapshot_stop = true;
+  if (m_db_snapshot_thread.joinable())
+    m_db_snapshot_thread.join();
+
   try
   {
+    m_db->stop_flusher();
     m_db->close();
     LOG_PRINT_L1("Local blockchain read/write activity stopped successfully");
   }
@@ -458,6 +632,69 @@ bool Blockchain::deinit()
   return true;
 }
 //------------------------------------------------------------------
+bool Blockchain::start_db_snapshot(const std::string &path, uint64_t max_bytes_per_sec, std::string &error)
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  CRITICAL_REGION_LOCAL(m_db_snapshot_lock);
+  if (m_db_snapshot.running)
+  {
+    error = "A snapshot to " + m_db_snapshot.path + " is already running";
+    return false;
+  }
+  if (m_db_snapshot_thread.joinable())
+    m_db_snapshot_thread.join();
+
+  m_db_snapshot.running = true;
+  m_db_snapshot.path = path;
+  m_db_snapshot.written = 0;
+  m_db_snapshot.total = 0;
+  m_db_snapshot.error.clear();
+  m_db_snapshot_stop = false;
+  m_db_snapshot_thread = boost::thread([this, path, max_bytes_per_sec]() {
+    LOG_PRINT_L0("Writing a snapshot of the database to " << path);
+    unsigned logged_percent = 0;
+    std::string error;
+    try
+    {
+      const bool done = m_db->copy_snapshot(path, max_bytes_per_sec, [this, &logged_percent](uint64_t written, uint64_t total) {
+        {
+          CRITICAL_REGION_LOCAL(m_db_snapshot_lock);
+          m_db_snapshot.written = written;
+          m_db_snapshot.total = total;
+        }
+        const unsigned percent = total ? std::min<uint64_t>(100, written * 100 / total) : 0;
+        if (percent >= logged_percent + 5)
+        {
+          logged_percent = percent - percent % 5;
+          LOG_PRINT_L0("Database snapshot " << logged_percent << "% done");
+        }
+        return !m_db_snapshot_stop;
+      });
+      if (!done)
+        error = "abandoned";
+    }
+    catch (const std::exception &e)
+    {
+      error = e.what();
+    }
+    if (error.empty())
+      LOG_PRINT_L0("Database snapshot written to " << path);
+    else
+      LOG_ERROR("Database snapshot to " << path << " failed: " << error);
+    CRITICAL_REGION_LOCAL(m_db_snapshot_lock);
+    m_db_snapshot.error = error;
+    m_db_snapshot.running = false;
+  });
+  return true;
+}
+//------------------------------------------------------------------
+Blockchain::db_snapshot_status Blockchain::get_db_snapshot_status() const
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  CRITICAL_REGION_LOCAL(m_db_snapshot_lock);
+  return m_db_snapshot;
+}
+//------------------------------------------------------------------
 // This function tells BlockchainDB to remove the top block from the
 // blockchain and then returns all transactions (except the miner tx, of course)
 // from it to the tx_pool
@@ -466,14 +703,34 @@ block Blockchain::pop_block_from_blockchain()
   LOG_PRINT_L3("Blockchain::" << __func__);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
 
-  m_timestamps_and_difficulties_height = 0;
+  std::vector<transaction> popped_txs;
+  block popped_block = pop_block_from_blockchain(popped_txs);
+
+  // FIXME: HardFork
+  // This is not quite correct, as we really want to add the txes
+  // to the pool based on the version determined after all blocks
+  // are popped. Reorgs pop through the other overload and do so.
+  return_txs_to_pool(popped_txs, get_current_hard_fork_version());
+
+  update_next_cumulative_size_limit();
+  m_tx_pool.on_blockchain_dec(m_db->height()-1, get_tail_id());
+
+  return popped_block;
+}
+//------------------------------------------------------------------
+// This function tells BlockchainDB to remove the top block from the
+// blockchain and hands its transactions (except the miner tx) to the caller
+block Blockchain::pop_block_from_blockchain(std::vector<transaction>& popped_txs)
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
 
   block popped_block;
-  std::vector<transaction> popped_txs;
+  std::vector<transaction> txs;
 
   try
   {
-    m_db->pop_block(popped_block, popped_txs);
+    m_db->pop_block(popped_block, txs);
   }
   // anything that could cause this to throw is likely catastrophic,
   // so we re-throw
@@ -487,48 +744,134 @@ block Blockchain::pop_block_from_blockchain()
     LOG_ERROR("Error popping block from blockchain, throwing!");
     throw;
   }
+  pop_top_block();
+  // the popped block's outputs are gone, and the next block will reuse their indices
+  m_output_key_cache.remove_from_height(m_db->height());
+  // only once the block is gone, so a reader seeing the new count reads the new chain
+  ++m_popped_blocks;
+  publish_chain_state();
+  m_events.publish(chain_events::block_removed, get_block_hash(popped_block), m_db->height());
 
-  // return transactions from popped block to the tx_pool
-  for (transaction& tx : popped_txs)
+  for (transaction& tx : txs)
   {
     if (!is_coinbase(tx))
+      popped_txs.push_back(std::move(tx));
+  }
+
+  return popped_block;
+}
+//------------------------------------------------------------------
+void Blockchain::return_txs_to_pool(std::vector<transaction>& txs, uint8_t version)
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+
+  for (transaction& tx : txs)
+  {
+    // a popped block's tx may be mined again by the chain switched to
+    if (m_db->tx_exists(get_transaction_hash(tx)))
+      continue;
+
+    cryptonote::tx_verification_context tvc = AUTO_VAL_INIT(tvc);
+
+    // We assume that if they were in a block, the transactions are already
+    // known to the network as a whole. However, if we had mined that block,
+    // that might not be always true. Unlikely though, and always relaying
+    // these again might cause a spike of traffic as many nodes re-relay
+    // all the transactions in a popped block when a reorg happens.
+    bool r = m_tx_pool.add_tx(tx, tvc, true, true, version);
+    if (!r)
     {
-      cryptonote::tx_verification_context tvc = AUTO_VAL_INIT(tvc);
+      LOG_ERROR("Error returning transaction to tx_pool");
+    }
+  }
+}
+//------------------------------------------------------------------
+Blockchain::blocks_ext_by_hash::iterator Blockchain::add_alternative_block(const crypto::hash& id, const block_extended_info& bei)
+{
+  auto i_res = m_alternative_chains.insert(blocks_ext_by_hash::value_type(id, bei));
+  if (!i_res.second)
+    return m_alternative_chains.end();
+  m_alternative_heights.insert(hashes_by_height::value_type(bei.height, id));
+  m_alternative_children.insert(hashes_by_parent::value_type(bei.bl.prev_id, id));
+  return i_res.first;
+}
+//------------------------------------------------------------------
+void Blockchain::remove_alternative_block(blocks_ext_by_hash::iterator it)
+{
+  const crypto::hash& id = it->first;
 
-      // FIXME: HardFork
-      // Besides the below, popping a block should also remove the last entry
-      // in hf_versions.
-      //
-      // FIXME: HardFork
-      // This is not quite correct, as we really want to add the txes
-      // to the pool based on the version determined after all blocks
-      // are popped.
-      uint8_t version = get_current_hard_fork_version();
+  auto heights = m_alternative_heights.equal_range(it->second.height);
+  for (auto i = heights.first; i != heights.second; ++i)
+  {
+    if (i->second == id)
+    {
+      m_alternative_heights.erase(i);
+      break;
+    }
+  }
+
+  auto children = m_alternative_children.equal_range(it->second.bl.prev_id);
+  for (auto i = children.first; i != children.second; ++i)
+  {
+    if (i->second == id)
+    {
+      m_alternative_children.erase(i);
+      break;
+    }
+  }
+
+  m_alternative_chains.erase(it);
+}
+//------------------------------------------------------------------
+void Blockchain::clear_alternative_blocks()
+{
+  m_alternative_chains.clear();
+  m_alternative_heights.clear();
+  m_alternative_children.clear();
+}
+//------------------------------------------------------------------
+void Blockchain::prune_alternative_blocks()
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+
+  const uint64_t blockchain_height = m_db->height();
+  while (!m_alternative_heights.empty())
+  {
+    auto lowest = m_alternative_heights.begin();
+    if (m_checkpoints.is_alternative_block_allowed(blockchain_height, lowest->first))
+      break;
 
-      // We assume that if they were in a block, the transactions are already
-      // known to the network as a whole. However, if we had mined that block,
-      // that might not be always true. Unlikely though, and always relaying
-      // these again might cause a spike of traffic as many nodes re-relay
-      // all the transactions in a popped block when a reorg happens.
-      bool r = m_tx_pool.add_tx(tx, tvc, true, true, version);
-      if (!r)
+    std::vector<crypto::hash> doomed(1, lowest->second);
+    while (!doomed.empty())
+    {
+      const crypto::hash id = doomed.back();
+      doomed.pop_back();
+      auto children = m_alternative_children.equal_range(id);
+      for (auto i = children.first; i != children.second; ++i)
+        doomed.push_back(i->second);
+      auto it = m_alternative_chains.find(id);
+      if (it != m_alternative_chains.end())
       {
-        LOG_ERROR("Error returning transaction to tx_pool");
+        LOG_PRINT_L2("Dropping alternative block " << id << " at height " << it->second.height << ", behind a checkpoint");
+        remove_alternative_block(it);
       }
     }
   }
-  update_next_cumulative_size_limit();
-  m_tx_pool.on_blockchain_dec(m_db->height()-1, get_tail_id());
-
-  return popped_block;
 }
 //------------------------------------------------------------------
 bool Blockchain::reset_and_set_genesis_block(const block& b)
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
-  m_alternative_chains.clear();
+  clear_alternative_blocks();
   m_db->reset();
+  m_output_key_cache.clear();
+  m_top_blocks.clear();
+  m_top_blocks_height = 0;
+  m_difficulty_window.clear();
+  m_difficulty_window_height = 0;
   m_hardfork->init();
 
   block_verification_context bvc = boost::value_initialized<block_verification_context>();
@@ -692,49 +1035,25 @@ difficulty_type Blockchain::get_difficulty_for_next_block()
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
-  std::vector<uint64_t> timestamps;
-  std::vector<difficulty_type> difficulties;
   auto height = m_db->height();
-  // ND: Speedup
-  // 1. Keep a list of the last 735 (or less) blocks that is used to compute difficulty,
-  //    then when the next block difficulty is queried, push the latest height data and
-  //    pop the oldest one from the list. This only requires 1x read per height instead
-  //    of doing 735 (DIFFICULTY_BLOCKS_COUNT).
-  if (m_timestamps_and_difficulties_height != 0 && ((height - m_timestamps_and_difficulties_height) == 1))
-  {
-    uint64_t index = height - 1;
-    m_timestamps.push_back(m_db->get_block_timestamp(index));
-    m_difficulties.push_back(m_db->get_block_cumulative_difficulty(index));
-
-    while (m_timestamps.size() > DIFFICULTY_BLOCKS_COUNT)
-      m_timestamps.erase(m_timestamps.begin());
-    while (m_difficulties.size() > DIFFICULTY_BLOCKS_COUNT)
-      m_difficulties.erase(m_difficulties.begin());
-
-    m_timestamps_and_difficulties_height = height;
-    timestamps = m_timestamps;
-    difficulties = m_difficulties;
-  }
-  else
+  if (m_difficulty_window_height != height)
   {
+    // not kept up to date by push_top_block/pop_top_block, start over
     size_t offset = height - std::min < size_t > (height, static_cast<size_t>(DIFFICULTY_BLOCKS_COUNT));
     if (offset == 0)
       ++offset;
 
-    timestamps.clear();
-    difficulties.clear();
+    m_difficulty_window.clear();
+    const uint64_t first = load_top_blocks();
     for (; offset < height; offset++)
     {
-      timestamps.push_back(m_db->get_block_timestamp(offset));
-      difficulties.push_back(m_db->get_block_cumulative_difficulty(offset));
+      const top_block_metadata &md = m_top_blocks[offset - first];
+      m_difficulty_window.push_back(md.timestamp, md.cumulative_difficulty);
     }
-
-    m_timestamps_and_difficulties_height = height;
-    m_timestamps = timestamps;
-    m_difficulties = difficulties;
+    m_difficulty_window_height = height;
   }
   size_t target = get_current_hard_fork_version() < 2 ? DIFFICULTY_TARGET_V1 : DIFFICULTY_TARGET_V2;
-  return next_difficulty(timestamps, difficulties, target);
+  return m_difficulty_window.next_difficulty(target);
 }
 //------------------------------------------------------------------
 // This function removes blocks from the blockchain until it gets to the
@@ -751,8 +1070,6 @@ bool Blockchain::rollback_blockchain_switching(std::list<block>& original_chain,
     return true;
   }
 
-  m_timestamps_and_difficulties_height = 0;
-
   // remove blocks from blockchain until we get back to where we should be.
   while (m_db->height() != rollback_height)
   {
@@ -787,8 +1104,6 @@ bool Blockchain::switch_to_alternative_blockchain(std::list<blocks_ext_by_hash::
   LOG_PRINT_L3("Blockchain::" << __func__);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
 
-  m_timestamps_and_difficulties_height = 0;
-
   // if empty alt chain passed (not sure how that could happen), return false
   CHECK_AND_ASSERT_MES(alt_chain.size(), false, "switch_to_alternative_blockchain: empty chain passed");
 
@@ -799,17 +1114,36 @@ bool Blockchain::switch_to_alternative_blockchain(std::list<blocks_ext_by_hash::
     return false;
   }
 
+  // pop and apply in one DB batch, unless the caller already runs one
+  bool batch_started = false;
+  try
+  {
+    m_db->batch_start(alt_chain.size());
+    batch_started = true;
+  }
+  catch (const DB_ERROR& e)
+  {
+    LOG_PRINT_L2("Reorganizing without a batch of its own: " << e.what());
+  }
+
   // pop blocks from the blockchain until the top block is the parent
-  // of the front block of the alt chain.
+  // of the front block of the alt chain, keeping their transactions
   std::list<block> disconnected_chain;
+  std::vector<transaction> popped_txs;
   while (m_db->top_block_hash() != alt_chain.front()->second.bl.prev_id)
   {
-    block b = pop_block_from_blockchain();
+    block b = pop_block_from_blockchain(popped_txs);
     disconnected_chain.push_front(b);
   }
 
   auto split_height = m_db->height();
 
+  // the alt chain's blocks take their txes from the pool, so the popped
+  // ones go back now, all at once and with the version at the split
+  return_txs_to_pool(popped_txs, m_hardfork->get(split_height - 1));
+  update_next_cumulative_size_limit();
+  m_tx_pool.on_blockchain_dec(split_height - 1, get_tail_id());
+
   //connecting new alternative chain
   for(auto alt_ch_iter = alt_chain.begin(); alt_ch_iter != alt_chain.end(); alt_ch_iter++)
   {
@@ -825,6 +1159,10 @@ bool Blockchain::switch_to_alternative_blockchain(std::list<blocks_ext_by_hash::
     {
       LOG_PRINT_L1("Failed to switch to alternative blockchain");
 
+      // the rollback reorganizes the hard fork state, which runs a batch
+      if (batch_started)
+        m_db->batch_stop();
+
       // rollback_blockchain_switching should be moved to two different
       // functions: rollback and apply_chain, but for now we pretend it is
       // just the latter (because the rollback was done above).
@@ -835,17 +1173,20 @@ bool Blockchain::switch_to_alternative_blockchain(std::list<blocks_ext_by_hash::
       // looking into.
       add_block_as_invalid(ch_ent->second, get_block_hash(ch_ent->second.bl));
       LOG_PRINT_L1("The block was inserted as invalid while connecting new alternative chain, block_id: " << get_block_hash(ch_ent->second.bl));
-      m_alternative_chains.erase(*alt_ch_iter++);
+      remove_alternative_block(*alt_ch_iter++);
 
       for(auto alt_ch_to_orph_iter = alt_ch_iter; alt_ch_to_orph_iter != alt_chain.end(); )
       {
         add_block_as_invalid((*alt_ch_to_orph_iter)->second, (*alt_ch_to_orph_iter)->first);
-        m_alternative_chains.erase(*alt_ch_to_orph_iter++);
+        remove_alternative_block(*alt_ch_to_orph_iter++);
       }
       return false;
     }
   }
 
+  if (batch_started)
+    m_db->batch_stop();
+
   // if we're to keep the disconnected blocks, add them as alternates
   if(!discard_disconnected_chain)
   {
@@ -866,11 +1207,15 @@ bool Blockchain::switch_to_alternative_blockchain(std::list<blocks_ext_by_hash::
   //removing alt_chain entries from alternative chains container
   for (auto ch_ent: alt_chain)
   {
-    m_alternative_chains.erase(ch_ent);
+    remove_alternative_block(ch_ent);
   }
 
   m_hardfork->reorganize_from_chain_height(split_height);
 
+  prune_alternative_blocks();
+
+  m_events.publish(chain_events::reorg, get_tail_id(), split_height);
+
   LOG_PRINT_GREEN("REORGANIZE SUCCESS! on height: " << split_height << ", new blockchain size: " << m_db->height(), LOG_LEVEL_0);
   return true;
 }
@@ -898,11 +1243,22 @@ difficulty_type Blockchain::get_next_difficulty_for_alternative_chain(const std:
     if(!main_chain_start_offset)
       ++main_chain_start_offset; //skip genesis block
 
-    // get difficulties and timestamps from relevant main chain blocks
+    // get difficulties and timestamps from relevant main chain blocks, the
+    // ones recent enough are already in the top blocks cache
+    const uint64_t first = load_top_blocks();
     for(; main_chain_start_offset < main_chain_stop_offset; ++main_chain_start_offset)
     {
-      timestamps.push_back(m_db->get_block_timestamp(main_chain_start_offset));
-      cumulative_difficulties.push_back(m_db->get_block_cumulative_difficulty(main_chain_start_offset));
+      if (main_chain_start_offset >= first)
+      {
+        const top_block_metadata &md = m_top_blocks[main_chain_start_offset - first];
+        timestamps.push_back(md.timestamp);
+        cumulative_difficulties.push_back(md.cumulative_difficulty);
+      }
+      else
+      {
+        timestamps.push_back(m_db->get_block_timestamp(main_chain_start_offset));
+        cumulative_difficulties.push_back(m_db->get_block_cumulative_difficulty(main_chain_start_offset));
+      }
     }
 
     // make sure we haven't accidentally grabbed too many blocks...maybe don't need this check?
@@ -937,7 +1293,7 @@ difficulty_type Blockchain::get_next_difficulty_for_alternative_chain(const std:
   size_t target = get_ideal_hard_fork_version(bei.height) < 2 ? DIFFICULTY_TARGET_V1 : DIFFICULTY_TARGET_V2;
 
   // calculate the difficulty target for the block and return it
-  return next_difficulty(timestamps, cumulative_difficulties, target);
+  return next_difficulty(std::move(timestamps), std::move(cumulative_difficulties), target);
 }
 //------------------------------------------------------------------
 // This function does a sanity check on basic things that all miner
@@ -1034,6 +1390,14 @@ void Blockchain::get_last_n_blocks_sizes(std::vector<size_t>& sz, size_t count)
   if(h == 0)
     return;
 
+  if (count <= TOP_BLOCKS_CACHE_SIZE)
+  {
+    const uint64_t first = load_top_blocks();
+    for (uint64_t i = h - std::min<uint64_t>(h, count); i < h; ++i)
+      sz.push_back(m_top_blocks[i - first].size);
+    return;
+  }
+
   m_db->block_txn_start(true);
   // add size of last <count> blocks to vector <sz> (or less, if blockchain size < count)
   size_t start_offset = h - std::min<size_t>(h, count);
@@ -1044,64 +1408,262 @@ void Blockchain::get_last_n_blocks_sizes(std::vector<size_t>& sz, size_t count)
   m_db->block_txn_stop();
 }
 //------------------------------------------------------------------
-uint64_t Blockchain::get_current_cumulative_blocksize_limit() const
+uint64_t Blockchain::load_top_blocks() const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
-  return m_current_block_cumul_sz_limit;
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  const uint64_t height = m_db->height();
+  if (m_top_blocks_height != height)
+  {
+    m_top_blocks.clear();
+    m_top_blocks_height = height;
+  }
+
+  // load whatever older blocks are missing, e.g. at startup, or after a
+  // reorg popped some off
+  const size_t wanted = std::min<uint64_t>(height, TOP_BLOCKS_CACHE_SIZE);
+  while (m_top_blocks.size() < wanted)
+  {
+    const uint64_t h = height - m_top_blocks.size() - 1;
+    top_block_metadata md;
+    md.timestamp = m_db->get_block_timestamp(h);
+    md.cumulative_difficulty = m_db->get_block_cumulative_difficulty(h);
+    md.size = m_db->get_block_size(h);
+    md.coins_generated = m_db->get_block_already_generated_coins(h);
+    m_top_blocks.push_front(md);
+  }
+  return height - m_top_blocks.size();
 }
 //------------------------------------------------------------------
-//TODO: This function only needed minor modification to work with BlockchainDB,
-//      and *works*.  As such, to reduce the number of things that might break
-//      in moving to BlockchainDB, this function will remain otherwise
-//      unchanged for the time being.
-//
-// This function makes a new block for a miner to mine the hash for
-//
-// FIXME: this codebase references #if defined(DEBUG_CREATE_BLOCK_TEMPLATE)
-// in a lot of places.  That flag is not referenced in any of the code
-// nor any of the makefiles, howeve.  Need to look into whether or not it's
-// necessary at all.
-bool Blockchain::create_block_template(block& b, const account_public_address& miner_address, difficulty_type& diffic, uint64_t& height, const blobdata& ex_nonce)
+void Blockchain::push_top_block(uint64_t new_height, const block& bl, size_t block_size, difficulty_type cumulative_difficulty, uint64_t coins_generated)
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
-  size_t median_size;
-  uint64_t already_generated_coins;
-
-  CRITICAL_REGION_BEGIN(m_blockchain_lock);
-  height = m_db->height();
-
-  b.major_version = m_hardfork->get_current_version();
-  b.minor_version = m_hardfork->get_ideal_version();
-  b.prev_id = get_tail_id();
-  b.timestamp = time(NULL);
-
-  diffic = get_difficulty_for_next_block();
-  CHECK_AND_ASSERT_MES(diffic, false, "difficulty overhead.");
-
-  median_size = m_current_block_cumul_sz_limit / 2;
-  already_generated_coins = m_db->get_block_already_generated_coins(height - 1);
-
-  CRITICAL_REGION_END();
-
-  size_t txs_size;
-  uint64_t fee;
-  if (!m_tx_pool.fill_block_template(b, median_size, already_generated_coins, txs_size, fee))
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  if (m_difficulty_window_height && m_difficulty_window_height + 1 == new_height)
   {
-    return false;
+    m_difficulty_window.push_back(bl.timestamp, cumulative_difficulty);
+    m_difficulty_window_height = new_height;
   }
-#if defined(DEBUG_CREATE_BLOCK_TEMPLATE)
-  size_t real_txs_size = 0;
-  uint64_t real_fee = 0;
-  CRITICAL_REGION_BEGIN(m_tx_pool.m_transactions_lock);
-  for(crypto::hash &cur_hash: b.tx_hashes)
+  else
   {
-    auto cur_res = m_tx_pool.m_transactions.find(cur_hash);
-    if (cur_res == m_tx_pool.m_transactions.end())
-    {
-      LOG_ERROR("Creating block template: error: transaction not found");
-      continue;
-    }
-    tx_memory_pool::tx_details &cur_tx = cur_res->second;
+    m_difficulty_window_height = 0;
+  }
+
+  if (m_top_blocks_height + 1 != new_height)
+  {
+    // not following the chain, load_top_blocks will start over
+    m_top_blocks.clear();
+    m_top_blocks_height = 0;
+    return;
+  }
+
+  top_block_metadata md;
+  md.timestamp = bl.timestamp;
+  md.cumulative_difficulty = cumulative_difficulty;
+  md.size = block_size;
+  md.coins_generated = coins_generated;
+  m_top_blocks.push_back(md);
+  while (m_top_blocks.size() > TOP_BLOCKS_CACHE_SIZE)
+    m_top_blocks.pop_front();
+  m_top_blocks_height = new_height;
+}
+//------------------------------------------------------------------
+void Blockchain::pop_top_block()
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  const uint64_t height = m_db->height();
+  if (m_difficulty_window_height && m_difficulty_window_height == height + 1 && m_difficulty_window.size())
+  {
+    // the block that was cut off the front comes back
+    m_difficulty_window.pop_back();
+    if (height > DIFFICULTY_BLOCKS_COUNT)
+    {
+      const uint64_t h = height - static_cast<uint64_t>(DIFFICULTY_BLOCKS_COUNT);
+      m_difficulty_window.push_front(m_db->get_block_timestamp(h), m_db->get_block_cumulative_difficulty(h));
+    }
+    m_difficulty_window_height = height;
+  }
+  else
+  {
+    m_difficulty_window_height = 0;
+  }
+
+  if (m_top_blocks_height != height + 1 || m_top_blocks.empty())
+  {
+    m_top_blocks.clear();
+    m_top_blocks_height = 0;
+    return;
+  }
+  m_top_blocks.pop_back();
+  m_top_blocks_height = height;
+}
+//------------------------------------------------------------------
+void Blockchain::publish_chain_state()
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  if (!m_db->height())
+    return;
+  boost::shared_ptr<chain_state> state(new chain_state());
+  state->top_hash = get_tail_id(state->height);
+  ++state->height;
+  state->difficulty = get_difficulty_for_next_block();
+  state->cumulative_difficulty = m_db->get_block_cumulative_difficulty(state->height - 1);
+  state->tx_count = m_db->get_tx_count();
+  state->hard_fork_version = get_current_hard_fork_version();
+  state->alt_blocks_count = m_alternative_chains.size();
+  boost::atomic_store(&m_chain_state, boost::shared_ptr<const chain_state>(state));
+}
+//------------------------------------------------------------------
+boost::shared_ptr<const Blockchain::chain_state> Blockchain::get_chain_state() const
+{
+  return boost::atomic_load(&m_chain_state);
+}
+//------------------------------------------------------------------
+Blockchain::read_region::read_region(const Blockchain &blockchain):
+  m_db(blockchain.m_db), m_lock(NULL)
+{
+  if (m_db->can_snapshot_reads())
+  {
+    m_db->read_snapshot_start();
+  }
+  else
+  {
+    m_lock = &blockchain.m_blockchain_lock;
+    m_lock->lock();
+  }
+}
+//------------------------------------------------------------------
+Blockchain::read_region::~read_region()
+{
+  if (m_lock)
+  {
+    m_lock->unlock();
+    return;
+  }
+  try
+  {
+    m_db->read_snapshot_stop();
+  }
+  catch (const std::exception &e)
+  {
+    LOG_ERROR("Failed to release a db read snapshot: " << e.what());
+  }
+}
+//------------------------------------------------------------------
+uint64_t Blockchain::get_current_cumulative_blocksize_limit() const
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  return m_current_block_cumul_sz_limit;
+}
+//------------------------------------------------------------------
+uint64_t Blockchain::get_average_block_size(size_t count) const
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  std::vector<size_t> sizes;
+  get_last_n_blocks_sizes(sizes, count);
+  if (sizes.empty())
+    return 0;
+  uint64_t total = 0;
+  for (size_t sz: sizes)
+    total += sz;
+  return total / sizes.size();
+}
+//------------------------------------------------------------------
+//TODO: This function only needed minor modification to work with BlockchainDB,
+//      and *works*.  As such, to reduce the number of things that might break
+//      in moving to BlockchainDB, this function will remain otherwise
+//      unchanged for the time being.
+//
+// This function makes a new block for a miner to mine the hash for
+//
+// FIXME: this codebase references #if defined(DEBUG_CREATE_BLOCK_TEMPLATE)
+// in a lot of places.  That flag is not referenced in any of the code
+// nor any of the makefiles, howeve.  Need to look into whether or not it's
+// necessary at all.
+bool Blockchain::create_block_template(block& b, const account_public_address& miner_address, difficulty_type& diffic, uint64_t& height, const blobdata& ex_nonce)
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+
+  // read before building, so a change made meanwhile is not hidden by the
+  // cached template
+  const uint64_t template_version = m_tx_pool.get_template_version();
+  const time_t now = time(NULL);
+
+  CRITICAL_REGION_LOCAL(m_block_template_lock);
+  block_template_cache& cache = m_block_template;
+  if (cache.version == template_version && now - cache.built < BLOCK_TEMPLATE_CACHE_SECONDS &&
+      cache.miner_address.m_spend_public_key == miner_address.m_spend_public_key &&
+      cache.miner_address.m_view_public_key == miner_address.m_view_public_key &&
+      cache.ex_nonce == ex_nonce)
+  {
+    b = cache.b;
+    b.timestamp = now;
+    diffic = cache.diffic;
+    height = cache.height;
+    return true;
+  }
+
+  if (!build_block_template(b, miner_address, diffic, height, ex_nonce))
+  {
+    cache.version = 0;
+    return false;
+  }
+  cache.version = template_version;
+  cache.built = now;
+  cache.miner_address = miner_address;
+  cache.ex_nonce = ex_nonce;
+  cache.b = b;
+  cache.diffic = diffic;
+  cache.height = height;
+  return true;
+}
+//------------------------------------------------------------------
+bool Blockchain::build_block_template(block& b, const account_public_address& miner_address, difficulty_type& diffic, uint64_t& height, const blobdata& ex_nonce)
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  size_t median_size;
+  uint64_t already_generated_coins;
+
+  CRITICAL_REGION_BEGIN(m_blockchain_lock);
+  height = m_db->height();
+
+  b.invalidate_hashes();
+  b.major_version = m_hardfork->get_current_version();
+  b.minor_version = m_hardfork->get_ideal_version();
+  b.prev_id = get_tail_id();
+  b.timestamp = time(NULL);
+
+  diffic = get_difficulty_for_next_block();
+  CHECK_AND_ASSERT_MES(diffic, false, "difficulty overhead.");
+
+  median_size = m_current_block_cumul_sz_limit / 2;
+  load_top_blocks();
+  already_generated_coins = m_top_blocks.back().coins_generated;
+
+  CRITICAL_REGION_END();
+
+  size_t txs_size;
+  uint64_t fee;
+  if (!m_tx_pool.fill_block_template(b, median_size, already_generated_coins, txs_size, fee))
+  {
+    return false;
+  }
+#if defined(DEBUG_CREATE_BLOCK_TEMPLATE)
+  size_t real_txs_size = 0;
+  uint64_t real_fee = 0;
+  {
+  boost::shared_lock<boost::shared_mutex> tx_pool_lock(m_tx_pool.m_transactions_lock);
+  for(crypto::hash &cur_hash: b.tx_hashes)
+  {
+    auto cur_res = m_tx_pool.m_transactions.find(cur_hash);
+    if (cur_res == m_tx_pool.m_transactions.end())
+    {
+      LOG_ERROR("Creating block template: error: transaction not found");
+      continue;
+    }
+    tx_memory_pool::tx_details &cur_tx = cur_res->second;
     real_txs_size += cur_tx.blob_size;
     real_fee += cur_tx.fee;
     if (cur_tx.blob_size != get_object_blobsize(cur_tx.tx))
@@ -1136,7 +1698,7 @@ bool Blockchain::create_block_template(block& b, const account_public_address& m
   {
     LOG_ERROR("Creating block template: error: wrongly calculated fee");
   }
-  CRITICAL_REGION_END();
+  }
   LOG_PRINT_L1("Creating block template: height " << height <<
       ", median size " << median_size <<
       ", already generated coins " << already_generated_coins <<
@@ -1222,9 +1784,13 @@ bool Blockchain::complete_timestamps_vector(uint64_t start_top_height, std::vect
   size_t need_elements = BLOCKCHAIN_TIMESTAMP_CHECK_WINDOW - timestamps.size();
   CHECK_AND_ASSERT_MES(start_top_height < m_db->height(), false, "internal error: passed start_height not < " << " m_db->height() -- " << start_top_height << " >= " << m_db->height());
   size_t stop_offset = start_top_height > need_elements ? start_top_height - need_elements : 0;
+  const uint64_t first = load_top_blocks();
   while (start_top_height != stop_offset)
   {
-    timestamps.push_back(m_db->get_block_timestamp(start_top_height));
+    if (start_top_height >= first)
+      timestamps.push_back(m_top_blocks[start_top_height - first].timestamp);
+    else
+      timestamps.push_back(m_db->get_block_timestamp(start_top_height));
     --start_top_height;
   }
   return true;
@@ -1240,7 +1806,6 @@ bool Blockchain::handle_alternative_block(const block& b, const crypto::hash& id
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
-  m_timestamps_and_difficulties_height = 0;
   uint64_t block_height = get_block_height(b);
   if(0 == block_height)
   {
@@ -1259,6 +1824,9 @@ bool Blockchain::handle_alternative_block(const block& b, const crypto::hash& id
     return false;
   }
 
+  // alt blocks a checkpoint since passed can never be switched to
+  prune_alternative_blocks();
+
   //block is not related with head of main chain
   //first of all - look in alternative chains container
   auto it_prev = m_alternative_chains.find(b.prev_id);
@@ -1367,9 +1935,9 @@ bool Blockchain::handle_alternative_block(const block& b, const crypto::hash& id
 
     // add block to alternate blocks storage,
     // as well as the current "alt chain" container
-    auto i_res = m_alternative_chains.insert(blocks_ext_by_hash::value_type(id, bei));
-    CHECK_AND_ASSERT_MES(i_res.second, false, "insertion of new alternative block returned as it already exist");
-    alt_chain.push_back(i_res.first);
+    auto i_res = add_alternative_block(id, bei);
+    CHECK_AND_ASSERT_MES(i_res != m_alternative_chains.end(), false, "insertion of new alternative block returned as it already exist");
+    alt_chain.push_back(i_res);
 
     // FIXME: is it even possible for a checkpoint to show up not on the main chain?
     if(is_a_checkpoint)
@@ -1412,10 +1980,10 @@ bool Blockchain::handle_alternative_block(const block& b, const crypto::hash& id
   return true;
 }
 //------------------------------------------------------------------
-bool Blockchain::get_blocks(uint64_t start_offset, size_t count, std::list<block>& blocks, std::list<transaction>& txs) const
+bool Blockchain::get_blocks(uint64_t start_offset, size_t count, std::vector<block>& blocks, std::vector<transaction>& txs) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  read_region region(*this);
   if(start_offset > m_db->height())
     return false;
 
@@ -1424,9 +1992,14 @@ bool Blockchain::get_blocks(uint64_t start_offset, size_t count, std::list<block
     return false;
   }
 
+  size_t n_txes = 0;
+  for(const block& blk : blocks)
+    n_txes += blk.tx_hashes.size();
+  txs.reserve(txs.size() + n_txes);
+
   for(const block& blk : blocks)
   {
-    std::list<crypto::hash> missed_ids;
+    std::vector<crypto::hash> missed_ids;
     get_transactions(blk.tx_hashes, txs, missed_ids);
     CHECK_AND_ASSERT_MES(!missed_ids.size(), false, "has missed transactions in own block in main blockchain");
   }
@@ -1434,13 +2007,14 @@ bool Blockchain::get_blocks(uint64_t start_offset, size_t count, std::list<block
   return true;
 }
 //------------------------------------------------------------------
-bool Blockchain::get_blocks(uint64_t start_offset, size_t count, std::list<block>& blocks) const
+bool Blockchain::get_blocks(uint64_t start_offset, size_t count, std::vector<block>& blocks) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  read_region region(*this);
   if(start_offset > m_db->height())
     return false;
 
+  blocks.reserve(blocks.size() + std::min<uint64_t>(count, m_db->height() - start_offset));
   for(size_t i = start_offset; i < start_offset + count && i < m_db->height();i++)
   {
     blocks.push_back(m_db->get_block_from_height(i));
@@ -1461,47 +2035,71 @@ bool Blockchain::handle_get_objects(NOTIFY_REQUEST_GET_OBJECTS::request& arg, NO
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
   m_db->block_txn_start(true);
   rsp.current_blockchain_height = get_current_blockchain_height();
-  std::list<block> blocks;
-  get_blocks(arg.blocks, blocks, rsp.missed_ids);
+  const uint64_t pruned_height = m_db->get_pruned_height();
 
-  for (const auto& bl: blocks)
+  rsp.blocks.reserve(arg.blocks.size());
+  for (const auto& block_hash : arg.blocks)
   {
-    std::list<crypto::hash> missed_tx_ids;
-    std::list<transaction> txs;
+    blobdata blob;
+    try
+    {
+      // pruned blocks can't be served in full, let the peer ask elsewhere
+      if (pruned_height > 0 && m_db->get_block_height(block_hash) < pruned_height)
+      {
+        rsp.missed_ids.push_back(block_hash);
+        continue;
+      }
+      blob = m_db->get_block_blob(block_hash);
+    }
+    catch (const BLOCK_DNE& e)
+    {
+      rsp.missed_ids.push_back(block_hash);
+      continue;
+    }
+    catch (const std::exception& e)
+    {
+      m_db->block_txn_stop();
+      return false;
+    }
+
+    // the block is only parsed for its tx hashes, it is sent as stored
+    block bl;
+    if (!parse_and_validate_block_from_blob(blob, bl))
+    {
+      LOG_ERROR("Failed to parse block " << block_hash << " retrieved from the db");
+      m_db->block_txn_stop();
+      return false;
+    }
+
+    rsp.blocks.push_back(block_complete_entry());
+    block_complete_entry& e = rsp.blocks.back();
+    e.block = std::move(blob);
+    e.txs.reserve(bl.tx_hashes.size());
 
     // FIXME: s/rsp.missed_ids/missed_tx_id/ ?  Seems like rsp.missed_ids
     //        is for missed blocks, not missed transactions as well.
-    get_transactions(bl.tx_hashes, txs, missed_tx_ids);
+    std::vector<crypto::hash> missed_tx_ids;
+    get_transactions_blobs(bl.tx_hashes, e.txs, missed_tx_ids);
 
     if (missed_tx_ids.size() != 0)
     {
       LOG_ERROR("Error retrieving blocks, missed " << missed_tx_ids.size()
-          << " transactions for block with hash: " << get_block_hash(bl)
+          << " transactions for block with hash: " << block_hash
           << std::endl
       );
 
       // append missed transaction hashes to response missed_ids field,
       // as done below if any standalone transactions were requested
       // and missed.
-      rsp.missed_ids.splice(rsp.missed_ids.end(), missed_tx_ids);
-	  m_db->block_txn_stop();
+      rsp.missed_ids.insert(rsp.missed_ids.end(), missed_tx_ids.begin(), missed_tx_ids.end());
+      rsp.blocks.pop_back();
+      m_db->block_txn_stop();
       return false;
     }
-
-    rsp.blocks.push_back(block_complete_entry());
-    block_complete_entry& e = rsp.blocks.back();
-    //pack block
-    e.block = t_serializable_object_to_blob(bl);
-    //pack transactions
-    for (transaction& tx: txs)
-      e.txs.push_back(t_serializable_object_to_blob(tx));
   }
   //get another transactions, if need
-  std::list<transaction> txs;
-  get_transactions(arg.txs, txs, rsp.missed_ids);
-  //pack aside transactions
-  for (const auto& tx: txs)
-    rsp.txs.push_back(t_serializable_object_to_blob(tx));
+  rsp.txs.reserve(arg.txs.size());
+  get_transactions_blobs(arg.txs, rsp.txs, rsp.missed_ids);
 
   m_db->block_txn_stop();
   return true;
@@ -1528,80 +2126,52 @@ size_t Blockchain::get_alternative_blocks_count() const
 //------------------------------------------------------------------
 // This function adds the output specified by <amount, i> to the result_outs container
 // unlocked and other such checks should be done by here.
-void Blockchain::add_out_to_get_random_outs(COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount& result_outs, uint64_t amount, size_t i) const
+void Blockchain::add_out_to_get_random_outs(COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount& result_outs, uint64_t amount, size_t i, const output_data_t& data) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
 
   COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::out_entry& oen = *result_outs.outs.insert(result_outs.outs.end(), COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::out_entry());
   oen.global_amount_index = i;
-  output_data_t data = m_db->get_output_key(amount, i);
   oen.out_key = data.pubkey;
 }
 //------------------------------------------------------------------
-// This function takes an RPC request for mixins and creates an RPC response
-// with the requested mixins.
-// TODO: figure out why this returns boolean / if we should be returning false
-// in some cases
-bool Blockchain::get_random_outs_for_amounts(const COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::request& req, COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::response& res) const
+void Blockchain::pick_random_outputs(uint64_t amount, uint64_t count, std::vector<uint64_t>& indices, std::vector<output_data_t>& outputs) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  read_region region(*this);
 
-  // for each amount that we need to get mixins for, get <n> random outputs
-  // from BlockchainDB where <n> is req.outs_count (number of mixins).
-  for (uint64_t amount : req.amounts)
+  // ensure we don't include outputs that aren't yet eligible to be used.
+  // outputs are sorted by height, so those are all past the unlocked count
+  uint64_t num_outs = 0;
   {
-    auto num_outs = m_db->get_num_outputs(amount);
-    // ensure we don't include outputs that aren't yet eligible to be used
-    // outpouts are sorted by height
-    while (num_outs > 0)
-    {
-      const tx_out_index toi = m_db->get_output_tx_and_index(amount, num_outs - 1);
-      const uint64_t height = m_db->get_tx_block_height(toi.first);
-      if (height + CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE <= m_db->height())
-        break;
-      --num_outs;
-    }
-
-    // create outs_for_amount struct and populate amount field
-    COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount& result_outs = *res.outs.insert(res.outs.end(), COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount());
-    result_outs.amount = amount;
-
-    std::unordered_set<uint64_t> seen_indices;
+    const std::vector<uint64_t> amounts(1, amount);
+    const auto histogram = m_db->get_output_histogram(amounts, true, 0);
+    const auto it = histogram.find(amount);
+    if (it != histogram.end())
+      num_outs = std::get<1>(it->second);
+  }
 
+  std::unordered_set<uint64_t> seen_indices;
+  std::vector<std::pair<uint64_t, uint64_t>> offsets;
+  std::vector<output_data_t> data;
+  while (indices.size() < count && seen_indices.size() < num_outs)
+  {
+    offsets.clear();
     // if there aren't enough outputs to mix with (or just enough),
     // use all of them.  Eventually this should become impossible.
-    if (num_outs <= req.outs_count)
+    if (num_outs <= count)
     {
-      for (uint64_t i = 0; i < num_outs; i++)
+      for (uint64_t i = 0; i < num_outs; ++i)
       {
-        // get tx_hash, tx_out_index from DB
-        tx_out_index toi = m_db->get_output_tx_and_index(amount, i);
-
-        // if tx is unlocked, add output to result_outs
-        if (is_tx_spendtime_unlocked(m_db->get_tx_unlock_time(toi.first)))
-        {
-          add_out_to_get_random_outs(result_outs, amount, i);
-        }
-
+        seen_indices.emplace(i);
+        offsets.push_back(std::make_pair(amount, i));
       }
     }
     else
     {
-      // while we still need more mixins
-      while (result_outs.outs.size() < req.outs_count)
+      const uint64_t wanted = std::min<uint64_t>(count - indices.size(), num_outs - seen_indices.size());
+      while (offsets.size() < wanted)
       {
-        // if we've gone through every possible output, we've gotten all we can
-        if (seen_indices.size() == num_outs)
-        {
-          break;
-        }
-
-        // get a random output index from the DB.  If we've already seen it,
-        // return to the top of the loop and try again, otherwise add it to the
-        // list of output indices we've seen.
-
         // triangular distribution over [a,b) with a=0, mode c=b=up_index_limit
         uint64_t r = crypto::rand<uint64_t>() % ((uint64_t)1 << 53);
         double frac = std::sqrt((double)r / ((uint64_t)1 << 53));
@@ -1610,38 +2180,60 @@ bool Blockchain::get_random_outs_for_amounts(const COMMAND_RPC_GET_RANDOM_OUTPUT
         if (i == num_outs)
           --i;
 
-        if (seen_indices.count(i))
-        {
-          continue;
-        }
-        seen_indices.emplace(i);
-
-        // get tx_hash, tx_out_index from DB
-        tx_out_index toi = m_db->get_output_tx_and_index(amount, i);
+        if (seen_indices.emplace(i).second)
+          offsets.push_back(std::make_pair(amount, i));
+      }
+      std::sort(offsets.begin(), offsets.end());
+    }
 
-        // if the output's transaction is unlocked, add the output's index to
-        // our list.
-        if (is_tx_spendtime_unlocked(m_db->get_tx_unlock_time(toi.first)))
-        {
-          add_out_to_get_random_outs(result_outs, amount, i);
-        }
+    m_db->get_output_keys_bulk(offsets, data);
+    for (size_t n = 0; n < offsets.size(); ++n)
+    {
+      // the output's unlock time is its tx's, no need to look the tx up
+      if (is_tx_spendtime_unlocked(data[n].unlock_time))
+      {
+        indices.push_back(offsets[n].second);
+        outputs.push_back(data[n]);
       }
     }
   }
+}
+//------------------------------------------------------------------
+// This function takes an RPC request for mixins and creates an RPC response
+// with the requested mixins.
+// TODO: figure out why this returns boolean / if we should be returning false
+// in some cases
+bool Blockchain::get_random_outs_for_amounts(const COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::request& req, COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::response& res) const
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  read_region region(*this);
+
+  // for each amount that we need to get mixins for, get <n> random outputs
+  // from BlockchainDB where <n> is req.outs_count (number of mixins).
+  for (uint64_t amount : req.amounts)
+  {
+    // create outs_for_amount struct and populate amount field
+    COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount& result_outs = *res.outs.insert(res.outs.end(), COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount());
+    result_outs.amount = amount;
+
+    std::vector<uint64_t> indices;
+    std::vector<output_data_t> outputs;
+    pick_random_outputs(amount, req.outs_count, indices, outputs);
+    for (size_t n = 0; n < indices.size(); ++n)
+      add_out_to_get_random_outs(result_outs, amount, indices[n], outputs[n]);
+  }
   return true;
 }
 //------------------------------------------------------------------
 // This function adds the ringct output at index i to the list
 // unlocked and other such checks should be done by here.
-void Blockchain::add_out_to_get_rct_random_outs(std::list<COMMAND_RPC_GET_RANDOM_RCT_OUTPUTS::out_entry>& outs, uint64_t amount, size_t i) const
+void Blockchain::add_out_to_get_rct_random_outs(std::list<COMMAND_RPC_GET_RANDOM_RCT_OUTPUTS::out_entry>& outs, uint64_t amount, size_t i, const output_data_t& data) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
 
   COMMAND_RPC_GET_RANDOM_RCT_OUTPUTS::out_entry& oen = *outs.insert(outs.end(), COMMAND_RPC_GET_RANDOM_RCT_OUTPUTS::out_entry());
   oen.amount = amount;
   oen.global_amount_index = i;
-  output_data_t data = m_db->get_output_key(amount, i);
   oen.out_key = data.pubkey;
   oen.commitment = data.commitment;
 }
@@ -1653,80 +2245,15 @@ void Blockchain::add_out_to_get_rct_random_outs(std::list<COMMAND_RPC_GET_RANDOM
 bool Blockchain::get_random_rct_outs(const COMMAND_RPC_GET_RANDOM_RCT_OUTPUTS::request& req, COMMAND_RPC_GET_RANDOM_RCT_OUTPUTS::response& res) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  read_region region(*this);
 
-  // for each amount that we need to get mixins for, get <n> random outputs
-  // from BlockchainDB where <n> is req.outs_count (number of mixins).
-  auto num_outs = m_db->get_num_outputs(0);
-  // ensure we don't include outputs that aren't yet eligible to be used
-  // outpouts are sorted by height
-  while (num_outs > 0)
-  {
-    const tx_out_index toi = m_db->get_output_tx_and_index(0, num_outs - 1);
-    const uint64_t height = m_db->get_tx_block_height(toi.first);
-    if (height + CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE <= m_db->height())
-      break;
-    --num_outs;
-  }
-
-  std::unordered_set<uint64_t> seen_indices;
-
-  // if there aren't enough outputs to mix with (or just enough),
-  // use all of them.  Eventually this should become impossible.
-  if (num_outs <= req.outs_count)
-  {
-    for (uint64_t i = 0; i < num_outs; i++)
-    {
-      // get tx_hash, tx_out_index from DB
-      tx_out_index toi = m_db->get_output_tx_and_index(0, i);
-
-      // if tx is unlocked, add output to result_outs
-      if (is_tx_spendtime_unlocked(m_db->get_tx_unlock_time(toi.first)))
-      {
-        add_out_to_get_rct_random_outs(res.outs, 0, i);
-      }
-    }
-  }
-  else
-  {
-    // while we still need more mixins
-    while (res.outs.size() < req.outs_count)
-    {
-      // if we've gone through every possible output, we've gotten all we can
-      if (seen_indices.size() == num_outs)
-      {
-        break;
-      }
-
-      // get a random output index from the DB.  If we've already seen it,
-      // return to the top of the loop and try again, otherwise add it to the
-      // list of output indices we've seen.
-
-      // triangular distribution over [a,b) with a=0, mode c=b=up_index_limit
-      uint64_t r = crypto::rand<uint64_t>() % ((uint64_t)1 << 53);
-      double frac = std::sqrt((double)r / ((uint64_t)1 << 53));
-      uint64_t i = (uint64_t)(frac*num_outs);
-      // just in case rounding up to 1 occurs after sqrt
-      if (i == num_outs)
-        --i;
-
-      if (seen_indices.count(i))
-      {
-        continue;
-      }
-      seen_indices.emplace(i);
-
-      // get tx_hash, tx_out_index from DB
-      tx_out_index toi = m_db->get_output_tx_and_index(0, i);
-
-      // if the output's transaction is unlocked, add the output's index to
-      // our list.
-      if (is_tx_spendtime_unlocked(m_db->get_tx_unlock_time(toi.first)))
-      {
-        add_out_to_get_rct_random_outs(res.outs, 0, i);
-      }
-    }
-  }
+  // get <n> random rct outputs from BlockchainDB where <n> is
+  // req.outs_count (number of mixins).
+  std::vector<uint64_t> indices;
+  std::vector<output_data_t> outputs;
+  pick_random_outputs(0, req.outs_count, indices, outputs);
+  for (size_t n = 0; n < indices.size(); ++n)
+    add_out_to_get_rct_random_outs(res.outs, 0, indices[n], outputs[n]);
 
   if (res.outs.size() < req.outs_count)
     return false;
@@ -1767,18 +2294,35 @@ bool Blockchain::get_random_rct_outs(const COMMAND_RPC_GET_RANDOM_RCT_OUTPUTS::r
 bool Blockchain::get_outs(const COMMAND_RPC_GET_OUTPUTS_BIN::request& req, COMMAND_RPC_GET_OUTPUTS_BIN::response& res) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  read_region region(*this);
 
   res.outs.clear();
-  res.outs.reserve(req.outputs.size());
-  for (const auto &i: req.outputs)
+
+  // look the keys up in B-tree order in one pass, then put them back in the
+  // order they were asked for
+  std::vector<size_t> order(req.outputs.size());
+  for (size_t n = 0; n < order.size(); ++n)
+    order[n] = n;
+  std::sort(order.begin(), order.end(), [&req](size_t a, size_t b) {
+    const auto &oa = req.outputs[a], &ob = req.outputs[b];
+    return oa.amount < ob.amount || (oa.amount == ob.amount && oa.index < ob.index);
+  });
+  std::vector<std::pair<uint64_t, uint64_t>> offsets;
+  offsets.reserve(order.size());
+  for (const size_t n : order)
+    offsets.push_back(std::make_pair(req.outputs[n].amount, req.outputs[n].index));
+  std::vector<output_data_t> outputs;
+  m_db->get_output_keys_bulk(offsets, outputs);
+
+  res.outs.resize(order.size());
+  for (size_t n = 0; n < order.size(); ++n)
   {
-    // get tx_hash, tx_out_index from DB
-    const output_data_t od = m_db->get_output_key(i.amount, i.index);
-    tx_out_index toi = m_db->get_output_tx_and_index(i.amount, i.index);
-    bool unlocked = is_tx_spendtime_unlocked(m_db->get_tx_unlock_time(toi.first));
+    // the stored output record holds its tx's unlock time, so that's the
+    // only lookup needed for each output
+    const output_data_t &od = outputs[n];
+    bool unlocked = is_tx_spendtime_unlocked(od.unlock_time);
 
-    res.outs.push_back({od.pubkey, od.commitment, unlocked});
+    res.outs[order[n]] = {od.pubkey, od.commitment, unlocked};
   }
   return true;
 }
@@ -1789,7 +2333,7 @@ bool Blockchain::get_outs(const COMMAND_RPC_GET_OUTPUTS_BIN::request& req, COMMA
 bool Blockchain::find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, uint64_t& starter_offset) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  read_region region(*this);
 
   // make sure the request includes at least the genesis block, otherwise
   // how can we expect to sync from the client that the block list came from?
@@ -1864,7 +2408,7 @@ template<class t_ids_container, class t_blocks_container, class t_missed_contain
 bool Blockchain::get_blocks(const t_ids_container& block_ids, t_blocks_container& blocks, t_missed_container& missed_bs) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  read_region region(*this);
 
   for (const auto& block_hash : block_ids)
   {
@@ -1890,13 +2434,18 @@ template<class t_ids_container, class t_tx_container, class t_missed_container>
 bool Blockchain::get_transactions(const t_ids_container& txs_ids, t_tx_container& txs, t_missed_container& missed_txs) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  read_region region(*this);
 
   for (const auto& tx_hash : txs_ids)
   {
     try
     {
-      txs.push_back(m_db->get_tx(tx_hash));
+      transaction tx = m_db->get_tx(tx_hash);
+      // don't hand out pruned txs as if they were whole
+      if (tx.pruned)
+        missed_txs.push_back(tx_hash);
+      else
+        txs.push_back(std::move(tx));
     }
     catch (const TX_DNE& e)
     {
@@ -1910,6 +2459,69 @@ bool Blockchain::get_transactions(const t_ids_container& txs_ids, t_tx_container
   return true;
 }
 //------------------------------------------------------------------
+bool Blockchain::get_pruned_transactions_blobs(const std::vector<crypto::hash>& txs_ids, std::list<pruned_tx_blob>& txs, std::list<crypto::hash>& missed_txs) const
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  read_region region(*this);
+
+  for (const auto& tx_hash : txs_ids)
+  {
+    try
+    {
+      blobdata blob;
+      if (!m_db->get_tx_blob(tx_hash, blob))
+      {
+        missed_txs.push_back(tx_hash);
+        continue;
+      }
+      txs.push_back(pruned_tx_blob());
+      pruned_tx_blob& ptx = txs.back();
+      ptx.tx_hash = tx_hash;
+      if (!get_pruned_tx_blob(blob, ptx.tx, ptx.blob, ptx.prunable_hash, ptx.has_prunable_hash))
+      {
+        LOG_ERROR("Failed to parse the base of tx " << tx_hash << " from the db");
+        return false;
+      }
+    }
+    catch (const std::exception& e)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+//------------------------------------------------------------------
+template<class t_ids_container, class t_tx_container, class t_missed_container>
+bool Blockchain::get_transactions_blobs(const t_ids_container& txs_ids, t_tx_container& txs, t_missed_container& missed_txs) const
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  read_region region(*this);
+
+  const uint64_t pruned_height = m_db->get_pruned_height();
+  for (const auto& tx_hash : txs_ids)
+  {
+    try
+    {
+      // don't hand out pruned txs as if they were whole
+      if (pruned_height > 0 && m_db->tx_exists(tx_hash) && m_db->get_tx_block_height(tx_hash) < pruned_height)
+      {
+        missed_txs.push_back(tx_hash);
+        continue;
+      }
+      blobdata tx;
+      if (m_db->get_tx_blob(tx_hash, tx))
+        txs.push_back(std::move(tx));
+      else
+        missed_txs.push_back(tx_hash);
+    }
+    catch (const std::exception& e)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+//------------------------------------------------------------------
 void Blockchain::print_blockchain(uint64_t start_index, uint64_t end_index) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
@@ -1960,7 +2572,7 @@ void Blockchain::print_blockchain_outs(const std::string& file) const
 bool Blockchain::find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, NOTIFY_RESPONSE_CHAIN_ENTRY::request& resp) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  read_region region(*this);
 
   // if we can't find the split point, return false
   if(!find_blockchain_supplement(qblock_ids, resp.start_height))
@@ -1968,7 +2580,7 @@ bool Blockchain::find_blockchain_supplement(const std::list<crypto::hash>& qbloc
     return false;
   }
 
-  resp.total_height = get_current_blockchain_height();
+  resp.total_height = m_db->height();
   size_t count = 0;
   for(size_t i = resp.start_height; i < resp.total_height && count < BLOCKS_IDS_SYNCHRONIZING_DEFAULT_COUNT; i++, count++)
   {
@@ -1977,14 +2589,164 @@ bool Blockchain::find_blockchain_supplement(const std::list<crypto::hash>& qbloc
   return true;
 }
 //------------------------------------------------------------------
+bool Blockchain::get_block_hashing_blobs(const std::list<crypto::hash>& block_ids, std::vector<blobdata>& headers) const
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+
+  headers.clear();
+  headers.reserve(block_ids.size());
+  m_db->block_txn_start(true);
+  try
+  {
+    for (const auto& block_id : block_ids)
+      headers.push_back(get_block_hashing_blob(m_db->get_block(block_id)));
+  }
+  catch (const std::exception& e)
+  {
+    m_db->block_txn_stop();
+    LOG_PRINT_L1("Failed to get block headers: " << e.what());
+    return false;
+  }
+  m_db->block_txn_stop();
+  return true;
+}
+//------------------------------------------------------------------
+bool Blockchain::verify_block_headers(uint64_t start_height, const std::list<crypto::hash>& block_ids, const std::vector<blobdata>& headers)
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  CHECK_AND_ASSERT_MES(headers.size() == block_ids.size(), false, "Got " << headers.size() << " headers for " << block_ids.size() << " block ids");
+  if (block_ids.empty())
+    return true;
+
+  // the difficulty window leading up to the first block, as get_difficulty_for_next_block sees it
+  std::vector<uint64_t> timestamps;
+  std::vector<difficulty_type> difficulties;
+  {
+    CRITICAL_REGION_LOCAL(m_blockchain_lock);
+    if (start_height >= m_db->height() || m_db->get_block_hash_from_height(start_height) != block_ids.front())
+    {
+      LOG_PRINT_L1("Chain entry does not start on our main chain, not checking its headers");
+      return true;
+    }
+    m_db->block_txn_start(true);
+    for (uint64_t h = start_height + 1 - std::min<uint64_t>(start_height + 1, DIFFICULTY_BLOCKS_COUNT); h <= start_height; ++h)
+    {
+      if (h == 0)
+        continue;
+      timestamps.push_back(m_db->get_block_timestamp(h));
+      difficulties.push_back(m_db->get_block_cumulative_difficulty(h));
+    }
+    m_db->block_txn_stop();
+  }
+
+  struct pow_check
+  {
+    const blobdata *header;
+    difficulty_type difficulty;
+    uint64_t height;
+  };
+  std::vector<pow_check> checks;
+
+  auto id_it = block_ids.begin();
+  crypto::hash prev_id = *id_it;
+  for (size_t i = 1; i < headers.size(); ++i)
+  {
+    const crypto::hash &id = *++id_it;
+    const uint64_t height = start_height + i;
+    block_header header;
+    crypto::hash tree_root_hash;
+    uint64_t tx_count;
+    if (!parse_block_hashing_blob(headers[i], header, tree_root_hash, tx_count))
+      return false;
+    if (header.prev_id != prev_id)
+    {
+      LOG_PRINT_L1("Block header at height " << height << " does not follow the previous one");
+      return false;
+    }
+    // block 202612's id does not follow from its header, see get_block_hash
+    crypto::hash header_id;
+    if (height != 202612 && (!get_object_hash(headers[i], header_id) || header_id != id))
+    {
+      LOG_PRINT_L1("Block header at height " << height << " does not match its block id " << id);
+      return false;
+    }
+    if (!m_checkpoints.check_block(height, id))
+    {
+      LOG_PRINT_L1("Block header at height " << height << " conflicts with a checkpoint");
+      return false;
+    }
+
+    const size_t target = header.major_version < 2 ? DIFFICULTY_TARGET_V1 : DIFFICULTY_TARGET_V2;
+    const difficulty_type difficulty = next_difficulty(timestamps, difficulties, target);
+    if (!m_checkpoints.is_in_checkpoint_zone(height) && height != 202612)
+      checks.push_back({&headers[i], difficulty, height});
+
+    timestamps.push_back(header.timestamp);
+    difficulties.push_back((difficulties.empty() ? 0 : difficulties.back()) + difficulty);
+    if (timestamps.size() > DIFFICULTY_BLOCKS_COUNT)
+    {
+      timestamps.erase(timestamps.begin());
+      difficulties.erase(difficulties.begin());
+    }
+    prev_id = id;
+  }
+
+  if (checks.empty())
+    return true;
+
+  // headers are handed out a few at a time, as in block_longhash_worker
+  std::atomic<size_t> next_check(0);
+  std::atomic<bool> pow_ok(true);
+  const uint64_t threads = m_verification_pool.count() + 1;
+  TIME_MEASURE_START(t);
+  tools::task_region(m_verification_pool, [&] (tools::task_region_handle& region) {
+    for (uint64_t n = 0; n < threads; ++n)
+    {
+      region.run([&] {
+        slow_hash_allocate_state();
+        const size_t ways = crypto::CN_SLOW_HASH_MAX_WAYS;
+        std::vector<const void*> data;
+        std::vector<size_t> lengths;
+        std::vector<crypto::hash> pows;
+        for (size_t first = next_check.fetch_add(ways); first < checks.size() && pow_ok && !m_cancel; first = next_check.fetch_add(ways))
+        {
+          const size_t last = std::min(first + ways, checks.size());
+          data.clear();
+          lengths.clear();
+          for (size_t i = first; i < last; ++i)
+          {
+            data.push_back(checks[i].header->data());
+            lengths.push_back(checks[i].header->size());
+          }
+          pows.resize(data.size());
+          crypto::cn_slow_hash_multi(data.data(), lengths.data(), data.size(), pows.data());
+          for (size_t i = first; i < last; ++i)
+          {
+            if (!check_hash(pows[i - first], checks[i].difficulty))
+            {
+              LOG_PRINT_L1("Block header at height " << checks[i].height << " does not have enough proof of work");
+              pow_ok = false;
+            }
+          }
+        }
+        slow_hash_free_state();
+      });
+    }
+  });
+  TIME_MEASURE_FINISH(t);
+  LOG_PRINT_L1("Checked proof of work of " << checks.size() << " block headers in " << t << " ms");
+  return pow_ok && !m_cancel;
+}
+//------------------------------------------------------------------
 //FIXME: change argument to std::vector, low priority
 // find split point between ours and foreign blockchain (or start at
 // blockchain height <req_start_block>), and return up to max_count FULL
 // blocks by reference.
-bool Blockchain::find_blockchain_supplement(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, std::list<std::pair<block, std::list<transaction> > >& blocks, uint64_t& total_height, uint64_t& start_height, size_t max_count) const
+bool Blockchain::find_blockchain_supplement(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, std::vector<std::pair<blobdata, std::vector<blobdata> > >& blocks, uint64_t& total_height, uint64_t& start_height, size_t max_count) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  read_region region(*this);
 
   // if a specific start height has been requested
   if(req_start_block > 0)
@@ -2004,14 +2766,24 @@ bool Blockchain::find_blockchain_supplement(const uint64_t req_start_block, cons
     }
   }
 
-  total_height = get_current_blockchain_height();
+  if (start_height < m_db->get_pruned_height())
+  {
+    LOG_PRINT_L1("Refusing to serve pruned blocks from height " << start_height);
+    return false;
+  }
+
+  total_height = m_db->height();
+  blocks.reserve(blocks.size() + std::min<uint64_t>(max_count, total_height - start_height));
   size_t count = 0;
   for(size_t i = start_height; i < total_height && count < max_count; i++, count++)
   {
     blocks.resize(blocks.size()+1);
-    blocks.back().first = m_db->get_block_from_height(i);
-    std::list<crypto::hash> mis;
-    get_transactions(blocks.back().first.tx_hashes, blocks.back().second, mis);
+    blocks.back().first = m_db->get_block_blob_from_height(i);
+    block b;
+    CHECK_AND_ASSERT_MES(parse_and_validate_block_from_blob(blocks.back().first, b), false, "internal error, invalid block");
+    blocks.back().second.reserve(b.tx_hashes.size());
+    std::vector<crypto::hash> mis;
+    get_transactions_blobs(b.tx_hashes, blocks.back().second, mis);
     CHECK_AND_ASSERT_MES(!mis.size(), false, "internal error, transaction from block not found");
   }
   return true;
@@ -2180,7 +2952,7 @@ bool Blockchain::check_tx_inputs(transaction& tx, uint64_t& max_used_block_heigh
 #if defined(PER_BLOCK_CHECKPOINT)
   // check if we're doing per-block checkpointing
   // FIXME: investigate why this block returns
-  if (m_db->height() < m_blocks_hash_check.size() && kept_by_block)
+  if (in_trusted_hashes_zone(m_db->height()) && kept_by_block)
   {
     TIME_MEASURE_START(a);
     m_blocks_txs_check.push_back(get_transaction_hash(tx));
@@ -2207,6 +2979,88 @@ bool Blockchain::check_tx_inputs(transaction& tx, uint64_t& max_used_block_heigh
   return true;
 }
 //------------------------------------------------------------------
+size_t Blockchain::verify_tx_signatures(const std::vector<transaction*>& txs)
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+
+  // the rings are resolved in a read region, and the signatures checked
+  // with no lock at all, so blocks and readers are not held up meanwhile
+  std::deque<tx_signature_check> sig_checks;
+  size_t n_failed = 0;
+  {
+    read_region region(*this);
+    for (transaction* tx : txs)
+    {
+      sig_checks.push_back(tx_signature_check());
+      if (!get_tx_signature_check(*tx, sig_checks.back()))
+      {
+        sig_checks.pop_back();
+        ++n_failed;
+      }
+    }
+  }
+
+  tools::task_region(m_verification_pool, [&] (tools::task_region_handle& region) {
+    for (tx_signature_check& check : sig_checks)
+      queue_tx_signatures(region, check);
+  });
+
+  // only the passing ones are remembered, under the ring members they were
+  // checked against: check_tx_inputs skips their signatures if it finds the
+  // same members in the chain it then sees, and checks the rest as usual
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  for (const tx_signature_check& check : sig_checks)
+  {
+    if (std::find(check.results.begin(), check.results.end(), 0) == check.results.end())
+      add_verified_tx(get_verified_tx_key(*check.tx, check.pubkeys));
+    else
+      ++n_failed;
+  }
+  return n_failed;
+}
+//------------------------------------------------------------------
+bool Blockchain::get_tx_signature_check(transaction& tx, tx_signature_check& check)
+{
+  check.tx = &tx;
+  check.tx_prefix_hash = get_transaction_prefix_hash(tx);
+  check.pubkeys.clear();
+  check.pubkeys.resize(tx.vin.size());
+  if (tx.version == 1 && tx.signatures.size() != tx.vin.size())
+    return false;
+
+  for (size_t i = 0; i < tx.vin.size(); ++i)
+  {
+    if (tx.vin[i].type() != typeid(txin_to_key))
+      return false;
+    const txin_to_key& in_to_key = boost::get<txin_to_key>(tx.vin[i]);
+    if (in_to_key.key_offsets.empty())
+      return false;
+
+    const std::vector<uint64_t> offsets = relative_output_offsets_to_absolute(in_to_key.key_offsets);
+    std::vector<output_data_t> outputs;
+    try
+    {
+      m_db->get_output_key(in_to_key.amount, offsets, outputs);
+    }
+    catch (const std::exception& e)
+    {
+      LOG_PRINT_L1("Failed to get the ring of tx " << get_transaction_hash(tx) << ": " << e.what());
+      return false;
+    }
+    if (outputs.size() != offsets.size() || (tx.version == 1 && tx.signatures[i].size() != outputs.size()))
+      return false;
+
+    for (const output_data_t& output : outputs)
+      check.pubkeys[i].push_back(rct::ctkey({rct::pk2rct(output.pubkey), output.commitment}));
+  }
+
+  if (tx.version != 1 && !expand_transaction_2(tx, check.tx_prefix_hash, check.pubkeys))
+    return false;
+
+  check.results.assign(tx.version == 1 ? tx.vin.size() : 1, 0);
+  return true;
+}
+//------------------------------------------------------------------
 bool Blockchain::check_tx_outputs(const transaction& tx, tx_verification_context &tvc)
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
@@ -2264,7 +3118,7 @@ bool Blockchain::have_tx_keyimges_as_spent(const transaction &tx) const
   }
   return false;
 }
-bool Blockchain::expand_transaction_2(transaction &tx, const crypto::hash &tx_prefix_hash, const std::vector<std::vector<rct::ctkey>> &pubkeys)
+bool Blockchain::expand_transaction_2(transaction &tx, const crypto::hash &tx_prefix_hash, const tx_ring_keys &pubkeys)
 {
   PERF_TIMER(expand_transaction_2);
   CHECK_AND_ASSERT_MES(tx.version == 2, false, "Transaction version is not 2");
@@ -2279,7 +3133,10 @@ bool Blockchain::expand_transaction_2(transaction &tx, const crypto::hash &tx_pr
   {
     rv.mixRing.resize(pubkeys[0].size());
     for (size_t m = 0; m < pubkeys[0].size(); ++m)
+    {
       rv.mixRing[m].clear();
+      rv.mixRing[m].reserve(pubkeys.size());
+    }
     for (size_t n = 0; n < pubkeys.size(); ++n)
     {
       CHECK_AND_ASSERT_MES(pubkeys[n].size() <= pubkeys[0].size(), false, "More inputs that first ring");
@@ -2293,13 +3150,7 @@ bool Blockchain::expand_transaction_2(transaction &tx, const crypto::hash &tx_pr
   {
     rv.mixRing.resize(pubkeys.size());
     for (size_t n = 0; n < pubkeys.size(); ++n)
-    {
-      rv.mixRing[n].clear();
-      for (size_t m = 0; m < pubkeys[n].size(); ++m)
-      {
-        rv.mixRing[n].push_back(pubkeys[n][m]);
-      }
-    }
+      rv.mixRing[n].assign(pubkeys[n].begin(), pubkeys[n].end());
   }
   else
   {
@@ -2341,7 +3192,7 @@ bool Blockchain::expand_transaction_2(transaction &tx, const crypto::hash &tx_pr
 //        check_tx_input() rather than here, and use this function simply
 //        to iterate the inputs as necessary (splitting the task
 //        using threads, etc.)
-bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc, uint64_t* pmax_used_block_height)
+bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc, uint64_t* pmax_used_block_height, tx_signature_check* deferred)
 {
   PERF_TIMER(check_tx_inputs);
   LOG_PRINT_L3("Blockchain::" << __func__);
@@ -2350,6 +3201,7 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
     *pmax_used_block_height = 0;
 
   crypto::hash tx_prefix_hash = get_transaction_prefix_hash(tx);
+  const tx_view view(tx);
 
   const uint8_t hf_version = m_hardfork->get_current_version();
 
@@ -2360,12 +3212,11 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
     size_t n_unmixable = 0, n_mixable = 0;
     size_t mixin = std::numeric_limits<size_t>::max();
     const size_t min_mixin = hf_version >= 5 ? 4 : 2;
-    for (const auto& txin : tx.vin)
+    for (const tx_view::input& in_to_key : view.inputs())
     {
       // non txin_to_key inputs will be rejected below
-      if (txin.type() == typeid(txin_to_key))
+      if (in_to_key.type == tx_view::input_to_key)
       {
-        const txin_to_key& in_to_key = boost::get<txin_to_key>(txin);
         if (in_to_key.amount == 0)
         {
           // always consider rct inputs mixable. Even if there's not enough rct
@@ -2383,8 +3234,9 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
           else
             ++n_mixable;
         }
-        if (in_to_key.key_offsets.size() - 1 < mixin)
-          mixin = in_to_key.key_offsets.size() - 1;
+        const size_t ring_size = in_to_key.key_offsets_count;
+        if (ring_size - 1 < mixin)
+          mixin = ring_size - 1;
       }
     }
 
@@ -2429,48 +3281,26 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
     assert(it != m_check_txin_table.end());
   }
 
-  uint64_t t_t1 = 0;
-  std::vector<std::vector<rct::ctkey>> pubkeys(tx.vin.size());
+  tx_ring_keys pubkeys(tx.vin.size());
   std::vector < uint64_t > results;
   results.resize(tx.vin.size(), 0);
 
-  int threads = tools::get_max_concurrency();
-
-  boost::asio::io_service ioservice;
-  boost::thread_group threadpool;
-  bool ioservice_active = false;
-
-  std::unique_ptr < boost::asio::io_service::work > work(new boost::asio::io_service::work(ioservice));
-  if(threads > 1)
-  {
-    for (int i = 0; i < threads; i++)
-    {
-      threadpool.create_thread(boost::bind(&boost::asio::io_service::run, &ioservice));
-    }
-    ioservice_active = true;
-  }
-
-#define KILL_IOSERVICE()  \
-        if(ioservice_active) \
-        { \
-            work.reset(); \
-            while (!ioservice.stopped()) ioservice.poll(); \
-            threadpool.join_all(); \
-            ioservice.stop(); \
-            ioservice_active = false; \
-        }
-
-  epee::misc_utils::auto_scope_leave_caller ioservice_killer = epee::misc_utils::create_scope_leave_handler([&]() { KILL_IOSERVICE(); });
-
-  for (const auto& txin : tx.vin)
+  for (const tx_view::input& in_to_key : view.inputs())
   {
     // make sure output being spent is of type txin_to_key, rather than
     // e.g. txin_gen, which is only used for miner transactions
-    CHECK_AND_ASSERT_MES(txin.type() == typeid(txin_to_key), false, "wrong type id in tx input at Blockchain::check_tx_inputs");
-    const txin_to_key& in_to_key = boost::get<txin_to_key>(txin);
+    if (in_to_key.type != tx_view::input_to_key)
+    {
+      LOG_ERROR("wrong type id in tx input at Blockchain::check_tx_inputs");
+      return false;
+    }
 
     // make sure tx output has key offset(s) (is signed to be used)
-    CHECK_AND_ASSERT_MES(in_to_key.key_offsets.size(), false, "empty in_to_key.key_offsets in transaction with id " << get_transaction_hash(tx));
+    if (!in_to_key.key_offsets_count)
+    {
+      LOG_ERROR("empty in_to_key.key_offsets in transaction with id " << get_transaction_hash(tx));
+      return false;
+    }
 
     if(have_tx_keyimg_as_spent(in_to_key.k_image))
     {
@@ -2482,7 +3312,11 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
     if (tx.version == 1)
     {
       // basically, make sure number of inputs == number of signatures
-      CHECK_AND_ASSERT_MES(sig_index < tx.signatures.size(), false, "wrong transaction: not signature entry for input with index= " << sig_index);
+      if (sig_index >= tx.signatures.size())
+      {
+        LOG_ERROR("wrong transaction: not signature entry for input with index= " << sig_index);
+        return false;
+      }
 
 #if defined(CACHE_VIN_RESULTS)
       auto itk = it->second.find(in_to_key.k_image);
@@ -2495,6 +3329,7 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
         }
 
         // txin has been verified already, skip
+        results[sig_index] = 1;
         sig_index++;
         continue;
       }
@@ -2503,7 +3338,7 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
 
     // make sure that output being spent matches up correctly with the
     // signature spending it.
-    if (!check_tx_input(tx.version, in_to_key, tx_prefix_hash, tx.version == 1 ? tx.signatures[sig_index] : std::vector<crypto::signature>(), tx.rct_signatures, pubkeys[sig_index], pmax_used_block_height))
+    if (!check_tx_input(tx.version, view, in_to_key, tx_prefix_hash, tx.version == 1 ? tx.signatures[sig_index] : std::vector<crypto::signature>(), tx.rct_signatures, pubkeys[sig_index], pmax_used_block_height))
     {
       it->second[in_to_key.k_image] = false;
       LOG_PRINT_L1("Failed to check ring signature for tx " << get_transaction_hash(tx) << "  vin key with k_image: " << in_to_key.k_image << "  sig_index: " << sig_index);
@@ -2515,60 +3350,10 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
       return false;
     }
 
-    if (tx.version == 1)
-    {
-      if (threads > 1)
-      {
-        // ND: Speedup
-        // 1. Thread ring signature verification if possible.
-        ioservice.dispatch(boost::bind(&Blockchain::check_ring_signature, this, std::cref(tx_prefix_hash), std::cref(in_to_key.k_image), std::cref(pubkeys[sig_index]), std::cref(tx.signatures[sig_index]), std::ref(results[sig_index])));
-      }
-      else
-      {
-        check_ring_signature(tx_prefix_hash, in_to_key.k_image, pubkeys[sig_index], tx.signatures[sig_index], results[sig_index]);
-        if (!results[sig_index])
-        {
-          it->second[in_to_key.k_image] = false;
-          LOG_PRINT_L1("Failed to check ring signature for tx " << get_transaction_hash(tx) << "  vin key with k_image: " << in_to_key.k_image << "  sig_index: " << sig_index);
-
-          if (pmax_used_block_height)  // a default value of NULL is used when called from Blockchain::handle_block_to_main_chain()
-          {
-            LOG_PRINT_L1("*pmax_used_block_height: " << *pmax_used_block_height);
-          }
-
-          return false;
-        }
-        it->second[in_to_key.k_image] = true;
-      }
-    }
-
     sig_index++;
   }
 
-  KILL_IOSERVICE();
-
-  if (tx.version == 1)
-  {
-    if (threads > 1)
-    {
-      // save results to table, passed or otherwise
-      bool failed = false;
-      for (size_t i = 0; i < tx.vin.size(); i++)
-      {
-        const txin_to_key& in_to_key = boost::get<txin_to_key>(tx.vin[i]);
-        it->second[in_to_key.k_image] = results[i];
-        if(!failed && !results[i])
-          failed = true;
-      }
-
-      if (failed)
-      {
-        LOG_PRINT_L1("Failed to check ring signatures!, t_loop: " << t_t1);
-        return false;
-      }
-    }
-  }
-  else
+  if (tx.version != 1)
   {
     if (!expand_transaction_2(tx, tx_prefix_hash, pubkeys))
     {
@@ -2629,18 +3414,12 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
       }
       for (size_t n = 0; n < tx.vin.size(); ++n)
       {
-        if (memcmp(&boost::get<txin_to_key>(tx.vin[n]).k_image, &rv.p.MGs[n].II[0], 32))
+        if (memcmp(&view.in(n).k_image, &rv.p.MGs[n].II[0], 32))
         {
           LOG_PRINT_L1("Failed to check ringct signatures: mismatched key image");
           return false;
         }
       }
-
-      if (!rct::verRctSimple(rv))
-      {
-        LOG_PRINT_L1("Failed to check ringct signatures!");
-        return false;
-      }
       break;
     }
     case rct::RCTTypeFull: {
@@ -2687,18 +3466,12 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
       }
       for (size_t n = 0; n < tx.vin.size(); ++n)
       {
-        if (memcmp(&boost::get<txin_to_key>(tx.vin[n]).k_image, &rv.p.MGs[0].II[n], 32))
+        if (memcmp(&view.in(n).k_image, &rv.p.MGs[0].II[n], 32))
         {
           LOG_PRINT_L1("Failed to check ringct signatures: mismatched II/vin sizes");
           return false;
         }
       }
-
-      if (!rct::verRct(rv))
-      {
-        LOG_PRINT_L1("Failed to check ringct signatures!");
-        return false;
-      }
       break;
     }
     default:
@@ -2706,11 +3479,136 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
       return false;
     }
   }
+
+  // a transaction accepted to the pool need not have its signatures checked
+  // again when it is mined, as long as its ring members are the same ones
+  const crypto::hash verified_key = get_verified_tx_key(tx, pubkeys);
+  const bool verified = m_verified_txs.find(verified_key) != m_verified_txs.end();
+
+  tx_signature_check local_check;
+  tx_signature_check& check = deferred ? *deferred : local_check;
+  check.tx = &tx;
+  check.tx_prefix_hash = tx_prefix_hash;
+  check.pubkeys = std::move(pubkeys);
+  if (tx.version == 1)
+    check.results = std::move(results);
+  else
+    check.results.assign(1, 0);
+  if (verified)
+    std::fill(check.results.begin(), check.results.end(), 1);
+
+  if (deferred)
+    return true;
+
+  if (!verified)
+  {
+    tools::task_region(m_verification_pool, [&] (tools::task_region_handle& region) {
+      queue_tx_signatures(region, check);
+    });
+  }
+  if (!finish_tx_signatures(check))
+    return false;
+
+  add_verified_tx(verified_key);
+  return true;
+}
+
+//------------------------------------------------------------------
+crypto::hash Blockchain::get_verified_tx_key(const transaction& tx, const tx_ring_keys& pubkeys) const
+{
+  // the tx hash covers the signatures, the ring members are what they are
+  // checked against, and may differ after a reorg for the same offsets
+  std::string blob;
+  const crypto::hash tx_hash = get_transaction_hash(tx);
+  blob.append((const char*)&tx_hash, sizeof(tx_hash));
+  for (const auto& ring : pubkeys)
+    blob.append((const char*)ring.data(), ring.size() * sizeof(rct::ctkey));
+  return crypto::cn_fast_hash(blob.data(), blob.size());
+}
+
+//------------------------------------------------------------------
+void Blockchain::add_verified_tx(const crypto::hash& key)
+{
+  if (!m_verified_txs.insert(key).second)
+    return;
+  m_verified_txs_order.push_back(key);
+  while (m_verified_txs_order.size() > VERIFIED_TXS_CACHE_SIZE)
+  {
+    m_verified_txs.erase(m_verified_txs_order.front());
+    m_verified_txs_order.pop_front();
+  }
+}
+
+//------------------------------------------------------------------
+void Blockchain::queue_tx_signatures(tools::task_region_handle& region, tx_signature_check& check)
+{
+  const transaction& tx = *check.tx;
+  if (tx.version == 1)
+  {
+    for (size_t i = 0; i < tx.vin.size(); ++i)
+    {
+      // already verified and cached
+      if (check.results[i])
+        continue;
+      region.run([this, &tx, &check, i] {
+        tools::arena_scope arena;
+        check_ring_signature(check.tx_prefix_hash, boost::get<txin_to_key>(tx.vin[i]).k_image, check.pubkeys[i], tx.signatures[i], check.results[i]);
+      });
+    }
+  }
+  else if (!check.results[0])
+  {
+    region.run([&check] {
+      tools::arena_scope arena;
+      const rct::rctSig &rv = check.tx->rct_signatures;
+      // a throw in a spawned task would terminate, report it as a failure
+      try
+      {
+        check.results[0] = (rv.type == rct::RCTTypeSimple ? rct::verRctSimple(rv) : rct::verRct(rv)) ? 1 : 0;
+      }
+      catch (...)
+      {
+        check.results[0] = 0;
+      }
+    });
+  }
+}
+
+//------------------------------------------------------------------
+bool Blockchain::finish_tx_signatures(const tx_signature_check& check)
+{
+  const transaction& tx = *check.tx;
+  if (tx.version == 1)
+  {
+    auto it = m_check_txin_table.find(check.tx_prefix_hash);
+    assert(it != m_check_txin_table.end());
+
+    // save results to table, passed or otherwise
+    bool failed = false;
+    for (size_t i = 0; i < tx.vin.size(); i++)
+    {
+      const txin_to_key& in_to_key = boost::get<txin_to_key>(tx.vin[i]);
+      it->second[in_to_key.k_image] = check.results[i];
+      if(!failed && !check.results[i])
+        failed = true;
+    }
+
+    if (failed)
+    {
+      LOG_PRINT_L1("Failed to check ring signatures for tx " << get_transaction_hash(tx));
+      return false;
+    }
+  }
+  else if (!check.results[0])
+  {
+    LOG_PRINT_L1("Failed to check ringct signatures for tx " << get_transaction_hash(tx));
+    return false;
+  }
   return true;
 }
 
 //------------------------------------------------------------------
-void Blockchain::check_ring_signature(const crypto::hash &tx_prefix_hash, const crypto::key_image &key_image, const std::vector<rct::ctkey> &pubkeys, const std::vector<crypto::signature>& sig, uint64_t &result)
+void Blockchain::check_ring_signature(const crypto::hash &tx_prefix_hash, const crypto::key_image &key_image, const ring_keys &pubkeys, const std::vector<crypto::signature>& sig, uint64_t &result)
 {
   if (m_is_in_checkpoint_zone)
   {
@@ -2718,14 +3616,15 @@ void Blockchain::check_ring_signature(const crypto::hash &tx_prefix_hash, const
     return;
   }
 
-  std::vector<const crypto::public_key *> p_output_keys;
+  tools::arena_vector<const crypto::public_key *> p_output_keys;
+  p_output_keys.reserve(pubkeys.size());
   for (auto &key : pubkeys)
   {
     // rct::key and crypto::public_key have the same structure, avoid object ctor/memcpy
     p_output_keys.push_back(&(const crypto::public_key&)key.dest);
   }
 
-  result = crypto::check_ring_signature(tx_prefix_hash, key_image, p_output_keys, sig.data()) ? 1 : 0;
+  result = crypto::check_ring_signature(tx_prefix_hash, key_image, p_output_keys.data(), p_output_keys.size(), sig.data()) ? 1 : 0;
 }
 
 //------------------------------------------------------------------
@@ -2842,7 +3741,7 @@ bool Blockchain::is_tx_spendtime_unlocked(uint64_t unlock_time) const
 // This function locates all outputs associated with a given input (mixins)
 // and validates that they exist and are usable.  It also checks the ring
 // signature for each input.
-bool Blockchain::check_tx_input(size_t tx_version, const txin_to_key& txin, const crypto::hash& tx_prefix_hash, const std::vector<crypto::signature>& sig, const rct::rctSig &rct_signatures, std::vector<rct::ctkey> &output_keys, uint64_t* pmax_related_block_height)
+bool Blockchain::check_tx_input(size_t tx_version, const tx_view& view, const tx_view::input& txin, const crypto::hash& tx_prefix_hash, const std::vector<crypto::signature>& sig, const rct::rctSig &rct_signatures, ring_keys &output_keys, uint64_t* pmax_related_block_height)
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
 
@@ -2852,9 +3751,9 @@ bool Blockchain::check_tx_input(size_t tx_version, const txin_to_key& txin, cons
 
   struct outputs_visitor
   {
-    std::vector<rct::ctkey >& m_output_keys;
+    ring_keys& m_output_keys;
     const Blockchain& m_bch;
-    outputs_visitor(std::vector<rct::ctkey>& output_keys, const Blockchain& bch) :
+    outputs_visitor(ring_keys& output_keys, const Blockchain& bch) :
       m_output_keys(output_keys), m_bch(bch)
     {
     }
@@ -2881,15 +3780,15 @@ bool Blockchain::check_tx_input(size_t tx_version, const txin_to_key& txin, cons
 
   // collect output keys
   outputs_visitor vi(output_keys, *this);
-  if (!scan_outputkeys_for_indexes(tx_version, txin, vi, tx_prefix_hash, pmax_related_block_height))
+  if (!scan_outputkeys_for_indexes(tx_version, view, txin, vi, tx_prefix_hash, pmax_related_block_height))
   {
-    LOG_PRINT_L1("Failed to get output keys for tx with amount = " << print_money(txin.amount) << " and count indexes " << txin.key_offsets.size());
+    LOG_PRINT_L1("Failed to get output keys for tx with amount = " << print_money(txin.amount) << " and count indexes " << txin.key_offsets_count);
     return false;
   }
 
-  if(txin.key_offsets.size() != output_keys.size())
+  if(txin.key_offsets_count != output_keys.size())
   {
-    LOG_PRINT_L1("Output keys for tx with amount = " << txin.amount << " and count indexes " << txin.key_offsets.size() << " returned wrong keys count " << output_keys.size());
+    LOG_PRINT_L1("Output keys for tx with amount = " << txin.amount << " and count indexes " << txin.key_offsets_count << " returned wrong keys count " << output_keys.size());
     return false;
   }
   if (tx_version == 1) {
@@ -2938,6 +3837,8 @@ bool Blockchain::check_block_timestamp(const block& b) const
     return false;
   }
 
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+
   // if not enough blocks, no proper median yet, return true
   if(m_db->height() < BLOCKCHAIN_TIMESTAMP_CHECK_WINDOW)
   {
@@ -2949,9 +3850,10 @@ bool Blockchain::check_block_timestamp(const block& b) const
 
   // need most recent 60 blocks, get index of first of those
   size_t offset = h - BLOCKCHAIN_TIMESTAMP_CHECK_WINDOW;
+  const uint64_t first = load_top_blocks();
   for(;offset < h; ++offset)
   {
-    timestamps.push_back(m_db->get_block_timestamp(offset));
+    timestamps.push_back(m_top_blocks[offset - first].timestamp);
   }
 
   return check_block_timestamp(timestamps, b);
@@ -2993,7 +3895,44 @@ bool Blockchain::flush_txes_from_pool(const std::list<crypto::hash> &txids)
       res = false;
     }
   }
-  return res;
+  return res;
+}
+//------------------------------------------------------------------
+bool Blockchain::check_block_header(const block& bl, const crypto::hash& id)
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+
+  uint64_t height;
+  difficulty_type difficulty;
+  {
+    CRITICAL_REGION_LOCAL(m_blockchain_lock);
+    if (bl.prev_id != get_tail_id())
+      return false;
+    height = m_db->height();
+    if (!m_hardfork->check(bl) || !check_block_timestamp(bl))
+      return false;
+    if (m_checkpoints.is_in_checkpoint_zone(height) && !m_checkpoints.check_block(height, id))
+      return false;
+    if (!prevalidate_miner_transaction(bl, height))
+      return false;
+    difficulty = get_difficulty_for_next_block();
+    if (!difficulty)
+      return false;
+  }
+
+  // the slow hash is done without the lock, and kept for the full check
+  const crypto::hash proof_of_work = get_block_longhash(bl, height);
+  if (!check_hash(proof_of_work, difficulty))
+  {
+    LOG_PRINT_L1("Block with id: " << id << " does not have enough proof of work: " << proof_of_work);
+    return false;
+  }
+
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  if (bl.prev_id != get_tail_id())
+    return false;
+  m_blocks_longhash_table.emplace(id, proof_of_work);
+  return true;
 }
 //------------------------------------------------------------------
 //      Needs to validate the block and acquire each transaction from the
@@ -3003,9 +3942,9 @@ bool Blockchain::handle_block_to_main_chain(const block& bl, const crypto::hash&
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
 
-  TIME_MEASURE_START(block_processing_time);
+  TIME_MEASURE_NS_START(block_processing_time);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
-  TIME_MEASURE_START(t1);
+  TIME_MEASURE_NS_START(t1);
 
   m_db->block_txn_start(true);
   if(bl.prev_id != get_tail_id())
@@ -3024,8 +3963,8 @@ leave:
     goto leave;
   }
 
-  TIME_MEASURE_FINISH(t1);
-  TIME_MEASURE_START(t2);
+  TIME_MEASURE_NS_FINISH(t1);
+  TIME_MEASURE_NS_START(t2);
 
   // make sure block timestamp is not less than the median timestamp
   // of a set number of the most recent blocks.
@@ -3036,9 +3975,9 @@ leave:
     goto leave;
   }
 
-  TIME_MEASURE_FINISH(t2);
+  TIME_MEASURE_NS_FINISH(t2);
   //check proof of work
-  TIME_MEASURE_START(target_calculating_time);
+  TIME_MEASURE_NS_START(target_calculating_time);
 
   // get the target difficulty for the block.
   // the calculation can overflow, among other failure cases,
@@ -3048,9 +3987,9 @@ leave:
   difficulty_type current_diffic = get_difficulty_for_next_block();
   CHECK_AND_ASSERT_MES(current_diffic, false, "!!!!!!!!! difficulty overhead !!!!!!!!!");
 
-  TIME_MEASURE_FINISH(target_calculating_time);
+  TIME_MEASURE_NS_FINISH(target_calculating_time);
 
-  TIME_MEASURE_START(longhash_calculating_time);
+  TIME_MEASURE_NS_START(longhash_calculating_time);
 
   crypto::hash proof_of_work = null_hash;
 
@@ -3066,7 +4005,7 @@ leave:
   bool precomputed = false;
   bool fast_check = false;
 #if defined(PER_BLOCK_CHECKPOINT)
-  if (m_db->height() < m_blocks_hash_check.size())
+  if (in_trusted_hashes_zone(m_db->height()))
   {
     auto hash = get_block_hash(bl);
     if (memcmp(&hash, &m_blocks_hash_check[m_db->height()], sizeof(hash)) != 0)
@@ -3110,11 +4049,11 @@ leave:
     }
   }
 
-  TIME_MEASURE_FINISH(longhash_calculating_time);
+  TIME_MEASURE_NS_FINISH(longhash_calculating_time);
   if (precomputed)
-    longhash_calculating_time += m_fake_pow_calc_time;
+    longhash_calculating_time += m_fake_pow_calc_time * 1000000;
 
-  TIME_MEASURE_START(t3);
+  TIME_MEASURE_NS_START(t3);
 
   // sanity check basic miner tx properties;
   if(!prevalidate_miner_transaction(bl, m_db->height()))
@@ -3135,115 +4074,158 @@ leave:
   uint64_t t_exists = 0;
   uint64_t t_pool = 0;
   uint64_t t_dblspnd = 0;
-  TIME_MEASURE_FINISH(t3);
+  TIME_MEASURE_NS_FINISH(t3);
 
 // XXX old code adds miner tx here
 
+  // signature checks for all the block's transactions are queued on the
+  // verification pool as each transaction passes its serial checks (outputs
+  // lookup, key images), then joined once all transactions have been seen.
+  // Their temporaries come from this thread's arena, freed with the block
+  tools::arena_scope arena;
+  std::deque<transaction> checked_txs;
+  std::deque<tx_signature_check> sig_checks;
+  bool txs_ok = true;
+
   int tx_index = 0;
-  // Iterate over the block's transaction hashes, grabbing each
-  // from the tx_pool and validating them.  Each is then added
-  // to txs.  Keys spent in each are added to <keys> by the double spend check.
-  for (const crypto::hash& tx_id : bl.tx_hashes)
-  {
-    transaction tx;
-    size_t blob_size = 0;
-    uint64_t fee = 0;
-    bool relayed = false;
-    TIME_MEASURE_START(aa);
+  tools::task_region(m_verification_pool, [&] (tools::task_region_handle& region) {
+    // Iterate over the block's transaction hashes, grabbing each
+    // from the tx_pool and validating them.  Each is then added
+    // to txs.  Keys spent in each are added to <keys> by the double spend check.
+    for (const crypto::hash& tx_id : bl.tx_hashes)
+    {
+      transaction tx;
+      size_t blob_size = 0;
+      uint64_t fee = 0;
+      bool relayed = false;
+      TIME_MEASURE_NS_START(aa);
 
 // XXX old code does not check whether tx exists
-    if (m_db->tx_exists(tx_id))
-    {
-      LOG_PRINT_L1("Block with id: " << id << " attempting to add transaction already in blockchain with id: " << tx_id);
-      bvc.m_verifivation_failed = true;
-      return_tx_to_pool(txs);
-      goto leave;
-    }
+      if (m_db->tx_exists(tx_id))
+      {
+        LOG_PRINT_L1("Block with id: " << id << " attempting to add transaction already in blockchain with id: " << tx_id);
+        bvc.m_verifivation_failed = true;
+        txs_ok = false;
+        return;
+      }
 
-    TIME_MEASURE_FINISH(aa);
-    t_exists += aa;
-    TIME_MEASURE_START(bb);
+      TIME_MEASURE_NS_FINISH(aa);
+      t_exists += aa;
+      TIME_MEASURE_NS_START(bb);
 
-    // get transaction with hash <tx_id> from tx_pool
-    if(!m_tx_pool.take_tx(tx_id, tx, blob_size, fee, relayed))
-    {
-      LOG_PRINT_L1("Block with id: " << id  << " has at least one unknown transaction with id: " << tx_id);
-      bvc.m_verifivation_failed = true;
-      return_tx_to_pool(txs);
-      goto leave;
-    }
+      // get transaction with hash <tx_id> from tx_pool
+      if(!m_tx_pool.take_tx(tx_id, tx, blob_size, fee, relayed))
+      {
+        LOG_PRINT_L1("Block with id: " << id  << " has at least one unknown transaction with id: " << tx_id);
+        bvc.m_verifivation_failed = true;
+        txs_ok = false;
+        return;
+      }
 
-    TIME_MEASURE_FINISH(bb);
-    t_pool += bb;
-    // add the transaction to the temp list of transactions, so we can either
-    // store the list of transactions all at once or return the ones we've
-    // taken from the tx_pool back to it if the block fails verification.
-    txs.push_back(tx);
-    TIME_MEASURE_START(dd);
-
-    // FIXME: the storage should not be responsible for validation.
-    //        If it does any, it is merely a sanity check.
-    //        Validation is the purview of the Blockchain class
-    //        - TW
-    //
-    // ND: this is not needed, db->add_block() checks for duplicate k_images and fails accordingly.
-    // if (!check_for_double_spend(tx, keys))
-    // {
-    //     LOG_PRINT_L0("Double spend detected in transaction (id: " << tx_id);
-    //     bvc.m_verifivation_failed = true;
-    //     break;
-    // }
-
-    TIME_MEASURE_FINISH(dd);
-    t_dblspnd += dd;
-    TIME_MEASURE_START(cc);
+      TIME_MEASURE_NS_FINISH(bb);
+      t_pool += bb;
+      // add the transaction to the temp list of transactions, so we can either
+      // store the list of transactions all at once or return the ones we've
+      // taken from the tx_pool back to it if the block fails verification.
+      txs.push_back(tx);
+      TIME_MEASURE_NS_START(dd);
+
+      // FIXME: the storage should not be responsible for validation.
+      //        If it does any, it is merely a sanity check.
+      //        Validation is the purview of the Blockchain class
+      //        - TW
+      //
+      // ND: this is not needed, db->add_block() checks for duplicate k_images and fails accordingly.
+      // if (!check_for_double_spend(tx, keys))
+      // {
+      //     LOG_PRINT_L0("Double spend detected in transaction (id: " << tx_id);
+      //     bvc.m_verifivation_failed = true;
+      //     break;
+      // }
+
+      TIME_MEASURE_NS_FINISH(dd);
+      t_dblspnd += dd;
+      TIME_MEASURE_NS_START(cc);
 
 #if defined(PER_BLOCK_CHECKPOINT)
-    if (!fast_check)
+      if (!fast_check)
 #endif
-    {
-      // validate that transaction inputs and the keys spending them are correct.
-      tx_verification_context tvc;
-      if(!check_tx_inputs(tx, tvc))
       {
-        LOG_PRINT_L1("Block with id: " << id  << " has at least one transaction (id: " << tx_id << ") with wrong inputs.");
-
-        //TODO: why is this done?  make sure that keeping invalid blocks makes sense.
-        add_block_as_invalid(bl, id);
-        LOG_PRINT_L1("Block with id " << id << " added as invalid because of wrong inputs in transactions");
-        bvc.m_verifivation_failed = true;
-        return_tx_to_pool(txs);
-        goto leave;
+        // validate that transaction inputs and the keys spending them are correct,
+        // the signatures themselves are checked on the pool
+        tx_verification_context tvc;
+        checked_txs.push_back(std::move(tx));
+        sig_checks.push_back(tx_signature_check());
+        if(!check_tx_inputs(checked_txs.back(), tvc, NULL, &sig_checks.back()))
+        {
+          LOG_PRINT_L1("Block with id: " << id  << " has at least one transaction (id: " << tx_id << ") with wrong inputs.");
+
+          //TODO: why is this done?  make sure that keeping invalid blocks makes sense.
+          add_block_as_invalid(bl, id);
+          LOG_PRINT_L1("Block with id " << id << " added as invalid because of wrong inputs in transactions");
+          bvc.m_verifivation_failed = true;
+          txs_ok = false;
+          return;
+        }
+        queue_tx_signatures(region, sig_checks.back());
       }
-    }
 #if defined(PER_BLOCK_CHECKPOINT)
-    else
+      else
+      {
+        // ND: if fast_check is enabled for blocks, there is no need to check
+        // the transaction inputs, but do some sanity checks anyway.
+        if (memcmp(&m_blocks_txs_check[tx_index++], &tx_id, sizeof(tx_id)) != 0)
+        {
+          LOG_PRINT_L1("Block with id: " << id << " has at least one transaction (id: " << tx_id << ") with wrong inputs.");
+          //TODO: why is this done?  make sure that keeping invalid blocks makes sense.
+          add_block_as_invalid(bl, id);
+          LOG_PRINT_L1("Block with id " << id << " added as invalid because of wrong inputs in transactions");
+          bvc.m_verifivation_failed = true;
+          txs_ok = false;
+          return;
+        }
+      }
+#endif
+      TIME_MEASURE_NS_FINISH(cc);
+      t_checktx += cc;
+      fee_summary += fee;
+      cumulative_block_size += blob_size;
+    }
+  });
+
+  if (txs_ok)
+  {
+    TIME_MEASURE_NS_START(ee);
+    for (const tx_signature_check& check : sig_checks)
     {
-      // ND: if fast_check is enabled for blocks, there is no need to check
-      // the transaction inputs, but do some sanity checks anyway.
-      if (memcmp(&m_blocks_txs_check[tx_index++], &tx_id, sizeof(tx_id)) != 0)
+      if (!finish_tx_signatures(check))
       {
-        LOG_PRINT_L1("Block with id: " << id << " has at least one transaction (id: " << tx_id << ") with wrong inputs.");
+        LOG_PRINT_L1("Block with id: " << id  << " has at least one transaction (id: " << get_transaction_hash(*check.tx) << ") with wrong inputs.");
+
         //TODO: why is this done?  make sure that keeping invalid blocks makes sense.
         add_block_as_invalid(bl, id);
         LOG_PRINT_L1("Block with id " << id << " added as invalid because of wrong inputs in transactions");
         bvc.m_verifivation_failed = true;
-        return_tx_to_pool(txs);
-        goto leave;
+        txs_ok = false;
+        break;
       }
     }
-#endif
-    TIME_MEASURE_FINISH(cc);
-    t_checktx += cc;
-    fee_summary += fee;
-    cumulative_block_size += blob_size;
+    TIME_MEASURE_NS_FINISH(ee);
+    t_checktx += ee;
+  }
+
+  if (!txs_ok)
+  {
+    return_tx_to_pool(txs);
+    goto leave;
   }
 
   m_blocks_txs_check.clear();
 
-  TIME_MEASURE_START(vmt);
+  TIME_MEASURE_NS_START(vmt);
   uint64_t base_reward = 0;
-  uint64_t already_generated_coins = m_db->height() ? m_db->get_block_already_generated_coins(m_db->height() - 1) : 0;
+  load_top_blocks();
+  uint64_t already_generated_coins = m_top_blocks.empty() ? 0 : m_top_blocks.back().coins_generated;
   if(!validate_miner_transaction(bl, cumulative_block_size, fee_summary, base_reward, already_generated_coins, bvc.m_partial_block_reward, m_hardfork->get_current_version()))
   {
     LOG_PRINT_L1("Block with id: " << id << " has incorrect miner transaction");
@@ -3252,7 +4234,7 @@ leave:
     goto leave;
   }
 
-  TIME_MEASURE_FINISH(vmt);
+  TIME_MEASURE_NS_FINISH(vmt);
   size_t block_size;
   difficulty_type cumulative_difficulty;
 
@@ -3264,21 +4246,25 @@ leave:
   // at MONEY_SUPPLY. already_generated_coins is only used to compute the block subsidy and MONEY_SUPPLY yields a
   // subsidy of 0 under the base formula and therefore the minimum subsidy >0 in the tail state.
   already_generated_coins = base_reward < (MONEY_SUPPLY-already_generated_coins) ? already_generated_coins + base_reward : MONEY_SUPPLY;
-  if(m_db->height())
-    cumulative_difficulty += m_db->get_block_cumulative_difficulty(m_db->height() - 1);
+  if(!m_top_blocks.empty())
+    cumulative_difficulty += m_top_blocks.back().cumulative_difficulty;
 
-  TIME_MEASURE_FINISH(block_processing_time);
+  TIME_MEASURE_NS_FINISH(block_processing_time);
   if(precomputed)
-    block_processing_time += m_fake_pow_calc_time;
+    block_processing_time += m_fake_pow_calc_time * 1000000;
 
   m_db->block_txn_stop();
-  TIME_MEASURE_START(addblock);
+  TIME_MEASURE_NS_START(addblock);
   uint64_t new_height = 0;
   if (!bvc.m_verifivation_failed)
   {
     try
     {
-      new_height = m_db->add_block(bl, block_size, cumulative_difficulty, already_generated_coins, txs);
+      // serialize the block and its transactions on the verification pool
+      // first, so the db's write transaction only has to store them
+      prepared_block_t prepared;
+      BlockchainDB::prepare_block(bl, txs, prepared, &m_verification_pool);
+      new_height = m_db->add_block(bl, block_size, cumulative_difficulty, already_generated_coins, txs, &prepared);
     }
     catch (const KEY_IMAGE_EXISTS& e)
     {
@@ -3294,29 +4280,42 @@ leave:
       return_tx_to_pool(txs);
       return false;
     }
+    push_top_block(new_height, bl, block_size, cumulative_difficulty, already_generated_coins);
   }
   else
   {
     LOG_ERROR("Blocks that failed verification should not reach here");
   }
 
-  TIME_MEASURE_FINISH(addblock);
+  TIME_MEASURE_NS_FINISH(addblock);
 
   // do this after updating the hard fork state since the size limit may change due to fork
   update_next_cumulative_size_limit();
 
-  LOG_PRINT_L1("+++++ BLOCK SUCCESSFULLY ADDED" << std::endl << "id:\t" << id << std::endl << "PoW:\t" << proof_of_work << std::endl << "HEIGHT " << new_height-1 << ", difficulty:\t" << current_diffic << std::endl << "block reward: " << print_money(fee_summary + base_reward) << "(" << print_money(base_reward) << " + " << print_money(fee_summary) << "), coinbase_blob_size: " << coinbase_blob_size << ", cumulative size: " << cumulative_block_size << ", " << block_processing_time << "(" << target_calculating_time << "/" << longhash_calculating_time << ")ms");
+  LOG_PRINT_L1("+++++ BLOCK SUCCESSFULLY ADDED" << std::endl << "id:\t" << id << std::endl << "PoW:\t" << proof_of_work << std::endl << "HEIGHT " << new_height-1 << ", difficulty:\t" << current_diffic << std::endl << "block reward: " << print_money(fee_summary + base_reward) << "(" << print_money(base_reward) << " + " << print_money(fee_summary) << "), coinbase_blob_size: " << coinbase_blob_size << ", cumulative size: " << cumulative_block_size << ", " << block_processing_time / 1000000 << "(" << target_calculating_time / 1000000 << "/" << longhash_calculating_time / 1000000 << ")ms");
   if(m_show_time_stats)
   {
     LOG_PRINT_L0("Height: " << new_height << " blob: " << coinbase_blob_size << " cumm: "
-        << cumulative_block_size << " p/t: " << block_processing_time << " ("
-        << target_calculating_time << "/" << longhash_calculating_time << "/"
-        << t1 << "/" << t2 << "/" << t3 << "/" << t_exists << "/" << t_pool
-        << "/" << t_checktx << "/" << t_dblspnd << "/" << vmt << "/" << addblock << ")ms");
-  }
+        << cumulative_block_size << " p/t: " << block_processing_time / 1000 << " ("
+        << target_calculating_time / 1000 << "/" << longhash_calculating_time / 1000 << "/"
+        << t1 / 1000 << "/" << t2 / 1000 << "/" << t3 / 1000 << "/" << t_exists / 1000 << "/" << t_pool / 1000
+        << "/" << t_checktx / 1000 << "/" << t_dblspnd / 1000 << "/" << vmt / 1000 << "/" << addblock / 1000 << ")us");
+  }
+
+  block_processing_stats::sample times;
+  times[bpp_difficulty] = target_calculating_time / 1000;
+  times[bpp_pow] = longhash_calculating_time / 1000;
+  times[bpp_tx_lookup] = t_exists / 1000;
+  times[bpp_pool] = t_pool / 1000;
+  times[bpp_tx_check] = t_checktx / 1000;
+  times[bpp_miner_tx] = vmt / 1000;
+  times[bpp_db_add] = addblock / 1000;
+  times[bpp_total] = (block_processing_time + addblock) / 1000;
+  m_block_processing_stats.add(times);
 
   bvc.m_added_to_main_chain = true;
   ++m_sync_counter;
+  m_events.publish(chain_events::block_added, id, new_height - 1);
 
   // appears to be a NOP *and* is called elsewhere.  wat?
   m_tx_pool.on_blockchain_inc(new_height, id);
@@ -3363,12 +4362,16 @@ bool Blockchain::add_new_block(const block& bl_, block_verification_context& bvc
     //chain switching or wrong block
     bvc.m_added_to_main_chain = false;
     m_db->block_txn_stop();
-    return handle_alternative_block(bl, id, bvc);
+    const bool r = handle_alternative_block(bl, id, bvc);
     //never relay alternative blocks
+    publish_chain_state();
+    return r;
   }
 
   m_db->block_txn_stop();
-  return handle_block_to_main_chain(bl, id, bvc);
+  const bool r = handle_block_to_main_chain(bl, id, bvc);
+  publish_chain_state();
+  return r;
 }
 //------------------------------------------------------------------
 //TODO: Refactor, consider returning a failure height and letting
@@ -3416,18 +4419,26 @@ bool Blockchain::update_checkpoints(const std::string& file_path, bool check_dns
   }
 
   // if we're checking both dns and json, load checkpoints from dns.
-  // if we're not hard-enforcing dns checkpoints, handle accordingly
-  if (m_enforce_dns_checkpoints && check_dns)
+  if (check_dns)
   {
-    if (!m_checkpoints.load_checkpoints_from_dns())
+    checkpoints dns_points;
+    dns_points.load_checkpoints_from_dns();
+    if (!add_dns_checkpoints(dns_points))
     {
       return false;
     }
   }
-  else if (check_dns)
+
+  check_against_checkpoints(m_checkpoints, true);
+
+  return true;
+}
+//------------------------------------------------------------------
+bool Blockchain::add_dns_checkpoints(const checkpoints& dns_points)
+{
+  // if we're not hard-enforcing dns checkpoints, only warn about them
+  if (!m_enforce_dns_checkpoints)
   {
-    checkpoints dns_points;
-    dns_points.load_checkpoints_from_dns();
     if (m_checkpoints.check_for_conflicts(dns_points))
     {
       check_against_checkpoints(dns_points, false);
@@ -3436,10 +4447,22 @@ bool Blockchain::update_checkpoints(const std::string& file_path, bool check_dns
     {
       LOG_PRINT_L0("One or more checkpoints fetched from DNS conflicted with existing checkpoints!");
     }
+    return true;
   }
 
+  {
+    CRITICAL_REGION_LOCAL(m_blockchain_lock);
+    if (!m_checkpoints.check_for_conflicts(dns_points))
+    {
+      LOG_ERROR("One or more checkpoints fetched from DNS conflicted with existing checkpoints!");
+      return false;
+    }
+    for (const auto& pt : dns_points.get_points())
+    {
+      m_checkpoints.add_checkpoint(pt.first, epee::string_tools::pod_to_hex(pt.second));
+    }
+  }
   check_against_checkpoints(m_checkpoints, true);
-
   return true;
 }
 //------------------------------------------------------------------
@@ -3449,20 +4472,33 @@ void Blockchain::set_enforce_dns_checkpoints(bool enforce_checkpoints)
 }
 
 //------------------------------------------------------------------
-void Blockchain::block_longhash_worker(const uint64_t height, const std::vector<block> &blocks, std::unordered_map<crypto::hash, crypto::hash> &map) const
+void Blockchain::block_longhash_worker(const uint64_t height, const std::vector<block> &blocks, std::atomic<size_t> &next_block, std::unordered_map<crypto::hash, crypto::hash> &map) const
 {
   TIME_MEASURE_START(t);
   slow_hash_allocate_state();
+  static std::atomic<bool> pages_reported(false);
+  if (!pages_reported.exchange(true))
+    LOG_PRINT_L0("Block hashing scratchpad uses " << slow_hash_state_pages());
 
-  //FIXME: height should be changing here, as get_block_longhash expects
-  //       the height of the block passed to it
-  for (const auto & block : blocks)
+  // blocks are claimed as many at a time as can be hashed together
+  const size_t ways = crypto::CN_SLOW_HASH_MAX_WAYS;
+  std::vector<const block*> group;
+  std::vector<uint64_t> heights;
+  std::vector<crypto::hash> pows;
+  for (size_t first = next_block.fetch_add(ways); first < blocks.size(); first = next_block.fetch_add(ways))
   {
     if (m_cancel)
-       return;
-    crypto::hash id = get_block_hash(block);
-    crypto::hash pow = get_block_longhash(block, height);
-    map.emplace(id, pow);
+      break;
+    group.clear();
+    heights.clear();
+    for (size_t i = first; i < std::min(first + ways, blocks.size()); ++i)
+    {
+      group.push_back(&blocks[i]);
+      heights.push_back(height + i);
+    }
+    get_block_longhashes(group, heights, pows);
+    for (size_t i = 0; i < group.size(); ++i)
+      map.emplace(get_block_hash(*group[i]), pows[i]);
   }
 
   slow_hash_free_state();
@@ -3478,7 +4514,15 @@ bool Blockchain::cleanup_handle_incoming_blocks(bool force_sync)
 
   if (m_sync_counter > 0)
   {
-    if (force_sync)
+    if (m_db_sync_mode == db_async)
+    {
+      // the db's flusher syncs when its policy says so, we only hurry it,
+      // never waiting for the sync here
+      if (force_sync)
+        m_db->request_flush();
+      m_sync_counter = 0;
+    }
+    else if (force_sync)
     {
       if(m_db_sync_mode != db_nosync)
         store_blockchain();
@@ -3486,14 +4530,10 @@ bool Blockchain::cleanup_handle_incoming_blocks(bool force_sync)
     }
     else if (m_db_blocks_per_sync && m_sync_counter >= m_db_blocks_per_sync)
     {
-      if(m_db_sync_mode == db_async)
-      {
-        m_sync_counter = 0;
-        m_async_service.dispatch(boost::bind(&Blockchain::store_blockchain, this));
-      }
-      else if(m_db_sync_mode == db_sync)
+      if(m_db_sync_mode == db_sync)
       {
         store_blockchain();
+        m_sync_counter = 0;
       }
       else // db_nosync
       {
@@ -3529,111 +4569,156 @@ void Blockchain::output_scan_worker(const uint64_t amount, const std::vector<uin
   }
 }
 
+//------------------------------------------------------------------
+void Blockchain::output_scan_bulk_worker(const std::vector<uint64_t> &amounts, const std::map<uint64_t, std::vector<uint64_t>> &offset_map, std::map<uint64_t, std::vector<output_data_t>> &tx_map) const
+{
+  // amounts are sorted, and so are the offsets of each, so this walks the
+  // output table in order
+  std::vector<std::pair<uint64_t, uint64_t>> offsets;
+  for (const uint64_t amount : amounts)
+    for (const uint64_t offset : offset_map.find(amount)->second)
+      offsets.push_back(std::make_pair(amount, offset));
+
+  std::vector<output_data_t> outputs;
+  try
+  {
+    m_db->get_output_keys_bulk(offsets, outputs);
+  }
+  catch (const std::exception& e)
+  {
+    LOG_PRINT_L1("EXCEPTION: " << e.what());
+    outputs.clear();
+  }
+  catch (...)
+  {
+    outputs.clear();
+  }
+
+  if (outputs.size() != offsets.size())
+  {
+    // one missing output fails the whole pass, so get the others per amount
+    std::unordered_map<crypto::hash, cryptonote::transaction> txs;
+    for (const uint64_t amount : amounts)
+      output_scan_worker(amount, offset_map.find(amount)->second, tx_map.find(amount)->second, txs);
+    return;
+  }
+
+  auto it = outputs.begin();
+  for (const uint64_t amount : amounts)
+  {
+    const size_t count = offset_map.find(amount)->second.size();
+    tx_map.find(amount)->second.assign(it, it + count);
+    it += count;
+  }
+}
+
 //------------------------------------------------------------------
 // ND: Speedups:
-// 1. Thread long_hash computations if possible (m_max_prepare_blocks_threads = nthreads, default = 4)
+// 1. Thread long_hash computations if possible (m_max_prepare_blocks_threads = nthreads, default = one per core)
 // 2. Group all amounts (from txs) and related absolute offsets and form a table of tx_prefix_hash
 //    vs [k_image, output_keys] (m_scan_table). This is faster because it takes advantage of bulk queries
 //    and is threaded if possible. The table (m_scan_table) will be used later when querying output
 //    keys.
-bool Blockchain::prepare_handle_incoming_blocks(const std::list<block_complete_entry> &blocks_entry)
+bool Blockchain::prepare_handle_incoming_blocks(const std::vector<block_complete_entry> &blocks_entry)
+{
+  return prepare_handle_incoming_blocks(blocks_entry, 0, blocks_entry.size());
+}
+//------------------------------------------------------------------
+size_t Blockchain::get_prepare_window(const std::vector<block_complete_entry> &blocks_entry, size_t first) const
+{
+  if (first >= blocks_entry.size())
+    return 0;
+  if (!m_max_prepare_blocks_bytes)
+    return blocks_entry.size() - first;
+
+  // the tables grow with the number of inputs and ring members, which the
+  // blob sizes follow closely enough without parsing everything once more
+  size_t count = 0;
+  uint64_t bytes = 0;
+  for (size_t i = first; i < blocks_entry.size(); ++i)
+  {
+    uint64_t entry_bytes = blocks_entry[i].block.size();
+    for (const auto &tx_blob : blocks_entry[i].txs)
+      entry_bytes += tx_blob.size();
+    if (count > 0 && bytes + entry_bytes > m_max_prepare_blocks_bytes)
+      break;
+    bytes += entry_bytes;
+    ++count;
+  }
+  return count;
+}
+//------------------------------------------------------------------
+bool Blockchain::prepare_handle_incoming_blocks(const std::vector<block_complete_entry> &blocks_entry, size_t first, size_t count)
 {
   LOG_PRINT_YELLOW("Blockchain::" << __func__, LOG_LEVEL_3);
   TIME_MEASURE_START(prepare);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
 
-  if(blocks_entry.size() == 0)
+  if(count == 0 || first + count > blocks_entry.size())
     return false;
 
-  if ((m_db->height() + blocks_entry.size()) < m_blocks_hash_check.size())
+  const auto window = boost::make_iterator_range(blocks_entry.begin() + first, blocks_entry.begin() + first + count);
+
+  if (in_trusted_hashes_zone(m_db->height() + count))
     return true;
 
   bool blocks_exist = false;
-  uint64_t threads = tools::get_max_concurrency();
+  uint64_t threads = m_verification_pool.count() + 1;
 
-  if (blocks_entry.size() > 1 && threads > 1 && m_max_prepare_blocks_threads > 1)
+  if (count > 1 && threads > 1 && m_max_prepare_blocks_threads != 1)
   {
-    // limit threads, default limit = 4
-    if(threads > m_max_prepare_blocks_threads)
+    // limit threads, by default only to the pool's size
+    if(m_max_prepare_blocks_threads && threads > m_max_prepare_blocks_threads)
       threads = m_max_prepare_blocks_threads;
+    if(threads > count)
+      threads = count;
 
     uint64_t height = m_db->height();
-    std::vector<boost::thread *> thread_list;
-    int batches = blocks_entry.size() / threads;
-    int extra = blocks_entry.size() % threads;
-    LOG_PRINT_L1("block_batches: " << batches);
-    std::vector<std::unordered_map<crypto::hash, crypto::hash>> maps(threads);
-    std::vector < std::vector < block >> blocks(threads);
-    auto it = blocks_entry.begin();
+    std::vector<block> blocks;
+    blocks.reserve(count);
 
-    for (uint64_t i = 0; i < threads; i++)
+    for (const auto &entry : window)
     {
-      for (int j = 0; j < batches; j++)
-      {
-        block block;
+      block block;
 
-        if (!parse_and_validate_block_from_blob(it->block, block))
-        {
-          std::advance(it, 1);
-          continue;
-        }
+      if (!parse_and_validate_block_from_blob(entry.block, block))
+        continue;
 
-        // check first block and skip all blocks if its not chained properly
-        if (i == 0 && j == 0)
-        {
-          crypto::hash tophash = m_db->top_block_hash();
-          if (block.prev_id != tophash)
-          {
-            LOG_PRINT_L1("Skipping prepare blocks. New blocks don't belong to chain.");
-            return true;
-          }
-        }
-        if (have_block(get_block_hash(block)))
+      // check first block and skip all blocks if its not chained properly
+      if (blocks.empty())
+      {
+        crypto::hash tophash = m_db->top_block_hash();
+        if (block.prev_id != tophash)
         {
-          blocks_exist = true;
-          break;
+          LOG_PRINT_L1("Skipping prepare blocks. New blocks don't belong to chain.");
+          return true;
         }
-
-        blocks[i].push_back(block);
-        std::advance(it, 1);
-      }
-    }
-
-    for (int i = 0; i < extra && !blocks_exist; i++)
-    {
-      block block;
-
-      if (!parse_and_validate_block_from_blob(it->block, block))
-      {
-        std::advance(it, 1);
-        continue;
       }
-
       if (have_block(get_block_hash(block)))
       {
         blocks_exist = true;
         break;
       }
 
-      blocks[i].push_back(block);
-      std::advance(it, 1);
+      blocks.push_back(std::move(block));
     }
 
     if (!blocks_exist)
     {
+      // blocks are handed out one at a time rather than in fixed slices, so
+      // no thread sits idle while another still has a backlog
+      LOG_PRINT_L1("prepare blocks: " << blocks.size() << " blocks on " << threads << " threads");
+      std::vector<std::unordered_map<crypto::hash, crypto::hash>> maps(threads);
+      std::atomic<size_t> next_block(0);
       m_blocks_longhash_table.clear();
-      for (uint64_t i = 0; i < threads; i++)
-      {
-        thread_list.push_back(new boost::thread(&Blockchain::block_longhash_worker, this, height + (i * batches), std::cref(blocks[i]), std::ref(maps[i])));
-      }
-
-      for (size_t j = 0; j < thread_list.size(); j++)
-      {
-        thread_list[j]->join();
-        delete thread_list[j];
-      }
-
-      thread_list.clear();
+      tools::task_region(m_verification_pool, [&] (tools::task_region_handle& region) {
+        for (uint64_t i = 0; i < threads; i++)
+        {
+          region.run([&, i] {
+            block_longhash_worker(height, blocks, next_block, maps[i]);
+          });
+        }
+      });
 
       if (m_cancel)
          return false;
@@ -3661,9 +4746,9 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::list<block_complete_e
   m_check_txin_table.clear();
 
   TIME_MEASURE_FINISH(prepare);
-  m_fake_pow_calc_time = prepare / blocks_entry.size();
+  m_fake_pow_calc_time = prepare / count;
 
-  if (blocks_entry.size() > 1 && threads > 1 && m_show_time_stats)
+  if (count > 1 && threads > 1 && m_show_time_stats)
     LOG_PRINT_L0("Prepare blocks took: " << prepare << " ms");
 
   TIME_MEASURE_START(scantable);
@@ -3683,7 +4768,7 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::list<block_complete_e
         } while(0); \
 
   // generate sorted tables for all amounts and absolute offsets
-  for (const auto &entry : blocks_entry)
+  for (const auto &entry : window)
   {
     if (m_cancel)
       return false;
@@ -3757,44 +4842,45 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::list<block_complete_e
   // [output] stores all transactions for each tx_out_index::hash found
   std::vector<std::unordered_map<crypto::hash, cryptonote::transaction>> transactions(amounts.size());
 
-  threads = tools::get_max_concurrency();
+  threads = m_verification_pool.count() + 1;
   if (!m_db->can_thread_bulk_indices())
     threads = 1;
 
   if (threads > 1)
   {
-    boost::asio::io_service ioservice;
-    boost::thread_group threadpool;
-    std::unique_ptr < boost::asio::io_service::work > work(new boost::asio::io_service::work(ioservice));
-
-    for (uint64_t i = 0; i < threads; i++)
-    {
-      threadpool.create_thread(boost::bind(&boost::asio::io_service::run, &ioservice));
-    }
-
-    for (size_t i = 0; i < amounts.size(); i++)
-    {
-      uint64_t amount = amounts[i];
-      ioservice.dispatch(boost::bind(&Blockchain::output_scan_worker, this, amount, std::cref(offset_map[amount]), std::ref(tx_map[amount]), std::ref(transactions[i])));
-    }
-
-    work.reset();
-    threadpool.join_all();
-    ioservice.stop();
+    // amounts with few offsets share a single DB pass, the others get a task each
+    std::vector<uint64_t> short_amounts;
+    tools::task_region(m_verification_pool, [&] (tools::task_region_handle& region) {
+      for (size_t i = 0; i < amounts.size(); i++)
+      {
+        uint64_t amount = amounts[i];
+        // operator[] may insert, so look the entries up before dispatching
+        const std::vector<uint64_t> *offsets = &offset_map[amount];
+        std::vector<output_data_t> *outputs = &tx_map[amount];
+        if (offsets->size() < BULK_OUTPUT_SCAN_MAX_OFFSETS)
+        {
+          short_amounts.push_back(amount);
+          continue;
+        }
+        region.run([&, i, amount, offsets, outputs] {
+          output_scan_worker(amount, *offsets, *outputs, transactions[i]);
+        });
+      }
+      if (!short_amounts.empty())
+        region.run([&] {
+          output_scan_bulk_worker(short_amounts, offset_map, tx_map);
+        });
+    });
   }
   else
   {
-    for (size_t i = 0; i < amounts.size(); i++)
-    {
-      uint64_t amount = amounts[i];
-      output_scan_worker(amount, offset_map[amount], tx_map[amount], transactions[i]);
-    }
+    output_scan_bulk_worker(amounts, offset_map, tx_map);
   }
 
   int total_txs = 0;
 
   // now generate a table for each tx_prefix and k_image hashes
-  for (const auto &entry : blocks_entry)
+  for (const auto &entry : window)
   {
     if (m_cancel)
       return false;
@@ -3857,12 +4943,62 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::list<block_complete_e
   return true;
 }
 
-void Blockchain::set_user_options(uint64_t maxthreads, uint64_t blocks_per_sync, blockchain_db_sync_mode sync_mode, bool fast_sync)
+void Blockchain::set_user_options(uint64_t maxthreads, uint64_t blocks_per_sync, blockchain_db_sync_mode sync_mode, bool fast_sync, uint64_t bytes_per_sync, uint64_t sync_interval)
 {
   m_db_sync_mode = sync_mode;
   m_fast_sync = fast_sync;
   m_db_blocks_per_sync = blocks_per_sync;
+  m_db_bytes_per_sync = bytes_per_sync;
+  m_db_sync_interval = sync_interval;
   m_max_prepare_blocks_threads = maxthreads;
+
+  // blockchain_import sets these after init, so apply them to the flusher
+  if (m_db)
+  {
+    m_db->stop_flusher();
+    if (m_db_sync_mode == db_async)
+      m_db->start_flusher(m_db_blocks_per_sync, m_db_bytes_per_sync, m_db_sync_interval * 1000);
+  }
+}
+
+void Blockchain::set_block_hashes_file(const std::string &path, const std::string &root)
+{
+  m_blocks_hash_file = path;
+  m_blocks_hash_file_root = root;
+}
+
+block_processing_stats Blockchain::get_block_processing_stats() const
+{
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  return m_block_processing_stats;
+}
+
+Blockchain::memory_stats Blockchain::get_memory_stats() const
+{
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  memory_stats stats;
+
+  // a parsed block takes about as much as its blob, the miner tx being most of it
+  stats.alt_blocks_count = m_alternative_chains.size() + m_invalid_blocks.size();
+  stats.alt_blocks_bytes = tools::unordered_container_bytes(m_alternative_chains) + tools::unordered_container_bytes(m_invalid_blocks);
+  for (const blocks_ext_by_hash *blocks: {&m_alternative_chains, &m_invalid_blocks})
+  {
+    for (const auto &i: *blocks)
+      stats.alt_blocks_bytes += i.second.bl.tx_hashes.capacity() * sizeof(crypto::hash) + get_object_blobsize(i.second.bl.miner_tx);
+  }
+
+  stats.scan_table_bytes = tools::unordered_container_bytes(m_scan_table) + tools::unordered_container_bytes(m_check_txin_table);
+  for (const auto &tx: m_scan_table)
+  {
+    stats.scan_table_bytes += tools::unordered_container_bytes(tx.second);
+    for (const auto &ki: tx.second)
+      stats.scan_table_bytes += tools::vector_bytes(ki.second);
+  }
+  for (const auto &tx: m_check_txin_table)
+    stats.scan_table_bytes += tools::unordered_container_bytes(tx.second);
+
+  stats.longhash_table_bytes = tools::unordered_container_bytes(m_blocks_longhash_table);
+  return stats;
 }
 
 HardFork::State Blockchain::get_hard_fork_state() const
@@ -3877,9 +5013,16 @@ bool Blockchain::get_hard_fork_voting_info(uint8_t version, uint32_t &window, ui
 
 std::map<uint64_t, std::tuple<uint64_t, uint64_t, uint64_t>> Blockchain:: get_output_histogram(const std::vector<uint64_t> &amounts, bool unlocked, uint64_t recent_cutoff) const
 {
+  read_region region(*this);
   return m_db->get_output_histogram(amounts, unlocked, recent_cutoff);
 }
 
+bool Blockchain::get_output_distribution(uint64_t amount, uint64_t from_height, uint64_t to_height, std::vector<uint64_t> &distribution, uint64_t &base) const
+{
+  read_region region(*this);
+  return m_db->get_output_distribution(amount, from_height, to_height, distribution, base);
+}
+
 void Blockchain::cancel()
 {
   m_cancel = true;
@@ -3888,45 +5031,142 @@ void Blockchain::cancel()
 #if defined(PER_BLOCK_CHECKPOINT)
 void Blockchain::load_compiled_in_block_hashes()
 {
-  if (m_fast_sync && get_blocks_dat_start(m_testnet) != nullptr)
+  if (!m_fast_sync)
+    return;
+
+  const crypto::hash *hashes = NULL;
+  uint64_t nblocks = 0;
+  if (get_blocks_dat_start(m_testnet) != nullptr && get_blocks_dat_size(m_testnet) > 4)
   {
-    if (get_blocks_dat_size(m_testnet) > 4)
+    const unsigned char *p = get_blocks_dat_start(m_testnet);
+    const uint32_t count = *p | ((*(p+1))<<8) | ((*(p+2))<<16) | ((*(p+3))<<24);
+    const size_t size_needed = 4 + count * sizeof(crypto::hash);
+    if (get_blocks_dat_size(m_testnet) >= size_needed)
     {
-      const unsigned char *p = get_blocks_dat_start(m_testnet);
-      const uint32_t nblocks = *p | ((*(p+1))<<8) | ((*(p+2))<<16) | ((*(p+3))<<24);
-      const size_t size_needed = 4 + nblocks * sizeof(crypto::hash);
-      if(nblocks > 0 && nblocks > m_db->height() && get_blocks_dat_size(m_testnet) >= size_needed)
-      {
-        LOG_PRINT_L0("Loading precomputed blocks: " << nblocks);
-        p += sizeof(uint32_t);
-        for (uint32_t i = 0; i < nblocks; i++)
-        {
-          crypto::hash hash;
-          memcpy(hash.data, p, sizeof(hash.data));
-          p += sizeof(hash.data);
-          m_blocks_hash_check.push_back(hash);
-        }
+      hashes = (const crypto::hash*)(p + sizeof(uint32_t));
+      nblocks = count;
+    }
+  }
 
-        // FIXME: clear tx_pool because the process might have been
-        // terminated and caused it to store txs kept by blocks.
-        // The core will not call check_tx_inputs(..) for these
-        // transactions in this case. Consequently, the sanity check
-        // for tx hashes will fail in handle_block_to_main_chain(..)
-        std::list<transaction> txs;
-        m_tx_pool.get_transactions(txs);
-
-        size_t blob_size;
-        uint64_t fee;
-        bool relayed;
-        transaction pool_tx;
-        for(const transaction &tx : txs)
-        {
-          crypto::hash tx_hash = get_transaction_hash(tx);
-          m_tx_pool.take_tx(tx_hash, pool_tx, blob_size, fee, relayed);
-        }
-      }
+  if (!m_blocks_hash_file.empty())
+  {
+    const crypto::hash *file_hashes;
+    uint64_t file_nblocks;
+    if (load_block_hashes_file(hashes, nblocks, file_hashes, file_nblocks) && file_nblocks > nblocks)
+    {
+      hashes = file_hashes;
+      nblocks = file_nblocks;
+    }
+  }
+
+  if(nblocks > 0 && nblocks > m_db->height())
+  {
+    LOG_PRINT_L0("Loading precomputed blocks: " << nblocks);
+    // the hashes are used in place, not copied
+    m_blocks_hash_check = hashes;
+    m_blocks_hash_check_count = nblocks;
+
+    // FIXME: clear tx_pool because the process might have been
+    // terminated and caused it to store txs kept by blocks.
+    // The core will not call check_tx_inputs(..) for these
+    // transactions in this case. Consequently, the sanity check
+    // for tx hashes will fail in handle_block_to_main_chain(..)
+    std::list<transaction> txs;
+    m_tx_pool.get_transactions(txs);
+
+    size_t blob_size;
+    uint64_t fee;
+    bool relayed;
+    transaction pool_tx;
+    for(const transaction &tx : txs)
+    {
+      crypto::hash tx_hash = get_transaction_hash(tx);
+      m_tx_pool.take_tx(tx_hash, pool_tx, blob_size, fee, relayed);
+    }
+  }
+}
+
+bool Blockchain::load_block_hashes_file(const crypto::hash *compiled_in, uint64_t compiled_in_count, const crypto::hash *&hashes, uint64_t &count)
+{
+  std::unique_ptr<boost::interprocess::file_mapping> mapping;
+  std::unique_ptr<boost::interprocess::mapped_region> region;
+  try
+  {
+    mapping.reset(new boost::interprocess::file_mapping(m_blocks_hash_file.c_str(), boost::interprocess::read_only));
+    region.reset(new boost::interprocess::mapped_region(*mapping, boost::interprocess::read_only));
+  }
+  catch (const std::exception &e)
+  {
+    LOG_ERROR("Failed to map block hashes file " << m_blocks_hash_file << ": " << e.what());
+    return false;
+  }
+
+  const unsigned char *p = (const unsigned char*)region->get_address();
+  const size_t size = region->get_size();
+  if (size < 4)
+  {
+    LOG_ERROR("Block hashes file " << m_blocks_hash_file << " is too short");
+    return false;
+  }
+  const uint32_t nblocks = *p | ((*(p+1))<<8) | ((*(p+2))<<16) | ((*(p+3))<<24);
+  if (nblocks == 0 || size < 4 + nblocks * sizeof(crypto::hash))
+  {
+    LOG_ERROR("Block hashes file " << m_blocks_hash_file << " is truncated");
+    return false;
+  }
+  const crypto::hash *file_hashes = (const crypto::hash*)(p + sizeof(uint32_t));
+
+  // tree hash chunks of the file in parallel, then the chunks' roots together
+  const size_t nchunks = (nblocks + BLOCK_HASHES_FILE_CHUNK_SIZE - 1) / BLOCK_HASHES_FILE_CHUNK_SIZE;
+  std::vector<crypto::hash> chunk_roots(nchunks);
+  tools::parallel_for(m_verification_pool, 0, nchunks, 1, [&] (size_t first, size_t last) {
+    for (size_t c = first; c < last; ++c)
+    {
+      const size_t start = c * BLOCK_HASHES_FILE_CHUNK_SIZE;
+      const size_t n = std::min<size_t>(BLOCK_HASHES_FILE_CHUNK_SIZE, nblocks - start);
+      crypto::tree_hash(file_hashes + start, n, chunk_roots[c]);
+    }
+    return true;
+  });
+  crypto::hash root;
+  crypto::tree_hash(chunk_roots.data(), chunk_roots.size(), root);
+  LOG_PRINT_L0("Block hashes file " << m_blocks_hash_file << " has " << nblocks << " blocks, root " << root);
+
+  if (!m_blocks_hash_file_root.empty())
+  {
+    crypto::hash expected_root;
+    if (!epee::string_tools::hex_to_pod(m_blocks_hash_file_root, expected_root))
+    {
+      LOG_ERROR("Invalid block hashes file root: " << m_blocks_hash_file_root);
+      return false;
+    }
+    if (root != expected_root)
+    {
+      LOG_ERROR("Block hashes file " << m_blocks_hash_file << " has root " << root << ", expected " << expected_root);
+      return false;
+    }
+  }
+
+  // it must agree with what is already trusted
+  if (compiled_in_count && memcmp(compiled_in, file_hashes, std::min<uint64_t>(compiled_in_count, nblocks) * sizeof(crypto::hash)))
+  {
+    LOG_ERROR("Block hashes file " << m_blocks_hash_file << " does not match the embedded block hashes");
+    return false;
+  }
+  for (const auto &point: m_checkpoints.get_points())
+  {
+    if (point.first < nblocks && file_hashes[point.first] != point.second)
+    {
+      LOG_ERROR("Block hashes file " << m_blocks_hash_file << " does not match the checkpoint at height " << point.first);
+      return false;
     }
   }
+
+  m_blocks_hash_mapping = std::move(mapping);
+  m_blocks_hash_region = std::move(region);
+  hashes = file_hashes;
+  count = nblocks;
+  return true;
 }
 #endif
 
@@ -37,7 +37,11 @@
 #include <boost/multi_index/hashed_index.hpp>
 #include <boost/multi_index/member.hpp>
 #include <boost/foreach.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
 #include <atomic>
+#include <deque>
 #include <unordered_map>
 #include <unordered_set>
 
@@ -45,9 +49,16 @@
 #include "string_tools.h"
 #include "cryptonote_basic.h"
 #include "common/util.h"
+#include "common/arena.h"
+#include "common/thread_group.h"
+#include "common/task_region.h"
 #include "cryptonote_protocol/cryptonote_protocol_defs.h"
 #include "rpc/core_rpc_server_commands_defs.h"
 #include "difficulty.h"
+#include "block_processing_stats.h"
+#include "chain_events.h"
+#include "output_key_cache.h"
+#include "tx_view.h"
 #include "cryptonote_core/cryptonote_format_utils.h"
 #include "verification_context.h"
 #include "crypto/hash.h"
@@ -87,6 +98,18 @@ namespace cryptonote
       std::vector<uint64_t> m_global_output_indexes;
     };
 
+    /**
+     * @brief a transaction stripped of its prunable data, as served to clients asking for it
+     */
+    struct pruned_tx_blob
+    {
+      crypto::hash tx_hash;
+      blobdata blob; //!< the prefix and ringct base
+      transaction tx; //!< parsed from blob, pruned
+      crypto::hash prunable_hash; //!< the hash of the prunable data, when has_prunable_hash
+      bool has_prunable_hash;
+    };
+
     /**
      * @brief container for passing a block and metadata about it on the blockchain
      */
@@ -99,6 +122,31 @@ namespace cryptonote
       uint64_t already_generated_coins; //!< the total coins minted after that block
     };
 
+    /**
+     * @brief the chain summary published on each change to the chain
+     */
+    struct chain_state
+    {
+      uint64_t height; //!< the blockchain height, one past the top block
+      crypto::hash top_hash; //!< the hash of the top block
+      difficulty_type difficulty; //!< the difficulty of the next block
+      difficulty_type cumulative_difficulty; //!< the accumulated difficulty after the top block
+      uint64_t tx_count; //!< the number of transactions in the chain, coinbases included
+      uint8_t hard_fork_version; //!< the current hard fork version
+      size_t alt_blocks_count; //!< the number of alternative blocks known
+    };
+
+    /**
+     * @brief estimated heap bytes of the Blockchain's in-memory containers
+     */
+    struct memory_stats
+    {
+      size_t alt_blocks_count; //!< blocks in m_alternative_chains and m_invalid_blocks
+      uint64_t alt_blocks_bytes; //!< their size
+      uint64_t scan_table_bytes; //!< m_scan_table and m_check_txin_table, while a sync batch is in progress
+      uint64_t longhash_table_bytes; //!< m_blocks_longhash_table, likewise
+    };
+
     /**
      * @brief Blockchain constructor
      *
@@ -154,7 +202,7 @@ namespace cryptonote
      *
      * @return false if start_offset > blockchain height, else true
      */
-    bool get_blocks(uint64_t start_offset, size_t count, std::list<block>& blocks, std::list<transaction>& txs) const;
+    bool get_blocks(uint64_t start_offset, size_t count, std::vector<block>& blocks, std::vector<transaction>& txs) const;
 
     /**
      * @brief get blocks from blocks based on start height and count
@@ -165,7 +213,7 @@ namespace cryptonote
      *
      * @return false if start_offset > blockchain height, else true
      */
-    bool get_blocks(uint64_t start_offset, size_t count, std::list<block>& blocks) const;
+    bool get_blocks(uint64_t start_offset, size_t count, std::vector<block>& blocks) const;
 
     /**
      * @brief compiles a list of all blocks stored as alternative chains
@@ -183,6 +231,72 @@ namespace cryptonote
      */
     size_t get_alternative_blocks_count() const;
 
+    /**
+     * @brief returns the thread pool used for signature checks, long hashes
+     * and output scans
+     *
+     * Exposed so its queue depth and busy time can be reported.
+     *
+     * @return the verification thread pool
+     */
+    const tools::thread_group& get_verification_pool() const { return m_verification_pool; }
+
+    /**
+     * @copydoc get_verification_pool
+     */
+    tools::thread_group& get_verification_pool() { return m_verification_pool; }
+
+    /**
+     * @brief returns the hit/miss counts and size of the ring member output cache
+     *
+     * @return the cache's stats
+     */
+    output_key_cache::stats get_output_key_cache_stats() const { return m_output_key_cache.get_stats(); }
+
+    /**
+     * @brief the state of the last database snapshot started
+     */
+    struct db_snapshot_status
+    {
+      bool running;
+      std::string path;
+      uint64_t written;  //!< bytes written so far
+      uint64_t total;    //!< bytes expected
+      std::string error; //!< why it failed, if it did
+    };
+
+    /**
+     * @brief starts writing a compacted copy of the database in the background
+     *
+     * See BlockchainDB::copy_snapshot. One copy runs at a time, while
+     * blocks keep being added; its progress is logged, and returned by
+     * get_db_snapshot_status.
+     *
+     * @param path the directory to write the copy in
+     * @param max_bytes_per_sec the most bytes written per second, 0 for no limit
+     * @param error return-by-reference the reason, if the copy was not started
+     *
+     * @return true if the copy was started
+     */
+    bool start_db_snapshot(const std::string &path, uint64_t max_bytes_per_sec, std::string &error);
+
+    /**
+     * @brief returns the state of the last database snapshot started
+     */
+    db_snapshot_status get_db_snapshot_status() const;
+
+    /**
+     * @brief pins the verification pool's threads to consecutive CPUs
+     *
+     * The long hash scratchpads are allocated by the pool's threads, so
+     * they end up local to the CPU doing the hashing.
+     *
+     * @param first_cpu the CPU for the pool's first thread
+     *
+     * @return false if any thread could not be pinned
+     */
+    bool set_verification_affinity(unsigned first_cpu) { return m_verification_pool.set_affinity(first_cpu); }
+
     /**
      * @brief gets a block's hash given a height
      *
@@ -218,7 +332,34 @@ namespace cryptonote
      *
      * @return false on erroneous blocks, else true
      */
-    bool prepare_handle_incoming_blocks(const std::list<block_complete_entry>  &blocks);
+    bool prepare_handle_incoming_blocks(const std::vector<block_complete_entry>  &blocks);
+
+    /**
+     * @brief performs the same preprocessing on a window of a group of incoming blocks
+     *
+     * The tables built are replaced by the next call, so a large group can be
+     * prepared and added a window at a time, each window still being looked
+     * up in bulk.
+     *
+     * @param blocks a list of incoming blocks
+     * @param first the index of the first block of the window
+     * @param count the number of blocks in the window
+     *
+     * @return false on erroneous blocks, else true
+     */
+    bool prepare_handle_incoming_blocks(const std::vector<block_complete_entry>  &blocks, size_t first, size_t count);
+
+    /**
+     * @brief gets how many blocks to prepare at once to stay within the memory cap
+     *
+     * @param blocks a list of incoming blocks
+     * @param first the index of the first block not yet prepared
+     *
+     * @return the size of the next window, at least one unless all blocks were prepared
+     *
+     * @note see set_prepare_blocks_max_bytes
+     */
+    size_t get_prepare_window(const std::vector<block_complete_entry>  &blocks, size_t first) const;
 
     /**
      * @brief incoming blocks post-processing, cleanup, and disk sync
@@ -261,6 +402,16 @@ namespace cryptonote
      */
     bool have_tx_keyimg_as_spent(const crypto::key_image &key_im) const;
 
+    /**
+     * @brief check if each of a list of key images is already spent on the blockchain
+     *
+     * plural version of have_tx_keyimg_as_spent, done in one db pass
+     *
+     * @param key_im the key images to search for
+     * @param spent return-by-reference whether each key image is spent, in input order
+     */
+    void have_tx_keyimgs_as_spent(const std::vector<crypto::key_image> &key_im, std::vector<bool> &spent) const;
+
     /**
      * @brief get the current height of the blockchain
      *
@@ -291,6 +442,21 @@ namespace cryptonote
      */
     difficulty_type get_difficulty_for_next_block();
 
+    /**
+     * @brief checks what can be checked of a block without its transactions
+     *
+     * The block must extend the main chain, and pass the version, timestamp,
+     * checkpoint, miner tx and proof of work checks done by add_new_block.
+     * The proof of work hash is then kept for add_new_block, as for the
+     * hashes prepared by prepare_handle_incoming_blocks.
+     *
+     * @param bl the block
+     * @param id the block's hash
+     *
+     * @return true if the block passes, otherwise false
+     */
+    bool check_block_header(const block& bl, const crypto::hash& id);
+
     /**
      * @brief adds a block to the blockchain
      *
@@ -324,6 +490,10 @@ namespace cryptonote
      * @param height return-by-reference tells the miner what height it's mining against
      * @param ex_nonce extra data to be added to the miner transaction's extra
      *
+     * The last template is kept, and handed out again with a fresh
+     * timestamp for the same address and extra data until the pool's
+     * template version changes.
+     *
      * @return true if block template filled in successfully, else false
      */
     bool create_block_template(block& b, const account_public_address& miner_address, difficulty_type& di, uint64_t& height, const blobdata& ex_nonce);
@@ -377,6 +547,38 @@ namespace cryptonote
      */
     bool find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, NOTIFY_RESPONSE_CHAIN_ENTRY::request& resp) const;
 
+    /**
+     * @brief gets the hashing blobs of blocks, ie. their headers
+     *
+     * A hashing blob is what a block's id and proof of work are computed
+     * from: the serialized block header, the tree root hash of the block's
+     * transactions and their count.
+     *
+     * @param block_ids the blocks to get the headers of
+     * @param headers return-by-reference the hashing blobs, in order
+     *
+     * @return false if any of the blocks is missing, otherwise true
+     */
+    bool get_block_hashing_blobs(const std::list<crypto::hash>& block_ids, std::vector<blobdata>& headers) const;
+
+    /**
+     * @brief checks a foreign chain entry's headers before downloading its blocks
+     *
+     * The entry must start at a block on our main chain. Each following
+     * header must chain onto the previous one and match its block id, and
+     * above the checkpoints its proof of work must meet the difficulty
+     * computed along the entry. Proof of work is checked on the
+     * verification threads.
+     *
+     * @param start_height the height of the first block in the entry
+     * @param block_ids the entry's block ids
+     * @param headers the corresponding hashing blobs
+     *
+     * @return false if any header is bad, true otherwise, or if the entry
+     * does not start on our main chain and so cannot be checked
+     */
+    bool verify_block_headers(uint64_t start_height, const std::list<crypto::hash>& block_ids, const std::vector<blobdata>& headers);
+
     /**
      * @brief find the most recent common point between ours and a foreign chain
      *
@@ -400,14 +602,14 @@ namespace cryptonote
      *
      * @param req_start_block if non-zero, specifies a start point (otherwise find most recent commonality)
      * @param qblock_ids the foreign chain's "short history" (see get_short_chain_history)
-     * @param blocks return-by-reference the blocks and their transactions
+     * @param blocks return-by-reference the blobs of the blocks and their transactions, as stored
      * @param total_height return-by-reference our current blockchain height
      * @param start_height return-by-reference the height of the first block returned
      * @param max_count the max number of blocks to get
      *
      * @return true if a block found in common or req_start_block specified, else false
      */
-    bool find_blockchain_supplement(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, std::list<std::pair<block, std::list<transaction> > >& blocks, uint64_t& total_height, uint64_t& start_height, size_t max_count) const;
+    bool find_blockchain_supplement(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, std::vector<std::pair<blobdata, std::vector<blobdata> > >& blocks, uint64_t& total_height, uint64_t& start_height, size_t max_count) const;
 
     /**
      * @brief retrieves a set of blocks and their transactions, and possibly other transactions
@@ -415,6 +617,8 @@ namespace cryptonote
      * the request object encapsulates a list of block hashes and a (possibly empty) list of
      * transaction hashes.  for each block hash, the block is fetched along with all of that
      * block's transactions.  Any transactions requested separately are fetched afterwards.
+     * Blocks and transactions are sent as stored, without being parsed and
+     * serialized again.
      *
      * @param arg the request
      * @param rsp return-by-reference the response to fill in
@@ -494,6 +698,24 @@ namespace cryptonote
      */
     bool store_blockchain();
 
+    /**
+     * @brief lets the BlockchainDB do housekeeping while the daemon is idle
+     *
+     * @return true
+     */
+    bool on_idle();
+
+    /**
+     * @brief picks up blocks another process wrote to a read only database
+     *
+     * Any blocks popped by the writer are reported as a reorg, new blocks
+     * as added blocks, and the caches following the chain are reset.
+     * Does nothing unless the database is open read only.
+     *
+     * @return true if the chain changed, otherwise false
+     */
+    bool refresh_from_db();
+
     /**
      * @brief validates a transaction's inputs
      *
@@ -512,6 +734,22 @@ namespace cryptonote
      */
     bool check_tx_inputs(transaction& tx, uint64_t& pmax_used_block_height, crypto::hash& max_used_block_id, tx_verification_context &tvc, bool kept_by_block = false);
 
+    /**
+     * @brief verifies the signatures of several transactions together
+     *
+     * The rings are read in a read_region, and the signature checks of all
+     * the transactions then run at once on the verification threads without
+     * the blockchain lock. Those passing are remembered as verified against
+     * the ring members read, so check_tx_inputs, which still has to be
+     * called, does not repeat the signature checks unless the chain it sees
+     * gives other members. Must not be called with the blockchain lock held.
+     *
+     * @param txs the transactions to check
+     *
+     * @return the number of transactions failing
+     */
+    size_t verify_tx_signatures(const std::vector<transaction*>& txs);
+
     /**
      * @brief get dynamic per kB fee for a given block size
      *
@@ -574,6 +812,15 @@ namespace cryptonote
      */
     uint64_t get_current_cumulative_blocksize_limit() const;
 
+    /**
+     * @brief gets the average size of recent blocks
+     *
+     * @param count the number of most recent blocks to average over
+     *
+     * @return the average block size in bytes, or 0 for an empty chain
+     */
+    uint64_t get_average_block_size(size_t count) const;
+
     /**
      * @brief checks if the blockchain is currently being stored
      *
@@ -584,6 +831,27 @@ namespace cryptonote
      */
     bool is_storing_blockchain()const{return m_is_blockchain_storing;}
 
+    /**
+     * @brief gets how many blocks were popped off the main chain so far
+     *
+     * Anything cached from the chain and keyed by height or hash must be
+     * dropped once this moves.  Read it before reading the chain.
+     *
+     * @return the number of blocks popped since startup
+     */
+    uint64_t get_popped_blocks_count() const { return m_popped_blocks; }
+
+    /**
+     * @brief gets the last published summary of the chain
+     *
+     * Never takes the blockchain lock, so pollers do not wait on block
+     * processing.  The fields are consistent with each other, but may
+     * trail a block being added right now.
+     *
+     * @return the chain state, or null before init
+     */
+    boost::shared_ptr<const chain_state> get_chain_state() const;
+
     /**
      * @brief gets the difficulty of the block with a given height
      *
@@ -623,6 +891,35 @@ namespace cryptonote
     template<class t_ids_container, class t_tx_container, class t_missed_container>
     bool get_transactions(const t_ids_container& txs_ids, t_tx_container& txs, t_missed_container& missed_txs) const;
 
+    /**
+     * @brief gets transaction blobs, as stored, based on a list of transaction hashes
+     *
+     * @tparam t_ids_container a standard-iterable container
+     * @tparam t_tx_container a standard-iterable container
+     * @tparam t_missed_container a standard-iterable container
+     * @param txs_ids a container of hashes for which to get the corresponding transactions
+     * @param txs return-by-reference a container to store result transaction blobs in
+     * @param missed_txs return-by-reference a container to store missed transactions in
+     *
+     * @return false if an unexpected exception occurs, else true
+     */
+    template<class t_ids_container, class t_tx_container, class t_missed_container>
+    bool get_transactions_blobs(const t_ids_container& txs_ids, t_tx_container& txs, t_missed_container& missed_txs) const;
+
+    /**
+     * @brief gets the prefix and ringct base of transactions, and the hash of the rest
+     *
+     * The blobs are cut where the base ends rather than parsed whole, and txs
+     * pruned in the db are found too, without their prunable hash.
+     *
+     * @param txs_ids the hashes of the transactions to get
+     * @param txs return-by-reference the transactions found, in the order asked for
+     * @param missed_txs return-by-reference the hashes of the transactions not found
+     *
+     * @return false if an unexpected exception occurs, else true
+     */
+    bool get_pruned_transactions_blobs(const std::vector<crypto::hash>& txs_ids, std::list<pruned_tx_blob>& txs, std::list<crypto::hash>& missed_txs) const;
+
 
     //debug functions
 
@@ -682,6 +979,21 @@ namespace cryptonote
      */
     bool update_checkpoints(const std::string& file_path, bool check_dns);
 
+    /**
+     * @brief applies checkpoints fetched from DNS
+     *
+     * The DNS lookups may take a while, so callers can do them without
+     * holding up anything else and hand the result over once it arrives.
+     * DNS checkpoints are added to the enforced set only if enforcing them
+     * is configured, otherwise the chain is just checked against them.
+     *
+     * @param dns_points the checkpoints fetched from DNS
+     *
+     * @return false if enforced DNS checkpoints conflict with the ones
+     *         already loaded, otherwise true
+     */
+    bool add_dns_checkpoints(const checkpoints& dns_points);
+
 
     // user options, must be called before calling init()
 
@@ -689,13 +1001,36 @@ namespace cryptonote
     /**
      * @brief sets various performance options
      *
-     * @param block_threads max number of threads when preparing blocks for addition
+     * @param block_threads max number of threads when preparing blocks for addition, 0 for no limit
      * @param blocks_per_sync number of blocks to cache before syncing to database
      * @param sync_mode the ::blockchain_db_sync_mode to use
      * @param fast_sync sync using built-in block hashes as trusted
+     * @param bytes_per_sync in async mode, also sync once this many bytes of blocks are unsynced, 0 for no limit
+     * @param sync_interval in async mode, also sync once a block has been unsynced this many seconds, 0 for no limit
      */
     void set_user_options(uint64_t block_threads, uint64_t blocks_per_sync,
-        blockchain_db_sync_mode sync_mode, bool fast_sync);
+        blockchain_db_sync_mode sync_mode, bool fast_sync,
+        uint64_t bytes_per_sync = 0, uint64_t sync_interval = 0);
+
+    /**
+     * @brief caps the incoming block data prepared at once
+     *
+     * @param max_bytes the most bytes of block and transaction blobs in a prepared window, 0 for no limit
+     */
+    void set_prepare_blocks_max_bytes(uint64_t max_bytes) { m_max_prepare_blocks_bytes = max_bytes; }
+
+    /**
+     * @brief sets a file of known block hashes to fast sync with
+     *
+     * The file is in the blocks.dat format blockchain_export writes. It is
+     * mapped rather than read in at init, and used instead of the compiled-in
+     * hashes when it covers more blocks and agrees with them and with the
+     * checkpoints.
+     *
+     * @param path the file, empty for none
+     * @param root the expected tree hash of the file's chunk roots, hex, empty to not check it
+     */
+    void set_block_hashes_file(const std::string &path, const std::string &root);
 
     /**
      * @brief set whether or not to show/print time statistics
@@ -704,6 +1039,33 @@ namespace cryptonote
      */
     void set_show_time_stats(bool stats) { m_show_time_stats = stats; }
 
+    /**
+     * @brief gets the per phase timings of the last blocks added to the main chain
+     *
+     * @return a copy of the stats, see block_processing_stats
+     */
+    block_processing_stats get_block_processing_stats() const;
+
+    /**
+     * @brief estimates the memory held by the alternative chains and the
+     * tables of the sync batch in progress
+     *
+     * @return the estimates, see memory_stats
+     */
+    memory_stats get_memory_stats() const;
+
+    /**
+     * @brief gets the journal of chain and pool changes
+     *
+     * Blocks joining or leaving the main chain and reorganizations are
+     * published by the Blockchain, transactions entering or leaving the
+     * pool by the pool.
+     *
+     * @return the journal, thread safe
+     */
+    chain_events& get_events() { return m_events; }
+    const chain_events& get_events() const { return m_events; }
+
     /**
      * @brief gets the hardfork voting state object
      *
@@ -776,6 +1138,13 @@ namespace cryptonote
      */
     std::map<uint64_t, std::tuple<uint64_t, uint64_t, uint64_t>> get_output_histogram(const std::vector<uint64_t> &amounts, bool unlocked, uint64_t recent_cutoff) const;
 
+    /**
+     * @brief return the cumulative number of outputs of an amount per block
+     *
+     * @copydetails BlockchainDB::get_output_distribution
+     */
+    bool get_output_distribution(uint64_t amount, uint64_t from_height, uint64_t to_height, std::vector<uint64_t> &distribution, uint64_t &base) const;
+
     /**
      * @brief perform a check on all key images in the blockchain
      *
@@ -834,20 +1203,43 @@ namespace cryptonote
         std::vector<output_data_t> &outputs, std::unordered_map<crypto::hash,
         cryptonote::transaction> &txs) const;
 
+    /**
+     * @brief get the outputs of several amounts in a single DB pass
+     *
+     * Falls back to output_scan_worker for each amount if any of the
+     * outputs can't be found.
+     *
+     * @param amounts the amounts, sorted
+     * @param offset_map the sorted indices (indexed to the amount) needed for each amount
+     * @param tx_map return-by-reference the outputs collected for each amount
+     */
+    void output_scan_bulk_worker(const std::vector<uint64_t> &amounts,
+        const std::map<uint64_t, std::vector<uint64_t>> &offset_map,
+        std::map<uint64_t, std::vector<output_data_t>> &tx_map) const;
+
     /**
      * @brief computes the "short" and "long" hashes for a set of blocks
      *
+     * Several workers can share the same blocks, each claiming the next
+     * few unhashed ones from next_block until none are left.
+     *
      * @param height the height of the first block
      * @param blocks the blocks to be hashed
+     * @param next_block index of the next block to be hashed
      * @param map return-by-reference the hashes for each block
      */
     void block_longhash_worker(const uint64_t height, const std::vector<block> &blocks,
-        std::unordered_map<crypto::hash, crypto::hash> &map) const;
+        std::atomic<size_t> &next_block, std::unordered_map<crypto::hash, crypto::hash> &map) const;
 
     void cancel();
 
   private:
 
+    /**
+     * @brief builds a new block template, see create_block_template
+     */
+    bool build_block_template(block& b, const account_public_address& miner_address, difficulty_type& di, uint64_t& height, const blobdata& ex_nonce);
+
     // TODO: evaluate whether or not each of these typedefs are left over from blockchain_storage
     typedef std::unordered_map<crypto::hash, size_t> blocks_by_id_index;
 
@@ -859,10 +1251,57 @@ namespace cryptonote
 
     typedef std::unordered_map<crypto::hash, block_extended_info> blocks_ext_by_hash;
 
+    typedef std::multimap<uint64_t, crypto::hash> hashes_by_height;
+
+    typedef std::unordered_multimap<crypto::hash, crypto::hash> hashes_by_parent;
+
     typedef std::unordered_map<crypto::hash, block> blocks_by_hash;
 
     typedef std::map<uint64_t, std::vector<std::pair<crypto::hash, size_t>>> outputs_container; //crypto::hash - tx hash, size_t - index of out in transaction
 
+    //! the public keys of one input's ring, from the current arena while verifying a block
+    typedef tools::arena_vector<rct::ctkey> ring_keys;
+
+    //! the rings of each of a transaction's inputs
+    typedef tools::arena_vector<ring_keys> tx_ring_keys;
+
+    /**
+     * @brief signature checks of a transaction, deferred to be run along with the rest of its block
+     */
+    struct tx_signature_check
+    {
+      const transaction* tx; //!< the transaction, must outlive the check
+      crypto::hash tx_prefix_hash; //!< the transaction prefix hash
+      tx_ring_keys pubkeys; //!< the public keys of each input's ring
+      std::vector<uint64_t> results; //!< one per input for v1 transactions, a single one for v2
+    };
+
+    /**
+     * @brief what a read-only query holds to see a consistent chain
+     *
+     * If the db can snapshot reads, this is a read snapshot for the calling
+     * thread, and blocks keep being added meanwhile. Otherwise it is the
+     * blockchain lock, as before.
+     *
+     * Code within one must only read the chain through m_db, or through
+     * get_chain_state. It must not take m_blockchain_lock, which a writer
+     * may hold while it waits for snapshots to end, nor touch anything else
+     * that lock guards, such as the alternative chains.
+     */
+    class read_region
+    {
+    public:
+      read_region(const Blockchain &blockchain);
+      ~read_region();
+
+    private:
+      read_region(const read_region&);
+      read_region& operator=(const read_region&);
+
+      const BlockchainDB *m_db;
+      epee::critical_section *m_lock;
+    };
+
 
     BlockchainDB* m_db;
 
@@ -876,31 +1315,91 @@ namespace cryptonote
 
     // metadata containers
     std::unordered_map<crypto::hash, std::unordered_map<crypto::key_image, std::vector<output_data_t>>> m_scan_table;
+    // ring members looked up outside of m_scan_table, mostly for pool txes
+    mutable output_key_cache m_output_key_cache;
+
+    // background database copy, see start_db_snapshot
+    boost::thread m_db_snapshot_thread;
+    db_snapshot_status m_db_snapshot;
+    mutable epee::critical_section m_db_snapshot_lock;
+    std::atomic<bool> m_db_snapshot_stop;
     std::unordered_map<crypto::hash, crypto::hash> m_blocks_longhash_table;
     std::unordered_map<crypto::hash, std::unordered_map<crypto::key_image, bool>> m_check_txin_table;
 
-    // SHA-3 hashes for each block and for fast pow checking
-    std::vector<crypto::hash> m_blocks_hash_check;
+    // transactions whose signatures were verified, by get_verified_tx_key, oldest first
+    std::unordered_set<crypto::hash> m_verified_txs;
+    std::deque<crypto::hash> m_verified_txs_order;
+
+    // SHA-3 hashes for each block and for fast pow checking, pointing into
+    // the compiled-in blocks.dat or into m_blocks_hash_region
+    const crypto::hash *m_blocks_hash_check;
+    uint64_t m_blocks_hash_check_count;
     std::vector<crypto::hash> m_blocks_txs_check;
 
+    // an external blocks.dat, see set_block_hashes_file
+    std::string m_blocks_hash_file;
+    std::string m_blocks_hash_file_root;
+    std::unique_ptr<boost::interprocess::file_mapping> m_blocks_hash_mapping;
+    std::unique_ptr<boost::interprocess::mapped_region> m_blocks_hash_region;
+
     blockchain_db_sync_mode m_db_sync_mode;
     bool m_fast_sync;
     bool m_show_time_stats;
+    block_processing_stats m_block_processing_stats;
+    chain_events m_events;
     uint64_t m_db_blocks_per_sync;
+    uint64_t m_db_bytes_per_sync;
+    uint64_t m_db_sync_interval;
     uint64_t m_max_prepare_blocks_threads;
+    uint64_t m_max_prepare_blocks_bytes;
     uint64_t m_fake_pow_calc_time;
     uint64_t m_fake_scan_time;
     uint64_t m_sync_counter;
-    std::vector<uint64_t> m_timestamps;
-    std::vector<difficulty_type> m_difficulties;
-    uint64_t m_timestamps_and_difficulties_height;
 
-    boost::asio::io_service m_async_service;
-    boost::thread_group m_async_pool;
-    std::unique_ptr<boost::asio::io_service::work> m_async_work_idle;
+    // metadata of the last TOP_BLOCKS_CACHE_SIZE main chain blocks, oldest
+    // first, so difficulty, size medians and timestamp checks need not go
+    // to the db for every block. Valid when m_top_blocks_height is the
+    // chain height (0 means it has not been filled yet).
+    struct top_block_metadata
+    {
+      uint64_t timestamp;
+      difficulty_type cumulative_difficulty;
+      size_t size;
+      uint64_t coins_generated;
+    };
+    mutable std::deque<top_block_metadata> m_top_blocks;
+    mutable uint64_t m_top_blocks_height;
+
+    // the difficulty window for the next block, following the chain like
+    // m_top_blocks. Valid when m_difficulty_window_height is the chain height.
+    difficulty_window m_difficulty_window;
+    uint64_t m_difficulty_window_height;
+
+    // hashes of the last main chain blocks seen in a read only database,
+    // oldest first, to find where the writer reorganized
+    std::deque<crypto::hash> m_followed_hashes;
+
+    // the last block template built, see create_block_template
+    struct block_template_cache
+    {
+      uint64_t version;  // the pool's template version when it was built, 0 if none
+      time_t built;
+      account_public_address miner_address;
+      blobdata ex_nonce;
+      block b;
+      difficulty_type diffic;
+      uint64_t height;
+    };
+    block_template_cache m_block_template;
+    epee::critical_section m_block_template_lock;
+
+    // long lived threads for ring signature checks, long hashes and output scans
+    tools::thread_group m_verification_pool;
 
     // all alternative chains
     blocks_ext_by_hash m_alternative_chains; // crypto::hash -> block_extended_info
+    hashes_by_height m_alternative_heights;  // height -> alternative block hash
+    hashes_by_parent m_alternative_children; // parent hash -> alternative block hash
 
     // some invalid blocks
     blocks_ext_by_hash m_invalid_blocks;     // crypto::hash -> block_extended_info
@@ -917,6 +1416,11 @@ namespace cryptonote
 
     std::atomic<bool> m_cancel;
 
+    std::atomic<uint64_t> m_popped_blocks;
+
+    //! set with boost::atomic_store by publish_chain_state, read with boost::atomic_load
+    boost::shared_ptr<const chain_state> m_chain_state;
+
     /**
      * @brief collects the keys for all outputs being "spent" as an input
      *
@@ -928,7 +1432,8 @@ namespace cryptonote
      * of the most recent block which contains an output used in the input set
      *
      * @tparam visitor_t a class encapsulating tx is unlocked and collect tx key
-     * @param tx_in_to_key a transaction input instance
+     * @param view the transaction's view
+     * @param tx_in_to_key the input in the view
      * @param vis an instance of the visitor to use
      * @param tx_prefix_hash the hash of the associated transaction_prefix
      * @param pmax_related_block_height return-by-pointer the height of the most recent block in the input set
@@ -937,7 +1442,7 @@ namespace cryptonote
      * @return false if any keys are not found or any inputs are not unlocked, otherwise true
      */
     template<class visitor_t>
-    inline bool scan_outputkeys_for_indexes(size_t tx_version, const txin_to_key& tx_in_to_key, visitor_t &vis, const crypto::hash &tx_prefix_hash, uint64_t* pmax_related_block_height = NULL) const;
+    inline bool scan_outputkeys_for_indexes(size_t tx_version, const tx_view& view, const tx_view::input& tx_in_to_key, visitor_t &vis, const crypto::hash &tx_prefix_hash, uint64_t* pmax_related_block_height = NULL) const;
 
     /**
      * @brief collect output public keys of a transaction input set
@@ -950,7 +1455,8 @@ namespace cryptonote
      * of the most recent block which contains an output used in the input set
      *
      * @param tx_version the transaction version
-     * @param txin the transaction input
+     * @param view the transaction's view
+     * @param txin the input in the view
      * @param tx_prefix_hash the transaction prefix hash, for caching organization
      * @param sig the input signature
      * @param output_keys return-by-reference the public keys of the outputs in the input set
@@ -959,7 +1465,7 @@ namespace cryptonote
      *
      * @return false if any output is not yet unlocked, or is missing, otherwise true
      */
-    bool check_tx_input(size_t tx_version,const txin_to_key& txin, const crypto::hash& tx_prefix_hash, const std::vector<crypto::signature>& sig, const rct::rctSig &rct_signatures, std::vector<rct::ctkey> &output_keys, uint64_t* pmax_related_block_height);
+    bool check_tx_input(size_t tx_version, const tx_view& view, const tx_view::input& txin, const crypto::hash& tx_prefix_hash, const std::vector<crypto::signature>& sig, const rct::rctSig &rct_signatures, ring_keys &output_keys, uint64_t* pmax_related_block_height);
 
     /**
      * @brief validate a transaction's inputs and their keys
@@ -973,15 +1479,74 @@ namespace cryptonote
      * of the most recent block which contains an output used in any input set
      *
      * Currently this function calls ring signature validation for each
-     * transaction.
+     * transaction, unless deferred is not NULL, in which case the signature
+     * checks are left to queue_tx_signatures and finish_tx_signatures.
+     * Signatures already verified against the same ring members are not
+     * checked again, so a transaction accepted to the pool is only fully
+     * verified once.
      *
      * @param tx the transaction to validate
      * @param tvc returned information about tx verification
      * @param pmax_related_block_height return-by-pointer the height of the most recent block in the input set
+     * @param deferred return-by-pointer the signature checks left to do
      *
      * @return false if any validation step fails, otherwise true
      */
-    bool check_tx_inputs(transaction& tx, tx_verification_context &tvc, uint64_t* pmax_used_block_height = NULL);
+    bool check_tx_inputs(transaction& tx, tx_verification_context &tvc, uint64_t* pmax_used_block_height = NULL, tx_signature_check* deferred = NULL);
+
+    /**
+     * @brief runs the signature checks deferred by check_tx_inputs
+     *
+     * The checks are spawned on the given region, so that the signatures of
+     * all transactions in a block are verified together rather than one
+     * transaction at a time. The results are only valid once the region
+     * has been joined.
+     *
+     * @param region the task region to spawn the checks on
+     * @param check the deferred checks, must outlive the region
+     */
+    void queue_tx_signatures(tools::task_region_handle& region, tx_signature_check& check);
+
+    /**
+     * @brief reads the rings of a transaction for its signature checks
+     *
+     * Only reads m_db, so it may be called in a read_region, and expands
+     * the RingCT signatures of a v2 transaction.
+     *
+     * @param tx the transaction
+     * @param check return-by-reference the checks, ready to be queued
+     *
+     * @return false if a ring member does not exist or the transaction is malformed, otherwise true
+     */
+    bool get_tx_signature_check(transaction& tx, tx_signature_check& check);
+
+    /**
+     * @brief collects the results of checks run by queue_tx_signatures
+     *
+     * @param check the joined checks
+     *
+     * @return false if any signature is invalid, otherwise true
+     */
+    bool finish_tx_signatures(const tx_signature_check& check);
+
+    /**
+     * @brief gets the key a transaction's verified signatures are cached under
+     *
+     * @param tx the transaction
+     * @param pubkeys the public keys of each input's ring
+     *
+     * @return a hash of the transaction hash and the ring members
+     */
+    crypto::hash get_verified_tx_key(const transaction& tx, const tx_ring_keys& pubkeys) const;
+
+    /**
+     * @brief remembers a transaction's signatures as verified
+     *
+     * The oldest entries are dropped when the cache is full.
+     *
+     * @param key the key from get_verified_tx_key
+     */
+    void add_verified_tx(const crypto::hash& key);
 
     /**
      * @brief performs a blockchain reorganization according to the longest chain rule
@@ -1004,6 +1569,61 @@ namespace cryptonote
      */
     block pop_block_from_blockchain();
 
+    /**
+     * @brief removes the most recent block from the blockchain, keeping its transactions
+     *
+     * Unlike pop_block_from_blockchain, the block's transactions are not
+     * returned to the tx_pool, and the size limit and the pool are not
+     * told about the new height, so several blocks can be popped and the
+     * caller do all of this once, see return_txs_to_pool.
+     *
+     * @param popped_txs return-by-reference the block's non-coinbase transactions are appended here
+     *
+     * @return the block removed
+     */
+    block pop_block_from_blockchain(std::vector<transaction>& popped_txs);
+
+    /**
+     * @brief returns transactions from popped blocks to the tx_pool
+     *
+     * Transactions still found in the blockchain are skipped.
+     *
+     * @param txs the transactions to return
+     * @param version the hard fork version to add them with
+     */
+    void return_txs_to_pool(std::vector<transaction>& txs, uint8_t version);
+
+    /**
+     * @brief adds a block to the alternative blocks storage and its indices
+     *
+     * @param id the block's hash
+     * @param bei the block
+     *
+     * @return an iterator to the stored block, or end() if it was already stored
+     */
+    blocks_ext_by_hash::iterator add_alternative_block(const crypto::hash& id, const block_extended_info& bei);
+
+    /**
+     * @brief removes a block from the alternative blocks storage and its indices
+     *
+     * @param it the block to remove
+     */
+    void remove_alternative_block(blocks_ext_by_hash::iterator it);
+
+    /**
+     * @brief removes all blocks from the alternative blocks storage
+     */
+    void clear_alternative_blocks();
+
+    /**
+     * @brief removes alternative blocks a checkpoint no longer allows to switch to
+     *
+     * Blocks are visited by height, lowest first, and each one dropped
+     * takes its descendants with it, since they could not be switched to
+     * either.
+     */
+    void prune_alternative_blocks();
+
     /**
      * @brief validate and add a new block to the end of the blockchain
      *
@@ -1113,14 +1733,49 @@ namespace cryptonote
      */
     void get_last_n_blocks_sizes(std::vector<size_t>& sz, size_t count) const;
 
+    /**
+     * @brief makes sure the recent block metadata cache matches the chain
+     *
+     * Reloads the cache from the db if it is not for the current height.
+     *
+     * @return the height of the first block in the cache
+     */
+    uint64_t load_top_blocks() const;
+
+    /**
+     * @brief appends a newly added main chain block to the recent block metadata cache
+     *
+     * @param new_height the chain height including the new block
+     * @param bl the block
+     * @param block_size the block's size
+     * @param cumulative_difficulty the block's cumulative difficulty
+     * @param coins_generated the total coins generated up to and including the block
+     */
+    void push_top_block(uint64_t new_height, const block& bl, size_t block_size, difficulty_type cumulative_difficulty, uint64_t coins_generated);
+
+    /**
+     * @brief removes the top block from the recent block metadata cache
+     *
+     * Call after the block was popped from the db.
+     */
+    void pop_top_block();
+
+    /**
+     * @brief publishes a fresh chain state for get_chain_state
+     *
+     * Call with the blockchain lock held, after the chain changed.
+     */
+    void publish_chain_state();
+
     /**
      * @brief adds the given output to the requested set of random outputs
      *
      * @param result_outs return-by-reference the set the output is to be added to
      * @param amount the output amount
      * @param i the output index (indexed to amount)
+     * @param data the output's data, as returned by BlockchainDB::get_output_key
      */
-    void add_out_to_get_random_outs(COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount& result_outs, uint64_t amount, size_t i) const;
+    void add_out_to_get_random_outs(COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount& result_outs, uint64_t amount, size_t i, const output_data_t& data) const;
 
     /**
      * @brief adds the given output to the requested set of random ringct outputs
@@ -1128,8 +1783,25 @@ namespace cryptonote
      * @param outs return-by-reference the set the output is to be added to
      * @param amount the output amount (0 for rct inputs)
      * @param i the rct output index
+     * @param data the output's data, as returned by BlockchainDB::get_output_key
      */
-    void add_out_to_get_rct_random_outs(std::list<COMMAND_RPC_GET_RANDOM_RCT_OUTPUTS::out_entry>& outs, uint64_t amount, size_t i) const;
+    void add_out_to_get_rct_random_outs(std::list<COMMAND_RPC_GET_RANDOM_RCT_OUTPUTS::out_entry>& outs, uint64_t amount, size_t i, const output_data_t& data) const;
+
+    /**
+     * @brief picks random unlocked outputs of the given amount
+     *
+     * Candidates are drawn from a triangular distribution over the outputs
+     * old enough to be spent, as many at a time as are still missing, and
+     * each round is looked up in a single sorted pass.  Candidates whose tx
+     * is still locked are skipped, until count outputs are picked or there
+     * are no candidates left.
+     *
+     * @param amount the output amount (0 for rct inputs)
+     * @param count how many outputs to pick
+     * @param indices return-by-reference the amount-specific indices picked
+     * @param outputs return-by-reference the picked outputs' data, in the same order
+     */
+    void pick_random_outputs(uint64_t amount, uint64_t count, std::vector<uint64_t>& indices, std::vector<output_data_t>& outputs) const;
 
     /**
      * @brief checks if a transaction is unlocked (its outputs spendable)
@@ -1250,7 +1922,7 @@ namespace cryptonote
      * @param result false if the ring signature is invalid, otherwise true
      */
     void check_ring_signature(const crypto::hash &tx_prefix_hash, const crypto::key_image &key_image,
-        const std::vector<rct::ctkey> &pubkeys, const std::vector<crypto::signature> &sig, uint64_t &result);
+        const ring_keys &pubkeys, const std::vector<crypto::signature> &sig, uint64_t &result);
 
     /**
      * @brief loads block hashes from compiled-in data set
@@ -1261,6 +1933,37 @@ namespace cryptonote
      */
     void load_compiled_in_block_hashes();
 
+    /**
+     * @brief maps and checks the file set by set_block_hashes_file
+     *
+     * The file is hashed in chunks on the verification pool and the
+     * chunks' tree hashes are hashed together into a root, checked against
+     * the expected one if it was given.
+     *
+     * @param compiled_in the compiled-in hashes, which the file must start with
+     * @param compiled_in_count the number of compiled-in hashes
+     * @param hashes return-by-reference the file's hashes
+     * @param count return-by-reference the number of hashes in the file
+     *
+     * @return true if the file can be used, false otherwise
+     */
+    bool load_block_hashes_file(const crypto::hash *compiled_in, uint64_t compiled_in_count, const crypto::hash *&hashes, uint64_t &count);
+
+    /**
+     * @brief checks whether a height is in the trusted hashes zone
+     *
+     * Blocks below the last known block hash are accepted when their hash
+     * matches the known one: their proof of work is not checked, and their
+     * transactions' inputs and signatures are not checked either, only
+     * their hashes against the block's. Syncing that far is then bound by
+     * I/O rather than by verification.
+     *
+     * @param height the height
+     *
+     * @return true if the height is below the last known block hash
+     */
+    bool in_trusted_hashes_zone(uint64_t height) const { return height < m_blocks_hash_check_count; }
+
     /**
      * @brief expands v2 transaction data from blockchain
      *
@@ -1268,6 +1971,6 @@ namespace cryptonote
      * can be reconstituted by the receiver. This function expands
      * that implicit data.
      */
-    bool expand_transaction_2(transaction &tx, const crypto::hash &tx_prefix_hash, const std::vector<std::vector<rct::ctkey>> &pubkeys);
+    bool expand_transaction_2(transaction &tx, const crypto::hash &tx_prefix_hash, const tx_ring_keys &pubkeys);
   };
 }  // namespace cryptonote
@@ -0,0 +1,104 @@
+// Copyright (c) 2014-2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <ctime>
+#include <boost/chrono/chrono.hpp>
+
+#include "chain_events.h"
+
+namespace cryptonote
+{
+  chain_events::chain_events(size_t max_kept):
+    m_max_kept(max_kept ? max_kept : 1),
+    m_seq((uint64_t)time(NULL) << 20)
+  {
+  }
+  //---------------------------------------------------------------
+  void chain_events::publish(event_type type, const crypto::hash &hash, uint64_t height)
+  {
+    {
+      boost::lock_guard<boost::mutex> lock(m_lock);
+      ++m_seq;
+      m_events.push_back({m_seq, type, hash, height});
+      if (m_events.size() > m_max_kept)
+        m_events.pop_front();
+    }
+    m_published.notify_all();
+  }
+  //---------------------------------------------------------------
+  bool chain_events::get_since(uint64_t since, std::vector<event> &events, size_t max_count) const
+  {
+    events.clear();
+    boost::lock_guard<boost::mutex> lock(m_lock);
+    if (since > m_seq)
+      return false;
+    if (since == m_seq)
+      return true;
+    // the event right after since must still be kept
+    if (m_events.empty() || m_events.front().seq > since + 1)
+      return false;
+
+    auto it = m_events.begin() + (since + 1 - m_events.front().seq);
+    size_t count = m_events.end() - it;
+    if (max_count && count > max_count)
+      count = max_count;
+    events.assign(it, it + count);
+    return true;
+  }
+  //---------------------------------------------------------------
+  uint64_t chain_events::get_last_seq() const
+  {
+    boost::lock_guard<boost::mutex> lock(m_lock);
+    return m_seq;
+  }
+  //---------------------------------------------------------------
+  uint64_t chain_events::wait(uint64_t since, unsigned timeout_seconds) const
+  {
+    boost::unique_lock<boost::mutex> lock(m_lock);
+    const boost::chrono::steady_clock::time_point deadline = boost::chrono::steady_clock::now() + boost::chrono::seconds(timeout_seconds);
+    while (m_seq == since)
+    {
+      if (m_published.wait_until(lock, deadline) == boost::cv_status::timeout)
+        break;
+    }
+    return m_seq;
+  }
+  //---------------------------------------------------------------
+  const char *chain_events::get_type_name(event_type type)
+  {
+    switch (type)
+    {
+      case block_added: return "block_added";
+      case block_removed: return "block_removed";
+      case reorg: return "reorg";
+      case tx_added: return "tx_added";
+      case tx_removed: return "tx_removed";
+      default: return "unknown";
+    }
+  }
+}
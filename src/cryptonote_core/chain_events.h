@@ -0,0 +1,110 @@
+// Copyright (c) 2014-2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include "crypto/hash.h"
+
+#define CHAIN_EVENTS_MAX_KEPT 10000
+
+namespace cryptonote
+{
+  /**
+   * @brief a journal of the latest changes to the chain and the pool
+   *
+   * Blockchain and tx_memory_pool publish to it as they change, and callers
+   * read back what happened after the last sequence number they saw, waiting
+   * for more if there is nothing new. Sequence numbers start from the time
+   * the journal was made, shifted up, so a number from a previous run is
+   * always older than anything kept and the caller knows to start over.
+   *
+   * Thread safe. Publishing takes only the journal's own lock, so it can be
+   * done under the Blockchain and pool locks.
+   */
+  class chain_events
+  {
+  public:
+    enum event_type
+    {
+      block_added,    //!< a block joined the main chain, height is its height
+      block_removed,  //!< the top block was popped, height is its height
+      reorg,          //!< an alternative chain became the main chain, hash is its top, height the split height
+      tx_added,       //!< a transaction entered the pool
+      tx_removed      //!< a transaction left the pool, mined or dropped
+    };
+
+    struct event
+    {
+      uint64_t seq;
+      event_type type;
+      crypto::hash hash;
+      uint64_t height;
+    };
+
+    explicit chain_events(size_t max_kept = CHAIN_EVENTS_MAX_KEPT);
+
+    void publish(event_type type, const crypto::hash &hash, uint64_t height = 0);
+
+    /**
+     * @brief gets the events after a given sequence number
+     *
+     * @param since the last sequence number the caller saw
+     * @param events return-by-reference the events after it, oldest first
+     * @param max_count the most events to return, 0 for no limit
+     *
+     * @return false if events after since were already dropped, or since is
+     *         from a previous run, otherwise true
+     */
+    bool get_since(uint64_t since, std::vector<event> &events, size_t max_count = 0) const;
+
+    //! the sequence number of the latest event
+    uint64_t get_last_seq() const;
+
+    /**
+     * @brief waits for an event after a given sequence number
+     *
+     * @return the sequence number of the latest event at the time of return
+     */
+    uint64_t wait(uint64_t since, unsigned timeout_seconds) const;
+
+    static const char *get_type_name(event_type type);
+
+  private:
+    const size_t m_max_kept;
+    uint64_t m_seq;
+    std::deque<event> m_events;  //!< the most recent events, oldest first
+    mutable boost::mutex m_lock;
+    mutable boost::condition_variable m_published;
+  };
+}
@@ -37,7 +37,6 @@ using namespace epee;
 #include "common/dns_utils.h"
 #include "include_base_utils.h"
 #include <sstream>
-#include <random>
 
 namespace
 {
@@ -240,47 +239,8 @@ namespace cryptonote
 							     , "testpoints.moneropulse.co"
     };
 
-    std::vector<std::vector<std::string> > records;
-    records.resize(dns_urls.size());
-
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<int> dis(0, dns_urls.size() - 1);
-    size_t first_index = dis(gen);
-
-    bool avail, valid;
-    size_t cur_index = first_index;
-    do
-    {
-      std::string url;
-      if (testnet)
-      {
-        url = testnet_dns_urls[cur_index];
-      }
-      else
-      {
-        url = dns_urls[cur_index];
-      }
-
-      records[cur_index] = tools::DNSResolver::instance().get_txt_record(url, avail, valid);
-      if (!avail)
-      {
-        records[cur_index].clear();
-        LOG_PRINT_L2("DNSSEC not available for checkpoint update at URL: " << url << ", skipping.");
-      }
-      if (!valid)
-      {
-        records[cur_index].clear();
-        LOG_PRINT_L2("DNSSEC validation failed for checkpoint update at URL: " << url << ", skipping.");
-      }
-
-      cur_index++;
-      if (cur_index == dns_urls.size())
-      {
-        cur_index = 0;
-      }
-      records[cur_index].clear();
-    } while (cur_index != first_index);
+    // all domains are queried at once, a slow or filtered one only costs the timeout once
+    const std::vector<std::vector<std::string> > records = tools::dns_utils::resolve_parallel(testnet ? testnet_dns_urls : dns_urls, tools::DNS_TYPE_TXT, true, CRYPTONOTE_DNS_TIMEOUT_MS);
 
     size_t num_valid_records = 0;
 
@@ -31,11 +31,55 @@
 #pragma once
 #include <unordered_set>
 #include <atomic>
+#include <deque>
+#include <memory>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
 #include "net/net_utils_base.h"
 #include "copyable_atomic.h"
+#include "crypto/hash.h"
+#include "cryptonote_config.h"
 
 namespace cryptonote
 {
+  // the most recent P2P_KNOWN_TXS_PER_PEER hashes inserted, the oldest are
+  // forgotten first. Thread safe, and copies of a connection context share it
+  class known_hashes
+  {
+  public:
+    known_hashes(): m_state(std::make_shared<state>()) {}
+
+    // returns whether the hash was known already, it is remembered either way
+    bool insert(const crypto::hash& hash)
+    {
+      boost::lock_guard<boost::mutex> lock(m_state->lock);
+      if (!m_state->hashes.insert(hash).second)
+        return true;
+      m_state->order.push_back(hash);
+      if (m_state->order.size() > P2P_KNOWN_TXS_PER_PEER)
+      {
+        m_state->hashes.erase(m_state->order.front());
+        m_state->order.pop_front();
+      }
+      return false;
+    }
+
+    bool contains(const crypto::hash& hash) const
+    {
+      boost::lock_guard<boost::mutex> lock(m_state->lock);
+      return m_state->hashes.count(hash) != 0;
+    }
+
+  private:
+    struct state
+    {
+      boost::mutex lock;
+      std::unordered_set<crypto::hash> hashes;
+      std::deque<crypto::hash> order;
+    };
+    std::shared_ptr<state> m_state;
+  };
 
   struct cryptonote_connection_context: public epee::net_utils::connection_context_base
   {
@@ -54,6 +98,18 @@ namespace cryptonote
     uint64_t m_remote_blockchain_height;
     uint64_t m_last_response_height;
     epee::copyable_atomic m_callback_request_count; //in debug purpose: problem with double callback rise
+    boost::posix_time::ptime m_last_request_time; //when the blocks we are waiting for were requested
+    uint64_t m_last_response_latency_ms = 0; //how long the last blocks request took to answer
+    double m_sync_rate = 0; //smoothed bytes per second of this peer's block responses
+    unsigned m_slow_strikes = 0; //sync checks in a row this peer was found too slow
+    unsigned m_early_relay_strikes = 0; //blocks with valid proof of work from this peer which failed verification
+    uint64_t m_verification_us = 0; //time spent checking the txs and blocks this peer sent
+    uint64_t m_serving_us = 0; //time spent answering this peer's chain and object requests
+    uint64_t m_useful_objects = 0; //new valid txs and blocks this peer sent
+    uint64_t m_window_verification_us = 0; //m_verification_us when the current cost window started
+    uint64_t m_window_useful_objects = 0; //m_useful_objects when the current cost window started
+    bool m_deprioritized = false; //over its verification budget this window, its txs are ignored
+    known_hashes m_known_txs; //blob hashes of the txes sent to or received from this peer
     //size_t m_score;  TODO: add score calculations
   };
 
@@ -33,6 +33,7 @@
 #include <boost/variant.hpp>
 #include <boost/functional/hash/hash.hpp>
 #include <vector>
+#include <atomic>
 #include <cstring>  // memcmp
 #include <sstream>
 #include "serialization/serialization.h"
@@ -60,6 +61,33 @@ namespace cryptonote
 
   typedef std::vector<crypto::signature> ring_signature;
 
+  // A value derived from the serialized form of a transaction or block,
+  // kept next to it so it needs computing only once. Copies carry it along.
+  template<typename T>
+  class cached_value
+  {
+  public:
+    cached_value(): m_valid(false) {}
+    cached_value(const cached_value &other): m_valid(false) { *this = other; }
+    cached_value &operator=(const cached_value &other)
+    {
+      if (other.valid())
+        set(other.get());
+      else
+        reset();
+      return *this;
+    }
+
+    bool valid() const { return m_valid.load(std::memory_order_acquire); }
+    const T &get() const { return m_value; }
+    void set(const T &value) const { m_value = value; m_valid.store(true, std::memory_order_release); }
+    void reset() { m_valid.store(false, std::memory_order_release); }
+
+  private:
+    mutable std::atomic<bool> m_valid;
+    mutable T m_value;
+  };
+
 
   /* outputs */
 
@@ -190,14 +218,30 @@ namespace cryptonote
     std::vector<std::vector<crypto::signature> > signatures; //count signatures  always the same as inputs count
     rct::rctSig rct_signatures;
 
+    // when set, the signatures (v1) or the prunable part of rct_signatures
+    // (v2) are absent, and are neither read nor written when serializing.
+    // The hash of a pruned transaction can't be computed from it.
+    bool pruned;
+
+    // the size of the blob this transaction was parsed from, and its hash
+    // once get_transaction_hash has computed it. Only transactions parsed
+    // from a blob keep these; code modifying one afterwards must call
+    // invalidate_hashes().
+    cached_value<crypto::hash> cached_hash;
+    cached_value<size_t> cached_blob_size;
+
     transaction();
     virtual ~transaction();
     void set_null();
+    void invalidate_hashes();
 
     BEGIN_SERIALIZE_OBJECT()
+      if (!W)
+        invalidate_hashes();
+
       FIELDS(*static_cast<transaction_prefix *>(this))
 
-      if (version == 1)
+      if (version == 1 && !pruned)
       {
         ar.tag("signatures");
         ar.begin_array();
@@ -228,7 +272,7 @@ namespace cryptonote
         }
         ar.end_array();
       }
-      else
+      else if (version != 1)
       {
         ar.tag("rct_signatures");
         if (!vin.empty())
@@ -237,7 +281,7 @@ namespace cryptonote
           bool r = rct_signatures.serialize_rctsig_base(ar, vin.size(), vout.size());
           if (!r || !ar.stream().good()) return false;
           ar.end_object();
-          if (rct_signatures.type != rct::RCTTypeNull)
+          if (rct_signatures.type != rct::RCTTypeNull && !pruned)
           {
             ar.tag("rctsig_prunable");
             ar.begin_object();
@@ -277,6 +321,15 @@ namespace cryptonote
     extra.clear();
     signatures.clear();
     rct_signatures.type = rct::RCTTypeNull;
+    pruned = false;
+    invalidate_hashes();
+  }
+
+  inline
+  void transaction::invalidate_hashes()
+  {
+    cached_hash.reset();
+    cached_blob_size.reset();
   }
 
   inline
@@ -320,7 +373,16 @@ namespace cryptonote
     transaction miner_tx;
     std::vector<crypto::hash> tx_hashes;
 
+    // same as for transaction: kept only for blocks parsed from a blob
+    cached_value<crypto::hash> cached_hash;
+    cached_value<size_t> cached_blob_size;
+
+    void invalidate_hashes() { cached_hash.reset(); cached_blob_size.reset(); }
+
     BEGIN_SERIALIZE_OBJECT()
+      if (!W)
+        invalidate_hashes();
+
       FIELDS(*static_cast<block_header *>(this))
       FIELD(miner_tx)
       FIELD(tx_hashes)
@@ -156,6 +156,8 @@ namespace boost
   template <class Archive>
   inline void serialize(Archive &a, cryptonote::transaction &x, const boost::serialization::version_type ver)
   {
+    if (Archive::is_loading::value)
+      x.invalidate_hashes();
     a & x.version;
     a & x.unlock_time;
     a & x.vin;
@@ -176,6 +178,8 @@ namespace boost
   template <class Archive>
   inline void serialize(Archive &a, cryptonote::block &b, const boost::serialization::version_type ver)
   {
+    if (Archive::is_loading::value)
+      b.invalidate_hashes();
     a & b.major_version;
     a & b.minor_version;
     a & b.timestamp;
@@ -32,18 +32,23 @@
 using namespace epee;
 
 #include <boost/foreach.hpp>
+#include <boost/chrono/chrono.hpp>
 #include <unordered_set>
 #include "cryptonote_core.h"
 #include "common/command_line.h"
 #include "common/util.h"
+#include "common/task_region.h"
 #include "warnings.h"
 #include "crypto/crypto.h"
+#include "crypto/cpu-features.h"
 #include "cryptonote_config.h"
 #include "cryptonote_format_utils.h"
 #include "misc_language.h"
+#include "profile_tools.h"
 #include <csignal>
 #include "cryptonote_core/checkpoints.h"
 #include "ringct/rctTypes.h"
+#include "ringct/rctSigs.h"
 #include "blockchain_db/blockchain_db.h"
 #include "blockchain_db/lmdb/db_lmdb.h"
 #if defined(BERKELEY_DB)
@@ -55,6 +60,44 @@ DISABLE_VS_WARNINGS(4355)
 namespace cryptonote
 {
 
+  //-----------------------------------------------------------------------------------------------
+  // says which crypto kernels this CPU got, and times each of them once, so
+  // that a slow node can be told apart from a node on slow code paths
+  static void log_crypto_kernels()
+  {
+    typedef boost::chrono::steady_clock clock;
+    const auto us_since = [](const clock::time_point &start) {
+      return boost::chrono::duration_cast<boost::chrono::microseconds>(clock::now() - start).count();
+    };
+
+    char features[128];
+    cpu_features_describe(cpu_features(), features, sizeof(features));
+    LOG_PRINT_L0("CPU features: " << features << "; slow hash: " << cn_slow_hash_kernel()
+        << ", keccak batch: " << keccak_batch_kernel() << ", field multiplication: " << fe_mul_kernel());
+
+    const std::vector<uint8_t> data(1024 * 64, 0x5a);
+    std::vector<crypto::hash> hashes(1024);
+    clock::time_point start = clock::now();
+    crypto::cn_slow_hash(data.data(), 76, hashes[0]);
+    const auto slow_hash_us = us_since(start);
+
+    start = clock::now();
+    crypto::cn_fast_hash_batch(data.data(), 64, hashes.size(), hashes.data());
+    const auto keccak_batch_us = us_since(start);
+
+    crypto::public_key pub;
+    crypto::secret_key sec;
+    crypto::generate_keys(pub, sec);
+    crypto::key_derivation derivation;
+    start = clock::now();
+    for (int i = 0; i < 16; ++i)
+      crypto::generate_key_derivation(pub, sec, derivation);
+    const auto derivation_us = us_since(start);
+
+    LOG_PRINT_L0("Crypto self-benchmark: slow hash " << slow_hash_us << " us, 1024 keccak "
+        << keccak_batch_us << " us, key derivation " << derivation_us / 16 << " us");
+  }
+
   //-----------------------------------------------------------------------------------------------
   core::core(i_cryptonote_protocol* pprotocol):
               m_mempool(m_blockchain_storage),
@@ -62,10 +105,13 @@ namespace cryptonote
               m_miner(this),
               m_miner_address(boost::value_initialized<account_public_address>()),
               m_starter_message_showed(false),
+              m_deferred_init_done(false),
               m_target_blockchain_height(0),
               m_checkpoints_path(""),
               m_last_dns_checkpoints_update(0),
-              m_last_json_checkpoints_update(0)
+              m_last_json_checkpoints_update(0),
+              m_early_block_relay(false),
+              m_db_follow(false)
   {
     set_cryptonote_protocol(pprotocol);
   }
@@ -92,23 +138,48 @@ namespace cryptonote
     m_blockchain_storage.set_enforce_dns_checkpoints(enforce_dns);
   }
   //-----------------------------------------------------------------------------------------------
-  bool core::update_checkpoints()
+  bool core::update_checkpoints(bool allow_dns)
   {
     if (m_testnet || m_fakechain) return true;
 
     if (m_checkpoints_updating.test_and_set()) return true;
 
     bool res = true;
-    if (time(NULL) - m_last_dns_checkpoints_update >= 3600)
+    const bool check_dns = allow_dns && time(NULL) - m_last_dns_checkpoints_update >= 3600;
+    if (check_dns || time(NULL) - m_last_json_checkpoints_update >= 600)
     {
-      res = m_blockchain_storage.update_checkpoints(m_checkpoints_path, true);
-      m_last_dns_checkpoints_update = time(NULL);
+      res = m_blockchain_storage.update_checkpoints(m_checkpoints_path, false);
       m_last_json_checkpoints_update = time(NULL);
     }
-    else if (time(NULL) - m_last_json_checkpoints_update >= 600)
+
+    if (res && check_dns)
     {
-      res = m_blockchain_storage.update_checkpoints(m_checkpoints_path, false);
-      m_last_json_checkpoints_update = time(NULL);
+      // the lookups may take up to CRYPTONOTE_DNS_TIMEOUT_MS, so they get a thread
+      // of their own, which keeps m_checkpoints_updating set until it's done
+      m_last_dns_checkpoints_update = time(NULL);
+      if (m_dns_checkpoints_thread.joinable())
+        m_dns_checkpoints_thread.join();
+      m_dns_checkpoints_thread = boost::thread([this]()
+      {
+        bool res = true;
+        try
+        {
+          checkpoints dns_points;
+          dns_points.load_checkpoints_from_dns();
+          res = m_blockchain_storage.add_dns_checkpoints(dns_points);
+        }
+        catch (const boost::thread_interrupted&)
+        {
+          LOG_PRINT_L1("DNS checkpoints lookup interrupted");
+        }
+        m_checkpoints_updating.clear();
+        if (!res)
+        {
+          LOG_ERROR("One or more checkpoints loaded from dns conflicted with existing checkpoints.");
+          graceful_exit();
+        }
+      });
+      return true;
     }
 
     m_checkpoints_updating.clear();
@@ -138,11 +209,24 @@ namespace cryptonote
     command_line::add_arg(desc, command_line::arg_dns_checkpoints);
     command_line::add_arg(desc, command_line::arg_db_type);
     command_line::add_arg(desc, command_line::arg_prep_blocks_threads);
+    command_line::add_arg(desc, command_line::arg_prep_blocks_max_mb);
+    command_line::add_arg(desc, command_line::arg_rct_verification_threads);
+    command_line::add_arg(desc, command_line::arg_verification_cpu_affinity);
+    command_line::add_arg(desc, command_line::arg_ring_member_cache_size);
     command_line::add_arg(desc, command_line::arg_fast_block_sync);
+    command_line::add_arg(desc, command_line::arg_fast_block_sync_file);
+    command_line::add_arg(desc, command_line::arg_fast_block_sync_file_root);
     command_line::add_arg(desc, command_line::arg_db_sync_mode);
+    command_line::add_arg(desc, command_line::arg_db_follow);
+    command_line::add_arg(desc, command_line::arg_db_sync_bytes);
+    command_line::add_arg(desc, command_line::arg_db_sync_interval);
     command_line::add_arg(desc, command_line::arg_show_time_stats);
+    command_line::add_arg(desc, command_line::arg_block_notify);
+    command_line::add_arg(desc, command_line::arg_max_txpool_size);
     command_line::add_arg(desc, command_line::arg_db_auto_remove_logs);
+    command_line::add_arg(desc, command_line::arg_db_prune_depth);
     command_line::add_arg(desc, command_line::arg_block_sync_size);
+    command_line::add_arg(desc, command_line::arg_early_block_relay);
   }
   //-----------------------------------------------------------------------------------------------
   bool core::handle_command_line(const boost::program_options::variables_map& vm)
@@ -190,12 +274,12 @@ namespace cryptonote
     return true;
   }
   //-----------------------------------------------------------------------------------------------
-  bool core::get_blocks(uint64_t start_offset, size_t count, std::list<block>& blocks, std::list<transaction>& txs) const
+  bool core::get_blocks(uint64_t start_offset, size_t count, std::vector<block>& blocks, std::vector<transaction>& txs) const
   {
     return m_blockchain_storage.get_blocks(start_offset, count, blocks, txs);
   }
   //-----------------------------------------------------------------------------------------------
-  bool core::get_blocks(uint64_t start_offset, size_t count, std::list<block>& blocks) const
+  bool core::get_blocks(uint64_t start_offset, size_t count, std::vector<block>& blocks) const
   {
     return m_blockchain_storage.get_blocks(start_offset, count, blocks);
   }  //-----------------------------------------------------------------------------------------------
@@ -250,16 +334,16 @@ namespace cryptonote
   //-----------------------------------------------------------------------------------------------
   bool core::init(const boost::program_options::variables_map& vm, const cryptonote::test_options *test_options)
   {
+    TIME_MEASURE_START(init_time);
     m_fakechain = test_options != NULL;
     bool r = handle_command_line(vm);
 
-    r = m_mempool.init(m_fakechain ? std::string() : m_config_folder);
-    CHECK_AND_ASSERT_MES(r, false, "Failed to initialize memory pool");
+    if (!m_fakechain)
+      log_crypto_kernels();
 
-    std::string db_type = command_line::get_arg(vm, command_line::arg_db_type);
-    std::string db_sync_mode = command_line::get_arg(vm, command_line::arg_db_sync_mode);
-    bool fast_sync = command_line::get_arg(vm, command_line::arg_fast_block_sync) != 0;
-    uint64_t blocks_threads = command_line::get_arg(vm, command_line::arg_prep_blocks_threads);
+    const size_t max_txpool_size = command_line::get_arg(vm, command_line::arg_max_txpool_size);
+    rct::set_verification_threads(command_line::get_arg(vm, command_line::arg_rct_verification_threads));
+    crypto::set_ring_member_cache_size(command_line::get_arg(vm, command_line::arg_ring_member_cache_size));
 
     boost::filesystem::path folder(m_config_folder);
     if (m_fakechain)
@@ -290,6 +374,71 @@ namespace cryptonote
     // folder might not be a directory, etc, etc
     catch (...) { }
 
+    const int32_t verification_cpu = command_line::get_arg(vm, command_line::arg_verification_cpu_affinity);
+    if (verification_cpu >= 0 && !m_blockchain_storage.set_verification_affinity(verification_cpu))
+      LOG_PRINT_L0("Failed to pin all verification threads to CPUs");
+
+    // the pool state file does not depend on the blockchain, so it is read
+    // while the database opens and the Blockchain initializes
+    bool mempool_loaded = false, blockchain_loaded = false;
+    tools::task_region(m_blockchain_storage.get_verification_pool(), [&] (tools::task_region_handle& region) {
+      region.run([&] {
+        TIME_MEASURE_START(mempool_time);
+        mempool_loaded = m_mempool.init(m_fakechain ? std::string() : m_config_folder, max_txpool_size);
+        TIME_MEASURE_FINISH(mempool_time);
+        LOG_PRINT_L0("Start-up: memory pool loaded in " << mempool_time << " ms");
+      });
+      blockchain_loaded = init_blockchain(vm, folder, test_options);
+    });
+    CHECK_AND_ASSERT_MES(mempool_loaded, false, "Failed to initialize memory pool");
+    r = blockchain_loaded;
+
+    // now that we have a valid m_blockchain_storage, we can clean out any
+    // transactions in the pool that do not conform to the current fork;
+    // checking their signatures waits until the daemon runs, see deferred_init
+    m_mempool.validate(m_blockchain_storage.get_current_hard_fork_version());
+
+    bool show_time_stats = command_line::get_arg(vm, command_line::arg_show_time_stats) != 0;
+    m_blockchain_storage.set_show_time_stats(show_time_stats);
+    CHECK_AND_ASSERT_MES(r, false, "Failed to initialize blockchain storage");
+
+    m_block_notify = command_line::get_arg(vm, command_line::arg_block_notify);
+    m_last_notified_block = m_blockchain_storage.get_tail_id();
+
+    block_sync_size = command_line::get_arg(vm, command_line::arg_block_sync_size);
+    m_early_block_relay = command_line::get_arg(vm, command_line::arg_early_block_relay);
+
+    // load json checkpoints, and verify them with respect to what blocks we
+    // already have; dns ones are fetched once the daemon runs
+    TIME_MEASURE_START(checkpoints_time);
+    CHECK_AND_ASSERT_MES(update_checkpoints(false), false, "One or more checkpoints loaded from json conflicted with existing checkpoints.");
+    TIME_MEASURE_FINISH(checkpoints_time);
+    LOG_PRINT_L0("Start-up: json checkpoints loaded in " << checkpoints_time << " ms");
+
+    r = m_miner.init(vm, m_testnet);
+    CHECK_AND_ASSERT_MES(r, false, "Failed to initialize miner instance");
+
+    r = load_state_data();
+    TIME_MEASURE_FINISH(init_time);
+    LOG_PRINT_L0("Start-up: core initialized in " << init_time << " ms");
+    return r;
+  }
+  //-----------------------------------------------------------------------------------------------
+  bool core::init_blockchain(const boost::program_options::variables_map& vm, boost::filesystem::path folder, const cryptonote::test_options *test_options)
+  {
+    std::string db_type = command_line::get_arg(vm, command_line::arg_db_type);
+    std::string db_sync_mode = command_line::get_arg(vm, command_line::arg_db_sync_mode);
+    const std::string db_follow = command_line::get_arg(vm, command_line::arg_db_follow);
+    m_db_follow = !db_follow.empty();
+    if (m_db_follow && db_type != "lmdb")
+    {
+      LOG_ERROR("Only lmdb databases can be followed");
+      return false;
+    }
+    bool fast_sync = command_line::get_arg(vm, command_line::arg_fast_block_sync) != 0;
+    uint64_t blocks_threads = command_line::get_arg(vm, command_line::arg_prep_blocks_threads);
+
+    TIME_MEASURE_START(db_time);
     BlockchainDB* db = nullptr;
     uint64_t DBS_FAST_MODE = 0;
     uint64_t DBS_FASTEST_MODE = 0;
@@ -319,7 +468,11 @@ namespace cryptonote
       return false;
     }
 
-    folder /= db->get_db_name();
+    // a follower opens another daemon's database, which it never writes
+    if (m_db_follow)
+      folder = db_follow;
+    else
+      folder /= db->get_db_name();
     LOG_PRINT_L0("Loading blockchain from folder " << folder.string() << " ...");
 
     const std::string filename = folder.string();
@@ -382,6 +535,18 @@ namespace cryptonote
 
       bool auto_remove_logs = command_line::get_arg(vm, command_line::arg_db_auto_remove_logs) != 0;
       db->set_auto_remove_logs(auto_remove_logs);
+      uint64_t prune_depth = command_line::get_arg(vm, command_line::arg_db_prune_depth);
+      if (prune_depth > 0 && prune_depth < CRYPTONOTE_PRUNING_MIN_DEPTH)
+      {
+        LOG_ERROR("Pruning depth must be at least " << CRYPTONOTE_PRUNING_MIN_DEPTH);
+        return false;
+      }
+      db->set_pruning_depth(prune_depth);
+      if (m_db_follow)
+      {
+        db_flags |= MDB_RDONLY;
+        sync_mode = db_nosync;
+      }
       db->open(filename, db_flags);
       if(!db->m_open)
         return false;
@@ -392,31 +557,22 @@ namespace cryptonote
       return false;
     }
 
-    m_blockchain_storage.set_user_options(blocks_threads,
-        blocks_per_sync, sync_mode, fast_sync);
+    TIME_MEASURE_FINISH(db_time);
+    LOG_PRINT_L0("Start-up: database opened in " << db_time << " ms");
 
-    r = m_blockchain_storage.init(db, m_testnet, test_options);
-
-    // now that we have a valid m_blockchain_storage, we can clean out any
-    // transactions in the pool that do not conform to the current fork
-    m_mempool.validate(m_blockchain_storage.get_current_hard_fork_version());
-
-    bool show_time_stats = command_line::get_arg(vm, command_line::arg_show_time_stats) != 0;
-    m_blockchain_storage.set_show_time_stats(show_time_stats);
-    CHECK_AND_ASSERT_MES(r, false, "Failed to initialize blockchain storage");
-
-    block_sync_size = command_line::get_arg(vm, command_line::arg_block_sync_size);
-    if (block_sync_size == 0)
-      block_sync_size = BLOCKS_SYNCHRONIZING_DEFAULT_COUNT;
-
-    // load json & DNS checkpoints, and verify them
-    // with respect to what blocks we already have
-    CHECK_AND_ASSERT_MES(update_checkpoints(), false, "One or more checkpoints loaded from json or dns conflicted with existing checkpoints.");
-
-    r = m_miner.init(vm, m_testnet);
-    CHECK_AND_ASSERT_MES(r, false, "Failed to initialize miner instance");
-
-    return load_state_data();
+    m_blockchain_storage.set_user_options(blocks_threads,
+        blocks_per_sync, sync_mode, fast_sync,
+        command_line::get_arg(vm, command_line::arg_db_sync_bytes),
+        command_line::get_arg(vm, command_line::arg_db_sync_interval));
+    m_blockchain_storage.set_prepare_blocks_max_bytes(command_line::get_arg(vm, command_line::arg_prep_blocks_max_mb) * 1024 * 1024);
+    m_blockchain_storage.set_block_hashes_file(command_line::get_arg(vm, command_line::arg_fast_block_sync_file),
+        command_line::get_arg(vm, command_line::arg_fast_block_sync_file_root));
+
+    TIME_MEASURE_START(blockchain_time);
+    const bool r = m_blockchain_storage.init(db, m_testnet, test_options);
+    TIME_MEASURE_FINISH(blockchain_time);
+    LOG_PRINT_L0("Start-up: blockchain initialized in " << blockchain_time << " ms");
+    return r;
   }
   //-----------------------------------------------------------------------------------------------
   bool core::set_genesis_block(const block& b)
@@ -432,6 +588,9 @@ namespace cryptonote
   //-----------------------------------------------------------------------------------------------
     bool core::deinit()
   {
+    m_dns_checkpoints_thread.interrupt();
+    if (m_dns_checkpoints_thread.joinable())
+      m_dns_checkpoints_thread.join();
     m_miner.stop();
     m_mempool.deinit();
     m_blockchain_storage.deinit();
@@ -465,11 +624,9 @@ namespace cryptonote
     return false;
   }
   //-----------------------------------------------------------------------------------------------
-  bool core::handle_incoming_tx(const blobdata& tx_blob, tx_verification_context& tvc, bool keeped_by_block, bool relayed)
+  bool core::handle_incoming_tx_pre(const blobdata& tx_blob, tx_verification_context& tvc, transaction& tx, crypto::hash& tx_hash, crypto::hash& tx_prefixt_hash, bool keeped_by_block) const
   {
     tvc = boost::value_initialized<tx_verification_context>();
-    //want to process all transactions sequentially
-    CRITICAL_REGION_LOCAL(m_incoming_tx_lock);
 
     if(tx_blob.size() > get_max_tx_size())
     {
@@ -479,9 +636,8 @@ namespace cryptonote
       return false;
     }
 
-    crypto::hash tx_hash = null_hash;
-    crypto::hash tx_prefixt_hash = null_hash;
-    transaction tx;
+    tx_hash = null_hash;
+    tx_prefixt_hash = null_hash;
 
     if(!parse_tx_from_blob(tx, tx_hash, tx_prefixt_hash, tx_blob))
     {
@@ -513,8 +669,11 @@ namespace cryptonote
       tvc.m_verifivation_failed = true;
       return false;
     }
-
-    bool r = add_new_tx(tx, tx_hash, tx_prefixt_hash, tx_blob.size(), tvc, keeped_by_block, relayed);
+    return true;
+  }
+  //-----------------------------------------------------------------------------------------------
+  void core::handle_incoming_tx_post(const crypto::hash& tx_hash, const tx_verification_context& tvc) const
+  {
     if(tvc.m_verifivation_failed)
     {LOG_PRINT_RED_L1("Transaction verification failed: " << tx_hash);}
     else if(tvc.m_verifivation_impossible)
@@ -522,9 +681,92 @@ namespace cryptonote
 
     if(tvc.m_added_to_pool)
       LOG_PRINT_L1("tx added: " << tx_hash);
+  }
+  //-----------------------------------------------------------------------------------------------
+  bool core::handle_incoming_tx(const blobdata& tx_blob, tx_verification_context& tvc, bool keeped_by_block, bool relayed)
+  {
+    //want to process all transactions sequentially
+    CRITICAL_REGION_LOCAL(m_incoming_tx_lock);
+
+    crypto::hash tx_hash, tx_prefixt_hash;
+    transaction tx;
+    if (!handle_incoming_tx_pre(tx_blob, tvc, tx, tx_hash, tx_prefixt_hash, keeped_by_block))
+      return false;
+
+    bool r = add_new_tx(tx, tx_hash, tx_prefixt_hash, tx_blob.size(), tvc, keeped_by_block, relayed);
+    handle_incoming_tx_post(tx_hash, tvc);
     return r;
   }
   //-----------------------------------------------------------------------------------------------
+  bool core::handle_incoming_txs(const std::list<blobdata>& tx_blobs, std::vector<tx_verification_context>& tvc, bool keeped_by_block, bool relayed)
+  {
+    //want to process all transactions sequentially
+    CRITICAL_REGION_LOCAL(m_incoming_tx_lock);
+
+    // parse, hash and check each transaction on the verification threads
+    const size_t n_txs = tx_blobs.size();
+    std::vector<transaction> txs(n_txs);
+    std::vector<crypto::hash> tx_hashes(n_txs), tx_prefix_hashes(n_txs);
+    std::vector<size_t> blob_sizes(n_txs);
+    std::unique_ptr<bool[]> parsed(new bool[n_txs]);
+    tvc.assign(n_txs, boost::value_initialized<tx_verification_context>());
+    tools::task_region(m_blockchain_storage.get_verification_pool(), [&] (tools::task_region_handle& region) {
+      size_t i = 0;
+      for (const blobdata& tx_blob : tx_blobs)
+      {
+        region.run([&, i] {
+          parsed[i] = handle_incoming_tx_pre(tx_blob, tvc[i], txs[i], tx_hashes[i], tx_prefix_hashes[i], keeped_by_block);
+        });
+        blob_sizes[i] = tx_blob.size();
+        ++i;
+      }
+    });
+
+    // as add_new_tx, skip those already known, and repeats within the batch
+    std::vector<transaction> new_txs;
+    std::vector<crypto::hash> new_tx_hashes;
+    std::vector<size_t> new_blob_sizes;
+    std::vector<size_t> new_indices;
+    std::unordered_set<crypto::hash> seen;
+    for (size_t i = 0; i < n_txs; ++i)
+    {
+      if (!parsed[i] || !seen.insert(tx_hashes[i]).second)
+        continue;
+      if (m_mempool.have_tx(tx_hashes[i]))
+      {
+        LOG_PRINT_L2("tx " << tx_hashes[i] << "already have transaction in tx_pool");
+        continue;
+      }
+      if (m_blockchain_storage.have_tx(tx_hashes[i]))
+      {
+        LOG_PRINT_L2("tx " << tx_hashes[i] << " already have transaction in blockchain");
+        continue;
+      }
+      new_txs.push_back(std::move(txs[i]));
+      new_tx_hashes.push_back(tx_hashes[i]);
+      new_blob_sizes.push_back(blob_sizes[i]);
+      new_indices.push_back(i);
+    }
+
+    if (!new_txs.empty())
+    {
+      std::vector<tx_verification_context> new_tvc(new_txs.size(), boost::value_initialized<tx_verification_context>());
+      uint8_t version = m_blockchain_storage.get_current_hard_fork_version();
+      m_mempool.add_txs(new_txs, new_tx_hashes, new_blob_sizes, new_tvc, keeped_by_block, relayed, version);
+      for (size_t n = 0; n < new_indices.size(); ++n)
+      {
+        tvc[new_indices[n]] = new_tvc[n];
+        handle_incoming_tx_post(new_tx_hashes[n], new_tvc[n]);
+      }
+    }
+
+    bool ok = true;
+    for (size_t i = 0; i < n_txs; ++i)
+      if (tvc[i].m_verifivation_failed)
+        ok = false;
+    return ok;
+  }
+  //-----------------------------------------------------------------------------------------------
   bool core::get_stat_info(core_stat_info& st_inf) const
   {
     st_inf.mining_speed = m_miner.get_speed();
@@ -608,17 +850,13 @@ namespace cryptonote
   //-----------------------------------------------------------------------------------------------
   bool core::are_key_images_spent(const std::vector<crypto::key_image>& key_im, std::vector<bool> &spent) const
   {
-    spent.clear();
-    BOOST_FOREACH(auto& ki, key_im)
-    {
-      spent.push_back(m_blockchain_storage.have_tx_keyimg_as_spent(ki));
-    }
+    m_blockchain_storage.have_tx_keyimgs_as_spent(key_im, spent);
     return true;
   }
   //-----------------------------------------------------------------------------------------------
   std::pair<uint64_t, uint64_t> core::get_coinbase_tx_sum(const uint64_t start_offset, const size_t count)
   {
-    std::list<block> blocks;
+    std::vector<block> blocks;
     std::list<transaction> txs;
     std::list<crypto::hash> missed_txs;
     uint64_t coinbase_amount = 0;
@@ -670,6 +908,11 @@ namespace cryptonote
     return m_blockchain_storage.get_total_transactions();
   }
   //-----------------------------------------------------------------------------------------------
+  uint64_t core::get_average_block_size(size_t count) const
+  {
+    return m_blockchain_storage.get_average_block_size(count);
+  }
+  //-----------------------------------------------------------------------------------------------
   bool core::add_new_tx(const transaction& tx, const crypto::hash& tx_hash, const crypto::hash& tx_prefix_hash, size_t blob_size, tx_verification_context& tvc, bool keeped_by_block, bool relayed)
   {
     if(m_mempool.have_tx(tx_hash))
@@ -733,7 +976,17 @@ namespace cryptonote
     return m_blockchain_storage.find_blockchain_supplement(qblock_ids, resp);
   }
   //-----------------------------------------------------------------------------------------------
-  bool core::find_blockchain_supplement(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, std::list<std::pair<block, std::list<transaction> > >& blocks, uint64_t& total_height, uint64_t& start_height, size_t max_count) const
+  bool core::get_block_hashing_blobs(const std::list<crypto::hash>& block_ids, std::vector<blobdata>& headers) const
+  {
+    return m_blockchain_storage.get_block_hashing_blobs(block_ids, headers);
+  }
+  //-----------------------------------------------------------------------------------------------
+  bool core::verify_block_headers(uint64_t start_height, const std::list<crypto::hash>& block_ids, const std::vector<blobdata>& headers)
+  {
+    return m_blockchain_storage.verify_block_headers(start_height, block_ids, headers);
+  }
+  //-----------------------------------------------------------------------------------------------
+  bool core::find_blockchain_supplement(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, std::vector<std::pair<blobdata, std::vector<blobdata> > >& blocks, uint64_t& total_height, uint64_t& start_height, size_t max_count) const
   {
     return m_blockchain_storage.find_blockchain_supplement(req_start_block, qblock_ids, blocks, total_height, start_height, max_count);
   }
@@ -832,11 +1085,22 @@ namespace cryptonote
   }
 
   //-----------------------------------------------------------------------------------------------
-  bool core::prepare_handle_incoming_blocks(const std::list<block_complete_entry> &blocks)
+  bool core::prepare_handle_incoming_blocks(const std::vector<block_complete_entry> &blocks)
   {
     m_blockchain_storage.prepare_handle_incoming_blocks(blocks);
     return true;
   }
+  //-----------------------------------------------------------------------------------------------
+  bool core::prepare_handle_incoming_blocks(const std::vector<block_complete_entry> &blocks, size_t first, size_t count)
+  {
+    m_blockchain_storage.prepare_handle_incoming_blocks(blocks, first, count);
+    return true;
+  }
+  //-----------------------------------------------------------------------------------------------
+  size_t core::get_prepare_window(const std::vector<block_complete_entry> &blocks, size_t first) const
+  {
+    return m_blockchain_storage.get_prepare_window(blocks, first);
+  }
 
   //-----------------------------------------------------------------------------------------------
   bool core::cleanup_handle_incoming_blocks(bool force_sync)
@@ -845,6 +1109,14 @@ namespace cryptonote
     return true;
   }
 
+  //-----------------------------------------------------------------------------------------------
+  bool core::check_incoming_block_header(const blobdata& block_blob)
+  {
+    block b = AUTO_VAL_INIT(b);
+    if(!parse_and_validate_block_from_blob(block_blob, b))
+      return false;
+    return m_blockchain_storage.check_block_header(b, get_block_hash(b));
+  }
   //-----------------------------------------------------------------------------------------------
   bool core::handle_incoming_block(const blobdata& block_blob, block_verification_context& bvc, bool update_miner_blocktemplate)
   {
@@ -895,6 +1167,21 @@ namespace cryptonote
     return m_mempool.get_transactions_count();
   }
   //-----------------------------------------------------------------------------------------------
+  uint64_t core::get_pool_memory_usage() const
+  {
+    return m_mempool.get_memory_usage();
+  }
+  //-----------------------------------------------------------------------------------------------
+  uint64_t core::get_block_template_version() const
+  {
+    return m_mempool.get_template_version();
+  }
+  //-----------------------------------------------------------------------------------------------
+  uint64_t core::wait_block_template_version(uint64_t version, unsigned timeout_seconds) const
+  {
+    return m_mempool.wait_template_version(version, timeout_seconds);
+  }
+  //-----------------------------------------------------------------------------------------------
   bool core::have_block(const crypto::hash& id) const
   {
     return m_blockchain_storage.have_block(id);
@@ -926,6 +1213,21 @@ namespace cryptonote
     return m_mempool.get_transactions_and_spent_keys_info(tx_infos, key_image_infos);
   }
   //-----------------------------------------------------------------------------------------------
+  void core::get_pool_transaction_hashes(std::vector<crypto::hash>& txs, uint64_t& pool_version) const
+  {
+    m_mempool.get_transaction_hashes(txs, pool_version);
+  }
+  //-----------------------------------------------------------------------------------------------
+  bool core::get_pool_transaction_changes(uint64_t since, std::vector<crypto::hash>& added, std::vector<crypto::hash>& removed, uint64_t& pool_version) const
+  {
+    return m_mempool.get_transaction_changes(since, added, removed, pool_version);
+  }
+  //-----------------------------------------------------------------------------------------------
+  void core::are_key_images_spent_in_pool(const std::vector<crypto::key_image>& key_im, std::vector<bool> &spent) const
+  {
+    m_mempool.have_tx_keyimgs_as_spent(key_im, spent);
+  }
+  //-----------------------------------------------------------------------------------------------
   bool core::get_short_chain_history(std::list<crypto::hash>& ids) const
   {
     return m_blockchain_storage.get_short_chain_history(ids);
@@ -954,6 +1256,18 @@ namespace cryptonote
   bool core::update_miner_block_template()
   {
     m_miner.on_block_chain_update();
+
+    // pushed to pool software, which would otherwise poll for new tips
+    if (!m_block_notify.empty())
+    {
+      const crypto::hash top = m_blockchain_storage.get_tail_id();
+      CRITICAL_REGION_LOCAL(m_block_notify_lock);
+      if (top != m_last_notified_block)
+      {
+        m_last_notified_block = top;
+        tools::run_notify_command(m_block_notify, epee::string_tools::pod_to_hex(top));
+      }
+    }
     return true;
   }
   //-----------------------------------------------------------------------------------------------
@@ -973,13 +1287,32 @@ namespace cryptonote
       m_starter_message_showed = true;
     }
 
+    if (!m_deferred_init_done)
+    {
+      m_deferred_init_done = true;
+      deferred_init();
+    }
+
     m_fork_moaner.do_call(boost::bind(&core::check_fork_time, this));
     m_txpool_auto_relayer.do_call(boost::bind(&core::relay_txpool_transactions, this));
+    if (m_db_follow)
+      m_blockchain_storage.refresh_from_db();
+    else
+      m_blockchain_db_idler.do_call(boost::bind(&Blockchain::on_idle, &m_blockchain_storage));
     m_miner.on_idle();
     m_mempool.on_idle();
     return true;
   }
   //-----------------------------------------------------------------------------------------------
+  void core::deferred_init()
+  {
+    // transactions failing here are checked again before being mined
+    m_mempool.verify_loaded_transactions();
+
+    // only starts the dns lookups, the checkpoints are applied when they arrive
+    update_checkpoints();
+  }
+  //-----------------------------------------------------------------------------------------------
   bool core::check_fork_time()
   {
     HardFork::State state = m_blockchain_storage.get_hard_fork_state();
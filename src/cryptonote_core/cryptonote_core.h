@@ -35,6 +35,7 @@
 #include <boost/program_options/options_description.hpp>
 #include <boost/program_options/variables_map.hpp>
 #include <boost/interprocess/sync/file_lock.hpp>
+#include <boost/filesystem/path.hpp>
 
 #include "p2p/net_node_common.h"
 #include "cryptonote_protocol/cryptonote_protocol_handler_common.h"
@@ -112,6 +113,22 @@ namespace cryptonote
       */
      bool handle_incoming_tx(const blobdata& tx_blob, tx_verification_context& tvc, bool keeped_by_block, bool relayed);
 
+     /**
+      * @brief handles a list of incoming transactions
+      *
+      * Parses and checks the transactions on the verification threads and
+      * passes those not already known to the transaction pool together, see
+      * tx_memory_pool::add_txs.
+      *
+      * @param tx_blobs the txs to handle
+      * @param tvc return-by-reference metadata about each transaction's validity
+      * @param keeped_by_block if the transactions have been in a block
+      * @param relayed whether or not the transactions were relayed to us
+      *
+      * @return false if any transaction failed verification, otherwise true
+      */
+     bool handle_incoming_txs(const std::list<blobdata>& tx_blobs, std::vector<tx_verification_context>& tvc, bool keeped_by_block, bool relayed);
+
      /**
       * @brief handles an incoming block
       *
@@ -128,12 +145,37 @@ namespace cryptonote
       */
      bool handle_incoming_block(const blobdata& block_blob, block_verification_context& bvc, bool update_miner_blocktemplate = true);
 
+     /**
+      * @brief checks an incoming block's header, proof of work and miner tx
+      *
+      * @param block_blob the block
+      *
+      * @return true if the block extends the main chain and passes the checks, false otherwise
+      *
+      * @note see Blockchain::check_block_header
+      */
+     bool check_incoming_block_header(const blobdata& block_blob);
+
      /**
       * @copydoc Blockchain::prepare_handle_incoming_blocks
       *
       * @note see Blockchain::prepare_handle_incoming_blocks
       */
-     bool prepare_handle_incoming_blocks(const std::list<block_complete_entry>  &blocks);
+     bool prepare_handle_incoming_blocks(const std::vector<block_complete_entry>  &blocks);
+
+     /**
+      * @copydoc Blockchain::prepare_handle_incoming_blocks(const std::vector<block_complete_entry>&, size_t, size_t)
+      *
+      * @note see Blockchain::prepare_handle_incoming_blocks
+      */
+     bool prepare_handle_incoming_blocks(const std::vector<block_complete_entry>  &blocks, size_t first, size_t count);
+
+     /**
+      * @copydoc Blockchain::get_prepare_window
+      *
+      * @note see Blockchain::get_prepare_window
+      */
+     size_t get_prepare_window(const std::vector<block_complete_entry>  &blocks, size_t first) const;
 
      /**
       * @copydoc Blockchain::cleanup_handle_incoming_blocks
@@ -286,18 +328,18 @@ namespace cryptonote
      bool get_blockchain_top(uint64_t& height, crypto::hash& top_id) const;
 
      /**
-      * @copydoc Blockchain::get_blocks(uint64_t, size_t, std::list<block>&, std::list<transaction>&) const
+      * @copydoc Blockchain::get_blocks(uint64_t, size_t, std::vector<block>&, std::vector<transaction>&) const
       *
-      * @note see Blockchain::get_blocks(uint64_t, size_t, std::list<block>&, std::list<transaction>&) const
+      * @note see Blockchain::get_blocks(uint64_t, size_t, std::vector<block>&, std::vector<transaction>&) const
       */
-     bool get_blocks(uint64_t start_offset, size_t count, std::list<block>& blocks, std::list<transaction>& txs) const;
+     bool get_blocks(uint64_t start_offset, size_t count, std::vector<block>& blocks, std::vector<transaction>& txs) const;
 
      /**
-      * @copydoc Blockchain::get_blocks(uint64_t, size_t, std::list<block>&) const
+      * @copydoc Blockchain::get_blocks(uint64_t, size_t, std::vector<block>&) const
       *
-      * @note see Blockchain::get_blocks(uint64_t, size_t, std::list<block>&) const
+      * @note see Blockchain::get_blocks(uint64_t, size_t, std::vector<block>&) const
       */
-     bool get_blocks(uint64_t start_offset, size_t count, std::list<block>& blocks) const;
+     bool get_blocks(uint64_t start_offset, size_t count, std::vector<block>& blocks) const;
 
      /**
       * @copydoc Blockchain::get_blocks(const t_ids_container&, t_blocks_container&, t_missed_container&) const
@@ -394,6 +436,27 @@ namespace cryptonote
       */
      bool get_pool_transactions_and_spent_keys_info(std::vector<tx_info>& tx_infos, std::vector<spent_key_image_info>& key_image_infos) const;
 
+     /**
+      * @copydoc tx_memory_pool::get_transaction_hashes
+      *
+      * @note see tx_memory_pool::get_transaction_hashes
+      */
+     void get_pool_transaction_hashes(std::vector<crypto::hash>& txs, uint64_t& pool_version) const;
+
+     /**
+      * @copydoc tx_memory_pool::get_transaction_changes
+      *
+      * @note see tx_memory_pool::get_transaction_changes
+      */
+     bool get_pool_transaction_changes(uint64_t since, std::vector<crypto::hash>& added, std::vector<crypto::hash>& removed, uint64_t& pool_version) const;
+
+     /**
+      * @copydoc tx_memory_pool::have_tx_keyimgs_as_spent
+      *
+      * @note see tx_memory_pool::have_tx_keyimgs_as_spent
+      */
+     void are_key_images_spent_in_pool(const std::vector<crypto::key_image>& key_im, std::vector<bool> &spent) const;
+
      /**
       * @copydoc tx_memory_pool::get_transactions_count
       *
@@ -401,6 +464,27 @@ namespace cryptonote
       */
      size_t get_pool_transactions_count() const;
 
+     /**
+      * @copydoc tx_memory_pool::get_memory_usage
+      *
+      * @note see tx_memory_pool::get_memory_usage
+      */
+     uint64_t get_pool_memory_usage() const;
+
+     /**
+      * @copydoc tx_memory_pool::get_template_version
+      *
+      * @note see tx_memory_pool::get_template_version
+      */
+     uint64_t get_block_template_version() const;
+
+     /**
+      * @copydoc tx_memory_pool::wait_template_version
+      *
+      * @note see tx_memory_pool::wait_template_version
+      */
+     uint64_t wait_block_template_version(uint64_t version, unsigned timeout_seconds) const;
+
      /**
       * @copydoc Blockchain::get_total_transactions
       *
@@ -430,11 +514,25 @@ namespace cryptonote
      bool find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, NOTIFY_RESPONSE_CHAIN_ENTRY::request& resp) const;
 
      /**
-      * @copydoc Blockchain::find_blockchain_supplement(const uint64_t, const std::list<crypto::hash>&, std::list<std::pair<block, std::list<transaction> > >&, uint64_t&, uint64_t&, size_t) const
+      * @copydoc Blockchain::get_block_hashing_blobs
       *
-      * @note see Blockchain::find_blockchain_supplement(const uint64_t, const std::list<crypto::hash>&, std::list<std::pair<block, std::list<transaction> > >&, uint64_t&, uint64_t&, size_t) const
+      * @note see Blockchain::get_block_hashing_blobs
       */
-     bool find_blockchain_supplement(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, std::list<std::pair<block, std::list<transaction> > >& blocks, uint64_t& total_height, uint64_t& start_height, size_t max_count) const;
+     bool get_block_hashing_blobs(const std::list<crypto::hash>& block_ids, std::vector<blobdata>& headers) const;
+
+     /**
+      * @copydoc Blockchain::verify_block_headers
+      *
+      * @note see Blockchain::verify_block_headers
+      */
+     bool verify_block_headers(uint64_t start_height, const std::list<crypto::hash>& block_ids, const std::vector<blobdata>& headers);
+
+     /**
+      * @copydoc Blockchain::find_blockchain_supplement(const uint64_t, const std::list<crypto::hash>&, std::vector<std::pair<blobdata, std::vector<blobdata> > >&, uint64_t&, uint64_t&, size_t) const
+      *
+      * @note see Blockchain::find_blockchain_supplement(const uint64_t, const std::list<crypto::hash>&, std::vector<std::pair<blobdata, std::vector<blobdata> > >&, uint64_t&, uint64_t&, size_t) const
+      */
+     bool find_blockchain_supplement(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, std::vector<std::pair<blobdata, std::vector<blobdata> > >& blocks, uint64_t& total_height, uint64_t& start_height, size_t max_count) const;
 
      /**
       * @brief gets some stats about the daemon
@@ -567,9 +665,14 @@ namespace cryptonote
       * its checkpoints if it is time.  If updating checkpoints fails,
       * the daemon is told to shut down.
       *
+      * DNS checkpoints are fetched on a separate thread and applied once
+      * they arrive, so a slow or filtered DNS does not hold up the caller.
+      *
+      * @param allow_dns whether the dns checkpoints may be fetched, if it is their time
+      *
       * @note see Blockchain::update_checkpoints()
       */
-     bool update_checkpoints();
+     bool update_checkpoints(bool allow_dns = true);
 
      /**
       * @brief tells the daemon to wind down operations and stop running
@@ -608,10 +711,32 @@ namespace cryptonote
      /**
       * @brief get the number of blocks to sync in one go
       *
-      * @return the number of blocks to sync in one go
+      * @return the number of blocks to sync in one go, or 0 if requests
+      * are sized by bytes instead
       */
      size_t get_block_sync_size() const { return block_sync_size; }
 
+     /**
+      * @brief get whether new blocks are relayed once their header checks out
+      *
+      * @return true if early block relay is enabled, otherwise false
+      */
+     bool get_early_block_relay() const { return m_early_block_relay; }
+
+     /**
+      * @brief get whether the blockchain is another daemon's database, opened read only
+      *
+      * @return true if following a database, otherwise false
+      */
+     bool get_db_follow() const { return m_db_follow; }
+
+     /**
+      * @copydoc Blockchain::get_average_block_size
+      *
+      * @note see Blockchain::get_average_block_size
+      */
+     uint64_t get_average_block_size(size_t count) const;
+
      /**
       * @brief get the sum of coinbase tx amounts between blocks
       *
@@ -662,6 +787,25 @@ namespace cryptonote
       */
      bool add_new_block(const block& b, block_verification_context& bvc);
 
+     /**
+      * @brief opens the blockchain database and initializes the Blockchain on it
+      *
+      * @param vm command line parameters
+      * @param folder the data directory, the database's own folder goes under it
+      * @param test_options configuration options for testing
+      *
+      * @return false if the database cannot be opened or the Blockchain fails to initialize, otherwise true
+      */
+     bool init_blockchain(const boost::program_options::variables_map& vm, boost::filesystem::path folder, const test_options *test_options);
+
+     /**
+      * @brief runs the start-up work left out of init, once the daemon is serving
+      *
+      * Verifies the signatures of the transactions loaded from the pool
+      * state and starts fetching the dns checkpoints.
+      */
+     void deferred_init();
+
      /**
       * @brief load any core state stored on disk
       *
@@ -708,6 +852,30 @@ namespace cryptonote
       */
      bool check_tx_semantic(const transaction& tx, bool keeped_by_block) const;
 
+     /**
+      * @brief the checks of handle_incoming_tx before the transaction pool
+      *
+      * Safe to run for several transactions at once.
+      *
+      * @param tx_blob the tx to handle
+      * @param tvc return-by-reference metadata about the transaction's validity
+      * @param tx return-by-reference the parsed transaction
+      * @param tx_hash return-by-reference the transaction's hash
+      * @param tx_prefixt_hash return-by-reference the transaction's prefix hash
+      * @param keeped_by_block if the transaction has been in a block
+      *
+      * @return true if the transaction passes, otherwise false
+      */
+     bool handle_incoming_tx_pre(const blobdata& tx_blob, tx_verification_context& tvc, transaction& tx, crypto::hash& tx_hash, crypto::hash& tx_prefixt_hash, bool keeped_by_block) const;
+
+     /**
+      * @brief logs the outcome of handling an incoming transaction
+      *
+      * @param tx_hash the transaction's hash
+      * @param tvc the transaction's verification status
+      */
+     void handle_incoming_tx_post(const crypto::hash& tx_hash, const tx_verification_context& tvc) const;
+
      /**
       * @copydoc miner::on_block_chain_update
       *
@@ -789,14 +957,20 @@ namespace cryptonote
 
      std::string m_config_folder; //!< folder to look in for configs and other files
 
+     std::string m_block_notify; //!< command to run for each new top block, empty for none
+     crypto::hash m_last_notified_block; //!< the top block m_block_notify last ran for
+     epee::critical_section m_block_notify_lock; //!< guards m_last_notified_block
+
      cryptonote_protocol_stub m_protocol_stub; //!< cryptonote protocol stub instance
 
      epee::math_helper::once_a_time_seconds<60*60*12, false> m_store_blockchain_interval; //!< interval for manual storing of Blockchain, if enabled
      epee::math_helper::once_a_time_seconds<60*60*2, false> m_fork_moaner; //!< interval for checking HardFork status
      epee::math_helper::once_a_time_seconds<60*2, false> m_txpool_auto_relayer; //!< interval for checking re-relaying txpool transactions
+     epee::math_helper::once_a_time_seconds<60, false> m_blockchain_db_idler; //!< interval for letting the db grow ahead of need
 
      friend class tx_validate_inputs;
      std::atomic<bool> m_starter_message_showed; //!< has the "daemon will sync now" message been shown?
+     bool m_deferred_init_done; //!< has the start-up work left out of init been run?
 
      uint64_t m_target_blockchain_height; //!< blockchain height target
 
@@ -809,10 +983,13 @@ namespace cryptonote
      time_t m_last_json_checkpoints_update; //!< time when json checkpoints were last updated
 
      std::atomic_flag m_checkpoints_updating; //!< set if checkpoints are currently updating to avoid multiple threads attempting to update at once
+     boost::thread m_dns_checkpoints_thread; //!< fetches and applies the dns checkpoints, holding m_checkpoints_updating
 
      boost::interprocess::file_lock db_lock; //!< a lock object for a file lock in the db directory
 
      size_t block_sync_size;
+     bool m_early_block_relay; //!< relay new blocks before verifying them fully
+     bool m_db_follow; //!< is the blockchain another daemon's database, opened read only?
    };
 }
 
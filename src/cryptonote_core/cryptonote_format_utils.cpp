@@ -69,10 +69,11 @@ namespace cryptonote
   //---------------------------------------------------------------
   void get_transaction_prefix_hash(const transaction_prefix& tx, crypto::hash& h)
   {
-    std::ostringstream s;
+    blobdata blob;
+    binary_output_stream s(blob);
     binary_archive<true> a(s);
     ::serialization::serialize(a, const_cast<transaction_prefix&>(tx));
-    crypto::cn_fast_hash(s.str().data(), s.str().size(), h);
+    crypto::cn_fast_hash(blob.data(), blob.size(), h);
   }
   //---------------------------------------------------------------
   crypto::hash get_transaction_prefix_hash(const transaction_prefix& tx)
@@ -84,22 +85,76 @@ namespace cryptonote
   //---------------------------------------------------------------
   bool parse_and_validate_tx_from_blob(const blobdata& tx_blob, transaction& tx)
   {
-    std::stringstream ss;
-    ss << tx_blob;
+    binary_input_stream ss(tx_blob);
     binary_archive<false> ba(ss);
+    tx.pruned = false;
     bool r = ::serialization::serialize(ba, tx);
     CHECK_AND_ASSERT_MES(r, false, "Failed to parse transaction from blob");
+    tx.cached_blob_size.set(tx_blob.size());
+    return true;
+  }
+  //---------------------------------------------------------------
+  bool parse_and_validate_tx_base_from_blob(const blobdata& tx_blob, transaction& tx)
+  {
+    binary_input_stream ss(tx_blob);
+    binary_archive<false> ba(ss);
+    tx.pruned = true;
+    bool r = ::serialization::serialize(ba, tx);
+    CHECK_AND_ASSERT_MES(r, false, "Failed to parse pruned transaction from blob");
+    return true;
+  }
+  //---------------------------------------------------------------
+  bool parse_tx_base_from_blob(const blobdata& tx_blob, transaction& tx)
+  {
+    // reads the prefix and ringct base of a full or pruned blob, whatever
+    // follows them is left unread
+    binary_input_stream ss(tx_blob);
+    binary_archive<false> ba(ss);
+    tx.pruned = true;
+    bool r = ::do_serialize(ba, tx) && ss.good();
+    CHECK_AND_ASSERT_MES(r, false, "Failed to parse transaction base from blob");
+    return true;
+  }
+  //---------------------------------------------------------------
+  bool get_pruned_tx_blob(const blobdata& tx_blob, transaction& tx, blobdata& pruned_blob, crypto::hash& prunable_hash, bool& has_prunable_hash)
+  {
+    // the prefix and ringct base are parsed to find where they end, the
+    // rest is hashed as it is
+    binary_input_stream ss(tx_blob);
+    binary_archive<false> ba(ss);
+    tx.pruned = true;
+    bool r = ::do_serialize(ba, tx) && ss.good();
+    CHECK_AND_ASSERT_MES(r, false, "Failed to parse transaction base from blob");
+    const std::streamoff base_size = ss.tellg();
+    CHECK_AND_ASSERT_MES(base_size >= 0 && (size_t)base_size <= tx_blob.size(), false, "Failed to find the end of the transaction base");
+
+    pruned_blob.assign(tx_blob, 0, base_size);
+    // only v2 hashes have a part for the prunable data, and it can't be
+    // told when the blob was pruned already
+    has_prunable_hash = false;
+    prunable_hash = null_hash;
+    if (tx.version >= 2)
+    {
+      if (tx.rct_signatures.type == rct::RCTTypeNull)
+        has_prunable_hash = true;
+      else if ((size_t)base_size < tx_blob.size())
+      {
+        cn_fast_hash(tx_blob.data() + base_size, tx_blob.size() - base_size, prunable_hash);
+        has_prunable_hash = true;
+      }
+    }
     return true;
   }
   //---------------------------------------------------------------
   bool parse_and_validate_tx_from_blob(const blobdata& tx_blob, transaction& tx, crypto::hash& tx_hash, crypto::hash& tx_prefix_hash)
   {
-    std::stringstream ss;
-    ss << tx_blob;
+    binary_input_stream ss(tx_blob);
     binary_archive<false> ba(ss);
+    tx.pruned = false;
     bool r = ::serialization::serialize(ba, tx);
     CHECK_AND_ASSERT_MES(r, false, "Failed to parse transaction from blob");
     //TODO: validate tx
+    tx.cached_blob_size.set(tx_blob.size());
 
     get_transaction_hash(tx, tx_hash);
     get_transaction_prefix_hash(tx, tx_prefix_hash);
@@ -110,6 +165,7 @@ namespace cryptonote
     tx.vin.clear();
     tx.vout.clear();
     tx.extra.clear();
+    tx.invalidate_hashes();
 
     keypair txkey = keypair::generate();
     add_tx_pub_key_to_extra(tx, txkey.pub);
@@ -299,8 +355,7 @@ namespace cryptonote
     if(tx_extra.empty())
       return true;
 
-    std::string extra_str(reinterpret_cast<const char*>(tx_extra.data()), tx_extra.size());
-    std::istringstream iss(extra_str);
+    binary_input_stream iss(tx_extra);
     binary_archive<false> ar(iss);
 
     bool eof = false;
@@ -368,10 +423,10 @@ namespace cryptonote
   //---------------------------------------------------------------
   bool remove_field_from_tx_extra(std::vector<uint8_t>& tx_extra, const std::type_info &type)
   {
-    std::string extra_str(reinterpret_cast<const char*>(tx_extra.data()), tx_extra.size());
-    std::istringstream iss(extra_str);
+    binary_input_stream iss(tx_extra);
     binary_archive<false> ar(iss);
-    std::ostringstream oss;
+    blobdata extra;
+    binary_output_stream oss(extra);
     binary_archive<true> newar(oss);
 
     bool eof = false;
@@ -388,10 +443,7 @@ namespace cryptonote
       iss.clear(state);
     }
     CHECK_AND_NO_ASSERT_MES_L1(::serialization::check_stream_state(ar), false, "failed to deserialize extra field. extra = " << string_tools::buff_to_hex_nodelimer(std::string(reinterpret_cast<const char*>(tx_extra.data()), tx_extra.size())));
-    tx_extra.clear();
-    std::string s = oss.str();
-    tx_extra.reserve(s.size());
-    std::copy(s.begin(), s.end(), std::back_inserter(tx_extra));
+    tx_extra.assign(extra.begin(), extra.end());
     return true;
   }
   //---------------------------------------------------------------
@@ -469,7 +521,7 @@ namespace cryptonote
     return encrypt_payment_id(payment_id, public_key, secret_key);
   }
   //---------------------------------------------------------------
-  bool construct_tx_and_get_tx_key(const account_keys& sender_account_keys, const std::vector<tx_source_entry>& sources, const std::vector<tx_destination_entry>& destinations, std::vector<uint8_t> extra, transaction& tx, uint64_t unlock_time, crypto::secret_key &tx_key, bool rct)
+  bool construct_tx_and_get_tx_key(const account_keys& sender_account_keys, const std::vector<tx_source_entry>& sources, const std::vector<tx_destination_entry>& destinations, std::vector<uint8_t> extra, transaction& tx, uint64_t unlock_time, crypto::secret_key &tx_key, bool rct, tools::thread_group *threads)
   {
     std::vector<rct::key> amount_keys;
     tx.set_null();
@@ -758,9 +810,9 @@ namespace cryptonote
       get_transaction_prefix_hash(tx, tx_prefix_hash);
       rct::ctkeyV outSk;
       if (use_simple_rct)
-        tx.rct_signatures = rct::genRctSimple(rct::hash2rct(tx_prefix_hash), inSk, destinations, inamounts, outamounts, amount_in - amount_out, mixRing, amount_keys, index, outSk);
+        tx.rct_signatures = rct::genRctSimple(rct::hash2rct(tx_prefix_hash), inSk, destinations, inamounts, outamounts, amount_in - amount_out, mixRing, amount_keys, index, outSk, threads);
       else
-        tx.rct_signatures = rct::genRct(rct::hash2rct(tx_prefix_hash), inSk, destinations, outamounts, mixRing, amount_keys, sources[0].real_output, outSk); // same index assumption
+        tx.rct_signatures = rct::genRct(rct::hash2rct(tx_prefix_hash), inSk, destinations, outamounts, mixRing, amount_keys, sources[0].real_output, outSk, threads); // same index assumption
 
       CHECK_AND_ASSERT_MES(tx.vout.size() == outSk.size(), false, "outSk size does not match vout");
 
@@ -888,6 +940,11 @@ namespace cryptonote
     return pk == out_key.key;
   }
   //---------------------------------------------------------------
+  bool is_out_to_acc_precomp(const crypto::public_key_precomp& spend_public_key, const txout_to_key& out_key, const crypto::key_derivation& derivation, size_t output_index)
+  {
+    return check_derived_public_key(derivation, output_index, spend_public_key, out_key.key);
+  }
+  //---------------------------------------------------------------
   bool lookup_acc_outs(const account_keys& acc, const transaction& tx, std::vector<size_t>& outs, uint64_t& money_transfered)
   {
     crypto::public_key tx_pub_key = get_tx_pub_key_from_extra(tx);
@@ -948,7 +1005,34 @@ namespace cryptonote
     return get_transaction_hash(t, res, NULL);
   }
   //---------------------------------------------------------------
+  size_t get_object_blobsize(const transaction& t)
+  {
+    if (t.cached_blob_size.valid())
+      return t.cached_blob_size.get();
+    return get_object_blobsize<transaction>(t);
+  }
+  //---------------------------------------------------------------
   bool get_transaction_hash(const transaction& t, crypto::hash& res, size_t* blob_size)
+  {
+    if (t.cached_hash.valid())
+    {
+      res = t.cached_hash.get();
+      if (blob_size)
+        *blob_size = get_object_blobsize(t);
+      return true;
+    }
+
+    if (!calculate_transaction_hash(t, res, blob_size))
+      return false;
+
+    // only cache for transactions parsed from a blob, others may still be
+    // modified by whoever is building them
+    if (t.cached_blob_size.valid())
+      t.cached_hash.set(res);
+    return true;
+  }
+  //---------------------------------------------------------------
+  bool calculate_transaction_hash(const transaction& t, crypto::hash& res, size_t* blob_size)
   {
     // v1 transactions hash the entire blob
     if (t.version == 1)
@@ -967,13 +1051,14 @@ namespace cryptonote
 
     // base rct
     {
-      std::stringstream ss;
+      blobdata blob;
+      binary_output_stream ss(blob);
       binary_archive<true> ba(ss);
       const size_t inputs = t.vin.size();
       const size_t outputs = t.vout.size();
       bool r = tt.rct_signatures.serialize_rctsig_base(ba, inputs, outputs);
       CHECK_AND_ASSERT_MES(r, false, "Failed to serialize rct signatures base");
-      cryptonote::get_blob_hash(ss.str(), hashes[1]);
+      cryptonote::get_blob_hash(blob, hashes[1]);
     }
 
     // prunable rct
@@ -983,14 +1068,15 @@ namespace cryptonote
     }
     else
     {
-      std::stringstream ss;
+      blobdata blob;
+      binary_output_stream ss(blob);
       binary_archive<true> ba(ss);
       const size_t inputs = t.vin.size();
       const size_t outputs = t.vout.size();
       const size_t mixin = t.vin.empty() ? 0 : t.vin[0].type() == typeid(txin_to_key) ? boost::get<txin_to_key>(t.vin[0]).key_offsets.size() - 1 : 0;
       bool r = tt.rct_signatures.p.serialize_rctsig_prunable(ba, t.rct_signatures.type, inputs, outputs, mixin);
       CHECK_AND_ASSERT_MES(r, false, "Failed to serialize rct signatures prunable");
-      cryptonote::get_blob_hash(ss.str(), hashes[2]);
+      cryptonote::get_blob_hash(blob, hashes[2]);
     }
 
     // the tx hash is the hash of the 3 hashes
@@ -1017,7 +1103,40 @@ namespace cryptonote
     return blob;
   }
   //---------------------------------------------------------------
+  bool parse_block_hashing_blob(const blobdata& blob, block_header& header, crypto::hash& tree_root_hash, uint64_t& tx_count)
+  {
+    binary_input_stream ss(blob);
+    binary_archive<false> ba(ss);
+    // not ::serialization::serialize, which wants the stream at its end
+    bool r = ::do_serialize(ba, header) && ss.good();
+    CHECK_AND_ASSERT_MES(r, false, "Failed to parse block header from hashing blob");
+    const std::streamoff header_size = ss.tellg();
+    CHECK_AND_ASSERT_MES(header_size >= 0 && blob.size() > header_size + sizeof(tree_root_hash), false, "Block hashing blob too short");
+
+    memcpy(&tree_root_hash, blob.data() + header_size, sizeof(tree_root_hash));
+    const std::string count_data = blob.substr(header_size + sizeof(tree_root_hash));
+    int read = tools::read_varint(count_data.begin(), count_data.end(), tx_count);
+    CHECK_AND_ASSERT_MES(read > 0 && (size_t)read == count_data.size() && tx_count > 0, false, "Bad tx count in block hashing blob");
+    return true;
+  }
+  //---------------------------------------------------------------
   bool get_block_hash(const block& b, crypto::hash& res)
+  {
+    if (b.cached_hash.valid())
+    {
+      res = b.cached_hash.get();
+      return true;
+    }
+
+    if (!calculate_block_hash(b, res))
+      return false;
+
+    if (b.cached_blob_size.valid())
+      b.cached_hash.set(res);
+    return true;
+  }
+  //---------------------------------------------------------------
+  bool calculate_block_hash(const block& b, crypto::hash& res)
   {
     // EXCEPTION FOR BLOCK 202612
     const std::string correct_blob_hash_202612 = "3a8a2b3a29b50fc86ff73dd087ea43c6f0d6b8f936c849194d5c84c737903966";
@@ -1096,6 +1215,39 @@ namespace cryptonote
     return true;
   }
   //---------------------------------------------------------------
+  bool get_block_longhashes(const std::vector<const block*>& blocks, const std::vector<uint64_t>& heights, std::vector<crypto::hash>& res)
+  {
+    CHECK_AND_ASSERT_MES(blocks.size() == heights.size(), false, "blocks and heights differ in size");
+    res.resize(blocks.size());
+
+    // hashed together, so their scratchpad accesses overlap
+    std::vector<blobdata> blobs;
+    std::vector<size_t> slots;
+    for (size_t i = 0; i < blocks.size(); ++i)
+    {
+      if (heights[i] == 202612)
+        get_block_longhash(*blocks[i], res[i], heights[i]);
+      else
+      {
+        blobs.push_back(get_block_hashing_blob(*blocks[i]));
+        slots.push_back(i);
+      }
+    }
+
+    std::vector<const void*> data;
+    std::vector<size_t> lengths;
+    for (const blobdata& bd : blobs)
+    {
+      data.push_back(bd.data());
+      lengths.push_back(bd.size());
+    }
+    std::vector<crypto::hash> hashes(blobs.size());
+    crypto::cn_slow_hash_multi(data.data(), lengths.data(), data.size(), hashes.data());
+    for (size_t i = 0; i < slots.size(); ++i)
+      res[slots[i]] = hashes[i];
+    return true;
+  }
+  //---------------------------------------------------------------
   std::vector<uint64_t> relative_output_offsets_to_absolute(const std::vector<uint64_t>& off)
   {
     std::vector<uint64_t> res = off;
@@ -1125,11 +1277,21 @@ namespace cryptonote
   //---------------------------------------------------------------
   bool parse_and_validate_block_from_blob(const blobdata& b_blob, block& b)
   {
-    std::stringstream ss;
-    ss << b_blob;
+    binary_input_stream ss(b_blob);
     binary_archive<false> ba(ss);
     bool r = ::serialization::serialize(ba, b);
     CHECK_AND_ASSERT_MES(r, false, "Failed to parse block from blob");
+    b.cached_blob_size.set(b_blob.size());
+    return true;
+  }
+  //---------------------------------------------------------------
+  bool parse_block_header_from_blob(const blobdata& b_blob, block_header& header)
+  {
+    // the header is the start of the block blob, the rest is left unread
+    binary_input_stream ss(b_blob);
+    binary_archive<false> ba(ss);
+    bool r = ::do_serialize(ba, header) && ss.good();
+    CHECK_AND_ASSERT_MES(r, false, "Failed to parse block header from blob");
     return true;
   }
   //---------------------------------------------------------------
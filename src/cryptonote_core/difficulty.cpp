@@ -116,23 +116,14 @@ namespace cryptonote {
     return !carry;
   }
 
-  difficulty_type next_difficulty(std::vector<std::uint64_t> timestamps, std::vector<difficulty_type> cumulative_difficulties, size_t target_seconds) {
-
-    if(timestamps.size() > DIFFICULTY_WINDOW)
-    {
-      timestamps.resize(DIFFICULTY_WINDOW);
-      cumulative_difficulties.resize(DIFFICULTY_WINDOW);
-    }
-
-
-    size_t length = timestamps.size();
-    assert(length == cumulative_difficulties.size());
+  // the timestamps are sorted, the cumulative difficulties in chain order
+  template<typename T, typename C>
+  static difficulty_type next_difficulty_sorted(const T &timestamps, const C &cumulative_difficulties, size_t length, size_t target_seconds) {
     if (length <= 1) {
       return 1;
     }
     static_assert(DIFFICULTY_WINDOW >= 2, "Window is too small");
     assert(length <= DIFFICULTY_WINDOW);
-    sort(timestamps.begin(), timestamps.end());
     size_t cut_begin, cut_end;
     static_assert(2 * DIFFICULTY_CUT <= DIFFICULTY_WINDOW - 2, "Cut length is too large");
     if (length <= DIFFICULTY_WINDOW - 2 * DIFFICULTY_CUT) {
@@ -159,4 +150,71 @@ namespace cryptonote {
     return (low + time_span - 1) / time_span;
   }
 
+  difficulty_type next_difficulty(std::vector<std::uint64_t> timestamps, std::vector<difficulty_type> cumulative_difficulties, size_t target_seconds) {
+    if(timestamps.size() > DIFFICULTY_WINDOW)
+    {
+      timestamps.resize(DIFFICULTY_WINDOW);
+      cumulative_difficulties.resize(DIFFICULTY_WINDOW);
+    }
+    size_t length = timestamps.size();
+    assert(length == cumulative_difficulties.size());
+    sort(timestamps.begin(), timestamps.end());
+    return next_difficulty_sorted(timestamps, cumulative_difficulties, length, target_seconds);
+  }
+
+  void difficulty_window::clear() {
+    m_timestamps.clear();
+    m_cumulative_difficulties.clear();
+    m_sorted_timestamps.clear();
+  }
+
+  void difficulty_window::insert_sorted(uint64_t timestamp) {
+    m_sorted_timestamps.insert(std::upper_bound(m_sorted_timestamps.begin(), m_sorted_timestamps.end(), timestamp), timestamp);
+  }
+
+  void difficulty_window::erase_sorted(uint64_t timestamp) {
+    auto it = std::lower_bound(m_sorted_timestamps.begin(), m_sorted_timestamps.end(), timestamp);
+    assert(it != m_sorted_timestamps.end() && *it == timestamp);
+    m_sorted_timestamps.erase(it);
+  }
+
+  void difficulty_window::push_back(uint64_t timestamp, difficulty_type cumulative_difficulty) {
+    m_timestamps.push_back(timestamp);
+    m_cumulative_difficulties.push_back(cumulative_difficulty);
+    if (m_timestamps.size() <= DIFFICULTY_WINDOW) {
+      insert_sorted(timestamp);
+    }
+    if (m_timestamps.size() > DIFFICULTY_BLOCKS_COUNT) {
+      // the oldest block leaves, the one DIFFICULTY_WINDOW after it takes its place
+      erase_sorted(m_timestamps.front());
+      m_timestamps.pop_front();
+      m_cumulative_difficulties.pop_front();
+      insert_sorted(m_timestamps[DIFFICULTY_WINDOW - 1]);
+    }
+  }
+
+  void difficulty_window::pop_back() {
+    assert(!m_timestamps.empty());
+    if (m_timestamps.size() <= DIFFICULTY_WINDOW) {
+      erase_sorted(m_timestamps.back());
+    }
+    m_timestamps.pop_back();
+    m_cumulative_difficulties.pop_back();
+  }
+
+  void difficulty_window::push_front(uint64_t timestamp, difficulty_type cumulative_difficulty) {
+    assert(m_timestamps.size() < DIFFICULTY_BLOCKS_COUNT);
+    m_timestamps.push_front(timestamp);
+    m_cumulative_difficulties.push_front(cumulative_difficulty);
+    insert_sorted(timestamp);
+    if (m_timestamps.size() > DIFFICULTY_WINDOW) {
+      erase_sorted(m_timestamps[DIFFICULTY_WINDOW]);
+    }
+  }
+
+  difficulty_type difficulty_window::next_difficulty(size_t target_seconds) const {
+    const size_t length = std::min<size_t>(m_timestamps.size(), DIFFICULTY_WINDOW);
+    assert(m_sorted_timestamps.size() == length);
+    return next_difficulty_sorted(m_sorted_timestamps, m_cumulative_difficulties, length, target_seconds);
+  }
 }
@@ -31,6 +31,7 @@
 #pragma once
 
 #include <cstdint>
+#include <deque>
 #include <vector>
 
 #include "crypto/hash.h"
@@ -53,4 +54,49 @@ namespace cryptonote
      */
     bool check_hash(const crypto::hash &hash, difficulty_type difficulty);
     difficulty_type next_difficulty(std::vector<std::uint64_t> timestamps, std::vector<difficulty_type> cumulative_difficulties, size_t target_seconds);
+
+    /**
+     * @brief the last DIFFICULTY_BLOCKS_COUNT blocks' timestamps and cumulative
+     * difficulties, updated a block at a time
+     *
+     * The timestamps next_difficulty would sort are kept sorted as blocks
+     * come and go, so getting the next difficulty does not sort them again.
+     */
+    class difficulty_window
+    {
+    public:
+      void clear();
+      size_t size() const { return m_timestamps.size(); }
+
+      /**
+       * @brief adds the block after the newest one, dropping the oldest one
+       * if the window is full
+       */
+      void push_back(std::uint64_t timestamp, difficulty_type cumulative_difficulty);
+
+      /**
+       * @brief removes the newest block
+       */
+      void pop_back();
+
+      /**
+       * @brief adds the block before the oldest one, the window must not be full
+       */
+      void push_front(std::uint64_t timestamp, difficulty_type cumulative_difficulty);
+
+      /**
+       * @brief same as next_difficulty on the window's timestamps and cumulative difficulties
+       */
+      difficulty_type next_difficulty(size_t target_seconds) const;
+
+    private:
+      void insert_sorted(std::uint64_t timestamp);
+      void erase_sorted(std::uint64_t timestamp);
+
+      // oldest first
+      std::deque<std::uint64_t> m_timestamps;
+      std::deque<difficulty_type> m_cumulative_difficulties;
+      // the timestamps of the oldest DIFFICULTY_WINDOW blocks, sorted
+      std::vector<std::uint64_t> m_sorted_timestamps;
+    };
 }
@@ -29,6 +29,7 @@
 #include <algorithm>
 #include <cstdio>
 
+#include "common/varint.h"
 #include "cryptonote_core/cryptonote_basic.h"
 #include "blockchain_db/blockchain_db.h"
 #include "hardfork.h"
@@ -121,7 +122,7 @@ bool HardFork::add(uint8_t block_version, uint8_t voting_version, uint64_t heigh
   if (!do_check(block_version, voting_version))
     return false;
 
-  db.set_hard_fork_version(height, heights[current_fork_index].version);
+  db.set_hard_fork_info(height, heights[current_fork_index].version, block_version, voting_version);
 
   voting_version = get_effective_version(voting_version);
 
@@ -195,8 +196,30 @@ uint8_t HardFork::get_block_version(uint64_t height) const
   if (height <= original_version_till_height)
     return original_version;
 
-  const cryptonote::block &block = db.get_block_from_height(height);
-  return ::get_block_version(block);
+  uint8_t block_version, vote;
+  get_block_info(height, block_version, vote);
+  return block_version;
+}
+
+void HardFork::get_block_info(uint64_t height, uint8_t &block_version, uint8_t &vote) const
+{
+  if (db.get_hard_fork_info(height, block_version, vote))
+    return;
+
+  // not kept for this block, the versions are the first fields of its blob,
+  // no need to deserialize the rest
+  const cryptonote::blobdata blob = db.get_block_blob_from_height(height);
+  uint64_t major_version, minor_version;
+  const int read = tools::read_varint(blob.begin(), blob.end(), major_version);
+  if (read <= 0 || tools::read_varint(blob.begin() + read, blob.end(), minor_version) <= 0)
+  {
+    const cryptonote::block b = db.get_block_from_height(height);
+    major_version = b.major_version;
+    minor_version = b.minor_version;
+  }
+  block_version = major_version;
+  // see get_block_vote
+  vote = minor_version == 0 ? 1 : minor_version;
 }
 
 bool HardFork::reorganize_from_block_height(uint64_t height)
@@ -218,8 +241,9 @@ bool HardFork::reorganize_from_block_height(uint64_t height)
     --current_fork_index;
   }
   for (uint64_t h = rescan_height; h <= height; ++h) {
-    cryptonote::block b = db.get_block_from_height(h);
-    const uint8_t v = get_effective_version(get_block_vote(b));
+    uint8_t block_version, vote;
+    get_block_info(h, block_version, vote);
+    const uint8_t v = get_effective_version(vote);
     last_versions[v]++;
     versions.push_back(v);
   }
@@ -231,7 +255,9 @@ bool HardFork::reorganize_from_block_height(uint64_t height)
 
   const uint64_t bc_height = db.height();
   for (uint64_t h = height + 1; h < bc_height; ++h) {
-    add(db.get_block_from_height(h), h);
+    uint8_t block_version, vote;
+    get_block_info(h, block_version, vote);
+    add(block_version, vote, h);
   }
 
   db.batch_stop();
@@ -260,8 +286,9 @@ bool HardFork::rescan_from_block_height(uint64_t height)
   for (size_t n = 0; n < 256; ++n)
     last_versions[n] = 0;
   for (uint64_t h = height; h < db.height(); ++h) {
-    cryptonote::block b = db.get_block_from_height(h);
-    const uint8_t v = get_effective_version(get_block_vote(b));
+    uint8_t block_version, vote;
+    get_block_info(h, block_version, vote);
+    const uint8_t v = get_effective_version(vote);
     last_versions[v]++;
     versions.push_back(v);
   }
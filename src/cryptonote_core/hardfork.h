@@ -210,6 +210,7 @@ namespace cryptonote
   private:
 
     uint8_t get_block_version(uint64_t height) const;
+    void get_block_info(uint64_t height, uint8_t &block_version, uint8_t &vote) const;
     bool do_check(uint8_t block_version, uint8_t voting_version) const;
     int get_voted_fork_index(uint64_t height) const;
     uint8_t get_effective_version(uint8_t voting_version) const;
@@ -40,6 +40,7 @@
 #include "cryptonote_format_utils.h"
 #include "file_io_utils.h"
 #include "common/command_line.h"
+#include "common/util.h"
 #include "string_coding.h"
 #include "storages/portable_storage_template_helper.h"
 
@@ -50,6 +51,7 @@ using namespace epee;
 
 extern "C" void slow_hash_allocate_state();
 extern "C" void slow_hash_free_state();
+extern "C" const char *slow_hash_state_pages();
 namespace cryptonote
 {
 
@@ -58,6 +60,7 @@ namespace cryptonote
     const command_line::arg_descriptor<std::string> arg_extra_messages =  {"extra-messages-file", "Specify file for extra messages to include into coinbase transactions", "", true};
     const command_line::arg_descriptor<std::string> arg_start_mining =    {"start-mining", "Specify wallet address to mining for", "", true};
     const command_line::arg_descriptor<uint32_t>      arg_mining_threads =  {"mining-threads", "Specify mining threads count", 0, true};
+    const command_line::arg_descriptor<int32_t>       arg_mining_cpu_affinity =  {"mining-cpu-affinity", "Pin mining threads to consecutive CPUs starting with this one, -1 to leave them unpinned", -1};
   }
 
 
@@ -70,6 +73,7 @@ namespace cryptonote
     m_height(0),
     m_pausers_count(0),
     m_threads_total(0),
+    m_first_cpu(-1),
     m_starter_nonce(0),
     m_last_hr_merge_time(0),
     m_hashes(0),
@@ -169,6 +173,7 @@ namespace cryptonote
     command_line::add_arg(desc, arg_extra_messages);
     command_line::add_arg(desc, arg_start_mining);
     command_line::add_arg(desc, arg_mining_threads);
+    command_line::add_arg(desc, arg_mining_cpu_affinity);
   }
   //-----------------------------------------------------------------------------------------------------
   bool miner::init(const boost::program_options::variables_map& vm, bool testnet)
@@ -210,6 +215,7 @@ namespace cryptonote
         m_threads_total = command_line::get_arg(vm, arg_mining_threads);
       }
     }
+    m_first_cpu = command_line::get_arg(vm, arg_mining_cpu_affinity);
 
     return true;
   }
@@ -349,12 +355,23 @@ namespace cryptonote
     uint32_t th_local_index = boost::interprocess::ipcdetail::atomic_inc32(&m_thread_index);
     LOG_PRINT_L0("Miner thread was started ["<< th_local_index << "]");
     log_space::log_singletone::set_thread_log_prefix(std::string("[miner ") + std::to_string(th_local_index) + "]");
+    // pinned before the scratchpad is allocated, so it is local to this CPU
+    if(m_first_cpu >= 0 && !tools::set_thread_affinity(m_first_cpu + th_local_index))
+      LOG_PRINT_L0("Failed to pin miner thread [" << th_local_index << "] to a CPU");
     uint32_t nonce = m_starter_nonce + th_local_index;
     uint64_t height = 0;
     difficulty_type local_diff = 0;
     uint32_t local_template_ver = 0;
     block b;
+    // several nonces are tried at once, to hash them together
+    std::vector<block> tries(crypto::CN_SLOW_HASH_MAX_WAYS);
+    std::vector<const block*> try_ptrs;
+    std::vector<uint64_t> try_heights(tries.size());
+    std::vector<crypto::hash> try_hashes;
+    for (const block& t : tries)
+      try_ptrs.push_back(&t);
     slow_hash_allocate_state();
+    LOG_PRINT_L0("Miner thread [" << th_local_index << "] scratchpad uses " << slow_hash_state_pages());
     while(!m_stop)
     {
       if(m_pausers_count)//anti split workaround
@@ -381,27 +398,36 @@ namespace cryptonote
         continue;
       }
 
-      b.nonce = nonce;
-      crypto::hash h;
-      get_block_longhash(b, h, height);
+      for (size_t i = 0; i < tries.size(); ++i)
+      {
+        tries[i] = b;
+        tries[i].nonce = nonce + i * m_threads_total;
+        try_heights[i] = height;
+      }
+      get_block_longhashes(try_ptrs, try_heights, try_hashes);
 
-      if(check_hash(h, local_diff))
+      for (size_t i = 0; i < tries.size(); ++i)
       {
-        //we lucky!
-        ++m_config.current_extra_message_index;
-        LOG_PRINT_GREEN("Found block for difficulty: " << local_diff, LOG_LEVEL_0);
-        if(!m_phandler->handle_block_found(b))
-        {
-          --m_config.current_extra_message_index;
-        }else
+        if(check_hash(try_hashes[i], local_diff))
         {
-          //success update, lets update config
-          if (!m_config_folder_path.empty())
-            epee::serialization::store_t_to_json_file(m_config, m_config_folder_path + "/" + MINER_CONFIG_FILE_NAME);
+          //we lucky!
+          ++m_config.current_extra_message_index;
+          LOG_PRINT_GREEN("Found block for difficulty: " << local_diff, LOG_LEVEL_0);
+          if(!m_phandler->handle_block_found(tries[i]))
+          {
+            --m_config.current_extra_message_index;
+          }else
+          {
+            //success update, lets update config
+            if (!m_config_folder_path.empty())
+              epee::serialization::store_t_to_json_file(m_config, m_config_folder_path + "/" + MINER_CONFIG_FILE_NAME);
+          }
+          // the template is about to change, the other tries are moot
+          break;
         }
       }
-      nonce+=m_threads_total;
-      ++m_hashes;
+      nonce+=m_threads_total * tries.size();
+      m_hashes += tries.size();
     }
     slow_hash_free_state();
     LOG_PRINT_L0("Miner thread stopped ["<< th_local_index << "]");
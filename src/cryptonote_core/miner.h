@@ -99,6 +99,7 @@ namespace cryptonote
     uint64_t m_height;
     volatile uint32_t m_thread_index; 
     volatile uint32_t m_threads_total;
+    int32_t m_first_cpu; // first CPU for mining threads to be pinned to, or -1
     std::atomic<int32_t> m_pausers_count;
     epee::critical_section m_miners_count_lock;
 
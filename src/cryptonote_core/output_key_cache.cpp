@@ -0,0 +1,128 @@
+// Copyright (c) 2014-2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "output_key_cache.h"
+
+namespace cryptonote
+{
+  output_key_cache::output_key_cache(size_t max_size):
+    m_max_shard_size((max_size + OUTPUT_KEY_CACHE_SHARDS - 1) / OUTPUT_KEY_CACHE_SHARDS),
+    m_generation(0)
+  {
+    for (shard &s: m_shards)
+    {
+      s.hits = 0;
+      s.misses = 0;
+    }
+  }
+  //---------------------------------------------------------------
+  bool output_key_cache::get(uint64_t amount, uint64_t index, output_data_t &data)
+  {
+    const key k = {amount, index};
+    shard &s = get_shard(k);
+    boost::lock_guard<boost::mutex> lock(s.lock);
+    auto it = s.index.find(k);
+    if (it == s.index.end())
+    {
+      ++s.misses;
+      return false;
+    }
+    s.lru.splice(s.lru.begin(), s.lru, it->second);
+    data = it->second->data;
+    ++s.hits;
+    return true;
+  }
+  //---------------------------------------------------------------
+  void output_key_cache::put(uint64_t amount, uint64_t index, const output_data_t &data, uint64_t generation)
+  {
+    if (m_max_shard_size == 0)
+      return;
+    const key k = {amount, index};
+    shard &s = get_shard(k);
+    boost::lock_guard<boost::mutex> lock(s.lock);
+    // checked under the shard lock, so an invalidation either sees this
+    // entry or made us skip it
+    if (m_generation.load(std::memory_order_acquire) != generation)
+      return;
+    if (s.index.find(k) != s.index.end())
+      return;
+    if (s.lru.size() >= m_max_shard_size)
+    {
+      // recycle the least recently used entry
+      s.index.erase(s.lru.back().k);
+      s.lru.splice(s.lru.begin(), s.lru, std::prev(s.lru.end()));
+    }
+    else
+    {
+      s.lru.emplace_front();
+    }
+    entry &e = s.lru.front();
+    e.k = k;
+    e.data = data;
+    s.index.emplace(k, s.lru.begin());
+  }
+  //---------------------------------------------------------------
+  void output_key_cache::remove_from_height(uint64_t height)
+  {
+    m_generation.fetch_add(1, std::memory_order_acq_rel);
+    for (shard &s: m_shards)
+    {
+      boost::lock_guard<boost::mutex> lock(s.lock);
+      for (auto it = s.lru.begin(); it != s.lru.end(); )
+      {
+        if (it->data.height >= height)
+        {
+          s.index.erase(it->k);
+          it = s.lru.erase(it);
+        }
+        else
+        {
+          ++it;
+        }
+      }
+    }
+  }
+  //---------------------------------------------------------------
+  void output_key_cache::clear()
+  {
+    remove_from_height(0);
+  }
+  //---------------------------------------------------------------
+  output_key_cache::stats output_key_cache::get_stats() const
+  {
+    stats st = {0, 0, 0, m_max_shard_size * OUTPUT_KEY_CACHE_SHARDS};
+    for (const shard &s: m_shards)
+    {
+      boost::lock_guard<boost::mutex> lock(s.lock);
+      st.hits += s.hits;
+      st.misses += s.misses;
+      st.size += s.lru.size();
+    }
+    return st;
+  }
+}
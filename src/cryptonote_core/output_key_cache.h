@@ -0,0 +1,129 @@
+// Copyright (c) 2014-2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <boost/thread/mutex.hpp>
+
+#include "blockchain_db/blockchain_db.h"
+
+#define OUTPUT_KEY_CACHE_SHARDS 16
+#define OUTPUT_KEY_CACHE_DEFAULT_SIZE 32768
+
+namespace cryptonote
+{
+  /**
+   * @brief bounded LRU cache of output data by (amount, index)
+   *
+   * Ring members are looked up again and again by the txes that use them
+   * as decoys, so Blockchain keeps the ones it looked up recently here.
+   * The cache is split in OUTPUT_KEY_CACHE_SHARDS independently locked
+   * shards, each with its own LRU list, so threads checking different
+   * txes rarely wait on each other.
+   *
+   * Outputs are immutable while they are in the chain, so entries only
+   * have to go when their block is popped, see remove_from_height.
+   */
+  class output_key_cache
+  {
+  public:
+    struct stats
+    {
+      uint64_t hits;
+      uint64_t misses;
+      size_t size;
+      size_t max_size;
+    };
+
+    explicit output_key_cache(size_t max_size = OUTPUT_KEY_CACHE_DEFAULT_SIZE);
+
+    /**
+     * @brief looks an output up
+     *
+     * @return true and sets data if it is cached, false otherwise
+     */
+    bool get(uint64_t amount, uint64_t index, output_data_t &data);
+
+    /**
+     * @brief adds an output read from the db
+     *
+     * Ignored if anything was invalidated since generation() was called,
+     * since the data may come from a block which got popped meanwhile.
+     *
+     * @param generation the value of generation() from before the db read
+     */
+    void put(uint64_t amount, uint64_t index, const output_data_t &data, uint64_t generation);
+
+    //! bumped by each invalidation, see put
+    uint64_t generation() const { return m_generation.load(std::memory_order_acquire); }
+
+    /**
+     * @brief drops the outputs created at or above a height
+     */
+    void remove_from_height(uint64_t height);
+
+    void clear();
+
+    stats get_stats() const;
+
+  private:
+    struct key
+    {
+      uint64_t amount;
+      uint64_t index;
+      bool operator==(const key &other) const { return amount == other.amount && index == other.index; }
+    };
+    struct key_hash
+    {
+      size_t operator()(const key &k) const { return std::hash<uint64_t>()(k.index * 0x9e3779b97f4a7c15ull ^ k.amount); }
+    };
+    struct entry
+    {
+      key k;
+      output_data_t data;
+    };
+    struct shard
+    {
+      mutable boost::mutex lock;
+      std::list<entry> lru; // most recently used first
+      std::unordered_map<key, std::list<entry>::iterator, key_hash> index;
+      uint64_t hits;
+      uint64_t misses;
+    };
+
+    shard &get_shard(const key &k) { return m_shards[key_hash()(k) % OUTPUT_KEY_CACHE_SHARDS]; }
+
+    shard m_shards[OUTPUT_KEY_CACHE_SHARDS];
+    size_t m_max_shard_size;
+    std::atomic<uint64_t> m_generation;
+  };
+}
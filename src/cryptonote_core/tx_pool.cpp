@@ -30,6 +30,7 @@
 
 #include <algorithm>
 #include <boost/filesystem.hpp>
+#include <fstream>
 #include <unordered_set>
 #include <vector>
 
@@ -40,7 +41,9 @@
 #include "blockchain.h"
 #include "common/boost_serialization_helper.h"
 #include "common/int-util.h"
+#include "common/memory_usage.h"
 #include "misc_language.h"
+#include "profile_tools.h"
 #include "warnings.h"
 #include "common/perf_timer.h"
 #include "crypto/hash.h"
@@ -60,6 +63,64 @@ namespace cryptonote
     size_t const TRANSACTION_SIZE_LIMIT_V2 = (((CRYPTONOTE_BLOCK_GRANTED_FULL_REWARD_ZONE_V2 * 125) / 100) - CRYPTONOTE_COINBASE_BLOB_RESERVED_SIZE);
     time_t const MIN_RELAY_TIME = (60 * 5); // only start re-relaying transactions after that many seconds
     time_t const MAX_RELAY_TIME = (60 * 60 * 4); // at most that many seconds between resends
+    size_t const MAX_POOL_CHANGES = 10000; // pool changes kept for get_transaction_changes
+
+    // flat pool state file: magic, version, then tagged records until POOL_STATE_END
+    const char POOL_STATE_MAGIC[8] = {'M', 'O', 'N', 'P', 'O', 'O', 'L', 0};
+    uint32_t const POOL_STATE_VERSION = 1;
+    enum : uint8_t { POOL_STATE_END = 0, POOL_STATE_TX = 1, POOL_STATE_TIMED_OUT = 2 };
+
+    void write_u8(std::ostream& out, uint8_t v)
+    {
+      out.put((char)v);
+    }
+
+    void write_u32(std::ostream& out, uint32_t v)
+    {
+      v = SWAP32LE(v);
+      out.write((const char*)&v, sizeof(v));
+    }
+
+    void write_u64(std::ostream& out, uint64_t v)
+    {
+      v = SWAP64LE(v);
+      out.write((const char*)&v, sizeof(v));
+    }
+
+    void write_hash(std::ostream& out, const crypto::hash& h)
+    {
+      out.write(h.data, sizeof(h.data));
+    }
+
+    bool read_u8(std::istream& in, uint8_t& v)
+    {
+      char c;
+      if (!in.get(c))
+        return false;
+      v = (uint8_t)c;
+      return true;
+    }
+
+    bool read_u32(std::istream& in, uint32_t& v)
+    {
+      if (!in.read((char*)&v, sizeof(v)))
+        return false;
+      v = SWAP32LE(v);
+      return true;
+    }
+
+    bool read_u64(std::istream& in, uint64_t& v)
+    {
+      if (!in.read((char*)&v, sizeof(v)))
+        return false;
+      v = SWAP64LE(v);
+      return true;
+    }
+
+    bool read_hash(std::istream& in, crypto::hash& h)
+    {
+      return (bool)in.read(h.data, sizeof(h.data));
+    }
 
     // a kind of increasing backoff within min/max bounds
     time_t get_relay_delay(time_t now, time_t received)
@@ -72,14 +133,15 @@ namespace cryptonote
   }
   //---------------------------------------------------------------------------------
   //---------------------------------------------------------------------------------
-  tx_memory_pool::tx_memory_pool(Blockchain& bchs): m_blockchain(bchs)
+  tx_memory_pool::tx_memory_pool(Blockchain& bchs): m_txpool_max_size(DEFAULT_TXPOOL_MAX_SIZE), m_txpool_size(0), m_txpool_count(0),
+    // start from the time, so versions from a previous run predate the changes kept
+    m_pool_version((uint64_t)time(NULL) << 20), m_template_version(1), m_blockchain(bchs)
   {
 
   }
   //---------------------------------------------------------------------------------
-  bool tx_memory_pool::add_tx(const transaction &tx, /*const crypto::hash& tx_prefix_hash,*/ const crypto::hash &id, size_t blob_size, tx_verification_context& tvc, bool kept_by_block, bool relayed, uint8_t version)
+  bool tx_memory_pool::check_tx(const transaction &tx, const crypto::hash &id, size_t blob_size, tx_verification_context& tvc, bool kept_by_block, uint8_t version, tx_details& txd) const
   {
-    PERF_TIMER(add_tx);
     if (tx.version == 0)
     {
       // v0 never accepted
@@ -171,28 +233,47 @@ namespace cryptonote
       return false;
     }
 
-    crypto::hash max_used_block_id = null_hash;
-    uint64_t max_used_block_height = 0;
-    tx_details txd;
     txd.tx = tx;
-    bool ch_inp_res = m_blockchain.check_tx_inputs(txd.tx, max_used_block_height, max_used_block_id, tvc, kept_by_block);
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    if(!ch_inp_res)
+    txd.blob_size = blob_size;
+    txd.fee = fee;
+    return true;
+  }
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::insert_tx(const crypto::hash &id, tx_details& txd, bool inputs_ok, tx_verification_context& tvc, bool kept_by_block, bool relayed)
+  {
+    // checked again with the lock held, as transactions checked together
+    // may spend the same key images
+    if(!kept_by_block)
+    {
+      BOOST_FOREACH(const auto& in, txd.tx.vin)
+      {
+        CHECKED_GET_SPECIFIC_VARIANT(in, const txin_to_key, txin, false);
+        if(m_spent_key_images.find(txin.k_image) != m_spent_key_images.end())
+        {
+          LOG_PRINT_L1("Transaction with id= "<< id << " used already spent key images");
+          tvc.m_verifivation_failed = true;
+          tvc.m_double_spend = true;
+          return false;
+        }
+      }
+    }
+
+    txd.kept_by_block = kept_by_block;
+    txd.receive_time = time(nullptr);
+    txd.last_relayed_time = time(NULL);
+    txd.relayed = relayed;
+    txd.last_failed_height = 0;
+    txd.last_failed_id = null_hash;
+    if(!inputs_ok)
     {
       // if the transaction was valid before (kept_by_block), then it
       // may become valid again, so ignore the failed inputs check.
       if(kept_by_block)
       {
+        txd.max_used_block_id = null_hash;
+        txd.max_used_block_height = 0;
         auto txd_p = m_transactions.insert(transactions_container::value_type(id, txd));
         CHECK_AND_ASSERT_MES(txd_p.second, false, "transaction already exists at inserting in memory pool");
-        txd_p.first->second.blob_size = blob_size;
-        txd_p.first->second.fee = fee;
-        txd_p.first->second.max_used_block_id = null_hash;
-        txd_p.first->second.max_used_block_height = 0;
-        txd_p.first->second.kept_by_block = kept_by_block;
-        txd_p.first->second.receive_time = time(nullptr);
-        txd_p.first->second.last_relayed_time = time(NULL);
-        txd_p.first->second.relayed = relayed;
         tvc.m_verifivation_impossible = true;
         tvc.m_added_to_pool = true;
       }else
@@ -206,16 +287,6 @@ namespace cryptonote
       //update transactions container
       auto txd_p = m_transactions.insert(transactions_container::value_type(id, txd));
       CHECK_AND_ASSERT_MES(txd_p.second, false, "internal error: transaction already exists at inserting in memorypool");
-      txd_p.first->second.blob_size = blob_size;
-      txd_p.first->second.kept_by_block = kept_by_block;
-      txd_p.first->second.fee = fee;
-      txd_p.first->second.max_used_block_id = max_used_block_id;
-      txd_p.first->second.max_used_block_height = max_used_block_height;
-      txd_p.first->second.last_failed_height = 0;
-      txd_p.first->second.last_failed_id = null_hash;
-      txd_p.first->second.receive_time = time(nullptr);
-      txd_p.first->second.last_relayed_time = time(NULL);
-      txd_p.first->second.relayed = relayed;
       tvc.m_added_to_pool = true;
 
       if(txd_p.first->second.fee > 0)
@@ -225,6 +296,7 @@ namespace cryptonote
     // assume failure during verification steps until success is certain
     tvc.m_verifivation_failed = true;
 
+    const transaction& tx = m_transactions[id].tx;
     BOOST_FOREACH(const auto& in, tx.vin)
     {
       CHECKED_GET_SPECIFIC_VARIANT(in, const txin_to_key, txin, false);
@@ -238,11 +310,68 @@ namespace cryptonote
 
     tvc.m_verifivation_failed = false;
 
-    m_txs_by_fee.emplace((double)blob_size / fee, id);
+    add_to_indexes(id, m_transactions[id]);
+    bump_template_version();
+    return true;
+  }
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::add_tx(const transaction &tx, /*const crypto::hash& tx_prefix_hash,*/ const crypto::hash &id, size_t blob_size, tx_verification_context& tvc, bool kept_by_block, bool relayed, uint8_t version)
+  {
+    PERF_TIMER(add_tx);
+    tx_details txd;
+    if (!check_tx(tx, id, blob_size, tvc, kept_by_block, version, txd))
+      return false;
+    // a popped block's transactions come back with the blockchain lock held,
+    // which the lock-free signature checks must not be called with
+    if (!kept_by_block)
+      m_blockchain.verify_tx_signatures(std::vector<transaction*>(1, &txd.tx));
+    const bool inputs_ok = m_blockchain.check_tx_inputs(txd.tx, txd.max_used_block_height, txd.max_used_block_id, tvc, kept_by_block);
 
+    boost::unique_lock<boost::shared_mutex> lock(m_transactions_lock);
+    if (!insert_tx(id, txd, inputs_ok, tvc, kept_by_block, relayed))
+      return false;
+    prune();
     return true;
   }
   //---------------------------------------------------------------------------------
+  size_t tx_memory_pool::add_txs(const std::vector<transaction>& txs, const std::vector<crypto::hash>& ids, const std::vector<size_t>& blob_sizes, std::vector<tx_verification_context>& tvcs, bool kept_by_block, bool relayed, uint8_t version)
+  {
+    PERF_TIMER(add_txs);
+    CHECK_AND_ASSERT_MES(txs.size() == ids.size() && txs.size() == blob_sizes.size() && txs.size() == tvcs.size(), 0, "Mismatched transaction batch sizes");
+
+    // cheap checks first, then the signatures of the survivors all at once
+    std::vector<tx_details> details(txs.size());
+    std::vector<bool> checked(txs.size(), false);
+    std::vector<transaction*> to_verify;
+    for (size_t i = 0; i < txs.size(); ++i)
+    {
+      checked[i] = check_tx(txs[i], ids[i], blob_sizes[i], tvcs[i], kept_by_block, version, details[i]);
+      if (checked[i])
+        to_verify.push_back(&details[i].tx);
+    }
+    if (to_verify.empty())
+      return 0;
+    m_blockchain.verify_tx_signatures(to_verify);
+
+    // signatures passing are cached, so this only redoes the serial checks
+    std::vector<bool> inputs_ok(txs.size(), false);
+    for (size_t i = 0; i < txs.size(); ++i)
+    {
+      if (checked[i])
+        inputs_ok[i] = m_blockchain.check_tx_inputs(details[i].tx, details[i].max_used_block_height, details[i].max_used_block_id, tvcs[i], kept_by_block);
+    }
+
+    size_t n_added = 0;
+    boost::unique_lock<boost::shared_mutex> lock(m_transactions_lock);
+    for (size_t i = 0; i < txs.size(); ++i)
+    {
+      if (checked[i] && insert_tx(ids[i], details[i], inputs_ok[i], tvcs[i], kept_by_block, relayed))
+        ++n_added;
+    }
+    prune();
+    return n_added;
+  }
+  //---------------------------------------------------------------------------------
   bool tx_memory_pool::add_tx(const transaction &tx, tx_verification_context& tvc, bool keeped_by_block, bool relayed, uint8_t version)
   {
     crypto::hash h = null_hash;
@@ -256,7 +385,6 @@ namespace cryptonote
   //       is treated properly.  Should probably not return early, however.
   bool tx_memory_pool::remove_transaction_keyimages(const transaction& tx)
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
     // ND: Speedup
     // 1. Move transaction hash calcuation outside of loop. ._.
     crypto::hash actual_hash = get_transaction_hash(tx);
@@ -286,23 +414,16 @@ namespace cryptonote
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::take_tx(const crypto::hash &id, transaction &tx, size_t& blob_size, uint64_t& fee, bool &relayed)
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    boost::unique_lock<boost::shared_mutex> lock(m_transactions_lock);
     auto it = m_transactions.find(id);
     if(it == m_transactions.end())
       return false;
 
-    auto sorted_it = find_tx_in_sorted_container(id);
-
-    if (sorted_it == m_txs_by_fee.end())
-      return false;
-
     tx = it->second.tx;
     blob_size = it->second.blob_size;
     fee = it->second.fee;
     relayed = it->second.relayed;
-    remove_transaction_keyimages(it->second.tx);
-    m_transactions.erase(it);
-    m_txs_by_fee.erase(sorted_it);
+    remove_transaction(it);
     return true;
   }
   //---------------------------------------------------------------------------------
@@ -311,42 +432,95 @@ namespace cryptonote
     m_remove_stuck_tx_interval.do_call([this](){return remove_stuck_transactions();});
   }
   //---------------------------------------------------------------------------------
-  sorted_tx_container::iterator tx_memory_pool::find_tx_in_sorted_container(const crypto::hash& id) const
+  tx_by_fee_entry tx_memory_pool::get_fee_entry(const crypto::hash& id, const tx_details& txd)
+  {
+    return tx_by_fee_entry(txd.fee / (double)txd.blob_size, id);
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::add_to_indexes(const crypto::hash& id, const tx_details& txd)
   {
-    return std::find_if( m_txs_by_fee.begin(), m_txs_by_fee.end()
-                       , [&](const sorted_tx_container::value_type& a){
-                         return a.second == id;
-                       }
-    );
+    m_txs_by_fee.insert(get_fee_entry(id, txd));
+    m_txs_by_receive_time.emplace(txd.receive_time, id);
+    m_txpool_size += txd.blob_size;
+    ++m_txpool_count;
+    record_pool_change(id, true);
+  }
+  //---------------------------------------------------------------------------------
+  tx_memory_pool::transactions_container::iterator tx_memory_pool::remove_transaction(transactions_container::iterator it)
+  {
+    const crypto::hash& id = it->first;
+    const tx_details& txd = it->second;
+    remove_transaction_keyimages(txd.tx);
+    if (!m_txs_by_fee.erase(get_fee_entry(id, txd)))
+    {
+      LOG_PRINT_L1("Removing tx " << id << " from tx pool, but it was not found in the sorted txs container!");
+    }
+    auto range = m_txs_by_receive_time.equal_range(txd.receive_time);
+    for (auto time_it = range.first; time_it != range.second; ++time_it)
+    {
+      if (time_it->second == id)
+      {
+        m_txs_by_receive_time.erase(time_it);
+        break;
+      }
+    }
+    m_txpool_size -= txd.blob_size;
+    --m_txpool_count;
+    record_pool_change(id, false);
+    bump_template_version();
+    return m_transactions.erase(it);
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::record_pool_change(const crypto::hash& id, bool added)
+  {
+    ++m_pool_version;
+    m_pool_changes.push_back({m_pool_version, id, added});
+    if (m_pool_changes.size() > MAX_POOL_CHANGES)
+      m_pool_changes.pop_front();
+    m_blockchain.get_events().publish(added ? chain_events::tx_added : chain_events::tx_removed, id);
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::prune()
+  {
+    // lowest fee per byte last; sorted_it is one past the next candidate,
+    // so it stays valid when the candidate is erased
+    auto sorted_it = m_txs_by_fee.end();
+    while (m_txpool_size > m_txpool_max_size && sorted_it != m_txs_by_fee.begin())
+    {
+      auto candidate = std::prev(sorted_it);
+      auto it = m_transactions.find(candidate->second);
+      if (it == m_transactions.end() || it->second.kept_by_block)
+      {
+        sorted_it = candidate;
+        continue;
+      }
+      LOG_PRINT_L1("Tx " << it->first << " evicted from tx pool, which is over " << m_txpool_max_size << " bytes");
+      remove_transaction(it);
+    }
   }
   //---------------------------------------------------------------------------------
   //TODO: investigate whether boolean return is appropriate
   bool tx_memory_pool::remove_stuck_transactions()
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    for(auto it = m_transactions.begin(); it!= m_transactions.end();)
+    boost::unique_lock<boost::shared_mutex> lock(m_transactions_lock);
+    const time_t now = time(nullptr);
+    // nothing received after this can have expired yet
+    const time_t min_expiry = now - std::min(CRYPTONOTE_MEMPOOL_TX_LIVETIME, CRYPTONOTE_MEMPOOL_TX_FROM_ALT_BLOCK_LIVETIME);
+    for(auto time_it = m_txs_by_receive_time.begin(); time_it != m_txs_by_receive_time.end() && time_it->first < min_expiry;)
     {
-      uint64_t tx_age = time(nullptr) - it->second.receive_time;
+      auto it = m_transactions.find(time_it->second);
+      ++time_it;
+      if (it == m_transactions.end())
+        continue;
+      uint64_t tx_age = now - it->second.receive_time;
 
       if((tx_age > CRYPTONOTE_MEMPOOL_TX_LIVETIME && !it->second.kept_by_block) ||
          (tx_age > CRYPTONOTE_MEMPOOL_TX_FROM_ALT_BLOCK_LIVETIME && it->second.kept_by_block) )
       {
         LOG_PRINT_L1("Tx " << it->first << " removed from tx pool due to outdated, age: " << tx_age );
-        remove_transaction_keyimages(it->second.tx);
-        auto sorted_it = find_tx_in_sorted_container(it->first);
-        if (sorted_it == m_txs_by_fee.end())
-        {
-          LOG_PRINT_L1("Removing tx " << it->first << " from tx pool, but it was not found in the sorted txs container!");
-        }
-        else
-        {
-          m_txs_by_fee.erase(sorted_it);
-        }
         m_timed_out_transactions.insert(it->first);
-        auto pit = it++;
-        m_transactions.erase(pit);
-      }else
-        ++it;
+        remove_transaction(it);
+      }
     }
     return true;
   }
@@ -354,7 +528,7 @@ namespace cryptonote
   //TODO: investigate whether boolean return is appropriate
   bool tx_memory_pool::get_relayable_transactions(std::list<std::pair<crypto::hash, cryptonote::transaction>> &txs) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    boost::shared_lock<boost::shared_mutex> lock(m_transactions_lock);
     const time_t now = time(NULL);
     for(auto it = m_transactions.begin(); it!= m_transactions.end();)
     {
@@ -377,7 +551,7 @@ namespace cryptonote
   //---------------------------------------------------------------------------------
   void tx_memory_pool::set_relayed(const std::list<std::pair<crypto::hash, cryptonote::transaction>> &txs)
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    boost::unique_lock<boost::shared_mutex> lock(m_transactions_lock);
     const time_t now = time(NULL);
     for (auto it = txs.begin(); it != txs.end(); ++it)
     {
@@ -392,21 +566,75 @@ namespace cryptonote
   //---------------------------------------------------------------------------------
   size_t tx_memory_pool::get_transactions_count() const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    return m_transactions.size();
+    return m_txpool_count;
+  }
+  //---------------------------------------------------------------------------------
+  uint64_t tx_memory_pool::get_memory_usage() const
+  {
+    boost::shared_lock<boost::shared_mutex> lock(m_transactions_lock);
+    uint64_t bytes = m_txpool_size;
+    bytes += tools::unordered_container_bytes(m_transactions);
+    bytes += tools::unordered_container_bytes(m_spent_key_images);
+    for (const auto& ki: m_spent_key_images)
+      bytes += tools::unordered_container_bytes(ki.second);
+    bytes += tools::tree_container_bytes(m_txs_by_fee);
+    bytes += tools::tree_container_bytes(m_txs_by_receive_time);
+    bytes += m_pool_changes.size() * sizeof(pool_change);
+    return bytes;
   }
   //---------------------------------------------------------------------------------
   void tx_memory_pool::get_transactions(std::list<transaction>& txs) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    boost::shared_lock<boost::shared_mutex> lock(m_transactions_lock);
     BOOST_FOREACH(const auto& tx_vt, m_transactions)
       txs.push_back(tx_vt.second.tx);
   }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::get_transaction_hashes(std::vector<crypto::hash>& txs, uint64_t& pool_version) const
+  {
+    boost::shared_lock<boost::shared_mutex> lock(m_transactions_lock);
+    txs.reserve(txs.size() + m_transactions.size());
+    for (const auto& tx_vt : m_transactions)
+      txs.push_back(tx_vt.first);
+    pool_version = m_pool_version;
+  }
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::get_transaction_changes(uint64_t since, std::vector<crypto::hash>& added, std::vector<crypto::hash>& removed, uint64_t& pool_version) const
+  {
+    boost::shared_lock<boost::shared_mutex> lock(m_transactions_lock);
+    pool_version = m_pool_version;
+    if (since > m_pool_version)
+      return false;
+    if (since == m_pool_version)
+      return true;
+    // the change right after since must still be kept
+    if (m_pool_changes.empty() || m_pool_changes.front().version > since + 1)
+      return false;
+
+    std::unordered_set<crypto::hash> added_set, removed_set;
+    for (auto it = m_pool_changes.begin() + (since + 1 - m_pool_changes.front().version); it != m_pool_changes.end(); ++it)
+    {
+      if (it->added)
+      {
+        // removed then added back is no change
+        if (!removed_set.erase(it->id))
+          added_set.insert(it->id);
+      }
+      else
+      {
+        if (!added_set.erase(it->id))
+          removed_set.insert(it->id);
+      }
+    }
+    added.assign(added_set.begin(), added_set.end());
+    removed.assign(removed_set.begin(), removed_set.end());
+    return true;
+  }
   //------------------------------------------------------------------
   //TODO: investigate whether boolean return is appropriate
   bool tx_memory_pool::get_transactions_and_spent_keys_info(std::vector<tx_info>& tx_infos, std::vector<spent_key_image_info>& key_image_infos) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    boost::shared_lock<boost::shared_mutex> lock(m_transactions_lock);
     for (const auto& tx_vt : m_transactions)
     {
       tx_info txi;
@@ -442,7 +670,7 @@ namespace cryptonote
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::get_transaction(const crypto::hash& id, transaction& tx) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    boost::shared_lock<boost::shared_mutex> lock(m_transactions_lock);
     auto it = m_transactions.find(id);
     if(it == m_transactions.end())
       return false;
@@ -452,17 +680,46 @@ namespace cryptonote
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::on_blockchain_inc(uint64_t new_block_height, const crypto::hash& top_block_id)
   {
+    bump_template_version();
     return true;
   }
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::on_blockchain_dec(uint64_t new_block_height, const crypto::hash& top_block_id)
   {
+    bump_template_version();
     return true;
   }
   //---------------------------------------------------------------------------------
+  void tx_memory_pool::bump_template_version()
+  {
+    {
+      boost::lock_guard<boost::mutex> lock(m_template_version_lock);
+      ++m_template_version;
+    }
+    m_template_version_changed.notify_all();
+  }
+  //---------------------------------------------------------------------------------
+  uint64_t tx_memory_pool::get_template_version() const
+  {
+    boost::lock_guard<boost::mutex> lock(m_template_version_lock);
+    return m_template_version;
+  }
+  //---------------------------------------------------------------------------------
+  uint64_t tx_memory_pool::wait_template_version(uint64_t version, unsigned timeout_seconds) const
+  {
+    boost::unique_lock<boost::mutex> lock(m_template_version_lock);
+    const boost::chrono::steady_clock::time_point deadline = boost::chrono::steady_clock::now() + boost::chrono::seconds(timeout_seconds);
+    while (m_template_version == version)
+    {
+      if (m_template_version_changed.wait_until(lock, deadline) == boost::cv_status::timeout)
+        break;
+    }
+    return m_template_version;
+  }
+  //---------------------------------------------------------------------------------
   bool tx_memory_pool::have_tx(const crypto::hash &id) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    boost::shared_lock<boost::shared_mutex> lock(m_transactions_lock);
     if(m_transactions.count(id))
       return true;
     return false;
@@ -470,11 +727,12 @@ namespace cryptonote
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::have_tx_keyimges_as_spent(const transaction& tx) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    boost::shared_lock<boost::shared_mutex> lock(m_transactions_lock);
     BOOST_FOREACH(const auto& in, tx.vin)
     {
       CHECKED_GET_SPECIFIC_VARIANT(in, const txin_to_key, tokey_in, true);//should never fail
-      if(have_tx_keyimg_as_spent(tokey_in.k_image))
+      // not have_tx_keyimg_as_spent, shared locks must not nest
+      if(m_spent_key_images.end() != m_spent_key_images.find(tokey_in.k_image))
          return true;
     }
     return false;
@@ -482,10 +740,19 @@ namespace cryptonote
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::have_tx_keyimg_as_spent(const crypto::key_image& key_im) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    boost::shared_lock<boost::shared_mutex> lock(m_transactions_lock);
     return m_spent_key_images.end() != m_spent_key_images.find(key_im);
   }
   //---------------------------------------------------------------------------------
+  void tx_memory_pool::have_tx_keyimgs_as_spent(const std::vector<crypto::key_image>& key_im, std::vector<bool>& spent) const
+  {
+    boost::shared_lock<boost::shared_mutex> lock(m_transactions_lock);
+    spent.clear();
+    spent.reserve(key_im.size());
+    for (const auto& ki : key_im)
+      spent.push_back(m_spent_key_images.end() != m_spent_key_images.find(ki));
+  }
+  //---------------------------------------------------------------------------------
   void tx_memory_pool::lock() const
   {
     m_transactions_lock.lock();
@@ -565,7 +832,7 @@ namespace cryptonote
   std::string tx_memory_pool::print_pool(bool short_format) const
   {
     std::stringstream ss;
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    boost::shared_lock<boost::shared_mutex> lock(m_transactions_lock);
     for (const transactions_container::value_type& txe : m_transactions) {
       const tx_details& txd = txe.second;
       ss << "id: " << txe.first << std::endl;
@@ -591,7 +858,7 @@ namespace cryptonote
     // coins as an argument and appears to do nothing
     // with it.
 
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    boost::unique_lock<boost::shared_mutex> lock(m_transactions_lock);
 
     total_size = 0;
     fee = 0;
@@ -648,26 +915,133 @@ namespace cryptonote
     return true;
   }
   //---------------------------------------------------------------------------------
+  size_t tx_memory_pool::verify_loaded_transactions()
+  {
+    std::vector<transaction> txs;
+    {
+      boost::shared_lock<boost::shared_mutex> lock(m_transactions_lock);
+      txs.reserve(m_transactions.size());
+      for (const auto& tx_vt : m_transactions)
+        txs.push_back(tx_vt.second.tx);
+    }
+    if (txs.empty())
+      return 0;
+
+    std::vector<transaction*> tx_ptrs;
+    tx_ptrs.reserve(txs.size());
+    for (transaction& tx : txs)
+      tx_ptrs.push_back(&tx);
+    TIME_MEASURE_START(t);
+    const size_t n_failed = m_blockchain.verify_tx_signatures(tx_ptrs);
+    TIME_MEASURE_FINISH(t);
+    LOG_PRINT_L0("Verified " << txs.size() << " transactions from the pool in " << t << " ms, "
+        << n_failed << " failed and will be checked again before being mined");
+    return n_failed;
+  }
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::store_state(std::ostream& out) const
+  {
+    out.write(POOL_STATE_MAGIC, sizeof(POOL_STATE_MAGIC));
+    write_u32(out, POOL_STATE_VERSION);
+    blobdata blob;
+    for (const auto& tx_vt : m_transactions)
+    {
+      const tx_details& txd = tx_vt.second;
+      blob.clear();
+      if (!t_serializable_object_to_blob(txd.tx, blob))
+        return false;
+      write_u8(out, POOL_STATE_TX);
+      write_u32(out, blob.size());
+      out.write(blob.data(), blob.size());
+      write_u64(out, txd.fee);
+      write_hash(out, txd.max_used_block_id);
+      write_u64(out, txd.max_used_block_height);
+      write_u8(out, txd.kept_by_block);
+      write_u64(out, txd.last_failed_height);
+      write_hash(out, txd.last_failed_id);
+      write_u64(out, txd.receive_time);
+      write_u64(out, txd.last_relayed_time);
+      write_u8(out, txd.relayed);
+      if (!out)
+        return false;
+    }
+    for (const crypto::hash& id : m_timed_out_transactions)
+    {
+      write_u8(out, POOL_STATE_TIMED_OUT);
+      write_hash(out, id);
+    }
+    write_u8(out, POOL_STATE_END);
+    return (bool)out;
+  }
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::load_state(std::istream& in)
+  {
+    uint32_t version;
+    if (!read_u32(in, version) || version != POOL_STATE_VERSION)
+    {
+      LOG_ERROR("Unsupported memory pool state version");
+      return false;
+    }
+    blobdata blob;
+    while (true)
+    {
+      uint8_t tag;
+      if (!read_u8(in, tag))
+        return false;
+      if (tag == POOL_STATE_END)
+        return true;
+      if (tag == POOL_STATE_TIMED_OUT)
+      {
+        crypto::hash id;
+        if (!read_hash(in, id))
+          return false;
+        m_timed_out_transactions.insert(id);
+        continue;
+      }
+      if (tag != POOL_STATE_TX)
+        return false;
+
+      uint32_t blob_size;
+      if (!read_u32(in, blob_size) || blob_size > CRYPTONOTE_MAX_TX_SIZE)
+        return false;
+      blob.resize(blob_size);
+      if (!in.read(&blob[0], blob_size))
+        return false;
+      tx_details txd;
+      crypto::hash id, prefix_hash;
+      if (!parse_and_validate_tx_from_blob(blob, txd.tx, id, prefix_hash))
+        return false;
+      uint8_t kept_by_block, relayed;
+      uint64_t receive_time, last_relayed_time;
+      txd.blob_size = blob_size;
+      if (!read_u64(in, txd.fee) || !read_hash(in, txd.max_used_block_id) || !read_u64(in, txd.max_used_block_height)
+          || !read_u8(in, kept_by_block) || !read_u64(in, txd.last_failed_height) || !read_hash(in, txd.last_failed_id)
+          || !read_u64(in, receive_time) || !read_u64(in, last_relayed_time) || !read_u8(in, relayed))
+        return false;
+      txd.kept_by_block = kept_by_block;
+      txd.receive_time = receive_time;
+      txd.last_relayed_time = last_relayed_time;
+      txd.relayed = relayed;
+
+      if (!m_transactions.emplace(id, std::move(txd)).second)
+        continue;
+      for (const txin_v& in_v : m_transactions[id].tx.vin)
+      {
+        if (in_v.type() == typeid(txin_to_key))
+          m_spent_key_images[boost::get<txin_to_key>(in_v).k_image].insert(id);
+      }
+    }
+  }
+  //---------------------------------------------------------------------------------
   size_t tx_memory_pool::validate(uint8_t version)
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    boost::unique_lock<boost::shared_mutex> lock(m_transactions_lock);
     size_t n_removed = 0;
     size_t tx_size_limit = (version < 2 ? TRANSACTION_SIZE_LIMIT_V1 : TRANSACTION_SIZE_LIMIT_V2);
     for (auto it = m_transactions.begin(); it != m_transactions.end(); ) {
       if (it->second.blob_size >= tx_size_limit) {
         LOG_PRINT_L1("Transaction " << get_transaction_hash(it->second.tx) << " is too big (" << it->second.blob_size << " bytes), removing it from pool");
-        remove_transaction_keyimages(it->second.tx);
-        auto sorted_it = find_tx_in_sorted_container(it->first);
-        if (sorted_it == m_txs_by_fee.end())
-        {
-          LOG_PRINT_L1("Removing tx " << it->first << " from tx pool, but it was not found in the sorted txs container!");
-        }
-        else
-        {
-          m_txs_by_fee.erase(sorted_it);
-        }
-        auto pit = it++;
-        m_transactions.erase(pit);
+        it = remove_transaction(it);
         ++n_removed;
         continue;
       }
@@ -677,10 +1051,11 @@ namespace cryptonote
   }
   //---------------------------------------------------------------------------------
   //TODO: investigate whether only ever returning true is correct
-  bool tx_memory_pool::init(const std::string& config_folder)
+  bool tx_memory_pool::init(const std::string& config_folder, size_t max_txpool_size)
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    boost::unique_lock<boost::shared_mutex> lock(m_transactions_lock);
 
+    m_txpool_max_size = max_txpool_size;
     m_config_folder = config_folder;
     if (m_config_folder.empty())
       return true;
@@ -689,21 +1064,41 @@ namespace cryptonote
     boost::system::error_code ec;
     if(!boost::filesystem::exists(state_file_path, ec))
       return true;
-    bool res = tools::unserialize_obj_from_file(*this, state_file_path);
-    if(!res)
+    bool res;
+    std::ifstream state_file(state_file_path, std::ios::in | std::ios::binary);
+    char magic[sizeof(POOL_STATE_MAGIC)];
+    if (state_file.read(magic, sizeof(magic)) && !memcmp(magic, POOL_STATE_MAGIC, sizeof(magic)))
+    {
+      // keep what could be read from a truncated file
+      res = load_state(state_file);
+      if (!res)
+        LOG_ERROR("Failed to load all of the memory pool from file " << state_file_path << ", loaded " << m_transactions.size() << " transactions");
+    }
+    else
     {
-      LOG_ERROR("Failed to load memory pool from file " << state_file_path);
+      // from before the flat format
+      state_file.close();
+      res = tools::unserialize_obj_from_file(*this, state_file_path);
+      if(!res)
+      {
+        LOG_ERROR("Failed to load memory pool from file " << state_file_path);
 
-      m_transactions.clear();
-      m_txs_by_fee.clear();
-      m_spent_key_images.clear();
+        m_transactions.clear();
+        m_txs_by_fee.clear();
+        m_spent_key_images.clear();
+      }
     }
 
-    // no need to store queue of sorted transactions, as it's easy to generate.
+    // no need to store the indexes, as they're easy to generate.
+    m_txs_by_fee.clear();
+    m_txs_by_receive_time.clear();
+    m_txpool_size = 0;
+    m_txpool_count = 0;
     for (const auto& tx : m_transactions)
     {
-      m_txs_by_fee.emplace((double)tx.second.blob_size / tx.second.fee, tx.first);
+      add_to_indexes(tx.first, tx.second);
     }
+    prune();
 
     // Ignore deserialization error
     return true;
@@ -727,8 +1122,26 @@ namespace cryptonote
       return false;
     }
 
-    std::string state_file_path = m_config_folder + "/" + CRYPTONOTE_POOLDATA_FILENAME;
-    bool res = tools::serialize_obj_to_file(*this, state_file_path);
+    // written aside and renamed, so a failed write does not lose the last state
+    const std::string state_file_path = m_config_folder + "/" + CRYPTONOTE_POOLDATA_FILENAME;
+    const std::string tmp_file_path = state_file_path + ".tmp";
+    bool res;
+    {
+      boost::shared_lock<boost::shared_mutex> lock(m_transactions_lock);
+      std::ofstream state_file(tmp_file_path, std::ios::out | std::ios::binary | std::ios::trunc);
+      res = state_file && store_state(state_file);
+      if (res)
+      {
+        state_file.flush();
+        res = (bool)state_file;
+      }
+    }
+    if (res)
+    {
+      boost::system::error_code ec;
+      boost::filesystem::rename(tmp_file_path, state_file_path, ec);
+      res = !ec;
+    }
     if(!res)
     {
       LOG_ERROR("Failed to serialize memory pool to file " << state_file_path);
@@ -31,12 +31,18 @@
 #pragma once
 #include "include_base_utils.h"
 
+#include <atomic>
+#include <deque>
+#include <map>
 #include <set>
 #include <unordered_map>
 #include <unordered_set>
 #include <queue>
 #include <boost/serialization/version.hpp>
 #include <boost/utility.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/shared_mutex.hpp>
 
 #include "string_tools.h"
 #include "syncobj.h"
@@ -53,19 +59,19 @@ namespace cryptonote
   /*                                                                      */
   /************************************************************************/
 
-  //! pair of <transaction fee, transaction hash> for organization
+  //! pair of <transaction fee per byte, transaction hash> for organization
   typedef std::pair<double, crypto::hash> tx_by_fee_entry;
 
   class txCompare
   {
   public:
-    bool operator()(const tx_by_fee_entry& a, const tx_by_fee_entry& b)
+    bool operator()(const tx_by_fee_entry& a, const tx_by_fee_entry& b) const
     {
       // sort by greatest first, not least
       if (a.first > b.first) return true;
       else if (a.first < b.first) return false;
-      else if (a.second != b.second) return true;
-      else return false;
+      // ties are ordered by hash, so that lookups find the entry
+      return memcmp(a.second.data, b.second.data, sizeof(a.second.data)) < 0;
     }
   };
 
@@ -123,6 +129,25 @@ namespace cryptonote
      */
     bool add_tx(const transaction &tx, tx_verification_context& tvc, bool kept_by_block, bool relayed, uint8_t version);
 
+    /**
+     * @brief add several transactions to the transaction pool together
+     *
+     * Does the same checks as add_tx for each transaction, but verifies the
+     * signatures of all of them at once on the verification threads, and
+     * takes the pool lock once to insert them.
+     *
+     * @param txs the transactions to be added
+     * @param ids the transactions' hashes
+     * @param blob_sizes the transactions' sizes
+     * @param tvcs return-by-reference status about each transaction's verification
+     * @param kept_by_block have these transactions been in a block?
+     * @param relayed were these transactions from the network or a local client?
+     * @param version the version used to create the transactions
+     *
+     * @return the number of transactions added
+     */
+    size_t add_txs(const std::vector<transaction>& txs, const std::vector<crypto::hash>& ids, const std::vector<size_t>& blob_sizes, std::vector<tx_verification_context>& tvcs, bool kept_by_block, bool relayed, uint8_t version);
+
     /**
      * @brief takes a transaction with the given hash from the pool
      *
@@ -148,7 +173,7 @@ namespace cryptonote
     /**
      * @brief action to take when notified of a block added to the blockchain
      *
-     * Currently does nothing
+     * Bumps the block template version
      *
      * @param new_block_height the height of the blockchain after the change
      * @param top_block_id the hash of the new top block
@@ -160,7 +185,7 @@ namespace cryptonote
     /**
      * @brief action to take when notified of a block removed from the blockchain
      *
-     * Currently does nothing
+     * Bumps the block template version
      *
      * @param new_block_height the height of the blockchain after the change
      * @param top_block_id the hash of the new top block
@@ -177,7 +202,28 @@ namespace cryptonote
     void on_idle();
 
     /**
-     * @brief locks the transaction pool
+     * @brief gets the block template version
+     *
+     * The version changes whenever a block template built now could differ
+     * from one built before: when the pool gains or loses transactions, or
+     * the chain's top block changes.
+     *
+     * @return the current version, starting at 1
+     */
+    uint64_t get_template_version() const;
+
+    /**
+     * @brief waits for the block template version to move on from a given one
+     *
+     * @param version the version to wait to change
+     * @param timeout_seconds how long to wait at most
+     *
+     * @return the version at the time of return
+     */
+    uint64_t wait_template_version(uint64_t version, unsigned timeout_seconds) const;
+
+    /**
+     * @brief locks the transaction pool exclusively
      */
     void lock() const;
 
@@ -192,10 +238,11 @@ namespace cryptonote
      * @brief loads pool state (if any) from disk, and initializes pool
      *
      * @param config_folder folder name where pool state will be
+     * @param max_txpool_size the most bytes of transactions to keep, see prune
      *
      * @return true
      */
-    bool init(const std::string& config_folder);
+    bool init(const std::string& config_folder, size_t max_txpool_size = DEFAULT_TXPOOL_MAX_SIZE);
 
     /**
      * @brief attempts to save the transaction pool state to disk
@@ -228,6 +275,32 @@ namespace cryptonote
      */
     void get_transactions(std::list<transaction>& txs) const;
 
+    /**
+     * @brief get the hashes of all transactions in the pool
+     *
+     * @param txs return-by-reference the transaction hashes
+     * @param pool_version return-by-reference the pool version they are for
+     */
+    void get_transaction_hashes(std::vector<crypto::hash>& txs, uint64_t& pool_version) const;
+
+    /**
+     * @brief get the transactions added to and removed from the pool since
+     *        a given pool version
+     *
+     * A transaction added and removed again since then is in neither list.
+     * Only the most recent changes are kept, so this fails for versions
+     * too old, or from a previous run; the caller should then start over
+     * with get_transaction_hashes.
+     *
+     * @param since the pool version the caller is up to date with
+     * @param added return-by-reference the hashes of added transactions
+     * @param removed return-by-reference the hashes of removed transactions
+     * @param pool_version return-by-reference the current pool version
+     *
+     * @return false if the changes since that version are not known, otherwise true
+     */
+    bool get_transaction_changes(uint64_t since, std::vector<crypto::hash>& added, std::vector<crypto::hash>& removed, uint64_t& pool_version) const;
+
     /**
      * @brief get information about all transactions and key images in the pool
      *
@@ -240,6 +313,16 @@ namespace cryptonote
      */
     bool get_transactions_and_spent_keys_info(std::vector<tx_info>& tx_infos, std::vector<spent_key_image_info>& key_image_infos) const;
 
+    /**
+     * @brief check which of a list of spent key images are in the pool
+     *
+     * plural version of have_tx_keyimg_as_spent, done under a single lock
+     *
+     * @param key_im the spent key images to look for
+     * @param spent return-by-reference whether each key image is present, in input order
+     */
+    void have_tx_keyimgs_as_spent(const std::vector<crypto::key_image>& key_im, std::vector<bool>& spent) const;
+
     /**
      * @brief get a specific transaction from the pool
      *
@@ -274,10 +357,22 @@ namespace cryptonote
     /**
      * @brief get the total number of transactions in the pool
      *
+     * Does not take the pool lock.
+     *
      * @return the number of transactions in the pool
      */
     size_t get_transactions_count() const;
 
+    /**
+     * @brief estimate the memory the pool holds
+     *
+     * A parsed transaction is taken to be about as large as its blob, to
+     * which the estimated size of the pool's indices is added.
+     *
+     * @return the estimate, in bytes
+     */
+    uint64_t get_memory_usage() const;
+
     /**
      * @brief get a string containing human-readable pool information
      *
@@ -300,6 +395,18 @@ namespace cryptonote
      */
     size_t validate(uint8_t version);
 
+    /**
+     * @brief verifies the signatures of the transactions loaded by init
+     *
+     * The signatures are checked together on the blockchain's verification
+     * threads, so that they are already known good when the transactions
+     * are picked for a block template or mined. Transactions failing are
+     * kept, and checked again as usual when filling a block template.
+     *
+     * @return the number of transactions failing
+     */
+    size_t verify_loaded_transactions();
+
 
 #define CURRENT_MEMPOOL_ARCHIVE_VER    11
 #define CURRENT_MEMPOOL_TX_DETAILS_ARCHIVE_VER    11
@@ -311,6 +418,9 @@ namespace cryptonote
      * in, this function does nothing, as it cannot deserialize after a
      * format change.
      *
+     * Only used to load pool state files from before the flat format,
+     * see store_state.
+     *
      * @tparam archive_t the archive class
      * @param a the archive to serialize to/from
      * @param version the archive version
@@ -320,7 +430,7 @@ namespace cryptonote
     {
       if(version < CURRENT_MEMPOOL_ARCHIVE_VER )
         return;
-      CRITICAL_REGION_LOCAL(m_transactions_lock);
+      // the caller holds m_transactions_lock, see init and deinit
       a & m_transactions;
       a & m_spent_key_images;
       a & m_timed_out_transactions;
@@ -406,6 +516,8 @@ namespace cryptonote
      * convenience/speed, so this is part of the process of removing
      * a transaction from the pool.
      *
+     * The caller must hold m_transactions_lock exclusively.
+     *
      * @param tx the transaction
      *
      * @return false if any key images to be removed cannot be found, otherwise true
@@ -458,7 +570,11 @@ namespace cryptonote
 #if defined(DEBUG_CREATE_BLOCK_TEMPLATE)
 public:
 #endif
-    mutable epee::critical_section m_transactions_lock;  //!< lock for the pool
+    //! lock for the pool, shared by the read only accessors
+    /*! Not recursive: functions taking it must not call each other, the
+     *  private helpers expect the caller to hold it.
+     */
+    mutable boost::shared_mutex m_transactions_lock;
     transactions_container m_transactions;  //!< container for transactions in the pool
 #if defined(DEBUG_CREATE_BLOCK_TEMPLATE)
 private:
@@ -471,17 +587,119 @@ private:
     //! interval on which to check for stale/"stuck" transactions
     epee::math_helper::once_a_time_seconds<30> m_remove_stuck_tx_interval;
 
-    //TODO: look into doing this better
     sorted_tx_container m_txs_by_fee;  //!< container for transactions organized by fee per size
+    std::multimap<time_t, crypto::hash> m_txs_by_receive_time;  //!< transactions, oldest first
+    size_t m_txpool_max_size;  //!< the most bytes of transactions to keep
+    size_t m_txpool_size;  //!< bytes of transactions in the pool
+    std::atomic<size_t> m_txpool_count;  //!< transactions in the pool, kept with m_txpool_size
+
+    //! a transaction entering or leaving the pool
+    struct pool_change
+    {
+      uint64_t version;  //!< the pool version after the change
+      crypto::hash id;  //!< the transaction's hash
+      bool added;  //!< true if it entered the pool, false if it left
+    };
+    uint64_t m_pool_version;  //!< bumped on every pool_change
+    std::deque<pool_change> m_pool_changes;  //!< the most recent changes, oldest first
 
     /**
-     * @brief get an iterator to a transaction in the sorted container
+     * @brief the checks of add_tx not needing the pool lock, bar the inputs
      *
-     * @param id the hash of the transaction to look for
+     * @param tx the transaction
+     * @param id the transaction's hash
+     * @param blob_size the transaction's size
+     * @param tvc return-by-reference status about the transaction verification
+     * @param kept_by_block has this transaction been in a block?
+     * @param version the version used to create the transaction
+     * @param txd return-by-reference the transaction, size and fee
+     *
+     * @return true if the transaction passes, otherwise false
+     */
+    bool check_tx(const transaction &tx, const crypto::hash &id, size_t blob_size, tx_verification_context& tvc, bool kept_by_block, uint8_t version, tx_details& txd) const;
+
+    /**
+     * @brief inserts a transaction passing check_tx into the pool
+     *
+     * The caller must hold m_transactions_lock exclusively, and prune after.
+     *
+     * @param id the transaction's hash
+     * @param txd the transaction's details from check_tx and its inputs check
+     * @param inputs_ok whether the inputs check passed
+     * @param tvc return-by-reference status about the transaction verification
+     * @param kept_by_block has this transaction been in a block?
+     * @param relayed was this transaction from the network or a local client?
+     *
+     * @return true if the transaction was added, otherwise false
+     */
+    bool insert_tx(const crypto::hash &id, tx_details& txd, bool inputs_ok, tx_verification_context& tvc, bool kept_by_block, bool relayed);
+
+    /**
+     * @brief writes the pool state in the flat format
+     *
+     * Each transaction is written as it is serialized, the caller must
+     * hold m_transactions_lock.
      *
-     * @return an iterator, possibly to the end of the container if not found
+     * @param out the stream to write to
+     *
+     * @return true if everything was written, otherwise false
      */
-    sorted_tx_container::iterator find_tx_in_sorted_container(const crypto::hash& id) const;
+    bool store_state(std::ostream& out) const;
+
+    /**
+     * @brief reads the pool state written by store_state
+     *
+     * The caller must have read the magic, and hold m_transactions_lock
+     * exclusively. Transactions read before any error are kept.
+     *
+     * @param in the stream to read from
+     *
+     * @return true if the whole state was read, otherwise false
+     */
+    bool load_state(std::istream& in);
+
+    /**
+     * @brief records a transaction entering or leaving the pool
+     *
+     * @param id the transaction's hash
+     * @param added true if it entered the pool, false if it left
+     */
+    void record_pool_change(const crypto::hash& id, bool added);
+
+    /**
+     * @brief gets a transaction's entry in the fee sorted container
+     *
+     * @param id the transaction's hash
+     * @param txd the transaction's details
+     *
+     * @return the entry, whether or not it is in the container
+     */
+    static tx_by_fee_entry get_fee_entry(const crypto::hash& id, const tx_details& txd);
+
+    /**
+     * @brief adds a transaction already in m_transactions to the other indexes
+     *
+     * @param id the transaction's hash
+     * @param txd the transaction's details
+     */
+    void add_to_indexes(const crypto::hash& id, const tx_details& txd);
+
+    /**
+     * @brief removes a transaction from the pool, and from all indexes
+     *
+     * @param it the transaction to remove
+     *
+     * @return an iterator to the transaction after it
+     */
+    transactions_container::iterator remove_transaction(transactions_container::iterator it);
+
+    /**
+     * @brief evicts the transactions paying the least per byte, until the
+     *        pool fits in m_txpool_max_size
+     *
+     * Transactions kept from popped blocks are never evicted.
+     */
+    void prune();
 
     //! transactions which are unlikely to be included in blocks
     /*! These transactions are kept in RAM in case they *are* included
@@ -489,6 +707,13 @@ private:
      */
     std::unordered_set<crypto::hash> m_timed_out_transactions;
 
+    //! notes a change that affects block templates, see get_template_version
+    void bump_template_version();
+
+    uint64_t m_template_version;  //!< the block template version
+    mutable boost::mutex m_template_version_lock;  //!< guards m_template_version
+    mutable boost::condition_variable m_template_version_changed;  //!< signalled on each bump
+
     std::string m_config_folder;  //!< the folder to save state to
     Blockchain& m_blockchain;  //!< reference to the Blockchain object
   };
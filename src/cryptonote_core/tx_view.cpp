@@ -0,0 +1,93 @@
+// Copyright (c) 2014-2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "tx_view.h"
+
+namespace cryptonote
+{
+  void tx_view::build(const transaction &tx)
+  {
+    m_inputs.clear();
+    m_outputs.clear();
+    m_key_offsets.clear();
+    m_all_inputs_to_key = true;
+
+    size_t n_offsets = 0;
+    for (const txin_v &txin: tx.vin)
+      if (txin.type() == typeid(txin_to_key))
+        n_offsets += boost::get<txin_to_key>(txin).key_offsets.size();
+    m_key_offsets.reserve(n_offsets);
+    m_inputs.resize(tx.vin.size());
+    m_outputs.resize(tx.vout.size());
+
+    for (size_t i = 0; i < tx.vin.size(); ++i)
+    {
+      const txin_v &txin = tx.vin[i];
+      input &in = m_inputs[i];
+      in.key_offsets_start = m_key_offsets.size();
+      in.key_offsets_count = 0;
+      in.amount = 0;
+      in.k_image = crypto::key_image();
+      if (txin.type() == typeid(txin_to_key))
+      {
+        const txin_to_key &in_to_key = boost::get<txin_to_key>(txin);
+        in.type = input_to_key;
+        in.amount = in_to_key.amount;
+        in.k_image = in_to_key.k_image;
+        in.key_offsets_count = in_to_key.key_offsets.size();
+        // same as relative_output_offsets_to_absolute, without its copy
+        uint64_t offset = 0;
+        for (uint64_t relative: in_to_key.key_offsets)
+        {
+          offset += relative;
+          m_key_offsets.push_back(offset);
+        }
+        continue;
+      }
+      m_all_inputs_to_key = false;
+      if (txin.type() == typeid(txin_gen))
+      {
+        in.type = input_gen;
+        in.height = boost::get<txin_gen>(txin).height;
+      }
+      else
+      {
+        in.type = input_other;
+      }
+    }
+
+    for (size_t i = 0; i < tx.vout.size(); ++i)
+    {
+      const tx_out &o = tx.vout[i];
+      output &out = m_outputs[i];
+      out.amount = o.amount;
+      out.to_key = o.target.type() == typeid(txout_to_key);
+      out.key = out.to_key ? boost::get<txout_to_key>(o.target).key : crypto::public_key();
+    }
+  }
+}
@@ -0,0 +1,112 @@
+// Copyright (c) 2014-2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "cryptonote_basic.h"
+
+namespace cryptonote
+{
+  /**
+   * @brief flat, read-only copy of the parts of a transaction checks look at
+   *
+   * A transaction keeps its inputs and outputs as vectors of variants, and
+   * each input its own vector of relative key offsets, which suits
+   * serialization but means a type check, a boost::get and a pointer chase
+   * for every look at them. Verification and wallet scanning look at them
+   * over and over, so they build one of these once the tx is parsed and
+   * walk that instead: inputs and outputs are fixed size records in one
+   * array each, and the key offsets of all inputs, already made absolute,
+   * are in a single array.
+   *
+   * The view copies what it needs, it does not point into the transaction,
+   * and it has to be rebuilt if the transaction changes.
+   */
+  class tx_view
+  {
+  public:
+    enum input_type: uint8_t
+    {
+      input_gen,
+      input_to_key,
+      input_other,  //!< script inputs, which no valid tx has
+    };
+
+    struct input
+    {
+      uint8_t type;
+      uint32_t key_offsets_start;  //!< index of the first offset in key_offsets()
+      uint32_t key_offsets_count;
+      union
+      {
+        uint64_t amount;  //!< input_to_key
+        uint64_t height;  //!< input_gen
+      };
+      crypto::key_image k_image;  //!< input_to_key
+    };
+
+    struct output
+    {
+      uint64_t amount;
+      crypto::public_key key;
+      bool to_key;  //!< key is only set for txout_to_key targets
+    };
+
+    tx_view() {}
+    explicit tx_view(const transaction &tx) { build(tx); }
+
+    /**
+     * @brief makes this a view of a tx
+     */
+    void build(const transaction &tx);
+
+    size_t num_inputs() const { return m_inputs.size(); }
+    size_t num_outputs() const { return m_outputs.size(); }
+    const input &in(size_t i) const { return m_inputs[i]; }
+    const output &out(size_t i) const { return m_outputs[i]; }
+    const std::vector<input> &inputs() const { return m_inputs; }
+    const std::vector<output> &outputs() const { return m_outputs; }
+
+    /**
+     * @brief the absolute key offsets of an input, key_offsets_count of them
+     */
+    const uint64_t *key_offsets(const input &in) const { return m_key_offsets.data() + in.key_offsets_start; }
+
+    //! true if every input spends outputs, as all inputs of a non coinbase tx must
+    bool all_inputs_to_key() const { return m_all_inputs_to_key; }
+
+  private:
+    std::vector<input> m_inputs;
+    std::vector<output> m_outputs;
+    std::vector<uint64_t> m_key_offsets;
+    bool m_all_inputs_to_key = false;
+  };
+}
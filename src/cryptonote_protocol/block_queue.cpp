@@ -0,0 +1,217 @@
+// Copyright (c) 2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 
+
+#include <algorithm>
+#include <iterator>
+#include "cryptonote_config.h"
+#include "block_queue.h"
+
+namespace cryptonote
+{
+//------------------------------------------------------------------
+block_queue::block_queue(): m_data_size(0)
+{
+}
+//------------------------------------------------------------------
+void block_queue::add_span(uint64_t start_block_height, std::list<crypto::hash> hashes, const boost::uuids::uuid &connection_id)
+{
+  span s;
+  s.start_block_height = start_block_height;
+  s.hashes = std::move(hashes);
+  s.connection_id = connection_id;
+  s.time = boost::posix_time::microsec_clock::universal_time();
+  s.size = 0;
+  m_spans.insert(std::make_pair(start_block_height, std::move(s)));
+}
+//------------------------------------------------------------------
+bool block_queue::reserve_span(uint64_t first_block_height, const std::list<crypto::hash> &block_hashes, size_t max_blocks, const boost::uuids::uuid &connection_id, uint64_t &start_block_height, std::list<crypto::hash> &span_hashes)
+{
+  CRITICAL_REGION_LOCAL(m_lock);
+  if (block_hashes.empty() || max_blocks == 0)
+    return false;
+
+  const uint64_t end_block_height = first_block_height + block_hashes.size();
+  uint64_t height = first_block_height;
+  auto hash_it = block_hashes.begin();
+
+  // skip past the spans covering the start of the hashes
+  auto it = m_spans.upper_bound(height);
+  if (it != m_spans.begin() && std::prev(it)->second.end_block_height() > height)
+    --it;
+  while (height < end_block_height && it != m_spans.end() && it->first <= height)
+  {
+    const uint64_t next_height = std::min(it->second.end_block_height(), end_block_height);
+    std::advance(hash_it, next_height - height);
+    height = next_height;
+    ++it;
+  }
+  if (height >= end_block_height)
+    return false;
+
+  // with enough buffered, only fill the gap holding back the spans we have
+  if (m_data_size > BLOCK_QUEUE_SIZE_THRESHOLD && !m_spans.empty() && height > m_spans.begin()->first)
+    return false;
+
+  uint64_t gap_end = std::min<uint64_t>(end_block_height, height + max_blocks);
+  if (it != m_spans.end())
+    gap_end = std::min(gap_end, it->first);
+
+  span_hashes.clear();
+  for (uint64_t h = height; h < gap_end; ++h)
+    span_hashes.push_back(*hash_it++);
+  start_block_height = height;
+  add_span(height, span_hashes, connection_id);
+  return true;
+}
+//------------------------------------------------------------------
+bool block_queue::retry_stalled_span(uint64_t first_block_height, const std::list<crypto::hash> &block_hashes, const boost::posix_time::time_duration &age, const boost::uuids::uuid &connection_id, uint64_t &start_block_height, std::list<crypto::hash> &span_hashes)
+{
+  CRITICAL_REGION_LOCAL(m_lock);
+  const boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+  for (auto &e: m_spans)
+  {
+    span &s = e.second;
+    if (s.filled() || s.connection_id == connection_id)
+      continue;
+    if (now - s.time < age)
+      continue;
+    if (s.start_block_height < first_block_height || s.end_block_height() > first_block_height + block_hashes.size())
+      continue;
+    auto hash_it = block_hashes.begin();
+    std::advance(hash_it, s.start_block_height - first_block_height);
+    if (!std::equal(s.hashes.begin(), s.hashes.end(), hash_it))
+      continue;
+
+    s.connection_id = connection_id;
+    s.time = now;
+    start_block_height = s.start_block_height;
+    span_hashes = s.hashes;
+    return true;
+  }
+  return false;
+}
+//------------------------------------------------------------------
+bool block_queue::fill_span(const crypto::hash &block_hash, const std::vector<block_complete_entry> &blocks, const boost::uuids::uuid &connection_id)
+{
+  CRITICAL_REGION_LOCAL(m_lock);
+  for (auto &e: m_spans)
+  {
+    span &s = e.second;
+    if (s.filled() || s.hashes.size() != blocks.size())
+      continue;
+    if (std::find(s.hashes.begin(), s.hashes.end(), block_hash) == s.hashes.end())
+      continue;
+
+    s.blocks = blocks;
+    s.connection_id = connection_id;
+    s.time = boost::posix_time::microsec_clock::universal_time();
+    for (const auto &b: s.blocks)
+    {
+      s.size += b.block.size();
+      for (const auto &tx: b.txs)
+        s.size += tx.size();
+    }
+    m_data_size += s.size;
+    return true;
+  }
+  return false;
+}
+//------------------------------------------------------------------
+bool block_queue::has_next_span(uint64_t height) const
+{
+  CRITICAL_REGION_LOCAL(m_lock);
+  if (m_spans.empty())
+    return false;
+  const span &s = m_spans.begin()->second;
+  return s.filled() && s.start_block_height <= height;
+}
+//------------------------------------------------------------------
+bool block_queue::get_next_span(uint64_t height, uint64_t &start_block_height, std::vector<block_complete_entry> &blocks, boost::uuids::uuid &connection_id)
+{
+  CRITICAL_REGION_LOCAL(m_lock);
+  if (!has_next_span(height))
+    return false;
+  span &s = m_spans.begin()->second;
+  start_block_height = s.start_block_height;
+  blocks = std::move(s.blocks);
+  connection_id = s.connection_id;
+  m_data_size -= s.size;
+  m_spans.erase(m_spans.begin());
+  return true;
+}
+//------------------------------------------------------------------
+void block_queue::mark_spans_stalled(const boost::uuids::uuid &connection_id)
+{
+  CRITICAL_REGION_LOCAL(m_lock);
+  for (auto &e: m_spans)
+  {
+    if (!e.second.filled() && e.second.connection_id == connection_id)
+      e.second.time = boost::posix_time::min_date_time;
+  }
+}
+//------------------------------------------------------------------
+void block_queue::flush_spans(const boost::uuids::uuid &connection_id)
+{
+  CRITICAL_REGION_LOCAL(m_lock);
+  for (auto it = m_spans.begin(); it != m_spans.end(); )
+  {
+    if (it->second.connection_id == connection_id)
+    {
+      m_data_size -= it->second.size;
+      it = m_spans.erase(it);
+    }
+    else
+      ++it;
+  }
+}
+//------------------------------------------------------------------
+void block_queue::release_spans(const boost::uuids::uuid &connection_id)
+{
+  CRITICAL_REGION_LOCAL(m_lock);
+  for (auto it = m_spans.begin(); it != m_spans.end(); )
+  {
+    if (!it->second.filled() && it->second.connection_id == connection_id)
+      it = m_spans.erase(it);
+    else
+      ++it;
+  }
+}
+//------------------------------------------------------------------
+size_t block_queue::get_data_size() const
+{
+  CRITICAL_REGION_LOCAL(m_lock);
+  return m_data_size;
+}
+//------------------------------------------------------------------
+size_t block_queue::get_num_spans() const
+{
+  CRITICAL_REGION_LOCAL(m_lock);
+  return m_spans.size();
+}
+}
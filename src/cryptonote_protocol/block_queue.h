@@ -0,0 +1,141 @@
+// Copyright (c) 2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 
+
+#pragma once
+
+#include <list>
+#include <map>
+#include <vector>
+#include <boost/uuid/uuid.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include "syncobj.h"
+#include "crypto/hash.h"
+#include "cryptonote_protocol_defs.h"
+
+namespace cryptonote
+{
+  /**
+   * @brief blocks downloaded during sync, kept as spans of consecutive heights
+   *
+   * Each synchronizing connection reserves a span of heights nobody else is
+   * fetching, and fills it when the blocks arrive. Filled spans are handed out
+   * strictly in height order, so blocks from several peers can be downloaded
+   * at once and still be added to the chain by a single consumer.
+   */
+  class block_queue
+  {
+  public:
+    struct span
+    {
+      uint64_t start_block_height;
+      std::list<crypto::hash> hashes;
+      std::vector<block_complete_entry> blocks;
+      boost::uuids::uuid connection_id;
+      boost::posix_time::ptime time;
+      size_t size;
+
+      bool filled() const { return !blocks.empty(); }
+      uint64_t end_block_height() const { return start_block_height + hashes.size(); }
+    };
+
+    block_queue();
+
+    /**
+     * @brief reserve the first heights of a connection's needed blocks not yet queued
+     *
+     * @param first_block_height height of the first hash in block_hashes
+     * @param block_hashes consecutive block hashes the connection can serve
+     * @param max_blocks the most blocks to reserve
+     * @param connection_id the connection which will fetch the span
+     * @param start_block_height return-by-reference height of the reserved span
+     * @param span_hashes return-by-reference hashes of the reserved span
+     *
+     * @return true if a span was reserved, false if everything is queued or
+     * too much is already buffered ahead of the next span to add
+     */
+    bool reserve_span(uint64_t first_block_height, const std::list<crypto::hash> &block_hashes, size_t max_blocks, const boost::uuids::uuid &connection_id, uint64_t &start_block_height, std::list<crypto::hash> &span_hashes);
+
+    /**
+     * @brief take over the lowest stalled span another connection is too slow to fill
+     *
+     * The span is only handed over if its hashes match the ones the caller
+     * knows at those heights.
+     *
+     * @return true if a span was taken over, false otherwise
+     */
+    bool retry_stalled_span(uint64_t first_block_height, const std::list<crypto::hash> &block_hashes, const boost::posix_time::time_duration &age, const boost::uuids::uuid &connection_id, uint64_t &start_block_height, std::list<crypto::hash> &span_hashes);
+
+    /**
+     * @brief fill the reserved span containing the given block
+     *
+     * @return false if no unfilled span of that size contains the block,
+     * eg. because another connection delivered it first
+     */
+    bool fill_span(const crypto::hash &block_hash, const std::vector<block_complete_entry> &blocks, const boost::uuids::uuid &connection_id);
+
+    /**
+     * @brief checks whether the lowest span is filled and may be added at the given height
+     */
+    bool has_next_span(uint64_t height) const;
+
+    /**
+     * @brief removes and returns the lowest span if it is filled and may be added at the given height
+     *
+     * @return true if a span was returned, false otherwise
+     */
+    bool get_next_span(uint64_t height, uint64_t &start_block_height, std::vector<block_complete_entry> &blocks, boost::uuids::uuid &connection_id);
+
+    /**
+     * @brief lets other connections take over the spans a connection did not fill yet
+     */
+    void mark_spans_stalled(const boost::uuids::uuid &connection_id);
+
+    /**
+     * @brief drops everything a connection reserved or delivered
+     */
+    void flush_spans(const boost::uuids::uuid &connection_id);
+
+    /**
+     * @brief drops the spans a connection reserved but did not fill yet
+     */
+    void release_spans(const boost::uuids::uuid &connection_id);
+
+    size_t get_data_size() const;
+    size_t get_num_spans() const;
+
+  private:
+    typedef std::map<uint64_t, span> span_map;
+
+    void add_span(uint64_t start_block_height, std::list<crypto::hash> hashes, const boost::uuids::uuid &connection_id);
+
+    span_map m_spans; //!< spans by start height, never overlapping
+    size_t m_data_size; //!< bytes of the blocks in filled spans
+    mutable epee::critical_section m_lock;
+  };
+}
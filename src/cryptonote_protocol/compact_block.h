@@ -0,0 +1,109 @@
+// Copyright (c) 2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 
+
+#pragma once
+
+#include <cstring>
+#include <string>
+#include <vector>
+#include "crypto/hash.h"
+#include "common/int-util.h"
+#include "cryptonote_protocol/blobdatatype.h"
+
+// bytes of a transaction's short id in a compact block
+#define COMPACT_TX_ID_SIZE 6
+
+namespace cryptonote
+{
+  /**
+   * @brief gets the key a compact block's short transaction ids are made with
+   *
+   * The key depends on the block and on a salt picked by the sender, so
+   * that transactions colliding with a block's short ids cannot be made
+   * ahead of time.
+   *
+   * @param block_blob the block, serialized without its transaction hashes
+   * @param salt the sender's salt
+   *
+   * @return the key
+   */
+  inline crypto::hash get_compact_block_key(const blobdata& block_blob, uint64_t salt)
+  {
+    blobdata data = block_blob;
+    salt = SWAP64LE(salt);
+    data.append((const char*)&salt, sizeof(salt));
+    return crypto::cn_fast_hash(data.data(), data.size());
+  }
+
+  /**
+   * @brief gets a transaction's short id in a compact block
+   *
+   * @param key the key from get_compact_block_key
+   * @param tx_hash the transaction's hash
+   *
+   * @return the first COMPACT_TX_ID_SIZE bytes of the keyed hash, in a uint64_t
+   */
+  inline uint64_t get_compact_tx_id(const crypto::hash& key, const crypto::hash& tx_hash)
+  {
+    char data[2 * sizeof(crypto::hash)];
+    memcpy(data, &key, sizeof(key));
+    memcpy(data + sizeof(key), &tx_hash, sizeof(tx_hash));
+    const crypto::hash h = crypto::cn_fast_hash(data, sizeof(data));
+    uint64_t id = 0;
+    memcpy(&id, &h, COMPACT_TX_ID_SIZE);
+    return SWAP64LE(id);
+  }
+
+  /**
+   * @brief appends a short id to a compact block's list of them
+   *
+   * @param ids the list, COMPACT_TX_ID_SIZE bytes per transaction
+   * @param id the short id from get_compact_tx_id
+   */
+  inline void append_compact_tx_id(std::string& ids, uint64_t id)
+  {
+    id = SWAP64LE(id);
+    ids.append((const char*)&id, COMPACT_TX_ID_SIZE);
+  }
+
+  /**
+   * @brief reads a short id from a compact block's list of them
+   *
+   * @param ids the list, COMPACT_TX_ID_SIZE bytes per transaction
+   * @param index the transaction's index in the block
+   *
+   * @return the short id
+   */
+  inline uint64_t read_compact_tx_id(const std::string& ids, size_t index)
+  {
+    uint64_t id = 0;
+    memcpy(&id, ids.data() + index * COMPACT_TX_ID_SIZE, COMPACT_TX_ID_SIZE);
+    return SWAP64LE(id);
+  }
+}
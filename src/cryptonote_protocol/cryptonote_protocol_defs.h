@@ -31,6 +31,7 @@
 #pragma once
 
 #include <list>
+#include <vector>
 #include "serialization/keyvalue_serialization.h"
 #include "cryptonote_core/cryptonote_basic.h"
 #include "cryptonote_protocol/blobdatatype.h"
@@ -72,6 +73,14 @@ namespace cryptonote
   
 	uint32_t support_flags;
 
+    uint64_t send_queue_bytes;
+    uint64_t recv_buffer_bytes;
+
+    uint64_t verification_us;
+    uint64_t serving_us;
+    uint64_t useful_objects;
+    bool deprioritized;
+
     BEGIN_KV_SERIALIZE_MAP()
       KV_SERIALIZE(incoming)
       KV_SERIALIZE(localhost)
@@ -90,6 +99,12 @@ namespace cryptonote
       KV_SERIALIZE(avg_upload)
       KV_SERIALIZE(current_upload)
       KV_SERIALIZE(support_flags)
+      KV_SERIALIZE(send_queue_bytes)
+      KV_SERIALIZE(recv_buffer_bytes)
+      KV_SERIALIZE(verification_us)
+      KV_SERIALIZE(serving_us)
+      KV_SERIALIZE(useful_objects)
+      KV_SERIALIZE(deprioritized)
     END_KV_SERIALIZE_MAP()
   };
 
@@ -99,7 +114,7 @@ namespace cryptonote
   struct block_complete_entry
   {
     blobdata block;
-    std::list<blobdata> txs;
+    std::vector<blobdata> txs;
     BEGIN_KV_SERIALIZE_MAP()
       KV_SERIALIZE(block)
       KV_SERIALIZE(txs)
@@ -169,9 +184,9 @@ namespace cryptonote
 
     struct request
     {
-      std::list<blobdata>              txs;
-      std::list<block_complete_entry>  blocks;
-      std::list<crypto::hash>               missed_ids;
+      std::vector<blobdata>              txs;
+      std::vector<block_complete_entry>  blocks;
+      std::vector<crypto::hash>          missed_ids;
       uint64_t                         current_blockchain_height;
 
       BEGIN_KV_SERIALIZE_MAP()
@@ -202,9 +217,11 @@ namespace cryptonote
     struct request
     {
       std::list<crypto::hash> block_ids; /*IDs of the first 10 blocks are sequential, next goes with pow(2,n) offset, like 2, 4, 8, 16, 32, 64 and so on, and the last one is always genesis block */
+      bool headers; /* also send the headers of the blocks in the response, older nodes ignore this */
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE_CONTAINER_POD_AS_BLOB(block_ids)
+        KV_SERIALIZE(headers)
       END_KV_SERIALIZE_MAP()
     };
   };
@@ -218,11 +235,13 @@ namespace cryptonote
       uint64_t start_height;
       uint64_t total_height;
       std::list<crypto::hash> m_block_ids;
+      std::vector<blobdata> m_block_headers; /* hashing blobs of m_block_ids when asked for, empty otherwise */
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(start_height)
         KV_SERIALIZE(total_height)
         KV_SERIALIZE_CONTAINER_POD_AS_BLOB(m_block_ids)
+        KV_SERIALIZE(m_block_headers)
       END_KV_SERIALIZE_MAP()
     };
   };
@@ -271,4 +290,52 @@ namespace cryptonote
     };
   }; 
     
+  /************************************************************************/
+  /*                                                                      */
+  /************************************************************************/
+  struct NOTIFY_NEW_COMPACT_BLOCK
+  {
+    const static int ID = BC_COMMANDS_POOL_BASE + 10;
+
+    struct request
+    {
+      blobdata block;  // without its transaction hashes
+      crypto::hash block_id;
+      uint64_t salt;
+      std::string short_tx_ids;  // COMPACT_TX_ID_SIZE bytes per transaction, see compact_block.h
+      uint64_t current_blockchain_height;
+      uint32_t hop;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(block)
+        KV_SERIALIZE_VAL_POD_AS_BLOB(block_id)
+        KV_SERIALIZE(salt)
+        KV_SERIALIZE(short_tx_ids)
+        KV_SERIALIZE(current_blockchain_height)
+        KV_SERIALIZE(hop)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  /************************************************************************/
+  /*                                                                      */
+  /************************************************************************/
+  struct NOTIFY_COMPRESSED
+  {
+    const static int ID = BC_COMMANDS_POOL_BASE + 11;
+
+    struct request
+    {
+      uint32_t command;  // the notification carried, only sent to peers with P2P_SUPPORT_FLAG_COMPRESSION
+      uint64_t size;     // its size once inflated
+      std::string data;  // its deflated body, see tools::compress
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(command)
+        KV_SERIALIZE(size)
+        KV_SERIALIZE(data)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
 }
@@ -37,16 +37,25 @@
 #include <boost/program_options/variables_map.hpp>
 #include <string>
 #include <ctime>
+#include <set>
+#include <unordered_map>
 
 #include "storages/levin_abstract_invoke2.h"
 #include "warnings.h"
 #include "cryptonote_protocol_defs.h"
 #include "cryptonote_protocol_handler_common.h"
+#include "block_queue.h"
+#include "orphan_block_buffer.h"
+#include "common/compression.h"
 #include "cryptonote_core/connection_context.h"
 #include "cryptonote_core/cryptonote_stat_info.h"
 #include "cryptonote_core/verification_context.h"
 // #include <netinet/in.h>
 #include <boost/circular_buffer.hpp>
+#include <boost/chrono/chrono.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include "math_helper.h"
 
 PUSH_WARNINGS
 DISABLE_VS_WARNINGS(4355)
@@ -92,7 +101,9 @@ namespace cryptonote
       HANDLE_NOTIFY_T2(NOTIFY_REQUEST_CHAIN, &cryptonote_protocol_handler::handle_request_chain)
       HANDLE_NOTIFY_T2(NOTIFY_RESPONSE_CHAIN_ENTRY, &cryptonote_protocol_handler::handle_response_chain_entry)
       HANDLE_NOTIFY_T2(NOTIFY_NEW_FLUFFY_BLOCK, &cryptonote_protocol_handler::handle_notify_new_fluffy_block)			
-      HANDLE_NOTIFY_T2(NOTIFY_REQUEST_FLUFFY_MISSING_TX, &cryptonote_protocol_handler::handle_request_fluffy_missing_tx)						
+      HANDLE_NOTIFY_T2(NOTIFY_REQUEST_FLUFFY_MISSING_TX, &cryptonote_protocol_handler::handle_request_fluffy_missing_tx)
+      HANDLE_NOTIFY_T2(NOTIFY_NEW_COMPACT_BLOCK, &cryptonote_protocol_handler::handle_notify_new_compact_block)						
+      HANDLE_NOTIFY_T2(NOTIFY_COMPRESSED, &cryptonote_protocol_handler::handle_notify_compressed)
     END_INVOKE_MAP2()
 
     bool on_idle();
@@ -110,6 +121,8 @@ namespace cryptonote
     void log_connections();
     std::list<connection_info> get_connections();
     void stop();
+    void on_connection_close(cryptonote_connection_context &context);
+    epee::net_utils::traffic_class get_traffic_class(int command) const;
   private:
     //----------------- commands handlers ----------------------------------------------
     int handle_notify_new_block(int command, NOTIFY_NEW_BLOCK::request& arg, cryptonote_connection_context& context);
@@ -120,6 +133,8 @@ namespace cryptonote
     int handle_response_chain_entry(int command, NOTIFY_RESPONSE_CHAIN_ENTRY::request& arg, cryptonote_connection_context& context);
     int handle_notify_new_fluffy_block(int command, NOTIFY_NEW_FLUFFY_BLOCK::request& arg, cryptonote_connection_context& context);
     int handle_request_fluffy_missing_tx(int command, NOTIFY_REQUEST_FLUFFY_MISSING_TX::request& arg, cryptonote_connection_context& context);
+    int handle_notify_new_compact_block(int command, NOTIFY_NEW_COMPACT_BLOCK::request& arg, cryptonote_connection_context& context);
+    int handle_notify_compressed(int command, NOTIFY_COMPRESSED::request& arg, cryptonote_connection_context& context);
 		
     //----------------- i_bc_protocol_layout ---------------------------------------
     virtual bool relay_block(NOTIFY_NEW_BLOCK::request& arg, cryptonote_connection_context& exclude_context);
@@ -127,8 +142,55 @@ namespace cryptonote
     //----------------------------------------------------------------------------------
     //bool get_payload_sync_data(HANDSHAKE_DATA::request& hshd, cryptonote_connection_context& context);
     bool request_missing_objects(cryptonote_connection_context& context, bool check_having_blocks);
+    size_t get_block_sync_count(const cryptonote_connection_context& context);
+    void notify_sync_thread();
+    void sync_thread();
+    void add_next_spans();
+    bool add_span_blocks(const std::vector<block_complete_entry>& blocks, bool check_having_blocks, const boost::uuids::uuid& connection_id);
+    void drop_span_connection(const boost::uuids::uuid& connection_id);
+    void kick_idle_peers();
+    void check_sync_peers();
     size_t get_synchronizing_connections_count();
     bool on_connection_synchronized();
+    void note_block_announce(const crypto::hash& id, const cryptonote_connection_context& context);
+    //! adds time a peer caused to its cost: checking what it sent counts
+    //! against its budget for the window, answering its requests does not
+    void charge_peer_cost(cryptonote_connection_context& context, uint64_t us, size_t useful, bool serving);
+    void check_peer_costs();
+
+    //! charges the time until it goes out of scope, or finish(), to a peer
+    class peer_cost_scope
+    {
+    public:
+      peer_cost_scope(t_cryptonote_protocol_handler& handler, cryptonote_connection_context& context, bool serving):
+        m_handler(handler), m_context(context), m_serving(serving), m_useful(0), m_start(boost::chrono::steady_clock::now()), m_done(false) {}
+      ~peer_cost_scope() { finish(); }
+      void add_useful(size_t count) { m_useful += count; }
+      void finish()
+      {
+        if (m_done)
+          return;
+        m_done = true;
+        const uint64_t us = boost::chrono::duration_cast<boost::chrono::microseconds>(boost::chrono::steady_clock::now() - m_start).count();
+        m_handler.charge_peer_cost(m_context, us, m_useful, m_serving);
+      }
+    private:
+      t_cryptonote_protocol_handler& m_handler;
+      cryptonote_connection_context& m_context;
+      const bool m_serving;
+      size_t m_useful;
+      const boost::chrono::steady_clock::time_point m_start;
+      bool m_done;
+    };
+    void flush_tx_relay_queue();
+
+    //! the peers relay_block sends to, by whether they take early relayed blocks
+    enum relay_peers { relay_all, relay_early_peers, relay_other_peers };
+    bool relay_block(NOTIFY_NEW_BLOCK::request& arg, cryptonote_connection_context& exclude_context, relay_peers peers);
+    bool relay_block_early(const NOTIFY_NEW_BLOCK::request& arg, cryptonote_connection_context& context);
+    bool tolerate_failed_block(const blobdata& block_blob, cryptonote_connection_context& context);
+    void keep_orphan_block(const block_complete_entry& entry);
+    void add_orphan_children(const crypto::hash& parent);
     t_core& m_core;
 
     nodetool::p2p_endpoint_stub<connection_context> m_p2p_stub;
@@ -137,10 +199,32 @@ namespace cryptonote
     std::atomic<bool> m_synchronized;
     bool m_one_request = true;
     std::atomic<bool> m_stopping;
+    block_queue m_block_queue;
+    orphan_block_buffer m_orphan_blocks;
+    boost::mutex m_sync_lock;
+    boost::condition_variable m_sync_cond;
+    boost::thread m_sync_thread;
+    std::atomic<double> m_median_sync_rate{0};
+    std::atomic<uint64_t> m_recent_block_size{0}; // refreshed by the sync thread, so downloaders need not wait on the chain
+    epee::math_helper::once_a_time_seconds<5> m_idle_peer_kicker;
+    epee::math_helper::once_a_time_seconds<P2P_PEER_COST_WINDOW> m_peer_cost_checker;
+
+    struct queued_tx
+    {
+      crypto::hash hash; // of the blob, as in m_known_txs
+      blobdata blob;
+      boost::uuids::uuid source; // connection it came from, if any
+    };
+    // txes to relay, coalesced until the next idle tick
+    boost::mutex m_tx_relay_lock;
+    std::vector<queued_tx> m_tx_relay_queue;
 
 		// static std::ofstream m_logreq;
     boost::mutex m_buffer_mutex;
     double get_avg_block_size();
+    boost::mutex m_block_announces_lock;
+    // first time each recent block was announced, and by which connections
+    std::unordered_map<crypto::hash, std::pair<uint64_t, std::set<boost::uuids::uuid>>> m_block_announces;
     boost::circular_buffer<size_t> m_avg_buffer = boost::circular_buffer<size_t>(10);
 
     template<class t_parameter>
@@ -153,6 +237,29 @@ namespace cryptonote
         return m_p2p->invoke_notify_to_peer(t_parameter::ID, blob, context);
       }
 
+      // as post_notify, deflated if large and the peer can inflate it
+      template<class t_parameter>
+      bool post_notify_compressible(typename t_parameter::request& arg, cryptonote_connection_context& context)
+      {
+        std::string blob;
+        epee::serialization::store_t_to_binary(arg, blob);
+        if (blob.size() >= P2P_COMPRESSION_THRESHOLD && (m_p2p->get_support_flags(context) & P2P_SUPPORT_FLAG_COMPRESSION))
+        {
+          NOTIFY_COMPRESSED::request compressed;
+          compressed.command = t_parameter::ID;
+          compressed.size = blob.size();
+          if (tools::compress(blob, compressed.data) && compressed.data.size() < blob.size())
+          {
+            LOG_PRINT_L2("[" << epee::net_utils::print_connection_context_short(context) << "] post " << typeid(t_parameter).name() << " deflated " << blob.size() << " -> " << compressed.data.size() << " -->");
+            std::string compressed_blob;
+            epee::serialization::store_t_to_binary(compressed, compressed_blob);
+            return m_p2p->invoke_notify_to_peer(NOTIFY_COMPRESSED::ID, compressed_blob, context);
+          }
+        }
+        LOG_PRINT_L2("[" << epee::net_utils::print_connection_context_short(context) << "] post " << typeid(t_parameter).name() << " -->");
+        return m_p2p->invoke_notify_to_peer(t_parameter::ID, blob, context);
+      }
+
       template<class t_parameter>
       bool relay_post_notify(typename t_parameter::request& arg, cryptonote_connection_context& exclude_context)
       {
@@ -38,8 +38,10 @@
 #include <boost/interprocess/detail/atomic.hpp>
 #include <list>
 #include <unordered_map>
+#include <unordered_set>
 
 #include "cryptonote_core/cryptonote_format_utils.h"
+#include "cryptonote_protocol/compact_block.h"
 #include "profile_tools.h"
 #include "../../contrib/otshell_utils/utils.hpp"
 #include "../../src/p2p/network_throttle-detail.hpp"
@@ -61,7 +63,8 @@ namespace cryptonote
                                                                                                               m_p2p(p_net_layout),
                                                                                                               m_syncronized_connections_count(0),
                                                                                                               m_synchronized(false),
-                                                                                                              m_stopping(false)
+                                                                                                              m_stopping(false),
+                                                                                                              m_orphan_blocks(ORPHAN_BLOCKS_MAX_SIZE, ORPHAN_BLOCKS_MAX_COUNT)
 
   {
     if(!m_p2p)
@@ -71,12 +74,17 @@ namespace cryptonote
   template<class t_core>
   bool t_cryptonote_protocol_handler<t_core>::init(const boost::program_options::variables_map& vm)
   {
+    m_sync_thread = boost::thread(boost::bind(&t_cryptonote_protocol_handler<t_core>::sync_thread, this));
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core>
   bool t_cryptonote_protocol_handler<t_core>::deinit()
   {
+    m_stopping = true;
+    notify_sync_thread();
+    if(m_sync_thread.joinable())
+      m_sync_thread.join();
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------
@@ -96,10 +104,16 @@ namespace cryptonote
     CHECK_AND_ASSERT_MES_CC( context.m_callback_request_count > 0, false, "false callback fired, but context.m_callback_request_count=" << context.m_callback_request_count);
     --context.m_callback_request_count;
 
-    if(context.m_state == cryptonote_connection_context::state_synchronizing)
+    if(context.m_state == cryptonote_connection_context::state_synchronizing && context.m_needed_objects.size())
+    {
+      // kicked while waiting for other peers' spans
+      request_missing_objects(context, true);
+    }
+    else if(context.m_state == cryptonote_connection_context::state_synchronizing)
     {
       NOTIFY_REQUEST_CHAIN::request r = boost::value_initialized<NOTIFY_REQUEST_CHAIN::request>();
       m_core.get_short_chain_history(r.block_ids);
+      r.headers = true;
       LOG_PRINT_CCONTEXT_L2("-->>NOTIFY_REQUEST_CHAIN: m_block_ids.size()=" << r.block_ids.size() );
       post_notify<NOTIFY_REQUEST_CHAIN>(r, context);
     }
@@ -210,6 +224,14 @@ namespace cryptonote
       cnx.send_count = cntxt.m_send_cnt;
       cnx.send_idle_time = timestamp;
 
+      cnx.send_queue_bytes = cntxt.m_send_que_bytes;
+      cnx.recv_buffer_bytes = cntxt.m_recv_buffer_bytes;
+
+      cnx.verification_us = cntxt.m_verification_us;
+      cnx.serving_us = cntxt.m_serving_us;
+      cnx.useful_objects = cntxt.m_useful_objects;
+      cnx.deprioritized = cntxt.m_deprioritized;
+
       cnx.state = get_protocol_state_string(cntxt.m_state);
 
       cnx.live_time = timestamp - cntxt.m_started;
@@ -321,8 +343,12 @@ namespace cryptonote
     LOG_PRINT_CCONTEXT_L2("NOTIFY_NEW_BLOCK (hop " << arg.hop << ")");
     if(context.m_state != cryptonote_connection_context::state_normal)
       return 1;
+    peer_cost_scope cost(*this, context, false);
+    block announced_block;
+    if(parse_and_validate_block_from_blob(arg.b.block, announced_block))
+      note_block_announce(get_block_hash(announced_block), context);
     m_core.pause_mine();
-    std::list<block_complete_entry> blocks;
+    std::vector<block_complete_entry> blocks;
     blocks.push_back(arg.b);
     m_core.prepare_handle_incoming_blocks(blocks);
     for(auto tx_blob_it = arg.b.txs.begin(); tx_blob_it!=arg.b.txs.end();tx_blob_it++)
@@ -339,26 +365,33 @@ namespace cryptonote
       }
     }
 
+    const bool relayed_early = relay_block_early(arg, context);
     block_verification_context bvc = boost::value_initialized<block_verification_context>();
     m_core.handle_incoming_block(arg.b.block, bvc); // got block from handle_notify_new_block
     m_core.cleanup_handle_incoming_blocks(true);
     m_core.resume_mine();
     if(bvc.m_verifivation_failed)
     {
+      if(tolerate_failed_block(arg.b.block, context))
+        return 1;
       LOG_PRINT_CCONTEXT_L0("Block verification failed, dropping connection");
       m_p2p->drop_connection(context);
       return 1;
     }
     if(bvc.m_added_to_main_chain)
     {
+      cost.add_useful(1 + arg.b.txs.size());
       ++arg.hop;
       //TODO: Add here announce protocol usage
-      relay_block(arg, context);
+      relay_block(arg, context, relayed_early ? relay_other_peers : relay_all);
+      add_orphan_children(get_block_hash(announced_block));
     }else if(bvc.m_marked_as_orphaned)
     {
+      keep_orphan_block(arg.b);
       context.m_state = cryptonote_connection_context::state_synchronizing;
       NOTIFY_REQUEST_CHAIN::request r = boost::value_initialized<NOTIFY_REQUEST_CHAIN::request>();
       m_core.get_short_chain_history(r.block_ids);
+      r.headers = true;
       LOG_PRINT_CCONTEXT_L2("-->>NOTIFY_REQUEST_CHAIN: m_block_ids.size()=" << r.block_ids.size() );
       post_notify<NOTIFY_REQUEST_CHAIN>(r, context);
     }
@@ -372,6 +405,7 @@ namespace cryptonote
     LOG_PRINT_CCONTEXT_L2("NOTIFY_NEW_FLUFFY_BLOCK (hop " << arg.hop << ")");
     if(context.m_state != cryptonote_connection_context::state_normal)
       return 1;
+    peer_cost_scope cost(*this, context, false);
     
     m_core.pause_mine();
       
@@ -379,6 +413,9 @@ namespace cryptonote
     transaction miner_tx;
     if(parse_and_validate_block_from_blob(arg.b.block, new_block))
     {
+      if(context.m_requested_objects.empty())
+        note_block_announce(get_block_hash(new_block), context);
+
       // This is a seccond notification, we must have asked for some missing tx
       if(!context.m_requested_objects.empty())
       {
@@ -400,7 +437,7 @@ namespace cryptonote
         }
       }      
       
-      std::list<blobdata> have_tx;
+      std::vector<blobdata> have_tx;
       
       // Instead of requesting missing transactions by hash like BTC, 
       // we do it by index (thanks to a suggestion from moneromooo) because
@@ -412,6 +449,8 @@ namespace cryptonote
         
       transaction tx;
       crypto::hash tx_hash;
+      // the ones not in our pool, admitted together once all are checked
+      std::list<blobdata> new_txs;
 
       BOOST_FOREACH(auto& tx_blob, arg.b.txs)
       {
@@ -477,21 +516,7 @@ namespace cryptonote
           // sent in our pool, so don't verify again..
           if(!m_core.get_pool_transaction(tx_hash, tx))
           {
-            cryptonote::tx_verification_context tvc = AUTO_VAL_INIT(tvc);                        
-            if(!m_core.handle_incoming_tx(tx_blob, tvc, true, true) || tvc.m_verifivation_failed)
-            {
-              LOG_PRINT_CCONTEXT_L1("Block verification failed: transaction verification failed, dropping connection");
-              m_p2p->drop_connection(context);
-              m_core.resume_mine();
-              return 1;
-            }
-            
-            //
-            // future todo: 
-            // tx should only not be added to pool if verification failed, but
-            // maybe in the future could not be added for other reasons 
-            // according to monero-moo so keep track of these separately ..
-            //
+            new_txs.push_back(tx_blob);
           }
         }
         else
@@ -509,6 +534,25 @@ namespace cryptonote
         }
       }
       
+      if(!new_txs.empty())
+      {
+        std::vector<cryptonote::tx_verification_context> tvc;
+        if(!m_core.handle_incoming_txs(new_txs, tvc, true, true))
+        {
+          LOG_PRINT_CCONTEXT_L1("Block verification failed: transaction verification failed, dropping connection");
+          m_p2p->drop_connection(context);
+          m_core.resume_mine();
+          return 1;
+        }
+
+        //
+        // future todo:
+        // tx should only not be added to pool if verification failed, but
+        // maybe in the future could not be added for other reasons
+        // according to monero-moo so keep track of these separately ..
+        //
+      }
+
       // The initial size equality check could have been fooled if the sender
       // gave us the number of transactions we asked for, but not the right 
       // ones. This check make sure the transactions we asked for were the
@@ -557,13 +601,17 @@ namespace cryptonote
       }
       else // whoo-hoo we've got em all ..
       {
-        block_complete_entry b;
-        b.block = arg.b.block;
-        b.txs = have_tx;
+        std::vector<block_complete_entry> blocks(1);
+        blocks.back().block = arg.b.block;
+        blocks.back().txs = std::move(have_tx);
 
-        std::list<block_complete_entry> blocks;
-        blocks.push_back(b);
         m_core.prepare_handle_incoming_blocks(blocks);
+
+        NOTIFY_NEW_BLOCK::request reg_arg = AUTO_VAL_INIT(reg_arg);
+        reg_arg.hop = arg.hop;
+        reg_arg.current_blockchain_height = arg.current_blockchain_height;
+        reg_arg.b.block = arg.b.block;
+        const bool relayed_early = relay_block_early(reg_arg, context);
           
         block_verification_context bvc = boost::value_initialized<block_verification_context>();
         m_core.handle_incoming_block(arg.b.block, bvc); // got block from handle_notify_new_block
@@ -572,25 +620,28 @@ namespace cryptonote
         
         if( bvc.m_verifivation_failed )
         {
+          if(tolerate_failed_block(arg.b.block, context))
+            return 1;
           LOG_PRINT_CCONTEXT_L0("Block verification failed, dropping connection");
           m_p2p->drop_connection(context);
           return 1;
         }
         if( bvc.m_added_to_main_chain )
         {
+          cost.add_useful(1 + new_block.tx_hashes.size());
           ++arg.hop;
           //TODO: Add here announce protocol usage
-          NOTIFY_NEW_BLOCK::request reg_arg = AUTO_VAL_INIT(reg_arg);
           reg_arg.hop = arg.hop;
-          reg_arg.current_blockchain_height = arg.current_blockchain_height;
-          reg_arg.b.block = b.block;
-          relay_block(reg_arg, context);
+          relay_block(reg_arg, context, relayed_early ? relay_other_peers : relay_all);
+          add_orphan_children(get_block_hash(new_block));
         }
         else if( bvc.m_marked_as_orphaned )
         {
+          keep_orphan_block(blocks.back());
           context.m_state = cryptonote_connection_context::state_synchronizing;
           NOTIFY_REQUEST_CHAIN::request r = boost::value_initialized<NOTIFY_REQUEST_CHAIN::request>();
           m_core.get_short_chain_history(r.block_ids);
+          r.headers = true;
           LOG_PRINT_CCONTEXT_L2("-->>NOTIFY_REQUEST_CHAIN: m_block_ids.size()=" << r.block_ids.size() );
           post_notify<NOTIFY_REQUEST_CHAIN>(r, context);
         }            
@@ -618,9 +669,10 @@ namespace cryptonote
   int t_cryptonote_protocol_handler<t_core>::handle_request_fluffy_missing_tx(int command, NOTIFY_REQUEST_FLUFFY_MISSING_TX::request& arg, cryptonote_connection_context& context)
   {
     LOG_PRINT_CCONTEXT_L2("NOTIFY_REQUEST_FLUFFY_MISSING_TX");
+    peer_cost_scope cost(*this, context, true);
     
-    std::list<block> local_blocks;
-    std::list<transaction> local_txs;
+    std::vector<block> local_blocks;
+    std::vector<transaction> local_txs;
     if(!m_core.get_blocks(arg.current_blockchain_height - 1, 1, local_blocks, local_txs))
     {
 
@@ -637,6 +689,8 @@ namespace cryptonote
 
     NOTIFY_NEW_FLUFFY_BLOCK::request fluffy_response;
     fluffy_response.b = arg.b;
+    // from a compact block, the requester does not have the transaction hashes
+    fluffy_response.b.block = t_serializable_object_to_blob(local_blocks.front());
     fluffy_response.current_blockchain_height = m_core.get_current_blockchain_height();
     fluffy_response.hop = arg.hop;    
     size_t local_txs_count = local_txs.size();
@@ -644,7 +698,7 @@ namespace cryptonote
     {
       if(tx_idx < local_txs_count)
       {
-        fluffy_response.b.txs.push_back(t_serializable_object_to_blob( *(std::next(local_txs.begin(), tx_idx)) ));
+        fluffy_response.b.txs.push_back(t_serializable_object_to_blob(local_txs[tx_idx]));
       }
       else
       {
@@ -673,24 +727,154 @@ namespace cryptonote
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core>
+  int t_cryptonote_protocol_handler<t_core>::handle_notify_new_compact_block(int command, NOTIFY_NEW_COMPACT_BLOCK::request& arg, cryptonote_connection_context& context)
+  {
+    LOG_PRINT_CCONTEXT_L2("NOTIFY_NEW_COMPACT_BLOCK (hop " << arg.hop << ")");
+    if(context.m_state != cryptonote_connection_context::state_normal)
+      return 1;
+    peer_cost_scope cost(*this, context, false);
+
+    block b;
+    if(!parse_and_validate_block_from_blob(arg.block, b) || !b.tx_hashes.empty() || arg.short_tx_ids.size() % COMPACT_TX_ID_SIZE)
+    {
+      LOG_ERROR_CCONTEXT("sent wrong compact block, dropping connection");
+      m_p2p->drop_connection(context);
+      return 1;
+    }
+    note_block_announce(arg.block_id, context);
+
+    // match the short ids against the pool, ids shared by several pool
+    // transactions are treated as missing
+    const crypto::hash key = get_compact_block_key(arg.block, arg.salt);
+    std::vector<crypto::hash> pool_hashes;
+    uint64_t pool_version;
+    m_core.get_pool_transaction_hashes(pool_hashes, pool_version);
+    std::unordered_map<uint64_t, crypto::hash> pool_ids;
+    std::unordered_set<uint64_t> collisions;
+    for (const crypto::hash& tx_hash : pool_hashes)
+    {
+      const uint64_t id = get_compact_tx_id(key, tx_hash);
+      if (!pool_ids.emplace(id, tx_hash).second)
+        collisions.insert(id);
+    }
+
+    const size_t n_txs = arg.short_tx_ids.size() / COMPACT_TX_ID_SIZE;
+    std::vector<size_t> need_tx_indices;
+    b.tx_hashes.resize(n_txs);
+    b.invalidate_hashes();
+    for (size_t i = 0; i < n_txs; ++i)
+    {
+      const uint64_t id = read_compact_tx_id(arg.short_tx_ids, i);
+      auto it = pool_ids.find(id);
+      if (it == pool_ids.end() || collisions.find(id) != collisions.end())
+        need_tx_indices.push_back(i);
+      else
+        b.tx_hashes[i] = it->second;
+    }
+
+    // a pool transaction may match the short id of another, the block id
+    // tells, and then the sender's block is needed with all transactions
+    if (need_tx_indices.empty() && get_block_hash(b) != arg.block_id)
+    {
+      LOG_PRINT_CCONTEXT_L1("Compact block " << arg.block_id << " reconstructed wrongly, requesting all transactions");
+      for (size_t i = 0; i < n_txs; ++i)
+        need_tx_indices.push_back(i);
+    }
+
+    if (need_tx_indices.empty())
+    {
+      LOG_PRINT_CCONTEXT_L2("Compact block " << arg.block_id << " reconstructed from the pool");
+      NOTIFY_NEW_FLUFFY_BLOCK::request fluffy_arg = AUTO_VAL_INIT(fluffy_arg);
+      fluffy_arg.b.block = block_to_blob(b);
+      fluffy_arg.current_blockchain_height = arg.current_blockchain_height;
+      fluffy_arg.hop = arg.hop;
+      cost.finish(); // the fluffy block handler charges its own time
+      return handle_notify_new_fluffy_block(NOTIFY_NEW_FLUFFY_BLOCK::ID, fluffy_arg, context);
+    }
+
+    // the peer sends back its block with the missing transactions, which
+    // then goes through handle_notify_new_fluffy_block
+    LOG_PRINT_CCONTEXT_L2("Compact block " << arg.block_id << " misses " << need_tx_indices.size() << "/" << n_txs << " transactions");
+    NOTIFY_REQUEST_FLUFFY_MISSING_TX::request missing_tx_req;
+    missing_tx_req.b.block = arg.block;
+    missing_tx_req.hop = arg.hop;
+    missing_tx_req.current_blockchain_height = arg.current_blockchain_height;
+    missing_tx_req.missing_tx_indices = std::move(need_tx_indices);
+    post_notify<NOTIFY_REQUEST_FLUFFY_MISSING_TX>(missing_tx_req, context);
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  int t_cryptonote_protocol_handler<t_core>::handle_notify_compressed(int command, NOTIFY_COMPRESSED::request& arg, cryptonote_connection_context& context)
+  {
+    LOG_PRINT_CCONTEXT_L2("NOTIFY_COMPRESSED (command " << arg.command << ", " << arg.data.size() << " -> " << arg.size << " bytes)");
+    std::string blob;
+    if(arg.size > LEVIN_DEFAULT_MAX_PACKET_SIZE || !tools::decompress(arg.data, arg.size, blob))
+    {
+      LOG_ERROR_CCONTEXT("failed to inflate NOTIFY_COMPRESSED, dropping connection");
+      m_p2p->drop_connection(context);
+      return 1;
+    }
+
+    // only the large sync responses are ever sent compressed
+    switch (arg.command)
+    {
+      case NOTIFY_RESPONSE_GET_OBJECTS::ID:
+      {
+        NOTIFY_RESPONSE_GET_OBJECTS::request req;
+        if(epee::serialization::load_t_from_binary(req, blob))
+          return handle_response_get_objects(arg.command, req, context);
+        break;
+      }
+      case NOTIFY_RESPONSE_CHAIN_ENTRY::ID:
+      {
+        NOTIFY_RESPONSE_CHAIN_ENTRY::request req;
+        if(epee::serialization::load_t_from_binary(req, blob))
+          return handle_response_chain_entry(arg.command, req, context);
+        break;
+      }
+      default:
+        break;
+    }
+    LOG_ERROR_CCONTEXT("bad NOTIFY_COMPRESSED for command " << arg.command << ", dropping connection");
+    m_p2p->drop_connection(context);
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
   int t_cryptonote_protocol_handler<t_core>::handle_notify_new_transactions(int command, NOTIFY_NEW_TRANSACTIONS::request& arg, cryptonote_connection_context& context)
   {
     LOG_PRINT_CCONTEXT_L2("NOTIFY_NEW_TRANSACTIONS");
     if(context.m_state != cryptonote_connection_context::state_normal)
       return 1;
 
-    for(auto tx_blob_it = arg.txs.begin(); tx_blob_it!=arg.txs.end();)
+    // whatever becomes of them, the peer need not be sent these back
+    for(const blobdata& tx_blob : arg.txs)
+      context.m_known_txs.insert(get_blob_hash(tx_blob));
+
+    // other peers relay the same txs, which cost this one nothing more
+    if(context.m_deprioritized)
     {
-      cryptonote::tx_verification_context tvc = AUTO_VAL_INIT(tvc);
-      m_core.handle_incoming_tx(*tx_blob_it, tvc, false, true);
-      if(tvc.m_verifivation_failed)
+      LOG_PRINT_CCONTEXT_L2("Over its verification budget, ignoring " << arg.txs.size() << " txs");
+      return 1;
+    }
+    peer_cost_scope cost(*this, context, false);
+
+    std::vector<cryptonote::tx_verification_context> tvc;
+    if(!m_core.handle_incoming_txs(arg.txs, tvc, false, true))
+    {
+      LOG_PRINT_CCONTEXT_L1("Tx verification failed, dropping connection");
+      m_p2p->drop_connection(context);
+      return 1;
+    }
+    size_t tx_idx = 0;
+    for(auto tx_blob_it = arg.txs.begin(); tx_blob_it!=arg.txs.end(); ++tx_idx)
+    {
+      if(tvc[tx_idx].m_should_be_relayed)
       {
-        LOG_PRINT_CCONTEXT_L1("Tx verification failed, dropping connection");
-        m_p2p->drop_connection(context);
-        return 1;
-      }
-      if(tvc.m_should_be_relayed)
+        cost.add_useful(1);
         ++tx_blob_it;
+      }
       else
         arg.txs.erase(tx_blob_it++);
     }
@@ -708,6 +892,7 @@ namespace cryptonote
   int t_cryptonote_protocol_handler<t_core>::handle_request_get_objects(int command, NOTIFY_REQUEST_GET_OBJECTS::request& arg, cryptonote_connection_context& context)
   {
     LOG_PRINT_CCONTEXT_L2("NOTIFY_REQUEST_GET_OBJECTS");
+    peer_cost_scope cost(*this, context, true);
     NOTIFY_RESPONSE_GET_OBJECTS::request rsp;
     if(!m_core.handle_get_objects(arg, rsp, context))
     {
@@ -716,7 +901,7 @@ namespace cryptonote
     }
     LOG_PRINT_CCONTEXT_L2("-->>NOTIFY_RESPONSE_GET_OBJECTS: blocks.size()=" << rsp.blocks.size() << ", txs.size()=" << rsp.txs.size()
                             << ", rsp.m_current_blockchain_height=" << rsp.current_blockchain_height << ", missed_ids.size()=" << rsp.missed_ids.size());
-    post_notify<NOTIFY_RESPONSE_GET_OBJECTS>(rsp, context);
+    post_notify_compressible<NOTIFY_RESPONSE_GET_OBJECTS>(rsp, context);
     //handler_response_blocks_now(sizeof(rsp)); // XXX
     //handler_response_blocks_now(200);
     return 1;
@@ -791,7 +976,20 @@ namespace cryptonote
 
     context.m_remote_blockchain_height = arg.current_blockchain_height;
 
+    if(!context.m_last_request_time.is_not_a_date_time())
+    {
+      const boost::posix_time::time_duration dt = boost::posix_time::microsec_clock::universal_time() - context.m_last_request_time;
+      context.m_last_response_latency_ms = std::max<int64_t>(dt.total_milliseconds(), 1);
+      const double rate = size * 1000.0 / context.m_last_response_latency_ms;
+      context.m_sync_rate = context.m_sync_rate > 0 ? (context.m_sync_rate * 2 + rate) / 3 : rate;
+      context.m_last_request_time = boost::posix_time::ptime();
+      if(rate * BLOCK_SYNC_SLOW_PEER_RATIO >= m_median_sync_rate)
+        context.m_slow_strikes = 0;
+      LOG_PRINT_CCONTEXT_L2("Blocks arrived in " << context.m_last_response_latency_ms << " ms, " << (uint64_t)context.m_sync_rate / 1024 << " kB/s");
+    }
+
     size_t count = 0;
+    crypto::hash first_block_hash = null_hash;
     BOOST_FOREACH(const block_complete_entry& block_entry, arg.blocks)
     {
       if (m_stopping)
@@ -808,18 +1006,8 @@ namespace cryptonote
         m_p2p->drop_connection(context);
         return 1;
       }
-      //to avoid concurrency in core between connections, suspend connections which delivered block later then first one
-      if(count == 2)
-      {
-        if(m_core.have_block(get_block_hash(b)))
-        {
-          context.m_state = cryptonote_connection_context::state_idle;
-          context.m_needed_objects.clear();
-          context.m_requested_objects.clear();
-          LOG_PRINT_CCONTEXT_L1("Connection set to idle state.");
-          return 1;
-        }
-      }
+      if(count == 1)
+        first_block_hash = get_block_hash(b);
 
       auto req_it = context.m_requested_objects.find(get_block_hash(b));
       if(req_it == context.m_requested_objects.end())
@@ -849,91 +1037,423 @@ namespace cryptonote
     }
 
 
+    if(!m_block_queue.fill_span(first_block_hash, arg.blocks, context.m_connection_id))
+      LOG_PRINT_CCONTEXT_L1("Blocks already downloaded from another peer");
+
+    // keep this peer busy while the sync thread adds the blocks
+    request_missing_objects(context, true);
+    notify_sync_thread();
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  void t_cryptonote_protocol_handler<t_core>::notify_sync_thread()
+  {
+    // taking the lock orders this with the sync thread's check before it waits
+    {
+      boost::lock_guard<boost::mutex> lock(m_sync_lock);
+    }
+    m_sync_cond.notify_one();
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  void t_cryptonote_protocol_handler<t_core>::sync_thread()
+  {
+    // blocks are verified here, off the network threads, which meanwhile keep
+    // downloading the next spans into the block queue, bounded by
+    // BLOCK_QUEUE_SIZE_THRESHOLD
+    while(!m_stopping)
     {
-      m_core.pause_mine();
-      epee::misc_utils::auto_scope_leave_caller scope_exit_handler = epee::misc_utils::create_scope_leave_handler(
-        boost::bind(&t_core::resume_mine, &m_core));
+      {
+        boost::unique_lock<boost::mutex> lock(m_sync_lock);
+        if(!m_stopping && !m_block_queue.has_next_span(m_core.get_current_blockchain_height()))
+          m_sync_cond.wait_for(lock, boost::chrono::seconds(1));
+      }
+      add_next_spans();
+    }
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  void t_cryptonote_protocol_handler<t_core>::add_next_spans()
+  {
+    if(!m_block_queue.has_next_span(m_core.get_current_blockchain_height()))
+      return;
 
-      LOG_PRINT_CCONTEXT_YELLOW( "Got NEW BLOCKS inside of " << __FUNCTION__ << ": size: " << arg.blocks.size() , LOG_LEVEL_1);
+    m_core.pause_mine();
+    epee::misc_utils::auto_scope_leave_caller scope_exit_handler = epee::misc_utils::create_scope_leave_handler(
+      boost::bind(&t_core::resume_mine, &m_core));
 
-      if (m_core.get_test_drop_download() && m_core.get_test_drop_download_height()) { // DISCARD BLOCKS for testing
+    uint64_t start_height;
+    std::vector<block_complete_entry> blocks;
+    boost::uuids::uuid span_connection_id;
+    while(m_block_queue.get_next_span(m_core.get_current_blockchain_height(), start_height, blocks, span_connection_id))
+    {
+      if(m_stopping)
+        return;
 
-        uint64_t previous_height = m_core.get_current_blockchain_height();
+      const uint64_t previous_height = m_core.get_current_blockchain_height();
+      const boost::chrono::steady_clock::time_point span_start = boost::chrono::steady_clock::now();
+      if(!add_span_blocks(blocks, start_height < previous_height, span_connection_id))
+      {
+        drop_span_connection(span_connection_id);
+        continue;
+      }
 
-        m_core.prepare_handle_incoming_blocks(arg.blocks);
-        BOOST_FOREACH(const block_complete_entry& block_entry, arg.blocks)
-        {
-          if (m_stopping)
-          {
-              m_core.cleanup_handle_incoming_blocks();
-              return 1;
-          }
+      // the span's verification is charged to the peer which sent it
+      const uint64_t span_us = boost::chrono::duration_cast<boost::chrono::microseconds>(boost::chrono::steady_clock::now() - span_start).count();
+      const uint64_t added = m_core.get_current_blockchain_height() - std::min(previous_height, m_core.get_current_blockchain_height());
+      m_p2p->for_each_connection([&](cryptonote_connection_context& context, nodetool::peerid_type peer_id, uint32_t support_flags)->bool{
+        if(context.m_connection_id != span_connection_id)
+          return true;
+        charge_peer_cost(context, span_us, added, false);
+        return false;
+      });
+
+      m_recent_block_size = m_core.get_average_block_size(CRYPTONOTE_REWARD_BLOCKS_WINDOW);
+      if(m_core.get_current_blockchain_height() > previous_height)
+      {
+        LOG_PRINT_YELLOW( "Synced " << m_core.get_current_blockchain_height() << "/" << m_core.get_target_blockchain_height()
+          << " (" << m_block_queue.get_num_spans() << " spans, " << m_block_queue.get_data_size() / 1000 << " kB queued)", LOG_LEVEL_0);
+      }
+    }
+    kick_idle_peers();
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  bool t_cryptonote_protocol_handler<t_core>::add_span_blocks(const std::vector<block_complete_entry>& blocks, bool check_having_blocks, const boost::uuids::uuid& connection_id)
+  {
+    const std::string peer = "[" + epee::string_tools::get_str_from_guid_a(connection_id) + "] ";
+    LOG_PRINT_YELLOW( peer << "Got NEW BLOCKS inside of " << __FUNCTION__ << ": size: " << blocks.size() , LOG_LEVEL_1);
 
-          // process transactions
-          TIME_MEASURE_START(transactions_process_time);
-          BOOST_FOREACH(auto& tx_blob, block_entry.txs)
-          {
-            tx_verification_context tvc = AUTO_VAL_INIT(tvc);
-            m_core.handle_incoming_tx(tx_blob, tvc, true, true);
-            if(tvc.m_verifivation_failed)
-            {
-              LOG_ERROR_CCONTEXT("transaction verification failed on NOTIFY_RESPONSE_GET_OBJECTS, \r\ntx_id = "
-                  << epee::string_tools::pod_to_hex(get_blob_hash(tx_blob)) << ", dropping connection");
-              m_p2p->drop_connection(context);
-              m_core.cleanup_handle_incoming_blocks();
-              return 1;
-            }
-          }
-          TIME_MEASURE_FINISH(transactions_process_time);
+    if (!(m_core.get_test_drop_download() && m_core.get_test_drop_download_height())) // DISCARD BLOCKS for testing
+      return true;
 
-          // process block
+    // the lookups are prepared a window at a time, so a span of large
+    // blocks does not have them all in memory at once
+    size_t window_end = 0;
+    for (size_t n = 0; n < blocks.size(); ++n)
+    {
+      const block_complete_entry& block_entry = blocks[n];
+      if (n == window_end)
+      {
+        if (n > 0)
+          m_core.cleanup_handle_incoming_blocks();
+        const size_t window = m_core.get_prepare_window(blocks, n);
+        m_core.prepare_handle_incoming_blocks(blocks, n, window);
+        window_end = n + window;
+      }
 
-          TIME_MEASURE_START(block_process_time);
-          block_verification_context bvc = boost::value_initialized<block_verification_context>();
+      if (m_stopping)
+      {
+        m_core.cleanup_handle_incoming_blocks();
+        return true;
+      }
 
-          m_core.handle_incoming_block(block_entry.block, bvc, false); // <--- process block
+      // the start of a span may overlap blocks added since it was reserved
+      if (check_having_blocks)
+      {
+        block b;
+        if (parse_and_validate_block_from_blob(block_entry.block, b) && m_core.have_block(get_block_hash(b)))
+          continue;
+      }
 
-          if(bvc.m_verifivation_failed)
-          {
-            LOG_PRINT_CCONTEXT_L1("Block verification failed, dropping connection");
-            m_p2p->drop_connection(context);
-            m_p2p->add_ip_fail(context.m_remote_ip);
-            m_core.cleanup_handle_incoming_blocks();
-            return 1;
-          }
-          if(bvc.m_marked_as_orphaned)
-          {
-            LOG_PRINT_CCONTEXT_L1("Block received at sync phase was marked as orphaned, dropping connection");
-            m_p2p->drop_connection(context);
-            m_p2p->add_ip_fail(context.m_remote_ip);
-            m_core.cleanup_handle_incoming_blocks();
-            return 1;
-          }
+      // process transactions
+      TIME_MEASURE_START(transactions_process_time);
+      BOOST_FOREACH(auto& tx_blob, block_entry.txs)
+      {
+        tx_verification_context tvc = AUTO_VAL_INIT(tvc);
+        m_core.handle_incoming_tx(tx_blob, tvc, true, true);
+        if(tvc.m_verifivation_failed)
+        {
+          LOG_ERROR(peer << "transaction verification failed on NOTIFY_RESPONSE_GET_OBJECTS, \r\ntx_id = "
+              << epee::string_tools::pod_to_hex(get_blob_hash(tx_blob)) << ", dropping connection");
+          m_core.cleanup_handle_incoming_blocks();
+          return false;
+        }
+      }
+      TIME_MEASURE_FINISH(transactions_process_time);
 
-          TIME_MEASURE_FINISH(block_process_time);
-          LOG_PRINT_CCONTEXT_L2("Block process time: " << block_process_time + transactions_process_time << "(" << transactions_process_time << "/" << block_process_time << ")ms");
+      // process block
 
-          epee::net_utils::data_logger::get_instance().add_data("calc_time", block_process_time + transactions_process_time);
-          epee::net_utils::data_logger::get_instance().add_data("block_processing", 1);
+      TIME_MEASURE_START(block_process_time);
+      block_verification_context bvc = boost::value_initialized<block_verification_context>();
 
-        } // each download block
+      m_core.handle_incoming_block(block_entry.block, bvc, false); // <--- process block
+
+      if(bvc.m_verifivation_failed)
+      {
+        LOG_PRINT_L1(peer << "Block verification failed, dropping connection");
         m_core.cleanup_handle_incoming_blocks();
+        return false;
+      }
+      if(bvc.m_marked_as_orphaned)
+      {
+        // the rest of the span builds on it, keep them all until it connects
+        LOG_PRINT_L1(peer << "Block received at sync phase was marked as orphaned, dropping connection");
+        m_core.cleanup_handle_incoming_blocks();
+        for (size_t i = n; i < blocks.size(); ++i)
+          keep_orphan_block(blocks[i]);
+        return false;
+      }
 
-        if (m_core.get_current_blockchain_height() > previous_height)
+      TIME_MEASURE_FINISH(block_process_time);
+      LOG_PRINT_L2(peer << "Block process time: " << block_process_time + transactions_process_time << "(" << transactions_process_time << "/" << block_process_time << ")ms");
+
+      epee::net_utils::data_logger::get_instance().add_data("calc_time", block_process_time + transactions_process_time);
+      epee::net_utils::data_logger::get_instance().add_data("block_processing", 1);
+
+    } // each download block
+    m_core.cleanup_handle_incoming_blocks();
+
+    uint64_t top_height;
+    crypto::hash top_id;
+    if (m_core.get_blockchain_top(top_height, top_id))
+      add_orphan_children(top_id);
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  void t_cryptonote_protocol_handler<t_core>::keep_orphan_block(const block_complete_entry& entry)
+  {
+    block b;
+    if(!parse_and_validate_block_from_blob(entry.block, b))
+      return;
+    if(m_orphan_blocks.add(get_block_hash(b), b.prev_id, entry))
+      LOG_PRINT_L1("Keeping orphan block " << get_block_hash(b) << " until " << b.prev_id << " arrives (" << m_orphan_blocks.get_count() << " kept)");
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  void t_cryptonote_protocol_handler<t_core>::add_orphan_children(const crypto::hash& parent)
+  {
+    // each block added may in turn be the parent of more kept ones
+    std::vector<crypto::hash> parents(1, parent);
+    while (!parents.empty() && !m_stopping)
+    {
+      std::vector<block_complete_entry> children;
+      m_orphan_blocks.take_children(parents.back(), children);
+      parents.pop_back();
+      for (const block_complete_entry& entry : children)
+      {
+        block b;
+        if(!parse_and_validate_block_from_blob(entry.block, b))
+          continue;
+        const crypto::hash id = get_block_hash(b);
+        if(m_core.have_block(id))
         {
-          LOG_PRINT_CCONTEXT_YELLOW( "Synced " << m_core.get_current_blockchain_height() << "/" << m_core.get_target_blockchain_height() , LOG_LEVEL_0);
+          parents.push_back(id);
+          continue;
         }
-      } // if not DISCARD BLOCK
 
+        std::vector<block_complete_entry> blocks(1, entry);
+        m_core.prepare_handle_incoming_blocks(blocks);
+        bool txs_ok = true;
+        for (const blobdata& tx_blob : entry.txs)
+        {
+          tx_verification_context tvc = AUTO_VAL_INIT(tvc);
+          m_core.handle_incoming_tx(tx_blob, tvc, true, true);
+          if(tvc.m_verifivation_failed)
+          {
+            txs_ok = false;
+            break;
+          }
+        }
+        block_verification_context bvc = boost::value_initialized<block_verification_context>();
+        if(txs_ok)
+          m_core.handle_incoming_block(entry.block, bvc);
+        m_core.cleanup_handle_incoming_blocks(true);
+        if(!txs_ok || bvc.m_verifivation_failed || bvc.m_marked_as_orphaned)
+        {
+          LOG_PRINT_L1("Kept orphan block " << id << " failed to be added");
+          continue;
+        }
 
+        LOG_PRINT_L1("Added kept orphan block " << id);
+        if(bvc.m_added_to_main_chain)
+        {
+          NOTIFY_NEW_BLOCK::request arg = AUTO_VAL_INIT(arg);
+          arg.hop = 1;
+          arg.current_blockchain_height = m_core.get_current_blockchain_height();
+          arg.b.block = entry.block;
+          cryptonote_connection_context exclude_context = boost::value_initialized<cryptonote_connection_context>();
+          relay_block(arg, exclude_context);
+        }
+        parents.push_back(id);
+      }
     }
-    request_missing_objects(context, true);
-    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  void t_cryptonote_protocol_handler<t_core>::drop_span_connection(const boost::uuids::uuid& connection_id)
+  {
+    // the peer which sent a bad span may not be the one we are running for
+    m_block_queue.flush_spans(connection_id);
+    m_p2p->for_each_connection([&](cryptonote_connection_context& context, nodetool::peerid_type peer_id, uint32_t support_flags)->bool{
+      if(context.m_connection_id != connection_id)
+        return true;
+      m_p2p->drop_connection(context);
+      m_p2p->add_ip_fail(context.m_remote_ip);
+      return false;
+    });
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  void t_cryptonote_protocol_handler<t_core>::kick_idle_peers()
+  {
+    // wake synchronizing peers which had nothing left to reserve, on their own strand
+    m_p2p->for_each_connection([&](cryptonote_connection_context& context, nodetool::peerid_type peer_id, uint32_t support_flags)->bool{
+      if(context.m_state == cryptonote_connection_context::state_synchronizing && context.m_requested_objects.empty()
+        && !context.m_needed_objects.empty() && context.m_callback_request_count == 0)
+      {
+        ++context.m_callback_request_count;
+        m_p2p->request_callback(context);
+      }
+      return true;
+    });
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  void t_cryptonote_protocol_handler<t_core>::check_sync_peers()
+  {
+    // hand the spans of peers far slower than the others over to them, and
+    // drop those which stay slow so the p2p layer connects to better ones
+    std::vector<double> rates;
+    m_p2p->for_each_connection([&](cryptonote_connection_context& context, nodetool::peerid_type peer_id, uint32_t support_flags)->bool{
+      if(context.m_state == cryptonote_connection_context::state_synchronizing && context.m_sync_rate > 0)
+        rates.push_back(context.m_sync_rate);
+      return true;
+    });
+    const double median_rate = rates.size() >= 3 ? epee::misc_utils::median(rates) : 0;
+    m_median_sync_rate = median_rate;
+
+    const boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+    const boost::posix_time::time_duration overdue = boost::posix_time::seconds(BLOCKS_SYNCHRONIZING_TARGET_SECONDS * BLOCK_SYNC_SLOW_PEER_RATIO);
+    bool reassigned = false;
+    m_p2p->for_each_connection([&](cryptonote_connection_context& context, nodetool::peerid_type peer_id, uint32_t support_flags)->bool{
+      if(context.m_state != cryptonote_connection_context::state_synchronizing || context.m_requested_objects.empty())
+        return true;
+      const bool slow = median_rate > 0 && context.m_sync_rate * BLOCK_SYNC_SLOW_PEER_RATIO < median_rate;
+      const bool late = !context.m_last_request_time.is_not_a_date_time() && now - context.m_last_request_time > overdue;
+      if(!slow && !late)
+        return true;
+
+      m_block_queue.mark_spans_stalled(context.m_connection_id);
+      reassigned = true;
+      if(++context.m_slow_strikes >= BLOCK_SYNC_SLOW_PEER_STRIKES)
+      {
+        LOG_PRINT_CCONTEXT_L1("Too slow for sync (" << (uint64_t)context.m_sync_rate / 1024 << " kB/s, median " << (uint64_t)median_rate / 1024 << " kB/s), dropping connection");
+        m_p2p->drop_connection(context);
+      }
+      else
+      {
+        LOG_PRINT_CCONTEXT_L2("Slow for sync (" << (uint64_t)context.m_sync_rate / 1024 << " kB/s, median " << (uint64_t)median_rate / 1024 << " kB/s), letting others take its span");
+      }
+      return true;
+    });
+    if(reassigned)
+      kick_idle_peers();
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  void t_cryptonote_protocol_handler<t_core>::charge_peer_cost(cryptonote_connection_context& context, uint64_t us, size_t useful, bool serving)
+  {
+    if(serving)
+    {
+      context.m_serving_us += us;
+      return;
+    }
+    context.m_verification_us += us;
+    context.m_useful_objects += useful;
+
+    // a peer sending what we need gets time for it, one costing far more
+    // than it brings is dropped, well before anything it sends fails
+    const uint64_t used = context.m_verification_us - context.m_window_verification_us;
+    const uint64_t budget = P2P_PEER_COST_FREE_US + (context.m_useful_objects - context.m_window_useful_objects) * P2P_PEER_COST_PER_OBJECT_US;
+    if(used > budget * P2P_PEER_COST_DROP_FACTOR)
+    {
+      LOG_PRINT_CCONTEXT_L0("Verification took " << used / 1000 << " ms for " << context.m_useful_objects - context.m_window_useful_objects << " useful objects, dropping connection");
+      m_p2p->drop_connection(context);
+    }
+    else if(used > budget && !context.m_deprioritized)
+    {
+      LOG_PRINT_CCONTEXT_L1("Verification took " << used / 1000 << " ms for " << context.m_useful_objects - context.m_window_useful_objects << " useful objects, ignoring its txs for now");
+      context.m_deprioritized = true;
+    }
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  void t_cryptonote_protocol_handler<t_core>::check_peer_costs()
+  {
+    // budgets are per window, a peer over it starts again
+    m_p2p->for_each_connection([&](cryptonote_connection_context& context, nodetool::peerid_type peer_id, uint32_t support_flags)->bool{
+      context.m_window_verification_us = context.m_verification_us;
+      context.m_window_useful_objects = context.m_useful_objects;
+      context.m_deprioritized = false;
+      return true;
+    });
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  epee::net_utils::traffic_class t_cryptonote_protocol_handler<t_core>::get_traffic_class(int command) const
+  {
+    switch (command)
+    {
+      case NOTIFY_NEW_BLOCK::ID:
+      case NOTIFY_NEW_TRANSACTIONS::ID:
+      case NOTIFY_NEW_FLUFFY_BLOCK::ID:
+      case NOTIFY_REQUEST_FLUFFY_MISSING_TX::ID:
+      case NOTIFY_NEW_COMPACT_BLOCK::ID:
+        return epee::net_utils::traffic_class_relay;
+      case NOTIFY_RESPONSE_GET_OBJECTS::ID:
+      case NOTIFY_RESPONSE_CHAIN_ENTRY::ID:
+      case NOTIFY_COMPRESSED::ID:
+        return epee::net_utils::traffic_class_sync;
+      default:
+        return epee::net_utils::traffic_class_peerlist;
+    }
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  void t_cryptonote_protocol_handler<t_core>::note_block_announce(const crypto::hash& id, const cryptonote_connection_context& context)
+  {
+    // the first peer to announce a block sets the reference, the others are
+    // as late as they come after it
+    const uint64_t now = epee::misc_utils::get_tick_count();
+    uint64_t delay = 0;
+    {
+      boost::unique_lock<boost::mutex> lock(m_block_announces_lock);
+      auto it = m_block_announces.find(id);
+      if (it == m_block_announces.end())
+      {
+        if (m_block_announces.size() >= P2P_TRACKED_BLOCK_ANNOUNCES)
+        {
+          auto oldest = m_block_announces.begin();
+          for (auto i = m_block_announces.begin(); i != m_block_announces.end(); ++i)
+            if (i->second.first < oldest->second.first)
+              oldest = i;
+          m_block_announces.erase(oldest);
+        }
+        it = m_block_announces.emplace(id, std::make_pair(now, std::set<boost::uuids::uuid>())).first;
+      }
+      if (!it->second.second.insert(context.m_connection_id).second)
+        return;
+      delay = now - it->second.first;
+    }
+    m_p2p->report_block_announce_delay(context, delay);
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  void t_cryptonote_protocol_handler<t_core>::on_connection_close(cryptonote_connection_context& context)
+  {
+    // whatever this peer was still fetching is up for grabs again
+    m_block_queue.release_spans(context.m_connection_id);
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core>
   bool t_cryptonote_protocol_handler<t_core>::on_idle()
   {
+    m_idle_peer_kicker.do_call([this](){ check_sync_peers(); kick_idle_peers(); return true; });
+    m_peer_cost_checker.do_call([this](){ check_peer_costs(); return true; });
+    flush_tx_relay_queue();
     return m_core.on_idle();
   }
   //------------------------------------------------------------------------------------------------------------------------
@@ -941,6 +1461,7 @@ namespace cryptonote
   int t_cryptonote_protocol_handler<t_core>::handle_request_chain(int command, NOTIFY_REQUEST_CHAIN::request& arg, cryptonote_connection_context& context)
   {
     LOG_PRINT_CCONTEXT_L2("NOTIFY_REQUEST_CHAIN: m_block_ids.size()=" << arg.block_ids.size());
+    peer_cost_scope cost(*this, context, true);
     NOTIFY_RESPONSE_CHAIN_ENTRY::request r;
     if(!m_core.find_blockchain_supplement(arg.block_ids, r))
     {
@@ -948,12 +1469,38 @@ namespace cryptonote
       m_p2p->drop_connection(context);
       return 1;
     }
+    if(arg.headers && !m_core.get_block_hashing_blobs(r.m_block_ids, r.m_block_headers))
+      r.m_block_headers.clear();
     LOG_PRINT_CCONTEXT_L2("-->>NOTIFY_RESPONSE_CHAIN_ENTRY: m_start_height=" << r.start_height << ", m_total_height=" << r.total_height << ", m_block_ids.size()=" << r.m_block_ids.size());
-    post_notify<NOTIFY_RESPONSE_CHAIN_ENTRY>(r, context);
+    post_notify_compressible<NOTIFY_RESPONSE_CHAIN_ENTRY>(r, context);
     return 1;
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core>
+  size_t t_cryptonote_protocol_handler<t_core>::get_block_sync_count(const cryptonote_connection_context& context)
+  {
+    const size_t fixed_count = m_core.get_block_sync_size();
+    if(fixed_count)
+      return fixed_count;
+
+    // size requests by bytes: early tiny blocks come thousands at a time, big
+    // recent ones few enough to arrive in a few seconds at this peer's rate
+    if(!m_recent_block_size)
+      m_recent_block_size = m_core.get_average_block_size(CRYPTONOTE_REWARD_BLOCKS_WINDOW);
+    const uint64_t block_size = std::max<uint64_t>(m_recent_block_size, 1);
+
+    uint64_t budget = BLOCKS_SYNCHRONIZING_DEFAULT_SIZE;
+    const time_t connection_time = time(NULL) - context.m_started;
+    if(connection_time > 0 && context.m_recv_cnt > 0)
+      budget = context.m_recv_cnt / connection_time * BLOCKS_SYNCHRONIZING_TARGET_SECONDS;
+    budget = std::min<uint64_t>(std::max<uint64_t>(budget, BLOCKS_SYNCHRONIZING_MIN_SIZE), BLOCKS_SYNCHRONIZING_MAX_SIZE);
+
+    const size_t count = std::min<uint64_t>(std::max<uint64_t>(budget / block_size, 1), BLOCKS_SYNCHRONIZING_MAX_COUNT);
+    LOG_PRINT_CCONTEXT_L2("Block sync count " << count << " for " << budget << " bytes at " << block_size << " bytes per block");
+    return count;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
   bool t_cryptonote_protocol_handler<t_core>::request_missing_objects(cryptonote_connection_context& context, bool check_having_blocks)
   {
     //if (!m_one_request == false)
@@ -965,35 +1512,58 @@ namespace cryptonote
       auto time_from_epoh = point.time_since_epoch();
       auto sec = duration_cast< seconds >( time_from_epoh ).count();*/
 
+    if(check_having_blocks)
+    {
+      // forget what was added to the chain since, whichever peer sent it
+      while(!context.m_needed_objects.empty() && m_core.have_block(context.m_needed_objects.front()))
+        context.m_needed_objects.pop_front();
+    }
+
+    if(context.m_requested_objects.size())
+    {
+      // still waiting for the last span we asked for
+      return true;
+    }
+
     if(context.m_needed_objects.size())
     {
-      //we know objects that we need, request this objects
+      //we know objects that we need, request the first span nobody else is fetching
       NOTIFY_REQUEST_GET_OBJECTS::request req;
-      size_t count = 0;
-      auto it = context.m_needed_objects.begin();
+      const uint64_t first_block_height = context.m_last_response_height + 1 - context.m_needed_objects.size();
+      uint64_t start_height;
+      std::list<crypto::hash> hashes;
 
-      const size_t count_limit = m_core.get_block_sync_size();
+      const size_t count_limit = get_block_sync_count(context);
       _note_c("net/req-calc" , "Setting count_limit: " << count_limit);
-      while(it != context.m_needed_objects.end() && count < count_limit)
+      // kept orphans at the end need not be downloaded again, they are added
+      // once the blocks before them are
+      std::list<crypto::hash> needed_objects = context.m_needed_objects;
+      while(needed_objects.size() > 1 && m_orphan_blocks.has(needed_objects.back()))
+        needed_objects.pop_back();
+      // spans stalled at a slow peer hold back everything after them, so take those first
+      if(!m_block_queue.retry_stalled_span(first_block_height, needed_objects, boost::posix_time::seconds(BLOCK_QUEUE_SPAN_RETRY_SECONDS), context.m_connection_id, start_height, hashes)
+        && !m_block_queue.reserve_span(first_block_height, needed_objects, count_limit, context.m_connection_id, start_height, hashes))
       {
-        if( !(check_having_blocks && m_core.have_block(*it)))
-        {
-          req.blocks.push_back(*it);
-          ++count;
-          context.m_requested_objects.insert(*it);
-        }
-        context.m_needed_objects.erase(it++);
+        LOG_PRINT_CCONTEXT_L2("All needed blocks are queued from other peers, waiting");
+        return true;
+      }
+      BOOST_FOREACH(const crypto::hash& h, hashes)
+      {
+        req.blocks.push_back(h);
+        context.m_requested_objects.insert(h);
       }
       LOG_PRINT_CCONTEXT_L1("-->>NOTIFY_REQUEST_GET_OBJECTS: blocks.size()=" << req.blocks.size() << ", txs.size()=" << req.txs.size()
-          << "requested blocks count=" << count << " / " << count_limit);
+          << ", span " << start_height << " - " << start_height + hashes.size() - 1 << ", requested blocks count=" << hashes.size() << " / " << count_limit);
       //epee::net_utils::network_throttle_manager::get_global_throttle_inreq().logger_handle_net("log/dr-monero/net/req-all.data", sec, get_avg_block_size());
 
+      context.m_last_request_time = boost::posix_time::microsec_clock::universal_time();
       post_notify<NOTIFY_REQUEST_GET_OBJECTS>(req, context);
     }else if(context.m_last_response_height < context.m_remote_blockchain_height-1)
     {//we have to fetch more objects ids, request blockchain entry
 
       NOTIFY_REQUEST_CHAIN::request r = boost::value_initialized<NOTIFY_REQUEST_CHAIN::request>();
       m_core.get_short_chain_history(r.block_ids);
+      r.headers = true;
       handler_request_blocks_history( r.block_ids ); // change the limit(?), sleep(?)
 
       //std::string blob; // for calculate size of request
@@ -1085,6 +1655,15 @@ namespace cryptonote
       m_p2p->drop_connection(context);
     }
 
+    // peers which know to send headers let us check the chain's work before fetching any block
+    if(!arg.m_block_headers.empty() && !m_core.verify_block_headers(arg.start_height, arg.m_block_ids, arg.m_block_headers))
+    {
+      LOG_ERROR_CCONTEXT("sent bad block headers in NOTIFY_RESPONSE_CHAIN_ENTRY, dropping connection");
+      m_p2p->drop_connection(context);
+      m_p2p->add_ip_fail(context.m_remote_ip);
+      return 1;
+    }
+
     BOOST_FOREACH(auto& bl_id, arg.m_block_ids)
     {
       if(!m_core.have_block(bl_id))
@@ -1097,26 +1676,93 @@ namespace cryptonote
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core>
   bool t_cryptonote_protocol_handler<t_core>::relay_block(NOTIFY_NEW_BLOCK::request& arg, cryptonote_connection_context& exclude_context)
+  {
+    return relay_block(arg, exclude_context, relay_all);
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  bool t_cryptonote_protocol_handler<t_core>::relay_block_early(const NOTIFY_NEW_BLOCK::request& arg, cryptonote_connection_context& context)
+  {
+    // all the block's transactions are in the pool by now, so the peers can
+    // get from us any they miss while we verify the block
+    if(!m_core.get_early_block_relay() || !m_core.check_incoming_block_header(arg.b.block))
+      return false;
+    NOTIFY_NEW_BLOCK::request early_arg = AUTO_VAL_INIT(early_arg);
+    early_arg.hop = arg.hop + 1;
+    early_arg.current_blockchain_height = arg.current_blockchain_height;
+    early_arg.b.block = arg.b.block;
+    LOG_PRINT_CCONTEXT_L2("Relaying block early, before verifying it");
+    relay_block(early_arg, context, relay_early_peers);
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  bool t_cryptonote_protocol_handler<t_core>::tolerate_failed_block(const blobdata& block_blob, cryptonote_connection_context& context)
+  {
+    // a peer relaying early may pass on a block it has not verified yet,
+    // which is forgiven a few times if it at least had the proof of work
+    if(!(m_p2p->get_support_flags(context) & P2P_SUPPORT_FLAG_EARLY_RELAY) || !m_core.check_incoming_block_header(block_blob))
+      return false;
+    if(++context.m_early_relay_strikes >= P2P_EARLY_RELAY_MAX_STRIKES)
+    {
+      LOG_PRINT_CCONTEXT_L0("Too many early relayed blocks failed verification, dropping connection");
+      m_p2p->add_ip_fail(context.m_remote_ip);
+      return false;
+    }
+    LOG_PRINT_CCONTEXT_L1("Early relayed block failed verification (" << context.m_early_relay_strikes << "/" << P2P_EARLY_RELAY_MAX_STRIKES << ")");
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  bool t_cryptonote_protocol_handler<t_core>::relay_block(NOTIFY_NEW_BLOCK::request& arg, cryptonote_connection_context& exclude_context, relay_peers peers)
   {
     NOTIFY_NEW_FLUFFY_BLOCK::request fluffy_arg = AUTO_VAL_INIT(fluffy_arg);
     fluffy_arg.hop = arg.hop;
     fluffy_arg.current_blockchain_height = arg.current_blockchain_height;    
-    std::list<blobdata> fluffy_txs;
-    fluffy_arg.b = arg.b;
-    fluffy_arg.b.txs = fluffy_txs;
+    fluffy_arg.b.block = arg.b.block;
+
+    // the compact block has short ids instead of the transaction hashes
+    NOTIFY_NEW_COMPACT_BLOCK::request compact_arg = AUTO_VAL_INIT(compact_arg);
+    compact_arg.hop = arg.hop;
+    compact_arg.current_blockchain_height = arg.current_blockchain_height;
+    bool compact = false;
+    block b;
+    if (parse_and_validate_block_from_blob(arg.b.block, b))
+    {
+      compact_arg.block_id = get_block_hash(b);
+      std::vector<crypto::hash> tx_hashes = std::move(b.tx_hashes);
+      b.tx_hashes.clear();
+      b.invalidate_hashes();
+      compact_arg.block = block_to_blob(b);
+      compact_arg.salt = crypto::rand<uint64_t>();
+      const crypto::hash key = get_compact_block_key(compact_arg.block, compact_arg.salt);
+      for (const crypto::hash& tx_hash : tx_hashes)
+        append_compact_tx_id(compact_arg.short_tx_ids, get_compact_tx_id(key, tx_hash));
+      compact = true;
+    }
 
     // pre-serialize them
-    std::string fullBlob, fluffyBlob;
+    std::string fullBlob, fluffyBlob, compactBlob;
     epee::serialization::store_t_to_binary(arg, fullBlob);
     epee::serialization::store_t_to_binary(fluffy_arg, fluffyBlob);
+    if (compact)
+      epee::serialization::store_t_to_binary(compact_arg, compactBlob);
 
-    // sort peers between fluffy ones and others
-    std::list<boost::uuids::uuid> fullConnections, fluffyConnections;
-    m_p2p->for_each_connection([this, &arg, &fluffy_arg, &exclude_context, &fullConnections, &fluffyConnections](connection_context& context, nodetool::peerid_type peer_id, uint32_t support_flags)
+    // sort peers between compact, fluffy ones and others
+    std::list<boost::uuids::uuid> fullConnections, fluffyConnections, compactConnections;
+    m_p2p->for_each_connection([this, compact, peers, &exclude_context, &fullConnections, &fluffyConnections, &compactConnections](connection_context& context, nodetool::peerid_type peer_id, uint32_t support_flags)
     {
+      const bool early = support_flags & P2P_SUPPORT_FLAG_EARLY_RELAY;
+      if ((peers == relay_early_peers && !early) || (peers == relay_other_peers && early))
+        return true;
       if (peer_id && exclude_context.m_connection_id != context.m_connection_id)
       {
-        if(m_core.get_testnet() && (support_flags & P2P_SUPPORT_FLAG_FLUFFY_BLOCKS))
+        if(compact && m_core.get_testnet() && (support_flags & P2P_SUPPORT_FLAG_COMPACT_BLOCKS))
+        {
+          LOG_PRINT_CCONTEXT_YELLOW("PEER SUPPORTS COMPACT BLOCKS - RELAYING SHORT TX IDS", LOG_LEVEL_1);
+          compactConnections.push_back(context.m_connection_id);
+        }
+        else if(m_core.get_testnet() && (support_flags & P2P_SUPPORT_FLAG_FLUFFY_BLOCKS))
         {
           LOG_PRINT_CCONTEXT_YELLOW("PEER SUPPORTS FLUFFY BLOCKS - RELAYING THIN/COMPACT WHATEVER BLOCK", LOG_LEVEL_1);
           fluffyConnections.push_back(context.m_connection_id);
@@ -1130,7 +1776,9 @@ namespace cryptonote
       return true;
     });
 
-    // send fluffy ones first, we want to encourage people to run that
+    // send compact and fluffy ones first, we want to encourage people to run that
+    if (compact)
+      m_p2p->relay_notify_to_list(NOTIFY_NEW_COMPACT_BLOCK::ID, compactBlob, compactConnections);
     m_p2p->relay_notify_to_list(NOTIFY_NEW_FLUFFY_BLOCK::ID, fluffyBlob, fluffyConnections);
     m_p2p->relay_notify_to_list(NOTIFY_NEW_BLOCK::ID, fullBlob, fullConnections);
 
@@ -1143,7 +1791,55 @@ namespace cryptonote
     // no check for success, so tell core they're relayed unconditionally
     for(auto tx_blob_it = arg.txs.begin(); tx_blob_it!=arg.txs.end(); ++tx_blob_it)
       m_core.on_transaction_relayed(*tx_blob_it);
-    return relay_post_notify<NOTIFY_NEW_TRANSACTIONS>(arg, exclude_context);
+
+    // sent at the next idle tick, along with any others by then
+    boost::lock_guard<boost::mutex> lock(m_tx_relay_lock);
+    for(const blobdata& tx_blob : arg.txs)
+      m_tx_relay_queue.push_back({get_blob_hash(tx_blob), tx_blob, exclude_context.m_connection_id});
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  void t_cryptonote_protocol_handler<t_core>::flush_tx_relay_queue()
+  {
+    std::vector<queued_tx> txs;
+    {
+      boost::lock_guard<boost::mutex> lock(m_tx_relay_lock);
+      txs.swap(m_tx_relay_queue);
+    }
+    if (txs.empty())
+      return;
+
+    // one notification per peer, of the txes it is not known to have
+    std::list<std::pair<boost::uuids::uuid, NOTIFY_NEW_TRANSACTIONS::request>> batches;
+    size_t sent = 0, skipped = 0;
+    m_p2p->for_each_connection([&](connection_context& context, nodetool::peerid_type peer_id, uint32_t support_flags)
+    {
+      if (!peer_id)
+        return true;
+      NOTIFY_NEW_TRANSACTIONS::request r;
+      for (const queued_tx& tx : txs)
+      {
+        if (tx.source == context.m_connection_id || context.m_known_txs.insert(tx.hash))
+          ++skipped;
+        else
+          r.txs.push_back(tx.blob);
+      }
+      if (!r.txs.empty())
+      {
+        sent += r.txs.size();
+        batches.emplace_back(context.m_connection_id, std::move(r));
+      }
+      return true;
+    });
+
+    LOG_PRINT_L2("Relaying " << txs.size() << " txes to " << batches.size() << " peers, " << sent << " sent, " << skipped << " already known");
+    for (const auto& batch : batches)
+    {
+      std::string blob;
+      epee::serialization::store_t_to_binary(batch.second, blob);
+      m_p2p->relay_notify_to_list(NOTIFY_NEW_TRANSACTIONS::ID, blob, std::list<boost::uuids::uuid>(1, batch.first));
+    }
   }
 
   /// @deprecated
@@ -1163,6 +1859,7 @@ namespace cryptonote
   void t_cryptonote_protocol_handler<t_core>::stop()
   {
     m_stopping = true;
+    notify_sync_thread();
     m_core.stop();
   }
 } // namespace
@@ -0,0 +1,116 @@
+// Copyright (c) 2014-2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include "orphan_block_buffer.h"
+
+namespace cryptonote
+{
+//------------------------------------------------------------------
+static size_t entry_size(const block_complete_entry &entry)
+{
+  size_t size = entry.block.size();
+  for (const blobdata &tx : entry.txs)
+    size += tx.size();
+  return size;
+}
+//------------------------------------------------------------------
+orphan_block_buffer::orphan_block_buffer(size_t max_size, size_t max_count):
+  m_data_size(0), m_max_size(max_size), m_max_count(max_count)
+{
+}
+//------------------------------------------------------------------
+bool orphan_block_buffer::add(const crypto::hash &id, const crypto::hash &parent, const block_complete_entry &entry)
+{
+  CRITICAL_REGION_LOCAL(m_lock);
+  const size_t size = entry_size(entry);
+  if (size > m_max_size || m_max_count == 0 || m_blocks.find(id) != m_blocks.end())
+    return false;
+
+  while (!m_order.empty() && (m_data_size + size > m_max_size || m_blocks.size() >= m_max_count))
+    remove(m_order.front());
+
+  m_blocks.insert(std::make_pair(id, orphan{parent, entry, size}));
+  m_children.insert(std::make_pair(parent, id));
+  m_order.push_back(id);
+  m_data_size += size;
+  return true;
+}
+//------------------------------------------------------------------
+void orphan_block_buffer::remove(const crypto::hash &id)
+{
+  auto it = m_blocks.find(id);
+  if (it == m_blocks.end())
+    return;
+  auto range = m_children.equal_range(it->second.parent);
+  for (auto child = range.first; child != range.second; ++child)
+  {
+    if (child->second == id)
+    {
+      m_children.erase(child);
+      break;
+    }
+  }
+  m_order.erase(std::find(m_order.begin(), m_order.end(), id));
+  m_data_size -= it->second.size;
+  m_blocks.erase(it);
+}
+//------------------------------------------------------------------
+void orphan_block_buffer::take_children(const crypto::hash &parent, std::vector<block_complete_entry> &blocks)
+{
+  CRITICAL_REGION_LOCAL(m_lock);
+  blocks.clear();
+  std::vector<crypto::hash> ids;
+  auto range = m_children.equal_range(parent);
+  for (auto child = range.first; child != range.second; ++child)
+    ids.push_back(child->second);
+  for (const crypto::hash &id : ids)
+  {
+    blocks.push_back(std::move(m_blocks.find(id)->second.entry));
+    remove(id);
+  }
+}
+//------------------------------------------------------------------
+bool orphan_block_buffer::has(const crypto::hash &id) const
+{
+  CRITICAL_REGION_LOCAL(m_lock);
+  return m_blocks.find(id) != m_blocks.end();
+}
+//------------------------------------------------------------------
+size_t orphan_block_buffer::get_data_size() const
+{
+  CRITICAL_REGION_LOCAL(m_lock);
+  return m_data_size;
+}
+//------------------------------------------------------------------
+size_t orphan_block_buffer::get_count() const
+{
+  CRITICAL_REGION_LOCAL(m_lock);
+  return m_blocks.size();
+}
+}
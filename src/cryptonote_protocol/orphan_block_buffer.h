@@ -0,0 +1,91 @@
+// Copyright (c) 2014-2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <deque>
+#include <unordered_map>
+#include <vector>
+#include "syncobj.h"
+#include "crypto/hash.h"
+#include "cryptonote_protocol_defs.h"
+
+namespace cryptonote
+{
+  /**
+   * @brief blocks which arrived before their parent, kept by parent hash
+   *
+   * A block announced or sent ahead of a block we do not have yet would be
+   * downloaded again once we synced up to it. It is kept here instead, and
+   * handed back once its parent was added. The oldest blocks are dropped
+   * past ORPHAN_BLOCKS_MAX_SIZE bytes or ORPHAN_BLOCKS_MAX_COUNT blocks.
+   */
+  class orphan_block_buffer
+  {
+  public:
+    orphan_block_buffer(size_t max_size, size_t max_count);
+
+    /**
+     * @brief keeps a block until its parent arrives
+     *
+     * @return false if the block is already kept, or larger than the whole buffer
+     */
+    bool add(const crypto::hash &id, const crypto::hash &parent, const block_complete_entry &entry);
+
+    /**
+     * @brief removes and returns the blocks whose parent is the given block
+     */
+    void take_children(const crypto::hash &parent, std::vector<block_complete_entry> &blocks);
+
+    /**
+     * @brief checks whether a block is kept
+     */
+    bool has(const crypto::hash &id) const;
+
+    size_t get_data_size() const;
+    size_t get_count() const;
+
+  private:
+    struct orphan
+    {
+      crypto::hash parent;
+      block_complete_entry entry;
+      size_t size;
+    };
+
+    void remove(const crypto::hash &id);
+
+    std::unordered_map<crypto::hash, orphan> m_blocks; //!< by block hash
+    std::unordered_multimap<crypto::hash, crypto::hash> m_children; //!< block hashes by parent hash
+    std::deque<crypto::hash> m_order; //!< block hashes, oldest first
+    size_t m_data_size;
+    const size_t m_max_size;
+    const size_t m_max_count;
+    mutable epee::critical_section m_lock;
+  };
+}
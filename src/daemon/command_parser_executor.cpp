@@ -482,4 +482,62 @@ bool t_command_parser_executor::print_coinbase_tx_sum(const std::vector<std::str
   return m_executor.print_coinbase_tx_sum(height, count);
 }
 
+bool t_command_parser_executor::print_db_stats(const std::vector<std::string>& args)
+{
+  if (!args.empty()) return false;
+  return m_executor.print_db_stats();
+}
+
+bool t_command_parser_executor::print_mem(const std::vector<std::string>& args)
+{
+  if (!args.empty()) return false;
+  return m_executor.print_mem();
+}
+
+bool t_command_parser_executor::snapshot_db(const std::vector<std::string>& args)
+{
+  if (args.size() > 2) return false;
+  std::string path;
+  uint64_t max_rate_kB = 0;
+  if (!args.empty())
+    path = args[0];
+  if (args.size() > 1 && !epee::string_tools::get_xtype_from_string(max_rate_kB, args[1]))
+  {
+    std::cout << "wrong rate parameter" << std::endl;
+    return false;
+  }
+  return m_executor.snapshot_db(path, max_rate_kB);
+}
+
+bool t_command_parser_executor::print_rpc_stats(const std::vector<std::string>& args)
+{
+  if (!args.empty()) return false;
+  return m_executor.print_rpc_stats();
+}
+
+bool t_command_parser_executor::print_net_stats(const std::vector<std::string>& args)
+{
+  if (args.empty()) return m_executor.print_net_stats(false);
+  if (args.size() == 1 && args[0] == "reset") return m_executor.print_net_stats(true);
+  return false;
+}
+
+bool t_command_parser_executor::print_block_processing_stats(const std::vector<std::string>& args)
+{
+  if (!args.empty()) return false;
+  return m_executor.print_block_processing_stats();
+}
+
+bool t_command_parser_executor::perf_profile(const std::vector<std::string>& args)
+{
+  if (args.size() > 1) return false;
+  if (args.empty()) return m_executor.print_perf_profile(false, false);
+  if (args[0] == "on") return m_executor.set_perf_profile(true);
+  if (args[0] == "off") return m_executor.set_perf_profile(false);
+  if (args[0] == "reset") return m_executor.print_perf_profile(true, false);
+  if (args[0] == "folded") return m_executor.print_perf_profile(false, true);
+  std::cout << "expected: perf_profile [on|off|reset|folded]" << std::endl;
+  return true;
+}
+
 } // namespace daemonize
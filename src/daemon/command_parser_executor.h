@@ -119,6 +119,20 @@ public:
   bool output_histogram(const std::vector<std::string>& args);
 
   bool print_coinbase_tx_sum(const std::vector<std::string>& args);
+
+  bool print_db_stats(const std::vector<std::string>& args);
+
+  bool print_mem(const std::vector<std::string>& args);
+
+  bool snapshot_db(const std::vector<std::string>& args);
+
+  bool print_rpc_stats(const std::vector<std::string>& args);
+
+  bool print_net_stats(const std::vector<std::string>& args);
+
+  bool print_block_processing_stats(const std::vector<std::string>& args);
+
+  bool perf_profile(const std::vector<std::string>& args);
 };
 
 } // namespace daemonize
@@ -225,6 +225,41 @@ t_command_server::t_command_server(
     , std::bind(&t_command_parser_executor::print_coinbase_tx_sum, &m_parser, p::_1)
     , "Print sum of coinbase transactions (start height, block count)"
     );
+    m_command_lookup.set_handler(
+      "print_db_stats"
+    , std::bind(&t_command_parser_executor::print_db_stats, &m_parser, p::_1)
+    , "Print per-method blockchain database statistics"
+    );
+    m_command_lookup.set_handler(
+      "print_mem"
+    , std::bind(&t_command_parser_executor::print_mem, &m_parser, p::_1)
+    , "Print estimated memory use by subsystem"
+    );
+    m_command_lookup.set_handler(
+      "snapshot_db"
+    , std::bind(&t_command_parser_executor::snapshot_db, &m_parser, p::_1)
+    , "snapshot_db [<dir> [<max_kB_per_s>]], Start a compacted copy of the blockchain database into <dir>, or show the progress of the last one"
+    );
+    m_command_lookup.set_handler(
+      "print_rpc_stats"
+    , std::bind(&t_command_parser_executor::print_rpc_stats, &m_parser, p::_1)
+    , "Print per-method RPC call statistics"
+    );
+    m_command_lookup.set_handler(
+      "print_net_stats"
+    , std::bind(&t_command_parser_executor::print_net_stats, &m_parser, p::_1)
+    , "print_net_stats [reset] - Print traffic and handler time per p2p command and traffic per peer, reset counts again from now"
+    );
+    m_command_lookup.set_handler(
+      "print_block_processing_stats"
+    , std::bind(&t_command_parser_executor::print_block_processing_stats, &m_parser, p::_1)
+    , "Print per-phase timings of the last blocks added to the chain"
+    );
+    m_command_lookup.set_handler(
+      "perf_profile"
+    , std::bind(&t_command_parser_executor::perf_profile, &m_parser, p::_1)
+    , "perf_profile [on|off|reset|folded] - Print the profile of the timed scopes, reset prints it and counts again from now, folded prints it for flame graph tools"
+    );
 }
 
 bool t_command_server::process_command_str(const std::string& cmd)
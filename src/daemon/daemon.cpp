@@ -31,6 +31,7 @@
 #include <memory>
 #include <stdexcept>
 #include "misc_log_ex.h"
+#include "misc_language.h"
 #include "daemon/daemon.h"
 
 #include "common/util.h"
@@ -38,6 +39,7 @@
 #include "daemon/p2p.h"
 #include "daemon/protocol.h"
 #include "daemon/rpc.h"
+#include "daemon/stratum.h"
 #include "daemon/command_server.h"
 #include "version.h"
 #include "../../contrib/epee/include/syncobj.h"
@@ -55,6 +57,7 @@ public:
   t_core core;
   t_p2p p2p;
   t_rpc rpc;
+  t_stratum stratum;
 
   t_internals(
       boost::program_options::variables_map const & vm
@@ -63,6 +66,7 @@ public:
     , protocol{vm, core}
     , p2p{vm, protocol}
     , rpc{vm, core, p2p}
+    , stratum{vm, core}
   {
     // Handle circular dependencies
     protocol.set_p2p_endpoint(p2p.get());
@@ -75,6 +79,7 @@ void t_daemon::init_options(boost::program_options::options_description & option
   t_core::init_options(option_spec);
   t_p2p::init_options(option_spec);
   t_rpc::init_options(option_spec);
+  t_stratum::init_options(option_spec);
 }
 
 t_daemon::t_daemon(
@@ -114,11 +119,19 @@ bool t_daemon::run(bool interactive)
   }
   tools::signal_handler::install(std::bind(&daemonize::t_daemon::stop_p2p, this));
 
+  // log writes leave the p2p and sync threads to a writer thread while the node runs,
+  // started here rather than in main as daemonizing forks
+  epee::log_space::log_singletone::set_async(true);
+  epee::misc_utils::auto_scope_leave_caller sync_logging = epee::misc_utils::create_scope_leave_handler([](){
+    epee::log_space::log_singletone::set_async(false);
+  });
+
   try
   {
     if (!mp_internals->core.run())
       return false;
     mp_internals->rpc.run();
+    mp_internals->stratum.run();
 
     daemonize::t_command_server* rpc_commands;
 
@@ -135,6 +148,7 @@ bool t_daemon::run(bool interactive)
       rpc_commands->stop_handling();
     }
 
+    mp_internals->stratum.stop();
     mp_internals->rpc.stop();
     LOG_PRINT("Node stopped.", LOG_LEVEL_0);
     return true;
@@ -158,6 +172,7 @@ void t_daemon::stop()
     throw std::runtime_error{"Can't stop stopped daemon"};
   }
   mp_internals->p2p.stop();
+  mp_internals->stratum.stop();
   mp_internals->rpc.stop();
   mp_internals.reset(nullptr); // Ensure resources are cleaned up before we return
 }
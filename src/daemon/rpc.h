@@ -63,7 +63,7 @@ public:
   void run()
   {
     LOG_PRINT_L0("Starting core rpc server...");
-    if (!m_server.run(2, false))
+    if (!m_server.run(m_server.get_threads_count(), false))
     {
       throw std::runtime_error("Failed to start core rpc server.");
     }
@@ -375,6 +375,20 @@ bool t_rpc_command_executor::show_status() {
     % (hfres.state == cryptonote::HardFork::Ready ? "up to date" : hfres.state == cryptonote::HardFork::UpdateNeeded ? "update needed" : "out of date, likely forked")
     % (unsigned)ires.outgoing_connections_count % (unsigned)ires.incoming_connections_count
   ;
+  tools::msg_writer() << boost::format("Verification pool: %llu queued, %.1f s busy")
+    % (unsigned long long)ires.verification_queue
+    % (ires.verification_busy_time / 1000.0)
+  ;
+  const uint64_t ring_member_lookups = ires.ring_member_cache_hits + ires.ring_member_cache_misses;
+  tools::msg_writer() << boost::format("Ring member cache: %.1f%% hit rate, %llu entries")
+    % (ring_member_lookups ? 100.0 * ires.ring_member_cache_hits / ring_member_lookups : 0.0)
+    % (unsigned long long)ires.ring_member_cache_size
+  ;
+  const uint64_t output_key_lookups = ires.output_key_cache_hits + ires.output_key_cache_misses;
+  tools::msg_writer() << boost::format("Ring member output cache: %.1f%% hit rate, %llu entries")
+    % (output_key_lookups ? 100.0 * ires.output_key_cache_hits / output_key_lookups : 0.0)
+    % (unsigned long long)ires.output_key_cache_size
+  ;
 
   return true;
 }
@@ -1367,5 +1381,314 @@ bool t_rpc_command_executor::print_coinbase_tx_sum(uint64_t height, uint64_t cou
   return true;
 }
 
+bool t_rpc_command_executor::print_db_stats()
+{
+  cryptonote::COMMAND_RPC_GET_DB_STATS::request req;
+  cryptonote::COMMAND_RPC_GET_DB_STATS::response res;
+  std::string fail_message = "Unsuccessful";
+  epee::json_rpc::error error_resp;
+
+  if (m_is_rpc)
+  {
+    if (!m_rpc_client->json_rpc_request(req, res, "get_db_stats", fail_message.c_str()))
+    {
+      return true;
+    }
+  }
+  else
+  {
+    if (!m_rpc_server->on_get_db_stats(req, res, error_resp) || res.status != CORE_RPC_STATUS_OK)
+    {
+      tools::fail_msg_writer() << fail_message.c_str();
+      return true;
+    }
+  }
+
+  tools::msg_writer() << boost::format("%-28s %-20s %12s %14s %12s %8s %10s %10s")
+    % "method" % "table" % "calls" % "bytes read" % "cursor ops" % "gets" % "p50 (us)" % "p99 (us)";
+  for (const auto &e: res.entries)
+  {
+    tools::msg_writer() << boost::format("%-28s %-20s %12u %14u %12u %8u %10u %10u")
+      % e.method % e.table % e.calls % e.bytes_read % e.cursor_ops % e.gets % e.p50_us % e.p99_us;
+  }
+  tools::msg_writer() << "syncs: " << res.syncs << ", last " << res.last_sync_us << " us, max " << res.max_sync_us
+    << " us, total " << res.total_sync_us << " us";
+  tools::msg_writer() << "not synced: " << res.unsynced_blocks << " blocks, " << res.unsynced_bytes << " bytes, lag "
+    << res.sync_lag_ms << " ms, max lag " << res.max_sync_lag_ms << " ms";
+  return true;
+}
+
+static std::string mem_mb(uint64_t bytes)
+{
+  return (boost::format("%.1f MB") % (bytes / 1048576.0)).str();
+}
+
+bool t_rpc_command_executor::print_mem()
+{
+  cryptonote::COMMAND_RPC_GET_MEMORY_STATS::request req;
+  cryptonote::COMMAND_RPC_GET_MEMORY_STATS::response res;
+  std::string fail_message = "Unsuccessful";
+  epee::json_rpc::error error_resp;
+
+  if (m_is_rpc)
+  {
+    if (!m_rpc_client->json_rpc_request(req, res, "get_memory_stats", fail_message.c_str()))
+    {
+      return true;
+    }
+  }
+  else
+  {
+    if (!m_rpc_server->on_get_memory_stats(req, res, error_resp) || res.status != CORE_RPC_STATUS_OK)
+    {
+      tools::fail_msg_writer() << fail_message.c_str();
+      return true;
+    }
+  }
+
+  tools::msg_writer() << boost::format("%-20s %10s %14s") % "subsystem" % "entries" % "memory";
+  tools::msg_writer() << boost::format("%-20s %10u %14s") % "txpool" % res.txpool_count % mem_mb(res.txpool_bytes);
+  tools::msg_writer() << boost::format("%-20s %10u %14s") % "alt blocks" % res.alt_blocks_count % mem_mb(res.alt_blocks_bytes);
+  tools::msg_writer() << boost::format("%-20s %10s %14s") % "scan tables" % "" % mem_mb(res.scan_table_bytes);
+  tools::msg_writer() << boost::format("%-20s %10s %14s") % "longhash table" % "" % mem_mb(res.longhash_table_bytes);
+  tools::msg_writer() << boost::format("%-20s %10u %14s") % "connections" % res.connections_count % mem_mb(res.connections_bytes);
+  tools::msg_writer() << boost::format("%-20s %10u %14s") % "peerlist" % res.peerlist_count % mem_mb(res.peerlist_bytes);
+  tools::msg_writer() << "database: " << mem_mb(res.db_resident_bytes) << " resident, " << mem_mb(res.db_used_bytes)
+    << " used of a " << mem_mb(res.db_map_size) << " map";
+  tools::msg_writer() << "process resident: " << mem_mb(res.resident_bytes);
+  return true;
+}
+
+bool t_rpc_command_executor::snapshot_db(const std::string &path, uint64_t max_rate_kB)
+{
+  cryptonote::COMMAND_RPC_SNAPSHOT_DB::request req;
+  cryptonote::COMMAND_RPC_SNAPSHOT_DB::response res;
+  std::string fail_message = "Unsuccessful";
+  epee::json_rpc::error error_resp;
+
+  req.path = path;
+  req.max_rate_kB = max_rate_kB;
+
+  if (m_is_rpc)
+  {
+    if (!m_rpc_client->json_rpc_request(req, res, "snapshot_db", fail_message.c_str()))
+    {
+      return true;
+    }
+  }
+  else
+  {
+    if (!m_rpc_server->on_snapshot_db(req, res, error_resp) || res.status != CORE_RPC_STATUS_OK)
+    {
+      tools::fail_msg_writer() << fail_message.c_str() << (error_resp.message.empty() ? "" : ": ") << error_resp.message;
+      return true;
+    }
+  }
+
+  if (res.path.empty())
+  {
+    tools::msg_writer() << "No database snapshot was started";
+    return true;
+  }
+  const unsigned percent = res.total ? std::min<uint64_t>(100, res.written * 100 / res.total) : 0;
+  if (res.running)
+    tools::msg_writer() << "Snapshot to " << res.path << " in progress: " << res.written << "/" << res.total << " bytes (" << percent << "%)";
+  else if (!res.error.empty())
+    tools::fail_msg_writer() << "Snapshot to " << res.path << " failed: " << res.error;
+  else
+    tools::success_msg_writer() << "Snapshot to " << res.path << " done, " << res.written << " bytes";
+  return true;
+}
+
+bool t_rpc_command_executor::print_rpc_stats()
+{
+  cryptonote::COMMAND_RPC_GET_RPC_STATS::request req;
+  cryptonote::COMMAND_RPC_GET_RPC_STATS::response res;
+  std::string fail_message = "Unsuccessful";
+  epee::json_rpc::error error_resp;
+
+  if (m_is_rpc)
+  {
+    if (!m_rpc_client->json_rpc_request(req, res, "get_rpc_stats", fail_message.c_str()))
+    {
+      return true;
+    }
+  }
+  else
+  {
+    if (!m_rpc_server->on_get_rpc_stats(req, res, error_resp) || res.status != CORE_RPC_STATUS_OK)
+    {
+      tools::fail_msg_writer() << fail_message.c_str();
+      return true;
+    }
+  }
+
+  tools::msg_writer() << boost::format("%-32s %10s %8s %14s %10s %10s %10s")
+    % "method" % "calls" % "errors" % "bytes out" % "p50 (us)" % "p90 (us)" % "p99 (us)";
+  for (const auto &e: res.methods)
+  {
+    tools::msg_writer() << boost::format("%-32s %10u %8u %14u %10u %10u %10u")
+      % e.method % e.calls % e.errors % e.bytes_out % e.p50_us % e.p90_us % e.p99_us;
+  }
+  tools::msg_writer() << "";
+  tools::msg_writer() << "fast threads: " << res.fast_threads << ", bulk threads: " << res.bulk_threads;
+  tools::msg_writer() << boost::format("%-32s %6s %9s %10s %8s %14s %14s")
+    % "bulk endpoint" % "limit" % "in flight" % "calls" % "busy" % "queue (us)" % "service (us)";
+  for (const auto &e: res.limits)
+  {
+    tools::msg_writer() << boost::format("%-32s %6u %9u %10u %8u %14u %14u")
+      % e.endpoint % e.max_in_flight % e.in_flight % e.calls % e.busy % e.queue_time_us % e.service_time_us;
+  }
+  tools::msg_writer() << "";
+  tools::msg_writer() << "response cache: " << res.response_cache_entries << " entries, " << res.response_cache_bytes << " bytes, "
+      << res.response_cache_hits << " hits, " << res.response_cache_misses << " misses";
+  return true;
+}
+
+bool t_rpc_command_executor::print_net_stats(bool reset)
+{
+  cryptonote::COMMAND_RPC_GET_NET_STATS::request req;
+  cryptonote::COMMAND_RPC_GET_NET_STATS::response res;
+  std::string fail_message = "Unsuccessful";
+  epee::json_rpc::error error_resp;
+
+  req.reset = reset;
+
+  if (m_is_rpc)
+  {
+    if (!m_rpc_client->json_rpc_request(req, res, "get_net_stats", fail_message.c_str()))
+    {
+      return true;
+    }
+  }
+  else
+  {
+    if (!m_rpc_server->on_get_net_stats(req, res, error_resp) || res.status != CORE_RPC_STATUS_OK)
+    {
+      tools::fail_msg_writer() << fail_message.c_str();
+      return true;
+    }
+  }
+
+  tools::msg_writer() << boost::format("%-26s %6s %10s %14s %10s %14s %14s")
+    % "command" % "id" % "in msgs" % "in bytes" % "out msgs" % "out bytes" % "handler (us)";
+  for (const auto &e: res.commands)
+  {
+    tools::msg_writer() << boost::format("%-26s %6u %10u %14u %10u %14u %14u")
+      % e.name % e.command % e.in_messages % e.in_bytes % e.out_messages % e.out_bytes % e.handler_us;
+  }
+  tools::msg_writer() << "";
+  tools::msg_writer() << boost::format("%-16s %10s %14s %10s %14s")
+    % "peer" % "in msgs" % "in bytes" % "out msgs" % "out bytes";
+  for (const auto &e: res.peers)
+  {
+    tools::msg_writer() << boost::format("%-16s %10u %14u %10u %14u")
+      % (e.ip ? epee::string_tools::get_ip_string_from_int32(e.ip) : std::string("others")) % e.in_messages % e.in_bytes % e.out_messages % e.out_bytes;
+  }
+  return true;
+}
+
+bool t_rpc_command_executor::print_block_processing_stats()
+{
+  cryptonote::COMMAND_RPC_GET_BLOCK_PROCESSING_STATS::request req;
+  cryptonote::COMMAND_RPC_GET_BLOCK_PROCESSING_STATS::response res;
+  std::string fail_message = "Unsuccessful";
+  epee::json_rpc::error error_resp;
+
+  if (m_is_rpc)
+  {
+    if (!m_rpc_client->json_rpc_request(req, res, "get_block_processing_stats", fail_message.c_str()))
+    {
+      return true;
+    }
+  }
+  else
+  {
+    if (!m_rpc_server->on_get_block_processing_stats(req, res, error_resp) || res.status != CORE_RPC_STATUS_OK)
+    {
+      tools::fail_msg_writer() << fail_message.c_str();
+      return true;
+    }
+  }
+
+  tools::msg_writer() << "last " << res.blocks << " blocks";
+  tools::msg_writer() << boost::format("%-12s %14s %10s %10s %10s %10s %10s")
+    % "phase" % "total (us)" % "mean (us)" % "p50 (us)" % "p90 (us)" % "p99 (us)" % "max (us)";
+  for (const auto &e: res.phases)
+  {
+    tools::msg_writer() << boost::format("%-12s %14u %10u %10u %10u %10u %10u")
+      % e.phase % e.total_us % (res.blocks ? e.total_us / res.blocks : 0) % e.p50_us % e.p90_us % e.p99_us % e.max_us;
+  }
+  return true;
+}
+
+bool t_rpc_command_executor::print_perf_profile(bool reset, bool folded)
+{
+  cryptonote::COMMAND_RPC_GET_PERF_PROFILE::request req;
+  cryptonote::COMMAND_RPC_GET_PERF_PROFILE::response res;
+  std::string fail_message = "Unsuccessful";
+  epee::json_rpc::error error_resp;
+
+  req.reset = reset;
+  if (m_is_rpc)
+  {
+    if (!m_rpc_client->json_rpc_request(req, res, "get_perf_profile", fail_message.c_str()))
+    {
+      return true;
+    }
+  }
+  else
+  {
+    if (!m_rpc_server->on_get_perf_profile(req, res, error_resp) || res.status != CORE_RPC_STATUS_OK)
+    {
+      tools::fail_msg_writer() << fail_message.c_str();
+      return true;
+    }
+  }
+
+  if (folded)
+  {
+    tools::msg_writer() << res.folded;
+    return true;
+  }
+  tools::msg_writer() << "profiling " << (res.enabled ? "on" : "off") << ", " << res.dropped << " scopes dropped";
+  tools::msg_writer() << boost::format("%-56s %10s %14s %14s")
+    % "path" % "calls" % "total (us)" % "self (us)";
+  for (const auto &e: res.entries)
+  {
+    tools::msg_writer() << boost::format("%-56s %10u %14u %14u")
+      % e.path % e.calls % e.total_us % e.self_us;
+  }
+  return true;
+}
+
+bool t_rpc_command_executor::set_perf_profile(bool enable)
+{
+  cryptonote::COMMAND_RPC_SET_PERF_PROFILE::request req;
+  cryptonote::COMMAND_RPC_SET_PERF_PROFILE::response res;
+  std::string fail_message = "Unsuccessful";
+  epee::json_rpc::error error_resp;
+
+  req.enable = enable;
+  if (m_is_rpc)
+  {
+    if (!m_rpc_client->json_rpc_request(req, res, "set_perf_profile", fail_message.c_str()))
+    {
+      return true;
+    }
+  }
+  else
+  {
+    if (!m_rpc_server->on_set_perf_profile(req, res, error_resp) || res.status != CORE_RPC_STATUS_OK)
+    {
+      tools::fail_msg_writer() << fail_message.c_str();
+      return true;
+    }
+  }
+
+  tools::success_msg_writer() << "Profiling " << (enable ? "on" : "off");
+  return true;
+}
+
 
 }// namespace daemonize
@@ -137,6 +137,22 @@ public:
   bool output_histogram(uint64_t min_count, uint64_t max_count);
 
   bool print_coinbase_tx_sum(uint64_t height, uint64_t count);
+
+  bool print_db_stats();
+
+  bool print_mem();
+
+  bool snapshot_db(const std::string &path, uint64_t max_rate_kB);
+
+  bool print_rpc_stats();
+
+  bool print_net_stats(bool reset);
+
+  bool print_block_processing_stats();
+
+  bool print_perf_profile(bool reset, bool folded);
+
+  bool set_perf_profile(bool enable);
 };
 
 } // namespace daemonize
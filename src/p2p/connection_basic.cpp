@@ -155,6 +155,8 @@ connection_basic::connection_basic(boost::asio::io_service& io_service, std::ato
 	socket_(io_service),
 	m_want_close_connection(false), 
 	m_was_shutdown(false),
+	m_send_que_in_flight(0),
+	m_write_scheduled(false),
 	m_ref_sock_count(ref_sock_count)
 { 
 	++ref_sock_count; // increase the global counter
@@ -184,6 +186,7 @@ void connection_basic::set_rate_up_limit(uint64_t limit) {
 		network_throttle_manager::get_global_throttle_out().set_target_speed(limit);
 		network_throttle_manager::get_global_throttle_out().set_real_target_speed(limit / SCALING_FACTOR);
 	}
+	traffic_shaper::get_global_out().set_rate(limit / SCALING_FACTOR);
 	save_limit_to_file(limit);
 }
 
@@ -197,6 +200,7 @@ void connection_basic::set_rate_down_limit(uint64_t limit) {
 	  CRITICAL_REGION_LOCAL(	network_throttle_manager::m_lock_get_global_throttle_inreq );
 		network_throttle_manager::get_global_throttle_inreq().set_target_speed(limit);
 	}
+	traffic_shaper::get_global_in().set_rate(limit);
     save_limit_to_file(limit);
 }
 
@@ -242,36 +246,10 @@ int connection_basic::get_tos_flag() {
 	return connection_basic_pimpl::m_default_tos;
 }
 
-void connection_basic::sleep_before_packet(size_t packet_size, int phase,  int q_len) {
-	double delay=0; // will be calculated
-	do
-	{ // rate limiting
-		if (m_was_shutdown) { 
-			_dbg2("m_was_shutdown - so abort sleep");
-			return;
-		}
-
-		{ 
-			CRITICAL_REGION_LOCAL(	network_throttle_manager::m_lock_get_global_throttle_out );
-			delay = network_throttle_manager::get_global_throttle_out().get_sleep_time_after_tick( packet_size ); // decission from global
-		}
-
-		delay *= 0.50;
-		if (delay > 0) {
-            long int ms = (long int)(delay * 1000);
-			_info_c("net/sleep", "Sleeping in " << __FUNCTION__ << " for " << ms << " ms before packet_size="<<packet_size); // debug sleep
-			_dbg1("sleep in sleep_before_packet");
-			epee::net_utils::data_logger::get_instance().add_data("sleep_up", ms);
-			boost::this_thread::sleep(boost::posix_time::milliseconds( ms ) );
-		}
-	} while(delay > 0);
-
-// XXX LATER XXX
-	{
-	  CRITICAL_REGION_LOCAL(	network_throttle_manager::m_lock_get_global_throttle_out );
-		network_throttle_manager::get_global_throttle_out().handle_trafic_exact( packet_size * 700); // increase counter - global
-	}
-
+void connection_basic::account_out_traffic(size_t packet_size) {
+	// only feeds the global statistics, shaping is done by traffic_shaper without sleeping
+	CRITICAL_REGION_LOCAL(	network_throttle_manager::m_lock_get_global_throttle_out );
+	network_throttle_manager::get_global_throttle_out().handle_trafic_exact(packet_size);
 }
 void connection_basic::set_start_time() {
 	CRITICAL_REGION_LOCAL(	network_throttle_manager::m_lock_get_global_throttle_out );
@@ -279,14 +257,14 @@ void connection_basic::set_start_time() {
 }
 
 void connection_basic::do_send_handler_write(const void* ptr , size_t cb ) {
-	sleep_before_packet(cb,1,-1);
-	_info_c("net/out/size", "handler_write (direct) - before ASIO write, for packet="<<cb<<" B (after sleep)");
+	account_out_traffic(cb);
+	_info_c("net/out/size", "handler_write (direct) - before ASIO write, for packet="<<cb<<" B");
 	set_start_time();
 }
 
 void connection_basic::do_send_handler_write_from_queue( const boost::system::error_code& e, size_t cb, int q_len ) {
-	sleep_before_packet(cb,2,q_len);
-	_info_c("net/out/size", "handler_write (after write, from queue="<<q_len<<") - before ASIO write, for packet="<<cb<<" B (after sleep)");
+	account_out_traffic(cb);
+	_info_c("net/out/size", "handler_write (after write, from queue="<<q_len<<") - before ASIO write, for packet="<<cb<<" B");
 
 	set_start_time();
 }
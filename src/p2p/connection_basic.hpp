@@ -56,6 +56,7 @@
 #include <boost/enable_shared_from_this.hpp>
 #include <boost/interprocess/detail/atomic.hpp>
 #include <boost/thread/thread.hpp>
+#include <boost/thread/condition_variable.hpp>
 
 #include <memory>
 
@@ -82,6 +83,26 @@ class connection_basic_pimpl; // PIMPL for this class
   
   std::string to_string(t_connection_type type);
 
+/// One queued write: bytes owned by this connection (e.g. a levin header) followed by an optional slice of a
+/// payload shared with other connections, written together with a single scatter-gather async_write
+struct send_que_entry {
+	std::string m_data;
+	shared_buffer m_shared;
+	size_t m_shared_offset;
+	size_t m_shared_size;
+	traffic_class m_class;
+
+	send_que_entry(): m_shared_offset(0), m_shared_size(0), m_class(traffic_class_peerlist) {}
+	size_t size() const { return m_data.size() + m_shared_size; }
+	boost::array<boost::asio::const_buffer, 2> buffers() const {
+		boost::array<boost::asio::const_buffer, 2> b = {{
+			boost::asio::buffer(m_data),
+			m_shared ? boost::asio::buffer(m_shared->data() + m_shared_offset, m_shared_size) : boost::asio::const_buffer()
+		}};
+		return b;
+	}
+};
+
 class connection_basic { // not-templated base class for rapid developmet of some code parts
 	public:
 		std::unique_ptr< connection_basic_pimpl > mI; // my Implementation
@@ -90,7 +111,10 @@ class connection_basic { // not-templated base class for rapid developmet of som
     volatile uint32_t m_want_close_connection;
     std::atomic<bool> m_was_shutdown;
     critical_section m_send_que_lock;
-    std::list<std::string> m_send_que;
+    std::list<send_que_entry> m_send_que;
+    size_t m_send_que_in_flight; // entries at the front of m_send_que handed to the current async_write
+    bool m_write_scheduled; // the next write waits on a timer for the upload shaper
+    boost::condition_variable_any m_send_que_cond; // signalled by handle_write when entries leave the queue
     volatile bool m_is_multithreaded;
     double m_start_time;
     /// Strand to ensure the connection's handlers are not called concurrently.
@@ -126,7 +150,7 @@ class connection_basic { // not-templated base class for rapid developmet of som
 		static int get_tos_flag();
 
 		// handlers and sleep
-		void sleep_before_packet(size_t packet_size, int phase, int q_len); // execute a sleep ; phase is not really used now(?)
+		void account_out_traffic(size_t packet_size); // count sent bytes in the global (statistics) throttle
 		static void save_limit_to_file(int limit); ///< for dr-monero
 		static double get_sleep_time(size_t cb);
 		
@@ -140,6 +140,56 @@ namespace net_utils
 		}
 	}
 	
+	traffic_stats &data_logger::peer_traffic(uint32_t peer_ip) {
+		auto it = m_peer_traffic.find(peer_ip);
+		if (it != m_peer_traffic.end())
+			return it->second;
+		if (m_peer_traffic.size() >= DATA_LOGGER_MAX_PEERS)
+			return m_peer_traffic[0];
+		return m_peer_traffic[peer_ip];
+	}
+
+	void data_logger::account_in(int command, uint32_t peer_ip, size_t bytes) {
+		boost::lock_guard<boost::mutex> lock(m_traffic_mutex);
+		traffic_stats &cmd = m_command_traffic[command];
+		++cmd.in_messages;
+		cmd.in_bytes += bytes;
+		traffic_stats &peer = peer_traffic(peer_ip);
+		++peer.in_messages;
+		peer.in_bytes += bytes;
+	}
+
+	void data_logger::account_out(int command, uint32_t peer_ip, size_t bytes) {
+		boost::lock_guard<boost::mutex> lock(m_traffic_mutex);
+		traffic_stats &cmd = m_command_traffic[command];
+		++cmd.out_messages;
+		cmd.out_bytes += bytes;
+		traffic_stats &peer = peer_traffic(peer_ip);
+		++peer.out_messages;
+		peer.out_bytes += bytes;
+	}
+
+	void data_logger::account_handler_time(int command, uint64_t us) {
+		boost::lock_guard<boost::mutex> lock(m_traffic_mutex);
+		m_command_traffic[command].handler_us += us;
+	}
+
+	std::map<int, traffic_stats> data_logger::get_command_traffic() {
+		boost::lock_guard<boost::mutex> lock(m_traffic_mutex);
+		return m_command_traffic;
+	}
+
+	std::map<uint32_t, traffic_stats> data_logger::get_peer_traffic() {
+		boost::lock_guard<boost::mutex> lock(m_traffic_mutex);
+		return m_peer_traffic;
+	}
+
+	void data_logger::reset_traffic() {
+		boost::lock_guard<boost::mutex> lock(m_traffic_mutex);
+		m_command_traffic.clear();
+		m_peer_traffic.clear();
+	}
+
 	bool data_logger::is_dying() {
 		if (m_state == data_logger_state::state_dying) {
 			return true;
@@ -196,6 +246,9 @@ std::atomic<bool> data_logger::m_save_graph(false); // (static)
 std::atomic<bool> data_logger::m_thread_maybe_running(false); // (static)
 boost::once_flag data_logger::m_singleton; // (static)
 std::unique_ptr<data_logger> data_logger::m_obj; // (static)
+boost::mutex data_logger::m_traffic_mutex; // (static)
+std::map<int, traffic_stats> data_logger::m_command_traffic; // (static)
+std::map<uint32_t, traffic_stats> data_logger::m_peer_traffic; // (static)
 
 } // namespace
 } // namespace
@@ -37,6 +37,9 @@
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/once.hpp>
 #include <atomic>
+#include <cstdint>
+
+#define DATA_LOGGER_MAX_PEERS 4096 ///< peers accounted one by one, later ones are summed under address 0
 
 namespace epee
 {
@@ -44,6 +47,17 @@ namespace net_utils
 {
 
 enum class data_logger_state { state_before_init, state_during_init, state_ready_to_use, state_dying };
+
+/***
+* traffic of one levin command, or of one peer, since start (or reset_traffic)
+*/
+struct traffic_stats {
+	uint64_t in_messages = 0;
+	uint64_t in_bytes = 0; ///< header included
+	uint64_t out_messages = 0;
+	uint64_t out_bytes = 0;
+	uint64_t handler_us = 0; ///< time spent in the command's handlers, kept per command only
+};
 	
 /***
 @note: use it ONLY via singleton! It will be spawned then, and will auto destruct on program exit.
@@ -71,6 +85,17 @@ enum class data_logger_state { state_before_init, state_during_init, state_ready
 			static std::atomic<bool> m_save_graph; ///< global setting flag, should we save all the data or not (can disable logging graphs data)
 			static bool is_dying();
 
+			/***
+			* In memory accounting of levin messages, kept whether or not graphs are saved.
+			* These are static: they do not need the singleton (or its thread), and can be used at any time after main started.
+			*/
+			static void account_in(int command, uint32_t peer_ip, size_t bytes); ///< a message came in
+			static void account_out(int command, uint32_t peer_ip, size_t bytes); ///< a message went out
+			static void account_handler_time(int command, uint64_t us); ///< a handler of the command took this long
+			static std::map<int, traffic_stats> get_command_traffic();
+			static std::map<uint32_t, traffic_stats> get_peer_traffic(); ///< by IPv4 address, 0 holds the peers past DATA_LOGGER_MAX_PEERS
+			static void reset_traffic();
+
 		private:
 			static boost::once_flag m_singleton; ///< to guarantee singleton creates the object exactly once
 			static data_logger_state m_state; ///< state of the singleton object
@@ -97,6 +122,11 @@ enum class data_logger_state { state_before_init, state_during_init, state_ready
 			std::map<std::string, fileData> mFilesMap;
 			boost::mutex mMutex;
 			void saveToFile(); ///< write data to the target files. do not use this directly
+
+			static traffic_stats &peer_traffic(uint32_t peer_ip); ///< lock m_traffic_mutex first
+			static boost::mutex m_traffic_mutex;
+			static std::map<int, traffic_stats> m_command_traffic;
+			static std::map<uint32_t, traffic_stats> m_peer_traffic;
 	};
 	
 } // namespace
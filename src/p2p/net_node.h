@@ -64,6 +64,7 @@ namespace nodetool
   {
     peerid_type peer_id;
     uint32_t support_flags;
+    int64_t peerlist_sent_up_to; // newest last_seen already sent to this peer
   };
 
   template<class t_payload_net_handler>
@@ -92,6 +93,9 @@ namespace nodetool
     m_offline(false),
     m_save_graph(false),
     is_closing(false),
+    m_connect_attempts_second(0),
+    m_connect_attempts_count(0),
+    m_seed_nodes_resolved(true),
     m_net_server( epee::net_utils::e_connection_type_P2P ) // this is a P2P connection of the main p2p node server, because this is class node_server<>
     {}
     virtual ~node_server()
@@ -117,6 +121,8 @@ namespace nodetool
     bool log_connections();
     virtual uint64_t get_connections_count();
     size_t get_outgoing_connections_count();
+    //! estimated bytes of the p2p connections, with what all connections, rpc ones too, have buffered
+    uint64_t get_connections_memory();
     peerlist_manager& get_peerlist_manager(){return m_peerlist;}
     void delete_connections(size_t count);
     virtual bool block_ip(uint32_t adress, time_t seconds = P2P_IP_BLOCKTIME);
@@ -171,6 +177,7 @@ namespace nodetool
     virtual void on_connection_new(p2p_connection_context& context);
     virtual void on_connection_close(p2p_connection_context& context);
     virtual void callback(p2p_connection_context& context);
+    virtual epee::net_utils::traffic_class get_traffic_class(int command);
     //----------------- i_p2p_endpoint -------------------------------------------------------------
     virtual bool relay_notify_to_list(int command, const std::string& data_buff, const std::list<boost::uuids::uuid> &connections);
     virtual bool relay_notify_to_all(int command, const std::string& data_buff, const epee::net_utils::connection_context_base& context);
@@ -179,7 +186,9 @@ namespace nodetool
     virtual bool drop_connection(const epee::net_utils::connection_context_base& context);
     virtual void request_callback(const epee::net_utils::connection_context_base& context);
     virtual void for_each_connection(std::function<bool(typename t_payload_net_handler::connection_context&, peerid_type, uint32_t)> f);
+    virtual uint32_t get_support_flags(const epee::net_utils::connection_context_base& context);
     virtual bool add_ip_fail(uint32_t address);
+    virtual void report_block_announce_delay(const epee::net_utils::connection_context_base& context, uint64_t delay_ms);
     //----------------- i_connection_filter  --------------------------------------------------------
     virtual bool is_remote_ip_allowed(uint32_t adress);
     //-----------------------------------------------------------------------------------------------
@@ -197,12 +206,20 @@ namespace nodetool
     bool fix_time_delta(std::list<peerlist_entry>& local_peerlist, time_t local_time, int64_t& delta);
 
     bool connections_maker();
+    void resolve_seed_nodes();
+    bool add_upnp_port_mapping(bool refresh, int log_level);
+    void upnp_worker();
     bool peer_sync_idle_maker();
     bool do_handshake_with_peer(peerid_type& pi, p2p_connection_context& context, bool just_take_peerlist = false);
+    bool handle_handshake_response(int code, const typename COMMAND_HANDSHAKE::response& rsp, p2p_connection_context& context, bool just_take_peerlist);
     bool do_peer_timed_sync(const epee::net_utils::connection_context_base& context, peerid_type peer_id);
 
     bool make_new_connection_from_peerlist(bool use_white_list);
     bool try_to_connect_and_handshake_with_new_peer(const net_address& na, bool just_take_peerlist = false, uint64_t last_seen_stamp = 0, bool white = true);
+    bool try_to_connect_and_handshake_with_new_peer_async(const net_address& na, uint64_t last_seen_stamp, bool white);
+    bool has_connect_attempt_slot();
+    size_t get_pending_connects_count();
+    void remove_pending_connect(const net_address& na);
     size_t get_random_index_with_fixed_probability(size_t max_index);
     bool is_peer_used(const peerlist_entry& peer);
     bool is_addr_connected(const net_address& peer);
@@ -226,6 +243,7 @@ namespace nodetool
     bool set_rate_up_limit(const boost::program_options::variables_map& vm, int64_t limit);
     bool set_rate_down_limit(const boost::program_options::variables_map& vm, int64_t limit);
     bool set_rate_limit(const boost::program_options::variables_map& vm, int64_t limit);
+    bool set_memory_limits(const boost::program_options::variables_map& vm, int64_t connection_limit, int64_t total_limit);
 
     void kill() { ///< will be called e.g. from deinit()
       _info("Killing the net_node");
@@ -296,6 +314,10 @@ namespace nodetool
     std::list<net_address>   m_priority_peers;
     std::vector<net_address> m_exclusive_peers;
     std::vector<net_address> m_seed_nodes;
+    epee::critical_section m_seed_nodes_lock;
+    std::atomic<bool> m_seed_nodes_resolved;
+    boost::thread m_seed_nodes_resolver;
+    boost::thread m_upnp_thread;
     std::list<nodetool::peerlist_entry> m_command_line_peers;
     uint64_t m_peer_livetime;
     //keep connections to initiate some interactions
@@ -305,6 +327,11 @@ namespace nodetool
     std::map<net_address, time_t> m_conn_fails_cache;
     epee::critical_section m_conn_fails_cache_lock;
 
+    std::set<net_address> m_pending_connects;
+    time_t m_connect_attempts_second;
+    size_t m_connect_attempts_count;
+    epee::critical_section m_pending_connects_lock;
+
     epee::critical_section m_blocked_ips_lock;
     std::map<uint32_t, time_t> m_blocked_ips;
 
@@ -98,6 +98,9 @@ namespace nodetool
     const command_line::arg_descriptor<int64_t> arg_limit_rate_up = {"limit-rate-up", "set limit-rate-up [kB/s]", -1};
     const command_line::arg_descriptor<int64_t> arg_limit_rate_down = {"limit-rate-down", "set limit-rate-down [kB/s]", -1};
     const command_line::arg_descriptor<int64_t> arg_limit_rate = {"limit-rate", "set limit-rate [kB/s]", -1};
+    const command_line::arg_descriptor<int64_t> arg_limit_connection_memory = {"limit-connection-memory", "set memory a peer may hold in queued and partially received data [MB], 0 for no limit", -1};
+    const command_line::arg_descriptor<int64_t> arg_limit_total_connection_memory = {"limit-total-connection-memory", "set memory all peers together may hold in queued and partially received data [MB], 0 for no limit", -1};
+    const command_line::arg_descriptor<uint32_t> arg_p2p_io_shards = {"p2p-io-shards", "pin each peer connection to one of this many single-threaded io_services, 0 to share one io_service", 0};
 
     const command_line::arg_descriptor<bool> arg_save_graph = {"save-graph", "Save data for dr monero", false};
   }
@@ -122,6 +125,9 @@ namespace nodetool
     command_line::add_arg(desc, arg_limit_rate_up);
     command_line::add_arg(desc, arg_limit_rate_down);
     command_line::add_arg(desc, arg_limit_rate);
+    command_line::add_arg(desc, arg_limit_connection_memory);
+    command_line::add_arg(desc, arg_limit_total_connection_memory);
+    command_line::add_arg(desc, arg_p2p_io_shards);
     command_line::add_arg(desc, arg_save_graph);
   }
   //-----------------------------------------------------------------------------------
@@ -174,6 +180,19 @@ namespace nodetool
   }
   //-----------------------------------------------------------------------------------
   template<class t_payload_net_handler>
+  uint32_t node_server<t_payload_net_handler>::get_support_flags(const epee::net_utils::connection_context_base& context)
+  {
+    uint32_t support_flags = 0;
+    m_net_server.get_config_object().foreach_connection([&](p2p_connection_context& cntx){
+      if (cntx.m_connection_id != context.m_connection_id)
+        return true;
+      support_flags = cntx.support_flags;
+      return false;
+    });
+    return support_flags;
+  }
+  //-----------------------------------------------------------------------------------
+  template<class t_payload_net_handler>
   bool node_server<t_payload_net_handler>::is_remote_ip_allowed(uint32_t addr)
   {
     CRITICAL_REGION_LOCAL(m_blocked_ips_lock);
@@ -248,6 +267,18 @@ namespace nodetool
   }
   //-----------------------------------------------------------------------------------
   template<class t_payload_net_handler>
+  void node_server<t_payload_net_handler>::report_block_announce_delay(const epee::net_utils::connection_context_base& context, uint64_t delay_ms)
+  {
+    // only outgoing connections are to a port the peer can be reached at again
+    if(context.m_is_income)
+      return;
+    net_address na = AUTO_VAL_INIT(na);
+    na.ip = context.m_remote_ip;
+    na.port = context.m_remote_port;
+    m_peerlist.set_peer_block_delay(na, delay_ms);
+  }
+  //-----------------------------------------------------------------------------------
+  template<class t_payload_net_handler>
   bool node_server<t_payload_net_handler>::parse_peer_from_string(nodetool::net_address& pe, const std::string& node_addr)
   {
     return epee::string_tools::parse_peer_from_string(pe.ip, pe.port, node_addr);
@@ -267,6 +298,9 @@ namespace nodetool
     m_allow_local_ip = command_line::get_arg(vm, arg_p2p_allow_local_ip);
     m_no_igd = command_line::get_arg(vm, arg_no_igd);
     m_offline = command_line::get_arg(vm, arg_offline);
+    // a daemon following another's database gets its blocks from there
+    if (command_line::has_arg(vm, command_line::arg_db_follow) && !command_line::get_arg(vm, command_line::arg_db_follow).empty())
+      m_offline = true;
 
     if (command_line::has_arg(vm, arg_p2p_add_peer))
     {
@@ -324,6 +358,11 @@ namespace nodetool
     if ( !set_rate_limit(vm, command_line::get_arg(vm, arg_limit_rate) ) )
       return false;
 
+    if ( !set_memory_limits(vm, command_line::get_arg(vm, arg_limit_connection_memory), command_line::get_arg(vm, arg_limit_total_connection_memory) ) )
+      return false;
+
+    m_net_server.set_io_service_shards(command_line::get_arg(vm, arg_p2p_io_shards));
+
     return true;
   }
   //-----------------------------------------------------------------------------------
@@ -382,83 +421,8 @@ namespace nodetool
     else
     {
       memcpy(&m_network_id, &::config::NETWORK_ID, 16);
-      // for each hostname in the seed nodes list, attempt to DNS resolve and
-      // add the result addresses as seed nodes
-      // TODO: at some point add IPv6 support, but that won't be relevant
-      // for some time yet.
-
-      std::vector<std::vector<std::string>> dns_results;
-      dns_results.resize(m_seed_nodes_list.size());
-
-      std::list<boost::thread*> dns_threads;
-      uint64_t result_index = 0;
-      for (const std::string& addr_str : m_seed_nodes_list)
-      {
-        boost::thread* th = new boost::thread([=, &dns_results, &addr_str]
-        {
-          LOG_PRINT_L4("dns_threads[" << result_index << "] created for: " << addr_str);
-          // TODO: care about dnssec avail/valid
-          bool avail, valid;
-          std::vector<std::string> addr_list;
-
-          try
-          {
-            addr_list = tools::DNSResolver::instance().get_ipv4(addr_str, avail, valid);
-            LOG_PRINT_L4("dns_threads[" << result_index << "] DNS resolve done");
-            boost::this_thread::interruption_point();
-          }
-          catch(const boost::thread_interrupted&)
-          {
-            // thread interruption request
-            // even if we now have results, finish thread without setting
-            // result variables, which are now out of scope in main thread
-            LOG_PRINT_L4("dns_threads[" << result_index << "] interrupted");
-            return;
-          }
-
-          LOG_PRINT_L4("dns_threads[" << result_index << "] addr_str: " << addr_str << "  number of results: " << addr_list.size());
-          dns_results[result_index] = addr_list;
-        });
-
-        dns_threads.push_back(th);
-        ++result_index;
-      }
-
-      LOG_PRINT_L4("dns_threads created, now waiting for completion or timeout of " << CRYPTONOTE_DNS_TIMEOUT_MS << "ms");
-      boost::chrono::system_clock::time_point deadline = boost::chrono::system_clock::now() + boost::chrono::milliseconds(CRYPTONOTE_DNS_TIMEOUT_MS);
-      uint64_t i = 0;
-      for (boost::thread* th : dns_threads)
-      {
-        if (! th->try_join_until(deadline))
-        {
-          LOG_PRINT_L4("dns_threads[" << i << "] timed out, sending interrupt");
-          th->interrupt();
-        }
-        ++i;
-      }
-
-      i = 0;
-      for (const auto& result : dns_results)
-      {
-        LOG_PRINT_L4("DNS lookup for " << m_seed_nodes_list[i] << ": " << result.size() << " results");
-        // if no results for node, thread's lookup likely timed out
-        if (result.size())
-        {
-          for (const auto& addr_string : result)
-            full_addrs.insert(addr_string + ":18080");
-        }
-        ++i;
-      }
-
-      if (!full_addrs.size())
-      {
-        LOG_PRINT_L0("DNS seed node lookup either timed out or failed, falling back to defaults");
-        full_addrs.insert("198.74.231.92:18080");
-        full_addrs.insert("161.67.132.39:18080");
-        full_addrs.insert("163.172.182.165:18080");
-        full_addrs.insert("204.12.248.66:18080");
-        full_addrs.insert("5.9.100.248:18080");
-      }
+      // the seed nodes from DNS are added when the lookups finish, see below
+      m_seed_nodes_resolved = false;
     }
 
     for (const auto& full_addr : full_addrs)
@@ -471,6 +435,22 @@ namespace nodetool
     bool res = handle_command_line(vm, testnet);
     CHECK_AND_ASSERT_MES(res, false, "Failed to handle command line");
 
+    // so a slow or filtered DNS doesn't hold up the start up
+    if (!m_seed_nodes_resolved)
+    {
+      m_seed_nodes_resolver = boost::thread([this]()
+      {
+        try
+        {
+          resolve_seed_nodes();
+        }
+        catch (const boost::thread_interrupted&)
+        {
+          LOG_PRINT_L1("DNS seed node lookup interrupted");
+        }
+      });
+    }
+
     auto config_arg = testnet ? command_line::arg_testnet_data_dir : command_line::arg_data_dir;
     m_config_folder = command_line::get_arg(vm, config_arg);
 
@@ -509,51 +489,78 @@ namespace nodetool
     if(m_external_port)
       LOG_PRINT_L0("External port defined as " << m_external_port);
 
-    // Add UPnP port mapping
-    if(m_no_igd == false) {
-      LOG_PRINT_L0("Attempting to add IGD port mapping.");
-      int result;
+    return res;
+  }
+  //-----------------------------------------------------------------------------------
+  template<class t_payload_net_handler>
+  bool node_server<t_payload_net_handler>::add_upnp_port_mapping(bool refresh, int log_level)
+  {
+    bool mapped = false;
+    LOG_PRINT((refresh ? "Refreshing" : "Attempting to add") << " IGD port mapping.", log_level);
+    int result;
 #if MINIUPNPC_API_VERSION > 13
-      // default according to miniupnpc.h
-      unsigned char ttl = 2;
-      UPNPDev* deviceList = upnpDiscover(1000, NULL, NULL, 0, 0, ttl, &result);
+    // default according to miniupnpc.h
+    unsigned char ttl = 2;
+    UPNPDev* deviceList = upnpDiscover(1000, NULL, NULL, 0, 0, ttl, &result);
 #else
-      UPNPDev* deviceList = upnpDiscover(1000, NULL, NULL, 0, 0, &result);
+    UPNPDev* deviceList = upnpDiscover(1000, NULL, NULL, 0, 0, &result);
 #endif
-      UPNPUrls urls;
-      IGDdatas igdData;
-      char lanAddress[64];
-      result = UPNP_GetValidIGD(deviceList, &urls, &igdData, lanAddress, sizeof lanAddress);
-      freeUPNPDevlist(deviceList);
-      if (result != 0) {
-        if (result == 1) {
-          std::ostringstream portString;
-          portString << m_listenning_port;
-
-          // Delete the port mapping before we create it, just in case we have dangling port mapping from the daemon not being shut down correctly
+    UPNPUrls urls;
+    IGDdatas igdData;
+    char lanAddress[64];
+    result = UPNP_GetValidIGD(deviceList, &urls, &igdData, lanAddress, sizeof lanAddress);
+    freeUPNPDevlist(deviceList);
+    if (result != 0) {
+      if (result == 1) {
+        std::ostringstream portString;
+        portString << m_listenning_port;
+
+        // Delete the port mapping before we create it, just in case we have dangling port mapping from the daemon not being shut down correctly
+        if (!refresh)
           UPNP_DeletePortMapping(urls.controlURL, igdData.first.servicetype, portString.str().c_str(), "TCP", 0);
 
-          int portMappingResult;
-          portMappingResult = UPNP_AddPortMapping(urls.controlURL, igdData.first.servicetype, portString.str().c_str(), portString.str().c_str(), lanAddress, CRYPTONOTE_NAME, "TCP", 0, "0");
-          if (portMappingResult != 0) {
-            LOG_ERROR("UPNP_AddPortMapping failed, error: " << strupnperror(portMappingResult));
-          } else {
-            LOG_PRINT_GREEN("Added IGD port mapping.", LOG_LEVEL_0);
-          }
-        } else if (result == 2) {
-          LOG_PRINT_L0("IGD was found but reported as not connected.");
-        } else if (result == 3) {
-          LOG_PRINT_L0("UPnP device was found but not recognized as IGD.");
+        int portMappingResult;
+        portMappingResult = UPNP_AddPortMapping(urls.controlURL, igdData.first.servicetype, portString.str().c_str(), portString.str().c_str(), lanAddress, CRYPTONOTE_NAME, "TCP", 0, "0");
+        if (portMappingResult != 0) {
+          LOG_ERROR("UPNP_AddPortMapping failed, error: " << strupnperror(portMappingResult));
         } else {
-          LOG_ERROR("UPNP_GetValidIGD returned an unknown result code.");
+          LOG_PRINT_GREEN((refresh ? "Refreshed" : "Added") << " IGD port mapping.", log_level);
+          mapped = true;
         }
-
-        FreeUPNPUrls(&urls);
+      } else if (result == 2) {
+        LOG_PRINT("IGD was found but reported as not connected.", log_level);
+      } else if (result == 3) {
+        LOG_PRINT("UPnP device was found but not recognized as IGD.", log_level);
       } else {
-        LOG_PRINT_L0("No IGD was found.");
+        LOG_ERROR("UPNP_GetValidIGD returned an unknown result code.");
       }
+
+      FreeUPNPUrls(&urls);
+    } else {
+      LOG_PRINT("No IGD was found.", log_level);
+    }
+    return mapped;
+  }
+  //-----------------------------------------------------------------------------------
+  template<class t_payload_net_handler>
+  void node_server<t_payload_net_handler>::upnp_worker()
+  {
+    // the first attempt is reported at level 0 as it used to be, retries and
+    // refreshes only at level 1
+    bool mapped = false;
+    int log_level = LOG_LEVEL_0;
+    try
+    {
+      while (!is_closing && !m_net_server.is_stop_signal_sent())
+      {
+        mapped = add_upnp_port_mapping(mapped, log_level);
+        log_level = LOG_LEVEL_1;
+        boost::this_thread::sleep_for(boost::chrono::seconds(mapped ? P2P_UPNP_REFRESH_INTERVAL : P2P_UPNP_RETRY_INTERVAL));
+      }
+    }
+    catch (const boost::thread_interrupted&)
+    {
     }
-    return res;
   }
   //-----------------------------------------------------------------------------------
   template<class t_payload_net_handler>
@@ -592,6 +599,11 @@ namespace nodetool
     //here you can set worker threads count
     int thrds_count = 10;
 
+    // UPnP discovery takes a while on networks without an IGD, so the port
+    // mapping is done on its own thread, now that the server is listening
+    if (!m_no_igd && !m_offline)
+      m_upnp_thread = boost::thread(boost::bind(&node_server<t_payload_net_handler>::upnp_worker, this));
+
     m_net_server.add_idle_handler(boost::bind(&node_server<t_payload_net_handler>::idle_worker, this), 1000);
     m_net_server.add_idle_handler(boost::bind(&t_payload_net_handler::on_idle, &m_payload_handler), 1000);
 
@@ -617,8 +629,22 @@ namespace nodetool
   }
   //-----------------------------------------------------------------------------------
   template<class t_payload_net_handler>
+  uint64_t node_server<t_payload_net_handler>::get_connections_memory()
+  {
+    // a connection object holds its read buffer
+    typedef typename net_server::connection_ptr::element_type connection_type;
+    return get_connections_count() * sizeof(connection_type) + epee::net_utils::connections_memory::usage();
+  }
+  //-----------------------------------------------------------------------------------
+  template<class t_payload_net_handler>
   bool node_server<t_payload_net_handler>::deinit()
   {
+    m_seed_nodes_resolver.interrupt();
+    if (m_seed_nodes_resolver.joinable())
+      m_seed_nodes_resolver.join();
+    m_upnp_thread.interrupt();
+    if (m_upnp_thread.joinable())
+      m_upnp_thread.join();
     kill();
     m_peerlist.deinit();
     m_net_server.deinit_server();
@@ -636,17 +662,35 @@ namespace nodetool
       return false;
     }
 
+    // write to a side file and swap it in, so a periodic store interrupted
+    // half way never leaves a truncated state file behind
     std::string state_file_path = m_config_folder + "/" + P2P_NET_DATA_FILENAME;
-    std::ofstream p2p_data;
-    p2p_data.open( state_file_path , std::ios_base::binary | std::ios_base::out| std::ios::trunc);
-    if(p2p_data.fail())
+    std::string new_state_file_path = state_file_path + ".new";
     {
-      LOG_PRINT_L0("Failed to save config to file " << state_file_path);
-      return false;
-    };
+      std::ofstream p2p_data;
+      p2p_data.open( new_state_file_path , std::ios_base::binary | std::ios_base::out| std::ios::trunc);
+      if(p2p_data.fail())
+      {
+        LOG_PRINT_L0("Failed to save config to file " << new_state_file_path);
+        return false;
+      };
+
+      boost::archive::binary_oarchive a(p2p_data);
+      a << *this;
+      p2p_data.flush();
+      if(p2p_data.fail())
+      {
+        LOG_PRINT_L0("Failed to write config to file " << new_state_file_path);
+        return false;
+      }
+    }
 
-    boost::archive::binary_oarchive a(p2p_data);
-    a << *this;
+    std::error_code e = tools::replace_file(new_state_file_path, state_file_path);
+    if(e)
+    {
+      LOG_PRINT_L0("Failed to move " << new_state_file_path << " to " << state_file_path << ": " << e.message());
+      return false;
+    }
     return true;
     CATCH_ENTRY_L0("blockchain_storage::save", false);
 
@@ -664,6 +708,51 @@ namespace nodetool
   //-----------------------------------------------------------------------------------
 
 
+  template<class t_payload_net_handler>
+  bool node_server<t_payload_net_handler>::handle_handshake_response(int code, const typename COMMAND_HANDSHAKE::response& rsp, p2p_connection_context& context, bool just_take_peerlist)
+  {
+    if(code < 0)
+    {
+      LOG_PRINT_CC_RED(context, "COMMAND_HANDSHAKE invoke failed. (" << code <<  ", " << epee::levin::get_err_descr(code) << ")", LOG_LEVEL_1);
+      return false;
+    }
+
+    if(rsp.node_data.network_id != m_network_id)
+    {
+      LOG_ERROR_CCONTEXT("COMMAND_HANDSHAKE Failed, wrong network!  (" << epee::string_tools::get_str_from_guid_a(rsp.node_data.network_id) << "), closing connection.");
+      return false;
+    }
+
+    if(!handle_remote_peerlist(rsp.local_peerlist, rsp.node_data.local_time, context))
+    {
+      LOG_ERROR_CCONTEXT("COMMAND_HANDSHAKE: failed to handle_remote_peerlist(...), closing connection.");
+      add_ip_fail(context.m_remote_ip);
+      return false;
+    }
+    if(!just_take_peerlist)
+    {
+      if(!m_payload_handler.process_payload_sync_data(rsp.payload_data, context, true))
+      {
+        LOG_ERROR_CCONTEXT("COMMAND_HANDSHAKE invoked, but process_payload_sync_data returned false, dropping connection.");
+        return false;
+      }
+
+      context.peer_id = rsp.node_data.peer_id;
+      m_peerlist.set_peer_just_seen(rsp.node_data.peer_id, context.m_remote_ip, context.m_remote_port);
+
+      if(rsp.node_data.peer_id == m_config.m_peer_id)
+      {
+        LOG_PRINT_CCONTEXT_L2("Connection to self detected, dropping connection");
+        return false;
+      }
+      LOG_PRINT_CCONTEXT_L1(" COMMAND_HANDSHAKE INVOKED OK");
+    }else
+    {
+      LOG_PRINT_CCONTEXT_L1(" COMMAND_HANDSHAKE(AND CLOSE) INVOKED OK");
+    }
+    return true;
+  }
+  //-----------------------------------------------------------------------------------
   template<class t_payload_net_handler>
   bool node_server<t_payload_net_handler>::do_handshake_with_peer(peerid_type& pi, p2p_connection_context& context_, bool just_take_peerlist)
   {
@@ -674,53 +763,21 @@ namespace nodetool
 
     epee::simple_event ev;
     std::atomic<bool> hsh_result(false);
+    const uint64_t invoke_time = epee::misc_utils::get_tick_count();
 
     bool r = epee::net_utils::async_invoke_remote_command2<typename COMMAND_HANDSHAKE::response>(context_.m_connection_id, COMMAND_HANDSHAKE::ID, arg, m_net_server.get_config_object(),
-      [this, &pi, &ev, &hsh_result, &just_take_peerlist](int code, const typename COMMAND_HANDSHAKE::response& rsp, p2p_connection_context& context)
+      [this, &pi, &ev, &hsh_result, &just_take_peerlist, invoke_time](int code, const typename COMMAND_HANDSHAKE::response& rsp, p2p_connection_context& context)
     {
       epee::misc_utils::auto_scope_leave_caller scope_exit_handler = epee::misc_utils::create_scope_leave_handler([&](){ev.raise();});
 
-      if(code < 0)
-      {
-        LOG_PRINT_CC_RED(context, "COMMAND_HANDSHAKE invoke failed. (" << code <<  ", " << epee::levin::get_err_descr(code) << ")", LOG_LEVEL_1);
-        return;
-      }
-
-      if(rsp.node_data.network_id != m_network_id)
-      {
-        LOG_ERROR_CCONTEXT("COMMAND_HANDSHAKE Failed, wrong network!  (" << epee::string_tools::get_str_from_guid_a(rsp.node_data.network_id) << "), closing connection.");
-        return;
-      }
-
-      if(!handle_remote_peerlist(rsp.local_peerlist, rsp.node_data.local_time, context))
-      {
-        LOG_ERROR_CCONTEXT("COMMAND_HANDSHAKE: failed to handle_remote_peerlist(...), closing connection.");
-        add_ip_fail(context.m_remote_ip);
-        return;
-      }
-      hsh_result = true;
-      if(!just_take_peerlist)
-      {
-        if(!m_payload_handler.process_payload_sync_data(rsp.payload_data, context, true))
-        {
-          LOG_ERROR_CCONTEXT("COMMAND_HANDSHAKE invoked, but process_payload_sync_data returned false, dropping connection.");
-          hsh_result = false;
-          return;
-        }
-
-        pi = context.peer_id = rsp.node_data.peer_id;
-        m_peerlist.set_peer_just_seen(rsp.node_data.peer_id, context.m_remote_ip, context.m_remote_port);
-
-        if(rsp.node_data.peer_id == m_config.m_peer_id)
-        {
-          LOG_PRINT_CCONTEXT_L2("Connection to self detected, dropping connection");
-          hsh_result = false;
-          return;
-        }
-        LOG_PRINT_CCONTEXT_L1(" COMMAND_HANDSHAKE INVOKED OK");
-      }else
+      hsh_result = handle_handshake_response(code, rsp, context, just_take_peerlist);
+      if(hsh_result && !just_take_peerlist)
       {
-        LOG_PRINT_CCONTEXT_L1(" COMMAND_HANDSHAKE(AND CLOSE) INVOKED OK");
+        pi = context.peer_id;
+        net_address na = AUTO_VAL_INIT(na);
+        na.ip = context.m_remote_ip;
+        na.port = context.m_remote_port;
+        m_peerlist.set_peer_rtt(na, epee::misc_utils::get_tick_count() - invoke_time);
       }
     }, P2P_DEFAULT_HANDSHAKE_INVOKE_TIMEOUT);
 
@@ -909,6 +966,132 @@ namespace nodetool
 
 #undef LOG_PRINT_CC_PRIORITY_NODE
 
+  //-----------------------------------------------------------------------------------
+  template<class t_payload_net_handler>
+  bool node_server<t_payload_net_handler>::has_connect_attempt_slot()
+  {
+    CRITICAL_REGION_LOCAL(m_pending_connects_lock);
+    if(m_current_number_of_out_peers + m_pending_connects.size() >= m_config.m_net_config.connections_count)
+      return false;
+    if(m_pending_connects.size() >= P2P_DEFAULT_MAX_PENDING_CONNECTIONS)
+      return false;
+    return m_connect_attempts_second != time(NULL) || m_connect_attempts_count < P2P_DEFAULT_CONNECTION_ATTEMPTS_PER_SECOND;
+  }
+  //-----------------------------------------------------------------------------------
+  template<class t_payload_net_handler>
+  size_t node_server<t_payload_net_handler>::get_pending_connects_count()
+  {
+    CRITICAL_REGION_LOCAL(m_pending_connects_lock);
+    return m_pending_connects.size();
+  }
+  //-----------------------------------------------------------------------------------
+  template<class t_payload_net_handler>
+  void node_server<t_payload_net_handler>::remove_pending_connect(const net_address& na)
+  {
+    CRITICAL_REGION_LOCAL(m_pending_connects_lock);
+    m_pending_connects.erase(na);
+  }
+  //-----------------------------------------------------------------------------------
+  template<class t_payload_net_handler>
+  bool node_server<t_payload_net_handler>::try_to_connect_and_handshake_with_new_peer_async(const net_address& na, uint64_t last_seen_stamp, bool white)
+  {
+    {
+      CRITICAL_REGION_LOCAL(m_pending_connects_lock);
+      if(!has_connect_attempt_slot())
+        return false;
+      const time_t now = time(NULL);
+      if(m_connect_attempts_second != now)
+      {
+        m_connect_attempts_second = now;
+        m_connect_attempts_count = 0;
+      }
+      if(!m_pending_connects.insert(na).second)
+        return false;
+      ++m_connect_attempts_count;
+    }
+
+    const std::string ip = epee::string_tools::get_ip_string_from_int32(na.ip);
+    const std::string port = epee::string_tools::num_to_string_fast(na.port);
+    LOG_PRINT_L1("Connecting (async) to " << ip << ":" << port << "(white=" << white << ", last_seen: "
+        << (last_seen_stamp ? epee::misc_utils::get_time_interval_string(time(NULL) - last_seen_stamp):"never")
+        << ")...");
+
+    bool r = m_net_server.connect_async(ip, port, m_config.m_net_config.connection_timeout, [this, na, ip, port, white](
+      const typename net_server::t_connection_context& con,
+      const boost::system::error_code& ec)->bool
+    {
+      // the connection, once up, counts as an outgoing peer by itself
+      remove_pending_connect(na);
+      if(ec)
+      {
+        LOG_PRINT_CC_L1(con, "Connect failed to " << ip << ":" << port);
+        if(!white)
+          cache_connect_fail_info(na);
+        return false;
+      }
+
+      typename COMMAND_HANDSHAKE::request arg;
+      get_local_node_data(arg.node_data);
+      m_payload_handler.get_payload_sync_data(arg.payload_data);
+
+      const uint64_t invoke_time = epee::misc_utils::get_tick_count();
+      bool inv_call_res = epee::net_utils::async_invoke_remote_command2<typename COMMAND_HANDSHAKE::response>(con.m_connection_id, COMMAND_HANDSHAKE::ID, arg, m_net_server.get_config_object(),
+        [this, na, invoke_time](int code, const typename COMMAND_HANDSHAKE::response& rsp, p2p_connection_context& context)
+      {
+        if(!handle_handshake_response(code, rsp, context, false))
+        {
+          LOG_PRINT_CC_L1(context, "COMMAND_HANDSHAKE Failed");
+          m_net_server.get_config_object().close(context.m_connection_id);
+          return;
+        }
+
+        peerlist_entry pe_local = AUTO_VAL_INIT(pe_local);
+        pe_local.adr = na;
+        pe_local.id = context.peer_id;
+        pe_local.last_seen = static_cast<int64_t>(time(NULL));
+        m_peerlist.append_with_peer_white(pe_local);
+        m_peerlist.set_peer_rtt(na, epee::misc_utils::get_tick_count() - invoke_time);
+
+        try_get_support_flags(context, [](p2p_connection_context& flags_context, const uint32_t& support_flags)
+        {
+          flags_context.support_flags = support_flags;
+        });
+        LOG_PRINT_CC_GREEN(context, "CONNECTION HANDSHAKED OK.", LOG_LEVEL_2);
+      }, P2P_DEFAULT_HANDSHAKE_INVOKE_TIMEOUT);
+
+      if(!inv_call_res)
+      {
+        LOG_PRINT_CC_L1(con, "COMMAND_HANDSHAKE invoke failed to " << ip << ":" << port);
+        m_net_server.get_config_object().close(con.m_connection_id);
+        return false;
+      }
+      return true;
+    });
+    if(!r)
+    {
+      LOG_PRINT_L1("Failed to call connect_async to " << ip << ":" << port);
+      remove_pending_connect(na);
+    }
+    return r;
+  }
+  //-----------------------------------------------------------------------------------
+  template<class t_payload_net_handler>
+  void node_server<t_payload_net_handler>::cache_connect_fail_info(const net_address& addr)
+  {
+    CRITICAL_REGION_LOCAL(m_conn_fails_cache_lock);
+    const time_t now = time(NULL);
+    m_conn_fails_cache[addr] = now;
+    if(m_conn_fails_cache.size() > P2P_LOCAL_GRAY_PEERLIST_LIMIT)
+    {
+      for(auto it = m_conn_fails_cache.begin(); it != m_conn_fails_cache.end();)
+      {
+        if(now - it->second > P2P_FAILED_ADDR_FORGET_SECONDS)
+          it = m_conn_fails_cache.erase(it);
+        else
+          ++it;
+      }
+    }
+  }
   //-----------------------------------------------------------------------------------
   template<class t_payload_net_handler>
   bool node_server<t_payload_net_handler>::is_addr_recently_failed(const net_address& addr)
@@ -933,23 +1116,35 @@ namespace nodetool
 
     size_t max_random_index = std::min<uint64_t>(local_peers_count -1, 20);
 
-    std::set<size_t> tried_peers;
+    std::vector<peerlist_entry> fast_peers;
+    if(use_white_list)
+      m_peerlist.get_fastest_white_peers(fast_peers, max_random_index + 1);
+
+    std::set<net_address> tried_peers;
 
     size_t try_count = 0;
     size_t rand_count = 0;
     while(rand_count < (max_random_index+1)*3 &&  try_count < 10 && !m_net_server.is_stop_signal_sent())
     {
       ++rand_count;
-      size_t random_index = get_random_index_with_fixed_probability(max_random_index);
-      CHECK_AND_ASSERT_MES(random_index < local_peers_count, false, "random_starter_index < peers_local.size() failed!!");
+      peerlist_entry pe = AUTO_VAL_INIT(pe);
+      if(!fast_peers.empty() && crypto::rand<size_t>() % 100 < P2P_DEFAULT_FAST_PEERS_PERCENT)
+      {
+        // prefer the peers measured fastest, the other picks keep the selection diverse
+        pe = fast_peers[get_random_index_with_fixed_probability(fast_peers.size() - 1)];
+      }
+      else
+      {
+        // white peers are biased towards the recently seen ones, gray peers are sampled uniformly
+        size_t random_index = use_white_list ? get_random_index_with_fixed_probability(max_random_index) : crypto::rand<size_t>() % local_peers_count;
+        CHECK_AND_ASSERT_MES(random_index < local_peers_count, false, "random_starter_index < peers_local.size() failed!!");
 
-      if(tried_peers.count(random_index))
-        continue;
+        bool r = use_white_list ? m_peerlist.get_white_peer_by_index(pe, random_index):m_peerlist.get_random_gray_peer(pe, random_index);
+        CHECK_AND_ASSERT_MES(r, false, "Failed to get random peer from peerlist(white:" << use_white_list << ")");
+      }
 
-      tried_peers.insert(random_index);
-      peerlist_entry pe = AUTO_VAL_INIT(pe);
-      bool r = use_white_list ? m_peerlist.get_white_peer_by_index(pe, random_index):m_peerlist.get_gray_peer_by_index(pe, random_index);
-      CHECK_AND_ASSERT_MES(r, false, "Failed to get random peer from peerlist(white:" << use_white_list << ")");
+      if(!tried_peers.insert(pe.adr).second)
+        continue;
 
       ++try_count;
 
@@ -971,8 +1166,8 @@ namespace nodetool
                     << "[white=" << use_white_list
                     << "] last_seen: " << (pe.last_seen ? epee::misc_utils::get_time_interval_string(time(NULL) - pe.last_seen) : "never"));
 
-      if(!try_to_connect_and_handshake_with_new_peer(pe.adr, false, pe.last_seen, use_white_list)) {
-        _note("Handshake failed");
+      if(!try_to_connect_and_handshake_with_new_peer_async(pe.adr, pe.last_seen, use_white_list)) {
+        _note("Connection attempt not started");
         continue;
       }
 
@@ -982,29 +1177,82 @@ namespace nodetool
   }
   //-----------------------------------------------------------------------------------
   template<class t_payload_net_handler>
+  void node_server<t_payload_net_handler>::resolve_seed_nodes()
+  {
+    // for each hostname in the seed nodes list, attempt to DNS resolve and
+    // add the result addresses as seed nodes
+    // TODO: at some point add IPv6 support, but that won't be relevant
+    // for some time yet.
+    // TODO: care about dnssec avail/valid
+    LOG_PRINT_L4("Resolving seed nodes, timeout " << CRYPTONOTE_DNS_TIMEOUT_MS << "ms");
+    const std::vector<std::vector<std::string>> dns_results = tools::dns_utils::resolve_parallel(m_seed_nodes_list, tools::DNS_TYPE_A, false, CRYPTONOTE_DNS_TIMEOUT_MS);
+
+    std::set<std::string> full_addrs;
+    for (size_t i = 0; i < dns_results.size(); ++i)
+    {
+      LOG_PRINT_L4("DNS lookup for " << m_seed_nodes_list[i] << ": " << dns_results[i].size() << " results");
+      // if no results for node, the lookup likely timed out
+      for (const auto& addr_string : dns_results[i])
+        full_addrs.insert(addr_string + ":18080");
+    }
+
+    if (!full_addrs.size())
+    {
+      LOG_PRINT_L0("DNS seed node lookup either timed out or failed, falling back to defaults");
+      full_addrs.insert("198.74.231.92:18080");
+      full_addrs.insert("161.67.132.39:18080");
+      full_addrs.insert("163.172.182.165:18080");
+      full_addrs.insert("204.12.248.66:18080");
+      full_addrs.insert("5.9.100.248:18080");
+    }
+
+    std::vector<net_address> seed_nodes;
+    for (const auto& full_addr : full_addrs)
+    {
+      LOG_PRINT_L2("Seed node: " << full_addr);
+      append_net_address(seed_nodes, full_addr);
+    }
+
+    CRITICAL_REGION_LOCAL(m_seed_nodes_lock);
+    m_seed_nodes.insert(m_seed_nodes.end(), seed_nodes.begin(), seed_nodes.end());
+    m_seed_nodes_resolved = true;
+    LOG_PRINT_L1("Number of seed nodes: " << m_seed_nodes.size());
+  }
+  //-----------------------------------------------------------------------------------
+  template<class t_payload_net_handler>
   bool node_server<t_payload_net_handler>::connections_maker()
   {
     if (!connect_to_peerlist(m_exclusive_peers)) return false;
 
     if (!m_exclusive_peers.empty()) return true;
 
-    if(!m_peerlist.get_white_peers_count() && m_seed_nodes.size())
+    if(!m_peerlist.get_white_peers_count())
     {
+      // the DNS seed nodes may still be resolving, in which case we try again
+      // on the next round
+      std::vector<net_address> seed_nodes;
+      {
+        CRITICAL_REGION_LOCAL(m_seed_nodes_lock);
+        seed_nodes = m_seed_nodes;
+      }
+      if (seed_nodes.empty() && !m_seed_nodes_resolved)
+        LOG_PRINT_L2("Waiting for seed nodes from DNS");
+
       size_t try_count = 0;
-      size_t current_index = crypto::rand<size_t>()%m_seed_nodes.size();
-      while(true)
+      size_t current_index = seed_nodes.empty() ? 0 : crypto::rand<size_t>()%seed_nodes.size();
+      while(!seed_nodes.empty())
       {
         if(m_net_server.is_stop_signal_sent())
           return false;
 
-        if(try_to_connect_and_handshake_with_new_peer(m_seed_nodes[current_index], true))
+        if(try_to_connect_and_handshake_with_new_peer(seed_nodes[current_index], true))
           break;
-        if(++try_count > m_seed_nodes.size())
+        if(++try_count > seed_nodes.size())
         {
           LOG_PRINT_RED_L0("Failed to connect to any of seed peers, continuing without seeds");
           break;
         }
-        if(++current_index >= m_seed_nodes.size())
+        if(++current_index >= seed_nodes.size())
           current_index = 0;
       }
     }
@@ -1045,12 +1293,15 @@ namespace nodetool
       return true;
 
     size_t conn_count = get_outgoing_connections_count();
-    //add new connections from white peers
-    while(conn_count < expected_connections)
+    //add new connections from white peers, attempts in flight count as connections
+    while(conn_count + get_pending_connects_count() < expected_connections)
     {
       if(m_net_server.is_stop_signal_sent())
         return false;
 
+      if(!has_connect_attempt_slot())
+        break;
+
       if(!make_new_connection_from_peerlist(white_list))
         break;
       conn_count = get_outgoing_connections_count();
@@ -1247,9 +1498,11 @@ namespace nodetool
   template<class t_payload_net_handler>
   bool node_server<t_payload_net_handler>::relay_notify_to_list(int command, const std::string& data_buff, const std::list<boost::uuids::uuid> &connections)
   {
+    // one copy of the payload, every connection's send queue references it
+    const epee::net_utils::shared_buffer shared_buff = epee::net_utils::make_shared_buffer(data_buff);
     BOOST_FOREACH(const auto& c_id, connections)
     {
-      m_net_server.get_config_object().notify(command, data_buff, c_id);
+      m_net_server.get_config_object().notify(command, shared_buff, c_id);
     }
     return true;
   }
@@ -1274,6 +1527,15 @@ namespace nodetool
   }
   //-----------------------------------------------------------------------------------
   template<class t_payload_net_handler>
+  epee::net_utils::traffic_class node_server<t_payload_net_handler>::get_traffic_class(int command)
+  {
+    //own commands are handshakes, timed syncs and pings
+    if (command >= P2P_COMMANDS_POOL_BASE && command < P2P_COMMANDS_POOL_BASE + 1000)
+      return epee::net_utils::traffic_class_peerlist;
+    return m_payload_handler.get_traffic_class(command);
+  }
+  //-----------------------------------------------------------------------------------
+  template<class t_payload_net_handler>
   bool node_server<t_payload_net_handler>::invoke_notify_to_peer(int command, const std::string& req_buff, const epee::net_utils::connection_context_base& context)
   {
     int res = m_net_server.get_config_object().notify(command, req_buff, context.m_connection_id);
@@ -1306,7 +1568,8 @@ namespace nodetool
     std::string ip = epee::string_tools::get_ip_string_from_int32(actual_ip);
     std::string port = epee::string_tools::num_to_string_fast(node_data.my_port);
     peerid_type pr = node_data.peer_id;
-    bool r = m_net_server.connect_async(ip, port, m_config.m_net_config.ping_connection_timeout, [cb, /*context,*/ ip, port, pr, this](
+    uint32_t my_port = node_data.my_port;
+    bool r = m_net_server.connect_async(ip, port, m_config.m_net_config.ping_connection_timeout, [cb, /*context,*/ ip, port, pr, actual_ip, my_port, this](
       const typename net_server::t_connection_context& ping_context,
       const boost::system::error_code& ec)->bool
     {
@@ -1325,6 +1588,7 @@ namespace nodetool
 
       // GCC 5.1.0 gives error with second use of uint64_t (peerid_type) variable.
       peerid_type pr_ = pr;
+      const uint64_t invoke_time = epee::misc_utils::get_tick_count();
 
       bool inv_call_res = epee::net_utils::async_invoke_remote_command2<COMMAND_PING::response>(ping_context.m_connection_id, COMMAND_PING::ID, req, m_net_server.get_config_object(),
         [=](int code, const COMMAND_PING::response& rsp, p2p_connection_context& context)
@@ -1342,6 +1606,10 @@ namespace nodetool
           return;
         }
         m_net_server.get_config_object().close(ping_context.m_connection_id);
+        net_address na = AUTO_VAL_INIT(na);
+        na.ip = actual_ip;
+        na.port = my_port;
+        m_peerlist.set_peer_rtt(na, epee::misc_utils::get_tick_count() - invoke_time);
         cb();
       });
 
@@ -1396,9 +1664,11 @@ namespace nodetool
       return 1;
     }
 
-    //fill response
+    //fill response, with only what changed since the last exchange
     rsp.local_time = time(NULL);
-    m_peerlist.get_peerlist_head(rsp.local_peerlist);
+    m_peerlist.get_peerlist_head(rsp.local_peerlist, P2P_DEFAULT_PEERS_IN_TIMED_SYNC, context.peerlist_sent_up_to);
+    if(!rsp.local_peerlist.empty())
+      context.peerlist_sent_up_to = rsp.local_peerlist.front().last_seen;
     m_payload_handler.get_payload_sync_data(rsp.payload_data);
     LOG_PRINT_CCONTEXT_L2("COMMAND_TIMED_SYNC");
     return 1;
@@ -1467,6 +1737,8 @@ namespace nodetool
 
     //fill response
     m_peerlist.get_peerlist_head(rsp.local_peerlist);
+    if(!rsp.local_peerlist.empty())
+      context.peerlist_sent_up_to = rsp.local_peerlist.front().last_seen;
     get_local_node_data(rsp.node_data);
     m_payload_handler.get_payload_sync_data(rsp.payload_data);
     LOG_PRINT_CCONTEXT_GREEN("COMMAND_HANDSHAKE", LOG_LEVEL_1);
@@ -1526,6 +1798,7 @@ namespace nodetool
   void node_server<t_payload_net_handler>::on_connection_close(p2p_connection_context& context)
   {
     LOG_PRINT_L2("["<< epee::net_utils::print_connection_context(context) << "] CLOSE CONNECTION");
+    m_payload_handler.on_connection_close(context);
   }
 
   template<class t_payload_net_handler>
@@ -1657,4 +1930,17 @@ namespace nodetool
 
     return true;
   }
+
+  template<class t_payload_net_handler>
+  bool node_server<t_payload_net_handler>::set_memory_limits(const boost::program_options::variables_map& vm, int64_t connection_limit, int64_t total_limit)
+  {
+    const uint64_t connection_bytes = connection_limit < 0 ? P2P_DEFAULT_CONNECTION_MEMORY_LIMIT : connection_limit * 1024 * 1024;
+    const uint64_t total_bytes = total_limit < 0 ? P2P_DEFAULT_TOTAL_CONNECTION_MEMORY_LIMIT : total_limit * 1024 * 1024;
+    if (connection_bytes && connection_bytes < P2P_DEFAULT_PACKET_MAX_SIZE)
+      LOG_PRINT_L0("Connection memory limit is below the maximum packet size, large responses will stall");
+    epee::net_utils::connections_memory::connection_limit() = connection_bytes;
+    epee::net_utils::connections_memory::total_limit() = total_bytes;
+    LOG_PRINT_L0("Set connection memory limits to " << connection_bytes/1024/1024 << " MB per peer, " << total_bytes/1024/1024 << " MB total");
+    return true;
+  }
 }
@@ -51,10 +51,12 @@ namespace nodetool
     virtual void request_callback(const epee::net_utils::connection_context_base& context)=0;
     virtual uint64_t get_connections_count()=0;
     virtual void for_each_connection(std::function<bool(t_connection_context&, peerid_type, uint32_t)> f)=0;
+    virtual uint32_t get_support_flags(const epee::net_utils::connection_context_base& context)=0;
     virtual bool block_ip(uint32_t adress, time_t seconds = 0)=0;
     virtual bool unblock_ip(uint32_t adress)=0;
     virtual std::map<uint32_t, time_t> get_blocked_ips()=0;
     virtual bool add_ip_fail(uint32_t adress)=0;
+    virtual void report_block_announce_delay(const epee::net_utils::connection_context_base& context, uint64_t delay_ms)=0;
   };
 
   template<class t_connection_context>
@@ -88,6 +90,10 @@ namespace nodetool
     {
 
     }
+    virtual uint32_t get_support_flags(const epee::net_utils::connection_context_base& context)
+    {
+      return 0;
+    }
 
     virtual uint64_t get_connections_count()    
     {
@@ -109,5 +115,9 @@ namespace nodetool
     {
       return true;
     }
+    virtual void report_block_announce_delay(const epee::net_utils::connection_context_base& context, uint64_t delay_ms)
+    {
+
+    }
   };
 }
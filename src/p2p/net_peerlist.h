@@ -33,17 +33,21 @@
 #include <list>
 #include <set>
 #include <map>
+#include <vector>
+#include <algorithm>
 #include <boost/foreach.hpp>
 //#include <boost/bimap.hpp>
 //#include <boost/bimap/multiset_of.hpp>
 #include <boost/archive/binary_oarchive.hpp>
 #include <boost/archive/binary_iarchive.hpp>
 #include <boost/serialization/version.hpp>
+#include <boost/serialization/map.hpp>
 
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/ordered_index.hpp>
 #include <boost/multi_index/identity.hpp>
 #include <boost/multi_index/member.hpp>
+#include <boost/multi_index/random_access_index.hpp>
 
 
 #include "syncobj.h"
@@ -51,9 +55,10 @@
 #include "p2p_protocol_defs.h"
 #include "cryptonote_config.h"
 #include "net_peerlist_boost_serialization.h"
+#include "common/memory_usage.h"
 
 
-#define CURRENT_PEERLIST_STORAGE_ARCHIVE_VER    4
+#define CURRENT_PEERLIST_STORAGE_ARCHIVE_VER    6
 
 namespace nodetool
 {
@@ -62,6 +67,14 @@ namespace nodetool
   /************************************************************************/
   /*                                                                      */
   /************************************************************************/
+  struct peer_latency
+  {
+    uint64_t rtt_ms;
+    uint64_t rtt_samples;
+    uint64_t block_delay_ms;
+    uint64_t block_delay_samples;
+  };
+
   class peerlist_manager
   {
   public: 
@@ -70,22 +83,29 @@ namespace nodetool
     size_t get_white_peers_count(){CRITICAL_REGION_LOCAL(m_peerlist_lock); return m_peers_white.size();}
     size_t get_gray_peers_count(){CRITICAL_REGION_LOCAL(m_peerlist_lock); return m_peers_gray.size();}
     bool merge_peerlist(const std::list<peerlist_entry>& outer_bs);
-    bool get_peerlist_head(std::list<peerlist_entry>& bs_head, uint32_t depth = P2P_DEFAULT_PEERS_IN_HANDSHAKE);
+    bool get_peerlist_head(std::list<peerlist_entry>& bs_head, uint32_t depth = P2P_DEFAULT_PEERS_IN_HANDSHAKE, int64_t seen_after = 0);
     bool get_peerlist_full(std::list<peerlist_entry>& pl_gray, std::list<peerlist_entry>& pl_white);
     bool get_white_peer_by_index(peerlist_entry& p, size_t i);
     bool get_gray_peer_by_index(peerlist_entry& p, size_t i);
+    bool get_random_gray_peer(peerlist_entry& p, size_t i);
     bool append_with_peer_white(const peerlist_entry& pr);
     bool append_with_peer_gray(const peerlist_entry& pr);
     bool set_peer_just_seen(peerid_type peer, uint32_t ip, uint32_t port);
     bool set_peer_just_seen(peerid_type peer, const net_address& addr);
     bool set_peer_unreachable(const peerlist_entry& pr);
     bool is_ip_allowed(uint32_t ip);
+    void set_peer_rtt(const net_address& addr, uint64_t rtt_ms);
+    void set_peer_block_delay(const net_address& addr, uint64_t delay_ms);
+    bool get_peer_latency(const net_address& addr, peer_latency& latency);
+    bool get_fastest_white_peers(std::vector<peerlist_entry>& peers, size_t count);
+    uint64_t get_memory_usage();
 
     
   private:
     struct by_time{};
     struct by_id{};
     struct by_addr{};
+    struct by_random_access{};
 
     struct modify_all_but_id
     {
@@ -127,10 +147,22 @@ namespace nodetool
       // access by peerlist_entry::net_adress
       boost::multi_index::ordered_unique<boost::multi_index::tag<by_addr>, boost::multi_index::member<peerlist_entry,net_address,&peerlist_entry::adr> >,
       // sort by peerlist_entry::last_seen<
-      boost::multi_index::ordered_non_unique<boost::multi_index::tag<by_time>, boost::multi_index::member<peerlist_entry,int64_t,&peerlist_entry::last_seen> >
+      boost::multi_index::ordered_non_unique<boost::multi_index::tag<by_time>, boost::multi_index::member<peerlist_entry,int64_t,&peerlist_entry::last_seen> >,
+      // O(1) access by position, for uniform sampling
+      boost::multi_index::random_access<boost::multi_index::tag<by_random_access> >
       > 
     > peers_indexed;
 
+    typedef boost::multi_index_container<
+      peerlist_entry,
+      boost::multi_index::indexed_by<
+      // access by peerlist_entry::net_adress
+      boost::multi_index::ordered_unique<boost::multi_index::tag<by_addr>, boost::multi_index::member<peerlist_entry,net_address,&peerlist_entry::adr> >,
+      // sort by peerlist_entry::last_seen<
+      boost::multi_index::ordered_non_unique<boost::multi_index::tag<by_time>, boost::multi_index::member<peerlist_entry,int64_t,&peerlist_entry::last_seen> >
+      > 
+    > peers_indexed_v4;
+
     typedef boost::multi_index_container<
       peerlist_entry,
       boost::multi_index::indexed_by<
@@ -158,14 +190,30 @@ namespace nodetool
         peers_indexed_from_old(pio, m_peers_white);
         return;
       }
+      if(ver < 5)
+      {
+        //same entries, stored without the random access index
+        peers_indexed_v4 white, gray;
+        a & white;
+        a & gray;
+        peers_indexed_from_old(white, m_peers_white);
+        peers_indexed_from_old(gray, m_peers_gray);
+        return;
+      }
       a & m_peers_white;
       a & m_peers_gray;
+      if(ver < 6)
+        return;
+      a & m_peers_latency;
     }
 
   private: 
-    bool peers_indexed_from_old(const peers_indexed_old& pio, peers_indexed& pi);
+    template<class t_peers_indexed>
+    bool peers_indexed_from_old(const t_peers_indexed& pio, peers_indexed& pi);
     void trim_white_peerlist();
     void trim_gray_peerlist();
+    void trim_peers_latency();
+    static uint64_t smooth_latency(uint64_t average, uint64_t samples, uint64_t sample);
 
     friend class boost::serialization::access;
     epee::critical_section m_peerlist_lock;
@@ -175,6 +223,7 @@ namespace nodetool
 
     peers_indexed m_peers_gray;
     peers_indexed m_peers_white;
+    std::map<net_address, peer_latency> m_peers_latency;
   };
   //--------------------------------------------------------------------------------------------------
   inline
@@ -190,8 +239,18 @@ namespace nodetool
     return true;
   }
   //--------------------------------------------------------------------------------------------------
-  inline 
-  bool peerlist_manager::peers_indexed_from_old(const peers_indexed_old& pio, peers_indexed& pi)
+  inline
+    uint64_t peerlist_manager::get_memory_usage()
+  {
+    CRITICAL_REGION_LOCAL(m_peerlist_lock);
+    // a node per entry, with three links for each ordered index, and one
+    // link each way for the random access index
+    const uint64_t entry_bytes = sizeof(peerlist_entry) + 8 * sizeof(void*);
+    return (m_peers_white.size() + m_peers_gray.size()) * entry_bytes + tools::tree_container_bytes(m_peers_latency);
+  }
+  //--------------------------------------------------------------------------------------------------
+  template<class t_peers_indexed>
+  bool peerlist_manager::peers_indexed_from_old(const t_peers_indexed& pio, peers_indexed& pi)
   {
     for(auto x: pio)
     {
@@ -223,6 +282,81 @@ namespace nodetool
     }
   }
   //--------------------------------------------------------------------------------------------------
+  inline void peerlist_manager::trim_peers_latency()
+  {
+    if(m_peers_latency.size() <= P2P_LOCAL_WHITE_PEERLIST_LIMIT)
+      return;
+    // only white peers get measured, forget the ones that left the white list
+    for(auto it = m_peers_latency.begin(); it != m_peers_latency.end();)
+    {
+      if(m_peers_white.get<by_addr>().find(it->first) == m_peers_white.get<by_addr>().end())
+        it = m_peers_latency.erase(it);
+      else
+        ++it;
+    }
+  }
+  //--------------------------------------------------------------------------------------------------
+  inline uint64_t peerlist_manager::smooth_latency(uint64_t average, uint64_t samples, uint64_t sample)
+  {
+    if(!samples)
+      return sample;
+    return (average * (P2P_PEER_LATENCY_SMOOTHING - 1) + sample) / P2P_PEER_LATENCY_SMOOTHING;
+  }
+  //--------------------------------------------------------------------------------------------------
+  inline
+  void peerlist_manager::set_peer_rtt(const net_address& addr, uint64_t rtt_ms)
+  {
+    CRITICAL_REGION_LOCAL(m_peerlist_lock);
+    peer_latency& l = m_peers_latency[addr];
+    l.rtt_ms = smooth_latency(l.rtt_ms, l.rtt_samples, rtt_ms);
+    ++l.rtt_samples;
+    trim_peers_latency();
+  }
+  //--------------------------------------------------------------------------------------------------
+  inline
+  void peerlist_manager::set_peer_block_delay(const net_address& addr, uint64_t delay_ms)
+  {
+    CRITICAL_REGION_LOCAL(m_peerlist_lock);
+    peer_latency& l = m_peers_latency[addr];
+    l.block_delay_ms = smooth_latency(l.block_delay_ms, l.block_delay_samples, delay_ms);
+    ++l.block_delay_samples;
+    trim_peers_latency();
+  }
+  //--------------------------------------------------------------------------------------------------
+  inline
+  bool peerlist_manager::get_peer_latency(const net_address& addr, peer_latency& latency)
+  {
+    CRITICAL_REGION_LOCAL(m_peerlist_lock);
+    auto it = m_peers_latency.find(addr);
+    if(it == m_peers_latency.end())
+      return false;
+    latency = it->second;
+    return true;
+  }
+  //--------------------------------------------------------------------------------------------------
+  inline
+  bool peerlist_manager::get_fastest_white_peers(std::vector<peerlist_entry>& peers, size_t count)
+  {
+    CRITICAL_REGION_LOCAL(m_peerlist_lock);
+    // peers that never announced a block to us are ranked as if they were slow at it
+    std::vector<std::pair<uint64_t, peerlist_entry>> scored;
+    for(const auto& l: m_peers_latency)
+    {
+      auto it = m_peers_white.get<by_addr>().find(l.first);
+      if(it == m_peers_white.get<by_addr>().end())
+        continue;
+      uint64_t block_delay = l.second.block_delay_samples ? l.second.block_delay_ms : P2P_PEER_UNKNOWN_BLOCK_DELAY_MS;
+      scored.push_back(std::make_pair(l.second.rtt_ms + block_delay, *it));
+    }
+    const size_t n = std::min(count, scored.size());
+    std::partial_sort(scored.begin(), scored.begin() + n, scored.end(),
+      [](const std::pair<uint64_t, peerlist_entry>& a, const std::pair<uint64_t, peerlist_entry>& b){ return a.first < b.first; });
+    peers.clear();
+    for(size_t i = 0; i < n; ++i)
+      peers.push_back(scored[i].second);
+    return true;
+  }
+  //--------------------------------------------------------------------------------------------------
   inline 
   bool peerlist_manager::merge_peerlist(const std::list<peerlist_entry>& outer_bs)
   {
@@ -260,6 +394,17 @@ namespace nodetool
     return true;
   }
   //--------------------------------------------------------------------------------------------------
+  inline
+  bool peerlist_manager::get_random_gray_peer(peerlist_entry& p, size_t i)
+  {
+    CRITICAL_REGION_LOCAL(m_peerlist_lock);
+    if(i >= m_peers_gray.size())
+      return false;
+
+    p = m_peers_gray.get<by_random_access>()[i];
+    return true;
+  }
+  //--------------------------------------------------------------------------------------------------
   inline 
   bool peerlist_manager::is_ip_allowed(uint32_t ip)
   {
@@ -274,7 +419,7 @@ namespace nodetool
   }
   //--------------------------------------------------------------------------------------------------
   inline 
-  bool peerlist_manager::get_peerlist_head(std::list<peerlist_entry>& bs_head, uint32_t depth)
+  bool peerlist_manager::get_peerlist_head(std::list<peerlist_entry>& bs_head, uint32_t depth, int64_t seen_after)
   {
     
     CRITICAL_REGION_LOCAL(m_peerlist_lock);
@@ -282,8 +427,9 @@ namespace nodetool
     uint32_t cnt = 0;
     BOOST_REVERSE_FOREACH(const peers_indexed::value_type& vl, by_time_index)
     {
-      if(!vl.last_seen)
-        continue;
+      // newest first, so everything from here on was seen before, or never
+      if(vl.last_seen <= seen_after)
+        break;
       bs_head.push_back(vl);      
       if(cnt++ > depth)
         break;
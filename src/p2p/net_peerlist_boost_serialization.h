@@ -30,6 +30,11 @@
 
 #pragma once
 
+namespace nodetool
+{
+  struct peer_latency;
+}
+
 namespace boost
 {
   namespace serialization
@@ -50,5 +55,14 @@ namespace boost
       a & pl.id;
       a & pl.last_seen;
     }    
+
+    template <class Archive, class ver_type>
+    inline void serialize(Archive &a,  nodetool::peer_latency& pl, const ver_type ver)
+    {
+      a & pl.rtt_ms;
+      a & pl.rtt_samples;
+      a & pl.block_delay_ms;
+      a & pl.block_delay_samples;
+    }
   }
 }
@@ -108,6 +108,101 @@ network_throttle_bw::network_throttle_bw(const std::string &name1)
 { }
 
 
+// ================================================================================================
+// traffic_shaper
+// ================================================================================================
+
+traffic_shaper::traffic_shaper()
+	: m_rate(0), m_burst(0), m_tokens(0), m_last_refill(get_time_seconds())
+{ }
+
+void traffic_shaper::set_rate(uint64_t bytes_per_second) {
+	boost::lock_guard<boost::mutex> lock(m_lock);
+	refill(get_time_seconds());
+	const bool was_unlimited = m_rate <= 0;
+	m_rate = bytes_per_second;
+	m_burst = std::max(m_rate, 16.0 * 1024); // one second worth, but room for at least a few packets
+	m_tokens = was_unlimited ? m_burst : std::min(m_tokens, m_burst);
+}
+
+uint64_t traffic_shaper::get_rate() const {
+	boost::lock_guard<boost::mutex> lock(m_lock);
+	return m_rate;
+}
+
+double traffic_shaper::reserve(traffic_class cls, size_t bytes) {
+	return reserve(cls, bytes, get_time_seconds());
+}
+
+double traffic_shaper::reserve(traffic_class cls, size_t bytes, double now) {
+	boost::lock_guard<boost::mutex> lock(m_lock);
+	refill(now);
+	const double wait = delay(cls);
+	if (wait <= 0)
+		m_tokens -= bytes;
+	return wait;
+}
+
+double traffic_shaper::get_delay(traffic_class cls) {
+	return get_delay(cls, get_time_seconds());
+}
+
+double traffic_shaper::get_delay(traffic_class cls, double now) {
+	boost::lock_guard<boost::mutex> lock(m_lock);
+	refill(now);
+	return delay(cls);
+}
+
+void traffic_shaper::consume(size_t bytes) {
+	consume(bytes, get_time_seconds());
+}
+
+void traffic_shaper::consume(size_t bytes, double now) {
+	boost::lock_guard<boost::mutex> lock(m_lock);
+	refill(now);
+	if (m_rate > 0)
+		m_tokens -= bytes;
+}
+
+void traffic_shaper::refill(double now) {
+	if (now > m_last_refill && m_rate > 0)
+		m_tokens = std::min(m_burst, m_tokens + (now - m_last_refill) * m_rate);
+	m_last_refill = std::max(m_last_refill, now);
+}
+
+double traffic_shaper::floor(traffic_class cls) const {
+	switch (cls) {
+		case traffic_class_relay: return -m_burst;
+		case traffic_class_sync: return m_burst / 4;
+		default: return 0;
+	}
+}
+
+double traffic_shaper::delay(traffic_class cls) const {
+	if (m_rate <= 0)
+		return 0;
+	const double floor_tokens = floor(cls);
+	if (m_tokens > floor_tokens)
+		return 0;
+	return std::max((floor_tokens - m_tokens) / m_rate, 0.001);
+}
+
+traffic_shaper & traffic_shaper::get_global_out() {
+	static traffic_shaper shaper;
+	return shaper;
+}
+
+traffic_shaper & traffic_shaper::get_global_in() {
+	static traffic_shaper shaper;
+	return shaper;
+}
+
+double traffic_shaper::get_time_seconds() {
+	using namespace boost::chrono;
+	return duration_cast<duration<double>>(steady_clock::now().time_since_epoch()).count();
+}
+
+
 
 
 } // namespace 
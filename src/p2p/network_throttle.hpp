@@ -171,6 +171,44 @@ class i_network_throttle {
 };
 
 
+/***
+@brief Non-blocking token bucket, shared by all connections for one direction (see get_global_out/in).
+Callers ask before sending and get back how long to wait instead of being put to sleep. Each traffic
+class may draw the bucket down to its own floor: relays may run into debt, peer list traffic down to
+empty, and bulk sync only while a reserve is left, so relays keep going when the limit is saturated.
+*/
+class traffic_shaper {
+	public:
+		traffic_shaper();
+
+		void set_rate(uint64_t bytes_per_second); ///< 0 means unlimited
+		uint64_t get_rate() const;
+
+		/// takes the bytes and returns 0 if the class may send now, otherwise returns the seconds to wait before asking again
+		double reserve(traffic_class cls, size_t bytes);
+		double reserve(traffic_class cls, size_t bytes, double now); ///< ditto, with the caller's clock (seconds)
+		/// seconds until the class may send, without taking anything ; consume() accounts traffic that already happened
+		double get_delay(traffic_class cls);
+		double get_delay(traffic_class cls, double now);
+		void consume(size_t bytes);
+		void consume(size_t bytes, double now);
+
+		static traffic_shaper & get_global_out(); ///< upload, all connections
+		static traffic_shaper & get_global_in(); ///< download, all connections
+		static double get_time_seconds(); ///< monotonic clock used by the shapers
+
+	private:
+		void refill(double now);
+		double floor(traffic_class cls) const;
+		double delay(traffic_class cls) const;
+
+		mutable boost::mutex m_lock;
+		double m_rate; // bytes per second, 0 for unlimited
+		double m_burst; // bucket capacity, bytes
+		double m_tokens; // may go negative (debt) for relays
+		double m_last_refill;
+};
+
 // ... more in the -advanced.h file
 
 
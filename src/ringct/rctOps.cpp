@@ -34,6 +34,55 @@ using namespace crypto;
 using namespace std;
 
 namespace rct {
+    namespace {
+      //H decompressed once, in the same fixed-base table layout ge_scalarmult_base uses for G
+      struct HTable {
+        ge_precomp table[32][8];
+        HTable() {
+          ge_p3 p;
+          CHECK_AND_ASSERT_THROW_MES(ge_frombytes_vartime(&p, H.bytes) == 0, "ge_frombytes_vartime failed on H");
+          ge_precomp_table(table, &p);
+        }
+      };
+
+      const HTable &get_H_table() {
+        static const HTable table;
+        return table;
+      }
+
+      //H2 decompressed once
+      struct H2Cache {
+        ge_cached points[ATOMS];
+        H2Cache() {
+          ge_p3 p;
+          for (size_t i = 0; i < ATOMS; ++i) {
+            CHECK_AND_ASSERT_THROW_MES(ge_frombytes_vartime(&p, H2[i].bytes) == 0, "ge_frombytes_vartime failed on H2");
+            ge_p3_to_cached(&points[i], &p);
+          }
+        }
+      };
+
+      const H2Cache &get_H2_cache() {
+        static const H2Cache cache;
+        return cache;
+      }
+
+      //C = aG + bH, a is reduced first like scalarmultBase does
+      void commitKeys(key &C, const key &a, const key &b) {
+        key ared;
+        ge_p3 aG, bH;
+        ge_cached bHc;
+        ge_p1p1 sum;
+        ge_p2 rv;
+        sc_reduce32copy(ared.bytes, a.bytes);
+        ge_scalarmult_base(&aG, ared.bytes);
+        ge_scalarmult_precomp(&bH, b.bytes, get_H_table().table);
+        ge_p3_to_cached(&bHc, &bH);
+        ge_add(&sum, &aG, &bHc);
+        ge_p1p1_to_p2(&rv, &sum);
+        ge_tobytes(C.bytes, &rv);
+      }
+    }
 
     //Various key initialization functions
 
@@ -101,18 +150,15 @@ namespace rct {
 
     //generates C =aG + bH from b, a is given..
     void genC(key & C, const key & a, xmr_amount amount) {
-        key bH = scalarmultH(d2h(amount));
-        addKeys1(C, a, bH);
+        commitKeys(C, a, d2h(amount));
     }
 
     //generates a <secret , public> / Pedersen commitment to the amount
     tuple<ctkey, ctkey> ctskpkGen(xmr_amount amount) {
         ctkey sk, pk;
         skpkGen(sk.dest, pk.dest);
-        skpkGen(sk.mask, pk.mask);
-        key am = d2h(amount);
-        key bH = scalarmultH(am);
-        addKeys(pk.mask, pk.mask, bH);
+        skGen(sk.mask);
+        commitKeys(pk.mask, sk.mask, d2h(amount));
         return make_tuple(sk, pk);
     }
     
@@ -127,19 +173,14 @@ namespace rct {
     }
     
     key zeroCommit(xmr_amount amount) {
-        key mask = identity();
-        mask = scalarmultBase(mask);
-        key am = d2h(amount);
-        key bH = scalarmultH(am);
-        addKeys(mask, mask, bH);
-        return mask;
+        key c;
+        commitKeys(c, identity(), d2h(amount));
+        return c;
     }
 
     key commit(xmr_amount amount, const key &mask) {
-        key c = scalarmultBase(mask);
-        key am = d2h(amount);
-        key bH = scalarmultH(am);
-        addKeys(c, c, bH);
+        key c;
+        commitKeys(c, mask, d2h(amount));
         return c;
     }
 
@@ -191,15 +232,18 @@ namespace rct {
 
     //Computes aH where H= toPoint(cn_fast_hash(G)), G the basepoint
     key scalarmultH(const key & a) {
-        ge_p3 A;
-        ge_p2 R;
-        CHECK_AND_ASSERT_THROW_MES(ge_frombytes_vartime(&A, H.bytes) == 0, "ge_frombytes_vartime failed at "+boost::lexical_cast<std::string>(__LINE__));
-        ge_scalarmult(&R, a.bytes, &A);
+        ge_p3 R;
+        ge_scalarmult_precomp(&R, a.bytes, get_H_table().table);
         key aP;
-        ge_tobytes(aP.bytes, &R);
+        ge_p3_tobytes(aP.bytes, &R);
         return aP;
     }
 
+    //H2[i] = 2^i H, as a point ready to be added or subtracted
+    const ge_cached &cachedH2(size_t i) {
+        return get_H2_cache().points[i];
+    }
+
     //Curve addition / subtractions
 
     //for curve points: AB = A + B
@@ -233,6 +277,14 @@ namespace rct {
         ge_tobytes(aGbB.bytes, &rv);
     }
 
+    //aGbB = aG + bB where a, b are scalars, G is the basepoint and B is a point
+    //B must be input after applying "precomp"
+    void addKeys2(key &aGbB, const key &a, const key &b, const ge_dsmp B) {
+        ge_p2 rv;
+        ge_double_scalarmult_base_precomp_vartime(&rv, b.bytes, B, a.bytes);
+        ge_tobytes(aGbB.bytes, &rv);
+    }
+
     //Does some precomputation to make addKeys3 more efficient
     // input B a curve point and output a ge_dsmp which has precomputation applied
     void precomp(ge_dsmp rv, const key & B) {
@@ -252,6 +304,14 @@ namespace rct {
         ge_tobytes(aAbB.bytes, &rv);
     }
 
+    //aAbB = a*A + b*B where a, b are scalars, A, B are curve points
+    //A and B must both be input after applying "precomp"
+    void addKeys3(key &aAbB, const key &a, const ge_dsmp A, const key &b, const ge_dsmp B) {
+        ge_p2 rv;
+        ge_double_scalarmult_precomp2_vartime(&rv, a.bytes, A, b.bytes, B);
+        ge_tobytes(aAbB.bytes, &rv);
+    }
+
 
     //subtract Keys (subtracts curve points)
     //AB = A - B where A, B are curve points
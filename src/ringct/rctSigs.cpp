@@ -28,7 +28,12 @@
 // STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
 // THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+#include <boost/thread/locks.hpp>
+#include <atomic>
+#include <exception>
+#include <memory>
 #include "misc_log_ex.h"
+#include "common/arena.h"
 #include "common/perf_timer.h"
 #include "common/task_region.h"
 #include "common/thread_group.h"
@@ -50,12 +55,242 @@ namespace rct {
 
       struct verRctMGSimpleWrapper_ {
         void operator()(const key &message, const mgSig &mg, const ctkeyV & pubs, const key & C, bool &result) const {
+          tools::arena_scope arena;
           result = verRctMGSimple(message, mg, pubs, C);
         }
       };
       constexpr const verRctMGSimpleWrapper_ verRctMGSimpleWrapper{};
+
+      //the temporaries of MG verification, from the current arena if any
+      typedef tools::arena_vector<key> arenaKeyV;
+      typedef matrix<key, tools::arena_allocator<key>> arenaKeyMatrix;
+
+      //MLSAG_Gen for any key matrix type, see there
+      template<typename Matrix>
+      mgSig MLSAG_Gen_(const key &message, const Matrix & pk, const keyV & xx, const unsigned int index, size_t dsRows) {
+          mgSig rv;
+          size_t cols = pk.size();
+          CHECK_AND_ASSERT_THROW_MES(cols >= 2, "Error! What is c if cols = 1!");
+          CHECK_AND_ASSERT_THROW_MES(index < cols, "Index out of range");
+          size_t rows = pk[0].size();
+          CHECK_AND_ASSERT_THROW_MES(rows >= 1, "Empty pk");
+          for (size_t i = 1; i < cols; ++i) {
+            CHECK_AND_ASSERT_THROW_MES(pk[i].size() == rows, "pk is not rectangular");
+          }
+          CHECK_AND_ASSERT_THROW_MES(xx.size() == rows, "Bad xx size");
+          CHECK_AND_ASSERT_THROW_MES(dsRows <= rows, "Bad dsRows size");
+
+          size_t i = 0, j = 0, ii = 0;
+          key c, c_old, L, R, Hi;
+          sc_0(c_old.bytes);
+          vector<geDsmp> Ip(dsRows);
+          rv.II = keyV(dsRows);
+          keyV alpha(rows);
+          keyV aG(rows);
+          rv.ss = keyM(cols, aG);
+          keyV aHP(dsRows);
+          keyV toHash(1 + 3 * dsRows + 2 * (rows - dsRows));
+          toHash[0] = message;
+          DP("here1");
+          for (i = 0; i < dsRows; i++) {
+              skpkGen(alpha[i], aG[i]); //need to save alphas for later..
+              Hi = hashToPoint(pk[index][i]);
+              aHP[i] = scalarmultKey(Hi, alpha[i]);
+              toHash[3 * i + 1] = pk[index][i];
+              toHash[3 * i + 2] = aG[i];
+              toHash[3 * i + 3] = aHP[i];
+              rv.II[i] = scalarmultKey(Hi, xx[i]);
+              precomp(Ip[i].k, rv.II[i]);
+          }
+          size_t ndsRows = 3 * dsRows; //non Double Spendable Rows (see identity chains paper)
+          for (i = dsRows, ii = 0 ; i < rows ; i++, ii++) {
+              skpkGen(alpha[i], aG[i]); //need to save alphas for later..
+              toHash[ndsRows + 2 * ii + 1] = pk[index][i];
+              toHash[ndsRows + 2 * ii + 2] = aG[i];
+          }
+
+          c_old = hash_to_scalar(toHash);
+
+          
+          i = (index + 1) % cols;
+          if (i == 0) {
+              copy(rv.cc, c_old);
+          }
+          while (i != index) {
+
+              for (j = 0; j < rows; j++) {
+                  skGen(rv.ss[i][j]);
+              }
+              sc_0(c.bytes);
+              for (j = 0; j < dsRows; j++) {
+                  addKeys2(L, rv.ss[i][j], c_old, pk[i][j]);
+                  hashToPoint(Hi, pk[i][j]);
+                  addKeys3(R, rv.ss[i][j], Hi, c_old, Ip[j].k);
+                  toHash[3 * j + 1] = pk[i][j];
+                  toHash[3 * j + 2] = L; 
+                  toHash[3 * j + 3] = R;
+              }
+              for (j = dsRows, ii = 0; j < rows; j++, ii++) {
+                  addKeys2(L, rv.ss[i][j], c_old, pk[i][j]);
+                  toHash[ndsRows + 2 * ii + 1] = pk[i][j];
+                  toHash[ndsRows + 2 * ii + 2] = L;
+              }
+              c = hash_to_scalar(toHash);
+              copy(c_old, c);
+              i = (i + 1) % cols;
+              
+              if (i == 0) { 
+                  copy(rv.cc, c_old);
+              }   
+          }
+          for (j = 0; j < rows; j++) {
+              sc_mulsub(rv.ss[index][j].bytes, c.bytes, xx[j].bytes, alpha[j].bytes);
+          }        
+          return rv;
+      }
+
+      //MLSAG_Ver for any key matrix type, see there
+      template<typename Matrix>
+      bool MLSAG_Ver_(const key &message, const Matrix & pk, const mgSig & rv, size_t dsRows) {
+
+          size_t cols = pk.size();
+          CHECK_AND_ASSERT_MES(cols >= 2, false, "Error! What is c if cols = 1!");
+          size_t rows = pk[0].size();
+          CHECK_AND_ASSERT_MES(rows >= 1, false, "Empty pk");
+          for (size_t i = 1; i < cols; ++i) {
+            CHECK_AND_ASSERT_MES(pk[i].size() == rows, false, "pk is not rectangular");
+          }
+          CHECK_AND_ASSERT_MES(rv.II.size() == dsRows, false, "Bad II size");
+          CHECK_AND_ASSERT_MES(rv.ss.size() == cols, false, "Bad rv.ss size");
+          for (size_t i = 0; i < cols; ++i) {
+            CHECK_AND_ASSERT_MES(rv.ss[i].size() == rows, false, "rv.ss is not rectangular");
+          }
+          CHECK_AND_ASSERT_MES(dsRows <= rows, false, "Bad dsRows value");
+
+          for (size_t i = 0; i < rv.ss.size(); ++i)
+            for (size_t j = 0; j < rv.ss[i].size(); ++j)
+              CHECK_AND_ASSERT_MES(sc_check(rv.ss[i][j].bytes) == 0, false, "Bad ss slot");
+          CHECK_AND_ASSERT_MES(sc_check(rv.cc.bytes) == 0, false, "Bad cc");
+
+          size_t i = 0, j = 0, ii = 0;
+          key c,  L, R;
+          ge_dsmp Pi, Hi;
+          key c_old = copy(rv.cc);
+          tools::arena_vector<geDsmp> Ip(dsRows);
+          for (i = 0 ; i < dsRows ; i++) {
+              precomp(Ip[i].k, rv.II[i]);
+          }
+          size_t ndsRows = 3 * dsRows; //non Double Spendable Rows (see identity chains paper
+          arenaKeyV toHash(1 + 3 * dsRows + 2 * (rows - dsRows));
+          toHash[0] = message;
+          i = 0;
+          while (i < cols) {
+              sc_0(c.bytes);
+              for (j = 0; j < dsRows; j++) {
+                  CHECK_AND_ASSERT_THROW_MES(ring_member_precomp(rct2pk(pk[i][j]), Pi, Hi), "ge_frombytes_vartime failed at "+boost::lexical_cast<std::string>(__LINE__));
+                  addKeys2(L, rv.ss[i][j], c_old, Pi);
+                  addKeys3(R, rv.ss[i][j], Hi, c_old, Ip[j].k);
+                  toHash[3 * j + 1] = pk[i][j];
+                  toHash[3 * j + 2] = L; 
+                  toHash[3 * j + 3] = R;
+              }
+              for (j = dsRows, ii = 0 ; j < rows ; j++, ii++) {
+                  addKeys2(L, rv.ss[i][j], c_old, pk[i][j]);
+                  toHash[ndsRows + 2 * ii + 1] = pk[i][j];
+                  toHash[ndsRows + 2 * ii + 2] = L;
+              }
+              hash_to_scalar(c, toHash.data(), toHash.size() * sizeof(key));
+              copy(c_old, c);
+              i = (i + 1);
+          }
+          sc_sub(c.bytes, c_old.bytes, rv.cc.bytes);
+          return sc_isnonzero(c.bytes) == 0;  
+      }
+
+      //queues the range proofs of rv on region as "batches" verRangeBatch
+      //calls, results[b] receives the outcomes for the outputs of batch b
+      void runRangeBatches(tools::task_region_handle &region, size_t batches, const rctSig &rv, std::vector<std::vector<bool>> &results) {
+        const size_t outputs = rv.outPk.size();
+        batches = std::min(outputs, batches);
+        results.clear();
+        results.resize(batches);
+        for (size_t b = 0; b < batches; ++b) {
+          region.run([&, b, batches] {
+            const size_t start = outputs * b / batches, end = outputs * (b + 1) / batches;
+            keyV C;
+            std::vector<const rangeSig*> as;
+            for (size_t i = start; i < end; ++i) {
+              C.push_back(rv.outPk[i].mask);
+              as.push_back(&rv.p.rangeSigs[i]);
+            }
+            verRangeBatch(C, as, &results[b]);
+          });
+        }
+      }
+
+      //returns the index of the first output whose range proof failed, or
+      //the number of outputs if all passed
+      size_t firstBadRange(const std::vector<std::vector<bool>> &results) {
+        size_t i = 0;
+        for (const auto &batch: results) {
+          for (bool ok: batch) {
+            if (!ok)
+              return i;
+            ++i;
+          }
+        }
+        return i;
+      }
+
+      //calls f(i) for each i < n, on threads and the calling thread if
+      //threads is given, and rethrows the first exception once all are done
+      template<typename F>
+      void runEach(tools::thread_group *threads, size_t n, const F &f) {
+        if (!threads || n < 2) {
+          for (size_t i = 0; i < n; ++i)
+            f(i);
+          return;
+        }
+        std::vector<std::exception_ptr> errors(n);
+        std::atomic<size_t> next(0);
+        const size_t workers = std::min(n, threads->count() + 1);
+        tools::task_region(*threads, [&] (tools::task_region_handle& region) {
+          for (size_t w = 0; w < workers; ++w) {
+            region.run([&] {
+              for (size_t i = next++; i < n; i = next++) {
+                // an exception leaving a dispatched task would terminate the process
+                try { f(i); }
+                catch (...) { errors[i] = std::current_exception(); }
+              }
+            });
+          }
+        });
+        for (const std::exception_ptr &e: errors)
+          if (e)
+            std::rethrow_exception(e);
+      }
+
+      boost::mutex threadpool_lock;
+      size_t threadpool_max_threads = 0;
+      std::shared_ptr<tools::thread_group> threadpool;
+
+      std::shared_ptr<tools::thread_group> get_threadpool() {
+        boost::lock_guard<boost::mutex> lock(threadpool_lock);
+        if (!threadpool) {
+          const size_t threads = threadpool_max_threads ? threadpool_max_threads - 1 : tools::thread_group::optimal();
+          threadpool = std::make_shared<tools::thread_group>(threads);
+        }
+        return threadpool;
+      }
     }
-    
+
+    void set_verification_threads(size_t threads) {
+      boost::lock_guard<boost::mutex> lock(threadpool_lock);
+      threadpool_max_threads = threads;
+      // verifications already running keep the old pool alive until done
+      threadpool.reset();
+    }
+
     //Borromean (c.f. gmax/andytoshi's paper)
     boroSig genBorromean(const key64 x, const key64 P1, const key64 P2, const bits indices) {
         key64 L[2], alpha;
@@ -127,83 +362,11 @@ namespace rct {
     //   the signer knows a secret key for each row in that column
     // Ver verifies that the MG sig was created correctly        
     mgSig MLSAG_Gen(const key &message, const keyM & pk, const keyV & xx, const unsigned int index, size_t dsRows) {
-        mgSig rv;
-        size_t cols = pk.size();
-        CHECK_AND_ASSERT_THROW_MES(cols >= 2, "Error! What is c if cols = 1!");
-        CHECK_AND_ASSERT_THROW_MES(index < cols, "Index out of range");
-        size_t rows = pk[0].size();
-        CHECK_AND_ASSERT_THROW_MES(rows >= 1, "Empty pk");
-        for (size_t i = 1; i < cols; ++i) {
-          CHECK_AND_ASSERT_THROW_MES(pk[i].size() == rows, "pk is not rectangular");
-        }
-        CHECK_AND_ASSERT_THROW_MES(xx.size() == rows, "Bad xx size");
-        CHECK_AND_ASSERT_THROW_MES(dsRows <= rows, "Bad dsRows size");
-
-        size_t i = 0, j = 0, ii = 0;
-        key c, c_old, L, R, Hi;
-        sc_0(c_old.bytes);
-        vector<geDsmp> Ip(dsRows);
-        rv.II = keyV(dsRows);
-        keyV alpha(rows);
-        keyV aG(rows);
-        rv.ss = keyM(cols, aG);
-        keyV aHP(dsRows);
-        keyV toHash(1 + 3 * dsRows + 2 * (rows - dsRows));
-        toHash[0] = message;
-        DP("here1");
-        for (i = 0; i < dsRows; i++) {
-            skpkGen(alpha[i], aG[i]); //need to save alphas for later..
-            Hi = hashToPoint(pk[index][i]);
-            aHP[i] = scalarmultKey(Hi, alpha[i]);
-            toHash[3 * i + 1] = pk[index][i];
-            toHash[3 * i + 2] = aG[i];
-            toHash[3 * i + 3] = aHP[i];
-            rv.II[i] = scalarmultKey(Hi, xx[i]);
-            precomp(Ip[i].k, rv.II[i]);
-        }
-        size_t ndsRows = 3 * dsRows; //non Double Spendable Rows (see identity chains paper)
-        for (i = dsRows, ii = 0 ; i < rows ; i++, ii++) {
-            skpkGen(alpha[i], aG[i]); //need to save alphas for later..
-            toHash[ndsRows + 2 * ii + 1] = pk[index][i];
-            toHash[ndsRows + 2 * ii + 2] = aG[i];
-        }
-
-        c_old = hash_to_scalar(toHash);
+        return MLSAG_Gen_(message, pk, xx, index, dsRows);
+    }
 
-        
-        i = (index + 1) % cols;
-        if (i == 0) {
-            copy(rv.cc, c_old);
-        }
-        while (i != index) {
-
-            rv.ss[i] = skvGen(rows);            
-            sc_0(c.bytes);
-            for (j = 0; j < dsRows; j++) {
-                addKeys2(L, rv.ss[i][j], c_old, pk[i][j]);
-                hashToPoint(Hi, pk[i][j]);
-                addKeys3(R, rv.ss[i][j], Hi, c_old, Ip[j].k);
-                toHash[3 * j + 1] = pk[i][j];
-                toHash[3 * j + 2] = L; 
-                toHash[3 * j + 3] = R;
-            }
-            for (j = dsRows, ii = 0; j < rows; j++, ii++) {
-                addKeys2(L, rv.ss[i][j], c_old, pk[i][j]);
-                toHash[ndsRows + 2 * ii + 1] = pk[i][j];
-                toHash[ndsRows + 2 * ii + 2] = L;
-            }
-            c = hash_to_scalar(toHash);
-            copy(c_old, c);
-            i = (i + 1) % cols;
-            
-            if (i == 0) { 
-                copy(rv.cc, c_old);
-            }   
-        }
-        for (j = 0; j < rows; j++) {
-            sc_mulsub(rv.ss[index][j].bytes, c.bytes, xx[j].bytes, alpha[j].bytes);
-        }        
-        return rv;
+    mgSig MLSAG_Gen(const key &message, const keyMatrix & pk, const keyV & xx, const unsigned int index, size_t dsRows) {
+        return MLSAG_Gen_(message, pk, xx, index, dsRows);
     }
     
     //Multilayered Spontaneous Anonymous Group Signatures (MLSAG signatures)
@@ -216,58 +379,11 @@ namespace rct {
     //   the signer knows a secret key for each row in that column
     // Ver verifies that the MG sig was created correctly            
     bool MLSAG_Ver(const key &message, const keyM & pk, const mgSig & rv, size_t dsRows) {
+        return MLSAG_Ver_(message, pk, rv, dsRows);
+    }
 
-        size_t cols = pk.size();
-        CHECK_AND_ASSERT_MES(cols >= 2, false, "Error! What is c if cols = 1!");
-        size_t rows = pk[0].size();
-        CHECK_AND_ASSERT_MES(rows >= 1, false, "Empty pk");
-        for (size_t i = 1; i < cols; ++i) {
-          CHECK_AND_ASSERT_MES(pk[i].size() == rows, false, "pk is not rectangular");
-        }
-        CHECK_AND_ASSERT_MES(rv.II.size() == dsRows, false, "Bad II size");
-        CHECK_AND_ASSERT_MES(rv.ss.size() == cols, false, "Bad rv.ss size");
-        for (size_t i = 0; i < cols; ++i) {
-          CHECK_AND_ASSERT_MES(rv.ss[i].size() == rows, false, "rv.ss is not rectangular");
-        }
-        CHECK_AND_ASSERT_MES(dsRows <= rows, false, "Bad dsRows value");
-
-        for (size_t i = 0; i < rv.ss.size(); ++i)
-          for (size_t j = 0; j < rv.ss[i].size(); ++j)
-            CHECK_AND_ASSERT_MES(sc_check(rv.ss[i][j].bytes) == 0, false, "Bad ss slot");
-        CHECK_AND_ASSERT_MES(sc_check(rv.cc.bytes) == 0, false, "Bad cc");
-
-        size_t i = 0, j = 0, ii = 0;
-        key c,  L, R, Hi;
-        key c_old = copy(rv.cc);
-        vector<geDsmp> Ip(dsRows);
-        for (i = 0 ; i < dsRows ; i++) {
-            precomp(Ip[i].k, rv.II[i]);
-        }
-        size_t ndsRows = 3 * dsRows; //non Double Spendable Rows (see identity chains paper
-        keyV toHash(1 + 3 * dsRows + 2 * (rows - dsRows));
-        toHash[0] = message;
-        i = 0;
-        while (i < cols) {
-            sc_0(c.bytes);
-            for (j = 0; j < dsRows; j++) {
-                addKeys2(L, rv.ss[i][j], c_old, pk[i][j]);
-                hashToPoint(Hi, pk[i][j]);
-                addKeys3(R, rv.ss[i][j], Hi, c_old, Ip[j].k);
-                toHash[3 * j + 1] = pk[i][j];
-                toHash[3 * j + 2] = L; 
-                toHash[3 * j + 3] = R;
-            }
-            for (j = dsRows, ii = 0 ; j < rows ; j++, ii++) {
-                addKeys2(L, rv.ss[i][j], c_old, pk[i][j]);
-                toHash[ndsRows + 2 * ii + 1] = pk[i][j];
-                toHash[ndsRows + 2 * ii + 2] = L;
-            }
-            c = hash_to_scalar(toHash);
-            copy(c_old, c);
-            i = (i + 1);
-        }
-        sc_sub(c.bytes, c_old.bytes, rv.cc.bytes);
-        return sc_isnonzero(c.bytes) == 0;  
+    bool MLSAG_Ver(const key &message, const keyMatrix & pk, const mgSig & rv, size_t dsRows) {
+        return MLSAG_Ver_(message, pk, rv, dsRows);
     }
     
 
@@ -288,15 +404,23 @@ namespace rct {
         key64 ai;
         key64 CiH;
         int i = 0;
+        ge_p3 aiG, tmp3;
+        ge_p1p1 tmp;
         for (i = 0; i < ATOMS; i++) {
             skGen(ai[i]);
+            ge_scalarmult_base(&aiG, ai[i].bytes);
             if (b[i] == 0) {
-                scalarmultBase(sig.Ci[i], ai[i]);
+                ge_p3_tobytes(sig.Ci[i].bytes, &aiG);
+                ge_sub(&tmp, &aiG, &cachedH2(i));
+                ge_p1p1_to_p3(&tmp3, &tmp);
+                ge_p3_tobytes(CiH[i].bytes, &tmp3);
             }
             if (b[i] == 1) {
-                addKeys1(sig.Ci[i], ai[i], H2[i]);
+                ge_add(&tmp, &aiG, &cachedH2(i));
+                ge_p1p1_to_p3(&tmp3, &tmp);
+                ge_p3_tobytes(sig.Ci[i].bytes, &tmp3);
+                ge_p3_tobytes(CiH[i].bytes, &aiG);
             }
-            subKeys(CiH[i], sig.Ci[i], H2[i]);
             sc_add(mask.bytes, mask.bytes, ai[i].bytes);
             addKeys(C, C, sig.Ci[i]);
         }
@@ -318,8 +442,13 @@ namespace rct {
         key64 CiH;
         int i = 0;
         key Ctmp = identity();
+        ge_p3 Ci, CiHp;
+        ge_p1p1 tmp;
         for (i = 0; i < 64; i++) {
-            subKeys(CiH[i], as.Ci[i], H2[i]);
+            CHECK_AND_ASSERT_THROW_MES(ge_frombytes_vartime(&Ci, as.Ci[i].bytes) == 0, "ge_frombytes_vartime failed on Ci");
+            ge_sub(&tmp, &Ci, &cachedH2(i));
+            ge_p1p1_to_p3(&CiHp, &tmp);
+            ge_p3_tobytes(CiH[i].bytes, &CiHp);
             addKeys(Ctmp, Ctmp, as.Ci[i]);
         }
         if (!equalKeys(C, Ctmp))
@@ -332,6 +461,81 @@ namespace rct {
       catch (...) { return false; }
     }
 
+    //verRangeBatch
+    //checks several range proofs (C[k], as[k]) with the same equations as verRange,
+    //but each Ci is only decompressed once and the 64 * as.size() intermediate
+    //points of each Borromean round are converted to bytes with a single batch
+    //inversion. Borromean signatures hash every intermediate point, so the proofs
+    //cannot be folded into one multi-exponentiation; the shared work is what gets
+    //batched. If the batch fails, every proof is rechecked with verRange so the
+    //bad one(s) can be identified through results, if given.
+    bool verRangeBatch(const keyV & C, const std::vector<const rangeSig*> & as, std::vector<bool> *results) {
+      CHECK_AND_ASSERT_MES(C.size() == as.size(), false, "Mismatched sizes of C and as");
+      PERF_TIMER(verRangeBatch);
+      const size_t n = as.size();
+      bool ok = true;
+      try
+      {
+        std::vector<ge_p3> Ci(n * ATOMS), CiH(n * ATOMS);
+        std::vector<ge_p2> L(n * ATOMS);
+        keyV LL(n * ATOMS);
+        ge_p3 sum;
+        ge_cached cached;
+        ge_p1p1 tmp;
+        key Ctmp;
+        size_t k = 0, i = 0, j = 0;
+        for (k = 0; ok && k < n; k++) {
+          ge_frombytes_vartime(&sum, I.bytes);
+          for (i = 0; i < ATOMS; i++) {
+            j = k * ATOMS + i;
+            if (ge_frombytes_vartime(&Ci[j], as[k]->Ci[i].bytes) != 0) {
+              ok = false;
+              break;
+            }
+            ge_p3_to_cached(&cached, &Ci[j]);
+            ge_add(&tmp, &sum, &cached);
+            ge_p1p1_to_p3(&sum, &tmp);
+            ge_sub(&tmp, &Ci[j], &cachedH2(i));
+            ge_p1p1_to_p3(&CiH[j], &tmp);
+          }
+          if (ok) {
+            ge_p3_tobytes(Ctmp.bytes, &sum);
+            ok = equalKeys(C[k], Ctmp);
+          }
+        }
+        if (ok && n > 0) {
+          for (k = 0; k < n; k++) {
+            for (i = 0; i < ATOMS; i++) {
+              j = k * ATOMS + i;
+              ge_double_scalarmult_base_vartime(&L[j], as[k]->asig.ee.bytes, &Ci[j], as[k]->asig.s0[i].bytes);
+            }
+          }
+          ge_tobytes_batch(LL[0].bytes, L.data(), L.size());
+          for (k = 0; k < n; k++) {
+            for (i = 0; i < ATOMS; i++) {
+              j = k * ATOMS + i;
+              key chash = hash_to_scalar(LL[j]);
+              ge_double_scalarmult_base_vartime(&L[j], chash.bytes, &CiH[j], as[k]->asig.s1[i].bytes);
+            }
+          }
+          ge_tobytes_batch(LL[0].bytes, L.data(), L.size());
+          for (k = 0; ok && k < n; k++) {
+            key eeComputed = hash_to_scalar(&LL[k * ATOMS]);
+            ok = equalKeys(eeComputed, as[k]->asig.ee);
+          }
+        }
+      }
+      catch (...) { ok = false; }
+
+      if (results) {
+        results->resize(n);
+        for (size_t k = 0; k < n; k++) {
+          (*results)[k] = ok || verRange(C[k], *as[k]);
+        }
+      }
+      return ok;
+    }
+
     key get_pre_mlsag_hash(const rctSig &rv)
     {
       keyV hashes;
@@ -339,13 +543,14 @@ namespace rct {
       hashes.push_back(rv.message);
       crypto::hash h;
 
-      std::stringstream ss;
+      std::string blob;
+      binary_output_stream ss(blob);
       binary_archive<true> ba(ss);
       const size_t inputs = rv.pseudoOuts.size();
       const size_t outputs = rv.ecdhInfo.size();
       CHECK_AND_ASSERT_THROW_MES(const_cast<rctSig&>(rv).serialize_rctsig_base(ba, inputs, outputs),
           "Failed to serialize rctSigBase");
-      cryptonote::get_blob_hash(ss.str(), h);
+      cryptonote::get_blob_hash(blob, h);
       hashes.push_back(hash2rct(h));
 
       keyV kv;
@@ -386,16 +591,13 @@ namespace rct {
         CHECK_AND_ASSERT_THROW_MES(outSk.size() == outPk.size(), "Bad outSk/outPk size");
 
         keyV sk(rows + 1);
-        keyV tmp(rows + 1);
         size_t i = 0, j = 0;
         for (i = 0; i < rows + 1; i++) {
             sc_0(sk[i].bytes);
-            identity(tmp[i]);
         }
-        keyM M(cols, tmp);
+        keyMatrix M(cols, rows + 1, identity());
         //create the matrix to mg sig
         for (i = 0; i < cols; i++) {
-            M[i][rows] = identity();
             for (j = 0; j < rows; j++) {
                 M[i][j] = pubs[i][j].dest;
                 addKeys(M[i][rows], M[i][rows], pubs[i][j].mask); //add input commitments in last row
@@ -433,10 +635,9 @@ namespace rct {
         size_t rows = 1;
         size_t cols = pubs.size();
         CHECK_AND_ASSERT_THROW_MES(cols >= 1, "Empty pubs");
-        keyV tmp(rows + 1);
         keyV sk(rows + 1);
         size_t i;
-        keyM M(cols, tmp);
+        keyMatrix M(cols, rows + 1);
         for (i = 0; i < cols; i++) {
             M[i][0] = pubs[i].dest;
             subKeys(M[i][1], pubs[i].mask, Cout);
@@ -466,12 +667,8 @@ namespace rct {
           CHECK_AND_ASSERT_MES(pubs[i].size() == rows, false, "pubs is not rectangular");
         }
 
-        keyV tmp(rows + 1);
         size_t i = 0, j = 0;
-        for (i = 0; i < rows + 1; i++) {
-            identity(tmp[i]);
-        }
-        keyM M(cols, tmp);
+        arenaKeyMatrix M(cols, rows + 1, identity());
 
         //create the matrix to mg sig
         for (j = 0; j < rows; j++) {
@@ -487,7 +684,7 @@ namespace rct {
             //subtract txn fee output in last row
             subKeys(M[i][rows], M[i][rows], txnFeeKey);
         }
-        return MLSAG_Ver(message, M, mg, rows);
+        return MLSAG_Ver_(message, M, mg, rows);
     }
 
     //Ring-ct Simple MG sigs
@@ -502,16 +699,15 @@ namespace rct {
             size_t rows = 1;
             size_t cols = pubs.size();
             CHECK_AND_ASSERT_MES(cols >= 1, false, "Empty pubs");
-            keyV tmp(rows + 1);
             size_t i;
-            keyM M(cols, tmp);
+            arenaKeyMatrix M(cols, rows + 1);
             //create the matrix to mg sig
             for (i = 0; i < cols; i++) {
                     M[i][0] = pubs[i].dest;
                     subKeys(M[i][1], pubs[i].mask, C);
             }
             //DP(C);
-            return MLSAG_Ver(message, M, mg, rows);
+            return MLSAG_Ver_(message, M, mg, rows);
         }
         catch (...) { return false; }
     }
@@ -577,7 +773,7 @@ namespace rct {
     //   must know the destination private key to find the correct amount, else will return a random number
     //   Note: For txn fees, the last index in the amounts vector should contain that
     //   Thus the amounts vector will be "one" longer than the destinations vectort
-    rctSig genRct(const key &message, const ctkeyV & inSk, const keyV & destinations, const vector<xmr_amount> & amounts, const ctkeyM &mixRing, const keyV &amount_keys, unsigned int index, ctkeyV &outSk) {
+    rctSig genRct(const key &message, const ctkeyV & inSk, const keyV & destinations, const vector<xmr_amount> & amounts, const ctkeyM &mixRing, const keyV &amount_keys, unsigned int index, ctkeyV &outSk, tools::thread_group *threads) {
         CHECK_AND_ASSERT_THROW_MES(amounts.size() == destinations.size() || amounts.size() == destinations.size() + 1, "Different number of amounts/destinations");
         CHECK_AND_ASSERT_THROW_MES(amount_keys.size() == destinations.size(), "Different number of amount_keys/destinations");
         CHECK_AND_ASSERT_THROW_MES(index < mixRing.size(), "Bad index into mixRing");
@@ -595,11 +791,13 @@ namespace rct {
         size_t i = 0;
         keyV masks(destinations.size()); //sk mask..
         outSk.resize(destinations.size());
+        //compute range proofs
+        runEach(threads, destinations.size(), [&] (size_t i) {
+            rv.p.rangeSigs[i] = proveRange(rv.outPk[i].mask, outSk[i].mask, amounts[i]);
+        });
         for (i = 0; i < destinations.size(); i++) {
             //add destination to sig
             rv.outPk[i].dest = copy(destinations[i]);
-            //compute range proof
-            rv.p.rangeSigs[i] = proveRange(rv.outPk[i].mask, outSk[i].mask, amounts[i]);
             #ifdef DBG
                 CHECK_AND_ASSERT_THROW_MES(verRange(rv.outPk[i].mask, rv.p.rangeSigs[i]), "verRange failed on newly created proof");
             #endif
@@ -637,7 +835,7 @@ namespace rct {
     
     //RCT simple    
     //for post-rct only
-    rctSig genRctSimple(const key &message, const ctkeyV & inSk, const keyV & destinations, const vector<xmr_amount> &inamounts, const vector<xmr_amount> &outamounts, xmr_amount txnFee, const ctkeyM & mixRing, const keyV &amount_keys, const std::vector<unsigned int> & index, ctkeyV &outSk) {
+    rctSig genRctSimple(const key &message, const ctkeyV & inSk, const keyV & destinations, const vector<xmr_amount> &inamounts, const vector<xmr_amount> &outamounts, xmr_amount txnFee, const ctkeyM & mixRing, const keyV &amount_keys, const std::vector<unsigned int> & index, ctkeyV &outSk, tools::thread_group *threads) {
         CHECK_AND_ASSERT_THROW_MES(inamounts.size() > 0, "Empty inamounts");
         CHECK_AND_ASSERT_THROW_MES(inamounts.size() == inSk.size(), "Different number of inamounts/inSk");
         CHECK_AND_ASSERT_THROW_MES(outamounts.size() == destinations.size(), "Different number of amounts/destinations");
@@ -659,12 +857,14 @@ namespace rct {
         keyV masks(destinations.size()); //sk mask..
         outSk.resize(destinations.size());
         key sumout = zero();
+        //compute range proofs
+        runEach(threads, destinations.size(), [&] (size_t i) {
+            rv.p.rangeSigs[i] = proveRange(rv.outPk[i].mask, outSk[i].mask, outamounts[i]);
+        });
         for (i = 0; i < destinations.size(); i++) {
 
             //add destination to sig
             rv.outPk[i].dest = copy(destinations[i]);
-            //compute range proof
-            rv.p.rangeSigs[i] = proveRange(rv.outPk[i].mask, outSk[i].mask, outamounts[i]);
          #ifdef DBG
              verRange(rv.outPk[i].mask, rv.p.rangeSigs[i]);
          #endif
@@ -697,9 +897,9 @@ namespace rct {
         DP(rv.pseudoOuts[i]);
 
         key full_message = get_pre_mlsag_hash(rv);
-        for (i = 0 ; i < inamounts.size(); i++) {
+        runEach(threads, inamounts.size(), [&] (size_t i) {
             rv.p.MGs[i] = proveRctMGSimple(full_message, rv.mixRing[i], inSk[i], a[i], rv.pseudoOuts[i], index[i]);
-        }
+        });
         return rv;
     }
 
@@ -736,28 +936,30 @@ namespace rct {
         // some rct ops can throw
         try
         {
-          std::deque<bool> results(rv.outPk.size(), false);
-          tools::thread_group threadpool(tools::thread_group::optimal_with_max(rv.outPk.size()));
+          std::shared_ptr<tools::thread_group> threads = get_threadpool();
+          std::vector<std::vector<bool>> results;
+          bool mgVerd = false;
+
+          //compute txn fee
+          key txnFeeKey = scalarmultH(d2h(rv.txnFee));
+          key message = get_pre_mlsag_hash(rv);
 
-          tools::task_region(threadpool, [&] (tools::task_region_handle& region) {
+          tools::task_region(*threads, [&] (tools::task_region_handle& region) {
             DP("range proofs verified?");
-            for (size_t i = 0; i < rv.outPk.size(); i++) {
-              region.run([&, i] {
-                results[i] = verRange(rv.outPk[i].mask, rv.p.rangeSigs[i]);
-              });
-            }
+            runRangeBatches(region, threads->count() + 1, rv, results);
+            region.run([&] {
+              // an exception leaving a dispatched task would terminate the process
+              try { mgVerd = verRctMG(rv.p.MGs[0], rv.mixRing, rv.outPk, txnFeeKey, message); }
+              catch (...) { mgVerd = false; }
+            });
           });
 
-          for (size_t i = 0; i < rv.outPk.size(); ++i) {
-            if (!results[i]) {
-              LOG_PRINT_L1("Range proof verified failed for output " << i);
-              return false;
-            }
+          const size_t bad = firstBadRange(results);
+          if (bad != rv.outPk.size()) {
+            LOG_PRINT_L1("Range proof verified failed for output " << bad);
+            return false;
           }
 
-          //compute txn fee
-          key txnFeeKey = scalarmultH(d2h(rv.txnFee));
-          bool mgVerd = verRctMG(rv.p.MGs[0], rv.mixRing, rv.outPk, txnFeeKey, get_pre_mlsag_hash(rv));
           DP("mg sig verified?");
           DP(mgVerd);
           if (!mgVerd) {
@@ -786,27 +988,9 @@ namespace rct {
         CHECK_AND_ASSERT_MES(rv.pseudoOuts.size() == rv.p.MGs.size(), false, "Mismatched sizes of rv.pseudoOuts and rv.p.MGs");
         CHECK_AND_ASSERT_MES(rv.pseudoOuts.size() == rv.mixRing.size(), false, "Mismatched sizes of rv.pseudoOuts and mixRing");
 
-        const size_t threads = std::max(rv.outPk.size(), rv.mixRing.size());
-
-        std::deque<bool> results(threads);
-        tools::thread_group threadpool(tools::thread_group::optimal_with_max(threads));
-
-        results.clear();
-        results.resize(rv.outPk.size());
-        tools::task_region(threadpool, [&] (tools::task_region_handle& region) {
-          for (size_t i = 0; i < rv.outPk.size(); i++) {
-            region.run([&, i] {
-                results[i] = verRange(rv.outPk[i].mask, rv.p.rangeSigs[i]);
-            });
-          }
-        });
-
-        for (size_t i = 0; i < results.size(); ++i) {
-          if (!results[i]) {
-            LOG_PRINT_L1("Range proof verified failed for output " << i);
-            return false;
-          }
-        }
+        std::shared_ptr<tools::thread_group> threads = get_threadpool();
+        std::vector<std::vector<bool>> range_results;
+        std::deque<bool> results(rv.mixRing.size(), false);
 
         key sumOutpks = identity();
         for (size_t i = 0; i < rv.outPk.size(); i++) {
@@ -818,9 +1002,9 @@ namespace rct {
 
         key message = get_pre_mlsag_hash(rv);
 
-        results.clear();
-        results.resize(rv.mixRing.size());
-        tools::task_region(threadpool, [&] (tools::task_region_handle& region) {
+        //range proofs and per input MLSAGs are independent, check them all at once
+        tools::task_region(*threads, [&] (tools::task_region_handle& region) {
+          runRangeBatches(region, threads->count() + 1, rv, range_results);
           for (size_t i = 0 ; i < rv.mixRing.size() ; i++) {
             region.run([&, i] {
               results[i] = verRctMGSimple(message, rv.p.MGs[i], rv.mixRing[i], rv.pseudoOuts[i]);
@@ -828,6 +1012,12 @@ namespace rct {
           }
         });
 
+        const size_t bad = firstBadRange(range_results);
+        if (bad != rv.outPk.size()) {
+          LOG_PRINT_L1("Range proof verified failed for output " << bad);
+          return false;
+        }
+
         for (size_t i = 0; i < results.size(); ++i) {
           if (!results[i]) {
             LOG_PRINT_L1("verRctMGSimple failed for input " << i);
@@ -64,6 +64,10 @@ extern "C" {
 using namespace std;
 using namespace crypto;
 
+namespace tools {
+    class thread_group;
+}
+
 namespace rct {
 
     boroSig genBorromean(const key64 x, const key64 P1, const key64 P2, const bits indices);
@@ -78,7 +82,9 @@ namespace rct {
     // Ver verifies that the MG sig was created correctly
     keyV keyImageV(const keyV &xx);
     mgSig MLSAG_Gen(const key &message, const keyM & pk, const keyV & xx, const unsigned int index, size_t dsRows);
+    mgSig MLSAG_Gen(const key &message, const keyMatrix & pk, const keyV & xx, const unsigned int index, size_t dsRows);
     bool MLSAG_Ver(const key &message, const keyM &pk, const mgSig &sig, size_t dsRows);
+    bool MLSAG_Ver(const key &message, const keyMatrix &pk, const mgSig &sig, size_t dsRows);
     //mgSig MLSAG_Gen_Old(const keyM & pk, const keyV & xx, const int index);
 
     //proveRange and verRange
@@ -90,6 +96,10 @@ namespace rct {
     //verRange verifies that \sum Ci = C and that each Ci is a commitment to 0 or 2^i
     rangeSig proveRange(key & C, key & mask, const xmr_amount & amount);
     bool verRange(const key & C, const rangeSig & as);
+    //verRangeBatch checks as[k] against C[k] for all k at once, sharing the
+    //point decompressions and field inversions between proofs. When the batch
+    //fails, results (if not NULL) tells which proofs are bad.
+    bool verRangeBatch(const keyV & C, const std::vector<const rangeSig*> & as, std::vector<bool> *results = NULL);
 
     //Ring-ct MG sigs
     //Prove:
@@ -122,10 +132,18 @@ namespace rct {
     //decodeRct: (c.f. http://eprint.iacr.org/2015/1098 section 5.1.1)
     //   uses the attached ecdh info to find the amounts represented by each output commitment
     //   must know the destination private key to find the correct amount, else will return a random number
-    rctSig genRct(const key &message, const ctkeyV & inSk, const keyV & destinations, const vector<xmr_amount> & amounts, const ctkeyM &mixRing, const keyV &amount_keys, unsigned int index, ctkeyV &outSk);
+    //genRct and genRctSimple make the range proofs (and the MG sigs of
+    //genRctSimple) on threads and the calling thread if threads is given,
+    //one after another if it is null
+    rctSig genRct(const key &message, const ctkeyV & inSk, const keyV & destinations, const vector<xmr_amount> & amounts, const ctkeyM &mixRing, const keyV &amount_keys, unsigned int index, ctkeyV &outSk, tools::thread_group *threads = NULL);
     rctSig genRct(const key &message, const ctkeyV & inSk, const ctkeyV  & inPk, const keyV & destinations, const vector<xmr_amount> & amounts, const keyV &amount_keys, const int mixin);
     rctSig genRctSimple(const key & message, const ctkeyV & inSk, const ctkeyV & inPk, const keyV & destinations, const vector<xmr_amount> & inamounts, const vector<xmr_amount> & outamounts, const keyV &amount_keys, xmr_amount txnFee, unsigned int mixin);
-    rctSig genRctSimple(const key & message, const ctkeyV & inSk, const keyV & destinations, const vector<xmr_amount> & inamounts, const vector<xmr_amount> & outamounts, xmr_amount txnFee, const ctkeyM & mixRing, const keyV &amount_keys, const std::vector<unsigned int> & index, ctkeyV &outSk);
+    rctSig genRctSimple(const key & message, const ctkeyV & inSk, const keyV & destinations, const vector<xmr_amount> & inamounts, const vector<xmr_amount> & outamounts, xmr_amount txnFee, const ctkeyM & mixRing, const keyV &amount_keys, const std::vector<unsigned int> & index, ctkeyV &outSk, tools::thread_group *threads = NULL);
+    //verRct and verRctSimple check range proofs and MG signatures on a
+    //thread pool shared by the whole process. set_verification_threads
+    //caps the number of threads used (the calling thread included),
+    //0 uses tools::thread_group::optimal() workers.
+    void set_verification_threads(size_t threads);
     bool verRct(const rctSig & rv);
     bool verRctSimple(const rctSig & rv);
     xmr_amount decodeRct(const rctSig & rv, const key & sk, unsigned int i, key & mask);
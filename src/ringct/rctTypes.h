@@ -33,6 +33,7 @@
 #define RCT_TYPES_H
 
 #include <cstddef>
+#include <memory>
 #include <mutex>
 #include <vector>
 #include <tuple>
@@ -46,6 +47,7 @@ extern "C" {
 #include "crypto/keccak.h"
 }
 #include "crypto/crypto.h"
+#include "misc_log_ex.h"
 
 #include "serialization/serialization.h"
 #include "serialization/debug_archive.h"
@@ -102,6 +104,67 @@ namespace rct {
     typedef vector<ctkey> ctkeyV;
     typedef vector<ctkeyV> ctkeyM;
 
+    //a cols x rows matrix in one contiguous block, column by column, so
+    //M[i][j] is row j of column i as with keyM. keyM and ctkeyM remain the
+    //types of signatures and of the rctSig API, matrix converts to and from
+    //them (which must then be rectangular)
+    template<typename T, typename Alloc = std::allocator<T>>
+    class matrix {
+    public:
+        //a column (stride 1) or a row (stride rows) of a matrix
+        template<typename U>
+        class view {
+        public:
+            view(U *data, size_t size, size_t stride): m_data(data), m_size(size), m_stride(stride) {}
+            size_t size() const { return m_size; }
+            U &operator[](size_t i) const { return m_data[i * m_stride]; }
+        private:
+            U *m_data;
+            size_t m_size;
+            size_t m_stride;
+        };
+
+        explicit matrix(const Alloc &alloc = Alloc()): m_cols(0), m_rows(0), m_data(alloc) {}
+        matrix(size_t cols, size_t rows, const T &value = T(), const Alloc &alloc = Alloc()):
+            m_cols(cols), m_rows(rows), m_data(cols * rows, value, alloc) {}
+        template<typename A>
+        explicit matrix(const vector<vector<T, A>> &m, const Alloc &alloc = Alloc()): m_cols(m.size()), m_rows(m.empty() ? 0 : m[0].size()), m_data(alloc) {
+            m_data.reserve(m_cols * m_rows);
+            for (const auto &col: m) {
+                CHECK_AND_ASSERT_THROW_MES(col.size() == m_rows, "matrix is not rectangular");
+                m_data.insert(m_data.end(), col.begin(), col.end());
+            }
+        }
+
+        //number of columns, as with keyM
+        size_t size() const { return m_cols; }
+        size_t cols() const { return m_cols; }
+        size_t rows() const { return m_rows; }
+
+        view<T> operator[](size_t col) { return view<T>(m_data.data() + col * m_rows, m_rows, 1); }
+        view<const T> operator[](size_t col) const { return view<const T>(m_data.data() + col * m_rows, m_rows, 1); }
+        view<T> row(size_t row) { return view<T>(m_data.data() + row, m_cols, m_rows); }
+        view<const T> row(size_t row) const { return view<const T>(m_data.data() + row, m_cols, m_rows); }
+
+        T *data() { return m_data.data(); }
+        const T *data() const { return m_data.data(); }
+
+        vector<vector<T>> to_vector() const {
+            vector<vector<T>> m;
+            m.reserve(m_cols);
+            for (size_t i = 0; i < m_cols; ++i)
+                m.emplace_back(m_data.begin() + i * m_rows, m_data.begin() + (i + 1) * m_rows);
+            return m;
+        }
+
+    private:
+        size_t m_cols;
+        size_t m_rows;
+        vector<T, Alloc> m_data;
+    };
+    typedef matrix<key> keyMatrix;
+    typedef matrix<ctkey> ctkeyMatrix;
+
     //data for passing the amount to the receiver secretly
     // If the pedersen commitment to an amount is C = aG + bH,
     // "mask" contains a 32 byte key a
@@ -34,18 +34,121 @@ using namespace epee;
 
 #include "core_rpc_server.h"
 #include "common/command_line.h"
+#include "common/perf_timer.h"
+#include "common/memory_usage.h"
 #include "cryptonote_core/cryptonote_format_utils.h"
 #include "cryptonote_core/account.h"
 #include "cryptonote_core/cryptonote_basic_impl.h"
 #include "misc_language.h"
 #include "crypto/hash.h"
 #include "core_rpc_server_error_codes.h"
+#include "storages/http_abstract_invoke.h"
+#include "p2p/data_logger.hpp"
 
 #define MAX_RESTRICTED_FAKE_OUTS_COUNT 40
 #define MAX_RESTRICTED_GLOBAL_FAKE_OUTS_COUNT 500
+#define MAX_RESTRICTED_BLOCK_HEADERS_COUNT 1000
+
+#define GET_BLOCKS_FAST_CACHE_SIZE 4
+
+// longest a getblocktemplate long poll waits for a new template
+#define BLOCK_TEMPLATE_LONG_POLL_SECONDS 30
+
+// longest a get_events long poll waits for an event, and how many may wait at once
+#define EVENTS_LONG_POLL_SECONDS 30
+#define EVENTS_LONG_POLL_THREADS 2
+
+// longest a bulk call waits for a free bulk thread before it is answered BUSY
+#define RPC_BULK_WAIT_MS 5000
+
+// bytes charged to a client's budget for any call, on top of its answer
+#define RPC_CLIENT_CALL_COST 1024
+
+// blocks at least this deep are taken not to be reorganized away, so answers
+// about them can be cached until a block gets popped
+#define RPC_RESPONSE_CACHE_MIN_DEPTH CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE
+
+// connections to, and longest wait for, the daemon whose database is followed
+#define DB_FOLLOW_RPC_CLIENTS 4
+#define DB_FOLLOW_RPC_TIMEOUT_MS 60000
 
 namespace cryptonote
 {
+  namespace
+  {
+    // fills the failure flags of a sendrawtransaction style result
+    template<typename t_result>
+    void set_tx_verification_failure(const tx_verification_context& tvc, t_result& res)
+    {
+      res.status = "Failed";
+      if ((res.low_mixin = tvc.m_low_mixin))
+        res.reason = "mixin too low";
+      if ((res.double_spend = tvc.m_double_spend))
+        res.reason = "double spend";
+      if ((res.invalid_input = tvc.m_invalid_input))
+        res.reason = "invalid input";
+      if ((res.invalid_output = tvc.m_invalid_output))
+        res.reason = "invalid output";
+      if ((res.too_big = tvc.m_too_big))
+        res.reason = "too big";
+      if ((res.overspend = tvc.m_overspend))
+        res.reason = "overspend";
+      if ((res.fee_too_low = tvc.m_fee_too_low))
+        res.reason = "fee too low";
+      if ((res.not_rct = tvc.m_not_rct))
+        res.reason = "tx is not ringct";
+    }
+
+    // passes a call on to another daemon, answering BUSY if it can't be reached
+    template<typename t_request, typename t_response>
+    bool forward_json(tools::http_client_pool& clients, const std::string& url, t_request req, t_response& res)
+    {
+      tools::http_client_pool::lease daemon(clients);
+      if (!epee::net_utils::invoke_http_json_remote_command2(url, req, res, daemon.get(), DB_FOLLOW_RPC_TIMEOUT_MS))
+      {
+        LOG_PRINT_L1("Failed to forward RPC call to " << url);
+        res.status = CORE_RPC_STATUS_BUSY;
+      }
+      return true;
+    }
+
+    template<typename t_request, typename t_response>
+    bool forward_bin(tools::http_client_pool& clients, const std::string& url, t_request req, t_response& res)
+    {
+      tools::http_client_pool::lease daemon(clients);
+      if (!epee::net_utils::invoke_http_bin_remote_command2(url, req, res, daemon.get(), DB_FOLLOW_RPC_TIMEOUT_MS))
+      {
+        LOG_PRINT_L1("Failed to forward RPC call to " << url);
+        res.status = CORE_RPC_STATUS_BUSY;
+      }
+      return true;
+    }
+
+    const char *get_levin_command_name(int command)
+    {
+      switch (command)
+      {
+        case P2P_COMMANDS_POOL_BASE + 1: return "handshake";
+        case P2P_COMMANDS_POOL_BASE + 2: return "timed_sync";
+        case nodetool::COMMAND_PING::ID: return "ping";
+        case P2P_COMMANDS_POOL_BASE + 4: return "request_stat_info";
+        case nodetool::COMMAND_REQUEST_NETWORK_STATE::ID: return "request_network_state";
+        case nodetool::COMMAND_REQUEST_PEER_ID::ID: return "request_peer_id";
+        case nodetool::COMMAND_REQUEST_SUPPORT_FLAGS::ID: return "request_support_flags";
+        case NOTIFY_NEW_BLOCK::ID: return "new_block";
+        case NOTIFY_NEW_TRANSACTIONS::ID: return "new_transactions";
+        case NOTIFY_REQUEST_GET_OBJECTS::ID: return "request_get_objects";
+        case NOTIFY_RESPONSE_GET_OBJECTS::ID: return "response_get_objects";
+        case NOTIFY_REQUEST_CHAIN::ID: return "request_chain";
+        case NOTIFY_RESPONSE_CHAIN_ENTRY::ID: return "response_chain_entry";
+        case NOTIFY_NEW_FLUFFY_BLOCK::ID: return "new_fluffy_block";
+        case NOTIFY_REQUEST_FLUFFY_MISSING_TX::ID: return "request_fluffy_missing_tx";
+        case NOTIFY_NEW_COMPACT_BLOCK::ID: return "new_compact_block";
+        case NOTIFY_COMPRESSED::ID: return "compressed";
+        default: return "unknown";
+      }
+    }
+  }
 
   //-----------------------------------------------------------------------------------
   void core_rpc_server::init_options(boost::program_options::options_description& desc)
@@ -55,6 +158,15 @@ namespace cryptonote
     command_line::add_arg(desc, arg_testnet_rpc_bind_port);
     command_line::add_arg(desc, arg_restricted_rpc);
     command_line::add_arg(desc, arg_user_agent);
+    command_line::add_arg(desc, arg_rpc_fast_threads);
+    command_line::add_arg(desc, arg_rpc_bulk_threads);
+    command_line::add_arg(desc, arg_rpc_bulk_queue);
+    command_line::add_arg(desc, arg_rpc_max_concurrent);
+    command_line::add_arg(desc, arg_rpc_response_cache_size);
+    command_line::add_arg(desc, arg_rpc_client_rate);
+    command_line::add_arg(desc, arg_rpc_client_burst);
+    command_line::add_arg(desc, arg_rpc_client_max_concurrent);
+    command_line::add_arg(desc, arg_db_follow_rpc);
   }
   //------------------------------------------------------------------------------------------------------------------------------
   core_rpc_server::core_rpc_server(
@@ -63,7 +175,25 @@ namespace cryptonote
     )
     : m_core(cr)
     , m_p2p(p2p)
-  {}
+    , m_fast_threads(2)
+    , m_bulk_pool("bulk", 2, 4, RPC_BULK_WAIT_MS)
+    , m_long_poll_pool("long_poll", EVENTS_LONG_POLL_THREADS, 0, 0)
+    , m_response_cache(0)
+    , m_db_follow(false)
+    , m_db_follow_clients(DB_FOLLOW_RPC_CLIENTS)
+  {
+    // calls whose cost grows with the request or the chain; the rest are cheap
+    // and always find one of the fast threads free
+    static const char* const bulk_endpoints[] = {
+      "/getblocks.bin", "/getblocks_range.bin", "/get_output_keys_range.bin", "/gethashes.bin", "/get_hashes_by_height.bin", "/get_txs_o_indexes.bin",
+      "/getrandom_outs.bin", "/get_outs.bin", "/get_outs", "/getrandom_rctouts.bin",
+      "/gettransactions", "/is_key_image_spent", "/is_key_image_spent.bin", "/get_transaction_pool", "/get_block_headers_range.bin",
+      "getblockheadersrange", "get_output_histogram", "get_output_distribution", "get_coinbase_tx_sum", "/send_raw_transactions.bin"
+    };
+    for (const char* endpoint: bulk_endpoints)
+      m_endpoint_limits[endpoint].reset(new rpc_endpoint_limit(endpoint, m_bulk_pool));
+    m_endpoint_limits["/get_events.bin"].reset(new rpc_endpoint_limit("/get_events.bin", m_long_poll_pool));
+  }
   //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::handle_command_line(
       const boost::program_options::variables_map& vm
@@ -74,9 +204,72 @@ namespace cryptonote
     m_bind_ip = command_line::get_arg(vm, arg_rpc_bind_ip);
     m_port = command_line::get_arg(vm, p2p_bind_arg);
     m_restricted = command_line::get_arg(vm, arg_restricted_rpc);
+
+    m_fast_threads = command_line::get_arg(vm, arg_rpc_fast_threads);
+    CHECK_AND_ASSERT_MES(m_fast_threads > 0, false, "--" << arg_rpc_fast_threads.name << " must be at least 1");
+    const size_t bulk_threads = command_line::get_arg(vm, arg_rpc_bulk_threads);
+    CHECK_AND_ASSERT_MES(bulk_threads > 0, false, "--" << arg_rpc_bulk_threads.name << " must be at least 1");
+    m_bulk_pool.set_limits(bulk_threads, command_line::get_arg(vm, arg_rpc_bulk_queue));
+
+    for (const std::string& limit: command_line::get_arg(vm, arg_rpc_max_concurrent))
+    {
+      const std::string::size_type eq = limit.rfind('=');
+      CHECK_AND_ASSERT_MES(eq != std::string::npos, false, "Invalid --" << arg_rpc_max_concurrent.name << " " << limit << ", expected <endpoint>=<count>");
+      const std::string endpoint = limit.substr(0, eq);
+      auto it = m_endpoint_limits.find(endpoint);
+      CHECK_AND_ASSERT_MES(it != m_endpoint_limits.end(), false, "Invalid --" << arg_rpc_max_concurrent.name << " " << limit << ", " << endpoint << " is not a bulk endpoint");
+      size_t count = 0;
+      CHECK_AND_ASSERT_MES(epee::string_tools::get_xtype_from_string(count, limit.substr(eq + 1)), false, "Invalid --" << arg_rpc_max_concurrent.name << " " << limit << ", expected <endpoint>=<count>");
+      it->second->max_in_flight = count;
+    }
+
+    m_response_cache.set_max_bytes(command_line::get_arg(vm, arg_rpc_response_cache_size) * 1024 * 1024);
+
+    // only a public, restricted server has clients to keep from each other
+    if (m_restricted)
+    {
+      const uint64_t rate = command_line::get_arg(vm, arg_rpc_client_rate) * 1024;
+      const uint64_t burst = command_line::get_arg(vm, arg_rpc_client_burst) * 1024;
+      CHECK_AND_ASSERT_MES(rate == 0 || burst > 0, false, "--" << arg_rpc_client_burst.name << " must be at least 1");
+      m_client_limits.set_limits(rate, burst, command_line::get_arg(vm, arg_rpc_client_max_concurrent));
+    }
+
+    m_db_follow = m_core.get_db_follow();
+    m_db_follow_rpc = command_line::get_arg(vm, arg_db_follow_rpc);
+    CHECK_AND_ASSERT_MES(!m_db_follow || !m_db_follow_rpc.empty(), false, "--" << arg_db_follow_rpc.name << " is needed with --" << command_line::arg_db_follow.name);
+    if (!m_db_follow_rpc.empty() && m_db_follow_rpc.find("://") == std::string::npos)
+      m_db_follow_rpc = "http://" + m_db_follow_rpc;
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::handle_http_request(const epee::net_utils::http::http_request_info& query_info, epee::net_utils::http::http_response_info& response, connection_context& m_conn_context)
+  {
+    LOG_PRINT_L2("HTTP [" << epee::string_tools::get_ip_string_from_int32(m_conn_context.m_remote_ip) << "] " << query_info.m_http_method_str << " " << query_info.m_URI);
+    response.m_response_code = 200;
+    response.m_response_comment = "Ok";
+    if (!m_current_client.get())
+      m_current_client.reset(new uint32_t(0));
+    *m_current_client = m_conn_context.m_remote_ip;
+    if (!handle_http_request_map(query_info, response, m_conn_context))
+    {
+      response.m_response_code = 404;
+      response.m_response_comment = "Not found";
+    }
+    // the answer's size stands for the blocks, outputs or transactions in it
+    m_client_limits.charge(m_conn_context.m_remote_ip, RPC_CLIENT_CALL_COST + response.m_sent_body_bytes + response.m_body.size());
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  uint32_t core_rpc_server::get_current_client() const
+  {
+    return m_current_client.get() ? *m_current_client : 0;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  size_t core_rpc_server::get_threads_count() const
+  {
+    return m_fast_threads + m_bulk_pool.get_threads_bound() + m_long_poll_pool.get_threads_bound();
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::init(
       const boost::program_options::variables_map& vm
     )
@@ -87,6 +280,8 @@ namespace cryptonote
     m_net_server.set_threads_prefix("RPC");
     bool r = handle_command_line(vm);
     CHECK_AND_ASSERT_MES(r, false, "Failed to process command line in core_rpc_server");
+    // large JSON answers go out as they are serialized rather than built whole first
+    set_chunked_responses(true);
     return epee::http_server_impl_base<core_rpc_server, connection_context>::init(m_port, m_bind_ip, m_user_agent);
   }
   //------------------------------------------------------------------------------------------------------------------------------
@@ -102,6 +297,9 @@ namespace cryptonote
   //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::check_core_ready()
   {
+    // the followed daemon does the syncing
+    if(m_db_follow)
+      return check_core_busy();
     if(!m_p2p.get_payload_object().is_synchronized())
     {
       return false;
@@ -109,12 +307,19 @@ namespace cryptonote
     return check_core_busy();
   }
 #define CHECK_CORE_READY() do { if(!check_core_ready()){res.status =  CORE_RPC_STATUS_BUSY;return true;} } while(0)
+// holds a slot of a bulk endpoint for the rest of the handler, or answers BUSY;
+// the client's own budget is checked first, so it can't hold up the queue
+#define RPC_ENDPOINT_SLOT(endpoint) rpc_client_slot rpc_client(m_client_limits, get_current_client()); if(!rpc_client.acquired()){res.status = CORE_RPC_STATUS_BUSY;return true;} \
+  rpc_endpoint_slot rpc_slot(*m_endpoint_limits.at(endpoint)); if(!rpc_slot.acquired()){res.status = CORE_RPC_STATUS_BUSY;return true;}
+#define JSON_RPC_ENDPOINT_SLOT(endpoint) rpc_client_slot rpc_client(m_client_limits, get_current_client()); if(!rpc_client.acquired()){error_resp.code = CORE_RPC_ERROR_CODE_CORE_BUSY;error_resp.message = "Over this client's RPC budget, retry later.";return false;} \
+  rpc_endpoint_slot rpc_slot(*m_endpoint_limits.at(endpoint)); if(!rpc_slot.acquired()){error_resp.code = CORE_RPC_ERROR_CODE_CORE_BUSY;error_resp.message = "Too many " endpoint " calls in progress.";return false;}
 
   //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_get_height(const COMMAND_RPC_GET_HEIGHT::request& req, COMMAND_RPC_GET_HEIGHT::response& res)
   {
     CHECK_CORE_BUSY();
-    res.height = m_core.get_current_blockchain_height();
+    const boost::shared_ptr<const Blockchain::chain_state> chain_state = m_core.get_blockchain_storage().get_chain_state();
+    res.height = chain_state ? chain_state->height : m_core.get_current_blockchain_height();
     res.status = CORE_RPC_STATUS_OK;
     return true;
   }
@@ -122,27 +327,39 @@ namespace cryptonote
   bool core_rpc_server::on_get_info(const COMMAND_RPC_GET_INFO::request& req, COMMAND_RPC_GET_INFO::response& res)
   {
     CHECK_CORE_BUSY();
-    crypto::hash top_hash;
-    if (!m_core.get_blockchain_top(res.height, top_hash))
+    // published by the chain on each change, so polling never waits on block processing
+    const boost::shared_ptr<const Blockchain::chain_state> chain_state = m_core.get_blockchain_storage().get_chain_state();
+    if (!chain_state)
     {
       res.status = "Failed";
       return false;
     }
-    ++res.height; // turn top block height into blockchain height
-    res.top_block_hash = string_tools::pod_to_hex(top_hash);
+    res.height = chain_state->height;
+    res.top_block_hash = string_tools::pod_to_hex(chain_state->top_hash);
     res.target_height = m_core.get_target_blockchain_height();
-    res.difficulty = m_core.get_blockchain_storage().get_difficulty_for_next_block();
-    res.target = m_core.get_blockchain_storage().get_current_hard_fork_version() < 2 ? DIFFICULTY_TARGET_V1 : DIFFICULTY_TARGET_V2;
-    res.tx_count = m_core.get_blockchain_storage().get_total_transactions() - res.height; //without coinbase
+    res.difficulty = chain_state->difficulty;
+    res.target = chain_state->hard_fork_version < 2 ? DIFFICULTY_TARGET_V1 : DIFFICULTY_TARGET_V2;
+    res.tx_count = chain_state->tx_count - res.height; //without coinbase
     res.tx_pool_size = m_core.get_pool_transactions_count();
-    res.alt_blocks_count = m_core.get_blockchain_storage().get_alternative_blocks_count();
+    res.alt_blocks_count = chain_state->alt_blocks_count;
     uint64_t total_conn = m_p2p.get_connections_count();
     res.outgoing_connections_count = m_p2p.get_outgoing_connections_count();
     res.incoming_connections_count = total_conn - res.outgoing_connections_count;
     res.white_peerlist_size = m_p2p.get_peerlist_manager().get_white_peers_count();
     res.grey_peerlist_size = m_p2p.get_peerlist_manager().get_gray_peers_count();
     res.testnet = m_testnet;
-    res.cumulative_difficulty = m_core.get_blockchain_storage().get_db().get_block_cumulative_difficulty(res.height - 1);
+    res.cumulative_difficulty = chain_state->cumulative_difficulty;
+    const tools::thread_group &verification_pool = m_core.get_blockchain_storage().get_verification_pool();
+    res.verification_queue = verification_pool.queue_depth();
+    res.verification_busy_time = verification_pool.busy_time() / 1000; // ms
+    const crypto::ring_member_cache_stats ring_member_cache = crypto::get_ring_member_cache_stats();
+    res.ring_member_cache_hits = ring_member_cache.hits;
+    res.ring_member_cache_misses = ring_member_cache.misses;
+    res.ring_member_cache_size = ring_member_cache.size;
+    const cryptonote::output_key_cache::stats output_key_cache = m_core.get_blockchain_storage().get_output_key_cache_stats();
+    res.output_key_cache_hits = output_key_cache.hits;
+    res.output_key_cache_misses = output_key_cache.misses;
+    res.output_key_cache_size = output_key_cache.size;
     res.status = CORE_RPC_STATUS_OK;
     return true;
   }
@@ -150,36 +367,107 @@ namespace cryptonote
   bool core_rpc_server::on_get_blocks(const COMMAND_RPC_GET_BLOCKS_FAST::request& req, COMMAND_RPC_GET_BLOCKS_FAST::response& res)
   {
     CHECK_CORE_BUSY();
-    std::list<std::pair<block, std::list<transaction> > > bs;
+    RPC_ENDPOINT_SLOT("/getblocks.bin");
 
-    if(!m_core.find_blockchain_supplement(req.start_height, req.block_ids, bs, res.current_height, res.start_height, COMMAND_RPC_GET_BLOCKS_FAST_MAX_COUNT))
+    uint64_t top_height;
+    crypto::hash top_id;
+    m_core.get_blockchain_top(top_height, top_id);
+    uint64_t start_height = req.start_height;
+    if (start_height == 0 && !m_core.get_blockchain_storage().find_blockchain_supplement(req.block_ids, start_height))
     {
       res.status = "Failed";
       return false;
     }
+    const uint64_t count = req.max_count ? std::min<uint64_t>(req.max_count, COMMAND_RPC_GET_BLOCKS_FAST_MAX_COUNT) : COMMAND_RPC_GET_BLOCKS_FAST_MAX_COUNT;
+    if (get_cached_blocks(start_height, count, top_id, res))
+      return true;
+
+    if (!get_blocks_range(start_height, count, res))
+      return false;
 
-    BOOST_FOREACH(auto& b, bs)
+    // only cache if the chain did not move while we were building it
+    crypto::hash new_top_id;
+    m_core.get_blockchain_top(top_height, new_top_id);
+    if (new_top_id == top_id)
+      add_cached_blocks(top_id, res);
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_blocks_range(const COMMAND_RPC_GET_BLOCKS_RANGE::request& req, COMMAND_RPC_GET_BLOCKS_RANGE::response& res)
+  {
+    CHECK_CORE_BUSY();
+    RPC_ENDPOINT_SLOT("/getblocks_range.bin");
+    if (req.start_height > req.end_height)
     {
-      res.blocks.resize(res.blocks.size()+1);
-      res.blocks.back().block = block_to_blob(b.first);
-      res.output_indices.push_back(COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices());
-      res.output_indices.back().indices.push_back(COMMAND_RPC_GET_BLOCKS_FAST::tx_output_indices());
-      bool r = m_core.get_tx_outputs_gindexs(get_transaction_hash(b.first.miner_tx), res.output_indices.back().indices.back().indices);
-      if (!r)
+      res.status = "Invalid start/end heights";
+      return true;
+    }
+    // longer ranges are cut short, the client carries on from where the
+    // response stops
+    const uint64_t count = std::min<uint64_t>(req.end_height - req.start_height + 1, COMMAND_RPC_GET_BLOCKS_FAST_MAX_COUNT);
+    get_blocks_range(req.start_height, count, res);
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_output_keys_range(const COMMAND_RPC_GET_OUTPUT_KEYS_RANGE::request& req, COMMAND_RPC_GET_OUTPUT_KEYS_RANGE::response& res)
+  {
+    CHECK_CORE_BUSY();
+    RPC_ENDPOINT_SLOT("/get_output_keys_range.bin");
+    BlockchainDB &db = m_core.get_blockchain_storage().get_db();
+    res.current_height = db.height();
+    res.start_height = req.start_height;
+    if (req.start_height > req.end_height || req.start_height >= res.current_height)
+    {
+      res.status = "Invalid start/end heights";
+      return true;
+    }
+    const uint64_t count = std::min<uint64_t>(req.end_height - req.start_height + 1, COMMAND_RPC_GET_BLOCKS_FAST_MAX_COUNT);
+
+    std::vector<std::pair<blobdata, std::vector<blobdata> > > bs;
+    std::vector<std::vector<std::vector<uint64_t> > > indices;
+    try
+    {
+      db.get_blocks_with_output_indices(req.start_height, count, bs, indices);
+    }
+    catch (const std::exception &e)
+    {
+      res.status = std::string("Failed to get blocks: ") + e.what();
+      return true;
+    }
+
+    res.block_tx_counts.reserve(bs.size());
+    for (size_t n = 0; n < bs.size(); ++n)
+    {
+      block b;
+      if (!parse_and_validate_block_from_blob(bs[n].first, b))
       {
-        res.status = "Failed";
-        return false;
+        res.status = "Failed to parse block at height " + boost::lexical_cast<std::string>(req.start_height + n);
+        return true;
       }
-      size_t txidx = 0;
-      BOOST_FOREACH(auto& t, b.second)
+      res.block_tx_counts.push_back(1 + bs[n].second.size());
+      for (size_t i = 0; i <= bs[n].second.size(); ++i)
       {
-        res.blocks.back().txs.push_back(tx_to_blob(t));
-        res.output_indices.back().indices.push_back(COMMAND_RPC_GET_BLOCKS_FAST::tx_output_indices());
-        bool r = m_core.get_tx_outputs_gindexs(b.first.tx_hashes[txidx++], res.output_indices.back().indices.back().indices);
-        if (!r)
+        // only the prefix and ringct base are parsed, signatures and
+        // range proofs are skipped over
+        transaction parsed;
+        if (i > 0 && !parse_tx_base_from_blob(bs[n].second[i - 1], parsed))
         {
-          res.status = "Failed";
-          return false;
+          res.status = "Failed to parse tx " + epee::string_tools::pod_to_hex(b.tx_hashes[i - 1]);
+          return true;
+        }
+        const transaction &tx = i == 0 ? b.miner_tx : parsed;
+        res.tx_hashes.push_back(i == 0 ? get_transaction_hash(b.miner_tx) : b.tx_hashes[i - 1]);
+        res.tx_pub_keys.push_back(get_tx_pub_key_from_extra(tx));
+        res.tx_output_counts.push_back(tx.vout.size());
+        const bool rct = tx.version > 1 && tx.rct_signatures.type != rct::RCTTypeNull;
+        for (size_t o = 0; o < tx.vout.size(); ++o)
+        {
+          const tx_out &out = tx.vout[o];
+          res.output_keys.push_back(out.target.type() == typeid(txout_to_key) ? boost::get<txout_to_key>(out.target).key : null_pkey);
+          res.amounts.push_back(out.amount);
+          res.output_indices.push_back(o < indices[n][i].size() ? indices[n][i][o] : 0);
+          res.ecdh_masks.push_back(rct && o < tx.rct_signatures.ecdhInfo.size() ? tx.rct_signatures.ecdhInfo[o].mask : rct::zero());
+          res.ecdh_amounts.push_back(rct && o < tx.rct_signatures.ecdhInfo.size() ? tx.rct_signatures.ecdhInfo[o].amount : rct::zero());
         }
       }
     }
@@ -188,9 +476,96 @@ namespace cryptonote
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::get_blocks_range(uint64_t start_height, uint64_t count, COMMAND_RPC_GET_BLOCKS_FAST::response& res)
+  {
+    BlockchainDB &db = m_core.get_blockchain_storage().get_db();
+    res.current_height = db.height();
+    res.start_height = start_height;
+    if (start_height >= res.current_height)
+    {
+      res.status = "Failed";
+      return false;
+    }
+    if (start_height < db.get_pruned_height())
+    {
+      LOG_PRINT_L1("Refusing to serve pruned blocks from height " << start_height);
+      res.status = "Failed";
+      return false;
+    }
+
+    // blobs are sent as stored, and the output indices come along in the
+    // same db pass rather than from one lookup per tx
+    std::vector<std::pair<blobdata, std::vector<blobdata> > > bs;
+    std::vector<std::vector<std::vector<uint64_t> > > indices;
+    try
+    {
+      db.get_blocks_with_output_indices(start_height, count, bs, indices);
+    }
+    catch (const std::exception &e)
+    {
+      res.status = std::string("Failed to get blocks: ") + e.what();
+      return false;
+    }
+
+    res.blocks.resize(bs.size());
+    res.output_indices.resize(bs.size());
+    for (size_t n = 0; n < bs.size(); ++n)
+    {
+      res.blocks[n].block = std::move(bs[n].first);
+      res.blocks[n].txs = std::move(bs[n].second);
+      res.output_indices[n].indices.resize(indices[n].size());
+      for (size_t i = 0; i < indices[n].size(); ++i)
+        res.output_indices[n].indices[i].indices = std::move(indices[n][i]);
+    }
+
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::get_cached_blocks(uint64_t start_height, uint64_t count, const crypto::hash& top_id, COMMAND_RPC_GET_BLOCKS_FAST::response& res)
+  {
+    CRITICAL_REGION_LOCAL(m_blocks_cache_lock);
+    for (auto it = m_blocks_cache.begin(); it != m_blocks_cache.end(); ++it)
+    {
+      // a shorter response only serves if it stopped at the top
+      const COMMAND_RPC_GET_BLOCKS_FAST::response &cached = it->res;
+      if (cached.start_height == start_height && it->top_id == top_id &&
+          (cached.blocks.size() >= count || cached.start_height + cached.blocks.size() >= cached.current_height))
+      {
+        m_blocks_cache.splice(m_blocks_cache.begin(), m_blocks_cache, it);
+        res = m_blocks_cache.front().res;
+        if (res.blocks.size() > count)
+        {
+          res.blocks.resize(count);
+          res.output_indices.resize(count);
+        }
+        return true;
+      }
+    }
+    return false;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void core_rpc_server::add_cached_blocks(const crypto::hash& top_id, const COMMAND_RPC_GET_BLOCKS_FAST::response& res)
+  {
+    CRITICAL_REGION_LOCAL(m_blocks_cache_lock);
+    // responses made for another top can't be served anymore
+    m_blocks_cache.remove_if([&top_id, &res](const blocks_cache_entry& e) { return e.top_id != top_id || e.res.start_height == res.start_height; });
+    m_blocks_cache.push_front(blocks_cache_entry());
+    m_blocks_cache.front().top_id = top_id;
+    m_blocks_cache.front().res = res;
+    while (m_blocks_cache.size() > GET_BLOCKS_FAST_CACHE_SIZE)
+      m_blocks_cache.pop_back();
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::is_buried(uint64_t height)
+  {
+    return height + RPC_RESPONSE_CACHE_MIN_DEPTH < m_core.get_current_blockchain_height();
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_get_hashes(const COMMAND_RPC_GET_HASHES_FAST::request& req, COMMAND_RPC_GET_HASHES_FAST::response& res)
   {
     CHECK_CORE_BUSY();
+    RPC_ENDPOINT_SLOT("/gethashes.bin");
     NOTIFY_RESPONSE_CHAIN_ENTRY::request resp;
 
     resp.start_height = req.start_height;
@@ -207,9 +582,46 @@ namespace cryptonote
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_hashes_by_height(const COMMAND_RPC_GET_HASHES_BY_HEIGHT::request& req, COMMAND_RPC_GET_HASHES_BY_HEIGHT::response& res)
+  {
+    CHECK_CORE_BUSY();
+    RPC_ENDPOINT_SLOT("/get_hashes_by_height.bin");
+    if (req.heights.size() > COMMAND_RPC_GET_HASHES_BY_HEIGHT_MAX_COUNT)
+    {
+      res.status = "Too many heights requested";
+      return true;
+    }
+    BlockchainDB &db = m_core.get_blockchain_storage().get_db();
+    res.current_height = db.height();
+    res.hashes.reserve(req.heights.size());
+    try
+    {
+      for (uint64_t height: req.heights)
+      {
+        if (height >= res.current_height)
+        {
+          res.status = "Height " + boost::lexical_cast<std::string>(height) + " is past the top";
+          res.hashes.clear();
+          return true;
+        }
+        res.hashes.push_back(db.get_block_hash_from_height(height));
+      }
+    }
+    catch (const std::exception &e)
+    {
+      res.status = std::string("Failed to get block hashes: ") + e.what();
+      res.hashes.clear();
+      return true;
+    }
+
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_get_random_outs(const COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::request& req, COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::response& res)
   {
     CHECK_CORE_BUSY();
+    RPC_ENDPOINT_SLOT("/getrandom_outs.bin");
     res.status = "Failed";
 
     if (m_restricted)
@@ -249,6 +661,7 @@ namespace cryptonote
   bool core_rpc_server::on_get_outs_bin(const COMMAND_RPC_GET_OUTPUTS_BIN::request& req, COMMAND_RPC_GET_OUTPUTS_BIN::response& res)
   {
     CHECK_CORE_BUSY();
+    RPC_ENDPOINT_SLOT("/get_outs.bin");
     res.status = "Failed";
 
     if (m_restricted)
@@ -272,6 +685,7 @@ namespace cryptonote
   bool core_rpc_server::on_get_outs(const COMMAND_RPC_GET_OUTPUTS::request& req, COMMAND_RPC_GET_OUTPUTS::response& res)
   {
     CHECK_CORE_BUSY();
+    RPC_ENDPOINT_SLOT("/get_outs");
     res.status = "Failed";
 
     if (m_restricted)
@@ -308,6 +722,7 @@ namespace cryptonote
   bool core_rpc_server::on_get_random_rct_outs(const COMMAND_RPC_GET_RANDOM_RCT_OUTPUTS::request& req, COMMAND_RPC_GET_RANDOM_RCT_OUTPUTS::response& res)
   {
     CHECK_CORE_BUSY();
+    RPC_ENDPOINT_SLOT("/getrandom_rctouts.bin");
     res.status = "Failed";
     if(!m_core.get_random_rct_outs(req, res))
     {
@@ -332,6 +747,10 @@ namespace cryptonote
   bool core_rpc_server::on_get_indexes(const COMMAND_RPC_GET_TX_GLOBAL_OUTPUTS_INDEXES::request& req, COMMAND_RPC_GET_TX_GLOBAL_OUTPUTS_INDEXES::response& res)
   {
     CHECK_CORE_BUSY();
+    const std::string cache_key = "/get_o_indexes.bin:" + epee::string_tools::pod_to_hex(req.txid);
+    const uint64_t popped_blocks = m_core.get_blockchain_storage().get_popped_blocks_count();
+    if (m_response_cache.get(cache_key, popped_blocks, res))
+      return true;
     bool r = m_core.get_tx_outputs_gindexs(req.txid, res.o_indexes);
     if(!r)
     {
@@ -340,12 +759,65 @@ namespace cryptonote
     }
     res.status = CORE_RPC_STATUS_OK;
     LOG_PRINT_L2("COMMAND_RPC_GET_TX_GLOBAL_OUTPUTS_INDEXES: [" << res.o_indexes.size() << "]");
+
+    try
+    {
+      if (is_buried(m_core.get_blockchain_storage().get_db().get_tx_block_height(req.txid)))
+        m_response_cache.add(cache_key, popped_blocks, res, res.o_indexes.size() * sizeof(uint64_t));
+    }
+    catch (const std::exception &e)
+    {
+      // popped in the meantime, just don't cache it
+    }
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_txs_indexes(const COMMAND_RPC_GET_TXS_GLOBAL_OUTPUTS_INDEXES::request& req, COMMAND_RPC_GET_TXS_GLOBAL_OUTPUTS_INDEXES::response& res)
+  {
+    CHECK_CORE_BUSY();
+    RPC_ENDPOINT_SLOT("/get_txs_o_indexes.bin");
+    if (req.txids.size() > COMMAND_RPC_GET_TXS_GLOBAL_OUTPUTS_INDEXES_MAX_COUNT)
+    {
+      res.status = "Too many txids requested";
+      return true;
+    }
+    std::vector<std::vector<uint64_t> > indices;
+    std::vector<bool> found;
+    try
+    {
+      m_core.get_blockchain_storage().get_db().get_txs_amount_output_indices(req.txids, indices, found);
+    }
+    catch (const std::exception &e)
+    {
+      res.status = std::string("Failed to get output indices: ") + e.what();
+      return true;
+    }
+
+    res.o_indexes.resize(req.txids.size());
+    for (size_t n = 0; n < req.txids.size(); ++n)
+    {
+      if (found[n])
+        res.o_indexes[n].indices.swap(indices[n]);
+      else
+        res.missed_txids.push_back(req.txids[n]);
+    }
+    LOG_PRINT_L2("COMMAND_RPC_GET_TXS_GLOBAL_OUTPUTS_INDEXES: " << req.txids.size() - res.missed_txids.size() << "/" << req.txids.size() << " found");
+    res.status = CORE_RPC_STATUS_OK;
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_get_transactions(const COMMAND_RPC_GET_TRANSACTIONS::request& req, COMMAND_RPC_GET_TRANSACTIONS::response& res)
   {
     CHECK_CORE_BUSY();
+    std::string cache_key = req.decode_as_json ? "/gettransactions:json" : "/gettransactions:";
+    if (req.prune)
+      cache_key += ":pruned";
+    BOOST_FOREACH(const auto& tx_hex_str, req.txs_hashes)
+      cache_key += ":" + tx_hex_str;
+    const uint64_t popped_blocks = m_core.get_blockchain_storage().get_popped_blocks_count();
+    if (m_response_cache.get(cache_key, popped_blocks, res))
+      return true;
+    RPC_ENDPOINT_SLOT("/gettransactions");
     std::vector<crypto::hash> vh;
     BOOST_FOREACH(const auto& tx_hex_str, req.txs_hashes)
     {
@@ -363,93 +835,187 @@ namespace cryptonote
       vh.push_back(*reinterpret_cast<const crypto::hash*>(b.data()));
     }
     std::list<crypto::hash> missed_txs;
-    std::list<transaction> txs;
-    bool r = m_core.get_transactions(vh, txs, missed_txs);
-    if(!r)
+    size_t found_in_pool = 0;
+    if (req.prune)
+    {
+      if (!get_pruned_transactions(vh, req.decode_as_json, res, missed_txs, found_in_pool))
+        return true;
+    }
+    else
+    {
+      std::list<transaction> txs;
+      bool r = m_core.get_transactions(vh, txs, missed_txs);
+      if(!r)
+      {
+        res.status = "Failed";
+        return true;
+      }
+      LOG_PRINT_L2("Found " << txs.size() << "/" << vh.size() << " transactions on the blockchain");
+
+      // try the pool for any missing txes
+      std::unordered_set<crypto::hash> pool_tx_hashes;
+      if (!missed_txs.empty())
+      {
+        std::list<transaction> pool_txs;
+        bool r = m_core.get_pool_transactions(pool_txs);
+        if(r)
+        {
+          for (std::list<transaction>::const_iterator i = pool_txs.begin(); i != pool_txs.end(); ++i)
+          {
+            crypto::hash tx_hash = get_transaction_hash(*i);
+            std::list<crypto::hash>::iterator mi = std::find(missed_txs.begin(), missed_txs.end(), tx_hash);
+            if (mi != missed_txs.end())
+            {
+              pool_tx_hashes.insert(tx_hash);
+              missed_txs.erase(mi);
+              txs.push_back(*i);
+              ++found_in_pool;
+            }
+          }
+        }
+        LOG_PRINT_L2("Found " << found_in_pool << "/" << vh.size() << " transactions in the pool");
+      }
+
+      std::list<std::string>::const_iterator txhi = req.txs_hashes.begin();
+      std::vector<crypto::hash>::const_iterator vhi = vh.begin();
+      BOOST_FOREACH(auto& tx, txs)
+      {
+        res.txs.push_back(COMMAND_RPC_GET_TRANSACTIONS::entry());
+        COMMAND_RPC_GET_TRANSACTIONS::entry &e = res.txs.back();
+
+        crypto::hash tx_hash = *vhi++;
+        e.tx_hash = *txhi++;
+        blobdata blob = t_serializable_object_to_blob(tx);
+        e.as_hex = string_tools::buff_to_hex_nodelimer(blob);
+        if (req.decode_as_json)
+          e.as_json = obj_to_json_str(tx);
+        e.in_pool = pool_tx_hashes.find(tx_hash) != pool_tx_hashes.end();
+        if (e.in_pool)
+        {
+          e.block_height = std::numeric_limits<uint64_t>::max();
+        }
+        else
+        {
+          e.block_height = m_core.get_blockchain_storage().get_db().get_tx_block_height(tx_hash);
+        }
+
+        // fill up old style responses too, in case an old wallet asks
+        res.txs_as_hex.push_back(e.as_hex);
+        if (req.decode_as_json)
+          res.txs_as_json.push_back(e.as_json);
+
+        // output indices too if not in pool
+        if (pool_tx_hashes.find(tx_hash) == pool_tx_hashes.end())
+        {
+          bool r = m_core.get_tx_outputs_gindexs(tx_hash, e.output_indices);
+          if (!r)
+          {
+            res.status = "Failed";
+            return false;
+          }
+        }
+      }
+    }
+
+    BOOST_FOREACH(const auto& miss_tx, missed_txs)
+    {
+      res.missed_tx.push_back(string_tools::pod_to_hex(miss_tx));
+    }
+
+    LOG_PRINT_L2(res.txs.size() << " transactions found, " << res.missed_tx.size() << " not found");
+    res.status = CORE_RPC_STATUS_OK;
+
+    // only once all of them are mined deep enough
+    if (res.missed_tx.empty() && found_in_pool == 0)
+    {
+      size_t bytes = 0;
+      bool buried = true;
+      for (const auto &e: res.txs)
+      {
+        buried = buried && is_buried(e.block_height);
+        bytes += e.tx_hash.size() + 2 * (e.as_hex.size() + e.as_json.size()) + e.output_indices.size() * sizeof(uint64_t);
+      }
+      if (buried)
+        m_response_cache.add(cache_key, popped_blocks, res, bytes);
+    }
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::get_pruned_transactions(const std::vector<crypto::hash>& vh, bool decode_as_json, COMMAND_RPC_GET_TRANSACTIONS::response& res, std::list<crypto::hash>& missed_txs, size_t& found_in_pool)
+  {
+    // the blobs are cut from the db as they are, the prunable data never gets parsed
+    std::list<Blockchain::pruned_tx_blob> txs;
+    if (!m_core.get_blockchain_storage().get_pruned_transactions_blobs(vh, txs, missed_txs))
     {
       res.status = "Failed";
-      return true;
+      return false;
     }
     LOG_PRINT_L2("Found " << txs.size() << "/" << vh.size() << " transactions on the blockchain");
+    const size_t found_in_chain = txs.size();
 
-    // try the pool for any missing txes
-    size_t found_in_pool = 0;
-    std::unordered_set<crypto::hash> pool_tx_hashes;
     if (!missed_txs.empty())
     {
       std::list<transaction> pool_txs;
-      bool r = m_core.get_pool_transactions(pool_txs);
-      if(r)
+      if (m_core.get_pool_transactions(pool_txs))
       {
-        for (std::list<transaction>::const_iterator i = pool_txs.begin(); i != pool_txs.end(); ++i)
+        for (const transaction& tx: pool_txs)
         {
-          crypto::hash tx_hash = get_transaction_hash(*i);
+          const crypto::hash tx_hash = get_transaction_hash(tx);
           std::list<crypto::hash>::iterator mi = std::find(missed_txs.begin(), missed_txs.end(), tx_hash);
-          if (mi != missed_txs.end())
+          if (mi == missed_txs.end())
+            continue;
+          missed_txs.erase(mi);
+          txs.push_back(Blockchain::pruned_tx_blob());
+          Blockchain::pruned_tx_blob& ptx = txs.back();
+          ptx.tx_hash = tx_hash;
+          if (!get_pruned_tx_blob(t_serializable_object_to_blob(tx), ptx.tx, ptx.blob, ptx.prunable_hash, ptx.has_prunable_hash))
           {
-            pool_tx_hashes.insert(tx_hash);
-            missed_txs.erase(mi);
-            txs.push_back(*i);
-            ++found_in_pool;
+            res.status = "Failed";
+            return false;
           }
+          ++found_in_pool;
         }
       }
       LOG_PRINT_L2("Found " << found_in_pool << "/" << vh.size() << " transactions in the pool");
     }
 
-    std::list<std::string>::const_iterator txhi = req.txs_hashes.begin();
-    std::vector<crypto::hash>::const_iterator vhi = vh.begin();
-    BOOST_FOREACH(auto& tx, txs)
+    size_t n = 0;
+    for (Blockchain::pruned_tx_blob& ptx: txs)
     {
       res.txs.push_back(COMMAND_RPC_GET_TRANSACTIONS::entry());
       COMMAND_RPC_GET_TRANSACTIONS::entry &e = res.txs.back();
-
-      crypto::hash tx_hash = *vhi++;
-      e.tx_hash = *txhi++;
-      blobdata blob = t_serializable_object_to_blob(tx);
-      e.as_hex = string_tools::buff_to_hex_nodelimer(blob);
-      if (req.decode_as_json)
-        e.as_json = obj_to_json_str(tx);
-      e.in_pool = pool_tx_hashes.find(tx_hash) != pool_tx_hashes.end();
+      e.tx_hash = string_tools::pod_to_hex(ptx.tx_hash);
+      e.as_hex = string_tools::buff_to_hex_nodelimer(ptx.blob);
+      if (ptx.has_prunable_hash)
+        e.prunable_hash = string_tools::pod_to_hex(ptx.prunable_hash);
+      if (decode_as_json)
+        e.as_json = obj_to_json_str(ptx.tx);
+      e.in_pool = n++ >= found_in_chain;
       if (e.in_pool)
       {
         e.block_height = std::numeric_limits<uint64_t>::max();
       }
       else
       {
-        e.block_height = m_core.get_blockchain_storage().get_db().get_tx_block_height(tx_hash);
-      }
-
-      // fill up old style responses too, in case an old wallet asks
-      res.txs_as_hex.push_back(e.as_hex);
-      if (req.decode_as_json)
-        res.txs_as_json.push_back(e.as_json);
-
-      // output indices too if not in pool
-      if (pool_tx_hashes.find(tx_hash) == pool_tx_hashes.end())
-      {
-        bool r = m_core.get_tx_outputs_gindexs(tx_hash, e.output_indices);
-        if (!r)
+        e.block_height = m_core.get_blockchain_storage().get_db().get_tx_block_height(ptx.tx_hash);
+        if (!m_core.get_tx_outputs_gindexs(ptx.tx_hash, e.output_indices))
         {
           res.status = "Failed";
           return false;
         }
       }
-    }
 
-    BOOST_FOREACH(const auto& miss_tx, missed_txs)
-    {
-      res.missed_tx.push_back(string_tools::pod_to_hex(miss_tx));
+      res.txs_as_hex.push_back(e.as_hex);
+      if (decode_as_json)
+        res.txs_as_json.push_back(e.as_json);
     }
-
-    LOG_PRINT_L2(res.txs.size() << " transactions found, " << res.missed_tx.size() << " not found");
-    res.status = CORE_RPC_STATUS_OK;
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_is_key_image_spent(const COMMAND_RPC_IS_KEY_IMAGE_SPENT::request& req, COMMAND_RPC_IS_KEY_IMAGE_SPENT::response& res)
   {
     CHECK_CORE_BUSY();
+    RPC_ENDPOINT_SLOT("/is_key_image_spent");
     std::vector<crypto::key_image> key_images;
     BOOST_FOREACH(const auto& ki_hex_str, req.key_images)
     {
@@ -465,53 +1031,55 @@ namespace cryptonote
       }
       key_images.push_back(*reinterpret_cast<const crypto::key_image*>(b.data()));
     }
-    std::vector<bool> spent_status;
-    bool r = m_core.are_key_images_spent(key_images, spent_status);
-    if(!r)
+    if(!get_key_images_spent_status(key_images, res.spent_status))
     {
       res.status = "Failed";
       return true;
     }
-    res.spent_status.clear();
-    for (size_t n = 0; n < spent_status.size(); ++n)
-      res.spent_status.push_back(spent_status[n] ? COMMAND_RPC_IS_KEY_IMAGE_SPENT::SPENT_IN_BLOCKCHAIN : COMMAND_RPC_IS_KEY_IMAGE_SPENT::UNSPENT);
-
-    // check the pool too
-    std::vector<cryptonote::tx_info> txs;
-    std::vector<cryptonote::spent_key_image_info> ki;
-    r = m_core.get_pool_transactions_and_spent_keys_info(txs, ki);
-    if(!r)
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_is_key_image_spent_bin(const COMMAND_RPC_IS_KEY_IMAGE_SPENT_BIN::request& req, COMMAND_RPC_IS_KEY_IMAGE_SPENT_BIN::response& res)
+  {
+    CHECK_CORE_BUSY();
+    RPC_ENDPOINT_SLOT("/is_key_image_spent.bin");
+    if (req.key_images.size() > COMMAND_RPC_IS_KEY_IMAGE_SPENT_MAX_COUNT)
     {
-      res.status = "Failed";
+      res.status = "Too many key images requested";
       return true;
     }
-    for (std::vector<cryptonote::spent_key_image_info>::const_iterator i = ki.begin(); i != ki.end(); ++i)
+    if(!get_key_images_spent_status(req.key_images, res.spent_status))
     {
-      crypto::hash hash;
-      crypto::key_image spent_key_image;
-      if (parse_hash256(i->id_hash, hash))
-      {
-        memcpy(&spent_key_image, &hash, sizeof(hash)); // a bit dodgy, should be other parse functions somewhere
-        for (size_t n = 0; n < res.spent_status.size(); ++n)
-        {
-          if (res.spent_status[n] == COMMAND_RPC_IS_KEY_IMAGE_SPENT::UNSPENT)
-          {
-            if (key_images[n] == spent_key_image)
-            {
-              res.spent_status[n] = COMMAND_RPC_IS_KEY_IMAGE_SPENT::SPENT_IN_POOL;
-              break;
-            }
-          }
-        }
-      }
+      res.status = "Failed";
+      return true;
     }
-
     res.status = CORE_RPC_STATUS_OK;
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::get_key_images_spent_status(const std::vector<crypto::key_image>& key_images, std::vector<int>& res)
+  {
+    std::vector<bool> spent_status;
+    if(!m_core.are_key_images_spent(key_images, spent_status))
+      return false;
+    res.clear();
+    res.reserve(spent_status.size());
+    for (size_t n = 0; n < spent_status.size(); ++n)
+      res.push_back(spent_status[n] ? COMMAND_RPC_IS_KEY_IMAGE_SPENT::SPENT_IN_BLOCKCHAIN : COMMAND_RPC_IS_KEY_IMAGE_SPENT::UNSPENT);
+
+    // check the pool too
+    m_core.are_key_images_spent_in_pool(key_images, spent_status);
+    for (size_t n = 0; n < res.size(); ++n)
+      if (res[n] == COMMAND_RPC_IS_KEY_IMAGE_SPENT::UNSPENT && spent_status[n])
+        res[n] = COMMAND_RPC_IS_KEY_IMAGE_SPENT::SPENT_IN_POOL;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_send_raw_tx(const COMMAND_RPC_SEND_RAW_TX::request& req, COMMAND_RPC_SEND_RAW_TX::response& res)
   {
+    if (m_db_follow)
+      return forward_json(m_db_follow_clients, m_db_follow_rpc + "/sendrawtransaction", req, res);
     CHECK_CORE_READY();
 
     std::string tx_blob;
@@ -534,23 +1102,7 @@ namespace cryptonote
       {
         LOG_PRINT_L0("[on_send_raw_tx]: Failed to process tx");
       }
-      res.status = "Failed";
-      if ((res.low_mixin = tvc.m_low_mixin))
-        res.reason = "mixin too low";
-      if ((res.double_spend = tvc.m_double_spend))
-        res.reason = "double spend";
-      if ((res.invalid_input = tvc.m_invalid_input))
-        res.reason = "invalid input";
-      if ((res.invalid_output = tvc.m_invalid_output))
-        res.reason = "invalid output";
-      if ((res.too_big = tvc.m_too_big))
-        res.reason = "too big";
-      if ((res.overspend = tvc.m_overspend))
-        res.reason = "overspend";
-      if ((res.fee_too_low = tvc.m_fee_too_low))
-        res.reason = "fee too low";
-      if ((res.not_rct = tvc.m_not_rct))
-        res.reason = "tx is not ringct";
+      set_tx_verification_failure(tvc, res);
       return true;
     }
 
@@ -571,6 +1123,57 @@ namespace cryptonote
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_send_raw_txs(const COMMAND_RPC_SEND_RAW_TXS::request& req, COMMAND_RPC_SEND_RAW_TXS::response& res)
+  {
+    CHECK_CORE_READY();
+    RPC_ENDPOINT_SLOT("/send_raw_transactions.bin");
+    if (m_db_follow)
+      return forward_bin(m_db_follow_clients, m_db_follow_rpc + "/send_raw_transactions.bin", req, res);
+    if (req.txs.size() > COMMAND_RPC_SEND_RAW_TXS_MAX_COUNT)
+    {
+      res.status = "Too many transactions, at most " + std::to_string(COMMAND_RPC_SEND_RAW_TXS_MAX_COUNT) + " per call";
+      return true;
+    }
+
+    // checked in parallel and admitted to the pool together
+    std::vector<tx_verification_context> tvc;
+    m_core.handle_incoming_txs(req.txs, tvc, false, false);
+
+    NOTIFY_NEW_TRANSACTIONS::request r;
+    res.results.resize(req.txs.size()); // value initialized, all flags false
+    size_t i = 0;
+    for (const std::string& tx_blob: req.txs)
+    {
+      COMMAND_RPC_SEND_RAW_TXS::tx_result& result = res.results[i];
+      if (tvc[i].m_verifivation_failed)
+      {
+        set_tx_verification_failure(tvc[i], result);
+      }
+      else if (!tvc[i].m_should_be_relayed || req.do_not_relay)
+      {
+        result.reason = "Not relayed";
+        result.not_relayed = true;
+        result.status = CORE_RPC_STATUS_OK;
+      }
+      else
+      {
+        r.txs.push_back(tx_blob);
+        result.status = CORE_RPC_STATUS_OK;
+      }
+      ++i;
+    }
+
+    // one message per peer for the whole lot
+    if (!r.txs.empty())
+    {
+      cryptonote_connection_context fake_context = AUTO_VAL_INIT(fake_context);
+      m_core.get_protocol()->relay_transactions(r, fake_context);
+    }
+    LOG_PRINT_L1("[on_send_raw_txs]: " << req.txs.size() << " txs, " << r.txs.size() << " relayed");
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_start_mining(const COMMAND_RPC_START_MINING::request& req, COMMAND_RPC_START_MINING::response& res)
   {
     CHECK_CORE_READY();
@@ -691,11 +1294,89 @@ namespace cryptonote
   bool core_rpc_server::on_get_transaction_pool(const COMMAND_RPC_GET_TRANSACTION_POOL::request& req, COMMAND_RPC_GET_TRANSACTION_POOL::response& res)
   {
     CHECK_CORE_BUSY();
+    RPC_ENDPOINT_SLOT("/get_transaction_pool");
+    if (m_db_follow)
+      return forward_json(m_db_follow_clients, m_db_follow_rpc + "/get_transaction_pool", req, res);
     m_core.get_pool_transactions_and_spent_keys_info(res.transactions, res.spent_key_images);
     res.status = CORE_RPC_STATUS_OK;
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_transaction_pool_hashes(const COMMAND_RPC_GET_TRANSACTION_POOL_HASHES::request& req, COMMAND_RPC_GET_TRANSACTION_POOL_HASHES::response& res)
+  {
+    CHECK_CORE_BUSY();
+    if (m_db_follow)
+      return forward_bin(m_db_follow_clients, m_db_follow_rpc + "/get_transaction_pool_hashes.bin", req, res);
+    m_core.get_pool_transaction_hashes(res.tx_hashes, res.pool_version);
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_transaction_pool_since(const COMMAND_RPC_GET_TRANSACTION_POOL_SINCE::request& req, COMMAND_RPC_GET_TRANSACTION_POOL_SINCE::response& res)
+  {
+    CHECK_CORE_BUSY();
+    if (m_db_follow)
+      return forward_bin(m_db_follow_clients, m_db_follow_rpc + "/get_transaction_pool_since.bin", req, res);
+    res.full = !m_core.get_pool_transaction_changes(req.pool_version, res.added_tx_hashes, res.removed_tx_hashes, res.pool_version);
+    if (res.full)
+    {
+      res.added_tx_hashes.clear();
+      res.removed_tx_hashes.clear();
+      m_core.get_pool_transaction_hashes(res.added_tx_hashes, res.pool_version);
+    }
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_events(const COMMAND_RPC_GET_EVENTS::request& req, COMMAND_RPC_GET_EVENTS::response& res)
+  {
+    CHECK_CORE_BUSY();
+    Blockchain& blockchain = m_core.get_blockchain_storage();
+    const chain_events& events = blockchain.get_events();
+    if (req.wait_seconds && req.since == events.get_last_seq())
+    {
+      // when all long poll threads are taken, answer at once rather than BUSY
+      rpc_endpoint_slot slot(*m_endpoint_limits.at("/get_events.bin"));
+      if (slot.acquired())
+        events.wait(req.since, std::min<uint64_t>(req.wait_seconds, EVENTS_LONG_POLL_SECONDS));
+    }
+
+    const size_t max_count = req.max_count ? std::min<uint64_t>(req.max_count, COMMAND_RPC_GET_EVENTS_MAX_COUNT) : COMMAND_RPC_GET_EVENTS_MAX_COUNT;
+    std::vector<chain_events::event> found;
+    res.full = !events.get_since(req.since, found, max_count);
+    // a caller starting over picks up from the latest event, having resynced by other means
+    res.last_seq = res.full ? events.get_last_seq() : found.empty() ? req.since : found.back().seq;
+
+    res.events.reserve(found.size());
+    for (const chain_events::event& e: found)
+    {
+      res.events.push_back(COMMAND_RPC_GET_EVENTS::event_entry());
+      COMMAND_RPC_GET_EVENTS::event_entry& entry = res.events.back();
+      entry.seq = e.seq;
+      entry.type = chain_events::get_type_name(e.type);
+      entry.hash = e.hash;
+      entry.height = e.height;
+      if (!req.include_blobs)
+        continue;
+      // blobs are read now, not when the event happened, so they may be gone
+      if (e.type == chain_events::block_added || e.type == chain_events::block_removed)
+      {
+        try { entry.blob = blockchain.get_db().get_block_blob(e.hash); }
+        catch (const BLOCK_DNE&) {}
+      }
+      else if (e.type == chain_events::tx_added || e.type == chain_events::tx_removed)
+      {
+        transaction tx;
+        if (m_core.get_pool_transaction(e.hash, tx))
+          entry.blob = t_serializable_object_to_blob(tx);
+        else
+          blockchain.get_db().get_tx_blob(e.hash, entry.blob);
+      }
+    }
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_stop_daemon(const COMMAND_RPC_STOP_DAEMON::request& req, COMMAND_RPC_STOP_DAEMON::response& res)
   {
     // FIXME: replace back to original m_p2p.send_stop_signal() after
@@ -779,6 +1460,12 @@ namespace cryptonote
       return false;
     }
 
+    // a caller passing the version it already has waits for a new one
+    if(req.template_version && req.template_version == m_core.get_block_template_version())
+      m_core.wait_block_template_version(req.template_version, BLOCK_TEMPLATE_LONG_POLL_SECONDS);
+
+    // read before the template is made, so it is never newer than the template
+    res.template_version = m_core.get_block_template_version();
     block b = AUTO_VAL_INIT(b);
     cryptonote::blobdata blob_reserve;
     blob_reserve.resize(req.reserve_size, 0);
@@ -978,6 +1665,7 @@ namespace cryptonote
       error_resp.message = "Core is busy.";
       return false;
     }
+    JSON_RPC_ENDPOINT_SLOT("getblockheadersrange");
     const uint64_t bc_height = m_core.get_current_blockchain_height();
     if (req.start_height >= bc_height || req.end_height >= bc_height || req.start_height > req.end_height)
     {
@@ -1022,6 +1710,86 @@ namespace cryptonote
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_block_headers_range_bin(const COMMAND_RPC_GET_BLOCK_HEADERS_RANGE_BIN::request& req, COMMAND_RPC_GET_BLOCK_HEADERS_RANGE_BIN::response& res)
+  {
+    CHECK_CORE_BUSY();
+    RPC_ENDPOINT_SLOT("/get_block_headers_range.bin");
+    Blockchain &blockchain = m_core.get_blockchain_storage();
+    BlockchainDB &db = blockchain.get_db();
+    const uint64_t bc_height = db.height();
+    if (req.start_height >= bc_height || req.end_height >= bc_height || req.start_height > req.end_height)
+    {
+      res.status = "Invalid start/end heights";
+      return true;
+    }
+    const uint64_t count = req.end_height - req.start_height + 1;
+    if (m_restricted && count > MAX_RESTRICTED_BLOCK_HEADERS_COUNT)
+    {
+      res.status = "Too many block headers requested";
+      return true;
+    }
+
+    // everything but the versions, nonce and reward comes from the per
+    // height block info, without touching the block blob
+    const uint32_t fields = req.fields ? req.fields : ~(uint32_t)0;
+    const bool need_header = fields & (BLOCK_HEADER_FIELD_VERSION | BLOCK_HEADER_FIELD_NONCE);
+    const bool need_block = fields & BLOCK_HEADER_FIELD_REWARD;
+    const bool need_hash = fields & (BLOCK_HEADER_FIELD_HASH | BLOCK_HEADER_FIELD_PREV_HASH);
+    try
+    {
+      crypto::hash prev_hash = null_hash;
+      if ((fields & BLOCK_HEADER_FIELD_PREV_HASH) && req.start_height > 0)
+        prev_hash = db.get_block_hash_from_height(req.start_height - 1);
+
+      for (uint64_t h = req.start_height; h <= req.end_height; ++h)
+      {
+        block blk;
+        if (need_block || need_header)
+        {
+          const blobdata blob = db.get_block_blob_from_height(h);
+          if (need_block ? !parse_and_validate_block_from_blob(blob, blk) : !parse_block_header_from_blob(blob, blk))
+          {
+            res.status = "Failed to parse block at height " + boost::lexical_cast<std::string>(h);
+            return true;
+          }
+        }
+
+        if (fields & BLOCK_HEADER_FIELD_VERSION)
+        {
+          res.major_versions.push_back(blk.major_version);
+          res.minor_versions.push_back(blk.minor_version);
+        }
+        if (fields & BLOCK_HEADER_FIELD_TIMESTAMP)
+          res.timestamps.push_back(db.get_block_timestamp(h));
+        if (fields & BLOCK_HEADER_FIELD_NONCE)
+          res.nonces.push_back(blk.nonce);
+        if (need_hash)
+        {
+          const crypto::hash hash = db.get_block_hash_from_height(h);
+          if (fields & BLOCK_HEADER_FIELD_PREV_HASH)
+            res.prev_hashes.push_back(prev_hash);
+          if (fields & BLOCK_HEADER_FIELD_HASH)
+            res.hashes.push_back(hash);
+          prev_hash = hash;
+        }
+        if (fields & BLOCK_HEADER_FIELD_DIFFICULTY)
+          res.difficulties.push_back(db.get_block_difficulty(h));
+        if (fields & BLOCK_HEADER_FIELD_REWARD)
+          res.rewards.push_back(get_block_reward(blk));
+        if (fields & BLOCK_HEADER_FIELD_SIZE)
+          res.sizes.push_back(db.get_block_size(h));
+      }
+    }
+    catch (const std::exception &e)
+    {
+      res.status = std::string("Failed to get block headers: ") + e.what();
+      return true;
+    }
+
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_get_block_header_by_height(const COMMAND_RPC_GET_BLOCK_HEADER_BY_HEIGHT::request& req, COMMAND_RPC_GET_BLOCK_HEADER_BY_HEIGHT::response& res, epee::json_rpc::error& error_resp){
     if(!check_core_busy())
     {
@@ -1035,6 +1803,14 @@ namespace cryptonote
       error_resp.message = std::string("Too big height: ") + std::to_string(req.height) + ", current blockchain height = " +  std::to_string(m_core.get_current_blockchain_height());
       return false;
     }
+    const std::string cache_key = "getblockheaderbyheight:" + std::to_string(req.height);
+    const uint64_t popped_blocks = m_core.get_blockchain_storage().get_popped_blocks_count();
+    if (m_response_cache.get(cache_key, popped_blocks, res))
+    {
+      // the one field which still moves
+      res.block_header.depth = m_core.get_current_blockchain_height() - req.height - 1;
+      return true;
+    }
     crypto::hash block_hash = m_core.get_block_id_by_height(req.height);
     block blk;
     bool have_block = m_core.get_block_by_hash(block_hash, blk);
@@ -1052,6 +1828,8 @@ namespace cryptonote
       return false;
     }
     res.status = CORE_RPC_STATUS_OK;
+    if (is_buried(req.height))
+      m_response_cache.add(cache_key, popped_blocks, res, sizeof(res) + res.block_header.hash.size() + res.block_header.prev_hash.size());
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
@@ -1062,6 +1840,14 @@ namespace cryptonote
       error_resp.message = "Core is busy.";
       return false;
     }
+    // by hash only, a height may name another block after a reorg
+    const std::string cache_key = "getblock:" + req.hash;
+    const uint64_t popped_blocks = m_core.get_blockchain_storage().get_popped_blocks_count();
+    if (!req.hash.empty() && m_response_cache.get(cache_key, popped_blocks, res))
+    {
+      res.block_header.depth = m_core.get_current_blockchain_height() - res.block_header.height - 1;
+      return true;
+    }
     crypto::hash block_hash;
     if (!req.hash.empty())
     {
@@ -1112,6 +1898,10 @@ namespace cryptonote
     res.blob = string_tools::buff_to_hex_nodelimer(t_serializable_object_to_blob(blk));
     res.json = obj_to_json_str(blk);
     res.status = CORE_RPC_STATUS_OK;
+
+    // alternative blocks are found by hash too, only main chain ones are settled
+    if (!req.hash.empty() && is_buried(block_height) && m_core.get_block_id_by_height(block_height) == block_hash)
+      m_response_cache.add(cache_key, popped_blocks, res, sizeof(res) + res.blob.size() + res.json.size() + res.tx_hashes.size() * 2 * sizeof(crypto::hash));
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
@@ -1161,6 +1951,17 @@ namespace cryptonote
     res.grey_peerlist_size = m_p2p.get_peerlist_manager().get_gray_peers_count();
     res.testnet = m_testnet;
     res.cumulative_difficulty = m_core.get_blockchain_storage().get_db().get_block_cumulative_difficulty(res.height - 1);
+    const tools::thread_group &verification_pool = m_core.get_blockchain_storage().get_verification_pool();
+    res.verification_queue = verification_pool.queue_depth();
+    res.verification_busy_time = verification_pool.busy_time() / 1000; // ms
+    const crypto::ring_member_cache_stats ring_member_cache = crypto::get_ring_member_cache_stats();
+    res.ring_member_cache_hits = ring_member_cache.hits;
+    res.ring_member_cache_misses = ring_member_cache.misses;
+    res.ring_member_cache_size = ring_member_cache.size;
+    const cryptonote::output_key_cache::stats output_key_cache = m_core.get_blockchain_storage().get_output_key_cache_stats();
+    res.output_key_cache_hits = output_key_cache.hits;
+    res.output_key_cache_misses = output_key_cache.misses;
+    res.output_key_cache_size = output_key_cache.size;
     res.status = CORE_RPC_STATUS_OK;
     return true;
   }
@@ -1291,6 +2092,7 @@ namespace cryptonote
       error_resp.message = "Core is busy.";
       return false;
     }
+    JSON_RPC_ENDPOINT_SLOT("get_output_histogram");
 
     std::map<uint64_t, std::tuple<uint64_t, uint64_t, uint64_t>> histogram;
     try
@@ -1315,6 +2117,52 @@ namespace cryptonote
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_output_distribution(const COMMAND_RPC_GET_OUTPUT_DISTRIBUTION::request& req, COMMAND_RPC_GET_OUTPUT_DISTRIBUTION::response& res, epee::json_rpc::error& error_resp)
+  {
+    if(!check_core_busy())
+    {
+      error_resp.code = CORE_RPC_ERROR_CODE_CORE_BUSY;
+      error_resp.message = "Core is busy.";
+      return false;
+    }
+    JSON_RPC_ENDPOINT_SLOT("get_output_distribution");
+
+    const uint64_t to_height = req.to_height ? req.to_height : std::numeric_limits<uint64_t>::max();
+    if (to_height < req.from_height)
+    {
+      error_resp.code = CORE_RPC_ERROR_CODE_WRONG_PARAM;
+      error_resp.message = "to_height is below from_height";
+      return false;
+    }
+
+    res.distributions.reserve(req.amounts.size());
+    for (uint64_t amount: req.amounts)
+    {
+      res.distributions.push_back(COMMAND_RPC_GET_OUTPUT_DISTRIBUTION::distribution());
+      COMMAND_RPC_GET_OUTPUT_DISTRIBUTION::distribution &d = res.distributions.back();
+      d.amount = amount;
+      d.start_height = req.from_height;
+      try
+      {
+        if (!m_core.get_blockchain_storage().get_output_distribution(amount, req.from_height, to_height, d.distribution, d.base))
+        {
+          error_resp.code = CORE_RPC_ERROR_CODE_TOO_BIG_HEIGHT;
+          error_resp.message = "from_height is past the top block";
+          return false;
+        }
+      }
+      catch (const std::exception &e)
+      {
+        res.status = "Failed to get output distribution";
+        res.distributions.clear();
+        return true;
+      }
+    }
+
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_get_version(const COMMAND_RPC_GET_VERSION::request& req, COMMAND_RPC_GET_VERSION::response& res, epee::json_rpc::error& error_resp)
   {
     res.version = CORE_RPC_VERSION;
@@ -1324,6 +2172,7 @@ namespace cryptonote
   //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_get_coinbase_tx_sum(const COMMAND_RPC_GET_COINBASE_TX_SUM::request& req, COMMAND_RPC_GET_COINBASE_TX_SUM::response& res, epee::json_rpc::error& error_resp)
   {
+    JSON_RPC_ENDPOINT_SLOT("get_coinbase_tx_sum");
     std::pair<uint64_t, uint64_t> amounts = m_core.get_coinbase_tx_sum(req.height, req.count);
     res.emission_amount = amounts.first;
     res.fee_amount = amounts.second;
@@ -1337,6 +2186,217 @@ namespace cryptonote
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_db_stats(const COMMAND_RPC_GET_DB_STATS::request& req, COMMAND_RPC_GET_DB_STATS::response& res, epee::json_rpc::error& error_resp)
+  {
+    std::vector<db_op_stats_t> stats;
+    m_core.get_blockchain_storage().get_db().get_op_stats(stats);
+    for (const auto &s: stats)
+    {
+      COMMAND_RPC_GET_DB_STATS::entry e;
+      e.method = s.method;
+      e.table = s.table;
+      e.calls = s.calls;
+      e.bytes_read = s.bytes_read;
+      e.cursor_ops = s.cursor_ops;
+      e.gets = s.gets;
+      e.p50_us = s.p50_us;
+      e.p99_us = s.p99_us;
+      res.entries.push_back(e);
+    }
+    db_sync_stats_t sync_stats;
+    m_core.get_blockchain_storage().get_db().get_sync_stats(sync_stats);
+    res.syncs = sync_stats.syncs;
+    res.unsynced_blocks = sync_stats.unsynced_blocks;
+    res.unsynced_bytes = sync_stats.unsynced_bytes;
+    res.sync_lag_ms = sync_stats.lag_ms;
+    res.max_sync_lag_ms = sync_stats.max_lag_ms;
+    res.last_sync_us = sync_stats.last_sync_us;
+    res.max_sync_us = sync_stats.max_sync_us;
+    res.total_sync_us = sync_stats.total_sync_us;
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_memory_stats(const COMMAND_RPC_GET_MEMORY_STATS::request& req, COMMAND_RPC_GET_MEMORY_STATS::response& res, epee::json_rpc::error& error_resp)
+  {
+    res.resident_bytes = tools::resident_memory();
+
+    res.txpool_count = m_core.get_pool_transactions_count();
+    res.txpool_bytes = m_core.get_pool_memory_usage();
+
+    const Blockchain::memory_stats chain_stats = m_core.get_blockchain_storage().get_memory_stats();
+    res.alt_blocks_count = chain_stats.alt_blocks_count;
+    res.alt_blocks_bytes = chain_stats.alt_blocks_bytes;
+    res.scan_table_bytes = chain_stats.scan_table_bytes;
+    res.longhash_table_bytes = chain_stats.longhash_table_bytes;
+
+    res.connections_count = m_p2p.get_connections_count();
+    res.connections_bytes = m_p2p.get_connections_memory();
+    nodetool::peerlist_manager& peerlist = m_p2p.get_peerlist_manager();
+    res.peerlist_count = peerlist.get_white_peers_count() + peerlist.get_gray_peers_count();
+    res.peerlist_bytes = peerlist.get_memory_usage();
+
+    db_memory_stats_t db_stats;
+    m_core.get_blockchain_storage().get_db().get_memory_stats(db_stats);
+    res.db_map_size = db_stats.map_size;
+    res.db_used_bytes = db_stats.used_bytes;
+    res.db_resident_bytes = db_stats.resident_bytes;
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_snapshot_db(const COMMAND_RPC_SNAPSHOT_DB::request& req, COMMAND_RPC_SNAPSHOT_DB::response& res, epee::json_rpc::error& error_resp)
+  {
+    Blockchain &blockchain = m_core.get_blockchain_storage();
+    if (!req.path.empty())
+    {
+      std::string error;
+      if (!blockchain.start_db_snapshot(req.path, req.max_rate_kB * 1000, error))
+      {
+        error_resp.code = CORE_RPC_ERROR_CODE_WRONG_PARAM;
+        error_resp.message = error;
+        return false;
+      }
+    }
+    const Blockchain::db_snapshot_status snapshot = blockchain.get_db_snapshot_status();
+    res.running = snapshot.running;
+    res.path = snapshot.path;
+    res.written = snapshot.written;
+    res.total = snapshot.total;
+    res.error = snapshot.error;
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_rpc_stats(const COMMAND_RPC_GET_RPC_STATS::request& req, COMMAND_RPC_GET_RPC_STATS::response& res, epee::json_rpc::error& error_resp)
+  {
+    res.fast_threads = m_fast_threads;
+    res.bulk_threads = m_bulk_pool.get_slots();
+    for (const epee::net_utils::http::method_stats *s: epee::net_utils::http::method_stats::get_all())
+    {
+      COMMAND_RPC_GET_RPC_STATS::method_entry e;
+      e.method = s->get_method();
+      e.calls = s->get_calls();
+      e.errors = s->get_errors();
+      e.bytes_out = s->get_bytes_out();
+      e.total_us = s->get_total_us();
+      e.p50_us = s->percentile(e.calls, 50);
+      e.p90_us = s->percentile(e.calls, 90);
+      e.p99_us = s->percentile(e.calls, 99);
+      for (unsigned i = 0; i < HTTP_METHOD_STATS_BUCKETS; ++i)
+        e.histogram.push_back(s->get_bucket(i));
+      res.methods.push_back(e);
+    }
+    for (const auto &i: m_endpoint_limits)
+    {
+      const rpc_endpoint_limit &limit = *i.second;
+      COMMAND_RPC_GET_RPC_STATS::limit_entry e;
+      e.endpoint = limit.name;
+      e.pool = limit.pool.get_name();
+      e.max_in_flight = limit.max_in_flight;
+      e.in_flight = limit.in_flight;
+      e.calls = limit.calls;
+      e.busy = limit.busy;
+      e.queue_time_us = limit.queue_time_us;
+      e.service_time_us = limit.service_time_us;
+      res.limits.push_back(e);
+    }
+    res.response_cache_entries = m_response_cache.get_count();
+    res.response_cache_bytes = m_response_cache.get_bytes();
+    res.response_cache_hits = m_response_cache.get_hits();
+    res.response_cache_misses = m_response_cache.get_misses();
+    res.client_limits_clients = m_client_limits.get_clients();
+    res.client_limits_busy = m_client_limits.get_busy();
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_net_stats(const COMMAND_RPC_GET_NET_STATS::request& req, COMMAND_RPC_GET_NET_STATS::response& res, epee::json_rpc::error& error_resp)
+  {
+    for (const auto &i: epee::net_utils::data_logger::get_command_traffic())
+    {
+      COMMAND_RPC_GET_NET_STATS::command_entry e;
+      e.command = i.first;
+      e.name = get_levin_command_name(i.first);
+      e.in_messages = i.second.in_messages;
+      e.in_bytes = i.second.in_bytes;
+      e.out_messages = i.second.out_messages;
+      e.out_bytes = i.second.out_bytes;
+      e.handler_us = i.second.handler_us;
+      res.commands.push_back(e);
+    }
+    for (const auto &i: epee::net_utils::data_logger::get_peer_traffic())
+    {
+      COMMAND_RPC_GET_NET_STATS::peer_entry e;
+      e.ip = i.first;
+      e.in_messages = i.second.in_messages;
+      e.in_bytes = i.second.in_bytes;
+      e.out_messages = i.second.out_messages;
+      e.out_bytes = i.second.out_bytes;
+      res.peers.push_back(e);
+    }
+    if (req.reset)
+      epee::net_utils::data_logger::reset_traffic();
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_block_processing_stats(const COMMAND_RPC_GET_BLOCK_PROCESSING_STATS::request& req, COMMAND_RPC_GET_BLOCK_PROCESSING_STATS::response& res, epee::json_rpc::error& error_resp)
+  {
+    const block_processing_stats stats = m_core.get_blockchain_storage().get_block_processing_stats();
+    res.blocks = stats.size();
+    for (size_t p = 0; p < block_processing_phases; ++p)
+    {
+      const block_processing_phase phase = (block_processing_phase)p;
+      COMMAND_RPC_GET_BLOCK_PROCESSING_STATS::phase_entry e;
+      e.phase = block_processing_stats::get_phase_name(phase);
+      e.total_us = stats.get_total_us(phase);
+      e.max_us = stats.get_max_us(phase);
+      e.p50_us = stats.percentile(phase, 50);
+      e.p90_us = stats.percentile(phase, 90);
+      e.p99_us = stats.percentile(phase, 99);
+      for (unsigned i = 0; i < BLOCK_PROCESSING_STATS_BUCKETS; ++i)
+        e.histogram.push_back(stats.get_bucket(phase, i));
+      res.phases.push_back(e);
+    }
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_perf_profile(const COMMAND_RPC_GET_PERF_PROFILE::request& req, COMMAND_RPC_GET_PERF_PROFILE::response& res, epee::json_rpc::error& error_resp)
+  {
+    const std::vector<tools::perf_profile_entry> entries = tools::get_performance_profile(req.reset, res.dropped);
+    for (const auto &e: entries)
+    {
+      COMMAND_RPC_GET_PERF_PROFILE::entry pe;
+      pe.path = e.path;
+      pe.calls = e.calls;
+      pe.total_us = e.total_ns / 1000;
+      pe.self_us = e.self_ns / 1000;
+      res.entries.push_back(pe);
+    }
+    res.folded = tools::get_performance_profile_folded(entries);
+    res.enabled = tools::get_performance_timers_enabled();
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_set_perf_profile(const COMMAND_RPC_SET_PERF_PROFILE::request& req, COMMAND_RPC_SET_PERF_PROFILE::response& res, epee::json_rpc::error& error_resp)
+  {
+    tools::set_performance_timers_enabled(req.enable);
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_metrics(const epee::net_utils::http::http_request_info& query_info, epee::net_utils::http::http_response_info& response_info, connection_context& context)
+  {
+    if (m_restricted)
+      return false;
+    response_info.m_body = epee::net_utils::http::get_method_stats_text("monerod_rpc");
+    response_info.m_mime_tipe = "text/plain; version=0.0.4";
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_out_peers(const COMMAND_RPC_OUT_PEERS::request& req, COMMAND_RPC_OUT_PEERS::response& res)
   {
 	  // TODO
@@ -1399,4 +2459,57 @@ namespace cryptonote
     , ""
     };
 
+  const command_line::arg_descriptor<size_t> core_rpc_server::arg_rpc_fast_threads = {
+      "rpc-fast-threads"
+    , "RPC threads kept for cheap calls, whatever bulk calls are running"
+    , 2
+    };
+
+  const command_line::arg_descriptor<size_t> core_rpc_server::arg_rpc_bulk_threads = {
+      "rpc-bulk-threads"
+    , "Most bulk RPC calls (blocks, outputs, transactions, ranges) served at once"
+    , 2
+    };
+
+  const command_line::arg_descriptor<size_t> core_rpc_server::arg_rpc_bulk_queue = {
+      "rpc-bulk-queue"
+    , "Most bulk RPC calls waiting for a bulk thread, more are answered BUSY"
+    , 4
+    };
+
+  const command_line::arg_descriptor<std::vector<std::string> > core_rpc_server::arg_rpc_max_concurrent = {
+      "rpc-max-concurrent"
+    , "Cap concurrent calls to one bulk endpoint, as <endpoint>=<count>, e.g. /getblocks.bin=1"
+    };
+
+  const command_line::arg_descriptor<size_t> core_rpc_server::arg_rpc_response_cache_size = {
+      "rpc-response-cache-size"
+    , "Megabytes of RPC responses about deep blocks and transactions kept in memory, 0 to disable"
+    , 32
+    };
+
+  const command_line::arg_descriptor<uint64_t> core_rpc_server::arg_rpc_client_rate = {
+      "rpc-client-rate"
+    , "With --restricted-rpc, kB of answers per second each client may get before bulk calls are answered BUSY, 0 for no limit"
+    , 2048
+    };
+
+  const command_line::arg_descriptor<uint64_t> core_rpc_server::arg_rpc_client_burst = {
+      "rpc-client-burst"
+    , "With --restricted-rpc, kB of answers a client may get at once after being idle"
+    , 65536
+    };
+
+  const command_line::arg_descriptor<size_t> core_rpc_server::arg_rpc_client_max_concurrent = {
+      "rpc-client-max-concurrent"
+    , "With --restricted-rpc, most bulk calls each client may have running or queued, 0 for no limit"
+    , 2
+    };
+
+  const command_line::arg_descriptor<std::string> core_rpc_server::arg_db_follow_rpc = {
+      "db-follow-rpc"
+    , "RPC address (host:port) of the daemon whose database --db-follow opens, which transactions and pool queries are passed on to"
+    , ""
+    };
+
 }  // namespace cryptonote
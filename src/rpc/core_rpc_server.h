@@ -32,9 +32,13 @@
 
 #include <boost/program_options/options_description.hpp>
 #include <boost/program_options/variables_map.hpp>
+#include <boost/thread/tss.hpp>
 
 #include "net/http_server_impl_base.h"
 #include "core_rpc_server_commands_defs.h"
+#include "rpc_limits.h"
+#include "rpc_response_cache.h"
+#include "common/http_client_pool.h"
 #include "cryptonote_core/cryptonote_core.h"
 #include "p2p/net_node.h"
 #include "cryptonote_protocol/cryptonote_protocol_handler.h"
@@ -57,6 +61,15 @@ namespace cryptonote
     static const command_line::arg_descriptor<std::string> arg_testnet_rpc_bind_port;
     static const command_line::arg_descriptor<bool> arg_restricted_rpc;
     static const command_line::arg_descriptor<std::string> arg_user_agent;
+    static const command_line::arg_descriptor<size_t> arg_rpc_fast_threads;
+    static const command_line::arg_descriptor<size_t> arg_rpc_bulk_threads;
+    static const command_line::arg_descriptor<size_t> arg_rpc_bulk_queue;
+    static const command_line::arg_descriptor<std::vector<std::string> > arg_rpc_max_concurrent;
+    static const command_line::arg_descriptor<size_t> arg_rpc_response_cache_size;
+    static const command_line::arg_descriptor<uint64_t> arg_rpc_client_rate;
+    static const command_line::arg_descriptor<uint64_t> arg_rpc_client_burst;
+    static const command_line::arg_descriptor<size_t> arg_rpc_client_max_concurrent;
+    static const command_line::arg_descriptor<std::string> arg_db_follow_rpc;
 
     typedef epee::net_utils::connection_context_base connection_context;
 
@@ -70,39 +83,54 @@ namespace cryptonote
         const boost::program_options::variables_map& vm
       );
     bool is_testnet() const { return m_testnet; }
+    /// Threads to run the server with: the fast ones plus all bulk calls may hold.
+    size_t get_threads_count() const;
 
-    CHAIN_HTTP_TO_MAP2(connection_context); //forward http requests to uri map
+    //forwards http requests to the uri map, charging the client for the answer
+    bool handle_http_request(const epee::net_utils::http::http_request_info& query_info, epee::net_utils::http::http_response_info& response, connection_context& m_conn_context);
 
     BEGIN_URI_MAP2()
       MAP_URI_AUTO_JON2("/getheight", on_get_height, COMMAND_RPC_GET_HEIGHT)
       MAP_URI_AUTO_BIN2("/getblocks.bin", on_get_blocks, COMMAND_RPC_GET_BLOCKS_FAST)
+      MAP_URI_AUTO_BIN2("/getblocks_range.bin", on_get_blocks_range, COMMAND_RPC_GET_BLOCKS_RANGE)
+      MAP_URI_AUTO_BIN2("/get_output_keys_range.bin", on_get_output_keys_range, COMMAND_RPC_GET_OUTPUT_KEYS_RANGE)
       MAP_URI_AUTO_BIN2("/gethashes.bin", on_get_hashes, COMMAND_RPC_GET_HASHES_FAST)
+      MAP_URI_AUTO_BIN2("/get_hashes_by_height.bin", on_get_hashes_by_height, COMMAND_RPC_GET_HASHES_BY_HEIGHT)
       MAP_URI_AUTO_BIN2("/get_o_indexes.bin", on_get_indexes, COMMAND_RPC_GET_TX_GLOBAL_OUTPUTS_INDEXES)      
+      MAP_URI_AUTO_BIN2("/get_txs_o_indexes.bin", on_get_txs_indexes, COMMAND_RPC_GET_TXS_GLOBAL_OUTPUTS_INDEXES)
       MAP_URI_AUTO_BIN2("/getrandom_outs.bin", on_get_random_outs, COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS)      
       MAP_URI_AUTO_BIN2("/get_outs.bin", on_get_outs_bin, COMMAND_RPC_GET_OUTPUTS_BIN)
       MAP_URI_AUTO_BIN2("/getrandom_rctouts.bin", on_get_random_rct_outs, COMMAND_RPC_GET_RANDOM_RCT_OUTPUTS)
       MAP_URI_AUTO_JON2("/gettransactions", on_get_transactions, COMMAND_RPC_GET_TRANSACTIONS)
       MAP_URI_AUTO_JON2("/is_key_image_spent", on_is_key_image_spent, COMMAND_RPC_IS_KEY_IMAGE_SPENT)
+      MAP_URI_AUTO_BIN2("/is_key_image_spent.bin", on_is_key_image_spent_bin, COMMAND_RPC_IS_KEY_IMAGE_SPENT_BIN)
       MAP_URI_AUTO_JON2("/sendrawtransaction", on_send_raw_tx, COMMAND_RPC_SEND_RAW_TX)
-      MAP_URI_AUTO_JON2_IF("/start_mining", on_start_mining, COMMAND_RPC_START_MINING, !m_restricted)
-      MAP_URI_AUTO_JON2_IF("/stop_mining", on_stop_mining, COMMAND_RPC_STOP_MINING, !m_restricted)
+      MAP_URI_AUTO_BIN2("/send_raw_transactions.bin", on_send_raw_txs, COMMAND_RPC_SEND_RAW_TXS)
+      MAP_URI_AUTO_JON2_IF("/start_mining", on_start_mining, COMMAND_RPC_START_MINING, !m_restricted && !m_db_follow)
+      MAP_URI_AUTO_JON2_IF("/stop_mining", on_stop_mining, COMMAND_RPC_STOP_MINING, !m_restricted && !m_db_follow)
       MAP_URI_AUTO_JON2_IF("/mining_status", on_mining_status, COMMAND_RPC_MINING_STATUS, !m_restricted)
-      MAP_URI_AUTO_JON2_IF("/save_bc", on_save_bc, COMMAND_RPC_SAVE_BC, !m_restricted)
+      MAP_URI_AUTO_JON2_IF("/save_bc", on_save_bc, COMMAND_RPC_SAVE_BC, !m_restricted && !m_db_follow)
       MAP_URI_AUTO_JON2_IF("/get_peer_list", on_get_peer_list, COMMAND_RPC_GET_PEER_LIST, !m_restricted)
       MAP_URI_AUTO_JON2_IF("/set_log_hash_rate", on_set_log_hash_rate, COMMAND_RPC_SET_LOG_HASH_RATE, !m_restricted)
       MAP_URI_AUTO_JON2_IF("/set_log_level", on_set_log_level, COMMAND_RPC_SET_LOG_LEVEL, !m_restricted)
       MAP_URI_AUTO_JON2("/get_transaction_pool", on_get_transaction_pool, COMMAND_RPC_GET_TRANSACTION_POOL)
+      MAP_URI_AUTO_BIN2("/get_transaction_pool_hashes.bin", on_get_transaction_pool_hashes, COMMAND_RPC_GET_TRANSACTION_POOL_HASHES)
+      MAP_URI_AUTO_BIN2("/get_transaction_pool_since.bin", on_get_transaction_pool_since, COMMAND_RPC_GET_TRANSACTION_POOL_SINCE)
+      MAP_URI_AUTO_BIN2("/get_events.bin", on_get_events, COMMAND_RPC_GET_EVENTS)
+      MAP_URI_AUTO_BIN2("/get_block_headers_range.bin", on_get_block_headers_range_bin, COMMAND_RPC_GET_BLOCK_HEADERS_RANGE_BIN)
       MAP_URI_AUTO_JON2_IF("/stop_daemon", on_stop_daemon, COMMAND_RPC_STOP_DAEMON, !m_restricted)
       MAP_URI_AUTO_JON2("/getinfo", on_get_info, COMMAND_RPC_GET_INFO)
       MAP_URI_AUTO_JON2_IF("/out_peers", on_out_peers, COMMAND_RPC_OUT_PEERS, !m_restricted)
       MAP_URI_AUTO_JON2_IF("/start_save_graph", on_start_save_graph, COMMAND_RPC_START_SAVE_GRAPH, !m_restricted)
       MAP_URI_AUTO_JON2_IF("/stop_save_graph", on_stop_save_graph, COMMAND_RPC_STOP_SAVE_GRAPH, !m_restricted)
       MAP_URI_AUTO_JON2("/get_outs", on_get_outs, COMMAND_RPC_GET_OUTPUTS)      
-      BEGIN_JSON_RPC_MAP("/json_rpc")
+      MAP_URI2("/metrics", on_get_metrics)
+      // handlers already run on many server threads, so batched calls can too
+      BEGIN_JSON_RPC_MAP_CONCURRENT("/json_rpc", m_fast_threads)
         MAP_JON_RPC("getblockcount",             on_getblockcount,              COMMAND_RPC_GETBLOCKCOUNT)
         MAP_JON_RPC_WE("on_getblockhash",        on_getblockhash,               COMMAND_RPC_GETBLOCKHASH)
-        MAP_JON_RPC_WE("getblocktemplate",       on_getblocktemplate,           COMMAND_RPC_GETBLOCKTEMPLATE)
-        MAP_JON_RPC_WE("submitblock",            on_submitblock,                COMMAND_RPC_SUBMITBLOCK)
+        MAP_JON_RPC_WE_IF("getblocktemplate",    on_getblocktemplate,           COMMAND_RPC_GETBLOCKTEMPLATE, !m_db_follow)
+        MAP_JON_RPC_WE_IF("submitblock",         on_submitblock,                COMMAND_RPC_SUBMITBLOCK, !m_db_follow)
         MAP_JON_RPC_WE("getlastblockheader",     on_get_last_block_header,      COMMAND_RPC_GET_LAST_BLOCK_HEADER)
         MAP_JON_RPC_WE("getblockheaderbyhash",   on_get_block_header_by_hash,   COMMAND_RPC_GET_BLOCK_HEADER_BY_HASH)
         MAP_JON_RPC_WE("getblockheaderbyheight", on_get_block_header_by_height, COMMAND_RPC_GET_BLOCK_HEADER_BY_HEIGHT)
@@ -113,21 +141,36 @@ namespace cryptonote
         MAP_JON_RPC_WE("hard_fork_info",         on_hard_fork_info,             COMMAND_RPC_HARD_FORK_INFO)
         MAP_JON_RPC_WE_IF("set_bans",            on_set_bans,                   COMMAND_RPC_SETBANS, !m_restricted)
         MAP_JON_RPC_WE_IF("get_bans",            on_get_bans,                   COMMAND_RPC_GETBANS, !m_restricted)
-        MAP_JON_RPC_WE_IF("flush_txpool",        on_flush_txpool,               COMMAND_RPC_FLUSH_TRANSACTION_POOL, !m_restricted)
+        MAP_JON_RPC_WE_IF("flush_txpool",        on_flush_txpool,               COMMAND_RPC_FLUSH_TRANSACTION_POOL, !m_restricted && !m_db_follow)
         MAP_JON_RPC_WE("get_output_histogram",   on_get_output_histogram,       COMMAND_RPC_GET_OUTPUT_HISTOGRAM)
+        MAP_JON_RPC_WE("get_output_distribution", on_get_output_distribution,   COMMAND_RPC_GET_OUTPUT_DISTRIBUTION)
         MAP_JON_RPC_WE("get_version",            on_get_version,                COMMAND_RPC_GET_VERSION)
         MAP_JON_RPC_WE("get_coinbase_tx_sum",    on_get_coinbase_tx_sum,        COMMAND_RPC_GET_COINBASE_TX_SUM)
         MAP_JON_RPC_WE("get_fee_estimate",       on_get_per_kb_fee_estimate,    COMMAND_RPC_GET_PER_KB_FEE_ESTIMATE)
+        MAP_JON_RPC_WE_IF("get_db_stats",        on_get_db_stats,               COMMAND_RPC_GET_DB_STATS, !m_restricted)
+        MAP_JON_RPC_WE_IF("get_memory_stats",    on_get_memory_stats,           COMMAND_RPC_GET_MEMORY_STATS, !m_restricted)
+        MAP_JON_RPC_WE_IF("snapshot_db",         on_snapshot_db,                COMMAND_RPC_SNAPSHOT_DB, !m_restricted)
+        MAP_JON_RPC_WE_IF("get_rpc_stats",       on_get_rpc_stats,              COMMAND_RPC_GET_RPC_STATS, !m_restricted)
+        MAP_JON_RPC_WE_IF("get_net_stats",       on_get_net_stats,              COMMAND_RPC_GET_NET_STATS, !m_restricted)
+        MAP_JON_RPC_WE_IF("get_block_processing_stats", on_get_block_processing_stats, COMMAND_RPC_GET_BLOCK_PROCESSING_STATS, !m_restricted)
+        MAP_JON_RPC_WE_IF("get_perf_profile",    on_get_perf_profile,           COMMAND_RPC_GET_PERF_PROFILE, !m_restricted)
+        MAP_JON_RPC_WE_IF("set_perf_profile",    on_set_perf_profile,           COMMAND_RPC_SET_PERF_PROFILE, !m_restricted)
       END_JSON_RPC_MAP()
     END_URI_MAP2()
 
     bool on_get_height(const COMMAND_RPC_GET_HEIGHT::request& req, COMMAND_RPC_GET_HEIGHT::response& res);
     bool on_get_blocks(const COMMAND_RPC_GET_BLOCKS_FAST::request& req, COMMAND_RPC_GET_BLOCKS_FAST::response& res);
+    bool on_get_blocks_range(const COMMAND_RPC_GET_BLOCKS_RANGE::request& req, COMMAND_RPC_GET_BLOCKS_RANGE::response& res);
+    bool on_get_output_keys_range(const COMMAND_RPC_GET_OUTPUT_KEYS_RANGE::request& req, COMMAND_RPC_GET_OUTPUT_KEYS_RANGE::response& res);
     bool on_get_hashes(const COMMAND_RPC_GET_HASHES_FAST::request& req, COMMAND_RPC_GET_HASHES_FAST::response& res);
+    bool on_get_hashes_by_height(const COMMAND_RPC_GET_HASHES_BY_HEIGHT::request& req, COMMAND_RPC_GET_HASHES_BY_HEIGHT::response& res);
     bool on_get_transactions(const COMMAND_RPC_GET_TRANSACTIONS::request& req, COMMAND_RPC_GET_TRANSACTIONS::response& res);
     bool on_is_key_image_spent(const COMMAND_RPC_IS_KEY_IMAGE_SPENT::request& req, COMMAND_RPC_IS_KEY_IMAGE_SPENT::response& res);
+    bool on_is_key_image_spent_bin(const COMMAND_RPC_IS_KEY_IMAGE_SPENT_BIN::request& req, COMMAND_RPC_IS_KEY_IMAGE_SPENT_BIN::response& res);
     bool on_get_indexes(const COMMAND_RPC_GET_TX_GLOBAL_OUTPUTS_INDEXES::request& req, COMMAND_RPC_GET_TX_GLOBAL_OUTPUTS_INDEXES::response& res);
+    bool on_get_txs_indexes(const COMMAND_RPC_GET_TXS_GLOBAL_OUTPUTS_INDEXES::request& req, COMMAND_RPC_GET_TXS_GLOBAL_OUTPUTS_INDEXES::response& res);
     bool on_send_raw_tx(const COMMAND_RPC_SEND_RAW_TX::request& req, COMMAND_RPC_SEND_RAW_TX::response& res);
+    bool on_send_raw_txs(const COMMAND_RPC_SEND_RAW_TXS::request& req, COMMAND_RPC_SEND_RAW_TXS::response& res);
     bool on_start_mining(const COMMAND_RPC_START_MINING::request& req, COMMAND_RPC_START_MINING::response& res);
     bool on_stop_mining(const COMMAND_RPC_STOP_MINING::request& req, COMMAND_RPC_STOP_MINING::response& res);
     bool on_mining_status(const COMMAND_RPC_MINING_STATUS::request& req, COMMAND_RPC_MINING_STATUS::response& res);
@@ -141,10 +184,16 @@ namespace cryptonote
     bool on_set_log_hash_rate(const COMMAND_RPC_SET_LOG_HASH_RATE::request& req, COMMAND_RPC_SET_LOG_HASH_RATE::response& res);
     bool on_set_log_level(const COMMAND_RPC_SET_LOG_LEVEL::request& req, COMMAND_RPC_SET_LOG_LEVEL::response& res);
     bool on_get_transaction_pool(const COMMAND_RPC_GET_TRANSACTION_POOL::request& req, COMMAND_RPC_GET_TRANSACTION_POOL::response& res);
+    bool on_get_transaction_pool_hashes(const COMMAND_RPC_GET_TRANSACTION_POOL_HASHES::request& req, COMMAND_RPC_GET_TRANSACTION_POOL_HASHES::response& res);
+    bool on_get_transaction_pool_since(const COMMAND_RPC_GET_TRANSACTION_POOL_SINCE::request& req, COMMAND_RPC_GET_TRANSACTION_POOL_SINCE::response& res);
+    bool on_get_events(const COMMAND_RPC_GET_EVENTS::request& req, COMMAND_RPC_GET_EVENTS::response& res);
+    bool on_get_block_headers_range_bin(const COMMAND_RPC_GET_BLOCK_HEADERS_RANGE_BIN::request& req, COMMAND_RPC_GET_BLOCK_HEADERS_RANGE_BIN::response& res);
     bool on_stop_daemon(const COMMAND_RPC_STOP_DAEMON::request& req, COMMAND_RPC_STOP_DAEMON::response& res);
     bool on_out_peers(const COMMAND_RPC_OUT_PEERS::request& req, COMMAND_RPC_OUT_PEERS::response& res);
     bool on_start_save_graph(const COMMAND_RPC_START_SAVE_GRAPH::request& req, COMMAND_RPC_START_SAVE_GRAPH::response& res);
     bool on_stop_save_graph(const COMMAND_RPC_STOP_SAVE_GRAPH::request& req, COMMAND_RPC_STOP_SAVE_GRAPH::response& res);
+    // per method call statistics in the Prometheus text format, not on restricted RPC
+    bool on_get_metrics(const epee::net_utils::http::http_request_info& query_info, epee::net_utils::http::http_response_info& response_info, connection_context& context);
     
     //json_rpc
     bool on_getblockcount(const COMMAND_RPC_GETBLOCKCOUNT::request& req, COMMAND_RPC_GETBLOCKCOUNT::response& res);
@@ -163,9 +212,18 @@ namespace cryptonote
     bool on_get_bans(const COMMAND_RPC_GETBANS::request& req, COMMAND_RPC_GETBANS::response& res, epee::json_rpc::error& error_resp);
     bool on_flush_txpool(const COMMAND_RPC_FLUSH_TRANSACTION_POOL::request& req, COMMAND_RPC_FLUSH_TRANSACTION_POOL::response& res, epee::json_rpc::error& error_resp);
     bool on_get_output_histogram(const COMMAND_RPC_GET_OUTPUT_HISTOGRAM::request& req, COMMAND_RPC_GET_OUTPUT_HISTOGRAM::response& res, epee::json_rpc::error& error_resp);
+    bool on_get_output_distribution(const COMMAND_RPC_GET_OUTPUT_DISTRIBUTION::request& req, COMMAND_RPC_GET_OUTPUT_DISTRIBUTION::response& res, epee::json_rpc::error& error_resp);
     bool on_get_version(const COMMAND_RPC_GET_VERSION::request& req, COMMAND_RPC_GET_VERSION::response& res, epee::json_rpc::error& error_resp);
     bool on_get_coinbase_tx_sum(const COMMAND_RPC_GET_COINBASE_TX_SUM::request& req, COMMAND_RPC_GET_COINBASE_TX_SUM::response& res, epee::json_rpc::error& error_resp);
     bool on_get_per_kb_fee_estimate(const COMMAND_RPC_GET_PER_KB_FEE_ESTIMATE::request& req, COMMAND_RPC_GET_PER_KB_FEE_ESTIMATE::response& res, epee::json_rpc::error& error_resp);
+    bool on_get_db_stats(const COMMAND_RPC_GET_DB_STATS::request& req, COMMAND_RPC_GET_DB_STATS::response& res, epee::json_rpc::error& error_resp);
+    bool on_get_memory_stats(const COMMAND_RPC_GET_MEMORY_STATS::request& req, COMMAND_RPC_GET_MEMORY_STATS::response& res, epee::json_rpc::error& error_resp);
+    bool on_snapshot_db(const COMMAND_RPC_SNAPSHOT_DB::request& req, COMMAND_RPC_SNAPSHOT_DB::response& res, epee::json_rpc::error& error_resp);
+    bool on_get_rpc_stats(const COMMAND_RPC_GET_RPC_STATS::request& req, COMMAND_RPC_GET_RPC_STATS::response& res, epee::json_rpc::error& error_resp);
+    bool on_get_net_stats(const COMMAND_RPC_GET_NET_STATS::request& req, COMMAND_RPC_GET_NET_STATS::response& res, epee::json_rpc::error& error_resp);
+    bool on_get_block_processing_stats(const COMMAND_RPC_GET_BLOCK_PROCESSING_STATS::request& req, COMMAND_RPC_GET_BLOCK_PROCESSING_STATS::response& res, epee::json_rpc::error& error_resp);
+    bool on_get_perf_profile(const COMMAND_RPC_GET_PERF_PROFILE::request& req, COMMAND_RPC_GET_PERF_PROFILE::response& res, epee::json_rpc::error& error_resp);
+    bool on_set_perf_profile(const COMMAND_RPC_SET_PERF_PROFILE::request& req, COMMAND_RPC_SET_PERF_PROFILE::response& res, epee::json_rpc::error& error_resp);
     //-----------------------
 
 private:
@@ -175,16 +233,56 @@ private:
       );
     bool check_core_busy();
     bool check_core_ready();
+    /// The address of the client whose request this thread is handling.
+    uint32_t get_current_client() const;
     
     //utils
     uint64_t get_block_reward(const block& blk);
     bool fill_block_header_response(const block& blk, bool orphan_status, uint64_t height, const crypto::hash& hash, block_header_response& response);
-    
+    bool get_blocks_range(uint64_t start_height, uint64_t count, COMMAND_RPC_GET_BLOCKS_FAST::response& res);
+    bool get_cached_blocks(uint64_t start_height, uint64_t count, const crypto::hash& top_id, COMMAND_RPC_GET_BLOCKS_FAST::response& res);
+    void add_cached_blocks(const crypto::hash& top_id, const COMMAND_RPC_GET_BLOCKS_FAST::response& res);
+    bool is_buried(uint64_t height);
+    //fills res with the prefix and ringct base of the txs found, in the chain then the pool; false once res.status is set to a failure
+    bool get_pruned_transactions(const std::vector<crypto::hash>& vh, bool decode_as_json, COMMAND_RPC_GET_TRANSACTIONS::response& res, std::list<crypto::hash>& missed_txs, size_t& found_in_pool);
+    bool get_key_images_spent_status(const std::vector<crypto::key_image>& key_images, std::vector<int>& spent_status);
+
+    // a getblocks.bin response, valid as long as the chain's top is top_id
+    struct blocks_cache_entry
+    {
+      crypto::hash top_id;
+      COMMAND_RPC_GET_BLOCKS_FAST::response res;
+    };
+
     core& m_core;
     nodetool::node_server<cryptonote::t_cryptonote_protocol_handler<cryptonote::core> >& m_p2p;
     std::string m_port;
     std::string m_bind_ip;
     bool m_testnet;
     bool m_restricted;
+
+    // when the core follows another daemon's database, transactions and pool
+    // queries go to that daemon's RPC, the pool being its own
+    bool m_db_follow;
+    std::string m_db_follow_rpc;
+    tools::http_client_pool m_db_follow_clients;
+
+    // recently served getblocks.bin responses, most recent first, so wallets
+    // syncing the same range near the tip do not each rebuild it
+    std::list<blocks_cache_entry> m_blocks_cache;
+    epee::critical_section m_blocks_cache_lock;
+
+    // bulk calls share m_bulk_pool, so they can't take the fast threads
+    size_t m_fast_threads;
+    rpc_handler_pool m_bulk_pool;
+    // get_events long polls park a thread each, so only this many may wait
+    rpc_handler_pool m_long_poll_pool;
+    std::map<std::string, std::unique_ptr<rpc_endpoint_limit> > m_endpoint_limits;
+    // in restricted mode, budgets of response bytes and bulk calls per client
+    rpc_client_limits m_client_limits;
+    boost::thread_specific_ptr<uint32_t> m_current_client;
+
+    // responses about blocks too deep to be reorganized away, by request
+    rpc_response_cache m_response_cache;
   };
 }
@@ -49,7 +49,7 @@ namespace cryptonote
 // advance which version they will stop working with
 // Don't go over 32767 for any of these
 #define CORE_RPC_VERSION_MAJOR 1
-#define CORE_RPC_VERSION_MINOR 0
+#define CORE_RPC_VERSION_MINOR 15
 #define CORE_RPC_VERSION (((CORE_RPC_VERSION_MAJOR)<<16)|(CORE_RPC_VERSION_MINOR))
 
   struct COMMAND_RPC_GET_HEIGHT
@@ -79,9 +79,11 @@ namespace cryptonote
     {
       std::list<crypto::hash> block_ids; //*first 10 blocks id goes sequential, next goes in pow(2,n) offset, like 2, 4, 8, 16, 32, 64 and so on, and the last one is always genesis block */
       uint64_t    start_height;
+      uint64_t    max_count; // at most this many blocks, 0 for COMMAND_RPC_GET_BLOCKS_FAST_MAX_COUNT
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE_CONTAINER_POD_AS_BLOB(block_ids)
         KV_SERIALIZE(start_height)
+        KV_SERIALIZE(max_count)
       END_KV_SERIALIZE_MAP()
     };
 
@@ -105,7 +107,7 @@ namespace cryptonote
 
     struct response
     {
-      std::list<block_complete_entry> blocks;
+      std::vector<block_complete_entry> blocks;
       uint64_t    start_height;
       uint64_t    current_height;
       std::string status;
@@ -121,6 +123,75 @@ namespace cryptonote
     };
   };
 
+  // like COMMAND_RPC_GET_BLOCKS_FAST, for the blocks from start_height to
+  // end_height included, without a short chain history to walk
+  struct COMMAND_RPC_GET_BLOCKS_RANGE
+  {
+    struct request
+    {
+      uint64_t start_height;
+      uint64_t end_height;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(start_height)
+        KV_SERIALIZE(end_height)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    typedef COMMAND_RPC_GET_BLOCKS_FAST::response response;
+  };
+
+  // what a wallet needs to find its outputs in the blocks from start_height
+  // to end_height included, without signatures or range proofs. Each field
+  // is a packed column: one entry per block in block_tx_counts, per tx
+  // (miner tx first) in the tx fields, per output in the output fields.
+  // ecdh fields are zero for outputs of non ringct txs, amounts are zero
+  // for ringct outputs.
+  struct COMMAND_RPC_GET_OUTPUT_KEYS_RANGE
+  {
+    struct request
+    {
+      uint64_t start_height;
+      uint64_t end_height;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(start_height)
+        KV_SERIALIZE(end_height)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      std::string status;
+      uint64_t start_height;
+      uint64_t current_height;
+      std::vector<uint32_t> block_tx_counts;
+      std::vector<crypto::hash> tx_hashes;
+      std::vector<crypto::public_key> tx_pub_keys;
+      std::vector<uint32_t> tx_output_counts;
+      std::vector<crypto::public_key> output_keys;
+      std::vector<uint64_t> amounts;
+      std::vector<uint64_t> output_indices;
+      std::vector<rct::key> ecdh_masks;
+      std::vector<rct::key> ecdh_amounts;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(status)
+        KV_SERIALIZE(start_height)
+        KV_SERIALIZE(current_height)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(block_tx_counts)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(tx_hashes)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(tx_pub_keys)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(tx_output_counts)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(output_keys)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(amounts)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(output_indices)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(ecdh_masks)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(ecdh_amounts)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
   struct COMMAND_RPC_GET_HASHES_FAST
   {
 
@@ -150,6 +221,33 @@ namespace cryptonote
     };
   };
 
+  // the hashes of the blocks at the given heights, all below current_height,
+  // at most COMMAND_RPC_GET_HASHES_BY_HEIGHT_MAX_COUNT of them
+  struct COMMAND_RPC_GET_HASHES_BY_HEIGHT
+  {
+    struct request
+    {
+      std::vector<uint64_t> heights;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(heights)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      std::vector<crypto::hash> hashes;
+      uint64_t current_height;
+      std::string status;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(hashes)
+        KV_SERIALIZE(current_height)
+        KV_SERIALIZE(status)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
   //-----------------------------------------------
   struct COMMAND_RPC_GET_TRANSACTIONS
   {
@@ -157,10 +255,12 @@ namespace cryptonote
     {
       std::list<std::string> txs_hashes;
       bool decode_as_json;
+      bool prune = false; // only the prefix and ringct base, with prunable_hash standing for the rest
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(txs_hashes)
         KV_SERIALIZE(decode_as_json)
+        KV_SERIALIZE(prune)
       END_KV_SERIALIZE_MAP()
     };
 
@@ -169,6 +269,7 @@ namespace cryptonote
       std::string tx_hash;
       std::string as_hex;
       std::string as_json;
+      std::string prunable_hash; // when pruned: with the prefix and base hashes, makes the hash of a v2 tx
       bool in_pool;
       uint64_t block_height;
       std::vector<uint64_t> output_indices;
@@ -177,6 +278,7 @@ namespace cryptonote
         KV_SERIALIZE(tx_hash)
         KV_SERIALIZE(as_hex)
         KV_SERIALIZE(as_json)
+        KV_SERIALIZE(prunable_hash)
         KV_SERIALIZE(in_pool)
         KV_SERIALIZE(block_height)
         KV_SERIALIZE(output_indices)
@@ -237,6 +339,32 @@ namespace cryptonote
     };
   };
 
+  //-----------------------------------------------
+  // binary is_key_image_spent, for wallets checking many key images at once,
+  // at most COMMAND_RPC_IS_KEY_IMAGE_SPENT_MAX_COUNT of them
+  struct COMMAND_RPC_IS_KEY_IMAGE_SPENT_BIN
+  {
+    struct request
+    {
+      std::vector<crypto::key_image> key_images;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(key_images)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      std::vector<int> spent_status;
+      std::string status;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(spent_status)
+        KV_SERIALIZE(status)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
   //-----------------------------------------------
   struct COMMAND_RPC_GET_TX_GLOBAL_OUTPUTS_INDEXES
   {
@@ -260,6 +388,33 @@ namespace cryptonote
     };
   };
   //-----------------------------------------------
+  // get_o_indexes.bin for many transactions at once, at most
+  // COMMAND_RPC_GET_TXS_GLOBAL_OUTPUTS_INDEXES_MAX_COUNT of them
+  struct COMMAND_RPC_GET_TXS_GLOBAL_OUTPUTS_INDEXES
+  {
+    struct request
+    {
+      std::vector<crypto::hash> txids;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(txids)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      std::vector<COMMAND_RPC_GET_BLOCKS_FAST::tx_output_indices> o_indexes; // in request order, empty for missed txids
+      std::vector<crypto::hash> missed_txids;
+      std::string status;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(o_indexes)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(missed_txids)
+        KV_SERIALIZE(status)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+  //-----------------------------------------------
   struct COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS
   {
     struct request
@@ -463,6 +618,61 @@ namespace cryptonote
     };
   };
   //-----------------------------------------------
+  struct COMMAND_RPC_SEND_RAW_TXS
+  {
+    struct request
+    {
+      std::list<std::string> txs;  // binary blobs, at most COMMAND_RPC_SEND_RAW_TXS_MAX_COUNT
+      bool do_not_relay;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(txs)
+        KV_SERIALIZE(do_not_relay)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    // as COMMAND_RPC_SEND_RAW_TX::response, for one of the txs
+    struct tx_result
+    {
+      std::string status;
+      std::string reason;
+      bool not_relayed;
+      bool low_mixin;
+      bool double_spend;
+      bool invalid_input;
+      bool invalid_output;
+      bool too_big;
+      bool overspend;
+      bool fee_too_low;
+      bool not_rct;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(status)
+        KV_SERIALIZE(reason)
+        KV_SERIALIZE(not_relayed)
+        KV_SERIALIZE(low_mixin)
+        KV_SERIALIZE(double_spend)
+        KV_SERIALIZE(invalid_input)
+        KV_SERIALIZE(invalid_output)
+        KV_SERIALIZE(too_big)
+        KV_SERIALIZE(overspend)
+        KV_SERIALIZE(fee_too_low)
+        KV_SERIALIZE(not_rct)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      std::string status;
+      std::vector<tx_result> results;  // in the order of the request
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(status)
+        KV_SERIALIZE(results)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+  //-----------------------------------------------
   struct COMMAND_RPC_START_MINING
   {
     struct request
@@ -512,6 +722,14 @@ namespace cryptonote
       bool testnet;
       std::string top_block_hash;
       uint64_t cumulative_difficulty;
+      uint64_t verification_queue;
+      uint64_t verification_busy_time;
+      uint64_t ring_member_cache_hits;
+      uint64_t ring_member_cache_misses;
+      uint64_t ring_member_cache_size;
+      uint64_t output_key_cache_hits;
+      uint64_t output_key_cache_misses;
+      uint64_t output_key_cache_size;
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(status)
@@ -529,6 +747,14 @@ namespace cryptonote
         KV_SERIALIZE(testnet)
         KV_SERIALIZE(top_block_hash)
         KV_SERIALIZE(cumulative_difficulty)
+        KV_SERIALIZE(verification_queue)
+        KV_SERIALIZE(verification_busy_time)
+        KV_SERIALIZE(ring_member_cache_hits)
+        KV_SERIALIZE(ring_member_cache_misses)
+        KV_SERIALIZE(ring_member_cache_size)
+        KV_SERIALIZE(output_key_cache_hits)
+        KV_SERIALIZE(output_key_cache_misses)
+        KV_SERIALIZE(output_key_cache_size)
       END_KV_SERIALIZE_MAP()
     };
   };
@@ -637,10 +863,12 @@ namespace cryptonote
     {
       uint64_t reserve_size;       //max 255 bytes
       std::string wallet_address;
+      uint64_t template_version;   //if the current one, waits for a new template (long poll)
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(reserve_size)
         KV_SERIALIZE(wallet_address)
+        KV_SERIALIZE(template_version)
       END_KV_SERIALIZE_MAP()
     };
 
@@ -652,6 +880,7 @@ namespace cryptonote
       std::string prev_hash;
       blobdata blocktemplate_blob;
       blobdata blockhashing_blob;
+      uint64_t template_version;
       std::string status;
 
       BEGIN_KV_SERIALIZE_MAP()
@@ -661,6 +890,7 @@ namespace cryptonote
         KV_SERIALIZE(prev_hash)
         KV_SERIALIZE(blocktemplate_blob)
         KV_SERIALIZE(blockhashing_blob)
+        KV_SERIALIZE(template_version)
         KV_SERIALIZE(status)
       END_KV_SERIALIZE_MAP()
     };
@@ -956,6 +1186,107 @@ namespace cryptonote
     };
   };
 
+  struct COMMAND_RPC_GET_TRANSACTION_POOL_HASHES
+  {
+    struct request
+    {
+      BEGIN_KV_SERIALIZE_MAP()
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      std::string status;
+      std::vector<crypto::hash> tx_hashes;
+      uint64_t pool_version;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(status)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(tx_hashes)
+        KV_SERIALIZE(pool_version)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  struct COMMAND_RPC_GET_TRANSACTION_POOL_SINCE
+  {
+    struct request
+    {
+      uint64_t pool_version;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(pool_version)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      std::string status;
+      bool full;  // the changes were not known, added is the whole pool
+      std::vector<crypto::hash> added_tx_hashes;
+      std::vector<crypto::hash> removed_tx_hashes;
+      uint64_t pool_version;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(status)
+        KV_SERIALIZE(full)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(added_tx_hashes)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(removed_tx_hashes)
+        KV_SERIALIZE(pool_version)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  struct COMMAND_RPC_GET_EVENTS
+  {
+    struct request
+    {
+      uint64_t since;         // last_seq of the previous call, 0 for the first
+      uint64_t wait_seconds = 0;  // if nothing came after since, waits this long for an event (long poll)
+      uint64_t max_count = 0;     // most events to return, 0 for COMMAND_RPC_GET_EVENTS_MAX_COUNT
+      bool include_blobs = false; // also return the blocks and transactions, if they can still be found
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(since)
+        KV_SERIALIZE(wait_seconds)
+        KV_SERIALIZE(max_count)
+        KV_SERIALIZE(include_blobs)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct event_entry
+    {
+      uint64_t seq;
+      std::string type;  // see chain_events::get_type_name
+      crypto::hash hash;
+      uint64_t height;
+      std::string blob;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(seq)
+        KV_SERIALIZE(type)
+        KV_SERIALIZE_VAL_POD_AS_BLOB(hash)
+        KV_SERIALIZE(height)
+        KV_SERIALIZE(blob)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      std::string status;
+      bool full;  // the events after since were not known, resync from last_seq
+      std::vector<event_entry> events;
+      uint64_t last_seq;  // pass as since in the next call
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(status)
+        KV_SERIALIZE(full)
+        KV_SERIALIZE(events)
+        KV_SERIALIZE(last_seq)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
   struct COMMAND_RPC_GET_CONNECTIONS
   {
     struct request
@@ -1002,6 +1333,65 @@ namespace cryptonote
     };
   };
 
+  // header fields COMMAND_RPC_GET_BLOCK_HEADERS_RANGE_BIN returns, none
+  // selected means all of them
+  enum
+  {
+    BLOCK_HEADER_FIELD_VERSION = 1 << 0,
+    BLOCK_HEADER_FIELD_TIMESTAMP = 1 << 1,
+    BLOCK_HEADER_FIELD_PREV_HASH = 1 << 2,
+    BLOCK_HEADER_FIELD_NONCE = 1 << 3,
+    BLOCK_HEADER_FIELD_HASH = 1 << 4,
+    BLOCK_HEADER_FIELD_DIFFICULTY = 1 << 5,
+    BLOCK_HEADER_FIELD_REWARD = 1 << 6,
+    BLOCK_HEADER_FIELD_SIZE = 1 << 7,
+  };
+
+  struct COMMAND_RPC_GET_BLOCK_HEADERS_RANGE_BIN
+  {
+    struct request
+    {
+      uint64_t start_height;
+      uint64_t end_height;
+      uint32_t fields;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(start_height)
+        KV_SERIALIZE(end_height)
+        KV_SERIALIZE(fields)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    // one entry per height from start_height to end_height in each of the
+    // selected fields, the others are left empty
+    struct response
+    {
+      std::string status;
+      std::vector<uint8_t> major_versions;
+      std::vector<uint8_t> minor_versions;
+      std::vector<uint64_t> timestamps;
+      std::vector<crypto::hash> prev_hashes;
+      std::vector<uint32_t> nonces;
+      std::vector<crypto::hash> hashes;
+      std::vector<difficulty_type> difficulties;
+      std::vector<uint64_t> rewards;
+      std::vector<uint64_t> sizes;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(status)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(major_versions)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(minor_versions)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(timestamps)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(prev_hashes)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(nonces)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(hashes)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(difficulties)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(rewards)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(sizes)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
   struct COMMAND_RPC_STOP_DAEMON
   {
     struct request
@@ -1267,6 +1657,50 @@ namespace cryptonote
     };
   };
 
+  // cumulative output counts per block, for wallets picking decoys themselves
+  // and fetching them through get_outs.bin; RingCT outputs are amount 0
+  struct COMMAND_RPC_GET_OUTPUT_DISTRIBUTION
+  {
+    struct request
+    {
+      std::vector<uint64_t> amounts;
+      uint64_t from_height;
+      uint64_t to_height; // 0 for the top block
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(amounts)
+        KV_SERIALIZE(from_height)
+        KV_SERIALIZE(to_height)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct distribution
+    {
+      uint64_t amount;
+      uint64_t start_height;
+      uint64_t base; // outputs before start_height
+      std::vector<uint64_t> distribution; // outputs up to and including start_height + n
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(amount)
+        KV_SERIALIZE(start_height)
+        KV_SERIALIZE(base)
+        KV_SERIALIZE(distribution)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      std::string status;
+      std::vector<distribution> distributions;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(status)
+        KV_SERIALIZE(distributions)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
   struct COMMAND_RPC_GET_VERSION
   {
     struct request
@@ -1336,4 +1770,400 @@ namespace cryptonote
       END_KV_SERIALIZE_MAP()
     };
   };
+
+  struct COMMAND_RPC_GET_DB_STATS
+  {
+    struct entry
+    {
+      std::string method;
+      std::string table;
+      uint64_t calls;
+      uint64_t bytes_read;
+      uint64_t cursor_ops;
+      uint64_t gets;
+      uint64_t p50_us;
+      uint64_t p99_us;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(method)
+        KV_SERIALIZE(table)
+        KV_SERIALIZE(calls)
+        KV_SERIALIZE(bytes_read)
+        KV_SERIALIZE(cursor_ops)
+        KV_SERIALIZE(gets)
+        KV_SERIALIZE(p50_us)
+        KV_SERIALIZE(p99_us)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct request
+    {
+      BEGIN_KV_SERIALIZE_MAP()
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      std::string status;
+      std::vector<entry> entries;
+      uint64_t syncs;
+      uint64_t unsynced_blocks;
+      uint64_t unsynced_bytes;
+      uint64_t sync_lag_ms;
+      uint64_t max_sync_lag_ms;
+      uint64_t last_sync_us;
+      uint64_t max_sync_us;
+      uint64_t total_sync_us;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(status)
+        KV_SERIALIZE(entries)
+        KV_SERIALIZE(syncs)
+        KV_SERIALIZE(unsynced_blocks)
+        KV_SERIALIZE(unsynced_bytes)
+        KV_SERIALIZE(sync_lag_ms)
+        KV_SERIALIZE(max_sync_lag_ms)
+        KV_SERIALIZE(last_sync_us)
+        KV_SERIALIZE(max_sync_us)
+        KV_SERIALIZE(total_sync_us)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  struct COMMAND_RPC_GET_MEMORY_STATS
+  {
+    struct request
+    {
+      BEGIN_KV_SERIALIZE_MAP()
+      END_KV_SERIALIZE_MAP()
+    };
+
+    // estimates, in bytes, of what each part of the daemon holds
+    struct response
+    {
+      std::string status;
+      uint64_t resident_bytes;
+      uint64_t txpool_count;
+      uint64_t txpool_bytes;
+      uint64_t alt_blocks_count;
+      uint64_t alt_blocks_bytes;
+      uint64_t scan_table_bytes;
+      uint64_t longhash_table_bytes;
+      uint64_t connections_count;
+      uint64_t connections_bytes;
+      uint64_t peerlist_count;
+      uint64_t peerlist_bytes;
+      uint64_t db_map_size;
+      uint64_t db_used_bytes;
+      uint64_t db_resident_bytes;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(status)
+        KV_SERIALIZE(resident_bytes)
+        KV_SERIALIZE(txpool_count)
+        KV_SERIALIZE(txpool_bytes)
+        KV_SERIALIZE(alt_blocks_count)
+        KV_SERIALIZE(alt_blocks_bytes)
+        KV_SERIALIZE(scan_table_bytes)
+        KV_SERIALIZE(longhash_table_bytes)
+        KV_SERIALIZE(connections_count)
+        KV_SERIALIZE(connections_bytes)
+        KV_SERIALIZE(peerlist_count)
+        KV_SERIALIZE(peerlist_bytes)
+        KV_SERIALIZE(db_map_size)
+        KV_SERIALIZE(db_used_bytes)
+        KV_SERIALIZE(db_resident_bytes)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  struct COMMAND_RPC_SNAPSHOT_DB
+  {
+    struct request
+    {
+      std::string path; // empty to only get the status of the last snapshot
+      uint64_t max_rate_kB; // kB per second, 0 for no limit
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(path)
+        KV_SERIALIZE(max_rate_kB)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      std::string status;
+      bool running;
+      std::string path;
+      uint64_t written;
+      uint64_t total;
+      std::string error;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(status)
+        KV_SERIALIZE(running)
+        KV_SERIALIZE(path)
+        KV_SERIALIZE(written)
+        KV_SERIALIZE(total)
+        KV_SERIALIZE(error)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  struct COMMAND_RPC_GET_RPC_STATS
+  {
+    struct method_entry
+    {
+      std::string method;
+      uint64_t calls;
+      uint64_t errors;
+      uint64_t bytes_out;
+      uint64_t total_us;
+      uint64_t p50_us;
+      uint64_t p90_us;
+      uint64_t p99_us;
+      std::vector<uint64_t> histogram; // calls per log2 bucket, bucket i up to 2^(i+1) us
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(method)
+        KV_SERIALIZE(calls)
+        KV_SERIALIZE(errors)
+        KV_SERIALIZE(bytes_out)
+        KV_SERIALIZE(total_us)
+        KV_SERIALIZE(p50_us)
+        KV_SERIALIZE(p90_us)
+        KV_SERIALIZE(p99_us)
+        KV_SERIALIZE(histogram)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct limit_entry
+    {
+      std::string endpoint;
+      std::string pool;
+      uint64_t max_in_flight;
+      uint64_t in_flight;
+      uint64_t calls;
+      uint64_t busy;
+      uint64_t queue_time_us;
+      uint64_t service_time_us;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(endpoint)
+        KV_SERIALIZE(pool)
+        KV_SERIALIZE(max_in_flight)
+        KV_SERIALIZE(in_flight)
+        KV_SERIALIZE(calls)
+        KV_SERIALIZE(busy)
+        KV_SERIALIZE(queue_time_us)
+        KV_SERIALIZE(service_time_us)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct request
+    {
+      BEGIN_KV_SERIALIZE_MAP()
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      std::string status;
+      uint64_t fast_threads;
+      uint64_t bulk_threads;
+      std::vector<method_entry> methods;
+      std::vector<limit_entry> limits;
+      uint64_t response_cache_entries;
+      uint64_t response_cache_bytes;
+      uint64_t response_cache_hits;
+      uint64_t response_cache_misses;
+      uint64_t client_limits_clients;
+      uint64_t client_limits_busy;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(status)
+        KV_SERIALIZE(fast_threads)
+        KV_SERIALIZE(bulk_threads)
+        KV_SERIALIZE(methods)
+        KV_SERIALIZE(limits)
+        KV_SERIALIZE(response_cache_entries)
+        KV_SERIALIZE(response_cache_bytes)
+        KV_SERIALIZE(response_cache_hits)
+        KV_SERIALIZE(response_cache_misses)
+        KV_SERIALIZE(client_limits_clients)
+        KV_SERIALIZE(client_limits_busy)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  struct COMMAND_RPC_GET_NET_STATS
+  {
+    struct command_entry
+    {
+      uint32_t command;
+      std::string name;
+      uint64_t in_messages;
+      uint64_t in_bytes;
+      uint64_t out_messages;
+      uint64_t out_bytes;
+      uint64_t handler_us;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(command)
+        KV_SERIALIZE(name)
+        KV_SERIALIZE(in_messages)
+        KV_SERIALIZE(in_bytes)
+        KV_SERIALIZE(out_messages)
+        KV_SERIALIZE(out_bytes)
+        KV_SERIALIZE(handler_us)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct peer_entry
+    {
+      uint32_t ip; // 0 for the peers past the tracking limit
+      uint64_t in_messages;
+      uint64_t in_bytes;
+      uint64_t out_messages;
+      uint64_t out_bytes;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(ip)
+        KV_SERIALIZE(in_messages)
+        KV_SERIALIZE(in_bytes)
+        KV_SERIALIZE(out_messages)
+        KV_SERIALIZE(out_bytes)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct request
+    {
+      bool reset = false; // start counting again from zero after answering
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(reset)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      std::string status;
+      std::vector<command_entry> commands;
+      std::vector<peer_entry> peers;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(status)
+        KV_SERIALIZE(commands)
+        KV_SERIALIZE(peers)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  struct COMMAND_RPC_GET_BLOCK_PROCESSING_STATS
+  {
+    struct phase_entry
+    {
+      std::string phase;
+      uint64_t total_us;
+      uint64_t max_us;
+      uint64_t p50_us;
+      uint64_t p90_us;
+      uint64_t p99_us;
+      std::vector<uint64_t> histogram; // blocks per log2 bucket, bucket i up to 2^(i+1) us
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(phase)
+        KV_SERIALIZE(total_us)
+        KV_SERIALIZE(max_us)
+        KV_SERIALIZE(p50_us)
+        KV_SERIALIZE(p90_us)
+        KV_SERIALIZE(p99_us)
+        KV_SERIALIZE(histogram)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct request
+    {
+      BEGIN_KV_SERIALIZE_MAP()
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      std::string status;
+      uint64_t blocks; // blocks the stats cover, the last ones added to the main chain
+      std::vector<phase_entry> phases;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(status)
+        KV_SERIALIZE(blocks)
+        KV_SERIALIZE(phases)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  struct COMMAND_RPC_GET_PERF_PROFILE
+  {
+    struct entry
+    {
+      std::string path; // scope names from the outermost, joined by ';'
+      uint64_t calls;
+      uint64_t total_us;
+      uint64_t self_us;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(path)
+        KV_SERIALIZE(calls)
+        KV_SERIALIZE(total_us)
+        KV_SERIALIZE(self_us)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct request
+    {
+      bool reset; // start counting again from now after this call
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(reset)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      std::string status;
+      bool enabled;
+      uint64_t dropped;
+      std::vector<entry> entries;
+      std::string folded; // folded stacks of self microseconds, for flame graph tools
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(status)
+        KV_SERIALIZE(enabled)
+        KV_SERIALIZE(dropped)
+        KV_SERIALIZE(entries)
+        KV_SERIALIZE(folded)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  struct COMMAND_RPC_SET_PERF_PROFILE
+  {
+    struct request
+    {
+      bool enable;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(enable)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      std::string status;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(status)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
 }
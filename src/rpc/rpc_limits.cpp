@@ -0,0 +1,268 @@
+// Copyright (c) 2014-2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include <boost/chrono/chrono.hpp>
+
+#include "rpc_limits.h"
+
+// clients tracked before those with a full bucket and no calls are forgotten
+#define RPC_CLIENT_LIMITS_MAX_CLIENTS 4096
+
+#define RPC_CLIENT_LIMITS_MAX_REFILL_US (24 * 3600 * 1000000ull)
+#define RPC_CLIENT_LIMITS_MAX_COST (1ull << 40)
+
+namespace
+{
+  uint64_t now_us()
+  {
+    return boost::chrono::duration_cast<boost::chrono::microseconds>(boost::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+}
+
+namespace cryptonote
+{
+  //------------------------------------------------------------------------------------------------------------------------------
+  rpc_handler_pool::rpc_handler_pool(const std::string& name, size_t slots, size_t max_waiting, uint64_t wait_ms)
+    : m_name(name)
+    , m_slots(slots)
+    , m_max_waiting(max_waiting)
+    , m_running(0)
+    , m_waiting(0)
+    , m_wait_ms(wait_ms)
+  {}
+  //------------------------------------------------------------------------------------------------------------------------------
+  void rpc_handler_pool::set_limits(size_t slots, size_t max_waiting)
+  {
+    boost::unique_lock<boost::mutex> lock(m_lock);
+    m_slots = slots;
+    m_max_waiting = max_waiting;
+    m_slot_freed.notify_all();
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool rpc_handler_pool::acquire()
+  {
+    boost::unique_lock<boost::mutex> lock(m_lock);
+    if (m_running < m_slots)
+    {
+      ++m_running;
+      return true;
+    }
+    if (m_waiting >= m_max_waiting)
+      return false;
+
+    ++m_waiting;
+    const boost::system_time deadline = boost::get_system_time() + boost::posix_time::milliseconds(m_wait_ms);
+    while (m_running >= m_slots)
+    {
+      if (!m_slot_freed.timed_wait(lock, deadline) && m_running >= m_slots)
+      {
+        --m_waiting;
+        return false;
+      }
+    }
+    --m_waiting;
+    ++m_running;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void rpc_handler_pool::release()
+  {
+    boost::unique_lock<boost::mutex> lock(m_lock);
+    --m_running;
+    m_slot_freed.notify_one();
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  size_t rpc_handler_pool::get_slots() const
+  {
+    boost::unique_lock<boost::mutex> lock(m_lock);
+    return m_slots;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  size_t rpc_handler_pool::get_threads_bound() const
+  {
+    boost::unique_lock<boost::mutex> lock(m_lock);
+    return m_slots + m_max_waiting;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  rpc_endpoint_limit::rpc_endpoint_limit(const std::string& name, rpc_handler_pool& pool, size_t max_in_flight)
+    : name(name)
+    , pool(pool)
+    , max_in_flight(max_in_flight)
+    , in_flight(0)
+    , calls(0)
+    , busy(0)
+    , queue_time_us(0)
+    , service_time_us(0)
+  {}
+  //------------------------------------------------------------------------------------------------------------------------------
+  rpc_endpoint_slot::rpc_endpoint_slot(rpc_endpoint_limit& endpoint)
+    : m_endpoint(endpoint)
+    , m_acquired(false)
+    , m_start_us(now_us())
+  {
+    // the endpoint's own cap turns calls away at once, only the pool makes them wait
+    const size_t in_flight = ++m_endpoint.in_flight;
+    if ((m_endpoint.max_in_flight && in_flight > m_endpoint.max_in_flight) || !m_endpoint.pool.acquire())
+    {
+      --m_endpoint.in_flight;
+      ++m_endpoint.busy;
+      return;
+    }
+    m_acquired = true;
+    const uint64_t start_us = now_us();
+    m_endpoint.queue_time_us += start_us - m_start_us;
+    m_start_us = start_us;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  rpc_endpoint_slot::~rpc_endpoint_slot()
+  {
+    if (!m_acquired)
+      return;
+    m_endpoint.service_time_us += now_us() - m_start_us;
+    ++m_endpoint.calls;
+    m_endpoint.pool.release();
+    --m_endpoint.in_flight;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  rpc_client_limits::rpc_client_limits()
+    : m_enabled(false)
+    , m_bytes_per_second(0)
+    , m_burst_bytes(0)
+    , m_max_in_flight(0)
+    , m_busy(0)
+  {}
+  //------------------------------------------------------------------------------------------------------------------------------
+  void rpc_client_limits::set_limits(uint64_t bytes_per_second, uint64_t burst_bytes, size_t max_in_flight)
+  {
+    boost::unique_lock<boost::mutex> lock(m_lock);
+    m_bytes_per_second = bytes_per_second;
+    m_burst_bytes = burst_bytes;
+    m_max_in_flight = max_in_flight;
+    m_clients.clear();
+    m_enabled = bytes_per_second > 0 || max_in_flight > 0;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void rpc_client_limits::refill(client_budget& budget, uint64_t now) const
+  {
+    if (now <= budget.refilled_us)
+      return;
+    // whole bytes only, the remainder of the interval is kept for next time;
+    // a day refills any bucket a single call can have emptied
+    const uint64_t elapsed = std::min<uint64_t>(now - budget.refilled_us, RPC_CLIENT_LIMITS_MAX_REFILL_US);
+    const uint64_t bytes = elapsed * m_bytes_per_second / 1000000;
+    if (bytes == 0)
+      return;
+    budget.refilled_us += bytes * 1000000 / m_bytes_per_second;
+    budget.balance = std::min<int64_t>(budget.balance + bytes, m_burst_bytes);
+    if (budget.balance == (int64_t)m_burst_bytes)
+      budget.refilled_us = now;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  rpc_client_limits::client_budget& rpc_client_limits::get_client(uint32_t client, uint64_t now)
+  {
+    auto i = m_clients.find(client);
+    if (i != m_clients.end())
+    {
+      if (m_bytes_per_second)
+        refill(i->second, now);
+      return i->second;
+    }
+
+    if (m_clients.size() >= RPC_CLIENT_LIMITS_MAX_CLIENTS)
+    {
+      // those back to a full bucket are no different from new clients
+      for (auto j = m_clients.begin(); j != m_clients.end(); )
+      {
+        if (m_bytes_per_second)
+          refill(j->second, now);
+        if (j->second.in_flight == 0 && (!m_bytes_per_second || j->second.balance == (int64_t)m_burst_bytes))
+          j = m_clients.erase(j);
+        else
+          ++j;
+      }
+    }
+    client_budget& budget = m_clients[client];
+    budget.balance = m_burst_bytes;
+    budget.refilled_us = now;
+    budget.in_flight = 0;
+    return budget;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool rpc_client_limits::begin_call(uint32_t client)
+  {
+    if (!m_enabled)
+      return true;
+    boost::unique_lock<boost::mutex> lock(m_lock);
+    client_budget& budget = get_client(client, now_us());
+    if ((m_bytes_per_second && budget.balance <= 0) || (m_max_in_flight && budget.in_flight >= m_max_in_flight))
+    {
+      ++m_busy;
+      return false;
+    }
+    ++budget.in_flight;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void rpc_client_limits::end_call(uint32_t client)
+  {
+    boost::unique_lock<boost::mutex> lock(m_lock);
+    auto i = m_clients.find(client);
+    if (i != m_clients.end() && i->second.in_flight > 0)
+      --i->second.in_flight;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void rpc_client_limits::charge(uint32_t client, uint64_t cost)
+  {
+    if (!m_enabled)
+      return;
+    boost::unique_lock<boost::mutex> lock(m_lock);
+    if (!m_bytes_per_second)
+      return;
+    client_budget& budget = get_client(client, now_us());
+    budget.balance -= std::min<uint64_t>(cost, RPC_CLIENT_LIMITS_MAX_COST);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  size_t rpc_client_limits::get_clients() const
+  {
+    boost::unique_lock<boost::mutex> lock(m_lock);
+    return m_clients.size();
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  rpc_client_slot::rpc_client_slot(rpc_client_limits& limits, uint32_t client)
+    : m_limits(limits)
+    , m_client(client)
+    , m_acquired(limits.begin_call(client))
+  {}
+  //------------------------------------------------------------------------------------------------------------------------------
+  rpc_client_slot::~rpc_client_slot()
+  {
+    if (m_acquired && m_limits.enabled())
+      m_limits.end_call(m_client);
+  }
+}
@@ -0,0 +1,178 @@
+// Copyright (c) 2014-2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace cryptonote
+{
+  /************************************************************************/
+  /* A class of RPC handlers sharing a bounded number of running slots.   */
+  /* Requests over the limit wait for a slot, but at most max_waiting of  */
+  /* them and for at most wait_ms, so a class never ties up more than    */
+  /* slots + max_waiting of the server's threads.                         */
+  /************************************************************************/
+  class rpc_handler_pool
+  {
+  public:
+    rpc_handler_pool(const std::string& name, size_t slots, size_t max_waiting, uint64_t wait_ms);
+
+    void set_limits(size_t slots, size_t max_waiting);
+
+    /// Takes a slot, waiting for one if needed; false if the pool stayed full.
+    bool acquire();
+    void release();
+
+    const std::string& get_name() const { return m_name; }
+    size_t get_slots() const;
+    /// The most threads handlers of this pool can hold, running or waiting.
+    size_t get_threads_bound() const;
+
+  private:
+    const std::string m_name;
+    mutable boost::mutex m_lock;
+    boost::condition_variable m_slot_freed;
+    size_t m_slots;
+    size_t m_max_waiting;
+    size_t m_running;
+    size_t m_waiting;
+    const uint64_t m_wait_ms;
+  };
+
+  /************************************************************************/
+  /* One limited endpoint: its own cap on concurrent calls (0 leaves only */
+  /* the pool's), and where its calls spent their time.                  */
+  /************************************************************************/
+  struct rpc_endpoint_limit
+  {
+    rpc_endpoint_limit(const std::string& name, rpc_handler_pool& pool, size_t max_in_flight = 0);
+
+    const std::string name;
+    rpc_handler_pool& pool;
+    size_t max_in_flight;
+
+    std::atomic<size_t> in_flight;
+    std::atomic<uint64_t> calls;           //!< calls that got a slot
+    std::atomic<uint64_t> busy;            //!< calls turned away
+    std::atomic<uint64_t> queue_time_us;   //!< total time calls waited for a slot
+    std::atomic<uint64_t> service_time_us; //!< total time calls held a slot
+  };
+
+  /************************************************************************/
+  /* Holds a slot for one call to a limited endpoint while in scope.      */
+  /************************************************************************/
+  class rpc_endpoint_slot
+  {
+  public:
+    explicit rpc_endpoint_slot(rpc_endpoint_limit& endpoint);
+    ~rpc_endpoint_slot();
+
+    bool acquired() const { return m_acquired; }
+
+  private:
+    rpc_endpoint_slot(const rpc_endpoint_slot&) = delete;
+    rpc_endpoint_slot& operator=(const rpc_endpoint_slot&) = delete;
+
+    rpc_endpoint_limit& m_endpoint;
+    bool m_acquired;
+    uint64_t m_start_us;
+  };
+
+  /************************************************************************/
+  /* Per client budgets for the costly calls of a public server. Each     */
+  /* client has a bucket of cost, in response bytes, refilled at a steady */
+  /* rate up to a burst. A costly call is let in while the bucket is not  */
+  /* empty and is charged once its answer is known, so a big answer puts  */
+  /* the client in debt until the refill pays it back. A client may also  */
+  /* only hold a few costly calls at once, running or queued, so clients  */
+  /* take turns at the shared queue instead of one filling it.            */
+  /************************************************************************/
+  class rpc_client_limits
+  {
+  public:
+    rpc_client_limits();
+
+    /// A rate of 0 leaves budgets off, a max_in_flight of 0 leaves calls per client unlimited.
+    void set_limits(uint64_t bytes_per_second, uint64_t burst_bytes, size_t max_in_flight);
+    bool enabled() const { return m_enabled; }
+
+    /// Starts a costly call; false if the client is in debt or holds too many calls.
+    bool begin_call(uint32_t client);
+    void end_call(uint32_t client);
+    /// Takes the cost of a finished call, costly or not, off the client's bucket.
+    void charge(uint32_t client, uint64_t cost);
+
+    size_t get_clients() const;
+    uint64_t get_busy() const { return m_busy; }
+
+  private:
+    struct client_budget
+    {
+      int64_t balance;
+      uint64_t refilled_us;
+      size_t in_flight;
+    };
+
+    client_budget& get_client(uint32_t client, uint64_t now);
+    void refill(client_budget& budget, uint64_t now) const;
+
+    std::atomic<bool> m_enabled;
+    mutable boost::mutex m_lock;
+    std::unordered_map<uint32_t, client_budget> m_clients;
+    uint64_t m_bytes_per_second;
+    uint64_t m_burst_bytes;
+    size_t m_max_in_flight;
+    std::atomic<uint64_t> m_busy; //!< calls turned away
+  };
+
+  /************************************************************************/
+  /* Holds one of a client's costly calls while in scope.                 */
+  /************************************************************************/
+  class rpc_client_slot
+  {
+  public:
+    rpc_client_slot(rpc_client_limits& limits, uint32_t client);
+    ~rpc_client_slot();
+
+    bool acquired() const { return m_acquired; }
+
+  private:
+    rpc_client_slot(const rpc_client_slot&) = delete;
+    rpc_client_slot& operator=(const rpc_client_slot&) = delete;
+
+    rpc_client_limits& m_limits;
+    const uint32_t m_client;
+    bool m_acquired;
+  };
+}
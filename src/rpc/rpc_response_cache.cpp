@@ -0,0 +1,145 @@
+// Copyright (c) 2014-2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "rpc_response_cache.h"
+
+namespace cryptonote
+{
+  //------------------------------------------------------------------------------------------------------------------------------
+  rpc_response_cache::rpc_response_cache(size_t max_bytes)
+    : m_max_bytes(max_bytes)
+    , m_bytes(0)
+    , m_popped_blocks(0)
+    , m_hits(0)
+    , m_misses(0)
+  {}
+  //------------------------------------------------------------------------------------------------------------------------------
+  void rpc_response_cache::set_max_bytes(size_t max_bytes)
+  {
+    boost::unique_lock<boost::mutex> lock(m_lock);
+    m_max_bytes = max_bytes;
+    evict(m_max_bytes);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  std::shared_ptr<const void> rpc_response_cache::find(const std::string& key, uint64_t popped_blocks, const std::type_info& type)
+  {
+    boost::unique_lock<boost::mutex> lock(m_lock);
+    if (!check_popped_blocks(popped_blocks))
+      return std::shared_ptr<const void>();
+    auto i = m_index.find(key);
+    if (i == m_index.end() || *i->second->type != type)
+    {
+      ++m_misses;
+      return std::shared_ptr<const void>();
+    }
+    m_entries.splice(m_entries.begin(), m_entries, i->second);
+    ++m_hits;
+    return i->second->value;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void rpc_response_cache::insert(const std::string& key, uint64_t popped_blocks, const std::type_info& type, std::shared_ptr<const void> value, size_t bytes)
+  {
+    boost::unique_lock<boost::mutex> lock(m_lock);
+    if (!check_popped_blocks(popped_blocks))
+      return;
+    bytes += key.size() + sizeof(entry);
+    if (bytes > m_max_bytes)
+      return;
+
+    auto i = m_index.find(key);
+    if (i != m_index.end())
+    {
+      m_bytes -= i->second->bytes;
+      m_entries.erase(i->second);
+      m_index.erase(i);
+    }
+    evict(m_max_bytes - bytes);
+    m_entries.push_front(entry());
+    entry &e = m_entries.front();
+    e.key = key;
+    e.type = &type;
+    e.value = std::move(value);
+    e.bytes = bytes;
+    m_index[key] = m_entries.begin();
+    m_bytes += bytes;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool rpc_response_cache::check_popped_blocks(uint64_t popped_blocks)
+  {
+    // a caller which read the count before the latest pop may hold a response from the old chain
+    if (popped_blocks < m_popped_blocks)
+      return false;
+    if (popped_blocks > m_popped_blocks)
+    {
+      evict(0);
+      m_popped_blocks = popped_blocks;
+    }
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void rpc_response_cache::evict(size_t max_bytes)
+  {
+    while (m_bytes > max_bytes)
+    {
+      const entry &e = m_entries.back();
+      m_bytes -= e.bytes;
+      m_index.erase(e.key);
+      m_entries.pop_back();
+    }
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  size_t rpc_response_cache::get_max_bytes() const
+  {
+    boost::unique_lock<boost::mutex> lock(m_lock);
+    return m_max_bytes;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  size_t rpc_response_cache::get_bytes() const
+  {
+    boost::unique_lock<boost::mutex> lock(m_lock);
+    return m_bytes;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  size_t rpc_response_cache::get_count() const
+  {
+    boost::unique_lock<boost::mutex> lock(m_lock);
+    return m_entries.size();
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  uint64_t rpc_response_cache::get_hits() const
+  {
+    boost::unique_lock<boost::mutex> lock(m_lock);
+    return m_hits;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  uint64_t rpc_response_cache::get_misses() const
+  {
+    boost::unique_lock<boost::mutex> lock(m_lock);
+    return m_misses;
+  }
+}
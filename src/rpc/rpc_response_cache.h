@@ -0,0 +1,103 @@
+// Copyright (c) 2014-2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+#include <typeinfo>
+#include <unordered_map>
+#include <boost/thread/mutex.hpp>
+
+namespace cryptonote
+{
+  /************************************************************************/
+  /* RPC responses which can't change anymore, kept least recently used  */
+  /* first within a byte budget. Entries are stamped with the chain's    */
+  /* popped blocks count: once a block is popped, lookups made with the  */
+  /* new count find the cache flushed.                                   */
+  /************************************************************************/
+  class rpc_response_cache
+  {
+  public:
+    explicit rpc_response_cache(size_t max_bytes);
+
+    /// 0 disables the cache.
+    void set_max_bytes(size_t max_bytes);
+
+    template<typename t_response>
+    bool get(const std::string& key, uint64_t popped_blocks, t_response& res)
+    {
+      std::shared_ptr<const void> value = find(key, popped_blocks, typeid(t_response));
+      if (!value)
+        return false;
+      res = *static_cast<const t_response*>(value.get());
+      return true;
+    }
+
+    /// bytes is what the response weighs, roughly; popped_blocks must be read before building it.
+    template<typename t_response>
+    void add(const std::string& key, uint64_t popped_blocks, const t_response& res, size_t bytes)
+    {
+      if (bytes < get_max_bytes())
+        insert(key, popped_blocks, typeid(t_response), std::make_shared<t_response>(res), bytes);
+    }
+
+    size_t get_max_bytes() const;
+    size_t get_bytes() const;
+    size_t get_count() const;
+    uint64_t get_hits() const;
+    uint64_t get_misses() const;
+
+  private:
+    struct entry
+    {
+      std::string key;
+      const std::type_info *type;
+      std::shared_ptr<const void> value;
+      size_t bytes;
+    };
+
+    std::shared_ptr<const void> find(const std::string& key, uint64_t popped_blocks, const std::type_info& type);
+    void insert(const std::string& key, uint64_t popped_blocks, const std::type_info& type, std::shared_ptr<const void> value, size_t bytes);
+    // both with m_lock held
+    bool check_popped_blocks(uint64_t popped_blocks);
+    void evict(size_t max_bytes);
+
+    mutable boost::mutex m_lock;
+    size_t m_max_bytes;
+    size_t m_bytes;
+    uint64_t m_popped_blocks;
+    uint64_t m_hits;
+    uint64_t m_misses;
+    std::list<entry> m_entries; // most recently used first
+    std::unordered_map<std::string, std::list<entry>::iterator> m_index;
+  };
+}
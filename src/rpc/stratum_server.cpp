@@ -0,0 +1,547 @@
+// Copyright (c) 2014-2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <limits>
+#include <vector>
+#include "include_base_utils.h"
+using namespace epee;
+
+#include "stratum_server.h"
+#include "cryptonote_core/cryptonote_basic_impl.h"
+#include "cryptonote_core/cryptonote_format_utils.h"
+#include "net/jsonrpc_protocol_handler.h"
+#include "net/jsonrpc_structs.h"
+#include "storages/portable_storage_template_helper.h"
+#include "string_tools.h"
+
+namespace cryptonote
+{
+  //------------------------------------------------------------------------------------------------------------------------------
+  stratum_connection_handler::stratum_connection_handler(epee::net_utils::i_service_endpoint* endpoint, config_type& config, connection_context& context)
+    : m_endpoint(endpoint)
+    , m_server(config)
+  {
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool stratum_connection_handler::after_init_connection()
+  {
+    m_worker = m_server->add_worker(m_endpoint);
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool stratum_connection_handler::handle_recv(const void* ptr, size_t cb)
+  {
+    m_line.append((const char*)ptr, cb);
+    size_t start = 0;
+    for (size_t end = m_line.find('\n'); end != std::string::npos; end = m_line.find('\n', start))
+    {
+      const std::string request = m_line.substr(start, end - start);
+      start = end + 1;
+      if (request.find_first_not_of(" \t\r") == std::string::npos)
+        continue;
+      if (!m_server->handle_request(m_worker, request))
+        return false;
+    }
+    m_line.erase(0, start);
+    if (m_line.size() > STRATUM_MAX_LINE)
+    {
+      LOG_PRINT_L1("Stratum worker " << m_worker->id << " sent a too long request, dropping");
+      return false;
+    }
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool stratum_connection_handler::release_protocol()
+  {
+    if (m_worker)
+    {
+      m_server->remove_worker(m_worker);
+      m_worker.reset();
+    }
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  stratum_server::stratum_server(core& cr)
+    : m_core(cr)
+    , m_enabled(false)
+    , m_address(AUTO_VAL_INIT(m_address))
+    , m_share_difficulty(STRATUM_DEFAULT_SHARE_DIFFICULTY)
+    , m_next_worker_id(0)
+    , m_next_extra_nonce(0)
+    , m_next_job_id(0)
+    , m_pending_shares(0)
+    , m_shares_accepted(0)
+    , m_shares_rejected(0)
+    , m_blocks_found(0)
+    , m_stop(false)
+    , m_net_server(epee::net_utils::e_connection_type_RPC)
+  {
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  stratum_server::~stratum_server()
+  {
+    stop();
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void stratum_server::init_options(boost::program_options::options_description& desc)
+  {
+    command_line::add_arg(desc, arg_stratum_bind_ip);
+    command_line::add_arg(desc, arg_stratum_bind_port);
+    command_line::add_arg(desc, arg_stratum_address);
+    command_line::add_arg(desc, arg_stratum_share_difficulty);
+    command_line::add_arg(desc, arg_stratum_threads);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool stratum_server::init(const boost::program_options::variables_map& vm)
+  {
+    const std::string port = command_line::get_arg(vm, arg_stratum_bind_port);
+    if (port.empty())
+      return true;
+
+    const bool testnet = command_line::get_arg(vm, command_line::arg_testnet_on);
+    const std::string address = command_line::get_arg(vm, arg_stratum_address);
+    if (address.empty() || !get_account_address_from_str(m_address, testnet, address))
+    {
+      LOG_ERROR("The stratum server needs a valid --" << arg_stratum_address.name << " to mine to");
+      return false;
+    }
+    m_share_difficulty = command_line::get_arg(vm, arg_stratum_share_difficulty);
+    if (!m_share_difficulty)
+    {
+      LOG_ERROR("--" << arg_stratum_share_difficulty.name << " must not be 0");
+      return false;
+    }
+
+    const size_t threads = command_line::get_arg(vm, arg_stratum_threads);
+    m_hash_pool.reset(new tools::thread_group(threads ? threads : tools::thread_group::optimal()));
+
+    m_net_server.set_threads_prefix("STRATUM");
+    m_net_server.get_config_object() = this;
+    if (!m_net_server.init_server(port, command_line::get_arg(vm, arg_stratum_bind_ip)))
+    {
+      LOG_ERROR("Failed to bind the stratum server");
+      return false;
+    }
+    m_enabled = true;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool stratum_server::run()
+  {
+    if (!m_enabled)
+      return true;
+    // workers logging in before the first template get an error and retry
+    update_template();
+    m_stop = false;
+    m_watcher = boost::thread(&stratum_server::watch_templates, this);
+    return m_net_server.run_server(STRATUM_IO_THREADS, false);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void stratum_server::stop()
+  {
+    if (!m_enabled)
+      return;
+    m_stop = true;
+    if (m_watcher.joinable())
+      m_watcher.join();
+    m_net_server.send_stop_signal();
+    m_net_server.timed_wait_server_stop(5000);
+    // no more shares come in, those queued are checked before this returns
+    m_hash_pool.reset();
+    m_enabled = false;
+    LOG_PRINT_L0("Stratum server stopped, " << m_shares_accepted << " shares accepted, " << m_shares_rejected
+      << " rejected, " << m_blocks_found << " blocks found");
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  std::shared_ptr<stratum_worker> stratum_server::add_worker(epee::net_utils::i_service_endpoint* endpoint)
+  {
+    std::shared_ptr<stratum_worker> worker = std::make_shared<stratum_worker>();
+    worker->endpoint = endpoint;
+    worker->logged_in = false;
+
+    boost::unique_lock<boost::mutex> lock(m_workers_lock);
+    worker->id = m_next_worker_id++;
+    // 2^32 connections before two workers can mine the same blob
+    worker->extra_nonce = m_next_extra_nonce++;
+    m_workers[worker->id] = worker;
+    LOG_PRINT_L1("Stratum worker " << worker->id << " connected");
+    return worker;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void stratum_server::remove_worker(const std::shared_ptr<stratum_worker>& worker)
+  {
+    {
+      boost::unique_lock<boost::mutex> lock(m_workers_lock);
+      m_workers.erase(worker->id);
+    }
+    // waits for a job being sent to it
+    boost::unique_lock<boost::mutex> lock(worker->mutex);
+    worker->endpoint = NULL;
+    LOG_PRINT_L1("Stratum worker " << worker->id << " disconnected");
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool stratum_server::handle_request(const std::shared_ptr<stratum_worker>& worker, const std::string& line)
+  {
+    epee::serialization::portable_json_reader ps;
+    if (!ps.load_from_json(line))
+    {
+      send_error(worker->endpoint, epee::serialization::storage_entry(std::string()), -32700, "Parse error");
+      return false;
+    }
+    epee::serialization::storage_entry id = std::string();
+    ps.get_value("id", id, nullptr);
+    std::string method;
+    if (!ps.get_value("method", method, nullptr))
+    {
+      send_error(worker->endpoint, id, -32600, "Invalid Request");
+      return true;
+    }
+
+    if (method == "login")
+    {
+      epee::json_rpc::request<stratum::login_params> req = AUTO_VAL_INIT(req);
+      if (!req.load(ps))
+      {
+        send_error(worker->endpoint, id, -32602, "Invalid params");
+        return true;
+      }
+      stratum::login_result res = AUTO_VAL_INIT(res);
+      {
+        boost::unique_lock<boost::mutex> lock(worker->mutex);
+        if (!make_job(*worker, res.job))
+        {
+          send_error(worker->endpoint, id, -1, "No block template yet");
+          return true;
+        }
+        worker->logged_in = true;
+      }
+      LOG_PRINT_L1("Stratum worker " << worker->id << " logged in as " << req.params.login << " (" << req.params.agent << ")");
+      res.id = std::to_string(worker->id);
+      res.status = "OK";
+      send_result(worker->endpoint, id, res);
+    }
+    else if (method == "submit")
+    {
+      epee::json_rpc::request<stratum::submit_params> req = AUTO_VAL_INIT(req);
+      if (!req.load(ps))
+      {
+        send_error(worker->endpoint, id, -32602, "Invalid params");
+        return true;
+      }
+      check_share(worker, id, req.params);
+    }
+    else if (method == "keepalived")
+    {
+      stratum::status_result res = AUTO_VAL_INIT(res);
+      res.status = "KEEPALIVED";
+      send_result(worker->endpoint, id, res);
+    }
+    else
+    {
+      send_error(worker->endpoint, id, -32601, "Method not found");
+    }
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool stratum_server::update_template()
+  {
+    std::shared_ptr<block_template> tmpl = std::make_shared<block_template>();
+    block b = AUTO_VAL_INIT(b);
+    const blobdata reserve(STRATUM_EXTRA_NONCE_SIZE, 0);
+    if (!m_core.get_block_template(b, m_address, tmpl->difficulty, tmpl->height, reserve))
+    {
+      LOG_ERROR("Stratum server failed to create block template");
+      return false;
+    }
+    tmpl->blob = block_to_blob(b);
+
+    // the reserved bytes follow the tx pub key, as for getblocktemplate
+    const crypto::public_key tx_pub_key = get_tx_pub_key_from_extra(b.miner_tx);
+    if (tx_pub_key == null_pkey)
+    {
+      LOG_ERROR("Stratum server failed to find tx pub key in coinbase extra");
+      return false;
+    }
+    const char* key = (const char*)&tx_pub_key;
+    const blobdata::const_iterator it = std::search(tmpl->blob.begin(), tmpl->blob.end(), key, key + sizeof(tx_pub_key));
+    tmpl->reserved_offset = (it - tmpl->blob.begin()) + sizeof(tx_pub_key) + 3; //3 bytes: tag for TX_EXTRA_TAG_PUBKEY(1 byte), tag for TX_EXTRA_NONCE(1 byte), counter in TX_EXTRA_NONCE(1 byte)
+    if (it == tmpl->blob.end() || tmpl->reserved_offset + STRATUM_EXTRA_NONCE_SIZE > tmpl->blob.size())
+    {
+      LOG_ERROR("Stratum server failed to find the reserved bytes in block template");
+      return false;
+    }
+
+    boost::unique_lock<boost::mutex> lock(m_template_lock);
+    m_template = tmpl;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void stratum_server::watch_templates()
+  {
+    uint64_t version = m_core.get_block_template_version();
+    uint64_t height = m_core.get_current_blockchain_height();
+    time_t built = time(NULL);
+    bool stale = false;
+    while (!m_stop)
+    {
+      const uint64_t current = m_core.wait_block_template_version(version, 1);
+      if (current != version)
+      {
+        version = current;
+        stale = true;
+      }
+      if (!stale)
+        continue;
+
+      // a new block makes the jobs worthless, pool changes only add fees
+      const uint64_t current_height = m_core.get_current_blockchain_height();
+      if (current_height == height && time(NULL) < built + STRATUM_TEMPLATE_REFRESH_SECONDS)
+        continue;
+
+      stale = false;
+      height = current_height;
+      built = time(NULL);
+      if (update_template())
+        broadcast_jobs();
+    }
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void stratum_server::broadcast_jobs()
+  {
+    std::vector<std::shared_ptr<stratum_worker>> workers;
+    {
+      boost::unique_lock<boost::mutex> lock(m_workers_lock);
+      workers.reserve(m_workers.size());
+      for (const auto& w: m_workers)
+        workers.push_back(w.second);
+    }
+
+    for (const std::shared_ptr<stratum_worker>& worker: workers)
+    {
+      stratum::job_notification notification = AUTO_VAL_INIT(notification);
+      notification.jsonrpc = "2.0";
+      notification.method = "job";
+      boost::unique_lock<boost::mutex> lock(worker->mutex);
+      if (!worker->endpoint || !worker->logged_in || !make_job(*worker, notification.params))
+        continue;
+      std::string json;
+      epee::serialization::store_t_to_json(notification, json, 0, false);
+      send_json(worker->endpoint, std::move(json));
+    }
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool stratum_server::make_job(stratum_worker& worker, stratum::job_entry& entry)
+  {
+    std::shared_ptr<const block_template> tmpl;
+    {
+      boost::unique_lock<boost::mutex> lock(m_template_lock);
+      tmpl = m_template;
+    }
+    if (!tmpl)
+      return false;
+
+    blobdata blob = tmpl->blob;
+    memcpy(&blob[tmpl->reserved_offset], &worker.extra_nonce, sizeof(worker.extra_nonce));
+    stratum_worker::job job;
+    if (!parse_and_validate_block_from_blob(blob, job.b))
+    {
+      LOG_ERROR("Stratum server failed to parse its block template");
+      return false;
+    }
+    job.id = m_next_job_id++;
+    job.height = tmpl->height;
+    job.block_difficulty = tmpl->difficulty;
+    job.share_difficulty = std::min(m_share_difficulty, tmpl->difficulty);
+
+    const uint64_t target = std::numeric_limits<uint64_t>::max() / job.share_difficulty;
+    entry.blob = string_tools::buff_to_hex_nodelimer(get_block_hashing_blob(job.b));
+    entry.job_id = std::to_string(job.id);
+    entry.target = string_tools::pod_to_hex(target);
+    entry.height = job.height;
+
+    worker.jobs.push_back(std::move(job));
+    while (worker.jobs.size() > STRATUM_JOBS_KEPT)
+      worker.jobs.pop_front();
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void stratum_server::check_share(const std::shared_ptr<stratum_worker>& worker, const epee::serialization::storage_entry& id, const stratum::submit_params& params)
+  {
+    block b;
+    uint64_t height;
+    difficulty_type block_difficulty, share_difficulty;
+    {
+      boost::unique_lock<boost::mutex> lock(worker->mutex);
+      if (!worker->logged_in || params.id != std::to_string(worker->id))
+      {
+        send_error(worker->endpoint, id, -1, "Unauthenticated");
+        return;
+      }
+      const auto job = std::find_if(worker->jobs.begin(), worker->jobs.end(), [&params](const stratum_worker::job& j) {
+        return std::to_string(j.id) == params.job_id;
+      });
+      if (job == worker->jobs.end())
+      {
+        ++m_shares_rejected;
+        send_error(worker->endpoint, id, -1, "Block expired");
+        return;
+      }
+      uint32_t nonce;
+      if (!string_tools::hex_to_pod(params.nonce, nonce))
+      {
+        ++m_shares_rejected;
+        send_error(worker->endpoint, id, -1, "Invalid nonce");
+        return;
+      }
+      if (!job->nonces.insert(nonce).second)
+      {
+        ++m_shares_rejected;
+        send_error(worker->endpoint, id, -1, "Duplicate share");
+        return;
+      }
+      b = job->b;
+      b.nonce = nonce;
+      height = job->height;
+      block_difficulty = job->block_difficulty;
+      share_difficulty = job->share_difficulty;
+    }
+
+    if (m_pending_shares >= STRATUM_MAX_PENDING_SHARES)
+    {
+      send_error(worker->endpoint, id, -1, "Server busy");
+      return;
+    }
+    ++m_pending_shares;
+
+    // the connection may go before its share is checked
+    epee::net_utils::i_service_endpoint* endpoint = worker->endpoint;
+    endpoint->add_ref();
+    const uint64_t worker_id = worker->id;
+    m_hash_pool->dispatch([this, endpoint, id, b, height, block_difficulty, share_difficulty, worker_id]() mutable {
+      try
+      {
+        crypto::hash hash;
+        get_block_longhash(b, hash, height);
+        if (!check_hash(hash, share_difficulty))
+        {
+          ++m_shares_rejected;
+          send_error(endpoint, id, -1, "Low difficulty share");
+        }
+        else
+        {
+          ++m_shares_accepted;
+          if (check_hash(hash, block_difficulty))
+          {
+            if (m_core.handle_block_found(b))
+            {
+              ++m_blocks_found;
+              LOG_PRINT_GREEN("Stratum worker " << worker_id << " found block " << get_block_hash(b) << " at height " << height, LOG_LEVEL_0);
+            }
+            else
+            {
+              LOG_ERROR("Block found by stratum worker " << worker_id << " was not accepted");
+            }
+          }
+          stratum::status_result res = AUTO_VAL_INIT(res);
+          res.status = "OK";
+          send_result(endpoint, id, res);
+        }
+      }
+      catch (const std::exception& e)
+      {
+        LOG_ERROR("Failed to check share of stratum worker " << worker_id << ": " << e.what());
+      }
+      catch (...)
+      {
+        LOG_ERROR("Failed to check share of stratum worker " << worker_id);
+      }
+      endpoint->release();
+      --m_pending_shares;
+    });
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  template<typename t_result>
+  void stratum_server::send_result(epee::net_utils::i_service_endpoint* endpoint, const epee::serialization::storage_entry& id, t_result& result)
+  {
+    epee::json_rpc::response<t_result, epee::json_rpc::dummy_error> rsp = AUTO_VAL_INIT(rsp);
+    rsp.jsonrpc = "2.0";
+    rsp.id = id;
+    rsp.result = result;
+    std::string json;
+    epee::serialization::store_t_to_json(rsp, json, 0, false);
+    send_json(endpoint, std::move(json));
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void stratum_server::send_error(epee::net_utils::i_service_endpoint* endpoint, const epee::serialization::storage_entry& id, int64_t code, const std::string& message)
+  {
+    std::string json;
+    epee::net_utils::jsonrpc2::make_error_resp_json(code, message, json, id);
+    endpoint->do_send(json.data(), json.size());
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void stratum_server::send_json(epee::net_utils::i_service_endpoint* endpoint, std::string json)
+  {
+    json += "\n";
+    endpoint->do_send(json.data(), json.size());
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+
+  const command_line::arg_descriptor<std::string> stratum_server::arg_stratum_bind_ip = {
+      "stratum-bind-ip"
+    , "IP for the stratum job server"
+    , "127.0.0.1"
+    };
+
+  const command_line::arg_descriptor<std::string> stratum_server::arg_stratum_bind_port = {
+      "stratum-bind-port"
+    , "Port for the stratum job server, which is off unless given"
+    , ""
+    };
+
+  const command_line::arg_descriptor<std::string> stratum_server::arg_stratum_address = {
+      "stratum-address"
+    , "Address blocks found by stratum workers pay to"
+    , ""
+    };
+
+  const command_line::arg_descriptor<uint64_t> stratum_server::arg_stratum_share_difficulty = {
+      "stratum-share-difficulty"
+    , "Difficulty of the shares stratum workers submit, capped by the block difficulty"
+    , STRATUM_DEFAULT_SHARE_DIFFICULTY
+    };
+
+  const command_line::arg_descriptor<size_t> stratum_server::arg_stratum_threads = {
+      "stratum-threads"
+    , "Threads checking stratum shares, 0 for one per core"
+    , 0
+    };
+
+}  // namespace cryptonote
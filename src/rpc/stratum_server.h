@@ -0,0 +1,191 @@
+// Copyright (c) 2014-2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/variables_map.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "net/abstract_tcp_server2.h"
+#include "storages/portable_storage_base.h"
+#include "common/command_line.h"
+#include "common/thread_group.h"
+#include "cryptonote_core/cryptonote_core.h"
+#include "stratum_server_commands_defs.h"
+
+#define STRATUM_IO_THREADS                2
+#define STRATUM_EXTRA_NONCE_SIZE          4     // bytes reserved in the coinbase extra, one value per worker
+#define STRATUM_JOBS_KEPT                 4     // per worker, so shares for the jobs just replaced still count
+#define STRATUM_TEMPLATE_REFRESH_SECONDS  10    // pool changes get a new template at most this often
+#define STRATUM_MAX_LINE                  4096  // longer requests drop the connection
+#define STRATUM_MAX_PENDING_SHARES        4096  // shares waiting for a hash thread, more are refused
+#define STRATUM_DEFAULT_SHARE_DIFFICULTY  5000
+
+namespace cryptonote
+{
+  /*!
+   * what the stratum server knows of a connected miner
+   */
+  struct stratum_worker
+  {
+    struct job
+    {
+      uint64_t id;
+      block b;  //!< the template with the worker's extra nonce
+      uint64_t height;
+      difficulty_type block_difficulty;
+      difficulty_type share_difficulty;
+      std::unordered_set<uint32_t> nonces;  //!< submitted already
+    };
+
+    uint64_t id;
+    uint32_t extra_nonce;
+    epee::net_utils::i_service_endpoint* endpoint;
+
+    boost::mutex mutex;  //!< guards what follows
+    bool logged_in;
+    std::deque<job> jobs;  //!< newest last
+  };
+
+  class stratum_server;
+
+  /*!
+   * one per miner connection, reads newline delimited json-rpc and hands
+   * each request to the server
+   */
+  class stratum_connection_handler
+  {
+  public:
+    typedef epee::net_utils::connection_context_base connection_context;
+    typedef stratum_server* config_type;
+
+    stratum_connection_handler(epee::net_utils::i_service_endpoint* endpoint, config_type& config, connection_context& context);
+
+    bool after_init_connection();
+    bool handle_recv(const void* ptr, size_t cb);
+    void handle_qued_callback() {}
+    bool release_protocol();
+
+  private:
+    epee::net_utils::i_service_endpoint* m_endpoint;
+    stratum_server* m_server;
+    std::string m_line;  //!< received past the last newline
+    std::shared_ptr<stratum_worker> m_worker;
+  };
+
+  /*!
+   * A stratum style job server for miners on a LAN, so they need neither a
+   * pool nor a proxy polling getblocktemplate.
+   *
+   * One block template is kept, rebuilt when the chain or the pool changes.
+   * Each worker mines it with its own extra nonce in the coinbase. Shares are
+   * checked on a pool of hash threads, and blocks go straight to
+   * core::handle_block_found. All blocks pay the address given on the
+   * command line, whatever the workers log in with.
+   */
+  class stratum_server
+  {
+  public:
+    static const command_line::arg_descriptor<std::string> arg_stratum_bind_ip;
+    static const command_line::arg_descriptor<std::string> arg_stratum_bind_port;
+    static const command_line::arg_descriptor<std::string> arg_stratum_address;
+    static const command_line::arg_descriptor<uint64_t> arg_stratum_share_difficulty;
+    static const command_line::arg_descriptor<size_t> arg_stratum_threads;
+
+    explicit stratum_server(core& cr);
+    ~stratum_server();
+
+    static void init_options(boost::program_options::options_description& desc);
+    //! \return false on bad options or if the port cannot be bound, true if disabled
+    bool init(const boost::program_options::variables_map& vm);
+    //! whether a port was given, the server does nothing otherwise
+    bool enabled() const { return m_enabled; }
+    bool run();
+    void stop();
+    int get_binded_port() { return m_net_server.get_binded_port(); }
+
+    // for the connection handlers
+    std::shared_ptr<stratum_worker> add_worker(epee::net_utils::i_service_endpoint* endpoint);
+    void remove_worker(const std::shared_ptr<stratum_worker>& worker);
+    //! \return false to drop the connection
+    bool handle_request(const std::shared_ptr<stratum_worker>& worker, const std::string& line);
+
+  private:
+    struct block_template
+    {
+      blobdata blob;
+      size_t reserved_offset;  //!< of the extra nonce in blob
+      difficulty_type difficulty;
+      uint64_t height;
+    };
+
+    bool update_template();
+    void watch_templates();
+    void broadcast_jobs();
+    //! makes the next job of a worker, whose mutex is held
+    bool make_job(stratum_worker& worker, stratum::job_entry& entry);
+    void check_share(const std::shared_ptr<stratum_worker>& worker, const epee::serialization::storage_entry& id, const stratum::submit_params& params);
+
+    template<typename t_result>
+    static void send_result(epee::net_utils::i_service_endpoint* endpoint, const epee::serialization::storage_entry& id, t_result& result);
+    static void send_error(epee::net_utils::i_service_endpoint* endpoint, const epee::serialization::storage_entry& id, int64_t code, const std::string& message);
+    static void send_json(epee::net_utils::i_service_endpoint* endpoint, std::string json);
+
+    core& m_core;
+    bool m_enabled;
+    account_public_address m_address;
+    difficulty_type m_share_difficulty;
+
+    boost::mutex m_template_lock;
+    std::shared_ptr<const block_template> m_template;
+
+    boost::mutex m_workers_lock;
+    std::map<uint64_t, std::shared_ptr<stratum_worker>> m_workers;
+    uint64_t m_next_worker_id;
+    uint32_t m_next_extra_nonce;
+    std::atomic<uint64_t> m_next_job_id;
+
+    std::unique_ptr<tools::thread_group> m_hash_pool;
+    std::atomic<size_t> m_pending_shares;
+    std::atomic<uint64_t> m_shares_accepted;
+    std::atomic<uint64_t> m_shares_rejected;
+    std::atomic<uint64_t> m_blocks_found;
+
+    std::atomic<bool> m_stop;
+    boost::thread m_watcher;
+    epee::net_utils::boosted_tcp_server<stratum_connection_handler> m_net_server;
+  };
+}
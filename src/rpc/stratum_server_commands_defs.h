@@ -0,0 +1,131 @@
+// Copyright (c) 2014-2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <string>
+#include "serialization/keyvalue_serialization.h"
+
+namespace cryptonote
+{
+  /*!
+   * Messages of the stratum job server, newline delimited json-rpc as most
+   * CryptoNote miners speak it. Requests are json_rpc::request<...params>,
+   * replies json_rpc::response<...result> or json_rpc::error_response.
+   */
+  namespace stratum
+  {
+    struct job_entry
+    {
+      std::string blob;    //!< hex hashing blob, the nonce at byte 39
+      std::string job_id;
+      std::string target;  //!< hex 64 bit little endian, 2^64 / share difficulty
+      uint64_t height;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(blob)
+        KV_SERIALIZE(job_id)
+        KV_SERIALIZE(target)
+        KV_SERIALIZE(height)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct login_params
+    {
+      std::string login;  //!< a worker name, blocks all pay the server's address
+      std::string pass;
+      std::string agent;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(login)
+        KV_SERIALIZE(pass)
+        KV_SERIALIZE(agent)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct login_result
+    {
+      std::string id;  //!< the worker id, passed back with each submit
+      job_entry job;
+      std::string status;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(id)
+        KV_SERIALIZE(job)
+        KV_SERIALIZE(status)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct submit_params
+    {
+      std::string id;
+      std::string job_id;
+      std::string nonce;   //!< hex, 4 bytes
+      std::string result;  //!< hex, the hash the miner found, only informative
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(id)
+        KV_SERIALIZE(job_id)
+        KV_SERIALIZE(nonce)
+        KV_SERIALIZE(result)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct keepalive_params
+    {
+      std::string id;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(id)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct status_result
+    {
+      std::string status;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(status)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    //! pushed to each worker when the template changes
+    struct job_notification
+    {
+      std::string jsonrpc;
+      std::string method;
+      job_entry params;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(jsonrpc)
+        KV_SERIALIZE(method)
+        KV_SERIALIZE(params)
+      END_KV_SERIALIZE_MAP()
+    };
+  }
+}
@@ -36,6 +36,9 @@
 #include <cassert>
 #include <iostream>
 #include <iterator>
+#include <streambuf>
+#include <string>
+#include <vector>
 #include <boost/type_traits/make_unsigned.hpp>
 
 #include "common/varint.h"
@@ -47,6 +50,141 @@ DISABLE_VS_WARNINGS(4244)
 
 //TODO: fix size_t warning in x32 platform
 
+/*! \class binary_input_buffer
+ *
+ * \brief read only stream buffer over a caller owned contiguous range
+ *
+ * \detailed Lets a binary_archive parse a blob in place, instead of
+ * copying it into a std::stringstream first. The range must outlive
+ * the buffer.
+ */
+class binary_input_buffer : public std::streambuf
+{
+public:
+  binary_input_buffer(const char *data, size_t size)
+  {
+    char *begin = const_cast<char *>(data);
+    setg(begin, begin, begin + size);
+  }
+
+protected:
+  pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which = std::ios_base::in)
+  {
+    if (!(which & std::ios_base::in))
+      return pos_type(off_type(-1));
+    const off_type cur = gptr() - eback(), end = egptr() - eback();
+    const off_type target = off + (dir == std::ios_base::beg ? 0 : dir == std::ios_base::cur ? cur : end);
+    if (target < 0 || target > end)
+      return pos_type(off_type(-1));
+    setg(eback(), eback() + target, egptr());
+    return pos_type(target);
+  }
+
+  pos_type seekpos(pos_type pos, std::ios_base::openmode which = std::ios_base::in)
+  {
+    return seekoff(off_type(pos), std::ios_base::beg, which);
+  }
+};
+
+/*! \class binary_input_stream
+ *
+ * \brief std::istream reading from a binary_input_buffer
+ *
+ * \detailed Use this, rather than a std::stringstream holding a
+ * copy, to give a binary_archive<false> a blob to read from.
+ */
+class binary_input_stream : private binary_input_buffer, public std::istream
+{
+public:
+  binary_input_stream(const char *data, size_t size)
+    : binary_input_buffer(data, size), std::istream(static_cast<binary_input_buffer *>(this)) { }
+  explicit binary_input_stream(const std::string &blob)
+    : binary_input_stream(blob.data(), blob.size()) { }
+  explicit binary_input_stream(const std::vector<uint8_t> &blob)
+    : binary_input_stream(reinterpret_cast<const char *>(blob.data()), blob.size()) { }
+  // the buffer is not copied, so it must not be a temporary
+  explicit binary_input_stream(std::string &&blob) = delete;
+  explicit binary_input_stream(std::vector<uint8_t> &&blob) = delete;
+};
+
+/*! \class binary_output_buffer
+ *
+ * \brief stream buffer appending to a caller owned string
+ *
+ * \detailed Lets a binary_archive<true> write a blob in place, without
+ * the copy std::stringstream::str() makes at the end.
+ */
+class binary_output_buffer : public std::streambuf
+{
+public:
+  explicit binary_output_buffer(std::string &out) : out_(out) { }
+
+protected:
+  int_type overflow(int_type c)
+  {
+    if (!traits_type::eq_int_type(c, traits_type::eof()))
+      out_.push_back(traits_type::to_char_type(c));
+    return traits_type::not_eof(c);
+  }
+
+  std::streamsize xsputn(const char *s, std::streamsize n)
+  {
+    out_.append(s, n);
+    return n;
+  }
+
+private:
+  std::string &out_;
+};
+
+/*! \class binary_size_counter
+ *
+ * \brief stream buffer that only counts what is written to it
+ *
+ * \detailed Gives the size of an object's blob without building it.
+ */
+class binary_size_counter : public std::streambuf
+{
+public:
+  binary_size_counter() : size_(0) { }
+  size_t size() const { return size_; }
+
+protected:
+  int_type overflow(int_type c)
+  {
+    if (!traits_type::eq_int_type(c, traits_type::eof()))
+      ++size_;
+    return traits_type::not_eof(c);
+  }
+
+  std::streamsize xsputn(const char *s, std::streamsize n)
+  {
+    size_ += n;
+    return n;
+  }
+
+private:
+  size_t size_;
+};
+
+/*! \class binary_output_stream
+ *
+ * \brief std::ostream over a binary_output_buffer or a binary_size_counter
+ */
+template <class Buffer>
+class binary_output_stream_t : private Buffer, public std::ostream
+{
+public:
+  binary_output_stream_t() : std::ostream(static_cast<Buffer *>(this)) { }
+  explicit binary_output_stream_t(std::string &out)
+    : Buffer(out), std::ostream(static_cast<Buffer *>(this)) { }
+
+  const Buffer &buffer() const { return *this; }
+};
+
+typedef binary_output_stream_t<binary_output_buffer> binary_output_stream;
+typedef binary_output_stream_t<binary_size_counter> binary_size_stream;
+
 /*! \struct binary_archive_base
  *
  * \brief base for the binary archive type
@@ -120,10 +258,15 @@ struct binary_archive<false> : public binary_archive_base<std::istream, false>
   {
     T ret = 0;
     unsigned shift = 0;
+    // reads straight from the stream buffer, an istream::get per byte
+    // costs a sentry each
+    std::streambuf *buf = stream_.rdbuf();
     for (size_t i = 0; i < width; i++) {
-      //std::cerr << "tell: " << stream_.tellg() << " value: " << ret << std::endl;
-      char c;
-      stream_.get(c);
+      int c = buf->sbumpc();
+      if (c == std::char_traits<char>::eof()) {
+        stream_.setstate(std::ios_base::eofbit | std::ios_base::failbit);
+        c = 0;
+      }
       T b = (unsigned char)c;
       ret += (b << shift);	// can this be changed to OR, i think it can.
       shift += 8;
@@ -133,7 +276,8 @@ struct binary_archive<false> : public binary_archive_base<std::istream, false>
   
   void serialize_blob(void *buf, size_t len, const char *delimiter="")
   {
-    stream_.read((char *)buf, len);
+    if (stream_.rdbuf()->sgetn((char *)buf, len) != (std::streamsize)len)
+      stream_.setstate(std::ios_base::eofbit | std::ios_base::failbit);
   }
   
   template <class T>
@@ -189,15 +333,19 @@ struct binary_archive<true> : public binary_archive_base<std::ostream, true>
   template <class T>
   void serialize_uint(T v)
   {
+    // one write per value instead of an ostream::put per byte
+    char buf[sizeof(T)];
     for (size_t i = 0; i < sizeof(T); i++) {
-      stream_.put((char)(v & 0xff));
+      buf[i] = (char)(v & 0xff);
       if (1 < sizeof(T)) v >>= 8;
     }
+    serialize_blob(buf, sizeof(T));
   }
 
   void serialize_blob(void *buf, size_t len, const char *delimiter="")
   {
-    stream_.write((char *)buf, len);
+    if (stream_.rdbuf()->sputn((const char *)buf, len) != (std::streamsize)len)
+      stream_.setstate(std::ios_base::badbit);
   }
 
   template <class T>
@@ -209,8 +357,10 @@ struct binary_archive<true> : public binary_archive_base<std::ostream, true>
   template <class T>
   void serialize_uvarint(T &v)
   {
-    typedef std::ostreambuf_iterator<char> it;
-    tools::write_varint(it(stream_), v);
+    char buf[(sizeof(T) * 8 + 6) / 7];
+    char *end = buf;
+    tools::write_varint(end, v);
+    serialize_blob(buf, end - buf);
   }
   void begin_array(size_t s)
   {
@@ -39,7 +39,7 @@ namespace serialization {
   template <class T>
     bool parse_binary(const std::string &blob, T &v)
     {
-      std::istringstream istr(blob);
+      binary_input_stream istr(blob);
       binary_archive<false> iar(istr);
       return ::serialization::serialize(iar, v);
     }
@@ -49,10 +49,10 @@ namespace serialization {
   template<class T>
     bool dump_binary(T& v, std::string& blob)
     {
-      std::stringstream ostr;
+      blob.clear();
+      binary_output_stream ostr(blob);
       binary_archive<true> oar(ostr);
       bool success = ::serialization::serialize(oar, v);
-      blob = ostr.str();
       return success && ostr.good();
     };
 
@@ -636,6 +636,66 @@ bool simple_wallet::set_confirm_missing_payment_id(const std::vector<std::string
   return true;
 }
 
+bool simple_wallet::set_refresh_prefetch_depth(const std::vector<std::string> &args/* = std::vector<std::string>()*/)
+{
+  uint32_t depth;
+  if (strchr(args[1].c_str(), '-') || !epee::string_tools::get_xtype_from_string(depth, args[1]) || depth < 1 || depth > WALLET_REFRESH_PREFETCH_DEPTH_MAX)
+  {
+    fail_msg_writer() << tr("refresh-prefetch-depth must be an integer from 1 to ") << WALLET_REFRESH_PREFETCH_DEPTH_MAX;
+    return true;
+  }
+
+  tools::password_container pwd_container(m_wallet_file.empty());
+  bool success = pwd_container.read_password();
+  if (!success)
+  {
+    fail_msg_writer() << tr("failed to read wallet password");
+    return true;
+  }
+
+  /* verify password before using so user doesn't accidentally set a new password for rewritten wallet */
+  success = m_wallet->verify_password(pwd_container.password());
+  if (!success)
+  {
+    fail_msg_writer() << tr("invalid password");
+    return true;
+  }
+
+  m_wallet->refresh_prefetch_depth(depth);
+  m_wallet->rewrite(m_wallet_file, pwd_container.password());
+  return true;
+}
+
+bool simple_wallet::set_decoy_pool_size(const std::vector<std::string> &args/* = std::vector<std::string>()*/)
+{
+  uint32_t size;
+  if (strchr(args[1].c_str(), '-') || !epee::string_tools::get_xtype_from_string(size, args[1]) || size > WALLET_DECOY_POOL_SIZE_MAX)
+  {
+    fail_msg_writer() << tr("decoy-pool-size must be an integer from 0 to ") << WALLET_DECOY_POOL_SIZE_MAX;
+    return true;
+  }
+
+  tools::password_container pwd_container(m_wallet_file.empty());
+  bool success = pwd_container.read_password();
+  if (!success)
+  {
+    fail_msg_writer() << tr("failed to read wallet password");
+    return true;
+  }
+
+  /* verify password before using so user doesn't accidentally set a new password for rewritten wallet */
+  success = m_wallet->verify_password(pwd_container.password());
+  if (!success)
+  {
+    fail_msg_writer() << tr("invalid password");
+    return true;
+  }
+
+  m_wallet->decoy_pool_size(size);
+  m_wallet->rewrite(m_wallet_file, pwd_container.password());
+  return true;
+}
+
 bool simple_wallet::help(const std::vector<std::string> &args/* = std::vector<std::string>()*/)
 {
   success_msg_writer() << get_commands_str();
@@ -674,7 +734,7 @@ simple_wallet::simple_wallet()
   m_cmd_binder.set_handler("viewkey", boost::bind(&simple_wallet::viewkey, this, _1), tr("Display private view key"));
   m_cmd_binder.set_handler("spendkey", boost::bind(&simple_wallet::spendkey, this, _1), tr("Display private spend key"));
   m_cmd_binder.set_handler("seed", boost::bind(&simple_wallet::seed, this, _1), tr("Display Electrum-style mnemonic seed"));
-  m_cmd_binder.set_handler("set", boost::bind(&simple_wallet::set_variable, this, _1), tr("Available options: seed language - set wallet seed language; always-confirm-transfers <1|0> - whether to confirm unsplit txes; store-tx-info <1|0> - whether to store outgoing tx info (destination address, payment ID, tx secret key) for future reference; default-mixin <n> - set default mixin (default is 4); auto-refresh <1|0> - whether to automatically sync new blocks from the daemon; refresh-type <full|optimize-coinbase|no-coinbase|default> - set wallet refresh behaviour; priority [1|2|3] - normal/elevated/priority fee; confirm-missing-payment-id <1|0>"));
+  m_cmd_binder.set_handler("set", boost::bind(&simple_wallet::set_variable, this, _1), tr("Available options: seed language - set wallet seed language; always-confirm-transfers <1|0> - whether to confirm unsplit txes; store-tx-info <1|0> - whether to store outgoing tx info (destination address, payment ID, tx secret key) for future reference; default-mixin <n> - set default mixin (default is 4); auto-refresh <1|0> - whether to automatically sync new blocks from the daemon; refresh-type <full|optimize-coinbase|no-coinbase|default> - set wallet refresh behaviour; priority [1|2|3] - normal/elevated/priority fee; confirm-missing-payment-id <1|0>; refresh-prefetch-depth <n> - how many batches of blocks to fetch ahead while refreshing; decoy-pool-size <n> - how many rct outputs to fetch ahead for rings, 0 to ask the daemon for each tx"));
   m_cmd_binder.set_handler("rescan_spent", boost::bind(&simple_wallet::rescan_spent, this, _1), tr("Rescan blockchain for spent outputs"));
   m_cmd_binder.set_handler("get_tx_key", boost::bind(&simple_wallet::get_tx_key, this, _1), tr("Get transaction key (r) for a given <txid>"));
   m_cmd_binder.set_handler("check_tx_key", boost::bind(&simple_wallet::check_tx_key, this, _1), tr("Check amount going to <address> in <txid>"));
@@ -704,6 +764,8 @@ bool simple_wallet::set_variable(const std::vector<std::string> &args)
     success_msg_writer() << "refresh-type = " << get_refresh_type_name(m_wallet->get_refresh_type());
     success_msg_writer() << "priority = " << m_wallet->get_default_priority();
     success_msg_writer() << "confirm-missing-payment-id = " << m_wallet->confirm_missing_payment_id();
+    success_msg_writer() << "refresh-prefetch-depth = " << m_wallet->refresh_prefetch_depth();
+    success_msg_writer() << "decoy-pool-size = " << m_wallet->decoy_pool_size();
     return true;
   }
   else
@@ -829,6 +891,32 @@ bool simple_wallet::set_variable(const std::vector<std::string> &args)
         return true;
       }
     }
+    else if (args[0] == "refresh-prefetch-depth")
+    {
+      if (args.size() <= 1)
+      {
+        fail_msg_writer() << tr("set refresh-prefetch-depth: needs an argument (integer >= 1)");
+        return true;
+      }
+      else
+      {
+        set_refresh_prefetch_depth(args);
+        return true;
+      }
+    }
+    else if (args[0] == "decoy-pool-size")
+    {
+      if (args.size() <= 1)
+      {
+        fail_msg_writer() << tr("set decoy-pool-size: needs an argument (integer >= 0)");
+        return true;
+      }
+      else
+      {
+        set_decoy_pool_size(args);
+        return true;
+      }
+    }
   }
   fail_msg_writer() << tr("set: unrecognized argument(s)");
   return true;
@@ -2970,7 +3058,8 @@ bool simple_wallet::sign_transfer(const std::vector<std::string> &args_)
   std::vector<tools::wallet2::pending_tx> ptx;
   try
   {
-    bool r = m_wallet->sign_tx("unsigned_monero_tx", "signed_monero_tx", ptx, [&](const tools::wallet2::unsigned_tx_set &tx){ return accept_loaded_tx(tx); });
+    bool r = m_wallet->sign_tx("unsigned_monero_tx", "signed_monero_tx", ptx, [&](const tools::wallet2::unsigned_tx_set &tx){ return accept_loaded_tx(tx); },
+      [&](size_t done, size_t total){ message_writer() << boost::format(tr("Signed %u/%u transactions")) % (unsigned)done % (unsigned)total; });
     if (!r)
     {
       fail_msg_writer() << tr("Failed to sign transaction");
@@ -39,6 +39,7 @@
 
 #include <string>
 #include <list>
+#include <unordered_map>
 
 using namespace epee;
 
@@ -49,6 +50,10 @@ TransactionHistory::~TransactionHistory() {}
 
 TransactionHistoryImpl::TransactionHistoryImpl(WalletImpl *wallet)
     : m_wallet(wallet)
+    , m_refreshHeight(0)
+    , m_detachCount(0)
+    , m_pendingCount(0)
+    , m_refreshed(false)
 {
 
 }
@@ -92,6 +97,17 @@ std::vector<TransactionInfo *> TransactionHistoryImpl::getAll() const
     return m_history;
 }
 
+std::vector<TransactionInfo *> TransactionHistoryImpl::getRange(int offset, int count) const
+{
+    boost::shared_lock<boost::shared_mutex> lock(m_historyMutex);
+    std::vector<TransactionInfo *> result;
+    if (offset < 0 || count <= 0 || static_cast<size_t>(offset) >= m_history.size())
+        return result;
+    size_t end = std::min(m_history.size(), static_cast<size_t>(offset) + static_cast<size_t>(count));
+    result.assign(m_history.begin() + offset, m_history.begin() + end);
+    return result;
+}
+
 void TransactionHistoryImpl::refresh()
 {
     // multithreaded access:
@@ -99,14 +115,31 @@ void TransactionHistoryImpl::refresh()
     // for "write" access, locking exclusively
     boost::unique_lock<boost::shared_mutex> lock(m_historyMutex);
 
-    // TODO: configurable values;
-    uint64_t min_height = 0;
-    uint64_t max_height = (uint64_t)-1;
+    const tools::wallet2 *wallet = m_wallet->m_wallet;
+
+    // confirmed entries are only ever dropped by a detach (reorg or rescan),
+    // otherwise we keep what we have and only read the blocks added since
+    if (!m_refreshed || wallet->get_detach_count() != m_detachCount) {
+        for (auto t : m_history)
+            delete t;
+        m_history.clear();
+        m_pendingCount = 0;
+        m_refreshHeight = 0;
+        m_detachCount = wallet->get_detach_count();
+        m_refreshed = true;
+    }
 
-    // delete old transactions;
-    for (auto t : m_history)
-        delete t;
-    m_history.clear();
+    // pending entries are kept at the end, take them off while appending
+    std::vector<TransactionInfoImpl*> old_pending;
+    for (size_t n = m_history.size() - m_pendingCount; n < m_history.size(); ++n)
+        old_pending.push_back(static_cast<TransactionInfoImpl*>(m_history[n]));
+    m_history.resize(m_history.size() - m_pendingCount);
+    m_pendingCount = 0;
+
+    // blocks up to the wallet's height minus one have been scanned
+    uint64_t min_height = m_refreshHeight;
+    uint64_t max_height = wallet->get_blockchain_current_height();
+    max_height = max_height > 0 ? max_height - 1 : 0;
 
     // transactions are stored in wallet2:
     // - confirmed_transfer_details   - out transfers
@@ -117,7 +150,7 @@ void TransactionHistoryImpl::refresh()
     // one input transaction contains only one transfer. e.g. <transaction_id> - <100XMR>
 
     std::list<std::pair<crypto::hash, tools::wallet2::payment_details>> in_payments;
-    m_wallet->m_wallet->get_payments(in_payments, min_height, max_height);
+    wallet->get_payments(in_payments, min_height, max_height);
     for (std::list<std::pair<crypto::hash, tools::wallet2::payment_details>>::const_iterator i = in_payments.begin(); i != in_payments.end(); ++i) {
         const tools::wallet2::payment_details &pd = i->second;
         std::string payment_id = string_tools::pod_to_hex(i->first);
@@ -149,7 +182,7 @@ void TransactionHistoryImpl::refresh()
     //
 
     std::list<std::pair<crypto::hash, tools::wallet2::confirmed_transfer_details>> out_payments;
-    m_wallet->m_wallet->get_payments_out(out_payments, min_height, max_height);
+    wallet->get_payments_out(out_payments, min_height, max_height);
 
     for (std::list<std::pair<crypto::hash, tools::wallet2::confirmed_transfer_details>>::const_iterator i = out_payments.begin();
          i != out_payments.end(); ++i) {
@@ -177,14 +210,21 @@ void TransactionHistoryImpl::refresh()
 
         // single output transaction might contain multiple transfers
         for (const auto &d: pd.m_dests) {
-            ti->m_transfers.push_back({d.amount, get_account_address_as_str(m_wallet->m_wallet->testnet(), d.addr)});
+            ti->m_transfers.push_back({d.amount, get_account_address_as_str(wallet->testnet(), d.addr)});
         }
         m_history.push_back(ti);
     }
 
-    // unconfirmed output transactions
+    if (max_height > m_refreshHeight)
+        m_refreshHeight = max_height;
+
+    // unconfirmed output transactions, updated in place when already known
+    std::unordered_map<std::string, TransactionInfoImpl*> known;
+    for (auto ti : old_pending)
+        known.emplace(ti->m_hash, ti);
+
     std::list<std::pair<crypto::hash, tools::wallet2::unconfirmed_transfer_details>> upayments;
-    m_wallet->m_wallet->get_unconfirmed_payments_out(upayments);
+    wallet->get_unconfirmed_payments_out(upayments);
     for (std::list<std::pair<crypto::hash, tools::wallet2::unconfirmed_transfer_details>>::const_iterator i = upayments.begin(); i != upayments.end(); ++i) {
         const tools::wallet2::unconfirmed_transfer_details &pd = i->second;
         const crypto::hash &hash = i->first;
@@ -194,18 +234,31 @@ void TransactionHistoryImpl::refresh()
         if (payment_id.substr(16).find_first_not_of('0') == std::string::npos)
             payment_id = payment_id.substr(0,16);
         bool is_failed = pd.m_state == tools::wallet2::unconfirmed_transfer_details::failed;
-
-        TransactionInfoImpl * ti = new TransactionInfoImpl();
+        std::string hash_str = string_tools::pod_to_hex(hash);
+
+        TransactionInfoImpl * ti;
+        auto it = known.find(hash_str);
+        if (it != known.end()) {
+            ti = it->second;
+            known.erase(it);
+        } else {
+            ti = new TransactionInfoImpl();
+        }
         ti->m_paymentid = payment_id;
         ti->m_amount = amount - pd.m_change;
         ti->m_fee    = fee;
         ti->m_direction = TransactionInfo::Direction_Out;
         ti->m_failed = is_failed;
         ti->m_pending = true;
-        ti->m_hash = string_tools::pod_to_hex(hash);
+        ti->m_hash = hash_str;
         ti->m_timestamp = pd.m_timestamp;
         m_history.push_back(ti);
+        ++m_pendingCount;
     }
+
+    // the rest got confirmed (and appended above) or dropped
+    for (auto &e : known)
+        delete e.second;
 }
 
 } // namespace
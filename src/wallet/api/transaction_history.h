@@ -45,6 +45,7 @@ public:
     virtual TransactionInfo * transaction(int index)  const;
     virtual TransactionInfo * transaction(const std::string &id) const;
     virtual std::vector<TransactionInfo*> getAll() const;
+    virtual std::vector<TransactionInfo*> getRange(int offset, int count) const;
     virtual void refresh();
 
 private:
@@ -52,6 +53,13 @@ private:
     // TransactionHistory is responsible of memory management
     std::vector<TransactionInfo*> m_history;
     WalletImpl *m_wallet;
+    // confirmed entries are loaded up to this height
+    uint64_t m_refreshHeight;
+    // wallet2's detach count when they were loaded
+    uint64_t m_detachCount;
+    // number of pending entries, kept at the end of m_history
+    size_t m_pendingCount;
+    bool m_refreshed;
     mutable boost::shared_mutex   m_historyMutex;
 };
 
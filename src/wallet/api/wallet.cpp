@@ -123,6 +123,15 @@ struct Wallet2CallbackImpl : public tools::i_wallet2_callback
         // TODO;
     }
 
+    virtual void on_refresh_progress(uint64_t height, uint64_t daemon_height, uint64_t blocks_fetched, double blocks_per_second)
+    {
+        LOG_PRINT_L3(__FUNCTION__ << ": height: " << height << "/" << daemon_height
+                     << ", blocks: " << blocks_fetched << ", " << blocks_per_second << " blocks/s");
+        if (m_listener) {
+            m_listener->refreshProgress(height, daemon_height, blocks_fetched, blocks_per_second);
+        }
+    }
+
     WalletListener * m_listener;
     WalletImpl     * m_wallet;
 };
@@ -551,6 +560,8 @@ bool WalletImpl::synchronized() const
 bool WalletImpl::refresh()
 {
     clearStatus();
+    // an explicit refresh must not wait on a paused one
+    m_wallet->pause_refresh(false);
     doRefresh();
     return m_status == Status_Ok;
 }
@@ -1037,6 +1048,7 @@ void WalletImpl::doRefresh()
 void WalletImpl::startRefresh()
 {
     LOG_PRINT_L2(__FUNCTION__ << ": refresh started/resumed...");
+    m_wallet->pause_refresh(false);
     if (!m_refreshEnabled) {
         m_refreshEnabled = true;
         m_refreshCV.notify_one();
@@ -1061,9 +1073,36 @@ void WalletImpl::pauseRefresh()
     // TODO synchronize access
     if (!m_refreshThreadDone) {
         m_refreshEnabled = false;
+        m_wallet->pause_refresh(true);
     }
 }
 
+void WalletImpl::cancelRefresh()
+{
+    LOG_PRINT_L2(__FUNCTION__ << ": refresh cancelled...");
+    m_wallet->stop();
+}
+
+void WalletImpl::setRefreshThreads(uint32_t threads)
+{
+    m_wallet->scan_threads(threads);
+}
+
+uint32_t WalletImpl::refreshThreads() const
+{
+    return m_wallet->scan_threads();
+}
+
+void WalletImpl::setRefreshCpuShare(uint32_t percent)
+{
+    m_wallet->refresh_cpu_share(percent);
+}
+
+uint32_t WalletImpl::refreshCpuShare() const
+{
+    return m_wallet->refresh_cpu_share();
+}
+
 
 bool WalletImpl::isNewWallet() const
 {
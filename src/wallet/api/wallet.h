@@ -109,6 +109,11 @@ public:
     virtual bool verifySignedMessage(const std::string &message, const std::string &address, const std::string &signature) const;
     virtual void startRefresh();
     virtual void pauseRefresh();
+    virtual void cancelRefresh();
+    virtual void setRefreshThreads(uint32_t threads);
+    virtual uint32_t refreshThreads() const;
+    virtual void setRefreshCpuShare(uint32_t percent);
+    virtual uint32_t refreshCpuShare() const;
 
 private:
     void clearStatus();
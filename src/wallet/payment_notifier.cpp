@@ -0,0 +1,124 @@
+// Copyright (c) 2014-2016, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "payment_notifier.h"
+#include "storages/portable_storage_template_helper.h"
+#include "string_tools.h"
+
+namespace tools
+{
+//----------------------------------------------------------------------------------------------------
+void payment_notifier::callback::on_payment_received(uint64_t height, const crypto::hash& payment_id, const crypto::hash& txid, uint64_t amount, uint64_t unlock_time)
+{
+  wallet_rpc::payment_notification payment;
+  payment.wallet = m_wallet;
+  payment.payment_id = epee::string_tools::pod_to_hex(payment_id);
+  payment.tx_hash = epee::string_tools::pod_to_hex(txid);
+  payment.amount = amount;
+  payment.block_height = height;
+  payment.unlock_time = unlock_time;
+  m_notifier.notify(payment);
+}
+//----------------------------------------------------------------------------------------------------
+payment_notifier::payment_notifier(const std::string &url):
+  m_url(url),
+  m_stop(false)
+{
+  m_thread = boost::thread([this]() { run(); });
+}
+//----------------------------------------------------------------------------------------------------
+payment_notifier::~payment_notifier()
+{
+  {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_cond.notify_all();
+  m_thread.join();
+}
+//----------------------------------------------------------------------------------------------------
+void payment_notifier::notify(wallet_rpc::payment_notification &payment)
+{
+  std::string body;
+  if (!epee::serialization::store_t_to_json(payment, body))
+  {
+    LOG_ERROR("Failed to serialize payment notification for " << payment.tx_hash);
+    return;
+  }
+  {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    if (m_queue.size() >= PAYMENT_NOTIFIER_MAX_QUEUED)
+    {
+      LOG_ERROR("Too many undelivered payment notifications, dropping the oldest");
+      m_queue.pop_front();
+    }
+    m_queue.push_back(std::move(body));
+  }
+  m_cond.notify_all();
+}
+//----------------------------------------------------------------------------------------------------
+void payment_notifier::run()
+{
+  epee::net_utils::http::fields_list headers;
+  headers.push_back(std::make_pair("Content-Type", "application/json"));
+  unsigned backoff = 0;
+  boost::unique_lock<boost::mutex> lock(m_mutex);
+  while (!m_stop)
+  {
+    if (m_queue.empty())
+    {
+      m_cond.wait(lock);
+      continue;
+    }
+    // out of the queue while sent, so dropping the oldest cannot take it
+    std::string body = std::move(m_queue.front());
+    m_queue.pop_front();
+    lock.unlock();
+
+    const epee::net_utils::http::http_response_info *info = NULL;
+    bool ok = epee::net_utils::http::invoke_request(m_url, m_http_client, PAYMENT_NOTIFIER_TIMEOUT_MS, &info, "POST", body, headers);
+    ok = ok && info && info->m_response_code / 100 == 2;
+    if (!ok)
+    {
+      LOG_PRINT_L0("Failed to deliver payment notification to " << m_url << (info ? ", HTTP " + std::to_string(info->m_response_code) : std::string()) << ", retrying");
+      m_http_client.disconnect();
+    }
+
+    lock.lock();
+    if (ok)
+    {
+      backoff = 0;
+      continue;
+    }
+    if (m_queue.size() < PAYMENT_NOTIFIER_MAX_QUEUED)
+      m_queue.push_front(std::move(body));
+    backoff = std::min(backoff ? backoff * 2 : 1, (unsigned)PAYMENT_NOTIFIER_MAX_BACKOFF_SECONDS);
+    m_cond.wait_for(lock, boost::chrono::seconds(backoff), [this]() { return m_stop; });
+  }
+}
+}
@@ -0,0 +1,87 @@
+// Copyright (c) 2014-2016, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <deque>
+#include <string>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "wallet2.h"
+#include "net/http_client.h"
+#include "wallet_rpc_server_commands_defs.h"
+
+#define PAYMENT_NOTIFIER_MAX_QUEUED 10000
+#define PAYMENT_NOTIFIER_TIMEOUT_MS 10000
+#define PAYMENT_NOTIFIER_MAX_BACKOFF_SECONDS 60
+
+namespace tools
+{
+  /*!
+   * \brief POSTs the payments wallets receive to a URL, as JSON
+   *
+   * Deliveries run on a thread of their own, so a slow or unreachable
+   * receiver never holds up refresh. A failed one is retried, waiting twice
+   * as long each time up to PAYMENT_NOTIFIER_MAX_BACKOFF_SECONDS, and the
+   * oldest are dropped past PAYMENT_NOTIFIER_MAX_QUEUED. Undelivered ones
+   * are lost on exit: the receiver still has get_payments to catch up.
+   */
+  class payment_notifier
+  {
+  public:
+    //! the callback to set on a wallet, reporting its payments under a name
+    class callback: public i_wallet2_callback
+    {
+    public:
+      callback(payment_notifier &notifier, const std::string &wallet): m_notifier(notifier), m_wallet(wallet) {}
+      virtual void on_payment_received(uint64_t height, const crypto::hash& payment_id, const crypto::hash& txid, uint64_t amount, uint64_t unlock_time);
+
+    private:
+      payment_notifier &m_notifier;
+      const std::string m_wallet;
+    };
+
+    explicit payment_notifier(const std::string &url);
+    ~payment_notifier();
+
+    void notify(wallet_rpc::payment_notification &payment);
+
+  private:
+    void run();
+
+    const std::string m_url;
+    epee::net_utils::http::http_simple_client m_http_client;  //!< only used by m_thread
+    boost::mutex m_mutex;
+    boost::condition_variable m_cond;
+    std::deque<std::string> m_queue;  //!< JSON bodies, oldest first
+    bool m_stop;
+    boost::thread m_thread;
+  };
+}
@@ -0,0 +1,175 @@
+// Copyright (c) 2014-2016, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include <boost/optional/optional.hpp>
+
+#include <algorithm>
+#include "shared_refresh.h"
+
+using namespace cryptonote;
+
+namespace tools
+{
+//----------------------------------------------------------------------------------------------------
+shared_refresh::shared_refresh() : m_run(true)
+{
+}
+//----------------------------------------------------------------------------------------------------
+bool shared_refresh::add(wallet2 *wallet)
+{
+  boost::lock_guard<boost::mutex> lock(m_mutex);
+  if (!m_wallets.empty() && m_wallets.front()->m_daemon_address != wallet->m_daemon_address)
+    return false;
+  if (std::find(m_wallets.begin(), m_wallets.end(), wallet) == m_wallets.end())
+    m_wallets.push_back(wallet);
+  return true;
+}
+//----------------------------------------------------------------------------------------------------
+void shared_refresh::remove(wallet2 *wallet)
+{
+  boost::lock_guard<boost::mutex> lock(m_mutex);
+  m_wallets.erase(std::remove(m_wallets.begin(), m_wallets.end(), wallet), m_wallets.end());
+}
+//----------------------------------------------------------------------------------------------------
+size_t shared_refresh::size() const
+{
+  boost::lock_guard<boost::mutex> lock(m_mutex);
+  return m_wallets.size();
+}
+//----------------------------------------------------------------------------------------------------
+size_t shared_refresh::refresh()
+{
+  boost::lock_guard<boost::mutex> lock(m_mutex);
+  m_run.store(true, std::memory_order_relaxed);
+
+  std::vector<wallet2*> wallets, alone;
+  for (wallet2 *wallet: m_wallets)
+  {
+    // only hashes are pulled up to the refresh height, there is nothing to share
+    if (wallet->m_refresh_from_block_height > wallet->m_blockchain.size())
+      alone.push_back(wallet);
+    else
+      wallets.push_back(wallet);
+  }
+
+  size_t try_count = 0;
+  while (m_run.load(std::memory_order_relaxed) && !wallets.empty())
+  {
+    try
+    {
+      if (!refresh_batch(wallets, alone))
+        break;
+      try_count = 0;
+    }
+    catch (const std::exception &e)
+    {
+      if (try_count < 3)
+      {
+        LOG_PRINT_L1("Another try shared pull_blocks (try_count=" << try_count << ")...");
+        ++try_count;
+      }
+      else
+      {
+        LOG_ERROR("Shared pull_blocks failed, try_count=" << try_count << ": " << e.what());
+        alone.insert(alone.end(), wallets.begin(), wallets.end());
+        wallets.clear();
+      }
+    }
+  }
+
+  for (wallet2 *wallet: wallets)
+  {
+    wallet->m_blockchain.trim(WALLET_HASHCHAIN_KEEP);
+    try
+    {
+      wallet->update_pool_state();
+    }
+    catch (...)
+    {
+      LOG_PRINT_L1("Failed to check pending transactions");
+    }
+  }
+
+  size_t failed = 0;
+  for (wallet2 *wallet: alone)
+  {
+    if (!m_run.load(std::memory_order_relaxed))
+      break;
+    uint64_t blocks_fetched = 0;
+    bool received_money = false, ok = false;
+    if (!wallet->refresh(blocks_fetched, received_money, ok))
+      ++failed;
+  }
+  LOG_PRINT_L1("Shared refresh done, " << wallets.size() << " wallets refreshed together, " << alone.size() << " alone, " << failed << " failed");
+  return failed;
+}
+//----------------------------------------------------------------------------------------------------
+bool shared_refresh::refresh_batch(std::vector<wallet2*> &wallets, std::vector<wallet2*> &alone)
+{
+  // pull from the wallet furthest behind, so the batch is of use to it
+  wallet2 *lead = *std::min_element(wallets.begin(), wallets.end(), [](const wallet2 *w0, const wallet2 *w1) {
+    return w0->m_blockchain.size() < w1->m_blockchain.size();
+  });
+  std::list<crypto::hash> short_chain_history;
+  lead->get_short_chain_history(short_chain_history);
+
+  uint64_t blocks_start_height;
+  std::vector<cryptonote::block_complete_entry> blocks;
+  std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> o_indices;
+  lead->pull_blocks(0, blocks_start_height, short_chain_history, blocks, o_indices);
+  THROW_WALLET_EXCEPTION_IF(blocks.size() != o_indices.size(), error::wallet_internal_error, "size mismatch");
+  wallet2::parsed_blocks_t parsed;
+  wallet2::parse_blocks(m_pool, blocks, parsed);
+
+  bool added = false;
+  for (std::vector<wallet2*>::iterator i = wallets.begin(); i != wallets.end(); )
+  {
+    wallet2 *wallet = *i;
+    // one ahead of the batch waits for the lead to catch up
+    if (wallet->m_blockchain.size() < blocks_start_height + blocks.size())
+    {
+      try
+      {
+        uint64_t blocks_added = 0;
+        wallet->process_parsed_blocks(m_pool, blocks_start_height, parsed, o_indices, blocks_added);
+        added |= blocks_added > 0;
+      }
+      catch (const std::exception &e)
+      {
+        // most likely on another fork than the lead, it sorts that out alone
+        LOG_PRINT_L1("Wallet " << wallet->get_account().get_public_address_str(wallet->testnet()) << " leaves the shared refresh: " << e.what());
+        alone.push_back(wallet);
+        i = wallets.erase(i);
+        continue;
+      }
+    }
+    ++i;
+  }
+  return added;
+}
+//----------------------------------------------------------------------------------------------------
+}
@@ -0,0 +1,82 @@
+// Copyright (c) 2014-2016, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include <boost/optional/optional.hpp>
+
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+
+#include "common/thread_group.h"
+#include "wallet2.h"
+
+namespace tools
+{
+  /*!
+   * \brief refreshes a set of wallets using the same daemon together
+   *
+   * Each batch of blocks is pulled from the daemon and parsed once, then
+   * scanned with the keys of every wallet it is new to. Wallets which cannot
+   * follow the shared batches, because they are still skipping to their
+   * refresh height or are on another fork, are refreshed on their own.
+   *
+   * The wallets are not owned, and must not be used elsewhere while refresh
+   * runs.
+   */
+  class shared_refresh
+  {
+  public:
+    shared_refresh();
+
+    /*!
+     * \return false if the wallet uses another daemon than those added before
+     */
+    bool add(wallet2 *wallet);
+    /*!
+     * \brief waits for a running refresh to finish, then drops the wallet
+     */
+    void remove(wallet2 *wallet);
+    size_t size() const;
+
+    /*!
+     * \brief refreshes every wallet added
+     * \return the number of wallets which failed to refresh
+     */
+    size_t refresh();
+    void stop() { m_run.store(false, std::memory_order_relaxed); }
+
+  private:
+    bool refresh_batch(std::vector<wallet2*> &wallets, std::vector<wallet2*> &alone);
+
+    mutable boost::mutex m_mutex;  //!< held for the whole of a refresh
+    std::vector<wallet2*> m_wallets;
+    std::atomic<bool> m_run;
+    tools::thread_group m_pool;
+  };
+}
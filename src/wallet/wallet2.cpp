@@ -30,10 +30,12 @@
 
 #include <random>
 #include <tuple>
+#include <limits>
 #include <boost/archive/binary_oarchive.hpp>
 #include <boost/archive/binary_iarchive.hpp>
 #include <boost/format.hpp>
 #include <boost/optional/optional.hpp>
+#include <boost/thread/condition_variable.hpp>
 #include <boost/utility/value_init.hpp>
 #include "include_base_utils.h"
 using namespace epee;
@@ -61,6 +63,8 @@ using namespace epee;
 #include "common/json_util.h"
 #include "common/base58.h"
 #include "common/scoped_message_writer.h"
+#include "common/parallel_for.h"
+#include "common/task_region.h"
 #include "ringct/rctSigs.h"
 
 extern "C"
@@ -85,15 +89,15 @@ using namespace cryptonote;
 #define RECENT_OUTPUT_RATIO (0.25) // 25% of outputs are from the recent zone
 #define RECENT_OUTPUT_ZONE (5 * 86400) // last 5 days are the recent zone
 
+#define DECOY_POOL_MAX_AGE 3600 // pooled outputs are dropped after that long, as the recent zone moves on
+
 #define FEE_ESTIMATE_GRACE_BLOCKS 10 // estimate fee valid for that many blocks
 
-#define KILL_IOSERVICE()  \
-    do { \
-      work.reset(); \
-      while (!ioservice.stopped()) ioservice.poll(); \
-      threadpool.join_all(); \
-      ioservice.stop(); \
-    } while(0)
+#define WALLET_SCAN_CHUNK_SIZE ((size_t)64) // txes a scan thread takes at a time, their key derivations are done together
+
+#define WALLET_REFRESH_BATCH_MIN_BLOCKS 20 // a pull starts with the last blocks of the one before, it must reach well past them
+#define WALLET_REFRESH_BATCH_TARGET_MS 2000 // pulls taking longer ask for fewer blocks, much quicker ones for more
+#define WALLET_REFRESH_BATCH_MAX_BYTES (16 * 1024 * 1024) // keeps the batches in flight to a bounded amount of memory
 
 namespace
 {
@@ -128,6 +132,114 @@ uint64_t calculate_fee(uint64_t fee_per_kb, size_t bytes, uint64_t fee_multiplie
   return kB * fee_per_kb * fee_multiplier;
 }
 
+// picks one of the num_recent_outs most recent of num_outs outputs
+uint64_t pick_recent_output(uint64_t num_outs, uint64_t num_recent_outs)
+{
+  uint64_t r = crypto::rand<uint64_t>() % ((uint64_t)1 << 53);
+  double frac = std::sqrt((double)r / ((uint64_t)1 << 53));
+  uint64_t i = (uint64_t)(frac*num_recent_outs) + num_outs - num_recent_outs;
+  // just in case rounding up to 1 occurs after calc
+  if (i == num_outs)
+    --i;
+  return i;
+}
+
+// picks one of num_outs outputs, triangular distribution over [a,b) with a=0, mode c=b=up_index_limit
+uint64_t pick_triangular_output(uint64_t num_outs)
+{
+  uint64_t r = crypto::rand<uint64_t>() % ((uint64_t)1 << 53);
+  double frac = std::sqrt((double)r / ((uint64_t)1 << 53));
+  uint64_t i = (uint64_t)(frac*num_outs);
+  // just in case rounding up to 1 occurs after calc
+  if (i == num_outs)
+    --i;
+  return i;
+}
+
+// a section of a sectioned cache file, before encryption
+template<typename T>
+std::string dump_cache_section(const T &t)
+{
+  std::stringstream oss;
+  boost::archive::binary_oarchive ar(oss);
+  ar << t;
+  return oss.str();
+}
+
+// throws on bad data
+template<typename T>
+void parse_cache_section(const std::string &data, T &t)
+{
+  std::stringstream iss;
+  iss << data;
+  boost::archive::binary_iarchive ar(iss);
+  ar >> t;
+}
+
+// reads and decrypts a section at the given file offset, empty if it cannot be read
+std::string read_cache_section(std::istream &stream, const std::pair<uint64_t, tools::wallet2::cache_section> &section, const crypto::chacha8_key &key)
+{
+  std::string cipher(section.second.size, '\0');
+  stream.clear();
+  stream.seekg(section.first);
+  stream.read(&cipher[0], cipher.size());
+  if (!stream.good())
+    return std::string();
+  std::string plain(cipher.size(), '\0');
+  crypto::chacha8(cipher.data(), cipher.size(), key, section.second.iv, &plain[0]);
+  return plain;
+}
+
+// hands items from one refresh stage to the next, holding at most capacity
+// of them. Once closed, pushes fail and pops only drain what is left.
+template<typename T>
+class stage_queue
+{
+public:
+  explicit stage_queue(size_t capacity) : m_capacity(std::max<size_t>(capacity, 1)), m_closed(false) {}
+
+  // waits while full, false if closed
+  bool push(T item)
+  {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    m_not_full.wait(lock, [this] { return m_items.size() < m_capacity || m_closed; });
+    if (m_closed)
+      return false;
+    m_items.push_back(std::move(item));
+    m_not_empty.notify_one();
+    return true;
+  }
+
+  // waits while empty, false once closed and drained
+  bool pop(T &item)
+  {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    m_not_empty.wait(lock, [this] { return !m_items.empty() || m_closed; });
+    if (m_items.empty())
+      return false;
+    item = std::move(m_items.front());
+    m_items.pop_front();
+    m_not_full.notify_one();
+    return true;
+  }
+
+  void close()
+  {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    m_closed = true;
+    m_not_full.notify_all();
+    m_not_empty.notify_all();
+  }
+
+private:
+  const size_t m_capacity;
+  bool m_closed;
+  std::deque<T> m_items;
+  boost::mutex m_mutex;
+  boost::condition_variable m_not_full;
+  boost::condition_variable m_not_empty;
+};
+
 uint64_t calculate_fee(uint64_t fee_per_kb, const cryptonote::blobdata &blob, uint64_t fee_multiplier)
 {
   return calculate_fee(fee_per_kb, blob.size(), fee_multiplier);
@@ -412,6 +524,65 @@ namespace tools
 // for now, limit to 30 attempts.  TODO: discuss a good number to limit to.
 const size_t MAX_SPLIT_ATTEMPTS = 30;
 
+//----------------------------------------------------------------------------------------------------
+bool hashchain::get(size_t height, crypto::hash &hash) const
+{
+  if (height >= size())
+    return false;
+  if (height >= m_offset)
+  {
+    hash = m_blockchain[height - m_offset];
+    return true;
+  }
+  if (height % WALLET_HASHCHAIN_CHECKPOINT_INTERVAL)
+    return false;
+  hash = m_checkpoints[height / WALLET_HASHCHAIN_CHECKPOINT_INTERVAL];
+  return true;
+}
+//----------------------------------------------------------------------------------------------------
+void hashchain::crop(size_t height)
+{
+  if (height >= size())
+    return;
+  if (height >= m_offset)
+  {
+    m_blockchain.resize(height - m_offset);
+    return;
+  }
+  // the hashes from height up go, trimmed ones included
+  m_blockchain.clear();
+  m_checkpoints.resize((height + WALLET_HASHCHAIN_CHECKPOINT_INTERVAL - 1) / WALLET_HASHCHAIN_CHECKPOINT_INTERVAL);
+  m_offset = height;
+}
+//----------------------------------------------------------------------------------------------------
+void hashchain::clear()
+{
+  m_offset = 0;
+  m_checkpoints.clear();
+  m_blockchain.clear();
+}
+//----------------------------------------------------------------------------------------------------
+void hashchain::fast_forward(const std::vector<crypto::hash> &checkpoints)
+{
+  if (checkpoints.empty())
+    return;
+  m_checkpoints.assign(checkpoints.begin(), checkpoints.end() - 1);
+  m_offset = m_checkpoints.size() * WALLET_HASHCHAIN_CHECKPOINT_INTERVAL;
+  m_blockchain.clear();
+  m_blockchain.push_back(checkpoints.back());
+}
+//----------------------------------------------------------------------------------------------------
+void hashchain::trim(size_t keep)
+{
+  while (m_blockchain.size() > keep)
+  {
+    if (m_offset % WALLET_HASHCHAIN_CHECKPOINT_INTERVAL == 0)
+      m_checkpoints.push_back(m_blockchain.front());
+    m_blockchain.pop_front();
+    ++m_offset;
+  }
+}
+//----------------------------------------------------------------------------------------------------
 const char* wallet2::tr(const char* str) { return i18n_translate(str, "tools::wallet2"); }
 
 bool wallet2::has_testnet_option(const boost::program_options::variables_map& vm)
@@ -465,11 +636,21 @@ std::pair<std::unique_ptr<wallet2>, password_container> wallet2::make_new(const
   return {make_basic(vm, opts), std::move(*pwd)};
 }
 
+std::unique_ptr<wallet2> wallet2::make_dummy(const boost::program_options::variables_map& vm)
+{
+  const options opts{};
+  return make_basic(vm, opts);
+}
+
 //----------------------------------------------------------------------------------------------------
 void wallet2::init(const std::string& daemon_address, uint64_t upper_transaction_size_limit)
 {
   m_upper_transaction_size_limit = upper_transaction_size_limit;
   m_daemon_address = daemon_address;
+  // connections to a previous daemon are not reused
+  m_daemon_clients.clear();
+  m_pool_tx_hashes.clear();
+  m_pool_tx_hashes_known = false;
 }
 //----------------------------------------------------------------------------------------------------
 bool wallet2::is_deterministic() const
@@ -526,27 +707,89 @@ void wallet2::set_spent(size_t idx, uint64_t height)
 {
   transfer_details &td = m_transfers[idx];
   LOG_PRINT_L2("Setting SPENT at " << height << ": ki " << td.m_key_image << ", amount " << print_money(td.m_amount));
+  if (!td.m_spent)
+    remove_unspent_balance(idx);
   td.m_spent = true;
   td.m_spent_height = height;
+  m_journal_spent.insert(idx);
 }
 //----------------------------------------------------------------------------------------------------
 void wallet2::set_unspent(size_t idx)
 {
   transfer_details &td = m_transfers[idx];
   LOG_PRINT_L2("Setting UNSPENT: ki " << td.m_key_image << ", amount " << print_money(td.m_amount));
+  if (td.m_spent)
+    add_unspent_balance(idx);
   td.m_spent = false;
   td.m_spent_height = 0;
+  m_journal_spent.insert(idx);
+}
+//----------------------------------------------------------------------------------------------------
+uint64_t wallet2::get_transfer_unlock_height(const transfer_details &td) const
+{
+  // the same conditions as is_transfer_unlocked, solved for m_blockchain.size()
+  const uint64_t unlock_time = td.m_unlock_time;
+  if (unlock_time >= CRYPTONOTE_MAX_BLOCK_NUMBER)
+    return std::numeric_limits<uint64_t>::max();
+  uint64_t height = td.m_block_height + CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE;
+  if (unlock_time + 1 > CRYPTONOTE_LOCKED_TX_ALLOWED_DELTA_BLOCKS)
+    height = std::max<uint64_t>(height, unlock_time + 1 - CRYPTONOTE_LOCKED_TX_ALLOWED_DELTA_BLOCKS);
+  return height;
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::add_unspent_balance(size_t idx)
+{
+  const transfer_details &td = m_transfers[idx];
+  m_unspent_balance += td.amount();
+  m_unspent_by_amount.insert(std::make_pair(td.amount(), idx));
+  const uint64_t unlock_height = get_transfer_unlock_height(td);
+  if (unlock_height > m_blockchain.size())
+    m_unlock_queue.insert(std::make_pair(unlock_height, idx));
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::remove_unspent_balance(size_t idx)
+{
+  const transfer_details &td = m_transfers[idx];
+  m_unspent_balance -= td.amount();
+  m_unspent_by_amount.erase(std::make_pair(td.amount(), idx));
+  m_unlock_queue.erase(std::make_pair(get_transfer_unlock_height(td), idx));
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::prune_unlock_queue()
+{
+  // time locked transfers sort last and stay, they are checked on each call
+  const uint64_t height = m_blockchain.size();
+  while (!m_unlock_queue.empty() && m_unlock_queue.begin()->first <= height)
+    m_unlock_queue.erase(m_unlock_queue.begin());
 }
 //----------------------------------------------------------------------------------------------------
-void wallet2::check_acc_out_precomp(const crypto::public_key &spend_public_key, const tx_out &o, const crypto::key_derivation &derivation, size_t i, bool &received, uint64_t &money_transfered, bool &error) const
+void wallet2::rebuild_balance()
 {
-  if (o.target.type() !=  typeid(txout_to_key))
+  m_unspent_balance = 0;
+  m_unspent_by_amount.clear();
+  m_unlock_queue.clear();
+  for (size_t i = 0; i < m_transfers.size(); ++i)
+    if (!m_transfers[i].m_spent)
+      add_unspent_balance(i);
+}
+//----------------------------------------------------------------------------------------------------
+crypto::public_key_precomp wallet2::get_spend_public_key_precomp() const
+{
+  crypto::public_key_precomp spend_public_key;
+  THROW_WALLET_EXCEPTION_IF(!crypto::precompute_public_key(m_account.get_keys().m_account_address.m_spend_public_key, spend_public_key),
+      error::wallet_internal_error, "Invalid spend public key");
+  return spend_public_key;
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::check_acc_out_precomp(const crypto::public_key_precomp &spend_public_key, const tx_view::output &o, const crypto::key_derivation &derivation, size_t i, bool &received, uint64_t &money_transfered, bool &error) const
+{
+  if (!o.to_key)
   {
      error = true;
      LOG_ERROR("wrong type id in transaction out");
      return;
   }
-  received = is_out_to_acc_precomp(spend_public_key, boost::get<txout_to_key>(o.target), derivation, i);
+  received = crypto::check_derived_public_key(derivation, i, spend_public_key, o.key);
   if(received)
   {
     money_transfered = o.amount; // may be 0 for ringct outputs
@@ -589,14 +832,155 @@ static uint64_t decodeRct(const rct::rctSig & rv, const crypto::public_key &pub,
   }
 }
 //----------------------------------------------------------------------------------------------------
-bool wallet2::wallet_generate_key_image_helper(const cryptonote::account_keys& ack, const crypto::public_key& tx_public_key, size_t real_output_index, cryptonote::keypair& in_ephemeral, crypto::key_image& ki)
+bool wallet2::wallet_generate_key_image_helper(const cryptonote::account_keys& ack, const crypto::public_key& tx_public_key, size_t real_output_index, cryptonote::keypair& in_ephemeral, crypto::key_image& ki) const
 {
   if (!cryptonote::generate_key_image_helper(ack, tx_public_key, real_output_index, in_ephemeral, ki))
     return false;
   return true;
 }
 //----------------------------------------------------------------------------------------------------
-void wallet2::process_new_transaction(const cryptonote::transaction& tx, const std::vector<uint64_t> &o_indices, uint64_t height, uint64_t ts, bool miner_tx, bool pool)
+void wallet2::scan_tx_pub_keys(const cryptonote::transaction& tx, tx_scan_info_t &scan) const
+{
+  // the scan_tx_* functions may run on a scan pool thread, so they must
+  // neither throw nor touch wallet state
+  try
+  {
+    scan.view.build(tx);
+    scan.extra_parsed = parse_tx_extra(tx.extra, scan.tx_extra_fields);
+    scan.no_pub_key = false;
+    scan.pub_keys.clear();
+
+    // Don't try to extract tx public key if tx has no ouputs
+    size_t pk_index = 0;
+    while (!tx.vout.empty())
+    {
+      // if tx.vout is not empty, we loop through all tx pubkeys
+
+      tx_extra_pub_key pub_key_field;
+      if(!find_tx_extra_field_by_type(scan.tx_extra_fields, pub_key_field, pk_index++))
+      {
+        scan.no_pub_key = pk_index == 1;
+        break;
+      }
+
+      scan.pub_keys.push_back(tx_pub_key_scan_info_t());
+      tx_pub_key_scan_info_t &pks = scan.pub_keys.back();
+      pks.pub_key = pub_key_field.pub_key;
+      pks.money = 0;
+      pks.error = false;
+    }
+  }
+  catch (...)
+  {
+    scan.exception = std::current_exception();
+  }
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::scan_tx_derivations(tx_scan_info_t *const *scans, size_t n) const
+{
+  try
+  {
+    // all the tx pubkeys go through the view key together
+    std::vector<crypto::public_key> pub_keys;
+    for (size_t i = 0; i < n; ++i)
+      for (const tx_pub_key_scan_info_t &pks: scans[i]->pub_keys)
+        pub_keys.push_back(pks.pub_key);
+    std::vector<crypto::key_derivation> derivations(pub_keys.size());
+    crypto::generate_key_derivations(pub_keys.data(), pub_keys.size(), m_account.get_keys().m_view_secret_key, derivations.data());
+    size_t k = 0;
+    for (size_t i = 0; i < n; ++i)
+      for (tx_pub_key_scan_info_t &pks: scans[i]->pub_keys)
+        pks.derivation = derivations[k++];
+  }
+  catch (...)
+  {
+    for (size_t i = 0; i < n; ++i)
+      if (!scans[i]->exception)
+        scans[i]->exception = std::current_exception();
+  }
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::scan_tx_outputs(const cryptonote::transaction& tx, bool miner_tx, const crypto::public_key_precomp &spend_public_key, tx_scan_info_t &scan) const
+{
+  if (scan.exception)
+    return;
+  try
+  {
+    const cryptonote::account_keys& keys = m_account.get_keys();
+    const cryptonote::tx_view &view = scan.view;
+    // checks output i, and derives what is needed to spend it if it is ours
+    auto check_output = [&](tx_pub_key_scan_info_t &pks, size_t i) -> bool
+    {
+      uint64_t money_transfered = 0;
+      bool error = false, received = false;
+      check_acc_out_precomp(spend_public_key, view.out(i), pks.derivation, i, received, money_transfered, error);
+      if (error)
+        return false;
+      if (received)
+      {
+        // sized on the first hit, as most scanned txes have nothing for us
+        if (pks.in_ephemeral.empty())
+        {
+          pks.in_ephemeral.resize(view.num_outputs());
+          pks.ki.resize(view.num_outputs());
+          pks.amount.resize(view.num_outputs());
+          pks.mask.resize(view.num_outputs());
+        }
+        wallet_generate_key_image_helper(keys, pks.pub_key, i, pks.in_ephemeral[i], pks.ki[i]);
+        THROW_WALLET_EXCEPTION_IF(pks.in_ephemeral[i].pub != view.out(i).key,
+            error::wallet_internal_error, "key_image generated ephemeral public key not matched with output_key");
+
+        pks.outs.push_back(i);
+        if (money_transfered == 0)
+        {
+          money_transfered = tools::decodeRct(tx.rct_signatures, pks.pub_key, keys.m_view_secret_key, i, pks.mask[i]);
+        }
+        pks.amount[i] = money_transfered;
+        pks.money += money_transfered;
+      }
+      return true;
+    };
+
+    for (tx_pub_key_scan_info_t &pks: scan.pub_keys)
+    {
+      if (miner_tx && m_refresh_type == RefreshNoCoinbase)
+      {
+        // assume coinbase isn't for us
+      }
+      else if (miner_tx && m_refresh_type == RefreshOptimizeCoinbase)
+      {
+        // this assumes that the miner tx pays a single address
+        if (!check_output(pks, 0))
+          pks.error = true;
+        else if (!pks.outs.empty())
+        {
+          // process the other outs from that tx
+          for (size_t i = 1; i < view.num_outputs() && !pks.error; ++i)
+            pks.error = !check_output(pks, i);
+        }
+      }
+      else
+      {
+        for (size_t i = 0; i < view.num_outputs() && !pks.error; ++i)
+          pks.error = !check_output(pks, i);
+      }
+    }
+  }
+  catch (...)
+  {
+    scan.exception = std::current_exception();
+  }
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::scan_tx(const cryptonote::transaction& tx, bool miner_tx, tx_scan_info_t &scan) const
+{
+  tx_scan_info_t *const scans[] = {&scan};
+  scan_tx_pub_keys(tx, scan);
+  scan_tx_derivations(scans, 1);
+  scan_tx_outputs(tx, miner_tx, get_spend_public_key_precomp(), scan);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::process_new_transaction(const cryptonote::transaction& tx, const std::vector<uint64_t> &o_indices, uint64_t height, uint64_t ts, bool miner_tx, bool pool, const tx_scan_info_t *scan)
 {
   class lazy_txid_getter
   {
@@ -616,202 +1000,46 @@ void wallet2::process_new_transaction(const cryptonote::transaction& tx, const s
     }
   } txid(tx);
 
+  // txes from blocks come scanned already, pool ones are scanned here
+  tx_scan_info_t local_scan;
+  if (!scan)
+  {
+    scan_tx(tx, miner_tx, local_scan);
+    scan = &local_scan;
+  }
+  if (scan->exception)
+    std::rethrow_exception(scan->exception);
+
   if (!miner_tx)
     process_unconfirmed(tx, height);
-  std::vector<size_t> outs;
   uint64_t tx_money_got_in_outs = 0;
   crypto::public_key tx_pub_key = null_pkey;
 
-  std::vector<tx_extra_field> tx_extra_fields;
-  if(!parse_tx_extra(tx.extra, tx_extra_fields))
+  const std::vector<tx_extra_field> &tx_extra_fields = scan->tx_extra_fields;
+  if(!scan->extra_parsed)
   {
     // Extra may only be partially parsed, it's OK if tx_extra_fields contains public key
     LOG_PRINT_L0("Transaction extra has unsupported format: " << txid());
   }
 
-  // Don't try to extract tx public key if tx has no ouputs
-  size_t pk_index = 0;
-  while (!tx.vout.empty())
+  if (scan->no_pub_key)
   {
-    // if tx.vout is not empty, we loop through all tx pubkeys
-
-    tx_extra_pub_key pub_key_field;
-    if(!find_tx_extra_field_by_type(tx_extra_fields, pub_key_field, pk_index++))
-    {
-      if (pk_index > 1)
-        break;
-      LOG_PRINT_L0("Public key wasn't found in the transaction extra. Skipping transaction " << txid());
-      if(0 != m_callback)
-	m_callback->on_skip_transaction(height, tx);
-      return;
-    }
-
-    int num_vouts_received = 0;
-    tx_pub_key = pub_key_field.pub_key;
-    bool r = true;
-    std::deque<cryptonote::keypair> in_ephemeral(tx.vout.size());
-    std::deque<crypto::key_image> ki(tx.vout.size());
-    std::deque<uint64_t> amount(tx.vout.size());
-    std::deque<rct::key> mask(tx.vout.size());
-    int threads = tools::get_max_concurrency();
-    const cryptonote::account_keys& keys = m_account.get_keys();
-    crypto::key_derivation derivation;
-    generate_key_derivation(tx_pub_key, keys.m_view_secret_key, derivation);
-    if (miner_tx && m_refresh_type == RefreshNoCoinbase)
-    {
-      // assume coinbase isn't for us
-    }
-    else if (miner_tx && m_refresh_type == RefreshOptimizeCoinbase)
-    {
-      uint64_t money_transfered = 0;
-      bool error = false, received = false;
-      check_acc_out_precomp(keys.m_account_address.m_spend_public_key, tx.vout[0], derivation, 0, received, money_transfered, error);
-      if (error)
-      {
-        r = false;
-      }
-      else
-      {
-        // this assumes that the miner tx pays a single address
-        if (received)
-        {
-          wallet_generate_key_image_helper(keys, tx_pub_key, 0, in_ephemeral[0], ki[0]);
-          THROW_WALLET_EXCEPTION_IF(in_ephemeral[0].pub != boost::get<cryptonote::txout_to_key>(tx.vout[0].target).key,
-              error::wallet_internal_error, "key_image generated ephemeral public key not matched with output_key");
-
-          outs.push_back(0);
-          if (money_transfered == 0)
-          {
-            money_transfered = tools::decodeRct(tx.rct_signatures, pub_key_field.pub_key, keys.m_view_secret_key, 0, mask[0]);
-          }
-          amount[0] = money_transfered;
-          tx_money_got_in_outs = money_transfered;
-          ++num_vouts_received;
-
-          // process the other outs from that tx
-          boost::asio::io_service ioservice;
-          boost::thread_group threadpool;
-          std::unique_ptr < boost::asio::io_service::work > work(new boost::asio::io_service::work(ioservice));
-          for (int i = 0; i < threads; i++)
-          {
-            threadpool.create_thread(boost::bind(&boost::asio::io_service::run, &ioservice));
-          }
-
-          std::vector<uint64_t> money_transfered(tx.vout.size());
-          std::deque<bool> error(tx.vout.size());
-          std::deque<bool> received(tx.vout.size());
-          // the first one was already checked
-          for (size_t i = 1; i < tx.vout.size(); ++i)
-          {
-            ioservice.dispatch(boost::bind(&wallet2::check_acc_out_precomp, this, std::cref(keys.m_account_address.m_spend_public_key), std::cref(tx.vout[i]), std::cref(derivation), i,
-              std::ref(received[i]), std::ref(money_transfered[i]), std::ref(error[i])));
-          }
-          KILL_IOSERVICE();
-          for (size_t i = 1; i < tx.vout.size(); ++i)
-          {
-            if (error[i])
-            {
-              r = false;
-              break;
-            }
-            if (received[i])
-            {
-              wallet_generate_key_image_helper(keys, tx_pub_key, i, in_ephemeral[i], ki[i]);
-              THROW_WALLET_EXCEPTION_IF(in_ephemeral[i].pub != boost::get<cryptonote::txout_to_key>(tx.vout[i].target).key,
-                  error::wallet_internal_error, "key_image generated ephemeral public key not matched with output_key");
-
-              outs.push_back(i);
-              if (money_transfered[i] == 0)
-              {
-                money_transfered[i] = tools::decodeRct(tx.rct_signatures, pub_key_field.pub_key, keys.m_view_secret_key, i, mask[i]);
-              }
-              tx_money_got_in_outs += money_transfered[i];
-              amount[i] = money_transfered[i];
-              ++num_vouts_received;
-            }
-          }
-        }
-      }
-    }
-    else if (tx.vout.size() > 1 && threads > 1)
-    {
-      boost::asio::io_service ioservice;
-      boost::thread_group threadpool;
-      std::unique_ptr < boost::asio::io_service::work > work(new boost::asio::io_service::work(ioservice));
-      for (int i = 0; i < threads; i++)
-      {
-        threadpool.create_thread(boost::bind(&boost::asio::io_service::run, &ioservice));
-      }
-
-      std::vector<uint64_t> money_transfered(tx.vout.size());
-      std::deque<bool> error(tx.vout.size());
-      std::deque<bool> received(tx.vout.size());
-      for (size_t i = 0; i < tx.vout.size(); ++i)
-      {
-        ioservice.dispatch(boost::bind(&wallet2::check_acc_out_precomp, this, std::cref(keys.m_account_address.m_spend_public_key), std::cref(tx.vout[i]), std::cref(derivation), i,
-          std::ref(received[i]), std::ref(money_transfered[i]), std::ref(error[i])));
-      }
-      KILL_IOSERVICE();
-      tx_money_got_in_outs = 0;
-      for (size_t i = 0; i < tx.vout.size(); ++i)
-      {
-        if (error[i])
-        {
-          r = false;
-          break;
-        }
-        if (received[i])
-        {
-          wallet_generate_key_image_helper(keys, tx_pub_key, i, in_ephemeral[i], ki[i]);
-          THROW_WALLET_EXCEPTION_IF(in_ephemeral[i].pub != boost::get<cryptonote::txout_to_key>(tx.vout[i].target).key,
-              error::wallet_internal_error, "key_image generated ephemeral public key not matched with output_key");
+    LOG_PRINT_L0("Public key wasn't found in the transaction extra. Skipping transaction " << txid());
+    if(0 != m_callback)
+      m_callback->on_skip_transaction(height, tx);
+    return;
+  }
 
-          outs.push_back(i);
-          if (money_transfered[i] == 0)
-          {
-            money_transfered[i] = tools::decodeRct(tx.rct_signatures, pub_key_field.pub_key, keys.m_view_secret_key, i, mask[i]);
-          }
-          tx_money_got_in_outs += money_transfered[i];
-          amount[i] = money_transfered[i];
-          ++num_vouts_received;
-        }
-      }
-    }
-    else
-    {
-      for (size_t i = 0; i < tx.vout.size(); ++i)
-      {
-        uint64_t money_transfered = 0;
-        bool error = false, received = false;
-        check_acc_out_precomp(keys.m_account_address.m_spend_public_key, tx.vout[i], derivation, i, received, money_transfered, error);
-        if (error)
-        {
-          r = false;
-          break;
-        }
-        else
-        {
-          if (received)
-          {
-            wallet_generate_key_image_helper(keys, tx_pub_key, i, in_ephemeral[i], ki[i]);
-            THROW_WALLET_EXCEPTION_IF(in_ephemeral[i].pub != boost::get<cryptonote::txout_to_key>(tx.vout[i].target).key,
-                error::wallet_internal_error, "key_image generated ephemeral public key not matched with output_key");
+  for (size_t pk_index = 0; pk_index < scan->pub_keys.size(); ++pk_index)
+  {
+    const tx_pub_key_scan_info_t &pks = scan->pub_keys[pk_index];
+    tx_pub_key = pks.pub_key;
+    THROW_WALLET_EXCEPTION_IF(pks.error, error::acc_outs_lookup_error, tx, tx_pub_key, m_account.get_keys());
 
-            outs.push_back(i);
-            if (money_transfered == 0)
-            {
-              money_transfered = tools::decodeRct(tx.rct_signatures, pub_key_field.pub_key, keys.m_view_secret_key, i, mask[i]);
-            }
-            amount[i] = money_transfered;
-            tx_money_got_in_outs += money_transfered;
-            ++num_vouts_received;
-          }
-        }
-      }
-    }
-    THROW_WALLET_EXCEPTION_IF(!r, error::acc_outs_lookup_error, tx, tx_pub_key, m_account.get_keys());
+    const std::vector<size_t> &outs = pks.outs;
+    tx_money_got_in_outs += pks.money;
 
-    if(!outs.empty() && num_vouts_received > 0)
+    if(!outs.empty())
     {
       //good news - got money! take care about it
       //usually we have only one transfer for user in transaction
@@ -827,7 +1055,7 @@ void wallet2::process_new_transaction(const cryptonote::transaction& tx, const s
 	THROW_WALLET_EXCEPTION_IF(tx.vout.size() <= o, error::wallet_internal_error, "wrong out in transaction: internal index=" +
 				  std::to_string(o) + ", total_outs=" + std::to_string(tx.vout.size()));
 
-        auto kit = m_pub_keys.find(in_ephemeral[o].pub);
+        auto kit = m_pub_keys.find(pks.in_ephemeral[o].pub);
 	THROW_WALLET_EXCEPTION_IF(kit != m_pub_keys.end() && kit->second >= m_transfers.size(),
             error::wallet_internal_error, std::string("Unexpected transfer index from public key: ")
             + "got " + (kit == m_pub_keys.end() ? "<none>" : boost::lexical_cast<std::string>(kit->second))
@@ -841,16 +1069,16 @@ void wallet2::process_new_transaction(const cryptonote::transaction& tx, const s
 	    td.m_block_height = height;
 	    td.m_internal_output_index = o;
 	    td.m_global_output_index = o_indices[o];
-	    td.m_tx = (const cryptonote::transaction_prefix&)tx;
+	    td.set_tx(tx, tx_pub_key);
 	    td.m_txid = txid();
-            td.m_key_image = ki[o];
+            td.m_key_image = pks.ki[o];
             td.m_key_image_known = !m_watch_only;
             td.m_amount = tx.vout[o].amount;
-            td.m_pk_index = pk_index - 1;
+            td.m_pk_index = pk_index;
             if (td.m_amount == 0)
             {
-              td.m_mask = mask[o];
-              td.m_amount = amount[o];
+              td.m_mask = pks.mask[o];
+              td.m_amount = pks.amount[o];
               td.m_rct = true;
             }
             else if (miner_tx && tx.version == 2)
@@ -864,8 +1092,9 @@ void wallet2::process_new_transaction(const cryptonote::transaction& tx, const s
               td.m_rct = false;
             }
 	    set_unspent(m_transfers.size()-1);
+	    add_unspent_balance(m_transfers.size()-1);
 	    m_key_images[td.m_key_image] = m_transfers.size()-1;
-	    m_pub_keys[in_ephemeral[o].pub] = m_transfers.size()-1;
+	    m_pub_keys[pks.in_ephemeral[o].pub] = m_transfers.size()-1;
 	    LOG_PRINT_L0("Received money: " << print_money(td.amount()) << ", with tx: " << txid());
 	    if (0 != m_callback)
 	      m_callback->on_money_received(height, tx, td.m_amount);
@@ -889,17 +1118,19 @@ void wallet2::process_new_transaction(const cryptonote::transaction& tx, const s
           if (!pool)
           {
             transfer_details &td = m_transfers[kit->second];
+            m_journal_full_store = true;
+            remove_unspent_balance(kit->second);
 	    td.m_block_height = height;
 	    td.m_internal_output_index = o;
 	    td.m_global_output_index = o_indices[o];
-	    td.m_tx = (const cryptonote::transaction_prefix&)tx;
+	    td.set_tx(tx, tx_pub_key);
 	    td.m_txid = txid();
             td.m_amount = tx.vout[o].amount;
-            td.m_pk_index = pk_index - 1;
+            td.m_pk_index = pk_index;
             if (td.m_amount == 0)
             {
-              td.m_mask = mask[o];
-              td.m_amount = amount[o];
+              td.m_mask = pks.mask[o];
+              td.m_amount = pks.amount[o];
               td.m_rct = true;
             }
             else if (miner_tx && tx.version == 2)
@@ -912,8 +1143,9 @@ void wallet2::process_new_transaction(const cryptonote::transaction& tx, const s
               td.m_mask = rct::identity();
               td.m_rct = false;
             }
-            THROW_WALLET_EXCEPTION_IF(td.get_public_key() != in_ephemeral[o].pub, error::wallet_internal_error, "Inconsistent public keys");
+            THROW_WALLET_EXCEPTION_IF(td.get_public_key() != pks.in_ephemeral[o].pub, error::wallet_internal_error, "Inconsistent public keys");
 	    THROW_WALLET_EXCEPTION_IF(td.m_spent, error::wallet_internal_error, "Inconsistent spent status");
+            add_unspent_balance(kit->second);
 
 	    LOG_PRINT_L0("Received money: " << print_money(td.amount()) << ", with tx: " << txid());
 	    if (0 != m_callback)
@@ -926,15 +1158,15 @@ void wallet2::process_new_transaction(const cryptonote::transaction& tx, const s
 
   uint64_t tx_money_spent_in_ins = 0;
   // check all outputs for spending (compare key images)
-  BOOST_FOREACH(auto& in, tx.vin)
+  for (const tx_view::input &in: scan->view.inputs())
   {
-    if(in.type() != typeid(cryptonote::txin_to_key))
+    if(in.type != tx_view::input_to_key)
       continue;
-    auto it = m_key_images.find(boost::get<cryptonote::txin_to_key>(in).k_image);
+    auto it = m_key_images.find(in.k_image);
     if(it != m_key_images.end())
     {
       transfer_details& td = m_transfers[it->second];
-      uint64_t amount = boost::get<cryptonote::txin_to_key>(in).amount;
+      uint64_t amount = in.amount;
       if (amount > 0)
       {
         THROW_WALLET_EXCEPTION_IF(amount != td.amount(), error::wallet_internal_error,
@@ -1009,8 +1241,15 @@ void wallet2::process_new_transaction(const cryptonote::transaction& tx, const s
     if (pool)
       m_unconfirmed_payments.emplace(payment_id, payment);
     else
-      m_payments.emplace(payment_id, payment);
+    {
+      load_history();
+      auto it = m_payments.emplace(payment_id, payment);
+      m_payments_by_height.insert(std::make_pair(payment.m_block_height, &*it));
+      m_journal_payments.push_back(std::make_pair(payment_id, payment));
+    }
     LOG_PRINT_L2("Payment found in " << (pool ? "pool" : "block") << ": " << payment_id << " / " << payment.m_tx_hash << " / " << payment.m_amount);
+    if (0 != m_callback)
+      m_callback->on_payment_received(pool ? 0 : height, payment_id, payment.m_tx_hash, payment.m_amount, payment.m_unlock_time);
   }
 }
 //----------------------------------------------------------------------------------------------------
@@ -1023,8 +1262,12 @@ void wallet2::process_unconfirmed(const cryptonote::transaction& tx, uint64_t he
   auto unconf_it = m_unconfirmed_txs.find(txid);
   if(unconf_it != m_unconfirmed_txs.end()) {
     if (store_tx_info()) {
+      load_history();
       try {
-        m_confirmed_txs.insert(std::make_pair(txid, confirmed_transfer_details(unconf_it->second, height)));
+        auto entry = m_confirmed_txs.insert(std::make_pair(txid, confirmed_transfer_details(unconf_it->second, height)));
+        if (entry.second)
+          add_confirmed_tx_index(*entry.first);
+        m_journal_confirmed_txs.insert(txid);
       }
       catch (...) {
         // can fail if the tx has unexpected input types
@@ -1037,8 +1280,12 @@ void wallet2::process_unconfirmed(const cryptonote::transaction& tx, uint64_t he
 //----------------------------------------------------------------------------------------------------
 void wallet2::process_outgoing(const cryptonote::transaction &tx, uint64_t height, uint64_t ts, uint64_t spent, uint64_t received)
 {
+  load_history();
   crypto::hash txid = get_transaction_hash(tx);
   std::pair<std::unordered_map<crypto::hash, confirmed_transfer_details>::iterator, bool> entry = m_confirmed_txs.insert(std::make_pair(txid, confirmed_transfer_details()));
+  m_journal_confirmed_txs.insert(txid);
+  if (!entry.second)
+    remove_confirmed_tx_index(*entry.first);
   // fill with the info we know, some info might already be there
   if (entry.second)
   {
@@ -1065,31 +1312,37 @@ void wallet2::process_outgoing(const cryptonote::transaction &tx, uint64_t heigh
   }
   entry.first->second.m_block_height = height;
   entry.first->second.m_timestamp = ts;
+  add_confirmed_tx_index(*entry.first);
+}
+//----------------------------------------------------------------------------------------------------
+bool wallet2::scans_block(const cryptonote::block& b, uint64_t height) const
+{
+  //optimization: seeking only for blocks that are not older then the wallet creation time plus 1 day. 1 day is for possible user incorrect time setup
+  return b.timestamp + 60*60*24 > m_account.get_createtime() && height >= m_refresh_from_block_height;
 }
 //----------------------------------------------------------------------------------------------------
-void wallet2::process_new_blockchain_entry(const cryptonote::block& b, const cryptonote::block_complete_entry& bche, const crypto::hash& bl_id, uint64_t height, const cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices &o_indices)
+void wallet2::process_new_blockchain_entry(const cryptonote::block& b, const std::vector<cryptonote::transaction>& txs, const std::vector<tx_scan_info_t>& scans, const crypto::hash& bl_id, uint64_t height, const cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices &o_indices)
 {
   size_t txidx = 0;
-  THROW_WALLET_EXCEPTION_IF(bche.txs.size() + 1 != o_indices.indices.size(), error::wallet_internal_error,
-      "block transactions=" + std::to_string(bche.txs.size()) +
+  THROW_WALLET_EXCEPTION_IF(txs.size() + 1 != o_indices.indices.size(), error::wallet_internal_error,
+      "block transactions=" + std::to_string(txs.size()) +
       " not match with daemon response size=" + std::to_string(o_indices.indices.size()));
 
   //handle transactions from new block
-    
-  //optimization: seeking only for blocks that are not older then the wallet creation time plus 1 day. 1 day is for possible user incorrect time setup
-  if(b.timestamp + 60*60*24 > m_account.get_createtime() && height >= m_refresh_from_block_height)
+  if(scans_block(b, height))
   {
+    THROW_WALLET_EXCEPTION_IF(scans.size() != txs.size() + 1, error::wallet_internal_error, "block transactions were not scanned");
+
     TIME_MEASURE_START(miner_tx_handle_time);
-    process_new_transaction(b.miner_tx, o_indices.indices[txidx++].indices, height, b.timestamp, true, false);
+    process_new_transaction(b.miner_tx, o_indices.indices[txidx].indices, height, b.timestamp, true, false, &scans[txidx]);
+    ++txidx;
     TIME_MEASURE_FINISH(miner_tx_handle_time);
 
     TIME_MEASURE_START(txs_handle_time);
-    BOOST_FOREACH(auto& txblob, bche.txs)
+    BOOST_FOREACH(auto& tx, txs)
     {
-      cryptonote::transaction tx;
-      bool r = parse_and_validate_tx_from_blob(txblob, tx);
-      THROW_WALLET_EXCEPTION_IF(!r, error::tx_parse_error, txblob);
-      process_new_transaction(tx, o_indices.indices[txidx++].indices, height, b.timestamp, false, false);
+      process_new_transaction(tx, o_indices.indices[txidx].indices, height, b.timestamp, false, false, &scans[txidx]);
+      ++txidx;
     }
     TIME_MEASURE_FINISH(txs_handle_time);
     LOG_PRINT_L2("Processed block: " << bl_id << ", height " << height << ", " <<  miner_tx_handle_time + txs_handle_time << "(" << miner_tx_handle_time << "/" << txs_handle_time <<")ms");
@@ -1113,11 +1366,22 @@ void wallet2::get_short_chain_history(std::list<crypto::hash>& ids) const
   if(!sz)
     return;
   size_t current_back_offset = 1;
+  size_t last_height = sz;
   bool genesis_included = false;
   while(current_back_offset < sz)
   {
-    ids.push_back(m_blockchain[sz-current_back_offset]);
-    if(sz-current_back_offset == 0)
+    // below the hashes kept in full, use the checkpoint under the height
+    size_t height = sz - current_back_offset;
+    crypto::hash id;
+    if (!m_blockchain.get(height, id))
+    {
+      height -= height % WALLET_HASHCHAIN_CHECKPOINT_INTERVAL;
+      m_blockchain.get(height, id);
+    }
+    if (height != last_height)
+      ids.push_back(id);
+    last_height = height;
+    if(height == 0)
       genesis_included = true;
     if(i < 10)
     {
@@ -1129,26 +1393,34 @@ void wallet2::get_short_chain_history(std::list<crypto::hash>& ids) const
     ++i;
   }
   if(!genesis_included)
-    ids.push_back(m_blockchain[0]);
+    ids.push_back(m_blockchain.genesis());
+}
+//----------------------------------------------------------------------------------------------------
+bool wallet2::is_split(uint64_t height, const crypto::hash &bl_id, uint64_t start_height, crypto::hash &local_id) const
+{
+  if (m_blockchain.get(height, local_id))
+    return bl_id != local_id;
+  local_id = null_hash;
+  return height != start_height;
 }
 //----------------------------------------------------------------------------------------------------
-void wallet2::parse_block_round(const cryptonote::blobdata &blob, cryptonote::block &bl, crypto::hash &bl_id, bool &error) const
+void wallet2::pull_blocks(uint64_t start_height, uint64_t &blocks_start_height, const std::list<crypto::hash> &short_chain_history, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &o_indices)
 {
-  error = !cryptonote::parse_and_validate_block_from_blob(blob, bl);
-  if (!error)
-    bl_id = get_block_hash(bl);
+  uint64_t current_height;
+  pull_blocks(start_height, 0, blocks_start_height, current_height, short_chain_history, blocks, o_indices);
 }
 //----------------------------------------------------------------------------------------------------
-void wallet2::pull_blocks(uint64_t start_height, uint64_t &blocks_start_height, const std::list<crypto::hash> &short_chain_history, std::list<cryptonote::block_complete_entry> &blocks, std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &o_indices)
+void wallet2::pull_blocks(uint64_t start_height, uint64_t max_count, uint64_t &blocks_start_height, uint64_t &current_height, const std::list<crypto::hash> &short_chain_history, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &o_indices)
 {
   cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::request req = AUTO_VAL_INIT(req);
   cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::response res = AUTO_VAL_INIT(res);
   req.block_ids = short_chain_history;
 
   req.start_height = start_height;
-  m_daemon_rpc_mutex.lock();
-  bool r = net_utils::invoke_http_bin_remote_command2(m_daemon_address + "/getblocks.bin", req, res, m_http_client, WALLET_RCP_CONNECTION_TIMEOUT);
-  m_daemon_rpc_mutex.unlock();
+  req.max_count = max_count;
+  tools::http_client_pool::lease daemon(m_daemon_clients);
+  bool r = net_utils::invoke_http_bin_remote_command2(m_daemon_address + "/getblocks.bin", req, res, daemon.get(), WALLET_RCP_CONNECTION_TIMEOUT);
+  daemon.release();
   THROW_WALLET_EXCEPTION_IF(!r, error::no_connection_to_daemon, "getblocks.bin");
   THROW_WALLET_EXCEPTION_IF(res.status == CORE_RPC_STATUS_BUSY, error::daemon_busy, "getblocks.bin");
   THROW_WALLET_EXCEPTION_IF(res.status != CORE_RPC_STATUS_OK, error::get_blocks_error, res.status);
@@ -1157,8 +1429,9 @@ void wallet2::pull_blocks(uint64_t start_height, uint64_t &blocks_start_height,
       boost::lexical_cast<std::string>(res.output_indices.size()) + ") sizes from daemon");
 
   blocks_start_height = res.start_height;
-  blocks = res.blocks;
-  o_indices = res.output_indices;
+  current_height = res.current_height;
+  blocks = std::move(res.blocks);
+  o_indices = std::move(res.output_indices);
 }
 //----------------------------------------------------------------------------------------------------
 void wallet2::pull_hashes(uint64_t start_height, uint64_t &blocks_start_height, const std::list<crypto::hash> &short_chain_history, std::list<crypto::hash> &hashes)
@@ -1168,9 +1441,9 @@ void wallet2::pull_hashes(uint64_t start_height, uint64_t &blocks_start_height,
   req.block_ids = short_chain_history;
 
   req.start_height = start_height;
-  m_daemon_rpc_mutex.lock();
-  bool r = net_utils::invoke_http_bin_remote_command2(m_daemon_address + "/gethashes.bin", req, res, m_http_client, WALLET_RCP_CONNECTION_TIMEOUT);
-  m_daemon_rpc_mutex.unlock();
+  tools::http_client_pool::lease daemon(m_daemon_clients);
+  bool r = net_utils::invoke_http_bin_remote_command2(m_daemon_address + "/gethashes.bin", req, res, daemon.get(), WALLET_RCP_CONNECTION_TIMEOUT);
+  daemon.release();
   THROW_WALLET_EXCEPTION_IF(!r, error::no_connection_to_daemon, "gethashes.bin");
   THROW_WALLET_EXCEPTION_IF(res.status == CORE_RPC_STATUS_BUSY, error::daemon_busy, "gethashes.bin");
   THROW_WALLET_EXCEPTION_IF(res.status != CORE_RPC_STATUS_OK, error::get_hashes_error, res.status);
@@ -1179,112 +1452,131 @@ void wallet2::pull_hashes(uint64_t start_height, uint64_t &blocks_start_height,
   hashes = res.m_block_ids;
 }
 //----------------------------------------------------------------------------------------------------
-void wallet2::process_blocks(uint64_t start_height, const std::list<cryptonote::block_complete_entry> &blocks, const std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &o_indices, uint64_t& blocks_added)
+void wallet2::process_blocks(uint64_t start_height, const std::vector<cryptonote::block_complete_entry> &blocks, const std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &o_indices, uint64_t& blocks_added)
 {
-  size_t current_index = start_height;
-  blocks_added = 0;
-  size_t tx_o_indices_idx = 0;
-
   THROW_WALLET_EXCEPTION_IF(blocks.size() != o_indices.size(), error::wallet_internal_error, "size mismatch");
 
-  int threads = tools::get_max_concurrency();
-  if (threads > 1)
-  {
-    std::vector<crypto::hash> round_block_hashes(threads);
-    std::vector<cryptonote::block> round_blocks(threads);
-    std::deque<bool> error(threads);
-    size_t blocks_size = blocks.size();
-    std::list<block_complete_entry>::const_iterator blocki = blocks.begin();
-    for (size_t b = 0; b < blocks_size; b += threads)
+  parsed_blocks_t parsed;
+  parse_blocks(scan_pool(), blocks, parsed);
+  process_parsed_blocks(scan_pool(), start_height, parsed, o_indices, blocks_added);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::parse_blocks(tools::thread_group &pool, const std::vector<cryptonote::block_complete_entry> &blocks, parsed_blocks_t &parsed)
+{
+  std::vector<cryptonote::block> &parsed_blocks = parsed.blocks;
+  std::vector<crypto::hash> &block_hashes = parsed.hashes;
+  std::vector<std::vector<cryptonote::transaction>> &parsed_txs = parsed.txes;
+  parsed_blocks.resize(blocks.size());
+  block_hashes.resize(blocks.size());
+  parsed_txs.resize(blocks.size());
+
+  // parsing stops at the first bad block or tx, which is then reported
+  std::vector<size_t> bad_tx(blocks.size(), 0);  // 1 + index of a tx that did not parse
+  std::deque<bool> bad_block(blocks.size());
+  tools::parallel_for(pool, 0, blocks.size(), 1, [&] (size_t first, size_t last) {
+    for (size_t i = first; i < last; ++i)
     {
-      size_t round_size = std::min((size_t)threads, blocks_size - b);
-
-      boost::asio::io_service ioservice;
-      boost::thread_group threadpool;
-      std::unique_ptr < boost::asio::io_service::work > work(new boost::asio::io_service::work(ioservice));
-      for (size_t i = 0; i < round_size; i++)
-      {
-        threadpool.create_thread(boost::bind(&boost::asio::io_service::run, &ioservice));
-      }
-
-      std::list<block_complete_entry>::const_iterator tmpblocki = blocki;
-      for (size_t i = 0; i < round_size; ++i)
-      {
-        ioservice.dispatch(boost::bind(&wallet2::parse_block_round, this, std::cref(tmpblocki->block),
-          std::ref(round_blocks[i]), std::ref(round_block_hashes[i]), std::ref(error[i])));
-        ++tmpblocki;
-      }
-      KILL_IOSERVICE();
-      tmpblocki = blocki;
-      for (size_t i = 0; i < round_size; ++i)
-      {
-        THROW_WALLET_EXCEPTION_IF(error[i], error::block_parse_error, tmpblocki->block);
-        ++tmpblocki;
-      }
-      for (size_t i = 0; i < round_size; ++i)
+      bad_block[i] = !cryptonote::parse_and_validate_block_from_blob(blocks[i].block, parsed_blocks[i]);
+      if (bad_block[i])
+        return false;
+      block_hashes[i] = get_block_hash(parsed_blocks[i]);
+      parsed_txs[i].resize(blocks[i].txs.size());
+      for (size_t j = 0; j < blocks[i].txs.size(); ++j)
       {
-        const crypto::hash &bl_id = round_block_hashes[i];
-        cryptonote::block &bl = round_blocks[i];
-
-        if(current_index >= m_blockchain.size())
-        {
-          process_new_blockchain_entry(bl, *blocki, bl_id, current_index, o_indices[b+i]);
-          ++blocks_added;
-        }
-        else if(bl_id != m_blockchain[current_index])
-        {
-          //split detected here !!!
-          THROW_WALLET_EXCEPTION_IF(current_index == start_height, error::wallet_internal_error,
-            "wrong daemon response: split starts from the first block in response " + string_tools::pod_to_hex(bl_id) +
-            " (height " + std::to_string(start_height) + "), local block id at this height: " +
-            string_tools::pod_to_hex(m_blockchain[current_index]));
-
-          detach_blockchain(current_index);
-          process_new_blockchain_entry(bl, *blocki, bl_id, current_index, o_indices[b+i]);
-        }
-        else
+        if (!parse_and_validate_tx_from_blob(blocks[i].txs[j], parsed_txs[i][j]))
         {
-          LOG_PRINT_L2("Block is already in blockchain: " << string_tools::pod_to_hex(bl_id));
+          bad_tx[i] = j + 1;
+          return false;
         }
-        ++current_index;
-        ++blocki;
       }
     }
-  }
-  else
-  {
-  BOOST_FOREACH(auto& bl_entry, blocks)
+    return true;
+  });
+  for (size_t i = 0; i < blocks.size(); ++i)
   {
-    cryptonote::block bl;
-    bool r = cryptonote::parse_and_validate_block_from_blob(bl_entry.block, bl);
-    THROW_WALLET_EXCEPTION_IF(!r, error::block_parse_error, bl_entry.block);
+    THROW_WALLET_EXCEPTION_IF(bad_block[i], error::block_parse_error, blocks[i].block);
+    THROW_WALLET_EXCEPTION_IF(bad_tx[i], error::tx_parse_error, blocks[i].txs[bad_tx[i] - 1]);
+  }
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::process_parsed_blocks(tools::thread_group &pool, uint64_t start_height, const parsed_blocks_t &parsed, const std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &o_indices, uint64_t& blocks_added)
+{
+  size_t current_index = start_height;
+  blocks_added = 0;
 
-    crypto::hash bl_id = get_block_hash(bl);
+  const std::vector<cryptonote::block> &parsed_blocks = parsed.blocks;
+  const std::vector<crypto::hash> &block_hashes = parsed.hashes;
+  const std::vector<std::vector<cryptonote::transaction>> &parsed_txs = parsed.txes;
+  THROW_WALLET_EXCEPTION_IF(parsed_blocks.size() != o_indices.size(), error::wallet_internal_error, "size mismatch");
+
+  // the blocks we have seen already lead the batch, and need no scanning
+  size_t first_new = 0;
+  crypto::hash local_id;
+  while (first_new < parsed_blocks.size() && start_height + first_new < m_blockchain.size() &&
+      !is_split(start_height + first_new, block_hashes[first_new], start_height, local_id))
+    ++first_new;
+
+  // scan the outputs of every tx in the rest of the batch, only updating
+  // the wallet with what was found is left to do in chain order
+  std::vector<std::vector<tx_scan_info_t>> scans(parsed_blocks.size());
+  std::vector<std::pair<size_t, size_t>> scan_jobs;
+  for (size_t i = first_new; i < parsed_blocks.size(); ++i)
+  {
+    if (!scans_block(parsed_blocks[i], start_height + i))
+      continue;
+    scans[i].resize(parsed_txs[i].size() + 1);
+    for (size_t j = 0; j < scans[i].size(); ++j)
+      scan_jobs.push_back(std::make_pair(i, j));
+  }
+  const crypto::public_key_precomp spend_public_key = get_spend_public_key_precomp();
+  TIME_MEASURE_START(scan_time);
+  // jobs are handed out a few at a time, so their key derivations are batched
+  tools::parallel_for(pool, 0, scan_jobs.size(), WALLET_SCAN_CHUNK_SIZE, [&] (size_t first, size_t last) {
+    auto job_tx = [&](size_t k) -> const cryptonote::transaction& {
+      const size_t i = scan_jobs[k].first, j = scan_jobs[k].second;
+      return j == 0 ? parsed_blocks[i].miner_tx : parsed_txs[i][j - 1];
+    };
+    std::vector<tx_scan_info_t*> chunk_scans;
+    chunk_scans.reserve(last - first);
+    for (size_t k = first; k < last; ++k)
+    {
+      chunk_scans.push_back(&scans[scan_jobs[k].first][scan_jobs[k].second]);
+      scan_tx_pub_keys(job_tx(k), *chunk_scans.back());
+    }
+    scan_tx_derivations(chunk_scans.data(), chunk_scans.size());
+    for (size_t k = first; k < last; ++k)
+      scan_tx_outputs(job_tx(k), scan_jobs[k].second == 0, spend_public_key, *chunk_scans[k - first]);
+    return true;
+  });
+  TIME_MEASURE_FINISH(scan_time);
+  LOG_PRINT_L2("Scanned " << scan_jobs.size() << " transactions in " << parsed_blocks.size() - first_new << " blocks, " << scan_time << " ms");
+
+  for (size_t i = 0; i < parsed_blocks.size(); ++i)
+  {
+    const crypto::hash &bl_id = block_hashes[i];
     if(current_index >= m_blockchain.size())
     {
-      process_new_blockchain_entry(bl, bl_entry, bl_id, current_index, o_indices[tx_o_indices_idx]);
+      process_new_blockchain_entry(parsed_blocks[i], parsed_txs[i], scans[i], bl_id, current_index, o_indices[i]);
       ++blocks_added;
     }
-    else if(bl_id != m_blockchain[current_index])
+    else if(is_split(current_index, bl_id, start_height, local_id))
     {
       //split detected here !!!
       THROW_WALLET_EXCEPTION_IF(current_index == start_height, error::wallet_internal_error,
         "wrong daemon response: split starts from the first block in response " + string_tools::pod_to_hex(bl_id) +
         " (height " + std::to_string(start_height) + "), local block id at this height: " +
-        string_tools::pod_to_hex(m_blockchain[current_index]));
+        string_tools::pod_to_hex(local_id));
 
       detach_blockchain(current_index);
-      process_new_blockchain_entry(bl, bl_entry, bl_id, current_index, o_indices[tx_o_indices_idx]);
+      process_new_blockchain_entry(parsed_blocks[i], parsed_txs[i], scans[i], bl_id, current_index, o_indices[i]);
     }
     else
     {
       LOG_PRINT_L2("Block is already in blockchain: " << string_tools::pod_to_hex(bl_id));
     }
-
     ++current_index;
-    ++tx_o_indices_idx;
-  }
   }
+  prune_unlock_queue();
 }
 //----------------------------------------------------------------------------------------------------
 void wallet2::refresh()
@@ -1299,58 +1591,234 @@ void wallet2::refresh(uint64_t start_height, uint64_t & blocks_fetched)
   refresh(start_height, blocks_fetched, received_money);
 }
 //----------------------------------------------------------------------------------------------------
-void wallet2::pull_next_blocks(uint64_t start_height, uint64_t &blocks_start_height, std::list<crypto::hash> &short_chain_history, const std::list<cryptonote::block_complete_entry> &prev_blocks, std::list<cryptonote::block_complete_entry> &blocks, std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &o_indices, bool &error)
+void wallet2::adapt_refresh_batch_size(uint64_t requested, const std::vector<cryptonote::block_complete_entry> &blocks, uint64_t elapsed_ms)
 {
-  error = false;
+  // a short batch reached the daemon's top, its timing tells little
+  if (blocks.empty() || blocks.size() < requested)
+    return;
 
-  try
+  uint64_t size = m_refresh_batch_size;
+  if (elapsed_ms > WALLET_REFRESH_BATCH_TARGET_MS)
+    size /= 2;
+  else if (elapsed_ms < WALLET_REFRESH_BATCH_TARGET_MS / 2)
+    size *= 2;
+
+  size_t bytes = 0;
+  for (const cryptonote::block_complete_entry &b: blocks)
   {
-    // prepend the last 3 blocks, should be enough to guard against a block or two's reorg
-    cryptonote::block bl;
-    std::list<cryptonote::block_complete_entry>::const_reverse_iterator i = prev_blocks.rbegin();
-    for (size_t n = 0; n < std::min((size_t)3, prev_blocks.size()); ++n)
+    bytes += b.block.size();
+    for (const cryptonote::blobdata &tx: b.txs)
+      bytes += tx.size();
+  }
+  const size_t bytes_per_block = bytes / blocks.size() + 1;
+  size = std::min<uint64_t>(size, WALLET_REFRESH_BATCH_MAX_BYTES / bytes_per_block);
+
+  size = std::max<uint64_t>(WALLET_REFRESH_BATCH_MIN_BLOCKS, std::min<uint64_t>(size, COMMAND_RPC_GET_BLOCKS_FAST_MAX_COUNT));
+  if (size != m_refresh_batch_size)
+    LOG_PRINT_L2("Refresh batch size " << m_refresh_batch_size << " -> " << size << " (" << elapsed_ms << " ms, " << bytes_per_block << " bytes per block)");
+  m_refresh_batch_size = size;
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::refresh_throttle(uint64_t busy_ms)
+{
+  // a share of s percent idles (100 - s) ms for every s ms of work; the
+  // pull and parse threads stall too once their queues fill up
+  const uint32_t share = m_refresh_cpu_share.load(std::memory_order_relaxed);
+  const uint64_t idle_until = epee::misc_utils::get_tick_count() + busy_ms * (100 - share) / share;
+  while (m_run.load(std::memory_order_relaxed) &&
+      (m_refresh_paused.load(std::memory_order_relaxed) || epee::misc_utils::get_tick_count() < idle_until))
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(50));
+}
+//----------------------------------------------------------------------------------------------------
+tools::thread_group &wallet2::scan_pool() const
+{
+  if (!m_scan_pool)
+  {
+    const uint32_t threads = m_scan_threads.load(std::memory_order_relaxed);
+    m_scan_pool.reset(threads ? new tools::thread_group(threads - 1) : new tools::thread_group());
+  }
+  return *m_scan_pool;
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::refresh_blocks(uint64_t start_height, std::list<crypto::hash> short_chain_history, uint64_t &blocks_fetched)
+{
+  tools::thread_group &pool = scan_pool();
+  stage_queue<std::unique_ptr<refresh_batch_t>> pulled(m_refresh_prefetch_depth);
+  stage_queue<std::unique_ptr<refresh_batch_t>> parsed(1);
+  std::exception_ptr pull_error, parse_error, process_error;
+
+  boost::thread pull_thread([&] {
+    try
     {
-      bool ok = cryptonote::parse_and_validate_block_from_blob(i->block, bl);
-      THROW_WALLET_EXCEPTION_IF(!ok, error::block_parse_error, i->block);
-      short_chain_history.push_front(cryptonote::get_block_hash(bl));
-      ++i;
+      while (m_run.load(std::memory_order_relaxed))
+      {
+        std::unique_ptr<refresh_batch_t> batch(new refresh_batch_t());
+        const uint64_t requested = m_refresh_batch_size;
+        uint64_t current_height;
+        TIME_MEASURE_START(pull_time);
+        pull_blocks(start_height, requested, batch->start_height, current_height, short_chain_history, batch->blocks, batch->o_indices);
+        TIME_MEASURE_FINISH(pull_time);
+        THROW_WALLET_EXCEPTION_IF(batch->blocks.size() != batch->o_indices.size(), error::wallet_internal_error, "size mismatch");
+        adapt_refresh_batch_size(requested, batch->blocks, pull_time);
+        batch->daemon_height = current_height;
+        batch->top = batch->start_height + batch->blocks.size() >= current_height;
+
+        // the next pull starts from the last 3 blocks of this one, should be
+        // enough to guard against a block or two's reorg
+        std::vector<cryptonote::block_complete_entry>::const_reverse_iterator i = batch->blocks.rbegin();
+        for (size_t n = 0; n < std::min((size_t)3, batch->blocks.size()); ++n)
+        {
+          cryptonote::block bl;
+          bool ok = cryptonote::parse_and_validate_block_from_blob(i->block, bl);
+          THROW_WALLET_EXCEPTION_IF(!ok, error::block_parse_error, i->block);
+          short_chain_history.push_front(cryptonote::get_block_hash(bl));
+          ++i;
+        }
+        // only the first pull may start from a given height
+        start_height = 0;
+
+        const bool top = batch->top;
+        if (!pulled.push(std::move(batch)) || top)
+          break;
+      }
+    }
+    catch (...)
+    {
+      pull_error = std::current_exception();
     }
+    pulled.close();
+  });
 
-    // pull the new blocks
-    pull_blocks(start_height, blocks_start_height, short_chain_history, blocks, o_indices);
+  boost::thread parse_thread([&] {
+    try
+    {
+      std::unique_ptr<refresh_batch_t> batch;
+      while (pulled.pop(batch))
+      {
+        TIME_MEASURE_START(parse_time);
+        parse_blocks(pool, batch->blocks, batch->parsed);
+        TIME_MEASURE_FINISH(parse_time);
+        batch->parse_ms = parse_time;
+        if (!parsed.push(std::move(batch)))
+          break;
+      }
+    }
+    catch (...)
+    {
+      parse_error = std::current_exception();
+    }
+    // the puller may be waiting for room nobody will make
+    pulled.close();
+    parsed.close();
+  });
+
+  try
+  {
+    const uint64_t start_time = epee::misc_utils::get_tick_count();
+    const uint64_t start_blocks_fetched = blocks_fetched;
+    std::unique_ptr<refresh_batch_t> batch;
+    while (m_run.load(std::memory_order_relaxed) && parsed.pop(batch))
+    {
+      uint64_t added_blocks = 0;
+      TIME_MEASURE_START(process_time);
+      try
+      {
+        process_parsed_blocks(pool, batch->start_height, batch->parsed, batch->o_indices, added_blocks);
+      }
+      catch (...)
+      {
+        blocks_fetched += added_blocks;
+        throw;
+      }
+      TIME_MEASURE_FINISH(process_time);
+      blocks_fetched += added_blocks;
+      if (m_callback)
+      {
+        const uint64_t elapsed = epee::misc_utils::get_tick_count() - start_time;
+        const double rate = elapsed ? (blocks_fetched - start_blocks_fetched) * 1000.0 / elapsed : 0.0;
+        m_callback->on_refresh_progress(m_blockchain.size(), batch->daemon_height, blocks_fetched, rate);
+      }
+      if (!added_blocks)
+        break;
+      refresh_throttle(batch->parse_ms + process_time);
+    }
   }
-  catch(...)
+  catch (...)
   {
-    error = true;
+    process_error = std::current_exception();
   }
+  parsed.close();
+  pulled.close();
+  parse_thread.join();
+  pull_thread.join();
+
+  if (process_error)
+    std::rethrow_exception(process_error);
+  if (parse_error)
+    std::rethrow_exception(parse_error);
+  if (pull_error)
+    std::rethrow_exception(pull_error);
 }
 //----------------------------------------------------------------------------------------------------
 void wallet2::update_pool_state()
 {
-  // get the pool state
-  cryptonote::COMMAND_RPC_GET_TRANSACTION_POOL::request req;
-  cryptonote::COMMAND_RPC_GET_TRANSACTION_POOL::response res;
-  m_daemon_rpc_mutex.lock();
-  bool r = epee::net_utils::invoke_http_json_remote_command2(m_daemon_address + "/get_transaction_pool", req, res, m_http_client, 200000);
-  m_daemon_rpc_mutex.unlock();
-  THROW_WALLET_EXCEPTION_IF(!r, error::no_connection_to_daemon, "get_transaction_pool");
-  THROW_WALLET_EXCEPTION_IF(res.status == CORE_RPC_STATUS_BUSY, error::daemon_busy, "get_transaction_pool");
-  THROW_WALLET_EXCEPTION_IF(res.status != CORE_RPC_STATUS_OK, error::get_tx_pool_error);
+  // get what changed in the pool since the last call, so only new txes are fetched and scanned
+  std::vector<crypto::hash> added;
+  cryptonote::COMMAND_RPC_GET_TRANSACTION_POOL_SINCE::request req;
+  cryptonote::COMMAND_RPC_GET_TRANSACTION_POOL_SINCE::response res;
+  // a version above the daemon's gets the whole pool
+  req.pool_version = m_pool_tx_hashes_known ? m_pool_version : std::numeric_limits<uint64_t>::max();
+  tools::http_client_pool::lease daemon(m_daemon_clients);
+  bool r = epee::net_utils::invoke_http_bin_remote_command2(m_daemon_address + "/get_transaction_pool_since.bin", req, res, daemon.get(), 200000);
+  daemon.release();
+  THROW_WALLET_EXCEPTION_IF(r && res.status == CORE_RPC_STATUS_BUSY, error::daemon_busy, "get_transaction_pool_since.bin");
+  if (r && res.status == CORE_RPC_STATUS_OK)
+  {
+    if (res.full)
+    {
+      std::unordered_set<crypto::hash> pool_hashes(res.added_tx_hashes.begin(), res.added_tx_hashes.end());
+      for (const crypto::hash &txid: res.added_tx_hashes)
+        if (m_pool_tx_hashes.find(txid) == m_pool_tx_hashes.end())
+          added.push_back(txid);
+      m_pool_tx_hashes = std::move(pool_hashes);
+    }
+    else
+    {
+      for (const crypto::hash &txid: res.removed_tx_hashes)
+        m_pool_tx_hashes.erase(txid);
+      for (const crypto::hash &txid: res.added_tx_hashes)
+        if (m_pool_tx_hashes.insert(txid).second)
+          added.push_back(txid);
+    }
+    m_pool_version = res.pool_version;
+    m_pool_tx_hashes_known = true;
+  }
+  else
+  {
+    // older daemons only give the whole list
+    cryptonote::COMMAND_RPC_GET_TRANSACTION_POOL_HASHES::request req;
+    cryptonote::COMMAND_RPC_GET_TRANSACTION_POOL_HASHES::response res;
+    tools::http_client_pool::lease daemon(m_daemon_clients);
+    bool r = epee::net_utils::invoke_http_bin_remote_command2(m_daemon_address + "/get_transaction_pool_hashes.bin", req, res, daemon.get(), 200000);
+    daemon.release();
+    THROW_WALLET_EXCEPTION_IF(!r, error::no_connection_to_daemon, "get_transaction_pool_hashes.bin");
+    THROW_WALLET_EXCEPTION_IF(res.status == CORE_RPC_STATUS_BUSY, error::daemon_busy, "get_transaction_pool_hashes.bin");
+    THROW_WALLET_EXCEPTION_IF(res.status != CORE_RPC_STATUS_OK, error::get_tx_pool_error);
+    std::unordered_set<crypto::hash> pool_hashes(res.tx_hashes.begin(), res.tx_hashes.end());
+    for (const crypto::hash &txid: res.tx_hashes)
+      if (m_pool_tx_hashes.find(txid) == m_pool_tx_hashes.end())
+        added.push_back(txid);
+    m_pool_tx_hashes = std::move(pool_hashes);
+    m_pool_tx_hashes_known = false;
+  }
+  const std::unordered_set<crypto::hash> &pool_hashes = m_pool_tx_hashes;
 
   // remove any pending tx that's not in the pool
   std::unordered_map<crypto::hash, wallet2::unconfirmed_transfer_details>::iterator it = m_unconfirmed_txs.begin();
   while (it != m_unconfirmed_txs.end())
   {
     const std::string txid = epee::string_tools::pod_to_hex(it->first);
-    bool found = false;
-    for (auto it2: res.transactions)
-    {
-      if (it2.id_hash == txid)
-      {
-        found = true;
-        break;
-      }
-    }
+    bool found = pool_hashes.find(it->first) != pool_hashes.end();
     auto pit = it++;
     if (!found)
     {
@@ -1395,16 +1863,7 @@ void wallet2::update_pool_state()
   std::unordered_map<crypto::hash, wallet2::payment_details>::iterator uit = m_unconfirmed_payments.begin();
   while (uit != m_unconfirmed_payments.end())
   {
-    const std::string txid = string_tools::pod_to_hex(uit->first);
-    bool found = false;
-    for (auto it2: res.transactions)
-    {
-      if (it2.id_hash == txid)
-      {
-        found = true;
-        break;
-      }
-    }
+    bool found = pool_hashes.find(uit->first) != pool_hashes.end();
     auto pit = uit++;
     if (!found)
     {
@@ -1412,98 +1871,107 @@ void wallet2::update_pool_state()
     }
   }
 
-  // add new pool txes to us
-  for (auto it: res.transactions)
+  // add new pool txes to us, all fetched in one call
+  cryptonote::COMMAND_RPC_GET_TRANSACTIONS::request txs_req;
+  cryptonote::COMMAND_RPC_GET_TRANSACTIONS::response txs_res;
+  for (const crypto::hash &txid: added)
   {
-    cryptonote::blobdata txid_data;
-    if(epee::string_tools::parse_hexstr_to_binbuff(it.id_hash, txid_data))
-    {
-      const crypto::hash txid = *reinterpret_cast<const crypto::hash*>(txid_data.data());
-      if (m_unconfirmed_payments.find(txid) == m_unconfirmed_payments.end())
-      {
-        LOG_PRINT_L1("Found new pool tx: " << txid);
-        bool found = false;
-        for (const auto &i: m_unconfirmed_txs)
-        {
-          if (i.first == txid)
-          {
-            found = true;
-            break;
-          }
-        }
-        if (!found)
-        {
-          // not one of those we sent ourselves
-          cryptonote::COMMAND_RPC_GET_TRANSACTIONS::request req;
-          cryptonote::COMMAND_RPC_GET_TRANSACTIONS::response res;
-          req.txs_hashes.push_back(it.id_hash);
-          req.decode_as_json = false;
-          m_daemon_rpc_mutex.lock();
-          bool r = epee::net_utils::invoke_http_json_remote_command2(m_daemon_address + "/gettransactions", req, res, m_http_client, 200000);
-          m_daemon_rpc_mutex.unlock();
-          if (r && res.status == CORE_RPC_STATUS_OK)
-          {
-            if (res.txs.size() == 1)
-            {
-              // might have just been put in a block
-              if (res.txs[0].in_pool)
-              {
-                cryptonote::transaction tx;
-                cryptonote::blobdata bd;
-                crypto::hash tx_hash, tx_prefix_hash;
-                if (epee::string_tools::parse_hexstr_to_binbuff(res.txs[0].as_hex, bd))
-                {
-                  if (cryptonote::parse_and_validate_tx_from_blob(bd, tx, tx_hash, tx_prefix_hash))
-                  {
-                    if (tx_hash == txid)
-                    {
-                      process_new_transaction(tx, std::vector<uint64_t>(), 0, time(NULL), false, true);
-                    }
-                    else
-                    {
-                      LOG_PRINT_L0("Mismatched txids when processing unconfimed txes from pool");
-                    }
-                  }
-                  else
-                  {
-                    LOG_PRINT_L0("failed to validate transaction from daemon");
-                  }
-                }
-                else
-                {
-                  LOG_PRINT_L0("Failed to parse tx " << txid);
-                }
-              }
-              else
-              {
-                LOG_PRINT_L1("Tx " << txid << " was in pool, but is no more");
-              }
-            }
-            else
-            {
-              LOG_PRINT_L0("Expected 1 tx, got " << res.txs.size());
-            }
-          }
-          else
-          {
-            LOG_PRINT_L0("Error calling gettransactions daemon RPC: r " << r << ", status " << res.status);
-          }
-        }
-        else
-        {
-          LOG_PRINT_L1("We sent that one");
-        }
-      }
-      else
-      {
-        LOG_PRINT_L1("Already saw that one");
-      }
+    if (m_unconfirmed_payments.find(txid) != m_unconfirmed_payments.end())
+    {
+      LOG_PRINT_L1("Already saw that one");
+    }
+    else if (m_unconfirmed_txs.find(txid) != m_unconfirmed_txs.end())
+    {
+      LOG_PRINT_L1("We sent that one");
     }
     else
     {
-      LOG_PRINT_L0("Failed to parse txid");
+      LOG_PRINT_L1("Found new pool tx: " << txid);
+      txs_req.txs_hashes.push_back(epee::string_tools::pod_to_hex(txid));
+    }
+  }
+  if (txs_req.txs_hashes.empty())
+    return;
+
+  txs_req.decode_as_json = false;
+  tools::http_client_pool::lease txs_daemon(m_daemon_clients);
+  r = epee::net_utils::invoke_http_json_remote_command2(m_daemon_address + "/gettransactions", txs_req, txs_res, txs_daemon.get(), 200000);
+  txs_daemon.release();
+  if (!r || txs_res.status != CORE_RPC_STATUS_OK)
+  {
+    LOG_PRINT_L0("Error calling gettransactions daemon RPC: r " << r << ", status " << txs_res.status);
+    // forget about them so they are fetched again next time
+    for (const crypto::hash &txid: added)
+      m_pool_tx_hashes.erase(txid);
+    m_pool_tx_hashes_known = false;
+    return;
+  }
+
+  for (const auto &e: txs_res.txs)
+  {
+    // might have just been put in a block
+    if (!e.in_pool)
+    {
+      LOG_PRINT_L1("Tx " << e.tx_hash << " was in pool, but is no more");
+      continue;
+    }
+    cryptonote::transaction tx;
+    cryptonote::blobdata bd;
+    crypto::hash tx_hash, tx_prefix_hash;
+    if (!epee::string_tools::parse_hexstr_to_binbuff(e.as_hex, bd))
+    {
+      LOG_PRINT_L0("Failed to parse tx " << e.tx_hash);
+      continue;
+    }
+    if (!cryptonote::parse_and_validate_tx_from_blob(bd, tx, tx_hash, tx_prefix_hash))
+    {
+      LOG_PRINT_L0("failed to validate transaction from daemon");
+      continue;
+    }
+    if (epee::string_tools::pod_to_hex(tx_hash) != e.tx_hash)
+    {
+      LOG_PRINT_L0("Mismatched txids when processing unconfimed txes from pool");
+      continue;
+    }
+    process_new_transaction(tx, std::vector<uint64_t>(), 0, time(NULL), false, true);
+  }
+}
+//----------------------------------------------------------------------------------------------------
+bool wallet2::fast_forward(uint64_t stop_height)
+{
+  const uint64_t top = stop_height - stop_height % WALLET_HASHCHAIN_CHECKPOINT_INTERVAL;
+  if (m_blockchain.size() != 1 || top == 0)
+    return false;
+
+  std::vector<crypto::hash> checkpoints;
+  uint64_t height = 0;
+  while (height <= top)
+  {
+    cryptonote::COMMAND_RPC_GET_HASHES_BY_HEIGHT::request req = AUTO_VAL_INIT(req);
+    cryptonote::COMMAND_RPC_GET_HASHES_BY_HEIGHT::response res = AUTO_VAL_INIT(res);
+    for (; height <= top && req.heights.size() < COMMAND_RPC_GET_HASHES_BY_HEIGHT_MAX_COUNT; height += WALLET_HASHCHAIN_CHECKPOINT_INTERVAL)
+      req.heights.push_back(height);
+    tools::http_client_pool::lease daemon(m_daemon_clients);
+    bool r = net_utils::invoke_http_bin_remote_command2(m_daemon_address + "/get_hashes_by_height.bin", req, res, daemon.get(), WALLET_RCP_CONNECTION_TIMEOUT);
+    daemon.release();
+    // older daemons do not know the call, and one still syncing may not
+    // reach stop_height: the caller pulls every hash instead
+    if (!r || res.status != CORE_RPC_STATUS_OK || res.hashes.size() != req.heights.size())
+    {
+      LOG_PRINT_L1("Could not get checkpoint hashes up to " << top << ": " << (r ? res.status : "no connection to daemon"));
+      return false;
     }
+    checkpoints.insert(checkpoints.end(), res.hashes.begin(), res.hashes.end());
   }
+  THROW_WALLET_EXCEPTION_IF(checkpoints.front() != m_blockchain.genesis(), error::wallet_internal_error,
+      "daemon has genesis " + string_tools::pod_to_hex(checkpoints.front()) + ", wallet has " + string_tools::pod_to_hex(m_blockchain.genesis()));
+
+  m_blockchain.fast_forward(checkpoints);
+  m_local_bc_height = m_blockchain.size();
+  // the journal only records hashes appended after a full store
+  m_journal_full_store = true;
+  LOG_PRINT_L1("Fast forwarded to height " << top << " from " << checkpoints.size() << " checkpoint hashes");
+  return true;
 }
 //----------------------------------------------------------------------------------------------------
 void wallet2::fast_refresh(uint64_t stop_height, uint64_t &blocks_start_height, std::list<crypto::hash> &short_chain_history)
@@ -1536,6 +2004,7 @@ void wallet2::fast_refresh(uint64_t stop_height, uint64_t &blocks_start_height,
     current_index = blocks_start_height;
     BOOST_FOREACH(auto& bl_id, hashes)
     {
+      crypto::hash local_id;
       if(current_index >= m_blockchain.size())
       {
         if (!(current_index % 1000))
@@ -1549,7 +2018,7 @@ void wallet2::fast_refresh(uint64_t stop_height, uint64_t &blocks_start_height,
           m_callback->on_new_block(current_index, dummy);
         }
       }
-      else if(bl_id != m_blockchain[current_index])
+      else if(is_split(current_index, bl_id, blocks_start_height, local_id))
       {
         //split detected here !!!
         return;
@@ -1590,21 +2059,27 @@ void wallet2::refresh(uint64_t start_height, uint64_t & blocks_fetched, bool& re
 {
   received_money = false;
   blocks_fetched = 0;
-  uint64_t added_blocks = 0;
   size_t try_count = 0;
   crypto::hash last_tx_hash_id = m_transfers.size() ? m_transfers.back().m_txid : null_hash;
   std::list<crypto::hash> short_chain_history;
-  boost::thread pull_thread;
   uint64_t blocks_start_height;
-  std::list<cryptonote::block_complete_entry> blocks;
-  std::vector<COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> o_indices;
 
-  // pull the first set of blocks
   get_short_chain_history(short_chain_history);
   m_run.store(true, std::memory_order_relaxed);
+  // a changed scan thread count takes effect here, where nothing uses the pool
+  const uint32_t scan_threads = m_scan_threads.load(std::memory_order_relaxed);
+  if (m_scan_pool && m_scan_pool->count() != (scan_threads ? scan_threads - 1 : tools::thread_group::optimal()))
+    m_scan_pool.reset();
   if (start_height > m_blockchain.size() || m_refresh_from_block_height > m_blockchain.size()) {
     if (!start_height)
       start_height = m_refresh_from_block_height;
+    // a fresh chain skips to the checkpoint below start_height, only the
+    // blocks after it are worth a hash each
+    if (fast_forward(start_height))
+    {
+      short_chain_history.clear();
+      get_short_chain_history(short_chain_history);
+    }
     // we can shortcut by only pulling hashes up to the start_height
     fast_refresh(start_height, blocks_start_height, short_chain_history);
     // regenerate the history now that we've got a full set of hashes
@@ -1614,48 +2089,23 @@ void wallet2::refresh(uint64_t start_height, uint64_t & blocks_fetched, bool& re
     // and then fall through to regular refresh processing
   }
 
-  pull_blocks(start_height, blocks_start_height, short_chain_history, blocks, o_indices);
-  // always reset start_height to 0 to force short_chain_ history to be used on
-  // subsequent pulls in this refresh.
-  start_height = 0;
-
   while(m_run.load(std::memory_order_relaxed))
   {
     try
     {
-      // pull the next set of blocks while we're processing the current one
-      uint64_t next_blocks_start_height;
-      std::list<cryptonote::block_complete_entry> next_blocks;
-      std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> next_o_indices;
-      bool error = false;
-      pull_thread = boost::thread([&]{pull_next_blocks(start_height, next_blocks_start_height, short_chain_history, blocks, next_blocks, next_o_indices, error);});
-
-      process_blocks(blocks_start_height, blocks, o_indices, added_blocks);
-      blocks_fetched += added_blocks;
-      pull_thread.join();
-      if(!added_blocks)
-        break;
-
-      // switch to the new blocks from the daemon
-      blocks_start_height = next_blocks_start_height;
-      blocks = next_blocks;
-      o_indices = next_o_indices;
-
-      // handle error from async fetching thread
-      if (error)
-      {
-        throw std::runtime_error("proxy exception in refresh thread");
-      }
+      refresh_blocks(start_height, short_chain_history, blocks_fetched);
+      break;
     }
     catch (const std::exception&)
     {
-      blocks_fetched += added_blocks;
-      if (pull_thread.joinable())
-        pull_thread.join();
       if(try_count < 3)
       {
         LOG_PRINT_L1("Another try pull_blocks (try_count=" << try_count << ")...");
         ++try_count;
+        // carry on from what was processed before the failure
+        short_chain_history.clear();
+        get_short_chain_history(short_chain_history);
+        start_height = 0;
       }
       else
       {
@@ -1666,6 +2116,7 @@ void wallet2::refresh(uint64_t start_height, uint64_t & blocks_fetched, bool& re
   }
   if(last_tx_hash_id != (m_transfers.size() ? m_transfers.back().m_txid : null_hash))
     received_money = true;
+  m_blockchain.trim(WALLET_HASHCHAIN_KEEP);
 
   try
   {
@@ -1676,6 +2127,15 @@ void wallet2::refresh(uint64_t start_height, uint64_t & blocks_fetched, bool& re
     LOG_PRINT_L1("Failed to check pending transactions");
   }
 
+  try
+  {
+    refill_decoy_pool();
+  }
+  catch (...)
+  {
+    LOG_PRINT_L1("Failed to refill the decoy pool");
+  }
+
   LOG_PRINT_L1("Refresh done, blocks received: " << blocks_fetched << ", balance: " << print_money(balance()) << ", unlocked: " << print_money(unlocked_balance()));
 }
 //----------------------------------------------------------------------------------------------------
@@ -1696,7 +2156,11 @@ bool wallet2::refresh(uint64_t & blocks_fetched, bool& received_money, bool& ok)
 void wallet2::detach_blockchain(uint64_t height)
 {
   LOG_PRINT_L0("Detaching blockchain on height " << height);
+  load_history();
   size_t transfers_detached = 0;
+  ++m_detach_count;
+  // the journal only records what was added
+  m_journal_full_store = true;
 
   for (size_t i = 0; i < m_transfers.size(); ++i)
   {
@@ -1726,10 +2190,19 @@ void wallet2::detach_blockchain(uint64_t height)
   }
   m_transfers.erase(it, m_transfers.end());
 
-  size_t blocks_detached = m_blockchain.end() - (m_blockchain.begin()+height);
-  m_blockchain.erase(m_blockchain.begin()+height, m_blockchain.end());
+  size_t blocks_detached = m_blockchain.size() - height;
+  m_blockchain.crop(height);
   m_local_bc_height -= blocks_detached;
+  {
+    // pooled outputs may have been in the blocks popped
+    boost::lock_guard<boost::mutex> lock(m_decoy_pool_mutex);
+    m_decoy_pool.recent.clear();
+    m_decoy_pool.older.clear();
+  }
+  // transfers the shorter chain locks again are not in the unlock queue
+  rebuild_balance();
 
+  m_payments_by_height.erase(m_payments_by_height.lower_bound(height), m_payments_by_height.end());
   for (auto it = m_payments.begin(); it != m_payments.end(); )
   {
     if(height <= it->second.m_block_height)
@@ -1738,6 +2211,7 @@ void wallet2::detach_blockchain(uint64_t height)
       ++it;
   }
 
+  m_confirmed_txs_by_height.erase(m_confirmed_txs_by_height.lower_bound(height), m_confirmed_txs_by_height.end());
   for (auto it = m_confirmed_txs.begin(); it != m_confirmed_txs.end(); )
   {
     if(height <= it->second.m_block_height)
@@ -1751,6 +2225,7 @@ void wallet2::detach_blockchain(uint64_t height)
 //----------------------------------------------------------------------------------------------------
 bool wallet2::deinit()
 {
+  wait_for_background_store();
   return true;
 }
 //----------------------------------------------------------------------------------------------------
@@ -1764,7 +2239,20 @@ bool wallet2::clear()
   m_payments.clear();
   m_tx_keys.clear();
   m_confirmed_txs.clear();
+  m_history_loaded = true;
+  m_cache_stream.reset();
+  m_cache_sections.clear();
+  m_history_journal.clear();
+  m_payments_by_height.clear();
+  m_confirmed_txs_by_height.clear();
   m_local_bc_height = 1;
+  m_journal_full_store = true;
+  m_unspent_balance = 0;
+  m_unspent_by_amount.clear();
+  m_unlock_queue.clear();
+  m_pool_tx_hashes.clear();
+  m_pool_tx_hashes_known = false;
+  ++m_detach_count;
   return true;
 }
 
@@ -1826,6 +2314,12 @@ bool wallet2::store_keys(const std::string& keys_file_name, const std::string& p
   value2.SetInt(m_confirm_missing_payment_id ? 1 :0);
   json.AddMember("confirm_missing_payment_id", value2, json.GetAllocator());
 
+  value2.SetUint(m_refresh_prefetch_depth);
+  json.AddMember("refresh_prefetch_depth", value2, json.GetAllocator());
+
+  value2.SetUint(m_decoy_pool_size);
+  json.AddMember("decoy_pool_size", value2, json.GetAllocator());
+
   // Serialize the JSON object
   rapidjson::StringBuffer buffer;
   rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
@@ -1834,7 +2328,11 @@ bool wallet2::store_keys(const std::string& keys_file_name, const std::string& p
 
   // Encrypt the entire JSON object.
   crypto::chacha8_key key;
-  crypto::generate_chacha8_key(password, key);
+  if (!get_cached_chacha8_key(m_keys_file_key, password.data(), password.size(), key))
+  {
+    crypto::generate_chacha8_key(password, key);
+    cache_chacha8_key(m_keys_file_key, password.data(), password.size(), key);
+  }
   std::string cipher;
   cipher.resize(account_data.size());
   keys_file_data.iv = crypto::rand<crypto::chacha8_iv>();
@@ -1892,6 +2390,8 @@ bool wallet2::load_keys(const std::string& keys_file_name, const std::string& pa
     m_auto_refresh = true;
     m_refresh_type = RefreshType::RefreshDefault;
     m_confirm_missing_payment_id = true;
+    m_refresh_prefetch_depth = WALLET_REFRESH_PREFETCH_DEPTH;
+    decoy_pool_size(0);
   }
   else
   {
@@ -1950,6 +2450,10 @@ bool wallet2::load_keys(const std::string& keys_file_name, const std::string& pa
     m_refresh_from_block_height = field_refresh_height;
     GET_FIELD_FROM_JSON_RETURN_ON_ERROR(json, confirm_missing_payment_id, int, Int, false, true);
     m_confirm_missing_payment_id = field_confirm_missing_payment_id;
+    GET_FIELD_FROM_JSON_RETURN_ON_ERROR(json, refresh_prefetch_depth, uint32_t, Uint, false, WALLET_REFRESH_PREFETCH_DEPTH);
+    refresh_prefetch_depth(field_refresh_prefetch_depth);
+    GET_FIELD_FROM_JSON_RETURN_ON_ERROR(json, decoy_pool_size, uint32_t, Uint, false, 0);
+    decoy_pool_size(field_decoy_pool_size);
   }
 
   const cryptonote::account_keys& keys = m_account.get_keys();
@@ -1958,6 +2462,7 @@ bool wallet2::load_keys(const std::string& keys_file_name, const std::string& pa
   if(!m_watch_only)
     r = r && verify_keys(keys.m_spend_secret_key, keys.m_account_address.m_spend_public_key);
   THROW_WALLET_EXCEPTION_IF(!r, error::invalid_password);
+  cache_chacha8_key(m_keys_file_key, password.data(), password.size(), key);
   return true;
 }
 
@@ -1982,7 +2487,9 @@ bool wallet2::verify_password(const std::string& password) const
   r = ::serialization::parse_binary(buf, keys_file_data);
   THROW_WALLET_EXCEPTION_IF(!r, error::wallet_internal_error, "internal error: failed to deserialize \"" + keys_file_name + '\"');
   crypto::chacha8_key key;
-  crypto::generate_chacha8_key(password, key);
+  const bool cached = get_cached_chacha8_key(m_keys_file_key, password.data(), password.size(), key);
+  if (!cached)
+    crypto::generate_chacha8_key(password, key);
   std::string account_data;
   account_data.resize(keys_file_data.account_data.size());
   crypto::chacha8(keys_file_data.account_data.data(), keys_file_data.account_data.size(), key, keys_file_data.iv, &account_data[0]);
@@ -2007,6 +2514,8 @@ bool wallet2::verify_password(const std::string& password) const
   r = r && verify_keys(keys.m_view_secret_key,  keys.m_account_address.m_view_public_key);
   if(!m_watch_only)
     r = r && verify_keys(keys.m_spend_secret_key, keys.m_account_address.m_spend_public_key);
+  if (r && !cached)
+    cache_chacha8_key(m_keys_file_key, password.data(), password.size(), key);
   return r;
 }
 
@@ -2222,9 +2731,9 @@ bool wallet2::prepare_file_names(const std::string& file_path)
 //----------------------------------------------------------------------------------------------------
 bool wallet2::check_connection(uint32_t *version)
 {
-  boost::lock_guard<boost::mutex> lock(m_daemon_rpc_mutex);
+  tools::http_client_pool::lease daemon(m_daemon_clients);
 
-  if(!m_http_client.is_connected())
+  if(!daemon.get().is_connected())
   {
     net_utils::http::url_content u;
     net_utils::parse_url(m_daemon_address, u);
@@ -2234,7 +2743,7 @@ bool wallet2::check_connection(uint32_t *version)
       u.port = m_testnet ? config::testnet::RPC_DEFAULT_PORT : config::RPC_DEFAULT_PORT;
     }
 
-    if (!m_http_client.connect(u.host, std::to_string(u.port), WALLET_RCP_CONNECTION_TIMEOUT))
+    if (!daemon.get().connect(u.host, std::to_string(u.port), WALLET_RCP_CONNECTION_TIMEOUT))
       return false;
   }
 
@@ -2245,7 +2754,7 @@ bool wallet2::check_connection(uint32_t *version)
     req_t.jsonrpc = "2.0";
     req_t.id = epee::serialization::storage_entry(0);
     req_t.method = "get_version";
-    bool r = net_utils::invoke_http_json_remote_command2(m_daemon_address + "/json_rpc", req_t, resp_t, m_http_client);
+    bool r = net_utils::invoke_http_json_remote_command2(m_daemon_address + "/json_rpc", req_t, resp_t, daemon.get());
     if (!r || resp_t.result.status != CORE_RPC_STATUS_OK)
       *version = 0;
     else
@@ -2255,6 +2764,27 @@ bool wallet2::check_connection(uint32_t *version)
   return true;
 }
 //----------------------------------------------------------------------------------------------------
+bool wallet2::wait_for_daemon_blocks(uint64_t &since, unsigned timeout_seconds, bool &changed)
+{
+  cryptonote::COMMAND_RPC_GET_EVENTS::request req = AUTO_VAL_INIT(req);
+  cryptonote::COMMAND_RPC_GET_EVENTS::response res = AUTO_VAL_INIT(res);
+  req.since = since;
+  req.wait_seconds = timeout_seconds;
+  tools::http_client_pool::lease daemon(m_daemon_clients);
+  bool r = net_utils::invoke_http_bin_remote_command2(m_daemon_address + "/get_events.bin", req, res, daemon.get(), WALLET_RCP_CONNECTION_TIMEOUT);
+  daemon.release();
+  if (!r || res.status != CORE_RPC_STATUS_OK)
+    return false;
+
+  // pool changes alone are left to the next refresh
+  changed = res.full;
+  for (const auto &e: res.events)
+    if (e.type != "tx_added" && e.type != "tx_removed")
+      changed = true;
+  since = res.last_seq;
+  return true;
+}
+//----------------------------------------------------------------------------------------------------
 bool wallet2::generate_chacha8_key_from_secret_keys(crypto::chacha8_key &key) const
 {
   const account_keys &keys = m_account.get_keys();
@@ -2264,11 +2794,48 @@ bool wallet2::generate_chacha8_key_from_secret_keys(crypto::chacha8_key &key) co
   memcpy(data, &view_key, sizeof(view_key));
   memcpy(data + sizeof(view_key), &spend_key, sizeof(spend_key));
   data[sizeof(data) - 1] = CHACHA8_KEY_TAIL;
-  crypto::generate_chacha8_key(data, sizeof(data), key);
+  if (!get_cached_chacha8_key(m_cache_file_key, data, sizeof(data), key))
+  {
+    crypto::generate_chacha8_key(data, sizeof(data), key);
+    cache_chacha8_key(m_cache_file_key, data, sizeof(data), key);
+  }
   memset(data, 0, sizeof(data));
   return true;
 }
 //----------------------------------------------------------------------------------------------------
+crypto::hash wallet2::get_chacha8_key_check(const void *data, size_t size) const
+{
+  // only computable with the secret keys, which give away more than what it checks
+  const account_keys &keys = m_account.get_keys();
+  std::string buf(sizeof(keys.m_view_secret_key) + sizeof(keys.m_spend_secret_key) + size, 0);
+  memcpy(&buf[0], &keys.m_view_secret_key, sizeof(keys.m_view_secret_key));
+  memcpy(&buf[sizeof(keys.m_view_secret_key)], &keys.m_spend_secret_key, sizeof(keys.m_spend_secret_key));
+  if (size)
+    memcpy(&buf[sizeof(keys.m_view_secret_key) + sizeof(keys.m_spend_secret_key)], data, size);
+  const crypto::hash check = crypto::cn_fast_hash(buf.data(), buf.size());
+  memset(&buf[0], 0, buf.size());
+  return check;
+}
+//----------------------------------------------------------------------------------------------------
+bool wallet2::get_cached_chacha8_key(const cached_chacha8_key &cache, const void *data, size_t size, crypto::chacha8_key &key) const
+{
+  const crypto::hash check = get_chacha8_key_check(data, size);
+  boost::lock_guard<boost::mutex> lock(m_chacha8_keys_mutex);
+  if (!cache.known || cache.check != check)
+    return false;
+  memcpy(&key, &cache.key, sizeof(key));
+  return true;
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::cache_chacha8_key(cached_chacha8_key &cache, const void *data, size_t size, const crypto::chacha8_key &key) const
+{
+  const crypto::hash check = get_chacha8_key_check(data, size);
+  boost::lock_guard<boost::mutex> lock(m_chacha8_keys_mutex);
+  memcpy(&cache.key, &key, sizeof(key));
+  cache.check = check;
+  cache.known = true;
+}
+//----------------------------------------------------------------------------------------------------
 void wallet2::load(const std::string& wallet_, const std::string& password)
 {
   clear();
@@ -2293,41 +2860,59 @@ void wallet2::load(const std::string& wallet_, const std::string& password)
   }
   else
   {
-    wallet2::cache_file_data cache_file_data;
-    std::string buf;
-    bool r = epee::file_io_utils::load_file_to_string(m_wallet_file, buf);
-    THROW_WALLET_EXCEPTION_IF(!r, error::file_read_error, m_wallet_file);
-
-    // try to read it as an encrypted cache
-    try
+    const size_t magiclen = strlen(WALLET_CACHE_SECTIONS_MAGIC);
+    std::unique_ptr<std::ifstream> istr(new std::ifstream(m_wallet_file, std::ios_base::binary | std::ios_base::in));
+    std::string magic(magiclen, '\0');
+    istr->read(&magic[0], magiclen);
+    if (istr->good() && magic == WALLET_CACHE_SECTIONS_MAGIC)
     {
-      LOG_PRINT_L1("Trying to decrypt cache data");
-
-      r = ::serialization::parse_binary(buf, cache_file_data);
-      THROW_WALLET_EXCEPTION_IF(!r, error::wallet_internal_error, "internal error: failed to deserialize \"" + m_wallet_file + '\"');
-      crypto::chacha8_key key;
-      generate_chacha8_key_from_secret_keys(key);
-      std::string cache_data;
-      cache_data.resize(cache_file_data.cache_data.size());
-      crypto::chacha8(cache_file_data.cache_data.data(), cache_file_data.cache_data.size(), key, cache_file_data.iv, &cache_data[0]);
-
-      std::stringstream iss;
-      iss << cache_data;
-      boost::archive::binary_iarchive ar(iss);
-      ar >> *this;
+      // only the header section is read here
+      load_cache_sections(std::move(istr));
     }
-    catch (...)
+    else
     {
-      LOG_PRINT_L1("Failed to load encrypted cache, trying unencrypted");
-      std::stringstream iss;
-      iss << buf;
-      boost::archive::binary_iarchive ar(iss);
-      ar >> *this;
+      istr.reset();
+      wallet2::cache_file_data cache_file_data;
+      std::string buf;
+      bool r = epee::file_io_utils::load_file_to_string(m_wallet_file, buf);
+      THROW_WALLET_EXCEPTION_IF(!r, error::file_read_error, m_wallet_file);
+
+      // try to read it as an encrypted cache
+      try
+      {
+        LOG_PRINT_L1("Trying to decrypt cache data");
+
+        r = ::serialization::parse_binary(buf, cache_file_data);
+        THROW_WALLET_EXCEPTION_IF(!r, error::wallet_internal_error, "internal error: failed to deserialize \"" + m_wallet_file + '\"');
+        crypto::chacha8_key key;
+        generate_chacha8_key_from_secret_keys(key);
+        std::string cache_data;
+        cache_data.resize(cache_file_data.cache_data.size());
+        crypto::chacha8(cache_file_data.cache_data.data(), cache_file_data.cache_data.size(), key, cache_file_data.iv, &cache_data[0]);
+
+        std::stringstream iss;
+        iss << cache_data;
+        boost::archive::binary_iarchive ar(iss);
+        ar >> *this;
+      }
+      catch (...)
+      {
+        LOG_PRINT_L1("Failed to load encrypted cache, trying unencrypted");
+        std::stringstream iss;
+        iss << buf;
+        boost::archive::binary_iarchive ar(iss);
+        ar >> *this;
+      }
     }
     THROW_WALLET_EXCEPTION_IF(
       m_account_public_address.m_spend_public_key != m_account.get_keys().m_account_address.m_spend_public_key ||
       m_account_public_address.m_view_public_key  != m_account.get_keys().m_account_address.m_view_public_key,
       error::wallet_files_doesnt_correspond, m_keys_file, m_wallet_file);
+
+    load_journal();
+    rebuild_balance();
+    if (m_history_loaded)
+      rebuild_height_indexes();
   }
 
   cryptonote::block genesis;
@@ -2341,6 +2926,8 @@ void wallet2::load(const std::string& wallet_, const std::string& password)
   else
   {
     check_genesis(genesis_hash);
+    // wallets stored before trimming carry all their hashes
+    m_blockchain.trim(WALLET_HASHCHAIN_KEEP);
   }
 
   m_local_bc_height = m_blockchain.size();
@@ -2349,7 +2936,7 @@ void wallet2::load(const std::string& wallet_, const std::string& password)
 void wallet2::check_genesis(const crypto::hash& genesis_hash) const {
   std::string what("Genesis block mismatch. You probably use wallet without testnet flag with blockchain from test network or vice versa");
 
-  THROW_WALLET_EXCEPTION_IF(genesis_hash != m_blockchain[0], error::wallet_internal_error, what);
+  THROW_WALLET_EXCEPTION_IF(genesis_hash != m_blockchain.genesis(), error::wallet_internal_error, what);
 }
 //----------------------------------------------------------------------------------------------------
 std::string wallet2::path() const
@@ -2394,20 +2981,15 @@ void wallet2::store_to(const std::string &path, const std::string &password)
       }
     }
   }
-  // preparing wallet data
-  std::stringstream oss;
-  boost::archive::binary_oarchive ar(oss);
-  ar << *this;
+  wait_for_background_store();
+  // only the changes since the last store, while the journal stays small
+  if (same_file && append_journal())
+    return;
 
-  wallet2::cache_file_data cache_file_data = boost::value_initialized<wallet2::cache_file_data>();
-  cache_file_data.cache_data = oss.str();
+  std::vector<std::string> sections;
+  serialize_cache_sections(sections);
   crypto::chacha8_key key;
   generate_chacha8_key_from_secret_keys(key);
-  std::string cipher;
-  cipher.resize(cache_file_data.cache_data.size());
-  cache_file_data.iv = crypto::rand<crypto::chacha8_iv>();
-  crypto::chacha8(cache_file_data.cache_data.data(), cache_file_data.cache_data.size(), key, cache_file_data.iv, &cipher[0]);
-  cache_file_data.cache_data = cipher;
 
   const std::string new_file = same_file ? m_wallet_file + ".new" : path;
   const std::string old_file = m_wallet_file;
@@ -2415,12 +2997,7 @@ void wallet2::store_to(const std::string &path, const std::string &password)
   const std::string old_address_file = m_wallet_file + ".address.txt";
 
   // save to new file
-  std::ofstream ostr;
-  ostr.open(new_file, std::ios_base::binary | std::ios_base::out | std::ios_base::trunc);
-  binary_archive<true> oar(ostr);
-  bool success = ::serialization::serialize(oar, cache_file_data);
-  ostr.close();
-  THROW_WALLET_EXCEPTION_IF(!success || !ostr.good(), error::file_save_error, new_file);
+  THROW_WALLET_EXCEPTION_IF(!write_cache_file(new_file, sections, key), error::file_save_error, new_file);
 
   // save keys to the new file
   // if we here, main wallet file is saved and we only need to save keys and address files
@@ -2451,24 +3028,420 @@ void wallet2::store_to(const std::string &path, const std::string &password)
     std::error_code e = tools::replace_file(new_file, m_wallet_file);
     THROW_WALLET_EXCEPTION_IF(e, error::file_save_error, m_wallet_file, e);
   }
+
+  // the journal extended the old cache, whose id it no longer matches
+  boost::system::error_code ec;
+  boost::filesystem::remove(old_file + WALLET_JOURNAL_FILE_SUFFIX, ec);
+  if (ec)
+    LOG_ERROR("error removing file: " << old_file + WALLET_JOURNAL_FILE_SUFFIX << ": " << ec.message());
+  reset_journal();
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::store_in_background()
+{
+  wait_for_background_store();
+  if (append_journal())
+    return;
+
+  std::shared_ptr<std::vector<std::string>> sections = std::make_shared<std::vector<std::string>>();
+  serialize_cache_sections(*sections);
+  crypto::chacha8_key key;
+  generate_chacha8_key_from_secret_keys(key);
+  const std::string file = m_wallet_file;
+  // the journal now follows the state being written; should the write fail,
+  // the next store is a full one, which does not use the journal
+  reset_journal();
+
+  m_background_store = boost::thread([this, sections, key, file]() {
+    const std::string new_file = file + ".new";
+    if (!write_cache_file(new_file, *sections, key))
+    {
+      LOG_ERROR("Failed to write " << new_file);
+      m_background_store_failed = true;
+      return;
+    }
+    std::error_code e = tools::replace_file(new_file, file);
+    if (e)
+    {
+      LOG_ERROR("Failed to replace " << file << ": " << e.message());
+      m_background_store_failed = true;
+      return;
+    }
+    boost::system::error_code ec;
+    boost::filesystem::remove(file + WALLET_JOURNAL_FILE_SUFFIX, ec);
+    if (ec)
+      LOG_ERROR("error removing file: " << file + WALLET_JOURNAL_FILE_SUFFIX << ": " << ec.message());
+  });
+}
+//----------------------------------------------------------------------------------------------------
+bool wallet2::wait_for_background_store()
+{
+  if (m_background_store.joinable())
+    m_background_store.join();
+  if (!m_background_store_failed.exchange(false))
+    return true;
+  m_journal_full_store = true;
+  return false;
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::serialize_cache_sections(std::vector<std::string> &sections)
+{
+  // each section encrypted on its own so the history ones can be left
+  // unread when the wallet is next loaded
+  load_history();
+  m_blockchain.trim(WALLET_HASHCHAIN_KEEP);
+  m_journal_id = crypto::rand<crypto::hash>();
+  sections.clear();
+  sections.resize(cache_section_count);
+  {
+    std::stringstream oss;
+    boost::archive::binary_oarchive ar(oss);
+    serialize_cache_header(ar);
+    sections[cache_section_header] = oss.str();
+  }
+  sections[cache_section_payments] = dump_cache_section(m_payments);
+  sections[cache_section_confirmed_txs] = dump_cache_section(m_confirmed_txs);
+  sections[cache_section_tx_keys] = dump_cache_section(m_tx_keys);
+}
+//----------------------------------------------------------------------------------------------------
+bool wallet2::write_cache_file(const std::string &file, std::vector<std::string> &sections, const crypto::chacha8_key &key)
+{
+  wallet2::cache_sections_index index = boost::value_initialized<wallet2::cache_sections_index>();
+  index.version = 1;
+  for (std::string &data: sections)
+  {
+    cache_section section;
+    section.iv = crypto::rand<crypto::chacha8_iv>();
+    section.size = data.size();
+    std::string cipher;
+    cipher.resize(data.size());
+    crypto::chacha8(data.data(), data.size(), key, section.iv, &cipher[0]);
+    data = cipher;
+    index.sections.push_back(section);
+  }
+
+  std::ofstream ostr;
+  ostr.open(file, std::ios_base::binary | std::ios_base::out | std::ios_base::trunc);
+  ostr << WALLET_CACHE_SECTIONS_MAGIC;
+  binary_archive<true> oar(ostr);
+  bool success = ::serialization::serialize(oar, index);
+  for (const std::string &data: sections)
+    ostr.write(data.data(), data.size());
+  ostr.close();
+  return success && ostr.good();
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::reset_journal()
+{
+  m_journal_full_store = false;
+  m_journal_blockchain_size = m_blockchain.size();
+  m_journal_transfers_size = m_transfers.size();
+  m_journal_spent.clear();
+  m_journal_payments.clear();
+  m_journal_confirmed_txs.clear();
+  m_journal_tx_keys.clear();
+}
+//----------------------------------------------------------------------------------------------------
+bool wallet2::append_journal()
+{
+  if (m_journal_full_store || m_journal_id == null_hash)
+    return false;
+
+  // compact once the journal outgrows the cache it extends
+  const std::string journal_file = m_wallet_file + WALLET_JOURNAL_FILE_SUFFIX;
+  boost::system::error_code ec;
+  const uint64_t cache_size = boost::filesystem::file_size(m_wallet_file, ec);
+  if (ec)
+    return false;
+  uint64_t journal_size = 0;
+  if (boost::filesystem::exists(journal_file, ec))
+    journal_size = boost::filesystem::file_size(journal_file, ec);
+  if (ec || journal_size > cache_size)
+    return false;
+
+  m_blockchain.trim(WALLET_HASHCHAIN_KEEP);
+  journal_record record = boost::value_initialized<journal_record>();
+  record.journal_id = m_journal_id;
+  // more blocks than are kept in full came since, the compact chain is sent instead
+  record.full_blockchain = m_journal_blockchain_size < m_blockchain.offset();
+  if (record.full_blockchain)
+  {
+    record.blockchain = m_blockchain;
+  }
+  else
+  {
+    record.blockchain_start = m_journal_blockchain_size;
+    for (size_t height = m_journal_blockchain_size; height < m_blockchain.size(); ++height)
+    {
+      crypto::hash hash;
+      m_blockchain.get(height, hash);
+      record.block_hashes.push_back(hash);
+    }
+  }
+  record.transfers_start = m_journal_transfers_size;
+  record.transfers.assign(m_transfers.begin() + m_journal_transfers_size, m_transfers.end());
+  for (size_t idx: m_journal_spent)
+  {
+    if (idx >= m_journal_transfers_size)
+      break;
+    const transfer_details &td = m_transfers[idx];
+    record.spent_changes.push_back({idx, td.m_spent, td.m_spent_height});
+  }
+  record.payments = m_journal_payments;
+  for (const crypto::hash &txid: m_journal_confirmed_txs)
+  {
+    auto it = m_confirmed_txs.find(txid);
+    if (it != m_confirmed_txs.end())
+      record.confirmed_txs.push_back(*it);
+  }
+  for (const crypto::hash &txid: m_journal_tx_keys)
+  {
+    auto it = m_tx_keys.find(txid);
+    if (it != m_tx_keys.end())
+      record.tx_keys.push_back(*it);
+  }
+  record.unconfirmed_txs = m_unconfirmed_txs;
+  record.unconfirmed_payments = m_unconfirmed_payments;
+  record.tx_notes = m_tx_notes;
+  record.address_book = m_address_book;
+
+  std::stringstream oss;
+  {
+    boost::archive::binary_oarchive ar(oss);
+    ar << record;
+  }
+
+  wallet2::cache_file_data cache_file_data = boost::value_initialized<wallet2::cache_file_data>();
+  const std::string plain = oss.str();
+  crypto::chacha8_key key;
+  generate_chacha8_key_from_secret_keys(key);
+  cache_file_data.cache_data.resize(plain.size());
+  cache_file_data.iv = crypto::rand<crypto::chacha8_iv>();
+  crypto::chacha8(plain.data(), plain.size(), key, cache_file_data.iv, &cache_file_data.cache_data[0]);
+
+  std::ofstream ostr;
+  ostr.open(journal_file, std::ios_base::binary | std::ios_base::out | std::ios_base::app);
+  binary_archive<true> oar(ostr);
+  bool success = ::serialization::serialize(oar, cache_file_data);
+  ostr.close();
+  THROW_WALLET_EXCEPTION_IF(!success || !ostr.good(), error::file_save_error, journal_file);
+
+  LOG_PRINT_L2("Appended " << record.block_hashes.size() << " block hashes and " << record.transfers.size() << " transfers to " << journal_file);
+  reset_journal();
+  return true;
+}
+//----------------------------------------------------------------------------------------------------
+bool wallet2::apply_journal_record(const journal_record &record)
+{
+  if (!record.full_blockchain && record.blockchain_start != m_blockchain.size())
+    return false;
+  if (record.transfers_start != m_transfers.size())
+    return false;
+  for (const journal_spent_change &change: record.spent_changes)
+    if (change.index >= m_transfers.size())
+      return false;
+
+  if (record.full_blockchain)
+    m_blockchain = record.blockchain;
+  for (const crypto::hash &hash: record.block_hashes)
+    m_blockchain.push_back(hash);
+  for (const journal_spent_change &change: record.spent_changes)
+  {
+    m_transfers[change.index].m_spent = change.spent;
+    m_transfers[change.index].m_spent_height = change.height;
+  }
+  for (const transfer_details &td: record.transfers)
+  {
+    m_key_images[td.m_key_image] = m_transfers.size();
+    m_pub_keys[td.get_public_key()] = m_transfers.size();
+    m_transfers.push_back(td);
+  }
+  // the history sections may not be read yet, their changes then wait for them
+  if (m_history_loaded)
+    apply_history_journal_record(record);
+  else
+    m_history_journal.push_back(record);
+  m_unconfirmed_txs = record.unconfirmed_txs;
+  m_unconfirmed_payments = record.unconfirmed_payments;
+  m_tx_notes = record.tx_notes;
+  m_address_book = record.address_book;
+  return true;
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::apply_history_journal_record(const journal_record &record)
+{
+  for (const auto &payment: record.payments)
+    m_payments.emplace(payment.first, payment.second);
+  for (const auto &confirmed: record.confirmed_txs)
+    m_confirmed_txs[confirmed.first] = confirmed.second;
+  for (const auto &tx_key: record.tx_keys)
+    m_tx_keys[tx_key.first] = tx_key.second;
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::load_cache_sections(std::unique_ptr<std::ifstream> stream)
+{
+  wallet2::cache_sections_index index;
+  binary_archive<false> iar(*stream);
+  bool r = ::serialization::serialize(iar, index);
+  THROW_WALLET_EXCEPTION_IF(!r || index.sections.size() != cache_section_count, error::file_read_error, m_wallet_file);
+
+  m_cache_sections.clear();
+  uint64_t offset = stream->tellg();
+  for (const cache_section &section: index.sections)
+  {
+    m_cache_sections.push_back(std::make_pair(offset, section));
+    offset += section.size;
+  }
+  boost::system::error_code ec;
+  const uint64_t file_size = boost::filesystem::file_size(m_wallet_file, ec);
+  THROW_WALLET_EXCEPTION_IF(ec || offset > file_size, error::file_read_error, m_wallet_file);
+  m_cache_stream = std::move(stream);
+
+  crypto::chacha8_key key;
+  generate_chacha8_key_from_secret_keys(key);
+  const std::string header = read_cache_section(*m_cache_stream, m_cache_sections[cache_section_header], key);
+  THROW_WALLET_EXCEPTION_IF(header.empty(), error::file_read_error, m_wallet_file);
+  try
+  {
+    std::stringstream iss;
+    iss << header;
+    boost::archive::binary_iarchive ar(iss);
+    serialize_cache_header(ar);
+  }
+  catch (...)
+  {
+    THROW_WALLET_EXCEPTION_IF(true, error::file_read_error, m_wallet_file);
+  }
+  m_history_loaded = false;
+  LOG_PRINT_L1("Loaded the header of " << m_wallet_file << ", " << m_transfers.size() << " transfers");
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::load_history() const
+{
+  if (m_history_loaded)
+    return;
+  // the history is the same whenever it is read, so getters do not lose their constness over it
+  wallet2 &self = const_cast<wallet2&>(*this);
+
+  TIME_MEASURE_START(load_time);
+  crypto::chacha8_key key;
+  generate_chacha8_key_from_secret_keys(key);
+  std::vector<std::string> sections(cache_section_count);
+  for (size_t n = cache_section_payments; n < cache_section_count; ++n)
+  {
+    sections[n] = read_cache_section(*m_cache_stream, m_cache_sections[n], key);
+    THROW_WALLET_EXCEPTION_IF(sections[n].empty(), error::file_read_error, m_wallet_file);
+  }
+
+  // nothing is swapped in before all of them were parsed, so a failure can be retried
+  payment_container payments;
+  std::unordered_map<crypto::hash, confirmed_transfer_details> confirmed_txs;
+  std::unordered_map<crypto::hash, crypto::secret_key> tx_keys;
+  try
+  {
+    tools::parallel_for(scan_pool(), cache_section_payments, cache_section_count, 1, [&] (size_t first, size_t last) {
+      for (size_t n = first; n < last; ++n)
+      {
+        if (n == cache_section_payments)
+          parse_cache_section(sections[n], payments);
+        else if (n == cache_section_confirmed_txs)
+          parse_cache_section(sections[n], confirmed_txs);
+        else
+          parse_cache_section(sections[n], tx_keys);
+      }
+      return true;
+    });
+  }
+  catch (...)
+  {
+    THROW_WALLET_EXCEPTION_IF(true, error::file_read_error, m_wallet_file);
+  }
+
+  self.m_payments.swap(payments);
+  self.m_confirmed_txs.swap(confirmed_txs);
+  self.m_tx_keys.swap(tx_keys);
+  for (const journal_record &record: m_history_journal)
+    self.apply_history_journal_record(record);
+  self.m_history_journal.clear();
+  self.m_cache_stream.reset();
+  self.m_cache_sections.clear();
+  self.m_history_loaded = true;
+  self.rebuild_height_indexes();
+  TIME_MEASURE_FINISH(load_time);
+  LOG_PRINT_L1("Loaded " << m_payments.size() << " payments and " << m_confirmed_txs.size() << " outgoing txes from " << m_wallet_file << " in " << load_time << " ms");
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::load_journal()
+{
+  reset_journal();
+  const std::string journal_file = m_wallet_file + WALLET_JOURNAL_FILE_SUFFIX;
+  boost::system::error_code ec;
+  if (!boost::filesystem::exists(journal_file, ec) || ec)
+    return;
+
+  crypto::chacha8_key key;
+  generate_chacha8_key_from_secret_keys(key);
+  std::ifstream istr(journal_file, std::ios_base::binary | std::ios_base::in);
+  binary_archive<false> iar(istr);
+  size_t records = 0;
+  bool complete = true;
+  while (complete && iar.remaining_bytes() > 0)
+  {
+    // a torn last record, or a journal left over from an older cache, ends the replay
+    wallet2::cache_file_data cache_file_data;
+    if (!::serialization::serialize(iar, cache_file_data))
+    {
+      complete = false;
+      break;
+    }
+    std::string plain;
+    plain.resize(cache_file_data.cache_data.size());
+    crypto::chacha8(cache_file_data.cache_data.data(), cache_file_data.cache_data.size(), key, cache_file_data.iv, &plain[0]);
+    journal_record record;
+    try
+    {
+      std::stringstream iss;
+      iss << plain;
+      boost::archive::binary_iarchive ar(iss);
+      ar >> record;
+    }
+    catch (...)
+    {
+      complete = false;
+      break;
+    }
+    complete = record.journal_id == m_journal_id && apply_journal_record(record);
+    if (complete)
+      ++records;
+  }
+
+  reset_journal();
+  LOG_PRINT_L1("Replayed " << records << " records from " << journal_file);
+  if (!complete)
+  {
+    LOG_PRINT_L0("The end of " << journal_file << " could not be replayed, the next store will rewrite the cache");
+    m_journal_full_store = true;
+  }
 }
 //----------------------------------------------------------------------------------------------------
 uint64_t wallet2::unlocked_balance() const
 {
-  uint64_t amount = 0;
-  BOOST_FOREACH(const transfer_details& td, m_transfers)
-    if(!td.m_spent && is_transfer_unlocked(td))
-      amount += td.amount();
+  uint64_t amount = m_unspent_balance;
+  // only the queue past the current height can still be locked
+  const auto start = m_unlock_queue.upper_bound(std::make_pair(m_blockchain.size(), std::numeric_limits<size_t>::max()));
+  for (auto it = start; it != m_unlock_queue.end(); ++it)
+  {
+    const transfer_details &td = m_transfers[it->second];
+    if (!is_transfer_unlocked(td))
+      amount -= td.amount();
+  }
 
   return amount;
 }
 //----------------------------------------------------------------------------------------------------
 uint64_t wallet2::balance() const
 {
-  uint64_t amount = 0;
-  BOOST_FOREACH(auto& td, m_transfers)
-    if(!td.m_spent)
-      amount += td.amount();
+  uint64_t amount = m_unspent_balance;
 
 
   BOOST_FOREACH(auto& utx, m_unconfirmed_txs)
@@ -2485,6 +3458,7 @@ void wallet2::get_transfers(wallet2::transfer_container& incoming_transfers) con
 //----------------------------------------------------------------------------------------------------
 void wallet2::get_payments(const crypto::hash& payment_id, std::list<wallet2::payment_details>& payments, uint64_t min_height) const
 {
+  load_history();
   auto range = m_payments.equal_range(payment_id);
   std::for_each(range.first, range.second, [&payments, &min_height](const payment_container::value_type& x) {
     if (min_height < x.second.m_block_height)
@@ -2494,27 +3468,101 @@ void wallet2::get_payments(const crypto::hash& payment_id, std::list<wallet2::pa
   });
 }
 //----------------------------------------------------------------------------------------------------
-void wallet2::get_payments(std::list<std::pair<crypto::hash,wallet2::payment_details>>& payments, uint64_t min_height, uint64_t max_height) const
+template<typename T, typename E>
+static bool get_by_height(const std::multimap<uint64_t, const T*> &index, std::list<E> &entries,
+    uint64_t min_height, uint64_t max_height, size_t limit, wallet2::height_cursor &cursor)
 {
-  auto range = std::make_pair(m_payments.begin(), m_payments.end());
-  std::for_each(range.first, range.second, [&payments, &min_height, &max_height](const payment_container::value_type& x) {
-    if (min_height < x.second.m_block_height && max_height >= x.second.m_block_height)
+  if (min_height >= max_height)
+    return false;
+
+  uint64_t height = min_height + 1;
+  size_t run = 0; // entries at height already returned
+  if (cursor.height >= height)
+  {
+    height = cursor.height;
+    run = cursor.skip;
+  }
+  auto it = index.lower_bound(height);
+  for (size_t n = 0; n < run && it != index.end() && it->first == height; ++n)
+    ++it;
+
+  size_t returned = 0;
+  for (; it != index.end() && it->first <= max_height; ++it)
+  {
+    if (it->first != height)
     {
-      payments.push_back(x);
+      height = it->first;
+      run = 0;
     }
-  });
+    if (limit && returned == limit)
+    {
+      cursor.height = height;
+      cursor.skip = run;
+      return true;
+    }
+    entries.push_back(*it->second);
+    ++returned;
+    ++run;
+  }
+  return false;
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::get_payments(std::list<std::pair<crypto::hash,wallet2::payment_details>>& payments, uint64_t min_height, uint64_t max_height) const
+{
+  load_history();
+  height_cursor cursor;
+  get_by_height(m_payments_by_height, payments, min_height, max_height, 0, cursor);
+}
+//----------------------------------------------------------------------------------------------------
+bool wallet2::get_payments(std::list<std::pair<crypto::hash,wallet2::payment_details>>& payments, uint64_t min_height, uint64_t max_height, size_t limit, height_cursor &cursor) const
+{
+  load_history();
+  return get_by_height(m_payments_by_height, payments, min_height, max_height, limit, cursor);
 }
 //----------------------------------------------------------------------------------------------------
 void wallet2::get_payments_out(std::list<std::pair<crypto::hash,wallet2::confirmed_transfer_details>>& confirmed_payments,
     uint64_t min_height, uint64_t max_height) const
 {
-  for (auto i = m_confirmed_txs.begin(); i != m_confirmed_txs.end(); ++i) {
-    if (i->second.m_block_height > min_height && i->second.m_block_height <= max_height) {
-      confirmed_payments.push_back(*i);
+  load_history();
+  height_cursor cursor;
+  get_by_height(m_confirmed_txs_by_height, confirmed_payments, min_height, max_height, 0, cursor);
+}
+//----------------------------------------------------------------------------------------------------
+bool wallet2::get_payments_out(std::list<std::pair<crypto::hash,wallet2::confirmed_transfer_details>>& confirmed_payments,
+    uint64_t min_height, uint64_t max_height, size_t limit, height_cursor &cursor) const
+{
+  load_history();
+  return get_by_height(m_confirmed_txs_by_height, confirmed_payments, min_height, max_height, limit, cursor);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::add_confirmed_tx_index(const std::pair<const crypto::hash, confirmed_transfer_details> &confirmed)
+{
+  m_confirmed_txs_by_height.insert(std::make_pair(confirmed.second.m_block_height, &confirmed));
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::remove_confirmed_tx_index(const std::pair<const crypto::hash, confirmed_transfer_details> &confirmed)
+{
+  auto range = m_confirmed_txs_by_height.equal_range(confirmed.second.m_block_height);
+  for (auto it = range.first; it != range.second; ++it)
+  {
+    if (it->second == &confirmed)
+    {
+      m_confirmed_txs_by_height.erase(it);
+      return;
     }
   }
 }
 //----------------------------------------------------------------------------------------------------
+void wallet2::rebuild_height_indexes()
+{
+  m_payments_by_height.clear();
+  for (const auto &payment: m_payments)
+    m_payments_by_height.insert(std::make_pair(payment.second.m_block_height, &payment));
+  m_confirmed_txs_by_height.clear();
+  for (const auto &confirmed: m_confirmed_txs)
+    add_confirmed_tx_index(confirmed);
+}
+//----------------------------------------------------------------------------------------------------
 void wallet2::get_unconfirmed_payments_out(std::list<std::pair<crypto::hash,wallet2::unconfirmed_transfer_details>>& unconfirmed_payments) const
 {
   for (auto i = m_unconfirmed_txs.begin(); i != m_unconfirmed_txs.end(); ++i) {
@@ -2531,27 +3579,20 @@ void wallet2::get_unconfirmed_payments(std::list<std::pair<crypto::hash,wallet2:
 //----------------------------------------------------------------------------------------------------
 void wallet2::rescan_spent()
 {
-  std::vector<std::string> key_images;
-
-  // make a list of key images for all our outputs
-  for (size_t i = 0; i < m_transfers.size(); ++i)
+  std::vector<int> spent_status;
+  spent_status.reserve(m_transfers.size());
+  bool use_bin = true;
+  for (size_t start = 0; start < m_transfers.size(); start += COMMAND_RPC_IS_KEY_IMAGE_SPENT_MAX_COUNT)
   {
-    const transfer_details& td = m_transfers[i];
-    key_images.push_back(string_tools::pod_to_hex(td.m_key_image));
-  }
-
-  COMMAND_RPC_IS_KEY_IMAGE_SPENT::request req = AUTO_VAL_INIT(req);
-  COMMAND_RPC_IS_KEY_IMAGE_SPENT::response daemon_resp = AUTO_VAL_INIT(daemon_resp);
-  req.key_images = key_images;
-  m_daemon_rpc_mutex.lock();
-  bool r = epee::net_utils::invoke_http_json_remote_command2(m_daemon_address + "/is_key_image_spent", req, daemon_resp, m_http_client, 200000);
-  m_daemon_rpc_mutex.unlock();
-  THROW_WALLET_EXCEPTION_IF(!r, error::no_connection_to_daemon, "is_key_image_spent");
-  THROW_WALLET_EXCEPTION_IF(daemon_resp.status == CORE_RPC_STATUS_BUSY, error::daemon_busy, "is_key_image_spent");
-  THROW_WALLET_EXCEPTION_IF(daemon_resp.status != CORE_RPC_STATUS_OK, error::is_key_image_spent_error, daemon_resp.status);
-  THROW_WALLET_EXCEPTION_IF(daemon_resp.spent_status.size() != key_images.size(), error::wallet_internal_error,
-    "daemon returned wrong response for is_key_image_spent, wrong amounts count = " +
-    std::to_string(daemon_resp.spent_status.size()) + ", expected " +  std::to_string(key_images.size()));
+    // make a list of key images for a chunk of our outputs
+    const size_t end = std::min(start + COMMAND_RPC_IS_KEY_IMAGE_SPENT_MAX_COUNT, m_transfers.size());
+    std::vector<crypto::key_image> key_images;
+    key_images.reserve(end - start);
+    for (size_t i = start; i < end; ++i)
+      key_images.push_back(m_transfers[i].m_key_image);
+    const std::vector<int> status = get_key_images_spent_status(key_images, use_bin);
+    spent_status.insert(spent_status.end(), status.begin(), status.end());
+  }
 
   // update spent status
   for (size_t i = 0; i < m_transfers.size(); ++i)
@@ -2560,7 +3601,7 @@ void wallet2::rescan_spent()
     // a view wallet may not know about key images
     if (!td.m_key_image_known)
       continue;
-    if (td.m_spent != (daemon_resp.spent_status[i] != COMMAND_RPC_IS_KEY_IMAGE_SPENT::UNSPENT))
+    if (td.m_spent != (spent_status[i] != COMMAND_RPC_IS_KEY_IMAGE_SPENT::UNSPENT))
     {
       if (td.m_spent)
       {
@@ -2578,6 +3619,48 @@ void wallet2::rescan_spent()
   }
 }
 //----------------------------------------------------------------------------------------------------
+std::vector<int> wallet2::get_key_images_spent_status(const std::vector<crypto::key_image> &key_images, bool &use_bin)
+{
+  THROW_WALLET_EXCEPTION_IF(key_images.size() > COMMAND_RPC_IS_KEY_IMAGE_SPENT_MAX_COUNT, error::wallet_internal_error,
+      "Too many key images for one is_key_image_spent call");
+
+  std::vector<int> spent_status;
+  std::string status;
+  if (use_bin)
+  {
+    COMMAND_RPC_IS_KEY_IMAGE_SPENT_BIN::request req = AUTO_VAL_INIT(req);
+    COMMAND_RPC_IS_KEY_IMAGE_SPENT_BIN::response res = AUTO_VAL_INIT(res);
+    req.key_images = key_images;
+    tools::http_client_pool::lease daemon(m_daemon_clients);
+    bool r = net_utils::invoke_http_bin_remote_command2(m_daemon_address + "/is_key_image_spent.bin", req, res, daemon.get(), WALLET_RCP_CONNECTION_TIMEOUT);
+    daemon.release();
+    // older daemons only have the json call
+    use_bin = r;
+    spent_status.swap(res.spent_status);
+    status = res.status;
+  }
+  if (!use_bin)
+  {
+    COMMAND_RPC_IS_KEY_IMAGE_SPENT::request req = AUTO_VAL_INIT(req);
+    COMMAND_RPC_IS_KEY_IMAGE_SPENT::response res = AUTO_VAL_INIT(res);
+    req.key_images.reserve(key_images.size());
+    for (const crypto::key_image &ki: key_images)
+      req.key_images.push_back(string_tools::pod_to_hex(ki));
+    tools::http_client_pool::lease daemon(m_daemon_clients);
+    bool r = epee::net_utils::invoke_http_json_remote_command2(m_daemon_address + "/is_key_image_spent", req, res, daemon.get(), WALLET_RCP_CONNECTION_TIMEOUT);
+    daemon.release();
+    THROW_WALLET_EXCEPTION_IF(!r, error::no_connection_to_daemon, "is_key_image_spent");
+    spent_status.swap(res.spent_status);
+    status = res.status;
+  }
+  THROW_WALLET_EXCEPTION_IF(status == CORE_RPC_STATUS_BUSY, error::daemon_busy, "is_key_image_spent");
+  THROW_WALLET_EXCEPTION_IF(status != CORE_RPC_STATUS_OK, error::is_key_image_spent_error, status);
+  THROW_WALLET_EXCEPTION_IF(spent_status.size() != key_images.size(), error::wallet_internal_error,
+    "daemon returned wrong response for is_key_image_spent, wrong amounts count = " +
+    std::to_string(spent_status.size()) + ", expected " +  std::to_string(key_images.size()));
+  return spent_status;
+}
+//----------------------------------------------------------------------------------------------------
 void wallet2::rescan_blockchain(bool refresh)
 {
   clear();
@@ -2594,7 +3677,7 @@ void wallet2::rescan_blockchain(bool refresh)
 //----------------------------------------------------------------------------------------------------
 bool wallet2::is_transfer_unlocked(const transfer_details& td) const
 {
-  if(!is_tx_spendtime_unlocked(td.m_tx.unlock_time, td.m_block_height))
+  if(!is_tx_spendtime_unlocked(td.m_unlock_time, td.m_block_height))
     return false;
 
   if(td.m_block_height + CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE > m_blockchain.size())
@@ -2672,14 +3755,36 @@ namespace
 // their ordering, but it could become more murky if we add scores later.
 float wallet2::get_output_relatedness(const transfer_details &td0, const transfer_details &td1) const
 {
-  int dh;
-
   // expensive test, and same tx will fall onto the same block height below
   if (td0.m_txid == td1.m_txid)
     return 1.0f;
 
+  uint64_t dh = td0.m_block_height > td1.m_block_height ? td0.m_block_height - td1.m_block_height : td1.m_block_height - td0.m_block_height;
+  return get_height_relatedness(dh);
+}
+//----------------------------------------------------------------------------------------------------
+// The most an output is related to any of a set, which get_output_relatedness
+// would find comparing it with each: the score falls with the height distance,
+// so only the nearest height matters
+float wallet2::get_output_relatedness(const transfer_details &td, const std::unordered_set<crypto::hash> &txids, const std::set<uint64_t> &heights) const
+{
+  if (txids.find(td.m_txid) != txids.end())
+    return 1.0f;
+
+  auto it = heights.lower_bound(td.m_block_height);
+  if (it == heights.end() && it == heights.begin())
+    return 0.0f;
+  uint64_t dh = std::numeric_limits<uint64_t>::max();
+  if (it != heights.end())
+    dh = *it - td.m_block_height;
+  if (it != heights.begin())
+    dh = std::min<uint64_t>(dh, td.m_block_height - *std::prev(it));
+  return get_height_relatedness(dh);
+}
+//----------------------------------------------------------------------------------------------------
+float wallet2::get_height_relatedness(uint64_t dh)
+{
   // same block height -> possibly tx burst, or same tx (since above is disabled)
-  dh = td0.m_block_height > td1.m_block_height ? td0.m_block_height - td1.m_block_height : td1.m_block_height - td0.m_block_height;
   if (dh == 0)
     return 0.9f;
 
@@ -2699,22 +3804,21 @@ float wallet2::get_output_relatedness(const transfer_details &td0, const transfe
 //----------------------------------------------------------------------------------------------------
 size_t wallet2::pop_best_value_from(const transfer_container &transfers, std::vector<size_t> &unused_indices, const std::list<size_t>& selected_transfers) const
 {
+  // index the selected outputs once, so each candidate is not compared to all of them
+  std::unordered_set<crypto::hash> selected_txids;
+  std::set<uint64_t> selected_heights;
+  for (size_t i: selected_transfers)
+  {
+    selected_txids.insert(transfers[i].m_txid);
+    selected_heights.insert(transfers[i].m_block_height);
+  }
+
   std::vector<size_t> candidates;
   float best_relatedness = 1.0f;
   for (size_t n = 0; n < unused_indices.size(); ++n)
   {
     const transfer_details &candidate = transfers[unused_indices[n]];
-    float relatedness = 0.0f;
-    for (std::list<size_t>::const_iterator i = selected_transfers.begin(); i != selected_transfers.end(); ++i)
-    {
-      float r = get_output_relatedness(candidate, transfers[*i]);
-      if (r > relatedness)
-      {
-        relatedness = r;
-        if (relatedness == 1.0f)
-          break;
-      }
-    }
+    float relatedness = get_output_relatedness(candidate, selected_txids, selected_heights);
 
     if (relatedness < best_relatedness)
     {
@@ -2936,9 +4040,9 @@ void wallet2::commit_tx(pending_tx& ptx)
   req.tx_as_hex = epee::string_tools::buff_to_hex_nodelimer(tx_to_blob(ptx.tx));
   req.do_not_relay = false;
   COMMAND_RPC_SEND_RAW_TX::response daemon_send_resp;
-  m_daemon_rpc_mutex.lock();
-  bool r = epee::net_utils::invoke_http_json_remote_command2(m_daemon_address + "/sendrawtransaction", req, daemon_send_resp, m_http_client, 200000);
-  m_daemon_rpc_mutex.unlock();
+  tools::http_client_pool::lease daemon(m_daemon_clients);
+  bool r = epee::net_utils::invoke_http_json_remote_command2(m_daemon_address + "/sendrawtransaction", req, daemon_send_resp, daemon.get(), 200000);
+  daemon.release();
   THROW_WALLET_EXCEPTION_IF(!r, error::no_connection_to_daemon, "sendrawtransaction");
   THROW_WALLET_EXCEPTION_IF(daemon_send_resp.status == CORE_RPC_STATUS_BUSY, error::daemon_busy, "sendrawtransaction");
   THROW_WALLET_EXCEPTION_IF(daemon_send_resp.status != CORE_RPC_STATUS_OK, error::tx_rejected, ptx.tx, daemon_send_resp.status, daemon_send_resp.reason);
@@ -2964,7 +4068,9 @@ void wallet2::commit_tx(pending_tx& ptx)
   add_unconfirmed_tx(ptx.tx, amount_in, dests, payment_id, ptx.change_dts.amount);
   if (store_tx_info())
   {
+    load_history();
     m_tx_keys.insert(std::make_pair(txid, ptx.tx_key));
+    m_journal_tx_keys.insert(txid);
   }
 
   LOG_PRINT_L2("transaction " << txid << " generated ok and sent to daemon, key_images: [" << ptx.key_images << "]");
@@ -3007,7 +4113,8 @@ bool wallet2::save_tx(const std::vector<pending_tx>& ptx_vector, const std::stri
   return epee::file_io_utils::save_string_to_file(filename, std::string(UNSIGNED_TX_PREFIX) + s);
 }
 //----------------------------------------------------------------------------------------------------
-bool wallet2::sign_tx(const std::string &unsigned_filename, const std::string &signed_filename, std::vector<wallet2::pending_tx> &txs, std::function<bool(const unsigned_tx_set&)> accept_func)
+bool wallet2::sign_tx(const std::string &unsigned_filename, const std::string &signed_filename, std::vector<wallet2::pending_tx> &txs, std::function<bool(const unsigned_tx_set&)> accept_func,
+  std::function<void(size_t, size_t)> progress_func)
 {
   std::string s;
   boost::system::error_code errcode;
@@ -3044,17 +4151,37 @@ bool wallet2::sign_tx(const std::string &unsigned_filename, const std::string &s
 
   import_outputs(exported_txs.transfers);
 
-  // sign the transactions
+  // sign the transactions; each one only depends on its own construction
+  // data, so the RingCT proofs are made in parallel, then the results are
+  // collected in order
+  const size_t count = exported_txs.txes.size();
   signed_tx_set signed_txes;
-  for (size_t n = 0; n < exported_txs.txes.size(); ++n)
+  signed_txes.ptx.resize(count);
+  std::vector<crypto::secret_key> tx_keys(count);
+  size_t signed_count = 0;
+  boost::mutex progress_lock;
+  tools::thread_group &pool = scan_pool();
+  tools::parallel_for(pool, 0, count, 1, [&] (size_t first, size_t last) {
+    for (size_t n = first; n < last; ++n)
+    {
+      const tools::wallet2::tx_construction_data &sd = exported_txs.txes[n];
+      LOG_PRINT_L1(" " << (n+1) << ": " << sd.sources.size() << " inputs, mixin " << (sd.sources[0].outputs.size()-1));
+      bool r = cryptonote::construct_tx_and_get_tx_key(m_account.get_keys(), sd.sources, sd.splitted_dsts, sd.extra, signed_txes.ptx[n].tx, sd.unlock_time, tx_keys[n], sd.use_rct, &pool);
+      THROW_WALLET_EXCEPTION_IF(!r, error::tx_not_constructed, sd.sources, sd.splitted_dsts, sd.unlock_time, m_testnet);
+      if (progress_func)
+      {
+        boost::unique_lock<boost::mutex> lock(progress_lock);
+        progress_func(++signed_count, count);
+      }
+    }
+    return true;
+  });
+
+  for (size_t n = 0; n < count; ++n)
   {
     const tools::wallet2::tx_construction_data &sd = exported_txs.txes[n];
-    LOG_PRINT_L1(" " << (n+1) << ": " << sd.sources.size() << " inputs, mixin " << (sd.sources[0].outputs.size()-1));
-    signed_txes.ptx.push_back(pending_tx());
-    tools::wallet2::pending_tx &ptx = signed_txes.ptx.back();
-    crypto::secret_key tx_key;
-    bool r = cryptonote::construct_tx_and_get_tx_key(m_account.get_keys(), sd.sources, sd.splitted_dsts, sd.extra, ptx.tx, sd.unlock_time, tx_key, sd.use_rct);
-    THROW_WALLET_EXCEPTION_IF(!r, error::tx_not_constructed, sd.sources, sd.splitted_dsts, sd.unlock_time, m_testnet);
+    tools::wallet2::pending_tx &ptx = signed_txes.ptx[n];
+    const crypto::secret_key &tx_key = tx_keys[n];
     // we don't test tx size, because we don't know the current limit, due to not having a blockchain,
     // and it's a bit pointless to fail there anyway, since it'd be a (good) guess only. We sign anyway,
     // and if we really go over limit, the daemon will reject when it gets submitted. Chances are it's
@@ -3066,7 +4193,9 @@ bool wallet2::sign_tx(const std::string &unsigned_filename, const std::string &s
     if (store_tx_info())
     {
       const crypto::hash txid = get_transaction_hash(ptx.tx);
+      load_history();
       m_tx_keys.insert(std::make_pair(txid, tx_key));
+      m_journal_tx_keys.insert(txid);
     }
 
     std::string key_images;
@@ -3102,10 +4231,8 @@ bool wallet2::sign_tx(const std::string &unsigned_filename, const std::string &s
     signed_txes.key_images[i] = m_transfers[i].m_key_image;
   }
 
-  s = obj_to_json_str(signed_txes);
-  if (s.empty())
-    return false;
-  LOG_PRINT_L2("Saving signed tx data: " << s);
+  // the json dump is only made when it is going to be logged
+  LOG_PRINT_L2("Saving signed tx data: " << obj_to_json_str(signed_txes));
   // save as binary as there's no implementation of loading a json_archive
   if (!::serialization::dump_binary(signed_txes, s))
     return false;
@@ -3155,6 +4282,7 @@ bool wallet2::load_tx(const std::string &signed_filename, std::vector<tools::wal
     LOG_PRINT_L1("More key images returned that we know outputs for");
     return false;
   }
+  m_journal_full_store = true;
   for (size_t i = 0; i < signed_txs.key_images.size(); ++i)
   {
     transfer_details &td = m_transfers[i];
@@ -3195,13 +4323,13 @@ uint64_t wallet2::get_dynamic_per_kb_fee_estimate()
   epee::json_rpc::request<cryptonote::COMMAND_RPC_GET_PER_KB_FEE_ESTIMATE::request> req_t = AUTO_VAL_INIT(req_t);
   epee::json_rpc::response<cryptonote::COMMAND_RPC_GET_PER_KB_FEE_ESTIMATE::response, std::string> resp_t = AUTO_VAL_INIT(resp_t);
 
-  m_daemon_rpc_mutex.lock();
+  tools::http_client_pool::lease daemon(m_daemon_clients);
   req_t.jsonrpc = "2.0";
   req_t.id = epee::serialization::storage_entry(0);
   req_t.method = "get_fee_estimate";
   req_t.params.grace_blocks = FEE_ESTIMATE_GRACE_BLOCKS;
-  bool r = net_utils::invoke_http_json_remote_command2(m_daemon_address + "/json_rpc", req_t, resp_t, m_http_client);
-  m_daemon_rpc_mutex.unlock();
+  bool r = net_utils::invoke_http_json_remote_command2(m_daemon_address + "/json_rpc", req_t, resp_t, daemon.get());
+  daemon.release();
   CHECK_AND_ASSERT_THROW_MES(r, "Failed to connect to daemon");
   CHECK_AND_ASSERT_THROW_MES(resp_t.result.status != CORE_RPC_STATUS_BUSY, "Failed to connect to daemon");
   CHECK_AND_ASSERT_THROW_MES(resp_t.result.status == CORE_RPC_STATUS_OK, "Failed to get fee estimate");
@@ -3338,12 +4466,17 @@ void wallet2::get_outs(std::vector<std::vector<entry>> &outs, const std::list<si
 {
   LOG_PRINT_L2("fake_outputs_count: " << fake_outputs_count);
   outs.clear();
+  if (fake_outputs_count > 0 && m_decoy_pool_size > 0 && get_pooled_outs(outs, selected_transfers, fake_outputs_count))
+  {
+    LOG_PRINT_L1("Took " << outs.size() << " rings from the decoy pool");
+    return;
+  }
   if (fake_outputs_count > 0)
   {
     // get histogram for the amounts we need
     epee::json_rpc::request<cryptonote::COMMAND_RPC_GET_OUTPUT_HISTOGRAM::request> req_t = AUTO_VAL_INIT(req_t);
     epee::json_rpc::response<cryptonote::COMMAND_RPC_GET_OUTPUT_HISTOGRAM::response, std::string> resp_t = AUTO_VAL_INIT(resp_t);
-    m_daemon_rpc_mutex.lock();
+    tools::http_client_pool::lease daemon(m_daemon_clients);
     req_t.jsonrpc = "2.0";
     req_t.id = epee::serialization::storage_entry(0);
     req_t.method = "get_output_histogram";
@@ -3354,8 +4487,8 @@ void wallet2::get_outs(std::vector<std::vector<entry>> &outs, const std::list<si
     req_t.params.amounts.resize(std::distance(req_t.params.amounts.begin(), end));
     req_t.params.unlocked = true;
     req_t.params.recent_cutoff = time(NULL) - RECENT_OUTPUT_ZONE;
-    bool r = net_utils::invoke_http_json_remote_command2(m_daemon_address + "/json_rpc", req_t, resp_t, m_http_client);
-    m_daemon_rpc_mutex.unlock();
+    bool r = net_utils::invoke_http_json_remote_command2(m_daemon_address + "/json_rpc", req_t, resp_t, daemon.get());
+    daemon.release();
     THROW_WALLET_EXCEPTION_IF(!r, error::no_connection_to_daemon, "transfer_selected");
     THROW_WALLET_EXCEPTION_IF(resp_t.result.status == CORE_RPC_STATUS_BUSY, error::daemon_busy, "get_output_histogram");
     THROW_WALLET_EXCEPTION_IF(resp_t.result.status != CORE_RPC_STATUS_OK, error::get_histogram_error, resp_t.result.status);
@@ -3440,24 +4573,12 @@ void wallet2::get_outs(std::vector<std::vector<entry>> &outs, const std::list<si
           uint64_t i;
           if (num_found - 1 < recent_outputs_count) // -1 to account for the real one we seeded with
           {
-            // equiprobable distribution over the recent outs
-            uint64_t r = crypto::rand<uint64_t>() % ((uint64_t)1 << 53);
-            double frac = std::sqrt((double)r / ((uint64_t)1 << 53));
-            i = (uint64_t)(frac*num_recent_outs) + num_outs - num_recent_outs;
-            // just in case rounding up to 1 occurs after calc
-            if (i == num_outs)
-              --i;
+            i = pick_recent_output(num_outs, num_recent_outs);
             LOG_PRINT_L2("picking " << i << " as recent");
           }
           else
           {
-            // triangular distribution over [a,b) with a=0, mode c=b=up_index_limit
-            uint64_t r = crypto::rand<uint64_t>() % ((uint64_t)1 << 53);
-            double frac = std::sqrt((double)r / ((uint64_t)1 << 53));
-            i = (uint64_t)(frac*num_outs);
-            // just in case rounding up to 1 occurs after calc
-            if (i == num_outs)
-              --i;
+            i = pick_triangular_output(num_outs);
             LOG_PRINT_L2("picking " << i << " as triangular");
           }
 
@@ -3479,9 +4600,9 @@ void wallet2::get_outs(std::vector<std::vector<entry>> &outs, const std::list<si
       LOG_PRINT_L1("asking for output " << i.index << " for " << print_money(i.amount));
 
     // get the keys for those
-    m_daemon_rpc_mutex.lock();
-    r = epee::net_utils::invoke_http_bin_remote_command2(m_daemon_address + "/get_outs.bin", req, daemon_resp, m_http_client, 200000);
-    m_daemon_rpc_mutex.unlock();
+    tools::http_client_pool::lease outs_daemon(m_daemon_clients);
+    r = epee::net_utils::invoke_http_bin_remote_command2(m_daemon_address + "/get_outs.bin", req, daemon_resp, outs_daemon.get(), 200000);
+    outs_daemon.release();
     THROW_WALLET_EXCEPTION_IF(!r, error::no_connection_to_daemon, "get_outs.bin");
     THROW_WALLET_EXCEPTION_IF(daemon_resp.status == CORE_RPC_STATUS_BUSY, error::daemon_busy, "get_outs.bin");
     THROW_WALLET_EXCEPTION_IF(daemon_resp.status != CORE_RPC_STATUS_OK, error::get_random_outs_error, daemon_resp.status);
@@ -3501,7 +4622,7 @@ void wallet2::get_outs(std::vector<std::vector<entry>> &outs, const std::list<si
       const rct::key mask = td.is_rct() ? rct::commit(td.amount(), td.m_mask) : rct::zeroCommit(td.amount());
 
       // pick real out first (it will be sorted when done)
-      outs.back().push_back(std::make_tuple(td.m_global_output_index, boost::get<txout_to_key>(td.m_tx.vout[td.m_internal_output_index].target).key, mask));
+      outs.back().push_back(std::make_tuple(td.m_global_output_index, td.get_public_key(), mask));
 
       // then pick others in random order till we reach the required number
       // since we use an equiprobable pick here, we don't upset the triangular distribution
@@ -3545,12 +4666,200 @@ void wallet2::get_outs(std::vector<std::vector<entry>> &outs, const std::list<si
       const transfer_details &td = m_transfers[idx];
       std::vector<entry> v;
       const rct::key mask = td.is_rct() ? rct::commit(td.amount(), td.m_mask) : rct::zeroCommit(td.amount());
-      v.push_back(std::make_tuple(td.m_global_output_index, boost::get<txout_to_key>(td.m_tx.vout[td.m_internal_output_index].target).key, mask));
+      v.push_back(std::make_tuple(td.m_global_output_index, td.get_public_key(), mask));
       outs.push_back(v);
     }
   }
 }
 
+template<typename entry>
+bool wallet2::get_pooled_outs(std::vector<std::vector<entry>> &outs, const std::list<size_t> &selected_transfers, size_t fake_outputs_count)
+{
+  for (size_t idx: selected_transfers)
+    if (!m_transfers[idx].is_rct())
+      return false;
+
+  boost::lock_guard<boost::mutex> lock(m_decoy_pool_mutex);
+  if (m_decoy_pool.recent.empty() && m_decoy_pool.older.empty())
+    return false;
+
+  // taken from copies, so a pool running short is left as it was
+  std::deque<decoy_pool_t::decoy> recent = m_decoy_pool.recent, older = m_decoy_pool.older;
+  const time_t cutoff = time(NULL) - DECOY_POOL_MAX_AGE;
+  std::vector<std::vector<entry>> pooled_outs;
+  pooled_outs.reserve(selected_transfers.size());
+  for (size_t idx: selected_transfers)
+  {
+    const transfer_details &td = m_transfers[idx];
+    pooled_outs.push_back(std::vector<entry>());
+    std::vector<entry> &ring = pooled_outs.back();
+    ring.reserve(fake_outputs_count + 1);
+    const rct::key mask = rct::commit(td.amount(), td.m_mask);
+    ring.push_back(std::make_tuple(td.m_global_output_index, td.get_public_key(), mask));
+
+    // the same share of recent outputs get_outs would pick
+    size_t recent_outputs_count = std::max<size_t>((fake_outputs_count + 1) * RECENT_OUTPUT_RATIO, 1);
+    if (td.m_global_output_index >= m_decoy_pool.num_outs - m_decoy_pool.num_recent_outs && recent_outputs_count > 0)
+      --recent_outputs_count; // if the real out is recent, pick one less recent fake out
+    recent_outputs_count = std::min(recent_outputs_count, fake_outputs_count);
+
+    const auto take = [&](std::deque<decoy_pool_t::decoy> &from, size_t count) {
+      while (ring.size() < count + 1 && !from.empty())
+      {
+        const decoy_pool_t::decoy d = from.front();
+        from.pop_front();
+        if (d.fetched < cutoff || d.index == td.m_global_output_index)
+          continue;
+        if (std::find_if(ring.begin(), ring.end(), [&](const entry &e) { return std::get<0>(e) == d.index; }) != ring.end())
+          continue;
+        ring.push_back(std::make_tuple(d.index, d.key, d.mask));
+      }
+    };
+    take(recent, recent_outputs_count);
+    take(older, fake_outputs_count);
+    take(recent, fake_outputs_count);
+    if (ring.size() < fake_outputs_count + 1)
+    {
+      LOG_PRINT_L1("Decoy pool ran short, asking the daemon");
+      return false;
+    }
+    std::sort(ring.begin(), ring.end(), [](const entry &a, const entry &b) { return std::get<0>(a) < std::get<0>(b); });
+  }
+
+  m_decoy_pool.recent.swap(recent);
+  m_decoy_pool.older.swap(older);
+  outs.swap(pooled_outs);
+  return true;
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::decoy_pool_size(uint32_t size)
+{
+  m_decoy_pool_size = std::min<uint32_t>(size, WALLET_DECOY_POOL_SIZE_MAX);
+  if (m_decoy_pool_size == 0)
+  {
+    boost::lock_guard<boost::mutex> lock(m_decoy_pool_mutex);
+    m_decoy_pool.recent.clear();
+    m_decoy_pool.older.clear();
+  }
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::refill_decoy_pool()
+{
+  const size_t size = m_decoy_pool_size;
+  if (size == 0)
+    return;
+  const size_t recent_size = std::max<size_t>(size * RECENT_OUTPUT_RATIO, 1);
+  const size_t older_size = std::max<size_t>(size - recent_size, 1);
+
+  // drop what is too old to use, and leave out what is left from the new picks
+  size_t recent_needed, older_needed;
+  std::unordered_set<uint64_t> seen_indices;
+  {
+    boost::lock_guard<boost::mutex> lock(m_decoy_pool_mutex);
+    const time_t cutoff = time(NULL) - DECOY_POOL_MAX_AGE;
+    for (std::deque<decoy_pool_t::decoy> *pool: {&m_decoy_pool.recent, &m_decoy_pool.older})
+    {
+      while (!pool->empty() && pool->front().fetched < cutoff)
+        pool->pop_front();
+      for (const decoy_pool_t::decoy &d: *pool)
+        seen_indices.insert(d.index);
+    }
+    recent_needed = recent_size - std::min(recent_size, m_decoy_pool.recent.size());
+    older_needed = older_size - std::min(older_size, m_decoy_pool.older.size());
+  }
+  if (recent_needed == 0 && older_needed == 0)
+    return;
+
+  epee::json_rpc::request<cryptonote::COMMAND_RPC_GET_OUTPUT_HISTOGRAM::request> req_t = AUTO_VAL_INIT(req_t);
+  epee::json_rpc::response<cryptonote::COMMAND_RPC_GET_OUTPUT_HISTOGRAM::response, std::string> resp_t = AUTO_VAL_INIT(resp_t);
+  req_t.jsonrpc = "2.0";
+  req_t.id = epee::serialization::storage_entry(0);
+  req_t.method = "get_output_histogram";
+  req_t.params.amounts.push_back(0);
+  req_t.params.unlocked = true;
+  req_t.params.recent_cutoff = time(NULL) - RECENT_OUTPUT_ZONE;
+  tools::http_client_pool::lease daemon(m_daemon_clients);
+  bool r = net_utils::invoke_http_json_remote_command2(m_daemon_address + "/json_rpc", req_t, resp_t, daemon.get());
+  daemon.release();
+  THROW_WALLET_EXCEPTION_IF(!r, error::no_connection_to_daemon, "get_output_histogram");
+  THROW_WALLET_EXCEPTION_IF(resp_t.result.status == CORE_RPC_STATUS_BUSY, error::daemon_busy, "get_output_histogram");
+  THROW_WALLET_EXCEPTION_IF(resp_t.result.status != CORE_RPC_STATUS_OK, error::get_histogram_error, resp_t.result.status);
+
+  uint64_t num_outs = 0, num_recent_outs = 0;
+  for (const auto &he: resp_t.result.histogram)
+  {
+    if (he.amount == 0)
+    {
+      num_outs = he.unlocked_instances;
+      num_recent_outs = std::min(he.recent_instances, num_outs);
+      break;
+    }
+  }
+  if (num_outs == 0)
+    return;
+
+  // with few outputs to pick from, repeats can leave the pool short, get_outs covers for it
+  COMMAND_RPC_GET_OUTPUTS_BIN::request req = AUTO_VAL_INIT(req);
+  COMMAND_RPC_GET_OUTPUTS_BIN::response daemon_resp = AUTO_VAL_INIT(daemon_resp);
+  std::vector<bool> recent_pick;
+  const auto pick = [&](size_t count, bool recent) {
+    for (size_t n = 0, attempts = 0; n < count && attempts < 10 * count; ++attempts)
+    {
+      const uint64_t i = recent ? pick_recent_output(num_outs, num_recent_outs) : pick_triangular_output(num_outs);
+      if (!seen_indices.insert(i).second)
+        continue;
+      req.outputs.push_back({0, i});
+      recent_pick.push_back(recent);
+      ++n;
+    }
+  };
+  if (num_recent_outs > 0)
+    pick(recent_needed, true);
+  pick(older_needed, false);
+  if (req.outputs.empty())
+    return;
+
+  // the daemon sees the picks sorted, not which are recent ones
+  std::vector<size_t> order(req.outputs.size());
+  for (size_t n = 0; n < order.size(); ++n)
+    order[n] = n;
+  std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return req.outputs[a].index < req.outputs[b].index; });
+  COMMAND_RPC_GET_OUTPUTS_BIN::request sorted_req = AUTO_VAL_INIT(sorted_req);
+  for (size_t n: order)
+    sorted_req.outputs.push_back(req.outputs[n]);
+
+  tools::http_client_pool::lease outs_daemon(m_daemon_clients);
+  r = epee::net_utils::invoke_http_bin_remote_command2(m_daemon_address + "/get_outs.bin", sorted_req, daemon_resp, outs_daemon.get(), 200000);
+  outs_daemon.release();
+  THROW_WALLET_EXCEPTION_IF(!r, error::no_connection_to_daemon, "get_outs.bin");
+  THROW_WALLET_EXCEPTION_IF(daemon_resp.status == CORE_RPC_STATUS_BUSY, error::daemon_busy, "get_outs.bin");
+  THROW_WALLET_EXCEPTION_IF(daemon_resp.status != CORE_RPC_STATUS_OK, error::get_random_outs_error, daemon_resp.status);
+  THROW_WALLET_EXCEPTION_IF(daemon_resp.outs.size() != sorted_req.outputs.size(), error::wallet_internal_error,
+    "daemon returned wrong response for get_outs.bin, wrong amounts count = " +
+    std::to_string(daemon_resp.outs.size()) + ", expected " +  std::to_string(sorted_req.outputs.size()));
+
+  // back in pick order, so consecutive pooled outputs are not close in index
+  std::vector<decoy_pool_t::decoy> recent, older;
+  const time_t now = time(NULL);
+  std::vector<size_t> position(order.size());
+  for (size_t n = 0; n < order.size(); ++n)
+    position[order[n]] = n;
+  for (size_t n = 0; n < req.outputs.size(); ++n)
+  {
+    const auto &out = daemon_resp.outs[position[n]];
+    if (!out.unlocked) // locked ones are picked again at the next refill
+      continue;
+    (recent_pick[n] ? recent : older).push_back({req.outputs[n].index, out.key, out.mask, now});
+  }
+
+  boost::lock_guard<boost::mutex> lock(m_decoy_pool_mutex);
+  m_decoy_pool.recent.insert(m_decoy_pool.recent.end(), recent.begin(), recent.end());
+  m_decoy_pool.older.insert(m_decoy_pool.older.end(), older.begin(), older.end());
+  m_decoy_pool.num_outs = num_outs;
+  m_decoy_pool.num_recent_outs = num_recent_outs;
+  LOG_PRINT_L2("Decoy pool refilled to " << m_decoy_pool.recent.size() << " recent and " << m_decoy_pool.older.size() << " other outputs");
+}
+
 template<typename T>
 void wallet2::transfer_selected(const std::vector<cryptonote::tx_destination_entry>& dsts, const std::list<size_t> selected_transfers, size_t fake_outputs_count,
   uint64_t unlock_time, uint64_t fee, const std::vector<uint8_t>& extra, T destination_split_strategy, const tx_dust_policy& dust_policy, cryptonote::transaction& tx, pending_tx &ptx)
@@ -3620,10 +4929,10 @@ void wallet2::transfer_selected(const std::vector<cryptonote::tx_destination_ent
 
     tx_output_entry real_oe;
     real_oe.first = td.m_global_output_index;
-    real_oe.second.dest = rct::pk2rct(boost::get<txout_to_key>(td.m_tx.vout[td.m_internal_output_index].target).key);
+    real_oe.second.dest = rct::pk2rct(td.get_public_key());
     real_oe.second.mask = rct::commit(td.amount(), td.m_mask);
     *it_to_replace = real_oe;
-    src.real_out_tx_key = get_tx_pub_key_from_extra(td.m_tx, td.m_pk_index);
+    src.real_out_tx_key = td.m_tx_pub_key;
     src.real_output = it_to_replace - src.outputs.begin();
     src.real_output_in_tx_index = td.m_internal_output_index;
     detail::print_source_entry(src);
@@ -3692,11 +5001,23 @@ void wallet2::transfer_selected(const std::vector<cryptonote::tx_destination_ent
 void wallet2::transfer_selected_rct(std::vector<cryptonote::tx_destination_entry> dsts, const std::list<size_t> selected_transfers, size_t fake_outputs_count,
   uint64_t unlock_time, uint64_t fee, const std::vector<uint8_t>& extra, cryptonote::transaction& tx, pending_tx &ptx)
 {
-  using namespace cryptonote;
   // throw if attempting a transaction with no destinations
   THROW_WALLET_EXCEPTION_IF(dsts.empty(), error::zero_destination);
 
   uint64_t upper_transaction_size_limit = get_upper_tranaction_size_limit();
+  std::vector<std::vector<rct_ring_entry>> outs;
+  get_outs(outs, selected_transfers, fake_outputs_count); // may throw
+
+  construct_tx_rct(dsts, selected_transfers, outs, fake_outputs_count, unlock_time, fee, extra, upper_transaction_size_limit, tx, ptx, &scan_pool());
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::construct_tx_rct(const std::vector<cryptonote::tx_destination_entry> &dsts, const std::list<size_t> &selected_transfers, const std::vector<std::vector<rct_ring_entry>> &outs,
+  size_t fake_outputs_count, uint64_t unlock_time, uint64_t fee, const std::vector<uint8_t>& extra, uint64_t upper_transaction_size_limit, cryptonote::transaction& tx, pending_tx &ptx, tools::thread_group *threads) const
+{
+  using namespace cryptonote;
+  THROW_WALLET_EXCEPTION_IF(dsts.empty(), error::zero_destination);
+  THROW_WALLET_EXCEPTION_IF(outs.size() != selected_transfers.size(), error::wallet_internal_error, "rings do not match the selected transfers");
+
   uint64_t needed_money = fee;
   LOG_PRINT_L2("transfer: starting with fee " << print_money (needed_money));
   LOG_PRINT_L0("selected transfers: ");
@@ -3722,10 +5043,6 @@ void wallet2::transfer_selected_rct(std::vector<cryptonote::tx_destination_entry
   LOG_PRINT_L2("wanted " << print_money(needed_money) << ", found " << print_money(found_money) << ", fee " << print_money(fee));
   THROW_WALLET_EXCEPTION_IF(found_money < needed_money, error::not_enough_money, found_money, needed_money - fee, fee);
 
-  typedef std::tuple<uint64_t, crypto::public_key, rct::key> entry;
-  std::vector<std::vector<entry>> outs;
-  get_outs(outs, selected_transfers, fake_outputs_count); // may throw
-
   //prepare inputs
   size_t i = 0, out_index = 0;
   std::vector<cryptonote::tx_source_entry> sources;
@@ -3759,10 +5076,10 @@ void wallet2::transfer_selected_rct(std::vector<cryptonote::tx_destination_entry
 
     tx_output_entry real_oe;
     real_oe.first = td.m_global_output_index;
-    real_oe.second.dest = rct::pk2rct(boost::get<txout_to_key>(td.m_tx.vout[td.m_internal_output_index].target).key);
+    real_oe.second.dest = rct::pk2rct(td.get_public_key());
     real_oe.second.mask = rct::commit(td.amount(), td.m_mask);
     *it_to_replace = real_oe;
-    src.real_out_tx_key = get_tx_pub_key_from_extra(td.m_tx, td.m_pk_index);
+    src.real_out_tx_key = td.m_tx_pub_key;
     src.real_output = it_to_replace - src.outputs.begin();
     src.real_output_in_tx_index = td.m_internal_output_index;
     src.mask = td.m_mask;
@@ -3791,7 +5108,7 @@ void wallet2::transfer_selected_rct(std::vector<cryptonote::tx_destination_entry
   splitted_dsts.push_back(change_dts);
 
   crypto::secret_key tx_key;
-  bool r = cryptonote::construct_tx_and_get_tx_key(m_account.get_keys(), sources, splitted_dsts, extra, tx, unlock_time, tx_key, true);
+  bool r = cryptonote::construct_tx_and_get_tx_key(m_account.get_keys(), sources, splitted_dsts, extra, tx, unlock_time, tx_key, true, threads);
   THROW_WALLET_EXCEPTION_IF(!r, error::tx_not_constructed, sources, dsts, unlock_time, m_testnet);
   THROW_WALLET_EXCEPTION_IF(upper_transaction_size_limit <= get_object_blobsize(tx), error::tx_too_big, tx, upper_transaction_size_limit);
 
@@ -3875,11 +5192,12 @@ std::vector<size_t> wallet2::pick_preferred_rct_inputs(uint64_t needed_money) co
 
   LOG_PRINT_L2("pick_preferred_rct_inputs: needed_money " << print_money(needed_money));
 
-  // try to find a rct input of enough size
-  for (size_t i = 0; i < m_transfers.size(); ++i)
+  // try to find a rct input of enough size, the smallest one
+  for (auto it = m_unspent_by_amount.lower_bound(std::make_pair(needed_money, (size_t)0)); it != m_unspent_by_amount.end(); ++it)
   {
+    const size_t i = it->second;
     const transfer_details& td = m_transfers[i];
-    if (!td.m_spent && td.is_rct() && td.amount() >= needed_money && is_transfer_unlocked(td))
+    if (td.is_rct() && is_transfer_unlocked(td))
     {
       LOG_PRINT_L2("We can use " << i << " alone: " << print_money(td.amount()));
       picks.push_back(i);
@@ -3891,16 +5209,24 @@ std::vector<size_t> wallet2::pick_preferred_rct_inputs(uint64_t needed_money) co
   // this could be made better by picking one of the outputs to be a small one, since those
   // are less useful since often below the needed money, so if one can be used in a pair,
   // it gets rid of it for the future
-  for (size_t i = 0; i < m_transfers.size(); ++i)
+  // each pair is met once, from its larger output, and only with the smaller
+  // outputs large enough to make up the rest
+  for (auto it = m_unspent_by_amount.rbegin(); it != m_unspent_by_amount.rend(); ++it)
   {
+    const size_t i = it->second;
     const transfer_details& td = m_transfers[i];
-    if (!td.m_spent && td.is_rct() && is_transfer_unlocked(td))
+    const uint64_t rest = td.amount() < needed_money ? needed_money - td.amount() : 0;
+    if (td.amount() < rest)
+      break;
+    if (td.is_rct() && is_transfer_unlocked(td))
     {
       LOG_PRINT_L2("Considering input " << i << ", " << print_money(td.amount()));
-      for (size_t j = i + 1; j < m_transfers.size(); ++j)
+      const auto end = std::prev(it.base());
+      for (auto it2 = m_unspent_by_amount.lower_bound(std::make_pair(rest, (size_t)0)); it2 != end; ++it2)
       {
+        const size_t j = it2->second;
         const transfer_details& td2 = m_transfers[j];
-        if (!td2.m_spent && td2.is_rct() && td.amount() + td2.amount() >= needed_money && is_transfer_unlocked(td2))
+        if (td2.is_rct() && is_transfer_unlocked(td2))
         {
           // update our picks if those outputs are less related than any we
           // already found. If the same, don't update, and oldest suitable outputs
@@ -3955,6 +5281,7 @@ std::vector<wallet2::pending_tx> wallet2::create_transactions_2(std::vector<cryp
     cryptonote::transaction tx;
     pending_tx ptx;
     size_t bytes;
+    uint64_t fee; // rct txes are built with it after all inputs are picked
 
     void add(const account_public_address &addr, uint64_t amount) {
       std::vector<cryptonote::tx_destination_entry>::iterator i;
@@ -3993,10 +5320,11 @@ std::vector<wallet2::pending_tx> wallet2::create_transactions_2(std::vector<cryp
   THROW_WALLET_EXCEPTION_IF(needed_money == 0, error::zero_destination);
 
   // gather all our dust and non dust outputs
-  for (size_t i = 0; i < m_transfers.size(); ++i)
+  for (const auto &unspent: m_unspent_by_amount)
   {
+    const size_t i = unspent.second;
     const transfer_details& td = m_transfers[i];
-    if (!td.m_spent && (use_rct ? true : !td.is_rct()) && is_transfer_unlocked(td))
+    if ((use_rct ? true : !td.is_rct()) && is_transfer_unlocked(td))
     {
       if ((td.is_rct()) || is_valid_decomposed_amount(td.amount()))
         unused_transfers_indices.push_back(i);
@@ -4165,20 +5493,24 @@ std::vector<wallet2::pending_tx> wallet2::create_transactions_2(std::vector<cryp
       {
         LOG_PRINT_L2("We made a tx, adjusting fee and saving it");
         if (use_rct)
-          transfer_selected_rct(tx.dsts, tx.selected_transfers, fake_outs_count, unlock_time, needed_fee, extra,
-            test_tx, test_ptx);
+        {
+          tx.fee = needed_fee;
+          accumulated_fee += needed_fee;
+        }
         else
+        {
           transfer_selected(tx.dsts, tx.selected_transfers, fake_outs_count, unlock_time, needed_fee, extra,
             detail::digit_split_strategy, tx_dust_policy(::config::DEFAULT_DUST_THRESHOLD), test_tx, test_ptx);
-        txBlob = t_serializable_object_to_blob(test_ptx.tx);
-        LOG_PRINT_L2("Made a final " << ((txBlob.size() + 1023)/1024) << " kB tx, with " << print_money(test_ptx.fee) <<
-          " fee  and " << print_money(test_ptx.change_dts.amount) << " change");
-
-        tx.tx = test_tx;
-        tx.ptx = test_ptx;
-        tx.bytes = txBlob.size();
-        accumulated_fee += test_ptx.fee;
-        accumulated_change += test_ptx.change_dts.amount;
+          txBlob = t_serializable_object_to_blob(test_ptx.tx);
+          LOG_PRINT_L2("Made a final " << ((txBlob.size() + 1023)/1024) << " kB tx, with " << print_money(test_ptx.fee) <<
+            " fee  and " << print_money(test_ptx.change_dts.amount) << " change");
+
+          tx.tx = test_tx;
+          tx.ptx = test_ptx;
+          tx.bytes = txBlob.size();
+          accumulated_fee += test_ptx.fee;
+          accumulated_change += test_ptx.change_dts.amount;
+        }
         adding_fee = false;
         if (!dsts.empty())
         {
@@ -4195,6 +5527,48 @@ std::vector<wallet2::pending_tx> wallet2::create_transactions_2(std::vector<cryp
     THROW_WALLET_EXCEPTION_IF(1, error::tx_not_possible, unlocked_balance(), needed_money, accumulated_fee + needed_fee);
   }
 
+  if (use_rct)
+  {
+    // the final txes only differ from the test ones by their fee: fetch the
+    // rings of all of them in one call, and build them on the pool, as the
+    // range proofs take most of the time
+    std::list<size_t> all_selected_transfers;
+    for (const TX &tx: txes)
+      all_selected_transfers.insert(all_selected_transfers.end(), tx.selected_transfers.begin(), tx.selected_transfers.end());
+    std::vector<std::vector<rct_ring_entry>> all_outs;
+    get_outs(all_outs, all_selected_transfers, fake_outs_count); // may throw
+    THROW_WALLET_EXCEPTION_IF(all_outs.size() != all_selected_transfers.size(), error::wallet_internal_error, "rings do not match the selected transfers");
+
+    std::vector<std::vector<std::vector<rct_ring_entry>>> outs(txes.size());
+    auto next_outs = all_outs.begin();
+    for (size_t i = 0; i < txes.size(); ++i)
+    {
+      auto end = next_outs + txes[i].selected_transfers.size();
+      outs[i].assign(std::make_move_iterator(next_outs), std::make_move_iterator(end));
+      next_outs = end;
+    }
+
+    // the first tx that fails to build throws from here
+    tools::thread_group &pool = scan_pool();
+    tools::parallel_for(pool, 0, txes.size(), 1, [&] (size_t first, size_t last) {
+      for (size_t i = first; i < last; ++i)
+      {
+        TX &tx = txes[i];
+        construct_tx_rct(tx.dsts, tx.selected_transfers, outs[i], fake_outs_count, unlock_time, tx.fee, extra,
+          upper_transaction_size_limit, tx.tx, tx.ptx, &pool);
+      }
+      return true;
+    });
+
+    for (TX &tx: txes)
+    {
+      tx.bytes = get_object_blobsize(tx.ptx.tx);
+      LOG_PRINT_L2("Made a final " << ((tx.bytes + 1023)/1024) << " kB tx, with " << print_money(tx.ptx.fee) <<
+        " fee  and " << print_money(tx.ptx.change_dts.amount) << " change");
+      accumulated_change += tx.ptx.change_dts.amount;
+    }
+  }
+
   LOG_PRINT_L1("Done creating " << txes.size() << " transactions, " << print_money(accumulated_fee) <<
     " total fee, " << print_money(accumulated_change) << " total change");
 
@@ -4223,10 +5597,11 @@ std::vector<wallet2::pending_tx> wallet2::create_transactions_all(const cryptono
   const bool use_rct = use_fork_rules(4, 0);
 
   // gather all our dust and non dust outputs
-  for (size_t i = 0; i < m_transfers.size(); ++i)
+  for (const auto &unspent: m_unspent_by_amount)
   {
+    const size_t i = unspent.second;
     const transfer_details& td = m_transfers[i];
-    if (!td.m_spent && (use_rct ? true : !td.is_rct()) && is_transfer_unlocked(td))
+    if ((use_rct ? true : !td.is_rct()) && is_transfer_unlocked(td))
     {
       if (td.is_rct() || is_valid_decomposed_amount(td.amount()))
         unused_transfers_indices.push_back(i);
@@ -4392,13 +5767,13 @@ void wallet2::get_hard_fork_info(uint8_t version, uint64_t &earliest_height)
   epee::json_rpc::request<cryptonote::COMMAND_RPC_HARD_FORK_INFO::request> req_t = AUTO_VAL_INIT(req_t);
   epee::json_rpc::response<cryptonote::COMMAND_RPC_HARD_FORK_INFO::response, std::string> resp_t = AUTO_VAL_INIT(resp_t);
 
-  m_daemon_rpc_mutex.lock();
+  tools::http_client_pool::lease daemon(m_daemon_clients);
   req_t.jsonrpc = "2.0";
   req_t.id = epee::serialization::storage_entry(0);
   req_t.method = "hard_fork_info";
   req_t.params.version = version;
-  bool r = net_utils::invoke_http_json_remote_command2(m_daemon_address + "/json_rpc", req_t, resp_t, m_http_client);
-  m_daemon_rpc_mutex.unlock();
+  bool r = net_utils::invoke_http_json_remote_command2(m_daemon_address + "/json_rpc", req_t, resp_t, daemon.get());
+  daemon.release();
   CHECK_AND_ASSERT_THROW_MES(r, "Failed to connect to daemon");
   CHECK_AND_ASSERT_THROW_MES(resp_t.result.status != CORE_RPC_STATUS_BUSY, "Failed to connect to daemon");
   CHECK_AND_ASSERT_THROW_MES(resp_t.result.status == CORE_RPC_STATUS_OK, "Failed to get hard fork status");
@@ -4411,9 +5786,9 @@ bool wallet2::use_fork_rules(uint8_t version, int64_t early_blocks)
   cryptonote::COMMAND_RPC_GET_HEIGHT::request req = AUTO_VAL_INIT(req);
   cryptonote::COMMAND_RPC_GET_HEIGHT::response res = AUTO_VAL_INIT(res);
 
-  m_daemon_rpc_mutex.lock();
-  bool r = net_utils::invoke_http_json_remote_command2(m_daemon_address + "/getheight", req, res, m_http_client);
-  m_daemon_rpc_mutex.unlock();
+  tools::http_client_pool::lease daemon(m_daemon_clients);
+  bool r = net_utils::invoke_http_json_remote_command2(m_daemon_address + "/getheight", req, res, daemon.get());
+  daemon.release();
   CHECK_AND_ASSERT_MES(r, false, "Failed to connect to daemon");
   CHECK_AND_ASSERT_MES(res.status != CORE_RPC_STATUS_BUSY, false, "Failed to connect to daemon");
   CHECK_AND_ASSERT_MES(res.status == CORE_RPC_STATUS_OK, false, "Failed to get current blockchain height");
@@ -4474,7 +5849,7 @@ std::vector<size_t> wallet2::select_available_outputs_from_histogram(uint64_t co
 {
   epee::json_rpc::request<cryptonote::COMMAND_RPC_GET_OUTPUT_HISTOGRAM::request> req_t = AUTO_VAL_INIT(req_t);
   epee::json_rpc::response<cryptonote::COMMAND_RPC_GET_OUTPUT_HISTOGRAM::response, std::string> resp_t = AUTO_VAL_INIT(resp_t);
-  m_daemon_rpc_mutex.lock();
+  tools::http_client_pool::lease daemon(m_daemon_clients);
   req_t.jsonrpc = "2.0";
   req_t.id = epee::serialization::storage_entry(0);
   req_t.method = "get_output_histogram";
@@ -4483,8 +5858,8 @@ std::vector<size_t> wallet2::select_available_outputs_from_histogram(uint64_t co
   req_t.params.min_count = count;
   req_t.params.max_count = 0;
   req_t.params.unlocked = unlocked;
-  bool r = net_utils::invoke_http_json_remote_command2(m_daemon_address + "/json_rpc", req_t, resp_t, m_http_client);
-  m_daemon_rpc_mutex.unlock();
+  bool r = net_utils::invoke_http_json_remote_command2(m_daemon_address + "/json_rpc", req_t, resp_t, daemon.get());
+  daemon.release();
   THROW_WALLET_EXCEPTION_IF(!r, error::no_connection_to_daemon, "select_available_unmixable_outputs");
   THROW_WALLET_EXCEPTION_IF(resp_t.result.status == CORE_RPC_STATUS_BUSY, error::daemon_busy, "get_output_histogram");
   THROW_WALLET_EXCEPTION_IF(resp_t.result.status != CORE_RPC_STATUS_OK, error::get_histogram_error, resp_t.result.status);
@@ -4515,15 +5890,15 @@ uint64_t wallet2::get_num_rct_outputs()
 {
   epee::json_rpc::request<cryptonote::COMMAND_RPC_GET_OUTPUT_HISTOGRAM::request> req_t = AUTO_VAL_INIT(req_t);
   epee::json_rpc::response<cryptonote::COMMAND_RPC_GET_OUTPUT_HISTOGRAM::response, std::string> resp_t = AUTO_VAL_INIT(resp_t);
-  m_daemon_rpc_mutex.lock();
+  tools::http_client_pool::lease daemon(m_daemon_clients);
   req_t.jsonrpc = "2.0";
   req_t.id = epee::serialization::storage_entry(0);
   req_t.method = "get_output_histogram";
   req_t.params.amounts.push_back(0);
   req_t.params.min_count = 0;
   req_t.params.max_count = 0;
-  bool r = net_utils::invoke_http_json_remote_command2(m_daemon_address + "/json_rpc", req_t, resp_t, m_http_client);
-  m_daemon_rpc_mutex.unlock();
+  bool r = net_utils::invoke_http_json_remote_command2(m_daemon_address + "/json_rpc", req_t, resp_t, daemon.get());
+  daemon.release();
   THROW_WALLET_EXCEPTION_IF(!r, error::no_connection_to_daemon, "get_num_rct_outputs");
   THROW_WALLET_EXCEPTION_IF(resp_t.result.status == CORE_RPC_STATUS_BUSY, error::daemon_busy, "get_output_histogram");
   THROW_WALLET_EXCEPTION_IF(resp_t.result.status != CORE_RPC_STATUS_OK, error::get_histogram_error, resp_t.result.status);
@@ -4539,6 +5914,40 @@ const wallet2::transfer_details &wallet2::get_transfer_details(size_t idx) const
   return m_transfers[idx];
 }
 //----------------------------------------------------------------------------------------------------
+bool wallet2::get_tx_blobs(const std::vector<crypto::hash> &txids, std::unordered_map<crypto::hash, cryptonote::blobdata> &blobs)
+{
+  blobs.clear();
+  if (txids.empty())
+    return true;
+
+  cryptonote::COMMAND_RPC_GET_TRANSACTIONS::request req;
+  cryptonote::COMMAND_RPC_GET_TRANSACTIONS::response res;
+  for (const crypto::hash &txid: txids)
+    req.txs_hashes.push_back(epee::string_tools::pod_to_hex(txid));
+  req.decode_as_json = false;
+  tools::http_client_pool::lease daemon(m_daemon_clients);
+  bool r = epee::net_utils::invoke_http_json_remote_command2(m_daemon_address + "/gettransactions", req, res, daemon.get(), 200000);
+  daemon.release();
+  if (!r || res.status != CORE_RPC_STATUS_OK)
+  {
+    LOG_PRINT_L1("Error calling gettransactions daemon RPC: r " << r << ", status " << res.status);
+    return false;
+  }
+
+  for (const auto &e: res.txs)
+  {
+    crypto::hash txid;
+    cryptonote::blobdata bd;
+    if (!epee::string_tools::hex_to_pod(e.tx_hash, txid) || !epee::string_tools::parse_hexstr_to_binbuff(e.as_hex, bd))
+    {
+      LOG_PRINT_L1("Failed to parse tx from gettransactions daemon RPC");
+      return false;
+    }
+    blobs[txid] = std::move(bd);
+  }
+  return true;
+}
+//----------------------------------------------------------------------------------------------------
 std::vector<size_t> wallet2::select_available_unmixable_outputs(bool trusted_daemon)
 {
   // request all outputs with less than 3 instances
@@ -4586,6 +5995,7 @@ std::vector<wallet2::pending_tx> wallet2::create_unmixable_sweep_transactions(bo
 
 bool wallet2::get_tx_key(const crypto::hash &txid, crypto::secret_key &tx_key) const
 {
+  load_history();
   const std::unordered_map<crypto::hash, crypto::secret_key>::const_iterator i = m_tx_keys.find(txid);
   if (i == m_tx_keys.end())
     return false;
@@ -4614,9 +6024,9 @@ uint64_t wallet2::get_daemon_blockchain_height(string &err)
   //      consider to move it from simplewallet to wallet2 ?
   COMMAND_RPC_GET_HEIGHT::request req;
   COMMAND_RPC_GET_HEIGHT::response res = boost::value_initialized<COMMAND_RPC_GET_HEIGHT::response>();
-  m_daemon_rpc_mutex.lock();
-  bool ok = net_utils::invoke_http_json_remote_command2(m_daemon_address + "/getheight", req, res, m_http_client);
-  m_daemon_rpc_mutex.unlock();
+  tools::http_client_pool::lease daemon(m_daemon_clients);
+  bool ok = net_utils::invoke_http_json_remote_command2(m_daemon_address + "/getheight", req, res, daemon.get());
+  daemon.release();
   // XXX: DRY violation. copy-pasted from simplewallet.cpp:interpret_rpc_response()
   if (ok)
   {
@@ -4644,12 +6054,12 @@ uint64_t wallet2::get_daemon_blockchain_target_height(string &err)
 {
   epee::json_rpc::request<cryptonote::COMMAND_RPC_GET_INFO::request> req_t = AUTO_VAL_INIT(req_t);
   epee::json_rpc::response<cryptonote::COMMAND_RPC_GET_INFO::response, std::string> resp_t = AUTO_VAL_INIT(resp_t);
-  m_daemon_rpc_mutex.lock();
+  tools::http_client_pool::lease daemon(m_daemon_clients);
   req_t.jsonrpc = "2.0";
   req_t.id = epee::serialization::storage_entry(0);
   req_t.method = "get_info";
-  bool ok = net_utils::invoke_http_json_remote_command2(m_daemon_address + "/json_rpc", req_t, resp_t, m_http_client);
-  m_daemon_rpc_mutex.unlock();
+  bool ok = net_utils::invoke_http_json_remote_command2(m_daemon_address + "/json_rpc", req_t, resp_t, daemon.get());
+  daemon.release();
   if (ok)
   {
     if (resp_t.result.status == CORE_RPC_STATUS_BUSY)
@@ -4733,85 +6143,19 @@ bool wallet2::verify(const std::string &data, const cryptonote::account_public_a
   return crypto::check_signature(hash, address.m_spend_public_key, s);
 }
 //----------------------------------------------------------------------------------------------------
-crypto::public_key wallet2::get_tx_pub_key_from_received_outs(const tools::wallet2::transfer_details &td) const
-{
-  std::vector<tx_extra_field> tx_extra_fields;
-  if(!parse_tx_extra(td.m_tx.extra, tx_extra_fields))
-  {
-    // Extra may only be partially parsed, it's OK if tx_extra_fields contains public key
-  }
-
-  // Due to a previous bug, there might be more than one tx pubkey in extra, one being
-  // the result of a previously discarded signature.
-  // For speed, since scanning for outputs is a slow process, we check whether extra
-  // contains more than one pubkey. If not, the first one is returned. If yes, they're
-  // checked for whether they yield at least one output
-  tx_extra_pub_key pub_key_field;
-  THROW_WALLET_EXCEPTION_IF(!find_tx_extra_field_by_type(tx_extra_fields, pub_key_field, 0), error::wallet_internal_error,
-      "Public key wasn't found in the transaction extra");
-  const crypto::public_key tx_pub_key = pub_key_field.pub_key;
-  bool two_found = find_tx_extra_field_by_type(tx_extra_fields, pub_key_field, 1);
-  if (!two_found) {
-    // easy case, just one found
-    return tx_pub_key;
-  }
-
-  // more than one, loop and search
-  const cryptonote::account_keys& keys = m_account.get_keys();
-  size_t pk_index = 0;
-  while (find_tx_extra_field_by_type(tx_extra_fields, pub_key_field, pk_index++)) {
-    const crypto::public_key tx_pub_key = pub_key_field.pub_key;
-    crypto::key_derivation derivation;
-    generate_key_derivation(tx_pub_key, keys.m_view_secret_key, derivation);
-
-    for (size_t i = 0; i < td.m_tx.vout.size(); ++i)
-    {
-      uint64_t money_transfered = 0;
-      bool error = false, received = false;
-      check_acc_out_precomp(keys.m_account_address.m_spend_public_key, td.m_tx.vout[i], derivation, i, received, money_transfered, error);
-      if (!error && received)
-        return tx_pub_key;
-    }
-  }
-
-  // we found no key yielding an output
-  THROW_WALLET_EXCEPTION_IF(true, error::wallet_internal_error,
-      "Public key yielding at least one output wasn't found in the transaction extra");
-  return cryptonote::null_pkey;
-}
-//----------------------------------------------------------------------------------------------------
 std::vector<std::pair<crypto::key_image, crypto::signature>> wallet2::export_key_images() const
 {
-  std::vector<std::pair<crypto::key_image, crypto::signature>> ski;
-
-  ski.reserve(m_transfers.size());
-  for (size_t n = 0; n < m_transfers.size(); ++n)
-  {
-    const transfer_details &td = m_transfers[n];
-
-    crypto::hash hash;
-    crypto::cn_fast_hash(&td.m_key_image, sizeof(td.m_key_image), hash);
+  std::vector<std::pair<crypto::key_image, crypto::signature>> ski(m_transfers.size());
 
+  // each key image takes a key derivation and a signature, they are spread over the scan pool
+  tools::parallel_transform(scan_pool(), m_transfers.begin(), m_transfers.end(), ski.begin(), 1, [this] (const transfer_details &td) {
     // get ephemeral public key
-    const cryptonote::tx_out &out = td.m_tx.vout[td.m_internal_output_index];
-    THROW_WALLET_EXCEPTION_IF(out.target.type() != typeid(txout_to_key), error::wallet_internal_error,
-        "Output is not txout_to_key");
-    const cryptonote::txout_to_key &o = boost::get<const cryptonote::txout_to_key>(out.target);
-    const crypto::public_key pkey = o.key;
-
-    // get tx pub key
-    std::vector<tx_extra_field> tx_extra_fields;
-    if(!parse_tx_extra(td.m_tx.extra, tx_extra_fields))
-    {
-      // Extra may only be partially parsed, it's OK if tx_extra_fields contains public key
-    }
-
-    crypto::public_key tx_pub_key = get_tx_pub_key_from_received_outs(td);
+    const crypto::public_key &pkey = td.get_public_key();
 
     // generate ephemeral secret key
     crypto::key_image ki;
     cryptonote::keypair in_ephemeral;
-    cryptonote::generate_key_image_helper(m_account.get_keys(), tx_pub_key, td.m_internal_output_index, in_ephemeral, ki);
+    cryptonote::generate_key_image_helper(m_account.get_keys(), td.m_tx_pub_key, td.m_internal_output_index, in_ephemeral, ki);
 
     THROW_WALLET_EXCEPTION_IF(td.m_key_image_known && ki != td.m_key_image,
         error::wallet_internal_error, "key_image generated not matched with cached key image");
@@ -4819,22 +6163,19 @@ std::vector<std::pair<crypto::key_image, crypto::signature>> wallet2::export_key
         error::wallet_internal_error, "key_image generated ephemeral public key not matched with output_key");
 
     // sign the key image with the output secret key
-    crypto::signature signature;
     std::vector<const crypto::public_key*> key_ptrs;
     key_ptrs.push_back(&pkey);
 
-    crypto::generate_ring_signature((const crypto::hash&)td.m_key_image, td.m_key_image, key_ptrs, in_ephemeral.sec, 0, &signature);
-
-    ski.push_back(std::make_pair(td.m_key_image, signature));
-  }
+    std::pair<crypto::key_image, crypto::signature> signed_key_image;
+    signed_key_image.first = td.m_key_image;
+    crypto::generate_ring_signature((const crypto::hash&)td.m_key_image, td.m_key_image, key_ptrs, in_ephemeral.sec, 0, &signed_key_image.second);
+    return signed_key_image;
+  });
   return ski;
 }
 //----------------------------------------------------------------------------------------------------
 uint64_t wallet2::import_key_images(const std::vector<std::pair<crypto::key_image, crypto::signature>> &signed_key_images, uint64_t &spent, uint64_t &unspent)
 {
-  COMMAND_RPC_IS_KEY_IMAGE_SPENT::request req = AUTO_VAL_INIT(req);
-  COMMAND_RPC_IS_KEY_IMAGE_SPENT::response daemon_resp = AUTO_VAL_INIT(daemon_resp);
-
   THROW_WALLET_EXCEPTION_IF(signed_key_images.size() > m_transfers.size(), error::wallet_internal_error,
       "The blockchain is out of date compared to the signed key images");
 
@@ -4845,61 +6186,93 @@ uint64_t wallet2::import_key_images(const std::vector<std::pair<crypto::key_imag
     return 0;
   }
 
-  for (size_t n = 0; n < signed_key_images.size(); ++n)
+  // the signatures of a chunk are checked on the scan pool while the daemon
+  // is asked about the chunk before it; nothing is changed until all are in
+  tools::thread_group &pool = scan_pool();
+  std::vector<int> spent_status;
+  spent_status.reserve(signed_key_images.size());
+  bool use_bin = true;
+  std::exception_ptr check_error, query_error;
+  boost::thread query_thread;
+  for (size_t start = 0; start < signed_key_images.size(); start += COMMAND_RPC_IS_KEY_IMAGE_SPENT_MAX_COUNT)
   {
-    const transfer_details &td = m_transfers[n];
-    const crypto::key_image &key_image = signed_key_images[n].first;
-    const crypto::signature &signature = signed_key_images[n].second;
-
-    // get ephemeral public key
-    const cryptonote::tx_out &out = td.m_tx.vout[td.m_internal_output_index];
-    THROW_WALLET_EXCEPTION_IF(out.target.type() != typeid(txout_to_key), error::wallet_internal_error,
-      "Non txout_to_key output found");
-    const cryptonote::txout_to_key &o = boost::get<cryptonote::txout_to_key>(out.target);
-    const crypto::public_key pkey = o.key;
-
-    std::vector<const crypto::public_key*> pkeys;
-    pkeys.push_back(&pkey);
-    THROW_WALLET_EXCEPTION_IF(!crypto::check_ring_signature((const crypto::hash&)key_image, key_image, pkeys, &signature),
-        error::wallet_internal_error, "Signature check failed: input " + boost::lexical_cast<std::string>(n) + "/"
-        + boost::lexical_cast<std::string>(signed_key_images.size()) + ", key image " + epee::string_tools::pod_to_hex(key_image)
-        + ", signature " + epee::string_tools::pod_to_hex(signature) + ", pubkey " + epee::string_tools::pod_to_hex(*pkeys[0]));
+    const size_t end = std::min(start + COMMAND_RPC_IS_KEY_IMAGE_SPENT_MAX_COUNT, signed_key_images.size());
+    try
+    {
+      tools::parallel_for(pool, start, end, 1, [&] (size_t first, size_t last) {
+        for (size_t n = first; n < last; ++n)
+        {
+          const transfer_details &td = m_transfers[n];
+          const crypto::key_image &key_image = signed_key_images[n].first;
+          const crypto::signature &signature = signed_key_images[n].second;
+
+          // get ephemeral public key
+          const crypto::public_key &pkey = td.get_public_key();
+
+          std::vector<const crypto::public_key*> pkeys;
+          pkeys.push_back(&pkey);
+          THROW_WALLET_EXCEPTION_IF(!crypto::check_ring_signature((const crypto::hash&)key_image, key_image, pkeys, &signature),
+              error::wallet_internal_error, "Signature check failed: input " + boost::lexical_cast<std::string>(n) + "/"
+              + boost::lexical_cast<std::string>(signed_key_images.size()) + ", key image " + epee::string_tools::pod_to_hex(key_image)
+              + ", signature " + epee::string_tools::pod_to_hex(signature) + ", pubkey " + epee::string_tools::pod_to_hex(*pkeys[0]));
+        }
+        return true;
+      });
+    }
+    catch (...)
+    {
+      check_error = std::current_exception();
+    }
 
-    req.key_images.push_back(epee::string_tools::pod_to_hex(key_image));
-  }
+    if (query_thread.joinable())
+      query_thread.join();
+    if (check_error || query_error)
+      break;
 
-  for (size_t n = 0; n < signed_key_images.size(); ++n)
-  {
-    m_transfers[n].m_key_image = signed_key_images[n].first;
-    m_key_images[m_transfers[n].m_key_image] = n;
-    m_transfers[n].m_key_image_known = true;
+    query_thread = boost::thread([&, start, end] {
+      try
+      {
+        std::vector<crypto::key_image> key_images;
+        key_images.reserve(end - start);
+        for (size_t n = start; n < end; ++n)
+          key_images.push_back(signed_key_images[n].first);
+        const std::vector<int> status = get_key_images_spent_status(key_images, use_bin);
+        spent_status.insert(spent_status.end(), status.begin(), status.end());
+      }
+      catch (...)
+      {
+        query_error = std::current_exception();
+      }
+    });
   }
+  if (query_thread.joinable())
+    query_thread.join();
+  if (check_error)
+    std::rethrow_exception(check_error);
+  if (query_error)
+    std::rethrow_exception(query_error);
 
-  m_daemon_rpc_mutex.lock();
-  bool r = epee::net_utils::invoke_http_json_remote_command2(m_daemon_address + "/is_key_image_spent", req, daemon_resp, m_http_client, 200000);
-  m_daemon_rpc_mutex.unlock();
-  THROW_WALLET_EXCEPTION_IF(!r, error::no_connection_to_daemon, "is_key_image_spent");
-  THROW_WALLET_EXCEPTION_IF(daemon_resp.status == CORE_RPC_STATUS_BUSY, error::daemon_busy, "is_key_image_spent");
-  THROW_WALLET_EXCEPTION_IF(daemon_resp.status != CORE_RPC_STATUS_OK, error::is_key_image_spent_error, daemon_resp.status);
-  THROW_WALLET_EXCEPTION_IF(daemon_resp.spent_status.size() != signed_key_images.size(), error::wallet_internal_error,
-    "daemon returned wrong response for is_key_image_spent, wrong amounts count = " +
-    std::to_string(daemon_resp.spent_status.size()) + ", expected " +  std::to_string(signed_key_images.size()));
-
+  m_journal_full_store = true;
   spent = 0;
   unspent = 0;
-  for (size_t n = 0; n < daemon_resp.spent_status.size(); ++n)
+  for (size_t n = 0; n < signed_key_images.size(); ++n)
   {
     transfer_details &td = m_transfers[n];
+    td.m_key_image = signed_key_images[n].first;
+    m_key_images[td.m_key_image] = n;
+    td.m_key_image_known = true;
+
     uint64_t amount = td.amount();
-    td.m_spent = daemon_resp.spent_status[n] != COMMAND_RPC_IS_KEY_IMAGE_SPENT::UNSPENT;
+    td.m_spent = spent_status[n] != COMMAND_RPC_IS_KEY_IMAGE_SPENT::UNSPENT;
     if (td.m_spent)
       spent += amount;
     else
       unspent += amount;
     LOG_PRINT_L2("Transfer " << n << ": " << print_money(amount) << " (" << td.m_global_output_index << "): "
-        << (td.m_spent ? "spent" : "unspent") << " (key image " << req.key_images[n] << ")");
+        << (td.m_spent ? "spent" : "unspent") << " (key image " << td.m_key_image << ")");
   }
   LOG_PRINT_L1("Total: " << print_money(spent) << " spent, " << print_money(unspent) << " unspent");
+  rebuild_balance();
 
   return m_transfers[signed_key_images.size() - 1].m_block_height;
 }
@@ -4921,6 +6294,7 @@ std::vector<tools::wallet2::transfer_details> wallet2::export_outputs() const
 //----------------------------------------------------------------------------------------------------
 size_t wallet2::import_outputs(const std::vector<tools::wallet2::transfer_details> &outputs)
 {
+  m_journal_full_store = true;
   m_transfers.clear();
   m_transfers.reserve(outputs.size());
   for (size_t i = 0; i < outputs.size(); ++i)
@@ -4929,23 +6303,16 @@ size_t wallet2::import_outputs(const std::vector<tools::wallet2::transfer_detail
 
     // the hot wallet wouldn't have known about key images (except if we already exported them)
     cryptonote::keypair in_ephemeral;
-    std::vector<tx_extra_field> tx_extra_fields;
-    tx_extra_pub_key pub_key_field;
-
-    THROW_WALLET_EXCEPTION_IF(td.m_tx.vout.empty(), error::wallet_internal_error, "tx with no outputs at index " + boost::lexical_cast<std::string>(i));
-    THROW_WALLET_EXCEPTION_IF(!parse_tx_extra(td.m_tx.extra, tx_extra_fields), error::wallet_internal_error,
-        "Transaction extra has unsupported format at index " + boost::lexical_cast<std::string>(i));
-    crypto::public_key tx_pub_key = get_tx_pub_key_from_received_outs(td);
-
-    cryptonote::generate_key_image_helper(m_account.get_keys(), tx_pub_key, td.m_internal_output_index, in_ephemeral, td.m_key_image);
+    cryptonote::generate_key_image_helper(m_account.get_keys(), td.m_tx_pub_key, td.m_internal_output_index, in_ephemeral, td.m_key_image);
     td.m_key_image_known = true;
-    THROW_WALLET_EXCEPTION_IF(in_ephemeral.pub != boost::get<cryptonote::txout_to_key>(td.m_tx.vout[td.m_internal_output_index].target).key,
+    THROW_WALLET_EXCEPTION_IF(in_ephemeral.pub != td.get_public_key(),
         error::wallet_internal_error, "key_image generated ephemeral public key not matched with output_key at index " + boost::lexical_cast<std::string>(i));
 
     m_key_images[td.m_key_image] = m_transfers.size();
     m_pub_keys[td.get_public_key()] = m_transfers.size();
     m_transfers.push_back(td);
   }
+  rebuild_balance();
 
   return m_transfers.size();
 }
@@ -35,9 +35,19 @@
 
 #include <boost/program_options/options_description.hpp>
 #include <boost/program_options/variables_map.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/serialization/deque.hpp>
 #include <boost/serialization/list.hpp>
+#include <boost/serialization/utility.hpp>
 #include <boost/serialization/vector.hpp>
+#include <algorithm>
 #include <atomic>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <map>
+#include <set>
+#include <unordered_set>
 
 #include "include_base_utils.h"
 #include "cryptonote_core/account.h"
@@ -47,7 +57,10 @@
 #include "storages/http_abstract_invoke.h"
 #include "rpc/core_rpc_server_commands_defs.h"
 #include "cryptonote_core/cryptonote_format_utils.h"
+#include "cryptonote_core/tx_view.h"
 #include "common/unordered_containers_boost_serialization.h"
+#include "common/http_client_pool.h"
+#include "common/thread_group.h"
 #include "crypto/chacha8.h"
 #include "crypto/hash.h"
 #include "ringct/rctTypes.h"
@@ -58,6 +71,19 @@
 
 #include <iostream>
 #define WALLET_RCP_CONNECTION_TIMEOUT                          200000
+#define WALLET_DAEMON_CONNECTIONS                              4
+// block hashes kept in full below the wallet's top, deeper ones are trimmed
+#define WALLET_HASHCHAIN_KEEP                                  1000
+// one trimmed hash in this many is kept, so the daemon can find deep reorgs
+#define WALLET_HASHCHAIN_CHECKPOINT_INTERVAL                   1000
+// appended to the wallet cache file name for the journal of changes since it was stored
+#define WALLET_JOURNAL_FILE_SUFFIX                             ".journal"
+// starts a cache file made of separately encrypted sections, older ones are a single cache_file_data
+#define WALLET_CACHE_SECTIONS_MAGIC                            "Monero wallet cache sections\001"
+// batches of blocks refresh pulls ahead of the one being processed
+#define WALLET_REFRESH_PREFETCH_DEPTH                          3
+#define WALLET_REFRESH_PREFETCH_DEPTH_MAX                      16
+#define WALLET_DECOY_POOL_SIZE_MAX                             10000
 
 namespace tools
 {
@@ -68,6 +94,10 @@ namespace tools
     virtual void on_money_received(uint64_t height, const cryptonote::transaction& tx, uint64_t amount) {}
     virtual void on_money_spent(uint64_t height, const cryptonote::transaction& in_tx, uint64_t amount, const cryptonote::transaction& spend_tx) {}
     virtual void on_skip_transaction(uint64_t height, const cryptonote::transaction& tx) {}
+    //! for each transaction paying the wallet, in the pool (height 0) and again once mined; payment_id is null_hash if it has none
+    virtual void on_payment_received(uint64_t height, const crypto::hash& payment_id, const crypto::hash& txid, uint64_t amount, uint64_t unlock_time) {}
+    //! after each batch of blocks refresh processes, with the blocks added and their rate since refresh started
+    virtual void on_refresh_progress(uint64_t height, uint64_t daemon_height, uint64_t blocks_fetched, double blocks_per_second) {}
     virtual ~i_wallet2_callback() {}
   };
 
@@ -85,8 +115,59 @@ namespace tools
     }
   };
 
+  /*!
+   * \brief The hashes of the blocks a wallet has seen, kept compact
+   *
+   * The most recent hashes are kept in full. Below them, only one hash every
+   * WALLET_HASHCHAIN_CHECKPOINT_INTERVAL blocks is kept, genesis included.
+   */
+  class hashchain
+  {
+  public:
+    hashchain(): m_offset(0) {}
+
+    size_t size() const { return m_offset + m_blockchain.size(); }
+    bool empty() const { return size() == 0; }
+    //! the height of the lowest hash kept in full
+    size_t offset() const { return m_offset; }
+    const crypto::hash &genesis() const { return m_offset ? m_checkpoints.front() : m_blockchain.front(); }
+    /*!
+     * \brief gets the hash of a block, if it is still kept
+     * \return false if the block is past the top, or was trimmed
+     */
+    bool get(size_t height, crypto::hash &hash) const;
+    void push_back(const crypto::hash &hash) { m_blockchain.push_back(hash); }
+    //! drops the hashes from height up, trimmed or not
+    void crop(size_t height);
+    void clear();
+    //! trims all but the last keep hashes, recording the checkpoints among them
+    void trim(size_t keep);
+    /*!
+     * \brief makes the chain end with the last of the given checkpoints
+     *
+     * The hashes in between are left unknown, as if trimmed.
+     *
+     * \param checkpoints the hashes at every multiple of the interval, the genesis one first
+     */
+    void fast_forward(const std::vector<crypto::hash> &checkpoints);
+
+    template <class t_archive>
+    inline void serialize(t_archive &a, const unsigned int ver)
+    {
+      a & m_offset;
+      a & m_checkpoints;
+      a & m_blockchain;
+    }
+
+  private:
+    uint64_t m_offset;  // hashes below this height were trimmed
+    std::vector<crypto::hash> m_checkpoints;  // the hashes at multiples of the interval below m_offset
+    std::deque<crypto::hash> m_blockchain;  // the hashes from m_offset up
+  };
+
   class wallet2
   {
+    friend class shared_refresh;
   public:
     enum RefreshType {
       RefreshFull,
@@ -96,7 +177,7 @@ namespace tools
     };
 
   private:
-    wallet2(const wallet2&) : m_run(true), m_callback(0), m_testnet(false), m_always_confirm_transfers(true), m_store_tx_info(true), m_default_mixin(0), m_default_priority(0), m_refresh_type(RefreshOptimizeCoinbase), m_auto_refresh(true), m_refresh_from_block_height(0), m_confirm_missing_payment_id(true) {}
+    wallet2(const wallet2&) : m_daemon_clients(WALLET_DAEMON_CONNECTIONS), m_run(true), m_refresh_paused(false), m_refresh_cpu_share(100), m_scan_threads(0), m_callback(0), m_testnet(false), m_always_confirm_transfers(true), m_store_tx_info(true), m_default_mixin(0), m_default_priority(0), m_refresh_type(RefreshOptimizeCoinbase), m_auto_refresh(true), m_refresh_from_block_height(0), m_confirm_missing_payment_id(true), m_refresh_prefetch_depth(WALLET_REFRESH_PREFETCH_DEPTH), m_refresh_batch_size(COMMAND_RPC_GET_BLOCKS_FAST_MAX_COUNT), m_decoy_pool_size(0), m_pool_version(0), m_pool_tx_hashes_known(false), m_journal_full_store(true), m_background_store_failed(false), m_unspent_balance(0), m_detach_count(0), m_history_loaded(true) {}
 
   public:
     static const char* tr(const char* str);// { return i18n_translate(str, "cryptonote::simple_wallet"); }
@@ -114,11 +195,17 @@ namespace tools
     //! Uses stdin and stdout. Returns a wallet2 and password for wallet with no file if no errors.
     static std::pair<std::unique_ptr<wallet2>, password_container> make_new(const boost::program_options::variables_map& vm);
 
-    wallet2(bool testnet = false, bool restricted = false) : m_run(true), m_callback(0), m_testnet(testnet), m_always_confirm_transfers(true), m_store_tx_info(true), m_default_mixin(0), m_default_priority(0), m_refresh_type(RefreshOptimizeCoinbase), m_auto_refresh(true), m_refresh_from_block_height(0), m_confirm_missing_payment_id(true), m_restricted(restricted), is_old_file_format(false) {}
+    //! Just parses variables, for a wallet loaded or generated by the caller.
+    static std::unique_ptr<wallet2> make_dummy(const boost::program_options::variables_map& vm);
+
+    ~wallet2() { if (m_background_store.joinable()) m_background_store.join(); }
+
+    wallet2(bool testnet = false, bool restricted = false) : m_daemon_clients(WALLET_DAEMON_CONNECTIONS), m_run(true), m_refresh_paused(false), m_refresh_cpu_share(100), m_scan_threads(0), m_callback(0), m_testnet(testnet), m_always_confirm_transfers(true), m_store_tx_info(true), m_default_mixin(0), m_default_priority(0), m_refresh_type(RefreshOptimizeCoinbase), m_auto_refresh(true), m_refresh_from_block_height(0), m_confirm_missing_payment_id(true), m_refresh_prefetch_depth(WALLET_REFRESH_PREFETCH_DEPTH), m_refresh_batch_size(COMMAND_RPC_GET_BLOCKS_FAST_MAX_COUNT), m_decoy_pool_size(0), m_pool_version(0), m_pool_tx_hashes_known(false), m_restricted(restricted), is_old_file_format(false), m_journal_full_store(true), m_background_store_failed(false), m_unspent_balance(0), m_detach_count(0), m_history_loaded(true) {}
+    // only what spending the output takes is kept, the rest of its tx can be
+    // fetched from the daemon by m_txid
     struct transfer_details
     {
       uint64_t m_block_height;
-      cryptonote::transaction_prefix m_tx;
       crypto::hash m_txid;
       size_t m_internal_output_index;
       uint64_t m_global_output_index;
@@ -130,14 +217,23 @@ namespace tools
       bool m_rct;
       bool m_key_image_known;
       size_t m_pk_index;
+      crypto::public_key m_output_key;
+      crypto::public_key m_tx_pub_key;  //!< the one of the tx's pub keys the output was received with
+      uint64_t m_unlock_time;
 
       bool is_rct() const { return m_rct; }
       uint64_t amount() const { return m_amount; }
-      const crypto::public_key &get_public_key() const { return boost::get<const cryptonote::txout_to_key>(m_tx.vout[m_internal_output_index].target).key; }
+      const crypto::public_key &get_public_key() const { return m_output_key; }
+      //! fills the fields taken from the output's tx
+      void set_tx(const cryptonote::transaction_prefix &tx, const crypto::public_key &tx_pub_key)
+      {
+        m_output_key = boost::get<const cryptonote::txout_to_key>(tx.vout[m_internal_output_index].target).key;
+        m_tx_pub_key = tx_pub_key;
+        m_unlock_time = tx.unlock_time;
+      }
 
       BEGIN_SERIALIZE_OBJECT()
         FIELD(m_block_height)
-        FIELD(m_tx)
         FIELD(m_txid)
         FIELD(m_internal_output_index)
         FIELD(m_global_output_index)
@@ -149,6 +245,9 @@ namespace tools
         FIELD(m_rct)
         FIELD(m_key_image_known)
         FIELD(m_pk_index)
+        FIELD(m_output_key)
+        FIELD(m_tx_pub_key)
+        VARINT_FIELD(m_unlock_time)
       END_SERIALIZE()
     };
 
@@ -215,6 +314,18 @@ namespace tools
     typedef std::vector<transfer_details> transfer_container;
     typedef std::unordered_multimap<crypto::hash, payment_details> payment_container;
 
+    /*!
+     * \brief where a paged, height ordered listing continues: at the
+     *        skip-th entry at height, the first one not returned yet
+     */
+    struct height_cursor
+    {
+      uint64_t height;
+      size_t skip;
+
+      height_cursor(): height(0), skip(0) {}
+    };
+
     // The convention for destinations is:
     // dests does not include change
     // splitted_dsts (in construction_data) does
@@ -286,7 +397,43 @@ namespace tools
         FIELD(cache_data)
       END_SERIALIZE()
     };
-    
+
+    /*!
+     * A sectioned cache file is WALLET_CACHE_SECTIONS_MAGIC, a cache_sections_index,
+     * then the encrypted data of each section in turn. The header section is read
+     * on load, the history ones (payments, outgoing txes, tx keys) on first use.
+     */
+    enum cache_section_id
+    {
+      cache_section_header = 0,
+      cache_section_payments,
+      cache_section_confirmed_txs,
+      cache_section_tx_keys,
+      cache_section_count
+    };
+
+    struct cache_section
+    {
+      crypto::chacha8_iv iv;
+      uint64_t size;
+
+      BEGIN_SERIALIZE_OBJECT()
+        FIELD(iv)
+        VARINT_FIELD(size)
+      END_SERIALIZE()
+    };
+
+    struct cache_sections_index
+    {
+      uint32_t version;
+      std::vector<cache_section> sections;
+
+      BEGIN_SERIALIZE_OBJECT()
+        VARINT_FIELD(version)
+        FIELD(sections)
+      END_SERIALIZE()
+    };
+
     // GUI Address book
     struct address_book_row
     {
@@ -295,6 +442,68 @@ namespace tools
       std::string m_description;   
     };
 
+    struct journal_spent_change
+    {
+      uint64_t index;
+      bool spent;
+      uint64_t height;
+
+      template <class t_archive>
+      inline void serialize(t_archive &a, const unsigned int ver)
+      {
+        a & index;
+        a & spent;
+        a & height;
+      }
+    };
+
+    /*!
+     * \brief the changes to a wallet since it was last stored
+     *
+     * Appended, encrypted, to the journal next to the cache file. Transfers,
+     * payments and block hashes only grow between full stores, the smaller
+     * containers are written whole.
+     */
+    struct journal_record
+    {
+      crypto::hash journal_id;  //!< the cache this extends
+      bool full_blockchain;  //!< blockchain is the whole chain, else block_hashes follow blockchain_start
+      hashchain blockchain;
+      uint64_t blockchain_start;
+      std::vector<crypto::hash> block_hashes;
+      uint64_t transfers_start;
+      transfer_container transfers;
+      std::vector<journal_spent_change> spent_changes;
+      std::vector<std::pair<crypto::hash, payment_details>> payments;
+      std::vector<std::pair<crypto::hash, confirmed_transfer_details>> confirmed_txs;
+      std::vector<std::pair<crypto::hash, crypto::secret_key>> tx_keys;
+      std::unordered_map<crypto::hash, unconfirmed_transfer_details> unconfirmed_txs;
+      std::unordered_map<crypto::hash, payment_details> unconfirmed_payments;
+      std::unordered_map<crypto::hash, std::string> tx_notes;
+      std::vector<address_book_row> address_book;
+
+      template <class t_archive>
+      inline void serialize(t_archive &a, const unsigned int ver)
+      {
+        a & journal_id;
+        a & full_blockchain;
+        a & blockchain;
+        a & blockchain_start;
+        a & block_hashes;
+        a & transfers_start;
+        a & transfers;
+        a & spent_changes;
+        a & payments;
+        a & confirmed_txs;
+        a & tx_keys;
+        a & unconfirmed_txs;
+        a & unconfirmed_payments;
+        a & tx_notes;
+        a & address_book;
+      }
+    };
+    
+
     /*!
      * \brief Generates a wallet or restores one.
      * \param  wallet_        Name of wallet file
@@ -341,6 +550,20 @@ namespace tools
      * \param password - password to protect new wallet (TODO: probably better save the password in the wallet object?)
      */
     void store_to(const std::string &path, const std::string &password);
+    /*!
+     * \brief stores like store(), leaving a full store's encryption and
+     * writing to a thread, so the wallet can be used again at once
+     *
+     * The state is serialized before this returns. Stores, and deinit, wait
+     * for a background store still running; if it failed, the next store is
+     * a full one.
+     */
+    void store_in_background();
+    /*!
+     * \brief waits for a store_in_background still writing
+     * \return false if it failed
+     */
+    bool wait_for_background_store();
 
     std::string path() const;
 
@@ -362,6 +585,20 @@ namespace tools
     bool deinit();
 
     void stop() { m_run.store(false, std::memory_order_relaxed); }
+    //! holds a refresh in progress between two batches of blocks until unpaused, or stopped
+    void pause_refresh(bool paused) { m_refresh_paused.store(paused, std::memory_order_relaxed); }
+    bool refresh_paused() const { return m_refresh_paused.load(std::memory_order_relaxed); }
+    /*!
+     * \brief share of the time, in percent, refresh keeps its threads busy
+     *
+     * Below 100, refresh idles after each batch for as long as the share
+     * asks. Takes effect from the next batch.
+     */
+    void refresh_cpu_share(uint32_t percent) { m_refresh_cpu_share.store(std::max<uint32_t>(1, std::min<uint32_t>(percent, 100)), std::memory_order_relaxed); }
+    uint32_t refresh_cpu_share() const { return m_refresh_cpu_share.load(std::memory_order_relaxed); }
+    //! threads scanning blocks and building txes, the calling one included, 0 for one per core. Takes effect from the next refresh
+    void scan_threads(uint32_t threads) { m_scan_threads.store(threads, std::memory_order_relaxed); }
+    uint32_t scan_threads() const { return m_scan_threads.load(std::memory_order_relaxed); }
 
     i_wallet2_callback* callback() const { return m_callback; }
     void callback(i_wallet2_callback* callback) { m_callback = callback; }
@@ -413,7 +650,14 @@ namespace tools
     void commit_tx(pending_tx& ptx_vector);
     void commit_tx(std::vector<pending_tx>& ptx_vector);
     bool save_tx(const std::vector<pending_tx>& ptx_vector, const std::string &filename);
-    bool sign_tx(const std::string &unsigned_filename, const std::string &signed_filename, std::vector<wallet2::pending_tx> &ptx, std::function<bool(const unsigned_tx_set&)> accept_func = NULL);
+    /*!
+     * \brief signs the transactions of an unsigned tx set, in parallel on the scan threads
+     *
+     * progress_func, if given, is called with (signed so far, total) after each
+     * transaction, one call at a time but possibly from a scan thread.
+     */
+    bool sign_tx(const std::string &unsigned_filename, const std::string &signed_filename, std::vector<wallet2::pending_tx> &ptx, std::function<bool(const unsigned_tx_set&)> accept_func = NULL,
+      std::function<void(size_t, size_t)> progress_func = NULL);
     bool load_tx(const std::string &signed_filename, std::vector<tools::wallet2::pending_tx> &ptx, std::function<bool(const signed_tx_set&)> accept_func = NULL);
     std::vector<pending_tx> create_transactions(std::vector<cryptonote::tx_destination_entry> dsts, const size_t fake_outs_count, const uint64_t unlock_time, uint32_t priority, const std::vector<uint8_t> extra, bool trusted_daemon);
     std::vector<wallet2::pending_tx> create_transactions_2(std::vector<cryptonote::tx_destination_entry> dsts, const size_t fake_outs_count, const uint64_t unlock_time, uint32_t priority, const std::vector<uint8_t> extra, bool trusted_daemon);
@@ -421,15 +665,43 @@ namespace tools
     std::vector<wallet2::pending_tx> create_transactions_from(const cryptonote::account_public_address &address, std::vector<size_t> unused_transfers_indices, std::vector<size_t> unused_dust_indices, const size_t fake_outs_count, const uint64_t unlock_time, uint32_t priority, const std::vector<uint8_t> extra, bool trusted_daemon);
     std::vector<pending_tx> create_unmixable_sweep_transactions(bool trusted_daemon);
     bool check_connection(uint32_t *version = NULL);
+    /*!
+     * \brief waits for the daemon's chain to change, over its get_events long poll
+     * \param since the daemon's event sequence number seen last, 0 at first, updated
+     * \param timeout_seconds how long the daemon may hold the call
+     * \param changed set if blocks were added or removed since, or events were missed
+     * \return false if the call failed, as with daemons not having the call
+     */
+    bool wait_for_daemon_blocks(uint64_t &since, unsigned timeout_seconds, bool &changed);
     void get_transfers(wallet2::transfer_container& incoming_transfers) const;
     void get_payments(const crypto::hash& payment_id, std::list<wallet2::payment_details>& payments, uint64_t min_height = 0) const;
     void get_payments(std::list<std::pair<crypto::hash,wallet2::payment_details>>& payments, uint64_t min_height, uint64_t max_height = (uint64_t)-1) const;
     void get_payments_out(std::list<std::pair<crypto::hash,wallet2::confirmed_transfer_details>>& confirmed_payments,
       uint64_t min_height, uint64_t max_height = (uint64_t)-1) const;
+    /*!
+     * \brief pages through the payments with min_height < height <= max_height, in height order
+     * \param limit the most payments to return, 0 for no limit
+     * \param cursor where to start, default constructed for the first page; set to where the next one starts
+     * \return true if payments remain after the ones returned
+     */
+    bool get_payments(std::list<std::pair<crypto::hash,wallet2::payment_details>>& payments, uint64_t min_height, uint64_t max_height, size_t limit, height_cursor &cursor) const;
+    /*!
+     * \brief pages through the outgoing transfers like get_payments above
+     */
+    bool get_payments_out(std::list<std::pair<crypto::hash,wallet2::confirmed_transfer_details>>& confirmed_payments,
+      uint64_t min_height, uint64_t max_height, size_t limit, height_cursor &cursor) const;
     void get_unconfirmed_payments_out(std::list<std::pair<crypto::hash,wallet2::unconfirmed_transfer_details>>& unconfirmed_payments) const;
     void get_unconfirmed_payments(std::list<std::pair<crypto::hash,wallet2::payment_details>>& unconfirmed_payments) const;
 
     uint64_t get_blockchain_current_height() const { return m_local_bc_height; }
+    /*!
+     * \brief counts the detach_blockchain and clear calls since the wallet was made
+     *
+     * Payments and transfers at heights below get_blockchain_current_height
+     * are only ever dropped by those, so a caller having seen them can tell
+     * whether it must read them all again.
+     */
+    uint64_t get_detach_count() const { return m_detach_count; }
     void rescan_spent();
     void rescan_blockchain(bool refresh = true);
     bool is_transfer_unlocked(const transfer_details& td) const;
@@ -439,7 +711,19 @@ namespace tools
       uint64_t dummy_refresh_height = 0; // moved to keys file
       if(ver < 5)
         return;
-      a & m_blockchain;
+      if(ver < 17)
+      {
+        // from before the compact hash chain
+        std::vector<crypto::hash> blockchain;
+        a & blockchain;
+        m_blockchain.clear();
+        for (const crypto::hash &hash: blockchain)
+          m_blockchain.push_back(hash);
+      }
+      else
+      {
+        a & m_blockchain;
+      }
       a & m_transfers;
       a & m_account_public_address;
       a & m_key_images;
@@ -471,10 +755,7 @@ namespace tools
         // we're loading an older wallet without a pubkey map, rebuild it
         for (size_t i = 0; i < m_transfers.size(); ++i)
         {
-          const transfer_details &td = m_transfers[i];
-          const cryptonote::tx_out &out = td.m_tx.vout[td.m_internal_output_index];
-          const cryptonote::txout_to_key &o = boost::get<const cryptonote::txout_to_key>(out.target);
-          m_pub_keys.emplace(o.key, i);
+          m_pub_keys.emplace(m_transfers[i].get_public_key(), i);
         }
         return;
       }
@@ -482,6 +763,25 @@ namespace tools
       if(ver < 16)
         return;
       a & m_address_book;
+      if(ver < 18)
+        return;
+      a & m_journal_id;
+    }
+
+    //! what the header section of a sectioned cache holds: all but the history
+    template <class t_archive>
+    inline void serialize_cache_header(t_archive &a)
+    {
+      a & m_blockchain;
+      a & m_transfers;
+      a & m_account_public_address;
+      a & m_key_images;
+      a & m_unconfirmed_txs;
+      a & m_tx_notes;
+      a & m_unconfirmed_payments;
+      a & m_pub_keys;
+      a & m_address_book;
+      a & m_journal_id;
     }
 
     /*!
@@ -517,6 +817,19 @@ namespace tools
     void auto_refresh(bool r) { m_auto_refresh = r; }
     bool confirm_missing_payment_id() const { return m_confirm_missing_payment_id; }
     void confirm_missing_payment_id(bool always) { m_confirm_missing_payment_id = always; }
+    uint32_t refresh_prefetch_depth() const { return m_refresh_prefetch_depth; }
+    void refresh_prefetch_depth(uint32_t depth) { m_refresh_prefetch_depth = std::max<uint32_t>(1, std::min<uint32_t>(depth, WALLET_REFRESH_PREFETCH_DEPTH_MAX)); }
+    uint32_t decoy_pool_size() const { return m_decoy_pool_size; }
+    void decoy_pool_size(uint32_t size);
+    /*!
+     * \brief tops the decoy pool up to decoy_pool_size rct outputs, refresh calls it
+     *
+     * Rings for rct inputs are then taken from the pool, without a daemon
+     * round trip, as long as it holds enough. Each pooled output is used
+     * once, and they are dropped once old enough for the recent zone to
+     * have moved on.
+     */
+    void refill_decoy_pool();
 
     bool get_tx_key(const crypto::hash &txid, crypto::secret_key &tx_key) const;
 
@@ -528,7 +841,10 @@ namespace tools
     bool delete_address_book_row(std::size_t row_id);
         
     uint64_t get_num_rct_outputs();
+    size_t get_num_transfer_details() const { return m_transfers.size(); }
     const transfer_details &get_transfer_details(size_t idx) const;
+    //! fetches the blobs of txes from the daemon in one call, as transfers do not keep them
+    bool get_tx_blobs(const std::vector<crypto::hash> &txids, std::unordered_map<crypto::hash, cryptonote::blobdata> &blobs);
 
     void get_hard_fork_info(uint8_t version, uint64_t &earliest_height);
     bool use_fork_rules(uint8_t version, int64_t early_blocks = 0);
@@ -573,6 +889,49 @@ namespace tools
     bool parse_uri(const std::string &uri, std::string &address, std::string &payment_id, uint64_t &amount, std::string &tx_description, std::string &recipient_name, std::vector<std::string> &unknown_parameters, std::string &error);
 
   private:
+    /*!
+     * \brief what scanning a transaction's outputs found for one tx pubkey
+     *
+     * Indexed by output, only the entries listed in outs are set, and the
+     * vectors are left empty when none is ours.
+     */
+    struct tx_pub_key_scan_info_t
+    {
+      crypto::public_key pub_key;
+      crypto::key_derivation derivation;
+      std::vector<size_t> outs;
+      std::vector<cryptonote::keypair> in_ephemeral;
+      std::vector<crypto::key_image> ki;
+      std::vector<uint64_t> amount;
+      std::vector<rct::key> mask;
+      uint64_t money;
+      bool error;  //!< an output could not be checked
+    };
+    /*!
+     * \brief the read-only part of processing a transaction
+     *
+     * Computed ahead of time for a whole batch of blocks, possibly on other
+     * threads, and handed to process_new_transaction in chain order.
+     */
+    struct tx_scan_info_t
+    {
+      cryptonote::tx_view view;  //!< what the scan and processing walk instead of the tx
+      std::vector<cryptonote::tx_extra_field> tx_extra_fields;
+      bool extra_parsed;
+      bool no_pub_key;
+      std::vector<tx_pub_key_scan_info_t> pub_keys;
+      std::exception_ptr exception;  //!< thrown while scanning, rethrown when processed
+    };
+    /*!
+     * \brief a batch of blocks from the daemon, parsed
+     */
+    struct parsed_blocks_t
+    {
+      std::vector<cryptonote::block> blocks;
+      std::vector<crypto::hash> hashes;
+      std::vector<std::vector<cryptonote::transaction>> txes;
+    };
+
     /*!
      * \brief  Stores wallet information to wallet file.
      * \param  keys_file_name Name of wallet file
@@ -587,17 +946,115 @@ namespace tools
      * \param password       Password of wallet file
      */
     bool load_keys(const std::string& keys_file_name, const std::string& password);
-    void process_new_transaction(const cryptonote::transaction& tx, const std::vector<uint64_t> &o_indices, uint64_t height, uint64_t ts, bool miner_tx, bool pool);
-    void process_new_blockchain_entry(const cryptonote::block& b, const cryptonote::block_complete_entry& bche, const crypto::hash& bl_id, uint64_t height, const cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices &o_indices);
+    void scan_tx_pub_keys(const cryptonote::transaction& tx, tx_scan_info_t &scan) const;
+    void scan_tx_derivations(tx_scan_info_t *const *scans, size_t n) const;
+    void scan_tx_outputs(const cryptonote::transaction& tx, bool miner_tx, const crypto::public_key_precomp &spend_public_key, tx_scan_info_t &scan) const;
+    void scan_tx(const cryptonote::transaction& tx, bool miner_tx, tx_scan_info_t &scan) const;
+    void process_new_transaction(const cryptonote::transaction& tx, const std::vector<uint64_t> &o_indices, uint64_t height, uint64_t ts, bool miner_tx, bool pool, const tx_scan_info_t *scan = NULL);
+    bool scans_block(const cryptonote::block& b, uint64_t height) const;
+    void process_new_blockchain_entry(const cryptonote::block& b, const std::vector<cryptonote::transaction>& txs, const std::vector<tx_scan_info_t>& scans, const crypto::hash& bl_id, uint64_t height, const cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices &o_indices);
     void detach_blockchain(uint64_t height);
     void get_short_chain_history(std::list<crypto::hash>& ids) const;
+    /*!
+     * \brief checks a block from the daemon against the hash seen before at its height
+     *
+     * A trimmed hash cannot be compared. The first block of a response is the
+     * one the daemon found in common with us, so it matches. Any later one is
+     * taken to differ, and gets scanned again.
+     *
+     * \param local_id return-by-reference the hash seen before, null if trimmed
+     * \return true if the block differs from the one seen before
+     */
+    bool is_split(uint64_t height, const crypto::hash &bl_id, uint64_t start_height, crypto::hash &local_id) const;
     bool is_tx_spendtime_unlocked(uint64_t unlock_time, uint64_t block_height) const;
     bool clear();
-    void pull_blocks(uint64_t start_height, uint64_t& blocks_start_height, const std::list<crypto::hash> &short_chain_history, std::list<cryptonote::block_complete_entry> &blocks, std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &o_indices);
+    void pull_blocks(uint64_t start_height, uint64_t& blocks_start_height, const std::list<crypto::hash> &short_chain_history, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &o_indices);
+    /*!
+     * \brief pulls at most max_count blocks, 0 for as many as the daemon sends
+     *
+     * \param current_height return-by-reference the height of the daemon's chain
+     */
+    void pull_blocks(uint64_t start_height, uint64_t max_count, uint64_t& blocks_start_height, uint64_t& current_height, const std::list<crypto::hash> &short_chain_history, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &o_indices);
     void pull_hashes(uint64_t start_height, uint64_t& blocks_start_height, const std::list<crypto::hash> &short_chain_history, std::list<crypto::hash> &hashes);
     void fast_refresh(uint64_t stop_height, uint64_t &blocks_start_height, std::list<crypto::hash> &short_chain_history);
-    void pull_next_blocks(uint64_t start_height, uint64_t &blocks_start_height, std::list<crypto::hash> &short_chain_history, const std::list<cryptonote::block_complete_entry> &prev_blocks, std::list<cryptonote::block_complete_entry> &blocks, std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &o_indices, bool &error);
-    void process_blocks(uint64_t start_height, const std::list<cryptonote::block_complete_entry> &blocks, const std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &o_indices, uint64_t& blocks_added);
+    /*!
+     * \brief skips a chain of just the genesis block ahead to the last checkpoint below stop_height
+     *
+     * Only the checkpoint hashes are pulled. A reorg reaching below them
+     * pulls the blocks it needs again, as for a trimmed chain.
+     *
+     * \return false if the chain was left as it was, fast_refresh can still be used
+     */
+    bool fast_forward(uint64_t stop_height);
+    /*!
+     * \brief a batch of blocks on its way through refresh_blocks
+     */
+    struct refresh_batch_t
+    {
+      uint64_t start_height;
+      std::vector<cryptonote::block_complete_entry> blocks;
+      std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> o_indices;
+      parsed_blocks_t parsed;
+      uint64_t daemon_height;  //!< the daemon's height when pulled
+      uint64_t parse_ms;
+      bool top;  //!< the daemon had no blocks past this batch
+    };
+    /*!
+     * \brief pulls, parses and processes blocks up to the daemon's top
+     *
+     * Each step runs on its own thread: up to m_refresh_prefetch_depth
+     * pulled batches wait to be parsed, and one parsed batch waits to be
+     * processed on the calling thread.
+     *
+     * \param blocks_fetched incremented by the blocks added, also on throw
+     */
+    void refresh_blocks(uint64_t start_height, std::list<crypto::hash> short_chain_history, uint64_t &blocks_fetched);
+    /*!
+     * \brief sizes the next pull from how long the last one took and how large its blocks were
+     */
+    void adapt_refresh_batch_size(uint64_t requested, const std::vector<cryptonote::block_complete_entry> &blocks, uint64_t elapsed_ms);
+    /*!
+     * \brief idles after busy_ms of refresh work, for the cpu share and while paused
+     */
+    void refresh_throttle(uint64_t busy_ms);
+    /*!
+     * \brief rct outputs fetched ahead of the rings they go in, see refill_decoy_pool
+     */
+    struct decoy_pool_t
+    {
+      struct decoy
+      {
+        uint64_t index;
+        crypto::public_key key;
+        rct::key mask;
+        time_t fetched;
+      };
+      std::deque<decoy> recent;  //!< picked over the recent zone
+      std::deque<decoy> older;  //!< picked triangularly over all unlocked outputs
+      uint64_t num_outs;  //!< unlocked rct outputs at the last refill
+      uint64_t num_recent_outs;
+    };
+    /*!
+     * \brief the rings get_outs would build, from the decoy pool
+     *
+     * \return false, with the pool left as it was, if an input is not rct or the pool runs short
+     */
+    template<typename entry>
+    bool get_pooled_outs(std::vector<std::vector<entry>> &outs, const std::list<size_t> &selected_transfers, size_t fake_outputs_count);
+    //! m_scan_pool, created with m_scan_threads if not yet
+    tools::thread_group &scan_pool() const;
+    /*!
+     * \brief asks the daemon which key images are spent, at most
+     *        COMMAND_RPC_IS_KEY_IMAGE_SPENT_MAX_COUNT of them per call
+     *
+     * \param use_bin cleared when the daemon does not know the binary call, which
+     *        later calls then skip
+     * \return a COMMAND_RPC_IS_KEY_IMAGE_SPENT::STATUS for each key image
+     */
+    std::vector<int> get_key_images_spent_status(const std::vector<crypto::key_image> &key_images, bool &use_bin);
+    void process_blocks(uint64_t start_height, const std::vector<cryptonote::block_complete_entry> &blocks, const std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &o_indices, uint64_t& blocks_added);
+    static void parse_blocks(tools::thread_group &pool, const std::vector<cryptonote::block_complete_entry> &blocks, parsed_blocks_t &parsed);
+    void process_parsed_blocks(tools::thread_group &pool, uint64_t start_height, const parsed_blocks_t &parsed, const std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &o_indices, uint64_t& blocks_added);
     uint64_t select_transfers(uint64_t needed_money, std::vector<size_t> unused_transfers_indices, std::list<size_t>& selected_transfers, bool trusted_daemon);
     bool prepare_file_names(const std::string& file_path);
     void process_unconfirmed(const cryptonote::transaction& tx, uint64_t height);
@@ -606,34 +1063,121 @@ namespace tools
     void generate_genesis(cryptonote::block& b);
     void check_genesis(const crypto::hash& genesis_hash) const; //throws
     bool generate_chacha8_key_from_secret_keys(crypto::chacha8_key &key) const;
+    struct cached_chacha8_key
+    {
+      crypto::chacha8_key key;
+      crypto::hash check;  //!< fast hash of the secret keys and of what the key was derived from
+      bool known;
+
+      cached_chacha8_key(): known(false) {}
+      ~cached_chacha8_key() { memset(&check, 0, sizeof(check)); }
+    };
+    crypto::hash get_chacha8_key_check(const void *data, size_t size) const;
+    bool get_cached_chacha8_key(const cached_chacha8_key &cache, const void *data, size_t size, crypto::chacha8_key &key) const;
+    void cache_chacha8_key(cached_chacha8_key &cache, const void *data, size_t size, const crypto::chacha8_key &key) const;
     crypto::hash get_payment_id(const pending_tx &ptx) const;
-    void check_acc_out_precomp(const crypto::public_key &spend_public_key, const cryptonote::tx_out &o, const crypto::key_derivation &derivation, size_t i, bool &received, uint64_t &money_transfered, bool &error) const;
-    void parse_block_round(const cryptonote::blobdata &blob, cryptonote::block &bl, crypto::hash &bl_id, bool &error) const;
+    crypto::public_key_precomp get_spend_public_key_precomp() const;
+    void check_acc_out_precomp(const crypto::public_key_precomp &spend_public_key, const cryptonote::tx_view::output &o, const crypto::key_derivation &derivation, size_t i, bool &received, uint64_t &money_transfered, bool &error) const;
     uint64_t get_upper_tranaction_size_limit();
     std::vector<uint64_t> get_unspent_amounts_vector();
     uint64_t get_fee_multiplier(uint32_t priority, bool use_new_fee) const;
     uint64_t get_dynamic_per_kb_fee_estimate();
     uint64_t get_per_kb_fee();
     float get_output_relatedness(const transfer_details &td0, const transfer_details &td1) const;
+    float get_output_relatedness(const transfer_details &td, const std::unordered_set<crypto::hash> &txids, const std::set<uint64_t> &heights) const;
+    static float get_height_relatedness(uint64_t dh);
     std::vector<size_t> pick_preferred_rct_inputs(uint64_t needed_money) const;
     void set_spent(size_t idx, uint64_t height);
     void set_unspent(size_t idx);
+    /*!
+     * \brief the chain size from which a transfer's height lock is over, or -1 if it is locked by time
+     */
+    uint64_t get_transfer_unlock_height(const transfer_details &td) const;
+    void add_unspent_balance(size_t idx);
+    void remove_unspent_balance(size_t idx);
+    /*!
+     * \brief drops from the unlock queue the transfers the chain has unlocked for good
+     */
+    void prune_unlock_queue();
+    /*!
+     * \brief recomputes the running balance after m_transfers was changed wholesale
+     */
+    void rebuild_balance();
+    void add_confirmed_tx_index(const std::pair<const crypto::hash, confirmed_transfer_details> &confirmed);
+    void remove_confirmed_tx_index(const std::pair<const crypto::hash, confirmed_transfer_details> &confirmed);
+    /*!
+     * \brief recomputes the height indexes after m_payments or m_confirmed_txs were loaded
+     */
+    void rebuild_height_indexes();
+    /*!
+     * \brief marks the current state as stored, the journal records changes from here
+     */
+    void reset_journal();
+    /*!
+     * \brief appends the changes since the last store to the journal
+     * \return false if they cannot be journaled, and a full store is needed
+     */
+    bool append_journal();
+    /*!
+     * \brief serializes the state into the plaintext sections of a cache file,
+     * starting a new journal id
+     */
+    void serialize_cache_sections(std::vector<std::string> &sections);
+    /*!
+     * \brief encrypts the sections in place and writes them as a cache file
+     * \return false if the file could not be written
+     */
+    static bool write_cache_file(const std::string &file, std::vector<std::string> &sections, const crypto::chacha8_key &key);
+    /*!
+     * \brief replays the journal next to the cache file just loaded
+     */
+    void load_journal();
+    /*!
+     * \brief applies a journal record on top of the state it follows
+     * \return false, and leaves the wallet alone, if the record does not follow it
+     */
+    bool apply_journal_record(const journal_record &record);
+    //! applies the payments, outgoing txes and tx keys of a journal record
+    void apply_history_journal_record(const journal_record &record);
+    /*!
+     * \brief reads the header section of a sectioned cache, leaving the history ones for load_history
+     */
+    void load_cache_sections(std::unique_ptr<std::ifstream> stream);
+    /*!
+     * \brief reads the history sections of the cache file if they were not yet
+     *
+     * Every use of m_payments, m_confirmed_txs or m_tx_keys goes after a call to this.
+     * Const getters call it too: the history they see is the same, only read later.
+     */
+    void load_history() const;
     template<typename entry>
     void get_outs(std::vector<std::vector<entry>> &outs, const std::list<size_t> &selected_transfers, size_t fake_outputs_count);
-    bool wallet_generate_key_image_helper(const cryptonote::account_keys& ack, const crypto::public_key& tx_public_key, size_t real_output_index, cryptonote::keypair& in_ephemeral, crypto::key_image& ki);
-    crypto::public_key get_tx_pub_key_from_received_outs(const tools::wallet2::transfer_details &td) const;
+    typedef std::tuple<uint64_t, crypto::public_key, rct::key> rct_ring_entry;
+    /*!
+     * \brief builds a rct tx with the rings get_outs fetched, without calling the daemon, so it may run on a worker thread
+     *
+     * The range proofs and MLSAGs are spread over threads if it is not null.
+     */
+    void construct_tx_rct(const std::vector<cryptonote::tx_destination_entry> &dsts, const std::list<size_t> &selected_transfers, const std::vector<std::vector<rct_ring_entry>> &outs,
+      size_t fake_outputs_count, uint64_t unlock_time, uint64_t fee, const std::vector<uint8_t>& extra, uint64_t upper_transaction_size_limit, cryptonote::transaction& tx, pending_tx &ptx, tools::thread_group *threads = NULL) const;
+    bool wallet_generate_key_image_helper(const cryptonote::account_keys& ack, const crypto::public_key& tx_public_key, size_t real_output_index, cryptonote::keypair& in_ephemeral, crypto::key_image& ki) const;
 
     cryptonote::account_base m_account;
     std::string m_daemon_address;
     std::string m_wallet_file;
     std::string m_keys_file;
-    epee::net_utils::http::http_simple_client m_http_client;
-    std::vector<crypto::hash> m_blockchain;
+    // daemon calls from different threads (refresh prefetch, pool updates, ring fetches) overlap on their own connections
+    tools::http_client_pool m_daemon_clients;
+    hashchain m_blockchain;
     std::atomic<uint64_t> m_local_bc_height; //temporary workaround
     std::unordered_map<crypto::hash, unconfirmed_transfer_details> m_unconfirmed_txs;
     std::unordered_map<crypto::hash, confirmed_transfer_details> m_confirmed_txs;
     std::unordered_map<crypto::hash, payment_details> m_unconfirmed_payments;
     std::unordered_map<crypto::hash, crypto::secret_key> m_tx_keys;
+    // pool txes already scanned, kept up to date with the daemon's pool changes since m_pool_version
+    std::unordered_set<crypto::hash> m_pool_tx_hashes;
+    uint64_t m_pool_version;
+    bool m_pool_tx_hashes_known;
 
     transfer_container m_transfers;
     payment_container m_payments;
@@ -645,8 +1189,16 @@ namespace tools
     uint64_t m_upper_transaction_size_limit; //TODO: auto-calc this value or request from daemon, now use some fixed value
 
     std::atomic<bool> m_run;
+    std::atomic<bool> m_refresh_paused;
+    std::atomic<uint32_t> m_refresh_cpu_share;
+    std::atomic<uint32_t> m_scan_threads;
 
-    boost::mutex m_daemon_rpc_mutex;
+    boost::mutex m_decoy_pool_mutex;
+    // the slow hash deriving the file keys is only done again when the password or the keys change
+    mutable boost::mutex m_chacha8_keys_mutex;
+    mutable cached_chacha8_key m_keys_file_key;
+    mutable cached_chacha8_key m_cache_file_key;
+    decoy_pool_t m_decoy_pool;
 
     i_wallet2_callback* m_callback;
     bool m_testnet;
@@ -662,10 +1214,44 @@ namespace tools
     bool m_auto_refresh;
     uint64_t m_refresh_from_block_height;
     bool m_confirm_missing_payment_id;
+    uint32_t m_refresh_prefetch_depth;
+    uint64_t m_refresh_batch_size;  //!< blocks asked for in a pull, adapted as refresh goes, not stored
+    uint32_t m_decoy_pool_size;  //!< 0 for no decoy pool
+
+    // the journal of changes since the cache file was stored, see append_journal
+    crypto::hash m_journal_id;  //!< random, chosen at each full store
+    bool m_journal_full_store;  //!< a change the journal cannot record was made
+    boost::thread m_background_store;  //!< writing the cache file, see store_in_background
+    std::atomic<bool> m_background_store_failed;
+    uint64_t m_journal_blockchain_size;
+    uint64_t m_journal_transfers_size;
+    std::set<size_t> m_journal_spent;  //!< stored transfers whose spent state changed
+
+    // running balance, not stored, rebuilt from m_transfers on load
+    uint64_t m_unspent_balance;  //!< sum of the unspent transfers
+    std::set<std::pair<uint64_t, size_t>> m_unspent_by_amount;  //!< unspent transfers, by amount
+    std::set<std::pair<uint64_t, size_t>> m_unlock_queue;  //!< unspent transfers which may still be locked, by unlock height
+
+    // height ordered views of m_payments and m_confirmed_txs, not stored;
+    // elements of the unordered containers keep their address until erased
+    std::multimap<uint64_t, const payment_container::value_type*> m_payments_by_height;
+    std::multimap<uint64_t, const std::pair<const crypto::hash, confirmed_transfer_details>*> m_confirmed_txs_by_height;
+    uint64_t m_detach_count;  //!< bumped when payments already seen may be dropped, see get_detach_count
+    std::vector<std::pair<crypto::hash, payment_details>> m_journal_payments;
+    std::unordered_set<crypto::hash> m_journal_confirmed_txs;
+    std::unordered_set<crypto::hash> m_journal_tx_keys;
+
+    // history sections of the cache file still unread, see load_history
+    bool m_history_loaded;
+    std::unique_ptr<std::ifstream> m_cache_stream;  //!< kept open until they are read
+    std::vector<std::pair<uint64_t, cache_section>> m_cache_sections;  //!< file offset and section
+    std::vector<journal_record> m_history_journal;  //!< journal records to apply on top of them
+
+    mutable std::unique_ptr<tools::thread_group> m_scan_pool;  //!< created on first refresh, tx construction or key image export
   };
 }
-BOOST_CLASS_VERSION(tools::wallet2, 16)
-BOOST_CLASS_VERSION(tools::wallet2::transfer_details, 7)
+BOOST_CLASS_VERSION(tools::wallet2, 18)
+BOOST_CLASS_VERSION(tools::wallet2::transfer_details, 8)
 BOOST_CLASS_VERSION(tools::wallet2::payment_details, 1)
 BOOST_CLASS_VERSION(tools::wallet2::unconfirmed_transfer_details, 6)
 BOOST_CLASS_VERSION(tools::wallet2::confirmed_transfer_details, 3)
@@ -676,16 +1262,16 @@ namespace boost
   namespace serialization
   {
     template <class Archive>
-    inline void initialize_transfer_details(Archive &a, tools::wallet2::transfer_details &x, const boost::serialization::version_type ver)
+    inline void initialize_transfer_details(Archive &a, tools::wallet2::transfer_details &x, const cryptonote::transaction_prefix &tx, const boost::serialization::version_type ver)
     {
     }
     template<>
-    inline void initialize_transfer_details(boost::archive::binary_iarchive &a, tools::wallet2::transfer_details &x, const boost::serialization::version_type ver)
+    inline void initialize_transfer_details(boost::archive::binary_iarchive &a, tools::wallet2::transfer_details &x, const cryptonote::transaction_prefix &tx, const boost::serialization::version_type ver)
     {
         if (ver < 1)
         {
           x.m_mask = rct::identity();
-          x.m_amount = x.m_tx.vout[x.m_internal_output_index].amount;
+          x.m_amount = tx.vout[x.m_internal_output_index].amount;
         }
         if (ver < 2)
         {
@@ -693,7 +1279,7 @@ namespace boost
         }
         if (ver < 4)
         {
-          x.m_rct = x.m_tx.vout[x.m_internal_output_index].amount == 0;
+          x.m_rct = tx.vout[x.m_internal_output_index].amount == 0;
         }
         if (ver < 6)
         {
@@ -703,6 +1289,11 @@ namespace boost
         {
           x.m_pk_index = 0;
         }
+        if (ver < 8)
+        {
+          // the whole tx prefix was kept before, only what is used of it is now
+          x.set_tx(tx, cryptonote::get_tx_pub_key_from_extra(tx, x.m_pk_index));
+        }
     }
 
     template <class Archive>
@@ -711,48 +1302,49 @@ namespace boost
       a & x.m_block_height;
       a & x.m_global_output_index;
       a & x.m_internal_output_index;
+      cryptonote::transaction_prefix tx;
       if (ver < 3)
       {
-        cryptonote::transaction tx;
-        a & tx;
-        x.m_tx = (const cryptonote::transaction_prefix&)tx;
-        x.m_txid = cryptonote::get_transaction_hash(tx);
+        cryptonote::transaction full_tx;
+        a & full_tx;
+        tx = (const cryptonote::transaction_prefix&)full_tx;
+        x.m_txid = cryptonote::get_transaction_hash(full_tx);
       }
-      else
+      else if (ver < 8)
       {
-        a & x.m_tx;
+        a & tx;
       }
       a & x.m_spent;
       a & x.m_key_image;
       if (ver < 1)
       {
         // ensure mask and amount are set
-        initialize_transfer_details(a, x, ver);
+        initialize_transfer_details(a, x, tx, ver);
         return;
       }
       a & x.m_mask;
       a & x.m_amount;
       if (ver < 2)
       {
-        initialize_transfer_details(a, x, ver);
+        initialize_transfer_details(a, x, tx, ver);
         return;
       }
       a & x.m_spent_height;
       if (ver < 3)
       {
-        initialize_transfer_details(a, x, ver);
+        initialize_transfer_details(a, x, tx, ver);
         return;
       }
       a & x.m_txid;
       if (ver < 4)
       {
-        initialize_transfer_details(a, x, ver);
+        initialize_transfer_details(a, x, tx, ver);
         return;
       }
       a & x.m_rct;
       if (ver < 5)
       {
-        initialize_transfer_details(a, x, ver);
+        initialize_transfer_details(a, x, tx, ver);
         return;
       }
       if (ver < 6)
@@ -760,16 +1352,24 @@ namespace boost
         // v5 did not properly initialize
         uint8_t u;
         a & u;
-        x.m_key_image_known = true;
+        initialize_transfer_details(a, x, tx, ver);
         return;
       }
       a & x.m_key_image_known;
       if (ver < 7)
       {
-        initialize_transfer_details(a, x, ver);
+        initialize_transfer_details(a, x, tx, ver);
         return;
       }
       a & x.m_pk_index;
+      if (ver < 8)
+      {
+        initialize_transfer_details(a, x, tx, ver);
+        return;
+      }
+      a & x.m_output_key;
+      a & x.m_tx_pub_key;
+      a & x.m_unlock_time;
     }
 
     template <class Archive>
@@ -970,15 +1570,12 @@ namespace tools
       BOOST_FOREACH(size_t idx, selected_transfers)
       {
         const transfer_container::const_iterator it = m_transfers.begin() + idx;
-        THROW_WALLET_EXCEPTION_IF(it->m_tx.vout.size() <= it->m_internal_output_index, error::wallet_internal_error,
-          "m_internal_output_index = " + std::to_string(it->m_internal_output_index) +
-          " is greater or equal to outputs count = " + std::to_string(it->m_tx.vout.size()));
         req.amounts.push_back(it->amount());
       }
 
-      m_daemon_rpc_mutex.lock();
-      bool r = epee::net_utils::invoke_http_bin_remote_command2(m_daemon_address + "/getrandom_outs.bin", req, daemon_resp, m_http_client, 200000);
-      m_daemon_rpc_mutex.unlock();
+      tools::http_client_pool::lease daemon(m_daemon_clients);
+      bool r = epee::net_utils::invoke_http_bin_remote_command2(m_daemon_address + "/getrandom_outs.bin", req, daemon_resp, daemon.get(), 200000);
+      daemon.release();
       THROW_WALLET_EXCEPTION_IF(!r, error::no_connection_to_daemon, "getrandom_outs.bin");
       THROW_WALLET_EXCEPTION_IF(daemon_resp.status == CORE_RPC_STATUS_BUSY, error::daemon_busy, "getrandom_outs.bin");
       THROW_WALLET_EXCEPTION_IF(daemon_resp.status != CORE_RPC_STATUS_OK, error::get_random_outs_error, daemon_resp.status);
@@ -1033,10 +1630,10 @@ namespace tools
       //size_t real_index = src.outputs.size() ? (rand() % src.outputs.size() ):0;
       tx_output_entry real_oe;
       real_oe.first = td.m_global_output_index;
-      real_oe.second.dest = rct::pk2rct(boost::get<txout_to_key>(td.m_tx.vout[td.m_internal_output_index].target).key);
+      real_oe.second.dest = rct::pk2rct(td.get_public_key());
       real_oe.second.mask = rct::identity();
       auto interted_it = src.outputs.insert(it_to_insert, real_oe);
-      src.real_out_tx_key = get_tx_pub_key_from_extra(td.m_tx);
+      src.real_out_tx_key = td.m_tx_pub_key;
       src.real_output = interted_it - src.outputs.begin();
       src.real_output_in_tx_index = td.m_internal_output_index;
       detail::print_source_entry(src);
@@ -129,6 +129,8 @@ struct TransactionHistory
     virtual TransactionInfo * transaction(int index)  const = 0;
     virtual TransactionInfo * transaction(const std::string &id) const = 0;
     virtual std::vector<TransactionInfo*> getAll() const = 0;
+    //! returns up to count transactions starting at offset, for paging through long histories
+    virtual std::vector<TransactionInfo*> getRange(int offset, int count) const = 0;
     virtual void refresh() = 0;
 };
 
@@ -210,6 +212,15 @@ struct WalletListener
      * @brief refreshed - called when wallet refreshed by background thread or explicitly refreshed by calling "refresh" synchronously
      */
     virtual void refreshed() = 0;
+
+    /**
+     * @brief refreshProgress  - called during a refresh, after each batch of blocks
+     * @param height           - wallet blockchain height
+     * @param daemonHeight     - daemon blockchain height
+     * @param blocksScanned    - blocks added since the refresh started
+     * @param blocksPerSecond  - rate of blocks added since the refresh started
+     */
+    virtual void refreshProgress(uint64_t height, uint64_t daemonHeight, uint64_t blocksScanned, double blocksPerSecond) {}
 };
 
 
@@ -369,9 +380,23 @@ struct Wallet
     */
     virtual void startRefresh() = 0;
    /**
-    * @brief pauseRefresh - pause refresh thread
+    * @brief pauseRefresh - pause refresh thread, a refresh in progress waits between two batches of blocks until startRefresh
     */
     virtual void pauseRefresh() = 0;
+   /**
+    * @brief cancelRefresh - stops a refresh in progress, the refresh thread carries on at the next interval
+    */
+    virtual void cancelRefresh() = 0;
+   /**
+    * @brief setRefreshThreads - number of threads scanning blocks, 0 for one per core. Takes effect from the next refresh
+    */
+    virtual void setRefreshThreads(uint32_t threads) = 0;
+    virtual uint32_t refreshThreads() const = 0;
+   /**
+    * @brief setRefreshCpuShare - share of the time, 1 to 100 percent, a refresh keeps its threads busy. Below 100 it idles after each batch of blocks
+    */
+    virtual void setRefreshCpuShare(uint32_t percent) = 0;
+    virtual uint32_t refreshCpuShare() const = 0;
 
     /**
      * @brief refresh - refreshes the wallet, updating transactions from daemon
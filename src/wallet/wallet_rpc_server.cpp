@@ -53,8 +53,41 @@ namespace
   const command_line::arg_descriptor<std::string> arg_rpc_login = {"rpc-login", "Specify username[:password] required for RPC connection"};
   const command_line::arg_descriptor<bool> arg_disable_rpc_login = {"disable-rpc-login", "Disable HTTP authentication for RPC"};
   const command_line::arg_descriptor<bool> arg_confirm_external_bind = {"confirm-external-bind", "Confirm rcp-bind-ip value is NOT a loopback (local) IP"};
+  const command_line::arg_descriptor<std::string> arg_wallet_dir = {"wallet-dir", "Host the wallets of this directory, opened and closed over RPC"};
+  const command_line::arg_descriptor<uint32_t> arg_max_loaded_wallets = {"max-loaded-wallets", "Most hosted wallets kept loaded at once", 64};
+  const command_line::arg_descriptor<uint32_t> arg_wallet_idle_timeout = {"wallet-idle-timeout", "Seconds without calls after which a hosted wallet is stored and unloaded", 600};
+  const command_line::arg_descriptor<std::string> arg_payment_notify_url = {"payment-notify-url", "POST each payment received, in the pool and once mined, as JSON to this URL"};
+
+  // a loaded wallet is refreshed when it has not been for that long
+  constexpr const uint64_t wallet_refresh_interval_ms = 20000;
+  // or as soon as the daemon has new blocks, which is checked that often
+  constexpr const uint64_t daemon_changed_check_ms = 500;
+  // longest the daemon holds a get_events long poll, bounding how long stopping waits for the watcher
+  constexpr const unsigned daemon_watch_seconds = 10;
+  // wait after a failed long poll, as with daemons not having the call
+  constexpr const unsigned daemon_watch_retry_seconds = 20;
 
   constexpr const char default_rpc_username[] = "monero";
+
+  // a continuation token holds one "height:skip" cursor per paged list, "-" for a list that is done
+  std::string cursor_to_token(bool more, const tools::wallet2::height_cursor &cursor)
+  {
+    if (!more)
+      return "-";
+    return std::to_string(cursor.height) + ":" + std::to_string(cursor.skip);
+  }
+
+  bool token_to_cursor(const std::string &token, bool &done, tools::wallet2::height_cursor &cursor)
+  {
+    done = token == "-";
+    if (done)
+      return true;
+    const size_t colon = token.find(':');
+    if (colon == std::string::npos)
+      return false;
+    return epee::string_tools::get_xtype_from_string(cursor.height, token.substr(0, colon)) &&
+        epee::string_tools::get_xtype_from_string(cursor.skip, token.substr(colon + 1));
+  }
 }
 
 namespace tools
@@ -65,11 +98,19 @@ namespace tools
   }
 
   //------------------------------------------------------------------------------------------------------------------------------
-  wallet_rpc_server::wallet_rpc_server(wallet2& w):m_wallet(w), rpc_login_filename(), m_stop(false)
+  wallet_rpc_server::wallet_rpc_server(wallet2& w):m_wallet(&w), rpc_login_filename(), m_stop(false), m_max_loaded_wallets(0), m_wallet_idle_ms(0), m_close_hosted_wallet(false), m_daemon_changed(false)
+  {}
+  //------------------------------------------------------------------------------------------------------------------------------
+  wallet_rpc_server::wallet_rpc_server(const boost::program_options::variables_map& vm, const std::string& wallet_dir):
+    m_wallet(nullptr), rpc_login_filename(), m_stop(false), m_wallet_dir(wallet_dir), m_vm(vm),
+    m_max_loaded_wallets(std::max<uint32_t>(command_line::get_arg(vm, arg_max_loaded_wallets), 1)),
+    m_wallet_idle_ms(command_line::get_arg(vm, arg_wallet_idle_timeout) * (uint64_t)1000), m_close_hosted_wallet(false), m_daemon_changed(false)
   {}
   //------------------------------------------------------------------------------------------------------------------------------
   wallet_rpc_server::~wallet_rpc_server()
   {
+    if (m_wallet && m_payment_callback)
+      m_wallet->callback(nullptr);
     try
     {
       boost::system::error_code ec{};
@@ -81,14 +122,35 @@ namespace tools
   bool wallet_rpc_server::run()
   {
     m_stop = false;
-    m_net_server.add_idle_handler([this](){
-      try {
-        m_wallet.refresh();
-      } catch (const std::exception& ex) {
-        LOG_ERROR("Exception at while refreshing, what=" << ex.what());
-      }
-      return true;
-    }, 20000);
+    m_daemon_changed = false;
+    wallet2 *watch_wallet = m_wallet;
+    if (m_wallet_dir.empty())
+    {
+      uint64_t last_refresh = epee::misc_utils::get_tick_count();
+      m_net_server.add_idle_handler([this, last_refresh]() mutable {
+        const uint64_t now = epee::misc_utils::get_tick_count();
+        if (!m_daemon_changed.exchange(false) && now - last_refresh < wallet_refresh_interval_ms)
+          return true;
+        try {
+          m_wallet->refresh();
+        } catch (const std::exception& ex) {
+          LOG_ERROR("Exception at while refreshing, what=" << ex.what());
+        }
+        last_refresh = epee::misc_utils::get_tick_count();
+        return true;
+      }, daemon_changed_check_ms);
+    }
+    else
+    {
+      m_net_server.add_idle_handler([this](){
+        schedule_hosted_wallets();
+        return true;
+      }, daemon_changed_check_ms);
+      m_watch_wallet = wallet2::make_dummy(m_vm);
+      watch_wallet = m_watch_wallet.get();
+    }
+    if (watch_wallet)
+      m_daemon_watcher = boost::thread([this, watch_wallet]() { watch_daemon(*watch_wallet); });
     m_net_server.add_idle_handler([this](){
       if (m_stop.load(std::memory_order_relaxed))
       {
@@ -99,7 +161,180 @@ namespace tools
     }, 500);
 
     //DO NOT START THIS SERVER IN MORE THEN 1 THREADS WITHOUT REFACTORING
-    return epee::http_server_impl_base<wallet_rpc_server, connection_context>::run(1, true);
+    bool r = epee::http_server_impl_base<wallet_rpc_server, connection_context>::run(1, true);
+    m_stop = true;
+    m_daemon_watcher.interrupt();
+    if (m_daemon_watcher.joinable())
+      m_daemon_watcher.join();
+    for (auto &hosted: m_hosted_wallets)
+      unload_hosted_wallet(hosted.first, hosted.second);
+    return r;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void wallet_rpc_server::watch_daemon(wallet2 &wallet)
+  {
+    uint64_t since = 0;
+    try
+    {
+      while (!m_stop.load(std::memory_order_relaxed))
+      {
+        const uint64_t start = epee::misc_utils::get_tick_count();
+        bool changed = false;
+        if (!wallet.wait_for_daemon_blocks(since, daemon_watch_seconds, changed))
+        {
+          LOG_PRINT_L2("Daemon get_events failed, refreshing on a timer only for a while");
+          boost::this_thread::sleep_for(boost::chrono::seconds(daemon_watch_retry_seconds));
+          continue;
+        }
+        if (changed)
+          m_daemon_changed = true;
+        // the daemon answers at once when all its long poll threads are taken
+        else if (epee::misc_utils::get_tick_count() - start < daemon_watch_seconds * 1000 / 2)
+          boost::this_thread::sleep_for(boost::chrono::milliseconds(wallet_refresh_interval_ms / 10));
+      }
+    }
+    catch (const boost::thread_interrupted&)
+    {
+    }
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool wallet_rpc_server::handle_http_request(const epee::net_utils::http::http_request_info& query_info, epee::net_utils::http::http_response_info& response, connection_context& context)
+  {
+    LOG_PRINT_L2("HTTP [" << epee::string_tools::get_ip_string_from_int32(context.m_remote_ip) << "] " << query_info.m_http_method_str << " " << query_info.m_URI);
+    response.m_response_code = 200;
+    response.m_response_comment = "Ok";
+    bool handled = false;
+    static const std::string wallet_prefix = "/wallet/";
+    if (m_wallet_dir.empty())
+    {
+      handled = query_info.m_URI != "/wallets" && handle_http_request_map(query_info, response, context);
+    }
+    else if (query_info.m_URI.compare(0, wallet_prefix.size(), wallet_prefix) != 0)
+    {
+      // without a wallet, only the hosting calls and metrics
+      handled = (query_info.m_URI == "/wallets" || query_info.m_URI == "/metrics") && handle_http_request_map(query_info, response, context);
+    }
+    else
+    {
+      const size_t slash = query_info.m_URI.find('/', wallet_prefix.size());
+      auto it = m_hosted_wallets.end();
+      if (slash != std::string::npos)
+        it = m_hosted_wallets.find(query_info.m_URI.substr(wallet_prefix.size(), slash - wallet_prefix.size()));
+      if (it != m_hosted_wallets.end())
+      {
+        try
+        {
+          m_wallet = &load_hosted_wallet(it->second);
+        }
+        catch (const std::exception &e)
+        {
+          LOG_ERROR("Failed to load wallet " << it->first << ": " << e.what());
+          response.m_response_code = 500;
+          response.m_response_comment = "Internal Server Error";
+          return true;
+        }
+        epee::net_utils::http::http_request_info call_info = query_info;
+        call_info.m_URI = query_info.m_URI.substr(slash);
+        m_close_hosted_wallet = false;
+        handled = call_info.m_URI != "/wallets" && handle_http_request_map(call_info, response, context);
+        it->second.last_used = epee::misc_utils::get_tick_count();
+        m_wallet = nullptr;
+        if (m_close_hosted_wallet)
+          m_hosted_wallets.erase(it);
+      }
+    }
+    if (!handled)
+    {
+      response.m_response_code = 404;
+      response.m_response_comment = "Not found";
+    }
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  wallet2 &wallet_rpc_server::load_hosted_wallet(hosted_wallet &hosted)
+  {
+    if (!hosted.wallet)
+    {
+      size_t loaded = 0;
+      for (const auto &i: m_hosted_wallets)
+        loaded += i.second.wallet ? 1 : 0;
+      while (loaded >= m_max_loaded_wallets)
+      {
+        auto lru = m_hosted_wallets.end();
+        for (auto i = m_hosted_wallets.begin(); i != m_hosted_wallets.end(); ++i)
+          if (i->second.wallet && (lru == m_hosted_wallets.end() || i->second.last_used < lru->second.last_used))
+            lru = i;
+        if (lru == m_hosted_wallets.end() || !unload_hosted_wallet(lru->first, lru->second))
+          break;
+        --loaded;
+      }
+
+      std::unique_ptr<wallet2> wallet = wallet2::make_dummy(m_vm);
+      if (!wallet)
+        throw std::runtime_error("bad daemon options");
+      // hosted wallets take turns on the server thread, scanning adds no threads of its own
+      wallet->scan_threads(1);
+      wallet->load(hosted.file, hosted.password);
+      wallet->callback(hosted.callback.get());
+      hosted.wallet = std::move(wallet);
+      hosted.last_refresh = 0;
+      LOG_PRINT_L1("Loaded wallet " << hosted.file);
+    }
+    hosted.last_used = epee::misc_utils::get_tick_count();
+    return *hosted.wallet;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool wallet_rpc_server::unload_hosted_wallet(const std::string &id, hosted_wallet &hosted)
+  {
+    if (!hosted.wallet)
+      return true;
+    try
+    {
+      hosted.wallet->store();
+    }
+    catch (const std::exception &e)
+    {
+      LOG_ERROR("Failed to store wallet " << id << ", keeping it loaded: " << e.what());
+      return false;
+    }
+    hosted.wallet.reset();
+    LOG_PRINT_L1("Stored and unloaded wallet " << id);
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void wallet_rpc_server::schedule_hosted_wallets()
+  {
+    const uint64_t now = epee::misc_utils::get_tick_count();
+    if (m_daemon_changed.exchange(false))
+    {
+      // new blocks: each loaded wallet is due, and they take their turns
+      for (auto &i: m_hosted_wallets)
+        i.second.last_refresh = 0;
+    }
+    hosted_wallet *next = nullptr;
+    for (auto &i: m_hosted_wallets)
+    {
+      hosted_wallet &hosted = i.second;
+      if (!hosted.wallet)
+        continue;
+      if (now - hosted.last_used > m_wallet_idle_ms && unload_hosted_wallet(i.first, hosted))
+        continue;
+      if (now - hosted.last_refresh >= wallet_refresh_interval_ms && (!next || hosted.last_refresh < next->last_refresh))
+        next = &hosted;
+    }
+    // one wallet a turn, so calls do not wait behind all of them
+    if (next)
+    {
+      try
+      {
+        next->wallet->refresh();
+      }
+      catch (const std::exception& ex)
+      {
+        LOG_ERROR("Exception at while refreshing " << next->file << ", what=" << ex.what());
+      }
+      next->last_refresh = epee::misc_utils::get_tick_count();
+    }
   }
   //------------------------------------------------------------------------------------------------------------------------------
   bool wallet_rpc_server::init(const boost::program_options::variables_map& vm)
@@ -195,6 +430,18 @@ namespace tools
       LOG_PRINT_L0(tr("RPC username/password is stored in file ") << temp);
     } // end auth enabled
 
+    const std::string payment_notify_url = command_line::get_arg(vm, arg_payment_notify_url);
+    if (!payment_notify_url.empty())
+    {
+      m_payment_notifier.reset(new payment_notifier(payment_notify_url));
+      if (m_wallet)
+      {
+        m_payment_callback.reset(new payment_notifier::callback(*m_payment_notifier, std::string()));
+        m_wallet->callback(m_payment_callback.get());
+      }
+      LOG_PRINT_L0(tr("Payments will be posted to ") << payment_notify_url);
+    }
+
     m_net_server.set_threads_prefix("RPC");
     return epee::http_server_impl_base<wallet_rpc_server, connection_context>::init(
       std::move(bind_port), std::move(bind_ip), std::string{}, boost::make_optional(!disable_auth, std::move(login))
@@ -205,8 +452,8 @@ namespace tools
   {
     try
     {
-      res.balance = m_wallet.balance();
-      res.unlocked_balance = m_wallet.unlocked_balance();
+      res.balance = m_wallet->balance();
+      res.unlocked_balance = m_wallet->unlocked_balance();
     }
     catch (std::exception& e)
     {
@@ -221,7 +468,7 @@ namespace tools
   {
     try
     {
-      res.address = m_wallet.get_account().get_public_address_str(m_wallet.testnet());
+      res.address = m_wallet->get_account().get_public_address_str(m_wallet->testnet());
     }
     catch (std::exception& e)
     {
@@ -236,7 +483,7 @@ namespace tools
   {
     try
     {
-      res.height = m_wallet.get_blockchain_current_height();
+      res.height = m_wallet->get_blockchain_current_height();
     }
     catch (std::exception& e)
     {
@@ -256,7 +503,7 @@ namespace tools
       cryptonote::tx_destination_entry de;
       bool has_payment_id;
       crypto::hash8 new_payment_id;
-      if(!get_account_integrated_address_from_str(de.addr, has_payment_id, new_payment_id, m_wallet.testnet(), it->address))
+      if(!get_account_integrated_address_from_str(de.addr, has_payment_id, new_payment_id, m_wallet->testnet(), it->address))
       {
         er.code = WALLET_RPC_ERROR_CODE_WRONG_ADDRESS;
         er.message = std::string("WALLET_RPC_ERROR_CODE_WRONG_ADDRESS: ") + it->address;
@@ -326,7 +573,7 @@ namespace tools
     std::vector<cryptonote::tx_destination_entry> dsts;
     std::vector<uint8_t> extra;
 
-    if (m_wallet.restricted())
+    if (m_wallet->restricted())
     {
       er.code = WALLET_RPC_ERROR_CODE_DENIED;
       er.message = "Command unavailable in restricted mode.";
@@ -342,11 +589,11 @@ namespace tools
     try
     {
       uint64_t mixin = req.mixin;
-      if (mixin < 2 && m_wallet.use_fork_rules(2, 10)) {
+      if (mixin < 2 && m_wallet->use_fork_rules(2, 10)) {
         LOG_PRINT_L1("Requested mixin " << req.mixin << " too low for hard fork 2, using 2");
         mixin = 2;
       }
-      std::vector<wallet2::pending_tx> ptx_vector = m_wallet.create_transactions_2(dsts, mixin, req.unlock_time, req.priority, extra, req.trusted_daemon);
+      std::vector<wallet2::pending_tx> ptx_vector = m_wallet->create_transactions_2(dsts, mixin, req.unlock_time, req.priority, extra, req.trusted_daemon);
 
       // reject proposed transactions if there are more than one.  see on_transfer_split below.
       if (ptx_vector.size() != 1)
@@ -356,7 +603,7 @@ namespace tools
         return false;
       }
 
-      m_wallet.commit_tx(ptx_vector);
+      m_wallet->commit_tx(ptx_vector);
 
       // populate response with tx hash
       res.tx_hash = epee::string_tools::pod_to_hex(cryptonote::get_transaction_hash(ptx_vector.back().tx));
@@ -394,7 +641,7 @@ namespace tools
     std::vector<cryptonote::tx_destination_entry> dsts;
     std::vector<uint8_t> extra;
 
-    if (m_wallet.restricted())
+    if (m_wallet->restricted())
     {
       er.code = WALLET_RPC_ERROR_CODE_DENIED;
       er.message = "Command unavailable in restricted mode.";
@@ -410,14 +657,14 @@ namespace tools
     try
     {
       uint64_t mixin = req.mixin;
-      if (mixin < 2 && m_wallet.use_fork_rules(2, 10)) {
+      if (mixin < 2 && m_wallet->use_fork_rules(2, 10)) {
         LOG_PRINT_L1("Requested mixin " << req.mixin << " too low for hard fork 2, using 2");
         mixin = 2;
       }
       std::vector<wallet2::pending_tx> ptx_vector;
-      ptx_vector = m_wallet.create_transactions_2(dsts, mixin, req.unlock_time, req.priority, extra, req.trusted_daemon);
+      ptx_vector = m_wallet->create_transactions_2(dsts, mixin, req.unlock_time, req.priority, extra, req.trusted_daemon);
 
-      m_wallet.commit_tx(ptx_vector);
+      m_wallet->commit_tx(ptx_vector);
 
       // populate response with tx hashes
       for (auto & ptx : ptx_vector)
@@ -455,7 +702,7 @@ namespace tools
   //------------------------------------------------------------------------------------------------------------------------------
   bool wallet_rpc_server::on_sweep_dust(const wallet_rpc::COMMAND_RPC_SWEEP_DUST::request& req, wallet_rpc::COMMAND_RPC_SWEEP_DUST::response& res, epee::json_rpc::error& er)
   {
-    if (m_wallet.restricted())
+    if (m_wallet->restricted())
     {
       er.code = WALLET_RPC_ERROR_CODE_DENIED;
       er.message = "Command unavailable in restricted mode.";
@@ -464,9 +711,9 @@ namespace tools
 
     try
     {
-      std::vector<wallet2::pending_tx> ptx_vector = m_wallet.create_unmixable_sweep_transactions(req.trusted_daemon);
+      std::vector<wallet2::pending_tx> ptx_vector = m_wallet->create_unmixable_sweep_transactions(req.trusted_daemon);
 
-      m_wallet.commit_tx(ptx_vector);
+      m_wallet->commit_tx(ptx_vector);
 
       // populate response with tx hashes
       for (auto & ptx : ptx_vector)
@@ -507,7 +754,7 @@ namespace tools
     std::vector<cryptonote::tx_destination_entry> dsts;
     std::vector<uint8_t> extra;
 
-    if (m_wallet.restricted())
+    if (m_wallet->restricted())
     {
       er.code = WALLET_RPC_ERROR_CODE_DENIED;
       er.message = "Command unavailable in restricted mode.";
@@ -526,9 +773,9 @@ namespace tools
 
     try
     {
-      std::vector<wallet2::pending_tx> ptx_vector = m_wallet.create_transactions_all(dsts[0].addr, req.mixin, req.unlock_time, req.priority, extra, req.trusted_daemon);
+      std::vector<wallet2::pending_tx> ptx_vector = m_wallet->create_transactions_all(dsts[0].addr, req.mixin, req.unlock_time, req.priority, extra, req.trusted_daemon);
 
-      m_wallet.commit_tx(ptx_vector);
+      m_wallet->commit_tx(ptx_vector);
 
       // populate response with tx hashes
       for (auto & ptx : ptx_vector)
@@ -583,7 +830,7 @@ namespace tools
         }
       }
 
-      res.integrated_address = m_wallet.get_account().get_public_integrated_address_str(payment_id, m_wallet.testnet());
+      res.integrated_address = m_wallet->get_account().get_public_integrated_address_str(payment_id, m_wallet->testnet());
       res.payment_id = epee::string_tools::pod_to_hex(payment_id);
       return true;
     }
@@ -604,7 +851,7 @@ namespace tools
       crypto::hash8 payment_id;
       bool has_payment_id;
 
-      if(!get_account_integrated_address_from_str(address, has_payment_id, payment_id, m_wallet.testnet(), req.integrated_address))
+      if(!get_account_integrated_address_from_str(address, has_payment_id, payment_id, m_wallet->testnet(), req.integrated_address))
       {
         er.code = WALLET_RPC_ERROR_CODE_WRONG_ADDRESS;
         er.message = "Invalid address";
@@ -616,7 +863,7 @@ namespace tools
         er.message = "Address is not an integrated address";
         return false;
       }
-      res.standard_address = get_account_address_as_str(m_wallet.testnet(),address);
+      res.standard_address = get_account_address_as_str(m_wallet->testnet(),address);
       res.payment_id = epee::string_tools::pod_to_hex(payment_id);
       return true;
     }
@@ -631,7 +878,7 @@ namespace tools
   //------------------------------------------------------------------------------------------------------------------------------
   bool wallet_rpc_server::on_store(const wallet_rpc::COMMAND_RPC_STORE::request& req, wallet_rpc::COMMAND_RPC_STORE::response& res, epee::json_rpc::error& er)
   {
-    if (m_wallet.restricted())
+    if (m_wallet->restricted())
     {
       er.code = WALLET_RPC_ERROR_CODE_DENIED;
       er.message = "Command unavailable in restricted mode.";
@@ -640,7 +887,10 @@ namespace tools
 
     try
     {
-      m_wallet.store();
+      if (req.background)
+        m_wallet->store_in_background();
+      else
+        m_wallet->store();
     }
     catch (std::exception& e)
     {
@@ -682,7 +932,7 @@ namespace tools
 
     res.payments.clear();
     std::list<wallet2::payment_details> payment_list;
-    m_wallet.get_payments(payment_id, payment_list);
+    m_wallet->get_payments(payment_id, payment_list);
     for (auto & payment : payment_list)
     {
       wallet_rpc::payment_details rpc_payment;
@@ -704,8 +954,18 @@ namespace tools
     /* If the payment ID list is empty, we get payments to any payment ID (or lack thereof) */
     if (req.payment_ids.empty())
     {
+      bool done = false;
+      wallet2::height_cursor cursor;
+      if (!req.continuation.empty() && (!token_to_cursor(req.continuation, done, cursor) || done))
+      {
+        er.code = WALLET_RPC_ERROR_CODE_WRONG_CONTINUATION;
+        er.message = "Invalid continuation: " + req.continuation;
+        return false;
+      }
+
       std::list<std::pair<crypto::hash,wallet2::payment_details>> payment_list;
-      m_wallet.get_payments(payment_list, req.min_block_height);
+      if (m_wallet->get_payments(payment_list, req.min_block_height, (uint64_t)-1, req.limit, cursor))
+        res.continuation = cursor_to_token(true, cursor);
 
       for (auto & payment : payment_list)
       {
@@ -754,7 +1014,7 @@ namespace tools
       }
 
       std::list<wallet2::payment_details> payment_list;
-      m_wallet.get_payments(payment_id, payment_list, req.min_block_height);
+      m_wallet->get_payments(payment_id, payment_list, req.min_block_height);
 
       for (auto & payment : payment_list)
       {
@@ -793,35 +1053,63 @@ namespace tools
       available = false;
     }
 
-    wallet2::transfer_container transfers;
-    m_wallet.get_transfers(transfers);
+    // the continuation is the index of the next transfer
+    size_t start = 0;
+    if (!req.continuation.empty() && !epee::string_tools::get_xtype_from_string(start, req.continuation))
+    {
+      er.code = WALLET_RPC_ERROR_CODE_WRONG_CONTINUATION;
+      er.message = "Invalid continuation: " + req.continuation;
+      return false;
+    }
 
-    bool transfers_found = false;
-    for (const auto& td : transfers)
+    const size_t num_transfers = m_wallet->get_num_transfer_details();
+    size_t returned = 0;
+    std::vector<crypto::hash> txids;
+    for (size_t i = start; i < num_transfers; ++i)
     {
+      const wallet2::transfer_details &td = m_wallet->get_transfer_details(i);
       if (!filter || available != td.m_spent)
       {
-        if (!transfers_found)
+        if (req.limit && returned == req.limit)
         {
-          transfers_found = true;
+          res.continuation = std::to_string(i);
+          break;
         }
-        auto txBlob = t_serializable_object_to_blob(td.m_tx);
+        ++returned;
         wallet_rpc::transfer_details rpc_transfers;
         rpc_transfers.amount       = td.amount();
         rpc_transfers.spent        = td.m_spent;
         rpc_transfers.global_index = td.m_global_output_index;
         rpc_transfers.tx_hash      = epee::string_tools::pod_to_hex(td.m_txid);
-        rpc_transfers.tx_size      = txBlob.size();
+        rpc_transfers.tx_size      = 0;
         res.transfers.push_back(rpc_transfers);
+        txids.push_back(td.m_txid);
       }
     }
 
+    // the wallet does not keep the txes, their sizes come from the daemon
+    std::unordered_map<crypto::hash, cryptonote::blobdata> blobs;
+    if (m_wallet->get_tx_blobs(txids, blobs))
+    {
+      auto txid = txids.begin();
+      for (wallet_rpc::transfer_details &rpc_transfers: res.transfers)
+      {
+        const auto it = blobs.find(*txid++);
+        if (it != blobs.end())
+          rpc_transfers.tx_size = it->second.size();
+      }
+    }
+    else
+    {
+      LOG_PRINT_L1("Failed to get txes from the daemon, tx sizes are not reported");
+    }
+
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
   bool wallet_rpc_server::on_query_key(const wallet_rpc::COMMAND_RPC_QUERY_KEY::request& req, wallet_rpc::COMMAND_RPC_QUERY_KEY::response& res, epee::json_rpc::error& er)
   {
-      if (m_wallet.restricted())
+      if (m_wallet->restricted())
       {
         er.code = WALLET_RPC_ERROR_CODE_DENIED;
         er.message = "Command unavailable in restricted mode.";
@@ -830,7 +1118,7 @@ namespace tools
 
       if (req.key_type.compare("mnemonic") == 0)
       {
-        if (!m_wallet.get_seed(res.key))
+        if (!m_wallet->get_seed(res.key))
         {
             er.message = "The wallet is non-deterministic. Cannot display seed.";
             return false;
@@ -838,7 +1126,7 @@ namespace tools
       }
       else if(req.key_type.compare("view_key") == 0)
       {
-          res.key = string_tools::pod_to_hex(m_wallet.get_account().get_keys().m_view_secret_key);
+          res.key = string_tools::pod_to_hex(m_wallet->get_account().get_keys().m_view_secret_key);
       }
       else
       {
@@ -851,7 +1139,7 @@ namespace tools
   //------------------------------------------------------------------------------------------------------------------------------
   bool wallet_rpc_server::on_rescan_blockchain(const wallet_rpc::COMMAND_RPC_RESCAN_BLOCKCHAIN::request& req, wallet_rpc::COMMAND_RPC_RESCAN_BLOCKCHAIN::response& res, epee::json_rpc::error& er)
   {
-    if (m_wallet.restricted())
+    if (m_wallet->restricted())
     {
       er.code = WALLET_RPC_ERROR_CODE_DENIED;
       er.message = "Command unavailable in restricted mode.";
@@ -860,7 +1148,7 @@ namespace tools
 
     try
     {
-      m_wallet.rescan_blockchain();
+      m_wallet->rescan_blockchain();
     }
     catch (std::exception& e)
     {
@@ -873,20 +1161,20 @@ namespace tools
   //------------------------------------------------------------------------------------------------------------------------------
   bool wallet_rpc_server::on_sign(const wallet_rpc::COMMAND_RPC_SIGN::request& req, wallet_rpc::COMMAND_RPC_SIGN::response& res, epee::json_rpc::error& er)
   {
-    if (m_wallet.restricted())
+    if (m_wallet->restricted())
     {
       er.code = WALLET_RPC_ERROR_CODE_DENIED;
       er.message = "Command unavailable in restricted mode.";
       return false;
     }
 
-    res.signature = m_wallet.sign(req.data);
+    res.signature = m_wallet->sign(req.data);
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
   bool wallet_rpc_server::on_verify(const wallet_rpc::COMMAND_RPC_VERIFY::request& req, wallet_rpc::COMMAND_RPC_VERIFY::response& res, epee::json_rpc::error& er)
   {
-    if (m_wallet.restricted())
+    if (m_wallet->restricted())
     {
       er.code = WALLET_RPC_ERROR_CODE_DENIED;
       er.message = "Command unavailable in restricted mode.";
@@ -896,20 +1184,20 @@ namespace tools
     cryptonote::account_public_address address;
     bool has_payment_id;
     crypto::hash8 payment_id;
-    if(!get_account_integrated_address_from_str(address, has_payment_id, payment_id, m_wallet.testnet(), req.address))
+    if(!get_account_integrated_address_from_str(address, has_payment_id, payment_id, m_wallet->testnet(), req.address))
     {
       er.code = WALLET_RPC_ERROR_CODE_WRONG_ADDRESS;
       er.message = "";
       return false;
     }
 
-    res.good = m_wallet.verify(req.data, address, req.signature);
+    res.good = m_wallet->verify(req.data, address, req.signature);
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
   bool wallet_rpc_server::on_stop_wallet(const wallet_rpc::COMMAND_RPC_STOP_WALLET::request& req, wallet_rpc::COMMAND_RPC_STOP_WALLET::response& res, epee::json_rpc::error& er)
   {
-    if (m_wallet.restricted())
+    if (m_wallet->restricted())
     {
       er.code = WALLET_RPC_ERROR_CODE_DENIED;
       er.message = "Command unavailable in restricted mode.";
@@ -918,8 +1206,12 @@ namespace tools
 
     try
     {
-      m_wallet.store();
-      m_stop.store(true, std::memory_order_relaxed);
+      m_wallet->store();
+      // a hosted wallet is closed, the others are still served
+      if (m_wallet_dir.empty())
+        m_stop.store(true, std::memory_order_relaxed);
+      else
+        m_close_hosted_wallet = true;
     }
     catch (std::exception& e)
     {
@@ -959,7 +1251,7 @@ namespace tools
     std::list<std::string>::const_iterator in = req.notes.begin();
     while (il != txids.end())
     {
-      m_wallet.set_tx_note(*il++, *in++);
+      m_wallet->set_tx_note(*il++, *in++);
     }
 
     return true;
@@ -988,14 +1280,14 @@ namespace tools
     std::list<crypto::hash>::const_iterator il = txids.begin();
     while (il != txids.end())
     {
-      res.notes.push_back(m_wallet.get_tx_note(*il++));
+      res.notes.push_back(m_wallet->get_tx_note(*il++));
     }
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
   bool wallet_rpc_server::on_get_transfers(const wallet_rpc::COMMAND_RPC_GET_TRANSFERS::request& req, wallet_rpc::COMMAND_RPC_GET_TRANSFERS::response& res, epee::json_rpc::error& er)
   {
-    if (m_wallet.restricted())
+    if (m_wallet->restricted())
     {
       er.code = WALLET_RPC_ERROR_CODE_DENIED;
       er.message = "Command unavailable in restricted mode.";
@@ -1009,10 +1301,28 @@ namespace tools
       max_height = req.max_height;
     }
 
-    if (req.in)
+    // the continuation is "<in>,<out>", pending, failed and pool only come with the first page
+    bool in_done = false, out_done = false;
+    tools::wallet2::height_cursor in_cursor, out_cursor;
+    const bool first_page = req.continuation.empty();
+    if (!first_page)
+    {
+      const size_t comma = req.continuation.find(',');
+      if (comma == std::string::npos ||
+          !token_to_cursor(req.continuation.substr(0, comma), in_done, in_cursor) ||
+          !token_to_cursor(req.continuation.substr(comma + 1), out_done, out_cursor))
+      {
+        er.code = WALLET_RPC_ERROR_CODE_WRONG_CONTINUATION;
+        er.message = "Invalid continuation: " + req.continuation;
+        return false;
+      }
+    }
+    bool in_more = false, out_more = false;
+
+    if (req.in && !in_done)
     {
       std::list<std::pair<crypto::hash, tools::wallet2::payment_details>> payments;
-      m_wallet.get_payments(payments, min_height, max_height);
+      in_more = m_wallet->get_payments(payments, min_height, max_height, req.limit, in_cursor);
       for (std::list<std::pair<crypto::hash, tools::wallet2::payment_details>>::const_iterator i = payments.begin(); i != payments.end(); ++i) {
         res.in.push_back(wallet_rpc::COMMAND_RPC_GET_TRANSFERS::entry());
         wallet_rpc::COMMAND_RPC_GET_TRANSFERS::entry &entry = res.in.back();
@@ -1026,14 +1336,14 @@ namespace tools
         entry.timestamp = pd.m_timestamp;
         entry.amount = pd.m_amount;
         entry.fee = 0; // TODO
-        entry.note = m_wallet.get_tx_note(pd.m_tx_hash);
+        entry.note = m_wallet->get_tx_note(pd.m_tx_hash);
       }
     }
 
-    if (req.out)
+    if (req.out && !out_done)
     {
       std::list<std::pair<crypto::hash, tools::wallet2::confirmed_transfer_details>> payments;
-      m_wallet.get_payments_out(payments, min_height, max_height);
+      out_more = m_wallet->get_payments_out(payments, min_height, max_height, req.limit, out_cursor);
       for (std::list<std::pair<crypto::hash, tools::wallet2::confirmed_transfer_details>>::const_iterator i = payments.begin(); i != payments.end(); ++i) {
         res.out.push_back(wallet_rpc::COMMAND_RPC_GET_TRANSFERS::entry());
         wallet_rpc::COMMAND_RPC_GET_TRANSFERS::entry &entry = res.out.back();
@@ -1048,20 +1358,23 @@ namespace tools
         entry.fee = pd.m_amount_in - pd.m_amount_out;
         uint64_t change = pd.m_change == (uint64_t)-1 ? 0 : pd.m_change; // change may not be known
         entry.amount = pd.m_amount_in - change - entry.fee;
-        entry.note = m_wallet.get_tx_note(i->first);
+        entry.note = m_wallet->get_tx_note(i->first);
 
         for (const auto &d: pd.m_dests) {
           entry.destinations.push_back(wallet_rpc::transfer_destination());
           wallet_rpc::transfer_destination &td = entry.destinations.back();
           td.amount = d.amount;
-          td.address = get_account_address_as_str(m_wallet.testnet(), d.addr);
+          td.address = get_account_address_as_str(m_wallet->testnet(), d.addr);
         }
       }
     }
 
-    if (req.pending || req.failed) {
+    if (in_more || out_more)
+      res.continuation = cursor_to_token(in_more, in_cursor) + "," + cursor_to_token(out_more, out_cursor);
+
+    if (first_page && (req.pending || req.failed)) {
       std::list<std::pair<crypto::hash, tools::wallet2::unconfirmed_transfer_details>> upayments;
-      m_wallet.get_unconfirmed_payments_out(upayments);
+      m_wallet->get_unconfirmed_payments_out(upayments);
       for (std::list<std::pair<crypto::hash, tools::wallet2::unconfirmed_transfer_details>>::const_iterator i = upayments.begin(); i != upayments.end(); ++i) {
         const tools::wallet2::unconfirmed_transfer_details &pd = i->second;
         bool is_failed = pd.m_state == tools::wallet2::unconfirmed_transfer_details::failed;
@@ -1080,16 +1393,16 @@ namespace tools
         entry.timestamp = pd.m_timestamp;
         entry.fee = pd.m_amount_in - pd.m_amount_out;
         entry.amount = pd.m_amount_in - pd.m_change - entry.fee;
-        entry.note = m_wallet.get_tx_note(i->first);
+        entry.note = m_wallet->get_tx_note(i->first);
       }
     }
 
-    if (req.pool)
+    if (first_page && req.pool)
     {
-      m_wallet.update_pool_state();
+      m_wallet->update_pool_state();
 
       std::list<std::pair<crypto::hash, tools::wallet2::payment_details>> payments;
-      m_wallet.get_unconfirmed_payments(payments);
+      m_wallet->get_unconfirmed_payments(payments);
       for (std::list<std::pair<crypto::hash, tools::wallet2::payment_details>>::const_iterator i = payments.begin(); i != payments.end(); ++i) {
         res.pool.push_back(wallet_rpc::COMMAND_RPC_GET_TRANSFERS::entry());
         wallet_rpc::COMMAND_RPC_GET_TRANSFERS::entry &entry = res.pool.back();
@@ -1103,7 +1416,7 @@ namespace tools
         entry.timestamp = pd.m_timestamp;
         entry.amount = pd.m_amount;
         entry.fee = 0; // TODO
-        entry.note = m_wallet.get_tx_note(pd.m_tx_hash);
+        entry.note = m_wallet->get_tx_note(pd.m_tx_hash);
       }
     }
 
@@ -1114,7 +1427,7 @@ namespace tools
   {
     try
     {
-      std::vector<std::pair<crypto::key_image, crypto::signature>> ski = m_wallet.export_key_images();
+      std::vector<std::pair<crypto::key_image, crypto::signature>> ski = m_wallet->export_key_images();
       res.signed_key_images.resize(ski.size());
       for (size_t n = 0; n < ski.size(); ++n)
       {
@@ -1160,7 +1473,7 @@ namespace tools
         ski[n].second = *reinterpret_cast<const crypto::signature*>(bd.data());
       }
       uint64_t spent = 0, unspent = 0;
-      uint64_t height = m_wallet.import_key_images(ski, spent, unspent);
+      uint64_t height = m_wallet->import_key_images(ski, spent, unspent);
       res.spent = spent;
       res.unspent = unspent;
       res.height = height;
@@ -1176,10 +1489,61 @@ namespace tools
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  bool wallet_rpc_server::on_export_key_images_bin(const wallet_rpc::COMMAND_RPC_EXPORT_KEY_IMAGES_BIN::request& req, wallet_rpc::COMMAND_RPC_EXPORT_KEY_IMAGES_BIN::response& res)
+  {
+    try
+    {
+      std::vector<std::pair<crypto::key_image, crypto::signature>> ski = m_wallet->export_key_images();
+      res.key_images.reserve(ski.size());
+      res.signatures.reserve(ski.size());
+      for (const auto &i: ski)
+      {
+        res.key_images.push_back(i.first);
+        res.signatures.push_back(i.second);
+      }
+    }
+    catch (const std::exception &e)
+    {
+      res.status = std::string("Failed to export key images: ") + e.what();
+      return true;
+    }
+
+    res.status = WALLET_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool wallet_rpc_server::on_import_key_images_bin(const wallet_rpc::COMMAND_RPC_IMPORT_KEY_IMAGES_BIN::request& req, wallet_rpc::COMMAND_RPC_IMPORT_KEY_IMAGES_BIN::response& res)
+  {
+    if (req.key_images.size() != req.signatures.size())
+    {
+      res.status = "Key images and signatures counts differ";
+      return true;
+    }
+    try
+    {
+      std::vector<std::pair<crypto::key_image, crypto::signature>> ski;
+      ski.reserve(req.key_images.size());
+      for (size_t n = 0; n < req.key_images.size(); ++n)
+        ski.push_back(std::make_pair(req.key_images[n], req.signatures[n]));
+      uint64_t spent = 0, unspent = 0;
+      res.height = m_wallet->import_key_images(ski, spent, unspent);
+      res.spent = spent;
+      res.unspent = unspent;
+    }
+    catch (const std::exception &e)
+    {
+      res.status = std::string("Failed to import key images: ") + e.what();
+      return true;
+    }
+
+    res.status = WALLET_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
   bool wallet_rpc_server::on_make_uri(const wallet_rpc::COMMAND_RPC_MAKE_URI::request& req, wallet_rpc::COMMAND_RPC_MAKE_URI::response& res, epee::json_rpc::error& er)
   {
     std::string error;
-    std::string uri = m_wallet.make_uri(req.address, req.payment_id, req.amount, req.tx_description, req.recipient_name, error);
+    std::string uri = m_wallet->make_uri(req.address, req.payment_id, req.amount, req.tx_description, req.recipient_name, error);
     if (uri.empty())
     {
       er.code = WALLET_RPC_ERROR_CODE_WRONG_URI;
@@ -1194,7 +1558,7 @@ namespace tools
   bool wallet_rpc_server::on_parse_uri(const wallet_rpc::COMMAND_RPC_PARSE_URI::request& req, wallet_rpc::COMMAND_RPC_PARSE_URI::response& res, epee::json_rpc::error& er)
   {
     std::string error;
-    if (!m_wallet.parse_uri(req.uri, res.uri.address, res.uri.payment_id, res.uri.amount, res.uri.tx_description, res.uri.recipient_name, res.unknown_parameters, error))
+    if (!m_wallet->parse_uri(req.uri, res.uri.address, res.uri.payment_id, res.uri.amount, res.uri.tx_description, res.uri.recipient_name, res.unknown_parameters, error))
     {
       er.code = WALLET_RPC_ERROR_CODE_WRONG_URI;
       er.message = "Error parsing URI: " + error;
@@ -1203,6 +1567,97 @@ namespace tools
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  bool wallet_rpc_server::on_open_wallet(const wallet_rpc::COMMAND_RPC_OPEN_WALLET::request& req, wallet_rpc::COMMAND_RPC_OPEN_WALLET::response& res, epee::json_rpc::error& er)
+  {
+    if (m_wallet_dir.empty())
+    {
+      er.code = WALLET_RPC_ERROR_CODE_NOT_HOSTING;
+      er.message = "Not hosting wallets, start with --wallet-dir";
+      return false;
+    }
+    if (req.filename.empty() || req.filename.find_first_of("/\\") != std::string::npos || req.filename == "." || req.filename == "..")
+    {
+      er.code = WALLET_RPC_ERROR_CODE_WRONG_WALLET;
+      er.message = "Wallet filename must name a file in the wallet dir";
+      return false;
+    }
+    if (m_hosted_wallets.count(req.filename))
+    {
+      er.code = WALLET_RPC_ERROR_CODE_WRONG_WALLET;
+      er.message = "Wallet already open: " + req.filename;
+      return false;
+    }
+
+    hosted_wallet hosted;
+    hosted.file = m_wallet_dir + "/" + req.filename;
+    hosted.password = req.password;
+    hosted.last_used = 0;
+    hosted.last_refresh = 0;
+    bool keys_file_exists, wallet_file_exists;
+    wallet2::wallet_exists(hosted.file, keys_file_exists, wallet_file_exists);
+    if (!keys_file_exists)
+    {
+      er.code = WALLET_RPC_ERROR_CODE_WRONG_WALLET;
+      er.message = "No such wallet: " + req.filename;
+      return false;
+    }
+    try
+    {
+      load_hosted_wallet(hosted);
+    }
+    catch (const std::exception &e)
+    {
+      er.code = WALLET_RPC_ERROR_CODE_UNKNOWN_ERROR;
+      er.message = std::string("Failed to open wallet: ") + e.what();
+      return false;
+    }
+    res.id = req.filename;
+    if (m_payment_notifier)
+      hosted.callback.reset(new payment_notifier::callback(*m_payment_notifier, res.id));
+    m_hosted_wallets.emplace(res.id, std::move(hosted));
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool wallet_rpc_server::on_close_wallet(const wallet_rpc::COMMAND_RPC_CLOSE_WALLET::request& req, wallet_rpc::COMMAND_RPC_CLOSE_WALLET::response& res, epee::json_rpc::error& er)
+  {
+    auto it = m_hosted_wallets.find(req.id);
+    if (it == m_hosted_wallets.end())
+    {
+      er.code = WALLET_RPC_ERROR_CODE_WRONG_WALLET;
+      er.message = "No such open wallet: " + req.id;
+      return false;
+    }
+    if (!unload_hosted_wallet(it->first, it->second))
+    {
+      er.code = WALLET_RPC_ERROR_CODE_UNKNOWN_ERROR;
+      er.message = "Failed to store wallet " + req.id;
+      return false;
+    }
+    m_hosted_wallets.erase(it);
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool wallet_rpc_server::on_list_wallets(const wallet_rpc::COMMAND_RPC_LIST_WALLETS::request& req, wallet_rpc::COMMAND_RPC_LIST_WALLETS::response& res, epee::json_rpc::error& er)
+  {
+    const uint64_t now = epee::misc_utils::get_tick_count();
+    for (const auto &i: m_hosted_wallets)
+    {
+      wallet_rpc::COMMAND_RPC_LIST_WALLETS::wallet_entry entry;
+      entry.id = i.first;
+      entry.loaded = !!i.second.wallet;
+      entry.idle_seconds = (now - i.second.last_used) / 1000;
+      res.wallets.push_back(entry);
+    }
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool wallet_rpc_server::on_get_metrics(const epee::net_utils::http::http_request_info& query_info, epee::net_utils::http::http_response_info& response_info, connection_context& context)
+  {
+    response_info.m_body = epee::net_utils::http::get_method_stats_text("monero_wallet_rpc");
+    response_info.m_mime_tipe = "text/plain; version=0.0.4";
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
 }
 
 int main(int argc, char** argv) {
@@ -1220,10 +1675,14 @@ int main(int argc, char** argv) {
   command_line::add_arg(desc_params, arg_confirm_external_bind);
   command_line::add_arg(desc_params, arg_wallet_file);
   command_line::add_arg(desc_params, arg_from_json);
+  command_line::add_arg(desc_params, arg_wallet_dir);
+  command_line::add_arg(desc_params, arg_max_loaded_wallets);
+  command_line::add_arg(desc_params, arg_wallet_idle_timeout);
+  command_line::add_arg(desc_params, arg_payment_notify_url);
 
   const auto vm = wallet_args::main(
     argc, argv,
-    "monero-wallet-rpc [--wallet-file=<file>|--generate-from-json=<file>] [--rpc-bind-port=<port>]",
+    "monero-wallet-rpc [--wallet-file=<file>|--generate-from-json=<file>|--wallet-dir=<dir>] [--rpc-bind-port=<port>]",
     desc_params,
     po::positional_options_description()
   );
@@ -1234,6 +1693,26 @@ int main(int argc, char** argv) {
 
   epee::log_space::log_singletone::add_logger(LOGGER_CONSOLE, NULL, NULL, LOG_LEVEL_2);
 
+  const auto wallet_dir = command_line::get_arg(*vm, arg_wallet_dir);
+  if (!wallet_dir.empty())
+  {
+    if (!command_line::get_arg(*vm, arg_wallet_file).empty() || !command_line::get_arg(*vm, arg_from_json).empty())
+    {
+      LOG_ERROR(tools::wallet_rpc_server::tr("Can't specify --wallet-dir with --wallet-file or --generate-from-json"));
+      return 1;
+    }
+    tools::wallet_rpc_server wrpc(*vm, wallet_dir);
+    bool r = wrpc.init(*vm);
+    CHECK_AND_ASSERT_MES(r, 1, tools::wallet_rpc_server::tr("Failed to initialize wallet rpc server"));
+    tools::signal_handler::install([&wrpc](int) {
+      wrpc.send_stop_signal();
+    });
+    LOG_PRINT_L0(tools::wallet_rpc_server::tr("Starting wallet rpc server, hosting the wallets of ") << wallet_dir);
+    wrpc.run();
+    LOG_PRINT_L0(tools::wallet_rpc_server::tr("Stopped wallet rpc server"));
+    return 0;
+  }
+
   std::unique_ptr<tools::wallet2> wal;
   try
   {
@@ -1248,7 +1727,7 @@ int main(int argc, char** argv) {
 
     if (wallet_file.empty() && from_json.empty())
     {
-      LOG_ERROR(tools::wallet_rpc_server::tr("Must specify --wallet-file or --generate-from-json"));
+      LOG_ERROR(tools::wallet_rpc_server::tr("Must specify --wallet-file, --generate-from-json or --wallet-dir"));
       return 1;
     }
 
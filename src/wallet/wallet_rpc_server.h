@@ -32,10 +32,14 @@
 
 #include <boost/program_options/options_description.hpp>
 #include <boost/program_options/variables_map.hpp>
+#include <boost/thread/thread.hpp>
+#include <map>
+#include <memory>
 #include <string>
 #include "net/http_server_impl_base.h"
 #include "wallet_rpc_server_commands_defs.h"
 #include "wallet2.h"
+#include "payment_notifier.h"
 namespace tools
 {
   /************************************************************************/
@@ -49,15 +53,28 @@ namespace tools
     static const char* tr(const char* str);
 
     wallet_rpc_server(wallet2& cr);
+    /*!
+     * \brief hosts the wallets of wallet_dir, opened and closed over the /wallets json rpc
+     *
+     * A hosted wallet's calls go to /wallet/<id>/json_rpc. Wallets idle for
+     * long, or least recently used when too many are loaded, are stored and
+     * unloaded, and loaded again by their next call. The loaded ones are
+     * refreshed in turn on the server thread.
+     */
+    wallet_rpc_server(const boost::program_options::variables_map& vm, const std::string& wallet_dir);
     ~wallet_rpc_server();
 
     bool init(const boost::program_options::variables_map& vm);
     bool run();
   private:
 
-    CHAIN_HTTP_TO_MAP2(connection_context); //forward http requests to uri map
+    //forward http requests to uri map, through the hosted wallet they are for if hosting
+    bool handle_http_request(const epee::net_utils::http::http_request_info& query_info, epee::net_utils::http::http_response_info& response, connection_context& context);
 
     BEGIN_URI_MAP2()
+      MAP_URI2("/metrics", on_get_metrics)
+      MAP_URI_AUTO_BIN2("/export_key_images.bin", on_export_key_images_bin, wallet_rpc::COMMAND_RPC_EXPORT_KEY_IMAGES_BIN)
+      MAP_URI_AUTO_BIN2("/import_key_images.bin", on_import_key_images_bin, wallet_rpc::COMMAND_RPC_IMPORT_KEY_IMAGES_BIN)
       BEGIN_JSON_RPC_MAP("/json_rpc")
         MAP_JON_RPC_WE("getbalance",         on_getbalance,         wallet_rpc::COMMAND_RPC_GET_BALANCE)
         MAP_JON_RPC_WE("getaddress",         on_getaddress,         wallet_rpc::COMMAND_RPC_GET_ADDRESS)
@@ -85,6 +102,11 @@ namespace tools
         MAP_JON_RPC_WE("make_uri",           on_make_uri,           wallet_rpc::COMMAND_RPC_MAKE_URI)
         MAP_JON_RPC_WE("parse_uri",          on_parse_uri,          wallet_rpc::COMMAND_RPC_PARSE_URI)
       END_JSON_RPC_MAP()
+      BEGIN_JSON_RPC_MAP("/wallets")
+        MAP_JON_RPC_WE("open_wallet",        on_open_wallet,        wallet_rpc::COMMAND_RPC_OPEN_WALLET)
+        MAP_JON_RPC_WE("close_wallet",       on_close_wallet,       wallet_rpc::COMMAND_RPC_CLOSE_WALLET)
+        MAP_JON_RPC_WE("list_wallets",       on_list_wallets,       wallet_rpc::COMMAND_RPC_LIST_WALLETS)
+      END_JSON_RPC_MAP()
     END_URI_MAP2()
 
       //json_rpc
@@ -114,13 +136,58 @@ namespace tools
       bool on_make_uri(const wallet_rpc::COMMAND_RPC_MAKE_URI::request& req, wallet_rpc::COMMAND_RPC_MAKE_URI::response& res, epee::json_rpc::error& er);
       bool on_parse_uri(const wallet_rpc::COMMAND_RPC_PARSE_URI::request& req, wallet_rpc::COMMAND_RPC_PARSE_URI::response& res, epee::json_rpc::error& er);
 
+      //wallet hosting
+      bool on_open_wallet(const wallet_rpc::COMMAND_RPC_OPEN_WALLET::request& req, wallet_rpc::COMMAND_RPC_OPEN_WALLET::response& res, epee::json_rpc::error& er);
+      bool on_close_wallet(const wallet_rpc::COMMAND_RPC_CLOSE_WALLET::request& req, wallet_rpc::COMMAND_RPC_CLOSE_WALLET::response& res, epee::json_rpc::error& er);
+      bool on_list_wallets(const wallet_rpc::COMMAND_RPC_LIST_WALLETS::request& req, wallet_rpc::COMMAND_RPC_LIST_WALLETS::response& res, epee::json_rpc::error& er);
+
+      //bin
+      bool on_export_key_images_bin(const wallet_rpc::COMMAND_RPC_EXPORT_KEY_IMAGES_BIN::request& req, wallet_rpc::COMMAND_RPC_EXPORT_KEY_IMAGES_BIN::response& res);
+      bool on_import_key_images_bin(const wallet_rpc::COMMAND_RPC_IMPORT_KEY_IMAGES_BIN::request& req, wallet_rpc::COMMAND_RPC_IMPORT_KEY_IMAGES_BIN::response& res);
+
+      // per method call statistics in the Prometheus text format
+      bool on_get_metrics(const epee::net_utils::http::http_request_info& query_info, epee::net_utils::http::http_response_info& response_info, connection_context& context);
+
       bool handle_command_line(const boost::program_options::variables_map& vm);
 
       //json rpc v2
       bool on_query_key(const wallet_rpc::COMMAND_RPC_QUERY_KEY::request& req, wallet_rpc::COMMAND_RPC_QUERY_KEY::response& res, epee::json_rpc::error& er);
 
-      wallet2& m_wallet;
+      // a wallet of the hosting mode, with what it takes to load it again
+      struct hosted_wallet
+      {
+        std::string file;
+        std::string password;
+        std::unique_ptr<wallet2> wallet;  //!< null while unloaded
+        uint64_t last_used;  //!< tick count of its last call
+        uint64_t last_refresh;  //!< tick count, 0 when never refreshed since loaded
+        std::unique_ptr<payment_notifier::callback> callback;  //!< null without --payment-notify-url
+      };
+
+      //! loads the wallet if unloaded, making room for it first
+      wallet2 &load_hosted_wallet(hosted_wallet &hosted);
+      //! stores and unloads the wallet, which stays loaded if it cannot be stored
+      bool unload_hosted_wallet(const std::string &id, hosted_wallet &hosted);
+      //! unloads the idle ones and refreshes the one that waited longest, called from the idle handler
+      void schedule_hosted_wallets();
+      //! long polls the daemon on its own thread, flagging m_daemon_changed when it has new blocks
+      void watch_daemon(wallet2 &wallet);
+
+      wallet2 *m_wallet;  //!< the wallet the current call is for, null between hosted calls
       std::string rpc_login_filename;
       std::atomic<bool> m_stop;
+
+      std::string m_wallet_dir;  //!< empty unless hosting
+      boost::program_options::variables_map m_vm;  //!< daemon and network options for hosted wallets
+      std::map<std::string, hosted_wallet> m_hosted_wallets;
+      size_t m_max_loaded_wallets;
+      uint64_t m_wallet_idle_ms;
+      bool m_close_hosted_wallet;  //!< set by stop_wallet on a hosted wallet, closed once the call is done
+
+      std::unique_ptr<payment_notifier> m_payment_notifier;  //!< null without --payment-notify-url
+      std::unique_ptr<payment_notifier::callback> m_payment_callback;  //!< the wallet's when not hosting
+      std::unique_ptr<wallet2> m_watch_wallet;  //!< for watch_daemon when hosting, m_wallet is used otherwise
+      boost::thread m_daemon_watcher;
+      std::atomic<bool> m_daemon_changed;  //!< loaded wallets are refreshed at once when set
   };
 }
@@ -276,7 +276,10 @@ namespace wallet_rpc
   {
     struct request
     {
+      bool background; // return once the state is serialized, writing the file in the background
+
       BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(background)
       END_KV_SERIALIZE_MAP()
     };
 
@@ -304,6 +307,26 @@ namespace wallet_rpc
     END_KV_SERIALIZE_MAP()
   };
 
+  // POSTed as JSON to --payment-notify-url for each payment to a wallet
+  struct payment_notification
+  {
+    std::string wallet;  // the hosted wallet's filename, empty if not hosting
+    std::string payment_id;
+    std::string tx_hash;
+    uint64_t amount;
+    uint64_t block_height;  // 0 while in the pool, it is sent again once mined
+    uint64_t unlock_time;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(wallet)
+      KV_SERIALIZE(payment_id)
+      KV_SERIALIZE(tx_hash)
+      KV_SERIALIZE(amount)
+      KV_SERIALIZE(block_height)
+      KV_SERIALIZE(unlock_time)
+    END_KV_SERIALIZE_MAP()
+  };
+
   struct COMMAND_RPC_GET_PAYMENTS
   {
     struct request
@@ -331,19 +354,25 @@ namespace wallet_rpc
     {
       std::vector<std::string> payment_ids;
       uint64_t min_block_height;
+      uint64_t limit; // 0 for all, only pages the payments to any payment ID
+      std::string continuation;
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(payment_ids)
         KV_SERIALIZE(min_block_height)
+        KV_SERIALIZE(limit)
+        KV_SERIALIZE(continuation)
       END_KV_SERIALIZE_MAP()
     };
 
     struct response
     {
       std::list<payment_details> payments;
+      std::string continuation; // empty on the last page
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(payments)
+        KV_SERIALIZE(continuation)
       END_KV_SERIALIZE_MAP()
     };
   };
@@ -370,18 +399,24 @@ namespace wallet_rpc
     struct request
     {
       std::string transfer_type;
+      uint64_t limit; // 0 for all
+      std::string continuation;
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(transfer_type)
+        KV_SERIALIZE(limit)
+        KV_SERIALIZE(continuation)
       END_KV_SERIALIZE_MAP()
     };
 
     struct response
     {
       std::list<transfer_details> transfers;
+      std::string continuation; // empty on the last page
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(transfers)
+        KV_SERIALIZE(continuation)
       END_KV_SERIALIZE_MAP()
     };
   };
@@ -539,6 +574,9 @@ namespace wallet_rpc
       uint64_t min_height;
       uint64_t max_height;
 
+      uint64_t limit; // 0 for all, pages the in and out lists
+      std::string continuation;
+
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(in);
         KV_SERIALIZE(out);
@@ -548,6 +586,8 @@ namespace wallet_rpc
         KV_SERIALIZE(filter_by_height);
         KV_SERIALIZE(min_height);
         KV_SERIALIZE(max_height);
+        KV_SERIALIZE(limit);
+        KV_SERIALIZE(continuation);
       END_KV_SERIALIZE_MAP()
     };
 
@@ -581,6 +621,7 @@ namespace wallet_rpc
       std::list<entry> pending;
       std::list<entry> failed;
       std::list<entry> pool;
+      std::string continuation; // empty on the last page
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(in);
@@ -588,6 +629,7 @@ namespace wallet_rpc
         KV_SERIALIZE(pending);
         KV_SERIALIZE(failed);
         KV_SERIALIZE(pool);
+        KV_SERIALIZE(continuation);
       END_KV_SERIALIZE_MAP()
     };
   };
@@ -703,6 +745,132 @@ namespace wallet_rpc
     };
   };
 
+  // binary export_key_images: key_images[n] is signed by signatures[n]
+  struct COMMAND_RPC_EXPORT_KEY_IMAGES_BIN
+  {
+    struct request
+    {
+      BEGIN_KV_SERIALIZE_MAP()
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      std::vector<crypto::key_image> key_images;
+      std::vector<crypto::signature> signatures;
+      std::string status;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(key_images)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(signatures)
+        KV_SERIALIZE(status)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  struct COMMAND_RPC_IMPORT_KEY_IMAGES_BIN
+  {
+    struct request
+    {
+      std::vector<crypto::key_image> key_images;
+      std::vector<crypto::signature> signatures;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(key_images)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(signatures)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      uint64_t height;
+      uint64_t spent;
+      uint64_t unspent;
+      std::string status;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(height)
+        KV_SERIALIZE(spent)
+        KV_SERIALIZE(unspent)
+        KV_SERIALIZE(status)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  // opens a wallet of the hosting server's wallet dir, its calls then go to /wallet/<id>/json_rpc
+  struct COMMAND_RPC_OPEN_WALLET
+  {
+    struct request
+    {
+      std::string filename;
+      std::string password;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(filename)
+        KV_SERIALIZE(password)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      std::string id;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(id)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  // stores and closes a hosted wallet
+  struct COMMAND_RPC_CLOSE_WALLET
+  {
+    struct request
+    {
+      std::string id;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(id)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      BEGIN_KV_SERIALIZE_MAP()
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  struct COMMAND_RPC_LIST_WALLETS
+  {
+    struct request
+    {
+      BEGIN_KV_SERIALIZE_MAP()
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct wallet_entry
+    {
+      std::string id;
+      bool loaded;
+      uint64_t idle_seconds;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(id)
+        KV_SERIALIZE(loaded)
+        KV_SERIALIZE(idle_seconds)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      std::list<wallet_entry> wallets;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(wallets)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
   struct uri_spec
   {
     std::string address;
@@ -42,3 +42,6 @@
 #define WALLET_RPC_ERROR_CODE_WRONG_SIGNATURE         -9
 #define WALLET_RPC_ERROR_CODE_WRONG_KEY_IMAGE        -10
 #define WALLET_RPC_ERROR_CODE_WRONG_URI              -11
+#define WALLET_RPC_ERROR_CODE_WRONG_CONTINUATION     -12
+#define WALLET_RPC_ERROR_CODE_NOT_HOSTING            -13
+#define WALLET_RPC_ERROR_CODE_WRONG_WALLET           -14
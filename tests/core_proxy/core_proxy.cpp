@@ -189,6 +189,15 @@ bool tests::proxy_core::handle_incoming_tx(const cryptonote::blobdata& tx_blob,
     return true;
 }
 
+bool tests::proxy_core::handle_incoming_txs(const std::list<cryptonote::blobdata>& tx_blobs, std::vector<cryptonote::tx_verification_context>& tvc, bool keeped_by_block, bool relayed) {
+    tvc.resize(tx_blobs.size());
+    size_t i = 0;
+    for (const cryptonote::blobdata& tx_blob : tx_blobs)
+        if (!handle_incoming_tx(tx_blob, tvc[i++], keeped_by_block, relayed))
+            return false;
+    return true;
+}
+
 bool tests::proxy_core::handle_incoming_block(const cryptonote::blobdata& block_blob, cryptonote::block_verification_context& bvc, bool update_miner_blocktemplate) {
     block b = AUTO_VAL_INIT(b);
 
@@ -75,22 +75,31 @@ namespace tests
     bool have_block(const crypto::hash& id);
     bool get_blockchain_top(uint64_t& height, crypto::hash& top_id);
     bool handle_incoming_tx(const cryptonote::blobdata& tx_blob, cryptonote::tx_verification_context& tvc, bool keeped_by_block, bool relaued);
+    bool handle_incoming_txs(const std::list<cryptonote::blobdata>& tx_blobs, std::vector<cryptonote::tx_verification_context>& tvc, bool keeped_by_block, bool relayed);
     bool handle_incoming_block(const cryptonote::blobdata& block_blob, cryptonote::block_verification_context& bvc, bool update_miner_blocktemplate = true);
     void pause_mine(){}
     void resume_mine(){}
     bool on_idle(){return true;}
     bool find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, cryptonote::NOTIFY_RESPONSE_CHAIN_ENTRY::request& resp){return true;}
+    bool get_block_hashing_blobs(const std::list<crypto::hash>& block_ids, std::vector<cryptonote::blobdata>& headers) const { return false; }
+    bool verify_block_headers(uint64_t start_height, const std::list<crypto::hash>& block_ids, const std::vector<cryptonote::blobdata>& headers) { return true; }
     bool handle_get_objects(cryptonote::NOTIFY_REQUEST_GET_OBJECTS::request& arg, cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request& rsp, cryptonote::cryptonote_connection_context& context){return true;}
     cryptonote::Blockchain &get_blockchain_storage() { throw std::runtime_error("Called invalid member function: please never call get_blockchain_storage on the TESTING class proxy_core."); }
     bool get_test_drop_download() {return true;}
     bool get_test_drop_download_height() {return true;}
-    bool prepare_handle_incoming_blocks(const std::list<cryptonote::block_complete_entry>  &blocks) { return true; }
+    bool prepare_handle_incoming_blocks(const std::vector<cryptonote::block_complete_entry>  &blocks) { return true; }
+    bool prepare_handle_incoming_blocks(const std::vector<cryptonote::block_complete_entry>  &blocks, size_t first, size_t count) { return true; }
+    size_t get_prepare_window(const std::vector<cryptonote::block_complete_entry>  &blocks, size_t first) const { return blocks.size() - first; }
     bool cleanup_handle_incoming_blocks(bool force_sync = false) { return true; }
     uint64_t get_target_blockchain_height() const { return 1; }
     size_t get_block_sync_size() const { return BLOCKS_SYNCHRONIZING_DEFAULT_COUNT; }
+    bool get_early_block_relay() const { return false; }
+    bool check_incoming_block_header(const cryptonote::blobdata& block_blob) { return false; }
+    uint64_t get_average_block_size(size_t count) const { return 0; }
     virtual void on_transaction_relayed(const cryptonote::blobdata& tx) {}
     bool get_testnet() const { return false; }
     bool get_pool_transaction(const crypto::hash& id, cryptonote::transaction& tx) const { return false; }
-    bool get_blocks(uint64_t start_offset, size_t count, std::list<cryptonote::block>& blocks, std::list<cryptonote::transaction>& txs) const { return false; }
+    void get_pool_transaction_hashes(std::vector<crypto::hash>& txs, uint64_t& pool_version) const { pool_version = 0; }
+    bool get_blocks(uint64_t start_offset, size_t count, std::vector<cryptonote::block>& blocks, std::vector<cryptonote::transaction>& txs) const { return false; }
   };
 }
@@ -28,10 +28,18 @@
 // 
 // Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
 
+#include <stdint.h>
+
 #include "crypto/random.c"
 
 #include "crypto-tests.h"
 
 void setup_random(void) {
     memset(&state, 42, sizeof(union hash_state));
+    /* the vectors expect a fixed stream: pin this thread's state and never reseed it */
+    memset(&thread_state, 42, sizeof(union hash_state));
+    thread_state_left = SIZE_MAX;
+#if !defined(_WIN32)
+    thread_state_pid = getpid();
+#endif
 }
@@ -82,7 +82,7 @@ bool make_tx(blockchain_storage& bch)
     sources.resize(sources.size()+1);
     cryptonote::tx_source_entry& src = sources.back();
     transfer_details& td = *it;
-    src.amount = td.m_tx.vout[td.m_internal_output_index].amount;
+    src.amount = td.amount();
     //paste mixin transaction
     if(daemon_resp.outs.size())
     {
@@ -108,9 +108,9 @@ bool make_tx(blockchain_storage& bch)
     //size_t real_index = src.outputs.size() ? (rand() % src.outputs.size() ):0;
     tx_output_entry real_oe;
     real_oe.first = td.m_global_output_index;
-    real_oe.second = boost::get<txout_to_key>(td.m_tx.vout[td.m_internal_output_index].target).key;
+    real_oe.second = td.get_public_key();
     auto interted_it = src.outputs.insert(it_to_insert, real_oe);
-    src.real_out_tx_key = td.m_tx.tx_pub_key;
+    src.real_out_tx_key = td.m_tx_pub_key;
     src.real_output = interted_it - src.outputs.begin();
     src.real_output_in_tx_index = td.m_internal_output_index;
     src.rct = false;
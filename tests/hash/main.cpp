@@ -29,6 +29,7 @@
 // Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
 
 #include <cstddef>
+#include <cstring>
 #include <fstream>
 #include <iomanip>
 #include <ios>
@@ -51,6 +52,43 @@ extern "C" {
     }
     tree_hash((const char (*)[32]) data, length >> 5, hash);
   }
+
+  // hashes enough copies of data to fill the SIMD lanes and the scalar
+  // tail behind them, and checks that they all agree
+  static void hash_fast_batch(const void *data, size_t length, char *hash) {
+    const size_t count = 11;
+    vector<char> batch_data(count * length + 1);
+    char batch_hash[count * 32];
+    for (size_t i = 0; i < count; i++) {
+      memcpy(batch_data.data() + i * length, data, length);
+    }
+    cn_fast_hash_batch(batch_data.data(), length, count, batch_hash);
+    for (size_t i = 1; i < count; i++) {
+      if (memcmp(batch_hash, batch_hash + i * 32, 32) != 0) {
+        throw ios_base::failure("Hashes of cn_fast_hash_batch disagree");
+      }
+    }
+    memcpy(hash, batch_hash, 32);
+  }
+
+  // hashes data in all lanes but the first, which gets the empty string, and
+  // checks that the lanes agree
+  static void hash_slow_multi(const void *data, size_t length, char *hash) {
+    const void *lane_data[CN_SLOW_HASH_MAX_WAYS];
+    size_t lane_length[CN_SLOW_HASH_MAX_WAYS];
+    char lane_hash[CN_SLOW_HASH_MAX_WAYS * 32];
+    for (size_t i = 0; i < CN_SLOW_HASH_MAX_WAYS; i++) {
+      lane_data[i] = data;
+      lane_length[i] = i == 0 ? 0 : length;
+    }
+    cn_slow_hash_multi(lane_data, lane_length, CN_SLOW_HASH_MAX_WAYS, lane_hash);
+    for (size_t i = 2; i < CN_SLOW_HASH_MAX_WAYS; i++) {
+      if (memcmp(lane_hash + 32, lane_hash + i * 32, 32) != 0) {
+        throw ios_base::failure("Lanes of cn_slow_hash_multi disagree");
+      }
+    }
+    memcpy(hash, lane_hash + 32, 32);
+  }
 }
 POP_WARNINGS
 
@@ -58,7 +96,7 @@ extern "C" typedef void hash_f(const void *, size_t, char *);
 struct hash_func {
   const string name;
   hash_f &f;
-} hashes[] = {{"fast", cn_fast_hash}, {"slow", cn_slow_hash}, {"tree", hash_tree},
+} hashes[] = {{"fast", cn_fast_hash}, {"fast-batch", hash_fast_batch}, {"slow", cn_slow_hash}, {"slow-multi", hash_slow_multi}, {"tree", hash_tree},
   {"extra-blake", hash_extra_blake}, {"extra-groestl", hash_extra_groestl},
   {"extra-jh", hash_extra_jh}, {"extra-skein", hash_extra_skein}};
 
@@ -0,0 +1,631 @@
+// Copyright (c) 2014-2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Relay benchmark: runs a number of complete node_server +
+// t_cryptonote_protocol_handler nodes in this process, connected over the
+// loopback in a random graph, each backed by a core which accepts anything
+// and notes when it first sees a transaction or block. Transactions are
+// injected at random nodes, then blocks made of them, which go out fluffy
+// or compact, and the time each takes to reach every other node is reported
+// along with the message rate, the cpu time per message and the memory per
+// connection.
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <boost/chrono.hpp>
+#include <boost/chrono/process_cpu_clocks.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "include_base_utils.h"
+#include "misc_log_ex.h"
+#include "common/command_line.h"
+#include "cryptonote_core/cryptonote_format_utils.h"
+#include "p2p/net_node.h"
+#include "cryptonote_protocol/cryptonote_protocol_handler.h"
+
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+namespace po = boost::program_options;
+
+namespace
+{
+  const command_line::arg_descriptor<size_t>   arg_nodes        = {"nodes", "Number of nodes", 8};
+  const command_line::arg_descriptor<size_t>   arg_out_peers    = {"out-peers", "Outgoing connections made by each node", 3};
+  const command_line::arg_descriptor<uint32_t> arg_base_port    = {"base-port", "Port of the first node, the others follow", 48080};
+  const command_line::arg_descriptor<size_t>   arg_txs          = {"txs", "Number of transactions to inject", 1000};
+  const command_line::arg_descriptor<size_t>   arg_tx_rate      = {"tx-rate", "Transactions injected per second", 200};
+  const command_line::arg_descriptor<size_t>   arg_tx_size      = {"tx-size", "Approximate size of each transaction in bytes", 2000};
+  const command_line::arg_descriptor<size_t>   arg_blocks       = {"blocks", "Number of blocks to inject after the transactions", 10};
+  const command_line::arg_descriptor<size_t>   arg_block_txs    = {"block-txs", "Transactions in each block", 50};
+  const command_line::arg_descriptor<bool>     arg_full_blocks  = {"full-blocks", "Relay blocks in full rather than fluffy/compact", false};
+  const command_line::arg_descriptor<unsigned> arg_timeout      = {"timeout", "Seconds to wait for each phase to reach every node", 60};
+  const command_line::arg_descriptor<int>      arg_log_level    = {"log-level", "", LOG_LEVEL_0};
+
+  typedef boost::chrono::steady_clock clock_type;
+
+  uint64_t now_us()
+  {
+    return boost::chrono::duration_cast<boost::chrono::microseconds>(clock_type::now().time_since_epoch()).count();
+  }
+
+  uint64_t cpu_time_us()
+  {
+    return boost::chrono::duration_cast<boost::chrono::microseconds>(
+      boost::chrono::process_user_cpu_clock::now().time_since_epoch() +
+      boost::chrono::process_system_cpu_clock::now().time_since_epoch()).count();
+  }
+
+  // resident set size in bytes, 0 where it is not known
+  uint64_t resident_memory()
+  {
+#ifdef __linux__
+    std::ifstream statm("/proc/self/statm");
+    uint64_t size = 0, resident = 0;
+    if (statm >> size >> resident)
+      return resident * sysconf(_SC_PAGESIZE);
+#endif
+    return 0;
+  }
+
+  //-----------------------------------------------------------------------------------------------
+  // arrival times of every injected object at every node, shared by the cores
+  class relay_stats
+  {
+  public:
+    enum kind { kind_tx, kind_block };
+
+    relay_stats(): m_messages(0), m_redundant(0) {}
+
+    void on_inject(const crypto::hash& id, kind k)
+    {
+      boost::lock_guard<boost::mutex> lock(m_lock);
+      object& o = m_objects[id];
+      o.k = k;
+      o.injected = now_us();
+    }
+
+    void on_arrival(const crypto::hash& id)
+    {
+      const uint64_t t = now_us();
+      boost::lock_guard<boost::mutex> lock(m_lock);
+      auto it = m_objects.find(id);
+      if (it != m_objects.end())
+        it->second.latencies.push_back(t - it->second.injected);
+    }
+
+    void on_message(bool redundant)
+    {
+      ++m_messages;
+      if (redundant)
+        ++m_redundant;
+    }
+
+    uint64_t messages() const { return m_messages; }
+    uint64_t redundant() const { return m_redundant; }
+
+    // how many of the objects of this kind have reached every other node
+    size_t complete(kind k, size_t other_nodes) const
+    {
+      boost::lock_guard<boost::mutex> lock(m_lock);
+      size_t n = 0;
+      for (const auto& i : m_objects)
+        if (i.second.k == k && i.second.latencies.size() >= other_nodes)
+          ++n;
+      return n;
+    }
+
+    void report(kind k, size_t other_nodes, std::ostream& out) const
+    {
+      std::vector<uint64_t> latencies;
+      size_t objects = 0, arrivals = 0;
+      {
+        boost::lock_guard<boost::mutex> lock(m_lock);
+        for (const auto& i : m_objects)
+        {
+          if (i.second.k != k)
+            continue;
+          ++objects;
+          arrivals += i.second.latencies.size();
+          latencies.insert(latencies.end(), i.second.latencies.begin(), i.second.latencies.end());
+        }
+      }
+      if (latencies.empty())
+      {
+        out << "  no arrivals" << std::endl;
+        return;
+      }
+      std::sort(latencies.begin(), latencies.end());
+      auto percentile = [&](double p) { return latencies[std::min(latencies.size() - 1, (size_t)(p * latencies.size()))] / 1000.0; };
+      out << "  reached " << arrivals << "/" << objects * other_nodes << " node/object pairs" << std::endl;
+      out << std::fixed << std::setprecision(2)
+          << "  latency ms: p50 " << percentile(0.5) << ", p90 " << percentile(0.9) << ", p99 " << percentile(0.99)
+          << ", max " << latencies.back() / 1000.0 << std::endl;
+    }
+
+  private:
+    struct object
+    {
+      kind k;
+      uint64_t injected;
+      std::vector<uint64_t> latencies;
+    };
+
+    mutable boost::mutex m_lock;
+    std::unordered_map<crypto::hash, object> m_objects;
+    std::atomic<uint64_t> m_messages;
+    std::atomic<uint64_t> m_redundant;
+  };
+
+  //-----------------------------------------------------------------------------------------------
+  // a core which takes every transaction and block as valid, keeps the
+  // transactions as its pool for fluffy and compact blocks, and relays each
+  // object the first time it sees it
+  class relay_core
+  {
+  public:
+    relay_core(relay_stats& stats, bool fluffy): m_stats(stats), m_fluffy(fluffy) {}
+
+    void on_synchronized(){}
+    uint64_t get_current_blockchain_height() const {return 1;}
+    void set_target_blockchain_height(uint64_t) {}
+    bool init(const boost::program_options::variables_map& vm) {return true;}
+    bool deinit(){return true;}
+    void stop(){}
+    bool get_short_chain_history(std::list<crypto::hash>& ids) const { return true; }
+    bool get_stat_info(cryptonote::core_stat_info& st_inf) const {return true;}
+    bool have_block(const crypto::hash& id) const {return true;}
+    bool get_blockchain_top(uint64_t& height, crypto::hash& top_id)const{height=0;top_id=cryptonote::null_hash;return true;}
+    bool handle_incoming_tx(const cryptonote::blobdata& tx_blob, cryptonote::tx_verification_context& tvc, bool keeped_by_block, bool relayed)
+    {
+      crypto::hash id;
+      tvc.m_should_be_relayed = add_tx(tx_blob, id) && !keeped_by_block;
+      tvc.m_verifivation_failed = id == cryptonote::null_hash;
+      return !tvc.m_verifivation_failed;
+    }
+    bool handle_incoming_txs(const std::list<cryptonote::blobdata>& tx_blobs, std::vector<cryptonote::tx_verification_context>& tvc, bool keeped_by_block, bool relayed)
+    {
+      tvc.resize(tx_blobs.size());
+      size_t i = 0, fresh = 0;
+      for (const cryptonote::blobdata& tx_blob : tx_blobs)
+      {
+        if (!handle_incoming_tx(tx_blob, tvc[i], keeped_by_block, relayed))
+          return false;
+        fresh += tvc[i++].m_should_be_relayed;
+      }
+      // missing transactions fetched for a block are part of the block message
+      if (!keeped_by_block)
+        m_stats.on_message(fresh == 0);
+      return true;
+    }
+    bool handle_incoming_block(const cryptonote::blobdata& block_blob, cryptonote::block_verification_context& bvc, bool update_miner_blocktemplate = true)
+    {
+      cryptonote::block b;
+      if (!cryptonote::parse_and_validate_block_from_blob(block_blob, b))
+      {
+        bvc.m_verifivation_failed = true;
+        return false;
+      }
+      const crypto::hash id = cryptonote::get_block_hash(b);
+      bool fresh;
+      {
+        boost::lock_guard<boost::mutex> lock(m_lock);
+        fresh = m_blocks.insert(id).second;
+      }
+      if (fresh)
+        m_stats.on_arrival(id);
+      m_stats.on_message(!fresh);
+      bvc.m_added_to_main_chain = fresh;
+      return true;
+    }
+    void pause_mine(){}
+    void resume_mine(){}
+    bool on_idle(){return true;}
+    bool find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, cryptonote::NOTIFY_RESPONSE_CHAIN_ENTRY::request& resp){return true;}
+    bool get_block_hashing_blobs(const std::list<crypto::hash>& block_ids, std::vector<cryptonote::blobdata>& headers) const { return false; }
+    bool verify_block_headers(uint64_t start_height, const std::list<crypto::hash>& block_ids, const std::vector<cryptonote::blobdata>& headers) { return true; }
+    bool handle_get_objects(cryptonote::NOTIFY_REQUEST_GET_OBJECTS::request& arg, cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request& rsp, cryptonote::cryptonote_connection_context& context){return true;}
+    bool get_test_drop_download() const {return true;}
+    bool get_test_drop_download_height() const {return true;}
+    bool prepare_handle_incoming_blocks(const std::vector<cryptonote::block_complete_entry>  &blocks) { return true; }
+    bool prepare_handle_incoming_blocks(const std::vector<cryptonote::block_complete_entry>  &blocks, size_t first, size_t count) { return true; }
+    size_t get_prepare_window(const std::vector<cryptonote::block_complete_entry>  &blocks, size_t first) const { return blocks.size() - first; }
+    bool cleanup_handle_incoming_blocks(bool force_sync = false) { return true; }
+    uint64_t get_target_blockchain_height() const { return 1; }
+    size_t get_block_sync_size() const { return BLOCKS_SYNCHRONIZING_DEFAULT_COUNT; }
+    bool get_early_block_relay() const { return false; }
+    bool check_incoming_block_header(const cryptonote::blobdata& block_blob) { return false; }
+    uint64_t get_average_block_size(size_t count) const { return 0; }
+    void on_transaction_relayed(const cryptonote::blobdata& tx) {}
+    // the protocol only relays fluffy and compact blocks on testnet
+    bool get_testnet() const { return m_fluffy; }
+    bool get_pool_transaction(const crypto::hash& id, cryptonote::transaction& tx) const
+    {
+      boost::lock_guard<boost::mutex> lock(m_lock);
+      auto it = m_pool.find(id);
+      if (it == m_pool.end())
+        return false;
+      tx = it->second;
+      return true;
+    }
+    void get_pool_transaction_hashes(std::vector<crypto::hash>& txs, uint64_t& pool_version) const
+    {
+      boost::lock_guard<boost::mutex> lock(m_lock);
+      txs.clear();
+      txs.reserve(m_pool.size());
+      for (const auto& i : m_pool)
+        txs.push_back(i.first);
+      pool_version = m_pool.size();
+    }
+    bool get_blocks(uint64_t start_offset, size_t count, std::vector<cryptonote::block>& blocks, std::vector<cryptonote::transaction>& txs) const { return false; }
+
+    // the injecting node has the object already, and does not count it as arrived
+    void add_injected_block(const crypto::hash& id)
+    {
+      boost::lock_guard<boost::mutex> lock(m_lock);
+      m_blocks.insert(id);
+    }
+    bool add_tx(const cryptonote::blobdata& tx_blob, crypto::hash& id, bool injected = false)
+    {
+      cryptonote::transaction tx;
+      crypto::hash prefix_hash;
+      id = cryptonote::null_hash;
+      if (!cryptonote::parse_and_validate_tx_from_blob(tx_blob, tx, id, prefix_hash))
+        return false;
+      {
+        boost::lock_guard<boost::mutex> lock(m_lock);
+        if (!m_pool.emplace(id, std::move(tx)).second)
+          return false;
+      }
+      if (!injected)
+        m_stats.on_arrival(id);
+      return true;
+    }
+
+  private:
+    relay_stats& m_stats;
+    bool m_fluffy;
+    mutable boost::mutex m_lock;
+    std::unordered_map<crypto::hash, cryptonote::transaction> m_pool;
+    std::unordered_set<crypto::hash> m_blocks;
+  };
+
+  typedef cryptonote::t_cryptonote_protocol_handler<relay_core> relay_protocol;
+  typedef nodetool::node_server<relay_protocol> relay_server;
+
+  struct relay_node
+  {
+    relay_node(relay_stats& stats, bool fluffy)
+      : core(stats, fluffy)
+      , protocol(core, NULL)
+      , server(protocol)
+    {
+      protocol.set_p2p_endpoint(&server);
+    }
+
+    relay_core core;
+    relay_protocol protocol;
+    relay_server server;
+    boost::thread thread;
+  };
+
+  //-----------------------------------------------------------------------------------------------
+  // a version 1 transaction with one input and two outputs, padded with extra
+  // to about the given size; nothing checks its signature
+  cryptonote::blobdata make_tx(size_t size)
+  {
+    cryptonote::transaction tx;
+    tx.version = 1;
+    tx.unlock_time = 0;
+    cryptonote::txin_to_key in;
+    in.amount = 0;
+    in.key_offsets.push_back(1);
+    in.k_image = crypto::rand<crypto::key_image>();
+    tx.vin.push_back(in);
+    for (int i = 0; i < 2; ++i)
+    {
+      cryptonote::txout_to_key out;
+      out.key = crypto::rand<crypto::public_key>();
+      tx.vout.push_back({1, out});
+    }
+    tx.signatures.push_back(std::vector<crypto::signature>(1, crypto::rand<crypto::signature>()));
+    const size_t base_size = cryptonote::tx_to_blob(tx).size();
+    if (size > base_size)
+    {
+      tx.extra.resize(size - base_size);
+      crypto::rand(tx.extra.size(), tx.extra.data());
+    }
+    return cryptonote::tx_to_blob(tx);
+  }
+
+  cryptonote::blobdata make_block(const std::vector<crypto::hash>& tx_hashes)
+  {
+    cryptonote::block b = AUTO_VAL_INIT(b);
+    b.major_version = CURRENT_BLOCK_MAJOR_VERSION;
+    b.minor_version = CURRENT_BLOCK_MINOR_VERSION;
+    b.timestamp = time(NULL);
+    b.prev_id = crypto::rand<crypto::hash>();
+    b.nonce = crypto::rand<uint32_t>();
+    b.miner_tx.version = 1;
+    b.miner_tx.vin.push_back(cryptonote::txin_gen{1});
+    cryptonote::txout_to_key out;
+    out.key = crypto::rand<crypto::public_key>();
+    b.miner_tx.vout.push_back({1, out});
+    b.tx_hashes = tx_hashes;
+    return cryptonote::block_to_blob(b);
+  }
+
+  bool wait_for(const std::function<bool()>& done, unsigned timeout)
+  {
+    const uint64_t deadline = now_us() + timeout * 1000000ull;
+    while (!done())
+    {
+      if (now_us() > deadline)
+        return false;
+      boost::this_thread::sleep_for(boost::chrono::milliseconds(50));
+    }
+    return true;
+  }
+
+  struct phase_counters
+  {
+    phase_counters(const relay_stats& stats): m_stats(stats), wall(now_us()), cpu(cpu_time_us()), messages(stats.messages()), redundant(stats.redundant()) {}
+
+    void report(std::ostream& out) const
+    {
+      const uint64_t n = m_stats.messages() - messages;
+      const double seconds = (now_us() - wall) / 1e6;
+      out << std::fixed << std::setprecision(2)
+          << "  " << n << " messages (" << m_stats.redundant() - redundant << " redundant) in " << seconds << " s, "
+          << (seconds > 0 ? n / seconds : 0.0) << " messages/s, "
+          << (n ? (cpu_time_us() - cpu) / (double)n : 0.0) << " us cpu/message" << std::endl;
+    }
+
+    const relay_stats& m_stats;
+    uint64_t wall;
+    uint64_t cpu;
+    uint64_t messages;
+    uint64_t redundant;
+  };
+}
+
+BOOST_CLASS_VERSION(relay_server, 1);
+
+int main(int argc, char* argv[])
+{
+  TRY_ENTRY();
+
+  po::options_description desc("Allowed options");
+  command_line::add_arg(desc, command_line::arg_help);
+  command_line::add_arg(desc, arg_nodes);
+  command_line::add_arg(desc, arg_out_peers);
+  command_line::add_arg(desc, arg_base_port);
+  command_line::add_arg(desc, arg_txs);
+  command_line::add_arg(desc, arg_tx_rate);
+  command_line::add_arg(desc, arg_tx_size);
+  command_line::add_arg(desc, arg_blocks);
+  command_line::add_arg(desc, arg_block_txs);
+  command_line::add_arg(desc, arg_full_blocks);
+  command_line::add_arg(desc, arg_timeout);
+  command_line::add_arg(desc, arg_log_level);
+
+  po::variables_map vm;
+  bool r = command_line::handle_error_helper(desc, [&]()
+  {
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+    return true;
+  });
+  if (!r)
+    return 1;
+  if (command_line::get_arg(vm, command_line::arg_help))
+  {
+    std::cout << desc << std::endl;
+    return 0;
+  }
+
+  epee::log_space::get_set_log_detalisation_level(true, command_line::get_arg(vm, arg_log_level));
+  epee::log_space::log_singletone::add_logger(LOGGER_CONSOLE, NULL, NULL);
+
+  const size_t n_nodes = command_line::get_arg(vm, arg_nodes);
+  const size_t out_peers = std::min(command_line::get_arg(vm, arg_out_peers), n_nodes - 1);
+  const uint32_t base_port = command_line::get_arg(vm, arg_base_port);
+  const size_t n_txs = command_line::get_arg(vm, arg_txs);
+  const size_t tx_rate = std::max<size_t>(command_line::get_arg(vm, arg_tx_rate), 1);
+  const size_t tx_size = command_line::get_arg(vm, arg_tx_size);
+  const size_t n_blocks = command_line::get_arg(vm, arg_blocks);
+  const size_t block_txs = command_line::get_arg(vm, arg_block_txs);
+  const bool fluffy = !command_line::get_arg(vm, arg_full_blocks);
+  const unsigned timeout = command_line::get_arg(vm, arg_timeout);
+  if (n_nodes < 2)
+  {
+    std::cout << "At least two nodes are needed" << std::endl;
+    return 1;
+  }
+
+  // each node connects to the next, so the graph is connected, and to
+  // random others
+  std::mt19937 rng(std::random_device{}());
+  std::vector<std::set<size_t>> links(n_nodes);
+  for (size_t i = 0; i < n_nodes; ++i)
+  {
+    links[i].insert((i + 1) % n_nodes);
+    while (links[i].size() < out_peers)
+    {
+      const size_t j = std::uniform_int_distribution<size_t>(0, n_nodes - 1)(rng);
+      if (j != i)
+        links[i].insert(j);
+    }
+  }
+
+  const boost::filesystem::path data_root = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("monero-relay-%%%%-%%%%");
+  relay_stats stats;
+  std::vector<std::unique_ptr<relay_node>> nodes;
+  for (size_t i = 0; i < n_nodes; ++i)
+  {
+    std::vector<std::string> args = {
+      "--testnet",
+      "--testnet-data-dir", (data_root / std::to_string(i)).string(),
+      "--p2p-bind-ip", "127.0.0.1",
+      "--testnet-p2p-bind-port", std::to_string(base_port + i),
+      "--no-igd",
+      "--hide-my-port"
+    };
+    for (size_t j : links[i])
+    {
+      args.push_back("--add-exclusive-node");
+      args.push_back("127.0.0.1:" + std::to_string(base_port + j));
+    }
+
+    po::options_description node_desc;
+    command_line::add_arg(node_desc, command_line::arg_testnet_on);
+    command_line::add_arg(node_desc, command_line::arg_testnet_data_dir, data_root.string());
+    command_line::add_arg(node_desc, command_line::arg_data_dir, data_root.string());
+    relay_server::init_options(node_desc);
+    po::variables_map node_vm;
+    po::store(po::command_line_parser(args).options(node_desc).run(), node_vm);
+    po::notify(node_vm);
+
+    nodes.emplace_back(new relay_node(stats, fluffy));
+    boost::filesystem::create_directories(data_root / std::to_string(i));
+    CHECK_AND_ASSERT_MES(nodes.back()->server.init(node_vm), 1, "Failed to initialize node " << i);
+    CHECK_AND_ASSERT_MES(nodes.back()->protocol.init(node_vm), 1, "Failed to initialize the protocol of node " << i);
+  }
+
+  const uint64_t memory_before = resident_memory();
+  for (auto& node : nodes)
+  {
+    relay_server& server = node->server;
+    node->thread = boost::thread([&server]() { server.run(); });
+  }
+
+  // every link is a connection at both of its ends
+  size_t expected_connections = 0;
+  for (const auto& l : links)
+    expected_connections += 2 * l.size();
+  auto connections = [&]() {
+    size_t n = 0;
+    for (auto& node : nodes)
+      n += node->protocol.get_connections().size();
+    return n;
+  };
+  if (!wait_for([&]() { return connections() >= expected_connections; }, timeout))
+    LOG_PRINT_L0("Only " << connections() << "/" << expected_connections << " connections made, going on");
+  const size_t n_connections = connections();
+  const uint64_t memory_after = resident_memory();
+
+  std::cout << n_nodes << " nodes, " << n_connections << " connections, " << (fluffy ? "fluffy/compact" : "full") << " blocks" << std::endl;
+  if (memory_before && memory_after > memory_before && n_connections)
+    std::cout << "  " << (memory_after - memory_before) / n_connections / 1024 << " kB resident per connection, io threads included" << std::endl;
+
+  // transactions, at the given rate from random nodes
+  std::vector<crypto::hash> tx_hashes;
+  {
+    phase_counters counters(stats);
+    const uint64_t start = now_us();
+    for (size_t i = 0; i < n_txs; ++i)
+    {
+      const uint64_t due = start + i * 1000000ull / tx_rate;
+      const uint64_t now = now_us();
+      if (due > now)
+        boost::this_thread::sleep_for(boost::chrono::microseconds(due - now));
+
+      relay_node& origin = *nodes[std::uniform_int_distribution<size_t>(0, n_nodes - 1)(rng)];
+      cryptonote::NOTIFY_NEW_TRANSACTIONS::request req;
+      req.txs.push_back(make_tx(tx_size));
+      crypto::hash id;
+      origin.core.add_tx(req.txs.back(), id, true);
+      stats.on_inject(id, relay_stats::kind_tx);
+      tx_hashes.push_back(id);
+      cryptonote::cryptonote_connection_context fake_context = AUTO_VAL_INIT(fake_context);
+      static_cast<cryptonote::i_cryptonote_protocol&>(origin.protocol).relay_transactions(req, fake_context);
+    }
+    if (!wait_for([&]() { return stats.complete(relay_stats::kind_tx, n_nodes - 1) >= n_txs; }, timeout))
+      LOG_PRINT_L0("Not all transactions reached every node");
+    std::cout << "transactions:" << std::endl;
+    stats.report(relay_stats::kind_tx, n_nodes - 1, std::cout);
+    counters.report(std::cout);
+  }
+
+  // blocks, one a second from random nodes, each with a slice of the
+  // transactions, which every node should have in its pool by now
+  {
+    phase_counters counters(stats);
+    for (size_t i = 0; i < n_blocks; ++i)
+    {
+      if (i)
+        boost::this_thread::sleep_for(boost::chrono::seconds(1));
+      std::vector<crypto::hash> hashes;
+      for (size_t j = 0; j < block_txs && !tx_hashes.empty(); ++j)
+        hashes.push_back(tx_hashes[(i * block_txs + j) % tx_hashes.size()]);
+
+      relay_node& origin = *nodes[std::uniform_int_distribution<size_t>(0, n_nodes - 1)(rng)];
+      cryptonote::NOTIFY_NEW_BLOCK::request req = AUTO_VAL_INIT(req);
+      req.b.block = make_block(hashes);
+      req.current_blockchain_height = 2;
+      cryptonote::block b;
+      cryptonote::parse_and_validate_block_from_blob(req.b.block, b);
+      const crypto::hash id = cryptonote::get_block_hash(b);
+      origin.core.add_injected_block(id);
+      stats.on_inject(id, relay_stats::kind_block);
+      cryptonote::cryptonote_connection_context fake_context = AUTO_VAL_INIT(fake_context);
+      static_cast<cryptonote::i_cryptonote_protocol&>(origin.protocol).relay_block(req, fake_context);
+    }
+    if (!wait_for([&]() { return stats.complete(relay_stats::kind_block, n_nodes - 1) >= n_blocks; }, timeout))
+      LOG_PRINT_L0("Not all blocks reached every node");
+    std::cout << "blocks:" << std::endl;
+    stats.report(relay_stats::kind_block, n_nodes - 1, std::cout);
+    counters.report(std::cout);
+  }
+
+  for (auto& node : nodes)
+    node->server.send_stop_signal();
+  for (auto& node : nodes)
+  {
+    node->thread.join();
+    node->protocol.deinit();
+    node->server.deinit();
+  }
+  boost::system::error_code ec;
+  boost::filesystem::remove_all(data_root, ec);
+  epee::net_utils::data_logger::get_instance().kill_instance();
+  return 0;
+
+  CATCH_ENTRY_L0("main", 1);
+}
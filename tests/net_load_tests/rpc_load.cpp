@@ -0,0 +1,416 @@
+// Copyright (c) 2014-2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Replays a weighted mix of daemon and wallet RPC calls against running
+// servers, from a number of connections at once and, if asked, at a set
+// rate, and reports the throughput and latency percentiles of each method.
+// The calls are made up from the daemon's chain: block heights and output
+// indices are drawn at random, and transaction hashes come from recent
+// blocks. transfer is real, it sends --transfer-amount from the wallet to
+// its own address and so costs a fee each time.
+
+#include <algorithm>
+#include <atomic>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+
+#include <boost/chrono.hpp>
+#include <boost/program_options.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "include_base_utils.h"
+#include "misc_log_ex.h"
+#include "common/command_line.h"
+#include "cryptonote_core/cryptonote_format_utils.h"
+#include "net/http_client.h"
+#include "rpc/core_rpc_server_commands_defs.h"
+#include "storages/http_abstract_invoke.h"
+#include "wallet/wallet_rpc_server_commands_defs.h"
+
+namespace po = boost::program_options;
+
+namespace
+{
+  const command_line::arg_descriptor<std::string> arg_daemon_address  = {"daemon-address", "Daemon RPC to load", "http://127.0.0.1:18081"};
+  const command_line::arg_descriptor<std::string> arg_wallet_address  = {"wallet-address", "Wallet RPC to load, its methods are left out without one", ""};
+  const command_line::arg_descriptor<std::string> arg_mix             = {"mix", "Relative weight of each method",
+    "getblocks.bin=4,get_outs.bin=4,gettransactions=2,get_info=10,getbalance=2,transfer=0"};
+  const command_line::arg_descriptor<size_t>      arg_concurrency     = {"concurrency", "Connections making calls at once", 8};
+  const command_line::arg_descriptor<double>      arg_rate            = {"rate", "Calls per second across all connections, 0 for as fast as they go", 0};
+  const command_line::arg_descriptor<unsigned>    arg_duration        = {"duration", "Seconds to run for", 30};
+  const command_line::arg_descriptor<unsigned>    arg_timeout         = {"timeout", "Milliseconds to wait for each call", 60000};
+  const command_line::arg_descriptor<uint64_t>    arg_blocks_per_call = {"blocks-per-call", "Blocks asked for by each getblocks.bin", 100};
+  const command_line::arg_descriptor<size_t>      arg_ring_size       = {"ring-size", "Outputs asked for by each get_outs.bin, and the ring size of transfers", 5};
+  const command_line::arg_descriptor<size_t>      arg_txs_per_call    = {"txs-per-call", "Transactions asked for by each gettransactions", 10};
+  const command_line::arg_descriptor<uint64_t>    arg_transfer_amount = {"transfer-amount", "Atomic units each transfer sends", 1000000000};
+  const command_line::arg_descriptor<int>         arg_log_level       = {"log-level", "", LOG_LEVEL_0};
+
+  typedef boost::chrono::steady_clock clock_type;
+
+  enum method_id
+  {
+    method_getblocks,
+    method_get_outs,
+    method_gettransactions,
+    method_get_info,
+    method_getbalance,
+    method_transfer,
+    method_count
+  };
+  const char* const method_names[method_count] = {"getblocks.bin", "get_outs.bin", "gettransactions", "get_info", "getbalance", "transfer"};
+
+  struct load_options
+  {
+    std::string daemon_address;
+    std::string wallet_address;
+    unsigned timeout;
+    uint64_t blocks_per_call;
+    size_t ring_size;
+    size_t txs_per_call;
+    uint64_t transfer_amount;
+  };
+
+  // what the calls are drawn from, read once before the load starts
+  struct chain_sample
+  {
+    uint64_t height;
+    uint64_t rct_outputs;
+    std::vector<std::string> tx_hashes;
+    std::string wallet_address;
+  };
+
+  struct method_stats
+  {
+    std::vector<uint64_t> latencies_us;
+    size_t errors;
+
+    method_stats(): errors(0) {}
+  };
+
+  bool parse_mix(const std::string& s, std::vector<double>& weights)
+  {
+    weights.assign(method_count, 0);
+    std::istringstream in(s);
+    std::string item;
+    while (std::getline(in, item, ','))
+    {
+      const size_t eq = item.find('=');
+      if (eq == std::string::npos)
+        return false;
+      const std::string name = item.substr(0, eq);
+      const size_t m = std::find(method_names, method_names + method_count, name) - method_names;
+      if (m == method_count)
+        return false;
+      std::istringstream weight_in(item.substr(eq + 1));
+      if (!(weight_in >> weights[m]) || weights[m] < 0)
+        return false;
+    }
+    return true;
+  }
+
+  bool sample_chain(epee::net_utils::http::http_simple_client& client, const load_options& options, chain_sample& sample)
+  {
+    cryptonote::COMMAND_RPC_GET_HEIGHT::request height_req = AUTO_VAL_INIT(height_req);
+    cryptonote::COMMAND_RPC_GET_HEIGHT::response height_res = AUTO_VAL_INIT(height_res);
+    bool r = epee::net_utils::invoke_http_json_remote_command2(options.daemon_address + "/getheight", height_req, height_res, client, options.timeout);
+    CHECK_AND_ASSERT_MES(r && height_res.status == CORE_RPC_STATUS_OK, false, "Failed to get the height from " << options.daemon_address);
+    sample.height = height_res.height;
+
+    cryptonote::COMMAND_RPC_GET_OUTPUT_HISTOGRAM::request histogram_req = AUTO_VAL_INIT(histogram_req);
+    cryptonote::COMMAND_RPC_GET_OUTPUT_HISTOGRAM::response histogram_res = AUTO_VAL_INIT(histogram_res);
+    histogram_req.amounts.push_back(0);
+    r = epee::net_utils::invoke_http_json_rpc(options.daemon_address + "/json_rpc", "get_output_histogram", histogram_req, histogram_res, client, options.timeout);
+    CHECK_AND_ASSERT_MES(r && histogram_res.status == CORE_RPC_STATUS_OK, false, "Failed to get the output histogram from " << options.daemon_address);
+    sample.rct_outputs = histogram_res.histogram.empty() ? 0 : histogram_res.histogram.front().unlocked_instances;
+
+    // transactions of the last blocks
+    cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::request blocks_req = AUTO_VAL_INIT(blocks_req);
+    cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::response blocks_res = AUTO_VAL_INIT(blocks_res);
+    blocks_req.start_height = sample.height > 200 ? sample.height - 200 : 1;
+    r = epee::net_utils::invoke_http_bin_remote_command2(options.daemon_address + "/getblocks.bin", blocks_req, blocks_res, client, options.timeout);
+    CHECK_AND_ASSERT_MES(r && blocks_res.status == CORE_RPC_STATUS_OK, false, "Failed to get blocks from " << options.daemon_address);
+    for (const cryptonote::block_complete_entry& entry: blocks_res.blocks)
+    {
+      cryptonote::block b;
+      if (!cryptonote::parse_and_validate_block_from_blob(entry.block, b))
+        continue;
+      for (const crypto::hash& h: b.tx_hashes)
+        sample.tx_hashes.push_back(epee::string_tools::pod_to_hex(h));
+    }
+
+    if (!options.wallet_address.empty())
+    {
+      tools::wallet_rpc::COMMAND_RPC_GET_ADDRESS::request address_req = AUTO_VAL_INIT(address_req);
+      tools::wallet_rpc::COMMAND_RPC_GET_ADDRESS::response address_res = AUTO_VAL_INIT(address_res);
+      r = epee::net_utils::invoke_http_json_rpc(options.wallet_address + "/json_rpc", "getaddress", address_req, address_res, client, options.timeout);
+      CHECK_AND_ASSERT_MES(r, false, "Failed to get the address of the wallet at " << options.wallet_address);
+      sample.wallet_address = address_res.address;
+    }
+    return true;
+  }
+
+  bool call(method_id m, epee::net_utils::http::http_simple_client& client, const load_options& options, const chain_sample& sample, std::mt19937_64& rng)
+  {
+    switch (m)
+    {
+      case method_getblocks:
+      {
+        cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::request req = AUTO_VAL_INIT(req);
+        cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::response res = AUTO_VAL_INIT(res);
+        req.start_height = std::uniform_int_distribution<uint64_t>(1, sample.height - 1)(rng);
+        req.max_count = options.blocks_per_call;
+        bool r = epee::net_utils::invoke_http_bin_remote_command2(options.daemon_address + "/getblocks.bin", req, res, client, options.timeout);
+        return r && res.status == CORE_RPC_STATUS_OK;
+      }
+      case method_get_outs:
+      {
+        cryptonote::COMMAND_RPC_GET_OUTPUTS_BIN::request req = AUTO_VAL_INIT(req);
+        cryptonote::COMMAND_RPC_GET_OUTPUTS_BIN::response res = AUTO_VAL_INIT(res);
+        std::uniform_int_distribution<uint64_t> index(0, sample.rct_outputs - 1);
+        for (size_t n = 0; n < options.ring_size; ++n)
+          req.outputs.push_back({0, index(rng)});
+        std::sort(req.outputs.begin(), req.outputs.end(),
+            [](const cryptonote::get_outputs_out& a, const cryptonote::get_outputs_out& b) { return a.index < b.index; });
+        bool r = epee::net_utils::invoke_http_bin_remote_command2(options.daemon_address + "/get_outs.bin", req, res, client, options.timeout);
+        return r && res.status == CORE_RPC_STATUS_OK;
+      }
+      case method_gettransactions:
+      {
+        cryptonote::COMMAND_RPC_GET_TRANSACTIONS::request req = AUTO_VAL_INIT(req);
+        cryptonote::COMMAND_RPC_GET_TRANSACTIONS::response res = AUTO_VAL_INIT(res);
+        std::uniform_int_distribution<size_t> index(0, sample.tx_hashes.size() - 1);
+        for (size_t n = 0; n < options.txs_per_call; ++n)
+          req.txs_hashes.push_back(sample.tx_hashes[index(rng)]);
+        bool r = epee::net_utils::invoke_http_json_remote_command2(options.daemon_address + "/gettransactions", req, res, client, options.timeout);
+        return r && res.status == CORE_RPC_STATUS_OK;
+      }
+      case method_get_info:
+      {
+        cryptonote::COMMAND_RPC_GET_INFO::request req = AUTO_VAL_INIT(req);
+        cryptonote::COMMAND_RPC_GET_INFO::response res = AUTO_VAL_INIT(res);
+        bool r = epee::net_utils::invoke_http_json_rpc(options.daemon_address + "/json_rpc", "get_info", req, res, client, options.timeout);
+        return r && res.status == CORE_RPC_STATUS_OK;
+      }
+      case method_getbalance:
+      {
+        tools::wallet_rpc::COMMAND_RPC_GET_BALANCE::request req = AUTO_VAL_INIT(req);
+        tools::wallet_rpc::COMMAND_RPC_GET_BALANCE::response res = AUTO_VAL_INIT(res);
+        return epee::net_utils::invoke_http_json_rpc(options.wallet_address + "/json_rpc", "getbalance", req, res, client, options.timeout);
+      }
+      case method_transfer:
+      {
+        tools::wallet_rpc::COMMAND_RPC_TRANSFER::request req = AUTO_VAL_INIT(req);
+        tools::wallet_rpc::COMMAND_RPC_TRANSFER::response res = AUTO_VAL_INIT(res);
+        tools::wallet_rpc::transfer_destination dst;
+        dst.amount = options.transfer_amount;
+        dst.address = sample.wallet_address;
+        req.destinations.push_back(dst);
+        req.mixin = options.ring_size - 1;
+        return epee::net_utils::invoke_http_json_rpc(options.wallet_address + "/json_rpc", "transfer", req, res, client, options.timeout);
+      }
+      default:
+        return false;
+    }
+  }
+
+  double percentile(const std::vector<uint64_t>& sorted, double p)
+  {
+    if (sorted.empty())
+      return 0;
+    return sorted[std::min(sorted.size() - 1, (size_t)(p * sorted.size()))] / 1000.0;
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  TRY_ENTRY();
+
+  po::options_description desc("Allowed options");
+  command_line::add_arg(desc, command_line::arg_help);
+  command_line::add_arg(desc, arg_daemon_address);
+  command_line::add_arg(desc, arg_wallet_address);
+  command_line::add_arg(desc, arg_mix);
+  command_line::add_arg(desc, arg_concurrency);
+  command_line::add_arg(desc, arg_rate);
+  command_line::add_arg(desc, arg_duration);
+  command_line::add_arg(desc, arg_timeout);
+  command_line::add_arg(desc, arg_blocks_per_call);
+  command_line::add_arg(desc, arg_ring_size);
+  command_line::add_arg(desc, arg_txs_per_call);
+  command_line::add_arg(desc, arg_transfer_amount);
+  command_line::add_arg(desc, arg_log_level);
+
+  po::variables_map vm;
+  bool r = command_line::handle_error_helper(desc, [&]()
+  {
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+    return true;
+  });
+  if (!r)
+    return 1;
+  if (command_line::get_arg(vm, command_line::arg_help))
+  {
+    std::cout << desc << std::endl;
+    return 0;
+  }
+
+  epee::log_space::get_set_log_detalisation_level(true, command_line::get_arg(vm, arg_log_level));
+  epee::log_space::log_singletone::add_logger(LOGGER_CONSOLE, NULL, NULL);
+
+  load_options options;
+  options.daemon_address = command_line::get_arg(vm, arg_daemon_address);
+  options.wallet_address = command_line::get_arg(vm, arg_wallet_address);
+  options.timeout = command_line::get_arg(vm, arg_timeout);
+  options.blocks_per_call = command_line::get_arg(vm, arg_blocks_per_call);
+  options.ring_size = std::max<size_t>(command_line::get_arg(vm, arg_ring_size), 1);
+  options.txs_per_call = command_line::get_arg(vm, arg_txs_per_call);
+  options.transfer_amount = command_line::get_arg(vm, arg_transfer_amount);
+  const size_t concurrency = std::max<size_t>(command_line::get_arg(vm, arg_concurrency), 1);
+  const double rate = command_line::get_arg(vm, arg_rate);
+  const unsigned duration = command_line::get_arg(vm, arg_duration);
+
+  std::vector<double> weights;
+  if (!parse_mix(command_line::get_arg(vm, arg_mix), weights))
+  {
+    std::cout << "The mix is a comma separated list of method=weight, of the methods";
+    for (const char* name: method_names)
+      std::cout << " " << name;
+    std::cout << std::endl;
+    return 1;
+  }
+
+  chain_sample sample;
+  {
+    epee::net_utils::http::http_simple_client client;
+    if (!sample_chain(client, options, sample))
+      return 1;
+  }
+  const auto drop = [&](method_id m, const char* reason) {
+    if (weights[m] > 0)
+      std::cout << "Leaving out " << method_names[m] << ": " << reason << std::endl;
+    weights[m] = 0;
+  };
+  if (sample.height < 2)
+    drop(method_getblocks, "no blocks past the genesis block");
+  if (sample.rct_outputs == 0)
+    drop(method_get_outs, "no unlocked rct outputs");
+  if (sample.tx_hashes.empty())
+    drop(method_gettransactions, "no transactions in the last blocks");
+  if (options.wallet_address.empty())
+  {
+    drop(method_getbalance, "no wallet");
+    drop(method_transfer, "no wallet");
+  }
+  if (std::all_of(weights.begin(), weights.end(), [](double w) { return w == 0; }))
+  {
+    std::cout << "Nothing left to call" << std::endl;
+    return 1;
+  }
+
+  std::vector<std::vector<method_stats>> stats(concurrency, std::vector<method_stats>(method_count));
+  std::atomic<uint64_t> next_call(0);
+  const clock_type::time_point start = clock_type::now();
+  const clock_type::time_point end = start + boost::chrono::seconds(duration);
+  std::vector<boost::thread> threads;
+  for (size_t t = 0; t < concurrency; ++t)
+  {
+    threads.emplace_back([&, t]() {
+      epee::net_utils::http::http_simple_client client;
+      std::mt19937_64 rng(std::random_device{}());
+      std::discrete_distribution<size_t> pick(weights.begin(), weights.end());
+      while (true)
+      {
+        // with a rate, each call has its slot in the schedule, and its latency
+        // counts from there, so calls queueing behind slow ones show up
+        clock_type::time_point due = clock_type::now();
+        if (rate > 0)
+        {
+          const uint64_t n = next_call++;
+          due = start + boost::chrono::duration_cast<clock_type::duration>(boost::chrono::duration<double>(n / rate));
+          if (due >= end)
+            break;
+          boost::this_thread::sleep_until(due);
+        }
+        else if (due >= end)
+        {
+          break;
+        }
+        const method_id m = (method_id)pick(rng);
+        const bool ok = call(m, client, options, sample, rng);
+        method_stats& s = stats[t][m];
+        if (ok)
+          s.latencies_us.push_back(boost::chrono::duration_cast<boost::chrono::microseconds>(clock_type::now() - due).count());
+        else
+          ++s.errors;
+      }
+    });
+  }
+  for (boost::thread& t: threads)
+    t.join();
+  const double elapsed = boost::chrono::duration<double>(clock_type::now() - start).count();
+
+  std::cout << std::endl << "method               calls  errors   calls/s   mean ms    p50 ms    p90 ms    p99 ms    max ms" << std::endl;
+  size_t total_calls = 0, total_errors = 0;
+  for (size_t m = 0; m < method_count; ++m)
+  {
+    method_stats merged;
+    for (const std::vector<method_stats>& s: stats)
+    {
+      merged.latencies_us.insert(merged.latencies_us.end(), s[m].latencies_us.begin(), s[m].latencies_us.end());
+      merged.errors += s[m].errors;
+    }
+    const size_t calls = merged.latencies_us.size();
+    if (calls == 0 && merged.errors == 0)
+      continue;
+    std::sort(merged.latencies_us.begin(), merged.latencies_us.end());
+    uint64_t sum = 0;
+    for (uint64_t us: merged.latencies_us)
+      sum += us;
+    std::cout << std::left << std::setw(18) << method_names[m] << std::right
+      << std::setw(8) << calls
+      << std::setw(8) << merged.errors
+      << std::fixed << std::setprecision(1)
+      << std::setw(10) << calls / elapsed
+      << std::setprecision(2)
+      << std::setw(10) << (calls ? sum / 1000.0 / calls : 0.0)
+      << std::setw(10) << percentile(merged.latencies_us, 0.5)
+      << std::setw(10) << percentile(merged.latencies_us, 0.9)
+      << std::setw(10) << percentile(merged.latencies_us, 0.99)
+      << std::setw(10) << (calls ? merged.latencies_us.back() / 1000.0 : 0.0) << std::endl;
+    total_calls += calls;
+    total_errors += merged.errors;
+  }
+  std::cout << std::endl << total_calls << " calls and " << total_errors << " errors in " << std::setprecision(1) << elapsed
+    << " s, " << total_calls / elapsed << " calls/s over " << concurrency << " connections" << std::endl;
+  return 0;
+
+  CATCH_ENTRY_L0("main", 1);
+}
@@ -0,0 +1,104 @@
+// Copyright (c) 2014-2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+
+#include <list>
+#include <type_traits>
+#include <vector>
+
+#include "cryptonote_protocol/blobdatatype.h"
+
+// packing a 1000 block response and handing it over to the caller, as
+// wallet2::pull_blocks does: either in the std::list containers it used to
+// have, copied out, or in reserved std::vector containers, moved out. The
+// previous response is kept while the next one is packed, as the wallet does
+// when refreshing, so the heap is not trimmed and regrown on each call
+template<bool use_vector>
+class test_block_entries
+{
+public:
+  static const size_t loop_count = 100;
+  static const size_t blocks_count = 1000;
+  static const size_t txes_per_block = 4;
+
+  template<typename T>
+  using container = typename std::conditional<use_vector, std::vector<T>, std::list<T>>::type;
+
+  struct entry
+  {
+    cryptonote::blobdata block;
+    container<cryptonote::blobdata> txs;
+  };
+
+  bool init()
+  {
+    m_block_blob.assign(200, 'b');
+    m_tx_blob.assign(2000, 't');
+    return true;
+  }
+
+  bool test()
+  {
+    container<entry> blocks;
+    reserve(blocks, blocks_count);
+    for (size_t i = 0; i < blocks_count; ++i)
+    {
+      blocks.push_back(entry());
+      entry &e = blocks.back();
+      e.block = m_block_blob;
+      reserve(e.txs, txes_per_block);
+      for (size_t j = 0; j < txes_per_block; ++j)
+        e.txs.push_back(m_tx_blob);
+    }
+
+    container<entry> received;
+    if (use_vector)
+      received = std::move(blocks);
+    else
+      received = blocks;
+
+    size_t size = 0;
+    for (const entry &e: received)
+      for (const cryptonote::blobdata &tx: e.txs)
+        size += tx.size();
+    m_previous = std::move(received);
+    return size == blocks_count * txes_per_block * m_tx_blob.size();
+  }
+
+private:
+  template<typename T>
+  static void reserve(std::vector<T> &v, size_t n) { v.reserve(n); }
+  template<typename T>
+  static void reserve(std::list<T> &l, size_t n) { }
+
+  cryptonote::blobdata m_block_blob;
+  cryptonote::blobdata m_tx_blob;
+  container<entry> m_previous;
+};
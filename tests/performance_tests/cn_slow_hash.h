@@ -35,6 +35,8 @@
 
 class test_cn_slow_hash
 {
+  friend class test_cn_slow_hash_multi;
+
 public:
   static const size_t loop_count = 10;
 
@@ -69,3 +71,37 @@ private:
   data_t m_data;
   crypto::hash m_expected_hash;
 };
+
+class test_cn_slow_hash_multi
+{
+public:
+  static const size_t loop_count = 10;
+
+  bool init()
+  {
+    if (!m_single.init())
+      return false;
+    for (size_t i = 0; i < crypto::CN_SLOW_HASH_MAX_WAYS; ++i)
+    {
+      m_data[i] = &m_single.m_data;
+      m_length[i] = sizeof(m_single.m_data);
+    }
+    return true;
+  }
+
+  bool test()
+  {
+    crypto::hash hashes[crypto::CN_SLOW_HASH_MAX_WAYS];
+    crypto::cn_slow_hash_multi(m_data, m_length, crypto::CN_SLOW_HASH_MAX_WAYS, hashes);
+    for (const crypto::hash& hash : hashes)
+      if (hash != m_single.m_expected_hash)
+        return false;
+    return true;
+  }
+
+private:
+  test_cn_slow_hash m_single;
+  const void* m_data[crypto::CN_SLOW_HASH_MAX_WAYS];
+  size_t m_length[crypto::CN_SLOW_HASH_MAX_WAYS];
+};
+
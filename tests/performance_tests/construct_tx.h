@@ -30,13 +30,22 @@
 
 #pragma once
 
+#include "common/thread_group.h"
 #include "cryptonote_core/account.h"
 #include "cryptonote_core/cryptonote_basic.h"
 #include "cryptonote_core/cryptonote_format_utils.h"
 
 #include "multi_tx_test_base.h"
 
-template<size_t a_in_count, size_t a_out_count, bool a_rct>
+// Pool the threaded cases hand to construct_tx_and_get_tx_key. main creates
+// it before pinning itself to one core, so the workers are not pinned too.
+inline tools::thread_group &construct_tx_threads()
+{
+  static tools::thread_group threads;
+  return threads;
+}
+
+template<size_t a_in_count, size_t a_out_count, bool a_rct, bool a_threaded = false>
 class test_construct_tx : private multi_tx_test_base<a_in_count>
 {
   static_assert(0 < a_in_count, "in_count must be greater than 0");
@@ -47,6 +56,7 @@ public:
   static const size_t in_count  = a_in_count;
   static const size_t out_count = a_out_count;
   static const bool rct = a_rct;
+  static const bool threaded = a_threaded;
 
   typedef multi_tx_test_base<a_in_count> base_class;
 
@@ -70,7 +80,8 @@ public:
   bool test()
   {
     crypto::secret_key tx_key;
-    return cryptonote::construct_tx_and_get_tx_key(this->m_miners[this->real_source_idx].get_keys(), this->m_sources, m_destinations, std::vector<uint8_t>(), m_tx, 0, tx_key, rct);
+    return cryptonote::construct_tx_and_get_tx_key(this->m_miners[this->real_source_idx].get_keys(), this->m_sources, m_destinations, std::vector<uint8_t>(), m_tx, 0, tx_key, rct,
+      threaded ? &construct_tx_threads() : NULL);
   }
 
 private:
@@ -47,3 +47,35 @@ public:
     return cryptonote::is_out_to_acc(m_bob.get_keys(), tx_out, m_tx_pub_key, 0);
   }
 };
+
+// an output which is not ours, as nearly all scanned ones are, checked with
+// the derivation known and the spend key as is, or precomputed
+template<bool precomp>
+class test_is_out_to_acc_precomp : public single_tx_test_base
+{
+public:
+  static const size_t loop_count = 1000;
+
+  bool init()
+  {
+    if (!single_tx_test_base::init())
+      return false;
+    m_alice.generate();
+    if (!crypto::generate_key_derivation(m_tx_pub_key, m_alice.get_keys().m_view_secret_key, m_derivation))
+      return false;
+    return crypto::precompute_public_key(m_alice.get_keys().m_account_address.m_spend_public_key, m_spend_public_key);
+  }
+
+  bool test()
+  {
+    const cryptonote::txout_to_key& tx_out = boost::get<cryptonote::txout_to_key>(m_tx.vout[0].target);
+    if (precomp)
+      return !cryptonote::is_out_to_acc_precomp(m_spend_public_key, tx_out, m_derivation, 0);
+    return !cryptonote::is_out_to_acc_precomp(m_alice.get_keys().m_account_address.m_spend_public_key, tx_out, m_derivation, 0);
+  }
+
+private:
+  cryptonote::account_base m_alice;
+  crypto::key_derivation m_derivation;
+  crypto::public_key_precomp m_spend_public_key;
+};
@@ -28,11 +28,15 @@
 // 
 // Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
 
+#include <boost/program_options.hpp>
+
+#include "common/command_line.h"
 #include "performance_tests.h"
 #include "performance_utils.h"
 
 // tests
 #include "construct_tx.h"
+#include "block_entries.h"
 #include "check_tx_signature.h"
 #include "cn_slow_hash.h"
 #include "derive_public_key.h"
@@ -43,9 +47,60 @@
 #include "generate_key_image_helper.h"
 #include "generate_keypair.h"
 #include "is_out_to_acc.h"
+#include "rct_mlsag.h"
+#include "rct_range_proof.h"
+#include "ring_member_precomp.h"
+#include "thread_group.h"
+#include "tree_hash.h"
+#include "tx_serialization.h"
+
+namespace po = boost::program_options;
+
+namespace
+{
+  const command_line::arg_descriptor<std::string> arg_filter      = {"filter", "Run only the tests whose name contains this", ""};
+  const command_line::arg_descriptor<std::string> arg_json_output = {"json-output", "Write the results to this file as json", ""};
+  const command_line::arg_descriptor<std::string> arg_baseline    = {"baseline", "Compare with the results of an earlier --json-output, and fail on regressions", ""};
+  const command_line::arg_descriptor<unsigned>    arg_threshold   = {"threshold", "Percent a test may get slower than the baseline before it counts as a regression", 10};
+}
 
 int main(int argc, char** argv)
 {
+  po::options_description desc_options("Allowed options");
+  command_line::add_arg(desc_options, command_line::arg_help);
+  command_line::add_arg(desc_options, arg_filter);
+  command_line::add_arg(desc_options, arg_json_output);
+  command_line::add_arg(desc_options, arg_baseline);
+  command_line::add_arg(desc_options, arg_threshold);
+
+  po::variables_map vm;
+  bool r = command_line::handle_error_helper(desc_options, [&]()
+  {
+    po::store(po::parse_command_line(argc, argv, desc_options), vm);
+    po::notify(vm);
+    return true;
+  });
+  if (!r)
+    return 1;
+
+  if (command_line::get_arg(vm, command_line::arg_help))
+  {
+    std::cout << desc_options << std::endl;
+    return 0;
+  }
+
+  // read first, so a bad path fails before the tests run
+  performance_results baseline;
+  const std::string baseline_file = command_line::get_arg(vm, arg_baseline);
+  if (!baseline_file.empty() && !epee::serialization::load_t_from_json_file(baseline, baseline_file))
+  {
+    std::cerr << "Failed to load baseline from " << baseline_file << std::endl;
+    return 1;
+  }
+  current_run().filter = command_line::get_arg(vm, arg_filter);
+
+  construct_tx_threads();
+  dispatch_threads();
   set_process_affinity(1);
   set_thread_high_priority();
 
@@ -85,6 +140,18 @@ int main(int argc, char** argv)
   TEST_PERFORMANCE3(test_construct_tx, 100, 2, true);
   TEST_PERFORMANCE3(test_construct_tx, 100, 10, true);
 
+  TEST_PERFORMANCE3(test_construct_tx, 2, 4, true);
+  TEST_PERFORMANCE3(test_construct_tx, 2, 16, true);
+  TEST_PERFORMANCE3(test_construct_tx, 10, 16, true);
+
+  TEST_PERFORMANCE4(test_construct_tx, 2, 2, true, true);
+  TEST_PERFORMANCE4(test_construct_tx, 2, 4, true, true);
+  TEST_PERFORMANCE4(test_construct_tx, 2, 10, true, true);
+  TEST_PERFORMANCE4(test_construct_tx, 2, 16, true, true);
+  TEST_PERFORMANCE4(test_construct_tx, 10, 2, true, true);
+  TEST_PERFORMANCE4(test_construct_tx, 10, 16, true, true);
+  TEST_PERFORMANCE4(test_construct_tx, 100, 2, true, true);
+
   TEST_PERFORMANCE2(test_check_tx_signature, 1, false);
   TEST_PERFORMANCE2(test_check_tx_signature, 2, false);
   TEST_PERFORMANCE2(test_check_tx_signature, 10, false);
@@ -94,18 +161,82 @@ int main(int argc, char** argv)
   TEST_PERFORMANCE2(test_check_tx_signature, 10, true);
   TEST_PERFORMANCE2(test_check_tx_signature, 100, true);
 
+  TEST_PERFORMANCE1(test_range_proof, false);
+  TEST_PERFORMANCE1(test_range_proof, true);
+
+  TEST_PERFORMANCE1(test_mlsag_gen, 3);
+  TEST_PERFORMANCE1(test_mlsag_gen, 5);
+  TEST_PERFORMANCE1(test_mlsag_gen, 10);
+
+  TEST_PERFORMANCE1(test_mlsag_ver, 3);
+  TEST_PERFORMANCE1(test_mlsag_ver, 5);
+  TEST_PERFORMANCE1(test_mlsag_ver, 10);
+
+  TEST_PERFORMANCE2(test_gen_rct_simple, 1, 2);
+  TEST_PERFORMANCE2(test_gen_rct_simple, 2, 4);
+  TEST_PERFORMANCE2(test_gen_rct_simple, 10, 4);
+
+  TEST_PERFORMANCE2(test_ver_rct_simple, 1, 2);
+  TEST_PERFORMANCE2(test_ver_rct_simple, 2, 4);
+  TEST_PERFORMANCE2(test_ver_rct_simple, 10, 4);
+
+  TEST_PERFORMANCE4(test_tx_serialization, 1, 2, false, false);
+  TEST_PERFORMANCE4(test_tx_serialization, 1, 2, false, true);
+  TEST_PERFORMANCE4(test_tx_serialization, 10, 2, true, false);
+  TEST_PERFORMANCE4(test_tx_serialization, 10, 2, true, true);
+  TEST_PERFORMANCE4(test_tx_serialization, 10, 10, true, false);
+  TEST_PERFORMANCE4(test_tx_serialization, 10, 10, true, true);
+
+  TEST_PERFORMANCE2(test_block_serialization, 10, false);
+  TEST_PERFORMANCE2(test_block_serialization, 10, true);
+  TEST_PERFORMANCE2(test_block_serialization, 1000, false);
+  TEST_PERFORMANCE2(test_block_serialization, 1000, true);
+
+  TEST_PERFORMANCE1(test_tree_hash, 1);
+  TEST_PERFORMANCE1(test_tree_hash, 10);
+  TEST_PERFORMANCE1(test_tree_hash, 1000);
+
   TEST_PERFORMANCE0(test_is_out_to_acc);
+  TEST_PERFORMANCE1(test_is_out_to_acc_precomp, false);
+  TEST_PERFORMANCE1(test_is_out_to_acc_precomp, true);
   TEST_PERFORMANCE0(test_generate_key_image_helper);
   TEST_PERFORMANCE0(test_generate_key_derivation);
   TEST_PERFORMANCE0(test_generate_key_image);
   TEST_PERFORMANCE0(test_derive_public_key);
   TEST_PERFORMANCE0(test_derive_secret_key);
   TEST_PERFORMANCE0(test_ge_frombytes_vartime);
+  TEST_PERFORMANCE1(test_ring_member_precomp, false);
+  TEST_PERFORMANCE1(test_ring_member_precomp, true);
   TEST_PERFORMANCE0(test_generate_keypair);
 
   TEST_PERFORMANCE0(test_cn_slow_hash);
+  TEST_PERFORMANCE0(test_cn_slow_hash_multi);
+
+  TEST_PERFORMANCE1(test_block_entries, false);
+  TEST_PERFORMANCE1(test_block_entries, true);
+
+  TEST_PERFORMANCE2(test_thread_group_dispatch, 1000, false);
+  TEST_PERFORMANCE2(test_thread_group_dispatch, 10000, false);
+  TEST_PERFORMANCE2(test_thread_group_dispatch, 10000, true);
 
   std::cout << "Tests finished. Elapsed time: " << timer.elapsed_ms() / 1000 << " sec" << std::endl;
 
+  const std::string json_output = command_line::get_arg(vm, arg_json_output);
+  if (!json_output.empty() && !epee::serialization::store_t_to_json_file(current_run().results, json_output))
+  {
+    std::cerr << "Failed to write results to " << json_output << std::endl;
+    return 1;
+  }
+
+  if (!baseline_file.empty())
+  {
+    const size_t regressions = compare_with_baseline(baseline, current_run().results, command_line::get_arg(vm, arg_threshold));
+    if (regressions)
+    {
+      std::cout << regressions << " regressions" << std::endl;
+      return 1;
+    }
+  }
+
   return 0;
 }
@@ -31,10 +31,16 @@
 #pragma once
 
 #include <iostream>
+#include <map>
 #include <stdint.h>
+#include <string>
+#include <vector>
 
 #include <boost/chrono.hpp>
 
+#include "serialization/keyvalue_serialization.h"
+#include "storages/portable_storage_template_helper.h"
+
 class performance_timer
 {
 public:
@@ -56,6 +62,12 @@ public:
     return static_cast<int>(boost::chrono::duration_cast<boost::chrono::milliseconds>(elapsed).count());
   }
 
+  uint64_t elapsed_ns()
+  {
+    clock::duration elapsed = clock::now() - m_start;
+    return boost::chrono::duration_cast<boost::chrono::nanoseconds>(elapsed).count();
+  }
+
 private:
   clock::time_point m_base;
   clock::time_point m_start;
@@ -88,13 +100,16 @@ public:
       if (!test.test())
         return false;
     }
-    m_elapsed = timer.elapsed_ms();
+    m_elapsed_ns = timer.elapsed_ns();
+    m_elapsed = static_cast<int>(m_elapsed_ns / 1000000);
 
     return true;
   }
 
   int elapsed_time() const { return m_elapsed; }
 
+  uint64_t ns_per_call() const { return m_elapsed_ns / T::loop_count; }
+
   int time_per_call() const
   {
     static_assert(0 < T::loop_count, "T::loop_count must be greater than 0");
@@ -119,23 +134,105 @@ private:
 private:
   volatile uint64_t m_warm_up;  ///<! This field is intended for preclude compiler optimizations
   int m_elapsed;
+  uint64_t m_elapsed_ns;
+};
+
+// one line of the --json-output file, which --baseline reads back
+struct performance_result
+{
+  std::string name;
+  uint64_t loop_count;
+  uint64_t ns_per_call;
+  bool ok;
+
+  BEGIN_KV_SERIALIZE_MAP()
+    KV_SERIALIZE(name)
+    KV_SERIALIZE(loop_count)
+    KV_SERIALIZE(ns_per_call)
+    KV_SERIALIZE(ok)
+  END_KV_SERIALIZE_MAP()
+};
+
+struct performance_results
+{
+  std::vector<performance_result> results;
+
+  BEGIN_KV_SERIALIZE_MAP()
+    KV_SERIALIZE(results)
+  END_KV_SERIALIZE_MAP()
+};
+
+// what the tests ran so far, and which of them to run
+struct performance_run
+{
+  std::string filter;  // only tests whose name contains it run
+  performance_results results;
 };
 
+inline performance_run &current_run()
+{
+  static performance_run run;
+  return run;
+}
+
 template <typename T>
 void run_test(const char* test_name)
 {
+  performance_run &run = current_run();
+  if (std::string(test_name).find(run.filter) == std::string::npos)
+    return;
+
   test_runner<T> runner;
+  performance_result result = {test_name, T::loop_count, 0, false};
   if (runner.run())
   {
     std::cout << test_name << " - OK:\n";
     std::cout << "  loop count:    " << T::loop_count << '\n';
     std::cout << "  elapsed:       " << runner.elapsed_time() << " ms\n";
-    std::cout << "  time per call: " << runner.time_per_call() << " ms/call\n" << std::endl;
+    std::cout << "  time per call: " << runner.ns_per_call() / 1000 << " us/call\n" << std::endl;
+    result.ns_per_call = runner.ns_per_call();
+    result.ok = true;
   }
   else
   {
     std::cout << test_name << " - FAILED" << std::endl;
   }
+  run.results.results.push_back(result);
+}
+
+// prints each test against the same test in baseline, and returns how many
+// got slower by more than threshold percent (or newly fail)
+inline size_t compare_with_baseline(const performance_results &baseline, const performance_results &results, unsigned threshold)
+{
+  std::map<std::string, const performance_result*> previous;
+  for (const performance_result &r: baseline.results)
+    previous[r.name] = &r;
+
+  size_t regressions = 0;
+  std::cout << "Compared with baseline (threshold " << threshold << "%):" << std::endl;
+  for (const performance_result &r: results.results)
+  {
+    const auto it = previous.find(r.name);
+    if (it == previous.end() || !it->second->ok || !it->second->ns_per_call)
+    {
+      std::cout << "  " << r.name << ": no baseline" << std::endl;
+      continue;
+    }
+    const performance_result &base = *it->second;
+    if (!r.ok)
+    {
+      std::cout << "  " << r.name << ": FAILED - REGRESSION" << std::endl;
+      ++regressions;
+      continue;
+    }
+    const double change = (static_cast<double>(r.ns_per_call) / base.ns_per_call - 1) * 100;
+    const bool regressed = change > threshold;
+    std::cout << "  " << r.name << ": " << base.ns_per_call / 1000 << " -> " << r.ns_per_call / 1000 << " us/call ("
+      << (change >= 0 ? "+" : "") << static_cast<int>(change) << "%)" << (regressed ? " - REGRESSION" : "") << std::endl;
+    if (regressed)
+      ++regressions;
+  }
+  return regressions;
 }
 
 #define QUOTEME(x) #x
@@ -143,3 +240,4 @@ void run_test(const char* test_name)
 #define TEST_PERFORMANCE1(test_class, a0)     run_test< test_class<a0> >(QUOTEME(test_class<a0>))
 #define TEST_PERFORMANCE2(test_class, a0, a1) run_test< test_class<a0, a1> >(QUOTEME(test_class) "<" QUOTEME(a0) ", " QUOTEME(a1) ">")
 #define TEST_PERFORMANCE3(test_class, a0, a1, a2) run_test< test_class<a0, a1, a2> >(QUOTEME(test_class) "<" QUOTEME(a0) ", " QUOTEME(a1) ", " QUOTEME(a2) ">")
+#define TEST_PERFORMANCE4(test_class, a0, a1, a2, a3) run_test< test_class<a0, a1, a2, a3> >(QUOTEME(test_class) "<" QUOTEME(a0) ", " QUOTEME(a1) ", " QUOTEME(a2) ", " QUOTEME(a3) ">")
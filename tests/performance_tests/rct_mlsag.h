@@ -0,0 +1,206 @@
+// Copyright (c) 2014-2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <vector>
+
+#include "ringct/rctSigs.h"
+
+// MLSAG verification of a ring_size columns matrix with a double spend
+// protected row and a commitment row, as verRctMGSimple builds it
+template<size_t a_ring_size>
+class test_mlsag_ver
+{
+public:
+  static const size_t loop_count = 100;
+  static const size_t ring_size = a_ring_size;
+
+  bool init()
+  {
+    const size_t rows = 2, index = ring_size / 2;
+    m_pk = rct::keyMInit(rows, ring_size);
+    rct::keyV sk(rows);
+    for (size_t i = 0; i < ring_size; ++i)
+    {
+      for (size_t j = 0; j < rows; ++j)
+      {
+        rct::key x;
+        rct::skpkGen(x, m_pk[i][j]);
+        if (i == index)
+          sk[j] = x;
+      }
+    }
+    m_message = rct::skGen();
+    m_sig = rct::MLSAG_Gen(m_message, m_pk, sk, index, 1);
+    return rct::MLSAG_Ver(m_message, m_pk, m_sig, 1);
+  }
+
+  bool test()
+  {
+    return rct::MLSAG_Ver(m_message, m_pk, m_sig, 1);
+  }
+
+private:
+  rct::key m_message;
+  rct::keyM m_pk;
+  rct::mgSig m_sig;
+};
+
+// MLSAG signing of the same matrix
+template<size_t a_ring_size>
+class test_mlsag_gen
+{
+public:
+  static const size_t loop_count = 100;
+  static const size_t ring_size = a_ring_size;
+
+  bool init()
+  {
+    const size_t rows = 2;
+    m_pk = rct::keyMInit(rows, ring_size);
+    m_sk.resize(rows);
+    for (size_t i = 0; i < ring_size; ++i)
+    {
+      for (size_t j = 0; j < rows; ++j)
+      {
+        rct::key x;
+        rct::skpkGen(x, m_pk[i][j]);
+        if (i == index)
+          m_sk[j] = x;
+      }
+    }
+    m_message = rct::skGen();
+    return true;
+  }
+
+  bool test()
+  {
+    const rct::mgSig sig = rct::MLSAG_Gen(m_message, m_pk, m_sk, index, 1);
+    return !sig.ss.empty();
+  }
+
+private:
+  static const size_t index = ring_size / 2;
+  rct::key m_message;
+  rct::keyM m_pk;
+  rct::keyV m_sk;
+};
+
+// inputs of amount 1000 and the two outputs paying them, minus a fee, as
+// genRctSimple takes them
+template<size_t a_inputs>
+class rct_simple_test_base
+{
+public:
+  static const size_t inputs = a_inputs;
+
+  bool init()
+  {
+    const rct::xmr_amount amount = 1000;
+    for (size_t n = 0; n < inputs; ++n)
+    {
+      rct::ctkey sk, pk;
+      std::tie(sk, pk) = rct::ctskpkGen(amount);
+      m_sc.push_back(sk);
+      m_pc.push_back(pk);
+      m_inamounts.push_back(amount);
+    }
+
+    const rct::xmr_amount total = inputs * amount - fee;
+    for (rct::xmr_amount out_amount : {total / 2, total - total / 2})
+    {
+      rct::key sk, pk;
+      rct::skpkGen(sk, pk);
+      m_destinations.push_back(pk);
+      m_amount_keys.push_back(rct::hash_to_scalar(rct::zero()));
+      m_outamounts.push_back(out_amount);
+    }
+
+    return true;
+  }
+
+protected:
+  static const rct::xmr_amount fee = 1;
+  rct::ctkeyV m_sc, m_pc;
+  std::vector<rct::xmr_amount> m_inamounts, m_outamounts;
+  rct::keyV m_destinations, m_amount_keys;
+};
+
+// genRctSimple of a transaction with the given inputs and mixin
+template<size_t a_inputs, size_t a_mixin>
+class test_gen_rct_simple : private rct_simple_test_base<a_inputs>
+{
+public:
+  static const size_t loop_count = 10;
+  static const size_t inputs = a_inputs;
+  static const size_t mixin = a_mixin;
+
+  typedef rct_simple_test_base<a_inputs> base_class;
+
+  bool init()
+  {
+    return base_class::init();
+  }
+
+  bool test()
+  {
+    const rct::rctSig sig = rct::genRctSimple(rct::skGen(), this->m_sc, this->m_pc, this->m_destinations, this->m_inamounts, this->m_outamounts,
+      this->m_amount_keys, base_class::fee, mixin);
+    return sig.p.rangeSigs.size() == this->m_destinations.size();
+  }
+};
+
+// verRctSimple of a transaction with the given inputs and mixin
+template<size_t a_inputs, size_t a_mixin>
+class test_ver_rct_simple : private rct_simple_test_base<a_inputs>
+{
+public:
+  static const size_t loop_count = 10;
+  static const size_t inputs = a_inputs;
+  static const size_t mixin = a_mixin;
+
+  typedef rct_simple_test_base<a_inputs> base_class;
+
+  bool init()
+  {
+    if (!base_class::init())
+      return false;
+    m_sig = rct::genRctSimple(rct::skGen(), this->m_sc, this->m_pc, this->m_destinations, this->m_inamounts, this->m_outamounts,
+      this->m_amount_keys, base_class::fee, mixin);
+    return rct::verRctSimple(m_sig);
+  }
+
+  bool test()
+  {
+    return rct::verRctSimple(m_sig);
+  }
+
+private:
+  rct::rctSig m_sig;
+};
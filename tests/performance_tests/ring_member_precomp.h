@@ -0,0 +1,70 @@
+// Copyright (c) 2014-2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <vector>
+
+#include "crypto/crypto.h"
+#include "cryptonote_core/cryptonote_basic.h"
+
+extern "C" {
+#include "crypto/crypto-ops.h"
+}
+
+// decompression and precomputation of the same ring members, with the cache
+// off (the single point path check_ring_signature used to take) or on
+template<bool cached>
+class test_ring_member_precomp
+{
+public:
+  static const size_t loop_count = 1000;
+  static const size_t ring_size = 16;
+
+  bool init()
+  {
+    for (size_t i = 0; i < ring_size; ++i)
+      m_keys.push_back(cryptonote::keypair::generate().pub);
+    crypto::set_ring_member_cache_size(cached ? 8192 : 0);
+    return true;
+  }
+
+  bool test()
+  {
+    ge_dsmp key_pre, hash_pre;
+    for (const crypto::public_key &key: m_keys)
+    {
+      if (!crypto::ring_member_precomp(key, key_pre, hash_pre))
+        return false;
+    }
+    return true;
+  }
+
+private:
+  std::vector<crypto::public_key> m_keys;
+};
@@ -0,0 +1,87 @@
+// Copyright (c) 2014-2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <atomic>
+
+#include "common/task_region.h"
+#include "common/thread_group.h"
+
+// Pool for the dispatch cases. main creates it before pinning itself to one
+// core, so the workers are not pinned too.
+inline tools::thread_group &dispatch_threads()
+{
+  static tools::thread_group threads;
+  return threads;
+}
+
+// Dispatches many tiny functions, the way per-output and per-input checks
+// do, so the time is mostly spent queueing and dequeueing them.
+template<size_t a_tasks, bool a_nested>
+class test_thread_group_dispatch
+{
+public:
+  static const size_t loop_count = 100;
+  static const size_t tasks = a_tasks;
+  static const bool nested = a_nested;
+
+  bool init()
+  {
+    return true;
+  }
+
+  bool test()
+  {
+    tools::thread_group &threads = dispatch_threads();
+    std::atomic<size_t> count{0};
+    tools::task_region(threads, [&] (tools::task_region_handle& region) {
+      if (nested)
+      {
+        // each task spawns the next level from its own thread, as a
+        // divide and conquer pass would
+        const size_t width = threads.count() + 1;
+        for (size_t i = 0; i < width; ++i)
+        {
+          region.run([&threads, &count, width] {
+            tools::task_region(threads, [&] (tools::task_region_handle& inner) {
+              for (size_t j = 0; j < tasks / width; ++j)
+                inner.run([&count] { ++count; });
+            });
+          });
+        }
+      }
+      else
+      {
+        for (size_t i = 0; i < tasks; ++i)
+          region.run([&count] { ++count; });
+      }
+    });
+    return count == (nested ? tasks / (threads.count() + 1) * (threads.count() + 1) : tasks);
+  }
+};
@@ -0,0 +1,133 @@
+// Copyright (c) 2014-2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <vector>
+
+#include "cryptonote_core/account.h"
+#include "cryptonote_core/cryptonote_basic.h"
+#include "cryptonote_core/cryptonote_format_utils.h"
+#include "crypto/crypto.h"
+
+#include "multi_tx_test_base.h"
+
+// serializing a transaction with the given ring size and outputs to its
+// blob, or parsing it back
+template<size_t a_ring_size, size_t a_out_count, bool a_rct, bool a_parse>
+class test_tx_serialization : private multi_tx_test_base<a_ring_size>
+{
+public:
+  static const size_t loop_count = 10000;
+  static const size_t ring_size = a_ring_size;
+  static const size_t out_count = a_out_count;
+  static const bool rct = a_rct;
+  static const bool parse = a_parse;
+
+  typedef multi_tx_test_base<a_ring_size> base_class;
+
+  bool init()
+  {
+    using namespace cryptonote;
+
+    if (!base_class::init())
+      return false;
+
+    account_base alice;
+    alice.generate();
+    std::vector<tx_destination_entry> destinations;
+    for (size_t i = 0; i < out_count; ++i)
+      destinations.push_back(tx_destination_entry(this->m_source_amount / out_count, alice.get_keys().m_account_address));
+
+    crypto::secret_key tx_key;
+    if (!construct_tx_and_get_tx_key(this->m_miners[this->real_source_idx].get_keys(), this->m_sources, destinations, std::vector<uint8_t>(), m_tx, 0, tx_key, rct))
+      return false;
+    m_blob = tx_to_blob(m_tx);
+    return true;
+  }
+
+  bool test()
+  {
+    if (parse)
+    {
+      cryptonote::transaction tx;
+      return cryptonote::parse_and_validate_tx_from_blob(m_blob, tx);
+    }
+    cryptonote::blobdata blob;
+    return cryptonote::t_serializable_object_to_blob(m_tx, blob) && blob.size() == m_blob.size();
+  }
+
+private:
+  cryptonote::transaction m_tx;
+  cryptonote::blobdata m_blob;
+};
+
+// serializing a block listing the given number of transactions to its
+// blob, or parsing it back
+template<size_t a_tx_count, bool a_parse>
+class test_block_serialization
+{
+public:
+  static const size_t loop_count = 10000;
+  static const size_t tx_count = a_tx_count;
+  static const bool parse = a_parse;
+
+  bool init()
+  {
+    using namespace cryptonote;
+
+    account_base miner;
+    miner.generate();
+    m_block.major_version = 1;
+    m_block.minor_version = 1;
+    m_block.timestamp = 1400000000;
+    m_block.prev_id = crypto::rand<crypto::hash>();
+    m_block.nonce = 0;
+    if (!construct_miner_tx(0, 0, 0, 2, 0, miner.get_keys().m_account_address, m_block.miner_tx))
+      return false;
+    for (size_t i = 0; i < tx_count; ++i)
+      m_block.tx_hashes.push_back(crypto::rand<crypto::hash>());
+    m_blob = block_to_blob(m_block);
+    return true;
+  }
+
+  bool test()
+  {
+    if (parse)
+    {
+      cryptonote::block b;
+      return cryptonote::parse_and_validate_block_from_blob(m_blob, b);
+    }
+    cryptonote::blobdata blob;
+    return cryptonote::t_serializable_object_to_blob(m_block, blob) && blob.size() == m_blob.size();
+  }
+
+private:
+  cryptonote::block m_block;
+  cryptonote::blobdata m_blob;
+};
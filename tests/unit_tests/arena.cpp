@@ -0,0 +1,106 @@
+// Copyright (c) 2014-2016, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include <cstdint>
+#include <numeric>
+#include <vector>
+#include "common/arena.h"
+
+TEST(Arena, Alignment)
+{
+  tools::arena a(64);
+  for (std::size_t alignment : {1, 2, 4, 8, 16, 32}) {
+    a.allocate(1, 1);
+    const void* p = a.allocate(8, alignment);
+    EXPECT_EQ(0u, reinterpret_cast<std::uintptr_t>(p) % alignment);
+  }
+}
+
+TEST(Arena, ReuseAfterReset)
+{
+  tools::arena a(1024);
+  void* first = a.allocate(100, 8);
+  a.allocate(2000, 8);
+  const std::size_t capacity = a.capacity();
+  EXPECT_LE(3024u, capacity);
+
+  a.reset();
+  EXPECT_EQ(first, a.allocate(100, 8));
+  a.allocate(2000, 8);
+  EXPECT_EQ(capacity, a.capacity());
+}
+
+TEST(Arena, Rewind)
+{
+  tools::arena a(1024);
+  a.allocate(10, 1);
+  const tools::arena::mark m = a.get_mark();
+  void* p = a.allocate(10, 1);
+  a.allocate(5000, 1);
+  a.rewind(m);
+  EXPECT_EQ(p, a.allocate(10, 1));
+}
+
+TEST(Arena, Scope)
+{
+  EXPECT_EQ(nullptr, tools::arena::current());
+  {
+    tools::arena_scope outer;
+    tools::arena* a = tools::arena::current();
+    ASSERT_NE(nullptr, a);
+
+    tools::arena_vector<int> kept(10);
+    std::iota(kept.begin(), kept.end(), 0);
+    {
+      tools::arena_scope inner;
+      EXPECT_EQ(a, tools::arena::current());
+      tools::arena_vector<int> scratch(1000, -1);
+    }
+
+    // the inner scope gave back only what it allocated
+    tools::arena_vector<int> after(1000, 7);
+    for (int i = 0; i < 10; ++i) {
+      EXPECT_EQ(i, kept[i]);
+    }
+  }
+  EXPECT_EQ(nullptr, tools::arena::current());
+}
+
+TEST(Arena, HeapOutsideScope)
+{
+  tools::arena_vector<tools::arena_vector<int>> v;
+  for (int i = 0; i < 100; ++i) {
+    v.emplace_back(i, i);
+  }
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(std::size_t(i), v[i].size());
+  }
+  EXPECT_EQ(tools::arena_allocator<int>(nullptr), v.get_allocator());
+}
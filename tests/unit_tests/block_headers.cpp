@@ -0,0 +1,101 @@
+// Copyright (c) 2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 
+
+#include "gtest/gtest.h"
+
+#include "cryptonote_config.h"
+#include "cryptonote_core/cryptonote_format_utils.h"
+
+namespace
+{
+  cryptonote::block make_block()
+  {
+    cryptonote::block b;
+    EXPECT_TRUE(cryptonote::generate_genesis_block(b, config::GENESIS_TX, config::GENESIS_NONCE));
+    b.major_version = 2;
+    b.minor_version = 3;
+    b.timestamp = 1469000000;
+    b.nonce = 0x12345678;
+    memset(&b.prev_id, 0x11, sizeof(b.prev_id));
+    b.tx_hashes.resize(2);
+    memset(&b.tx_hashes[0], 0x22, sizeof(b.tx_hashes[0]));
+    memset(&b.tx_hashes[1], 0x33, sizeof(b.tx_hashes[1]));
+    return b;
+  }
+}
+
+TEST(block_headers, hashing_blob_round_trip)
+{
+  const cryptonote::block b = make_block();
+  const cryptonote::blobdata blob = cryptonote::get_block_hashing_blob(b);
+
+  cryptonote::block_header header;
+  crypto::hash tree_root_hash;
+  uint64_t tx_count;
+  ASSERT_TRUE(cryptonote::parse_block_hashing_blob(blob, header, tree_root_hash, tx_count));
+  ASSERT_EQ(b.major_version, header.major_version);
+  ASSERT_EQ(b.minor_version, header.minor_version);
+  ASSERT_EQ(b.timestamp, header.timestamp);
+  ASSERT_EQ(b.nonce, header.nonce);
+  ASSERT_TRUE(b.prev_id == header.prev_id);
+  ASSERT_TRUE(cryptonote::get_tx_tree_hash(b) == tree_root_hash);
+  ASSERT_EQ(3, tx_count);
+
+  // a block's id follows from its header alone
+  crypto::hash id;
+  ASSERT_TRUE(cryptonote::get_object_hash(blob, id));
+  ASSERT_TRUE(cryptonote::get_block_hash(b) == id);
+}
+
+TEST(block_headers, bad_hashing_blob)
+{
+  const cryptonote::blobdata blob = cryptonote::get_block_hashing_blob(make_block());
+  cryptonote::block_header header;
+  crypto::hash tree_root_hash;
+  uint64_t tx_count;
+  ASSERT_FALSE(cryptonote::parse_block_hashing_blob(blob.substr(0, blob.size() - 1), header, tree_root_hash, tx_count));
+  ASSERT_FALSE(cryptonote::parse_block_hashing_blob(blob + '\x01', header, tree_root_hash, tx_count));
+  ASSERT_FALSE(cryptonote::parse_block_hashing_blob(blob.substr(0, 10), header, tree_root_hash, tx_count));
+}
+
+TEST(block_headers, header_from_block_blob)
+{
+  const cryptonote::block b = make_block();
+  const cryptonote::blobdata blob = cryptonote::block_to_blob(b);
+
+  cryptonote::block_header header;
+  ASSERT_TRUE(cryptonote::parse_block_header_from_blob(blob, header));
+  ASSERT_EQ(b.major_version, header.major_version);
+  ASSERT_EQ(b.minor_version, header.minor_version);
+  ASSERT_EQ(b.timestamp, header.timestamp);
+  ASSERT_EQ(b.nonce, header.nonce);
+  ASSERT_TRUE(b.prev_id == header.prev_id);
+
+  ASSERT_FALSE(cryptonote::parse_block_header_from_blob(blob.substr(0, 10), header));
+}
@@ -0,0 +1,89 @@
+// Copyright (c) 2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 
+
+
+#include "gtest/gtest.h"
+
+#include "cryptonote_core/block_processing_stats.h"
+
+using namespace cryptonote;
+
+namespace
+{
+  block_processing_stats::sample make_sample(uint64_t usec)
+  {
+    block_processing_stats::sample s;
+    s.fill(usec);
+    return s;
+  }
+}
+
+TEST(block_processing_stats, empty)
+{
+  block_processing_stats stats;
+  ASSERT_EQ(0, stats.size());
+  ASSERT_EQ(0, stats.get_total_us(bpp_pow));
+  ASSERT_EQ(0, stats.get_max_us(bpp_pow));
+  ASSERT_EQ(0, stats.percentile(bpp_pow, 50));
+  ASSERT_EQ(0, stats.get_cumulative_blocks());
+  ASSERT_EQ(0, stats.get_cumulative_us(bpp_pow));
+}
+
+TEST(block_processing_stats, buckets)
+{
+  block_processing_stats stats;
+  stats.add(make_sample(0));
+  stats.add(make_sample(2));
+  stats.add(make_sample(3));
+  stats.add(make_sample(1000));
+  ASSERT_EQ(4, stats.size());
+  ASSERT_EQ(1005, stats.get_total_us(bpp_db_add));
+  ASSERT_EQ(1000, stats.get_max_us(bpp_db_add));
+  ASSERT_EQ(1, stats.get_bucket(bpp_db_add, 0));
+  ASSERT_EQ(2, stats.get_bucket(bpp_db_add, 1));
+  ASSERT_EQ(1, stats.get_bucket(bpp_db_add, 9));
+  ASSERT_EQ(4, stats.percentile(bpp_db_add, 50));
+  ASSERT_EQ(1024, stats.percentile(bpp_db_add, 99));
+}
+
+TEST(block_processing_stats, rolling)
+{
+  block_processing_stats stats(3);
+  stats.add(make_sample(5000));
+  for (int n = 0; n < 3; ++n)
+    stats.add(make_sample(10));
+  ASSERT_EQ(3, stats.size());
+  ASSERT_EQ(30, stats.get_total_us(bpp_total));
+  ASSERT_EQ(10, stats.get_max_us(bpp_total));
+  ASSERT_EQ(0, stats.get_bucket(bpp_total, 12));
+  ASSERT_EQ(3, stats.get_bucket(bpp_total, 3));
+  ASSERT_EQ(16, stats.percentile(bpp_total, 99));
+  ASSERT_EQ(4, stats.get_cumulative_blocks());
+  ASSERT_EQ(5030, stats.get_cumulative_us(bpp_total));
+}
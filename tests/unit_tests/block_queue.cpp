@@ -0,0 +1,161 @@
+// Copyright (c) 2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 
+
+#include "gtest/gtest.h"
+
+#include <boost/uuid/random_generator.hpp>
+#include "cryptonote_protocol/block_queue.h"
+
+namespace
+{
+  std::list<crypto::hash> make_hashes(uint64_t first, size_t n)
+  {
+    std::list<crypto::hash> hashes;
+    for (size_t i = 0; i < n; ++i)
+    {
+      crypto::hash h = cryptonote::null_hash;
+      *reinterpret_cast<uint64_t*>(h.data) = first + i + 1;
+      hashes.push_back(h);
+    }
+    return hashes;
+  }
+
+  std::vector<cryptonote::block_complete_entry> make_blocks(size_t n)
+  {
+    std::vector<cryptonote::block_complete_entry> blocks(n);
+    for (auto &b: blocks)
+      b.block = "block";
+    return blocks;
+  }
+}
+
+TEST(block_queue, reserves_disjoint_spans)
+{
+  cryptonote::block_queue queue;
+  const boost::uuids::uuid a = boost::uuids::random_generator()(), b = boost::uuids::random_generator()();
+  const std::list<crypto::hash> hashes = make_hashes(10, 100);
+  uint64_t start;
+  std::list<crypto::hash> span;
+
+  ASSERT_TRUE(queue.reserve_span(10, hashes, 30, a, start, span));
+  ASSERT_EQ(10, start);
+  ASSERT_EQ(30, span.size());
+  ASSERT_TRUE(span.front() == hashes.front());
+
+  ASSERT_TRUE(queue.reserve_span(10, hashes, 30, b, start, span));
+  ASSERT_EQ(40, start);
+  ASSERT_EQ(30, span.size());
+
+  ASSERT_TRUE(queue.reserve_span(10, hashes, 50, a, start, span));
+  ASSERT_EQ(70, start);
+  ASSERT_EQ(40, span.size());
+
+  ASSERT_FALSE(queue.reserve_span(10, hashes, 50, b, start, span));
+  ASSERT_EQ(3, queue.get_num_spans());
+
+  // a closed connection's reservations can be taken again
+  queue.release_spans(b);
+  ASSERT_TRUE(queue.reserve_span(10, hashes, 50, a, start, span));
+  ASSERT_EQ(40, start);
+  ASSERT_EQ(30, span.size());
+}
+
+TEST(block_queue, adds_in_order)
+{
+  cryptonote::block_queue queue;
+  const boost::uuids::uuid a = boost::uuids::random_generator()(), b = boost::uuids::random_generator()();
+  const std::list<crypto::hash> hashes = make_hashes(10, 20);
+  uint64_t start;
+  std::list<crypto::hash> span_a, span_b;
+  ASSERT_TRUE(queue.reserve_span(10, hashes, 10, a, start, span_a));
+  ASSERT_TRUE(queue.reserve_span(10, hashes, 10, b, start, span_b));
+
+  std::vector<cryptonote::block_complete_entry> blocks;
+  boost::uuids::uuid connection_id;
+
+  // the second span arrives first and has to wait
+  ASSERT_FALSE(queue.fill_span(span_b.front(), make_blocks(9), b));
+  ASSERT_TRUE(queue.fill_span(span_b.front(), make_blocks(10), b));
+  ASSERT_FALSE(queue.has_next_span(10));
+  ASSERT_EQ(50, queue.get_data_size());
+
+  ASSERT_TRUE(queue.fill_span(span_a.back(), make_blocks(10), a));
+  ASSERT_FALSE(queue.has_next_span(9));
+  ASSERT_TRUE(queue.get_next_span(10, start, blocks, connection_id));
+  ASSERT_EQ(10, start);
+  ASSERT_TRUE(connection_id == a);
+  ASSERT_EQ(10, blocks.size());
+
+  ASSERT_TRUE(queue.get_next_span(20, start, blocks, connection_id));
+  ASSERT_EQ(20, start);
+  ASSERT_TRUE(connection_id == b);
+  ASSERT_FALSE(queue.has_next_span(30));
+  ASSERT_EQ(0, queue.get_data_size());
+  ASSERT_EQ(0, queue.get_num_spans());
+}
+
+TEST(block_queue, retries_stalled_span)
+{
+  cryptonote::block_queue queue;
+  const boost::uuids::uuid a = boost::uuids::random_generator()(), b = boost::uuids::random_generator()();
+  const std::list<crypto::hash> hashes = make_hashes(10, 20);
+  uint64_t start;
+  std::list<crypto::hash> span;
+  ASSERT_TRUE(queue.reserve_span(10, hashes, 20, a, start, span));
+
+  ASSERT_FALSE(queue.retry_stalled_span(10, hashes, boost::posix_time::hours(1), b, start, span));
+  ASSERT_FALSE(queue.retry_stalled_span(10, make_hashes(20, 20), boost::posix_time::seconds(0), b, start, span));
+  ASSERT_TRUE(queue.retry_stalled_span(10, hashes, boost::posix_time::seconds(0), b, start, span));
+  ASSERT_EQ(10, start);
+  ASSERT_EQ(20, span.size());
+
+  // a bad span from either peer is dropped with everything it sent
+  ASSERT_TRUE(queue.fill_span(span.front(), make_blocks(20), a));
+  queue.flush_spans(a);
+  ASSERT_EQ(0, queue.get_num_spans());
+  ASSERT_EQ(0, queue.get_data_size());
+}
+
+TEST(block_queue, slow_peer_spans_taken_over)
+{
+  cryptonote::block_queue queue;
+  const boost::uuids::uuid a = boost::uuids::random_generator()(), b = boost::uuids::random_generator()(), c = boost::uuids::random_generator()();
+  const std::list<crypto::hash> hashes = make_hashes(10, 30);
+  uint64_t start;
+  std::list<crypto::hash> span;
+  ASSERT_TRUE(queue.reserve_span(10, hashes, 10, a, start, span));
+  ASSERT_TRUE(queue.reserve_span(10, hashes, 10, b, start, span));
+
+  // only the slow peer's span is up for grabs, even if it is not the lowest
+  ASSERT_FALSE(queue.retry_stalled_span(10, hashes, boost::posix_time::hours(1), c, start, span));
+  queue.mark_spans_stalled(b);
+  ASSERT_TRUE(queue.retry_stalled_span(10, hashes, boost::posix_time::hours(1), c, start, span));
+  ASSERT_EQ(20, start);
+  ASSERT_FALSE(queue.retry_stalled_span(10, hashes, boost::posix_time::hours(1), a, start, span));
+}
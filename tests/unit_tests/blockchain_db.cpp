@@ -29,6 +29,7 @@
 #include <boost/filesystem.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 #include <cstdio>
+#include <set>
 #include <iostream>
 #include <chrono>
 #include <thread>
@@ -337,4 +338,410 @@ TYPED_TEST(BlockchainDBTest, RetrieveBlockData)
   ASSERT_HASH_EQ(get_block_hash(this->m_blocks[1]), hashes[1]);
 }
 
+TYPED_TEST(BlockchainDBTest, RetrieveBlobs)
+{
+  std::string fname(tmpnam(NULL));
+  this->set_prefix(fname);
+
+  // make sure open does not throw
+  ASSERT_NO_THROW(this->m_db->open(fname));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+
+  blobdata bd;
+  ASSERT_NO_THROW(bd = this->m_db->get_block_blob(get_block_hash(this->m_blocks[0])));
+  ASSERT_EQ(block_to_blob(this->m_blocks[0]), bd);
+  ASSERT_NO_THROW(bd = this->m_db->get_block_blob_from_height(0));
+  ASSERT_EQ(block_to_blob(this->m_blocks[0]), bd);
+  ASSERT_THROW(this->m_db->get_block_blob_from_height(1), BLOCK_DNE);
+
+  for (auto& tx : this->m_txs[0])
+  {
+    ASSERT_TRUE(this->m_db->get_tx_blob(get_transaction_hash(tx), bd));
+    ASSERT_EQ(tx_to_blob(tx), bd);
+  }
+  ASSERT_FALSE(this->m_db->get_tx_blob(null_hash, bd));
+}
+
+TYPED_TEST(BlockchainDBTest, RetrieveOutputKeysBulk)
+{
+  std::string fname(tmpnam(NULL));
+  this->set_prefix(fname);
+
+  // make sure open does not throw
+  ASSERT_NO_THROW(this->m_db->open(fname));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+
+  std::set<uint64_t> amounts;
+  for (size_t n = 0; n < 2; ++n)
+    for (const auto &o : this->m_blocks[n].miner_tx.vout)
+      amounts.insert(o.amount);
+
+  std::vector<std::pair<uint64_t, uint64_t>> offsets;
+  for (const uint64_t amount : amounts)
+    for (uint64_t i = 0; i < this->m_db->get_num_outputs(amount); ++i)
+      offsets.push_back(std::make_pair(amount, i));
+  ASSERT_FALSE(offsets.empty());
+
+  std::vector<output_data_t> outputs;
+  ASSERT_NO_THROW(this->m_db->get_output_keys_bulk(offsets, outputs));
+  ASSERT_EQ(offsets.size(), outputs.size());
+  for (size_t n = 0; n < offsets.size(); ++n)
+  {
+    const output_data_t od = this->m_db->get_output_key(offsets[n].first, offsets[n].second);
+    ASSERT_EQ(od.pubkey, outputs[n].pubkey);
+    ASSERT_EQ(od.height, outputs[n].height);
+  }
+
+  offsets.push_back(std::make_pair(*amounts.rbegin(), this->m_db->get_num_outputs(*amounts.rbegin())));
+  ASSERT_THROW(this->m_db->get_output_keys_bulk(offsets, outputs), OUTPUT_DNE);
+}
+
+TYPED_TEST(BlockchainDBTest, RetrieveKeyImagesBulk)
+{
+  std::string fname(tmpnam(NULL));
+  this->set_prefix(fname);
+
+  // make sure open does not throw
+  ASSERT_NO_THROW(this->m_db->open(fname));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+
+  std::vector<crypto::key_image> images;
+  for (size_t n = 0; n < 2; ++n)
+    for (const auto &tx : this->m_txs[n])
+      for (const auto &in : tx.vin)
+        if (in.type() == typeid(txin_to_key))
+          images.push_back(boost::get<txin_to_key>(in).k_image);
+
+  crypto::key_image unspent;
+  memset(&unspent, 0x42, sizeof(unspent));
+  images.insert(images.begin(), unspent);
+
+  std::vector<bool> spent;
+  ASSERT_NO_THROW(this->m_db->has_key_images(images, spent));
+  ASSERT_EQ(images.size(), spent.size());
+  ASSERT_FALSE(spent[0]);
+  for (size_t n = 0; n < images.size(); ++n)
+    ASSERT_EQ(this->m_db->has_key_image(images[n]), spent[n]);
+}
+
+TYPED_TEST(BlockchainDBTest, RetrieveBlocksWithOutputIndices)
+{
+  std::string fname(tmpnam(NULL));
+  this->set_prefix(fname);
+
+  // make sure open does not throw
+  ASSERT_NO_THROW(this->m_db->open(fname));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+
+  std::vector<std::pair<blobdata, std::vector<blobdata> > > blocks;
+  std::vector<std::vector<std::vector<uint64_t> > > indices;
+  ASSERT_NO_THROW(this->m_db->get_blocks_with_output_indices(0, 10, blocks, indices));
+  ASSERT_EQ(2, blocks.size());
+  ASSERT_EQ(2, indices.size());
+  for (size_t n = 0; n < 2; ++n)
+  {
+    ASSERT_EQ(block_to_blob(this->m_blocks[n]), blocks[n].first);
+    ASSERT_EQ(this->m_txs[n].size(), blocks[n].second.size());
+    for (size_t i = 0; i < this->m_txs[n].size(); ++i)
+      ASSERT_EQ(tx_to_blob(this->m_txs[n][i]), blocks[n].second[i]);
+    ASSERT_EQ(1 + this->m_txs[n].size(), indices[n].size());
+    ASSERT_EQ(this->m_blocks[n].miner_tx.vout.size(), indices[n][0].size());
+  }
+
+  // the per tx lookups of the base class give the same answer
+  std::vector<std::pair<blobdata, std::vector<blobdata> > > slow_blocks;
+  std::vector<std::vector<std::vector<uint64_t> > > slow_indices;
+  ASSERT_NO_THROW(this->m_db->BlockchainDB::get_blocks_with_output_indices(1, 1, slow_blocks, slow_indices));
+  ASSERT_EQ(1, slow_blocks.size());
+  ASSERT_EQ(blocks[1].first, slow_blocks[0].first);
+  ASSERT_EQ(blocks[1].second, slow_blocks[0].second);
+  ASSERT_EQ(indices[1], slow_indices[0]);
+
+  blocks.clear();
+  ASSERT_NO_THROW(this->m_db->get_blocks_with_output_indices(2, 10, blocks, indices));
+  ASSERT_TRUE(blocks.empty());
+}
+
+TYPED_TEST(BlockchainDBTest, RetrieveTxsOutputIndices)
+{
+  std::string fname(tmpnam(NULL));
+  this->set_prefix(fname);
+
+  // make sure open does not throw
+  ASSERT_NO_THROW(this->m_db->open(fname));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+
+  std::vector<crypto::hash> hashes;
+  for (size_t n = 0; n < 2; ++n)
+  {
+    hashes.push_back(get_transaction_hash(this->m_blocks[n].miner_tx));
+    for (const auto &tx : this->m_txs[n])
+      hashes.push_back(get_transaction_hash(tx));
+  }
+  crypto::hash missing;
+  memset(&missing, 0x42, sizeof(missing));
+  hashes.insert(hashes.begin() + 1, missing);
+
+  std::vector<std::vector<uint64_t> > indices;
+  std::vector<bool> found;
+  ASSERT_NO_THROW(this->m_db->get_txs_amount_output_indices(hashes, indices, found));
+  ASSERT_EQ(hashes.size(), indices.size());
+  ASSERT_EQ(hashes.size(), found.size());
+  ASSERT_FALSE(found[1]);
+  ASSERT_TRUE(indices[1].empty());
+  for (size_t n = 0; n < hashes.size(); ++n)
+  {
+    if (n == 1)
+      continue;
+    uint64_t tx_id;
+    ASSERT_TRUE(found[n]);
+    ASSERT_TRUE(this->m_db->tx_exists(hashes[n], tx_id));
+    ASSERT_EQ(this->m_db->get_tx_amount_output_indices(tx_id), indices[n]);
+  }
+
+  // the per tx lookups of the base class give the same answer
+  std::vector<std::vector<uint64_t> > slow_indices;
+  std::vector<bool> slow_found;
+  ASSERT_NO_THROW(this->m_db->BlockchainDB::get_txs_amount_output_indices(hashes, slow_indices, slow_found));
+  ASSERT_EQ(indices, slow_indices);
+  ASSERT_EQ(found, slow_found);
+}
+
+TYPED_TEST(BlockchainDBTest, OutputHistogram)
+{
+  std::string fname(tmpnam(NULL));
+  this->set_prefix(fname);
+
+  // make sure open does not throw
+  ASSERT_NO_THROW(this->m_db->open(fname));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+
+  // the counts of the latest blocks are loaded now, then kept up to date
+  std::map<uint64_t, std::tuple<uint64_t, uint64_t, uint64_t>> histogram0, histogram1, histogram;
+  ASSERT_NO_THROW(histogram0 = this->m_db->get_output_histogram(std::vector<uint64_t>(), true, 1));
+  ASSERT_FALSE(histogram0.empty());
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+  ASSERT_NO_THROW(histogram1 = this->m_db->get_output_histogram(std::vector<uint64_t>(), true, 1));
+  for (const auto &e: histogram1)
+  {
+    ASSERT_EQ(this->m_db->get_num_outputs(e.first), std::get<0>(e.second));
+    // nothing is old enough to be unlocked yet
+    ASSERT_EQ(0, std::get<1>(e.second));
+    ASSERT_EQ(0, std::get<2>(e.second));
+  }
+
+  block b;
+  std::vector<transaction> txs;
+  ASSERT_NO_THROW(this->m_db->pop_block(b, txs));
+  ASSERT_NO_THROW(histogram = this->m_db->get_output_histogram(std::vector<uint64_t>(), true, 1));
+  ASSERT_EQ(histogram0, histogram);
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+  ASSERT_NO_THROW(histogram = this->m_db->get_output_histogram(std::vector<uint64_t>(), true, 1));
+  ASSERT_EQ(histogram1, histogram);
+}
+
+TYPED_TEST(BlockchainDBTest, OutputDistribution)
+{
+  std::string fname(tmpnam(NULL));
+  this->set_prefix(fname);
+
+  // make sure open does not throw
+  ASSERT_NO_THROW(this->m_db->open(fname));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+
+  std::vector<uint64_t> amounts(1, 0);
+  for (const auto &out: this->m_blocks[1].miner_tx.vout)
+    amounts.push_back(out.amount);
+
+  for (uint64_t amount: amounts)
+  {
+    std::vector<uint64_t> distribution, slow_distribution;
+    uint64_t base, slow_base;
+    ASSERT_TRUE(this->m_db->get_output_distribution(amount, 0, 10, distribution, base));
+    ASSERT_EQ(2, distribution.size());
+    ASSERT_EQ(0, base);
+    ASSERT_EQ(this->m_db->get_num_outputs(amount), distribution.back());
+
+    // the per block counts of the base class give the same answer
+    ASSERT_TRUE(this->m_db->BlockchainDB::get_output_distribution(amount, 0, 10, slow_distribution, slow_base));
+    ASSERT_EQ(slow_distribution, distribution);
+    ASSERT_EQ(slow_base, base);
+
+    ASSERT_TRUE(this->m_db->get_output_distribution(amount, 1, 1, distribution, base));
+    ASSERT_EQ(1, distribution.size());
+    ASSERT_EQ(slow_distribution[0], base);
+    ASSERT_EQ(slow_distribution[1], distribution[0]);
+
+    ASSERT_FALSE(this->m_db->get_output_distribution(amount, 2, 10, distribution, base));
+  }
+
+  // the running counts follow blocks being popped and added again
+  block b;
+  std::vector<transaction> txs;
+  std::vector<uint64_t> distribution;
+  uint64_t base;
+  ASSERT_NO_THROW(this->m_db->pop_block(b, txs));
+  ASSERT_TRUE(this->m_db->get_output_distribution(0, 0, 10, distribution, base));
+  ASSERT_EQ(1, distribution.size());
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+  ASSERT_TRUE(this->m_db->get_output_distribution(0, 0, 10, distribution, base));
+  ASSERT_EQ(2, distribution.size());
+  ASSERT_EQ(this->m_db->get_num_outputs(0), distribution.back());
+}
+
+TYPED_TEST(BlockchainDBTest, GroupSync)
+{
+  std::string fname(tmpnam(NULL));
+  this->set_prefix(fname);
+
+  // make sure open does not throw
+  ASSERT_NO_THROW(this->m_db->open(fname));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  db_sync_stats_t stats;
+  this->m_db->start_flusher(2, 0, 0);
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+  this->m_db->get_sync_stats(stats);
+  ASSERT_EQ(1, stats.unsynced_blocks);
+  ASSERT_EQ(t_sizes[0], stats.unsynced_bytes);
+  ASSERT_EQ(0, stats.syncs);
+
+  // the second block makes a group, synced on the flusher thread
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+  for (int n = 0; n < 500; ++n)
+  {
+    this->m_db->get_sync_stats(stats);
+    if (stats.syncs)
+      break;
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  this->m_db->stop_flusher();
+  ASSERT_EQ(1, stats.syncs);
+  ASSERT_EQ(0, stats.unsynced_blocks);
+  ASSERT_EQ(0, stats.unsynced_bytes);
+  ASSERT_EQ(0, stats.lag_ms);
+  ASSERT_EQ(stats.last_sync_us, stats.total_sync_us);
+}
+
+TYPED_TEST(BlockchainDBTest, ReadSnapshot)
+{
+  std::string fname(tmpnam(NULL));
+  this->set_prefix(fname);
+
+  // make sure open does not throw
+  ASSERT_NO_THROW(this->m_db->open(fname));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+  if (!this->m_db->can_snapshot_reads())
+    return;
+
+  // a snapshot keeps seeing one block while another thread adds a second
+  const crypto::hash h1 = get_block_hash(this->m_blocks[1]);
+  this->m_db->read_snapshot_start();
+  this->m_db->read_snapshot_start();
+  ASSERT_EQ(1, this->m_db->height());
+  std::thread writer([this]() {
+    this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]);
+  });
+  writer.join();
+  ASSERT_EQ(1, this->m_db->height());
+  ASSERT_FALSE(this->m_db->block_exists(h1));
+  ASSERT_EQ(get_block_hash(this->m_blocks[0]), this->m_db->top_block_hash());
+
+  // read txns within the snapshot leave it in place, and so does an inner one
+  this->m_db->block_txn_start(true);
+  this->m_db->block_txn_stop();
+  this->m_db->read_snapshot_stop();
+  ASSERT_EQ(1, this->m_db->height());
+  ASSERT_FALSE(this->m_db->block_exists(h1));
+
+  this->m_db->read_snapshot_stop();
+  ASSERT_EQ(2, this->m_db->height());
+  ASSERT_TRUE(this->m_db->block_exists(h1));
+}
+
+TYPED_TEST(BlockchainDBTest, ParallelIteration)
+{
+  std::string fname(tmpnam(NULL));
+  this->set_prefix(fname);
+
+  // make sure open does not throw
+  ASSERT_NO_THROW(this->m_db->open(fname));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+
+  // more shards than items, so some are empty; each item must be seen once
+  const unsigned shards = 7;
+
+  std::vector<std::vector<uint64_t>> heights(shards);
+  ASSERT_TRUE(this->m_db->for_all_blocks_parallel(shards, [&](unsigned shard, uint64_t height, const crypto::hash&, const block&) {
+    heights[shard].push_back(height); return true; }));
+  std::multiset<uint64_t> all_heights;
+  for (const auto &v: heights)
+    all_heights.insert(v.begin(), v.end());
+  ASSERT_EQ((std::multiset<uint64_t>{0, 1}), all_heights);
+
+  std::multiset<std::string> expected, seen;
+  std::vector<std::vector<std::string>> per_shard(shards);
+  this->m_db->for_all_transactions([&](const crypto::hash &h, const transaction&) { expected.insert(epee::string_tools::pod_to_hex(h)); return true; });
+  ASSERT_TRUE(this->m_db->for_all_transactions_parallel(shards, [&](unsigned shard, const crypto::hash &h, const transaction&) {
+    per_shard[shard].push_back(epee::string_tools::pod_to_hex(h)); return true; }));
+  for (const auto &v: per_shard)
+    seen.insert(v.begin(), v.end());
+  ASSERT_EQ(expected, seen);
+
+  expected.clear(); seen.clear(); per_shard.assign(shards, std::vector<std::string>());
+  this->m_db->for_all_key_images([&](const crypto::key_image &ki) { expected.insert(epee::string_tools::pod_to_hex(ki)); return true; });
+  ASSERT_TRUE(this->m_db->for_all_key_images_parallel(shards, [&](unsigned shard, const crypto::key_image &ki) {
+    per_shard[shard].push_back(epee::string_tools::pod_to_hex(ki)); return true; }));
+  for (const auto &v: per_shard)
+    seen.insert(v.begin(), v.end());
+  ASSERT_EQ(expected, seen);
+
+  expected.clear(); seen.clear(); per_shard.assign(shards, std::vector<std::string>());
+  this->m_db->for_all_outputs([&](uint64_t amount, const crypto::hash &h, size_t idx) {
+    expected.insert(std::to_string(amount) + epee::string_tools::pod_to_hex(h) + std::to_string(idx)); return true; });
+  ASSERT_FALSE(expected.empty());
+  ASSERT_TRUE(this->m_db->for_all_outputs_parallel(shards, [&](unsigned shard, uint64_t amount, const crypto::hash &h, size_t idx) {
+    per_shard[shard].push_back(std::to_string(amount) + epee::string_tools::pod_to_hex(h) + std::to_string(idx)); return true; }));
+  for (const auto &v: per_shard)
+    seen.insert(v.begin(), v.end());
+  ASSERT_EQ(expected, seen);
+
+  // a false return stops the walk and is reported
+  ASSERT_FALSE(this->m_db->for_all_blocks_parallel(shards, [](unsigned, uint64_t, const crypto::hash&, const block&) { return false; }));
+}
+
 }  // anonymous namespace
@@ -0,0 +1,105 @@
+// Copyright (c) 2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 
+
+
+#include "gtest/gtest.h"
+
+#include "cryptonote_core/chain_events.h"
+
+using namespace cryptonote;
+
+namespace
+{
+  crypto::hash make_hash(unsigned char c)
+  {
+    crypto::hash h;
+    memset(&h, c, sizeof(h));
+    return h;
+  }
+}
+
+TEST(chain_events, empty)
+{
+  chain_events events;
+  std::vector<chain_events::event> found;
+  ASSERT_TRUE(events.get_since(events.get_last_seq(), found));
+  ASSERT_TRUE(found.empty());
+  // from before the journal was made, or from the future
+  ASSERT_FALSE(events.get_since(0, found));
+  ASSERT_FALSE(events.get_since(events.get_last_seq() + 1, found));
+}
+
+TEST(chain_events, since)
+{
+  chain_events events;
+  const uint64_t start = events.get_last_seq();
+  events.publish(chain_events::block_added, make_hash(1), 10);
+  events.publish(chain_events::tx_added, make_hash(2));
+  events.publish(chain_events::block_removed, make_hash(1), 10);
+  ASSERT_EQ(start + 3, events.get_last_seq());
+
+  std::vector<chain_events::event> found;
+  ASSERT_TRUE(events.get_since(start, found));
+  ASSERT_EQ(3, found.size());
+  ASSERT_EQ(start + 1, found[0].seq);
+  ASSERT_EQ(chain_events::block_added, found[0].type);
+  ASSERT_EQ(make_hash(1), found[0].hash);
+  ASSERT_EQ(10, found[0].height);
+  ASSERT_EQ(chain_events::tx_added, found[1].type);
+  ASSERT_EQ(chain_events::block_removed, found[2].type);
+
+  ASSERT_TRUE(events.get_since(start + 1, found, 1));
+  ASSERT_EQ(1, found.size());
+  ASSERT_EQ(start + 2, found[0].seq);
+}
+
+TEST(chain_events, dropped)
+{
+  chain_events events(2);
+  const uint64_t start = events.get_last_seq();
+  for (unsigned char c = 1; c <= 3; ++c)
+    events.publish(chain_events::tx_added, make_hash(c));
+
+  std::vector<chain_events::event> found;
+  ASSERT_FALSE(events.get_since(start, found));
+  ASSERT_TRUE(events.get_since(start + 1, found));
+  ASSERT_EQ(2, found.size());
+  ASSERT_EQ(make_hash(2), found[0].hash);
+  ASSERT_EQ(make_hash(3), found[1].hash);
+}
+
+TEST(chain_events, wait)
+{
+  chain_events events;
+  const uint64_t start = events.get_last_seq();
+  // nothing comes, so it times out
+  ASSERT_EQ(start, events.wait(start, 0));
+  events.publish(chain_events::reorg, make_hash(1), 5);
+  ASSERT_EQ(start + 1, events.wait(start, 10));
+}
@@ -0,0 +1,70 @@
+// Copyright (c) 2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 
+
+#include "gtest/gtest.h"
+
+#include "cryptonote_protocol/compact_block.h"
+
+namespace
+{
+  crypto::hash make_hash(char c)
+  {
+    crypto::hash h;
+    memset(&h, c, sizeof(h));
+    return h;
+  }
+}
+
+TEST(compact_block, ids_round_trip)
+{
+  const crypto::hash key = cryptonote::get_compact_block_key("block", 42);
+  std::string ids;
+  std::vector<uint64_t> expected;
+  for (char c = 0; c < 10; ++c)
+  {
+    expected.push_back(cryptonote::get_compact_tx_id(key, make_hash(c)));
+    cryptonote::append_compact_tx_id(ids, expected.back());
+  }
+  ASSERT_EQ(10 * COMPACT_TX_ID_SIZE, ids.size());
+  for (size_t i = 0; i < expected.size(); ++i)
+  {
+    EXPECT_EQ(expected[i], cryptonote::read_compact_tx_id(ids, i));
+    EXPECT_EQ(0, expected[i] >> (8 * COMPACT_TX_ID_SIZE));
+  }
+}
+
+TEST(compact_block, ids_depend_on_salt_and_block)
+{
+  const crypto::hash tx_hash = make_hash(1);
+  const uint64_t id = cryptonote::get_compact_tx_id(cryptonote::get_compact_block_key("block", 42), tx_hash);
+  EXPECT_EQ(id, cryptonote::get_compact_tx_id(cryptonote::get_compact_block_key("block", 42), tx_hash));
+  EXPECT_NE(id, cryptonote::get_compact_tx_id(cryptonote::get_compact_block_key("block", 43), tx_hash));
+  EXPECT_NE(id, cryptonote::get_compact_tx_id(cryptonote::get_compact_block_key("other", 42), tx_hash));
+  EXPECT_NE(id, cryptonote::get_compact_tx_id(cryptonote::get_compact_block_key("block", 42), make_hash(2)));
+}
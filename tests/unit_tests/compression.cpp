@@ -0,0 +1,65 @@
+// Copyright (c) 2014-2016, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include <string>
+#include "common/compression.h"
+
+TEST(Compression, RoundTrip)
+{
+  if (!tools::compression_available())
+    return;
+
+  std::string data;
+  for (int i = 0; i < 10000; ++i)
+    data += "block " + std::to_string(i % 100);
+
+  std::string compressed, inflated;
+  ASSERT_TRUE(tools::compress(data, compressed));
+  EXPECT_LT(compressed.size(), data.size());
+  ASSERT_TRUE(tools::decompress(compressed, data.size(), inflated));
+  EXPECT_EQ(data, inflated);
+}
+
+TEST(Compression, Invalid)
+{
+  if (!tools::compression_available())
+    return;
+
+  const std::string data(1000, 'x');
+  std::string compressed, inflated;
+  ASSERT_TRUE(tools::compress(data, compressed));
+
+  // the size is part of the message and must match exactly
+  EXPECT_FALSE(tools::decompress(compressed, data.size() - 1, inflated));
+  EXPECT_FALSE(tools::decompress(compressed, data.size() + 1, inflated));
+
+  EXPECT_FALSE(tools::decompress(compressed.substr(0, compressed.size() / 2), data.size(), inflated));
+  EXPECT_FALSE(tools::decompress(std::string(100, 'x'), data.size(), inflated));
+}
@@ -0,0 +1,98 @@
+// Copyright (c) 2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 
+
+#include "gtest/gtest.h"
+
+#include <vector>
+
+#include "cryptonote_config.h"
+#include "cryptonote_core/difficulty.h"
+
+namespace
+{
+  struct chain
+  {
+    std::vector<uint64_t> timestamps;
+    std::vector<cryptonote::difficulty_type> cumulative_difficulties;
+
+    void add(uint64_t n)
+    {
+      // timestamps out of order, as they may be on the chain
+      const uint64_t t = 1400000000 + n * 120 + (n * 7919) % 600;
+      const cryptonote::difficulty_type d = 1000 + (n * 104729) % 500;
+      timestamps.push_back(t);
+      cumulative_difficulties.push_back((cumulative_difficulties.empty() ? 0 : cumulative_difficulties.back()) + d);
+    }
+
+    cryptonote::difficulty_type expected(size_t target) const
+    {
+      const size_t begin = timestamps.size() - std::min<size_t>(timestamps.size(), DIFFICULTY_BLOCKS_COUNT);
+      return cryptonote::next_difficulty(std::vector<uint64_t>(timestamps.begin() + begin, timestamps.end()),
+          std::vector<cryptonote::difficulty_type>(cumulative_difficulties.begin() + begin, cumulative_difficulties.end()), target);
+    }
+  };
+}
+
+TEST(difficulty_window, same_as_next_difficulty_when_pushing)
+{
+  chain c;
+  cryptonote::difficulty_window w;
+  ASSERT_EQ(w.next_difficulty(DIFFICULTY_TARGET_V2), 1);
+  for (uint64_t n = 0; n < 2 * DIFFICULTY_BLOCKS_COUNT; ++n)
+  {
+    c.add(n);
+    w.push_back(c.timestamps.back(), c.cumulative_difficulties.back());
+    ASSERT_EQ(w.size(), std::min<size_t>(c.timestamps.size(), DIFFICULTY_BLOCKS_COUNT));
+    ASSERT_EQ(w.next_difficulty(DIFFICULTY_TARGET_V2), c.expected(DIFFICULTY_TARGET_V2));
+  }
+}
+
+TEST(difficulty_window, same_as_next_difficulty_when_popping)
+{
+  chain c;
+  cryptonote::difficulty_window w;
+  for (uint64_t n = 0; n < DIFFICULTY_BLOCKS_COUNT + 100; ++n)
+  {
+    c.add(n);
+    w.push_back(c.timestamps.back(), c.cumulative_difficulties.back());
+  }
+  while (c.timestamps.size() > 1)
+  {
+    c.timestamps.pop_back();
+    c.cumulative_difficulties.pop_back();
+    w.pop_back();
+    if (c.timestamps.size() >= DIFFICULTY_BLOCKS_COUNT)
+    {
+      const size_t h = c.timestamps.size() - static_cast<size_t>(DIFFICULTY_BLOCKS_COUNT);
+      w.push_front(c.timestamps[h], c.cumulative_difficulties[h]);
+    }
+    ASSERT_EQ(w.size(), std::min<size_t>(c.timestamps.size(), DIFFICULTY_BLOCKS_COUNT));
+    ASSERT_EQ(w.next_difficulty(DIFFICULTY_TARGET_V1), c.expected(DIFFICULTY_TARGET_V1));
+  }
+}
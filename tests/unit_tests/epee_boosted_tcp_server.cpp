@@ -38,6 +38,7 @@
 #include "include_base_utils.h"
 #include "string_tools.h"
 #include "net/abstract_tcp_server2.h"
+#include "net/net_helper.h"
 
 namespace
 {
@@ -133,3 +134,46 @@ TEST(boosted_tcp_server, worker_threads_are_exception_resistant)
   ASSERT_TRUE(srv.timed_wait_server_stop(5 * 1000));
   ASSERT_TRUE(srv.deinit_server());
 }
+
+TEST(boosted_tcp_server, io_service_shards_serve_connections)
+{
+  test_tcp_server srv(epee::net_utils::e_connection_type_RPC); // RPC disables network limit for unit tests
+  srv.set_io_service_shards(2);
+  ASSERT_EQ(2, srv.get_io_service_shards_count());
+  ASSERT_TRUE(srv.init_server(test_server_port, test_server_host));
+
+  // sharding is fixed once the acceptor is open
+  srv.set_io_service_shards(4);
+  ASSERT_EQ(2, srv.get_io_service_shards_count());
+
+  ASSERT_TRUE(srv.run_server(1, false));
+  for (size_t i = 0; i < 4; ++i)
+  {
+    test_connection_context context;
+    ASSERT_TRUE(srv.connect(test_server_host, std::to_string(test_server_port), 5000, context));
+  }
+
+  srv.send_stop_signal();
+  ASSERT_TRUE(srv.timed_wait_server_stop(5 * 1000));
+  ASSERT_TRUE(srv.deinit_server());
+}
+
+TEST(boosted_tcp_server, idle_connections_are_closed)
+{
+  test_tcp_server srv(epee::net_utils::e_connection_type_RPC); // RPC disables network limit for unit tests
+  srv.set_connection_idle_timeout(100);
+  ASSERT_TRUE(srv.init_server(test_server_port, test_server_host));
+  ASSERT_TRUE(srv.run_server(1, false));
+
+  epee::net_utils::blocked_mode_client client;
+  ASSERT_TRUE(client.connect(test_server_host, std::to_string(test_server_port), 5000, 5000));
+
+  // the server sends nothing, so the read ends with the server closing the connection
+  std::string buff;
+  ASSERT_TRUE(client.recv(buff));
+  ASSERT_TRUE(buff.empty());
+
+  srv.send_stop_signal();
+  ASSERT_TRUE(srv.timed_wait_server_stop(5 * 1000));
+  ASSERT_TRUE(srv.deinit_server());
+}
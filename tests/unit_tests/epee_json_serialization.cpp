@@ -0,0 +1,207 @@
+// Copyright (c) 2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 
+
+#include "gtest/gtest.h"
+
+#include "include_base_utils.h"
+#include "serialization/keyvalue_serialization.h"
+#include "storages/portable_storage_template_helper.h"
+#include "net/jsonrpc_structs.h"
+
+namespace
+{
+  struct inner
+  {
+    std::string name;
+    std::vector<uint64_t> values;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(name)
+      KV_SERIALIZE(values)
+    END_KV_SERIALIZE_MAP()
+  };
+
+  struct outer
+  {
+    uint64_t big;
+    int32_t negative;
+    uint8_t small;
+    bool flag;
+    double ratio;
+    std::string text;
+    inner child;
+    std::vector<inner> children;
+    std::vector<std::string> strings;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(big)
+      KV_SERIALIZE(negative)
+      KV_SERIALIZE(small)
+      KV_SERIALIZE(flag)
+      KV_SERIALIZE(ratio)
+      KV_SERIALIZE(text)
+      KV_SERIALIZE(child)
+      KV_SERIALIZE(children)
+      KV_SERIALIZE(strings)
+    END_KV_SERIALIZE_MAP()
+  };
+
+  outer make_outer()
+  {
+    outer o;
+    o.big = 18446744073709551615ull;
+    o.negative = -12345;
+    o.small = 200;
+    o.flag = true;
+    o.ratio = 0.625;
+    o.text = "quote \" backslash \\ slash / tab \t newline \n";
+    o.child.name = "child";
+    o.child.values = {1, 2, 3};
+    for(size_t i = 0; i < 5; ++i)
+    {
+      inner in;
+      in.name = std::string(i, 'a');
+      in.values.resize(i, i);
+      o.children.push_back(in);
+    }
+    o.strings = {"one", "two", ""};
+    return o;
+  }
+
+  void check_equal(const outer& a, const outer& b)
+  {
+    ASSERT_EQ(a.big, b.big);
+    ASSERT_EQ(a.negative, b.negative);
+    ASSERT_EQ(a.small, b.small);
+    ASSERT_EQ(a.flag, b.flag);
+    ASSERT_EQ(a.ratio, b.ratio);
+    ASSERT_EQ(a.text, b.text);
+    ASSERT_EQ(a.child.name, b.child.name);
+    ASSERT_EQ(a.child.values, b.child.values);
+    ASSERT_EQ(a.children.size(), b.children.size());
+    for(size_t i = 0; i < a.children.size(); ++i)
+    {
+      ASSERT_EQ(a.children[i].name, b.children[i].name);
+      ASSERT_EQ(a.children[i].values, b.children[i].values);
+    }
+    ASSERT_EQ(a.strings, b.strings);
+  }
+}
+
+TEST(epee_json_serialization, roundtrip)
+{
+  outer o = make_outer();
+  for(bool pretty: {false, true})
+  {
+    std::string json;
+    ASSERT_TRUE(epee::serialization::store_t_to_json(o, json, 0, pretty));
+
+    outer loaded;
+    ASSERT_TRUE(epee::serialization::load_t_from_json(loaded, json));
+    check_equal(o, loaded);
+  }
+}
+
+TEST(epee_json_serialization, compatible_with_tree)
+{
+  outer o = make_outer();
+
+  // the tree parser reads what the writer produces
+  std::string json;
+  ASSERT_TRUE(epee::serialization::store_t_to_json(o, json, 0, false));
+  epee::serialization::portable_storage ps;
+  ASSERT_TRUE(ps.load_from_json(json));
+  outer from_tree;
+  ASSERT_TRUE(from_tree.load(ps));
+  check_equal(o, from_tree);
+
+  // and the reader reads what the tree produces
+  epee::serialization::portable_storage ps2;
+  o.store(ps2);
+  std::string tree_json;
+  ASSERT_TRUE(ps2.dump_as_json(tree_json));
+  outer from_reader;
+  ASSERT_TRUE(epee::serialization::load_t_from_json(from_reader, tree_json));
+  check_equal(o, from_reader);
+}
+
+TEST(epee_json_serialization, nulls_and_errors)
+{
+  outer o;
+  o.big = 7;
+  ASSERT_TRUE(epee::serialization::load_t_from_json(o, "{\"big\": null, \"text\": \"x\"}"));
+  ASSERT_EQ(7, o.big);
+  ASSERT_EQ("x", o.text);
+
+  ASSERT_FALSE(epee::serialization::load_t_from_json(o, "{\"big\": 1,"));
+  ASSERT_FALSE(epee::serialization::load_t_from_json(o, "[1, 2]"));
+  ASSERT_FALSE(epee::serialization::load_t_from_json(o, "{\"negative\": \"not a number\"}"));
+  ASSERT_FALSE(epee::serialization::load_t_from_json(o, "{\"small\": 256}"));
+}
+
+TEST(epee_json_serialization, jsonrpc_id)
+{
+  const std::string req_json = "{\"jsonrpc\": \"2.0\", \"id\": 42, \"method\": \"test\", \"params\": {\"name\": \"n\", \"values\": [5]}}";
+  epee::serialization::portable_json_reader reader;
+  ASSERT_TRUE(reader.load_from_json(req_json));
+  epee::json_rpc::request<inner> req;
+  ASSERT_TRUE(req.load(reader));
+  ASSERT_EQ("test", req.method);
+  ASSERT_EQ("n", req.params.name);
+  ASSERT_EQ(std::vector<uint64_t>{5}, req.params.values);
+
+  epee::json_rpc::response<inner, epee::json_rpc::dummy_error> resp;
+  resp.jsonrpc = "2.0";
+  resp.id = req.id;
+  resp.result = req.params;
+  std::string resp_json;
+  ASSERT_TRUE(epee::serialization::store_t_to_json(resp, resp_json, 0, false));
+  ASSERT_EQ("{\"jsonrpc\":\"2.0\",\"id\":42,\"result\":{\"name\":\"n\",\"values\":[5]}}", resp_json);
+}
+
+TEST(epee_json_serialization, spilled)
+{
+  outer o = make_outer();
+  std::string json;
+  ASSERT_TRUE(epee::serialization::store_t_to_json(o, json));
+
+  std::string spilled;
+  size_t spills = 0;
+  std::string rest;
+  ASSERT_TRUE(epee::serialization::store_t_to_json_spilled(o, rest, 16, [&](std::string& text)
+  {
+    ASSERT_EQ(16, text.size());
+    spilled += text;
+    text.clear();
+    ++spills;
+  }));
+  ASSERT_LT(rest.size(), 16);
+  ASSERT_EQ(json.size() / 16, spills);
+  ASSERT_EQ(json, spilled + rest);
+}
@@ -422,6 +422,23 @@ TEST_F(positive_test_connection_to_levin_protocol_handler_calls, handler_process
   ASSERT_EQ(3, m_commands_handler.callback_counter());
 }
 
+TEST_F(positive_test_connection_to_levin_protocol_handler_calls, shared_notify_sends_same_packet)
+{
+  const int expected_command = 4673261;
+  const std::string data(256, 's');
+
+  test_connection_ptr conn = create_connection();
+
+  ASSERT_EQ(1, m_handler_config.notify(expected_command, data, conn->m_protocol_handler.get_connection_id()));
+  const std::string expected = conn->last_send_data();
+  conn->reset_last_send_data();
+
+  const epee::net_utils::shared_buffer shared = epee::net_utils::make_shared_buffer(data);
+  ASSERT_EQ(1, m_handler_config.notify(expected_command, shared, conn->m_protocol_handler.get_connection_id()));
+  ASSERT_EQ(expected, conn->last_send_data());
+  ASSERT_EQ(sizeof(epee::levin::bucket_head2) + data.size(), expected.size());
+}
+
 TEST_F(test_levin_protocol_handler__hanle_recv_with_invalid_data, handles_big_packet_1)
 {
   std::string buf("yyyyyy");
@@ -524,6 +541,59 @@ TEST_F(test_levin_protocol_handler__hanle_recv_with_invalid_data, handles_two_re
   ASSERT_EQ(2, m_commands_handler.invoke_counter());
 }
 
+TEST_F(test_levin_protocol_handler__hanle_recv_with_invalid_data, handles_requests_split_at_every_byte)
+{
+  prepare_buf();
+  m_buf.append(m_buf);
+
+  for (size_t i = 0; i < m_buf.size(); ++i)
+    ASSERT_TRUE(m_conn->m_protocol_handler.handle_recv(m_buf.data() + i, 1));
+  ASSERT_EQ(2, m_commands_handler.invoke_counter());
+  ASSERT_EQ(m_in_data, m_commands_handler.last_in_buf());
+}
+
+TEST_F(test_levin_protocol_handler__hanle_recv_with_invalid_data, handles_request_split_after_full_request)
+{
+  prepare_buf();
+  const std::string one = m_buf;
+  m_buf.append(one, 0, sizeof(m_req_head) + 10);
+
+  ASSERT_TRUE(m_conn->m_protocol_handler.handle_recv(m_buf.data(), m_buf.size()));
+  ASSERT_EQ(1, m_commands_handler.invoke_counter());
+
+  ASSERT_TRUE(m_conn->m_protocol_handler.handle_recv(one.data() + sizeof(m_req_head) + 10, one.size() - sizeof(m_req_head) - 10));
+  ASSERT_EQ(2, m_commands_handler.invoke_counter());
+  ASSERT_EQ(m_in_data, m_commands_handler.last_in_buf());
+}
+
+TEST_F(test_levin_protocol_handler__hanle_recv_with_invalid_data, accounts_staged_body_memory)
+{
+  prepare_buf();
+  const uint64_t usage_before = epee::net_utils::connections_memory::usage();
+  const size_t first_size = sizeof(m_req_head) + m_in_data.size() / 2;
+
+  ASSERT_TRUE(m_conn->m_protocol_handler.handle_recv(m_buf.data(), first_size));
+  ASSERT_EQ(m_in_data.size(), m_conn->m_protocol_handler.get_context_ref().m_recv_buffer_bytes);
+  ASSERT_EQ(usage_before + m_in_data.size(), epee::net_utils::connections_memory::usage());
+
+  ASSERT_TRUE(m_conn->m_protocol_handler.handle_recv(m_buf.data() + first_size, m_buf.size() - first_size));
+  ASSERT_EQ(1, m_commands_handler.invoke_counter());
+  ASSERT_EQ(0, m_conn->m_protocol_handler.get_context_ref().m_recv_buffer_bytes);
+  ASSERT_EQ(usage_before, epee::net_utils::connections_memory::usage());
+}
+
+TEST_F(test_levin_protocol_handler__hanle_recv_with_invalid_data, refuses_invoke_over_memory_limit)
+{
+  prepare_buf();
+  ASSERT_TRUE(m_conn->m_protocol_handler.handle_recv(m_buf.data(), sizeof(m_req_head) + 1));
+
+  epee::net_utils::connections_memory::total_limit() = 1;
+  std::string out;
+  const int r = m_handler_config.invoke(expected_command, m_in_data, out, m_conn->m_protocol_handler.get_connection_id());
+  epee::net_utils::connections_memory::total_limit() = 0;
+  ASSERT_EQ(LEVIN_ERROR_CONNECTION_OVERLOADED, r);
+}
+
 TEST_F(test_levin_protocol_handler__hanle_recv_with_invalid_data, handles_unexpected_response)
 {
   m_req_head.m_flags = LEVIN_PACKET_RESPONSE;
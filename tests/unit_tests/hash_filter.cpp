@@ -0,0 +1,89 @@
+// Copyright (c) 2014-2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "crypto/crypto.h"
+#include "blockchain_db/hash_filter.h"
+
+TEST(hash_filter, no_false_negatives)
+{
+  cryptonote::hash_filter filter(10000);
+  std::vector<crypto::hash> hashes(10000);
+  for (auto &h: hashes)
+  {
+    h = crypto::rand<crypto::hash>();
+    filter.insert(&h);
+  }
+  ASSERT_EQ(hashes.size(), filter.size());
+  for (const auto &h: hashes)
+    ASSERT_TRUE(filter.may_contain(&h));
+}
+
+TEST(hash_filter, false_positive_rate)
+{
+  cryptonote::hash_filter filter(100000);
+  for (int i = 0; i < 100000; ++i)
+  {
+    const crypto::hash h = crypto::rand<crypto::hash>();
+    filter.insert(&h);
+  }
+  size_t positives = 0;
+  for (int i = 0; i < 100000; ++i)
+  {
+    const crypto::hash h = crypto::rand<crypto::hash>();
+    if (filter.may_contain(&h))
+      ++positives;
+  }
+  // about 0.07% expected at capacity
+  ASSERT_LT(positives, 300);
+}
+
+TEST(hash_filter, concurrent_inserts)
+{
+  const size_t nthreads = 4, per_thread = 5000;
+  cryptonote::hash_filter filter(nthreads * per_thread);
+  std::vector<std::vector<crypto::hash>> hashes(nthreads, std::vector<crypto::hash>(per_thread));
+  for (auto &v: hashes)
+    for (auto &h: v)
+      h = crypto::rand<crypto::hash>();
+
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < nthreads; ++i)
+    threads.emplace_back([&filter, &hashes, i]{ for (const auto &h: hashes[i]) filter.insert(&h); });
+  for (auto &t: threads)
+    t.join();
+
+  ASSERT_EQ(nthreads * per_thread, filter.size());
+  for (const auto &v: hashes)
+    for (const auto &h: v)
+      ASSERT_TRUE(filter.may_contain(&h));
+}
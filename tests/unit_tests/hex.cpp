@@ -0,0 +1,118 @@
+// Copyright (c) 2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "gtest/gtest.h"
+
+#include <sstream>
+#include "string_tools.h"
+
+namespace
+{
+  std::string reference_hex(const std::string& s)
+  {
+    std::stringstream ss;
+    ss << std::hex;
+    for (unsigned char c: s)
+      ss << std::setw(2) << std::setfill('0') << (unsigned)c;
+    return ss.str();
+  }
+
+  // every byte value, over lengths crossing the vector widths
+  std::string test_data(size_t size)
+  {
+    std::string s(size, '\0');
+    for (size_t i = 0; i < size; ++i)
+      s[i] = (char)(i * 37 + size);
+    return s;
+  }
+}
+
+TEST(hex, encode)
+{
+  for (size_t size = 0; size < 200; ++size)
+  {
+    const std::string data = test_data(size);
+    ASSERT_EQ(reference_hex(data), epee::string_tools::buff_to_hex_nodelimer(data)) << size;
+  }
+}
+
+TEST(hex, decode)
+{
+  for (size_t size = 0; size < 200; ++size)
+  {
+    const std::string data = test_data(size);
+    std::string hex = reference_hex(data), decoded;
+    ASSERT_TRUE(epee::string_tools::parse_hexstr_to_binbuff(hex, decoded));
+    ASSERT_EQ(data, decoded);
+    for (char& c: hex)
+      c = toupper(c);
+    ASSERT_TRUE(epee::string_tools::parse_hexstr_to_binbuff(hex, decoded));
+    ASSERT_EQ(data, decoded);
+  }
+}
+
+TEST(hex, reject_non_digits_anywhere)
+{
+  const std::string hex = reference_hex(test_data(100));
+  for (size_t pos = 0; pos < hex.size(); ++pos)
+  {
+    for (char c: {'g', 'G', '/', ':', '@', '`', ' ', '\0', '\xc1', '\xe1'})
+    {
+      std::string bad = hex, decoded;
+      bad[pos] = c;
+      ASSERT_FALSE(epee::string_tools::parse_hexstr_to_binbuff(bad, decoded)) << pos << " " << (int)c;
+      ASSERT_TRUE(decoded.empty());
+    }
+  }
+}
+
+TEST(hex, odd_length)
+{
+  std::string decoded;
+  ASSERT_FALSE(epee::string_tools::parse_hexstr_to_binbuff(std::string("abc"), decoded));
+  ASSERT_TRUE(epee::string_tools::parse_hexstr_to_binbuff(std::string("abc"), decoded, true));
+  ASSERT_EQ(std::string("\xab\x0c", 2), decoded);
+  ASSERT_FALSE(epee::string_tools::parse_hexstr_to_binbuff(std::string("abx"), decoded, true));
+}
+
+TEST(hex, pod)
+{
+  struct { unsigned char data[40]; } pod, parsed;
+  for (size_t i = 0; i < sizeof(pod.data); ++i)
+    pod.data[i] = (unsigned char)(i * 101);
+  const std::string hex = epee::string_tools::pod_to_hex(pod);
+  ASSERT_EQ(reference_hex(std::string((const char*)pod.data, sizeof(pod.data))), hex);
+  ASSERT_TRUE(epee::string_tools::hex_to_pod(hex, parsed));
+  ASSERT_EQ(0, memcmp(&pod, &parsed, sizeof(pod)));
+  memset(&parsed, 0, sizeof(parsed));
+  ASSERT_TRUE(epee::string_tools::parse_tpod_from_hex_string(hex, parsed));
+  ASSERT_EQ(0, memcmp(&pod, &parsed, sizeof(pod)));
+  ASSERT_FALSE(epee::string_tools::hex_to_pod(hex.substr(2), parsed));
+  ASSERT_FALSE(epee::string_tools::hex_to_pod(" " + hex.substr(1), parsed));
+}
@@ -0,0 +1,113 @@
+// Copyright (c) 2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include "include_base_utils.h"
+#include "net/http_protocol_handler.h"
+
+using epee::net_utils::connection_context_base;
+using epee::net_utils::http::http_request_info;
+using epee::net_utils::http::http_response_info;
+
+namespace
+{
+  struct test_endpoint: public epee::net_utils::i_service_endpoint
+  {
+    std::string sent;
+    bool closed = false;
+
+    virtual bool do_send(const void* ptr, size_t cb) { sent.append((const char*)ptr, cb); return true; }
+    virtual bool close() { closed = true; return true; }
+    virtual bool call_run_once_service_io() { return true; }
+    virtual bool request_callback() { return true; }
+    virtual boost::asio::io_service& get_io_service() { static boost::asio::io_service io_service; return io_service; }
+    virtual bool add_ref() { return true; }
+    virtual bool release() { return true; }
+  };
+
+  // sends two pieces through the chunk sender when there is one, and leaves a tail in the body
+  struct test_handler: public epee::net_utils::http::i_http_server_handler<connection_context_base>
+  {
+    bool chunked = false;
+
+    virtual bool handle_http_request(const http_request_info& query_info, http_response_info& response, connection_context_base& context)
+    {
+      response.m_mime_tipe = "text/plain";
+      chunked = bool(response.m_send_chunk);
+      for (size_t n = 0; n < 2; ++n)
+      {
+        response.m_body += std::string(1000, 'a' + n);
+        if (response.m_send_chunk && !response.m_send_chunk(response.m_body))
+          return false;
+      }
+      response.m_body += "tail";
+      return true;
+    }
+  };
+
+  std::string request(const std::string& version, bool chunked_responses, test_handler& handler, test_endpoint& endpoint)
+  {
+    epee::net_utils::http::custum_handler_config<connection_context_base> config;
+    config.m_phandler = &handler;
+    config.m_chunked_responses = chunked_responses;
+    connection_context_base context;
+    epee::net_utils::http::http_custom_handler<connection_context_base> protocol(&endpoint, config, context);
+    const std::string query = "GET /test " + version + "\r\nHost: localhost\r\n\r\n";
+    // HTTP/1.0 without keep-alive asks for the connection to be closed once answered
+    EXPECT_EQ(version == "HTTP/1.1", protocol.handle_recv(query.data(), query.size()));
+    return endpoint.sent;
+  }
+}
+
+TEST(http_chunked_response, chunks_in_order_then_last_chunk)
+{
+  test_handler handler;
+  test_endpoint endpoint;
+  const std::string sent = request("HTTP/1.1", true, handler, endpoint);
+  ASSERT_TRUE(handler.chunked);
+  const size_t body = sent.find("\r\n\r\n");
+  ASSERT_NE(std::string::npos, body);
+  ASSERT_NE(std::string::npos, sent.substr(0, body).find("Transfer-Encoding: chunked"));
+  ASSERT_EQ(std::string::npos, sent.substr(0, body).find("Content-Length"));
+  ASSERT_EQ("3e8\r\n" + std::string(1000, 'a') + "\r\n3e8\r\n" + std::string(1000, 'b') + "\r\n4\r\ntail\r\n0\r\n\r\n", sent.substr(body + 4));
+  ASSERT_FALSE(endpoint.closed);
+}
+
+TEST(http_chunked_response, whole_body_when_not_enabled_or_http_1_0)
+{
+  for (bool chunked_responses: {false, true})
+  {
+    test_handler handler;
+    test_endpoint endpoint;
+    const std::string sent = request(chunked_responses ? "HTTP/1.0" : "HTTP/1.1", chunked_responses, handler, endpoint);
+    ASSERT_FALSE(handler.chunked);
+    ASSERT_NE(std::string::npos, sent.find("Content-Length: 2004\r\n"));
+    ASSERT_EQ(std::string(1000, 'a') + std::string(1000, 'b') + "tail", sent.substr(sent.find("\r\n\r\n") + 4));
+  }
+}
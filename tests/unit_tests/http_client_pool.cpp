@@ -0,0 +1,89 @@
+// Copyright (c) 2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <boost/thread/thread.hpp>
+#include "common/http_client_pool.h"
+
+TEST(HttpClientPool, Reuse)
+{
+  tools::http_client_pool pool(2);
+  tools::http_client_pool::client *first;
+  {
+    tools::http_client_pool::lease lease(pool);
+    first = &lease.get();
+  }
+  tools::http_client_pool::lease again(pool);
+  EXPECT_EQ(first, &again.get());
+  // with one out, another is made
+  tools::http_client_pool::lease other(pool);
+  EXPECT_NE(first, &other.get());
+}
+
+TEST(HttpClientPool, Release)
+{
+  tools::http_client_pool pool(1);
+  tools::http_client_pool::lease lease(pool);
+  tools::http_client_pool::client *first = &lease.get();
+  lease.release();
+  lease.release();
+  tools::http_client_pool::lease again(pool);
+  EXPECT_EQ(first, &again.get());
+}
+
+TEST(HttpClientPool, WaitsAtMax)
+{
+  tools::http_client_pool pool(1);
+  std::atomic<bool> taken{false};
+  boost::thread waiter;
+  {
+    tools::http_client_pool::lease lease(pool);
+    waiter = boost::thread([&] {
+      tools::http_client_pool::lease second(pool);
+      taken = true;
+    });
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(50));
+    EXPECT_FALSE(taken);
+  }
+  waiter.join();
+  EXPECT_TRUE(taken);
+}
+
+TEST(HttpClientPool, Clear)
+{
+  tools::http_client_pool pool(1);
+  tools::http_client_pool::lease lease(pool);
+  pool.clear();
+  // the leased client is dropped when given back, and no longer counts
+  // towards the limit, else this would wait forever
+  lease.release();
+  tools::http_client_pool::lease again(pool);
+  EXPECT_FALSE(again.get().is_connected());
+}
@@ -0,0 +1,214 @@
+// Copyright (c) 2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "gtest/gtest.h"
+
+#include "include_base_utils.h"
+#include "net/http_protocol_handler.h"
+
+#ifdef HTTP_ENABLE_GZIP
+
+using epee::net_utils::connection_context_base;
+using epee::net_utils::http::http_request_info;
+using epee::net_utils::http::http_response_info;
+
+namespace
+{
+  struct test_endpoint: public epee::net_utils::i_service_endpoint
+  {
+    std::string sent;
+
+    virtual bool do_send(const void* ptr, size_t cb) { sent.append((const char*)ptr, cb); return true; }
+    virtual bool close() { return true; }
+    virtual bool call_run_once_service_io() { return true; }
+    virtual bool request_callback() { return true; }
+    virtual boost::asio::io_service& get_io_service() { static boost::asio::io_service io_service; return io_service; }
+    virtual bool add_ref() { return true; }
+    virtual bool release() { return true; }
+  };
+
+  struct test_handler: public epee::net_utils::http::i_http_server_handler<connection_context_base>
+  {
+    std::string body;
+    bool use_chunks = false;
+
+    virtual bool handle_http_request(const http_request_info& query_info, http_response_info& response, connection_context_base& context)
+    {
+      response.m_mime_tipe = "application/json";
+      response.m_body = body;
+      if (use_chunks && response.m_send_chunk)
+      {
+        if (!response.m_send_chunk(response.m_body))
+          return false;
+        // a second copy goes out with the last chunk
+        response.m_body = body;
+      }
+      return true;
+    }
+  };
+
+  struct collector: public epee::net_utils::i_target_handler
+  {
+    std::string data;
+    virtual bool handle_target_data(std::string& piece_of_transfer) { data += piece_of_transfer; piece_of_transfer.clear(); return true; }
+  };
+
+  std::string request(const std::string& accept_encoding, bool chunked_responses, test_handler& handler)
+  {
+    test_endpoint endpoint;
+    epee::net_utils::http::custum_handler_config<connection_context_base> config;
+    config.m_phandler = &handler;
+    config.m_chunked_responses = chunked_responses;
+    connection_context_base context;
+    epee::net_utils::http::http_custom_handler<connection_context_base> protocol(&endpoint, config, context);
+    std::string query = "POST /json_rpc HTTP/1.1\r\nHost: localhost\r\nContent-Length: 0\r\n";
+    if (!accept_encoding.empty())
+      query += "Accept-Encoding: " + accept_encoding + "\r\n";
+    query += "\r\n";
+    EXPECT_TRUE(protocol.handle_recv(query.data(), query.size()));
+    return endpoint.sent;
+  }
+
+  // decodes in small pieces, as a client reading off the socket would
+  bool inflate(const std::string& encoded, std::string& out)
+  {
+    collector target;
+    epee::net_utils::content_encoding_gzip decoder(&target);
+    for (size_t pos = 0; pos < encoded.size(); pos += 100)
+    {
+      std::string piece = encoded.substr(pos, 100);
+      if (!decoder.update_in(piece))
+        return false;
+    }
+    out = target.data;
+    return true;
+  }
+
+  std::string unchunk(const std::string& body)
+  {
+    std::string out;
+    size_t pos = 0;
+    while (true)
+    {
+      const size_t line_end = body.find("\r\n", pos);
+      const size_t size = std::stoul(body.substr(pos, line_end - pos), NULL, 16);
+      if (size == 0)
+        return out;
+      out += body.substr(line_end + 2, size);
+      pos = line_end + 2 + size + 2;
+    }
+  }
+
+  std::string json_body(size_t entries)
+  {
+    std::string body = "{\"blocks\": [";
+    for (size_t n = 0; n < entries; ++n)
+      body += "{\"height\": " + std::to_string(n) + ", \"hash\": \"0123456789abcdef\"},";
+    return body + "]}";
+  }
+}
+
+TEST(http_compression, accept_encoding)
+{
+  ASSERT_TRUE(epee::net_utils::is_gzip_accepted("gzip"));
+  ASSERT_TRUE(epee::net_utils::is_gzip_accepted("deflate, GZIP;q=0.5"));
+  ASSERT_TRUE(epee::net_utils::is_gzip_accepted("x-gzip"));
+  ASSERT_FALSE(epee::net_utils::is_gzip_accepted(""));
+  ASSERT_FALSE(epee::net_utils::is_gzip_accepted("deflate"));
+  ASSERT_FALSE(epee::net_utils::is_gzip_accepted("gzip;q=0"));
+  ASSERT_FALSE(epee::net_utils::is_gzip_accepted("gzipx"));
+}
+
+TEST(http_compression, round_trip_in_pieces)
+{
+  const std::string body = json_body(5000);
+  epee::net_utils::gzip_encoder encoder;
+  std::string encoded;
+  for (size_t pos = 0; pos < body.size(); pos += 4096)
+    ASSERT_TRUE(encoder.update(body.substr(pos, 4096), encoded, false));
+  ASSERT_TRUE(encoder.update(std::string(), encoded, true));
+  ASSERT_LT(encoded.size(), body.size() / 4);
+  std::string decoded;
+  ASSERT_TRUE(inflate(encoded, decoded));
+  ASSERT_EQ(body, decoded);
+}
+
+TEST(http_compression, corrupt_input)
+{
+  collector target;
+  epee::net_utils::content_encoding_gzip decoder(&target);
+  std::string garbage(1000, 'x');
+  ASSERT_FALSE(decoder.update_in(garbage));
+}
+
+TEST(http_compression, large_body_gzipped_when_accepted)
+{
+  test_handler handler;
+  handler.body = json_body(1000);
+  const std::string sent = request("gzip, deflate", false, handler);
+  const size_t head_end = sent.find("\r\n\r\n");
+  ASSERT_NE(std::string::npos, head_end);
+  const std::string head = sent.substr(0, head_end);
+  ASSERT_NE(std::string::npos, head.find("Content-Encoding:gzip"));
+  const std::string encoded = sent.substr(head_end + 4);
+  ASSERT_NE(std::string::npos, head.find("Content-Length: " + std::to_string(encoded.size()) + "\r\n"));
+  std::string decoded;
+  ASSERT_TRUE(inflate(encoded, decoded));
+  ASSERT_EQ(handler.body, decoded);
+}
+
+TEST(http_compression, sent_as_is_when_small_or_not_accepted)
+{
+  for (const auto& c: {std::make_pair(std::string("gzip"), (size_t)2), std::make_pair(std::string(), (size_t)1000), std::make_pair(std::string("gzip;q=0"), (size_t)1000)})
+  {
+    test_handler handler;
+    handler.body = json_body(c.second);
+    const std::string sent = request(c.first, false, handler);
+    ASSERT_EQ(std::string::npos, sent.find("Content-Encoding"));
+    ASSERT_EQ(handler.body, sent.substr(sent.find("\r\n\r\n") + 4));
+  }
+}
+
+TEST(http_compression, chunked_body_gzipped_as_a_stream)
+{
+  test_handler handler;
+  handler.body = json_body(1000);
+  handler.use_chunks = true;
+  const std::string sent = request("gzip", true, handler);
+  const size_t head_end = sent.find("\r\n\r\n");
+  ASSERT_NE(std::string::npos, head_end);
+  const std::string head = sent.substr(0, head_end);
+  ASSERT_NE(std::string::npos, head.find("Transfer-Encoding: chunked"));
+  ASSERT_NE(std::string::npos, head.find("Content-Encoding:gzip"));
+  std::string decoded;
+  ASSERT_TRUE(inflate(unchunk(sent.substr(head_end + 4)), decoded));
+  ASSERT_EQ(handler.body + handler.body, decoded);
+}
+
+#endif
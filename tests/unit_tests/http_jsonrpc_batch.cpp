@@ -0,0 +1,103 @@
+// Copyright (c) 2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include "net/http_server_jsonrpc_batch.h"
+
+using epee::net_utils::http::http_request_info;
+using epee::net_utils::http::http_response_info;
+
+TEST(http_jsonrpc_batch, split)
+{
+  std::vector<std::string> calls;
+  ASSERT_FALSE(epee::json_rpc::is_batch("{\"method\":\"a\"}"));
+  ASSERT_TRUE(epee::json_rpc::is_batch(" \n[{}]"));
+
+  ASSERT_TRUE(epee::json_rpc::split_batch("[]", calls));
+  ASSERT_TRUE(calls.empty());
+  ASSERT_TRUE(epee::json_rpc::split_batch(" [ {\"a\":[1,2]} , {\"b\":\"],\\\"}\"},3 ]\n", calls));
+  ASSERT_EQ(3, calls.size());
+  ASSERT_EQ("{\"a\":[1,2]}", calls[0]);
+  ASSERT_EQ("{\"b\":\"],\\\"}\"}", calls[1]);
+  ASSERT_EQ("3", calls[2]);
+
+  ASSERT_FALSE(epee::json_rpc::split_batch("[{}", calls));
+  ASSERT_FALSE(epee::json_rpc::split_batch("[{},]", calls));
+  ASSERT_FALSE(epee::json_rpc::split_batch("[,{}]", calls));
+  ASSERT_FALSE(epee::json_rpc::split_batch("[{}] x", calls));
+}
+
+TEST(http_jsonrpc_batch, answers_in_order)
+{
+  http_request_info query;
+  query.m_body = "[{\"id\":1},[],{\"id\":2},{\"id\":3},{\"throw\":1}]";
+  for (size_t threads: {1, 4})
+  {
+    http_response_info response;
+    int context = 0;
+    epee::json_rpc::handle_batch(query, response, context, threads,
+      [](const http_request_info& call, http_response_info& call_response, int& call_context)
+      {
+        if (call.m_body.find("throw") != std::string::npos)
+          throw std::runtime_error("failed");
+        call_response.m_body = call.m_body;
+        ++call_context;
+        return true;
+      });
+    ASSERT_EQ(0, response.m_body.find("[{\"id\":1},{"));
+    ASSERT_NE(std::string::npos, response.m_body.find("-32600"));
+    ASSERT_NE(std::string::npos, response.m_body.find("},{\"id\":2},{\"id\":3},{"));
+    ASSERT_NE(std::string::npos, response.m_body.find("-32603"));
+    if (threads == 1)
+      ASSERT_EQ(3, context);
+  }
+}
+
+TEST(http_jsonrpc_batch, rejects_empty_and_oversized_batches)
+{
+  http_request_info query;
+  http_response_info response;
+  int context = 0;
+  auto handler = [](const http_request_info&, http_response_info& call_response, int&) { call_response.m_body = "{}"; return true; };
+
+  query.m_body = "[]";
+  epee::json_rpc::handle_batch(query, response, context, 1, handler);
+  ASSERT_NE(std::string::npos, response.m_body.find("-32600"));
+
+  query.m_body = "[{}";
+  for (size_t i = 0; i < JSON_RPC_MAX_BATCH_SIZE; ++i)
+    query.m_body += ",{}";
+  query.m_body += "]";
+  epee::json_rpc::handle_batch(query, response, context, 1, handler);
+  ASSERT_NE(std::string::npos, response.m_body.find("-32600"));
+
+  query.m_body = "[{}, {}";
+  epee::json_rpc::handle_batch(query, response, context, 1, handler);
+  ASSERT_NE(std::string::npos, response.m_body.find("-32700"));
+}
@@ -0,0 +1,77 @@
+// Copyright (c) 2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include "net/http_server_method_stats.h"
+
+using epee::net_utils::http::method_stats;
+using epee::net_utils::http::method_stats_scope;
+
+TEST(http_method_stats, percentiles_come_from_log2_buckets)
+{
+  method_stats stats("/test_percentiles");
+  for (int i = 0; i < 98; ++i)
+    stats.add(10, 100, false);
+  stats.add(1000, 100, false);
+  stats.add(1000, 0, true);
+
+  ASSERT_EQ(100, stats.get_calls());
+  ASSERT_EQ(1, stats.get_errors());
+  ASSERT_EQ(9900, stats.get_bytes_out());
+  ASSERT_EQ(16, stats.percentile(stats.get_calls(), 50));
+  ASSERT_EQ(16, stats.percentile(stats.get_calls(), 98));
+  ASSERT_EQ(1024, stats.percentile(stats.get_calls(), 99));
+}
+
+TEST(http_method_stats, scope_records_response_size_and_errors)
+{
+  method_stats stats("/test_scope");
+  epee::net_utils::http::http_response_info response;
+  {
+    method_stats_scope scope(stats, response);
+    response.m_body = "12345";
+    scope.succeeded();
+  }
+  {
+    method_stats_scope scope(stats, response);
+  }
+  ASSERT_EQ(2, stats.get_calls());
+  ASSERT_EQ(1, stats.get_errors());
+  ASSERT_EQ(10, stats.get_bytes_out());
+}
+
+TEST(http_method_stats, text_lists_registered_methods)
+{
+  static method_stats stats("/test_text");
+  stats.add(3, 7, false);
+  const std::string text = epee::net_utils::http::get_method_stats_text("test_rpc");
+  ASSERT_NE(std::string::npos, text.find("test_rpc_request_duration_seconds_count{method=\"/test_text\"} 1\n"));
+  ASSERT_NE(std::string::npos, text.find("test_rpc_request_duration_seconds_bucket{method=\"/test_text\",le=\"4e-06\"} 1\n"));
+  ASSERT_NE(std::string::npos, text.find("test_rpc_response_bytes_total{method=\"/test_text\"} 7\n"));
+}
@@ -0,0 +1,146 @@
+// Copyright (c) 2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "gtest/gtest.h"
+
+#include "include_base_utils.h"
+#include "net/http_protocol_handler.h"
+
+using epee::net_utils::connection_context_base;
+using epee::net_utils::http::http_request_info;
+using epee::net_utils::http::http_response_info;
+
+namespace
+{
+  struct test_endpoint: public epee::net_utils::i_service_endpoint
+  {
+    virtual bool do_send(const void* ptr, size_t cb) { return true; }
+    virtual bool close() { return true; }
+    virtual bool call_run_once_service_io() { return true; }
+    virtual bool request_callback() { return true; }
+    virtual boost::asio::io_service& get_io_service() { static boost::asio::io_service io_service; return io_service; }
+    virtual bool add_ref() { return true; }
+    virtual bool release() { return true; }
+  };
+
+  struct test_handler: public epee::net_utils::http::i_http_server_handler<connection_context_base>
+  {
+    std::vector<http_request_info> requests;
+
+    virtual bool handle_http_request(const http_request_info& query_info, http_response_info& response, connection_context_base& context)
+    {
+      requests.push_back(query_info);
+      response.m_response_code = 200;
+      response.m_mime_tipe = "text/plain";
+      return true;
+    }
+  };
+
+  // feeds the data in pieces of the given size, as the network may hand it over
+  bool feed(const std::string& data, size_t piece, test_handler& handler)
+  {
+    test_endpoint endpoint;
+    epee::net_utils::http::custum_handler_config<connection_context_base> config;
+    config.m_phandler = &handler;
+    connection_context_base context;
+    epee::net_utils::http::http_custom_handler<connection_context_base> protocol(&endpoint, config, context);
+    for (size_t pos = 0; pos < data.size(); pos += piece)
+    {
+      const std::string part = data.substr(pos, piece);
+      if (!protocol.handle_recv(part.data(), part.size()))
+        return false;
+    }
+    return true;
+  }
+}
+
+TEST(http_request_parser, request_line)
+{
+  for (size_t piece: {1, 7, 1000})
+  {
+    test_handler handler;
+    ASSERT_TRUE(feed("post /json_rpc?a=1&b=2#top HTTP/1.1\r\nContent-Length: 0\r\n\r\nGET / HTTP/1.0\nConnection: keep-alive\n\n", piece, handler));
+    ASSERT_EQ(2, handler.requests.size());
+
+    const http_request_info& post = handler.requests[0];
+    ASSERT_EQ(epee::net_utils::http::http_method_post, post.m_http_method);
+    ASSERT_EQ("post", post.m_http_method_str);
+    ASSERT_EQ("/json_rpc?a=1&b=2#top", post.m_URI);
+    ASSERT_EQ("post /json_rpc?a=1&b=2#top HTTP/1.1\r\n", post.m_full_request_str);
+    ASSERT_EQ(1, post.m_http_ver_hi);
+    ASSERT_EQ(1, post.m_http_ver_lo);
+    ASSERT_EQ("/json_rpc", post.m_uri_content.m_path);
+    ASSERT_EQ("a=1&b=2", post.m_uri_content.m_query);
+    ASSERT_EQ("top", post.m_uri_content.m_fragment);
+    ASSERT_EQ(2, post.m_uri_content.m_query_params.size());
+
+    const http_request_info& get = handler.requests[1];
+    ASSERT_EQ(epee::net_utils::http::http_method_get, get.m_http_method);
+    ASSERT_EQ("/", get.m_URI);
+    ASSERT_EQ("/", get.m_uri_content.m_path);
+    ASSERT_TRUE(get.m_uri_content.m_query.empty());
+    ASSERT_EQ(0, get.m_http_ver_lo);
+  }
+}
+
+TEST(http_request_parser, bad_request_lines)
+{
+  for (const char* line: {"GET HTTP/1.1", "GET  / HTTP/1.1", "GET / HTTP/1.1 x", "FETCH / HTTP/1.1", "GET / HTTPS/1.1", "GET / HTTP/1.", "GET / HTTP/99999.1", "GET\t/ HTTP/1.1"})
+  {
+    test_handler handler;
+    ASSERT_FALSE(feed(std::string(line) + "\r\n\r\n", 1000, handler)) << line;
+    ASSERT_TRUE(handler.requests.empty());
+  }
+}
+
+TEST(http_request_parser, header_fields)
+{
+  test_handler handler;
+  ASSERT_TRUE(feed("GET /x HTTP/1.1\r\n"
+    "host: example.com:18081\r\n"
+    "CONTENT-TYPE :application/json\r\n"
+    "User-Agent:  spaced  \r\n"
+    "X-Folded: one\r\n two\r\n"
+    "not a field\r\n"
+    "Accept-Encoding: gzip\r\n"
+    "X_Custom: 1\r\n"
+    "\r\n", 1000, handler));
+  ASSERT_EQ(1, handler.requests.size());
+  const epee::net_utils::http::http_header_info& h = handler.requests[0].m_header_info;
+  ASSERT_EQ("example.com:18081", h.m_host);
+  ASSERT_EQ("application/json", h.m_content_type);
+  ASSERT_EQ(" spaced  ", h.m_user_agent);
+  ASSERT_EQ("gzip", h.m_accept_encoding);
+  ASSERT_TRUE(h.m_connection.empty());
+  ASSERT_EQ(2, h.m_etc_fields.size());
+  ASSERT_EQ("X-Folded", h.m_etc_fields.front().first);
+  ASSERT_EQ("one\r\n two", h.m_etc_fields.front().second);
+  ASSERT_EQ("X_Custom", h.m_etc_fields.back().first);
+  ASSERT_EQ("1", h.m_etc_fields.back().second);
+}
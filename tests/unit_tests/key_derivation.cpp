@@ -0,0 +1,137 @@
+// Copyright (c) 2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include <cstring>
+#include <vector>
+#include "crypto/crypto.h"
+
+namespace crypto
+{
+  static bool operator==(const key_derivation &d0, const key_derivation &d1)
+  {
+    return !memcmp(&d0, &d1, sizeof(d0));
+  }
+}
+
+namespace
+{
+  void make_keys(size_t n, std::vector<crypto::public_key> &pub, std::vector<crypto::secret_key> &sec)
+  {
+    pub.resize(n);
+    sec.resize(n);
+    for (size_t i = 0; i < n; ++i)
+      crypto::generate_keys(pub[i], sec[i]);
+  }
+
+  void check_one_public_key(size_t n)
+  {
+    std::vector<crypto::public_key> pub;
+    std::vector<crypto::secret_key> sec;
+    make_keys(n, pub, sec);
+    std::vector<crypto::key_derivation> derivations(n);
+    ASSERT_TRUE(crypto::generate_key_derivations(pub[0], sec.data(), n, derivations.data()));
+    for (size_t i = 0; i < n; ++i)
+    {
+      crypto::key_derivation expected;
+      ASSERT_TRUE(crypto::generate_key_derivation(pub[0], sec[i], expected));
+      ASSERT_EQ(expected, derivations[i]);
+    }
+  }
+}
+
+TEST(key_derivation, one_public_key_many_secret_keys)
+{
+  check_one_public_key(1);
+  check_one_public_key(5);
+  // large enough to use the full table of the public key
+  check_one_public_key(100);
+}
+
+TEST(key_derivation, many_public_keys_one_secret_key)
+{
+  std::vector<crypto::public_key> pub;
+  std::vector<crypto::secret_key> sec;
+  make_keys(100, pub, sec);
+  std::vector<crypto::key_derivation> derivations(pub.size());
+  ASSERT_TRUE(crypto::generate_key_derivations(pub.data(), pub.size(), sec[0], derivations.data()));
+  for (size_t i = 0; i < pub.size(); ++i)
+  {
+    crypto::key_derivation expected;
+    ASSERT_TRUE(crypto::generate_key_derivation(pub[i], sec[0], expected));
+    ASSERT_EQ(expected, derivations[i]);
+  }
+}
+
+TEST(key_derivation, invalid_public_key)
+{
+  std::vector<crypto::public_key> pub;
+  std::vector<crypto::secret_key> sec;
+  make_keys(3, pub, sec);
+  // not a point on the curve
+  memset(&pub[1], 0xff, sizeof(pub[1]));
+  crypto::key_derivation untouched;
+  memset(&untouched, 0x42, sizeof(untouched));
+  std::vector<crypto::key_derivation> derivations(pub.size(), untouched);
+  ASSERT_FALSE(crypto::generate_key_derivations(pub.data(), pub.size(), sec[0], derivations.data()));
+  ASSERT_EQ(untouched, derivations[1]);
+  for (size_t i: {0, 2})
+  {
+    crypto::key_derivation expected;
+    ASSERT_TRUE(crypto::generate_key_derivation(pub[i], sec[0], expected));
+    ASSERT_EQ(expected, derivations[i]);
+  }
+  ASSERT_FALSE(crypto::generate_key_derivations(pub[1], sec.data(), sec.size(), derivations.data()));
+}
+
+TEST(key_derivation, check_derived_public_key)
+{
+  std::vector<crypto::public_key> pub;
+  std::vector<crypto::secret_key> sec;
+  make_keys(3, pub, sec);
+  crypto::key_derivation derivation;
+  ASSERT_TRUE(crypto::generate_key_derivation(pub[0], sec[1], derivation));
+  crypto::public_key_precomp spend, other_spend;
+  ASSERT_TRUE(crypto::precompute_public_key(pub[2], spend));
+  ASSERT_TRUE(crypto::precompute_public_key(pub[1], other_spend));
+  for (size_t i = 0; i < 10; ++i)
+  {
+    crypto::public_key out_key;
+    ASSERT_TRUE(crypto::derive_public_key(derivation, i, pub[2], out_key));
+    ASSERT_TRUE(crypto::check_derived_public_key(derivation, i, spend, out_key));
+    ASSERT_FALSE(crypto::check_derived_public_key(derivation, i + 1, spend, out_key));
+    ASSERT_FALSE(crypto::check_derived_public_key(derivation, i, other_spend, out_key));
+    // same y coordinate, other x
+    out_key.data[31] ^= 0x80;
+    ASSERT_FALSE(crypto::check_derived_public_key(derivation, i, spend, out_key));
+  }
+  crypto::public_key invalid;
+  memset(&invalid, 0xff, sizeof(invalid));
+  ASSERT_FALSE(crypto::precompute_public_key(invalid, spend));
+}
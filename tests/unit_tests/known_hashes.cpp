@@ -0,0 +1,68 @@
+// Copyright (c) 2014-2016, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include "cryptonote_core/connection_context.h"
+
+static crypto::hash make_hash(uint64_t n)
+{
+  crypto::hash h;
+  memset(&h, 0, sizeof(h));
+  memcpy(&h, &n, sizeof(n));
+  return h;
+}
+
+TEST(known_hashes, insert)
+{
+  cryptonote::known_hashes known;
+  EXPECT_FALSE(known.contains(make_hash(1)));
+  EXPECT_FALSE(known.insert(make_hash(1)));
+  EXPECT_TRUE(known.insert(make_hash(1)));
+  EXPECT_TRUE(known.contains(make_hash(1)));
+  EXPECT_FALSE(known.contains(make_hash(2)));
+}
+
+TEST(known_hashes, oldest_forgotten)
+{
+  cryptonote::known_hashes known;
+  for (uint64_t n = 0; n < P2P_KNOWN_TXS_PER_PEER + 10; ++n)
+    known.insert(make_hash(n));
+  for (uint64_t n = 0; n < 10; ++n)
+    EXPECT_FALSE(known.contains(make_hash(n)));
+  for (uint64_t n = 10; n < P2P_KNOWN_TXS_PER_PEER + 10; ++n)
+    EXPECT_TRUE(known.contains(make_hash(n)));
+}
+
+TEST(known_hashes, shared_by_copies)
+{
+  cryptonote::cryptonote_connection_context context;
+  cryptonote::cryptonote_connection_context copy = context;
+  copy.m_known_txs.insert(make_hash(1));
+  EXPECT_TRUE(context.m_known_txs.contains(make_hash(1)));
+}
@@ -0,0 +1,129 @@
+// Copyright (c) 2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "gtest/gtest.h"
+
+#include <boost/thread.hpp>
+#include "include_base_utils.h"
+
+namespace
+{
+  const int capture_logger_type = 100;
+
+  // keeps what it is given, noting whether that came from the thread writing queued messages
+  struct capture_stream: public epee::log_space::ibase_log_stream
+  {
+    static boost::mutex lock;
+    static std::vector<std::string> lines;
+    static std::vector<boost::thread::id> writers;
+
+    virtual bool out_buffer(const char* buffer, int buffer_len, int log_level, int color, const char* plog_name = NULL)
+    {
+      boost::lock_guard<boost::mutex> guard(lock);
+      lines.push_back(std::string(buffer, buffer_len));
+      writers.push_back(boost::this_thread::get_id());
+      return true;
+    }
+    virtual int get_type() { return capture_logger_type; }
+  };
+  boost::mutex capture_stream::lock;
+  std::vector<std::string> capture_stream::lines;
+  std::vector<boost::thread::id> capture_stream::writers;
+
+  struct logging: public testing::Test
+  {
+    virtual void SetUp()
+    {
+      capture_stream::lines.clear();
+      capture_stream::writers.clear();
+      epee::log_space::log_singletone::add_logger(new capture_stream());
+    }
+    virtual void TearDown()
+    {
+      epee::log_space::log_singletone::set_async(false);
+      epee::log_space::log_singletone::remove_logger(capture_logger_type);
+    }
+  };
+
+  void log(const std::string& text)
+  {
+    epee::log_space::log_singletone::do_log_message(text, LOG_LEVEL_0, epee::log_space::console_color_default, false);
+  }
+}
+
+TEST_F(logging, sync_writes_on_the_calling_thread)
+{
+  log("sync");
+  ASSERT_EQ(1, capture_stream::lines.size());
+  ASSERT_EQ("sync", capture_stream::lines[0]);
+  ASSERT_EQ(boost::this_thread::get_id(), capture_stream::writers[0]);
+}
+
+TEST_F(logging, async_writes_everything_in_order_per_thread)
+{
+  const size_t threads = 4, messages = 1000;
+  ASSERT_TRUE(epee::log_space::log_singletone::set_async(true));
+  boost::thread_group group;
+  for (size_t t = 0; t < threads; ++t)
+    group.create_thread([t]() {
+      for (size_t n = 0; n < messages; ++n)
+        log(std::to_string(t) + " " + std::to_string(n));
+    });
+  group.join_all();
+  // leaving async writes what is still queued before returning
+  ASSERT_TRUE(epee::log_space::log_singletone::set_async(false));
+
+  ASSERT_EQ(threads * messages, capture_stream::lines.size());
+  std::vector<size_t> next(threads, 0);
+  for (size_t i = 0; i < capture_stream::lines.size(); ++i)
+  {
+    ASSERT_NE(boost::this_thread::get_id(), capture_stream::writers[i]);
+    std::istringstream line(capture_stream::lines[i]);
+    size_t t, n;
+    line >> t >> n;
+    ASSERT_LT(t, threads);
+    ASSERT_EQ(next[t]++, n);
+  }
+
+  log("sync again");
+  ASSERT_EQ(boost::this_thread::get_id(), capture_stream::writers.back());
+}
+
+TEST_F(logging, disabled_levels_are_not_formatted)
+{
+  const int level = epee::log_space::get_set_log_detalisation_level();
+  epee::log_space::get_set_log_detalisation_level(true, LOG_LEVEL_0);
+  size_t formatted = 0;
+  auto format = [&formatted]() { ++formatted; return "x"; };
+  LOG_PRINT_L3(format());
+  LOG_PRINT_L0(format());
+  epee::log_space::get_set_log_detalisation_level(true, level);
+  ASSERT_EQ(1, formatted);
+  ASSERT_EQ(1, capture_stream::lines.size());
+}
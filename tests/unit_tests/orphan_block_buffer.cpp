@@ -0,0 +1,100 @@
+// Copyright (c) 2014-2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include "cryptonote_protocol/orphan_block_buffer.h"
+
+namespace
+{
+  crypto::hash make_hash(uint64_t n)
+  {
+    crypto::hash h = cryptonote::null_hash;
+    *reinterpret_cast<uint64_t*>(h.data) = n;
+    return h;
+  }
+
+  cryptonote::block_complete_entry make_block(size_t size)
+  {
+    cryptonote::block_complete_entry b;
+    b.block = std::string(size, 'b');
+    return b;
+  }
+}
+
+TEST(orphan_block_buffer, hands_back_children)
+{
+  cryptonote::orphan_block_buffer orphans(1000, 10);
+  ASSERT_TRUE(orphans.add(make_hash(2), make_hash(1), make_block(10)));
+  ASSERT_TRUE(orphans.add(make_hash(3), make_hash(1), make_block(20)));
+  ASSERT_TRUE(orphans.add(make_hash(4), make_hash(2), make_block(30)));
+  ASSERT_FALSE(orphans.add(make_hash(4), make_hash(2), make_block(30)));
+  ASSERT_EQ(3, orphans.get_count());
+  ASSERT_EQ(60, orphans.get_data_size());
+  ASSERT_TRUE(orphans.has(make_hash(3)));
+
+  std::vector<cryptonote::block_complete_entry> blocks;
+  orphans.take_children(make_hash(5), blocks);
+  ASSERT_TRUE(blocks.empty());
+
+  orphans.take_children(make_hash(1), blocks);
+  ASSERT_EQ(2, blocks.size());
+  ASSERT_EQ(30, blocks[0].block.size() + blocks[1].block.size());
+  ASSERT_FALSE(orphans.has(make_hash(2)));
+  ASSERT_FALSE(orphans.has(make_hash(3)));
+  ASSERT_EQ(1, orphans.get_count());
+  ASSERT_EQ(30, orphans.get_data_size());
+
+  orphans.take_children(make_hash(2), blocks);
+  ASSERT_EQ(1, blocks.size());
+  ASSERT_EQ(0, orphans.get_count());
+  ASSERT_EQ(0, orphans.get_data_size());
+}
+
+TEST(orphan_block_buffer, drops_oldest_past_limits)
+{
+  cryptonote::orphan_block_buffer orphans(100, 3);
+  ASSERT_TRUE(orphans.add(make_hash(1), make_hash(0), make_block(40)));
+  ASSERT_TRUE(orphans.add(make_hash(2), make_hash(0), make_block(40)));
+  ASSERT_TRUE(orphans.add(make_hash(3), make_hash(0), make_block(40)));
+  ASSERT_FALSE(orphans.has(make_hash(1)));
+  ASSERT_EQ(2, orphans.get_count());
+  ASSERT_EQ(80, orphans.get_data_size());
+
+  ASSERT_TRUE(orphans.add(make_hash(4), make_hash(9), make_block(10)));
+  ASSERT_TRUE(orphans.add(make_hash(5), make_hash(9), make_block(10)));
+  ASSERT_FALSE(orphans.has(make_hash(2)));
+  ASSERT_EQ(3, orphans.get_count());
+
+  ASSERT_FALSE(orphans.add(make_hash(6), make_hash(0), make_block(101)));
+
+  std::vector<cryptonote::block_complete_entry> blocks;
+  orphans.take_children(make_hash(0), blocks);
+  ASSERT_EQ(1, blocks.size());
+  ASSERT_EQ(2, orphans.get_count());
+}
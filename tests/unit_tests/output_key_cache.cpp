@@ -0,0 +1,106 @@
+// Copyright (c) 2014-2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include "cryptonote_core/output_key_cache.h"
+
+static cryptonote::output_data_t make_output(uint64_t height)
+{
+  cryptonote::output_data_t data = AUTO_VAL_INIT(data);
+  data.height = height;
+  data.unlock_time = height + 60;
+  return data;
+}
+
+TEST(output_key_cache, get_put)
+{
+  cryptonote::output_key_cache cache(64);
+  cryptonote::output_data_t data;
+  ASSERT_FALSE(cache.get(0, 7, data));
+  cache.put(0, 7, make_output(100), cache.generation());
+  ASSERT_TRUE(cache.get(0, 7, data));
+  ASSERT_EQ(100, data.height);
+  ASSERT_EQ(160, data.unlock_time);
+  // the amount is part of the key
+  ASSERT_FALSE(cache.get(1, 7, data));
+
+  const cryptonote::output_key_cache::stats st = cache.get_stats();
+  ASSERT_EQ(1, st.hits);
+  ASSERT_EQ(2, st.misses);
+  ASSERT_EQ(1, st.size);
+}
+
+TEST(output_key_cache, bounded)
+{
+  cryptonote::output_key_cache cache(OUTPUT_KEY_CACHE_SHARDS * 4);
+  for (uint64_t i = 0; i < 1000; ++i)
+    cache.put(0, i, make_output(i), cache.generation());
+  ASSERT_EQ(OUTPUT_KEY_CACHE_SHARDS * 4, cache.get_stats().size);
+}
+
+TEST(output_key_cache, least_recently_used_goes_first)
+{
+  cryptonote::output_key_cache cache(OUTPUT_KEY_CACHE_SHARDS * 2);
+  cryptonote::output_data_t data;
+  cache.put(0, 0, make_output(0), cache.generation());
+  for (uint64_t i = 1; i < 1000; ++i)
+  {
+    // keep touching the first one
+    ASSERT_TRUE(cache.get(0, 0, data));
+    cache.put(0, i, make_output(i), cache.generation());
+  }
+  ASSERT_TRUE(cache.get(0, 0, data));
+  ASSERT_FALSE(cache.get(0, 1, data));
+}
+
+TEST(output_key_cache, remove_from_height)
+{
+  cryptonote::output_key_cache cache(1024);
+  for (uint64_t i = 0; i < 100; ++i)
+    cache.put(0, i, make_output(i), cache.generation());
+  cache.remove_from_height(50);
+  cryptonote::output_data_t data;
+  ASSERT_TRUE(cache.get(0, 49, data));
+  ASSERT_FALSE(cache.get(0, 50, data));
+  ASSERT_FALSE(cache.get(0, 99, data));
+  ASSERT_EQ(50, cache.get_stats().size);
+
+  cache.clear();
+  ASSERT_EQ(0, cache.get_stats().size);
+}
+
+TEST(output_key_cache, stale_put_ignored)
+{
+  cryptonote::output_key_cache cache(1024);
+  const uint64_t generation = cache.generation();
+  cache.remove_from_height(10);
+  cache.put(0, 3, make_output(12), generation);
+  cryptonote::output_data_t data;
+  ASSERT_FALSE(cache.get(0, 3, data));
+}
@@ -101,3 +101,38 @@ TEST(select_outputs, order)
   PICK(1); // then the one that's on the same height
 }
 
+
+TEST(select_outputs, nearest_selected_height)
+{
+  tools::wallet2 w;
+
+  // check that a candidate is as related as it is to the nearest selected height
+  tools::wallet2::transfer_container transfers = make_transfers_container(4);
+  transfers[0].m_block_height = 700;
+  transfers[1].m_block_height = 720;
+  transfers[2].m_block_height = 711;
+  transfers[3].m_block_height = 730;
+  std::vector<size_t> unused_indices({0, 1, 2, 3});
+  std::list<size_t> selected;
+  SELECT(0);
+  SELECT(1);
+  PICK(3); // ten blocks away from the nearest
+  PICK(2); // nine blocks away from the nearest
+}
+
+TEST(select_outputs, same_tx)
+{
+  tools::wallet2 w;
+
+  // check that an output from a selected tx comes last, whatever its height
+  tools::wallet2::transfer_container transfers = make_transfers_container(3);
+  transfers[0].m_block_height = 700;
+  transfers[1].m_block_height = 900;
+  transfers[1].m_txid = transfers[0].m_txid;
+  transfers[2].m_block_height = 701;
+  std::vector<size_t> unused_indices({0, 1, 2});
+  std::list<size_t> selected;
+  SELECT(0);
+  PICK(2);
+  PICK(1);
+}
@@ -0,0 +1,141 @@
+// Copyright (c) 2014-2016, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+#include "common/parallel_for.h"
+
+TEST(ParallelFor, CoversRange)
+{
+  for (size_t threads = 0; threads < 4; ++threads) {
+    tools::thread_group group(threads);
+    for (size_t grain : {1, 3, 7, 100, 1000}) {
+      std::vector<std::atomic<unsigned>> seen(250);
+      for (auto& s : seen) {
+        s = 0;
+      }
+      EXPECT_TRUE(tools::parallel_for(group, 10, seen.size(), grain, [&] (size_t first, size_t last) {
+        EXPECT_LT(first, last);
+        EXPECT_GE(grain, last - first);
+        for (size_t i = first; i < last; ++i) {
+          ++seen[i];
+        }
+        return true;
+      }));
+      for (size_t i = 0; i < seen.size(); ++i) {
+        EXPECT_EQ(i < 10 ? 0u : 1u, seen[i]);
+      }
+    }
+  }
+}
+
+TEST(ParallelFor, Empty)
+{
+  tools::thread_group group(2);
+  bool called = false;
+  EXPECT_TRUE(tools::parallel_for(group, 5, 5, 1, [&] (size_t, size_t) { called = true; return true; }));
+  EXPECT_FALSE(called);
+}
+
+TEST(ParallelFor, StopsOnFailure)
+{
+  tools::thread_group group(2);
+  std::atomic<unsigned> calls{0};
+  EXPECT_FALSE(tools::parallel_for(group, 0, 100000, 1, [&] (size_t first, size_t) {
+    ++calls;
+    return first != 10;
+  }));
+  // the others stop at their next range
+  EXPECT_GT(100000u, calls);
+}
+
+TEST(ParallelFor, RethrowsFirstException)
+{
+  for (size_t threads = 0; threads < 3; ++threads) {
+    tools::thread_group group(threads);
+    std::atomic<unsigned> calls{0};
+    EXPECT_THROW(tools::parallel_for(group, 0, 100000, 1, [&] (size_t first, size_t) -> bool {
+      ++calls;
+      if (first == 10) {
+        throw std::runtime_error("test");
+      }
+      return true;
+    }), std::runtime_error);
+    EXPECT_GT(100000u, calls);
+  }
+}
+
+TEST(ParallelFor, Transform)
+{
+  tools::thread_group group(3);
+  std::vector<unsigned> in(1000);
+  std::iota(in.begin(), in.end(), 0);
+  std::vector<unsigned> out(in.size());
+  tools::parallel_transform(group, in.begin(), in.end(), out.begin(), 16, [] (unsigned x) { return x * 2; });
+  for (size_t i = 0; i < in.size(); ++i) {
+    EXPECT_EQ(in[i] * 2, out[i]);
+  }
+}
+
+TEST(ParallelFor, Reduce)
+{
+  tools::thread_group group(3);
+  const uint64_t sum = tools::parallel_reduce(group, 0, 10001, 64, uint64_t(0),
+    [] (size_t first, size_t last) {
+      uint64_t s = 0;
+      for (size_t i = first; i < last; ++i) {
+        s += i;
+      }
+      return s;
+    },
+    [] (uint64_t a, uint64_t b) { return a + b; });
+  EXPECT_EQ(10000u * 10001 / 2, sum);
+
+  // folded in range order
+  const std::string order = tools::parallel_reduce(group, 0, 10, 1, std::string(),
+    [] (size_t first, size_t) { return std::string(1, '0' + first); },
+    [] (std::string a, std::string b) { return a + b; });
+  EXPECT_EQ("0123456789", order);
+}
+
+TEST(ParallelFor, Nested)
+{
+  tools::thread_group group(2);
+  std::atomic<unsigned> count{0};
+  EXPECT_TRUE(tools::parallel_for(group, 0, 8, 1, [&] (size_t, size_t) {
+    return tools::parallel_for(group, 0, 100, 10, [&] (size_t first, size_t last) {
+      count += last - first;
+      return true;
+    });
+  }));
+  EXPECT_EQ(800u, count);
+}
@@ -0,0 +1,103 @@
+// Copyright (c) 2014-2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 
+
+
+
+#include "gtest/gtest.h"
+
+#include "common/perf_timer.h"
+
+namespace
+{
+  void inner()
+  {
+    PERF_TIMER(inner);
+  }
+
+  void outer(int n)
+  {
+    PERF_TIMER(outer);
+    for (int i = 0; i < n; ++i)
+      inner();
+  }
+
+  const tools::perf_profile_entry *find(const std::vector<tools::perf_profile_entry> &entries, const std::string &path)
+  {
+    for (const auto &e: entries)
+      if (e.path == path)
+        return &e;
+    return NULL;
+  }
+}
+
+TEST(perf_timer, call_paths)
+{
+  uint64_t dropped;
+  tools::set_performance_timers_enabled(true);
+  tools::get_performance_profile(true, dropped);
+  outer(3);
+  inner();
+  const std::vector<tools::perf_profile_entry> entries = tools::get_performance_profile(false, dropped);
+  const tools::perf_profile_entry *o = find(entries, "outer");
+  const tools::perf_profile_entry *oi = find(entries, "outer;inner");
+  const tools::perf_profile_entry *i = find(entries, "inner");
+  ASSERT_TRUE(o != NULL);
+  ASSERT_TRUE(oi != NULL);
+  ASSERT_TRUE(i != NULL);
+  ASSERT_EQ(1, o->calls);
+  ASSERT_EQ(3, oi->calls);
+  ASSERT_EQ(1, i->calls);
+  ASSERT_GE(o->total_ns, oi->total_ns);
+  ASSERT_EQ(o->total_ns - oi->total_ns, o->self_ns);
+}
+
+TEST(perf_timer, reset)
+{
+  uint64_t dropped;
+  tools::set_performance_timers_enabled(true);
+  outer(1);
+  tools::get_performance_profile(true, dropped);
+  ASSERT_TRUE(find(tools::get_performance_profile(false, dropped), "outer") == NULL);
+  outer(2);
+  const std::vector<tools::perf_profile_entry> entries = tools::get_performance_profile(false, dropped);
+  ASSERT_TRUE(find(entries, "outer") != NULL);
+  ASSERT_EQ(1, find(entries, "outer")->calls);
+  ASSERT_EQ(2, find(entries, "outer;inner")->calls);
+}
+
+TEST(perf_timer, disabled)
+{
+  uint64_t dropped;
+  tools::set_performance_timers_enabled(true);
+  tools::get_performance_profile(true, dropped);
+  tools::set_performance_timers_enabled(false);
+  outer(1);
+  tools::set_performance_timers_enabled(true);
+  ASSERT_TRUE(tools::get_performance_profile(false, dropped).empty());
+}
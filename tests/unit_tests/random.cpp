@@ -0,0 +1,67 @@
+// Copyright (c) 2014-2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 
+
+#include <unordered_set>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "crypto/crypto.h"
+
+TEST(random, distinct_values)
+{
+  std::unordered_set<crypto::hash> seen;
+  for (int i = 0; i < 1000; ++i)
+    ASSERT_TRUE(seen.insert(crypto::rand<crypto::hash>()).second);
+}
+
+TEST(random, threads_have_distinct_streams)
+{
+  const size_t nthreads = 8;
+  std::vector<crypto::hash> first(nthreads);
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < nthreads; ++i)
+    threads.emplace_back([&first, i]{ first[i] = crypto::rand<crypto::hash>(); });
+  for (auto &t: threads)
+    t.join();
+
+  std::unordered_set<crypto::hash> seen(first.begin(), first.end());
+  ASSERT_EQ(nthreads, seen.size());
+}
+
+TEST(random, large_requests_reseed)
+{
+  // more than a reseed interval in one go, then more after it
+  std::vector<uint8_t> a(3 * 1024 * 1024), b(a.size());
+  crypto::rand(a.size(), a.data());
+  crypto::rand(b.size(), b.data());
+  ASSERT_NE(a, b);
+  ASSERT_NE(std::vector<uint8_t>(a.size(), 0), a);
+}
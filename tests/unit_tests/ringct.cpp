@@ -134,6 +134,44 @@ TEST(ringct, MG_sigs)
         ASSERT_FALSE(MLSAG_Ver(message, P, IIccss, R));
 }
 
+TEST(ringct, MG_sigs_matrix)
+{
+    const size_t N = 4, R = 2;
+    keyM P = keyMInit(R, N);
+    keyV sk(R);
+    const unsigned int ind = 1;
+    for (size_t i = 0; i < N; i++) {
+        for (size_t j = 0; j < R; j++) {
+            key x = skGen();
+            P[i][j] = scalarmultBase(x);
+            if (i == ind)
+                sk[j] = x;
+        }
+    }
+
+    const keyMatrix M(P);
+    ASSERT_EQ(N, M.cols());
+    ASSERT_EQ(R, M.rows());
+    for (size_t i = 0; i < N; i++) {
+        for (size_t j = 0; j < R; j++) {
+            ASSERT_TRUE(M[i][j] == P[i][j]);
+            ASSERT_TRUE(M.row(j)[i] == P[i][j]);
+        }
+    }
+    ASSERT_TRUE(M.to_vector() == P);
+
+    // either layout signs and verifies for the other
+    key message = identity();
+    ASSERT_TRUE(MLSAG_Ver(message, P, MLSAG_Gen(message, M, sk, ind, R), R));
+    ASSERT_TRUE(MLSAG_Ver(message, M, MLSAG_Gen(message, P, sk, ind, R), R));
+
+    sk[0] = skGen();
+    ASSERT_FALSE(MLSAG_Ver(message, M, MLSAG_Gen(message, M, sk, ind, R), R));
+
+    P[1].pop_back();
+    ASSERT_THROW(keyMatrix{P}, std::exception);
+}
+
 TEST(ringct, range_proofs)
 {
         //Ring CT Stuff
@@ -808,6 +846,41 @@ TEST(ringct, range_proofs_accept_very_long_simple)
   EXPECT_TRUE(range_proof_test(true, NELTS(inputs), inputs, NELTS(outputs), outputs, false, true));
 }
 
+TEST(ringct, range_proofs_batch)
+{
+  const size_t N = 6;
+  keyV C(N);
+  std::vector<rangeSig> sigs(N);
+  std::vector<const rangeSig*> as;
+  std::vector<bool> results;
+  key mask;
+  for (size_t n = 0; n < N; ++n) {
+    sigs[n] = proveRange(C[n], mask, n * 1000 + 1);
+    as.push_back(&sigs[n]);
+  }
+  ASSERT_TRUE(verRangeBatch(C, as, &results));
+  ASSERT_EQ(results.size(), N);
+  for (size_t n = 0; n < N; ++n)
+    ASSERT_TRUE(results[n]);
+
+  // bad Borromean signature in the middle of the batch
+  const key s0 = sigs[2].asig.s0[7];
+  sigs[2].asig.s0[7] = skGen();
+  ASSERT_FALSE(verRangeBatch(C, as, &results));
+  for (size_t n = 0; n < N; ++n)
+    ASSERT_EQ(results[n], n != 2);
+
+  // commitment not matching its proof
+  sigs[2].asig.s0[7] = s0;
+  C[4] = C[3];
+  ASSERT_FALSE(verRangeBatch(C, as));
+  ASSERT_FALSE(verRangeBatch(C, as, &results));
+  for (size_t n = 0; n < N; ++n)
+    ASSERT_EQ(results[n], n != 4);
+
+  ASSERT_TRUE(verRangeBatch(keyV(), std::vector<const rangeSig*>()));
+}
+
 TEST(ringct, HPow2)
 {
   key G = scalarmultBase(d2h(1));
@@ -819,8 +892,66 @@ TEST(ringct, HPow2)
   }
 }
 
+TEST(ringct, ring_member_cache)
+{
+  const key P = pkGen(), a = skGen(), b = skGen();
+  geDsmp B;
+  precomp(B.k, pkGen());
+  key expectedL, expectedR;
+  addKeys2(expectedL, a, b, P);
+  addKeys3(expectedR, a, hashToPoint(P), b, B.k);
+
+  const crypto::ring_member_cache_stats before = crypto::get_ring_member_cache_stats();
+  for (int n = 0; n < 2; ++n) {
+    geDsmp Pp, Hp;
+    ASSERT_TRUE(crypto::ring_member_precomp(rct2pk(P), Pp.k, Hp.k));
+    key L, R;
+    addKeys2(L, a, b, Pp.k);
+    addKeys3(R, a, Hp.k, b, B.k);
+    ASSERT_TRUE(equalKeys(expectedL, L));
+    ASSERT_TRUE(equalKeys(expectedR, R));
+  }
+  const crypto::ring_member_cache_stats after = crypto::get_ring_member_cache_stats();
+  ASSERT_EQ(before.misses + 1, after.misses);
+  ASSERT_EQ(before.hits + 1, after.hits);
+
+  // invalid points are rejected, and not cached
+  key bad = P;
+  ge_p3 point;
+  while (ge_frombytes_vartime(&point, bad.bytes) == 0)
+    bad.bytes[0]++;
+  geDsmp Pp, Hp;
+  ASSERT_FALSE(crypto::ring_member_precomp(rct2pk(bad), Pp.k, Hp.k));
+  ASSERT_EQ(after.size, crypto::get_ring_member_cache_stats().size);
+
+  crypto::set_ring_member_cache_size(0);
+  ASSERT_EQ(0, crypto::get_ring_member_cache_stats().size);
+  crypto::set_ring_member_cache_size(before.max_size);
+}
+
 static const xmr_amount test_amounts[]={0, 1, 2, 3, 4, 5, 10000, 10000000000000000000ull, 10203040506070809000ull, 123456789123456789};
 
+TEST(ringct, HTable)
+{
+  for (auto amount: test_amounts) {
+    const key a = d2h(amount);
+    const key mask = skGen();
+    const key aH = scalarmultKey(H, a);
+    ASSERT_TRUE(equalKeys(scalarmultH(a), aH));
+    key C;
+    addKeys(C, scalarmultBase(mask), aH);
+    ASSERT_TRUE(equalKeys(commit(amount, mask), C));
+    genC(C, mask, amount);
+    ASSERT_TRUE(equalKeys(commit(amount, mask), C));
+    addKeys(C, scalarmultBase(identity()), aH);
+    ASSERT_TRUE(equalKeys(zeroCommit(amount), C));
+  }
+  for (int n = 0; n < 16; ++n) {
+    const key a = skGen();
+    ASSERT_TRUE(equalKeys(scalarmultH(a), scalarmultKey(H, a)));
+  }
+}
+
 TEST(ringct, ecdh_roundtrip)
 {
   key k;
@@ -0,0 +1,139 @@
+// Copyright (c) 2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include "rpc/rpc_limits.h"
+
+using cryptonote::rpc_handler_pool;
+using cryptonote::rpc_endpoint_limit;
+using cryptonote::rpc_endpoint_slot;
+using cryptonote::rpc_client_limits;
+using cryptonote::rpc_client_slot;
+
+TEST(rpc_limits, pool_turns_away_calls_over_slots_and_queue)
+{
+  rpc_handler_pool pool("bulk", 1, 0, 10);
+  ASSERT_EQ(1, pool.get_threads_bound());
+  rpc_endpoint_limit blocks("/getblocks.bin", pool);
+  rpc_endpoint_limit outs("/get_outs.bin", pool);
+  {
+    rpc_endpoint_slot first(blocks);
+    ASSERT_TRUE(first.acquired());
+    rpc_endpoint_slot second(outs);
+    ASSERT_FALSE(second.acquired());
+  }
+  rpc_endpoint_slot third(outs);
+  ASSERT_TRUE(third.acquired());
+  ASSERT_EQ(1, blocks.calls);
+  ASSERT_EQ(1, outs.busy);
+  ASSERT_EQ(1, outs.in_flight);
+}
+
+TEST(rpc_limits, queued_call_times_out)
+{
+  rpc_handler_pool pool("bulk", 1, 1, 10);
+  ASSERT_EQ(2, pool.get_threads_bound());
+  rpc_endpoint_limit blocks("/getblocks.bin", pool);
+  rpc_endpoint_slot first(blocks);
+  ASSERT_TRUE(first.acquired());
+  rpc_endpoint_slot second(blocks);
+  ASSERT_FALSE(second.acquired());
+  ASSERT_EQ(1, blocks.busy);
+}
+
+TEST(rpc_limits, endpoint_cap_is_below_pool)
+{
+  rpc_handler_pool pool("bulk", 4, 0, 10);
+  rpc_endpoint_limit blocks("/getblocks.bin", pool, 1);
+  rpc_endpoint_limit outs("/get_outs.bin", pool);
+  rpc_endpoint_slot first(blocks);
+  ASSERT_TRUE(first.acquired());
+  rpc_endpoint_slot second(blocks);
+  ASSERT_FALSE(second.acquired());
+  rpc_endpoint_slot third(outs);
+  ASSERT_TRUE(third.acquired());
+}
+
+TEST(rpc_limits, client_limits_off_by_default)
+{
+  rpc_client_limits limits;
+  ASSERT_FALSE(limits.enabled());
+  limits.charge(1, 1000000);
+  rpc_client_slot first(limits, 1);
+  ASSERT_TRUE(first.acquired());
+  rpc_client_slot second(limits, 1);
+  ASSERT_TRUE(second.acquired());
+  ASSERT_EQ(0, limits.get_clients());
+}
+
+TEST(rpc_limits, client_in_debt_is_turned_away)
+{
+  rpc_client_limits limits;
+  // a byte a second refills nothing within the test
+  limits.set_limits(1, 1000, 0);
+  {
+    rpc_client_slot first(limits, 1);
+    ASSERT_TRUE(first.acquired());
+  }
+  limits.charge(1, 1500);
+  rpc_client_slot second(limits, 1);
+  ASSERT_FALSE(second.acquired());
+  rpc_client_slot other(limits, 2);
+  ASSERT_TRUE(other.acquired());
+  ASSERT_EQ(1, limits.get_busy());
+  ASSERT_EQ(2, limits.get_clients());
+}
+
+TEST(rpc_limits, client_calls_are_capped)
+{
+  rpc_client_limits limits;
+  limits.set_limits(0, 0, 2);
+  rpc_client_slot first(limits, 1);
+  rpc_client_slot second(limits, 1);
+  ASSERT_TRUE(first.acquired());
+  ASSERT_TRUE(second.acquired());
+  {
+    rpc_client_slot third(limits, 1);
+    ASSERT_FALSE(third.acquired());
+  }
+  rpc_client_slot other(limits, 2);
+  ASSERT_TRUE(other.acquired());
+}
+
+TEST(rpc_limits, client_calls_free_up)
+{
+  rpc_client_limits limits;
+  limits.set_limits(0, 0, 1);
+  {
+    rpc_client_slot first(limits, 1);
+    ASSERT_TRUE(first.acquired());
+  }
+  rpc_client_slot second(limits, 1);
+  ASSERT_TRUE(second.acquired());
+}
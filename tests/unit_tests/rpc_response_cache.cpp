@@ -0,0 +1,85 @@
+// Copyright (c) 2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include "rpc/rpc_response_cache.h"
+
+using cryptonote::rpc_response_cache;
+
+TEST(rpc_response_cache, hits_only_same_key_and_type)
+{
+  rpc_response_cache cache(1024 * 1024);
+  cache.add("a", 0, std::string("response"), 8);
+  std::string s;
+  ASSERT_TRUE(cache.get("a", 0, s));
+  ASSERT_EQ("response", s);
+  ASSERT_FALSE(cache.get("b", 0, s));
+  uint64_t u;
+  ASSERT_FALSE(cache.get("a", 0, u));
+  ASSERT_EQ(1, cache.get_hits());
+  ASSERT_EQ(2, cache.get_misses());
+}
+
+TEST(rpc_response_cache, evicts_least_recently_used)
+{
+  rpc_response_cache cache(0);
+  cache.add("a", 0, 1, 0);
+  ASSERT_EQ(0, cache.get_count());
+
+  cache.set_max_bytes(35000);
+  int v;
+  cache.add("a", 0, 1, 10000);
+  cache.add("b", 0, 2, 10000);
+  ASSERT_TRUE(cache.get("a", 0, v));
+  cache.add("c", 0, 3, 10000);
+  cache.add("d", 0, 4, 10000);
+  ASSERT_LE(cache.get_bytes(), cache.get_max_bytes());
+  ASSERT_FALSE(cache.get("b", 0, v));
+  ASSERT_TRUE(cache.get("d", 0, v));
+  ASSERT_EQ(4, v);
+
+  cache.set_max_bytes(0);
+  ASSERT_EQ(0, cache.get_count());
+  ASSERT_EQ(0, cache.get_bytes());
+}
+
+TEST(rpc_response_cache, popped_block_flushes)
+{
+  rpc_response_cache cache(1024 * 1024);
+  int v;
+  cache.add("a", 0, 1, 4);
+  ASSERT_TRUE(cache.get("a", 0, v));
+  ASSERT_FALSE(cache.get("a", 1, v));
+  ASSERT_EQ(0, cache.get_count());
+
+  // built before the pop, never served after it
+  cache.add("a", 0, 1, 4);
+  ASSERT_FALSE(cache.get("a", 1, v));
+  ASSERT_FALSE(cache.get("a", 0, v));
+}
@@ -36,6 +36,7 @@
 #include <boost/foreach.hpp>
 #include "cryptonote_core/cryptonote_basic.h"
 #include "cryptonote_core/cryptonote_basic_impl.h"
+#include "cryptonote_core/cryptonote_format_utils.h"
 #include "ringct/rctSigs.h"
 #include "serialization/serialization.h"
 #include "serialization/binary_archive.h"
@@ -154,6 +155,74 @@ TEST(Serialization, BinaryArchiveVarInts) {
   ASSERT_EQ(x, x1);
 }
 
+TEST(Serialization, BinaryArchiveInputStream) {
+  const string blob("\x01\x02\x03\x04\x80\x01xyz", 9);
+  uint32_t i;
+  uint64_t v;
+  char tail[3];
+
+  binary_input_stream iss(blob);
+  binary_archive<false> iar(iss);
+  ASSERT_EQ(9, iar.remaining_bytes());
+  iar.serialize_int(i);
+  ASSERT_EQ(0x04030201, i);
+  iar.serialize_varint(v);
+  ASSERT_EQ(128, v);
+  ASSERT_EQ(6, iss.tellg());
+  ASSERT_EQ(3, iar.remaining_bytes());
+  iar.serialize_blob(tail, sizeof(tail));
+  ASSERT_TRUE(iss.good());
+  ASSERT_EQ(string("xyz"), string(tail, sizeof(tail)));
+  ASSERT_EQ(EOF, iss.peek());
+
+  // reading past the end fails the stream
+  binary_input_stream short_iss(blob.data(), 2);
+  binary_archive<false> short_iar(short_iss);
+  short_iar.serialize_int(i);
+  ASSERT_FALSE(short_iss.good());
+  binary_input_stream short_blob_iss(blob.data(), 2);
+  binary_archive<false> short_blob_iar(short_blob_iss);
+  short_blob_iar.serialize_blob(tail, sizeof(tail));
+  ASSERT_FALSE(short_blob_iss.good());
+
+  Struct1 s1;
+  s1.si.push_back(0);
+  s1.vi.push_back(10);
+  string s1_blob;
+  ASSERT_TRUE(serialization::dump_binary(s1, s1_blob));
+  Struct1 s2;
+  ASSERT_TRUE(serialization::parse_binary(s1_blob, s2));
+  ASSERT_EQ(s1.vi, s2.vi);
+  ASSERT_FALSE(serialization::parse_binary(s1_blob + '\0', s2));
+  ASSERT_FALSE(serialization::parse_binary(s1_blob.substr(0, s1_blob.size() - 1), s2));
+}
+
+TEST(Serialization, BinaryArchiveOutputStream) {
+  uint32_t i = 0x04030201;
+  uint64_t v = 128;
+
+  string blob("prefix");
+  binary_output_stream oss(blob);
+  binary_archive<true> oar(oss);
+  oar.serialize_int(i);
+  oar.serialize_varint(v);
+  oar.serialize_blob((void *)"xyz", 3);
+  ASSERT_TRUE(oss.good());
+  ASSERT_EQ(string("prefix\x01\x02\x03\x04\x80\x01xyz", 15), blob);
+
+  binary_size_stream sss;
+  binary_archive<true> sar(sss);
+  sar.serialize_int(i);
+  sar.serialize_varint(v);
+  sar.serialize_blob((void *)"xyz", 3);
+  ASSERT_TRUE(sss.good());
+  ASSERT_EQ(9, sss.buffer().size());
+
+  uint64_t big = std::numeric_limits<uint64_t>::max();
+  sar.serialize_varint(big);
+  ASSERT_EQ(19, sss.buffer().size());
+}
+
 TEST(Serialization, Test1) {
   ostringstream str;
   binary_archive<true> ar(str);
@@ -447,6 +516,53 @@ TEST(Serialization, serializes_transacion_signatures_correctly)
   ASSERT_FALSE(serialization::parse_binary(blob, tx1));
 }
 
+TEST(Serialization, serializes_pruned_transactions)
+{
+  using namespace cryptonote;
+
+  transaction tx;
+  transaction tx1;
+  string blob, pruned_blob;
+
+  txin_to_key txin_to_key1;
+  txin_to_key1.amount = 1;
+  memset(&txin_to_key1.k_image, 0x42, sizeof(crypto::key_image));
+  txin_to_key1.key_offsets.push_back(12);
+  txin_to_key1.key_offsets.push_back(3453);
+
+  tx.set_null();
+  tx.vin.push_back(txin_to_key1);
+  tx.signatures.resize(1);
+  tx.signatures[0].resize(txin_to_key1.key_offsets.size());
+  ASSERT_TRUE(serialization::dump_binary(tx, blob));
+
+  // pruning drops the signatures, and only them
+  tx.pruned = true;
+  ASSERT_TRUE(serialization::dump_binary(tx, pruned_blob));
+  ASSERT_EQ(blob.size() - 2 * sizeof(crypto::signature), pruned_blob.size());
+  ASSERT_EQ(pruned_blob, blob.substr(0, pruned_blob.size()));
+
+  ASSERT_TRUE(parse_and_validate_tx_base_from_blob(pruned_blob, tx1));
+  ASSERT_TRUE(tx1.pruned);
+  ASSERT_TRUE(tx1.signatures.empty());
+  ASSERT_EQ(get_transaction_prefix_hash(tx), get_transaction_prefix_hash(tx1));
+
+  // the base alone can be read from either blob, but the strict parse
+  // wants the pruned one
+  ASSERT_FALSE(parse_and_validate_tx_base_from_blob(blob, tx1));
+  ASSERT_TRUE(parse_tx_base_from_blob(blob, tx1));
+  ASSERT_TRUE(tx1.signatures.empty());
+  ASSERT_EQ(get_transaction_prefix_hash(tx), get_transaction_prefix_hash(tx1));
+  ASSERT_TRUE(parse_tx_base_from_blob(pruned_blob, tx1));
+  ASSERT_EQ(get_transaction_prefix_hash(tx), get_transaction_prefix_hash(tx1));
+  ASSERT_FALSE(parse_tx_base_from_blob(pruned_blob.substr(0, pruned_blob.size() / 2), tx1));
+
+  // a full parse resets the flag
+  ASSERT_TRUE(parse_and_validate_tx_from_blob(blob, tx1));
+  ASSERT_FALSE(tx1.pruned);
+  ASSERT_EQ(tx.signatures.size(), tx1.signatures.size());
+}
+
 TEST(Serialization, serializes_ringct_types)
 {
   string blob;
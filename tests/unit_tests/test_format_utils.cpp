@@ -203,3 +203,87 @@ TEST(validate_parse_amount_case, validate_parse_amount)
   r = cryptonote::parse_amount(res, "1 00.00 00");
   ASSERT_FALSE(r);
 }
+
+TEST(transaction_hash_cache, parsed_transactions_cache_hash_and_size)
+{
+  cryptonote::transaction tx = AUTO_VAL_INIT(tx);
+  cryptonote::account_base acc;
+  acc.generate();
+  ASSERT_TRUE(cryptonote::construct_miner_tx(0, 0, 10000000000000, 1000, TEST_FEE, acc.get_keys().m_account_address, tx, cryptonote::blobdata(), 1));
+  const crypto::hash expected_hash = cryptonote::get_transaction_hash(tx);
+  ASSERT_FALSE(tx.cached_hash.valid());
+
+  const cryptonote::blobdata blob = cryptonote::tx_to_blob(tx);
+  cryptonote::transaction parsed;
+  ASSERT_TRUE(cryptonote::parse_and_validate_tx_from_blob(blob, parsed));
+  ASSERT_TRUE(parsed.cached_blob_size.valid());
+  ASSERT_EQ(blob.size(), cryptonote::get_object_blobsize(parsed));
+  ASSERT_EQ(expected_hash, cryptonote::get_transaction_hash(parsed));
+  ASSERT_TRUE(parsed.cached_hash.valid());
+
+  cryptonote::transaction copy = parsed;
+  ASSERT_TRUE(copy.cached_hash.valid());
+  ASSERT_EQ(expected_hash, copy.cached_hash.get());
+
+  copy.unlock_time += 1;
+  copy.invalidate_hashes();
+  ASSERT_NE(expected_hash, cryptonote::get_transaction_hash(copy));
+  ASSERT_FALSE(copy.cached_hash.valid());
+
+  cryptonote::transaction copy_of_copy;
+  copy_of_copy = copy;
+  copy_of_copy.set_null();
+  ASSERT_FALSE(copy_of_copy.cached_blob_size.valid());
+}
+
+TEST(get_pruned_tx_blob, v1_has_no_prunable_hash)
+{
+  cryptonote::transaction tx = AUTO_VAL_INIT(tx);
+  cryptonote::account_base acc;
+  acc.generate();
+  ASSERT_TRUE(cryptonote::construct_miner_tx(0, 0, 10000000000000, 1000, TEST_FEE, acc.get_keys().m_account_address, tx, cryptonote::blobdata(), 1, 1));
+  const cryptonote::blobdata blob = cryptonote::tx_to_blob(tx);
+
+  cryptonote::transaction parsed;
+  cryptonote::blobdata pruned_blob;
+  crypto::hash prunable_hash;
+  bool has_prunable_hash = true;
+  ASSERT_TRUE(cryptonote::get_pruned_tx_blob(blob, parsed, pruned_blob, prunable_hash, has_prunable_hash));
+  ASSERT_EQ(blob, pruned_blob);
+  ASSERT_FALSE(has_prunable_hash);
+  ASSERT_EQ(cryptonote::get_transaction_prefix_hash(tx), cryptonote::get_transaction_prefix_hash(parsed));
+}
+
+TEST(get_pruned_tx_blob, v2_without_signatures_has_null_prunable_hash)
+{
+  cryptonote::transaction tx = AUTO_VAL_INIT(tx);
+  cryptonote::account_base acc;
+  acc.generate();
+  ASSERT_TRUE(cryptonote::construct_miner_tx(0, 0, 10000000000000, 1000, TEST_FEE, acc.get_keys().m_account_address, tx, cryptonote::blobdata(), 1, 4));
+  ASSERT_EQ(2, tx.version);
+  const cryptonote::blobdata blob = cryptonote::tx_to_blob(tx);
+
+  cryptonote::transaction parsed;
+  cryptonote::blobdata pruned_blob;
+  crypto::hash prunable_hash;
+  bool has_prunable_hash = false;
+  ASSERT_TRUE(cryptonote::get_pruned_tx_blob(blob, parsed, pruned_blob, prunable_hash, has_prunable_hash));
+  ASSERT_EQ(blob, pruned_blob);
+  ASSERT_TRUE(has_prunable_hash);
+  ASSERT_EQ(cryptonote::null_hash, prunable_hash);
+}
+
+TEST(get_pruned_tx_blob, fails_on_truncated_blob)
+{
+  cryptonote::transaction tx = AUTO_VAL_INIT(tx);
+  cryptonote::account_base acc;
+  acc.generate();
+  ASSERT_TRUE(cryptonote::construct_miner_tx(0, 0, 10000000000000, 1000, TEST_FEE, acc.get_keys().m_account_address, tx, cryptonote::blobdata(), 1, 4));
+  const cryptonote::blobdata blob = cryptonote::tx_to_blob(tx);
+
+  cryptonote::transaction parsed;
+  cryptonote::blobdata pruned_blob;
+  crypto::hash prunable_hash;
+  bool has_prunable_hash;
+  ASSERT_FALSE(cryptonote::get_pruned_tx_blob(blob.substr(0, blob.size() - 1), parsed, pruned_blob, prunable_hash, has_prunable_hash));
+}
@@ -82,3 +82,119 @@ TEST(peer_list, merge_peer_lists)
 
 
 }
+
+TEST(peer_list, random_gray_peer)
+{
+  nodetool::peerlist_manager plm;
+  plm.init(false);
+  std::set<uint32_t> ips;
+  for (uint32_t i = 1; i <= 10; ++i)
+  {
+    nodetool::peerlist_entry ple;
+    ple.last_seen = 34345 + i;
+    ple.adr.ip = MAKE_IP(123,43,12,i);
+    ple.adr.port = 8080;
+    ple.id = i;
+    plm.append_with_peer_gray(ple);
+    ips.insert(ple.adr.ip);
+  }
+  ASSERT_EQ(10, plm.get_gray_peers_count());
+
+  std::set<uint32_t> seen;
+  for (size_t i = 0; i < plm.get_gray_peers_count(); ++i)
+  {
+    nodetool::peerlist_entry pe;
+    ASSERT_TRUE(plm.get_random_gray_peer(pe, i));
+    seen.insert(pe.adr.ip);
+  }
+  ASSERT_EQ(ips, seen);
+
+  nodetool::peerlist_entry pe;
+  ASSERT_FALSE(plm.get_random_gray_peer(pe, 10));
+
+  // promoting a peer to the white list removes it from random access too
+  nodetool::peerlist_entry white;
+  white.last_seen = 40000;
+  white.adr.ip = MAKE_IP(123,43,12,5);
+  white.adr.port = 8080;
+  white.id = 5;
+  plm.append_with_peer_white(white);
+  ASSERT_EQ(9, plm.get_gray_peers_count());
+  for (size_t i = 0; i < plm.get_gray_peers_count(); ++i)
+  {
+    ASSERT_TRUE(plm.get_random_gray_peer(pe, i));
+    ASSERT_NE(white.adr.ip, pe.adr.ip);
+  }
+}
+
+TEST(peer_list, fastest_white_peers)
+{
+  nodetool::peerlist_manager plm;
+  plm.init(false);
+  for (uint32_t i = 1; i <= 5; ++i)
+  {
+    nodetool::peerlist_entry ple;
+    ple.last_seen = 34345 + i;
+    ple.adr.ip = MAKE_IP(123,43,12,i);
+    ple.adr.port = 8080;
+    ple.id = i;
+    plm.append_with_peer_white(ple);
+  }
+
+  auto addr = [](uint32_t i) { nodetool::net_address na; na.ip = MAKE_IP(123,43,12,i); na.port = 8080; return na; };
+  plm.set_peer_rtt(addr(1), 300);
+  plm.set_peer_rtt(addr(2), 100);
+  plm.set_peer_rtt(addr(3), 200);
+  plm.set_peer_block_delay(addr(3), 0);
+  // not in the white list, never returned
+  plm.set_peer_rtt(addr(9), 1);
+
+  std::vector<nodetool::peerlist_entry> fast;
+  ASSERT_TRUE(plm.get_fastest_white_peers(fast, 10));
+  ASSERT_EQ(3, fast.size());
+  ASSERT_EQ(3, fast[0].id);
+  ASSERT_EQ(2, fast[1].id);
+  ASSERT_EQ(1, fast[2].id);
+
+  ASSERT_TRUE(plm.get_fastest_white_peers(fast, 1));
+  ASSERT_EQ(1, fast.size());
+  ASSERT_EQ(3, fast[0].id);
+
+  // later samples are smoothed into the average
+  plm.set_peer_rtt(addr(2), 500);
+  nodetool::peer_latency latency;
+  ASSERT_TRUE(plm.get_peer_latency(addr(2), latency));
+  ASSERT_EQ(2, latency.rtt_samples);
+  ASSERT_EQ((100 * (P2P_PEER_LATENCY_SMOOTHING - 1) + 500) / P2P_PEER_LATENCY_SMOOTHING, latency.rtt_ms);
+  ASSERT_FALSE(plm.get_peer_latency(addr(4), latency));
+}
+
+TEST(peer_list, peerlist_head_since)
+{
+  nodetool::peerlist_manager plm;
+  plm.init(false);
+  for (uint32_t i = 1; i <= 10; ++i)
+  {
+    nodetool::peerlist_entry ple;
+    ple.last_seen = i == 10 ? 0 : 1000 + i;
+    ple.adr.ip = MAKE_IP(123,43,12,i);
+    ple.adr.port = 8080;
+    ple.id = i;
+    plm.append_with_peer_white(ple);
+  }
+
+  std::list<nodetool::peerlist_entry> head;
+  ASSERT_TRUE(plm.get_peerlist_head(head));
+  ASSERT_EQ(9, head.size());
+  ASSERT_EQ(1009, head.front().last_seen);
+
+  head.clear();
+  ASSERT_TRUE(plm.get_peerlist_head(head, P2P_DEFAULT_PEERS_IN_HANDSHAKE, 1006));
+  ASSERT_EQ(3, head.size());
+  for (const auto& pe: head)
+    ASSERT_LT(1006, pe.last_seen);
+
+  head.clear();
+  ASSERT_TRUE(plm.get_peerlist_head(head, P2P_DEFAULT_PEERS_IN_HANDSHAKE, 1009));
+  ASSERT_TRUE(head.empty());
+}
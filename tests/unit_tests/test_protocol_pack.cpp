@@ -53,3 +53,110 @@ TEST(protocol_pack, protocol_pack_command)
     ASSERT_TRUE(r.total_height == 3);
   }
 }
+
+TEST(protocol_pack, protocol_pack_nested_objects)
+{
+  cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request r;
+  r.current_blockchain_height = 42;
+  for(size_t i = 0; i < 100; ++i)
+  {
+    r.txs.push_back(std::string(i, 't'));
+    cryptonote::block_complete_entry bce;
+    bce.block = std::string(i + 1, 'b');
+    bce.txs.resize(i % 7, std::string(i, 'x'));
+    r.blocks.push_back(bce);
+  }
+
+  std::string buff;
+  ASSERT_TRUE(epee::serialization::store_t_to_binary(r, buff));
+
+  cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request r2;
+  ASSERT_TRUE(epee::serialization::load_t_from_binary(r2, buff));
+  ASSERT_EQ(42, r2.current_blockchain_height);
+  ASSERT_EQ(r.txs, r2.txs);
+  ASSERT_EQ(r.blocks.size(), r2.blocks.size());
+  for(size_t i = 0; i < r.blocks.size(); ++i)
+  {
+    ASSERT_EQ(r.blocks[i].block, r2.blocks[i].block);
+    ASSERT_EQ(r.blocks[i].txs, r2.blocks[i].txs);
+  }
+
+  // a truncated payload must be rejected
+  std::string bogus = buff.substr(0, buff.size() / 2);
+  cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request r3;
+  ASSERT_FALSE(epee::serialization::load_t_from_binary(r3, bogus));
+}
+
+namespace
+{
+  cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request make_objects_request()
+  {
+    cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request r;
+    r.current_blockchain_height = 1000000;
+    r.missed_ids.resize(3, crypto::hash{});
+    for(size_t i = 0; i < 70; ++i)
+    {
+      cryptonote::block_complete_entry bce;
+      bce.block = std::string(i * 3, 'b');
+      bce.txs.resize(i, std::string(i, 'x'));
+      r.blocks.push_back(bce);
+    }
+    return r;
+  }
+}
+
+TEST(protocol_pack, stream_writer_matches_tree)
+{
+  cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request r = make_objects_request();
+
+  epee::serialization::portable_storage ps;
+  r.store(ps);
+  std::string tree_buff;
+  ASSERT_TRUE(ps.store_to_binary(tree_buff));
+
+  std::string stream_buff;
+  epee::serialization::portable_bin_writer writer;
+  r.store(writer);
+  ASSERT_TRUE(writer.store_to_binary(stream_buff));
+  ASSERT_EQ(tree_buff.size(), stream_buff.size());
+
+  // only the order of entries may differ, so re-storing through the tree must give the same bytes
+  epee::serialization::portable_storage ps2;
+  ASSERT_TRUE(ps2.load_from_binary(stream_buff));
+  std::string restored_buff;
+  ASSERT_TRUE(ps2.store_to_binary(restored_buff));
+  ASSERT_EQ(tree_buff, restored_buff);
+}
+
+TEST(protocol_pack, stream_reader_loads_tree_output)
+{
+  cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request r = make_objects_request();
+
+  epee::serialization::portable_storage ps;
+  r.store(ps);
+  std::string tree_buff;
+  ASSERT_TRUE(ps.store_to_binary(tree_buff));
+
+  cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request r2;
+  epee::serialization::portable_bin_reader reader;
+  ASSERT_TRUE(reader.load_from_binary(tree_buff));
+  ASSERT_TRUE(r2.load(reader));
+  ASSERT_EQ(r.current_blockchain_height, r2.current_blockchain_height);
+  ASSERT_EQ(r.missed_ids.size(), r2.missed_ids.size());
+  ASSERT_TRUE(r2.txs.empty());
+  ASSERT_EQ(r.blocks.size(), r2.blocks.size());
+  for(size_t i = 0; i < r.blocks.size(); ++i)
+  {
+    ASSERT_EQ(r.blocks[i].block, r2.blocks[i].block);
+    ASSERT_EQ(r.blocks[i].txs, r2.blocks[i].txs);
+  }
+
+  // the reader rejects anything the tree loader rejects
+  for(size_t len = 0; len < tree_buff.size(); len += 97)
+  {
+    epee::serialization::portable_storage ps_truncated;
+    epee::serialization::portable_bin_reader reader_truncated;
+    const std::string truncated = tree_buff.substr(0, len);
+    ASSERT_EQ(ps_truncated.load_from_binary(truncated), reader_truncated.load_from_binary(truncated));
+  }
+}
@@ -107,6 +107,50 @@ TEST(ThreadGroup, TwoThreads)
   }
 }
 
+TEST(ThreadGroup, Stats)
+{
+  tools::thread_group group(1);
+  EXPECT_EQ(0u, group.queue_depth());
+  EXPECT_EQ(0u, group.busy_time());
+
+  std::atomic<bool> started{false};
+  std::atomic<bool> completed{false};
+  tools::task_region(group, [&] (tools::task_region_handle& region) {
+    region.run([&] { started = true; while (!completed); });
+    while (!started);
+    region.run([&] {});
+    region.run([&] {});
+    EXPECT_EQ(2u, group.queue_depth());
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(5));
+    completed = true;
+  });
+  EXPECT_EQ(0u, group.queue_depth());
+
+  // time is accounted after the function returns, so allow the worker to catch up
+  for (unsigned i = 0; i < 100 && group.busy_time() < 5000; ++i)
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+  EXPECT_LE(5000u, group.busy_time());
+}
+
+TEST(ThreadGroup, Affinity)
+{
+  EXPECT_TRUE(tools::thread_group(0).set_affinity(0));
+
+  tools::thread_group group(2);
+#ifdef __linux__
+  EXPECT_TRUE(group.set_affinity(0));
+#else
+  group.set_affinity(0);
+#endif
+  // pinned threads still run work
+  std::atomic<unsigned> completed{0};
+  tools::task_region(group, [&] (tools::task_region_handle& region) {
+    region.run([&] { ++completed; });
+    region.run([&] { ++completed; });
+  });
+  EXPECT_EQ(2u, completed);
+}
+
 TEST(ThreadGroup, Nested) {
   struct fib {
     unsigned operator()(tools::thread_group& group, unsigned value) const {
@@ -146,6 +190,38 @@ TEST(ThreadGroup, Many)
   }
 }
 
+TEST(ThreadGroup, ManyThreads)
+{
+  tools::thread_group group(4);
+
+  for (unsigned i = 0; i < 3; ++i) {
+    std::atomic<unsigned> count{0};
+    tools::task_region(group, [&] (tools::task_region_handle& region) {
+      for (unsigned tasks = 0; tasks < 10000; ++tasks) {
+        region.run([&] { ++count; });
+      }
+    });
+    EXPECT_EQ(10000u, count);
+  }
+}
+
+TEST(ThreadGroup, Stealing)
+{
+  tools::thread_group group(2);
+
+  for (unsigned i = 0; i < 3; ++i) {
+    std::atomic<bool> completed{false};
+    tools::task_region(group, [&] (tools::task_region_handle& region) {
+      region.run([&] {
+        // goes on this thread's own queue, which it does not get back to
+        group.dispatch([&] { completed = true; });
+        while (!completed);
+      });
+    });
+    EXPECT_TRUE(completed);
+  }
+}
+
 TEST(ThreadGroup, ThrowInTaskRegion)
 {
   class test_exception final : std::exception {
@@ -0,0 +1,71 @@
+// Copyright (c) 2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 
+
+#include "gtest/gtest.h"
+
+#include "p2p/network_throttle.hpp"
+
+using epee::net_utils::traffic_shaper;
+
+TEST(traffic_shaper, unlimited_never_waits)
+{
+  traffic_shaper shaper;
+  for (int i = 0; i < 100; ++i)
+    ASSERT_EQ(0, shaper.reserve(epee::net_utils::traffic_class_sync, 1000000, 0));
+}
+
+TEST(traffic_shaper, relay_keeps_sending_when_sync_is_shaped)
+{
+  traffic_shaper shaper;
+  shaper.set_rate(100000);
+  const double now = traffic_shaper::get_time_seconds();
+
+  // sync drains the bucket down to its reserve, then has to wait
+  while (shaper.reserve(epee::net_utils::traffic_class_sync, 10000, now) == 0);
+  ASSERT_GT(shaper.get_delay(epee::net_utils::traffic_class_sync, now), 0);
+
+  // peer list traffic may use the reserve, relays may go beyond it
+  ASSERT_EQ(0, shaper.get_delay(epee::net_utils::traffic_class_peerlist, now));
+  ASSERT_EQ(0, shaper.reserve(epee::net_utils::traffic_class_relay, 50000, now));
+  ASSERT_EQ(0, shaper.reserve(epee::net_utils::traffic_class_relay, 50000, now));
+  ASSERT_GT(shaper.get_delay(epee::net_utils::traffic_class_peerlist, now), 0);
+}
+
+TEST(traffic_shaper, refill_follows_rate)
+{
+  traffic_shaper shaper;
+  shaper.set_rate(100000);
+  const double now = traffic_shaper::get_time_seconds();
+
+  shaper.consume(200000, now);
+  const double wait = shaper.get_delay(epee::net_utils::traffic_class_peerlist, now);
+  ASSERT_NEAR(1.0, wait, 0.1);
+  ASSERT_GT(shaper.get_delay(epee::net_utils::traffic_class_peerlist, now + wait / 2), 0);
+  ASSERT_EQ(0, shaper.get_delay(epee::net_utils::traffic_class_peerlist, now + wait + 0.01));
+}
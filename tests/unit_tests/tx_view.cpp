@@ -0,0 +1,117 @@
+// Copyright (c) 2014-2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "gtest/gtest.h"
+
+#include "cryptonote_core/tx_view.h"
+
+static cryptonote::txin_to_key make_input(uint64_t amount, const std::vector<uint64_t> &relative_offsets, char k_image)
+{
+  cryptonote::txin_to_key in;
+  in.amount = amount;
+  in.key_offsets = relative_offsets;
+  memset(&in.k_image, k_image, sizeof(in.k_image));
+  return in;
+}
+
+TEST(tx_view, inputs)
+{
+  cryptonote::transaction tx;
+  tx.vin.push_back(make_input(0, {5, 3, 10}, 1));
+  tx.vin.push_back(make_input(2000, {7}, 2));
+
+  const cryptonote::tx_view view(tx);
+  ASSERT_TRUE(view.all_inputs_to_key());
+  ASSERT_EQ(2, view.num_inputs());
+
+  const cryptonote::tx_view::input &in0 = view.in(0);
+  ASSERT_EQ(cryptonote::tx_view::input_to_key, in0.type);
+  ASSERT_EQ(0, in0.amount);
+  ASSERT_EQ(boost::get<cryptonote::txin_to_key>(tx.vin[0]).k_image, in0.k_image);
+  ASSERT_EQ(3, in0.key_offsets_count);
+  // offsets are absolute in the view
+  ASSERT_EQ(5, view.key_offsets(in0)[0]);
+  ASSERT_EQ(8, view.key_offsets(in0)[1]);
+  ASSERT_EQ(18, view.key_offsets(in0)[2]);
+
+  const cryptonote::tx_view::input &in1 = view.in(1);
+  ASSERT_EQ(2000, in1.amount);
+  ASSERT_EQ(1, in1.key_offsets_count);
+  ASSERT_EQ(7, view.key_offsets(in1)[0]);
+}
+
+TEST(tx_view, coinbase)
+{
+  cryptonote::transaction tx;
+  cryptonote::txin_gen gen;
+  gen.height = 1234;
+  tx.vin.push_back(gen);
+
+  const cryptonote::tx_view view(tx);
+  ASSERT_FALSE(view.all_inputs_to_key());
+  ASSERT_EQ(cryptonote::tx_view::input_gen, view.in(0).type);
+  ASSERT_EQ(1234, view.in(0).height);
+  ASSERT_EQ(0, view.in(0).key_offsets_count);
+}
+
+TEST(tx_view, outputs)
+{
+  cryptonote::transaction tx;
+  crypto::public_key key;
+  memset(&key, 9, sizeof(key));
+  cryptonote::tx_out out;
+  out.amount = 100;
+  out.target = cryptonote::txout_to_key(key);
+  tx.vout.push_back(out);
+  out.amount = 0;
+  out.target = cryptonote::txout_to_script();
+  tx.vout.push_back(out);
+
+  const cryptonote::tx_view view(tx);
+  ASSERT_EQ(2, view.num_outputs());
+  ASSERT_TRUE(view.out(0).to_key);
+  ASSERT_EQ(100, view.out(0).amount);
+  ASSERT_EQ(key, view.out(0).key);
+  ASSERT_FALSE(view.out(1).to_key);
+}
+
+TEST(tx_view, rebuild)
+{
+  cryptonote::transaction tx;
+  tx.vin.push_back(make_input(0, {1, 1}, 1));
+  cryptonote::tx_view view(tx);
+  ASSERT_EQ(2, view.in(0).key_offsets_count);
+
+  tx.vin.clear();
+  tx.vin.push_back(make_input(0, {4}, 3));
+  view.build(tx);
+  ASSERT_EQ(1, view.num_inputs());
+  ASSERT_EQ(0, view.in(0).key_offsets_start);
+  ASSERT_EQ(4, view.key_offsets(view.in(0))[0]);
+}
@@ -0,0 +1,145 @@
+// Copyright (c) 2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include <boost/archive/binary_oarchive.hpp>
+#include "wallet/wallet2.h"
+
+namespace
+{
+  crypto::hash make_hash(size_t height)
+  {
+    crypto::hash hash = cryptonote::null_hash;
+    memcpy(hash.data, &height, sizeof(height));
+    hash.data[31] = 1;
+    return hash;
+  }
+
+  void fill(tools::hashchain &chain, size_t from, size_t to)
+  {
+    for (size_t height = from; height < to; ++height)
+      chain.push_back(make_hash(height));
+  }
+}
+
+TEST(wallet_hashchain, trim_keeps_recent_and_checkpoints)
+{
+  tools::hashchain chain;
+  fill(chain, 0, 5 * WALLET_HASHCHAIN_CHECKPOINT_INTERVAL + 7);
+  chain.trim(WALLET_HASHCHAIN_KEEP);
+  ASSERT_EQ(5 * WALLET_HASHCHAIN_CHECKPOINT_INTERVAL + 7, chain.size());
+  ASSERT_EQ(chain.size() - WALLET_HASHCHAIN_KEEP, chain.offset());
+  ASSERT_EQ(make_hash(0), chain.genesis());
+
+  crypto::hash hash;
+  for (size_t height = 0; height < chain.size(); ++height)
+  {
+    const bool kept = height >= chain.offset() || height % WALLET_HASHCHAIN_CHECKPOINT_INTERVAL == 0;
+    ASSERT_EQ(kept, chain.get(height, hash));
+    if (kept)
+      ASSERT_EQ(make_hash(height), hash);
+  }
+  ASSERT_FALSE(chain.get(chain.size(), hash));
+}
+
+TEST(wallet_hashchain, crop_below_offset)
+{
+  tools::hashchain chain;
+  fill(chain, 0, 5 * WALLET_HASHCHAIN_CHECKPOINT_INTERVAL);
+  chain.trim(10);
+  const size_t height = 2 * WALLET_HASHCHAIN_CHECKPOINT_INTERVAL + 1;
+  chain.crop(height);
+  ASSERT_EQ(height, chain.size());
+  crypto::hash hash;
+  ASSERT_TRUE(chain.get(2 * WALLET_HASHCHAIN_CHECKPOINT_INTERVAL, hash));
+  ASSERT_FALSE(chain.get(3 * WALLET_HASHCHAIN_CHECKPOINT_INTERVAL, hash));
+
+  // trimming again carries on from the same checkpoints
+  fill(chain, height, 4 * WALLET_HASHCHAIN_CHECKPOINT_INTERVAL + 1);
+  chain.trim(0);
+  for (size_t n = 0; n <= 4; ++n)
+  {
+    ASSERT_TRUE(chain.get(n * WALLET_HASHCHAIN_CHECKPOINT_INTERVAL, hash));
+    ASSERT_EQ(make_hash(n * WALLET_HASHCHAIN_CHECKPOINT_INTERVAL), hash);
+  }
+}
+
+TEST(wallet_hashchain, fast_forward)
+{
+  std::vector<crypto::hash> checkpoints;
+  for (size_t n = 0; n <= 3; ++n)
+    checkpoints.push_back(make_hash(n * WALLET_HASHCHAIN_CHECKPOINT_INTERVAL));
+  tools::hashchain chain;
+  fill(chain, 0, 1);
+  chain.fast_forward(checkpoints);
+  ASSERT_EQ(3 * WALLET_HASHCHAIN_CHECKPOINT_INTERVAL + 1, chain.size());
+  ASSERT_EQ(3 * WALLET_HASHCHAIN_CHECKPOINT_INTERVAL, chain.offset());
+  ASSERT_EQ(make_hash(0), chain.genesis());
+  crypto::hash hash;
+  for (size_t n = 0; n <= 3; ++n)
+  {
+    ASSERT_TRUE(chain.get(n * WALLET_HASHCHAIN_CHECKPOINT_INTERVAL, hash));
+    ASSERT_EQ(make_hash(n * WALLET_HASHCHAIN_CHECKPOINT_INTERVAL), hash);
+  }
+  ASSERT_FALSE(chain.get(WALLET_HASHCHAIN_CHECKPOINT_INTERVAL + 1, hash));
+
+  // blocks carry on from the last checkpoint, and a reorg below it crops as if trimmed
+  fill(chain, chain.size(), chain.size() + 5);
+  ASSERT_TRUE(chain.get(3 * WALLET_HASHCHAIN_CHECKPOINT_INTERVAL + 5, hash));
+  ASSERT_EQ(make_hash(3 * WALLET_HASHCHAIN_CHECKPOINT_INTERVAL + 5), hash);
+  chain.crop(WALLET_HASHCHAIN_CHECKPOINT_INTERVAL + 1);
+  ASSERT_EQ(WALLET_HASHCHAIN_CHECKPOINT_INTERVAL + 1, chain.size());
+  ASSERT_TRUE(chain.get(WALLET_HASHCHAIN_CHECKPOINT_INTERVAL, hash));
+}
+
+TEST(wallet_hashchain, serialization)
+{
+  tools::hashchain chain;
+  fill(chain, 0, 3 * WALLET_HASHCHAIN_CHECKPOINT_INTERVAL);
+  chain.trim(WALLET_HASHCHAIN_KEEP / 2);
+
+  std::stringstream ss;
+  {
+    boost::archive::binary_oarchive oa(ss);
+    oa << chain;
+  }
+  tools::hashchain loaded;
+  boost::archive::binary_iarchive ia(ss);
+  ia >> loaded;
+
+  ASSERT_EQ(chain.size(), loaded.size());
+  ASSERT_EQ(chain.offset(), loaded.offset());
+  crypto::hash hash0, hash1;
+  for (size_t height = 0; height < chain.size(); ++height)
+  {
+    ASSERT_EQ(chain.get(height, hash0), loaded.get(height, hash1));
+    if (chain.get(height, hash0))
+      ASSERT_EQ(hash0, hash1);
+  }
+}
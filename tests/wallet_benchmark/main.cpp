@@ -0,0 +1,340 @@
+// Copyright (c) 2014-2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Times wallet2 against a recorded chain. --record fetches getblocks.bin
+// responses from a daemon into --blocks-file; without it, the recording is
+// served by a mock daemon in this process, and a wallet rescans it a few
+// times, then makes transactions to itself, which are never sent, for each
+// ring size, destination count and share of its unlocked balance asked for.
+// Reported are the blocks and outputs scanned per second and the time to
+// make a transaction by its inputs, outputs and ring size.
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <tuple>
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+
+#include "include_base_utils.h"
+using namespace epee;
+
+#include "common/command_line.h"
+#include "cryptonote_core/cryptonote_format_utils.h"
+#include "net/http_client.h"
+#include "profile_tools.h"
+#include "storages/http_abstract_invoke.h"
+#include "wallet/wallet2.h"
+
+#include "mock_daemon.h"
+
+namespace po = boost::program_options;
+
+namespace
+{
+  const command_line::arg_descriptor<std::string> arg_blocks_file       = {"blocks-file", "Recording of getblocks.bin responses, from the genesis block on", "", true};
+  const command_line::arg_descriptor<std::string> arg_record            = {"record", "Record the chain of the daemon at this address to --blocks-file, and exit", ""};
+  const command_line::arg_descriptor<uint64_t>    arg_stop_height       = {"stop-height", "Stop recording at this height, 0 for the daemon's top", 0};
+  const command_line::arg_descriptor<bool>        arg_testnet           = {"testnet", "The recording is of a testnet chain", false};
+  const command_line::arg_descriptor<std::string> arg_wallet_file       = {"wallet-file", "Wallet to scan with and spend from", ""};
+  const command_line::arg_descriptor<std::string> arg_password          = {"password", "Password of --wallet-file", ""};
+  const command_line::arg_descriptor<std::string> arg_spend_key         = {"spend-key", "Restore a temporary wallet from this secret spend key instead, as blockchain_generate writes them", ""};
+  const command_line::arg_descriptor<uint32_t>    arg_port              = {"port", "Port the mock daemon listens on", 48280};
+  const command_line::arg_descriptor<uint32_t>    arg_scan_threads      = {"scan-threads", "Threads the wallet scans with, 0 for its default", 0};
+  const command_line::arg_descriptor<size_t>      arg_refresh_runs      = {"refresh-runs", "Number of times to rescan the chain", 3};
+  const command_line::arg_descriptor<std::string> arg_ring_sizes        = {"ring-sizes", "Ring sizes to make transactions with", "5,11"};
+  const command_line::arg_descriptor<std::string> arg_destinations      = {"destinations", "Destination counts to make transactions with", "1,2,4"};
+  const command_line::arg_descriptor<std::string> arg_balance_fractions = {"balance-fractions", "Shares of the unlocked balance to send, which set how many inputs are needed", "0.01,0.1,0.5"};
+  const command_line::arg_descriptor<size_t>      arg_transfer_runs     = {"transfer-runs", "Transactions made for each case", 5};
+  const command_line::arg_descriptor<int>         arg_log_level         = {"log-level", "", LOG_LEVEL_0};
+
+  template<typename T>
+  bool parse_list(const std::string& s, std::vector<T>& values)
+  {
+    std::istringstream in(s);
+    std::string item;
+    while (std::getline(in, item, ','))
+    {
+      std::istringstream item_in(item);
+      T value;
+      if (!(item_in >> value))
+        return false;
+      values.push_back(value);
+    }
+    return !values.empty();
+  }
+
+  int record(const std::string& daemon_address, const std::string& path, uint64_t stop_height, bool testnet)
+  {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out)
+    {
+      std::cout << "Failed to open " << path << std::endl;
+      return 1;
+    }
+
+    cryptonote::block genesis;
+    if (testnet)
+      cryptonote::generate_genesis_block(genesis, config::testnet::GENESIS_TX, config::testnet::GENESIS_NONCE);
+    else
+      cryptonote::generate_genesis_block(genesis, config::GENESIS_TX, config::GENESIS_NONCE);
+
+    net_utils::http::http_simple_client client;
+    uint64_t start_height = 0;
+    while (true)
+    {
+      cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::request req = AUTO_VAL_INIT(req);
+      cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::response res = AUTO_VAL_INIT(res);
+      // start_height 0 has the daemon look for the wallet's blocks, of
+      // which the genesis block is the only one it has to have
+      req.block_ids.push_back(cryptonote::get_block_hash(genesis));
+      req.start_height = start_height;
+      if (stop_height)
+        req.max_count = stop_height - start_height;
+      bool r = net_utils::invoke_http_bin_remote_command2(daemon_address + "/getblocks.bin", req, res, client, WALLET_RCP_CONNECTION_TIMEOUT);
+      if (!r || res.status != CORE_RPC_STATUS_OK)
+      {
+        std::cout << "Failed to get blocks from " << start_height << " from " << daemon_address << std::endl;
+        return 1;
+      }
+      if (res.blocks.empty())
+        break;
+      if (!wallet_benchmark::append_blocks_response(out, res))
+      {
+        std::cout << "Failed to write to " << path << std::endl;
+        return 1;
+      }
+      start_height = res.start_height + res.blocks.size();
+      std::cout << "Recorded " << start_height << "/" << res.current_height << " blocks" << std::endl;
+      if (start_height >= res.current_height || (stop_height && start_height >= stop_height))
+        break;
+    }
+    return 0;
+  }
+
+  void print_latencies(const std::map<std::tuple<size_t, size_t, size_t>, std::vector<uint64_t>>& latencies)
+  {
+    std::cout << std::endl << "ring  inputs  outputs  txs     mean ms      min ms      max ms" << std::endl;
+    for (const auto& i: latencies)
+    {
+      const std::vector<uint64_t>& ns = i.second;
+      uint64_t total = 0;
+      for (uint64_t t: ns)
+        total += t;
+      std::cout << std::setw(4) << std::get<0>(i.first)
+        << std::setw(8) << std::get<1>(i.first)
+        << std::setw(9) << std::get<2>(i.first)
+        << std::setw(5) << ns.size()
+        << std::fixed << std::setprecision(2)
+        << std::setw(12) << total / 1e6 / ns.size()
+        << std::setw(12) << *std::min_element(ns.begin(), ns.end()) / 1e6
+        << std::setw(12) << *std::max_element(ns.begin(), ns.end()) / 1e6 << std::endl;
+    }
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  TRY_ENTRY();
+
+  po::options_description desc("Allowed options");
+  command_line::add_arg(desc, command_line::arg_help);
+  command_line::add_arg(desc, arg_blocks_file);
+  command_line::add_arg(desc, arg_record);
+  command_line::add_arg(desc, arg_stop_height);
+  command_line::add_arg(desc, arg_testnet);
+  command_line::add_arg(desc, arg_wallet_file);
+  command_line::add_arg(desc, arg_password);
+  command_line::add_arg(desc, arg_spend_key);
+  command_line::add_arg(desc, arg_port);
+  command_line::add_arg(desc, arg_scan_threads);
+  command_line::add_arg(desc, arg_refresh_runs);
+  command_line::add_arg(desc, arg_ring_sizes);
+  command_line::add_arg(desc, arg_destinations);
+  command_line::add_arg(desc, arg_balance_fractions);
+  command_line::add_arg(desc, arg_transfer_runs);
+  command_line::add_arg(desc, arg_log_level);
+
+  po::variables_map vm;
+  bool r = command_line::handle_error_helper(desc, [&]()
+  {
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+    return true;
+  });
+  if (!r)
+    return 1;
+  if (command_line::get_arg(vm, command_line::arg_help))
+  {
+    std::cout << desc << std::endl;
+    return 0;
+  }
+
+  log_space::get_set_log_detalisation_level(true, command_line::get_arg(vm, arg_log_level));
+  log_space::log_singletone::add_logger(LOGGER_CONSOLE, NULL, NULL);
+
+  const std::string blocks_file = command_line::get_arg(vm, arg_blocks_file);
+  const bool testnet = command_line::get_arg(vm, arg_testnet);
+  if (!command_line::get_arg(vm, arg_record).empty())
+    return record(command_line::get_arg(vm, arg_record), blocks_file, command_line::get_arg(vm, arg_stop_height), testnet);
+
+  std::vector<size_t> ring_sizes, destinations;
+  std::vector<double> fractions;
+  if (!parse_list(command_line::get_arg(vm, arg_ring_sizes), ring_sizes) ||
+      !parse_list(command_line::get_arg(vm, arg_destinations), destinations) ||
+      !parse_list(command_line::get_arg(vm, arg_balance_fractions), fractions))
+  {
+    std::cout << "Ring sizes, destinations and balance fractions are comma separated lists" << std::endl;
+    return 1;
+  }
+
+  wallet_benchmark::mock_daemon daemon;
+  std::cout << "Loading " << blocks_file << std::endl;
+  if (!daemon.load(blocks_file))
+    return 1;
+  std::cout << "Loaded " << daemon.height() << " blocks, " << daemon.outputs_since(0) << " outputs" << std::endl;
+  const std::string port = std::to_string(command_line::get_arg(vm, arg_port));
+  if (!daemon.init(port, "127.0.0.1"))
+    return 1;
+  daemon.run(2, false);
+
+  const boost::filesystem::path work_dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("monero-wallet-benchmark-%%%%-%%%%");
+  int ret = 0;
+  try
+  {
+    tools::wallet2 wallet(testnet);
+    const std::string wallet_file = command_line::get_arg(vm, arg_wallet_file);
+    const std::string spend_key = command_line::get_arg(vm, arg_spend_key);
+    if (!wallet_file.empty())
+    {
+      wallet.load(wallet_file, command_line::get_arg(vm, arg_password));
+    }
+    else
+    {
+      boost::filesystem::create_directories(work_dir);
+      const std::string path = (work_dir / "wallet").string();
+      if (spend_key.empty())
+      {
+        wallet.generate(path, "");
+      }
+      else
+      {
+        crypto::secret_key key;
+        if (!string_tools::hex_to_pod(spend_key, key))
+          throw std::runtime_error("Failed to parse the spend key");
+        wallet.generate(path, "", key, true);
+      }
+    }
+    wallet.init("http://127.0.0.1:" + port);
+    wallet.set_refresh_from_block_height(0);
+    if (command_line::get_arg(vm, arg_scan_threads))
+      wallet.scan_threads(command_line::get_arg(vm, arg_scan_threads));
+
+    // the genesis block is the wallet's to start with
+    const uint64_t blocks = daemon.height() - 1;
+    const uint64_t outputs = daemon.outputs_since(1);
+    for (size_t run = 0; run < command_line::get_arg(vm, arg_refresh_runs); ++run)
+    {
+      wallet.rescan_blockchain(false);
+      TIME_MEASURE_NS_START(refresh_time);
+      wallet.refresh();
+      TIME_MEASURE_NS_FINISH(refresh_time);
+      const double seconds = refresh_time / 1e9;
+      std::cout << "Refresh " << run + 1 << ": " << std::fixed << std::setprecision(2) << seconds << " s, "
+        << blocks / seconds << " blocks/s, " << outputs / seconds << " outputs/s" << std::endl;
+    }
+
+    const uint64_t unlocked = wallet.unlocked_balance();
+    std::cout << "Unlocked balance " << cryptonote::print_money(unlocked) << std::endl;
+    if (unlocked == 0)
+    {
+      std::cout << "Nothing to spend, no transactions made" << std::endl;
+    }
+    else
+    {
+      // a call making several transactions counts as one, with their inputs
+      // and outputs added up
+      std::map<std::tuple<size_t, size_t, size_t>, std::vector<uint64_t>> latencies;
+      const cryptonote::account_public_address& address = wallet.get_account().get_keys().m_account_address;
+      for (size_t ring_size: ring_sizes)
+      {
+        for (size_t n_destinations: destinations)
+        {
+          for (double fraction: fractions)
+          {
+            const uint64_t amount = unlocked * fraction / std::max<size_t>(n_destinations, 1);
+            if (amount == 0 || ring_size == 0)
+              continue;
+            std::vector<cryptonote::tx_destination_entry> dsts(n_destinations, cryptonote::tx_destination_entry(amount, address));
+            for (size_t run = 0; run < command_line::get_arg(vm, arg_transfer_runs); ++run)
+            {
+              std::vector<tools::wallet2::pending_tx> ptx;
+              TIME_MEASURE_NS_START(transfer_time);
+              try
+              {
+                ptx = wallet.create_transactions_2(dsts, ring_size - 1, 0, 0, std::vector<uint8_t>(), true);
+              }
+              catch (const std::exception& e)
+              {
+                std::cout << "Ring size " << ring_size << ", " << n_destinations << " destinations of "
+                  << cryptonote::print_money(amount) << ": " << e.what() << std::endl;
+                break;
+              }
+              TIME_MEASURE_NS_FINISH(transfer_time);
+              size_t inputs = 0, outs = 0;
+              for (const tools::wallet2::pending_tx& tx: ptx)
+              {
+                inputs += tx.selected_transfers.size();
+                outs += tx.tx.vout.size();
+              }
+              latencies[std::make_tuple(ring_size, inputs, outs)].push_back(transfer_time);
+            }
+          }
+        }
+      }
+      print_latencies(latencies);
+    }
+  }
+  catch (const std::exception& e)
+  {
+    std::cout << "Error: " << e.what() << std::endl;
+    ret = 1;
+  }
+
+  daemon.send_stop_signal();
+  daemon.deinit();
+  boost::system::error_code ec;
+  boost::filesystem::remove_all(work_dir, ec);
+  return ret;
+
+  CATCH_ENTRY_L0("main", 1);
+}
@@ -0,0 +1,309 @@
+// Copyright (c) 2014-2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include <ctime>
+#include <fstream>
+#include <limits>
+
+#include "include_base_utils.h"
+using namespace epee;
+
+#include "common/int-util.h"
+#include "cryptonote_core/cryptonote_format_utils.h"
+#include "ringct/rctOps.h"
+#include "storages/portable_storage_template_helper.h"
+
+#include "mock_daemon.h"
+
+using namespace cryptonote;
+
+namespace
+{
+  // a made up key for output index of amount, which says whether it is the
+  // output key or the commitment mask
+  rct::key made_up_key(uint64_t amount, uint64_t index, uint64_t which)
+  {
+    const uint64_t data[3] = {SWAP64LE(amount), SWAP64LE(index), SWAP64LE(which)};
+    rct::key scalar;
+    rct::hash_to_scalar(scalar, data, sizeof(data));
+    return rct::scalarmultBase(scalar);
+  }
+}
+
+namespace wallet_benchmark
+{
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool append_blocks_response(std::ostream& out, const COMMAND_RPC_GET_BLOCKS_FAST::response& res)
+  {
+    std::string blob;
+    if (!epee::serialization::store_t_to_binary(res, blob))
+      return false;
+    const uint64_t size = SWAP64LE((uint64_t)blob.size());
+    out.write((const char*)&size, sizeof(size));
+    out.write(blob.data(), blob.size());
+    return out.good();
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  mock_daemon::mock_daemon():
+    m_time_shift(0)
+  {
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool mock_daemon::load(const std::string& path)
+  {
+    std::ifstream in(path, std::ios::binary);
+    CHECK_AND_ASSERT_MES(in, false, "Failed to open " << path);
+
+    uint64_t size;
+    while (in.read((char*)&size, sizeof(size)))
+    {
+      size = SWAP64LE(size);
+      std::string blob(size, '\0');
+      CHECK_AND_ASSERT_MES(in.read(&blob[0], size), false, "Truncated record in " << path);
+      COMMAND_RPC_GET_BLOCKS_FAST::response res = AUTO_VAL_INIT(res);
+      CHECK_AND_ASSERT_MES(epee::serialization::load_t_from_binary(res, blob), false, "Failed to parse a record in " << path);
+      CHECK_AND_ASSERT_MES(res.blocks.size() == res.output_indices.size(), false, "Mismatched blocks and output indices in " << path);
+      CHECK_AND_ASSERT_MES(res.start_height <= m_blocks.size(), false,
+          "Recording skips from height " << m_blocks.size() << " to " << res.start_height);
+
+      // consecutive responses overlap by the blocks the wallet already had
+      for (size_t n = m_blocks.size() - res.start_height; n < res.blocks.size(); ++n)
+      {
+        if (!add_block(res.blocks[n], res.output_indices[n]))
+          return false;
+      }
+    }
+    CHECK_AND_ASSERT_MES(!m_blocks.empty(), false, "No blocks in " << path);
+
+    const uint64_t now = time(NULL);
+    m_time_shift = now > m_timestamps.back() ? now - m_timestamps.back() : 0;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool mock_daemon::add_block(const block_complete_entry& entry, const COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices& indices)
+  {
+    const uint64_t height = m_blocks.size();
+    block b;
+    CHECK_AND_ASSERT_MES(parse_and_validate_block_from_blob(entry.block, b), false, "Failed to parse block at height " << height);
+    CHECK_AND_ASSERT_MES(indices.indices.size() == entry.txs.size() + 1, false, "Wrong output indices for block at height " << height);
+
+    std::vector<transaction> txs(entry.txs.size() + 1);
+    txs[0] = b.miner_tx;
+    for (size_t n = 0; n < entry.txs.size(); ++n)
+      CHECK_AND_ASSERT_MES(parse_and_validate_tx_from_blob(entry.txs[n], txs[n + 1]), false, "Failed to parse a transaction at height " << height);
+
+    uint64_t outputs = 0;
+    for (size_t n = 0; n < txs.size(); ++n)
+    {
+      const transaction& tx = txs[n];
+      CHECK_AND_ASSERT_MES(indices.indices[n].indices.size() == tx.vout.size(), false, "Wrong output indices for a transaction at height " << height);
+      for (size_t o = 0; o < tx.vout.size(); ++o)
+      {
+        std::vector<output>& outs = m_outputs[tx.version >= 2 ? 0 : tx.vout[o].amount];
+        const uint64_t index = indices.indices[n].indices[o];
+        if (outs.size() <= index)
+          outs.resize(index + 1, output{height, std::numeric_limits<uint64_t>::max()});
+        outs[index] = output{height, tx.unlock_time};
+      }
+      outputs += tx.vout.size();
+    }
+
+    m_heights[get_block_hash(b)] = height;
+    m_timestamps.push_back(b.timestamp);
+    m_major_versions.push_back(b.major_version);
+    m_cumulative_outputs.push_back((m_cumulative_outputs.empty() ? 0 : m_cumulative_outputs.back()) + outputs);
+    m_blocks.push_back(entry);
+    m_indices.push_back(indices);
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  uint64_t mock_daemon::outputs_since(uint64_t start_height) const
+  {
+    if (start_height >= m_cumulative_outputs.size())
+      return 0;
+    return m_cumulative_outputs.back() - (start_height ? m_cumulative_outputs[start_height - 1] : 0);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool mock_daemon::is_unlocked(const output& out) const
+  {
+    if (out.height + CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE > height())
+      return false;
+    if (out.unlock_time < CRYPTONOTE_MAX_BLOCK_NUMBER)
+      return out.unlock_time <= height() - 1 + CRYPTONOTE_LOCKED_TX_ALLOWED_DELTA_BLOCKS;
+    return out.unlock_time <= m_timestamps.back() + CRYPTONOTE_LOCKED_TX_ALLOWED_DELTA_SECONDS_V2;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  uint64_t mock_daemon::recent_height(uint64_t recent_cutoff) const
+  {
+    const uint64_t cutoff = recent_cutoff > m_time_shift ? recent_cutoff - m_time_shift : 0;
+    uint64_t h = m_timestamps.size();
+    while (h > 0 && m_timestamps[h - 1] >= cutoff)
+      --h;
+    return h;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool mock_daemon::on_get_height(const COMMAND_RPC_GET_HEIGHT::request& req, COMMAND_RPC_GET_HEIGHT::response& res)
+  {
+    res.height = height();
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool mock_daemon::on_get_blocks(const COMMAND_RPC_GET_BLOCKS_FAST::request& req, COMMAND_RPC_GET_BLOCKS_FAST::response& res)
+  {
+    uint64_t start_height = req.start_height;
+    if (start_height == 0)
+    {
+      // like the daemon, from the wallet's newest block we both have
+      std::list<crypto::hash>::const_iterator i = req.block_ids.begin();
+      for (; i != req.block_ids.end(); ++i)
+      {
+        std::unordered_map<crypto::hash, uint64_t>::const_iterator h = m_heights.find(*i);
+        if (h != m_heights.end())
+        {
+          start_height = h->second;
+          break;
+        }
+      }
+      if (i == req.block_ids.end())
+      {
+        res.status = "Failed";
+        return false;
+      }
+    }
+
+    const uint64_t count = req.max_count ? std::min<uint64_t>(req.max_count, COMMAND_RPC_GET_BLOCKS_FAST_MAX_COUNT) : COMMAND_RPC_GET_BLOCKS_FAST_MAX_COUNT;
+    for (uint64_t h = start_height; h < height() && h < start_height + count; ++h)
+    {
+      res.blocks.push_back(m_blocks[h]);
+      res.output_indices.push_back(m_indices[h]);
+    }
+    res.start_height = start_height;
+    res.current_height = height();
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool mock_daemon::on_get_outs_bin(const COMMAND_RPC_GET_OUTPUTS_BIN::request& req, COMMAND_RPC_GET_OUTPUTS_BIN::response& res)
+  {
+    res.outs.reserve(req.outputs.size());
+    for (const get_outputs_out& out: req.outputs)
+    {
+      std::map<uint64_t, std::vector<output>>::const_iterator i = m_outputs.find(out.amount);
+      if (i == m_outputs.end() || out.index >= i->second.size())
+      {
+        res.status = "Failed to get outputs";
+        res.outs.clear();
+        return true;
+      }
+      COMMAND_RPC_GET_OUTPUTS_BIN::outkey key;
+      key.key = rct::rct2pk(made_up_key(out.amount, out.index, 0));
+      key.mask = out.amount ? rct::zeroCommit(out.amount) : made_up_key(out.amount, out.index, 1);
+      key.unlocked = is_unlocked(i->second[out.index]);
+      res.outs.push_back(key);
+    }
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool mock_daemon::on_get_version(const COMMAND_RPC_GET_VERSION::request& req, COMMAND_RPC_GET_VERSION::response& res, epee::json_rpc::error& er)
+  {
+    res.version = CORE_RPC_VERSION;
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool mock_daemon::on_hard_fork_info(const COMMAND_RPC_HARD_FORK_INFO::request& req, COMMAND_RPC_HARD_FORK_INFO::response& res, epee::json_rpc::error& er)
+  {
+    // a version the recording never reached is far off, but not so far the
+    // wallet's early_blocks margin wraps around
+    res.earliest_height = std::numeric_limits<uint64_t>::max() / 2;
+    for (uint64_t h = 0; h < m_major_versions.size(); ++h)
+    {
+      if (m_major_versions[h] >= req.version)
+      {
+        res.earliest_height = h;
+        break;
+      }
+    }
+    res.version = m_major_versions.back();
+    res.enabled = req.version <= res.version;
+    res.window = 0;
+    res.votes = 0;
+    res.threshold = 0;
+    res.voting = res.version;
+    res.state = 0;
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool mock_daemon::on_get_output_histogram(const COMMAND_RPC_GET_OUTPUT_HISTOGRAM::request& req, COMMAND_RPC_GET_OUTPUT_HISTOGRAM::response& res, epee::json_rpc::error& er)
+  {
+    const uint64_t unlocked_height = height() >= CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE ? height() - CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE + 1 : 0;
+    const uint64_t recent = recent_height(req.recent_cutoff);
+    const auto add = [&](uint64_t amount, const std::vector<output>& outs)
+    {
+      const uint64_t total = outs.size();
+      if (total < req.min_count || (req.max_count && total > req.max_count))
+        return;
+      // outputs of each amount are in height order
+      const auto below = [&outs](uint64_t h) -> uint64_t {
+        return std::lower_bound(outs.begin(), outs.end(), h, [](const output& o, uint64_t v) { return o.height < v; }) - outs.begin();
+      };
+      const uint64_t unlocked = req.unlocked ? below(unlocked_height) : total;
+      const uint64_t older = std::min(unlocked, below(recent));
+      res.histogram.push_back(COMMAND_RPC_GET_OUTPUT_HISTOGRAM::entry(amount, total, unlocked, unlocked - older));
+    };
+
+    if (req.amounts.empty())
+    {
+      for (const auto& i: m_outputs)
+        add(i.first, i.second);
+    }
+    else
+    {
+      for (uint64_t amount: req.amounts)
+      {
+        std::map<uint64_t, std::vector<output>>::const_iterator i = m_outputs.find(amount);
+        if (i != m_outputs.end())
+          add(amount, i->second);
+      }
+    }
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool mock_daemon::on_get_fee_estimate(const COMMAND_RPC_GET_PER_KB_FEE_ESTIMATE::request& req, COMMAND_RPC_GET_PER_KB_FEE_ESTIMATE::response& res, epee::json_rpc::error& er)
+  {
+    // the fee does not change how long a transaction takes to make
+    res.fee = FEE_PER_KB;
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+}
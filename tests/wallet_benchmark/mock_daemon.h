@@ -0,0 +1,123 @@
+// Copyright (c) 2014-2016, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <map>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "net/http_server_impl_base.h"
+#include "rpc/core_rpc_server_commands_defs.h"
+
+namespace wallet_benchmark
+{
+  /*!
+   * \brief appends a getblocks.bin response to a recording
+   *
+   * A recording is a sequence of little endian 64 bit sizes, each followed
+   * by that many bytes of a COMMAND_RPC_GET_BLOCKS_FAST response in the
+   * epee binary format, as the daemon sent it.
+   */
+  bool append_blocks_response(std::ostream& out, const cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::response& res);
+
+  /*!
+   * \brief serves a wallet from a recording, in place of a daemon
+   *
+   * getblocks.bin is answered from the recorded blocks, which must start at
+   * the genesis block. get_outs.bin answers with keys made up from the
+   * amount and index, so decoys look like outputs but were never on chain;
+   * the wallet only needs their keys to sign, and takes its real outputs
+   * from its own transfers. Which outputs exist, and when they unlock, comes
+   * from the recording. The pool endpoints are left out, the wallet carries
+   * on without them.
+   */
+  class mock_daemon: public epee::http_server_impl_base<mock_daemon>
+  {
+  public:
+    typedef epee::net_utils::connection_context_base connection_context;
+
+    mock_daemon();
+
+    bool load(const std::string& path);
+
+    uint64_t height() const { return m_blocks.size(); }
+    //! outputs in the blocks from start_height up to the top
+    uint64_t outputs_since(uint64_t start_height) const;
+
+    CHAIN_HTTP_TO_MAP2(connection_context);
+
+    BEGIN_URI_MAP2()
+      MAP_URI_AUTO_JON2("/getheight", on_get_height, cryptonote::COMMAND_RPC_GET_HEIGHT)
+      MAP_URI_AUTO_BIN2("/getblocks.bin", on_get_blocks, cryptonote::COMMAND_RPC_GET_BLOCKS_FAST)
+      MAP_URI_AUTO_BIN2("/get_outs.bin", on_get_outs_bin, cryptonote::COMMAND_RPC_GET_OUTPUTS_BIN)
+      BEGIN_JSON_RPC_MAP("/json_rpc")
+        MAP_JON_RPC_WE("get_version",          on_get_version,          cryptonote::COMMAND_RPC_GET_VERSION)
+        MAP_JON_RPC_WE("hard_fork_info",       on_hard_fork_info,       cryptonote::COMMAND_RPC_HARD_FORK_INFO)
+        MAP_JON_RPC_WE("get_output_histogram", on_get_output_histogram, cryptonote::COMMAND_RPC_GET_OUTPUT_HISTOGRAM)
+        MAP_JON_RPC_WE("get_fee_estimate",     on_get_fee_estimate,     cryptonote::COMMAND_RPC_GET_PER_KB_FEE_ESTIMATE)
+      END_JSON_RPC_MAP()
+    END_URI_MAP2()
+
+  private:
+    bool on_get_height(const cryptonote::COMMAND_RPC_GET_HEIGHT::request& req, cryptonote::COMMAND_RPC_GET_HEIGHT::response& res);
+    bool on_get_blocks(const cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::request& req, cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::response& res);
+    bool on_get_outs_bin(const cryptonote::COMMAND_RPC_GET_OUTPUTS_BIN::request& req, cryptonote::COMMAND_RPC_GET_OUTPUTS_BIN::response& res);
+
+    bool on_get_version(const cryptonote::COMMAND_RPC_GET_VERSION::request& req, cryptonote::COMMAND_RPC_GET_VERSION::response& res, epee::json_rpc::error& er);
+    bool on_hard_fork_info(const cryptonote::COMMAND_RPC_HARD_FORK_INFO::request& req, cryptonote::COMMAND_RPC_HARD_FORK_INFO::response& res, epee::json_rpc::error& er);
+    bool on_get_output_histogram(const cryptonote::COMMAND_RPC_GET_OUTPUT_HISTOGRAM::request& req, cryptonote::COMMAND_RPC_GET_OUTPUT_HISTOGRAM::response& res, epee::json_rpc::error& er);
+    bool on_get_fee_estimate(const cryptonote::COMMAND_RPC_GET_PER_KB_FEE_ESTIMATE::request& req, cryptonote::COMMAND_RPC_GET_PER_KB_FEE_ESTIMATE::response& res, epee::json_rpc::error& er);
+
+    bool add_block(const cryptonote::block_complete_entry& entry, const cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices& indices);
+    struct output
+    {
+      uint64_t height;
+      uint64_t unlock_time;
+    };
+
+    bool is_unlocked(const output& out) const;
+    //! the first height whose block is no older than the shifted cutoff
+    uint64_t recent_height(uint64_t recent_cutoff) const;
+
+    std::vector<cryptonote::block_complete_entry> m_blocks;
+    std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> m_indices;
+    std::unordered_map<crypto::hash, uint64_t> m_heights;
+    std::vector<uint64_t> m_timestamps;
+    std::vector<uint8_t> m_major_versions;
+    //! outputs of each block and those before it
+    std::vector<uint64_t> m_cumulative_outputs;
+    //! by amount, in global index order, 0 for rct outputs
+    std::map<uint64_t, std::vector<output>> m_outputs;
+    //! how far the recording is behind the clock, the wallet's time based
+    //! cutoffs are moved back by it
+    uint64_t m_time_shift;
+  };
+}